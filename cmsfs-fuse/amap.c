@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -23,225 +24,213 @@
 #include "helper.h"
 
 /*
- * Hint where to look for the next free block (level 0 only).
- * Updated if a free block is found. If the level 0 amap bitmap
- * block is exhausted we still scan all amap blocks.
+ * In-memory copy of the allocation map. Level 0 has one bit per disk
+ * block which is set if the block is used. A bit on a higher level is
+ * set if the corresponding word on the level below is completely used,
+ * so a free block is found by walking down from the single top word.
+ * Bits after the disk end are set.
  */
-struct amap_alloction_hint {
-	/* addr of amap bitmap block to check */
-	off_t amap_addr;
-	/* disk addr of the last allocated or freed block */
-	off_t addr;
-	/* offset to start of the amap data block */
-	off_t offset;
+#define AMAP_WORD_BITS		64
+#define AMAP_MAX_LEVELS		8
+
+struct amap_cache {
+	/* disk addresses of the allocation map bitmap blocks */
+	off_t		*blocks;
+	int		nr_blocks;
+	/* bitmap words per level */
+	uint64_t	*map[AMAP_MAX_LEVELS];
+	int		levels;
+	/* number of disk blocks */
+	unsigned long	nr_bits;
 };
 
-static struct amap_alloction_hint amap_hint;
+static struct amap_cache amap_cache;
 
-static void update_amap_hint(off_t amap_addr, off_t addr)
+static inline uint64_t amap_word_bit(unsigned long nr)
 {
-	amap_hint.amap_addr = amap_addr;
-	amap_hint.addr = addr;
+	return 1ULL << (nr % AMAP_WORD_BITS);
 }
 
 /*
- * Get L1 block number from address.
+ * Propagate the level 0 state of disk block nr to the higher levels.
  */
-static int amap_blocknumber(off_t addr)
+static void amap_cache_update(unsigned long nr)
 {
-	return addr / BYTES_PER_BLOCK;
+	unsigned long word;
+	int level;
+
+	for (level = 0; level < amap_cache.levels - 1; level++) {
+		word = nr / AMAP_WORD_BITS;
+		if (amap_cache.map[level][word] == ~0ULL)
+			amap_cache.map[level + 1][word / AMAP_WORD_BITS] |=
+				amap_word_bit(word);
+		else
+			amap_cache.map[level + 1][word / AMAP_WORD_BITS] &=
+				~amap_word_bit(word);
+		nr = word;
+	}
 }
 
 /*
- * Get the block number for a specific level.
+ * Return the number of the first free disk block or -1 if the disk is full.
  */
-static int amap_blocknumber_level(int level, off_t addr)
+static long amap_cache_find_free(void)
 {
-	int entry = amap_blocknumber(addr);
-
-	while (level-- > 1)
-		entry /= PTRS_PER_BLOCK;
-	return entry;
+	unsigned long nr = 0;
+	uint64_t word;
+	int level;
+
+	for (level = amap_cache.levels - 1; level >= 0; level--) {
+		word = amap_cache.map[level][nr];
+		if (word == ~0ULL)
+			return -1;
+		nr = nr * AMAP_WORD_BITS + __builtin_ctzll(~word);
+	}
+	return nr;
 }
 
 /*
- * Return address of to the allocation map for a block number > 0.
+ * Return the disk address of the allocation map byte for disk block nr.
  */
-static off_t get_amap_addr(int level, off_t addr, off_t ptr)
+static off_t amap_byte_addr(unsigned long nr)
 {
-	int block = amap_blocknumber_level(level, addr) % PTRS_PER_BLOCK;
+	unsigned long bits_per_block = 8UL * cmsfs.blksize;
 
-	if (cmsfs.amap_levels == 0)
-		return cmsfs.amap;
-
-	if (level--) {
-		ptr = get_fixed_pointer(ptr + (off_t) block * PTR_SIZE);
-		if (!ptr)
-			DIE("amap invalid ptr at addr: %llx\n",
-				(unsigned long long) ptr +
-				(off_t) block * PTR_SIZE);
-		return get_amap_addr(level, addr, ptr);
-	}
-	return ptr;
+	return amap_cache.blocks[nr / bits_per_block] +
+		(nr % bits_per_block) / 8;
 }
 
 /*
- * Mark disk address as allocated in alloc map.
+ * Mark disk block nr as allocated or free in the alloc map.
  */
-static void amap_block_set(off_t amap, int bit)
+static void amap_block_mark(unsigned long nr, int used)
 {
-	u8 entry;
+	off_t amap = amap_byte_addr(nr);
+	u8 entry, mask = 1 << (7 - nr % 8);
+	uint64_t *word;
 	int rc;
 
+	BUG(nr >= amap_cache.nr_bits);
+	word = &amap_cache.map[0][nr / AMAP_WORD_BITS];
+	/* must not be allocated or freed twice */
+	BUG(!(*word & amap_word_bit(nr)) == !used);
+
 	rc = _read(&entry, sizeof(entry), amap);
 	BUG(rc < 0);
-
-	/* already used */
-	BUG(entry & (1 << (7 - bit)));
-
-	entry |= (1 << (7 - bit));
+	if (used)
+		entry |= mask;
+	else
+		entry &= ~mask;
 	rc = _write(&entry, sizeof(entry), amap);
 	BUG(rc < 0);
-}
-
-/*
- * Mark disk address as free in alloc map. Unaligned addr is tolerated.
- */
-static void amap_block_clear(off_t addr)
-{
-	off_t amap = get_amap_addr(cmsfs.amap_levels, addr, cmsfs.amap);
-	int rc, block = amap_blocknumber(addr);
-	off_t disk_addr = addr;
-	unsigned int byte, bit;
-	u8 entry;
-
-	if (block > 0)
-		addr -= (off_t) block * BYTES_PER_BLOCK;
-
-	addr >>= BITS_PER_DATA_BLOCK;
-	byte = addr / 8;
-	bit = addr % 8;
-
-	rc = _read(&entry, sizeof(entry), amap + byte);
-	BUG(rc < 0);
-
-	/* already cleared */
-	BUG(!(entry & (1 << (7 - bit))));
-
-	entry &= ~(1 << (7 - bit));
-	rc = _write(&entry, sizeof(entry), amap + byte);
-	BUG(rc < 0);
 
-	/*
-	 * If the freed addr is lower set the hint to it to ensure
-	 * the amap bitmap is packed from the start. That way we do not
-	 * need an extra check if the bitmap entry is above disk end, the
-	 * check if we overflow the total block limit is sufficient.
-	 */
-	if (disk_addr < amap_hint.addr)
-		update_amap_hint(amap + byte, disk_addr);
+	if (used)
+		*word |= amap_word_bit(nr);
+	else
+		*word &= ~amap_word_bit(nr);
+	amap_cache_update(nr);
 }
 
 /*
- * Return the first free bit in one byte.
+ * Collect the addresses of all bitmap blocks in disk order.
  */
-static inline int find_first_empty_bit(u8 entry)
+static void amap_collect_blocks(int level, off_t amap, int needed)
 {
-	u8 i;
+	off_t ptr;
+	int i;
+
+	if (!level) {
+		amap_cache.blocks[amap_cache.nr_blocks++] = amap;
+		return;
+	}
 
-	for (i = 0; i < 8; i++)
-		if (!(entry & 1 << (7 - i)))
-			return i;
-	/* unreachable */
-	return -1;
+	for (i = 0; i < PTRS_PER_BLOCK; i++) {
+		if (amap_cache.nr_blocks == needed)
+			return;
+		ptr = get_fixed_pointer(amap + (off_t) i * PTR_SIZE);
+		if (ptr < 0)
+			DIE("amap invalid ptr at addr: %llx\n",
+			    (unsigned long long) amap + (off_t) i * PTR_SIZE);
+		if (!ptr)
+			return;
+		amap_collect_blocks(level - 1, ptr, needed);
+	}
 }
 
 /*
- * Return the number of bytes addressed by one pointer entry for the
- * specified level.
+ * Read the allocation map into memory.
  */
-static off_t bytes_per_level(int level)
-{
-	off_t mult = BYTES_PER_BLOCK;
-
-	if (!level)
-		return 0;
-	level--;
-	while (level--)
-		mult *= PTRS_PER_BLOCK;
-	return mult;
-}
-
-static inline int get_amap_entry_bit(off_t amap)
-{
-	u8 entry;
-	int rc;
-
-	rc = _read(&entry, sizeof(entry), amap);
-	BUG(rc < 0);
-
-	if (entry == 0xff)
-		return -1;
-	return find_first_empty_bit(entry);
-}
-
-static off_t __get_free_block_fast(void)
+void amap_cache_init(void)
 {
-	off_t addr, amap = amap_hint.amap_addr & ~DATA_BLOCK_MASK;
-	int bit, i = amap_hint.amap_addr & DATA_BLOCK_MASK;
-
-	for (; i < cmsfs.blksize; i++) {
-		bit = get_amap_entry_bit(amap + i);
-		if (bit == -1)
-			continue;
-
-		/* Calculate the addr for the free block we've found. */
-		addr = (off_t) amap_blocknumber(amap_hint.addr) * BYTES_PER_BLOCK;
-		addr += i * 8 * cmsfs.blksize;
-		addr += bit * cmsfs.blksize;
-
-		amap_block_set(amap + i, bit);
-		update_amap_hint(amap + i, addr);
-		return addr;
+	unsigned long bits_per_block = 8UL * cmsfs.blksize, nr, words;
+	int needed, level, i, rc;
+	u8 *buf;
+
+	amap_cache.nr_bits = cmsfs.total_blocks;
+	needed = (amap_cache.nr_bits + bits_per_block - 1) / bits_per_block;
+	amap_cache.blocks = calloc(needed, sizeof(off_t));
+	buf = malloc(cmsfs.blksize);
+	if (amap_cache.blocks == NULL || buf == NULL)
+		DIE_PERROR("malloc failed\n");
+	amap_collect_blocks(cmsfs.amap_levels, cmsfs.amap, needed);
+
+	/* allocate all levels up to a single top word */
+	nr = amap_cache.nr_bits;
+	do {
+		BUG(amap_cache.levels == AMAP_MAX_LEVELS);
+		words = (nr + AMAP_WORD_BITS - 1) / AMAP_WORD_BITS;
+		amap_cache.map[amap_cache.levels] = calloc(words,
+							   sizeof(uint64_t));
+		if (amap_cache.map[amap_cache.levels] == NULL)
+			DIE_PERROR("malloc failed\n");
+		/* mark bits after the end as used */
+		if (nr % AMAP_WORD_BITS)
+			amap_cache.map[amap_cache.levels][words - 1] =
+				~0ULL << (nr % AMAP_WORD_BITS);
+		amap_cache.levels++;
+		nr = words;
+	} while (words > 1);
+
+	/* blocks not covered by the allocation map cannot be used */
+	for (nr = amap_cache.nr_blocks * bits_per_block;
+	     nr < amap_cache.nr_bits; nr++)
+		amap_cache.map[0][nr / AMAP_WORD_BITS] |= amap_word_bit(nr);
+
+	for (i = 0; i < amap_cache.nr_blocks; i++) {
+		rc = _read(buf, cmsfs.blksize, amap_cache.blocks[i]);
+		BUG(rc < 0);
+		for (nr = i * bits_per_block;
+		     nr < (i + 1) * bits_per_block && nr < amap_cache.nr_bits;
+		     nr++)
+			if (buf[(nr % bits_per_block) / 8] & (1 << (7 - nr % 8)))
+				amap_cache.map[0][nr / AMAP_WORD_BITS] |=
+					amap_word_bit(nr);
+	}
+	free(buf);
+
+	/* calculate the higher levels */
+	nr = amap_cache.nr_bits;
+	for (level = 0; level < amap_cache.levels - 1; level++) {
+		words = (nr + AMAP_WORD_BITS - 1) / AMAP_WORD_BITS;
+		for (nr = 0; nr < words; nr++)
+			if (amap_cache.map[level][nr] == ~0ULL)
+				amap_cache.map[level + 1][nr / AMAP_WORD_BITS] |=
+					amap_word_bit(nr);
+		nr = words;
 	}
-	return 0;
 }
 
 /*
- * Look for the first unallocated block and return addr of allocated block.
+ * Release the in-memory allocation map.
  */
-static off_t __get_free_block(int level, off_t amap, off_t addr)
+void amap_cache_free(void)
 {
-	off_t ptr;
-	int bit, i;
-
-	if (level > 0) {
-		for (i = 0; i < PTRS_PER_BLOCK; i++) {
-			ptr = get_fixed_pointer(amap);
-			if (!ptr)
-				return 0;
-			ptr = __get_free_block(level - 1, ptr,
-				addr + i * bytes_per_level(level));
-			if (ptr)
-				return ptr;
-			amap += PTR_SIZE;
-		}
-		return 0;
-	}
+	int level;
 
-	for (i = 0; i < cmsfs.blksize; i++) {
-		bit = get_amap_entry_bit(amap + i);
-		if (bit == -1)
-			continue;
-		amap_block_set(amap + i, bit);
-		/* add byte offset */
-		addr += i * 8 * cmsfs.blksize;
-		/* add bit offset */
-		addr += bit * cmsfs.blksize;
-		update_amap_hint(amap + i, addr);
-		return addr;
-	}
-	return 0;
+	for (level = 0; level < amap_cache.levels; level++)
+		free(amap_cache.map[level]);
+	free(amap_cache.blocks);
+	memset(&amap_cache, 0, sizeof(amap_cache));
 }
 
 /*
@@ -249,18 +238,16 @@ static off_t __get_free_block(int level, off_t amap, off_t addr)
  */
 off_t get_free_block(void)
 {
-	off_t addr = 0;
+	long nr;
 
 	if (cmsfs.used_blocks + cmsfs.reserved_blocks >= cmsfs.total_blocks)
 		return -ENOSPC;
-	if (amap_hint.amap_addr)
-		addr = __get_free_block_fast();
-	if (!addr)
-		addr = __get_free_block(cmsfs.amap_levels, cmsfs.amap, 0);
-	BUG(!addr);
+	nr = amap_cache_find_free();
+	BUG(nr <= 0);
+	amap_block_mark(nr, 1);
 
 	cmsfs.used_blocks++;
-	return addr;
+	return (off_t) nr * cmsfs.blksize;
 }
 
 /*
@@ -286,7 +273,8 @@ off_t get_zero_block(void)
 void free_block(off_t addr)
 {
 	if (addr) {
-		amap_block_clear(addr);
+		/* unaligned addr is tolerated */
+		amap_block_mark(addr >> BITS_PER_DATA_BLOCK, 0);
 		cmsfs.used_blocks--;
 	}
 }
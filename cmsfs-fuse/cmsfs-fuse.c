@@ -23,7 +23,7 @@
 #include <linux/xattr.h>
 #endif
 #include <math.h>
-#include <search.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -125,6 +125,9 @@ static char CODEPAGE_LINUX[] = "ISO-8859-1";
 
 #define WCACHE_MAX		(MAX_RECORD_LEN + 1)
 
+/* data blocks announced ahead of sequential reads */
+#define READAHEAD_BLOCKS	32
+
 struct block {
 	off_t		disk_addr;
 	unsigned int	disp;
@@ -165,8 +168,7 @@ struct record {
 struct file;
 
 struct file_operations {
-	int (*cache_data) (struct file *f, off_t addr, int level, int *block,
-			    unsigned int *disp, int *record, off_t *total);
+	int (*cache_data) (struct file *f);
 	int (*write_data) (struct file *f, const char *buf, int len, size_t size,
 			   int rlen);
 	int (*delete_pointers) (struct file *f, int level, off_t addr);
@@ -208,10 +210,22 @@ struct file {
 	int		linefeed;
 	/* list of records */
 	struct		record *rlist;
+	/* number of data blocks scanned into rlist and blist */
+	int		cached_blocks;
+	/* last scanned record, may still be incomplete */
+	int		cached_record;
+	/* logical file offset after the last scanned record */
+	off_t		cached_total;
+	/* rlist and blist contain the whole file */
+	int		cache_complete;
 	/* record scan state machine flag */
 	int		record_scan_state;
 	/* next record for sequential reads */
 	int		next_record_hint;
+	/* file offset after the last read */
+	off_t		read_end;
+	/* first data block not yet announced for read-ahead */
+	int		readahead_block;
 	/* counter for null bytes to detect block start */
 	int		null_ctr;
 	/* list of disk blocks */
@@ -242,6 +256,8 @@ struct file {
 	int		wcache_commited;
 	/* dirty flag for file meta data */
 	int		ptr_dirty;
+	/* pointers and FST of appended data are not yet written */
+	int		meta_dirty;
 	/* fops pointers */
 	struct file_operations *fops;
 	/* pointers per block constant */
@@ -254,6 +270,8 @@ struct file {
 	int		write_count;
 	/* unlink flag */
 	int		unlinked;
+	/* serializes reads which extend rlist and move the read hint */
+	pthread_mutex_t	read_lock;
 };
 
 struct xattr {
@@ -273,15 +291,13 @@ static struct xattr xattr_mode = { .name = "user.file_mode", .size = 2 };
 #define SHOW_UNLINKED		0
 #define HIDE_UNLINKED		1
 
-#define WALK_FLAG_LOOKUP	0x1
 #define WALK_FLAG_READDIR	0x2
 #define WALK_FLAG_LOCATE_EMPTY	0x4
 #define WALK_FLAG_CACHE_DBLOCKS	0x8
+#define WALK_FLAG_INDEX		0x10
 
 struct walk_file {
 	int		flag;
-	char		*name;
-	char		*type;
 	void		*buf;
 	off_t		addr;
 	fuse_fill_dir_t	filler;
@@ -294,6 +310,7 @@ struct walk_file {
  */
 static struct file *create_file_object(struct fst_entry *fst, int *rc);
 static void destroy_file_object(struct file *f);
+static int commit_file(struct file *f);
 
 static unsigned long dec_to_hex(unsigned long long num)
 {
@@ -311,12 +328,41 @@ static unsigned int hex_to_dec(unsigned int num)
 	return res & 0xffffffff;
 }
 
-static void setup_iconv(iconv_t *conv, const char *from, const char *to)
+/*
+ * Build a conversion table by converting every single byte with iconv.
+ * Characters without a single byte representation in the target code
+ * page cannot be converted.
+ */
+static void setup_conv_table(struct conv_table *table, const char *from,
+			     const char *to)
 {
-	*conv = iconv_open(to, from);
-	if (*conv == ((iconv_t) -1))
+	size_t in_count, out_count;
+	char in, out[8], *in_buf, *out_buf;
+	iconv_t conv;
+	int i;
+
+	conv = iconv_open(to, from);
+	if (conv == ((iconv_t) -1))
 		DIE("Could not initialize conversion table %s->%s.\n",
 			from, to);
+
+	table->complete = 1;
+	for (i = 0; i < 256; i++) {
+		in = i;
+		in_buf = &in;
+		in_count = 1;
+		out_buf = out;
+		out_count = sizeof(out);
+		iconv(conv, NULL, NULL, NULL, NULL);
+		if (iconv(conv, &in_buf, &in_count, &out_buf, &out_count) ==
+		    (size_t) -1 || out_buf - out != 1) {
+			table->complete = 0;
+			continue;
+		}
+		table->map[i] = out[0];
+		table->valid[i] = 1;
+	}
+	iconv_close(conv);
 }
 
 static inline struct file *get_fobj(struct fuse_file_info *fi)
@@ -1215,38 +1261,38 @@ static int cache_fixed_data_block(struct file *f, off_t addr, int *block,
 }
 
 /*
- * Walk all pointer blocks of a fixed file and call function for every
- * data block respecting the sequence of the data.
+ * Return the number of data blocks addressed by one pointer on the
+ * highest pointer block level.
  */
-static int cache_file_fixed(struct file *f, off_t addr, int level, int *block,
-			    unsigned int *disp, int *record, off_t *total)
+static int pointer_span(struct file *f)
 {
-	int left = f->ptr_per_block;
-	off_t ptr;
+	int level, span = 1;
 
-	if (level > 0) {
-		level--;
-		while (left--) {
-			ptr = get_fixed_pointer(addr);
-			if (ptr < 0)
-				return ptr;
-			/*
-			 * In difference to variable record format a null pointer
-			 * may be valid for a null block so we cannot determine
-			 * the file end from a pointer entry. Check for the number
-			 * of scanned blocks instead.
-			 */
-			if (*block >= f->fst->nr_blocks
-			    || *record >= f->fst->nr_records)
-				return 0;
-			cache_file_fixed(f, ptr, level, block, disp, record, total);
-			/* don't increment for null block pointers */
-			if (addr)
-				addr += PTR_SIZE;
-		}
-		return 0;
+	for (level = 1; level < f->fst->levels; level++)
+		span *= f->ptr_per_block;
+	return span;
+}
+
+/*
+ * Scan the next data block of a fixed file. The pointer to the data block
+ * is found by walking down the pointer blocks, a null pointer block
+ * contains only null blocks.
+ */
+static int cache_file_fixed(struct file *f)
+{
+	int span = pointer_span(f), block = f->cached_blocks, level;
+	off_t addr = ABS(f->fst->fop);
+
+	for (level = f->fst->levels; level > 0; level--) {
+		if (addr)
+			addr += (block / span % f->ptr_per_block) * PTR_SIZE;
+		addr = get_fixed_pointer(addr);
+		if (addr < 0)
+			return addr;
+		span /= f->ptr_per_block;
 	}
-	return cache_fixed_data_block(f, addr, block, record, total, 0);
+	return cache_fixed_data_block(f, addr, &f->cached_blocks,
+				      &f->cached_record, &f->cached_total, 0);
 }
 
 static int cache_variable_data_block(struct file *f, off_t addr, int *block,
@@ -1275,32 +1321,31 @@ static int cache_variable_data_block(struct file *f, off_t addr, int *block,
 }
 
 /*
- * Walk all pointer blocks of a variable file and call function for every
- * data block respecting the sequence of the data.
+ * Scan the next data block of a variable file. The displacement of the
+ * data block is taken from its pointer on the lowest pointer block level.
  */
-static int cache_file_variable(struct file *f, off_t addr, int level,
-				int *block, unsigned int *disp,
-				int *record, off_t *total)
+static int cache_file_variable(struct file *f)
 {
-	int nr, left = f->ptr_per_block;
-	off_t ptr;
+	int span = pointer_span(f), block = f->cached_blocks, level, nr;
+	off_t addr = ABS(f->fst->fop);
+	unsigned int disp = 0;
 
-	if (level > 0) {
-		level--;
+	for (level = f->fst->levels; level > 0; level--) {
 		/* 4 or 8 bytes are left at the end (offset) which we ignore */
-		while (left--) {
-			ptr = get_var_pointer(addr, &nr, disp);
-			if (ptr < 0)
-				return ptr;
-			if (ptr == VAR_FILE_END)
-				return 0;
-			cache_file_variable(f, ptr, level, block,
-					    disp, record, total);
-			addr += VPTR_SIZE;
-		}
-		return 0;
+		addr += (block / span % f->ptr_per_block) * VPTR_SIZE;
+		addr = get_var_pointer(addr, &nr, &disp);
+		if (addr < 0)
+			return addr;
+		if (addr == VAR_FILE_END)
+			return 0;
+		/* only data blocks may be null blocks */
+		if (addr == NULL_BLOCK && level > 1)
+			return -EIO;
+		span /= f->ptr_per_block;
 	}
-	return cache_variable_data_block(f, addr, block, record, *disp, total, 0);
+	return cache_variable_data_block(f, addr, &f->cached_blocks,
+					 &f->cached_record, disp,
+					 &f->cached_total, 0);
 }
 
 static int locate_last_data_vptr(off_t addr, int level,
@@ -1365,97 +1410,115 @@ static int linefeed_mode_enabled(struct fst_entry *fst)
 }
 
 /*
- * Workaround glibc 2.9 bug with less than 3 files and give room for some
- * new files. If cache is full it will be purged and rebuild.
+ * The file index maps every file name in the directory to the address of
+ * its FST entry. It is built when the disk is mounted and kept up to date
+ * when files are created, renamed and deleted, so looking up a file never
+ * needs to walk the directory.
  */
-static int max_cache_entries(void)
+static unsigned int file_index_hash(const char *name)
 {
-	return cmsfs.files + 10 + cmsfs.files / 4;
+	unsigned int hash = 5381;
+
+	while (*name)
+		hash = hash * 33 + (unsigned char) *name++;
+	return hash & (cmsfs.findex_size - 1);
 }
 
-static void resize_htab(void)
+static struct findex_entry *file_index_find(const char *name)
 {
-	int i;
+	struct findex_entry *fie;
 
-	for (i = 0; i < cmsfs.fcache_used; i++)
-		free(cmsfs.fcache[i].str);
-	hdestroy_r(&cmsfs.htab);
-	free(cmsfs.fcache);
-	cmsfs.fcache_used = 0;
-	cmsfs.fcache_max = max_cache_entries();
-
-	cmsfs.fcache = calloc(cmsfs.fcache_max, sizeof(struct fcache_entry));
-	if (!hcreate_r(cmsfs.fcache_max, &cmsfs.htab))
-		DIE("hcreate failed\n");
+	for (fie = cmsfs.findex[file_index_hash(name)]; fie; fie = fie->next)
+		if (strcmp(fie->name, name) == 0)
+			return fie;
+	return NULL;
 }
 
-static void cache_fst_addr(off_t addr, const char *file)
+/*
+ * Double the number of hash buckets if there are more files than buckets.
+ */
+static void file_index_grow(void)
 {
-	struct fcache_entry *fce;
-	ENTRY e, *eptr;
-
-	e.key = strdup(file);
+	struct findex_entry **old = cmsfs.findex, *fie, *next;
+	unsigned int old_size = cmsfs.findex_size, i, hash;
 
-again:
-	if (hsearch_r(e, FIND, &eptr, &cmsfs.htab) == 0) {
-		/* cache it */
-		if (cmsfs.fcache_used == cmsfs.fcache_max - 1) {
-			DEBUG("hsearch: hash table full: %d\n", cmsfs.fcache_used);
-			resize_htab();
-			goto again;
+	if (cmsfs.findex_used < cmsfs.findex_size)
+		return;
+	cmsfs.findex_size *= 2;
+	cmsfs.findex = calloc(cmsfs.findex_size, sizeof(*cmsfs.findex));
+	if (cmsfs.findex == NULL)
+		DIE_PERROR("calloc failed");
+	for (i = 0; i < old_size; i++) {
+		for (fie = old[i]; fie; fie = next) {
+			next = fie->next;
+			hash = file_index_hash(fie->name);
+			fie->next = cmsfs.findex[hash];
+			cmsfs.findex[hash] = fie;
 		}
-
-		fce = &cmsfs.fcache[cmsfs.fcache_used];
-		cmsfs.fcache_used++;
-		fce->fst_addr = addr;
-		fce->str = e.key;
-
-		e.data = fce;
-		if (hsearch_r(e, ENTER, &eptr, &cmsfs.htab) == 0)
-			DIE("hsearch: hash table full\n");
-	} else
-		free(e.key);
+	}
+	free(old);
 }
 
-static void update_htab_entry(off_t addr, const char *file)
+static void file_index_add(off_t addr, const char *name)
 {
-	struct fcache_entry *fce;
-	ENTRY e, *eptr;
+	struct findex_entry *fie;
+	unsigned int hash;
 
-	e.key = strdup(file);
-
-	if (hsearch_r(e, FIND, &eptr, &cmsfs.htab) == 0) {
-		/* not yet cached, nothing to do */
-		free(e.key);
+	fie = file_index_find(name);
+	if (fie) {
+		fie->fst_addr = addr;
 		return;
-	} else {
-		/* update it */
-		fce = eptr->data;
-		fce->fst_addr = addr;
-		e.data = fce;
-		if (hsearch_r(e, ENTER, &eptr, &cmsfs.htab) == 0)
-			DIE("%s: hash table full\n", __func__);
 	}
+	file_index_grow();
+	fie = malloc(sizeof(*fie));
+	if (fie == NULL)
+		DIE_PERROR("malloc failed");
+	util_strlcpy(fie->name, name, sizeof(fie->name));
+	fie->fst_addr = addr;
+	hash = file_index_hash(name);
+	fie->next = cmsfs.findex[hash];
+	cmsfs.findex[hash] = fie;
+	cmsfs.findex_used++;
 }
 
-static void invalidate_htab_entry(const char *name)
+static void file_index_update(off_t addr, const char *name)
 {
-	struct fcache_entry *fce;
-	ENTRY e, *eptr;
+	struct findex_entry *fie = file_index_find(name);
 
-	e.key = strdup(name);
+	BUG(fie == NULL);
+	fie->fst_addr = addr;
+}
 
-	if (hsearch_r(e, FIND, &eptr, &cmsfs.htab) == 0) {
-		/* nothing to do if not cached */
-		free(e.key);
-		return;
+static void file_index_remove(const char *name)
+{
+	struct findex_entry **pfie, *fie;
+
+	for (pfie = &cmsfs.findex[file_index_hash(name)]; *pfie;
+	     pfie = &(*pfie)->next) {
+		fie = *pfie;
+		if (strcmp(fie->name, name) == 0) {
+			*pfie = fie->next;
+			free(fie);
+			cmsfs.findex_used--;
+			return;
+		}
 	}
+}
+
+static void file_index_free(void)
+{
+	struct findex_entry *fie, *next;
+	unsigned int i;
 
-	fce = eptr->data;
-	fce->fst_addr = 0;
-	e.data = fce;
-	if (hsearch_r(e, ENTER, &eptr, &cmsfs.htab) == 0)
-		DIE("hsearch: hash table full\n");
+	for (i = 0; i < cmsfs.findex_size; i++) {
+		for (fie = cmsfs.findex[i]; fie; fie = next) {
+			next = fie->next;
+			free(fie);
+		}
+	}
+	free(cmsfs.findex);
+	cmsfs.findex = NULL;
+	cmsfs.findex_used = 0;
 }
 
 /*
@@ -1502,22 +1565,17 @@ static void walk_dir_block(struct fst_entry *fst, struct walk_file *walk,
 		/* directory and allocmap type are skipped */
 
 		if (ret == READDIR_FILE_ENTRY) {
-			if (walk->flag == WALK_FLAG_LOOKUP) {
-				if ((memcmp(fst->name, walk->name, 8) == 0) &&
-				    (memcmp(fst->type, walk->type, 8) == 0)) {
-					/* got it */
-					*hit = walk->addr;
-					return;
-				}
-			}
-
 			if (walk->flag == WALK_FLAG_READDIR) {
 				memset(file, 0, sizeof(file));
 				decode_edf_name(file, fst->name, fst->type);
-				if (!file_unlinked(file)) {
-					cache_fst_addr(walk->addr, file);
+				if (!file_unlinked(file))
 					walk->filler(walk->buf, file, NULL, 0);
-				}
+			}
+
+			if (walk->flag == WALK_FLAG_INDEX) {
+				memset(file, 0, sizeof(file));
+				decode_edf_name(file, fst->name, fst->type);
+				file_index_add(walk->addr, file);
 			}
 		}
 
@@ -1560,12 +1618,8 @@ static int check_fst_valid(struct fst_entry *fst)
  */
 static off_t lookup_file(const char *name, struct fst_entry *fst, int flag)
 {
-	struct fcache_entry *fce;
+	struct findex_entry *fie;
 	char uc_name[MAX_FNAME];
-	char fname[8], ftype[8];
-	struct walk_file walk;
-	ENTRY e, *eptr;
-	off_t faddr = 0;
 	int rc;
 
 	util_strlcpy(uc_name, name, MAX_FNAME);
@@ -1574,52 +1628,102 @@ static off_t lookup_file(const char *name, struct fst_entry *fst, int flag)
 	if (flag == HIDE_UNLINKED && file_unlinked(uc_name))
 		return 0;
 
-	e.key = strdup(uc_name);
+	fie = file_index_find(uc_name);
+	if (!fie)
+		return 0;
 
-	/* already cached ? */
-	if (hsearch_r(e, FIND, &eptr, &cmsfs.htab)) {
-		fce = eptr->data;
+	/* read in the fst entry */
+	rc = _read(fst, sizeof(*fst), fie->fst_addr);
+	BUG(rc < 0);
 
-		/* check if fst is valid, may be zero for a stale entry */
-		if (!fce->fst_addr)
-			goto renew;
+	if (!check_fst_valid(fst))
+		DIE("Invalid file format in file: %s\n", uc_name);
+	return fie->fst_addr;
+}
 
-		/* read in the fst entry */
-		rc = _read(fst, sizeof(*fst), fce->fst_addr);
-		BUG(rc < 0);
+/*
+ * Add all files in the directory to the file index.
+ */
+static void build_file_index(void)
+{
+	struct fst_entry fst;
+	struct walk_file walk;
+
+	cmsfs.findex_size = 64;
+	while (cmsfs.findex_size < (unsigned int) cmsfs.files)
+		cmsfs.findex_size *= 2;
+	cmsfs.findex = calloc(cmsfs.findex_size, sizeof(*cmsfs.findex));
+	if (cmsfs.findex == NULL)
+		DIE_PERROR("calloc failed");
 
-		if (!check_fst_valid(fst))
-			DIE("Invalid file format in file: %s\n", uc_name);
+	memset(&walk, 0, sizeof(walk));
+	walk.flag = WALK_FLAG_INDEX;
+	walk_directory(&fst, &walk, NULL);
+}
+
+/*
+ * The record and block lists are built on demand while the file is read,
+ * so opening a file and reading its beginning does not require to scan
+ * all of its data blocks.
+ */
+static int cache_next_block(struct file *f)
+{
+	int block = f->cached_blocks, rc;
 
-		free(e.key);
-		return fce->fst_addr;
+	if (block < f->fst->nr_blocks) {
+		rc = f->fops->cache_data(f);
+		if (rc < 0)
+			return rc;
 	}
+	/* nothing left to scan */
+	if (f->cached_blocks == block)
+		f->cache_complete = 1;
+	return 0;
+}
 
-renew:
-	free(e.key);
-	if (encode_edf_name(uc_name, fname, ftype))
-		return 0;
-	memset(&walk, 0, sizeof(walk));
-	walk.flag = WALK_FLAG_LOOKUP;
-	walk.name = fname;
-	walk.type = ftype;
-	walk_directory(fst, &walk, &faddr);
-	if (!faddr)
-		return 0;
-	if (!check_fst_valid(fst))
-		DIE("Invalid file format in file: %s\n", uc_name);
-	cache_fst_addr(faddr, uc_name);
-	return faddr;
+/*
+ * Scan data blocks until all records up to logical file offset offset
+ * are complete.
+ */
+static int cache_file_upto(struct file *f, off_t offset)
+{
+	int rc;
+
+	while (!f->cache_complete) {
+		/* a record is complete if the next record has started */
+		if (f->cached_record >= 0 &&
+		    f->rlist[f->cached_record].file_start > offset)
+			return 0;
+		rc = cache_next_block(f);
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
 }
 
+/*
+ * Scan all remaining data blocks, needed before the file is modified.
+ */
 static int cache_file(struct file *f)
 {
-	int block = 0, record = -1;
-	unsigned int disp = 0;
-	off_t total = 0;
+	int rc;
+
+	while (!f->cache_complete) {
+		rc = cache_next_block(f);
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
+}
 
-	return f->fops->cache_data(f, ABS(f->fst->fop), f->fst->levels,
-				   &block, &disp, &record, &total);
+/*
+ * Return the number of complete records in the record list.
+ */
+static int cached_records(struct file *f)
+{
+	if (f->cache_complete)
+		return f->fst->nr_records;
+	return f->cached_record;
 }
 
 /*
@@ -1732,6 +1836,7 @@ static int cmsfs_getattr(const char *path, struct stat *stbuf)
 {
 	int mask = (cmsfs.allow_other) ? 0444 : 0440;
 	struct fst_entry fst;
+	struct file *f;
 
         if (!cmsfs.readonly)
                 mask |= ((cmsfs.allow_other) ? 0222 : 0220);
@@ -1765,6 +1870,18 @@ static int cmsfs_getattr(const char *path, struct stat *stbuf)
 		stbuf->st_mode = S_IFREG | mask;
 		stbuf->st_nlink = 1;
 
+		/* appended data of an opened file may not be committed yet */
+		f = file_open(path + 1);
+		if (f != NULL && f->meta_dirty) {
+			stbuf->st_mtime = stbuf->st_atime = stbuf->st_ctime =
+				fst_date_to_time_t(&f->fst->date[0],
+					f->fst->flag & FST_FLAG_CENTURY);
+			stbuf->st_size = f->session_size;
+			stbuf->st_blocks = (off_t) f->fst->nr_blocks *
+				cmsfs.nr_blocks_512;
+			return 0;
+		}
+
 		/* date */
 		stbuf->st_mtime = stbuf->st_atime = stbuf->st_ctime =
 			fst_date_to_time_t(&fst.date[0],
@@ -2189,7 +2306,7 @@ static int cmsfs_create(const char *path, mode_t mode,
 
 	rc = _write(&fst, sizeof(fst), fst_addr);
 	BUG(rc < 0);
-	cache_fst_addr(fst_addr, uc_name);
+	file_index_add(fst_addr, uc_name);
 	increase_file_count();
 	return cmsfs_open(path, fi);
 }
@@ -2428,8 +2545,8 @@ static int guess_record_number(struct file *f, off_t offset)
 		nr = (offset / (f->fst->record_len + 1));
 	else
 		nr = (offset / f->fst->record_len);
-	if (nr >= f->fst->nr_records)
-		nr = f->fst->nr_records - 1;
+	if (nr >= cached_records(f))
+		nr = cached_records(f) - 1;
 	return nr;
 }
 
@@ -2455,8 +2572,8 @@ static void set_hint(struct file *f, int hint)
 	f->next_record_hint = hint;
 
 	/* limit hint to last record */
-	if (f->next_record_hint >= f->fst->nr_records)
-		f->next_record_hint = f->fst->nr_records - 1;
+	if (f->next_record_hint >= cached_records(f))
+		f->next_record_hint = cached_records(f) - 1;
 }
 
 /*
@@ -2469,7 +2586,7 @@ static void set_hint(struct file *f, int hint)
  */
 static struct record *find_record(struct file *f, off_t offset, int *nr)
 {
-	int i, start, step, max = f->fst->nr_records;
+	int i, start, step, max = cached_records(f);
 	struct record *rec;
 
 	/*
@@ -2570,27 +2687,106 @@ static void get_block_data_from_record(struct record *rec, off_t offset,
 	}
 }
 
-static int convert_text(iconv_t conv, char *in_buf, char *out_buf, int size)
+/*
+ * Convert size bytes from in_buf to out_buf, both may be identical.
+ */
+static int convert_text(struct conv_table *table, char *in_buf,
+			char *out_buf, int size)
 {
-	size_t out_count = size;
-	size_t in_count = size;
-	int rc;
+	unsigned char *in = (unsigned char *) in_buf;
+	unsigned char *out = (unsigned char *) out_buf;
+	int i;
 
-	rc = iconv(conv, &in_buf, &in_count, &out_buf, &out_count);
-	if ((rc == -1) || (in_count != 0)) {
-		DEBUG("Code page translation EBCDIC-ASCII failed\n");
-		return -EIO;
+	if (!table->complete) {
+		for (i = 0; i < size; i++) {
+			if (!table->valid[in[i]]) {
+				DEBUG("Code page translation EBCDIC-ASCII failed\n");
+				return -EIO;
+			}
+			out[i] = table->map[in[i]];
+		}
+		return 0;
 	}
+
+	if (out != in)
+		memcpy(out, in, size);
+#ifdef __s390x__
+	/* TRANSLATE handles up to 256 bytes per instruction */
+	for (; size >= 256; size -= 256, out += 256)
+		asm volatile("tr	0(256,%[buf]),0(%[table])"
+			     :
+			     : [buf] "a" (out), [table] "a" (table->map)
+			     : "memory");
+#endif
+	for (; size > 0; size--, out++)
+		*out = table->map[*out];
 	return 0;
 }
 
+/*
+ * Tell the kernel that the disk range will be read soon.
+ */
+static void advise_willneed(off_t addr, off_t len)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	off_t start = addr & ~((off_t) page_size - 1);
+
+	len += addr - start;
+	if (cmsfs.map != MAP_FAILED)
+		madvise(cmsfs.map + start, len, MADV_WILLNEED);
+	else
+		posix_fadvise(cmsfs.fd, start, len, POSIX_FADV_WILLNEED);
+}
+
+/*
+ * The data blocks of a file need not be adjacent on the disk, so the
+ * kernel cannot do a useful read-ahead for sequential reads. Announce
+ * the next data blocks of the file instead, merging adjacent blocks.
+ */
+static void read_ahead(struct file *f, int block)
+{
+	off_t addr, start = 0, len = 0;
+	int i, end;
+
+	/* announce in batches of half the read-ahead window */
+	if (block + READAHEAD_BLOCKS / 2 < f->readahead_block)
+		return;
+	block = MAX(block, f->readahead_block);
+	end = block + READAHEAD_BLOCKS;
+
+	/* the block list may not yet contain the blocks */
+	while (!f->cache_complete && f->cached_blocks < end)
+		if (cache_next_block(f) < 0)
+			return;
+	end = MIN(end, f->cached_blocks);
+
+	for (i = block; i < end; i++) {
+		addr = f->blist[i].disk_addr;
+		/* nothing to read for null blocks */
+		if (addr == NULL_BLOCK)
+			continue;
+		if (len && addr == start + len) {
+			len += cmsfs.blksize;
+			continue;
+		}
+		if (len)
+			advise_willneed(start, len);
+		start = addr;
+		len = cmsfs.blksize;
+	}
+	if (len)
+		advise_willneed(start, len);
+	f->readahead_block = end;
+}
+
 static int cmsfs_read(const char *path, char *buf, size_t size, off_t offset,
 		      struct fuse_file_info *fi)
 {
 	struct file *f = get_fobj(fi);
+	int chunk, nr, rc, last_block = -1;
+	int sequential = (offset == f->read_end);
 	size_t len, copied = 0;
 	struct record *rec;
-	int chunk, nr, rc;
 	off_t addr;
 
 	(void) path;
@@ -2602,6 +2798,10 @@ static int cmsfs_read(const char *path, char *buf, size_t size, off_t offset,
 	if (offset + size > len)
 		size = len - offset;
 
+	rc = cache_file_upto(f, offset + size - 1);
+	if (rc < 0)
+		return rc;
+
 	while (size > 0) {
 		rec = find_record(f, offset, &nr);
 		if (rec == NULL) {
@@ -2627,6 +2827,7 @@ static int cmsfs_read(const char *path, char *buf, size_t size, off_t offset,
 
 		/* get addr and block size from record */
 		get_block_data_from_record(rec, offset, &addr, &chunk);
+		last_block = rec->block_nr;
 		if (chunk <= 0 || addr < 0)
 			DIE("Invalid record data\n");
 
@@ -2638,10 +2839,10 @@ static int cmsfs_read(const char *path, char *buf, size_t size, off_t offset,
 		if (addr == NULL_BLOCK)
 			memset(buf, 0, chunk);
 		else if (f->translate) {
-			rc = _read(f->iconv_buf, chunk, addr);
+			rc = _read(buf, chunk, addr);
 			if (rc < 0)
 				return rc;
-			rc = convert_text(cmsfs.iconv_from, f->iconv_buf, buf, chunk);
+			rc = convert_text(&cmsfs.conv_from, buf, buf, chunk);
 			if (rc < 0)
 				return rc;
 		} else {
@@ -2655,6 +2856,9 @@ static int cmsfs_read(const char *path, char *buf, size_t size, off_t offset,
 		buf += chunk;
 		offset += chunk;
 	}
+	f->read_end = offset;
+	if (sequential && last_block >= 0)
+		read_ahead(f, last_block + 1);
 out:
 	DEBUG("%s: copied: %lu\n", __func__, copied);
 	return copied;
@@ -2760,6 +2964,9 @@ static int delete_file(const char *path)
 	f = create_file_object(&fst, &rc);
 	if (f == NULL)
 		return rc;
+	rc = cache_file(f);
+	if (rc < 0)
+		goto error;
 
 	/* delete all data blocks */
 	for (i = 0; i < f->fst->nr_blocks; i++)
@@ -2776,10 +2983,10 @@ static int delete_file(const char *path)
 	else
 		fst_last = find_last_fdir_entry(cmsfs.fdir, cmsfs.dir_levels);
 
-	/* remove unlinked file from fcache */
+	/* remove unlinked file from the file index */
 	util_strlcpy(file, path + 1, MAX_FNAME);
 	str_toupper(file);
-	invalidate_htab_entry(file);
+	file_index_remove(file);
 
 	if (fst_last == fst_kill)
 		goto skip_copy;
@@ -2790,10 +2997,10 @@ static int delete_file(const char *path)
 	rc = _write(&fst, sizeof(struct fst_entry), fst_kill);
 	BUG(rc < 0);
 
-	/* update moved fcache entry */
+	/* update the file index entry of the moved FST */
 	memset(file, 0, sizeof(file));
 	decode_edf_name(file, fst.name, fst.type);
-	update_htab_entry(fst_kill, file);
+	file_index_update(fst_kill, file);
 	/* update cached address of moved FST */
 	f_moved = file_open(file);
 	if (f_moved != NULL)
@@ -2870,7 +3077,7 @@ static int cmsfs_rename(const char *path, const char *new_path)
 
 	util_strlcpy(uc_old_name, path + 1, MAX_FNAME);
 	str_toupper(uc_old_name);
-	invalidate_htab_entry(uc_old_name);
+	file_index_remove(uc_old_name);
 
 	/* update name in file object if the file is opened */
 	f = file_open(uc_old_name);
@@ -2883,18 +3090,28 @@ static int cmsfs_rename(const char *path, const char *new_path)
 
 	rc = _write(&fst, sizeof(fst), fst_addr);
 	BUG(rc < 0);
+
+	memset(uc_old_name, 0, sizeof(uc_old_name));
+	decode_edf_name(uc_old_name, fst.name, fst.type);
+	file_index_add(fst_addr, uc_old_name);
 	return 0;
 }
 
 static int cmsfs_fsync(const char *path, int datasync,
 		       struct fuse_file_info *fi)
 {
+	int rc;
+
 	(void) path;
 	(void) datasync;
-	(void) fi;
 
 	if (cmsfs.readonly)
 		return -EROFS;
+	if (fi != NULL && get_fobj(fi) != NULL) {
+		rc = commit_file(get_fobj(fi));
+		if (rc < 0)
+			return rc;
+	}
 	return msync(cmsfs.map,	cmsfs.size, MS_SYNC);
 }
 
@@ -3152,6 +3369,10 @@ static int shrink_file(struct file *f, off_t size)
 	off_t offset = size;
 	int new_end_nr, rc;
 
+	rc = cache_file(f);
+	if (rc < 0)
+		return rc;
+
 	/* truncate MUST be aligned to record length for fixed files */
 	if (f->fst->record_format == RECORD_LEN_FIXED) {
 		if (f->linefeed)
@@ -3248,6 +3469,9 @@ static int cmsfs_truncate(const char *path, off_t size)
 	 */
 	f = file_open(path + 1);
 	if (f != NULL) {
+		rc = commit_file(f);
+		if (rc < 0)
+			return rc;
 		fst_addr = f->fst_addr;
 		len = f->session_size;
 	} else {
@@ -3366,6 +3590,7 @@ static int cmsfs_getxattr(const char *path, const char *name, char *value,
 {
 	char buf[xattr_lrecl.size + 1];
 	struct fst_entry fst;
+	struct file *f;
 
 	/* nothing for root directory but clear error code needed */
 	if (strcmp(path, "/") == 0)
@@ -3396,6 +3621,10 @@ static int cmsfs_getxattr(const char *path, const char *name, char *value,
 			return xattr_lrecl.size;
 		if (size < xattr_lrecl.size)
 			return -ERANGE;
+		/* variable files may have a not yet committed longer record */
+		f = file_open(path + 1);
+		if (f != NULL)
+			fst.record_len = f->fst->record_len;
 		memset(buf, 0, sizeof(buf));
 		snprintf(buf, sizeof(buf), "%d", fst.record_len);
 		memcpy(value, buf, strlen(buf));
@@ -4094,12 +4323,15 @@ out:
 static int do_write(struct file *f, const char *buf, size_t size, off_t offset)
 {
 	off_t len, copied = 0;
-	struct var_ptr vptr;
 	int rc;
 
 	if (!size)
 		return 0;
 
+	rc = cache_file(f);
+	if (rc < 0)
+		return rc;
+
 	len = f->session_size;
 	if (f->linefeed)
 		len -= f->fst->nr_records;
@@ -4126,6 +4358,29 @@ static int do_write(struct file *f, const char *buf, size_t size, off_t offset)
 	if (f->linefeed)
 		f->session_size++;
 
+	rc = set_fst_date_current(f->fst);
+	if (rc != 0)
+		return rc;
+
+	/* pointers and FST are written by commit_file() */
+	f->meta_dirty = 1;
+	return copied;
+}
+
+/*
+ * Write the pointer blocks and the FST after data was appended. Rewriting
+ * the pointers is expensive for large files, so this is done only once
+ * when the file is released or synced instead of after every write
+ * request. Until then the disk contains the file as it was before.
+ */
+static int commit_file(struct file *f)
+{
+	struct var_ptr vptr;
+	int rc;
+
+	if (!f->meta_dirty)
+		return 0;
+
 	if (f->ptr_dirty) {
 		f->old_levels = f->fst->levels;
 		update_levels(f);
@@ -4146,14 +4401,11 @@ static int do_write(struct file *f, const char *buf, size_t size, off_t offset)
 				return rc;
 		}
 
-	rc = set_fst_date_current(f->fst);
-	if (rc != 0)
-		return rc;
-
 	update_fst(f, f->fst_addr);
 	set_fdir_date_current();
 	update_block_count();
-	return copied;
+	f->meta_dirty = 0;
+	return 0;
 }
 
 static void cache_write_data(struct file *f, const char *buf, int len)
@@ -4234,7 +4486,8 @@ static int cmsfs_write_strings(struct file *f, const char *buf,
 	}
 
 	/* translate */
-	rc = convert_text(cmsfs.iconv_to, f->wcache, f->iconv_buf, f->wcache_used);
+	rc = convert_text(&cmsfs.conv_to, f->wcache, f->iconv_buf,
+			  f->wcache_used);
 	if (rc < 0)
 		return rc;
 
@@ -4327,7 +4580,8 @@ static int flush_wcache(struct file *f)
 	int rc;
 
 	/* translate */
-	rc = convert_text(cmsfs.iconv_to, f->wcache, f->iconv_buf, f->wcache_used);
+	rc = convert_text(&cmsfs.conv_to, f->wcache, f->iconv_buf,
+			  f->wcache_used);
 	if (rc < 0)
 		return rc;
 
@@ -4346,7 +4600,7 @@ static int flush_wcache(struct file *f)
 static int cmsfs_release(const char *path, struct fuse_file_info *fi)
 {
 	struct file *f = get_fobj(fi);
-	int rc = 0;
+	int rc = 0, rc2;
 
 	(void) path;
 
@@ -4360,6 +4614,9 @@ static int cmsfs_release(const char *path, struct fuse_file_info *fi)
 		if (f->wcache_used)
 			rc = flush_wcache(f);
 	}
+	rc2 = commit_file(f);
+	if (!rc)
+		rc = rc2;
 
 	if (f->use_count == 1) {
 		if (f->unlinked)
@@ -4399,6 +4656,7 @@ static struct file *create_file_object(struct fst_entry *fst, int *rc)
 		goto oom_f;
 
 	memcpy(f->fst, fst, sizeof(*fst));
+	pthread_mutex_init(&f->read_lock, NULL);
 	workaround_nr_blocks(f);
 	init_fops(f);
 
@@ -4406,6 +4664,7 @@ static struct file *create_file_object(struct fst_entry *fst, int *rc)
 	f->translate = f->linefeed;
 
 	f->record_scan_state = RSS_DATA_BLOCK_STARTED;
+	f->cached_record = -1;
 
 	if (f->fst->record_format == RECORD_LEN_FIXED)
 		f->ptr_per_block = cmsfs.fixed_ptrs_per_block;
@@ -4419,10 +4678,12 @@ static struct file *create_file_object(struct fst_entry *fst, int *rc)
 
 	/*
 	 * Prevent calloc for zero records since it returns a pointer != NULL
-	 * which causes trouble at free. Also don't call cache_file.
+	 * which causes trouble at free. There is also nothing to cache.
 	 */
-	if (f->fst->nr_records == 0)
+	if (f->fst->nr_records == 0) {
+		f->cache_complete = 1;
 		return f;
+	}
 
 	f->rlist = calloc(f->fst->nr_records, sizeof(struct record));
 	if (f->rlist == NULL)
@@ -4432,14 +4693,9 @@ static struct file *create_file_object(struct fst_entry *fst, int *rc)
 	if (f->blist == NULL)
 		goto oom_rlist;
 
-	*rc = cache_file(f);
-	if (*rc < 0)
-		goto error;
+	/* the record list is filled by cache_file_upto() and cache_file() */
 	return f;
 
-error:
-	if (*rc == 0)
-		*rc = -ENOMEM;
 oom_rlist:
 	free(f->rlist);
 oom_wstate:
@@ -4449,6 +4705,7 @@ oom_fst:
 oom_f:
 	free(f);
 oom:
+	*rc = -ENOMEM;
 	return NULL;
 }
 
@@ -4475,6 +4732,7 @@ static void destroy_file_object(struct file *f)
 	free(f->rlist);
 	free(f->blist);
 	free(f->fst);
+	pthread_mutex_destroy(&f->read_lock);
 	free(f);
 }
 
@@ -4492,24 +4750,226 @@ static struct file_operations fops_variable = {
 	.write_pointers = rewrite_pointer_block_variable,
 };
 
+/*
+ * FUSE calls the operations from several threads. Operations which only
+ * read the disk run in parallel holding the shared lock. Reads of the same
+ * file are serialized by the read lock of the file object. All other
+ * operations modify the disk or the list of open files and hold the lock
+ * exclusively. This includes fsync, which commits the file: that allocates
+ * and frees blocks in the allocation map and rewrites the pointer blocks
+ * and the FST, which getattr, readdir and read access under the shared
+ * lock.
+ */
+static pthread_rwlock_t cmsfs_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void lock_shared(void)
+{
+	if (pthread_rwlock_rdlock(&cmsfs_lock))
+		DIE("%s: locking failed\n", __func__);
+}
+
+static void lock_exclusive(void)
+{
+	if (pthread_rwlock_wrlock(&cmsfs_lock))
+		DIE("%s: locking failed\n", __func__);
+}
+
+static void unlock(void)
+{
+	pthread_rwlock_unlock(&cmsfs_lock);
+}
+
+static int cmsfs_locked_getattr(const char *path, struct stat *stbuf)
+{
+	int rc;
+
+	lock_shared();
+	rc = cmsfs_getattr(path, stbuf);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_statfs(const char *path, struct statvfs *buf)
+{
+	int rc;
+
+	lock_shared();
+	rc = cmsfs_statfs(path, buf);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_readdir(const char *path, void *buf,
+				fuse_fill_dir_t filler, off_t offset,
+				struct fuse_file_info *fi)
+{
+	int rc;
+
+	lock_shared();
+	rc = cmsfs_readdir(path, buf, filler, offset, fi);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_open(const char *path, struct fuse_file_info *fi)
+{
+	int rc;
+
+	lock_exclusive();
+	rc = cmsfs_open(path, fi);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_release(const char *path, struct fuse_file_info *fi)
+{
+	int rc;
+
+	lock_exclusive();
+	rc = cmsfs_release(path, fi);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_read(const char *path, char *buf, size_t size,
+			     off_t offset, struct fuse_file_info *fi)
+{
+	struct file *f = get_fobj(fi);
+	int rc;
+
+	lock_shared();
+	pthread_mutex_lock(&f->read_lock);
+	rc = cmsfs_read(path, buf, size, offset, fi);
+	pthread_mutex_unlock(&f->read_lock);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_utimens(const char *path, const struct timespec ts[2])
+{
+	int rc;
+
+	lock_exclusive();
+	rc = cmsfs_utimens(path, ts);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_rename(const char *path, const char *new_path)
+{
+	int rc;
+
+	lock_exclusive();
+	rc = cmsfs_rename(path, new_path);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_fsync(const char *path, int datasync,
+			      struct fuse_file_info *fi)
+{
+	int rc;
+
+	lock_exclusive();
+	rc = cmsfs_fsync(path, datasync, fi);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_truncate(const char *path, off_t size)
+{
+	int rc;
+
+	lock_exclusive();
+	rc = cmsfs_truncate(path, size);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_create(const char *path, mode_t mode,
+			       struct fuse_file_info *fi)
+{
+	int rc;
+
+	lock_exclusive();
+	rc = cmsfs_create(path, mode, fi);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_write(const char *path, const char *buf, size_t size,
+			      off_t offset, struct fuse_file_info *fi)
+{
+	int rc;
+
+	lock_exclusive();
+	rc = cmsfs_write(path, buf, size, offset, fi);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_unlink(const char *path)
+{
+	int rc;
+
+	lock_exclusive();
+	rc = cmsfs_unlink(path);
+	unlock();
+	return rc;
+}
+
+#ifdef HAVE_SETXATTR
+static int cmsfs_locked_listxattr(const char *path, char *list, size_t size)
+{
+	int rc;
+
+	lock_shared();
+	rc = cmsfs_listxattr(path, list, size);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_getxattr(const char *path, const char *name,
+				 char *value, size_t size)
+{
+	int rc;
+
+	lock_shared();
+	rc = cmsfs_getxattr(path, name, value, size);
+	unlock();
+	return rc;
+}
+
+static int cmsfs_locked_setxattr(const char *path, const char *name,
+				 const char *value, size_t size, int flags)
+{
+	int rc;
+
+	lock_exclusive();
+	rc = cmsfs_setxattr(path, name, value, size, flags);
+	unlock();
+	return rc;
+}
+#endif
+
 static struct fuse_operations cmsfs_oper = {
-	.getattr	= cmsfs_getattr,
-	.statfs		= cmsfs_statfs,
-	.readdir	= cmsfs_readdir,
-	.open		= cmsfs_open,
-	.release	= cmsfs_release,
-	.read		= cmsfs_read,
-	.utimens	= cmsfs_utimens,
-	.rename		= cmsfs_rename,
-	.fsync		= cmsfs_fsync,
-	.truncate	= cmsfs_truncate,
-	.create		= cmsfs_create,
-	.write		= cmsfs_write,
-	.unlink		= cmsfs_unlink,
+	.getattr	= cmsfs_locked_getattr,
+	.statfs		= cmsfs_locked_statfs,
+	.readdir	= cmsfs_locked_readdir,
+	.open		= cmsfs_locked_open,
+	.release	= cmsfs_locked_release,
+	.read		= cmsfs_locked_read,
+	.utimens	= cmsfs_locked_utimens,
+	.rename		= cmsfs_locked_rename,
+	.fsync		= cmsfs_locked_fsync,
+	.truncate	= cmsfs_locked_truncate,
+	.create		= cmsfs_locked_create,
+	.write		= cmsfs_locked_write,
+	.unlink		= cmsfs_locked_unlink,
 #ifdef HAVE_SETXATTR
-	.listxattr      = cmsfs_listxattr,
-	.getxattr       = cmsfs_getxattr,
-	.setxattr       = cmsfs_setxattr,
+	.listxattr      = cmsfs_locked_listxattr,
+	.getxattr       = cmsfs_locked_getxattr,
+	.setxattr       = cmsfs_locked_setxattr,
 	/* no removexattr since our xattrs are virtual */
 #endif
 };
@@ -4588,6 +5048,11 @@ static void init_io(int fd)
 		io_ops.write = &write_syscall;
 	} else {
 		DEBUG("  addr: %p\n", cmsfs.map);
+		/*
+		 * Metadata is accessed randomly and file data is announced
+		 * by read_ahead(), so avoid the kernel read-around.
+		 */
+		madvise(cmsfs.map, cmsfs.size, MADV_RANDOM);
 		io_ops.read = &read_memory;
 		io_ops.write = &write_memory;
 	}
@@ -4610,16 +5075,11 @@ static void cmsfs_init(int fd)
 	cmsfs.dir_levels = get_levels(cmsfs.fdir);
 	cmsfs.files = get_files_count(cmsfs.fdir);
 
-	/* alloc cache entries for all files */
-	cmsfs.fcache_max = max_cache_entries();
-	cmsfs.fcache = calloc(cmsfs.fcache_max, sizeof(struct fcache_entry));
-
 	cmsfs.amap = get_fop(cmsfs.fdir + sizeof(struct fst_entry));
 	cmsfs.amap_levels = get_levels(cmsfs.fdir + sizeof(struct fst_entry));
-	cmsfs.amap_bytes_per_block = cmsfs.blksize * 8 * cmsfs.blksize;
+	amap_cache_init();
 
-	if (!hcreate_r(cmsfs.fcache_max, &cmsfs.htab))
-		DIE("hcreate failed\n");
+	build_file_index();
 
 	util_list_init(&open_file_list, struct file, list);
 	util_list_init(&text_type_list, struct filetype, list);
@@ -4667,8 +5127,6 @@ int main(int argc, char *argv[])
 
 	if (cmsfs.readonly)
 		fuse_opt_add_arg(&args, "-oro");
-	/* force single threaded mode which requires no locking */
-	fuse_opt_add_arg(&args, "-s");
 	/* force immediate file removal */
 	fuse_opt_add_arg(&args, "-ohard_remove");
 
@@ -4682,10 +5140,10 @@ int main(int argc, char *argv[])
 		if (cmsfs.codepage_to == NULL)
 			cmsfs.codepage_to = CODEPAGE_LINUX;
 
-		setup_iconv(&cmsfs.iconv_from, cmsfs.codepage_from,
-			    cmsfs.codepage_to);
-		setup_iconv(&cmsfs.iconv_to, cmsfs.codepage_to,
-			    cmsfs.codepage_from);
+		setup_conv_table(&cmsfs.conv_from, cmsfs.codepage_from,
+				 cmsfs.codepage_to);
+		setup_conv_table(&cmsfs.conv_to, cmsfs.codepage_to,
+				 cmsfs.codepage_from);
 	}
 
 	rc = cmsfs_fuse_main(&args, &cmsfs_oper);
@@ -4694,6 +5152,7 @@ int main(int argc, char *argv[])
 #ifdef DEBUG_ENABLED
 	fclose(logfile);
 #endif
-	hdestroy_r(&cmsfs.htab);
+	file_index_free();
+	amap_cache_free();
 	return rc;
 }
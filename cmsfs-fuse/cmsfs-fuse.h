@@ -12,7 +12,6 @@
 #ifndef _CMSFS_H
 #define _CMSFS_H
 
-#include <iconv.h>
 #include <search.h>
 
 #include "lib/util_list.h"
@@ -24,13 +23,13 @@ extern struct cmsfs cmsfs;
 #define ABS(x)			((off_t) (x - 1) * cmsfs.blksize)
 #define REL(x)			((x / cmsfs.blksize) + 1)
 
-struct fcache_entry {
-	/* filename used as hash key */
-	char		name[18];
+struct findex_entry {
+	/* next entry in the same hash bucket */
+	struct findex_entry *next;
 	/* location of fst entry */
 	off_t		fst_addr;
-	/* filename string address */
-	char		*str;
+	/* filename used as hash key */
+	char		name[18];
 };
 
 enum cmsfs_mode {
@@ -39,6 +38,16 @@ enum cmsfs_mode {
 	TYPE_MODE,
 };
 
+/* single byte code page conversion table */
+struct conv_table {
+	/* converted characters */
+	unsigned char	map[256];
+	/* characters with a single byte representation in the target */
+	unsigned char	valid[256];
+	/* all characters can be converted */
+	int		complete;
+};
+
 /* the per device global struture */
 struct cmsfs {
 	/* name of the block device, e.g. /dev/dasde */
@@ -74,8 +83,8 @@ struct cmsfs {
 	/* iconv codepage options */
 	const char	*codepage_from;
 	const char	*codepage_to;
-	iconv_t		iconv_from;
-	iconv_t		iconv_to;
+	struct conv_table conv_from;
+	struct conv_table conv_to;
 
 	/* disk stats */
 	int		total_blocks;
@@ -89,13 +98,11 @@ struct cmsfs {
 	int		bits_per_data_block;
 	int		bits_per_ptr_block;
 	int		data_block_mask;
-	off_t		amap_bytes_per_block;
 
-	/* file cache */
-	struct		fcache_entry *fcache;
-	int		fcache_used;
-	int		fcache_max;
-	struct hsearch_data htab;
+	/* file index, hash buckets of all files in the directory */
+	struct		findex_entry **findex;
+	unsigned int	findex_size;
+	unsigned int	findex_used;
 };
 
 #define MAX_TYPE_LEN		9
@@ -112,7 +119,6 @@ struct filetype {
 #define VPTRS_PER_BLOCK		(cmsfs.var_ptrs_per_block)
 #define DATA_BLOCK_MASK		(cmsfs.data_block_mask)
 #define BITS_PER_DATA_BLOCK	(cmsfs.bits_per_data_block)
-#define BYTES_PER_BLOCK		(cmsfs.amap_bytes_per_block)
 
 extern int get_device_info(struct cmsfs *cmsfs);
 extern int scan_conf_file(struct util_list *list);
@@ -124,6 +130,8 @@ int _write(const void *, size_t, off_t);
 int _zero(off_t, size_t);
 off_t get_fixed_pointer(off_t);
 
+void amap_cache_init(void);
+void amap_cache_free(void);
 off_t get_free_block(void);
 off_t get_zero_block(void);
 void free_block(off_t);
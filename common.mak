@@ -219,6 +219,13 @@ ALL_CFLAGS := $(filter-out -O%,$(ALL_CFLAGS)) --coverage
 ALL_CXXFLAGS := $(filter-out -O%,$(ALL_CXXFLAGS)) --coverage
 ALL_LDFLAGS += --coverage
 endif
+
+# make HAVE_SDT=1
+# Compile in static tracepoints (USDT) that are defined with ZT_PROBE().
+# This requires <sys/sdt.h> from systemtap-sdt-devel or systemtap-sdt-dev.
+ifeq ("${HAVE_SDT}","1")
+ALL_CPPFLAGS += -DHAVE_SDT
+endif
 export AS LD CC CPP AR NM STRIP OBJCOPY OBJDUMP INSTALL CFLAGS CXXFLAGS \
        LDFLAGS CPPFLAGS ALL_CFLAGS ALL_CXXFLAGS ALL_LDFLAGS ALL_CPPFLAGS
 
@@ -14,6 +14,7 @@
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -39,6 +40,8 @@ static const char *const usage =
 	"\t-d, --disable [counter]   Disable one or all counters\n"
 	"\t-r, --reset   [counter]   Reset one or all counter values\n"
 	"\t-p, --print   [counter]   Print one or all counter values\n"
+	"\t-P, --pid PID             Apply to the counters of a process\n"
+	"\t-c, --cgroup PATH         Apply to the counters of a cgroup\n"
 	"\tcounter can be: 'aes' 'des' 'rng' 'sha' 'ecc' or 'all'\n";
 
 static const char *const counter_str[] = {
@@ -92,6 +95,50 @@ static int recv_answer(int s, int *ctr, int *state, uint64_t *value)
 }
 
 
+static int send_query_target(int s, enum target_cmd_e cmd,
+			     enum target_e kind, int pid, const char *cgroup)
+{
+	struct msg m;
+
+	memset(&m, 0, sizeof(m));
+
+	m.head.m_ver = VERSION;
+	m.head.m_type = QUERY_TARGET;
+	m.query_target.m_cmd = cmd;
+	m.query_target.m_kind = kind;
+	m.query_target.m_pid = pid;
+	if (cgroup)
+		snprintf(m.query_target.m_cgroup,
+			 sizeof(m.query_target.m_cgroup), "%s", cgroup);
+
+	return send_msg(s, &m);
+}
+
+
+static int recv_answer_all(int s, struct msg_answer_all *answer)
+{
+	struct msg m;
+	int rc;
+
+	rc = recv_msg(s, &m);
+	if (rc == 0) {
+		if (m.head.m_ver != VERSION) {
+			eprint("Received msg with wrong version %d != %d\n",
+			       m.head.m_ver, VERSION);
+			return -1;
+		}
+		if (m.head.m_type != ANSWER_ALL) {
+			eprint("Received msg with wrong type %d != %d\n",
+			       m.head.m_type, ANSWER_ALL);
+			return -1;
+		}
+		*answer = m.answer_all;
+	}
+
+	return rc;
+}
+
+
 static void print_answer(int ctr, int state, uint64_t value)
 {
 	if (state < 0)
@@ -124,11 +171,52 @@ int eprint(const char *format, ...)
 }
 
 
+/*
+ * Send a query for the counters of a process or cgroup and print the answer
+ */
+static int do_target(int s, enum cmd_e cmd, enum ctr_e ctr,
+		     enum target_e kind, int pid, const char *cgroup)
+{
+	static const enum target_cmd_e target_cmd[] = {
+		[PRINT]   = TARGET_PRINT,
+		[ENABLE]  = TARGET_ADD,
+		[DISABLE] = TARGET_REMOVE,
+		[RESET]   = TARGET_RESET,
+	};
+	struct msg_answer_all all;
+	int i, state;
+
+	if (send_query_target(s, target_cmd[cmd], kind, pid, cgroup) != 0) {
+		eprint("Error on sending query message to daemon\n");
+		return -1;
+	}
+	if (recv_answer_all(s, &all) != 0) {
+		eprint("Error on receiving answer message from daemon\n");
+		return -1;
+	}
+	for (i = 0; i < ALL_COUNTER && i < (int) all.m_count; i++) {
+		if (ctr != ALL_COUNTER && i != (int) ctr)
+			continue;
+		state = all.m_ctr[i].m_state;
+		if (state < 0) {
+			eprint("Received bad status code %d from daemon [%s]\n",
+			       state, strerror(-state));
+			return -1;
+		}
+		print_answer(i, state, all.m_ctr[i].m_value);
+	}
+
+	return 0;
+}
+
+
 int main(int argc, char *argv[])
 {
+	char cgroup[PATH_MAX], *endp, *cgroup_arg = NULL;
 	enum ctr_e ctr = ALL_COUNTER;
 	enum cmd_e cmd = PRINT;
-	int i, j, s, state;
+	int i, j, s, rc, state, pid = 0;
+	struct msg_answer_all all;
 	uint64_t value;
 
 	if (argc > 1) {
@@ -140,10 +228,12 @@ int main(int argc, char *argv[])
 			{ "disable", 0, NULL, 'd' },
 			{ "reset", 0, NULL, 'r' },
 			{ "print", 0, NULL, 'p' },
+			{ "pid", 1, NULL, 'P' },
+			{ "cgroup", 1, NULL, 'c' },
 			{ NULL, 0, NULL, 0 } };
 		while (1) {
 			opt = getopt_long(argc, argv,
-					  "hvedrp", long_opts, &idx);
+					  "hvedrpP:c:", long_opts, &idx);
 			if (opt == -1)
 				break; /* no more arguments */
 			switch (opt) {
@@ -169,6 +259,16 @@ int main(int argc, char *argv[])
 			case 'p':
 				cmd = PRINT;
 				break;
+			case 'P':
+				pid = strtol(optarg, &endp, 10);
+				if (*endp || pid <= 0) {
+					eprint("Invalid pid '%s'\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'c':
+				cgroup_arg = optarg;
+				break;
 			default:
 				eprint("Invalid argument, try -h or --help for more information\n");
 				exit(1);
@@ -188,6 +288,23 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (pid && cgroup_arg) {
+		eprint("Options --pid and --cgroup are mutually exclusive\n");
+		exit(1);
+	}
+	/* the daemon needs the absolute path of the cgroup */
+	if (cgroup_arg) {
+		if (!realpath(cgroup_arg, cgroup)) {
+			eprint("Can't access cgroup '%s', errno=%d [%s]\n",
+			       cgroup_arg, errno, strerror(errno));
+			exit(1);
+		}
+		if (strlen(cgroup) >= TARGET_PATH_LEN) {
+			eprint("Cgroup path '%s' is too long\n", cgroup);
+			exit(1);
+		}
+	}
+
 	/* try to open and connect socket to the cpacfstatsd daemon */
 	s = open_socket(CLIENT);
 	if (s < 0) {
@@ -195,6 +312,17 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	if (pid || cgroup_arg) {
+		rc = do_target(s, cmd, ctr, pid ? TARGET_PID : TARGET_CGROUP,
+			       pid, cgroup_arg ? cgroup : NULL);
+		close(s);
+		return rc ? 1 : 0;
+	}
+
+	/* all counter values are fetched with a single message */
+	if (cmd == PRINT && ctr == ALL_COUNTER)
+		cmd = PRINT_ALL;
+
 	/* send query */
 	if (send_query(s, cmd, ctr) != 0) {
 		eprint("Error on sending query message to daemon\n");
@@ -202,7 +330,24 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
-	if (ctr == ALL_COUNTER) {
+	if (cmd == PRINT_ALL) {
+		/* receive answer */
+		if (recv_answer_all(s, &all) != 0) {
+			eprint("Error on receiving answer message from daemon\n");
+			close(s);
+			exit(1);
+		}
+		for (i = 0; i < ALL_COUNTER && i < (int) all.m_count; i++) {
+			state = all.m_ctr[i].m_state;
+			if (state < 0) {
+				eprint("Received bad status code %d from daemon\n",
+				       state);
+				close(s);
+				exit(1);
+			}
+			print_answer(i, state, all.m_ctr[i].m_value);
+		}
+	} else if (ctr == ALL_COUNTER) {
 		for (i = 0; i < ALL_COUNTER; i++) {
 			/* receive answer */
 			if (recv_answer(s, &j, &state, &value) != 0) {
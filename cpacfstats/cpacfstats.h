@@ -33,14 +33,32 @@ enum ctr_e {
 
 enum type_e {
 	QUERY = 0,
-	ANSWER
+	ANSWER,
+	ANSWER_ALL,
+	QUERY_TARGET
 };
 
 enum cmd_e {
 	PRINT = 0,
 	ENABLE,
 	DISABLE,
-	RESET
+	RESET,
+	PRINT_ALL
+};
+
+/*
+ * Commands for the counters of a single process or cgroup
+ */
+enum target_cmd_e {
+	TARGET_ADD = 0,
+	TARGET_REMOVE,
+	TARGET_RESET,
+	TARGET_PRINT
+};
+
+enum target_e {
+	TARGET_PID = 0,
+	TARGET_CGROUP
 };
 
 enum state_e {
@@ -73,6 +91,39 @@ struct msg_answer {
 	uint64_t m_value;
 } __packed;
 
+/*
+ * query for a process or cgroup send from client to daemon
+ * Consist of:
+ * command, see enum target_cmd_e
+ * kind of target, see enum target_e
+ * process ID for TARGET_PID
+ * absolute path of the cgroup directory for TARGET_CGROUP
+ * The daemon answers with a struct msg_answer_all.
+ */
+#define TARGET_PATH_LEN 256
+
+struct msg_query_target {
+	uint32_t m_cmd;
+	uint32_t m_kind;
+	int32_t  m_pid;
+	char     m_cgroup[TARGET_PATH_LEN];
+} __packed;
+
+/*
+ * answer to a PRINT_ALL query send from daemon to client
+ * Consist of:
+ * number of counters
+ * status code and counter value for each counter, indexed by enum ctr_e
+ * All counter values are read at the same time.
+ */
+struct msg_answer_all {
+	uint32_t m_count;
+	struct {
+		int32_t  m_state;
+		uint64_t m_value;
+	} __packed m_ctr[ALL_COUNTER];
+} __packed;
+
 /* stats_sock.c */
 
 #define SERVER 1
@@ -95,6 +146,8 @@ struct msg {
 	union {
 		struct msg_query  query;
 		struct msg_answer answer;
+		struct msg_answer_all answer_all;
+		struct msg_query_target query_target;
 	};
 } __packed;
 
@@ -102,6 +155,42 @@ int open_socket(int mode);
 int send_msg(int sfd, struct msg *m);
 int recv_msg(int sfd, struct msg *m);
 
+/* stats_shm.c */
+
+#define SHM_FILE    "/run/cpacfstatsd_counters"
+#define SHM_MAGIC   0x43504143	/* "CPAC" */
+#define SHM_VERSION 1
+
+/*
+ * Counter values exported by the daemon in the shared memory file SHM_FILE
+ *
+ * The file is updated in place and protected by a sequence counter. Readers
+ * map the file read-only and copy the data as follows:
+ *
+ * 1. Read seq, retry if it is odd (update in progress)
+ * 2. Copy the counters
+ * 3. Read seq again, retry if it differs from the value read in step 1
+ */
+struct shm_ctr {
+	int32_t  state;		/* enum state_e or negative error code */
+	uint32_t reserved;
+	uint64_t value;		/* counter value if state is ENABLED */
+};
+
+struct shm_counters {
+	uint32_t magic;		/* SHM_MAGIC */
+	uint32_t version;	/* SHM_VERSION */
+	uint32_t seq;		/* sequence counter, odd during an update */
+	uint32_t count;		/* number of counters */
+	uint64_t interval;	/* update interval in milliseconds */
+	uint64_t timestamp;	/* time of last update, ns since the epoch */
+	struct shm_ctr ctr[ALL_COUNTER];	/* indexed by enum ctr_e */
+};
+
+int  shm_create(unsigned long interval);
+void shm_update(const int state[ALL_COUNTER]);
+void shm_remove(void);
+
 /* perf_crypto.c */
 
 int  perf_init(void);
@@ -110,6 +199,14 @@ int  perf_enable_ctr(enum ctr_e ctr);
 int  perf_disable_ctr(enum ctr_e ctr);
 int  perf_reset_ctr(enum ctr_e ctr);
 int  perf_read_ctr(enum ctr_e ctr, uint64_t *value);
+int  perf_read_all(uint64_t value[ALL_COUNTER]);
+
+struct perf_target;
+
+int  perf_target_open(enum target_e kind, int id, struct perf_target **target);
+void perf_target_close(struct perf_target *target);
+int  perf_target_reset(struct perf_target *target);
+int  perf_target_read(struct perf_target *target, uint64_t value[ALL_COUNTER]);
 int  perf_ecc_supported(void);
 
 #endif
@@ -14,15 +14,22 @@
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <linux/magic.h>
+#include <sys/fsuid.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "lib/zt_common.h"
@@ -39,32 +46,44 @@ static const char *const usage =
 	"\n"
 	"\t-h, --help          Print this help, then exit\n"
 	"\t-v, --version       Print version information, then exit\n"
-	"\t-f, --foreground    Run in foreground, do not detach\n";
+	"\t-f, --foreground    Run in foreground, do not detach\n"
+	"\t-i, --interval MS   Export counter values to " SHM_FILE "\n"
+	"\t                    every MS milliseconds\n";
 
 static int daemonized;
 
 static int ctr_state[ALL_COUNTER];
 
+/* processes and cgroups with their own counters */
+#define MAX_TARGETS 64
 
-static int recv_query(int s, enum ctr_e *ctr, enum cmd_e *cmd)
+static struct target {
+	struct perf_target *perf;
+	enum target_e kind;
+	int pid;
+	unsigned long long start_time;	/* of pid, detects pid reuse */
+	uid_t uid;			/* of the client that added the target */
+	char cgroup[PATH_MAX];
+} targets[MAX_TARGETS];
+
+
+static int recv_query(int s, struct msg *m)
 {
-	struct msg m;
 	int rc;
 
-	rc = recv_msg(s, &m);
+	rc = recv_msg(s, m);
 	if (rc == 0) {
-		if (m.head.m_ver != VERSION) {
+		if (m->head.m_ver != VERSION) {
 			eprint("Received msg with wrong version %d != %d\n",
-			       m.head.m_ver, VERSION);
+			       m->head.m_ver, VERSION);
 			return -1;
 		}
-		if (m.head.m_type != QUERY) {
+		if (m->head.m_type != QUERY &&
+		    m->head.m_type != QUERY_TARGET) {
 			eprint("Received msg with wrong type %d != %d\n",
-			       m.head.m_type, QUERY);
+			       m->head.m_type, QUERY);
 			return -1;
 		}
-		*ctr = m.query.m_ctr;
-		*cmd = m.query.m_cmd;
 	}
 
 	return rc;
@@ -186,6 +205,345 @@ static int do_print(int s, enum ctr_e ctr)
 	return rc;
 }
 
+/*
+ * Answer with the state and value of all counters in one message,
+ * the values are read at the same time
+ */
+static int do_print_all(int s)
+{
+	uint64_t value[ALL_COUNTER];
+	struct msg m;
+	int i, rc;
+
+	rc = perf_read_all(value);
+
+	memset(&m, 0, sizeof(m));
+
+	m.head.m_ver = VERSION;
+	m.head.m_type = ANSWER_ALL;
+	m.answer_all.m_count = ALL_COUNTER;
+	for (i = 0; i < ALL_COUNTER; i++) {
+		if (ctr_state[i] == ENABLED) {
+			m.answer_all.m_ctr[i].m_state = rc ? rc : ENABLED;
+			m.answer_all.m_ctr[i].m_value = rc ? 0 : value[i];
+		} else {
+			m.answer_all.m_ctr[i].m_state = ctr_state[i];
+		}
+	}
+	send_msg(s, &m);
+
+	return rc;
+}
+
+
+/*
+ * Find the target of a query, returns NULL if there is none
+ */
+static struct target *find_target(struct msg_query_target *q,
+				  const char *cgroup)
+{
+	int i;
+
+	for (i = 0; i < MAX_TARGETS; i++) {
+		if (!targets[i].perf || targets[i].kind != q->m_kind)
+			continue;
+		if (q->m_kind == TARGET_PID && targets[i].pid == q->m_pid)
+			return &targets[i];
+		if (q->m_kind == TARGET_CGROUP &&
+		    strcmp(targets[i].cgroup, cgroup) == 0)
+			return &targets[i];
+	}
+
+	return NULL;
+}
+
+
+static void remove_target(struct target *t)
+{
+	perf_target_close(t->perf);
+	memset(t, 0, sizeof(*t));
+}
+
+
+/*
+ * Get the start time of process pid, returns 0 on success and a negative
+ * errno value otherwise
+ */
+static int get_start_time(int pid, unsigned long long *start_time)
+{
+	char path[64], buf[1024], *p;
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return -ESRCH;
+	buf[len] = '\0';
+
+	/* skip pid and command name, which may contain blanks */
+	p = strrchr(buf, ')');
+	if (!p || sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+			 "%*u %*u %*d %*d %*d %*d %*d %*d %llu",
+			 start_time) != 1)
+		return -EINVAL;
+
+	return 0;
+}
+
+
+/*
+ * Remove the targets of processes that have exited
+ */
+static void remove_stale_targets(void)
+{
+	unsigned long long start_time;
+	int i;
+
+	for (i = 0; i < MAX_TARGETS; i++) {
+		if (!targets[i].perf || targets[i].kind != TARGET_PID)
+			continue;
+		if (get_start_time(targets[i].pid, &start_time) == 0 &&
+		    start_time == targets[i].start_time)
+			continue;
+		eprint("Removing counters for exited pid %d\n",
+		       targets[i].pid);
+		remove_target(&targets[i]);
+	}
+}
+
+
+/*
+ * Check if the client with credentials cred may count the events of process
+ * pid. Like for ptrace, the client must be root, or its user and group IDs
+ * must match the real, effective, and saved IDs of the process, and the
+ * process must be dumpable.
+ */
+static int check_pid_access(const struct ucred *cred, int pid)
+{
+	bool uid_ok = false, gid_ok = false;
+	char path[64], line[256];
+	unsigned int id[3];
+	struct stat st;
+	FILE *f;
+
+	if (cred->uid == 0)
+		return 0;
+
+	/* /proc/<pid> of a process that is not dumpable is owned by root */
+	snprintf(path, sizeof(path), "/proc/%d", pid);
+	if (stat(path, &st) != 0)
+		return -errno;
+	if (st.st_uid != cred->uid)
+		return -EPERM;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	f = fopen(path, "r");
+	if (!f)
+		return -errno;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "Uid: %u %u %u", &id[0], &id[1], &id[2]) == 3)
+			uid_ok = id[0] == cred->uid && id[1] == cred->uid &&
+				 id[2] == cred->uid;
+		else if (sscanf(line, "Gid: %u %u %u",
+				&id[0], &id[1], &id[2]) == 3)
+			gid_ok = id[0] == cred->gid && id[1] == cred->gid &&
+				 id[2] == cred->gid;
+	}
+	fclose(f);
+
+	return uid_ok && gid_ok ? 0 : -EPERM;
+}
+
+
+/*
+ * Resolve the cgroup path with the file system permissions of the client
+ * with credentials cred, so that the daemon does not reveal paths that
+ * the client cannot access
+ */
+static int resolve_cgroup(const struct ucred *cred, const char *path,
+			  char *cgroup)
+{
+	int old_fsuid, old_fsgid, rc = 0;
+
+	old_fsgid = setfsgid(cred->gid);
+	old_fsuid = setfsuid(cred->uid);
+	if (!realpath(path, cgroup))
+		rc = -errno;
+	setfsuid(old_fsuid);
+	setfsgid(old_fsgid);
+
+	return rc;
+}
+
+
+/*
+ * Start counting for a process or cgroup on behalf of the client with
+ * credentials cred. Non-root clients may only add processes they could
+ * ptrace and cgroup directories they own.
+ */
+static int add_target(struct msg_query_target *q, const char *cgroup,
+		      const struct ucred *cred)
+{
+	unsigned long long start_time = 0, check_time;
+	struct target *t = NULL;
+	struct statfs sfs;
+	struct stat st;
+	int i, fd, rc;
+
+	remove_stale_targets();
+	if (find_target(q, cgroup))
+		return -EEXIST;
+	for (i = 0; i < MAX_TARGETS && !t; i++) {
+		if (!targets[i].perf)
+			t = &targets[i];
+	}
+	if (!t)
+		return -ENOSPC;
+
+	if (q->m_kind == TARGET_PID) {
+		if (q->m_pid <= 0)
+			return -EINVAL;
+		rc = get_start_time(q->m_pid, &start_time);
+		if (rc == 0)
+			rc = check_pid_access(cred, q->m_pid);
+		if (rc)
+			return rc == -ENOENT ? -ESRCH : rc;
+		rc = perf_target_open(TARGET_PID, q->m_pid, &t->perf);
+		/* the checked process might have been replaced meanwhile */
+		if (rc == 0 && (get_start_time(q->m_pid, &check_time) != 0 ||
+				check_time != start_time)) {
+			remove_target(t);
+			rc = -ESRCH;
+		}
+	} else {
+		fd = open(cgroup, O_RDONLY | O_DIRECTORY);
+		if (fd < 0)
+			return -errno;
+		/* only accept directories of a cgroup file system */
+		if (fstatfs(fd, &sfs) != 0 ||
+		    (sfs.f_type != CGROUP_SUPER_MAGIC &&
+		     sfs.f_type != CGROUP2_SUPER_MAGIC)) {
+			close(fd);
+			return -EINVAL;
+		}
+		/* like processes, cgroups must belong to the client */
+		if (cred->uid != 0 &&
+		    (fstat(fd, &st) != 0 || st.st_uid != cred->uid)) {
+			close(fd);
+			return -EPERM;
+		}
+		rc = perf_target_open(TARGET_CGROUP, fd, &t->perf);
+		close(fd);
+	}
+	if (rc)
+		return rc;
+
+	t->kind = q->m_kind;
+	t->pid = q->m_pid;
+	t->start_time = start_time;
+	t->uid = cred->uid;
+	strcpy(t->cgroup, cgroup);
+
+	return 0;
+}
+
+
+static void remove_all_targets(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_TARGETS; i++) {
+		if (targets[i].perf)
+			remove_target(&targets[i]);
+	}
+}
+
+
+/*
+ * Process a query for a process or cgroup, answer with the state and value
+ * of all counters of the target. Only root and the client that added a
+ * target may access it.
+ */
+static int do_target(int s, struct msg_query_target *q)
+{
+	socklen_t len = sizeof(struct ucred);
+	char cgroup[PATH_MAX] = "";
+	uint64_t value[ALL_COUNTER];
+	struct target *t = NULL;
+	struct ucred cred;
+	struct msg m;
+	int i, rc = 0;
+
+	memset(value, 0, sizeof(value));
+	if (getsockopt(s, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+		rc = -errno;
+	} else if (q->m_kind == TARGET_CGROUP) {
+		q->m_cgroup[sizeof(q->m_cgroup) - 1] = '\0';
+		rc = resolve_cgroup(&cred, q->m_cgroup, cgroup);
+	} else if (q->m_kind != TARGET_PID) {
+		rc = -EINVAL;
+	}
+
+	if (rc == 0 && q->m_cmd == TARGET_ADD) {
+		rc = add_target(q, cgroup, &cred);
+		if (rc && q->m_kind == TARGET_PID)
+			eprint("Couldn't add counters for pid %d, error %d\n",
+			       q->m_pid, rc);
+		else if (rc)
+			eprint("Couldn't add counters for cgroup '%s', error %d\n",
+			       cgroup, rc);
+	}
+	if (rc == 0) {
+		t = find_target(q, cgroup);
+		if (!t)
+			rc = -ENOENT;
+		else if (cred.uid != 0 && t->uid != cred.uid)
+			rc = -EPERM;
+	}
+	if (rc == 0) {
+		switch (q->m_cmd) {
+		case TARGET_REMOVE:
+			remove_target(t);
+			break;
+		case TARGET_RESET:
+			rc = perf_target_reset(t->perf);
+			break;
+		case TARGET_ADD:
+		case TARGET_PRINT:
+			rc = perf_target_read(t->perf, value);
+			break;
+		default:
+			rc = -EINVAL;
+			break;
+		}
+	}
+
+	memset(&m, 0, sizeof(m));
+
+	m.head.m_ver = VERSION;
+	m.head.m_type = ANSWER_ALL;
+	m.answer_all.m_count = ALL_COUNTER;
+	for (i = 0; i < ALL_COUNTER; i++) {
+		if (rc)
+			m.answer_all.m_ctr[i].m_state = rc;
+		else if (i == ECC_FUNCTIONS && !perf_ecc_supported())
+			m.answer_all.m_ctr[i].m_state = UNSUPPORTED;
+		else if (q->m_cmd == TARGET_REMOVE)
+			m.answer_all.m_ctr[i].m_state = DISABLED;
+		else
+			m.answer_all.m_ctr[i].m_state = ENABLED;
+		m.answer_all.m_ctr[i].m_value = value[i];
+	}
+	send_msg(s, &m);
+
+	return rc;
+}
+
 
 static int become_daemon(void)
 {
@@ -332,6 +690,8 @@ void signalhandler(int sig)
 		eprint("Caught signal %d, terminating...\n", sig);
 
 	remove_sock();
+	shm_remove();
+	remove_all_targets();
 	perf_close();
 	remove_pidfile();
 
@@ -361,10 +721,40 @@ int eprint(const char *format, ...)
 }
 
 
+/*
+ * Return the number of milliseconds until the next shared memory update
+ * is due and advance the due time if it has passed
+ */
+static int shm_timeout(struct timespec *due, unsigned long interval)
+{
+	struct timespec now;
+	long ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (due->tv_sec - now.tv_sec) * 1000 +
+		(due->tv_nsec - now.tv_nsec) / 1000000;
+	if (ms > 0)
+		return ms;
+
+	/* do not try to catch up missed updates */
+	*due = now;
+	due->tv_sec += interval / 1000;
+	due->tv_nsec += (interval % 1000) * 1000000;
+	if (due->tv_nsec >= 1000000000) {
+		due->tv_sec++;
+		due->tv_nsec -= 1000000000;
+	}
+	return 0;
+}
+
+
 int main(int argc, char *argv[])
 {
 	int rc, sfd, foreground = 0;
+	unsigned long interval = 0;
+	struct timespec due = { 0, 0 };
 	struct sigaction act;
+	char *endp;
 
 	if (argc > 1) {
 		int opt, idx = 0;
@@ -372,10 +762,11 @@ int main(int argc, char *argv[])
 			{ "help", 0, NULL, 'h' },
 			{ "foreground", 0, NULL, 'f' },
 			{ "version", 0, NULL, 'v' },
+			{ "interval", 1, NULL, 'i' },
 			{ NULL, 0, NULL, 0 } };
 		while (1) {
 			opt = getopt_long(argc, argv,
-					  "hfv", long_opts, &idx);
+					  "hfvi:", long_opts, &idx);
 			if (opt == -1)
 				break; /* no more arguments */
 			switch (opt) {
@@ -385,6 +776,16 @@ int main(int argc, char *argv[])
 			case 'f':
 				foreground = 1;
 				break;
+			case 'i':
+				errno = 0;
+				interval = strtoul(optarg, &endp, 10);
+				if (errno || *endp || !*optarg || !interval ||
+				    interval > INT_MAX) {
+					printf("%s: Invalid interval '%s'\n",
+					       name, optarg);
+					exit(1);
+				}
+				break;
 			case 'v':
 				printf("%s: Linux on System z CPACF Crypto Activity Counters Daemon\n"
 				       "Version %s\n%s\n",
@@ -415,6 +816,7 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 	atexit(perf_close);
+	atexit(remove_all_targets);
 
 	if (!perf_ecc_supported())
 		ctr_state[ECC_FUNCTIONS] = UNSUPPORTED;
@@ -426,6 +828,14 @@ int main(int argc, char *argv[])
 	}
 	atexit(remove_sock);
 
+	if (interval) {
+		if (shm_create(interval) != 0) {
+			eprint("Couldn't initialize shared memory export\n");
+			exit(1);
+		}
+		atexit(shm_remove);
+	}
+
 	memset(&act, 0, sizeof(act));
 	act.sa_handler = signalhandler;
 	act.sa_flags = 0;
@@ -445,8 +855,21 @@ int main(int argc, char *argv[])
 	while (1) {
 		enum ctr_e ctr;
 		enum cmd_e cmd;
+		struct msg m;
 		int s;
 
+		if (interval) {
+			struct pollfd pfd = { .fd = sfd, .events = POLLIN };
+			int timeout = shm_timeout(&due, interval);
+
+			if (timeout == 0) {
+				shm_update(ctr_state);
+				continue;
+			}
+			if (poll(&pfd, 1, timeout) <= 0)
+				continue;
+		}
+
 		s = accept(sfd, NULL, NULL);
 		if (s < 0) {
 			if (errno == EINTR)
@@ -456,11 +879,17 @@ int main(int argc, char *argv[])
 			exit(1);
 		}
 
-		rc = recv_query(s, &ctr, &cmd);
+		rc = recv_query(s, &m);
 		if (rc != 0) {
 			eprint("Recv_query() failed, ignoring\n");
 			goto cleanup;
 		}
+		if (m.head.m_type == QUERY_TARGET) {
+			rc = do_target(s, &m.query_target);
+			goto cleanup;
+		}
+		ctr = m.query.m_ctr;
+		cmd = m.query.m_cmd;
 
 		if (cmd == ENABLE)
 			rc = do_enable(s, ctr);
@@ -470,12 +899,18 @@ int main(int argc, char *argv[])
 			rc = do_reset(s, ctr);
 		else if (cmd == PRINT)
 			rc = do_print(s, ctr);
+		else if (cmd == PRINT_ALL)
+			rc = do_print_all(s);
 		else {
 			eprint("Received unknown command %d, ignoring\n",
 			       (int) cmd);
 			goto cleanup;
 		}
 
+		/* make state changes visible without waiting for the interval */
+		if (cmd == ENABLE || cmd == DISABLE || cmd == RESET)
+			shm_update(ctr_state);
+
 cleanup:
 		close(s);
 	}
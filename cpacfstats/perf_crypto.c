@@ -10,6 +10,7 @@
  */
 
 #include <asm/unistd.h>
+#include <dirent.h>
 #include <errno.h>
 #include <getopt.h>
 #define __STDC_FORMAT_MACROS
@@ -56,6 +57,24 @@ static const struct {
  */
 static int *ctr_fds[ALL_COUNTER];
 
+/*
+ * To read all counters at the same time, the counter events of each CPU
+ * are members of a perf event group:
+ *
+ * grp_fds - file descriptor array of the group leaders, one per CPU,
+ * terminated by 0 like the ctr_fds arrays. The leader is an always
+ * enabled software dummy event so that the counters can still be enabled
+ * and disabled individually.
+ *
+ * grp_idx - position of each counter in the values of a group read,
+ * 0 for counters that are not opened. Position 0 is the leader itself.
+ *
+ * If the kernel does not support the group, grp_fds is NULL and the
+ * counters are read one after the other.
+ */
+static int *grp_fds;
+static int grp_idx[ALL_COUNTER];
+
 static int ecc_supported;
 
 static long perf_event_open(struct perf_event_attr *hw_event, pid_t pid,
@@ -131,23 +150,84 @@ static int perf_event_encode(struct perf_event_attr *attr,
 	return 0;
 }
 
-int perf_init(void)
+/*
+ * Encode the perf event attributes for a counter
+ */
+static int ctr_event_encode(int ctr, struct perf_event_attr *attr)
 {
-	int i, cpus, ctr, cpu, *fds;
+	int i;
+
+	/* search for the counter's corresponding pfm name */
+	for (i = ALL_COUNTER-1; i >= 0; i--)
+		if ((int) pmf_counter_name[i].ctr == ctr)
+			break;
+	if (i < 0) {
+		eprint("Pfm ctr name not found for counter %d, please adjust pmf_counter_name[] in %s\n",
+		       ctr, __FILE__);
+		return -1;
+	}
 
-	memset(ctr_fds, 0, sizeof(ctr_fds));
+	memset(attr, 0, sizeof(*attr));
+	attr->size = sizeof(*attr);
+	if (perf_event_encode(attr, pmf_counter_name[i].pmu,
+			      pmf_counter_name[i].pfm_name)) {
+		eprint("Failed to initialize counter %s for pmu %s\n",
+		       pmf_counter_name[i].pfm_name,
+		       pmf_counter_name[i].pmu);
+		return -1;
+	}
 
-	/*  initialize performance monitoring library */
-	if (!perf_supported()) {
-		eprint("Performance counter not supported");
+	return 0;
+}
+
+static int *alloc_fds(int cpus)
+{
+	int *fds;
+
+	/*
+	 * allocate an array of ints to store for each CPU
+	 * one filedescriptor + a terminating 0
+	 */
+	fds = (int *) calloc(sizeof(int), cpus+1);
+	if (!fds)
+		eprint("Malloc() of %d byte failed, errno=%d [%s]\n",
+		       (int)(sizeof(int) * (cpus+1)), errno, strerror(errno));
+	return fds;
+}
+
+/*
+ * Open the group leaders, one for each CPU
+ */
+static int perf_open_groups(int cpus)
+{
+	struct perf_event_attr grp_event;
+	int cpu, fd;
+
+	grp_fds = alloc_fds(cpus);
+	if (!grp_fds)
 		return -1;
+
+	for (cpu = 0; cpu < cpus; cpu++) {
+		memset(&grp_event, 0, sizeof(grp_event));
+		grp_event.size = sizeof(grp_event);
+		grp_event.type = PERF_TYPE_SOFTWARE;
+		grp_event.config = PERF_COUNT_SW_DUMMY;
+		grp_event.read_format = PERF_FORMAT_GROUP;
+		fd = perf_event_open(&grp_event, -1, cpu, -1, 0);
+		if (fd < 0)
+			return -1;
+		grp_fds[cpu] = fd;
 	}
 
-	/* Check if ECC is supported on current hardware */
-	ecc_supported = perf_counter_supported("cpum_cf", "ECC_FUNCTION_COUNT");
+	return 0;
+}
 
-	/* get number of logical processors */
-	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+/*
+ * Open the counter events, as group members if grouped is set
+ */
+static int perf_open_ctrs(int cpus, int grouped)
+{
+	int ctr, cpu, idx = 1, *fds;
 
 	/* for each counter */
 	for (ctr = 0; ctr < ALL_COUNTER; ctr++) {
@@ -156,44 +236,18 @@ int perf_init(void)
 		if (ctr == ECC_FUNCTIONS && !ecc_supported)
 			continue;
 
-		/*
-		 * allocate an array of ints to store for each CPU
-		 * one filedescriptor + a terminating 0
-		 */
-		fds = (int *) calloc(sizeof(int), cpus+1);
-		if (!fds) {
-			eprint("Malloc() of %d byte failed, errno=%d [%s]\n",
-			       (int)(sizeof(int) * (cpus+1)),
-			       errno, strerror(errno));
+		fds = alloc_fds(cpus);
+		if (!fds)
 			return -1;
-		}
 
 		ctr_fds[ctr] = fds;
 
-		/* search for the counter's corresponding pfm name */
-		for (i = ALL_COUNTER-1; i >= 0; i--)
-			if ((int) pmf_counter_name[i].ctr == ctr)
-				break;
-		if (i < 0) {
-			eprint("Pfm ctr name not found for counter %d, please adjust pmf_counter_name[] in %s\n",
-			       ctr, __FILE__);
-			return -1;
-		}
-
 		for (cpu = 0; cpu < cpus; cpu++) {
 			struct perf_event_attr pfm_event;
 			int fd;
 
-			memset(&pfm_event, 0, sizeof(pfm_event));
-			pfm_event.size = sizeof(pfm_event);
-			if (perf_event_encode(&pfm_event,
-					      pmf_counter_name[i].pmu,
-					      pmf_counter_name[i].pfm_name)) {
-				eprint("Failed to initialize counter %s for pmu %s\n",
-				       pmf_counter_name[i].pfm_name,
-				       pmf_counter_name[i].pmu);
+			if (ctr_event_encode(ctr, &pfm_event))
 				return -1;
-			}
 
 			/* fetch file descriptor for this perf event
 			 * the counter event should start disabled
@@ -203,20 +257,50 @@ int perf_init(void)
 				&pfm_event,
 				-1,  /* pid -1 means all processes */
 				cpu,
-				-1,  /* group filedescriptor */
+				grouped ? grp_fds[cpu] : -1,
 				0);  /* flags */
 			if (fd < 0) {
-				eprint("Perf_event_open() failed with errno=%d [%s]\n",
-				       errno, strerror(errno));
+				if (!grouped)
+					eprint("Perf_event_open() failed with errno=%d [%s]\n",
+					       errno, strerror(errno));
 				return -1;
 			}
 			fds[cpu] = fd;
 		}
+		grp_idx[ctr] = grouped ? idx++ : 0;
 	}
 
 	return 0;
 }
 
+int perf_init(void)
+{
+	int cpus;
+
+	memset(ctr_fds, 0, sizeof(ctr_fds));
+	memset(grp_idx, 0, sizeof(grp_idx));
+	grp_fds = NULL;
+
+	/*  initialize performance monitoring library */
+	if (!perf_supported()) {
+		eprint("Performance counter not supported");
+		return -1;
+	}
+
+	/* Check if ECC is supported on current hardware */
+	ecc_supported = perf_counter_supported("cpum_cf", "ECC_FUNCTION_COUNT");
+
+	/* get number of logical processors */
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* try grouped counters first, fall back to single counters */
+	if (perf_open_groups(cpus) == 0 && perf_open_ctrs(cpus, 1) == 0)
+		return 0;
+	perf_close();
+
+	return perf_open_ctrs(cpus, 0);
+}
+
 
 void perf_close(void)
 {
@@ -229,7 +313,12 @@ void perf_close(void)
 		}
 		free(ctr_fds[ctr]);
 		ctr_fds[ctr] = NULL;
+		grp_idx[ctr] = 0;
 	}
+	for (fds = grp_fds; fds && *fds; fds++)
+		close(*fds);
+	free(grp_fds);
+	grp_fds = NULL;
 }
 
 
@@ -331,6 +420,237 @@ int perf_read_ctr(enum ctr_e ctr, uint64_t *value)
 	return rc;
 }
 
+/*
+ * Read all counters with one read per CPU on the group leader
+ */
+static int perf_read_groups(uint64_t value[ALL_COUNTER])
+{
+	struct {
+		uint64_t nr;
+		uint64_t values[ALL_COUNTER + 1];
+	} buf;
+	int *fds, ctr, rc = -1;
+	ssize_t ec;
+
+	for (fds = grp_fds; *fds; fds++) {
+		ec = read(*fds, &buf, sizeof(buf));
+		if (ec < (ssize_t) sizeof(buf.nr) ||
+		    ec < (ssize_t) ((buf.nr + 1) * sizeof(uint64_t))) {
+			eprint("Read() on perf group file descriptor failed with errno=%d [%s]\n",
+			       errno, strerror(errno));
+			continue;
+		}
+		for (ctr = 0; ctr < ALL_COUNTER; ctr++) {
+			if (grp_idx[ctr] && grp_idx[ctr] < (int) buf.nr)
+				value[ctr] += buf.values[grp_idx[ctr]];
+		}
+		rc = 0;
+	}
+
+	return rc;
+}
+
+/*
+ * Read all counters at once, counters that are not opened read as 0
+ */
+int perf_read_all(uint64_t value[ALL_COUNTER])
+{
+	int ctr, rc = 0;
+
+	memset(value, 0, ALL_COUNTER * sizeof(uint64_t));
+	if (grp_fds)
+		return perf_read_groups(value);
+
+	for (ctr = 0; ctr < ALL_COUNTER; ctr++) {
+		if (!ctr_fds[ctr])
+			continue;
+		if (perf_read_ctr(ctr, &value[ctr]) != 0)
+			rc = -1;
+	}
+
+	return rc;
+}
+
+/*
+ * Counters of a single process or cgroup
+ *
+ * For a process there is one file descriptor per thread and counter, the
+ * counters are inherited by threads and processes created later on. For
+ * a cgroup there is one file descriptor per CPU and counter. The arrays
+ * are terminated by 0 like the ctr_fds arrays.
+ */
+struct perf_target {
+	int *fds[ALL_COUNTER];
+};
+
+/*
+ * Get the IDs of all threads of a process
+ */
+static int get_tids(int pid, int **tids)
+{
+	char path[PATH_MAX];
+	struct dirent *de;
+	int n = 0, size = 16;
+	DIR *dir;
+
+	snprintf(path, sizeof(path), "/proc/%d/task", pid);
+	dir = opendir(path);
+	if (!dir)
+		return -ESRCH;
+	*tids = malloc(size * sizeof(int));
+	if (!*tids) {
+		closedir(dir);
+		return -ENOMEM;
+	}
+	while ((de = readdir(dir)) != NULL) {
+		if (de->d_name[0] == '.')
+			continue;
+		if (n == size) {
+			int *tmp = realloc(*tids, 2 * size * sizeof(int));
+
+			if (!tmp) {
+				free(*tids);
+				closedir(dir);
+				return -ENOMEM;
+			}
+			*tids = tmp;
+			size *= 2;
+		}
+		(*tids)[n++] = atoi(de->d_name);
+	}
+	closedir(dir);
+
+	return n ? n : -ESRCH;
+}
+
+/*
+ * Open counters for a process (kind TARGET_PID, id is the PID) or a cgroup
+ * (kind TARGET_CGROUP, id is a file descriptor of the cgroup directory)
+ *
+ * Returns 0 on success or a negative errno value.
+ */
+int perf_target_open(enum target_e kind, int id, struct perf_target **target)
+{
+	struct perf_event_attr pfm_event;
+	int i, j, n, ctr, fd, rc = 0;
+	struct perf_target *t;
+	int *tids = NULL;
+
+	if (kind == TARGET_PID) {
+		n = get_tids(id, &tids);
+		if (n < 0)
+			return n;
+	} else {
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+
+	t = calloc(1, sizeof(*t));
+	if (!t) {
+		free(tids);
+		return -ENOMEM;
+	}
+
+	for (ctr = 0; ctr < ALL_COUNTER && rc == 0; ctr++) {
+		if (ctr == ECC_FUNCTIONS && !ecc_supported)
+			continue;
+		t->fds[ctr] = alloc_fds(n);
+		if (!t->fds[ctr]) {
+			rc = -ENOMEM;
+			break;
+		}
+		if (ctr_event_encode(ctr, &pfm_event)) {
+			rc = -ENODEV;
+			break;
+		}
+		for (i = j = 0; i < n; i++) {
+			if (kind == TARGET_PID) {
+				/* count new threads and children too */
+				pfm_event.inherit = 1;
+				fd = perf_event_open(&pfm_event, tids[i], -1,
+						     -1, 0);
+				/* thread may have exited meanwhile */
+				if (fd < 0 && errno == ESRCH)
+					continue;
+			} else {
+				fd = perf_event_open(&pfm_event, id, i, -1,
+						     PERF_FLAG_PID_CGROUP);
+			}
+			if (fd < 0) {
+				rc = -errno;
+				eprint("Perf_event_open() failed with errno=%d [%s]\n",
+				       errno, strerror(errno));
+				break;
+			}
+			t->fds[ctr][j++] = fd;
+		}
+	}
+	free(tids);
+
+	if (rc) {
+		perf_target_close(t);
+		return rc;
+	}
+	*target = t;
+
+	return 0;
+}
+
+void perf_target_close(struct perf_target *t)
+{
+	int ctr, *fds;
+
+	if (!t)
+		return;
+	for (ctr = 0; ctr < ALL_COUNTER; ctr++) {
+		for (fds = t->fds[ctr]; fds && *fds; fds++)
+			close(*fds);
+		free(t->fds[ctr]);
+	}
+	free(t);
+}
+
+int perf_target_reset(struct perf_target *t)
+{
+	int ctr, *fds, rc = 0;
+
+	for (ctr = 0; ctr < ALL_COUNTER; ctr++) {
+		for (fds = t->fds[ctr]; fds && *fds; fds++) {
+			if (ioctl(*fds, PERF_EVENT_IOC_RESET, 0) < 0) {
+				eprint("Ioctl(PERF_EVENT_IOC_RESET) failed with errno=%d [%s]\n",
+				       errno, strerror(errno));
+				rc = -1;
+			}
+		}
+	}
+
+	return rc;
+}
+
+/*
+ * Read the counters of a process or cgroup, counters that are not opened
+ * read as 0
+ */
+int perf_target_read(struct perf_target *t, uint64_t value[ALL_COUNTER])
+{
+	int ctr, *fds, rc = 0;
+	uint64_t val;
+
+	for (ctr = 0; ctr < ALL_COUNTER; ctr++) {
+		value[ctr] = 0;
+		for (fds = t->fds[ctr]; fds && *fds; fds++) {
+			if (read(*fds, &val, sizeof(val)) != sizeof(val)) {
+				eprint("Read() on perf file descriptor failed with errno=%d [%s]\n",
+				       errno, strerror(errno));
+				rc = -1;
+			} else {
+				value[ctr] += val;
+			}
+		}
+	}
+
+	return rc;
+}
+
 int  perf_ecc_supported(void)
 {
 	return ecc_supported;
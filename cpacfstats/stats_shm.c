@@ -0,0 +1,137 @@
+/*
+ * cpacfstats - display and maintain CPACF perf counters
+ *
+ * shared memory export of the counter values
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cpacfstats.h"
+
+static struct shm_counters *shm;
+static size_t shm_size;
+
+
+int shm_create(unsigned long interval)
+{
+	struct group *grp;
+	int fd;
+
+	grp = getgrnam(CPACFSTATS_GROUP);
+	if (!grp) {
+		eprint("Getgrnam() failed, group '%s' may not exist on this system ?\n",
+		       CPACFSTATS_GROUP);
+		return -1;
+	}
+
+	remove(SHM_FILE);
+	fd = open(SHM_FILE, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		eprint("Open('%s') failed, errno=%d [%s]\n",
+		       SHM_FILE, errno, strerror(errno));
+		return -1;
+	}
+
+	/* members of the group may only read the counters */
+	if (fchown(fd, 0, grp->gr_gid) ||
+	    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP)) {
+		eprint("Changing owner of '%s' failed, errno=%d [%s]\n",
+		       SHM_FILE, errno, strerror(errno));
+		goto out_remove;
+	}
+
+	shm_size = sysconf(_SC_PAGESIZE);
+	if (shm_size < sizeof(*shm))
+		shm_size = sizeof(*shm);
+	if (ftruncate(fd, shm_size)) {
+		eprint("Ftruncate('%s') failed, errno=%d [%s]\n",
+		       SHM_FILE, errno, strerror(errno));
+		goto out_remove;
+	}
+
+	shm = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED) {
+		eprint("Mmap('%s') failed, errno=%d [%s]\n",
+		       SHM_FILE, errno, strerror(errno));
+		shm = NULL;
+		goto out_remove;
+	}
+	close(fd);
+
+	shm->version = SHM_VERSION;
+	shm->count = ALL_COUNTER;
+	shm->interval = interval;
+	/* readers check the magic last */
+	__atomic_store_n(&shm->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+	return 0;
+
+out_remove:
+	close(fd);
+	remove(SHM_FILE);
+	return -1;
+}
+
+
+/*
+ * Read all counters and publish the values of the enabled counters
+ */
+void shm_update(const int state[ALL_COUNTER])
+{
+	struct shm_ctr ctr[ALL_COUNTER];
+	uint64_t value[ALL_COUNTER];
+	struct timespec ts;
+	uint32_t seq;
+	int i, rc;
+
+	if (!shm)
+		return;
+
+	rc = perf_read_all(value);
+	memset(ctr, 0, sizeof(ctr));
+	for (i = 0; i < ALL_COUNTER; i++) {
+		if (state[i] == ENABLED) {
+			ctr[i].state = rc ? rc : ENABLED;
+			ctr[i].value = rc ? 0 : value[i];
+		} else {
+			ctr[i].state = state[i];
+		}
+	}
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	/* mark update in progress before any data is changed */
+	seq = shm->seq;
+	__atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy(shm->ctr, ctr, sizeof(ctr));
+	shm->timestamp = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+	/* publish the data */
+	__atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+void shm_remove(void)
+{
+	if (!shm)
+		return;
+	munmap(shm, shm_size);
+	shm = NULL;
+	remove(SHM_FILE);
+}
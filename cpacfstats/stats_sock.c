@@ -161,6 +161,12 @@ int send_msg(int sfd, struct msg *m)
 	case ANSWER:
 		len += sizeof(m->answer);
 		break;
+	case ANSWER_ALL:
+		len += sizeof(m->answer_all);
+		break;
+	case QUERY_TARGET:
+		len += sizeof(m->query_target);
+		break;
 	default:
 		eprint("Unknown type %d\n", m->head.m_type);
 		return -1;
@@ -195,6 +201,12 @@ int recv_msg(int sfd, struct msg *m)
 	case ANSWER:
 		len = sizeof(m->answer);
 		break;
+	case ANSWER_ALL:
+		len = sizeof(m->answer_all);
+		break;
+	case QUERY_TARGET:
+		len = sizeof(m->query_target);
+		break;
 	default:
 		eprint("Unknown type %d\n", m->head.m_type);
 		return -1;
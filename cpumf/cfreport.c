@@ -0,0 +1,458 @@
+/*
+ * Interval report of CPU Measurement counter facility counters
+ *
+ * The counters of each counter set are opened as one perf event group per
+ * CPU, so that one read returns all counters of the set at the same time.
+ * At the end of each interval the deltas of all CPUs are printed together
+ * with derived metrics.
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib/util_base.h"
+#include "lib/util_libc.h"
+
+#include "cfreport.h"
+
+/* Derived metrics */
+enum metric {
+	M_CPI,			/* Cycles per instruction */
+	M_PROBLEM,		/* Problem-state instructions in percent */
+	M_L1I,			/* L1 instruction cache misses per 100 instr. */
+	M_L1D,			/* L1 data cache misses per 100 instructions */
+	M_L1I_PEN,		/* Penalty cycles per L1I miss */
+	M_L1D_PEN,		/* Penalty cycles per L1D miss */
+	M_TLB,			/* TLB misses per 100 instructions */
+	M_TLB_CYC,		/* Cycles with TLB miss in progress in percent */
+	M_CRYPTO,		/* CPACF functions per second */
+	M_CNT
+};
+
+static const char *const metric_hdr[M_CNT] = {
+	"CPI", "Prob%", "L1I/100", "L1D/100", "L1I-pen", "L1D-pen",
+	"TLB/100", "TLB-cyc%", "Crypto/s"
+};
+
+/* Indices of counters used for metrics, see find_counters() */
+enum {
+	I_CYCLES,
+	I_INSTR,
+	I_PS_INSTR,
+	I_L1I_WRITES,
+	I_L1D_WRITES,
+	I_L1I_PEN,
+	I_L1D_PEN,
+	I_ITLB_WRITES,
+	I_DTLB_WRITES,
+	I_ITLB_MISSES,
+	I_DTLB_MISSES,
+	I_CNT
+};
+
+/* Counter of the report */
+struct cf_ctr {
+	struct counters *def;		/* Counter definition */
+	bool avail;			/* Counter could be opened */
+};
+
+/* Counter values of a CPU */
+struct cf_cpu {
+	int cpu;
+	int *fds;			/* File descriptor per counter or -1 */
+	uint64_t *prev;			/* Values at the start of the interval */
+	uint64_t *delta;		/* Deltas of the last interval */
+};
+
+static struct {
+	struct cf_ctr *ctrs;
+	size_t cnt;
+	struct cf_cpu *cpus;
+	int cpu_cnt;
+	uint64_t *total;		/* Deltas summed over all CPUs */
+	uint64_t *buf;			/* Buffer for group reads */
+	int idx[I_CNT];			/* Counter indices for the metrics */
+} l;
+
+static volatile sig_atomic_t stop;
+
+static void sig_stop(int UNUSED(sig))
+{
+	stop = 1;
+}
+
+static int find_counter(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < l.cnt; i++) {
+		if (l.ctrs[i].avail && !strcmp(l.ctrs[i].def->name, name))
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Look up the counters used by the metrics. The extended counter set is
+ * machine specific: older machines have TLB1 counters, newer machines TLB2
+ * counters.
+ */
+static void find_counters(void)
+{
+	l.idx[I_CYCLES] = find_counter("CPU_CYCLES");
+	l.idx[I_INSTR] = find_counter("INSTRUCTIONS");
+	l.idx[I_PS_INSTR] = find_counter("PROBLEM_STATE_INSTRUCTIONS");
+	l.idx[I_L1I_WRITES] = find_counter("L1I_DIR_WRITES");
+	l.idx[I_L1D_WRITES] = find_counter("L1D_DIR_WRITES");
+	l.idx[I_L1I_PEN] = find_counter("L1I_PENALTY_CYCLES");
+	l.idx[I_L1D_PEN] = find_counter("L1D_PENALTY_CYCLES");
+	l.idx[I_ITLB_WRITES] = find_counter("ITLB1_WRITES");
+	l.idx[I_DTLB_WRITES] = find_counter("DTLB1_WRITES");
+	l.idx[I_ITLB_MISSES] = find_counter("ITLB1_MISSES");
+	l.idx[I_DTLB_MISSES] = find_counter("DTLB1_MISSES");
+	if (l.idx[I_ITLB_WRITES] < 0 && l.idx[I_DTLB_WRITES] < 0) {
+		l.idx[I_ITLB_WRITES] = find_counter("ITLB2_WRITES");
+		l.idx[I_DTLB_WRITES] = find_counter("DTLB2_WRITES");
+		l.idx[I_ITLB_MISSES] = find_counter("ITLB2_MISSES");
+		l.idx[I_DTLB_MISSES] = find_counter("DTLB2_MISSES");
+	}
+}
+
+/*
+ * Return the delta of a metric counter, false if it is not available
+ */
+static bool get(uint64_t *delta, int i, double *val)
+{
+	if (l.idx[i] < 0)
+		return false;
+	*val = delta[l.idx[i]];
+	return true;
+}
+
+/*
+ * Return the sum of two metric counters, at least one must be available
+ */
+static bool get2(uint64_t *delta, int i, int j, double *val)
+{
+	double a = 0, b = 0;
+	bool ok;
+
+	ok = get(delta, i, &a);
+	ok |= get(delta, j, &b);
+	*val = a + b;
+	return ok;
+}
+
+static bool is_crypto_function(struct counters *def)
+{
+	return def->ctrset == CPUMF_CTRSET_CRYPTO &&
+		strstr(def->name, "FUNCTION") && !strstr(def->name, "BLOCKED");
+}
+
+/*
+ * Compute derived metrics from counter deltas, metrics that can not be
+ * computed are set to -1
+ */
+static void compute_metrics(uint64_t *delta, double secs, double *m)
+{
+	double cyc, ins, a, b;
+	size_t i;
+
+	for (i = 0; i < M_CNT; i++)
+		m[i] = -1;
+	if (!get(delta, I_INSTR, &ins) || !ins)
+		ins = 0;
+	if (get(delta, I_CYCLES, &cyc) && ins)
+		m[M_CPI] = cyc / ins;
+	if (get(delta, I_PS_INSTR, &a) && ins)
+		m[M_PROBLEM] = 100 * a / ins;
+	if (get(delta, I_L1I_WRITES, &a) && ins)
+		m[M_L1I] = 100 * a / ins;
+	if (get(delta, I_L1D_WRITES, &a) && ins)
+		m[M_L1D] = 100 * a / ins;
+	if (get(delta, I_L1I_PEN, &a) && get(delta, I_L1I_WRITES, &b) && b)
+		m[M_L1I_PEN] = a / b;
+	if (get(delta, I_L1D_PEN, &a) && get(delta, I_L1D_WRITES, &b) && b)
+		m[M_L1D_PEN] = a / b;
+	if (get2(delta, I_ITLB_WRITES, I_DTLB_WRITES, &a) && ins)
+		m[M_TLB] = 100 * a / ins;
+	if (get2(delta, I_ITLB_MISSES, I_DTLB_MISSES, &a) &&
+	    get(delta, I_CYCLES, &cyc) && cyc)
+		m[M_TLB_CYC] = 100 * a / cyc;
+	for (i = 0, a = 0, b = 0; i < l.cnt; i++) {
+		if (l.ctrs[i].avail && is_crypto_function(l.ctrs[i].def)) {
+			a += delta[i];
+			b = 1;
+		}
+	}
+	if (b)
+		m[M_CRYPTO] = a / secs;
+}
+
+static void print_metrics(const char *cpu, uint64_t *delta, double secs)
+{
+	double m[M_CNT];
+	int i;
+
+	compute_metrics(delta, secs, m);
+	printf("%-5s", cpu);
+	for (i = 0; i < M_CNT; i++) {
+		if (m[i] < 0)
+			printf(" %9s", "-");
+		else
+			printf(" %9.2f", m[i]);
+	}
+	printf("\n");
+}
+
+static void print_report(unsigned int nr, double secs)
+{
+	char cpu[16];
+	size_t i;
+	int c;
+
+	printf("\nInterval %u (%.2f seconds)\n", nr, secs);
+	printf("%-5s", "CPU");
+	for (i = 0; i < M_CNT; i++)
+		printf(" %9s", metric_hdr[i]);
+	printf("\n");
+	for (c = 0; c < l.cpu_cnt; c++) {
+		snprintf(cpu, sizeof(cpu), "%d", l.cpus[c].cpu);
+		print_metrics(cpu, l.cpus[c].delta, secs);
+	}
+	print_metrics("all", l.total, secs);
+
+	printf("\n%-5s %-40s %20s\n", "Ctr", "Counter (all CPUs)", "Delta");
+	for (i = 0; i < l.cnt; i++) {
+		if (!l.ctrs[i].avail || !l.total[i])
+			continue;
+		printf("%-5d %-40s %20lu\n", l.ctrs[i].def->ctrnum,
+		       l.ctrs[i].def->name, (unsigned long)l.total[i]);
+	}
+}
+
+/*
+ * Read all counter groups of a CPU, compute the deltas and add them to
+ * the totals
+ */
+static int read_cpu(struct cf_cpu *cc)
+{
+	size_t first, end, pos, n;
+	int leader;
+	uint64_t val;
+	ssize_t len;
+
+	for (first = 0; first < l.cnt; first = end) {
+		/* Group leader is the first opened counter of the set */
+		leader = -1;
+		for (end = first; end < l.cnt &&
+		     l.ctrs[end].def->ctrset == l.ctrs[first].def->ctrset; end++)
+			if (leader < 0 && cc->fds[end] >= 0)
+				leader = cc->fds[end];
+		if (leader < 0)
+			continue;
+		len = read(leader, l.buf, (l.cnt + 1) * sizeof(*l.buf));
+		if (len < (ssize_t)sizeof(*l.buf) ||
+		    len < (ssize_t)((l.buf[0] + 1) * sizeof(*l.buf))) {
+			linux_error("Can not read counters");
+			return -1;
+		}
+		/* Group values are in the order the counters were opened */
+		for (pos = first, n = 1; pos < end && n <= l.buf[0]; pos++) {
+			if (cc->fds[pos] < 0)
+				continue;
+			val = l.buf[n++];
+			cc->delta[pos] = val - cc->prev[pos];
+			cc->prev[pos] = val;
+			l.total[pos] += cc->delta[pos];
+		}
+	}
+	return 0;
+}
+
+static int counter_open(int type, struct counters *def, int cpu, int group)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = def->ctrnum;
+	if (group < 0)
+		attr.read_format = PERF_FORMAT_GROUP;
+	return syscall(__NR_perf_event_open, &attr, -1, cpu, group, 0);
+}
+
+/*
+ * Open the counter groups of a CPU. Counters that can not be opened on the
+ * first CPU are left out on all CPUs.
+ */
+static int open_cpu(int type, struct cf_cpu *cc, bool first_cpu)
+{
+	int leader = -1, set = -1;
+	size_t i;
+
+	for (i = 0; i < l.cnt; i++) {
+		cc->fds[i] = -1;
+		if (l.ctrs[i].def->ctrset != set) {
+			set = l.ctrs[i].def->ctrset;
+			leader = -1;
+		}
+		if (!l.ctrs[i].avail)
+			continue;
+		cc->fds[i] = counter_open(type, l.ctrs[i].def, cc->cpu, leader);
+		if (cc->fds[i] < 0) {
+			if (first_cpu && errno != EMFILE && errno != ENODEV) {
+				l.ctrs[i].avail = false;
+				continue;
+			}
+			return -1;
+		}
+		if (leader < 0)
+			leader = cc->fds[i];
+	}
+	return 0;
+}
+
+static void close_cpu(struct cf_cpu *cc)
+{
+	size_t i;
+
+	for (i = 0; i < l.cnt; i++) {
+		if (cc->fds[i] >= 0)
+			close(cc->fds[i]);
+	}
+}
+
+/*
+ * Raise the open file limit, each counter needs one file descriptor per CPU
+ */
+static void raise_nofile(unsigned long need)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl))
+		return;
+	if (rl.rlim_cur >= need + 64)
+		return;
+	rl.rlim_cur = MIN(need + 64, rl.rlim_max);
+	setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Report the counters "ctrs" of the counter facility PMU "type" every
+ * "interval" seconds, "count" times or until interrupted if count is 0.
+ * The counters must be ordered by counter set.
+ */
+int cfreport_run(int type, struct counters **ctrs, size_t cnt,
+		 unsigned int interval, unsigned int count)
+{
+	int cpus, c, err, rc = EXIT_FAILURE;
+	struct timespec ts;
+	struct sigaction sa;
+	unsigned int nr;
+	double start, t;
+	size_t i;
+
+	cpus = sysconf(_SC_NPROCESSORS_CONF);
+	l.cnt = cnt;
+	l.ctrs = util_zalloc(cnt * sizeof(*l.ctrs));
+	for (i = 0; i < cnt; i++) {
+		l.ctrs[i].def = ctrs[i];
+		l.ctrs[i].avail = true;
+	}
+	l.cpus = util_zalloc(cpus * sizeof(*l.cpus));
+	l.total = util_zalloc(cnt * sizeof(*l.total));
+	l.buf = util_zalloc((cnt + 1) * sizeof(*l.buf));
+	raise_nofile(cnt * cpus);
+
+	for (c = 0; c < cpus; c++) {
+		struct cf_cpu *cc = &l.cpus[l.cpu_cnt];
+
+		cc->cpu = c;
+		cc->fds = util_malloc(cnt * sizeof(*cc->fds));
+		cc->prev = util_zalloc(cnt * sizeof(*cc->prev));
+		cc->delta = util_zalloc(cnt * sizeof(*cc->delta));
+		if (open_cpu(type, cc, l.cpu_cnt == 0)) {
+			err = errno;
+			close_cpu(cc);
+			free(cc->fds);
+			free(cc->prev);
+			free(cc->delta);
+			/* Offline CPUs can not be measured */
+			if (err == ENODEV)
+				continue;
+			errno = err;
+			linux_error("Can not open counters");
+			goto out;
+		}
+		l.cpu_cnt++;
+	}
+	if (!l.cpu_cnt) {
+		fprintf(stderr, "No CPU can be measured\n");
+		goto out;
+	}
+	find_counters();
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig_stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	for (c = 0; c < l.cpu_cnt; c++) {
+		if (read_cpu(&l.cpus[c]))
+			goto out;
+	}
+	start = now();
+	for (nr = 1; !stop && (!count || nr <= count); nr++) {
+		ts.tv_sec = interval;
+		ts.tv_nsec = 0;
+		while (nanosleep(&ts, &ts) && errno == EINTR && !stop)
+			;
+		memset(l.total, 0, cnt * sizeof(*l.total));
+		for (c = 0; c < l.cpu_cnt; c++) {
+			if (read_cpu(&l.cpus[c]))
+				goto out;
+		}
+		t = now();
+		print_report(nr, t - start);
+		fflush(stdout);
+		start = t;
+	}
+	rc = EXIT_SUCCESS;
+out:
+	for (c = 0; c < l.cpu_cnt; c++) {
+		close_cpu(&l.cpus[c]);
+		free(l.cpus[c].fds);
+		free(l.cpus[c].prev);
+		free(l.cpus[c].delta);
+	}
+	free(l.cpus);
+	free(l.ctrs);
+	free(l.total);
+	free(l.buf);
+	return rc;
+}
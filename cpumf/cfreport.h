@@ -0,0 +1,18 @@
+/*
+ * Interval report of CPU Measurement counter facility counters
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef CFREPORT_H
+#define	CFREPORT_H
+
+#include "defines.h"
+
+int cfreport_run(int type, struct counters **ctrs, size_t cnt,
+		 unsigned int interval, unsigned int count);
+
+#endif
@@ -15,6 +15,20 @@
 #define	PERF_SF		"cpum_sf"
 #define	PERF_CF		"cpum_cf"
 
+#define CPUMF_CTRSET_NONE               0
+#define CPUMF_CTRSET_BASIC              2
+#define CPUMF_CTRSET_PROBLEM_STATE      4
+#define CPUMF_CTRSET_CRYPTO             8
+#define CPUMF_CTRSET_EXTENDED           1
+#define CPUMF_CTRSET_MT_DIAG            32
+
+struct counters {
+	int ctrnum;
+	int ctrset;
+	char *name;
+	char *desc;
+};
+
 static inline void linux_error(const char *message)
 {
 	fprintf(stderr, "Error: %s: %s\n", message, strerror(errno));
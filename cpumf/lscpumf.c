@@ -26,15 +26,20 @@
 #include "lib/util_opt.h"
 #include "lib/util_prg.h"
 #include "lib/util_base.h"
+#include "lib/util_libc.h"
 
 #include "defines.h"
+#include "cfreport.h"
+#include "sfprof.h"
 
 #define	ACTION_NONE	0
 #define	ACTION_INFO	1
 #define	ACTION_CNT	2
 #define	ACTION_CNTALL	3
 #define	ACTION_SAMPLE	4
-static bool actions[ACTION_SAMPLE + 1];	/* Specified command line options */
+#define	ACTION_PROFILE	5
+#define	ACTION_REPORT	6
+static bool actions[ACTION_REPORT + 1];	/* Specified command line options */
 
 /* This defines the number of pages a Sample Data Buffer Table (SDBT) can hold
  * as payload data. Each SDBT is one PAGE (4096 bytes) and continas 512 eight
@@ -70,6 +75,28 @@ static struct util_opt opt_vec[] = {
 		.option = { "list-sampling-events", no_argument, NULL, 's' },
 		.desc = "Lists sampling events for which the LPAR is authorized.",
 	},
+	{
+		.option = { "profile", required_argument, NULL, 'p' },
+		.argument = "SECONDS",
+		.desc = "Samples all CPUs for SECONDS seconds (0 until "
+			"interrupted) and lists the hot spots.",
+	},
+	{
+		.option = { "top", required_argument, NULL, 't' },
+		.argument = "NUM",
+		.desc = "Lists NUM hot spots (default 20).",
+	},
+	{
+		.option = { "report", required_argument, NULL, 'r' },
+		.argument = "SECONDS",
+		.desc = "Reports counter deltas and derived metrics for all "
+			"CPUs every SECONDS seconds.",
+	},
+	{
+		.option = { "count", required_argument, NULL, 'N' },
+		.argument = "NUM",
+		.desc = "Stops after NUM reports (default until interrupted).",
+	},
 	UTIL_OPT_HELP,
 	UTIL_OPT_VERSION,
 	UTIL_OPT_END
@@ -89,6 +116,10 @@ static const struct util_prg prg = {
 
 static char prefix[32];			/* Counter prefix */
 static bool show_names;
+static unsigned int profile_secs;	/* Sampling duration for profile */
+static unsigned int profile_top = 20;	/* Hot spots to list */
+static unsigned int report_secs;	/* Counter report interval */
+static unsigned int report_count;	/* Number of counter reports */
 
 static struct cpumf_info {
 	unsigned int first_vn;		/* Counter facility first version nr */
@@ -164,20 +195,6 @@ static struct samples {		/* Sample definition for all machines */
  * Second version number: >3    Range 448 to 495 inclusive (48 counters)
  */
 
-#define CPUMF_CTRSET_NONE               0
-#define CPUMF_CTRSET_BASIC              2
-#define CPUMF_CTRSET_PROBLEM_STATE      4
-#define CPUMF_CTRSET_CRYPTO             8
-#define CPUMF_CTRSET_EXTENDED           1
-#define CPUMF_CTRSET_MT_DIAG            32
-
-struct counters {
-	int ctrnum;
-	int ctrset;
-	char *name;
-	char *desc;
-};
-
 static struct counters cpumcf_fvn1_counters[] = {
 	{
 		.ctrnum = 0,
@@ -2606,6 +2623,39 @@ static int read_cpumf_type(const char *filename, const char *type)
 	return rc;
 }
 
+static unsigned int parse_uint(const char *arg, const char *what)
+{
+	unsigned long value;
+	char *endp;
+
+	errno = 0;
+	value = strtoul(arg, &endp, 10);
+	if (errno || *endp || !*arg || value > UINT_MAX) {
+		fprintf(stderr, "Invalid %s '%s'\n", what, arg);
+		exit(EXIT_FAILURE);
+	}
+	return value;
+}
+
+/* Read the perf event type of a CPU-measurement PMU */
+static int read_pmu_type(const char *filename, int *type)
+{
+	int rc = EXIT_SUCCESS;
+	FILE *fp;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		linux_error(filename);
+		return EXIT_FAILURE;
+	}
+	if (fscanf(fp, "%d", type) != 1) {
+		fprintf(stderr, "Can not parse file %s\n", filename);
+		rc = EXIT_FAILURE;
+	}
+	fclose(fp);
+	return rc;
+}
+
 /* Parse tool parameters. In case of --help or --version, print
  * respective text to stdout and exit.
  * Only handle one option and simulate behavior of previous tool.
@@ -2639,6 +2689,25 @@ static int parse_args(int argc, char **argv)
 		case 'C':
 			actions[ACTION_CNTALL] = true;
 			break;
+		case 'p':
+			actions[ACTION_PROFILE] = true;
+			profile_secs = parse_uint(optarg, "profile duration");
+			break;
+		case 't':
+			profile_top = parse_uint(optarg, "number of hot spots");
+			break;
+		case 'r':
+			actions[ACTION_REPORT] = true;
+			report_secs = parse_uint(optarg, "report interval");
+			if (!report_secs) {
+				fprintf(stderr, "Invalid report interval '%s'\n",
+					optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'N':
+			report_count = parse_uint(optarg, "report count");
+			break;
 		case '?':
 			fprintf(stderr, "One or more options are not valid\n");
 			fprintf(stderr, "Try 'lscpumf --help' for more"
@@ -2654,6 +2723,10 @@ static int parse_args(int argc, char **argv)
 		return ACTION_CNTALL;
 	else if (actions[ACTION_SAMPLE])
 		return ACTION_SAMPLE;
+	else if (actions[ACTION_PROFILE])
+		return ACTION_PROFILE;
+	else if (actions[ACTION_REPORT])
+		return ACTION_REPORT;
 
 	return ACTION_NONE;
 }
@@ -2947,6 +3020,27 @@ static void show_hdr(void)
 #define	FORMATS	"%s%5lx\t%s\n\n                %s\n                %s\n\n"
 #define	FORMATC	"%s%d%s\n\n                %s\n                %s %d / %s\n\n"
 
+/* Sample with the basic-sampling event roughly 1000 times per second and
+ * CPU, within the sampling interval limits of the machine.
+ */
+static int profile(void)
+{
+	unsigned long period;
+	int type;
+
+	if (!cpumf.have_samples) {
+		fprintf(stderr, "No CPU-measurement sampling facility detected\n");
+		return EXIT_FAILURE;
+	}
+	if (read_pmu_type(CPUMF_SF_TYPE, &type) == EXIT_FAILURE)
+		return EXIT_FAILURE;
+	period = MAX(cpumf.cpu_speed * 1000, cpumf.min_rate);
+	if (cpumf.max_rate)
+		period = MIN(period, cpumf.max_rate);
+	return sfprof_run(type, def_samples[0].counter, period, profile_secs,
+			  profile_top);
+}
+
 static void show_sample(void)
 {
 	printf("Perf events for activating the sampling facility\n");
@@ -3069,6 +3163,40 @@ static void show_counterset(bool all, struct counters *cp, size_t cp_cnt)
 	}
 }
 
+/* Report all authorized counters of the basic, problem-state, crypto and
+ * extended counter sets.
+ */
+static int report(void)
+{
+	static const int sets[] = { CPUMF_CTRSET_BASIC, CPUMF_CTRSET_CRYPTO,
+				    CPUMF_CTRSET_EXTENDED };
+	struct counters **ctrs, *cp;
+	size_t cp_cnt, cnt = 0;
+	int type, rc;
+
+	if (read_pmu_type(CPUMF_CF_TYPE, &type) == EXIT_FAILURE)
+		return EXIT_FAILURE;
+
+	ctrs = NULL;
+	for (unsigned int i = 0; i < ARRAY_SIZE(sets); ++i) {
+		cp = get_counter(sets[i], &cp_cnt);
+		ctrs = util_realloc(ctrs, (cnt + cp_cnt) * sizeof(*ctrs));
+		for (size_t j = 0; j < cp_cnt; ++j, ++cp) {
+			if (auth_counterset(cp))
+				ctrs[cnt++] = cp;
+		}
+	}
+	if (!cnt) {
+		fprintf(stderr, "No authorized counter sets\n");
+		free(ctrs);
+		return EXIT_FAILURE;
+	}
+	printf("Counter report for %s\n", machine_name());
+	rc = cfreport_run(type, ctrs, cnt, report_secs, report_count);
+	free(ctrs);
+	return rc;
+}
+
 static void show_counter(bool all)
 {
 	struct counters *cp;
@@ -3112,6 +3240,12 @@ int main(int argc, char **argv)
 		if (ret == EXIT_SUCCESS)
 			show_sample();
 		break;
+	case ACTION_PROFILE:
+		ret = profile();
+		break;
+	case ACTION_REPORT:
+		ret = report();
+		break;
 	case ACTION_NONE:
 	case ACTION_INFO:
 		show_info(&cpumf, ret == ACTION_INFO);
@@ -0,0 +1,589 @@
+/*
+ * Hot-spot profile from CPU Measurement sampling facility data
+ *
+ * The cpum_sf PMU converts the basic-sampling entries of the sample data
+ * blocks into perf samples. These are read from the perf mmap ring buffer
+ * of each CPU while sampling is active and aggregated by instruction
+ * address and by symbol. Each profile table holds at most
+ * SFPROF_MAX_ENTRIES entries. When a table is full, the entry with the
+ * lowest count is replaced ("space saving" algorithm): the counts of hot
+ * spots are exact or overestimated by at most the listed error.
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib/util_base.h"
+#include "lib/util_hash.h"
+#include "lib/util_libc.h"
+
+#include "defines.h"
+#include "sfprof.h"
+
+#define	RING_PAGES	16		/* Data pages per ring buffer */
+#define	MAX_MAPS_PIDS	1024		/* Processes with cached mappings */
+#define	KALLSYMS	"/proc/kallsyms"
+
+/* Entry of a profile table */
+struct hot_ent {
+	char *key;			/* Address or symbol */
+	char *sym;			/* Symbol of address entries */
+	unsigned long count;		/* Number of samples */
+	unsigned long err;		/* Maximum overestimation of count */
+	unsigned long pos;		/* Position in heap */
+};
+
+/* Profile table with bounded number of entries */
+struct hot_tbl {
+	struct util_hash *hash;		/* Entries by key */
+	struct hot_ent **heap;		/* Entries as min-heap on count */
+	unsigned long len;		/* Number of entries */
+};
+
+/* Kernel symbol */
+struct ksym {
+	unsigned long addr;
+	char *name;
+};
+
+/* Memory mapping of a process */
+struct map {
+	unsigned long start;
+	unsigned long end;
+	char *name;
+};
+
+struct maps {
+	struct map *vec;
+	unsigned long cnt;
+};
+
+/* Per-CPU sampling event */
+struct cpu_event {
+	int fd;
+	void *base;			/* Mapped ring buffer */
+};
+
+static struct {
+	struct hot_tbl addr;		/* Profile by instruction address */
+	struct hot_tbl sym;		/* Profile by symbol */
+	unsigned long samples;		/* Samples received */
+	unsigned long lost;		/* Samples lost in ring buffer */
+	struct ksym *ksyms;		/* Kernel symbols sorted by address */
+	unsigned long ksym_cnt;
+	struct util_hash *maps;		/* Mappings by PID */
+	size_t page_size;
+} l;
+
+static volatile sig_atomic_t stop;
+
+static void hot_init(struct hot_tbl *tbl)
+{
+	tbl->hash = util_hash_new(UTIL_HASH_KEY_STR, SFPROF_MAX_ENTRIES);
+	tbl->heap = util_malloc(SFPROF_MAX_ENTRIES * sizeof(*tbl->heap));
+	tbl->len = 0;
+}
+
+static void hot_ent_free(void *data)
+{
+	struct hot_ent *ent = data;
+
+	free(ent->key);
+	free(ent->sym);
+	free(ent);
+}
+
+static void hot_exit(struct hot_tbl *tbl)
+{
+	util_hash_free(tbl->hash, hot_ent_free);
+	free(tbl->heap);
+}
+
+static void hot_swap(struct hot_tbl *tbl, unsigned long a, unsigned long b)
+{
+	struct hot_ent *tmp = tbl->heap[a];
+
+	tbl->heap[a] = tbl->heap[b];
+	tbl->heap[b] = tmp;
+	tbl->heap[a]->pos = a;
+	tbl->heap[b]->pos = b;
+}
+
+/*
+ * Restore the heap order after an entry was added at the end
+ */
+static void hot_sift_up(struct hot_tbl *tbl, unsigned long pos)
+{
+	unsigned long parent;
+
+	while (pos) {
+		parent = (pos - 1) / 2;
+		if (tbl->heap[parent]->count <= tbl->heap[pos]->count)
+			return;
+		hot_swap(tbl, pos, parent);
+		pos = parent;
+	}
+}
+
+/*
+ * Restore the heap order after the count of an entry was increased
+ */
+static void hot_sift_down(struct hot_tbl *tbl, unsigned long pos)
+{
+	unsigned long min, child;
+
+	while (1) {
+		min = pos;
+		child = 2 * pos + 1;
+		if (child < tbl->len &&
+		    tbl->heap[child]->count < tbl->heap[min]->count)
+			min = child;
+		child++;
+		if (child < tbl->len &&
+		    tbl->heap[child]->count < tbl->heap[min]->count)
+			min = child;
+		if (min == pos)
+			return;
+		hot_swap(tbl, pos, min);
+		pos = min;
+	}
+}
+
+/*
+ * Count one sample for key, returns the entry and sets *new if the entry
+ * was created or replaced
+ */
+static struct hot_ent *hot_add(struct hot_tbl *tbl, const char *key,
+			       bool *new)
+{
+	struct hot_ent *ent;
+
+	ent = util_hash_get_str(tbl->hash, key);
+	*new = !ent;
+	if (ent) {
+		ent->count++;
+	} else if (tbl->len < SFPROF_MAX_ENTRIES) {
+		ent = util_zalloc(sizeof(*ent));
+		ent->key = util_strdup(key);
+		ent->count = 1;
+		ent->pos = tbl->len++;
+		tbl->heap[ent->pos] = ent;
+		hot_sift_up(tbl, ent->pos);
+		util_hash_set_str(tbl->hash, key, ent);
+	} else {
+		/* Replace the entry with the lowest count */
+		ent = tbl->heap[0];
+		util_hash_remove_str(tbl->hash, ent->key);
+		free(ent->key);
+		free(ent->sym);
+		ent->key = util_strdup(key);
+		ent->sym = NULL;
+		ent->err = ent->count;
+		ent->count++;
+		util_hash_set_str(tbl->hash, key, ent);
+	}
+	hot_sift_down(tbl, ent->pos);
+	return ent;
+}
+
+static int ksym_cmp(const void *a, const void *b)
+{
+	const struct ksym *ka = a, *kb = b;
+
+	if (ka->addr == kb->addr)
+		return 0;
+	return ka->addr < kb->addr ? -1 : 1;
+}
+
+/*
+ * Read kernel symbols, addresses are only visible with sufficient privileges
+ */
+static void ksyms_read(void)
+{
+	unsigned long addr, size = 0;
+	char *line = NULL, name[128];
+	size_t line_sz;
+	char type;
+	FILE *fp;
+
+	fp = fopen(KALLSYMS, "r");
+	if (!fp)
+		return;
+	while (getline(&line, &line_sz, fp) != -1) {
+		if (sscanf(line, "%lx %c %127s", &addr, &type, name) != 3)
+			continue;
+		if (!addr || (type != 't' && type != 'T'))
+			continue;
+		if (l.ksym_cnt == size) {
+			size = size ? 2 * size : 4096;
+			l.ksyms = util_realloc(l.ksyms,
+					       size * sizeof(*l.ksyms));
+		}
+		l.ksyms[l.ksym_cnt].addr = addr;
+		l.ksyms[l.ksym_cnt].name = util_strdup(name);
+		l.ksym_cnt++;
+	}
+	free(line);
+	fclose(fp);
+	qsort(l.ksyms, l.ksym_cnt, sizeof(*l.ksyms), ksym_cmp);
+}
+
+static const char *ksym_find(unsigned long addr)
+{
+	unsigned long lo = 0, hi = l.ksym_cnt, mid;
+
+	/* Find the last symbol with an address lower or equal addr */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (l.ksyms[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo ? l.ksyms[lo - 1].name : NULL;
+}
+
+static void maps_free(void *data)
+{
+	struct maps *maps = data;
+	unsigned long i;
+
+	for (i = 0; i < maps->cnt; i++)
+		free(maps->vec[i].name);
+	free(maps->vec);
+	free(maps);
+}
+
+/*
+ * Read the file mappings of a process
+ */
+static struct maps *maps_read(int pid)
+{
+	unsigned long start, end, size = 0;
+	char *line = NULL, *path, *name;
+	struct maps *maps;
+	size_t line_sz;
+	char fname[64];
+	int off;
+	FILE *fp;
+
+	maps = util_zalloc(sizeof(*maps));
+	snprintf(fname, sizeof(fname), "/proc/%d/maps", pid);
+	fp = fopen(fname, "r");
+	if (!fp)
+		return maps;
+	while (getline(&line, &line_sz, fp) != -1) {
+		if (sscanf(line, "%lx-%lx %*s %*s %*s %*s %n",
+			   &start, &end, &off) != 2)
+			continue;
+		path = line + off;
+		path[strcspn(path, "\n")] = 0;
+		if (!*path)
+			continue;
+		name = strrchr(path, '/');
+		name = name ? name + 1 : path;
+		if (maps->cnt == size) {
+			size = size ? 2 * size : 64;
+			maps->vec = util_realloc(maps->vec,
+						 size * sizeof(*maps->vec));
+		}
+		maps->vec[maps->cnt].start = start;
+		maps->vec[maps->cnt].end = end;
+		maps->vec[maps->cnt].name = util_strdup(name);
+		maps->cnt++;
+	}
+	free(line);
+	fclose(fp);
+	return maps;
+}
+
+static const char *maps_find(struct maps *maps, unsigned long addr)
+{
+	unsigned long i;
+
+	for (i = 0; i < maps->cnt; i++) {
+		if (addr >= maps->vec[i].start && addr < maps->vec[i].end)
+			return maps->vec[i].name;
+	}
+	return NULL;
+}
+
+/*
+ * Find the name of the mapped file for a user space address
+ */
+static const char *usym_find(int pid, unsigned long addr)
+{
+	struct maps *maps;
+	const char *name;
+
+	maps = util_hash_get_int(l.maps, pid);
+	if (maps) {
+		name = maps_find(maps, addr);
+		if (name)
+			return name;
+		/* Mapping might be new, read again */
+		maps_free(util_hash_remove_int(l.maps, pid));
+	}
+	if (util_hash_len(l.maps) >= MAX_MAPS_PIDS) {
+		util_hash_free(l.maps, maps_free);
+		l.maps = util_hash_new(UTIL_HASH_KEY_INT, MAX_MAPS_PIDS);
+	}
+	maps = maps_read(pid);
+	util_hash_set_int(l.maps, pid, maps);
+	return maps_find(maps, addr);
+}
+
+/*
+ * Aggregate one sample
+ */
+static void sample_add(unsigned long ip, int pid, bool user)
+{
+	char key[64], sym[160];
+	struct hot_ent *ent;
+	const char *name;
+	bool new;
+
+	if (user)
+		snprintf(key, sizeof(key), "%d:%lx", pid, ip);
+	else
+		snprintf(key, sizeof(key), "%lx", ip);
+	ent = hot_add(&l.addr, key, &new);
+	if (new) {
+		name = user ? usym_find(pid, ip) : ksym_find(ip);
+		if (name)
+			snprintf(sym, sizeof(sym), "%s%s", name,
+				 user ? "" : " [kernel]");
+		else
+			snprintf(sym, sizeof(sym), "[unknown%s]",
+				 user ? "" : " kernel");
+		ent->sym = util_strdup(sym);
+	}
+	hot_add(&l.sym, ent->sym, &new);
+	l.samples++;
+}
+
+/*
+ * Process all records in the ring buffer of one CPU
+ */
+static void ring_read(struct cpu_event *ev)
+{
+	struct perf_event_mmap_page *mp = ev->base;
+	unsigned long size = RING_PAGES * l.page_size;
+	unsigned char *data = (unsigned char *)ev->base + l.page_size;
+	struct perf_event_header *hdr;
+	unsigned char buf[256];
+	unsigned long off, len;
+	__u64 head, tail;
+	__u64 *val;
+
+	head = __atomic_load_n(&mp->data_head, __ATOMIC_ACQUIRE);
+	tail = mp->data_tail;
+	while (tail < head) {
+		off = tail % size;
+		hdr = (struct perf_event_header *)(data + off);
+		len = hdr->size;
+		if (len < sizeof(*hdr))
+			break;
+		if (off + len > size) {
+			/* Record wraps around the end of the ring buffer */
+			if (len > sizeof(buf)) {
+				tail += len;
+				continue;
+			}
+			memcpy(buf, data + off, size - off);
+			memcpy(buf + size - off, data, len - (size - off));
+			hdr = (struct perf_event_header *)buf;
+		}
+		val = (__u64 *)(hdr + 1);
+		switch (hdr->type) {
+		case PERF_RECORD_SAMPLE:
+			/* PERF_SAMPLE_IP followed by PERF_SAMPLE_TID */
+			sample_add(val[0], ((__u32 *)&val[1])[0],
+				   (hdr->misc & PERF_RECORD_MISC_CPUMODE_MASK) ==
+				   PERF_RECORD_MISC_USER);
+			break;
+		case PERF_RECORD_LOST:
+			/* Event id followed by number of lost samples */
+			l.lost += val[1];
+			break;
+		}
+		tail += len;
+	}
+	__atomic_store_n(&mp->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+static int cpu_event_open(struct cpu_event *ev, int cpu, int type,
+			  unsigned long config, unsigned long period)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.sample_period = period;
+	attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID;
+	attr.disabled = 1;
+	/* Wake up when a quarter of the ring buffer is filled */
+	attr.watermark = 1;
+	attr.wakeup_watermark = RING_PAGES * l.page_size / 4;
+	ev->fd = syscall(__NR_perf_event_open, &attr, -1, cpu, -1, 0);
+	if (ev->fd < 0)
+		return -1;
+	ev->base = mmap(NULL, (RING_PAGES + 1) * l.page_size,
+			PROT_READ | PROT_WRITE, MAP_SHARED, ev->fd, 0);
+	if (ev->base == MAP_FAILED) {
+		ev->base = NULL;
+		close(ev->fd);
+		return -1;
+	}
+	return 0;
+}
+
+static void cpu_event_close(struct cpu_event *ev)
+{
+	munmap(ev->base, (RING_PAGES + 1) * l.page_size);
+	close(ev->fd);
+}
+
+static void sig_stop(int UNUSED(sig))
+{
+	stop = 1;
+}
+
+static int ent_cmp(const void *a, const void *b)
+{
+	const struct hot_ent *ea = *(struct hot_ent **)a;
+	const struct hot_ent *eb = *(struct hot_ent **)b;
+
+	if (ea->count == eb->count)
+		return 0;
+	return ea->count > eb->count ? -1 : 1;
+}
+
+static void hot_show(struct hot_tbl *tbl, const char *title,
+		     unsigned int top, bool addr)
+{
+	struct hot_ent **vec;
+	unsigned long i;
+
+	vec = util_malloc(tbl->len * sizeof(*vec));
+	memcpy(vec, tbl->heap, tbl->len * sizeof(*vec));
+	qsort(vec, tbl->len, sizeof(*vec), ent_cmp);
+	printf("\n%s\n", title);
+	printf("-------------------------------------------------"
+	       "-----------------------------\n");
+	printf("%10s %7s %8s  %s\n", "Samples", "Percent", "Error",
+	       addr ? "[PID:]Address       Symbol" : "Symbol");
+	for (i = 0; i < tbl->len && i < top; i++) {
+		printf("%10lu %6.2f%% %8lu  %s%s%s\n", vec[i]->count,
+		       100.0 * vec[i]->count / l.samples, vec[i]->err,
+		       vec[i]->key, addr ? "  " : "",
+		       addr ? vec[i]->sym : "");
+	}
+	free(vec);
+}
+
+/*
+ * Sample all online CPUs with the sampling facility event "type:config"
+ * every "period" CPU cycles for "seconds" seconds, or until interrupted if
+ * seconds is 0. Then list the "top" hottest addresses and symbols.
+ */
+int sfprof_run(int type, unsigned long config, unsigned long period,
+	       unsigned int seconds, unsigned int top)
+{
+	struct cpu_event *evs;
+	struct pollfd *pfds;
+	struct sigaction sa;
+	time_t end;
+	int cpus, i, n = 0, rc = EXIT_FAILURE;
+
+	l.page_size = sysconf(_SC_PAGESIZE);
+	cpus = sysconf(_SC_NPROCESSORS_CONF);
+	evs = util_zalloc(cpus * sizeof(*evs));
+	pfds = util_zalloc(cpus * sizeof(*pfds));
+	hot_init(&l.addr);
+	hot_init(&l.sym);
+	l.maps = util_hash_new(UTIL_HASH_KEY_INT, MAX_MAPS_PIDS);
+	ksyms_read();
+
+	for (i = 0; i < cpus; i++) {
+		if (cpu_event_open(&evs[i], i, type, config, period)) {
+			/* Offline CPUs cannot be sampled */
+			if (errno == ENODEV || errno == EINVAL)
+				continue;
+			linux_error("Can not open sampling event");
+			goto out;
+		}
+		pfds[n].fd = evs[i].fd;
+		pfds[n].events = POLLIN;
+		n++;
+	}
+	if (!n) {
+		linux_error("Can not open sampling event");
+		goto out;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig_stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	for (i = 0; i < cpus; i++) {
+		if (evs[i].base)
+			ioctl(evs[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	end = time(NULL) + seconds;
+	while (!stop && (!seconds || time(NULL) < end)) {
+		if (poll(pfds, n, 1000) < 0 && errno != EINTR)
+			break;
+		for (i = 0; i < cpus; i++) {
+			if (evs[i].base)
+				ring_read(&evs[i]);
+		}
+	}
+	for (i = 0; i < cpus; i++) {
+		if (!evs[i].base)
+			continue;
+		ioctl(evs[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+		ring_read(&evs[i]);
+	}
+
+	printf("Samples: %lu  Lost: %lu  CPUs: %d  Interval: %lu cycles\n",
+	       l.samples, l.lost, n, period);
+	if (l.samples) {
+		hot_show(&l.addr, "Hot spots by address", top, true);
+		hot_show(&l.sym, "Hot spots by symbol", top, false);
+	}
+	rc = EXIT_SUCCESS;
+out:
+	for (i = 0; i < cpus; i++) {
+		if (evs[i].base)
+			cpu_event_close(&evs[i]);
+	}
+	for (i = 0; i < (int)l.ksym_cnt; i++)
+		free(l.ksyms[i].name);
+	free(l.ksyms);
+	util_hash_free(l.maps, maps_free);
+	hot_exit(&l.addr);
+	hot_exit(&l.sym);
+	free(pfds);
+	free(evs);
+	return rc;
+}
@@ -0,0 +1,18 @@
+/*
+ * Hot-spot profile from CPU Measurement sampling facility data
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef SFPROF_H
+#define	SFPROF_H
+
+#define	SFPROF_MAX_ENTRIES	4096	/* Entries kept per profile table */
+
+int sfprof_run(int type, unsigned long config, unsigned long period,
+	       unsigned int seconds, unsigned int top);
+
+#endif
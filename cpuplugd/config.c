@@ -171,6 +171,23 @@ static void parse_configline(char *line)
 		return;
 	if (check_value("cmm_max", name, rvalue, &cfg.cmm_max))
 		return;
+	if (check_value("psi_cpu", name, rvalue, &cfg.psi_cpu))
+		return;
+	if (check_value("psi_memory", name, rvalue, &cfg.psi_memory))
+		return;
+	if (check_value("psi_update", name, rvalue, &cfg.psi_update)) {
+		if (cfg.psi_update > 0)
+			return;
+		cpuplugd_exit("psi_update must be > 0\n");
+	}
+	if (!strcasecmp(name, "psi_cgroup")) {
+		cpuplugd_debug("found psi_cgroup value: %s\n", rvalue);
+		free(cfg.psi_cgroup);
+		cfg.psi_cgroup = strdup(rvalue);
+		if (!cfg.psi_cgroup)
+			cpuplugd_exit("Out of memory: psi_cgroup\n");
+		return;
+	}
 
 	cpuplugd_debug("found the following variable: %s = %s\n",
 		       name, rvalue);
@@ -29,7 +29,7 @@
 #define MAX_HISTORY	100
 #define PIDFILE		"/run/cpuplugd.pid"
 #define LOCKFILE	"/var/lock/cpuplugd.lock"
-#define PROCINFO_LINE	512
+#define PROC_FILE_SIZE	4096
 #define CPUSTAT_SIZE	1024
 #define VARINFO_SIZE	4096
 #define MAX_VARNAME	128
@@ -94,6 +94,10 @@ enum operation {
 	OP_MINUS,
 	OP_MULT,
 	OP_DIV,
+	/* Trend functions over the history */
+	OP_FUNC_SLOPE,
+	OP_FUNC_EWMA,
+	OP_FUNC_PREDICT,
 	/* ... */
 	/*Variables which are eligible within rules*/
 	VAR_LOAD,       /* loadaverage */
@@ -118,6 +122,63 @@ struct symbols {
 	double steal;
 	double guest;
 	double guest_nice;
+	/* number of intervals ago these values were gathered */
+	unsigned int history_offset;
+};
+
+/*
+ * /proc file that is kept open between reads
+ */
+struct proc_file {
+	const char *path;
+	int fd;
+	char *buf;
+	size_t size;
+};
+
+#define PROC_FILE_INIT(p) { .path = (p), .fd = -1 }
+
+/*
+ * Symbol table for /proc data
+ *
+ * Only symbols that are referenced by rules or used internally are
+ * registered. Each /proc snapshot is parsed once when it is read and the
+ * values of all registered symbols are stored for each history index.
+ */
+struct proc_symtab {
+	char separator;
+	char **names;
+	unsigned int count;
+	double *values;		/* (history_max + 1) * count values */
+};
+
+/* Internally used symbols, registered in this order */
+enum cpustat_sym {
+	CPUSTAT_USER,
+	CPUSTAT_NICE,
+	CPUSTAT_SYSTEM,
+	CPUSTAT_IDLE,
+	CPUSTAT_IOWAIT,
+	CPUSTAT_IRQ,
+	CPUSTAT_SOFTIRQ,
+	CPUSTAT_STEAL,
+	CPUSTAT_GUEST,
+	CPUSTAT_GUEST_NICE,
+	CPUSTAT_TOTAL_TICKS,
+	CPUSTAT_LOADAVG,
+	CPUSTAT_RUNNABLE_PROC,
+	CPUSTAT_ONUMCPUS,
+};
+
+enum meminfo_sym {
+	MEMINFO_MEMFREE,
+};
+
+enum vmstat_sym {
+	VMSTAT_PSWPIN,
+	VMSTAT_PSWPOUT,
+	VMSTAT_PGPGIN,
+	VMSTAT_PGPGOUT,
 };
 
 struct term {
@@ -125,6 +186,8 @@ struct term {
 	double value;
 	struct term *left, *right;
 	char *proc_name;
+	struct proc_symtab *symtab;
+	unsigned int sym;
 	unsigned int index;
 };
 
@@ -144,6 +207,10 @@ struct config {
 	struct term *hotunplug;
 	struct term *memplug;
 	struct term *memunplug;
+	long psi_cpu;
+	long psi_memory;
+	long psi_update;
+	char *psi_cgroup;
 };
 
 struct symbol_names {
@@ -160,14 +227,13 @@ extern int num_cpu_start; /* # of online cpus at the time of the startup */
 extern long cmm_pagesize_start; /* cmm_pageize at the time of daemon startup */
 extern struct config cfg;
 extern int reload_pending;
-extern unsigned long meminfo_size;
-extern unsigned long vmstat_size;
 extern unsigned long cpustat_size;
 extern unsigned long varinfo_size;
-extern char *meminfo;
-extern char *vmstat;
 extern char *cpustat;
 extern char *varinfo;
+extern struct proc_symtab meminfo_symtab;
+extern struct proc_symtab vmstat_symtab;
+extern struct proc_symtab cpustat_symtab;
 extern double *timestamps;
 extern unsigned int history_max;
 extern unsigned int history_current;
@@ -184,10 +250,15 @@ void print_term(struct term *fn);
 struct term *parse_term(char **p, enum op_prio prio);
 int eval_term(struct term *fn, struct symbols *symbols);
 double eval_double(struct term *fn, struct symbols *symbols);
-double get_proc_value(char *procinfo, char *name, char separator);
-void proc_read(char *procinfo, char *path, unsigned long size);
+void proc_symtab_init(void);
+unsigned int proc_symtab_count(void);
+unsigned int proc_symtab_add(struct proc_symtab *symtab, const char *name);
+void proc_symtab_parse(struct proc_symtab *symtab, char *procinfo,
+		       unsigned int history_index);
+double proc_symtab_value(struct proc_symtab *symtab, unsigned int sym,
+			 unsigned int history_index);
+char *proc_file_read(struct proc_file *file);
 void proc_cpu_read(char *procinfo);
-unsigned long proc_read_size(char *path);
 char *get_var_rvalue(char *var_name);
 void cleanup_cmm(void);
 int hotplug(int cpuid);
@@ -206,6 +277,11 @@ void set_cmm_pages(long size);
 int check_lpar();
 int cpu_is_configured(int cpuid);
 void setup_history(void);
+unsigned int history_index(unsigned int offset);
+void history_symbols(struct symbols *symbols, unsigned int offset);
+void psi_setup(void);
+void psi_cleanup(void);
+void psi_wait(void);
 
 
 #define cpuplugd_info(fmt, ...) ({			\
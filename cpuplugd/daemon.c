@@ -179,7 +179,7 @@ void reload_handler(int UNUSED(a))
 
 void reload_daemon()
 {
-	unsigned int temp_history;
+	unsigned int temp_history, temp_symbols;
 	long temp_mem;
 	int temp_cpu;
 
@@ -193,22 +193,28 @@ void reload_daemon()
 	temp_cpu = num_cpu_start;
 	temp_mem = cmm_pagesize_start;
 	temp_history = history_max;
+	temp_symbols = proc_symtab_count();
 
 	/* clear varinfo before re-reading variables from config file */
 	memset(varinfo, 0, varinfo_size);
 	history_max = 1;
+	psi_cleanup();
 	parse_configfile(configfile);
 	if (history_max > MAX_HISTORY)
 		cpuplugd_exit("History depth %i exceeded maximum (%i)\n",
 			      history_max, MAX_HISTORY);
-	if (history_max != temp_history) {
-		free(meminfo);
-		free(vmstat);
+	/* New symbols have no history values, so history is set up again */
+	if (history_max != temp_history ||
+	    proc_symtab_count() != temp_symbols) {
 		free(cpustat);
+		free(meminfo_symtab.values);
+		free(vmstat_symtab.values);
+		free(cpustat_symtab.values);
 		free(timestamps);
 		setup_history();
 	}
 	check_config();
+	psi_setup();
 
 	num_cpu_start = temp_cpu;
 	cmm_pagesize_start = temp_mem;
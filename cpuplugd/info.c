@@ -9,11 +9,53 @@
  * it under the terms of the MIT license. See LICENSE for details.
  */
 
+#include <fcntl.h>
+#include <math.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
 #include "cpuplugd.h"
 
+/*
+ * Read /proc file into the buffer of "file" and return the buffer
+ *
+ * The file is opened at the first read and kept open, later reads start
+ * again at offset 0. The buffer is enlarged until the complete file fits.
+ */
+char *proc_file_read(struct proc_file *file)
+{
+	ssize_t bytes_read;
+
+	if (file->fd < 0) {
+		file->fd = open(file->path, O_RDONLY);
+		if (file->fd < 0)
+			cpuplugd_exit("%s open failed: %s\n", file->path,
+				      strerror(errno));
+	}
+	if (!file->buf) {
+		file->size = PROC_FILE_SIZE;
+		file->buf = malloc(file->size);
+		if (!file->buf)
+			cpuplugd_exit("Out of memory: %s\n", file->path);
+	}
+	while (1) {
+		bytes_read = pread(file->fd, file->buf, file->size, 0);
+		if (bytes_read < 0)
+			cpuplugd_exit("%s read failed: %s\n", file->path,
+				      strerror(errno));
+		if (bytes_read == 0)
+			cpuplugd_exit("%s read failed\n", file->path);
+		if ((size_t) bytes_read < file->size)
+			break;
+		file->size *= 2;
+		file->buf = realloc(file->buf, file->size);
+		if (!file->buf)
+			cpuplugd_exit("Out of memory: %s\n", file->path);
+	}
+	file->buf[bytes_read] = '\0';
+	return file->buf;
+}
+
 /*
  * Return current load average and runnable processes based on /proc/loadavg
  *
@@ -27,38 +69,29 @@
  */
 void get_loadavg_runnable(double *loadavg, double *runnable)
 {
-	FILE *filp;
+	static struct proc_file file = PROC_FILE_INIT("/proc/loadavg");
 	double dummy;
 	int rc;
 
-	filp = fopen("/proc/loadavg", "r");
-	if (!filp)
-		cpuplugd_exit("cannot open kernel loadaverage "
-			      "statistics: %s\n", strerror(errno));
-	rc = fscanf(filp, "%lf %lf %lf %lf/", loadavg, &dummy, &dummy,
-		    runnable);
+	rc = sscanf(proc_file_read(&file), "%lf %lf %lf %lf/", loadavg,
+		    &dummy, &dummy, runnable);
 	if (rc != 4)
 		cpuplugd_exit("cannot parse kernel loadaverage "
-			      "statistics: %s\n", strerror(errno));
-	fclose(filp);
-	return;
+			      "statistics\n");
 }
 
 void proc_cpu_read(char *procinfo)
 {
-	FILE *filp;
+	static struct proc_file file = PROC_FILE_INIT("/proc/stat");
 	unsigned int rc, onumcpus;
 	unsigned long user, nice, system, idle, iowait, irq, softirq, steal,
 		      guest, guest_nice, total_ticks;
 	double loadavg, runnable;
 
 	guest = guest_nice = 0;		/* set to 0 if not present in kernel */
-	filp = fopen("/proc/stat", "r");
-	if (!filp)
-		cpuplugd_exit("/proc/stat open failed: %s\n", strerror(errno));
-	rc = fscanf(filp, "cpu %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld", &user,
-		    &nice, &system, &idle, &iowait, &irq, &softirq, &steal,
-		    &guest, &guest_nice);
+	rc = sscanf(proc_file_read(&file), "cpu %ld %ld %ld %ld %ld %ld %ld "
+		    "%ld %ld %ld", &user, &nice, &system, &idle, &iowait, &irq,
+		    &softirq, &steal, &guest, &guest_nice);
 
 	get_loadavg_runnable(&loadavg, &runnable);
 	onumcpus = get_num_online_cpus();
@@ -75,83 +108,145 @@ void proc_cpu_read(char *procinfo)
 	if (rc >= cpustat_size)
 		cpuplugd_exit("cpustat buffer too small: need %d, have %ld "
 			      "(bytes)\n", rc, cpustat_size);
-	fclose(filp);
 	return;
 }
 
-void proc_read(char *procinfo, char *path, unsigned long size)
+struct proc_symtab meminfo_symtab = { .separator = ':' };
+struct proc_symtab vmstat_symtab = { .separator = ' ' };
+struct proc_symtab cpustat_symtab = { .separator = ' ' };
+
+static const char *cpustat_names[] = {
+	[CPUSTAT_USER] = "user",
+	[CPUSTAT_NICE] = "nice",
+	[CPUSTAT_SYSTEM] = "system",
+	[CPUSTAT_IDLE] = "idle",
+	[CPUSTAT_IOWAIT] = "iowait",
+	[CPUSTAT_IRQ] = "irq",
+	[CPUSTAT_SOFTIRQ] = "softirq",
+	[CPUSTAT_STEAL] = "steal",
+	[CPUSTAT_GUEST] = "guest",
+	[CPUSTAT_GUEST_NICE] = "guest_nice",
+	[CPUSTAT_TOTAL_TICKS] = "total_ticks",
+	[CPUSTAT_LOADAVG] = "loadavg",
+	[CPUSTAT_RUNNABLE_PROC] = "runnable_proc",
+	[CPUSTAT_ONUMCPUS] = "onumcpus",
+};
+
+static const char *meminfo_names[] = {
+	[MEMINFO_MEMFREE] = "MemFree",
+};
+
+static const char *vmstat_names[] = {
+	[VMSTAT_PSWPIN] = "pswpin",
+	[VMSTAT_PSWPOUT] = "pswpout",
+	[VMSTAT_PGPGIN] = "pgpgin",
+	[VMSTAT_PGPGOUT] = "pgpgout",
+};
+
+/*
+ * Register symbol "name" in "symtab" and return its index
+ */
+unsigned int proc_symtab_add(struct proc_symtab *symtab, const char *name)
 {
-	size_t bytes_read;
-	FILE *filp;
+	unsigned int i;
 
-	filp = fopen(path, "r");
-	if (!filp)
-		cpuplugd_exit("%s open failed: %s\n", path, strerror(errno));
+	for (i = 0; i < symtab->count; i++) {
+		if (strcmp(symtab->names[i], name) == 0)
+			return i;
+	}
+	symtab->names = realloc(symtab->names,
+				sizeof(char *) * (symtab->count + 1));
+	if (!symtab->names)
+		cpuplugd_exit("Out of memory: symtab\n");
+	symtab->names[i] = strdup(name);
+	if (!symtab->names[i])
+		cpuplugd_exit("Out of memory: symtab\n");
+	symtab->count++;
+	return i;
+}
 
-	bytes_read = fread(procinfo, 1, size, filp);
-	if (bytes_read == 0)
-		cpuplugd_exit("%s read failed\n", path);
-	if (bytes_read == size)
-		cpuplugd_exit("procinfo buffer too small for %s\n", path);
+static void proc_symtab_register(struct proc_symtab *symtab,
+				 const char **names, unsigned int count)
+{
+	unsigned int i;
 
-	procinfo[bytes_read] = '\0';
-	fclose(filp);
-	return;
+	for (i = 0; i < count; i++)
+		proc_symtab_add(symtab, names[i]);
 }
 
-unsigned long proc_read_size(char *path)
+/*
+ * Register the internally used symbols, must be called before rules
+ * are parsed
+ */
+void proc_symtab_init(void)
 {
-	FILE *filp;
-	char buf[PROCINFO_LINE];
-	char *linep, *linep_offset;
-	unsigned long size;
-
-	filp = fopen(path, "r");
-	if (!filp)
-		cpuplugd_exit("%s open failed: %s\n", path, strerror(errno));
-
-	size = 0;
-	while ((linep = fgets(buf, sizeof(buf), filp))) {
-		if (!(linep_offset = strchr(linep, '\n')))
-			cpuplugd_exit("buf too small for line\n");
-		size = size + linep_offset - linep + 1;
-	}
-	fclose(filp);
-	return size;
+	proc_symtab_register(&cpustat_symtab, cpustat_names,
+			     ARRAY_SIZE(cpustat_names));
+	proc_symtab_register(&meminfo_symtab, meminfo_names,
+			     ARRAY_SIZE(meminfo_names));
+	proc_symtab_register(&vmstat_symtab, vmstat_names,
+			     ARRAY_SIZE(vmstat_names));
 }
 
-double get_proc_value(char *procinfo, char *name, char separator)
+/*
+ * Return total number of registered symbols
+ */
+unsigned int proc_symtab_count(void)
 {
-	char buf[PROCINFO_LINE];
-	char *proc_offset;
-	unsigned long proc_length, name_length;
-	double value;
-	int found;
-
-	value = -1;
-	found = 0;
-	name_length = strlen(name);
-	while ((proc_offset = strchr(procinfo, separator))) {
-		proc_length = proc_offset - procinfo;
-		/*
-		 * proc_read_size() made sure that proc_length < PROCINFO_LINE
-		 */
-		memcpy(buf, procinfo, proc_length);
-		buf[proc_length] = '\0';
-		procinfo = proc_offset + 1;
-		if (strncmp(buf, name, MAX(proc_length, name_length)) == 0) {
+	return cpustat_symtab.count + meminfo_symtab.count +
+		vmstat_symtab.count;
+}
+
+/*
+ * Parse /proc data and store the values of all registered symbols
+ * at "history_index"
+ *
+ * Symbols that are not found get the value NAN, an error is reported
+ * only if such a symbol is evaluated.
+ */
+void proc_symtab_parse(struct proc_symtab *symtab, char *procinfo,
+		       unsigned int history_index)
+{
+	double *values = symtab->values + history_index * symtab->count;
+	unsigned int i, found = 0;
+	char *sep, *eol;
+	size_t len;
+
+	for (i = 0; i < symtab->count; i++)
+		values[i] = NAN;
+	while (found < symtab->count) {
+		sep = strchr(procinfo, symtab->separator);
+		if (!sep)
+			break;
+		len = sep - procinfo;
+		for (i = 0; i < symtab->count; i++) {
+			if (strncmp(symtab->names[i], procinfo, len) != 0 ||
+			    symtab->names[i][len] != '\0')
+				continue;
 			errno = 0;
-			value = strtod(procinfo, NULL);
+			values[i] = strtod(sep + 1, NULL);
 			if (errno)
 				cpuplugd_exit("strtod failed\n");
-			found = 1;
+			found++;
 			break;
 		}
-		proc_offset = strchr(procinfo, '\n');
-		procinfo = proc_offset + 1;
+		eol = strchr(sep + 1, '\n');
+		if (!eol)
+			break;
+		procinfo = eol + 1;
 	}
-	if (!found)
+}
+
+/*
+ * Return value of symbol "sym" at "history_index"
+ */
+double proc_symtab_value(struct proc_symtab *symtab, unsigned int sym,
+			 unsigned int history_index)
+{
+	double value = symtab->values[history_index * symtab->count + sym];
+
+	if (isnan(value))
 		cpuplugd_exit("Symbol %s not found, check your config file\n",
-			      name);
+			      symtab->names[sym]);
 	return value;
 }
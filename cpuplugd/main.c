@@ -52,15 +52,21 @@ struct config cfg = {
 	.memunplug = NULL,
 	.hotplug = NULL,
 	.hotunplug = NULL,
+	.psi_cpu = -1,
+	.psi_memory = -1,
+	.psi_update = -1,
+	.psi_cgroup = NULL,
 };
 
 int num_cpu_start, memory, cpu, reload_pending;
 long cmm_pagesize_start;
-unsigned long meminfo_size, vmstat_size, cpustat_size, varinfo_size;
-char *meminfo, *vmstat, *cpustat, *varinfo;
+unsigned long cpustat_size, varinfo_size;
+char *cpustat, *varinfo;
 double *timestamps;
 unsigned int history_max, history_current, history_prev, sym_names_count;
 
+static struct proc_file meminfo_file = PROC_FILE_INIT("/proc/meminfo");
+static struct proc_file vmstat_file = PROC_FILE_INIT("/proc/vmstat");
 static struct symbols symbols;
 static jmp_buf jmpenv;
 static struct sigaction act;
@@ -73,62 +79,108 @@ static void sigfpe_handler(int UNUSED(sig))
 	longjmp(jmpenv, 1);
 }
 
-static void eval_cpu_rules(void)
+static double cpustat_value(unsigned int sym, unsigned int history_index)
+{
+	return proc_symtab_value(&cpustat_symtab, sym, history_index);
+}
+
+static double vmstat_value(unsigned int sym, unsigned int history_index)
+{
+	return proc_symtab_value(&vmstat_symtab, sym, history_index);
+}
+
+/*
+ * Calculate the CPU symbols of the interval between the history indexes
+ * "prev" and "cur"
+ */
+static void cpu_symbols(struct symbols *s, unsigned int cur,
+			unsigned int prev)
 {
 	double diffs[CPUSTATS], diffs_total, percent_factor;
-	char *procinfo_current, *procinfo_prev;
-	int cpu, nr_cpus, on_off;
+	int i;
 
-	nr_cpus = get_numcpus();
-	procinfo_current = cpustat + history_current * cpustat_size;
-	procinfo_prev = cpustat + history_prev * cpustat_size;
-
-	diffs[0] = get_proc_value(procinfo_current, "user", ' ') -
-		   get_proc_value(procinfo_prev, "user", ' ');
-	diffs[1] = get_proc_value(procinfo_current, "nice", ' ') -
-		   get_proc_value(procinfo_prev, "nice", ' ');
-	diffs[2] = get_proc_value(procinfo_current, "system", ' ') -
-		   get_proc_value(procinfo_prev, "system", ' ');
-	diffs[3] = get_proc_value(procinfo_current, "idle", ' ') -
-		   get_proc_value(procinfo_prev, "idle", ' ');
-	diffs[4] = get_proc_value(procinfo_current, "iowait", ' ') -
-		   get_proc_value(procinfo_prev, "iowait", ' ');
-	diffs[5] = get_proc_value(procinfo_current, "irq", ' ') -
-		   get_proc_value(procinfo_prev, "irq", ' ');
-	diffs[6] = get_proc_value(procinfo_current, "softirq", ' ') -
-		   get_proc_value(procinfo_prev, "softirq", ' ');
-	diffs[7] = get_proc_value(procinfo_current, "steal", ' ') -
-		   get_proc_value(procinfo_prev, "steal", ' ');
-	diffs[8] = get_proc_value(procinfo_current, "guest", ' ') -
-		   get_proc_value(procinfo_prev, "guest", ' ');
-	diffs[9] = get_proc_value(procinfo_current, "guest_nice", ' ') -
-		   get_proc_value(procinfo_prev, "guest_nice", ' ');
-
-	diffs_total = get_proc_value(procinfo_current, "total_ticks", ' ') -
-		      get_proc_value(procinfo_prev, "total_ticks", ' ');
+	/* The first CPUSTATS symbols are user ... guest_nice */
+	for (i = 0; i < CPUSTATS; i++)
+		diffs[i] = cpustat_value(i, cur) - cpustat_value(i, prev);
+
+	diffs_total = cpustat_value(CPUSTAT_TOTAL_TICKS, cur) -
+		      cpustat_value(CPUSTAT_TOTAL_TICKS, prev);
 	if (diffs_total == 0)
 		diffs_total = 1;
 
-	symbols.loadavg = get_proc_value(procinfo_current, "loadavg", ' ');
-	symbols.runnable_proc = get_proc_value(procinfo_current,
-					       "runnable_proc", ' ');
-	symbols.onumcpus = get_proc_value(procinfo_current, "onumcpus", ' ');
-
-	percent_factor = 100 * symbols.onumcpus;
-	symbols.user = (diffs[0] / diffs_total) * percent_factor;
-	symbols.nice = (diffs[1] / diffs_total) * percent_factor;
-	symbols.system = (diffs[2] / diffs_total) * percent_factor;
-	symbols.idle = (diffs[3] / diffs_total) * percent_factor;
-	symbols.iowait = (diffs[4] / diffs_total) * percent_factor;
-	symbols.irq = (diffs[5] / diffs_total) * percent_factor;
-	symbols.softirq = (diffs[6] / diffs_total) * percent_factor;
-	symbols.steal = (diffs[7] / diffs_total) * percent_factor;
-	symbols.guest = (diffs[8] / diffs_total) * percent_factor;
-	symbols.guest_nice = (diffs[9] / diffs_total) * percent_factor;
+	s->loadavg = cpustat_value(CPUSTAT_LOADAVG, cur);
+	s->runnable_proc = cpustat_value(CPUSTAT_RUNNABLE_PROC, cur);
+	s->onumcpus = cpustat_value(CPUSTAT_ONUMCPUS, cur);
+
+	percent_factor = 100 * s->onumcpus;
+	s->user = (diffs[0] / diffs_total) * percent_factor;
+	s->nice = (diffs[1] / diffs_total) * percent_factor;
+	s->system = (diffs[2] / diffs_total) * percent_factor;
+	s->idle = (diffs[3] / diffs_total) * percent_factor;
+	s->iowait = (diffs[4] / diffs_total) * percent_factor;
+	s->irq = (diffs[5] / diffs_total) * percent_factor;
+	s->softirq = (diffs[6] / diffs_total) * percent_factor;
+	s->steal = (diffs[7] / diffs_total) * percent_factor;
+	s->guest = (diffs[8] / diffs_total) * percent_factor;
+	s->guest_nice = (diffs[9] / diffs_total) * percent_factor;
+}
+
+/*
+ * Calculate the memory symbols of the interval between the history indexes
+ * "prev" and "cur"
+ */
+static void mem_symbols(struct symbols *s, unsigned int cur,
+			unsigned int prev, double interval)
+{
+	double free_memory;
+
+	free_memory = proc_symtab_value(&meminfo_symtab, MEMINFO_MEMFREE, cur);
+	// swaprate in 4K pages / sec
+	s->swaprate = (vmstat_value(VMSTAT_PSWPIN, cur) +
+		       vmstat_value(VMSTAT_PSWPOUT, cur) -
+		       vmstat_value(VMSTAT_PSWPIN, prev) -
+		       vmstat_value(VMSTAT_PSWPOUT, prev)) / interval;
+	// apcr in 512 byte blocks / sec
+	s->apcr = (vmstat_value(VMSTAT_PGPGIN, cur) +
+		   vmstat_value(VMSTAT_PGPGOUT, cur) -
+		   vmstat_value(VMSTAT_PGPGIN, prev) -
+		   vmstat_value(VMSTAT_PGPGOUT, prev)) / interval;
+	s->freemem = free_memory / 1024;	// freemem in MB
+}
+
+/*
+ * Return the history index of the values gathered "offset" intervals ago
+ */
+unsigned int history_index(unsigned int offset)
+{
+	if (offset <= history_current)
+		return history_current - offset;
+	return history_max + 1 - (offset - history_current);
+}
+
+/*
+ * Calculate all symbols of the interval "offset" intervals ago
+ */
+void history_symbols(struct symbols *s, unsigned int offset)
+{
+	unsigned int cur, prev;
+
+	cur = history_index(offset);
+	prev = history_index(offset + 1);
+	cpu_symbols(s, cur, prev);
+	mem_symbols(s, cur, prev, timestamps[cur] - timestamps[prev]);
+	s->history_offset = offset;
+}
+
+static void eval_cpu_rules(void)
+{
+	int cpu, nr_cpus, on_off;
+
+	nr_cpus = get_numcpus();
+	cpu_symbols(&symbols, history_current, history_prev);
 
 	/* only use this for development and testing */
-	cpuplugd_debug("cpustat values:\n%s", cpustat + history_current *
-		       cpustat_size);
+	cpuplugd_debug("cpustat values:\n%s", cpustat);
 	if (debug && foreground == 1) {
 		printf("-------------------- CPU --------------------\n");
 		printf("cpu_min: %ld\n", cfg.cpu_min);
@@ -212,29 +264,9 @@ static void eval_cpu_rules(void)
 static void eval_mem_rules(double interval)
 {
 	long cmmpages_size, cmm_inc, cmm_dec, cmm_new;
-	double free_memory, swaprate, apcr;
-	char *procinfo_current, *procinfo_prev;
-
-	procinfo_current = meminfo + history_current * meminfo_size;
-	free_memory = get_proc_value(procinfo_current, "MemFree", ':');
-
-	procinfo_current = vmstat + history_current * vmstat_size;
-	procinfo_prev = vmstat + history_prev * vmstat_size;
-	swaprate = (get_proc_value(procinfo_current, "pswpin", ' ') +
-		    get_proc_value(procinfo_current, "pswpout", ' ') -
-		    get_proc_value(procinfo_prev, "pswpin", ' ') -
-		    get_proc_value(procinfo_prev, "pswpout", ' ')) /
-		    interval;
-	apcr = (get_proc_value(procinfo_current, "pgpgin", ' ') +
-		get_proc_value(procinfo_current, "pgpgout", ' ') -
-		get_proc_value(procinfo_prev, "pgpgin", ' ') -
-		get_proc_value(procinfo_prev, "pgpgout", ' ')) /
-		interval;
 
+	mem_symbols(&symbols, history_current, history_prev, interval);
 	cmmpages_size = get_cmmpages_size();
-	symbols.apcr = apcr;			// apcr in 512 byte blocks / sec
-	symbols.swaprate = swaprate;		// swaprate in 4K pages / sec
-	symbols.freemem = free_memory / 1024;	// freemem in MB
 
 	cmm_inc = eval_double(cfg.cmm_inc, &symbols);
 	/* cmm_dec is optional */
@@ -319,25 +351,40 @@ static void time_read(double *timestamps)
 	return;
 }
 
+static void symtab_alloc(struct proc_symtab *symtab)
+{
+	symtab->values = malloc(sizeof(double) * symtab->count *
+				(history_max + 1));
+	if (!symtab->values)
+		cpuplugd_exit("Out of memory: symtab\n");
+}
+
+/*
+ * Read /proc data and store the symbol values at "history_index"
+ *
+ * Only the last snapshot of each /proc file is kept as text.
+ */
+static void proc_sample(unsigned int history_index)
+{
+	time_read(&timestamps[history_index]);
+	proc_symtab_parse(&meminfo_symtab, proc_file_read(&meminfo_file),
+			  history_index);
+	proc_symtab_parse(&vmstat_symtab, proc_file_read(&vmstat_file),
+			  history_index);
+	proc_cpu_read(cpustat);
+	proc_symtab_parse(&cpustat_symtab, cpustat, history_index);
+}
+
 void setup_history()
 {
-	/*
-	 * The /proc file size will vary during intervals, use double of current
-	 * size to have enough buffer for growing values.
-	 */
-	meminfo_size = proc_read_size("/proc/meminfo") * 2;
-	vmstat_size = proc_read_size("/proc/vmstat") * 2;
 	cpustat_size = CPUSTAT_SIZE;
 
-	meminfo = malloc(meminfo_size * (history_max + 1));
-	if (!meminfo)
-		cpuplugd_exit("Out of memory: meminfo\n");
-	vmstat = malloc(vmstat_size * (history_max + 1));
-	if (!vmstat)
-		cpuplugd_exit("Out of memory: vmstat\n");
-	cpustat = malloc(cpustat_size * (history_max + 1));
+	cpustat = malloc(cpustat_size);
 	if (!cpustat)
 		cpuplugd_exit("Out of memory: cpustat\n");
+	symtab_alloc(&meminfo_symtab);
+	symtab_alloc(&vmstat_symtab);
+	symtab_alloc(&cpustat_symtab);
 	timestamps = malloc(sizeof(double) * (history_max + 1));
 	if (!timestamps)
 		cpuplugd_exit("Out of memory: timestamps\n");
@@ -349,12 +396,7 @@ void setup_history()
 	cpuplugd_info("Waiting %i intervals to accumulate history.\n",
 		      history_max);
 	do {
-		time_read(&timestamps[history_current]);
-		proc_read(meminfo + history_current * meminfo_size,
-			  "/proc/meminfo", meminfo_size);
-		proc_read(vmstat + history_current * vmstat_size,
-			  "/proc/vmstat", vmstat_size);
-		proc_cpu_read(cpustat + history_current * cpustat_size);
+		proc_sample(history_current);
 		sleep(cfg.update);
 		history_current++;
 	} while (history_current < history_max);
@@ -406,6 +448,7 @@ int main(int argc, char *argv[])
 
 	/* Need 1 history level minimum for internal symbols */
 	history_max = 1;
+	proc_symtab_init();
 	/*
 	 * Parse arguments from the configuration file, also calculate
 	 * history_max
@@ -438,6 +481,7 @@ int main(int argc, char *argv[])
 			      strerror(errno));
 
 	setup_history();
+	psi_setup();
 
 	/* Main loop */
 	while (1) {
@@ -448,12 +492,7 @@ int main(int argc, char *argv[])
 
 		history_prev = history_current;
 		history_current = (history_current + 1) % (history_max + 1);
-		time_read(&timestamps[history_current]);
-		proc_read(meminfo + history_current * meminfo_size,
-			  "/proc/meminfo", meminfo_size);
-		proc_read(vmstat + history_current * vmstat_size,
-			  "/proc/vmstat", vmstat_size);
-		proc_cpu_read(cpustat + history_current * cpustat_size);
+		proc_sample(history_current);
 		interval = timestamps[history_current] -
 			   timestamps[history_prev];
 		cpuplugd_debug("config update interval: %ld seconds\n",
@@ -477,7 +516,7 @@ int main(int argc, char *argv[])
 					       "skipping memory rule "
 					       "evaluation.\n");
 		}
-		sleep(cfg.update);
+		psi_wait();
 	}
 	return 0;
 }
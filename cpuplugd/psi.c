@@ -0,0 +1,145 @@
+/*
+ * cpuplugd - Linux for System z Hotplug Daemon
+ *
+ * Pressure stall information (PSI) triggers
+ *
+ * Copyright IBM Corp. 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+
+#include "cpuplugd.h"
+
+#define PSI_WINDOW_US	1000000
+#define PSI_MAX_FDS	3
+
+static struct pollfd psi_fds[PSI_MAX_FDS];
+static const char *psi_names[PSI_MAX_FDS];
+static int psi_is_cgroup[PSI_MAX_FDS];
+static unsigned int psi_fd_count;
+
+/*
+ * Register a PSI trigger that fires if tasks are stalled for more than
+ * "stall_ms" milliseconds within one second
+ */
+static void psi_trigger_add(const char *path, long stall_ms)
+{
+	char trigger[64];
+	int fd, len;
+
+	/* Without PSI support the update interval is used */
+	fd = open(path, O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+		cpuplugd_error("%s open failed: %s\n", path, strerror(errno));
+		return;
+	}
+	len = snprintf(trigger, sizeof(trigger), "some %ld %d", stall_ms * 1000,
+		       PSI_WINDOW_US);
+	if (write(fd, trigger, len + 1) < 0) {
+		cpuplugd_error("Cannot set PSI trigger \"%s\" for %s: %s\n",
+			       trigger, path, strerror(errno));
+		close(fd);
+		return;
+	}
+	cpuplugd_debug("PSI trigger \"%s\" set for %s\n", trigger, path);
+	psi_fds[psi_fd_count].fd = fd;
+	psi_fds[psi_fd_count].events = POLLPRI;
+	psi_names[psi_fd_count] = path;
+	psi_is_cgroup[psi_fd_count] = 0;
+	psi_fd_count++;
+}
+
+/*
+ * Watch the memory.events file of a cgroup, which is changed when the
+ * memory usage of the cgroup hits its high or max boundary
+ */
+static void psi_cgroup_add(const char *cgroup)
+{
+	static char path[PATH_MAX];
+	char buf[VARINFO_SIZE];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/memory.events", cgroup);
+	fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		cpuplugd_exit("%s open failed: %s\n", path, strerror(errno));
+	/* Changes are only reported after the file has been read */
+	if (pread(fd, buf, sizeof(buf), 0) < 0)
+		cpuplugd_exit("%s read failed: %s\n", path, strerror(errno));
+	cpuplugd_debug("Watching %s\n", path);
+	psi_fds[psi_fd_count].fd = fd;
+	psi_fds[psi_fd_count].events = POLLPRI;
+	psi_names[psi_fd_count] = path;
+	psi_is_cgroup[psi_fd_count] = 1;
+	psi_fd_count++;
+}
+
+/*
+ * Set up the PSI triggers from the configuration file
+ */
+void psi_setup(void)
+{
+	if (cfg.psi_cpu > 0 && cpu)
+		psi_trigger_add("/proc/pressure/cpu", cfg.psi_cpu);
+	if (cfg.psi_memory > 0 && memory)
+		psi_trigger_add("/proc/pressure/memory", cfg.psi_memory);
+	if (cfg.psi_cgroup && memory)
+		psi_cgroup_add(cfg.psi_cgroup);
+}
+
+/*
+ * Remove all PSI triggers
+ */
+void psi_cleanup(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < psi_fd_count; i++)
+		close(psi_fds[i].fd);
+	psi_fd_count = 0;
+}
+
+/*
+ * Wait for the next update interval
+ *
+ * Without PSI triggers this is the UPDATE interval. Otherwise wait for
+ * PSI_UPDATE seconds or until one of the triggers fires.
+ */
+void psi_wait(void)
+{
+	char buf[VARINFO_SIZE];
+	long update;
+	unsigned int i;
+	int rc;
+
+	if (psi_fd_count == 0) {
+		sleep(cfg.update);
+		return;
+	}
+	update = cfg.psi_update > 0 ? cfg.psi_update : cfg.update;
+	rc = poll(psi_fds, psi_fd_count, update * 1000);
+	if (rc < 0) {
+		/* Signals like SIGHUP are handled by the main loop */
+		if (errno == EINTR)
+			return;
+		cpuplugd_exit("poll failed: %s\n", strerror(errno));
+	}
+	for (i = 0; i < psi_fd_count; i++) {
+		if (!psi_is_cgroup[i] && (psi_fds[i].revents & POLLERR))
+			cpuplugd_exit("PSI trigger for %s failed\n",
+				      psi_names[i]);
+		if (!(psi_fds[i].revents & POLLPRI))
+			continue;
+		cpuplugd_debug("Pressure event on %s\n", psi_names[i]);
+		/* Changes of cgroup files are reported with POLLERR | POLLPRI */
+		if (psi_is_cgroup[i] &&
+		    pread(psi_fds[i].fd, buf, sizeof(buf), 0) < 0)
+			cpuplugd_exit("%s read failed: %s\n", psi_names[i],
+				      strerror(errno));
+	}
+}
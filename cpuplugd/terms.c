@@ -24,6 +24,12 @@ static enum op_prio op_prio_table[] =
 	[OP_OR] = OP_PRIO_OR,
 };
 
+static struct symbol_names func_names[] = {
+	{ "slope", OP_FUNC_SLOPE },
+	{ "ewma", OP_FUNC_EWMA },
+	{ "predict", OP_FUNC_PREDICT },
+};
+
 static void free_term(struct term *fn)
 {
 	if (!fn)
@@ -47,6 +53,9 @@ static void free_term(struct term *fn)
 		break;
 	case OP_NEG:
 	case OP_NOT:
+	case OP_FUNC_SLOPE:
+	case OP_FUNC_EWMA:
+	case OP_FUNC_PREDICT:
 		free_term(fn->left);
 		free(fn);
 		break;
@@ -147,6 +156,14 @@ void print_term(struct term *fn)
 		print_term(fn->left);
 		printf(")");
 		break;
+	case OP_FUNC_SLOPE:
+	case OP_FUNC_EWMA:
+	case OP_FUNC_PREDICT:
+		printf("%s(", fn->op == OP_FUNC_SLOPE ? "slope" :
+		       fn->op == OP_FUNC_EWMA ? "ewma" : "predict");
+		print_term(fn->left);
+		printf(", %u)", fn->index);
+		break;
 	case OP_PLUS:
 	case OP_MINUS:
 	case OP_MULT:
@@ -208,6 +225,9 @@ void print_term(struct term *fn)
 		case OP_SYMBOL_TIME:	// TODO use default: ???
 		case OP_NEG:
 		case OP_NOT:
+		case OP_FUNC_SLOPE:
+		case OP_FUNC_EWMA:
+		case OP_FUNC_PREDICT:
 		case VAR_LOAD:
 		case VAR_RUN:
 		case VAR_ONLINE:
@@ -253,6 +273,91 @@ static struct term *parse_var_term(char **p)
 	return fn;
 }
 
+/*
+ * Return the number of history levels that are needed to evaluate a term
+ */
+static unsigned int term_history(struct term *fn)
+{
+	unsigned int left, right;
+
+	switch (fn->op) {
+	case OP_SYMBOL_MEMINFO:
+	case OP_SYMBOL_VMSTAT:
+	case OP_SYMBOL_CPUSTAT:
+	case OP_SYMBOL_TIME:
+		return fn->index;
+	case OP_NEG:
+	case OP_NOT:
+		return term_history(fn->left);
+	case OP_AND:
+	case OP_OR:
+	case OP_GREATER:
+	case OP_LESSER:
+	case OP_PLUS:
+	case OP_MINUS:
+	case OP_MULT:
+	case OP_DIV:
+		left = term_history(fn->left);
+		right = term_history(fn->right);
+		return MAX(left, right);
+	case OP_FUNC_SLOPE:
+	case OP_FUNC_EWMA:
+	case OP_FUNC_PREDICT:
+		/*
+		 * The oldest interval also needs its predecessor for the
+		 * percentages and rates
+		 */
+		return term_history(fn->left) + fn->index;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Parse a trend function, e.g. slope(loadavg,5)
+ *
+ * Returns NULL if "p" does not start with a function name.
+ */
+static struct term *parse_func_term(char **p)
+{
+	unsigned int i, length, min, history;
+	struct term *fn;
+	char *s, *endptr;
+	long intervals;
+
+	for (i = 0; i < ARRAY_SIZE(func_names); i++) {
+		length = strlen(func_names[i].name);
+		if (strncmp(*p, func_names[i].name, length) == 0 &&
+		    (*p)[length] == '(')
+			break;
+	}
+	if (i >= ARRAY_SIZE(func_names))
+		return NULL;
+	s = *p + length + 1;
+	fn = malloc(sizeof(struct term));
+	if (fn == NULL)
+		cpuplugd_exit("Out of memory: term\n");
+	fn->op = func_names[i].symop;
+	fn->left = parse_term(&s, OP_PRIO_NONE);
+	if (fn->left == NULL || *s != ',' || !isdigit(s[1]))
+		cpuplugd_exit("parsing error at %s\n", *p);
+	intervals = strtol(s + 1, &endptr, 10);
+	if (*endptr != ')')
+		cpuplugd_exit("parsing error at %s\n", *p);
+	/* A slope needs at least two values */
+	min = (fn->op == OP_FUNC_EWMA) ? 1 : 2;
+	if (intervals < min || intervals > MAX_HISTORY)
+		cpuplugd_exit("Number of intervals for %s must be between %u "
+			      "and %i: %s\n", func_names[i].name, min,
+			      MAX_HISTORY, *p);
+	fn->index = intervals;
+	history = term_history(fn);
+	if (history_max < history)
+		history_max = history;
+	*p = endptr + 1;
+	return fn;
+}
+
 struct term *parse_term(char **p, enum op_prio prio)
 {
 	struct term *fn, *new;
@@ -308,8 +413,10 @@ struct term *parse_term(char **p, enum op_prio prio)
 			goto out_error;
 		s++;
 	} else {
-		/* Check for variable name */
-		fn = parse_var_term(&s);
+		/* Check for function and variable name */
+		fn = parse_func_term(&s);
+		if (fn == NULL)
+			fn = parse_var_term(&s);
 		if (fn == NULL) {
 			for (i = 0; i < sym_names_count; i++)
 				if (strncmp(s, sym_names[i].name,
@@ -326,6 +433,7 @@ struct term *parse_term(char **p, enum op_prio prio)
 			if (fn == NULL)
 				goto out_error;
 			fn->op = sym_names[i].symop;
+			fn->index = 0;
 			s += strlen(sym_names[i].name);
 			length = 0;
 			if (fn->op == OP_SYMBOL_MEMINFO ||
@@ -338,6 +446,14 @@ struct term *parse_term(char **p, enum op_prio prio)
 					goto out_error;
 				strncpy(fn->proc_name, s, length);
 				fn->proc_name[length] = '\0';
+				if (fn->op == OP_SYMBOL_MEMINFO)
+					fn->symtab = &meminfo_symtab;
+				else if (fn->op == OP_SYMBOL_VMSTAT)
+					fn->symtab = &vmstat_symtab;
+				else
+					fn->symtab = &cpustat_symtab;
+				fn->sym = proc_symtab_add(fn->symtab,
+							  fn->proc_name);
 			}
 			if (fn->op == OP_SYMBOL_MEMINFO ||
 			    fn->op == OP_SYMBOL_VMSTAT ||
@@ -413,32 +529,21 @@ out_error:
 	return NULL;
 }
 
-static double get_value(struct term *fn)
+static double get_value(struct term *fn, struct symbols *symbols)
 {
+	unsigned int index;
 	double value = 0;
-	char *procinfo;
-	unsigned int history_index;
 
-	if (fn->index <= history_current)
-		history_index = history_current - fn->index;
-	else
-		history_index = history_max + 1 - (fn->index - history_current);
+	index = history_index(fn->index + symbols->history_offset);
 
 	switch (fn->op) {
 	case OP_SYMBOL_MEMINFO:
-		procinfo = meminfo + history_index * meminfo_size;
-		value = get_proc_value(procinfo, fn->proc_name, ':');
-		break;
 	case OP_SYMBOL_VMSTAT:
-		procinfo = vmstat + history_index * vmstat_size;
-		value = get_proc_value(procinfo, fn->proc_name, ' ');
-		break;
 	case OP_SYMBOL_CPUSTAT:
-		procinfo = cpustat + history_index * cpustat_size;
-		value = get_proc_value(procinfo, fn->proc_name, ' ');
+		value = proc_symtab_value(fn->symtab, fn->sym, index);
 		break;
 	case OP_SYMBOL_TIME:
-		value = timestamps[history_index];
+		value = timestamps[index];
 		break;
 	default:
 		cpuplugd_exit("Invalid term specified: %i\n", fn->op);
@@ -446,6 +551,45 @@ static double get_value(struct term *fn)
 	return value;
 }
 
+/*
+ * Evaluate a trend function over the last fn->index intervals
+ *
+ * The term is evaluated with the symbols of each of these intervals. The
+ * slope is calculated by linear regression over the timestamps, so it is
+ * a change per second also if the intervals differ in length.
+ */
+static double eval_func(struct term *fn, struct symbols *symbols)
+{
+	double x, y, t0, slope, alpha, ewma = 0;
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+	unsigned int n = fn->index, offset, k;
+	struct symbols hist;
+
+	t0 = timestamps[history_index(symbols->history_offset)];
+	alpha = 2.0 / (n + 1);
+	/* Start with the oldest interval */
+	for (k = n; k-- > 0;) {
+		offset = symbols->history_offset + k;
+		history_symbols(&hist, offset);
+		y = eval_double(fn->left, &hist);
+		x = timestamps[history_index(offset)] - t0;
+		ewma = (k == n - 1) ? y : alpha * y + (1 - alpha) * ewma;
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+	}
+	if (fn->op == OP_FUNC_EWMA)
+		return ewma;
+	slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+	if (fn->op == OP_FUNC_SLOPE)
+		return slope;
+	/* Extrapolate by the average length of the intervals */
+	x = (t0 - timestamps[history_index(symbols->history_offset + n - 1)]) /
+		(n - 1);
+	return (sy - slope * sx) / n + slope * x;
+}
+
 double eval_double(struct term *fn, struct symbols *symbols)
 {
 	double a, b, sum;
@@ -487,7 +631,11 @@ double eval_double(struct term *fn, struct symbols *symbols)
 	case OP_SYMBOL_VMSTAT:
 	case OP_SYMBOL_CPUSTAT:
 	case OP_SYMBOL_TIME:
-		return get_value(fn);
+		return get_value(fn, symbols);
+	case OP_FUNC_SLOPE:
+	case OP_FUNC_EWMA:
+	case OP_FUNC_PREDICT:
+		return eval_func(fn, symbols);
 	case OP_CONST:
 		return fn->value;
 	case OP_NEG:
@@ -9,10 +9,13 @@
  */
 
 #include <linux/version.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <sys/sysmacros.h>
 #include <sys/time.h>
 #include <sys/utsname.h>
+#include <sys/wait.h>
+#include <time.h>
 
 #include "lib/dasd_base.h"
 #include "lib/dasd_sys.h"
@@ -22,6 +25,7 @@
 #include "lib/util_proc.h"
 #include "lib/vtoc.h"
 #include "lib/zt_common.h"
+#include "lib/zt_probe.h"
 
 #include "dasdfmt.h"
 
@@ -36,11 +40,16 @@ static format_mode_t mode;
 static char *prog_name;
 static volatile sig_atomic_t program_interrupt_in_progress;
 static int reqsize;
+static int queue_depth = DEFAULT_QUEUEDEPTH;
+static int check_stride = 1;
+static int stats_fd = -1;
 
 static const struct util_prg prg = {
 	.desc = "Use dasdfmt to format a DASD ECKD device for use by Linux.\n"
-		"DEVICE is the node of the device (e.g. '/dev/dasda').",
-	.args = "DEVICE",
+		"DEVICE is the node of the device (e.g. '/dev/dasda'). When\n"
+		"more than one DEVICE is specified, all devices are processed\n"
+		"concurrently.",
+	.args = "DEVICE...",
 	.copyright_vec = {
 		{
 			.owner = "IBM Corp.",
@@ -77,6 +86,7 @@ static struct dasdfmt_globals {
 	int   mode_specified;
 	int   ese;
 	int   no_discard;
+	int   multiple_devices;
 } g = {
 	.dasd_info = { 0 },
 };
@@ -85,6 +95,9 @@ static struct dasdfmt_globals {
 #define OPT_CHECK	128
 #define OPT_NOZERO	129
 #define OPT_NODISCARD	130
+#define OPT_QUEUEDEPTH	131
+#define OPT_CHECKSAMPLE	132
+#define OPT_STATS	133
 
 static struct util_opt opt_vec[] = {
 	UTIL_OPT_SECTION("FORMAT ACTIONS"),
@@ -101,6 +114,13 @@ static struct util_opt opt_vec[] = {
 		.desc = "Perform complete format check on device",
 		.flags = UTIL_OPT_FLAG_NOSHORT,
 	},
+	{
+		.option = { "check-sample", required_argument, NULL,
+			    OPT_CHECKSAMPLE },
+		.argument = "PERCENT",
+		.desc = "Perform format check on PERCENT of the device",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
 	UTIL_OPT_SECTION("FORMAT OPTIONS"),
 	{
 		.option = { "blocksize", required_argument, NULL, 'b' },
@@ -130,7 +150,15 @@ static struct util_opt opt_vec[] = {
 	{
 		.option = { "requestsize", required_argument, NULL, 'r' },
 		.argument = "NUM",
-		.desc = "Process NUM cylinders in one formatting step",
+		.desc = "Process NUM cylinders in one formatting step, or\n"
+			"'auto' to determine NUM while formatting",
+	},
+	{
+		.option = { "queue-depth", required_argument, NULL,
+			    OPT_QUEUEDEPTH },
+		.argument = "NUM",
+		.desc = "Keep NUM format requests in flight (default 1)",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
 	},
 	{
 		.option = { "norecordzero", no_argument, NULL, OPT_NOZERO },
@@ -161,6 +189,12 @@ static struct util_opt opt_vec[] = {
 		.option = { "percentage", no_argument, NULL, 'P' },
 		.desc = "Show progress in percent",
 	},
+	{
+		.option = { "stats", required_argument, NULL, OPT_STATS },
+		.argument = "FILE",
+		.desc = "Write throughput statistics in CSV format to FILE",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
 	UTIL_OPT_SECTION("MISC"),
 	{
 		.option = { "check_host_count", no_argument, NULL, 'C' },
@@ -193,6 +227,8 @@ static void error(const char *format, ...)
 	va_list args;
 
 	fprintf(stderr, "%s: ", prog_name);
+	if (g.multiple_devices && g.dev_path)
+		fprintf(stderr, "%s: ", g.dev_path);
 	va_start(args, format);
 	vfprintf(stderr, format, args);
 	va_end(args);
@@ -313,6 +349,8 @@ static void draw_progress(int cyl, unsigned int cylinders, int aborted)
 	}
 
 	if (g.print_percentage) {
+		if (g.multiple_devices)
+			printf("%s: ", g.dev_path);
 		printf("cyl %7d of %7d |%3d%%\n", cyl, cylinders,
 		       cyl * 100 / cylinders);
 		fflush(stdout);
@@ -506,21 +544,15 @@ static void program_interrupt_signal(int sig)
  * Retrieve reliable device node and store device information in global
  * dev_node and dev_path accordingly.
  */
-static void get_device_name(int optind, int argc, char *argv[])
+static void get_device_name(const char *name)
 {
 	struct util_proc_dev_entry dev_entry;
 	unsigned int maj, min;
 	struct stat dev_stat;
 
-	if (optind + 1 < argc)
-		error("More than one device specified!");
-
-	if (optind >= argc)
-		error("No device specified!");
-
-	if (strlen(argv[optind]) >= PATH_MAX)
+	if (strlen(name) >= PATH_MAX)
 		error("device name too long!");
-	util_asprintf(&g.dev_path, argv[optind]);
+	util_asprintf(&g.dev_path, name);
 
 	if (stat(g.dev_path, &dev_stat) != 0)
 		error("Could not get information for device node %s: %s",
@@ -777,6 +809,21 @@ static void check_hashmarks(void)
 	}
 }
 
+/*
+ * Format a range of tracks, the USDT probes dasdfmt:format_disk and
+ * dasdfmt:format_disk_done report the track range of each request.
+ */
+static int format_disk(int fd, format_data_t *p)
+{
+	int rc;
+
+	ZT_PROBE(dasdfmt, format_disk, p->start_unit, p->stop_unit,
+		 p->blksize, p->intensity);
+	rc = dasd_format_disk(fd, p);
+	ZT_PROBE(dasdfmt, format_disk_done, p->start_unit, p->stop_unit, rc);
+	return rc;
+}
+
 /*
  * This function checks whether a range of tracks is in regular format
  * with the specified block size.
@@ -810,6 +857,265 @@ static format_check_t check_track_format(format_data_t *p)
 	return cdata;
 }
 
+/*
+ * Set the track range of the step starting at cur_trk. A step ends at
+ * a cylinder boundary after at most reqsize cylinders or at stop_trk.
+ * For a sampled check, the tracks of check_stride - 1 further steps are
+ * skipped, but the last step up to stop_trk is always included.
+ * Return the number of tracks to the start of the next step.
+ */
+static unsigned long set_step(format_data_t *step, unsigned long cur_trk,
+			      unsigned int heads, unsigned long stop_trk)
+{
+	unsigned long step_value = reqsize * heads - (cur_trk % heads);
+	unsigned long stop_cyl = stop_trk / heads;
+	unsigned long last, next;
+
+	step->start_unit = cur_trk;
+	if (cur_trk + heads * reqsize >= stop_trk) {
+		step->stop_unit = stop_trk;
+		return step_value;
+	}
+	step->stop_unit = cur_trk + step_value - 1;
+	if (check_stride <= 1)
+		return step_value;
+
+	/* Start of the step that ends at stop_trk */
+	if (stop_cyl + 1 > (unsigned long) reqsize)
+		last = (stop_cyl + 1 - reqsize) * heads;
+	else
+		last = 0;
+	next = cur_trk + step_value + (check_stride - 1) * reqsize * heads;
+	if (next > last)
+		next = MAX(last, cur_trk + step_value);
+
+	return next - cur_trk;
+}
+
+/*
+ * Automatic request size tuning: Starting with one cylinder, the request
+ * size is doubled as long as this improves the rate of processed tracks.
+ * The request size with the best rate is used for the remaining tracks.
+ */
+static struct reqsize_tuning {
+	int active;
+	int steps;		/* steps measured with the current size */
+	unsigned long tracks;	/* tracks processed with the current size */
+	double time;		/* seconds spent with the current size */
+	double best_rate;	/* tracks per second of best_size */
+	int best_size;
+} tuning;
+
+static double get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Account a step of tracks that took time seconds and select the request
+ * size for the next step.
+ */
+static void tune_reqsize(unsigned long tracks, double time)
+{
+	double rate;
+
+	if (!tuning.active)
+		return;
+
+	tuning.tracks += tracks;
+	tuning.time += time;
+	if (++tuning.steps < TUNING_STEPS || tuning.time <= 0)
+		return;
+
+	rate = tuning.tracks / tuning.time;
+	if (g.verbosity > 0)
+		printf("Request size %d: %.0f tracks per second\n", reqsize,
+		       rate);
+	if (rate > tuning.best_rate * TUNING_MIN_GAIN) {
+		tuning.best_rate = rate;
+		tuning.best_size = reqsize;
+		if (reqsize < MAX_REQUESTSIZE) {
+			reqsize = MIN(2 * reqsize, MAX_REQUESTSIZE);
+			tuning.steps = 0;
+			tuning.tracks = 0;
+			tuning.time = 0;
+			return;
+		}
+	}
+	reqsize = tuning.best_size;
+	tuning.active = 0;
+	if (g.verbosity > 0)
+		printf("Using a request size of %d cylinders.\n", reqsize);
+}
+
+/*
+ * Write the CSV header line to the statistics file
+ */
+static void stats_write_header(void)
+{
+	const char header[] = "type,device,operation,start_track,stop_track,"
+			      "tracks,seconds,tracks_per_second\n";
+
+	if (write(stats_fd, header, strlen(header)) < 0)
+		error("Could not write statistics: %s", strerror(errno));
+}
+
+/*
+ * Write one line to the statistics file. A step line describes a single
+ * request, a total line the whole range processed for a device.
+ */
+static void stats_write(const char *type, unsigned long start_trk,
+			unsigned long stop_trk, unsigned long tracks,
+			double time)
+{
+	char line[PATH_MAX + 128];
+	int len;
+
+	if (stats_fd < 0)
+		return;
+
+	len = snprintf(line, sizeof(line), "%s,%s,%s,%lu,%lu,%lu,%.6f,%.0f\n",
+		       type, g.dev_path, g.check ? "check" : "format",
+		       start_trk, stop_trk, tracks, time,
+		       time > 0 ? tracks / time : 0);
+	/* A single write keeps lines of concurrent processes intact */
+	if (write(stats_fd, line, len) != len) {
+		warn("Could not write statistics");
+		stats_fd = -1;
+	}
+}
+
+/*
+ * State shared by the threads issuing format or check requests
+ */
+struct format_queue {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	format_data_t params;	/* parameters and range of the whole format */
+	unsigned int heads;
+	unsigned long next_trk;	/* start of the next step to be issued */
+	unsigned long done;	/* number of processed or skipped tracks */
+	unsigned long tracks;	/* number of processed tracks */
+	int active;		/* number of running threads */
+	int err;		/* first error of a format request */
+	format_check_t cdata;	/* first format error found by a check */
+};
+
+/*
+ * Issue format or check requests for the next steps until all steps are
+ * issued, a request failed, or a check found a format error.
+ */
+static void *format_thread(void *arg)
+{
+	struct format_queue *q = arg;
+	format_data_t step = q->params;
+	format_check_t cdata = { .expect = {0}, 0 };
+	unsigned long step_value, tracks;
+	int err = 0;
+	double start;
+
+	pthread_mutex_lock(&q->lock);
+	while (!q->err && !q->cdata.result &&
+	       q->next_trk < q->params.stop_unit) {
+		step_value = set_step(&step, q->next_trk, q->heads,
+				      q->params.stop_unit);
+		q->next_trk += step_value;
+		pthread_mutex_unlock(&q->lock);
+
+		start = get_time();
+		if (g.check)
+			cdata = check_track_format(&step);
+		else
+			err = format_disk(filedes, &step);
+		tracks = step.stop_unit - step.start_unit + 1;
+
+		pthread_mutex_lock(&q->lock);
+		stats_write("step", step.start_unit, step.stop_unit, tracks,
+			    get_time() - start);
+		q->tracks += tracks;
+		if (err != 0 && !q->err)
+			q->err = err;
+		/* Steps are issued in order, report the lowest error track */
+		if (g.check && cdata.result &&
+		    (!q->cdata.result || cdata.unit < q->cdata.unit))
+			q->cdata = cdata;
+		q->done += step_value;
+		pthread_cond_signal(&q->cond);
+	}
+	q->active--;
+	pthread_cond_signal(&q->cond);
+	pthread_mutex_unlock(&q->lock);
+
+	return NULL;
+}
+
+/*
+ * Format or check the tracks with queue_depth requests in flight. Each
+ * request blocks in the ioctl, so every request is issued by a separate
+ * thread while the main thread draws the progress. Return the result of
+ * the check of the first track with a format error and the number of
+ * processed tracks in tracks.
+ */
+static format_check_t process_tracks_queued(unsigned int cylinders,
+					    unsigned int heads,
+					    format_data_t *p,
+					    unsigned long *tracks)
+{
+	struct format_queue q = {
+		.params = *p,
+		.heads = heads,
+		.next_trk = p->start_unit,
+	};
+	sigset_t set, oldset;
+	pthread_t *threads;
+	unsigned int cyl;
+	int i, rc;
+
+	pthread_mutex_init(&q.lock, NULL);
+	pthread_cond_init(&q.cond, NULL);
+	threads = util_malloc(queue_depth * sizeof(pthread_t));
+
+	/* Interrupt signals are handled by the main thread */
+	sigemptyset(&set);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGQUIT);
+	pthread_sigmask(SIG_BLOCK, &set, &oldset);
+	pthread_mutex_lock(&q.lock);
+	for (i = 0; i < queue_depth; i++) {
+		rc = pthread_create(&threads[i], NULL, format_thread, &q);
+		if (rc != 0)
+			error("Could not start thread: %s", strerror(rc));
+		q.active++;
+	}
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	while (q.active) {
+		pthread_cond_wait(&q.cond, &q.lock);
+		cyl = MIN((p->start_unit + q.done) / heads, cylinders);
+		pthread_mutex_unlock(&q.lock);
+		draw_progress(cyl, cylinders, 0);
+		pthread_mutex_lock(&q.lock);
+	}
+	pthread_mutex_unlock(&q.lock);
+
+	for (i = 0; i < queue_depth; i++)
+		pthread_join(threads[i], NULL);
+	*tracks = q.tracks;
+	free(threads);
+	pthread_cond_destroy(&q.cond);
+	pthread_mutex_destroy(&q.lock);
+
+	if (q.err != 0)
+		error("the ioctl call to format tracks failed: %s",
+		      strerror(q.err));
+
+	return q.cdata;
+}
+
 /*
  * Either do the actual format or check depending on the check-value.
  */
@@ -818,24 +1124,42 @@ static int process_tracks(unsigned int cylinders, unsigned int heads,
 {
 	format_check_t cdata = { .expect = {0}, 0};
 	format_data_t step = *format_params;
-	unsigned long step_value;
+	unsigned long step_value, tracks = 0;
 	unsigned long cur_trk;
 	int cyl = 0, err;
+	double start, total_start = get_time();
 
 	check_hashmarks();
 
-	cur_trk = format_params->start_unit;
+	if (queue_depth > 1) {
+		cdata = process_tracks_queued(cylinders, heads, format_params,
+					      &tracks);
+		stats_write("total", format_params->start_unit,
+			    format_params->stop_unit, tracks,
+			    get_time() - total_start);
+		if (cdata.result) {
+			cyl = cdata.unit / heads + 1;
+			draw_progress(cyl, cylinders, 1);
+			evaluate_format_error(&cdata, heads);
+			return cdata.result;
+		}
+		step.stop_unit = format_params->stop_unit;
+		cur_trk = format_params->stop_unit;
+	} else {
+		cur_trk = format_params->start_unit;
+	}
 
 	while (cur_trk < format_params->stop_unit) {
-		step_value = reqsize * heads - (cur_trk % heads);
-		step.start_unit = cur_trk;
-		if (cur_trk + heads * reqsize >= format_params->stop_unit)
-			step.stop_unit = format_params->stop_unit;
-		else
-			step.stop_unit = cur_trk + step_value - 1;
+		step_value = set_step(&step, cur_trk, heads,
+				      format_params->stop_unit);
+		start = get_time();
 
 		if (g.check) {
 			cdata = check_track_format(&step);
+			stats_write("step", step.start_unit, step.stop_unit,
+				    step.stop_unit - step.start_unit + 1,
+				    get_time() - start);
+			tracks += step.stop_unit - step.start_unit + 1;
 			if (cdata.result) {
 				cyl = cur_trk / heads + 1;
 				draw_progress(cyl, cylinders, 1);
@@ -843,16 +1167,27 @@ static int process_tracks(unsigned int cylinders, unsigned int heads,
 				break;
 			}
 		} else {
-			err = dasd_format_disk(filedes, &step);
+			err = format_disk(filedes, &step);
 			if (err != 0)
 				error("the ioctl call to format tracks failed: %s", strerror(err));
+			stats_write("step", step.start_unit, step.stop_unit,
+				    step.stop_unit - step.start_unit + 1,
+				    get_time() - start);
+			tracks += step.stop_unit - step.start_unit + 1;
 		}
 
+		tune_reqsize(step.stop_unit - step.start_unit + 1,
+			     get_time() - start);
+
 		cyl = cur_trk / heads + 1;
 		draw_progress(cyl, cylinders, 0);
 
 		cur_trk += step_value;
 	}
+	if (queue_depth <= 1)
+		stats_write("total", format_params->start_unit,
+			    format_params->stop_unit, tracks,
+			    get_time() - total_start);
 	/* We're done, draw the 100% mark */
 	if (!cdata.result) {
 		cyl = step.stop_unit / heads + 1;
@@ -872,7 +1207,11 @@ static void check_disk_format(unsigned int cylinders, unsigned int heads,
 	check_params->start_unit = 0;
 	check_params->stop_unit = (cylinders * heads) - 1;
 
-	printf("Checking format of the entire disk...\n");
+	if (check_stride > 1)
+		printf("Checking format of every %d. step of the disk...\n",
+		       check_stride);
+	else
+		printf("Checking format of the entire disk...\n");
 
 	if (g.testmode) {
 		printf("Test mode active, omitting ioctl.\n");
@@ -1272,7 +1611,7 @@ static void dasdfmt_prepare_and_format(unsigned int cylinders, unsigned int head
 	if (g.verbosity > 0)
 		printf("Invalidate first track...\n");
 
-	err = dasd_format_disk(filedes, &temp);
+	err = format_disk(filedes, &temp);
 	if (err != 0)
 		error("(invalidate first track) IOCTL BIODASDFMT failed: %s", strerror(err));
 
@@ -1289,7 +1628,7 @@ static void dasdfmt_prepare_and_format(unsigned int cylinders, unsigned int head
 	if (g.verbosity > 0)
 		printf("Revalidate first track...\n");
 
-	err = dasd_format_disk(filedes, &temp);
+	err = format_disk(filedes, &temp);
 	if (err != 0)
 		error("(re-validate first track) IOCTL BIODASDFMT failed: %s", strerror(err));
 
@@ -1369,7 +1708,7 @@ static void dasdfmt_quick_format(unsigned int cylinders, unsigned int heads,
 	disk_disable(g.dev_node);
 
 	/* Now do the actual formatting of our first two tracks */
-	err = dasd_format_disk(filedes, p);
+	err = format_disk(filedes, p);
 	if (err != 0)
 		error("the ioctl to format the device failed: %s", strerror(err));
 
@@ -1495,20 +1834,139 @@ static void set_prog_name(char *s)
 		prog_name = p + 1;
 }
 
-int main(int argc, char *argv[])
+/*
+ * Format or check a single device
+ */
+static void process_device(volume_label_t *vlabel, const char *device)
 {
-	volume_label_t vlabel;
+	unsigned int cylinders, heads;
 	char old_volser[7];
-
 	char str[ERR_LENGTH];
+	int rc;
+
+	get_device_name(device);
+
+	rc = dasd_get_info(g.dev_node, &g.dasd_info);
+	if (rc != 0)
+		error("the ioctl call to retrieve device information failed: %s", strerror(rc));
+
+	g.ese = dasd_sys_ese(g.dev_node);
+	eval_format_mode();
+
+	/* Either let the user specify the blksize or get it from the kernel */
+	if (!g.blksize_specified) {
+		if (!(mode == FULL ||
+		      g.dasd_info.format == DASD_FORMAT_NONE) || g.check)
+			get_blocksize(&format_params.blksize);
+		else if (!g.multiple_devices)
+			format_params = ask_user_for_blksize(format_params);
+	}
+
+	if (g.keep_volser) {
+		if (g.labelspec)
+			error("The -k and -l options are mutually exclusive");
+		if (!(format_params.intensity & DASD_FMT_INT_COMPAT))
+			error("WARNING: VOLSER cannot be kept when using the ldl format!");
+
+		if (dasdfmt_get_volser(old_volser) == 0)
+			vtoc_volume_label_set_volser(vlabel, old_volser);
+		else
+			error("VOLSER not found on device %s", g.dev_path);
+	}
+
+	check_disk();
+
+	if (check_param(str, ERR_LENGTH, &format_params) < 0)
+		error("%s", str);
+
+	set_geo(&cylinders, &heads);
+	set_label(vlabel, &format_params, cylinders);
+
+	if (g.check)
+		check_disk_format(cylinders, heads, &format_params);
+	else
+		do_format_dasd(vlabel, &format_params, cylinders, heads);
+}
+
+/*
+ * Process each device in a separate child process so that all devices
+ * are formatted concurrently. Return EXIT_SUCCESS if all devices were
+ * processed successfully, EXIT_FAILURE otherwise.
+ */
+static int process_devices(volume_label_t *vlabel, int count, char *devices[])
+{
+	struct stat dev_stat;
+	int i, j, status, rc = EXIT_SUCCESS;
+	dev_t *rdev;
+	pid_t *pids;
+
+	/* Prompts and redrawn progress lines of multiple devices mix up */
+	if (!g.withoutprompt && !g.testmode && !g.check)
+		error("Formatting more than one device requires -y");
+	if (g.print_progressbar || g.print_hashmarks)
+		error("Use -P to show the progress of more than one device");
+
+	rdev = util_malloc(count * sizeof(dev_t));
+	for (i = 0; i < count; i++) {
+		if (stat(devices[i], &dev_stat) != 0)
+			error("Could not get information for device node %s: %s",
+			      devices[i], strerror(errno));
+		rdev[i] = dev_stat.st_rdev;
+		for (j = 0; j < i; j++) {
+			if (rdev[j] == rdev[i])
+				error("Device %s specified more than once",
+				      devices[i]);
+		}
+	}
+	free(rdev);
+
+	g.multiple_devices = 1;
+	pids = util_malloc(count * sizeof(pid_t));
+	fflush(stdout);
+	for (i = 0; i < count; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0)
+			error("Could not start process for %s: %s", devices[i],
+			      strerror(errno));
+		if (pids[i] == 0) {
+			free(pids);
+			setvbuf(stdout, NULL, _IOLBF, 0);
+			process_device(vlabel, devices[i]);
+			free(g.dev_path);
+			free(g.dev_node);
+			exit(EXIT_SUCCESS);
+		}
+	}
+
+	/* The child processes re-enable their devices when interrupted */
+	signal(SIGTERM, SIG_IGN);
+	signal(SIGINT,  SIG_IGN);
+	signal(SIGQUIT, SIG_IGN);
+
+	for (i = 0; i < count; i++) {
+		if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status) != EXIT_SUCCESS) {
+			ERRMSG("%s: Processing of device %s failed\n",
+			       prog_name, devices[i]);
+			rc = EXIT_FAILURE;
+		}
+	}
+	free(pids);
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	volume_label_t vlabel;
 	char buf[7];
 
 	char *blksize_param_str = NULL;
 	char *reqsize_param_str = NULL;
 	char *hashstep_str      = NULL;
+	char *stats_path        = NULL;
 
-	int rc;
-	unsigned int cylinders, heads;
+	int rc, percent;
 
 	/* Establish a handler for interrupt signals. */
 	signal(SIGTERM, program_interrupt_signal);
@@ -1633,6 +2091,23 @@ int main(int argc, char *argv[])
 		case OPT_CHECK:
 			g.check = 1;
 			break;
+		case OPT_STATS:
+			stats_path = optarg;
+			break;
+		case OPT_CHECKSAMPLE:
+			PARSE_PARAM_INTO(percent, optarg, 10, "check sample");
+			if (percent < 1 || percent > 100)
+				error("invalid check sample %d%% specified",
+				      percent);
+			check_stride = 100 / percent;
+			g.check = 1;
+			break;
+		case OPT_QUEUEDEPTH:
+			PARSE_PARAM_INTO(queue_depth, optarg, 10, "queue depth");
+			if (queue_depth < 1 || queue_depth > MAX_QUEUEDEPTH)
+				error("invalid queue depth %d specified",
+				      queue_depth);
+			break;
 		case -1:
 			/* End of options string - start of devices list */
 			break;
@@ -1651,9 +2126,14 @@ int main(int argc, char *argv[])
 	if (g.blksize_specified)
 		PARSE_PARAM_INTO(format_params.blksize, blksize_param_str, 10,
 				 "blocksize");
-	if (g.reqsize_specified) {
+	if (g.reqsize_specified && strcasecmp(reqsize_param_str, "auto") == 0) {
+		if (queue_depth > 1)
+			error("--requestsize=auto cannot be used with --queue-depth");
+		reqsize = 1;
+		tuning.active = 1;
+	} else if (g.reqsize_specified) {
 		PARSE_PARAM_INTO(reqsize, reqsize_param_str, 10, "requestsize");
-		if (reqsize < 1 || reqsize > 255)
+		if (reqsize < 1 || reqsize > MAX_REQUESTSIZE)
 			error("invalid requestsize %d specified", reqsize);
 	} else {
 		reqsize = DEFAULT_REQUESTSIZE;
@@ -1662,48 +2142,22 @@ int main(int argc, char *argv[])
 	if (g.print_hashmarks)
 		PARSE_PARAM_INTO(g.hashstep, hashstep_str, 10, "hashstep");
 
-	get_device_name(optind, argc, argv);
-
-	rc = dasd_get_info(g.dev_node, &g.dasd_info);
-	if (rc != 0)
-		error("the ioctl call to retrieve device information failed: %s", strerror(rc));
-
-	g.ese = dasd_sys_ese(g.dev_node);
-	eval_format_mode();
-
-	/* Either let the user specify the blksize or get it from the kernel */
-	if (!g.blksize_specified) {
-		if (!(mode == FULL ||
-		      g.dasd_info.format == DASD_FORMAT_NONE) || g.check)
-			get_blocksize(&format_params.blksize);
-		else
-			format_params = ask_user_for_blksize(format_params);
-	}
-
-	if (g.keep_volser) {
-		if (g.labelspec)
-			error("The -k and -l options are mutually exclusive");
-		if (!(format_params.intensity & DASD_FMT_INT_COMPAT))
-			error("WARNING: VOLSER cannot be kept when using the ldl format!");
-
-		if (dasdfmt_get_volser(old_volser) == 0)
-			vtoc_volume_label_set_volser(&vlabel, old_volser);
-		else
-			error("VOLSER not found on device %s", g.dev_path);
+	if (stats_path) {
+		stats_fd = open(stats_path, O_WRONLY | O_CREAT | O_TRUNC |
+				O_APPEND, 0644);
+		if (stats_fd < 0)
+			error("Could not open statistics file %s: %s",
+			      stats_path, strerror(errno));
+		stats_write_header();
 	}
 
-	check_disk();
-
-	if (check_param(str, ERR_LENGTH, &format_params) < 0)
-		error("%s", str);
+	if (optind >= argc)
+		error("No device specified!");
 
-	set_geo(&cylinders, &heads);
-	set_label(&vlabel, &format_params, cylinders);
+	if (optind + 1 < argc)
+		return process_devices(&vlabel, argc - optind, &argv[optind]);
 
-	if (g.check)
-		check_disk_format(cylinders, heads, &format_params);
-	else
-		do_format_dasd(&vlabel, &format_params, cylinders, heads);
+	process_device(&vlabel, argv[optind]);
 
 	free(g.dev_path);
 	free(g.dev_node);
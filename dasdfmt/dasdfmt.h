@@ -55,6 +55,13 @@ static void error(const char *format, ...)
 #define DEFAULT_BLOCKSIZE  4096
 /* requestsize - number of cylinders in one format step */
 #define DEFAULT_REQUESTSIZE 10
+#define MAX_REQUESTSIZE 255
+/* requestsize tuning - steps per measurement and minimum rate gain */
+#define TUNING_STEPS 3
+#define TUNING_MIN_GAIN 1.05
+/* queue depth - number of format requests in flight */
+#define DEFAULT_QUEUEDEPTH 1
+#define MAX_QUEUEDEPTH 16
 
 #define ERRMSG(x...) {fflush(stdout);fprintf(stderr,x);}
 #define ERRMSG_EXIT(ec,x...) {fflush(stdout);fprintf(stderr,x);exit(ec);}
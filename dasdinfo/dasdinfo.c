@@ -369,14 +369,33 @@ static int dinfo_get_dev_from_blockdev(char *blockdev, dev_t *dev)
 	return 0;
 }
 
-static int
-dinfo_is_busiddir(const char *fpath, const struct stat *UNUSED(sb),
-		  int tflag, struct FTW *ftwbuf)
+/*
+ * Check if the directory belongs to a device bound to a DASD driver.
+ * Returns 1 if so, 0 if not, and -1 on error.
+ */
+static int dinfo_is_dasd_dir(const char *fpath)
 {
 	char *tempdir;
 	char linkdir[128];
 	ssize_t i;
 
+	if (asprintf(&tempdir, "%s/driver", fpath) < 0)
+		return -1;
+	i = readlink(tempdir, linkdir, sizeof(linkdir));
+	free(tempdir);
+	if ((i < 0) || (i >= (ssize_t) sizeof(linkdir)))
+		return -1;
+	/* append '\0' because readlink returns non zero terminated string */
+	linkdir[i] = '\0';
+	return strstr(linkdir, "dasd") != NULL;
+}
+
+static int
+dinfo_is_busiddir(const char *fpath, const struct stat *UNUSED(sb),
+		  int tflag, struct FTW *ftwbuf)
+{
+	int rc;
+
 	if (tflag != FTW_D || (strncmp((fpath + ftwbuf->base), searchbusid,
 				       strlen(searchbusid)) != 0))
 		return FTW_CONTINUE;
@@ -385,15 +404,10 @@ dinfo_is_busiddir(const char *fpath, const struct stat *UNUSED(sb),
 	 * subchannel ID
 	 * for large systems subchannel IDs may look like busids
 	 */
-	if (asprintf(&tempdir, "%s/driver", fpath) < 0)
+	rc = dinfo_is_dasd_dir(fpath);
+	if (rc < 0)
 		return -1;
-	i = readlink(tempdir, linkdir, 128);
-	free(tempdir);
-	if ((i < 0) || (i >= 128))
-		return -1;
-	/* append '\0' because readlink returns non zero terminated string */
-	tempdir[i + 1] = '\0';
-	if (strstr(linkdir, "dasd") == NULL)
+	if (rc == 0)
 		return FTW_CONTINUE;
 	free(busiddir);
 	busiddir = strdup(fpath);
@@ -441,10 +455,22 @@ dinfo_get_blockdev_from_busid(char *busid, char **blkdev)
 	char *result = NULL;
 	char *sysfsdir = "/sys/devices/";
 
-	/* dinfo_is_devnode needs to know the busid */
-	searchbusid = busid;
-	if (nftw(sysfsdir, dinfo_is_busiddir, 200, flags) != FTW_STOP)
+	/*
+	 * Fast path: the ccw bus lists every device by its busid, so
+	 * there is no need to walk the whole device tree
+	 */
+	if (asprintf(&busiddir, "/sys/bus/ccw/devices/%s", busid) < 0) {
+		busiddir = NULL;
 		goto out;
+	}
+	if (strchr(busid, '/') != NULL || dinfo_is_dasd_dir(busiddir) != 1) {
+		free(busiddir);
+		busiddir = NULL;
+		/* dinfo_is_devnode needs to know the busid */
+		searchbusid = busid;
+		if (nftw(sysfsdir, dinfo_is_busiddir, 200, flags) != FTW_STOP)
+			goto out;
+	}
 
 	/*
 	 * new sysfs: busid directory  contains a directory 'block'
@@ -16,6 +16,7 @@
 #include <getopt.h>
 #include <linux/version.h>
 #include <malloc.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -2090,67 +2091,141 @@ static void dasdview_print_raw_track(char *trackdata,
 	} while (1);
 }
 
+/*
+ * Raw tracks are read in large chunks by a reader thread into one of two
+ * buffers while the tracks of the other buffer are printed.
+ */
+struct raw_reader {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct dasdhandle *dasdh;
+	char *buffer[2];
+	u_int64_t start[2];	/* first track in buffer */
+	u_int64_t count[2];	/* number of tracks in buffer, 0 if empty */
+	u_int64_t track;	/* next track to be read */
+	u_int64_t residual;	/* number of tracks still to be read */
+	u_int64_t chunk;	/* maximum number of tracks per read */
+	int rc;
+};
+
+static void *dasdview_raw_reader(void *arg)
+{
+	struct raw_reader *r = arg;
+	u_int64_t count;
+	int n = 0, rc;
+
+	while (r->residual) {
+		pthread_mutex_lock(&r->mutex);
+		while (r->count[n])
+			pthread_cond_wait(&r->cond, &r->mutex);
+		pthread_mutex_unlock(&r->mutex);
+
+		count = MIN(r->chunk, r->residual);
+		rc = lzds_dasdhandle_read_tracks_to_buffer(r->dasdh, r->track,
+							   r->track + count - 1,
+							   r->buffer[n]);
+
+		pthread_mutex_lock(&r->mutex);
+		if (rc) {
+			r->rc = rc;
+			pthread_cond_signal(&r->cond);
+			pthread_mutex_unlock(&r->mutex);
+			break;
+		}
+		r->start[n] = r->track;
+		r->count[n] = count;
+		pthread_cond_signal(&r->cond);
+		pthread_mutex_unlock(&r->mutex);
+
+		r->track += count;
+		r->residual -= count;
+		n ^= 1;
+	}
+	return NULL;
+}
+
 static void dasdview_view_raw(dasdview_info_t *info)
 {
-	u_int64_t residual, trckstart, trckend, track, trckbuffsize;
-	u_int64_t tracks_to_read, trckcount, i;
-	char *trackdata;
+	struct raw_reader r = {
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+	};
+	u_int64_t tracks_to_read, printed, i;
+	long pagesize = sysconf(_SC_PAGESIZE);
+	pthread_t thread;
+	int rc, n;
 	char *data;
-	int rc;
-	struct dasdhandle *dasdh;
 
-	trckstart = info->begin / RAWTRACKSIZE;
+	r.track = info->begin / RAWTRACKSIZE;
 	tracks_to_read = info->size / RAWTRACKSIZE;
+	r.residual = tracks_to_read;
 
-	/* TODO: how large should we make our buffer?
-	 * The DASD device driver cannot read more than 16 tracks at once
-	 * but we can read a larger blob and the block layer will split up
-	 * the requests for us.
+	/*
+	 * The DASD device driver cannot read more than 16 tracks at once,
+	 * but the block layer splits up larger reads and keeps the
+	 * resulting requests in flight together.
 	 */
-	trckbuffsize = MIN(tracks_to_read, 16u);
+	r.chunk = MIN(tracks_to_read, (u_int64_t) RAW_READ_TRACKS);
 	/* track data must be page aligned for O_DIRECT */
-	trackdata = memalign(4096, trckbuffsize * RAWTRACKSIZE);
-	if (!trackdata) {
-		zt_error_print("failed to allocate memory\n");
-		exit(EXIT_FAILURE);
+	for (n = 0; n < 2; n++) {
+		r.buffer[n] = memalign(pagesize, r.chunk * RAWTRACKSIZE);
+		if (!r.buffer[n]) {
+			zt_error_print("failed to allocate memory\n");
+			exit(EXIT_FAILURE);
+		}
 	}
-	rc = lzds_dasd_alloc_dasdhandle(info->dasd, &dasdh);
+	rc = lzds_dasd_alloc_dasdhandle(info->dasd, &r.dasdh);
 	if (rc) {
 		zt_error_print("failed to allocate memory\n");
 		exit(EXIT_FAILURE);
 	}
-	rc = lzds_dasdhandle_open(dasdh);
+	rc = lzds_dasdhandle_open(r.dasdh);
 	if (rc) {
-		lzds_dasdhandle_free(dasdh);
+		lzds_dasdhandle_free(r.dasdh);
 		zt_error_print("failed to open device\n");
 		exit(EXIT_FAILURE);
 	}
-	/* residual is the number of tracks we still have to read */
-	residual = tracks_to_read;
-	track = trckstart;
-	while (residual) {
-		trckcount = MIN(trckbuffsize, residual);
-		trckend = track + trckcount - 1;
-		rc = lzds_dasdhandle_read_tracks_to_buffer(dasdh, track,
-							   trckend, trackdata);
-		if (rc) {
+	rc = pthread_create(&thread, NULL, dasdview_raw_reader, &r);
+	if (rc) {
+		zt_error_print("failed to start reader thread\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* printed is the number of tracks we have already printed */
+	printed = 0;
+	n = 0;
+	while (printed < tracks_to_read) {
+		pthread_mutex_lock(&r.mutex);
+		while (!r.count[n] && !r.rc)
+			pthread_cond_wait(&r.cond, &r.mutex);
+		pthread_mutex_unlock(&r.mutex);
+		if (!r.count[n]) {
+			errno = r.rc;
 			perror("Error on read");
 			exit(EXIT_FAILURE);
 		}
-		data = trackdata;
-		for (i = 0; i < trckcount; ++i) {
-			dasdview_print_raw_track(data, track / info->geo.heads,
-						 track % info->geo.heads);
+		data = r.buffer[n];
+		for (i = 0; i < r.count[n]; ++i) {
+			dasdview_print_raw_track(data,
+						 (r.start[n] + i) / info->geo.heads,
+						 (r.start[n] + i) % info->geo.heads);
 			data += RAWTRACKSIZE;
-			++track;
 		}
-		residual -= trckcount;
+		printed += r.count[n];
+
+		pthread_mutex_lock(&r.mutex);
+		r.count[n] = 0;
+		pthread_cond_signal(&r.cond);
+		pthread_mutex_unlock(&r.mutex);
+		n ^= 1;
 	}
+	pthread_join(thread, NULL);
 
-	free(trackdata);
+	free(r.buffer[0]);
+	free(r.buffer[1]);
 
-	rc = lzds_dasdhandle_close(dasdh);
-	lzds_dasdhandle_free(dasdh);
+	rc = lzds_dasdhandle_close(r.dasdh);
+	lzds_dasdhandle_free(r.dasdh);
 	if (rc < 0) {
 		perror("Error on closing file");
 		exit(EXIT_FAILURE);
@@ -47,6 +47,7 @@
 #define NO_PART_LABELS 8 /* for partition related labels (f1,f8 and f9) */
 #define SEEK_STEP 4194304LL
 #define DUMP_STRING_SIZE 1024LL
+#define RAW_READ_TRACKS 256 /* tracks per read in raw track access mode */
 
 #define ERROR_STRING_SIZE 1024
 static char error_str[ERROR_STRING_SIZE];
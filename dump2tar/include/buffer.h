@@ -40,6 +40,8 @@ int buffer_truncate(struct buffer *buffer, size_t len);
 
 ssize_t buffer_read_fd(struct buffer *buffer, int fd, size_t chunk,
 		       bool usefile, size_t max_buffer_size);
+ssize_t buffer_copy_fd(struct buffer *buffer, int fd, size_t chunk);
+int buffer_send_fd(struct buffer *buffer, int fd);
 int buffer_add_data(struct buffer *buffer, char *addr, size_t len,
 		    bool usefile, size_t max_buffer_size);
 
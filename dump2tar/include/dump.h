@@ -38,11 +38,18 @@ struct dump_opts {
 	bool recursive;
 	bool threaded;
 	bool verbose;
+	bool zstd;
+	const char *connect;
 	const char *output_file;
+	const char *profile;
+	const char *snapshot;
+	int compress_level;
 	int file_timeout;
 	int timeout;
+	long compress_threads;
 	long jobs;
 	long jobs_per_cpu;
+	long report_slow;
 	size_t file_max_size;
 	size_t max_buffer_size;
 	size_t max_size;
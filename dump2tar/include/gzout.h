@@ -0,0 +1,29 @@
+/*
+ * dump2tar - tool to dump files and command output into a tar archive
+ *
+ * Parallel gzip compression of the output stream
+ *
+ * Copyright IBM Corp. 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef GZOUT_H
+#define GZOUT_H
+
+#include <stdlib.h>
+
+/* Size of uncompressed data that is compressed as one gzip member (bytes) */
+#define GZOUT_BLOCK_SIZE	(1024 * 1024)
+
+/* Maximum number of compression threads */
+#define GZOUT_THREADS_MAX	8
+
+struct gzout;
+
+struct gzout *gzout_open(int fd, int level, long threads);
+int gzout_write(struct gzout *gz, const char *ptr, size_t len);
+int gzout_close(struct gzout *gz);
+
+#endif /* GZOUT_H */
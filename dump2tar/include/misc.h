@@ -90,6 +90,8 @@ void set_dummy_stat(struct stat *st);
 bool starts_with(const char *str, const char *prefix);
 bool ends_with(const char *str, const char *suffix);
 
+int net_connect(const char *addr);
+
 int cmd_child(int fd, char *cmd);
 int cmd_open(char *cmd, pid_t *pid_ptr);
 int cmd_close(int fd, pid_t pid, int *status_ptr);
@@ -0,0 +1,27 @@
+/*
+ * dump2tar - tool to dump files and command output into a tar archive
+ *
+ * Profile files with read times of previous runs
+ *
+ * Copyright IBM Corp. 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+
+/* Read times below this number of milliseconds are not recorded */
+#define PROFILE_MIN_MSEC	10
+
+struct profile;
+
+struct profile *profile_open(const char *filename);
+long profile_get(struct profile *pf, const char *name);
+void profile_update(struct profile *pf, const char *name, long msec);
+int profile_close(struct profile *pf, bool save);
+
+#endif /* PROFILE_H */
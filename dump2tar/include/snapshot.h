@@ -0,0 +1,32 @@
+/*
+ * dump2tar - tool to dump files and command output into a tar archive
+ *
+ * Snapshot files for incremental archives
+ *
+ * Copyright IBM Corp. 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Initial value for content hash calculation */
+#define SNAPSHOT_HASH_INIT	0xcbf29ce484222325ULL
+
+struct buffer;
+struct snapshot;
+
+struct snapshot *snapshot_open(const char *filename);
+void snapshot_hash_data(uint64_t *hash, const void *addr, size_t len);
+int snapshot_hash_buffer(struct buffer *buffer, uint64_t *hash);
+bool snapshot_update(struct snapshot *ss, const char *name, uint64_t hash,
+		     size_t size);
+int snapshot_close(struct snapshot *ss, bool save);
+
+#endif /* SNAPSHOT_H */
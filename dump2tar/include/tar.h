@@ -40,5 +40,6 @@ int tar_emit_file_from_buffer(char *filename, char *link, size_t len,
 int tar_emit_file_from_data(char *filename, char *link, size_t len,
 			    struct stat *stat, char type, void *addr,
 			    emit_cb_t emit_cb, void *data);
+int tar_emit_padding(size_t len, emit_cb_t emit_cb, void *data);
 
 #endif /* TAR_H */
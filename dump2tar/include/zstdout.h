@@ -0,0 +1,26 @@
+/*
+ * dump2tar - tool to dump files and command output into a tar archive
+ *
+ * Zstandard compression of the output stream
+ *
+ * Copyright IBM Corp. 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef ZSTDOUT_H
+#define ZSTDOUT_H
+
+#include <stdlib.h>
+
+/* Maximum supported compression level */
+#define ZSTDOUT_LEVEL_MAX	19
+
+struct zstdout;
+
+struct zstdout *zstdout_open(int fd, int level, long threads);
+int zstdout_write(struct zstdout *zs, const char *ptr, size_t len);
+int zstdout_close(struct zstdout *zs);
+
+#endif /* ZSTDOUT_H */
@@ -9,9 +9,11 @@
  * it under the terms of the MIT license. See LICENSE for details.
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/sendfile.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -181,6 +183,27 @@ ssize_t buffer_read_fd(struct buffer *buffer, int fd, size_t chunk,
 	return c;
 }
 
+/* Try to copy @chunk bytes from @fd to the buffer file of @buffer without
+ * passing data through user space. Return the number of bytes copied on
+ * success, %0 on EOF or %-1 on error with errno set. */
+ssize_t buffer_copy_fd(struct buffer *buffer, int fd, size_t chunk)
+{
+	ssize_t c;
+
+	/* Data in buffer file must precede data in memory buffer */
+	if (buffer_open(buffer) || buffer_flush(buffer)) {
+		errno = EIO;
+		return -1;
+	}
+
+	c = copy_file_range(fd, NULL, buffer->fd, NULL, chunk, 0);
+	DBG("buffer_copy_fd wanted %zu got %zd", chunk, c);
+	if (c > 0)
+		buffer->total += c;
+
+	return c;
+}
+
 /* Add @len bytes at @addr to @buffer. If @addr is %NULL, add zeroes. Return
  * %EXIT_OK on success, %EXIT_RUNTIME otherwise. */
 int buffer_add_data(struct buffer *buffer, char *addr, size_t len, bool usefile,
@@ -242,6 +265,41 @@ int buffer_iterate(struct buffer *buffer, buffer_cb_t cb, void *data)
 	return EXIT_OK;
 }
 
+/* Write all data in @buffer to @fd. Data in the buffer file is sent using
+ * sendfile() without passing it through user space. Return %0 on success,
+ * %-1 on error with errno set. An errno value of %EINVAL or %ENOSYS
+ * indicates that sendfile() is not supported for @fd and that no data was
+ * written. */
+int buffer_send_fd(struct buffer *buffer, int fd)
+{
+	off_t off = 0;
+	ssize_t c;
+
+	if (buffer->total == 0)
+		return 0;
+
+	if (buffer_open(buffer) || buffer_flush(buffer)) {
+		errno = EIO;
+		return -1;
+	}
+
+	while ((size_t) off < buffer->total) {
+		c = sendfile(fd, buffer->fd, &off, buffer->total - off);
+		if (c < 0) {
+			if (off > 0 && (errno == EINVAL || errno == ENOSYS))
+				errno = EIO;
+			return -1;
+		}
+		if (c == 0) {
+			/* Buffer file is shorter than expected */
+			errno = EIO;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 /* Truncate @buffer to at most @len bytes */
 int buffer_truncate(struct buffer *buffer, size_t len)
 {
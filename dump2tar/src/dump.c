@@ -14,7 +14,9 @@
 #include <fcntl.h>
 #include <fnmatch.h>
 #include <getopt.h>
+#include <limits.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -26,18 +28,46 @@
 #include <zlib.h>
 #endif /* HAVE_ZLIB */
 
+#include "lib/zt_probe.h"
+
 #include "buffer.h"
 #include "dref.h"
+#ifdef HAVE_ZLIB
+#include "gzout.h"
+#endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+#include "zstdout.h"
+#endif /* HAVE_ZSTD */
 #include "dump.h"
 #include "global.h"
 #include "idcache.h"
 #include "misc.h"
+#include "profile.h"
+#include "snapshot.h"
 #include "tar.h"
 
 /* Default input file read size (bytes) */
 #define DEFAULT_READ_CHUNK_SIZE		(512 * 1024)
 #define DEFAULT_MAX_BUFFER_SIZE		(2 * 1024 * 1024)
 
+/* Maximum number of unused job representations kept for reuse */
+#define JOB_POOL_MAX	1024
+
+/* Maximum number of entries in the report of slow sources */
+#define SLOW_REPORT_MAX	20
+
+/* Number of completed jobs a worker collects before releasing them */
+#define DONE_BATCH	32
+
+/* Assumed read rate of regular files without profile data (bytes/msec) */
+#define COST_BYTES_PER_MSEC	(64 * 1024)
+/* Assumed read time of commands without profile data (msec) */
+#define COST_CMD_MSEC		1000
+/* Jobs that took this many milliseconds or longer are slow-prone */
+#define SLOW_PRONE_MSEC		1000
+/* Files in debugfs may block for a long time while being read */
+#define DEBUGFS_PREFIX		"/sys/kernel/debug/"
+
 #define _SET_ABORTED(task)	_set_aborted((task), __func__, __LINE__)
 #define SET_ABORTED(task)	set_aborted((task), __func__, __LINE__)
 
@@ -65,6 +95,7 @@
 /* Jobs representing a file or command output to add */
 struct job {
 	struct job *next_job;
+	struct job *prev_job;
 	enum job_type {
 		JOB_INIT,	/* Initialization work */
 		JOB_FILE,	/* Add a regular file */
@@ -83,12 +114,39 @@ struct job {
 	char *outname;
 	char *inname;
 	char *relname;
+	/* Buffer holding inname, outname and relname */
+	char *names;
+	size_t names_size;
 	struct stat stat;
 	bool timed;
 	struct timespec deadline;
+	struct timespec start_ts;
 	struct dref *dref;
 	int cmd_status;
 	struct buffer *content;
+	/* Content hash for incremental archives */
+	bool hashed;
+	uint64_t hash;
+	/* Estimated read time in milliseconds used for scheduling */
+	long cost;
+	bool slow_prone;
+};
+
+/* Double-ended queue of jobs */
+struct job_queue {
+	struct job *head;
+	struct job *tail;
+	/* Number of queued jobs. Can be read without holding the queue lock
+	 * to skip empty queues. */
+	unsigned long num;
+};
+
+/* Job that took longer to read than the --report-slow threshold */
+struct slow_job {
+	char *inname;
+	enum job_type type;
+	enum job_status status;
+	long msec;
 };
 
 /* Run-time statistics */
@@ -110,18 +168,47 @@ struct task {
 	pthread_mutex_t mutex;
 	pthread_cond_t worker_cond;
 	pthread_cond_t cond;
+	/* Updated atomically. Only drops to zero with mutex held. */
 	unsigned long num_jobs_active;
-	struct job *jobs_head;
-	struct job *jobs_tail;
+	/* Number of workers waiting on worker_cond, updated atomically */
+	unsigned long num_idle;
 	bool aborted;
+	/* queue_mutex serializes access to jobs and slow_queue */
+	pthread_mutex_t queue_mutex;
+	struct job_queue jobs;
+	/* Per-thread job queues for work-stealing */
+	struct per_thread *threads;
+	long num_threads;
+	/* Slow-prone jobs sorted by descending cost. Threads 0 to
+	 * num_slow_threads - 1 take jobs from this queue first. A value of
+	 * zero disables cost-based scheduling. */
+	struct job_queue slow_queue;
+	long num_slow_threads;
+	/* Read times of previous and current run */
+	struct profile *profile;
+	/* Unused job representations kept for reuse */
+	struct job *job_pool;
+	unsigned long job_pool_num;
+	/* Slowest jobs in order of descending duration */
+	struct slow_job slow_jobs[SLOW_REPORT_MAX];
+	unsigned int num_slow_jobs;
+	unsigned long num_slow_total;
 
 	/* output_mutex serializes access to output file */
 	pthread_mutex_t output_mutex;
 	int output_fd;
 	size_t output_written;
+	/* Buffer file data can be sent to output_fd using sendfile() */
+	bool output_sendfile;
+	/* Content of previous archive for incremental archives */
+	struct snapshot *snapshot;
+	unsigned long output_num_unchanged;
 #ifdef HAVE_ZLIB
-	gzFile output_gzfd;
+	struct gzout *output_gz;
 #endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+	struct zstdout *output_zs;
+#endif /* HAVE_ZSTD */
 	unsigned long output_num_files;
 
 	/* No protection needed (only accessed in single-threaded mode) */
@@ -137,6 +224,12 @@ struct per_thread {
 	bool timed_out;
 	struct stats stats;
 	struct job *job;
+	/* jobs_mutex serializes access to jobs between owner and thieves */
+	pthread_mutex_t jobs_mutex;
+	struct job_queue jobs;
+	/* Completed jobs not yet released */
+	struct job *done;
+	unsigned int num_done;
 	struct buffer buffer;
 	struct task *task;
 };
@@ -172,6 +265,22 @@ static void main_unlock(struct task *task)
 	pthread_mutex_unlock(&task->mutex);
 }
 
+/* Lock job queue mutex @mutex */
+static void jq_lock(pthread_mutex_t *mutex)
+{
+	if (!global_threaded)
+		return;
+	pthread_mutex_lock(mutex);
+}
+
+/* Unlock job queue mutex @mutex */
+static void jq_unlock(pthread_mutex_t *mutex)
+{
+	if (!global_threaded)
+		return;
+	pthread_mutex_unlock(mutex);
+}
+
 /* Lock output mutex */
 static void output_lock(struct task *task)
 {
@@ -274,7 +383,7 @@ static void cancel_disable(void)
 static void _set_aborted(struct task *task, const char *func, unsigned int line)
 {
 	DBG("set aborted at %s:%u", func, line);
-	task->aborted = true;
+	__atomic_store_n(&task->aborted, true, __ATOMIC_RELAXED);
 	_worker_wakeup_all(task);
 	_main_wakeup(task);
 }
@@ -299,19 +408,75 @@ static bool is_aborted(struct task *task)
 	return result;
 }
 
-/* Release resources associated with @job */
-static void free_job(struct task *task, struct job *job)
+/* Return a new job representation. To reduce the number of memory
+ * allocations, a previously released job representation is reused
+ * if available. */
+static struct job *alloc_job(struct task *task)
+{
+	struct job *job;
+	size_t names_size;
+	char *names;
+
+	main_lock(task);
+	job = task->job_pool;
+	if (job) {
+		task->job_pool = job->next_job;
+		task->job_pool_num--;
+	}
+	main_unlock(task);
+
+	if (!job)
+		return mmalloc(sizeof(struct job));
+
+	/* Keep name buffer for reuse */
+	names = job->names;
+	names_size = job->names_size;
+	memset(job, 0, sizeof(struct job));
+	job->names = names;
+	job->names_size = names_size;
+
+	return job;
+}
+
+/* Release resources associated with @job. Must be called with task->mutex
+ * locked. */
+static void _free_job(struct task *task, struct job *job)
 {
-	DBG("free job %p (%s)", job, job->inname);
 	if (!job)
 		return;
-	free(job->inname);
-	free(job->outname);
-	free(job->relname);
+	DBG("free job %p (%s)", job, job->inname);
 	dref_put(job->dref);
+	if (task->job_pool_num < JOB_POOL_MAX) {
+		job->next_job = task->job_pool;
+		task->job_pool = job;
+		task->job_pool_num++;
+		return;
+	}
+	free(job->names);
 	free(job);
 }
 
+/* Release resources associated with @job */
+static void free_job(struct task *task, struct job *job)
+{
+	main_lock(task);
+	_free_job(task, job);
+	main_unlock(task);
+}
+
+/* Release all job representations kept for reuse */
+static void free_job_pool(struct task *task)
+{
+	struct job *job;
+
+	while ((job = task->job_pool)) {
+		task->job_pool = job->next_job;
+		free(job->names);
+		free(job);
+	}
+	task->job_pool_num = 0;
+}
+
 /* Check if file type specified by mode @m was marked as excluded */
 static bool is_type_excluded(struct dump_opts *opts, mode_t m)
 {
@@ -335,12 +500,14 @@ static void escape_filename(char *filename)
 }
 
 /* Determine filename in archive from original filename @inname and
- * requested new filename @outname and depending on @type. */
-static void set_outname(char **result_ptr, const char *outname,
-			const char *inname, enum job_type type)
+ * requested new filename @outname and depending on @type. If @result is
+ * specified, store the filename there. Return the number of bytes needed
+ * for the filename including the terminating NUL. */
+static size_t make_outname(char *result, const char *outname,
+			   const char *inname, enum job_type type)
 {
 	const char *prefix = "", *name, *suffix;
-	char *result, *end;
+	char *end;
 	size_t olen = outname ? strlen(outname) : 0, plen, nlen;
 
 	if (olen == 0) {
@@ -362,8 +529,8 @@ static void set_outname(char **result_ptr, const char *outname,
 
 	plen = strlen(prefix);
 	nlen = strlen(name);
-
-	result = mmalloc(plen + nlen + strlen(suffix) + /* NUL */ 1);
+	if (!result)
+		return plen + nlen + strlen(suffix) + /* NUL */ 1;
 
 	/* Add prefix */
 	strcpy(result, prefix);
@@ -380,32 +547,93 @@ static void set_outname(char **result_ptr, const char *outname,
 
 	remove_double_slashes(result);
 
-	*result_ptr = result;
+	return strlen(result) + /* NUL */ 1;
 }
 
-static void sanitize_dirname(char **name_ptr)
+/* Ensure that directory name @name ends with a single slash. @name must
+ * provide room for one additional character. */
+static void sanitize_dirname(char *name)
 {
-	char *name;
-
-	name = mmalloc(strlen(*name_ptr) + /* Slash */ 1 + /* NUL */ 1);
-	strcpy(name, *name_ptr);
 	remove_double_slashes(name);
 	chomp(name, "/");
 	strcat(name, "/");
-	free(*name_ptr);
-	*name_ptr = name;
+}
+
+/* Store input filename @inname, the filename in archive as determined from
+ * @outname, and relative filename @relname in the name buffer of @job */
+static void set_job_names(struct job *job, const char *inname,
+			  const char *outname, const char *relname)
+{
+	size_t inlen, outlen, rellen, size;
+
+	inlen = strlen(inname) + /* Slash */ 1 + /* NUL */ 1;
+	outlen = make_outname(NULL, outname, inname, job->type);
+	rellen = relname ? strlen(relname) + /* NUL */ 1 : 0;
+	size = inlen + outlen + rellen;
+	if (size > job->names_size) {
+		free(job->names);
+		job->names = mmalloc(size);
+		job->names_size = size;
+	}
+
+	job->inname = job->names;
+	strcpy(job->inname, inname);
+	if (job->type == JOB_DIR)
+		sanitize_dirname(job->inname);
+	job->outname = job->names + inlen;
+	make_outname(job->outname, outname, inname, job->type);
+	if (relname) {
+		job->relname = job->outname + outlen;
+		strcpy(job->relname, relname);
+	}
 }
 
 /* Allocate and initialize a new job representation to add an entry according
  * to the specified parameters. @relname and @dref are used for opening files
  * more efficiently using *at() functions if specified. @is_cmd specifies if
  * the specified inname is a command line. */
+/* Estimate the time it takes to read the data of @job using read times from
+ * the profile or the file size, and determine whether @job is likely to
+ * block a worker thread for a long time. */
+static void set_job_cost(struct task *task, struct job *job)
+{
+	long msec = -1;
+
+	if (task->profile)
+		msec = profile_get(task->profile, job->inname);
+
+	switch (job->type) {
+	case JOB_DIR:
+		/* Process directories first to make their entries available
+		 * for scheduling as early as possible */
+		job->cost = LONG_MAX;
+		return;
+	case JOB_CMD:
+		job->cost = msec >= 0 ? msec : COST_CMD_MSEC;
+		job->slow_prone = true;
+		break;
+	case JOB_FILE:
+		if (msec >= 0)
+			job->cost = msec;
+		else if (S_ISREG(job->stat.st_mode))
+			job->cost = job->stat.st_size / COST_BYTES_PER_MSEC;
+		job->slow_prone = !S_ISREG(job->stat.st_mode) ||
+				  strncmp(job->inname, DEBUGFS_PREFIX,
+					  sizeof(DEBUGFS_PREFIX) - 1) == 0;
+		break;
+	default:
+		break;
+	}
+	if (msec >= SLOW_PRONE_MSEC)
+		job->slow_prone = true;
+}
+
 static struct job *create_job(struct task *task, const char *inname,
 			      const char *outname, bool is_cmd,
 			      const char *relname, struct dref *dref,
 			      struct stats *stats)
 {
-	struct job *job = mmalloc(sizeof(struct job));
+	struct job *job = alloc_job(task);
 	int rc;
 
 	DBG("create job inname=%s outname=%s is_cmd=%d relname=%s dref=%p",
@@ -418,27 +646,26 @@ static struct job *create_job(struct task *task, const char *inname,
 		return job;
 	}
 
-	job->inname = mstrdup(inname);
-
 	if (is_cmd) {
 		/* Special case - read from command output */
 		job->type = JOB_CMD;
 		set_dummy_stat(&job->stat);
+		relname = NULL;
 		goto out;
 	}
 
-	if (!relname && strcmp(job->inname, "-") == 0) {
+	if (!relname && strcmp(inname, "-") == 0) {
 		/* Special case - read from standard input */
 		job->type = JOB_FILE;
 		set_dummy_stat(&job->stat);
 		goto out;
 	}
 
-	rc = stat_file(task->opts->dereference, job->inname, relname, dref,
+	rc = stat_file(task->opts->dereference, inname, relname, dref,
 		       &job->stat);
 
 	if (rc < 0) {
-		read_error(task, job->inname, "Cannot stat file");
+		read_error(task, inname, "Cannot stat file");
 		free_job(task, job);
 		stats->num_failed++;
 		return NULL;
@@ -454,7 +681,6 @@ static struct job *create_job(struct task *task, const char *inname,
 		job->type = JOB_LINK;
 	} else if (S_ISDIR(job->stat.st_mode)) {
 		job->type = JOB_DIR;
-		sanitize_dirname(&job->inname);
 
 		/* No need to keep parent directory open */
 		relname = NULL;
@@ -463,12 +689,11 @@ static struct job *create_job(struct task *task, const char *inname,
 		job->type = JOB_FILE;
 	}
 
-	if (relname)
-		job->relname = mstrdup(relname);
 	job->dref = dref_get(dref);
 
 out:
-	set_outname(&job->outname, outname, inname, job->type);
+	set_job_names(job, inname, outname, relname);
+	set_job_cost(task, job);
 
 	return job;
 }
@@ -488,15 +713,10 @@ void job_print(struct job *job)
 	printf("DEBUG:   content=%p\n", job->content);
 }
 
-/* Return the number of bytes written to the output file */
+/* Return the number of bytes written to the output file. For compressed
+ * output, this is the number of uncompressed bytes. */
 static size_t get_output_size(struct task *task)
 {
-#ifdef HAVE_ZLIB
-	if (task->opts->gzip) {
-		gzflush(task->output_gzfd, Z_SYNC_FLUSH);
-		return gztell(task->output_gzfd);
-	}
-#endif /* HAVE_ZLIB */
 	return task->output_written;
 }
 
@@ -506,15 +726,29 @@ static int write_output(struct task *task, const char *ptr, size_t len)
 	size_t todo = len;
 	ssize_t w;
 
+	ZT_PROBE(dump2tar, write_output, task->output_written, len);
 #ifdef HAVE_ZLIB
 	if (task->opts->gzip) {
-		if (gzwrite(task->output_gzfd, ptr, len) == 0)
+		if (gzout_write(task->output_gz, ptr, len))
 			goto err_write;
 		task->output_written += len;
+		ZT_PROBE(dump2tar, write_output_done, task->output_written,
+			 len, EXIT_OK);
 
 		return EXIT_OK;
 	}
 #endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+	if (task->opts->zstd) {
+		if (zstdout_write(task->output_zs, ptr, len))
+			goto err_write;
+		task->output_written += len;
+		ZT_PROBE(dump2tar, write_output_done, task->output_written,
+			 len, EXIT_OK);
+
+		return EXIT_OK;
+	}
+#endif /* HAVE_ZSTD */
 
 	while (todo > 0) {
 		w = write(task->output_fd, ptr, todo);
@@ -524,11 +758,15 @@ static int write_output(struct task *task, const char *ptr, size_t len)
 		ptr += w;
 	}
 	task->output_written += len;
+	ZT_PROBE(dump2tar, write_output_done, task->output_written, len,
+		 EXIT_OK);
 
 	return EXIT_OK;
 
 err_write:
 	write_error(task, "Cannot write output");
+	ZT_PROBE(dump2tar, write_output_done, task->output_written, 0,
+		 EXIT_RUNTIME);
 
 	return EXIT_RUNTIME;
 }
@@ -584,6 +822,58 @@ static int write_job_status_file(struct task *task, struct job *job)
 	return rc;
 }
 
+/* Write tar entry for regular file data in @job to output. File data that
+ * was stored in a buffer file is sent directly to the output file if
+ * possible. Must be called with output_lock held. */
+static int _write_file_data(struct task *task, struct job *job)
+{
+	struct buffer *buffer = job->content;
+	int rc;
+
+	if (!task->output_sendfile || !buffer->fd_open) {
+		return tar_emit_file_from_buffer(job->outname, NULL,
+						 buffer->total, &job->stat,
+						 TYPE_REGULAR, buffer,
+						 _write_job_data_cb, task);
+	}
+
+	rc = tar_emit_file_from_buffer(job->outname, NULL, buffer->total,
+				       &job->stat, TYPE_REGULAR, NULL,
+				       _write_job_data_cb, task);
+	if (rc)
+		return rc;
+
+	if (buffer_send_fd(buffer, task->output_fd) == 0) {
+		task->output_written += buffer->total;
+	} else if (errno == EINVAL || errno == ENOSYS) {
+		DBG("sendfile not supported for output file");
+		task->output_sendfile = false;
+		rc = buffer_iterate(buffer, _write_job_data_cb, task);
+		if (rc)
+			return rc;
+	} else {
+		write_error(task, "Cannot write output");
+		return EXIT_RUNTIME;
+	}
+
+	return tar_emit_padding(buffer->total, _write_job_data_cb, task);
+}
+
+/* Check if @job has the same content as in the archive described by the
+ * previous snapshot and record its current content in the snapshot. Must be
+ * called with output_lock held. */
+static bool _is_job_unchanged(struct task *task, struct job *job)
+{
+	if (!task->snapshot || !job->hashed)
+		return false;
+	if (!snapshot_update(task->snapshot, job->outname, job->hash,
+			     job->content->total))
+		return false;
+	task->output_num_unchanged++;
+
+	return true;
+}
+
 /* Write tar entry for data in @job to output. Must be called with output_lock
  * held. */
 static void _write_job_data(struct task *task, struct job *job)
@@ -603,6 +893,11 @@ static void _write_job_data(struct task *task, struct job *job)
 		return;
 	}
 
+	if (_is_job_unchanged(task, job)) {
+		DBG("skipping unchanged entry %s", job->outname);
+		return;
+	}
+
 	switch (job->type) {
 	case JOB_CMD:
 		tar_emit_file_from_buffer(job->outname, NULL, buffer->total,
@@ -615,9 +910,7 @@ static void _write_job_data(struct task *task, struct job *job)
 		}
 		break;
 	case JOB_FILE:
-		tar_emit_file_from_buffer(job->outname, NULL, buffer->total,
-					  &job->stat, TYPE_REGULAR, buffer,
-					  _write_job_data_cb, task);
+		_write_file_data(task, job);
 		task->output_num_files++;
 		break;
 	case JOB_LINK:
@@ -701,15 +994,74 @@ static int read_symlink(struct task *task, const char *filename,
 	return rc;
 }
 
+/* Copy data of the regular file of @size bytes at @fd directly to the buffer
+ * file of @buffer. Return %EXIT_OK if the remaining data, if any, can be read
+ * using read(), %EXIT_RUNTIME on error. */
+static int copy_fd(struct task *task, int fd, struct buffer *buffer,
+		   size_t size)
+{
+	size_t limit = size, c;
+	ssize_t rc = 0;
+
+	if (task->opts->file_max_size > 0 &&
+	    limit > task->opts->file_max_size)
+		limit = task->opts->file_max_size;
+
+	while (!is_aborted(task) && buffer->total < limit) {
+		c = limit - buffer->total;
+		if (c > task->opts->max_buffer_size)
+			c = task->opts->max_buffer_size;
+
+		cancel_enable();
+		/* copy_file_range() is not a cancellation point */
+		pthread_testcancel();
+		rc = buffer_copy_fd(buffer, fd, c);
+		cancel_disable();
+
+		if (rc <= 0)
+			break;
+	}
+
+	if (rc < 0) {
+		switch (errno) {
+		case EXDEV:
+		case EINVAL:
+		case ENOSYS:
+		case EOPNOTSUPP:
+			/* Not supported for this file - fall back to read() */
+			DBG("copy_file_range not supported: %s",
+			    strerror(errno));
+			break;
+		default:
+			return EXIT_RUNTIME;
+		}
+	}
+
+	/* A result of 0 may also indicate a file system that does not
+	 * support copy_file_range(). Reading the remaining data will show */
+	return EXIT_OK;
+}
+
 /* Read data from the file descriptor @fd until an end-of-file condition is
  * encountered. On success, *@done bytes in @buffer contain the read data
- * and the return value is %EXIT_OK. */
+ * and the return value is %EXIT_OK. If @size is non-zero, @fd refers to a
+ * regular file of that size: A short read that ends at this size indicates
+ * an end-of-file condition without the need for another read. */
 static int read_fd(struct task *task, const char *name, int fd,
-		   struct buffer *buffer)
+		   struct buffer *buffer, size_t size)
 {
 	ssize_t rc = 0;
 	size_t c = buffer->size ? buffer->size : task->opts->read_chunk_size;
 
+	ZT_PROBE(dump2tar, read_fd, name, fd, size);
+	/* Large files would be stored in a buffer file anyway */
+	if (size > task->opts->max_buffer_size &&
+	    copy_fd(task, fd, buffer, size)) {
+		ZT_PROBE(dump2tar, read_fd_done, name, buffer->total,
+			 EXIT_RUNTIME);
+		return EXIT_RUNTIME;
+	}
+
 	while (!is_aborted(task)) {
 		cancel_enable();
 		rc = buffer_read_fd(buffer, fd, c, true,
@@ -719,6 +1071,12 @@ static int read_fd(struct task *task, const char *name, int fd,
 		if (rc <= 0)
 			break;
 
+		/* Trust size of regular file, saving one read per file */
+		if (size > 0 && buffer->total == size && (size_t) rc < c) {
+			rc = 0;
+			break;
+		}
+
 		/* Ensure that content doesn't exceed --file-max-size limit */
 		if (task->opts->file_max_size > 0 &&
 		    buffer->total >= task->opts->file_max_size) {
@@ -743,8 +1101,12 @@ static int read_fd(struct task *task, const char *name, int fd,
 		}
 	}
 
-	if (is_aborted(task) || rc != 0)
+	if (is_aborted(task) || rc != 0) {
+		ZT_PROBE(dump2tar, read_fd_done, name, buffer->total,
+			 EXIT_RUNTIME);
 		return EXIT_RUNTIME;
+	}
+	ZT_PROBE(dump2tar, read_fd_done, name, buffer->total, EXIT_OK);
 
 	return EXIT_OK;
 }
@@ -753,10 +1115,12 @@ static int read_fd(struct task *task, const char *name, int fd,
  * encountered. On success, @buffer contains the data read and the return
  * value is %EXIT_OK. If @relname is non-null it points to the name of the
  * file relative to its parent directory for which @dirfd is an open file
- * handle. */
+ * handle. @st contains the result of a previous stat() of the file. */
 static int read_regular(struct task *task, const char *filename,
-			const char *relname, int dirfd, struct buffer *buffer)
+			const char *relname, int dirfd, struct stat *st,
+			struct buffer *buffer)
 {
+	size_t size = 0;
 	int fd, rc = EXIT_OK;
 	bool need_close = true;
 
@@ -777,7 +1141,12 @@ static int read_regular(struct task *task, const char *filename,
 		return EXIT_RUNTIME;
 	}
 
-	rc = read_fd(task, filename, fd, buffer);
+	/* Files in procfs, sysfs and debugfs may report a size that differs
+	 * from the actual data size. The size is therefore only used to
+	 * detect end-of-file after a short read ending exactly at this size */
+	if (need_close && S_ISREG(st->st_mode))
+		size = st->st_size;
+	rc = read_fd(task, filename, fd, buffer, size);
 	if (rc) {
 		if (is_aborted(task))
 			mwarnx("%s: Read aborted", filename);
@@ -807,7 +1176,7 @@ static int read_cmd_output(struct task *task, char *cmd, struct buffer *buffer,
 		return rc;
 	}
 
-	if (read_fd(task, cmd, fd, buffer)) {
+	if (read_fd(task, cmd, fd, buffer, 0)) {
 		if (is_aborted(task))
 			mwarnx("%s: Command aborted", cmd);
 		else
@@ -836,25 +1205,149 @@ static const char *get_exclude_match(struct task *task, const char *filename)
 	return NULL;
 }
 
+/* Adjust the number of jobs in job queue @queue by @num */
+static void _jq_count(struct job_queue *queue, long num)
+{
+	__atomic_store_n(&queue->num, queue->num + num, __ATOMIC_RELEASE);
+}
+
+/* Add the list of @num jobs starting with @first up to @last to the start of
+ * job queue @queue */
+static void _jq_add_head(struct job_queue *queue, struct job *first,
+			 struct job *last, int num)
+{
+	first->prev_job = NULL;
+	last->next_job = queue->head;
+	if (queue->head)
+		queue->head->prev_job = last;
+	else
+		queue->tail = last;
+	queue->head = first;
+	_jq_count(queue, num);
+}
+
+/* Add the specified @job to the end of job queue @queue */
+static void _jq_add_tail(struct job_queue *queue, struct job *job)
+{
+	job->next_job = NULL;
+	job->prev_job = queue->tail;
+	if (queue->tail)
+		queue->tail->next_job = job;
+	else
+		queue->head = job;
+	queue->tail = job;
+	_jq_count(queue, 1);
+}
+
+/* Remove the specified @job from job queue @queue */
+static void _jq_remove(struct job_queue *queue, struct job *job)
+{
+	if (job->prev_job)
+		job->prev_job->next_job = job->next_job;
+	else
+		queue->head = job->next_job;
+	if (job->next_job)
+		job->next_job->prev_job = job->prev_job;
+	else
+		queue->tail = job->prev_job;
+	job->next_job = NULL;
+	job->prev_job = NULL;
+	_jq_count(queue, -1);
+}
+
+/* Insert the list of jobs starting with @list into job queue @queue. Both
+ * must be sorted by descending cost. */
+static void _jq_merge(struct job_queue *queue, struct job *list)
+{
+	struct job *pos = queue->head, *job;
+
+	while (list) {
+		job = list;
+		list = list->next_job;
+		while (pos && pos->cost >= job->cost)
+			pos = pos->next_job;
+		/* Insert job before pos */
+		job->next_job = pos;
+		job->prev_job = pos ? pos->prev_job : queue->tail;
+		if (job->prev_job)
+			job->prev_job->next_job = job;
+		else
+			queue->head = job;
+		if (pos)
+			pos->prev_job = job;
+		else
+			queue->tail = job;
+		_jq_count(queue, 1);
+	}
+}
+
+/* Compare jobs by descending cost */
+static int cmp_job_cost(const void *a, const void *b)
+{
+	const struct job *job_a = *(struct job * const *) a;
+	const struct job *job_b = *(struct job * const *) b;
+
+	if (job_a->cost > job_b->cost)
+		return -1;
+	if (job_a->cost < job_b->cost)
+		return 1;
+	return 0;
+}
+
+/* Sort the list of @num jobs starting with @first by descending cost. Move
+ * slow-prone jobs from this list to the list starting with @slow_first.
+ * Return the number of slow-prone jobs. */
+static int sort_jobs(struct job **first, struct job **last,
+		     struct job **slow_first, int num)
+{
+	struct job **array, *job, *tail = NULL, *slow_tail = NULL;
+	int i, num_slow = 0;
+
+	array = mmalloc(num * sizeof(struct job *));
+	for (i = 0, job = *first; i < num; i++, job = job->next_job)
+		array[i] = job;
+	qsort(array, num, sizeof(struct job *), cmp_job_cost);
+
+	*first = NULL;
+	*slow_first = NULL;
+	for (i = 0; i < num; i++) {
+		job = array[i];
+		job->next_job = NULL;
+		if (job->slow_prone) {
+			job->prev_job = slow_tail;
+			if (slow_tail)
+				slow_tail->next_job = job;
+			else
+				*slow_first = job;
+			slow_tail = job;
+			num_slow++;
+		} else {
+			job->prev_job = tail;
+			if (tail)
+				tail->next_job = job;
+			else
+				*first = job;
+			tail = job;
+		}
+	}
+	*last = tail;
+	free(array);
+
+	return num_slow;
+}
+
 /* Add the specified @job to the start of the job queue */
 static void _queue_job_head(struct task *task, struct job *job)
 {
 	DBG("queue job type=%d inname=%s at head", job->type, job->inname);
-	job->next_job = task->jobs_head;
-	task->jobs_head = job;
-	if (!task->jobs_tail)
-		task->jobs_tail = job;
+	_jq_add_head(&task->jobs, job, job, 1);
 }
 
 /* Add the specified @job to the end of the job queue */
 static void _queue_job_tail(struct task *task, struct job *job)
 {
 	DBG("queue job type=%d inname=%s at tail", job->type, job->inname);
-	if (task->jobs_tail)
-		task->jobs_tail->next_job = job;
-	else
-		task->jobs_head = job;
-	task->jobs_tail = job;
+	_jq_add_tail(&task->jobs, job);
 }
 
 /* Add the specified @job to the job queue and trigger processing.
@@ -862,47 +1355,155 @@ static void _queue_job_tail(struct task *task, struct job *job)
  * otherwise at the end. */
 static void queue_job(struct task *task, struct job *job, bool head)
 {
-	main_lock(task);
-	task->num_jobs_active++;
+	__atomic_add_fetch(&task->num_jobs_active, 1, __ATOMIC_RELAXED);
+	jq_lock(&task->queue_mutex);
 	if (head)
 		_queue_job_head(task, job);
 	else
 		_queue_job_tail(task, job);
+	jq_unlock(&task->queue_mutex);
+
+	main_lock(task);
 	_worker_wakeup_one(task);
 	main_unlock(task);
 }
 
-/* Add the specified list of jobs starting with @first up to @last to the start
- * of the job queue and trigger processing */
-static void queue_jobs(struct task *task, struct job *first, struct job *last,
-		       int num)
+/* Wake up idle workers after jobs were queued. The main mutex is only taken
+ * if a worker is waiting. */
+static void wakeup_idle_workers(struct task *task)
 {
+	/* Pairs with the fence in get_next_job(): Either the waiting worker
+	 * sees the new jobs, or this thread sees the waiting worker. */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&task->num_idle, __ATOMIC_RELAXED) == 0)
+		return;
 	main_lock(task);
-	last->next_job = task->jobs_head;
-	task->jobs_head = first;
-	task->num_jobs_active += num;
 	_worker_wakeup_all(task);
 	main_unlock(task);
 }
 
-/* Remove the head of the job queue and return it to the caller */
+/* Add the specified list of jobs starting with @first up to @last to the start
+ * of the job queue of @thread and trigger processing. Idle workers are woken
+ * up so that they can steal jobs from this queue. With cost-based scheduling,
+ * jobs are sorted by descending cost and slow-prone jobs are added to the
+ * queue of slow-prone jobs instead. */
+static void queue_jobs(struct per_thread *thread, struct job *first,
+		       struct job *last, int num)
+{
+	struct task *task = thread->task;
+	struct job *slow_first = NULL;
+	int num_slow = 0;
+
+	if (task->num_slow_threads > 0)
+		num_slow = sort_jobs(&first, &last, &slow_first, num);
+
+	/* Account before publishing so that the count cannot drop to zero
+	 * while new jobs are queued */
+	__atomic_add_fetch(&task->num_jobs_active, num, __ATOMIC_RELAXED);
+	if (first) {
+		jq_lock(&thread->jobs_mutex);
+		_jq_add_head(&thread->jobs, first, last, num - num_slow);
+		jq_unlock(&thread->jobs_mutex);
+	}
+	if (slow_first) {
+		jq_lock(&task->queue_mutex);
+		_jq_merge(&task->slow_queue, slow_first);
+		jq_unlock(&task->queue_mutex);
+	}
+	wakeup_idle_workers(task);
+}
+
+/* Mark @job as dequeued */
+static struct job *_start_job(struct job *job)
+{
+	DBG("dequeueing job type=%d inname=%s", job->type, job->inname);
+	job->status = JOB_IN_PROGRESS;
+
+	return job;
+}
+
+/* Remove the head of the global job queue and return it to the caller */
 static struct job *_dequeue_job(struct task *task)
 {
-	struct job *job = NULL;
+	struct job *job = task->jobs.head;
 
-	if (task->jobs_head) {
-		job = task->jobs_head;
-		task->jobs_head = job->next_job;
-		job->next_job = NULL;
-		if (job == task->jobs_tail)
-			task->jobs_tail = NULL;
-		DBG("dequeueing job type=%d inname=%s", job->type, job->inname);
-		job->status = JOB_IN_PROGRESS;
-	} else {
+	if (!job) {
 		DBG("no job to dequeue");
+		return NULL;
 	}
+	_jq_remove(&task->jobs, job);
 
-	return job;
+	return _start_job(job);
+}
+
+/* Remove the most expensive slow-prone job and return it to the caller */
+static struct job *_dequeue_slow_job(struct task *task)
+{
+	struct job *job = task->slow_queue.head;
+
+	if (!job)
+		return NULL;
+	_jq_remove(&task->slow_queue, job);
+
+	return _start_job(job);
+}
+
+/* Remove the head of job queue @queue protected by @mutex and return it to
+ * the caller. If @tail is %true, remove the tail instead. Empty queues are
+ * skipped without taking @mutex. */
+static struct job *jq_take(struct job_queue *queue, pthread_mutex_t *mutex,
+			   bool tail)
+{
+	struct job *job;
+
+	if (__atomic_load_n(&queue->num, __ATOMIC_ACQUIRE) == 0)
+		return NULL;
+
+	jq_lock(mutex);
+	job = tail ? queue->tail : queue->head;
+	if (job)
+		_jq_remove(queue, job);
+	jq_unlock(mutex);
+
+	return job ? _start_job(job) : NULL;
+}
+
+/* Return the next job for @thread: Jobs are taken from the start of the
+ * thread's own queue first, then from the global job queue. If both are
+ * empty, the oldest job is stolen from the end of the queue of another
+ * thread. Older jobs typically represent larger parts of a directory tree,
+ * so stealing them balances the load among threads. Threads reserved for
+ * slow-prone jobs take those first, all other threads only when no other
+ * job is available. Each queue is protected by its own mutex so that
+ * task->mutex is not needed. */
+static struct job *dequeue_job_thread(struct per_thread *thread)
+{
+	struct task *task = thread->task;
+	struct per_thread *victim;
+	struct job *job;
+	long i;
+
+	if (thread->num < task->num_slow_threads) {
+		job = jq_take(&task->slow_queue, &task->queue_mutex, false);
+		if (job)
+			return job;
+	}
+	job = jq_take(&thread->jobs, &thread->jobs_mutex, false);
+	if (job)
+		return job;
+	job = jq_take(&task->jobs, &task->queue_mutex, false);
+	if (job)
+		return job;
+	for (i = 1; i < task->num_threads; i++) {
+		victim = &task->threads[(thread->num + i) % task->num_threads];
+		job = jq_take(&victim->jobs, &victim->jobs_mutex, true);
+		if (job) {
+			DBG("stole job from thread %ld", victim->num);
+			return job;
+		}
+	}
+
+	return jq_take(&task->slow_queue, &task->queue_mutex, false);
 }
 
 /* Create and queue job for file at @filename */
@@ -924,12 +1525,15 @@ static void init_queue(struct task *task)
 	queue_file(task, NULL, NULL, false, NULL, NULL, NULL, true);
 }
 
-/* Create and queue jobs for all files found in @dirname */
-static void queue_dir(struct task *task, const char *dirname,
+/* Create and queue jobs for all files found in @dirname to the job queue of
+ * @thread */
+static void queue_dir(struct per_thread *thread, const char *dirname,
 		      const char *outname, struct stats *stats)
 {
+	struct task *task = thread->task;
 	struct dirent *de;
 	char *inpath, *outpath;
+	size_t inlen, outlen;
 	struct dref *dref;
 	struct job *job, *first = NULL, *last = NULL;
 	int num = 0;
@@ -940,6 +1544,14 @@ static void queue_dir(struct task *task, const char *dirname,
 		return;
 	}
 
+	/* Path names for all entries share the same buffers */
+	inlen = strlen(dirname);
+	outlen = strlen(outname);
+	inpath = mmalloc(inlen + NAME_MAX + /* NUL */ 1);
+	outpath = mmalloc(outlen + NAME_MAX + /* NUL */ 1);
+	memcpy(inpath, dirname, inlen);
+	memcpy(outpath, outname, outlen);
+
 	while ((de = readdir(dref->dd))) {
 		if (de->d_name[0] == '.') {
 			if (de->d_name[1] == 0)
@@ -948,13 +1560,14 @@ static void queue_dir(struct task *task, const char *dirname,
 				continue;
 		}
 		DBG("next file %s", de->d_name);
-		inpath = masprintf("%s%s", dirname, de->d_name);
-		outpath = masprintf("%s%s", outname, de->d_name);
+		strcpy(inpath + inlen, de->d_name);
+		strcpy(outpath + outlen, de->d_name);
 		job = create_job(task, inpath, outpath, false, de->d_name, dref,
 				 stats);
 		if (job) {
 			if (last) {
 				last->next_job = job;
+				job->prev_job = last;
 				last = job;
 			} else {
 				first = job;
@@ -962,34 +1575,69 @@ static void queue_dir(struct task *task, const char *dirname,
 			}
 			num++;
 		}
-		free(inpath);
-		free(outpath);
 	}
+	free(inpath);
+	free(outpath);
 
 	if (first)
-		queue_jobs(task, first, last, num);
+		queue_jobs(thread, first, last, num);
 
 	dref_put(dref);
 }
 
-/* Create and queue jobs for all files specified on the command line */
-static void queue_jobs_from_opts(struct task *task, struct stats *stats)
+/* Create and queue jobs for all files specified on the command line to the
+ * job queue of @thread */
+static void queue_jobs_from_opts(struct per_thread *thread,
+				 struct stats *stats)
 {
+	struct task *task = thread->task;
 	struct dump_opts *opts = task->opts;
+	struct job *job, *first = NULL, *last = NULL;
 	unsigned int i;
+	int num = 0;
 
 	/* Queue directly specified entries */
 	for (i = 0; i < opts->num_specs && !is_aborted(task); i++) {
-		queue_file(task, opts->specs[i].inname, opts->specs[i].outname,
-			   opts->specs[i].is_cmd, NULL, NULL, stats, false);
+		job = create_job(task, opts->specs[i].inname,
+				 opts->specs[i].outname, opts->specs[i].is_cmd,
+				 NULL, NULL, stats);
+		if (!job)
+			continue;
+		if (last) {
+			last->next_job = job;
+			job->prev_job = last;
+		} else {
+			first = job;
+		}
+		last = job;
+		num++;
 	}
+
+	if (first)
+		queue_jobs(thread, first, last, num);
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+/* Return the number of threads to use for compressing output. Without
+ * --compress-threads or --jobs, one thread per online CPU is used. */
+static long get_compress_threads(struct task *task)
+{
+	long num_cpus;
+
+	if (task->opts->compress_threads > 0)
+		return task->opts->compress_threads;
+	num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return num_cpus > 0 ? num_cpus : 1;
 }
+#endif /* HAVE_ZLIB || HAVE_ZSTD */
 
 /* Prepare output stream */
 static int open_output(struct task *task)
 {
-	bool to_stdout = !task->opts->output_file ||
-			 strcmp(task->opts->output_file, "-") == 0;
+	bool to_stdout = !task->opts->connect &&
+			 (!task->opts->output_file ||
+			  strcmp(task->opts->output_file, "-") == 0);
 	int rc = EXIT_OK;
 	struct stat st;
 
@@ -999,26 +1647,19 @@ static int open_output(struct task *task)
 	}
 
 	cancel_enable();
-#ifdef HAVE_ZLIB
-	if (task->opts->gzip) {
-		if (to_stdout) {
-			task->output_gzfd =
-				gzdopen(STDOUT_FILENO,
-					task->opts->append ? "ab" : "wb");
-		} else {
-			task->output_gzfd =
-				gzopen(task->opts->output_file,
-				       task->opts->append ? "ab" : "wb");
-		}
-
-		if (!task->output_gzfd)
-			rc = EXIT_RUNTIME;
-		goto out;
-	}
-#endif /* HAVE_ZLIB */
-
 	if (to_stdout) {
 		task->output_fd = STDOUT_FILENO;
+	} else if (task->opts->connect) {
+		task->opts->output_file = task->opts->connect;
+		/* Report a closed connection as write error */
+		signal(SIGPIPE, SIG_IGN);
+		/* Blocking writes limit the rate at which data is read to
+		 * the rate at which the receiver accepts data */
+		task->output_fd = net_connect(task->opts->connect);
+		if (task->output_fd < 0) {
+			cancel_disable();
+			return EXIT_RUNTIME;
+		}
 	} else {
 		task->output_fd =
 			open(task->opts->output_file, O_WRONLY | O_CREAT |
@@ -1036,10 +1677,32 @@ static int open_output(struct task *task)
 	}
 
 #ifdef HAVE_ZLIB
-out:
+	if (rc == EXIT_OK && task->opts->gzip) {
+		/* Appending a gzip member to an existing gzip file results in
+		 * a valid gzip file */
+		task->output_gz = gzout_open(task->output_fd,
+					     task->opts->compress_level ?
+					     task->opts->compress_level :
+					     Z_DEFAULT_COMPRESSION,
+					     get_compress_threads(task));
+		if (!task->output_gz)
+			rc = EXIT_RUNTIME;
+	}
 #endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+	if (rc == EXIT_OK && task->opts->zstd) {
+		/* The same applies to zstd frames */
+		task->output_zs = zstdout_open(task->output_fd,
+					       task->opts->compress_level,
+					       get_compress_threads(task));
+		if (!task->output_zs)
+			rc = EXIT_RUNTIME;
+	}
+#endif /* HAVE_ZSTD */
 	cancel_disable();
 
+	task->output_sendfile = !task->opts->gzip && !task->opts->zstd;
+
 	if (rc != EXIT_OK) {
 		mwarn("%s: Cannot open output file", task->opts->output_file);
 		return rc;
@@ -1089,7 +1752,7 @@ static void process_job(struct per_thread *thread, struct job *job)
 			status = JOB_FAILED;
 			goto out;
 		}
-		queue_jobs_from_opts(task, &thread->stats);
+		queue_jobs_from_opts(thread, &thread->stats);
 		break;
 	case JOB_CMD: /* Capture command output */
 		tverb("Dumping command output '%s'\n", job->inname);
@@ -1111,14 +1774,15 @@ static void process_job(struct per_thread *thread, struct job *job)
 		tverb("Dumping directory '%s'\n", job->inname);
 
 		if (task->opts->recursive) {
-			queue_dir(task, job->inname, job->outname,
+			queue_dir(thread, job->inname, job->outname,
 				  &thread->stats);
 		}
 		break;
 	case JOB_FILE: /* Read file contents */
 		tverb("Dumping file '%s'\n", job->inname);
 
-		if (read_regular(task, job->inname, relname, dirfd, buffer))
+		if (read_regular(task, job->inname, relname, dirfd, &job->stat,
+				 buffer))
 			status = JOB_FAILED;
 
 		break;
@@ -1172,12 +1836,31 @@ static void add_stats(struct stats *to, struct stats *from)
 	to->num_failed += from->num_failed;
 }
 
+/* Move jobs left on the job queue of @thread to the global job queue */
+static void release_thread_jobs(struct per_thread *thread)
+{
+	struct task *task = thread->task;
+	struct job *job;
+
+	while ((job = thread->jobs.head)) {
+		_jq_remove(&thread->jobs, job);
+		_jq_add_tail(&task->jobs, job);
+	}
+}
+
 /* Release resources allocated to @thread */
 static void cleanup_thread(struct per_thread *thread)
 {
+	struct job *job;
+
 	if (thread->job)
 		free_job(thread->task, thread->job);
+	while ((job = thread->done)) {
+		thread->done = job->next_job;
+		free_job(thread->task, job);
+	}
 	buffer_free(&thread->buffer, false);
+	pthread_mutex_destroy(&thread->jobs_mutex);
 }
 
 /* Register activate @job at @thread */
@@ -1187,6 +1870,8 @@ static void start_thread_job(struct per_thread *thread, struct job *job)
 
 	thread->job = job;
 	job->content = &thread->buffer;
+	if (task->opts->report_slow > 0 || task->profile)
+		set_timespec(&job->start_ts, 0, 0);
 	if (task->opts->file_timeout > 0 && job->type != JOB_INIT) {
 		/* Set up per-job timeout */
 		set_timespec(&job->deadline, task->opts->file_timeout, 0);
@@ -1205,25 +1890,79 @@ static void stop_thread_job(struct per_thread *thread, struct job *job)
 	buffer_reset(&thread->buffer);
 }
 
+/* Release the completed jobs of @thread. If these were the last active jobs
+ * inform main thread and idle workers. Must be called with main_lock mutex
+ * held. */
+static void _flush_done_jobs(struct per_thread *thread)
+{
+	struct task *task = thread->task;
+	struct job *job;
+
+	if (thread->num_done == 0)
+		return;
+	DBG("releasing %u completed jobs", thread->num_done);
+	while ((job = thread->done)) {
+		thread->done = job->next_job;
+		_free_job(task, job);
+	}
+	if (__atomic_sub_fetch(&task->num_jobs_active, thread->num_done,
+			       __ATOMIC_SEQ_CST) == 0) {
+		_main_wakeup(task);
+		_worker_wakeup_all(task);
+	}
+	thread->num_done = 0;
+}
+
+/* Mark @job as complete. Completed jobs are collected per thread and
+ * released in batches of DONE_BATCH, or when the thread runs out of jobs. */
+static void complete_job(struct per_thread *thread, struct job *job)
+{
+	struct task *task = thread->task;
+
+	job->next_job = thread->done;
+	thread->done = job;
+	if (++thread->num_done < DONE_BATCH)
+		return;
+	main_lock(task);
+	_flush_done_jobs(thread);
+	main_unlock(task);
+}
+
 /* Wait until a job is available in the job queue. When a job becomes
  * available, dequeue and return it. Return %NULL if no more jobs are
- * available, or if processing was aborted. Must be called with task->mutex
- * locked. */
-static struct job *_get_next_job(struct task *task)
+ * available, or if processing was aborted. The main mutex is only taken when
+ * no job is immediately available. */
+static struct job *get_next_job(struct per_thread *thread)
 {
-	struct job *job = NULL;
+	struct task *task = thread->task;
+	struct job *job;
+
+	if (!__atomic_load_n(&task->aborted, __ATOMIC_RELAXED)) {
+		job = dequeue_job_thread(thread);
+		if (job)
+			return job;
+	}
 
+	main_lock(task);
+	_flush_done_jobs(thread);
+	__atomic_add_fetch(&task->num_idle, 1, __ATOMIC_RELAXED);
+	/* Pairs with the fence in wakeup_idle_workers() */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
 	do {
 		DBG("checking for jobs");
+		job = NULL;
 		if (task->aborted)
 			break;
-		job = _dequeue_job(task);
+		job = dequeue_job_thread(thread);
 		if (job)
 			break;
-		if (task->num_jobs_active == 0)
+		if (__atomic_load_n(&task->num_jobs_active,
+				    __ATOMIC_SEQ_CST) == 0)
 			break;
-		DBG("found no jobs (%d active)", task->num_jobs_active);
+		DBG("found no jobs (%lu active)", task->num_jobs_active);
 	} while (_worker_wait(task) == 0);
+	__atomic_sub_fetch(&task->num_idle, 1, __ATOMIC_RELAXED);
+	main_unlock(task);
 
 	return job;
 }
@@ -1251,6 +1990,80 @@ static void write_job_data(struct task *task, struct job *job)
 	output_unlock(task);
 }
 
+/* Add @job that took @msec milliseconds to the list of slow jobs. Must be
+ * called with main_lock mutex held. */
+static void _add_slow_job(struct task *task, struct job *job, long msec)
+{
+	struct slow_job *slow = task->slow_jobs;
+	unsigned int i;
+
+	task->num_slow_total++;
+	if (task->num_slow_jobs == SLOW_REPORT_MAX) {
+		if (msec <= slow[SLOW_REPORT_MAX - 1].msec)
+			return;
+		free(slow[--task->num_slow_jobs].inname);
+	}
+
+	/* Keep list sorted by duration */
+	for (i = task->num_slow_jobs; i > 0 && slow[i - 1].msec < msec; i--)
+		slow[i] = slow[i - 1];
+	slow[i].inname = mstrdup(job->inname);
+	slow[i].type = job->type;
+	slow[i].status = job->status;
+	slow[i].msec = msec;
+	task->num_slow_jobs++;
+}
+
+/* Record the time it took to read the data of @job in the profile and if it
+ * exceeds the --report-slow threshold */
+static void record_job_time(struct task *task, struct job *job)
+{
+	struct timespec now_ts;
+	bool slow;
+	long msec;
+
+	if ((task->opts->report_slow == 0 && !task->profile) ||
+	    job->type == JOB_INIT || job->type == JOB_DIR ||
+	    job->status == JOB_EXCLUDED)
+		return;
+
+	set_timespec(&now_ts, 0, 0);
+	msec = (now_ts.tv_sec - job->start_ts.tv_sec) * 1000 +
+	       (now_ts.tv_nsec - job->start_ts.tv_nsec) / NSEC_PER_MSEC;
+	slow = task->opts->report_slow > 0 && msec >= task->opts->report_slow;
+	if (!slow && (!task->profile || msec < PROFILE_MIN_MSEC))
+		return;
+
+	main_lock(task);
+	if (slow)
+		_add_slow_job(task, job, msec);
+	if (task->profile)
+		profile_update(task->profile, job->inname, msec);
+	main_unlock(task);
+}
+
+/* Calculate the content hash of @job for incremental archives */
+static void hash_job(struct task *task, struct job *job)
+{
+	job->hashed = false;
+	if (!task->snapshot)
+		return;
+	if (job->type != JOB_FILE && job->type != JOB_CMD)
+		return;
+	if (job->status != JOB_DONE && job->status != JOB_PARTIAL)
+		return;
+
+	job->hash = SNAPSHOT_HASH_INIT;
+	if (snapshot_hash_buffer(job->content, &job->hash))
+		return;
+	/* Exit status is part of command output content */
+	if (job->type == JOB_CMD && task->opts->add_cmd_status) {
+		snapshot_hash_data(&job->hash, &job->cmd_status,
+				   sizeof(job->cmd_status));
+	}
+	job->hashed = true;
+}
+
 /* Perform second part of job processing for @job at @thread by writing the
  * resulting tar file entry */
 static void postprocess_job(struct per_thread *thread, struct job *job,
@@ -1258,7 +2071,9 @@ static void postprocess_job(struct per_thread *thread, struct job *job,
 {
 	struct task *task = thread->task;
 
+	record_job_time(task, job);
 	account_stats(task, &thread->stats, job);
+	hash_job(task, job);
 	if (cancelable)
 		write_job_data(task, job);
 	else
@@ -1270,10 +2085,9 @@ static void postprocess_job(struct per_thread *thread, struct job *job,
  * mutex held. */
 static void _complete_job(struct task *task, struct job *job)
 {
-	task->num_jobs_active--;
-	if (task->num_jobs_active == 0)
+	if (__atomic_sub_fetch(&task->num_jobs_active, 1, __ATOMIC_SEQ_CST) == 0)
 		_main_wakeup(task);
-	free_job(task, job);
+	_free_job(task, job);
 }
 
 static void init_thread(struct per_thread *thread, struct task *task, long num)
@@ -1281,6 +2095,7 @@ static void init_thread(struct per_thread *thread, struct task *task, long num)
 	memset(thread, 0, sizeof(struct per_thread));
 	thread->task = task;
 	thread->num = num;
+	pthread_mutex_init(&thread->jobs_mutex, NULL);
 }
 
 /* Dequeue and process all jobs on the job queue */
@@ -1290,8 +2105,10 @@ static int process_queue(struct task *task)
 	struct per_thread thread;
 
 	init_thread(&thread, task, 0);
+	task->threads = &thread;
+	task->num_threads = 1;
 
-	while ((job = _dequeue_job(task)) && !is_aborted(task)) {
+	while ((job = dequeue_job_thread(&thread)) && !is_aborted(task)) {
 		start_thread_job(&thread, job);
 		process_job(&thread, job);
 		postprocess_job(&thread, job, false);
@@ -1300,6 +2117,7 @@ static int process_queue(struct task *task)
 	}
 
 	task->stats = thread.stats;
+	release_thread_jobs(&thread);
 	cleanup_thread(&thread);
 
 	return EXIT_OK;
@@ -1328,6 +2146,7 @@ static void *worker_thread_main(void *d)
 	struct per_thread *thread = d;
 	struct task *task = thread->task;
 	struct job *job;
+	bool timed;
 
 	/* Allow cancel only at specific code points */
 	cancel_disable();
@@ -1350,8 +2169,20 @@ static void *worker_thread_main(void *d)
 
 	DBG("enter worker loop");
 
-	main_lock(task);
-	while ((job = _get_next_job(task))) {
+	/* With per-file timeouts, the main thread monitors thread->job under
+	 * task->mutex. Otherwise completion is batched without locking. */
+	timed = task->opts->file_timeout > 0;
+	while ((job = get_next_job(thread))) {
+		if (!timed) {
+			start_thread_job(thread, job);
+			process_job(thread, job);
+			postprocess_job(thread, job, true);
+			stop_thread_job(thread, job);
+			complete_job(thread, job);
+			continue;
+		}
+
+		main_lock(task);
 		start_thread_job(thread, job);
 		main_unlock(task);
 
@@ -1363,8 +2194,10 @@ static void *worker_thread_main(void *d)
 			goto out;
 		stop_thread_job(thread, job);
 		_complete_job(task, job);
+		main_unlock(task);
 	}
 
+	main_lock(task);
 out:
 	thread->running = false;
 	_main_wakeup(task);
@@ -1483,7 +2316,8 @@ static int wait_for_completion(struct task *task, struct per_thread *threads)
 	inc_timespec(&tool_deadline_ts, task->opts->timeout, 0);
 
 	main_lock(task);
-	while (!task->aborted && task->num_jobs_active > 0) {
+	while (!task->aborted &&
+	       __atomic_load_n(&task->num_jobs_active, __ATOMIC_RELAXED) > 0) {
 		/* Calculate nearest timeout */
 		earliest_timeout = 0;
 		earliest_ts = NULL;
@@ -1495,11 +2329,13 @@ static int wait_for_completion(struct task *task, struct per_thread *threads)
 		}
 
 		for (i = 0; i < task->opts->jobs; i++) {
+			/* thread->job is only protected with per-file
+			 * timeouts */
+			if (task->opts->file_timeout == 0)
+				break;
 			job = threads[i].job;
 			if (!job || !job->timed)
 				continue;
-			if (task->opts->file_timeout == 0)
-				continue;
 			if (!earliest_ts ||
 			    ts_before(&job->deadline, earliest_ts)) {
 				earliest_timeout = task->opts->file_timeout;
@@ -1565,11 +2401,19 @@ static int wait_for_completion(struct task *task, struct per_thread *threads)
 static void close_output(struct task *task)
 {
 #ifdef HAVE_ZLIB
-	if (task->opts->gzip) {
-		gzclose(task->output_gzfd);
-		return;
+	if (task->opts->gzip && task->output_gz) {
+		if (gzout_close(task->output_gz))
+			write_error(task, "Cannot write output");
+		task->output_gz = NULL;
 	}
 #endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+	if (task->opts->zstd && task->output_zs) {
+		if (zstdout_close(task->output_zs))
+			write_error(task, "Cannot write output");
+		task->output_zs = NULL;
+	}
+#endif /* HAVE_ZSTD */
 
 	if (task->output_fd != STDOUT_FILENO)
 		close(task->output_fd);
@@ -1582,12 +2426,21 @@ static int process_queue_threaded(struct task *task)
 	int rc;
 	long i;
 
-	tverb("Using %ld threads\n", task->opts->jobs);
+	/* Reserve a quarter of the threads for slow-prone jobs so that they
+	 * do not block the processing of other jobs */
+	task->num_slow_threads = task->opts->jobs / 4;
+	if (task->num_slow_threads == 0)
+		task->num_slow_threads = 1;
+	tverb("Using %ld threads (%ld for slow sources)\n", task->opts->jobs,
+	      task->num_slow_threads);
 	threads = mcalloc(sizeof(struct per_thread), task->opts->jobs);
+	for (i = 0; i < task->opts->jobs; i++)
+		init_thread(&threads[i], task, i);
+	task->threads = threads;
+	task->num_threads = task->opts->jobs;
 
 	rc = 0;
 	for (i = 0; i < task->opts->jobs; i++) {
-		init_thread(&threads[i], task, i);
 		rc = start_worker_thread(&threads[i]);
 		if (rc)
 			break;
@@ -1606,9 +2459,13 @@ static int process_queue_threaded(struct task *task)
 		DBG("join %p", thread->thread);
 		pthread_join(thread->thread, NULL);
 		add_stats(&task->stats, &thread->stats);
+		release_thread_jobs(thread);
 		cleanup_thread(thread);
 	}
 
+	task->threads = NULL;
+	task->num_threads = 0;
+	task->num_slow_threads = 0;
 	free(threads);
 
 	return rc;
@@ -1619,7 +2476,7 @@ static void abort_queued_jobs(struct task *task)
 {
 	struct job *job;
 
-	while ((job = _dequeue_job(task))) {
+	while ((job = _dequeue_job(task)) || (job = _dequeue_slow_job(task))) {
 		DBG("aborting job %s", job->inname);
 		task->stats.num_failed++;
 		job->status = JOB_FAILED;
@@ -1646,10 +2503,12 @@ static void print_summary(struct task *task)
 	num_special += stats->num_partial > 0	? 1 : 0;
 	num_special += stats->num_excluded > 0	? 1 : 0;
 	num_special += stats->num_failed > 0	? 1 : 0;
+	num_special += task->output_num_unchanged > 0 ? 1 : 0;
 
 	num_added = stats->num_done;
 	if (task->opts->ignore_failed_read)
 		num_added += stats->num_partial + stats->num_failed;
+	num_added -= task->output_num_unchanged;
 
 	rc = snprintf(&msg[off], MSG_LEN - off, "Dumped %lu entries ",
 		      num_added);
@@ -1680,6 +2539,15 @@ static void print_summary(struct task *task)
 			rc = snprintf(&msg[off], MSG_LEN - off, "%lu failed",
 				      stats->num_failed);
 			HANDLE_RC(rc, MSG_LEN, off, out);
+			if (--num_special > 0) {
+				rc = snprintf(&msg[off], MSG_LEN - off, ", ");
+				HANDLE_RC(rc, MSG_LEN, off, out);
+			}
+		}
+		if (task->output_num_unchanged > 0) {
+			rc = snprintf(&msg[off], MSG_LEN - off, "%lu unchanged",
+				      task->output_num_unchanged);
+			HANDLE_RC(rc, MSG_LEN, off, out);
 		}
 		rc = snprintf(&msg[off], MSG_LEN - off, ") ");
 		HANDLE_RC(rc, MSG_LEN, off, out);
@@ -1693,6 +2561,49 @@ out:
 	info("%s\n", msg);
 }
 
+/* Print a list of the slowest jobs */
+static void print_slow_report(struct task *task)
+{
+	struct slow_job *slow;
+	const char *note;
+	unsigned int i;
+
+	if (task->opts->report_slow == 0)
+		return;
+
+	info("%lu entries took %ldms or longer to read%s\n",
+	     task->num_slow_total, task->opts->report_slow,
+	     task->num_slow_total > task->num_slow_jobs ?
+	     " - slowest entries:" : "");
+	for (i = 0; i < task->num_slow_jobs; i++) {
+		slow = &task->slow_jobs[i];
+		switch (slow->status) {
+		case JOB_PARTIAL:
+			note = " (partial)";
+			break;
+		case JOB_FAILED:
+			note = " (failed)";
+			break;
+		default:
+			note = "";
+			break;
+		}
+		info("  %5ld.%03lds %s%s%s\n", slow->msec / 1000,
+		     slow->msec % 1000, slow->type == JOB_CMD ? "command " : "",
+		     slow->inname, note);
+	}
+}
+
+/* Release resources used for the report of slow jobs */
+static void free_slow_jobs(struct task *task)
+{
+	unsigned int i;
+
+	for (i = 0; i < task->num_slow_jobs; i++)
+		free(task->slow_jobs[i].inname);
+	task->num_slow_jobs = 0;
+}
+
 static int init_task(struct task *task, struct dump_opts *opts)
 {
 	pthread_condattr_t attr;
@@ -1701,6 +2612,7 @@ static int init_task(struct task *task, struct dump_opts *opts)
 	set_timespec(&task->start_ts, 0, 0);
 	task->opts = opts;
 	pthread_mutex_init(&task->mutex, NULL);
+	pthread_mutex_init(&task->queue_mutex, NULL);
 	pthread_mutex_init(&task->output_mutex, NULL);
 	pthread_cond_init(&task->worker_cond, NULL);
 
@@ -1755,6 +2667,9 @@ void dump_opts_print(struct dump_opts *opts)
 		printf("DEBUG:  exclude_type[%d]=%d\n", i,
 		       opts->exclude_type[i]);
 	printf("DEBUG:  gzip=%d\n", opts->gzip);
+	printf("DEBUG:  zstd=%d\n", opts->zstd);
+	printf("DEBUG:  compress_level=%d\n", opts->compress_level);
+	printf("DEBUG:  compress_threads=%ld\n", opts->compress_threads);
 	printf("DEBUG:  ignore_failed_read=%d\n", opts->ignore_failed_read);
 	printf("DEBUG:  no_eof=%d\n", opts->no_eof);
 	printf("DEBUG:  quiet=%d\n", opts->quiet);
@@ -1762,10 +2677,14 @@ void dump_opts_print(struct dump_opts *opts)
 	printf("DEBUG:  threaded=%d\n", opts->threaded);
 	printf("DEBUG:  verbose=%d\n", opts->verbose);
 	printf("DEBUG:  output_file=%s\n", opts->output_file);
+	printf("DEBUG:  connect=%s\n", opts->connect);
+	printf("DEBUG:  snapshot=%s\n", opts->snapshot);
+	printf("DEBUG:  profile=%s\n", opts->profile);
 	printf("DEBUG:  file_timeout=%d\n", opts->file_timeout);
 	printf("DEBUG:  timeout=%d\n", opts->timeout);
 	printf("DEBUG:  jobs=%ld\n", opts->jobs);
 	printf("DEBUG:  jobs_per_cpu=%ld\n", opts->jobs_per_cpu);
+	printf("DEBUG:  report_slow=%ld\n", opts->report_slow);
 	printf("DEBUG:  file_max_size=%zu\n", opts->file_max_size);
 	printf("DEBUG:  max_buffer_size=%zu\n", opts->max_buffer_size);
 	printf("DEBUG:  max_size=%zu\n", opts->max_size);
@@ -1826,6 +2745,12 @@ int dump_to_tar(struct dump_opts *opts)
 		opts->jobs = num_cpus;
 	}
 
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+	/* Compress using as many threads as there are parallel jobs */
+	if (opts->compress_threads == 0 && opts->jobs > 0)
+		opts->compress_threads = opts->jobs;
+#endif /* HAVE_ZLIB || HAVE_ZSTD */
+
 	if (opts->jobs == 0 && (opts->timeout > 0 || opts->file_timeout > 0)) {
 		/* Separate thread needed to implement timeout via cancel */
 		opts->jobs = 1;
@@ -1835,6 +2760,21 @@ int dump_to_tar(struct dump_opts *opts)
 	if (rc)
 		return rc;
 
+	if (opts->snapshot) {
+		task.snapshot = snapshot_open(opts->snapshot);
+		if (!task.snapshot)
+			return EXIT_RUNTIME;
+	}
+
+	if (opts->profile) {
+		task.profile = profile_open(opts->profile);
+		if (!task.profile) {
+			if (task.snapshot)
+				snapshot_close(task.snapshot, false);
+			return EXIT_RUNTIME;
+		}
+	}
+
 	/* Queue initial job */
 	init_queue(&task);
 
@@ -1844,14 +2784,25 @@ int dump_to_tar(struct dump_opts *opts)
 	else
 		rc = process_queue(&task);
 	abort_queued_jobs(&task);
+	free_job_pool(&task);
 
 	if (task.output_num_files > 0 && !opts->no_eof)
 		write_eof(&task);
 
 	print_summary(&task);
+	print_slow_report(&task);
+	free_slow_jobs(&task);
 
 	close_output(&task);
 
+	/* Only complete archives may serve as base for the next one */
+	if (task.snapshot && snapshot_close(task.snapshot, !task.aborted))
+		rc = EXIT_RUNTIME;
+
+	/* Read times of incomplete runs are still useful for scheduling */
+	if (task.profile && profile_close(task.profile, true))
+		rc = EXIT_RUNTIME;
+
 	if (rc == 0 && task.aborted)
 		rc = EXIT_RUNTIME;
 
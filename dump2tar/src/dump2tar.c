@@ -25,6 +25,9 @@
 #include "idcache.h"
 #include "misc.h"
 #include "strarray.h"
+#ifdef HAVE_ZSTD
+#include "zstdout.h"
+#endif /* HAVE_ZSTD */
 
 #define MIN_BUFFER_SIZE		4096
 
@@ -33,6 +36,16 @@
 #define	OPT_DEREFERENCE		(OPT_NOSHORT_BASE + 0)
 #define OPT_NORECURSION		(OPT_NOSHORT_BASE + 1)
 #define OPT_EXCLUDETYPE		(OPT_NOSHORT_BASE + 2)
+#define OPT_ZSTD		(OPT_NOSHORT_BASE + 3)
+#define OPT_COMPRESSLEVEL	(OPT_NOSHORT_BASE + 4)
+#define OPT_COMPRESSTHREADS	(OPT_NOSHORT_BASE + 5)
+#define OPT_REPORTSLOW		(OPT_NOSHORT_BASE + 6)
+#define OPT_SNAPSHOT		(OPT_NOSHORT_BASE + 7)
+#define OPT_CONNECT		(OPT_NOSHORT_BASE + 8)
+#define OPT_PROFILE		(OPT_NOSHORT_BASE + 9)
+
+/* Maximum gzip compression level */
+#define GZIP_LEVEL_MAX		9
 
 /* Program description */
 static const struct util_prg dump2tar_prg = {
@@ -60,12 +73,49 @@ static struct util_opt dump2tar_opts[] = {
 		.argument = "FILE",
 		.desc = "Write archive to FILE (default: standard output)",
 	},
+	{
+		.option = { "connect", required_argument, NULL, OPT_CONNECT },
+		.argument = "HOST:PORT",
+		.desc = "Write archive to TCP connection with HOST:PORT",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
 #ifdef HAVE_ZLIB
 	{
 		.option = { "gzip", no_argument, NULL, 'z' },
 		.desc = "Write a gzip compressed archive",
 	},
 #endif /* HAVE_ZLIB */
+#ifdef HAVE_ZSTD
+	{
+		.option = { "zstd", no_argument, NULL, OPT_ZSTD },
+		.desc = "Write a zstd compressed archive",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
+#endif /* HAVE_ZSTD */
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+	{
+		.option = { "compress-level", required_argument, NULL,
+			    OPT_COMPRESSLEVEL },
+		.argument = "N",
+		.desc = "Use compression level N",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
+	{
+		.option = { "compress-threads", required_argument, NULL,
+			    OPT_COMPRESSTHREADS },
+		.argument = "N",
+		.desc = "Compress using N threads (default: --jobs value "
+			"or one per CPU)",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
+#endif /* HAVE_ZLIB || HAVE_ZSTD */
+	{
+		.option = { "snapshot", required_argument, NULL,
+			    OPT_SNAPSHOT },
+		.argument = "FILE",
+		.desc = "Omit entries unchanged since snapshot in FILE",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
 	{
 		.option = { "max-size", required_argument, NULL, 'm' },
 		.argument = "N",
@@ -111,6 +161,20 @@ static struct util_opt dump2tar_opts[] = {
 		.option = { "file-timeout", required_argument, NULL, 'T' },
 		.desc = "Stop reading file after SEC seconds",
 	},
+	{
+		.option = { "report-slow", required_argument, NULL,
+			    OPT_REPORTSLOW },
+		.argument = "MSEC",
+		.desc = "Report files taking MSEC milliseconds or longer to "
+			"read",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
+	{
+		.option = { "profile", required_argument, NULL, OPT_PROFILE },
+		.argument = "FILE",
+		.desc = "Schedule jobs using read times recorded in FILE",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
 	{
 		.option = { "file-max-size", required_argument, NULL, 'M' },
 		.argument = "N",
@@ -418,6 +482,22 @@ int main(int argc, char *argv[])
 				goto out;
 			}
 			break;
+		case OPT_CONNECT: /* --connect HOST:PORT */
+			opts->connect = optarg;
+			break;
+		case OPT_SNAPSHOT: /* --snapshot FILE */
+			opts->snapshot = optarg;
+			break;
+		case OPT_PROFILE: /* --profile FILE */
+			opts->profile = optarg;
+			break;
+		case OPT_REPORTSLOW: /* --report-slow MSEC */
+			opts->report_slow = atol(optarg);
+			if (opts->report_slow < 1) {
+				mwarnx("Invalid time value: %s", optarg);
+				goto out;
+			}
+			break;
 		case 'm': /* --max-size N */
 			opts->max_size = atol(optarg);
 			if (opts->max_size < 2) {
@@ -435,6 +515,24 @@ int main(int argc, char *argv[])
 		case 'z': /* --gzip */
 			opts->gzip = true;
 			break;
+		case OPT_ZSTD: /* --zstd */
+			opts->zstd = true;
+			break;
+		case OPT_COMPRESSLEVEL: /* --compress-level N */
+			opts->compress_level = atoi(optarg);
+			if (opts->compress_level < 1) {
+				mwarnx("Invalid compression level: %s", optarg);
+				goto out;
+			}
+			break;
+		case OPT_COMPRESSTHREADS: /* --compress-threads N */
+			opts->compress_threads = atol(optarg);
+			if (opts->compress_threads < 1) {
+				mwarnx("Invalid number of compression threads: "
+				       "%s", optarg);
+				goto out;
+			}
+			break;
 		case 1: /* Filename specification or unrecognized option */
 			if (optarg[0] == '-') {
 				mwarnx("Invalid option '%s'", optarg);
@@ -460,6 +558,27 @@ int main(int argc, char *argv[])
 		mwarnx("Please specify files to dump");
 		goto out;
 	}
+	if (opts->connect && (opts->output_file || opts->append)) {
+		mwarnx("Option --connect cannot be used with --output-file "
+		       "or --append");
+		goto out;
+	}
+	if (opts->gzip && opts->zstd) {
+		mwarnx("Options --gzip and --zstd are mutually exclusive");
+		goto out;
+	}
+	if (opts->gzip && opts->compress_level > GZIP_LEVEL_MAX) {
+		mwarnx("Compression level too high for gzip (maximum %d)",
+		       GZIP_LEVEL_MAX);
+		goto out;
+	}
+#ifdef HAVE_ZSTD
+	if (opts->zstd && opts->compress_level > ZSTDOUT_LEVEL_MAX) {
+		mwarnx("Compression level too high for zstd (maximum %d)",
+		       ZSTDOUT_LEVEL_MAX);
+		goto out;
+	}
+#endif /* HAVE_ZSTD */
 
 	for (i = optind; i < argc; i++)
 		dump_opts_add_spec(opts, argv[i], NULL, false);
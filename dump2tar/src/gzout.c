@@ -0,0 +1,331 @@
+/*
+ * dump2tar - tool to dump files and command output into a tar archive
+ *
+ * Parallel gzip compression of the output stream
+ *
+ * The output stream is split into blocks of GZOUT_BLOCK_SIZE bytes. Each
+ * block is compressed independently into a separate gzip member by one of
+ * a number of compression threads. Blocks are written to the output file in
+ * their original order. The concatenation of gzip members is a valid gzip
+ * file that can be decompressed by any gzip implementation.
+ *
+ * Copyright IBM Corp. 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "gzout.h"
+#include "misc.h"
+
+/* Additional space needed for gzip header and trailer (bytes) */
+#define GZIP_OVERHEAD	32
+
+enum gzout_state {
+	GZOUT_FREE,	/* Block is being filled with data */
+	GZOUT_QUEUED,	/* Block is waiting for compression */
+	GZOUT_BUSY,	/* Block is being compressed */
+	GZOUT_DONE,	/* Block is waiting to be written */
+};
+
+struct gzout_block {
+	enum gzout_state state;
+	char *in;		/* Uncompressed data */
+	size_t in_len;
+	char *out;		/* Compressed data */
+	size_t out_len;
+	size_t out_off;		/* Number of compressed bytes written */
+	bool failed;		/* Compression failed */
+};
+
+struct gzout {
+	int fd;
+	int level;
+	size_t out_size;
+	/* mutex serializes access to block states and sequence numbers */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t *threads;
+	long num_threads;
+	z_stream strm;		/* Used when compressing without threads */
+	bool strm_init;
+	struct gzout_block *blocks;
+	unsigned long num_blocks;
+	unsigned long seq_fill;		/* Block currently being filled */
+	unsigned long seq_compress;	/* Next block to compress */
+	unsigned long seq_write;	/* Next block to write */
+	bool stop;
+};
+
+/* Return the block with sequence number @seq */
+static struct gzout_block *get_block(struct gzout *gz, unsigned long seq)
+{
+	return &gz->blocks[seq % gz->num_blocks];
+}
+
+/* Initialize z_stream @strm for writing gzip members at @level */
+static int init_strm(z_stream *strm, int level)
+{
+	memset(strm, 0, sizeof(z_stream));
+
+	return deflateInit2(strm, level, Z_DEFLATED, 15 + 16, 8,
+			    Z_DEFAULT_STRATEGY) == Z_OK ? 0 : -1;
+}
+
+/* Compress the data of block @blk into a gzip member using @strm */
+static void compress_block(struct gzout *gz, z_stream *strm,
+			   struct gzout_block *blk)
+{
+	int rc;
+
+	deflateReset(strm);
+	strm->next_in = (Bytef *) blk->in;
+	strm->avail_in = blk->in_len;
+	strm->next_out = (Bytef *) blk->out;
+	strm->avail_out = gz->out_size;
+	rc = deflate(strm, Z_FINISH);
+	blk->failed = (rc != Z_STREAM_END);
+	blk->out_len = gz->out_size - strm->avail_out;
+	blk->out_off = 0;
+}
+
+/* Compression thread: Compress queued blocks in sequence */
+static void *compress_thread_main(void *data)
+{
+	struct gzout *gz = data;
+	struct gzout_block *blk;
+	z_stream strm;
+	bool ok;
+
+	set_threadname("gzip");
+	ok = (init_strm(&strm, gz->level) == 0);
+
+	pthread_mutex_lock(&gz->mutex);
+	while (true) {
+		while (!gz->stop && gz->seq_compress == gz->seq_fill)
+			pthread_cond_wait(&gz->cond, &gz->mutex);
+		if (gz->stop)
+			break;
+		blk = get_block(gz, gz->seq_compress++);
+		blk->state = GZOUT_BUSY;
+		pthread_mutex_unlock(&gz->mutex);
+
+		if (ok)
+			compress_block(gz, &strm, blk);
+		else
+			blk->failed = true;
+
+		pthread_mutex_lock(&gz->mutex);
+		blk->state = GZOUT_DONE;
+		pthread_cond_broadcast(&gz->cond);
+	}
+	pthread_mutex_unlock(&gz->mutex);
+
+	if (ok)
+		deflateEnd(&strm);
+	clear_threadname();
+
+	return NULL;
+}
+
+/* Wait until block @blk has been compressed and write it to the output file.
+ * The thread may only be canceled while writing. Return 0 on success, -1 on
+ * error with errno set. */
+static int write_block(struct gzout *gz, struct gzout_block *blk,
+		       int cancel_state)
+{
+	ssize_t w;
+
+	if (gz->num_threads > 0) {
+		pthread_mutex_lock(&gz->mutex);
+		while (blk->state != GZOUT_DONE)
+			pthread_cond_wait(&gz->cond, &gz->mutex);
+		pthread_mutex_unlock(&gz->mutex);
+	}
+	if (blk->failed) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	while (blk->out_off < blk->out_len) {
+		pthread_setcancelstate(cancel_state, NULL);
+		w = write(gz->fd, blk->out + blk->out_off,
+			  blk->out_len - blk->out_off);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		if (w < 0)
+			return -1;
+		blk->out_off += w;
+	}
+	blk->state = GZOUT_FREE;
+	blk->in_len = 0;
+	gz->seq_write++;
+
+	return 0;
+}
+
+/* Queue the currently filled block for compression and make the next block
+ * available for filling. */
+static int submit_block(struct gzout *gz, int cancel_state)
+{
+	struct gzout_block *blk = get_block(gz, gz->seq_fill);
+
+	if (gz->num_threads > 0) {
+		pthread_mutex_lock(&gz->mutex);
+		blk->state = GZOUT_QUEUED;
+		gz->seq_fill++;
+		pthread_cond_signal(&gz->cond);
+		pthread_mutex_unlock(&gz->mutex);
+	} else {
+		compress_block(gz, &gz->strm, blk);
+		blk->state = GZOUT_DONE;
+		gz->seq_fill++;
+	}
+
+	/* Blocks are reused in sequence, so if all blocks are in use, the
+	 * block to be filled next is the oldest block not written yet */
+	if (gz->seq_fill - gz->seq_write == gz->num_blocks)
+		return write_block(gz, get_block(gz, gz->seq_write),
+				   cancel_state);
+
+	return 0;
+}
+
+/* Stop compression threads and release all resources of @gz */
+static void free_gzout(struct gzout *gz)
+{
+	unsigned long i;
+	long num;
+
+	pthread_mutex_lock(&gz->mutex);
+	gz->stop = true;
+	pthread_cond_broadcast(&gz->cond);
+	pthread_mutex_unlock(&gz->mutex);
+	for (num = 0; num < gz->num_threads; num++)
+		pthread_join(gz->threads[num], NULL);
+
+	if (gz->strm_init)
+		deflateEnd(&gz->strm);
+	for (i = 0; i < gz->num_blocks; i++) {
+		free(gz->blocks[i].in);
+		free(gz->blocks[i].out);
+	}
+	free(gz->blocks);
+	free(gz->threads);
+	pthread_mutex_destroy(&gz->mutex);
+	pthread_cond_destroy(&gz->cond);
+	free(gz);
+}
+
+/* Open a gzip output stream writing to file descriptor @fd using compression
+ * level @level and up to @threads compression threads. Return a pointer to
+ * the stream on success, %NULL otherwise. */
+struct gzout *gzout_open(int fd, int level, long threads)
+{
+	struct gzout *gz;
+	unsigned long i;
+	long num;
+	int rc;
+
+	gz = mcalloc(sizeof(struct gzout), 1);
+	gz->fd = fd;
+	gz->level = level;
+	gz->out_size = compressBound(GZOUT_BLOCK_SIZE) + GZIP_OVERHEAD;
+	pthread_mutex_init(&gz->mutex, NULL);
+	pthread_cond_init(&gz->cond, NULL);
+
+	if (threads > GZOUT_THREADS_MAX)
+		threads = GZOUT_THREADS_MAX;
+	if (threads < 2)
+		threads = 0;
+
+	/* Two blocks per thread allow filling and writing blocks while others
+	 * are being compressed */
+	gz->num_blocks = threads > 0 ? 2 * threads : 1;
+	gz->blocks = mcalloc(sizeof(struct gzout_block), gz->num_blocks);
+	for (i = 0; i < gz->num_blocks; i++) {
+		gz->blocks[i].in = mmalloc(GZOUT_BLOCK_SIZE);
+		gz->blocks[i].out = mmalloc(gz->out_size);
+	}
+
+	gz->threads = mcalloc(sizeof(pthread_t), threads ? threads : 1);
+	for (num = 0; num < threads; num++) {
+		rc = pthread_create(&gz->threads[num], NULL,
+				    &compress_thread_main, gz);
+		if (rc) {
+			mwarnx("Cannot start compression thread: %s",
+			       strerror(rc));
+			break;
+		}
+	}
+	gz->num_threads = num;
+	DBG("using %ld compression threads", gz->num_threads);
+
+	if (gz->num_threads == 0) {
+		if (init_strm(&gz->strm, level)) {
+			free_gzout(gz);
+			return NULL;
+		}
+		gz->strm_init = true;
+	}
+
+	return gz;
+}
+
+/* Write @len bytes at @ptr to gzip output stream @gz. Must not be called
+ * concurrently for the same stream. Return 0 on success, -1 on error with
+ * errno set. */
+int gzout_write(struct gzout *gz, const char *ptr, size_t len)
+{
+	struct gzout_block *blk;
+	int cancel_state, rc = 0;
+	size_t n;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+	while (len > 0) {
+		blk = get_block(gz, gz->seq_fill);
+		n = GZOUT_BLOCK_SIZE - blk->in_len;
+		if (n > len)
+			n = len;
+		memcpy(blk->in + blk->in_len, ptr, n);
+		blk->in_len += n;
+		ptr += n;
+		len -= n;
+		if (blk->in_len == GZOUT_BLOCK_SIZE) {
+			rc = submit_block(gz, cancel_state);
+			if (rc)
+				break;
+		}
+	}
+	pthread_setcancelstate(cancel_state, NULL);
+
+	return rc;
+}
+
+/* Write all remaining data of gzip output stream @gz and release all
+ * associated resources. The output file descriptor is not closed. Return 0
+ * on success, -1 on error with errno set. */
+int gzout_close(struct gzout *gz)
+{
+	int cancel_state, rc = 0;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+	/* An empty stream still needs one gzip member to be a valid file */
+	if (get_block(gz, gz->seq_fill)->in_len > 0 || gz->seq_fill == 0)
+		rc = submit_block(gz, cancel_state);
+	while (rc == 0 && gz->seq_write < gz->seq_fill)
+		rc = write_block(gz, get_block(gz, gz->seq_write),
+				 cancel_state);
+	free_gzout(gz);
+
+	pthread_setcancelstate(cancel_state, NULL);
+
+	return rc;
+}
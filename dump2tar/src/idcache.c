@@ -22,23 +22,29 @@
 /* Maximum user and group name lengths as defined in tar header */
 #define ID_NAME_MAXLEN	32
 
+/* Number of hash buckets per ID cache */
+#define ID_CACHE_HASH_SIZE	256
+
 /* Types for user and group ID caches */
 typedef uid_t generic_id_t; /* Assumes that uid_t == gid_t */
 
 struct id_cache_entry {
+	struct id_cache_entry *next;
 	generic_id_t id;
+	bool found;	/* %false if ID has no associated name */
 	char name[ID_NAME_MAXLEN];
 };
 
 struct id_cache {
-	unsigned int num;
-	struct id_cache_entry entries[];
+	struct id_cache_entry *hash[ID_CACHE_HASH_SIZE];
 };
 
-/* cache_mutex serializes access to cached uid and gid data */
+/* id_cache_mutex serializes additions to cached uid and gid data. Entries
+ * are never modified after they are published, so lookups do not need to
+ * take the mutex. */
 static pthread_mutex_t id_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
-static struct id_cache *id_cache_uid;
-static struct id_cache *id_cache_gid;
+static struct id_cache id_cache_uid;
+static struct id_cache id_cache_gid;
 
 /* Lock cache mutex */
 static void cache_lock(void)
@@ -56,56 +62,89 @@ static void cache_unlock(void)
 	pthread_mutex_unlock(&id_cache_mutex);
 }
 
+/* Return the hash bucket for @id in @cache */
+static struct id_cache_entry **get_bucket(struct id_cache *cache,
+					  generic_id_t id)
+{
+	return &cache->hash[id % ID_CACHE_HASH_SIZE];
+}
+
+/* Return the entry for @id in @cache or %NULL if there is none. Can be
+ * called without id_cache_mutex locked. */
+static struct id_cache_entry *find_id_cache_entry(struct id_cache *cache,
+						  generic_id_t id)
+{
+	struct id_cache_entry *entry;
+
+	/* Pairs with the release store in add_id_cache_entry() */
+	entry = __atomic_load_n(get_bucket(cache, id), __ATOMIC_ACQUIRE);
+	for (; entry; entry = entry->next) {
+		if (entry->id == id)
+			return entry;
+	}
+
+	return NULL;
+}
+
 /* Copy the name associated with @id in @cache to at most @len bytes at @dest.
- * Return %true if name was found in cache, %false otherwise. */
+ * Return %true if @id was found in cache, %false otherwise. IDs without
+ * associated name are also cached, in which case @dest remains unchanged. */
 static bool strncpy_id_cache_entry(char *dest, struct id_cache *cache,
 				   generic_id_t id, size_t len)
 {
-	unsigned int i;
-	bool hit = false;
+	struct id_cache_entry *entry;
 
-	cache_lock();
-	if (cache) {
-		for (i = 0; i < cache->num; i++) {
-			if (cache->entries[i].id == id) {
-				strncpy(dest, cache->entries[i].name, len);
-				hit = true;
-				break;
-			}
-		}
-	}
-	cache_unlock();
+	entry = find_id_cache_entry(cache, id);
+	if (entry && entry->found)
+		strncpy(dest, entry->name, len);
 
-	return hit;
+	return entry != NULL;
 }
 
-/* Add a new entry consisting of @id and @name to ID cache in @*cache_ptr.
- * Update @cache_ptr if necessary. */
-static void add_id_cache_entry(struct id_cache **cache_ptr, generic_id_t id,
-			       char *name)
+/* Add a new entry consisting of @id and @name to ID cache @cache. If @name is
+ * %NULL, record that @id has no associated name. */
+static void add_id_cache_entry(struct id_cache *cache, generic_id_t id,
+			       const char *name)
 {
-	struct id_cache *cache;
-	unsigned int cache_num;
-	size_t new_size;
-	struct id_cache *new_cache;
+	struct id_cache_entry *entry, **bucket;
 
 	cache_lock();
 
-	cache = *cache_ptr;
-	cache_num = cache ? cache->num : 0;
-	new_size = sizeof(struct id_cache) +
-		   sizeof(struct id_cache_entry) * (cache_num + 1);
-	new_cache = mrealloc(cache, new_size);
-	if (cache_num == 0)
-		new_cache->num = 0;
-	new_cache->entries[cache_num].id = id;
-	strncpy(new_cache->entries[cache_num].name, name, ID_NAME_MAXLEN);
-	new_cache->num++;
-	*cache_ptr = new_cache;
+	/* Another thread might have added the same ID in the meantime */
+	if (find_id_cache_entry(cache, id))
+		goto out;
+
+	entry = mmalloc(sizeof(struct id_cache_entry));
+	entry->id = id;
+	if (name) {
+		/* Name is not NUL-terminated if it fills the whole field */
+		memcpy(entry->name, name, strnlen(name, ID_NAME_MAXLEN));
+		entry->found = true;
+	}
+	bucket = get_bucket(cache, id);
+	entry->next = *bucket;
+	/* Publish fully initialized entry to lock-less readers */
+	__atomic_store_n(bucket, entry, __ATOMIC_RELEASE);
 
+out:
 	cache_unlock();
 }
 
+/* Release all entries of ID cache @cache */
+static void free_id_cache(struct id_cache *cache)
+{
+	struct id_cache_entry *entry, *next;
+	unsigned int i;
+
+	for (i = 0; i < ID_CACHE_HASH_SIZE; i++) {
+		for (entry = cache->hash[i]; entry; entry = next) {
+			next = entry->next;
+			free(entry);
+		}
+		cache->hash[i] = NULL;
+	}
+}
+
 /* Copy the user name corresponding to user ID @uid to at most @len bytes
  * at @name */
 void uid_to_name(uid_t uid, char *name, size_t len)
@@ -113,13 +152,15 @@ void uid_to_name(uid_t uid, char *name, size_t len)
 	struct passwd pwd, *pwd_ptr;
 	char buffer[PWD_BUFFER_SIZE], *result;
 
-	if (strncpy_id_cache_entry(name, id_cache_uid, uid, len))
+	if (strncpy_id_cache_entry(name, &id_cache_uid, uid, len))
 		return;
 
 	/* getpwuid() can be slow so cache results */
 	getpwuid_r(uid, &pwd, buffer, PWD_BUFFER_SIZE, &pwd_ptr);
-	if (!pwd_ptr || !pwd_ptr->pw_name)
+	if (!pwd_ptr || !pwd_ptr->pw_name) {
+		add_id_cache_entry(&id_cache_uid, uid, NULL);
 		return;
+	}
 	result = pwd_ptr->pw_name;
 
 	add_id_cache_entry(&id_cache_uid, uid, result);
@@ -134,13 +175,15 @@ void gid_to_name(gid_t gid, char *name, size_t len)
 	struct group grp, *grp_ptr;
 	char buffer[GRP_BUFFER_SIZE], *result;
 
-	if (strncpy_id_cache_entry(name, id_cache_gid, gid, len))
+	if (strncpy_id_cache_entry(name, &id_cache_gid, gid, len))
 		return;
 
 	/* getgrgid() can be slow so cache results */
 	getgrgid_r(gid, &grp, buffer, GRP_BUFFER_SIZE, &grp_ptr);
-	if (!grp_ptr || !grp_ptr->gr_name)
+	if (!grp_ptr || !grp_ptr->gr_name) {
+		add_id_cache_entry(&id_cache_gid, gid, NULL);
 		return;
+	}
 	result = grp_ptr->gr_name;
 
 	add_id_cache_entry(&id_cache_gid, gid, result);
@@ -150,6 +193,6 @@ void gid_to_name(gid_t gid, char *name, size_t len)
 
 void idcache_cleanup(void)
 {
-	free(id_cache_uid);
-	free(id_cache_gid);
+	free_id_cache(&id_cache_uid);
+	free_id_cache(&id_cache_gid);
 }
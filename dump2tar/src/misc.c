@@ -11,11 +11,14 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <netdb.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -370,6 +373,8 @@ int cmd_child(int fd, char *cmd)
 	char *env[] = { NULL };
 
 	argv[2] = cmd;
+	/* SIGPIPE might be ignored when writing to a network connection */
+	signal(SIGPIPE, SIG_DFL);
 	if (dup2(fd, STDOUT_FILENO) == -1 || dup2(fd, STDERR_FILENO) == -1) {
 		mwarn("Could not redirect command output");
 		return EXIT_RUNTIME;
@@ -380,6 +385,59 @@ int cmd_child(int fd, char *cmd)
 	return EXIT_RUNTIME;
 }
 
+/* Open a TCP connection to @addr which has the format HOST:PORT. IPv6
+ * addresses must be enclosed in brackets. Return the socket file descriptor
+ * on success, %-1 otherwise. */
+int net_connect(const char *addr)
+{
+	struct addrinfo hints, *result, *ai;
+	char *host, *port;
+	int fd = -1, rc;
+
+	host = mstrdup(addr);
+	port = strrchr(host, ':');
+	if (!port || port == host || !port[1]) {
+		mwarnx("%s: Invalid network address - expected HOST:PORT",
+		       addr);
+		goto out;
+	}
+	*port++ = 0;
+	if (host[0] == '[' && ends_with(host, "]")) {
+		chomp(host, "]");
+		memmove(host, host + 1, strlen(host));
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	rc = getaddrinfo(host, port, &hints, &result);
+	if (rc) {
+		mwarnx("%s: Cannot resolve network address: %s", addr,
+		       gai_strerror(rc));
+		goto out;
+	}
+
+	for (ai = result; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		rc = errno;
+		close(fd);
+		fd = -1;
+		errno = rc;
+	}
+	freeaddrinfo(result);
+	if (fd < 0)
+		mwarn("%s: Cannot connect", addr);
+
+out:
+	free(host);
+
+	return fd;
+}
+
 #define PIPE_READ	0
 #define PIPE_WRITE	1
 
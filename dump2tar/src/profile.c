@@ -0,0 +1,172 @@
+/*
+ * dump2tar - tool to dump files and command output into a tar archive
+ *
+ * Profile files with read times of previous runs
+ *
+ * A profile file records how long it took to read each file or command
+ * output that was not read almost instantly. The read times of a previous
+ * run are used to estimate the cost of jobs when scheduling them.
+ *
+ * Each line of a profile file has the format "MSEC NAME".
+ *
+ * Copyright IBM Corp. 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lib/util_hash.h"
+
+#include "misc.h"
+#include "profile.h"
+
+struct profile {
+	char *filename;
+	/* Read times of the previous run - read-only after opening */
+	struct util_hash *prev;
+	/* Read times of the current run */
+	struct util_hash *curr;
+};
+
+/* Read entries of profile file @filename into @pf. A missing file is treated
+ * as empty profile. Return %EXIT_OK on success, %EXIT_RUNTIME otherwise. */
+static int read_profile(struct profile *pf, const char *filename)
+{
+	unsigned long lineno = 0;
+	size_t line_size = 0;
+	char *line = NULL;
+	int rc = EXIT_OK, off;
+	long msec;
+	FILE *fd;
+
+	fd = fopen(filename, "r");
+	if (!fd) {
+		if (errno == ENOENT)
+			return EXIT_OK;
+		mwarn("%s: Cannot open profile file", filename);
+		return EXIT_RUNTIME;
+	}
+
+	while (getline(&line, &line_size, fd) != -1) {
+		lineno++;
+		chomp(line, "\n");
+		if (sscanf(line, "%ld %n", &msec, &off) != 1 ||
+		    line[off] == 0 || msec < 0) {
+			mwarnx("%s:%lu: Invalid profile file entry", filename,
+			       lineno);
+			rc = EXIT_RUNTIME;
+			break;
+		}
+		util_hash_set_str(pf->prev, &line[off],
+				  (void *) (uintptr_t) (msec + 1));
+	}
+
+	if (rc == EXIT_OK && ferror(fd)) {
+		mwarn("%s: Cannot read profile file", filename);
+		rc = EXIT_RUNTIME;
+	}
+	free(line);
+	fclose(fd);
+
+	return rc;
+}
+
+/* Write all entries of the current run in @pf to a new profile file that
+ * replaces the previous one. Return %EXIT_OK on success, %EXIT_RUNTIME
+ * otherwise. */
+static int write_profile(struct profile *pf)
+{
+	struct util_hash_iter it;
+	char *tmpname;
+	int fd, rc = EXIT_OK;
+	FILE *file;
+
+	tmpname = masprintf("%s.XXXXXX", pf->filename);
+	fd = mkstemp(tmpname);
+	if (fd < 0 || !(file = fdopen(fd, "w"))) {
+		mwarn("%s: Cannot create profile file", tmpname);
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmpname);
+		}
+		free(tmpname);
+		return EXIT_RUNTIME;
+	}
+
+	util_hash_iterate(pf->curr, &it) {
+		fprintf(file, "%ld %s\n", (long) (uintptr_t) it.value - 1,
+			it.key_str);
+	}
+
+	if (fclose(file) != 0) {
+		mwarn("%s: Cannot write profile file", tmpname);
+		rc = EXIT_RUNTIME;
+	} else if (rename(tmpname, pf->filename) != 0) {
+		mwarn("%s: Cannot replace profile file", pf->filename);
+		rc = EXIT_RUNTIME;
+	}
+	if (rc)
+		unlink(tmpname);
+	free(tmpname);
+
+	return rc;
+}
+
+/* Open profile file @filename. Return a pointer to the profile on success,
+ * %NULL otherwise. */
+struct profile *profile_open(const char *filename)
+{
+	struct profile *pf;
+
+	pf = mcalloc(sizeof(struct profile), 1);
+	pf->filename = mstrdup(filename);
+	pf->prev = util_hash_new(UTIL_HASH_KEY_STR, 0);
+	pf->curr = util_hash_new(UTIL_HASH_KEY_STR, 0);
+	if (read_profile(pf, filename)) {
+		profile_close(pf, false);
+		return NULL;
+	}
+
+	return pf;
+}
+
+/* Return the number of milliseconds it took to read @name in the previous
+ * run, or -1 if this is unknown. May be called concurrently. */
+long profile_get(struct profile *pf, const char *name)
+{
+	return (long) (uintptr_t) util_hash_get_str(pf->prev, name) - 1;
+}
+
+/* Record that it took @msec milliseconds to read @name in the current run.
+ * Must not be called concurrently for the same profile. */
+void profile_update(struct profile *pf, const char *name, long msec)
+{
+	/* Such names cannot be represented in a profile file */
+	if (msec < PROFILE_MIN_MSEC || strchr(name, '\n'))
+		return;
+	util_hash_set_str(pf->curr, name, (void *) (uintptr_t) (msec + 1));
+}
+
+/* Release all resources associated with @pf. If @save is %true, write entries
+ * of the current run to the profile file first. Return %EXIT_OK on success,
+ * %EXIT_RUNTIME otherwise. */
+int profile_close(struct profile *pf, bool save)
+{
+	int rc = EXIT_OK;
+
+	if (save)
+		rc = write_profile(pf);
+
+	util_hash_free(pf->prev, NULL);
+	util_hash_free(pf->curr, NULL);
+	free(pf->filename);
+	free(pf);
+
+	return rc;
+}
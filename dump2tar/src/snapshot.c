@@ -0,0 +1,284 @@
+/*
+ * dump2tar - tool to dump files and command output into a tar archive
+ *
+ * Snapshot files for incremental archives
+ *
+ * A snapshot file records the content hash and size of all entries that
+ * were added to an archive. When creating the next archive using the same
+ * snapshot file, entries with unchanged content are omitted. Content is
+ * compared instead of modification times because files in procfs, sysfs
+ * and debugfs as well as command output do not provide meaningful
+ * modification times.
+ *
+ * Each line of a snapshot file has the format "HASH SIZE NAME" with HASH
+ * being a 64 bit FNV-1a hash of the entry content in hexadecimal notation.
+ *
+ * Copyright IBM Corp. 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "misc.h"
+#include "snapshot.h"
+
+/* Number of hash buckets for snapshot entries */
+#define SNAPSHOT_HASH_SIZE	4096
+
+/* Prime of the 64 bit FNV-1a hash function. SNAPSHOT_HASH_INIT is the
+ * corresponding offset basis. */
+#define FNV_PRIME		0x100000001b3ULL
+
+struct snapshot_entry {
+	struct snapshot_entry *next;
+	uint64_t hash;
+	size_t size;
+	bool current;	/* Entry was part of the current archive */
+	char name[];
+};
+
+struct snapshot {
+	char *filename;
+	struct snapshot_entry *hash[SNAPSHOT_HASH_SIZE];
+};
+
+/* Continue FNV-1a hash @hash with @len bytes at @addr */
+static uint64_t fnv1a(uint64_t hash, const void *addr, size_t len)
+{
+	const unsigned char *c = addr;
+
+	while (len-- > 0) {
+		hash ^= *c++;
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/* Return the hash bucket for @name in @ss */
+static struct snapshot_entry **get_bucket(struct snapshot *ss,
+					  const char *name)
+{
+	uint64_t hash = fnv1a(SNAPSHOT_HASH_INIT, name, strlen(name));
+
+	return &ss->hash[hash % SNAPSHOT_HASH_SIZE];
+}
+
+/* Return the entry for @name in @ss or %NULL if there is none */
+static struct snapshot_entry *find_entry(struct snapshot *ss, const char *name)
+{
+	struct snapshot_entry *entry;
+
+	for (entry = *get_bucket(ss, name); entry; entry = entry->next) {
+		if (strcmp(entry->name, name) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/* Add an entry for @name to @ss */
+static struct snapshot_entry *add_entry(struct snapshot *ss, const char *name,
+					uint64_t hash, size_t size)
+{
+	struct snapshot_entry **bucket = get_bucket(ss, name), *entry;
+
+	entry = mmalloc(sizeof(struct snapshot_entry) + strlen(name) + 1);
+	strcpy(entry->name, name);
+	entry->hash = hash;
+	entry->size = size;
+	entry->next = *bucket;
+	*bucket = entry;
+
+	return entry;
+}
+
+/* Read entries of snapshot file @filename into @ss. A missing file is treated
+ * as empty snapshot. Return %EXIT_OK on success, %EXIT_RUNTIME otherwise. */
+static int read_snapshot(struct snapshot *ss, const char *filename)
+{
+	size_t line_size = 0, size;
+	unsigned long lineno = 0;
+	char *line = NULL;
+	int rc = EXIT_OK, off;
+	uint64_t hash;
+	FILE *fd;
+
+	fd = fopen(filename, "r");
+	if (!fd) {
+		if (errno == ENOENT)
+			return EXIT_OK;
+		mwarn("%s: Cannot open snapshot file", filename);
+		return EXIT_RUNTIME;
+	}
+
+	while (getline(&line, &line_size, fd) != -1) {
+		lineno++;
+		chomp(line, "\n");
+		if (sscanf(line, "%" SCNx64 " %zu %n", &hash, &size,
+			   &off) != 2 || line[off] == 0) {
+			mwarnx("%s:%lu: Invalid snapshot file entry", filename,
+			       lineno);
+			rc = EXIT_RUNTIME;
+			break;
+		}
+		if (!find_entry(ss, &line[off]))
+			add_entry(ss, &line[off], hash, size);
+	}
+
+	if (rc == EXIT_OK && ferror(fd)) {
+		mwarn("%s: Cannot read snapshot file", filename);
+		rc = EXIT_RUNTIME;
+	}
+	free(line);
+	fclose(fd);
+
+	return rc;
+}
+
+/* Write all entries of the current archive in @ss to a new snapshot file
+ * that replaces the previous one. Return %EXIT_OK on success, %EXIT_RUNTIME
+ * otherwise. */
+static int write_snapshot(struct snapshot *ss)
+{
+	struct snapshot_entry *entry;
+	char *tmpname;
+	int fd, rc = EXIT_OK;
+	unsigned int i;
+	FILE *file;
+
+	tmpname = masprintf("%s.XXXXXX", ss->filename);
+	fd = mkstemp(tmpname);
+	if (fd < 0 || !(file = fdopen(fd, "w"))) {
+		mwarn("%s: Cannot create snapshot file", tmpname);
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmpname);
+		}
+		free(tmpname);
+		return EXIT_RUNTIME;
+	}
+
+	for (i = 0; i < SNAPSHOT_HASH_SIZE; i++) {
+		for (entry = ss->hash[i]; entry; entry = entry->next) {
+			if (!entry->current)
+				continue;
+			fprintf(file, "%016" PRIx64 " %zu %s\n", entry->hash,
+				entry->size, entry->name);
+		}
+	}
+
+	if (fclose(file) != 0) {
+		mwarn("%s: Cannot write snapshot file", tmpname);
+		rc = EXIT_RUNTIME;
+	} else if (rename(tmpname, ss->filename) != 0) {
+		mwarn("%s: Cannot replace snapshot file", ss->filename);
+		rc = EXIT_RUNTIME;
+	}
+	if (rc)
+		unlink(tmpname);
+	free(tmpname);
+
+	return rc;
+}
+
+/* Open snapshot file @filename for use with an incremental archive. Return
+ * a pointer to the snapshot on success, %NULL otherwise. */
+struct snapshot *snapshot_open(const char *filename)
+{
+	struct snapshot *ss;
+
+	ss = mcalloc(sizeof(struct snapshot), 1);
+	ss->filename = mstrdup(filename);
+	if (read_snapshot(ss, filename)) {
+		snapshot_close(ss, false);
+		return NULL;
+	}
+
+	return ss;
+}
+
+/* Callback for hashing chunks of buffer data */
+static int hash_cb(void *data, void *addr, size_t len)
+{
+	uint64_t *hash = data;
+
+	*hash = fnv1a(*hash, addr, len);
+
+	return 0;
+}
+
+/* Continue content hash calculation in @hash with @len bytes at @addr. @hash
+ * must be initialized to SNAPSHOT_HASH_INIT before the first call. */
+void snapshot_hash_data(uint64_t *hash, const void *addr, size_t len)
+{
+	*hash = fnv1a(*hash, addr, len);
+}
+
+/* Continue content hash calculation in @hash with the data in @buffer. @hash
+ * must be initialized to SNAPSHOT_HASH_INIT before the first call. Return
+ * %EXIT_OK on success, %EXIT_RUNTIME otherwise. */
+int snapshot_hash_buffer(struct buffer *buffer, uint64_t *hash)
+{
+	return buffer_iterate(buffer, hash_cb, hash);
+}
+
+/* Record that entry @name with content hash @hash and @size bytes of data is
+ * part of the current archive. Return %true if the previous snapshot
+ * contained @name with the same content, %false otherwise. Must not be
+ * called concurrently for the same snapshot. */
+bool snapshot_update(struct snapshot *ss, const char *name, uint64_t hash,
+		     size_t size)
+{
+	struct snapshot_entry *entry;
+	bool unchanged;
+
+	/* Such names cannot be represented in a snapshot file */
+	if (strchr(name, '\n'))
+		return false;
+
+	entry = find_entry(ss, name);
+	if (!entry) {
+		entry = add_entry(ss, name, hash, size);
+		entry->current = true;
+		return false;
+	}
+
+	unchanged = (entry->hash == hash && entry->size == size);
+	entry->hash = hash;
+	entry->size = size;
+	entry->current = true;
+
+	return unchanged;
+}
+
+/* Release all resources associated with @ss. If @save is %true, write entries
+ * of the current archive to the snapshot file first. Return %EXIT_OK on
+ * success, %EXIT_RUNTIME otherwise. */
+int snapshot_close(struct snapshot *ss, bool save)
+{
+	struct snapshot_entry *entry, *next;
+	int rc = EXIT_OK;
+	unsigned int i;
+
+	if (save)
+		rc = write_snapshot(ss);
+
+	for (i = 0; i < SNAPSHOT_HASH_SIZE; i++) {
+		for (entry = ss->hash[i]; entry; entry = next) {
+			next = entry->next;
+			free(entry);
+		}
+	}
+	free(ss->filename);
+	free(ss);
+
+	return rc;
+}
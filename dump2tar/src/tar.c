@@ -270,3 +270,11 @@ int tar_emit_file_from_data(char *filename, char *link, size_t len,
 
 	return rc;
 }
+
+/* Emit zero bytes via @emit_cb to pad file content of @len bytes that was
+ * written without using the tar_emit_file_* functions to a multiple of
+ * BLOCKSIZE. @data is passed through to the callback for arbitrary use. */
+int tar_emit_padding(size_t len, emit_cb_t emit_cb, void *data)
+{
+	return emit_padding(emit_cb, data, len);
+}
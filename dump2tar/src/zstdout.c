@@ -0,0 +1,163 @@
+/*
+ * dump2tar - tool to dump files and command output into a tar archive
+ *
+ * Zstandard compression of the output stream
+ *
+ * Data is compressed into a single zstd frame. When more than one thread
+ * is requested, compression is performed by the worker threads of the zstd
+ * library while the calling thread continues to provide data. Long distance
+ * matching finds repeated content across files, e.g. in similar log files or
+ * duplicated sysfs data.
+ *
+ * Copyright IBM Corp. 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <zstd.h>
+
+#include "misc.h"
+#include "zstdout.h"
+
+/* Window size used for long distance matching (log2 bytes). 128 MiB is the
+ * largest window that zstd decompresses without additional options. */
+#define ZSTD_LONG_WINDOW_LOG	27
+
+struct zstdout {
+	int fd;
+	ZSTD_CCtx *cctx;
+	char *out;		/* Compressed data */
+	size_t out_size;
+	size_t out_len;
+	size_t out_off;		/* Number of compressed bytes written */
+};
+
+/* Write pending compressed data of @zs to the output file. The thread may
+ * only be canceled while writing. Return 0 on success, -1 on error with
+ * errno set. */
+static int flush_out(struct zstdout *zs, int cancel_state)
+{
+	ssize_t w;
+
+	while (zs->out_off < zs->out_len) {
+		pthread_setcancelstate(cancel_state, NULL);
+		w = write(zs->fd, zs->out + zs->out_off,
+			  zs->out_len - zs->out_off);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		if (w < 0)
+			return -1;
+		zs->out_off += w;
+	}
+	zs->out_len = 0;
+	zs->out_off = 0;
+
+	return 0;
+}
+
+/* Pass @in to the compressor using end directive @end and write the
+ * resulting data. Return 0 on success, -1 on error with errno set. */
+static int compress_stream(struct zstdout *zs, ZSTD_inBuffer *in,
+			   ZSTD_EndDirective end, int cancel_state)
+{
+	ZSTD_outBuffer out;
+	size_t rc;
+
+	do {
+		if (flush_out(zs, cancel_state))
+			return -1;
+		out.dst = zs->out;
+		out.size = zs->out_size;
+		out.pos = 0;
+		rc = ZSTD_compressStream2(zs->cctx, &out, in, end);
+		zs->out_len = out.pos;
+		if (ZSTD_isError(rc)) {
+			mwarnx("Compression failed: %s", ZSTD_getErrorName(rc));
+			errno = EIO;
+			return -1;
+		}
+	} while (in->pos < in->size || (end == ZSTD_e_end && rc > 0));
+
+	return flush_out(zs, cancel_state);
+}
+
+/* Open a zstd output stream writing to file descriptor @fd using compression
+ * level @level and up to @threads compression threads. Return a pointer to
+ * the stream on success, %NULL otherwise. */
+struct zstdout *zstdout_open(int fd, int level, long threads)
+{
+	struct zstdout *zs;
+	size_t rc;
+
+	zs = mcalloc(sizeof(struct zstdout), 1);
+	zs->fd = fd;
+	zs->cctx = ZSTD_createCCtx();
+	if (!zs->cctx) {
+		free(zs);
+		return NULL;
+	}
+	rc = ZSTD_CCtx_setParameter(zs->cctx, ZSTD_c_compressionLevel, level);
+	if (ZSTD_isError(rc)) {
+		mwarnx("Invalid compression level %d: %s", level,
+		       ZSTD_getErrorName(rc));
+		zstdout_close(zs);
+		return NULL;
+	}
+	if (threads > 1) {
+		rc = ZSTD_CCtx_setParameter(zs->cctx, ZSTD_c_nbWorkers,
+					    threads);
+		/* Library might have been built without thread support */
+		if (ZSTD_isError(rc))
+			DBG("cannot use %ld compression threads: %s", threads,
+			    ZSTD_getErrorName(rc));
+	}
+	rc = ZSTD_CCtx_setParameter(zs->cctx, ZSTD_c_enableLongDistanceMatching,
+				    1);
+	if (!ZSTD_isError(rc))
+		rc = ZSTD_CCtx_setParameter(zs->cctx, ZSTD_c_windowLog,
+					    ZSTD_LONG_WINDOW_LOG);
+	if (ZSTD_isError(rc))
+		DBG("cannot use long distance matching: %s",
+		    ZSTD_getErrorName(rc));
+	zs->out_size = ZSTD_CStreamOutSize();
+	zs->out = mmalloc(zs->out_size);
+
+	return zs;
+}
+
+/* Write @len bytes at @ptr to zstd output stream @zs. Must not be called
+ * concurrently for the same stream. Return 0 on success, -1 on error with
+ * errno set. */
+int zstdout_write(struct zstdout *zs, const char *ptr, size_t len)
+{
+	ZSTD_inBuffer in = { ptr, len, 0 };
+	int cancel_state, rc;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+	rc = compress_stream(zs, &in, ZSTD_e_continue, cancel_state);
+	pthread_setcancelstate(cancel_state, NULL);
+
+	return rc;
+}
+
+/* Write all remaining data of zstd output stream @zs and release all
+ * associated resources. The output file descriptor is not closed. Return 0
+ * on success, -1 on error with errno set. */
+int zstdout_close(struct zstdout *zs)
+{
+	ZSTD_inBuffer in = { NULL, 0, 0 };
+	int cancel_state, rc = 0;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+	if (zs->out)
+		rc = compress_stream(zs, &in, ZSTD_e_end, cancel_state);
+	ZSTD_freeCCtx(zs->cctx);
+	free(zs->out);
+	free(zs);
+	pthread_setcancelstate(cancel_state, NULL);
+
+	return rc;
+}
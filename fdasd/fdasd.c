@@ -10,6 +10,7 @@
 #include <getopt.h>
 #include <stdio.h>
 #include <sys/sysmacros.h>
+#include <sys/wait.h>
 
 #include "lib/dasd_base.h"
 #include "lib/dasd_sys.h"
@@ -125,8 +126,9 @@ static int get_part_dsname_by_type(unsigned int type, char **dsname)
 
 static const struct util_prg prg = {
 	.desc = "Manage partitions on DASD volumes.\n"
-		"DEVICE is the node of the device (e.g. '/dev/dasda').",
-	.args = "DEVICE",
+		"DEVICE is the node of the device (e.g. '/dev/dasda'). More\n"
+		"than one DEVICE can be partitioned with 'auto' or 'config'.",
+	.args = "DEVICE...",
 	.copyright_vec = {
 		{
 			.owner = "IBM Corp.",
@@ -678,10 +680,9 @@ static void fdasd_parse_options(fdasd_anchor_t *anc,
 	if (optind >= argc)
 		fdasd_error(anc, parser_failed,
 			    "No device specified.\n");
-	if (optind + 1 < argc)
-		fdasd_error(anc, parser_failed,
-			    "More than one device specified.\n");
 	options->device = argv[optind];
+	options->devices = &argv[optind];
+	options->device_count = argc - optind;
 }
 
 static int gettoken(char *str, char *ch, char *token[], int max)
@@ -1038,6 +1039,86 @@ static void fdasd_verify_options(fdasd_anchor_t *anc)
 			    "Option 'config' cannot be used with"
 			    " 'table'.\n");
 	}
+
+	if (options.device_count > 1) {
+		if (!anc->auto_partition && !options.conffile) {
+			fdasd_error(anc, parser_failed,
+				    "Option 'auto' or 'config' required when"
+				    " specifying more than one device.\n");
+		}
+		if (options.volser) {
+			fdasd_error(anc, parser_failed,
+				    "Option 'label' cannot be used with"
+				    " more than one device.\n");
+		}
+	}
+}
+
+/*
+ * Partitions each of the specified devices in a separate child process.
+ * The children return to partition their device, the parent waits for
+ * all children and exits with a non-zero code if any of them failed.
+ */
+static void fdasd_fork_devices(fdasd_anchor_t *anc)
+{
+	char err_str[ERROR_STRING_SIZE];
+	struct stat sbuf, *sbufs;
+	int i, j, n, status, rc = 0;
+	pid_t *pids;
+
+	pids = malloc(options.device_count * sizeof(pid_t));
+	sbufs = calloc(options.device_count, sizeof(struct stat));
+	if (!pids || !sbufs)
+		fdasd_error(anc, malloc_failed, "Cannot allocate process list.\n");
+
+	/* Concurrent processes must not partition the same device */
+	for (i = 0; i < options.device_count; i++) {
+		if (stat(options.devices[i], &sbuf) != 0)
+			continue;
+		for (j = 0; j < i; j++) {
+			if (S_ISBLK(sbuf.st_mode) &&
+			    S_ISBLK(sbufs[j].st_mode) &&
+			    sbufs[j].st_rdev == sbuf.st_rdev) {
+				snprintf(err_str, ERROR_STRING_SIZE,
+					 "Device '%s' specified more than "
+					 "once.\n", options.devices[i]);
+				fdasd_error(anc, parser_failed, err_str);
+			}
+		}
+		sbufs[i] = sbuf;
+	}
+	free(sbufs);
+
+	fflush(stdout);
+	for (i = 0; i < options.device_count; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			fprintf(stderr, "%s Cannot start process for %s: %s\n",
+				FDASD_ERROR, options.devices[i],
+				strerror(errno));
+			rc = 1;
+			break;
+		}
+		if (pids[i] == 0) {
+			free(pids);
+			setvbuf(stdout, NULL, _IOLBF, 0);
+			options.device = options.devices[i];
+			options.device_count = 1;
+			return;
+		}
+	}
+
+	n = i;
+	for (i = 0; i < n; i++) {
+		if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status) != 0) {
+			fprintf(stderr, "%s Partitioning of %s failed\n",
+				FDASD_ERROR, options.devices[i]);
+			rc = 1;
+		}
+	}
+	free(pids);
+	fdasd_exit(anc, rc);
 }
 
 /*
@@ -2948,8 +3029,10 @@ int main(int argc, char *argv[])
 	fdasd_initialize_anchor(&anchor);
 
 	fdasd_parse_options(&anchor, &options, argc, argv);
-	fdasd_verify_device(&anchor, options.device);
 	fdasd_verify_options(&anchor);
+	if (options.device_count > 1)
+		fdasd_fork_devices(&anchor);
+	fdasd_verify_device(&anchor, options.device);
 	fdasd_get_geometry(&anchor);
 	fdasd_check_disk_access(&anchor);
 
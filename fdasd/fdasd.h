@@ -58,12 +58,16 @@ struct fdasd_options {
 	char *device;
 	char *volser;
 	char *conffile;
+	char **devices;
+	int device_count;
 };
 
 static struct fdasd_options options = {
-	NULL,		/* device   */
-	NULL,		/* volser   */
-	NULL,		/* conffile */
+	NULL,		/* device       */
+	NULL,		/* volser       */
+	NULL,		/* conffile     */
+	NULL,		/* devices      */
+	0,		/* device_count */
 };
 
 typedef struct partition_info {
@@ -28,44 +28,13 @@ enum {
 };
 
 static gint log_level = LOG_LEVEL_CRITICAL;
-static gchar *tmp_dir;
-
-static void rmdir_recursive(gchar *dir_path, GError **err)
-{
-	const gchar *file = NULL;
-	g_autoptr(GDir) d = NULL;
-
-	if (!dir_path)
-		return;
-
-	d = g_dir_open(dir_path, 0, err);
-	if (!d) {
-		g_set_error(err, G_FILE_ERROR,
-			    (gint)g_file_error_from_errno(errno),
-			    _("Failed to open directory '%s': %s"), dir_path,
-			    g_strerror(errno));
-		return;
-	}
-
-	while ((file = g_dir_read_name(d)) != NULL) {
-		g_autofree gchar *file_path =
-			g_build_filename(dir_path, file, NULL);
-		/* ignore error */
-		(void)g_unlink(file_path);
-	}
-
-	if (g_rmdir(dir_path) != 0) {
-		g_set_error(err, G_FILE_ERROR,
-			    (gint)g_file_error_from_errno(errno),
-			    _("Failed to remove directory '%s': %s"), dir_path,
-			    g_strerror(errno));
-		return;
-	}
-}
+/* image that is removed if genprotimg fails */
+static const gchar *image_path;
 
 static void sig_term_handler(int signal G_GNUC_UNUSED)
 {
-	rmdir_recursive(tmp_dir, NULL);
+	if (image_path)
+		(void)g_unlink(image_path);
 	exit(EXIT_FAILURE);
 }
 
@@ -139,20 +108,14 @@ gint main(gint argc, gchar *argv[])
 	/* set new log level */
 	log_level = args->log_level;
 
-	/* if the user has not specified a temporary directory let's
-	 * create one
+	/* allocate and initialize ``pv_img`` data structure. This
+	 * creates the image file, the components are written to it
+	 * while they are added.
 	 */
-	if (!args->tmp_dir) {
-		tmp_dir = g_dir_make_tmp("genprotimg-XXXXXX", &err);
-		if (!tmp_dir)
-			goto error;
-		args->tmp_dir = g_strdup(tmp_dir);
-	}
-
-	/* allocate and initialize ``pv_img`` data structure */
 	img = pv_img_new(args, GENPROTIMG_STAGE3A_PATH, &err);
 	if (!img)
 		goto error;
+	image_path = args->output_path;
 
 	/* add user components: `args->comps` must be sorted by the
 	 * component type => by memory address
@@ -167,8 +130,24 @@ gint main(gint argc, gchar *argv[])
 	if (pv_img_finalize(img, GENPROTIMG_STAGE3B_PATH, &err) < 0)
 		goto error;
 
-	if (pv_img_write(img, args->output_path, &err) < 0)
+	if (pv_img_write(img, &err) < 0)
 		goto error;
+	image_path = NULL;
+
+	/* batch mode: the images for the other targets only differ in
+	 * the PV header
+	 */
+	for (GSList *iterator = args->targets; iterator; iterator = iterator->next) {
+		const PvTarget *target = iterator->data;
+
+		if (pv_img_set_target(img, args, target, &err) < 0)
+			goto error;
+		image_path = target->output_path;
+
+		if (pv_img_write(img, &err) < 0)
+			goto error;
+		image_path = NULL;
+	}
 
 	ret = EXIT_SUCCESS;
 
@@ -178,9 +157,10 @@ error:
 		fputc('\n', stderr);
 		g_clear_error(&err);
 	}
-	rmdir_recursive(tmp_dir, NULL);
+	/* don't leave an incomplete image behind */
+	if (ret != EXIT_SUCCESS && image_path)
+		(void)g_unlink(image_path);
 	remove_signal_handler(signals, G_N_ELEMENTS(signals));
-	g_free(tmp_dir);
 	g_clear_pointer(&img, pv_img_free);
 	g_clear_pointer(&args, pv_args_free);
 	exit(ret);
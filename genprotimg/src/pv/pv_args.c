@@ -51,6 +51,71 @@ static gint pv_arg_has_type(gconstpointer arg, gconstpointer type)
 	return 1;
 }
 
+/* Each line of the batch file specifies an image by its output file
+ * followed by its host-key documents. Empty lines and lines starting with
+ * '#' are ignored. The first image is used as if it was specified by
+ * '--output' and '--host-key-document', the others are stored in
+ * @args->targets.
+ */
+static gint pv_args_load_batch(PvArgs *args, GError **err)
+{
+	g_autofree gchar *content = NULL;
+	g_auto(GStrv) lines = NULL;
+
+	if (args->output_path || args->host_keys) {
+		g_set_error(err, PV_PARSE_ERROR, PV_PARSE_ERROR_SYNTAX,
+			    _("Option '--batch' cannot be combined with '--output' or '--host-key-document'"));
+		return -1;
+	}
+
+	if (!g_file_get_contents(args->batch_path, &content, NULL, err))
+		return -1;
+
+	lines = g_strsplit(content, "\n", -1);
+	for (guint i = 0; lines[i]; i++) {
+		const gchar *line = g_strstrip(lines[i]);
+		g_auto(GStrv) fields = NULL;
+		gint count;
+
+		if (line[0] == '\0' || line[0] == '#')
+			continue;
+
+		/* allow quoting of file names */
+		if (!g_shell_parse_argv(line, &count, &fields, err)) {
+			g_prefix_error(err, _("'%s', line %u: "),
+				       args->batch_path, i + 1);
+			return -1;
+		}
+
+		if (count < 2) {
+			g_set_error(err, PV_PARSE_ERROR, PV_PARSE_ERROR_SYNTAX,
+				    _("'%s', line %u: An output file and at least one host-key document are required"),
+				    args->batch_path, i + 1);
+			return -1;
+		}
+
+		if (!args->output_path) {
+			args->output_path = g_strdup(fields[0]);
+			args->host_keys = g_strdupv(&fields[1]);
+			continue;
+		}
+
+		args->targets = g_slist_append(
+			args->targets,
+			pv_target_new(fields[0],
+				      (const gchar *const *)&fields[1]));
+	}
+
+	if (!args->output_path) {
+		g_set_error(err, PV_PARSE_ERROR, PR_PARSE_ERROR_MISSING_ARGUMENT,
+			    _("'%s' does not specify any image"),
+			    args->batch_path);
+		return -1;
+	}
+
+	return 0;
+}
+
 static gint pv_args_set_defaults(PvArgs *args, GError **err G_GNUC_UNUSED)
 {
 	if (!args->psw_addr)
@@ -150,6 +215,10 @@ static gboolean cb_set_string_option(const gchar *option, const gchar *value,
 
 	if (g_str_equal(option, "--root-ca"))
 		args_option = &args->root_ca_path;
+	if (g_str_equal(option, "--crl-cache-dir"))
+		args_option = &args->crl_cache_dir;
+	if (g_str_equal(option, "--batch"))
+		args_option = &args->batch_path;
 	if (g_str_equal(option, "-o") || g_str_equal(option, "--output"))
 		args_option = &args->output_path;
 	if (g_str_equal(option, "--x-comp-key"))
@@ -239,6 +308,17 @@ gint pv_args_parse_options(PvArgs *args, gint *argc, gchar **argv[],
 		  .arg_data = cb_set_string_option,
 		  .description = _("Set FILE as the output file."),
 		  .arg_description = _("FILE") },
+		{ .long_name = "batch",
+		  .short_name = 0,
+		  .flags = G_OPTION_FLAG_FILENAME,
+		  .arg = G_OPTION_ARG_CALLBACK,
+		  .arg_data = cb_set_string_option,
+		  .description = _(
+			  "Create one image per line of FILE, each line\n" INDENT
+			  "lists the output file and its host-key\n" INDENT
+			  "documents. The components are encrypted only\n" INDENT
+			  "once for all images (optional)."),
+		  .arg_description = _("FILE") },
 		{ .long_name = "image",
 		  .short_name = 'i',
 		  .flags = G_OPTION_FLAG_FILENAME,
@@ -276,8 +356,19 @@ gint pv_args_parse_options(PvArgs *args, gint *argc, gchar **argv[],
 		  .flags = G_OPTION_FLAG_NONE,
 		  .arg = G_OPTION_ARG_NONE,
 		  .arg_data = &args->offline,
-		  .description = _("Don't download CRLs (optional)."),
+		  .description = _("Don't download CRLs, use only cached CRLs\n" INDENT
+				   "(optional)."),
 		  .arg_description = NULL },
+		{ .long_name = "crl-cache-dir",
+		  .short_name = 0,
+		  .flags = G_OPTION_FLAG_FILENAME,
+		  .arg = G_OPTION_ARG_CALLBACK,
+		  .arg_data = cb_set_string_option,
+		  .description = _(
+			  "Cache downloaded CRLs in DIR until their next\n" INDENT
+			  "update is due (optional). The default is\n" INDENT
+			  "'~/.cache/genprotimg/crls'."),
+		  .arg_description = _("DIR") },
 		{ .long_name = "root-ca",
 		  .short_name = 0,
 		  .flags = G_OPTION_FLAG_FILENAME,
@@ -399,6 +490,9 @@ gint pv_args_parse_options(PvArgs *args, gint *argc, gchar **argv[],
 		exit(EXIT_SUCCESS);
 	}
 
+	if (args->batch_path && pv_args_load_batch(args, err) < 0)
+		return -1;
+
 	if (pv_args_set_defaults(args, err) < 0)
 		return -1;
 
@@ -426,16 +520,38 @@ void pv_args_free(PvArgs *args)
 	g_free(args->gcm_iv_path);
 	g_free(args->root_ca_path);
 	g_strfreev(args->crl_paths);
+	g_free(args->crl_cache_dir);
 	g_strfreev(args->untrusted_cert_paths);
 	g_strfreev(args->host_keys);
 	g_free(args->xts_key_path);
 	g_slist_free_full(args->comps, (GDestroyNotify)pv_arg_free);
 	g_ptr_array_free(args->unused_values, TRUE);
 	g_free(args->output_path);
-	g_free(args->tmp_dir);
+	g_free(args->batch_path);
+	g_slist_free_full(args->targets, (GDestroyNotify)pv_target_free);
 	g_free(args);
 }
 
+PvTarget *pv_target_new(const gchar *output_path,
+			const gchar *const *host_keys)
+{
+	g_autoptr(PvTarget) ret = g_new0(PvTarget, 1);
+
+	ret->output_path = g_strdup(output_path);
+	ret->host_keys = g_strdupv((gchar **)host_keys);
+	return g_steal_pointer(&ret);
+}
+
+void pv_target_free(PvTarget *target)
+{
+	if (!target)
+		return;
+
+	g_free(target->output_path);
+	g_strfreev(target->host_keys);
+	g_free(target);
+}
+
 void pv_arg_free(PvArg *arg)
 {
 	if (!arg)
@@ -22,6 +22,16 @@ typedef struct pv_arg {
 PvArg *pv_arg_new(PvComponentType type, const gchar *path);
 void pv_arg_free(PvArg *arg);
 
+/* Additional image of the batch mode */
+typedef struct pv_target {
+	gchar *output_path;
+	gchar **host_keys;
+} PvTarget;
+
+PvTarget *pv_target_new(const gchar *output_path,
+			const gchar *const *host_keys);
+void pv_target_free(PvTarget *target);
+
 typedef struct {
 	gint log_level;
 	gint no_verify;
@@ -40,10 +50,12 @@ typedef struct {
 			      */
 	gchar **untrusted_cert_paths;
 	gchar **crl_paths;
+	gchar *crl_cache_dir; /* directory used for caching downloaded CRLs */
 	gchar *xts_key_path;
 	GSList *comps;
 	gchar *output_path;
-	gchar *tmp_dir;
+	gchar *batch_path;
+	GSList *targets; /* further images of the batch mode */
 	GPtrArray *unused_values;
 } PvArgs;
 
@@ -54,6 +66,7 @@ gint pv_args_parse_options(PvArgs *args, gint *argc, gchar **argv[],
 			   GError **err);
 
 WRAPPED_G_DEFINE_AUTOPTR_CLEANUP_FUNC(PvArg, pv_arg_free)
+WRAPPED_G_DEFINE_AUTOPTR_CLEANUP_FUNC(PvTarget, pv_target_free)
 WRAPPED_G_DEFINE_AUTOPTR_CLEANUP_FUNC(PvArgs, pv_args_free)
 
 #endif
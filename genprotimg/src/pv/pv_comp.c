@@ -155,8 +155,67 @@ gboolean pv_component_is_stage3b(const PvComponent *component)
 	return pv_component_type(component) == PV_COMP_TYPE_STAGE3B;
 }
 
-gint pv_component_align_and_encrypt(PvComponent *component, const gchar *tmp_path,
-				    void *opaque, GError **err)
+/* Writes the page aligned buffer of @component to its address in @fd_out
+ * and updates @pld_ctx with its pages
+ */
+static gint pv_component_write_buf(const PvComponent *component, gint fd_out,
+				   const gchar *path_out, EVP_MD_CTX *pld_ctx,
+				   GError **err)
+{
+	const Buffer *buf = component->buf;
+
+	g_assert(IS_PAGE_ALIGNED(buf->size) && buf->size != 0);
+
+	if (EVP_DigestUpdate(pld_ctx, buf->data, buf->size) != 1) {
+		g_set_error(err, PV_CRYPTO_ERROR, PV_CRYPTO_ERROR_INTERNAL,
+			    _("EVP_DigestUpdate failed"));
+		return -1;
+	}
+
+	if (file_pwrite(fd_out, buf->data, buf->size,
+			pv_component_get_src_addr(component), err) < 0) {
+		g_prefix_error(err, _("Failed to write file '%s': "), path_out);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Pads, encrypts (if @parms is given) and writes the file of @component to
+ * its address in @fd_out and updates @pld_ctx with its pages. The input file
+ * is read only once.
+ */
+static gint pv_component_write_file(PvComponent *component,
+				    const struct cipher_parms *parms,
+				    gint fd_out, const gchar *path_out,
+				    EVP_MD_CTX *pld_ctx, GError **err)
+{
+	CompFile *file = component->file;
+	gsize orig_size;
+	gsize prep_size;
+
+	g_assert(file->path);
+
+	if (pad_encrypt_and_digest_file(parms, file->path, fd_out, path_out,
+					pv_component_get_src_addr(component),
+					pld_ctx, &orig_size, &prep_size,
+					err) < 0)
+		return -1;
+
+	if (component->orig_size != orig_size) {
+		g_set_error(err, G_FILE_ERROR, PV_ERROR_INTERNAL,
+			    _("File has changed during the preparation '%s'"),
+			    file->path);
+		return -1;
+	}
+
+	file->size = prep_size;
+	return 0;
+}
+
+gint pv_component_align_encrypt_and_write(PvComponent *component, gint fd_out,
+					  const gchar *path_out, void *opaque,
+					  EVP_MD_CTX *pld_ctx, GError **err)
 {
 	struct cipher_parms *parms = opaque;
 
@@ -178,71 +237,38 @@ gint pv_component_align_and_encrypt(PvComponent *component, const gchar *tmp_pat
 
 		buffer_clear(&component->buf);
 		component->buf = g_steal_pointer(&enc_buf);
-		return 0;
-	}
-	case DATA_FILE: {
-		const gchar *comp_name = pv_component_name(component);
-		gchar *path_in = component->file->path;
-		g_autofree gchar *path_out = NULL;
-		gsize orig_size;
-		gsize prep_size;
-
-		g_assert(path_in);
-
-		path_out = g_build_filename(tmp_path, comp_name, NULL);
-		if (encrypt_file(parms, path_in, path_out, &orig_size,
-				 &prep_size, err) < 0)
-			return -1;
-
-		if (component->orig_size != orig_size) {
-			g_set_error(err, G_FILE_ERROR, PV_ERROR_INTERNAL,
-				    _("File has changed during the preparation '%s'"),
-				    path_out);
-			return -1;
-		}
-
-		g_free(component->file->path);
-		component->file->size = prep_size;
-		component->file->path = g_steal_pointer(&path_out);
-		return 0;
+		return pv_component_write_buf(component, fd_out, path_out,
+					      pld_ctx, err);
 	}
+	case DATA_FILE:
+		return pv_component_write_file(component, parms, fd_out,
+					       path_out, pld_ctx, err);
 	}
 
 	g_assert_not_reached();
 }
 
-/* Page align the size of the component */
-gint pv_component_align(PvComponent *component, const gchar *tmp_path,
-			void *opaque G_GNUC_UNUSED, GError **err)
+/* Page align the component and write it without encryption */
+gint pv_component_align_and_write(PvComponent *component, gint fd_out,
+				  const gchar *path_out,
+				  void *opaque G_GNUC_UNUSED,
+				  EVP_MD_CTX *pld_ctx, GError **err)
 {
-	if (IS_PAGE_ALIGNED(pv_component_size(component)))
-		return 0;
-
-	switch (component->d_type) {
+	switch ((PvComponentDataType)component->d_type) {
 	case DATA_BUFFER: {
-		g_autoptr(Buffer) buf = NULL;
-
-		buf = buffer_dup(component->buf, TRUE);
-		buffer_clear(&component->buf);
-		component->buf = g_steal_pointer(&buf);
-		return 0;
-	} break;
-	case DATA_FILE: {
-		const gchar *comp_name = pv_component_name(component);
-		g_autofree gchar *path_out =
-			g_build_filename(tmp_path, comp_name, NULL);
-		gchar *path_in = component->file->path;
-		gsize size_out;
-
-		if (pad_file_right(path_out, path_in, &size_out, PAGE_SIZE,
-				   err) < 0)
-			return -1;
+		if (!(IS_PAGE_ALIGNED(pv_component_size(component)))) {
+			g_autoptr(Buffer) buf = NULL;
 
-		g_free(component->file->path);
-		component->file->path = g_steal_pointer(&path_out);
-		component->file->size = size_out;
-		return 0;
-	} break;
+			buf = buffer_dup(component->buf, TRUE);
+			buffer_clear(&component->buf);
+			component->buf = g_steal_pointer(&buf);
+		}
+		return pv_component_write_buf(component, fd_out, path_out,
+					      pld_ctx, err);
+	}
+	case DATA_FILE:
+		return pv_component_write_file(component, NULL, fd_out,
+					       path_out, pld_ctx, err);
 	}
 
 	g_assert_not_reached();
@@ -291,83 +317,6 @@ int64_t pv_component_update_ald(const PvComponent *comp, EVP_MD_CTX *ctx,
 	return nep;
 }
 
-int64_t pv_component_update_pld(const PvComponent *comp, EVP_MD_CTX *ctx,
-				GError **err)
-{
-	uint64_t size = pv_component_size(comp);
-	int64_t nep = 0;
-
-	g_assert(IS_PAGE_ALIGNED(size) && size != 0);
-
-	switch (comp->d_type) {
-	case DATA_BUFFER: {
-		const Buffer *buf = comp->buf;
-
-		g_assert(buf->size <= INT64_MAX);
-		g_assert(buf->size == size);
-
-		if (EVP_DigestUpdate(ctx, buf->data, buf->size) != 1) {
-			g_set_error(err, PV_CRYPTO_ERROR,
-				    PV_CRYPTO_ERROR_INTERNAL,
-				    _("EVP_DigestUpdate failed"));
-			return -1;
-		}
-
-		nep = (int64_t)(buf->size / PAGE_SIZE);
-		break;
-	}
-	case DATA_FILE: {
-		const gchar *in_path = comp->file->path;
-		guchar in_buf[PAGE_SIZE];
-		gsize num_bytes_read_total = 0;
-		gsize num_bytes_read = 0;
-		FILE *f_in;
-
-		f_in = file_open(in_path, "rb", err);
-		if (!f_in)
-			return -1;
-
-		do {
-			/* Read data in blocks. Update the digest
-			 * context each read.
-			 */
-			if (file_read(f_in, in_buf, sizeof(*in_buf),
-				      sizeof(in_buf), &num_bytes_read,
-				      err) < 0) {
-				fclose(f_in);
-				return -1;
-			}
-			num_bytes_read_total += num_bytes_read;
-
-			if (EVP_DigestUpdate(ctx, in_buf, sizeof(in_buf)) != 1) {
-				g_set_error(err, PV_CRYPTO_ERROR,
-					    PV_CRYPTO_ERROR_INTERNAL,
-					    _("EVP_DigestUpdate failed"));
-				fclose(f_in);
-				return -1;
-			}
-
-			nep++;
-		} while (num_bytes_read_total < pv_component_size(comp) &&
-			 num_bytes_read != 0);
-
-		if (num_bytes_read_total != pv_component_size(comp)) {
-			g_set_error(err, G_FILE_ERROR, PV_ERROR_INTERNAL,
-				    _("'%s' has changed during the preparation"),
-				    in_path);
-			fclose(f_in);
-			return -1;
-		}
-		fclose(f_in);
-		break;
-	}
-	default:
-		g_assert_not_reached();
-	}
-
-	return nep;
-}
-
 int64_t pv_component_update_tld(const PvComponent *comp, EVP_MD_CTX *ctx,
 				GError **err)
 {
@@ -416,31 +365,3 @@ int64_t pv_component_update_tld(const PvComponent *comp, EVP_MD_CTX *ctx,
 
 	return nep;
 }
-
-gint pv_component_write(const PvComponent *component, FILE *f, GError **err)
-{
-	uint64_t offset = pv_component_get_src_addr(component);
-
-	g_assert(f);
-
-	switch (component->d_type) {
-	case DATA_BUFFER: {
-		const Buffer *buf = component->buf;
-
-		if (seek_and_write_buffer(f, buf, offset, err) < 0)
-			return -1;
-
-		return 0;
-	}
-	case DATA_FILE: {
-		const CompFile *file = component->file;
-
-		if (seek_and_write_file(f, file, offset, err) < 0)
-			return -1;
-
-		return 0;
-	}
-	}
-
-	g_assert_not_reached();
-}
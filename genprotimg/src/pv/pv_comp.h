@@ -61,17 +61,17 @@ uint64_t pv_component_get_src_addr(const PvComponent *component);
 uint64_t pv_component_get_orig_size(const PvComponent *component);
 uint64_t pv_component_get_tweak_prefix(const PvComponent *component);
 gboolean pv_component_is_stage3b(const PvComponent *component);
-gint pv_component_align_and_encrypt(PvComponent *component, const gchar *tmp_path,
-				    void *opaque, GError **err);
-gint pv_component_align(PvComponent *component, const gchar *tmp_path,
-			void *opaque G_GNUC_UNUSED, GError **err);
-int64_t pv_component_update_pld(const PvComponent *comp, EVP_MD_CTX *ctx,
-				GError **err);
+gint pv_component_align_encrypt_and_write(PvComponent *component, gint fd_out,
+					  const gchar *path_out, void *opaque,
+					  EVP_MD_CTX *pld_ctx, GError **err);
+gint pv_component_align_and_write(PvComponent *component, gint fd_out,
+				  const gchar *path_out,
+				  void *opaque G_GNUC_UNUSED,
+				  EVP_MD_CTX *pld_ctx, GError **err);
 int64_t pv_component_update_ald(const PvComponent *comp, EVP_MD_CTX *ctx,
 				GError **err);
 int64_t pv_component_update_tld(const PvComponent *comp, EVP_MD_CTX *ctx,
 				GError **err);
-gint pv_component_write(const PvComponent *component, FILE *f, GError **err);
 
 WRAPPED_G_DEFINE_AUTOPTR_CLEANUP_FUNC(PvComponent, pv_component_free)
 
@@ -30,6 +30,10 @@ struct _pv_img_comps {
 	EVP_MD_CTX *ald; /* context used for the hash of the addresses */
 	EVP_MD_CTX *pld; /* context used for the hash of the pages content */
 	EVP_MD_CTX *tld; /* context used for the hash of the tweaks */
+	/* digests are computed once when finalizing */
+	Buffer *pld_digest;
+	Buffer *ald_digest;
+	Buffer *tld_digest;
 	GSList *comps; /* elements sorted by component type */
 };
 
@@ -41,6 +45,9 @@ void pv_img_comps_free(PvImgComps *comps)
 	EVP_MD_CTX_free(comps->ald);
 	EVP_MD_CTX_free(comps->pld);
 	EVP_MD_CTX_free(comps->tld);
+	buffer_free(comps->pld_digest);
+	buffer_free(comps->ald_digest);
+	buffer_free(comps->tld_digest);
 	g_slist_free_full(comps->comps, (GDestroyNotify)pv_component_free);
 	g_free(comps);
 }
@@ -70,32 +77,28 @@ guint pv_img_comps_length(const PvImgComps *comps)
 	return g_slist_length(comps->comps);
 }
 
-/* Update hashes and nep */
+/* Update the address and tweak hashes and nep. The hash of the pages
+ * content is updated while the component is written.
+ */
 /* Returns 0 in case of success and -1 in case of a failure */
 static gint pv_img_comps_hash_comp(PvImgComps *comps, const PvComponent *comp,
 				   GError **err)
 {
 	int64_t nep_1 = 0;
 	int64_t nep_2 = 0;
-	int64_t nep_3 = 0;
-
-	/* update pld */
-	nep_1 = pv_component_update_pld(comp, comps->pld, err);
-	if (nep_1 < 0)
-		return -1;
 
 	/* update ald */
-	nep_2 = pv_component_update_ald(comp, comps->ald, err);
-	if (nep_2 < 0)
+	nep_1 = pv_component_update_ald(comp, comps->ald, err);
+	if (nep_1 < 0)
 		return -1;
 
 	/* update tld */
-	nep_3 = pv_component_update_tld(comp, comps->tld, err);
-	if (nep_3 < 0)
+	nep_2 = pv_component_update_tld(comp, comps->tld, err);
+	if (nep_2 < 0)
 		return -1;
 
 	g_assert(nep_1 == nep_2);
-	g_assert(nep_2 == nep_3);
+	g_assert((uint64_t)nep_1 == pv_component_size(comp) / PAGE_SIZE);
 
 	/* update comps->nep */
 	g_assert_true(g_uint64_checked_add(&comps->nep, comps->nep,
@@ -103,6 +106,34 @@ static gint pv_img_comps_hash_comp(PvImgComps *comps, const PvComponent *comp,
 	return 0;
 }
 
+/* Sets the address of @comp in the memory layout. This must be done before
+ * the component is written and added.
+ */
+gint pv_img_comps_set_src_addr(PvImgComps *comps, PvComponent *comp,
+			       GError **err)
+{
+	g_assert(comp);
+	g_assert(comps);
+	g_assert(IS_PAGE_ALIGNED(comps->next_src));
+
+	if (comps->finalized) {
+		g_set_error(err, PV_COMPONENT_ERROR, PV_COMPONENT_ERROR_FINALIZED,
+			    _("Failed to add component, image is already finalized"));
+		return -1;
+	}
+
+	comp->src_addr = comps->next_src;
+	return 0;
+}
+
+/* Returns the context used for the hash of the pages content. The
+ * components must update it in the order they are added.
+ */
+EVP_MD_CTX *pv_img_comps_get_pld_ctx(const PvImgComps *comps)
+{
+	return comps->pld;
+}
+
 gint pv_img_comps_add_component(PvImgComps *comps, PvComponent **comp,
 				GError **err)
 {
@@ -111,7 +142,6 @@ gint pv_img_comps_add_component(PvImgComps *comps, PvComponent **comp,
 	g_assert(comps);
 	g_assert(IS_PAGE_ALIGNED(comps->next_src));
 
-	uint64_t src_addr = comps->next_src;
 	uint64_t src_size = pv_component_size(*comp)
 				    ? PAGE_ALIGN(pv_component_size(*comp))
 				    : PAGE_SIZE;
@@ -122,13 +152,17 @@ gint pv_img_comps_add_component(PvImgComps *comps, PvComponent **comp,
 		return -1;
 	}
 
-	/* set the address of the component in the memory layout */
-	(*comp)->src_addr = src_addr;
+	/* the address must be set by `pv_img_comps_set_src_addr` */
+	g_assert(pv_component_get_src_addr(*comp) == comps->next_src);
 
 	g_info("%12s:\t0x%012lx (%12ld / %12ld Bytes)",
 	       pv_component_name(*comp), pv_component_get_src_addr(*comp),
 	       pv_component_size(*comp), pv_component_get_orig_size(*comp));
 
+	/* update hashes and nep */
+	if (pv_img_comps_hash_comp(comps, *comp, err) < 0)
+		return -1;
+
 	/* append the component and pass the responsibility of @comp
 	 * to @comps
 	 */
@@ -210,38 +244,33 @@ GSList *pv_img_comps_get_comps(const PvImgComps *comps)
 	return comps->comps;
 }
 
+/* Can be called multiple times, e.g. for the images of the batch mode,
+ * the digests are only computed the first time.
+ */
 gint pv_img_comps_finalize(PvImgComps *comps, Buffer **pld_digest,
 			   Buffer **ald_digest, Buffer **tld_digest,
 			   uint64_t *nep, GError **err)
 {
-	g_autoptr(Buffer) tmp_pld_digest = NULL;
-	g_autoptr(Buffer) tmp_ald_digest = NULL;
-	g_autoptr(Buffer) tmp_tld_digest = NULL;
-
-	comps->finalized = TRUE;
-	for (GSList *iterator = comps->comps; iterator; iterator = iterator->next) {
-		const PvComponent *comp = iterator->data;
-
-		/* update hashes and nep */
-		if (pv_img_comps_hash_comp(comps, comp, err) < 0)
+	if (!comps->finalized) {
+		/* the hashes are updated while the components are added */
+		comps->pld_digest = digest_ctx_finalize(comps->pld, err);
+		if (!comps->pld_digest)
 			return -1;
-	}
 
-	tmp_pld_digest = digest_ctx_finalize(comps->pld, err);
-	if (!tmp_pld_digest)
-		return -1;
+		comps->ald_digest = digest_ctx_finalize(comps->ald, err);
+		if (!comps->ald_digest)
+			return -1;
 
-	tmp_ald_digest = digest_ctx_finalize(comps->ald, err);
-	if (!tmp_ald_digest)
-		return -1;
+		comps->tld_digest = digest_ctx_finalize(comps->tld, err);
+		if (!comps->tld_digest)
+			return -1;
 
-	tmp_tld_digest = digest_ctx_finalize(comps->tld, err);
-	if (!tmp_tld_digest)
-		return -1;
+		comps->finalized = TRUE;
+	}
 
-	*pld_digest = g_steal_pointer(&tmp_pld_digest);
-	*ald_digest = g_steal_pointer(&tmp_ald_digest);
-	*tld_digest = g_steal_pointer(&tmp_tld_digest);
+	*pld_digest = buffer_dup(comps->pld_digest, FALSE);
+	*ald_digest = buffer_dup(comps->ald_digest, FALSE);
+	*tld_digest = buffer_dup(comps->tld_digest, FALSE);
 	*nep = comps->nep;
 	return 0;
 }
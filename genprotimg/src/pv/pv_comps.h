@@ -28,6 +28,9 @@ guint pv_img_comps_length(const PvImgComps *comps);
 GSList *pv_img_comps_get_comps(const PvImgComps *comps);
 struct stage3b_args *pv_img_comps_get_stage3b_args(const PvImgComps *comps,
 						   struct psw_t *psw);
+gint pv_img_comps_set_src_addr(PvImgComps *comps, PvComponent *comp,
+			       GError **err);
+EVP_MD_CTX *pv_img_comps_get_pld_ctx(const PvImgComps *comps);
 gint pv_img_comps_add_component(PvImgComps *comps, PvComponent **comp,
 				GError **err);
 PvComponent *pv_img_comps_get_nth_comp(PvImgComps *comps, guint n);
@@ -47,6 +47,7 @@ typedef enum {
 typedef enum {
 	PV_IMAGE_ERROR_OFFSET,
 	PV_IMAGE_ERROR_FINALIZED,
+	PV_IMAGE_ERROR_OUTPUT,
 } PvImageErrors;
 
 typedef enum {
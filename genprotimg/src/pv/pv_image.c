@@ -8,12 +8,16 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <openssl/evp.h>
 #include <openssl/x509.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "boot/s390.h"
 #include "boot/stage3a.h"
@@ -49,8 +53,9 @@ const PvComponent *pv_img_get_stage3b_comp(const PvImage *img, GError **err)
 	return comp;
 }
 
-typedef gint (*prepare_func)(PvComponent *obj, const gchar *tmp_path,
-			     void *opaque, GError **err);
+typedef gint (*prepare_func)(PvComponent *obj, gint fd_out,
+			     const gchar *path_out, void *opaque,
+			     EVP_MD_CTX *pld_ctx, GError **err);
 
 static gint pv_img_prepare_component(const PvImage *img, PvComponent *comp,
 				     GError **err)
@@ -63,7 +68,7 @@ static gint pv_img_prepare_component(const PvImage *img, PvComponent *comp,
 
 	if (img->pcf & PV_CFLAG_NO_DECRYPTION) {
 		/* we only need to align the components */
-		func = pv_component_align;
+		func = pv_component_align_and_write;
 		opaque = NULL;
 	} else {
 		const EVP_CIPHER *cipher = img->xts_cipher;
@@ -78,7 +83,7 @@ static gint pv_img_prepare_component(const PvImage *img, PvComponent *comp,
 
 		tweak = buffer_alloc(sizeof(comp->tweak.data));
 		memcpy(tweak->data, comp->tweak.data, tweak->size);
-		func = pv_component_align_and_encrypt;
+		func = pv_component_align_encrypt_and_write;
 		parms.cipher = cipher;
 		parms.key = img->xts_key;
 		parms.iv_or_tweak = tweak;
@@ -86,7 +91,8 @@ static gint pv_img_prepare_component(const PvImage *img, PvComponent *comp,
 		opaque = &parms;
 	}
 
-	rc = (*func)(comp, img->tmp_dir, opaque, err);
+	rc = (*func)(comp, img->out_fd, img->out_path, opaque,
+		     pv_img_comps_get_pld_ctx(img->comps), err);
 	if (rc < 0)
 		return -1;
 
@@ -254,8 +260,11 @@ static gint pv_img_hostkey_verify(GSList *host_key_certs,
 				  const gchar *root_ca_path,
 				  const gchar *const *crl_paths,
 				  const gchar *const *untrusted_cert_paths,
+				  const gchar *crl_cache_dir,
 				  gboolean offline, GError **err)
 {
+	g_autoptr(STACK_OF_X509_CRL) downloaded_ibm_signing_crls = NULL;
+	g_autofree gchar *default_crl_cache_dir = NULL;
 	g_autoslist(x509_with_path) untrusted_certs_with_path = NULL;
 	g_autoptr(STACK_OF_X509) ibm_signing_certs = NULL;
 	g_autoptr(STACK_OF_X509) untrusted_certs = NULL;
@@ -270,31 +279,38 @@ static gint pv_img_hostkey_verify(GSList *host_key_certs,
 	if (!trusted)
 		goto error;
 
-	if (!offline) {
-		g_autoptr(STACK_OF_X509_CRL) downloaded_ibm_signing_crls = NULL;
+	/* Downloaded CRLs are cached on disk and reused until their next
+	 * update is due. In offline mode only the cached CRLs are used.
+	 */
+	if (!crl_cache_dir) {
+		default_crl_cache_dir = g_build_filename(g_get_user_cache_dir(),
+							 "genprotimg", "crls",
+							 NULL);
+		crl_cache_dir = default_crl_cache_dir;
+	}
+	setup_crl_cache(crl_cache_dir, offline);
 
-		/* Set up the download routine for the lookup of CRLs. */
-		store_setup_crl_download(trusted);
+	/* Set up the download routine for the lookup of CRLs. */
+	store_setup_crl_download(trusted);
 
-		/* Try to download the CRLs of the IBM Z signing certificates
-		 * specified in the host-key documents. Ignore download errors
-		 * as it's still possible that a CRL is specified via command
-		 * line.
-		 */
-		downloaded_ibm_signing_crls = try_load_crls_by_certs(host_key_certs);
+	/* Try to download the CRLs of the IBM Z signing certificates
+	 * specified in the host-key documents. Ignore download errors
+	 * as it's still possible that a CRL is specified via command
+	 * line.
+	 */
+	downloaded_ibm_signing_crls = try_load_crls_by_certs(host_key_certs);
 
-		/* Add the downloaded CRLs to the store so they can be used for
-		 * the verification later.
-		 */
-		for (int i = 0; i < sk_X509_CRL_num(downloaded_ibm_signing_crls); i++) {
-			X509_CRL *crl = sk_X509_CRL_value(downloaded_ibm_signing_crls, i);
-
-			if (X509_STORE_add_crl(trusted, crl) != 1) {
-				g_set_error(err, PV_CRYPTO_ERROR,
-					    PV_CRYPTO_ERROR_INTERNAL,
-					    _("failed to load CRL"));
-				goto error;
-			}
+	/* Add the downloaded CRLs to the store so they can be used for
+	 * the verification later.
+	 */
+	for (int i = 0; i < sk_X509_CRL_num(downloaded_ibm_signing_crls); i++) {
+		X509_CRL *crl = sk_X509_CRL_value(downloaded_ibm_signing_crls, i);
+
+		if (X509_STORE_add_crl(trusted, crl) != 1) {
+			g_set_error(err, PV_CRYPTO_ERROR,
+				    PV_CRYPTO_ERROR_INTERNAL,
+				    _("failed to load CRL"));
+			goto error;
 		}
 	}
 
@@ -398,6 +414,22 @@ static gint pv_img_hostkey_verify(GSList *host_key_certs,
 		const gchar *host_key_path = host_key_with_path->path;
 		X509 *host_key = host_key_with_path->cert;
 		gint flags = X509_V_FLAG_CRL_CHECK;
+		gboolean verified = FALSE;
+
+		/* a host-key document specified multiple times is only
+		 * verified once
+		 */
+		for (GSList *prev = host_key_certs; prev != iterator;
+		     prev = prev->next) {
+			const x509_with_path *prev_with_path = prev->data;
+
+			if (X509_cmp(prev_with_path->cert, host_key) == 0) {
+				verified = TRUE;
+				break;
+			}
+		}
+		if (verified)
+			continue;
 
 		if (verify_host_key(host_key, ibm_z_pairs, flags,
 				    PV_CERTS_SECURITY_LEVEL, err) < 0) {
@@ -412,11 +444,39 @@ error:
 	return -1;
 }
 
-/* read in the keys or auto-generate them */
-static gint pv_img_set_keys(PvImage *img, const PvArgs *args, GError **err)
+/* Load, verify and set the public keys of the host-key documents */
+static gint pv_img_set_host_keys(PvImage *img, const PvArgs *args,
+				 gchar **host_keys, GError **err)
 {
 	g_autoslist(x509_with_path) host_key_certs = NULL;
 
+	/* Load all host-key documents specified on the command line */
+	host_key_certs = load_certificates((const gchar **)host_keys, err);
+	if (!host_key_certs)
+		return -1;
+
+	if (!args->no_verify &&
+	    pv_img_hostkey_verify(host_key_certs, args->root_ca_path,
+				  (const gchar * const *)args->crl_paths,
+				  (const gchar * const *)args->untrusted_cert_paths,
+				  args->crl_cache_dir, args->offline, err) < 0) {
+		return -1;
+	}
+
+	/* Loads the public keys stored in the host-key documents and verify
+	 * that the correct elliptic curve is used.
+	 */
+	img->host_pub_keys =
+		pv_img_get_host_keys(host_key_certs, img->nid, err);
+	if (!img->host_pub_keys)
+		return -1;
+
+	return 0;
+}
+
+/* read in the keys or auto-generate them */
+static gint pv_img_set_keys(PvImage *img, const PvArgs *args, GError **err)
+{
 	g_assert(img->xts_cipher);
 	g_assert(img->cust_comm_cipher);
 	g_assert(img->gcm_cipher);
@@ -444,29 +504,7 @@ static gint pv_img_set_keys(PvImage *img, const PvArgs *args, GError **err)
 	if (!img->cust_pub_priv_key)
 		return -1;
 
-	/* Load all host-key documents specified on the command line */
-	host_key_certs = load_certificates((const gchar **)args->host_keys,
-					   err);
-	if (!host_key_certs)
-		return -1;
-
-	if (!args->no_verify &&
-	    pv_img_hostkey_verify(host_key_certs, args->root_ca_path,
-				  (const gchar * const *)args->crl_paths,
-				  (const gchar * const *)args->untrusted_cert_paths,
-				  args->offline, err) < 0) {
-		return -1;
-	}
-
-	/* Loads the public keys stored in the host-key documents and verify
-	 * that the correct elliptic curve is used.
-	 */
-	img->host_pub_keys =
-		pv_img_get_host_keys(host_key_certs, img->nid, err);
-	if (!img->host_pub_keys)
-		return -1;
-
-	return 0;
+	return pv_img_set_host_keys(img, args, args->host_keys, err);
 }
 
 static void pv_img_add_host_slot(PvImage *img, PvHdrKeySlot *slot)
@@ -571,12 +609,58 @@ static gint pv_img_set_comps_offset(PvImage *img, uint64_t offset, GError **err)
 	return pv_img_comps_set_offset(img->comps, offset, err);
 }
 
+/* The image is written while the components are read, therefore it must
+ * not be one of them
+ */
+static gint pv_img_check_output_path(const PvArgs *args,
+				     const gchar *output_path, GError **err)
+{
+	GStatBuf out_st, in_st;
+
+	if (g_stat(output_path, &out_st) != 0)
+		return 0;
+
+	for (GSList *iterator = args->comps; iterator; iterator = iterator->next) {
+		const PvArg *arg = iterator->data;
+
+		if (g_stat(arg->path, &in_st) != 0)
+			continue;
+
+		if (in_st.st_dev == out_st.st_dev &&
+		    in_st.st_ino == out_st.st_ino) {
+			g_set_error(err, PV_IMAGE_ERROR, PV_IMAGE_ERROR_OUTPUT,
+				    _("Output file '%s' is also used as input"),
+				    output_path);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static gint pv_img_open_output(const gchar *path, GError **err)
+{
+	gint fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		g_set_error(err, G_FILE_ERROR,
+			    (gint)g_file_error_from_errno(errno),
+			    _("Failed to open file '%s': %s"), path,
+			    g_strerror(errno));
+		return -1;
+	}
+
+	return fd;
+}
+
 PvImage *pv_img_new(PvArgs *args, const gchar *stage3a_path, GError **err)
 {
 	g_autoptr(PvImage) ret = g_new0(PvImage, 1);
 	uint64_t offset;
 
-	g_assert(args->tmp_dir);
+	ret->out_fd = -1;
+	g_assert(args->output_path);
 	g_assert(stage3a_path);
 
 	if (args->no_verify)
@@ -594,7 +678,6 @@ PvImage *pv_img_new(PvArgs *args, const gchar *stage3a_path, GError **err)
 	ret->initial_psw.addr = DEFAULT_INITIAL_PSW_ADDR;
 	ret->initial_psw.mask = DEFAULT_INITIAL_PSW_MASK;
 	ret->nid = NID_secp521r1;
-	ret->tmp_dir = g_strdup(args->tmp_dir);
 	ret->xts_cipher = EVP_aes_256_xts();
 
 	/* set initial PSW that will be loaded by the stage3b */
@@ -624,6 +707,15 @@ PvImage *pv_img_new(PvArgs *args, const gchar *stage3a_path, GError **err)
 	if (pv_img_set_comps_offset(ret, offset, err) < 0)
 		return NULL;
 
+	/* the components are written to the image while they are added */
+	if (pv_img_check_output_path(args, args->output_path, err) < 0)
+		return NULL;
+
+	ret->out_fd = pv_img_open_output(args->output_path, err);
+	if (ret->out_fd < 0)
+		return NULL;
+	ret->out_path = g_strdup(args->output_path);
+
 	return g_steal_pointer(&ret);
 }
 
@@ -639,7 +731,9 @@ void pv_img_free(PvImage *img)
 	EVP_PKEY_free(img->cust_pub_priv_key);
 	buffer_clear(&img->stage3a);
 	pv_img_comps_free(img->comps);
-	g_free(img->tmp_dir);
+	if (img->out_fd >= 0)
+		close(img->out_fd);
+	g_free(img->out_path);
 	buffer_free(img->xts_key);
 	buffer_free(img->cust_root_key);
 	buffer_free(img->gcm_iv);
@@ -653,8 +747,15 @@ static gint pv_img_prepare_and_add_component(PvImage *img, PvComponent **comp,
 	g_assert(comp);
 	g_assert(*comp);
 
+	/* the component is written to its final location in the image,
+	 * therefore its address must be known beforehand
+	 */
+	if (pv_img_comps_set_src_addr(img->comps, *comp, err) < 0)
+		return -1;
+
 	/* prepares the component: does the alignment and encryption
-	 * if required
+	 * if required, writes it to the image and updates the hash of
+	 * the pages content
 	 */
 	if (pv_img_prepare_component(img, *comp, err) < 0)
 		return -1;
@@ -882,13 +983,31 @@ static Buffer *pv_img_create_pv_hdr(PvImage *img, GError **err)
 	return g_steal_pointer(&hdr_buf);
 }
 
+/* Creates the PV header and writes it and the IPIB to stage3a */
+static gint pv_img_build_hdr_and_stage3a(PvImage *pv, GError **err)
+{
+	g_autoptr(Buffer) hdr = NULL;
+
+	/* create the PV header */
+	hdr = pv_img_create_pv_hdr(pv, err);
+	if (!hdr)
+		return -1;
+
+	/* generate stage3a. At this point in time the PV header and
+	 * the stage3b must be generated and encrypted
+	 */
+	if (pv_img_build_stage3a(pv->stage3a, pv->stage3a_bin_size,
+				 pv_img_comps_get_comps(pv->comps), hdr, err) < 0)
+		return -1;
+
+	return 0;
+}
+
 /* No changes to the components are allowed after calling this
  * function
  */
 gint pv_img_finalize(PvImage *pv, const gchar *stage3b_path, GError **err)
 {
-	g_autoptr(Buffer) hdr = NULL;
-
 	/* load stage3b template into memory and add it to the list of
 	 * components. This must be done before calling
 	 * `pv_img_load_and_set_stage3a`.
@@ -896,19 +1015,115 @@ gint pv_img_finalize(PvImage *pv, const gchar *stage3b_path, GError **err)
 	if (pv_img_add_stage3b_comp(pv, stage3b_path, err) < 0)
 		return -1;
 
-	/* create the PV header */
-	hdr = pv_img_create_pv_hdr(pv, err);
-	if (!hdr)
-		return -1;
+	return pv_img_build_hdr_and_stage3a(pv, err);
+}
 
-	/* generate stage3a. At this point in time the PV header and
-	 * the stage3b must be generated and encrypted
+/* Prepares @img, that has already been written, for the next output
+ * image of @target. The encrypted components and the stage3b are the
+ * same for all targets and are copied from the previous image. Only the
+ * PV header is built again with new customer keys and a new IV, and
+ * with key slots for the host keys of @target.
+ */
+gint pv_img_set_target(PvImage *img, const PvArgs *args,
+		       const PvTarget *target, GError **err)
+{
+	const PvComponent *first, *last;
+	GStatBuf in_st, out_st;
+	uint64_t start, end;
+	GSList *comps;
+	gint in_fd;
+
+	g_assert(img->out_fd < 0);
+	g_assert(img->out_path);
+
+	/* the size of the PV header determines the location of the
+	 * components, therefore it must not change
 	 */
-	if (pv_img_build_stage3a(pv->stage3a, pv->stage3a_bin_size,
-				 pv_img_comps_get_comps(pv->comps), hdr, err) < 0)
+	if (g_strv_length(target->host_keys) !=
+	    g_slist_length(img->host_pub_keys)) {
+		g_set_error(err, PV_IMAGE_ERROR, PV_IMAGE_ERROR_OUTPUT,
+			    _("Output file '%s' must use the same number of host-key documents as '%s'"),
+			    target->output_path, args->output_path);
 		return -1;
+	}
 
+	/* never reuse the keys of the PV header */
+	EVP_PKEY_free(img->cust_pub_priv_key);
+	img->cust_pub_priv_key = pv_img_get_cust_pub_priv_key(img->nid, err);
+	if (!img->cust_pub_priv_key)
+		return -1;
+
+	if (!args->cust_root_key_path) {
+		buffer_free(img->cust_root_key);
+		img->cust_root_key = pv_img_get_key(img->gcm_cipher, NULL, err);
+		if (!img->cust_root_key)
+			return -1;
+	}
+
+	buffer_free(img->gcm_iv);
+	img->gcm_iv = pv_img_get_iv(img->gcm_cipher, args->gcm_iv_path, err);
+	if (!img->gcm_iv)
+		return -1;
+
+	g_slist_free_full(g_steal_pointer(&img->key_slots),
+			  (GDestroyNotify)pv_hdr_key_slot_free);
+	g_slist_free_full(g_steal_pointer(&img->host_pub_keys),
+			  (GDestroyNotify)EVP_PKEY_free);
+	if (pv_img_set_host_keys(img, args, target->host_keys, err) < 0)
+		return -1;
+
+	if (pv_img_set_host_slots(img, err) < 0)
+		return -1;
+
+	if (pv_img_check_output_path(args, target->output_path, err) < 0)
+		return -1;
+
+	in_fd = open(img->out_path, O_RDONLY);
+	if (in_fd < 0) {
+		g_set_error(err, G_FILE_ERROR,
+			    (gint)g_file_error_from_errno(errno),
+			    _("Failed to open file '%s': %s"), img->out_path,
+			    g_strerror(errno));
+		return -1;
+	}
+
+	/* the previous image is the source of the components */
+	if (fstat(in_fd, &in_st) == 0 &&
+	    g_stat(target->output_path, &out_st) == 0 &&
+	    in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+		g_set_error(err, PV_IMAGE_ERROR, PV_IMAGE_ERROR_OUTPUT,
+			    _("Output file '%s' is used more than once"),
+			    target->output_path);
+		goto err;
+	}
+
+	img->out_fd = pv_img_open_output(target->output_path, err);
+	if (img->out_fd < 0)
+		goto err;
+
+	comps = pv_img_comps_get_comps(img->comps);
+	first = comps->data;
+	last = g_slist_last(comps)->data;
+	start = pv_component_get_src_addr(first);
+	end = pv_component_get_src_addr(last) + pv_component_size(last);
+	if (file_copy_range(in_fd, img->out_fd, start, end - start, err) < 0)
+		goto err_unlink;
+
+	if (pv_img_build_hdr_and_stage3a(img, err) < 0)
+		goto err_unlink;
+
+	close(in_fd);
+	g_free(img->out_path);
+	img->out_path = g_strdup(target->output_path);
 	return 0;
+
+err_unlink:
+	close(img->out_fd);
+	img->out_fd = -1;
+	(void)g_unlink(target->output_path);
+err:
+	close(in_fd);
+	return -1;
 }
 
 static gint convert_psw_to_short_psw(const struct psw_t *psw, uint64_t *dst,
@@ -948,7 +1163,7 @@ static gint convert_psw_to_short_psw(const struct psw_t *psw, uint64_t *dst,
 	return 0;
 }
 
-static gint write_short_psw(FILE *f, struct psw_t *psw, GError **err)
+static gint write_short_psw(gint fd, struct psw_t *psw, GError **err)
 {
 	uint64_t short_psw, short_psw_be;
 
@@ -956,45 +1171,36 @@ static gint write_short_psw(FILE *f, struct psw_t *psw, GError **err)
 		return -1;
 
 	short_psw_be = GUINT64_TO_BE(short_psw);
-	return file_write(f, &short_psw_be, 1, sizeof(short_psw_be), NULL, err);
+	return file_pwrite(fd, &short_psw_be, sizeof(short_psw_be), 0, err);
 }
 
-gint pv_img_write(PvImage *img, const gchar *path, GError **err)
+/* The components are already written to the image by
+ * `pv_img_add_component` and `pv_img_finalize`. Only the short PSW and
+ * stage3a are missing as they depend on all components.
+ */
+gint pv_img_write(PvImage *img, GError **err)
 {
-	gint ret = -1;
-	FILE *f = file_open(path, "wb", err);
+	gint fd = img->out_fd;
 
-	if (!f)
-		return -1;
+	g_assert(fd >= 0);
 
-	if (write_short_psw(f, &img->stage3a_psw, err) < 0) {
-		g_prefix_error(err, _("Failed to write image '%s': "), path);
+	if (write_short_psw(fd, &img->stage3a_psw, err) < 0)
 		goto err;
-	}
 
-	if (seek_and_write_buffer(f, img->stage3a, STAGE3A_LOAD_ADDRESS, err) <
-	    0) {
-		g_prefix_error(err, _("Failed to write image '%s': "), path);
+	if (file_pwrite(fd, img->stage3a->data, img->stage3a->size,
+			STAGE3A_LOAD_ADDRESS, err) < 0)
 		goto err;
-	}
 
-	/* list is sorted by component type => by address */
-	for (GSList *iterator = pv_img_comps_get_comps(img->comps); iterator;
-	     iterator = iterator->next) {
-		gint rc;
-		const PvComponent *comp = iterator->data;
-
-		rc = pv_component_write(comp, f, err);
-		if (rc < 0) {
-			g_prefix_error(err, _("Failed to write image '%s': "),
-				       path);
-			goto err;
-		}
+	img->out_fd = -1;
+	if (close(fd) != 0) {
+		g_set_error(err, G_FILE_ERROR,
+			    (gint)g_file_error_from_errno(errno),
+			    _("Failed to close file: %s"), g_strerror(errno));
+		goto err;
 	}
 
-	ret = 0;
+	return 0;
 err:
-	if (f)
-		fclose(f);
-	return ret;
+	g_prefix_error(err, _("Failed to write image '%s': "), img->out_path);
+	return -1;
 }
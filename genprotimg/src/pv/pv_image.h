@@ -24,7 +24,8 @@
 #include "pv_stage3.h"
 
 typedef struct {
-	gchar *tmp_dir; /* directory used for temporary files */
+	gchar *out_path; /* path of the image */
+	gint out_fd; /* the image the components are written to */
 	Buffer *stage3a; /* stage3a containing IPIB and PV header */
 	gsize stage3a_bin_size; /* size of stage3a.bin */
 	struct psw_t stage3a_psw; /* (short) PSW that is written to
@@ -54,6 +55,8 @@ PvImage *pv_img_new(PvArgs *args, const gchar *stage3a_path, GError **err);
 void pv_img_free(PvImage *img);
 gint pv_img_add_component(PvImage *img, const PvArg *arg, GError **err);
 gint pv_img_finalize(PvImage *img, const gchar *stage3b_path, GError **err);
+gint pv_img_set_target(PvImage *img, const PvArgs *args,
+		       const PvTarget *target, GError **err);
 gint pv_img_calc_pld_ald_tld_nep(const PvImage *img, Buffer **pld, Buffer **ald,
 				 Buffer **tld, uint64_t *nep, GError **err);
 gint pv_img_load_and_set_stage3a(PvImage *img, const gchar *path, GError **err);
@@ -61,7 +64,7 @@ const PvComponent *pv_img_get_stage3b_comp(const PvImage *img, GError **err);
 gint pv_img_add_stage3b_comp(PvImage *img, const gchar *path, GError **err);
 uint32_t pv_img_get_enc_size(const PvImage *img);
 uint32_t pv_img_get_pv_hdr_size(const PvImage *img);
-gint pv_img_write(PvImage *img, const gchar *path, GError **err);
+gint pv_img_write(PvImage *img, GError **err);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(PvImage, pv_img_free)
 
@@ -7,6 +7,8 @@
  * it under the terms of the MIT license. See LICENSE for details.
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <glib.h>
 #include <glib/gtypes.h>
 #include <limits.h>
@@ -20,9 +22,12 @@
 #include <openssl/x509v3.h>
 #include <openssl/x509_vfy.h>
 #include <openssl/err.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "boot/s390.h"
 #include "common.h"
@@ -473,12 +478,107 @@ static X509_CRL *GByteArray_to_X509_CRL(const GByteArray *data)
 	return g_steal_pointer(&ret);
 }
 
+/* Used for the on-disk caching of the downloaded CRLs */
+static gchar *crl_cache_dir;
+static gboolean crl_cache_offline;
+
+/* Downloaded CRLs are stored in @cache_dir and reused until their next
+ * update is due. If @offline is TRUE, only the cached CRLs are used.
+ * @cache_dir is allowed to be NULL, then no CRLs are cached.
+ */
+void setup_crl_cache(const gchar *cache_dir, gboolean offline)
+{
+	g_free(crl_cache_dir);
+	crl_cache_dir = g_strdup(cache_dir);
+	crl_cache_offline = offline;
+}
+
+static gchar *crl_cache_path(const gchar *url)
+{
+	g_autofree gchar *name = NULL;
+	g_autofree gchar *hash = NULL;
+
+	hash = g_compute_checksum_for_string(G_CHECKSUM_SHA256, url, -1);
+	name = g_strdup_printf("%s.crl", hash);
+	return g_build_filename(crl_cache_dir, name, NULL);
+}
+
+/* Returns the cached CRL for @url if its next update is not due yet */
+static X509_CRL *crl_cache_lookup(const gchar *url)
+{
+	g_autoptr(X509_CRL) crl = NULL;
+	g_autofree gchar *path = NULL;
+	const ASN1_TIME *next;
+	g_autoptr(BIO) bio = NULL;
+
+	if (!crl_cache_dir)
+		return NULL;
+
+	path = crl_cache_path(url);
+	bio = BIO_new_file(path, "rb");
+	if (!bio) {
+		ERR_clear_error();
+		return NULL;
+	}
+
+	crl = load_crl_from_bio(bio);
+	if (!crl) {
+		ERR_clear_error();
+		return NULL;
+	}
+
+	/* without a next update the CRL is always downloaded again */
+	next = X509_CRL_get0_nextUpdate(crl);
+	if (!next || X509_cmp_current_time(next) <= 0) {
+		g_debug("Cached CRL '%s' for '%s' is outdated", path, url);
+		return NULL;
+	}
+
+	g_debug("Using cached CRL '%s' for '%s'", path, url);
+	return g_steal_pointer(&crl);
+}
+
+/* Errors are ignored as the cache is only an optimization */
+static void crl_cache_store(const gchar *url, const GByteArray *data)
+{
+	g_autofree gchar *path = NULL;
+	g_autoptr(GError) err = NULL;
+
+	if (!crl_cache_dir)
+		return;
+
+	if (g_mkdir_with_parents(crl_cache_dir, 0700) != 0) {
+		g_debug("Cannot create CRL cache '%s': %s", crl_cache_dir,
+			g_strerror(errno));
+		return;
+	}
+
+	/* g_file_set_contents replaces the file atomically */
+	path = crl_cache_path(url);
+	if (!g_file_set_contents(path, (const gchar *)data->data,
+				 (gssize)data->len, &err))
+		g_debug("Cannot cache CRL for '%s': %s", url, err->message);
+}
+
 static gint load_crl_from_web(const gchar *url, X509_CRL **crl, GError **err)
 {
 	g_autoptr(X509_CRL) tmp_crl = NULL;
 	g_autoptr(GByteArray) data = NULL;
 	g_assert(crl);
 
+	tmp_crl = crl_cache_lookup(url);
+	if (tmp_crl) {
+		*crl = g_steal_pointer(&tmp_crl);
+		return 0;
+	}
+
+	if (crl_cache_offline) {
+		g_set_error(err, PV_CRYPTO_ERROR,
+			    PV_CRYPTO_ERROR_CRL_DOWNLOAD_FAILED,
+			    _("no cached CRL for '%s' in offline mode"), url);
+		return -1;
+	}
+
 	data = curl_download(url, CRL_DOWNLOAD_TIMEOUT_MS,
 			     CRL_DOWNLOAD_MAX_SIZE, err);
 	if (!data) {
@@ -492,6 +592,7 @@ static gint load_crl_from_web(const gchar *url, X509_CRL **crl, GError **err)
 			    _("unable to load CRL from '%s'"), url);
 		return -1;
 	}
+	crl_cache_store(url, data);
 	*crl = g_steal_pointer(&tmp_crl);
 	return 0;
 }
@@ -1283,6 +1384,7 @@ void pv_crypto_cleanup(void)
 	if (!digicert_assured_id_root_ca)
 		return;
 	g_clear_pointer(&cached_crls, g_hash_table_destroy);
+	g_clear_pointer(&crl_cache_dir, g_free);
 	g_clear_pointer(&digicert_assured_id_root_ca, ASN1_OCTET_STRING_free);
 }
 
@@ -1944,52 +2046,291 @@ Buffer *decrypt_buf(const struct cipher_parms *parms, const Buffer *in,
 	return __encrypt_decrypt_buffer(parms, in, FALSE, err);
 }
 
-static gint __encrypt_decrypt_file(const struct cipher_parms *parms,
-				   const gchar *path_in, const gchar *path_out,
-				   gsize *size_in, gsize *size_out, gboolean encrypt,
-				   GError **err)
+/* Number of pages a worker thread processes at once */
+#define FILE_CHUNK_PAGES 256
+
+struct file_pages_job {
+	const struct cipher_parms *parms; /* NULL if no encryption is done */
+	const gchar *path_in;
+	const gchar *path_out;
+	gint fd_in;
+	gint fd_out;
+	uint64_t offset_out;
+	gsize size_in;
+	guint64 num_pages;
+	guint num_chunks;
+	gint next_chunk;
+	gint failed;
+	EVP_MD_CTX *md_ctx;
+	guint next_digest_chunk; /* protected by @digest_mutex */
+	GMutex digest_mutex;
+	GCond digest_cond;
+	GMutex err_mutex;
+	GError *err;
+};
+
+/* Adds @offset to the big-endian tweak @tweak */
+static void xts_tweak_add(guchar *tweak, gsize tweak_size, guint64 offset)
+{
+	guint carry = 0;
+	guint sum;
+	gsize i;
+
+	for (i = tweak_size; i > 0 && (offset || carry); i--) {
+		sum = (guint)tweak[i - 1] + (guint)(offset & 0xff) + carry;
+		tweak[i - 1] = (guchar)(sum & 0xff);
+		carry = sum >> 8;
+		offset >>= 8;
+	}
+}
+
+/* Records the first error of all workers and stops the other workers */
+G_GNUC_PRINTF(2, 3)
+static void file_pages_job_set_error(struct file_pages_job *job,
+				     const gchar *format, ...)
+{
+	va_list args;
+
+	g_atomic_int_set(&job->failed, 1);
+	g_mutex_lock(&job->err_mutex);
+	if (!job->err) {
+		va_start(args, format);
+		job->err = g_error_new_valist(PV_CRYPTO_ERROR,
+					      PV_CRYPTO_ERROR_INTERNAL, format,
+					      args);
+		va_end(args);
+	}
+	g_mutex_unlock(&job->err_mutex);
+
+	/* wake up the workers waiting for their turn to update the digest */
+	g_mutex_lock(&job->digest_mutex);
+	g_cond_broadcast(&job->digest_cond);
+	g_mutex_unlock(&job->digest_mutex);
+}
+
+/* The digest must be computed over the pages in the order of the file.
+ * Chunks are taken in ascending order, therefore a worker only has to wait
+ * until the previous chunks are hashed by the other workers.
+ */
+static gint file_pages_job_digest(struct file_pages_job *job, guint chunk,
+				  const guchar *data, gsize size)
 {
-	g_autoptr(BIO) b_out = NULL;
-	g_autoptr(BIO) b_in = NULL;
+	gint rc = -1;
 
-	b_in = BIO_new_file(path_in, "rb");
-	if (!b_in) {
-		g_set_error(err, PV_CRYPTO_ERROR,
-			    PV_CRYPTO_ERROR_READ_CERTIFICATE,
-			    _("Failed to read file '%s'"), path_in);
-		return -1;
+	g_mutex_lock(&job->digest_mutex);
+	while (job->next_digest_chunk != chunk &&
+	       !g_atomic_int_get(&job->failed))
+		g_cond_wait(&job->digest_cond, &job->digest_mutex);
+	if (!g_atomic_int_get(&job->failed)) {
+		rc = EVP_DigestUpdate(job->md_ctx, data, size);
+		job->next_digest_chunk++;
+		g_cond_broadcast(&job->digest_cond);
 	}
+	g_mutex_unlock(&job->digest_mutex);
 
-	b_out = BIO_new_file(path_out, "wb");
-	if (!b_out) {
-		g_set_error(err, PV_CRYPTO_ERROR,
-			    PV_CRYPTO_ERROR_READ_CERTIFICATE,
-			    _("Failed to write file '%s'"), path_out);
-		return -1;
+	if (rc == 0)
+		file_pages_job_set_error(job, _("EVP_DigestUpdate failed"));
+	return rc == 1 ? 0 : -1;
+}
+
+/* Pads, encrypts, hashes and writes the chunks of a file until all chunks
+ * are taken. Each page is a separate XTS data unit whose tweak is the
+ * initial tweak plus the page offset, exactly as in __encrypt_decrypt_bio.
+ * Therefore, the pages can be encrypted in any order and by multiple threads
+ * at once.
+ */
+static gpointer file_pages_worker(gpointer data)
+{
+	struct file_pages_job *job = data;
+	const struct cipher_parms *parms = job->parms;
+	g_autoptr(EVP_CIPHER_CTX) ctx = NULL;
+	g_autofree guchar *tmp_tweak = NULL;
+	g_autofree guchar *in_buf = NULL;
+	g_autofree guchar *out_buf = NULL;
+	guint64 first_page, num_pages, i;
+	gsize chunk_size, offset, len;
+	ssize_t num_bytes;
+	gint chunk, out_len;
+
+	if (parms) {
+		ctx = EVP_CIPHER_CTX_new();
+		if (!ctx)
+			g_abort();
+
+		if (EVP_CipherInit_ex(ctx, parms->cipher, NULL,
+				      parms->key->data,
+				      parms->iv_or_tweak->data, 1) != 1) {
+			file_pages_job_set_error(job,
+						 _("EVP_CipherInit_ex failed"));
+			return NULL;
+		}
+
+		tmp_tweak = g_malloc0(parms->iv_or_tweak->size);
+		out_buf = g_malloc(FILE_CHUNK_PAGES * PAGE_SIZE);
 	}
+	in_buf = g_malloc(FILE_CHUNK_PAGES * PAGE_SIZE);
 
-	if (__encrypt_decrypt_bio(parms, b_in, b_out, size_in, size_out,
-				  encrypt, err) < 0)
-		return -1;
+	while (!g_atomic_int_get(&job->failed)) {
+		chunk = g_atomic_int_add(&job->next_chunk, 1);
+		if (chunk < 0 || (guint)chunk >= job->num_chunks)
+			break;
 
-	return 0;
-}
+		first_page = (guint64)chunk * FILE_CHUNK_PAGES;
+		num_pages = MIN(job->num_pages - first_page,
+				(guint64)FILE_CHUNK_PAGES);
+		chunk_size = (gsize)num_pages * PAGE_SIZE;
+		offset = (gsize)first_page * PAGE_SIZE;
+
+		/* the last page is padded with zeros */
+		memset(in_buf, 0, chunk_size);
+		len = 0;
+		while (offset + len < job->size_in && len < chunk_size) {
+			num_bytes = pread(job->fd_in, in_buf + len,
+					  MIN(chunk_size,
+					      job->size_in - offset) - len,
+					  (off_t)(offset + len));
+			if (num_bytes < 0 && errno == EINTR)
+				continue;
+			if (num_bytes <= 0) {
+				file_pages_job_set_error(job,
+							 _("Failed to read file '%s'"),
+							 job->path_in);
+				return NULL;
+			}
+			len += (gsize)num_bytes;
+		}
 
-gint encrypt_file(const struct cipher_parms *parms, const gchar *path_in,
-		  const gchar *path_out, gsize *in_size, gsize *out_size,
-		  GError **err)
-{
-	return __encrypt_decrypt_file(parms, path_in, path_out, in_size,
-				      out_size, TRUE, err);
+		for (i = 0; parms && i < num_pages; i++) {
+			const Buffer *tweak = parms->iv_or_tweak;
+
+			memcpy(tmp_tweak, tweak->data, tweak->size);
+			xts_tweak_add(tmp_tweak, tweak->size,
+				      (first_page + i) * PAGE_SIZE);
+
+			if (EVP_CipherInit_ex(ctx, NULL, NULL, NULL, tmp_tweak,
+					      1) != 1 ||
+			    EVP_CipherUpdate(ctx, out_buf + i * PAGE_SIZE,
+					     &out_len, in_buf + i * PAGE_SIZE,
+					     (gint)PAGE_SIZE) != 1 ||
+			    out_len != (gint)PAGE_SIZE) {
+				file_pages_job_set_error(job,
+							 _("EVP_CipherUpdate failed"));
+				return NULL;
+			}
+		}
+
+		len = 0;
+		while (len < chunk_size) {
+			num_bytes = pwrite(job->fd_out,
+					   (parms ? out_buf : in_buf) + len,
+					   chunk_size - len,
+					   (off_t)(job->offset_out + offset +
+						   len));
+			if (num_bytes < 0 && errno == EINTR)
+				continue;
+			if (num_bytes <= 0) {
+				file_pages_job_set_error(job,
+							 _("Failed to write file '%s'"),
+							 job->path_out);
+				return NULL;
+			}
+			len += (gsize)num_bytes;
+		}
+
+		if (job->md_ctx &&
+		    file_pages_job_digest(job, (guint)chunk,
+					  parms ? out_buf : in_buf,
+					  chunk_size) < 0)
+			return NULL;
+	}
+
+	return NULL;
 }
 
-G_GNUC_UNUSED static gint decrypt_file(const struct cipher_parms *parms,
-				       const gchar *path_in, const gchar *path_out,
-				       gsize *in_size, gsize *out_size,
-				       GError **err)
-{
-	return __encrypt_decrypt_file(parms, path_in, path_out, in_size,
-				      out_size, FALSE, err);
+/* Reads the file @path_in, pads it with zeros to a multiple of PAGE_SIZE,
+ * encrypts it with AES-XTS if @parms is given, updates @md_ctx with the
+ * resulting pages if given and writes them to @fd_out at @offset_out. All of
+ * this is done in a single pass over the input by multiple threads. The
+ * encryption result is the same as with __encrypt_decrypt_bio.
+ */
+gint pad_encrypt_and_digest_file(const struct cipher_parms *parms,
+				 const gchar *path_in, gint fd_out,
+				 const gchar *path_out, uint64_t offset_out,
+				 EVP_MD_CTX *md_ctx, gsize *size_in,
+				 gsize *size_out, GError **err)
+{
+	struct file_pages_job job = {
+		.parms = parms,
+		.path_in = path_in,
+		.path_out = path_out,
+		.fd_in = -1,
+		.fd_out = fd_out,
+		.offset_out = offset_out,
+		.md_ctx = md_ctx,
+	};
+	g_autofree GThread **threads = NULL;
+	guint num_threads, i;
+	struct stat st_buf;
+	gint ret = -1;
+
+	if (parms) {
+		g_assert(EVP_CIPHER_mode(parms->cipher) == EVP_CIPH_XTS_MODE);
+		g_assert(parms->key);
+		g_assert(parms->iv_or_tweak);
+		g_assert(parms->iv_or_tweak->size <= INT_MAX);
+	}
+
+	g_mutex_init(&job.digest_mutex);
+	g_cond_init(&job.digest_cond);
+	g_mutex_init(&job.err_mutex);
+
+	job.fd_in = open(path_in, O_RDONLY);
+	if (job.fd_in < 0 || fstat(job.fd_in, &st_buf) != 0) {
+		g_set_error(err, PV_CRYPTO_ERROR,
+			    PV_CRYPTO_ERROR_READ_CERTIFICATE,
+			    _("Failed to read file '%s'"), path_in);
+		goto out;
+	}
+	/* the chunks are read in ascending order, a larger read-ahead
+	 * keeps the workers busy (errors are not fatal)
+	 */
+	(void)posix_fadvise(job.fd_in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	/* An empty file results in one page of zeros */
+	job.size_in = (gsize)st_buf.st_size;
+	job.num_pages = MAX((job.size_in + PAGE_SIZE - 1) / PAGE_SIZE, 1);
+	job.num_chunks = (guint)((job.num_pages + FILE_CHUNK_PAGES - 1) /
+				 FILE_CHUNK_PAGES);
+
+	num_threads = MIN(g_get_num_processors(), job.num_chunks);
+	threads = g_new0(GThread *, num_threads);
+	/* the calling thread is the first worker */
+	for (i = 1; i < num_threads; i++) {
+		threads[i] = g_thread_try_new("pages", file_pages_worker, &job,
+					      NULL);
+		/* the workers already running process all chunks */
+		if (!threads[i])
+			break;
+	}
+	file_pages_worker(&job);
+	for (i = 1; i < num_threads && threads[i]; i++)
+		g_thread_join(threads[i]);
+
+	if (job.err) {
+		g_propagate_error(err, job.err);
+		goto out;
+	}
+
+	*size_in = job.size_in;
+	*size_out = (gsize)job.num_pages * PAGE_SIZE;
+	ret = 0;
+out:
+	if (job.fd_in >= 0)
+		close(job.fd_in);
+	g_mutex_clear(&job.err_mutex);
+	g_cond_clear(&job.digest_cond);
+	g_mutex_clear(&job.digest_mutex);
+	return ret;
 }
 
 /* GCM mode uses (zero-)padding */
@@ -150,6 +150,7 @@ X509_STORE_CTX *create_store_ctx(X509_STORE *trusted, STACK_OF_X509 *chain,
 gint verify_cert(X509 *cert, X509_STORE_CTX *ctx, GError **err);
 X509_CRL *get_first_valid_crl(X509_STORE_CTX *ctx, X509 *cert, GError **err);
 void store_setup_crl_download(X509_STORE *st);
+void setup_crl_cache(const gchar *cache_dir, gboolean offline);
 EVP_PKEY *read_ec_pubkey_cert(X509 *cert, gint nid, GError **err);
 
 Buffer *compute_exchange_key(EVP_PKEY *cust, EVP_PKEY *host, GError **err);
@@ -164,9 +165,11 @@ Buffer *sha256_buffer(const Buffer *buf, GError **err);
 int64_t gcm_encrypt(const Buffer *in, const Buffer *aad,
 		    const struct cipher_parms *parms, Buffer *out,
 		    Buffer *tag, GError **err);
-gint encrypt_file(const struct cipher_parms *parms, const gchar *in_path,
-		  const gchar *path_out, gsize *in_size, gsize *out_size,
-		  GError **err);
+gint pad_encrypt_and_digest_file(const struct cipher_parms *parms,
+				 const gchar *path_in, gint fd_out,
+				 const gchar *path_out, uint64_t offset_out,
+				 EVP_MD_CTX *md_ctx, gsize *size_in,
+				 gsize *size_out, GError **err);
 Buffer *encrypt_buf(const struct cipher_parms *parms, const Buffer *in,
 		    GError **err);
 G_GNUC_UNUSED Buffer *decrypt_buf(const struct cipher_parms *parms,
@@ -15,6 +15,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "pv/pv_error.h"
 
@@ -106,129 +107,101 @@ gint file_write(FILE *out, const void *ptr, gsize size, gsize count,
 	return 0;
 }
 
-static gint file_seek(FILE *f, uint64_t offset, GError **err)
+#define FILE_COPY_BUF_SIZE (1024 * 1024)
+
+/* Writes all @size bytes of @ptr to @fd at @offset */
+gint file_pwrite(gint fd, const void *ptr, gsize size, uint64_t offset,
+		 GError **err)
 {
-	gint rc;
+	const guchar *data = ptr;
+	ssize_t num_bytes;
+	gsize len = 0;
 
-	if (offset > LONG_MAX) {
+	if (offset > (uint64_t)G_MAXINT64 - size) {
 		g_set_error(err, PV_ERROR, 0, _("Offset is too large"));
 		return -1;
 	}
 
-	rc = fseek(f, (long)offset, SEEK_SET);
-	if (rc != 0) {
-		g_set_error(err, G_FILE_ERROR,
-			    (gint)g_file_error_from_errno(errno),
-			    _("Failed to seek: '%s'"), g_strerror(errno));
-		return -1;
+	while (len < size) {
+		num_bytes = pwrite(fd, data + len, size - len,
+				   (off_t)(offset + len));
+		if (num_bytes < 0 && errno == EINTR)
+			continue;
+		if (num_bytes <= 0) {
+			g_set_error(err, G_FILE_ERROR,
+				    (gint)g_file_error_from_errno(errno),
+				    _("Failed to write file: %s"),
+				    g_strerror(errno));
+			return -1;
+		}
+		len += (gsize)num_bytes;
 	}
 
 	return 0;
 }
 
-gint seek_and_write_file(FILE *o, const CompFile *ifile, uint64_t offset,
-			 GError **err)
+/* Copies @size bytes at @offset of @fd_in to the same offset of @fd_out.
+ * copy_file_range() allows the file system to share the data blocks, if
+ * it is not supported the data is copied.
+ */
+gint file_copy_range(gint fd_in, gint fd_out, uint64_t offset, uint64_t size,
+		     GError **err)
 {
-	gsize bytes_read, bytes_written;
-	gsize total_bytes_read = 0;
-	FILE *i = NULL;
-	gchar buf[4096];
-	gint ret = -1;
-
-	if (file_seek(o, offset, err) < 0)
-		return -1;
+	g_autofree guchar *buf = NULL;
+	loff_t off_in = (loff_t)offset;
+	loff_t off_out = (loff_t)offset;
+	uint64_t len = 0;
+	ssize_t num_bytes;
 
-	i = file_open(ifile->path, "rb", err);
-	if (!i)
+	if (offset > (uint64_t)G_MAXINT64 - size) {
+		g_set_error(err, PV_ERROR, 0, _("Offset is too large"));
 		return -1;
-
-	do {
-		if (file_read(i, buf, 1, sizeof(buf), &bytes_read, err) < 0) {
-			g_prefix_error(err, _("Failed to read file '%s': "),
-				       ifile->path);
-			goto err;
-		}
-
-		if (bytes_read == 0)
-			break;
-
-		total_bytes_read += bytes_read;
-
-		if (file_write(o, buf, bytes_read, 1, &bytes_written, err) < 0)
-			goto err;
-	} while (bytes_written != 0);
-
-	if (ifile->size != total_bytes_read) {
-		g_set_error(err, PV_ERROR, PV_ERROR_INTERNAL,
-			    _("'%s' has changed during the preparation"),
-			    ifile->path);
-		goto err;
 	}
 
-	ret = 0;
-err:
-	fclose(i);
-	return ret;
-}
-
-gint seek_and_write_buffer(FILE *o, const Buffer *buf, uint64_t offset,
-			   GError **err)
-{
-	if (file_seek(o, offset, err) < 0)
-		return -1;
-
-	if (buffer_write(buf, o, err) < 0)
-		return -1;
-
-	return 0;
-}
-
-gint pad_file_right(const gchar *path_out, const gchar *path_in, gsize *size_out,
-		    guint padding, GError **err)
-{
-	FILE *f_in, *f_out = NULL;
-	guchar buf[padding];
-	gsize num_bytes_written;
-	gsize num_bytes_read;
-	uint64_t size_in = 0;
-	gint ret = -1;
-
-	*size_out = 0;
-	f_in = file_open(path_in, "rb", err);
-	if (!f_in)
-		goto err;
-
-	f_out = file_open(path_out, "wb", err);
-	if (!f_out)
-		goto err;
-
-	do {
-		memset(buf, 0, sizeof(buf));
-
-		if (file_read(f_in, buf, 1, sizeof(buf), &num_bytes_read, err) < 0) {
-			g_prefix_error(err, _("Failed to read file '%s': "),
-				       path_in);
-			goto err;
+	while (len < size) {
+		num_bytes = copy_file_range(fd_in, &off_in, fd_out, &off_out,
+					    (gsize)MIN(size - len, G_MAXSSIZE),
+					    0);
+		if (num_bytes < 0 && errno == EINTR)
+			continue;
+		if (num_bytes < 0 &&
+		    (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+		     errno == EOPNOTSUPP))
+			break;
+		if (num_bytes <= 0) {
+			g_set_error(err, G_FILE_ERROR,
+				    (gint)g_file_error_from_errno(errno),
+				    _("Failed to copy file: %s"),
+				    num_bytes < 0 ? g_strerror(errno) :
+						    _("unexpected end of file"));
+			return -1;
 		}
+		len += (uint64_t)num_bytes;
+	}
 
-		size_in += num_bytes_read;
-
-		if (file_write(f_out, buf, 1, sizeof(buf), &num_bytes_written, err)) {
-			g_prefix_error(err, _("Failed to write file '%s': "),
-				       path_out);
-			goto err;
+	/* fallback if copy_file_range is not supported */
+	buf = g_malloc(FILE_COPY_BUF_SIZE);
+	while (len < size) {
+		gsize count = (gsize)MIN(size - len, FILE_COPY_BUF_SIZE);
+
+		num_bytes = pread(fd_in, buf, count, (off_t)(offset + len));
+		if (num_bytes < 0 && errno == EINTR)
+			continue;
+		if (num_bytes <= 0) {
+			g_set_error(err, G_FILE_ERROR,
+				    (gint)g_file_error_from_errno(errno),
+				    _("Failed to copy file: %s"),
+				    num_bytes < 0 ? g_strerror(errno) :
+						    _("unexpected end of file"));
+			return -1;
 		}
 
-		*size_out += num_bytes_written;
-	} while (num_bytes_read == padding);
+		if (file_pwrite(fd_out, buf, (gsize)num_bytes, offset + len,
+				err) < 0)
+			return -1;
 
-	g_assert(num_bytes_written == ALIGN(num_bytes_read, padding));
+		len += (uint64_t)num_bytes;
+	}
 
-	ret = 0;
-err:
-	if (f_out)
-		fclose(f_out);
-	if (f_in)
-		fclose(f_in);
-	return ret;
+	return 0;
 }
@@ -0,0 +1,9 @@
+#define main daemon_main
+#include "/root/repo/cpacfstats/cpacfstatsd.c"
+#undef main
+int main(int argc, char **argv)
+{
+	struct ucred me = { .uid = 1000, .gid = 1000 }, other = { .uid = 1001, .gid = 1000 };
+	printf("1000->sleep %d 1001->sleep %d\n", check_pid_access(&me, atoi(argv[1])), check_pid_access(&other, atoi(argv[1])));
+	return 0;
+}
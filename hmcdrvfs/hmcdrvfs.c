@@ -43,13 +43,18 @@
  */
 #define HMCDRV_FUSE_CACHE_TMOFS 30
 
-/* size of file name/attributes cache (should be a prime number)
+/* initial number of hash table lines of file name/attributes cache (must be
+ * a power of two), the table grows with the number of cached files
  */
-#define HMCDRV_FUSE_CACHE_SIZE	2053
+#define HMCDRV_FUSE_CACHE_SIZE	2048
 
-/* number of hash table lines inspected in a single garbage loop
+/* max. number of files in cache, least recently used files are evicted
  */
-#define HMCDRV_FUSE_GARBAGE_MAX 128
+#define HMCDRV_FUSE_CACHE_MAX	(128 * 1024)
+
+/* max. number of expired cache entries freed in a single garbage loop
+ */
+#define HMCDRV_FUSE_GARBAGE_MAX 1024
 
 /* max. size of FTP 'dir <path>' output chunk size
  */
@@ -59,6 +64,18 @@
  */
 #define HMCDRV_FUSE_DIRBUF_LEN	(HMCDRV_FUSE_DIRBUF_SIZE - 1)
 
+/* size of a file content block read with a single FTP 'get' (power of two)
+ */
+#define HMCDRV_FUSE_BLKSIZE	(1024 * 1024)
+
+/* number of blocks in file content cache
+ */
+#define HMCDRV_FUSE_BLKCNT	16
+
+/* number of blocks read ahead on sequential file access
+ */
+#define HMCDRV_FUSE_RDAHEAD	4
+
 
 /* pointer to path (token) in FTP command string associated with file 'fp'
  */
@@ -139,6 +156,9 @@ struct hmcdrv_fuse_context {
 	struct stat st; /* mount point stat attributes */
 	time_t ctmo; /* cache timeout (derived from entry/attr_timeout) */
 	pthread_t tid; /* cache aging thread ID */
+	pthread_t rdtid; /* read-ahead thread ID */
+	int rdahead; /* read-ahead thread is running */
+	pthread_cond_t rdcond; /* read-ahead request condition */
 	pthread_mutex_t mutex; /* cache access mutex */
 	pid_t pid; /* PID of main() */
 	char *abmon[12]; /* abbreviated month name of HMC locale */
@@ -151,14 +171,46 @@ struct hmcdrv_fuse_context {
  */
 struct hmcdrv_fuse_file {
 	struct hmcdrv_fuse_file *next; /* collision list (equal hash) */
+	struct hmcdrv_fuse_file *lru_prev; /* next recently used file */
+	struct hmcdrv_fuse_file *lru_next; /* next least recently used file */
+	unsigned int hash; /* hash value of path */
 	struct stat st; /* stat structure of this file */
 	char *symlnk; /* pointer to path name of symlink target (S_IFLNK) */
 	time_t timeout; /* cache timeout for this file */
+	time_t listed; /* directory listing in cache is complete until */
+	unsigned long listed_gen; /* eviction count at time of listing */
 	size_t cmdlen; /* length of FTP command + path */
 	char ftpcmd[0]; /* FTP command + path (max HMCDRV_FUSE_MAXCMDLEN) */
 };
 
 
+/*
+ * file content cache block
+ */
+struct hmcdrv_fuse_block {
+	char path[HMCDRV_FUSE_MAXPATH]; /* file path (empty if unused) */
+	time_t mtime; /* modification time of file */
+	off_t offset; /* file offset of block */
+	size_t len; /* number of bytes in block (less at end of file) */
+	unsigned long used; /* LRU stamp */
+	char *data; /* block data (HMCDRV_FUSE_BLKSIZE bytes) */
+};
+
+
+/*
+ * file content cache and sequential read detection
+ */
+struct hmcdrv_fuse_content {
+	struct hmcdrv_fuse_block blk[HMCDRV_FUSE_BLKCNT]; /* cached blocks */
+	unsigned long stamp; /* current LRU stamp */
+	char seqpath[HMCDRV_FUSE_MAXPATH]; /* path of last read */
+	off_t seqnext; /* file offset following last read */
+	char rdpath[HMCDRV_FUSE_MAXPATH]; /* path of file to read ahead */
+	off_t rdoffset; /* offset of next block to read ahead */
+	int rdcnt; /* number of blocks still to read ahead */
+};
+
+
 /*
  * all file attributes accumulated from interpreting tokens/fields of 'dir'
  * command listing
@@ -195,7 +247,22 @@ static const char *const hmcdrv_fuse_logsevname[] = {
 /*
  * file attributes cache
  */
-static struct hmcdrv_fuse_file *hmcdrv_fuse_cache[HMCDRV_FUSE_CACHE_SIZE];
+struct hmcdrv_fuse_cache {
+	struct hmcdrv_fuse_file **table; /* hash table (collision lists) */
+	unsigned int size; /* number of hash table lines (power of two) */
+	unsigned int count; /* number of files in cache */
+	struct hmcdrv_fuse_file *lru_first; /* most recently used file */
+	struct hmcdrv_fuse_file *lru_last; /* least recently used file */
+	unsigned long evictions; /* number of LRU evictions */
+};
+
+static struct hmcdrv_fuse_cache hmcdrv_fuse_cache;
+
+
+/*
+ * file content cache
+ */
+static struct hmcdrv_fuse_content hmcdrv_fuse_content;
 
 
 /*
@@ -234,31 +301,79 @@ static void hmcdrv_fuse_log(int sev, const char *fmt, ...)
 
 
 /*
- * calculate a hash value from a file path
+ * calculate a hash value from a file path (FNV-1a)
  */
 static unsigned int hmcdrv_hash_path(const char *path)
 {
-	unsigned int hash = ~0;
-	int len = strlen(path);
-
-	while (len > 0) {
-		hash += (unsigned) *path;
+	unsigned int hash = 2166136261U;
 
+	while (*path != '\0') {
+		hash ^= (unsigned char) *path;
+		hash *= 16777619U;
 		++path;
-		--len;
 	}
 
-	hash %= HMCDRV_FUSE_CACHE_SIZE;
 	return hash;
 }
 
 
+/*
+ * return the storage location of the first file in collision list of hash
+ */
+static struct hmcdrv_fuse_file **hmcdrv_cache_line(unsigned int hash)
+{
+	return &hmcdrv_fuse_cache.table[hash & (hmcdrv_fuse_cache.size - 1)];
+}
+
+
+/*
+ * remove cache entry from LRU list
+ */
+static void hmcdrv_cache_lru_del(struct hmcdrv_fuse_file *fp)
+{
+	if (fp->lru_prev != NULL)
+		fp->lru_prev->lru_next = fp->lru_next;
+	else
+		hmcdrv_fuse_cache.lru_first = fp->lru_next;
+
+	if (fp->lru_next != NULL)
+		fp->lru_next->lru_prev = fp->lru_prev;
+	else
+		hmcdrv_fuse_cache.lru_last = fp->lru_prev;
+}
+
+
+/*
+ * add cache entry as most recently used one to LRU list
+ */
+static void hmcdrv_cache_lru_add(struct hmcdrv_fuse_file *fp)
+{
+	fp->lru_prev = NULL;
+	fp->lru_next = hmcdrv_fuse_cache.lru_first;
+
+	if (fp->lru_next != NULL)
+		fp->lru_next->lru_prev = fp;
+	else
+		hmcdrv_fuse_cache.lru_last = fp;
+
+	hmcdrv_fuse_cache.lru_first = fp;
+}
+
+
 /*
  * restart of cache entry aging time
+ *
+ * Note: All entries have the same aging time, so the LRU list is also
+ *       sorted by timeout.
  */
 static void hmcdrv_cache_trestart(struct hmcdrv_fuse_file *fp)
 {
 	fp->timeout = time(NULL) + hmcdrv_ctx.ctmo;
+
+	if (hmcdrv_fuse_cache.lru_first != fp) {
+		hmcdrv_cache_lru_del(fp);
+		hmcdrv_cache_lru_add(fp);
+	}
 }
 
 
@@ -285,6 +400,77 @@ static void hmcdrv_cache_symlink(struct hmcdrv_fuse_file *fp,
 
 
 
+/*
+ * remove a file from cache and free it
+ */
+static void hmcdrv_cache_del(struct hmcdrv_fuse_file *fp)
+{
+	struct hmcdrv_fuse_file **pbase = hmcdrv_cache_line(fp->hash);
+
+	while (*pbase != fp)
+		pbase = &(*pbase)->next;
+
+	*pbase = fp->next;
+	hmcdrv_cache_lru_del(fp);
+	hmcdrv_cache_symlink(fp, NULL);
+	free(fp);
+	--hmcdrv_fuse_cache.count;
+}
+
+
+/*
+ * evict the least recently used file from cache (the root is never evicted)
+ */
+static void hmcdrv_cache_evict(void)
+{
+	struct hmcdrv_fuse_file *fp = hmcdrv_fuse_cache.lru_last;
+
+	if ((fp != NULL) && (strcmp(HMCDRV_FUSE_PATH(fp), "/") == 0))
+		fp = fp->lru_prev;
+
+	if (fp != NULL) {
+		hmcdrv_cache_del(fp);
+		++hmcdrv_fuse_cache.evictions;
+	}
+}
+
+
+/*
+ * double the number of hash table lines if there are more files than lines
+ *
+ * Note: If there is not enough memory the old table remains in use.
+ */
+static void hmcdrv_cache_grow(void)
+{
+	struct hmcdrv_fuse_file **table, **old = hmcdrv_fuse_cache.table;
+	unsigned int i, size = hmcdrv_fuse_cache.size;
+	struct hmcdrv_fuse_file *fp, *next;
+
+	if (hmcdrv_fuse_cache.count <= size)
+		return;
+
+	table = calloc(2 * size, sizeof(*table));
+
+	if (table == NULL)
+		return;
+
+	hmcdrv_fuse_cache.table = table;
+	hmcdrv_fuse_cache.size = 2 * size;
+
+	for (i = 0; i < size; ++i) {
+		for (fp = old[i]; fp != NULL; fp = next) {
+			next = fp->next;
+			fp->next = *hmcdrv_cache_line(fp->hash);
+			*hmcdrv_cache_line(fp->hash) = fp;
+		}
+	}
+
+	free(old);
+	HMCDRV_FUSE_DBGLOG("cache resized to %u lines",
+			   hmcdrv_fuse_cache.size);
+}
+
+
 /*
  * refresh the attributes of file/directory 'path'
  * note: if there is no cache entry for this file, then create one
@@ -292,9 +478,8 @@ static void hmcdrv_cache_symlink(struct hmcdrv_fuse_file *fp,
 static void hmcdrv_cache_refresh(const char *path, const struct stat *st,
 				const char *symlink)
 {
-	struct hmcdrv_fuse_file **pbase; /* storage location of fp */
 	struct hmcdrv_fuse_file *fp;
-	unsigned int index;
+	unsigned int hash;
 
 	int pathlen = strlen(path);
 
@@ -304,24 +489,26 @@ static void hmcdrv_cache_refresh(const char *path, const struct stat *st,
 		return;
 	}
 
-	index = hmcdrv_hash_path(path);
-	pbase = &hmcdrv_fuse_cache[index];
-	fp = *pbase;
+	hash = hmcdrv_hash_path(path);
+	fp = *hmcdrv_cache_line(hash);
 
 	while (fp != NULL) {
-		if (strcmp(HMCDRV_FUSE_PATH(fp), path) == 0) {
+		if ((fp->hash == hash) &&
+		    (strcmp(HMCDRV_FUSE_PATH(fp), path) == 0)) {
 			fp->st = *st;		   /* update file info */
 			hmcdrv_cache_symlink(fp, symlink);
 			hmcdrv_cache_trestart(fp); /* restart aging */
 			return;
 		}
 
-		pbase = &fp->next;
 		fp = fp->next;
 	}
 
 	/* entry does not exist so far - create new one
 	 */
+	if (hmcdrv_fuse_cache.count >= HMCDRV_FUSE_CACHE_MAX)
+		hmcdrv_cache_evict();
+
 	fp = malloc((offsetof(struct hmcdrv_fuse_file, ftpcmd) +
 		     HMCDRV_FUSE_OFSPATH + 1) + pathlen);
 
@@ -330,14 +517,19 @@ static void hmcdrv_cache_refresh(const char *path, const struct stat *st,
 				(offsetof(struct hmcdrv_fuse_file, ftpcmd) +
 				 HMCDRV_FUSE_OFSPATH + 1) + pathlen);
 	} else {
-		*pbase = fp;
+		fp->hash = hash;
+		fp->next = *hmcdrv_cache_line(hash);
+		*hmcdrv_cache_line(hash) = fp;
+		hmcdrv_cache_lru_add(fp);
+		++hmcdrv_fuse_cache.count;
 		fp->cmdlen = pathlen + HMCDRV_FUSE_OFSPATH;
 		fp->st = *st;
 		memcpy(HMCDRV_FUSE_PATH(fp), path, pathlen + 1);
 		fp->symlnk = NULL;
+		fp->listed = 0;
 		hmcdrv_cache_symlink(fp, symlink);
 		hmcdrv_cache_trestart(fp);
-		fp->next = NULL;
+		hmcdrv_cache_grow();
 	}
 }
 
@@ -347,11 +539,12 @@ static void hmcdrv_cache_refresh(const char *path, const struct stat *st,
  */
 static struct hmcdrv_fuse_file *hmcdrv_cache_find(const char *path)
 {
-	unsigned index = hmcdrv_hash_path(path);
-	struct hmcdrv_fuse_file *fp = hmcdrv_fuse_cache[index];
+	unsigned int hash = hmcdrv_hash_path(path);
+	struct hmcdrv_fuse_file *fp = *hmcdrv_cache_line(hash);
 
 	while (fp != NULL) {
-		if (strcmp(HMCDRV_FUSE_PATH(fp), path) == 0) {
+		if ((fp->hash == hash) &&
+		    (strcmp(HMCDRV_FUSE_PATH(fp), path) == 0)) {
 			hmcdrv_cache_trestart(fp);
 			return fp;
 		}
@@ -364,31 +557,27 @@ static struct hmcdrv_fuse_file *hmcdrv_cache_find(const char *path)
 
 
 /*
- * check for aging timeout of cache entry at index
+ * check whether the complete listing of the parent directory of 'path' is
+ * in cache, so 'path' does not exist if it is not found in cache
  */
-static void hmcdrv_cache_expire(unsigned index, time_t now)
+static int hmcdrv_cache_listed(const char *path)
 {
-	struct hmcdrv_fuse_file **pbase; /* storage location of fp */
-	struct hmcdrv_fuse_file *fp, *next;
+	struct hmcdrv_fuse_file *fp;
+	char *tmp;
 
-	pbase = &hmcdrv_fuse_cache[index];
-	fp = *pbase;
+	if (strcmp(path, "/") == 0)
+		return 0;
 
-	/* iterate the collision list */
-	while (fp != NULL) {
-		next = fp->next;
+	tmp = strdup(path); /* need a copy because of dirname() */
 
-		if ((fp->timeout <= now) &&
-		    (strcmp(HMCDRV_FUSE_PATH(fp), "/") != 0)) {
-			hmcdrv_cache_symlink(fp, NULL);
-			*pbase = next;
-			free(fp);
-		} else {
-			pbase = &fp->next;
-		}
+	if (tmp == NULL)
+		return 0;
 
-		fp = next;
-	}
+	fp = hmcdrv_cache_find(dirname(tmp));
+	free(tmp);
+
+	return (fp != NULL) && (fp->listed > time(NULL)) &&
+		(fp->listed_gen == hmcdrv_fuse_cache.evictions);
 }
 
 
@@ -397,25 +586,32 @@ static void hmcdrv_cache_expire(unsigned index, time_t now)
  */
 static void *hmcdrv_cache_aging(void *UNUSED(arg))
 {
+	struct hmcdrv_fuse_file *fp, *prev;
 	unsigned int cnt;
 	time_t now;
 
-	unsigned index = 0;
-
 	while (1) {
 		sleep(1);
 
 		pthread_mutex_lock(&hmcdrv_ctx.mutex);
 		now = time(NULL);
 
-		/* each second scan a number of cache entries
+		/* each second free a number of expired cache entries,
+		 * starting with the least recently used one
 		 */
-		for (cnt = 0; cnt < HMCDRV_FUSE_GARBAGE_MAX; ++cnt) {
+		fp = hmcdrv_fuse_cache.lru_last;
+
+		for (cnt = 0; (cnt < HMCDRV_FUSE_GARBAGE_MAX) && (fp != NULL);
+		     ++cnt) {
+			if (fp->timeout > now)
+				break;
 
-			hmcdrv_cache_expire(index, now);
+			prev = fp->lru_prev;
 
-			if (++index == HMCDRV_FUSE_CACHE_SIZE)
-				index = 0;
+			if (strcmp(HMCDRV_FUSE_PATH(fp), "/") != 0)
+				hmcdrv_cache_del(fp);
+
+			fp = prev;
 		}
 
 		pthread_mutex_unlock(&hmcdrv_ctx.mutex);
@@ -988,6 +1184,7 @@ static int hmcdrv_cache_dir(const char *dir, fuse_fill_dir_t filler, void *buf)
 			 */
 			if (*fname != '\0') {
 				hmcdrv_cache_refresh(path, &st, symlink);
+				hmcdrv_cache_trestart(fpdir); /* keep it */
 
 				if ((filler != NULL) &&
 				    (filler(buf, fname, &st, 0) != 0))
@@ -1034,6 +1231,13 @@ static int hmcdrv_cache_dir(const char *dir, fuse_fill_dir_t filler, void *buf)
 
 	free(dirbuf);
 
+	/* all files of this directory are in cache now
+	 */
+	if (dirlen == 0) {
+		fpdir->listed = time(NULL) + hmcdrv_ctx.ctmo;
+		fpdir->listed_gen = hmcdrv_fuse_cache.evictions;
+	}
+
 	/* restore old host timezone
 	 */
 	if (hmcdrv_ctx.opt.hmctz != NULL) {
@@ -1090,6 +1294,11 @@ static struct hmcdrv_fuse_file *hmcdrv_file_get(const char *path)
 	if (fp != NULL) /* path found in cache ? */
 		return fp;
 
+	/* a file that is not in a complete directory listing does not exist
+	 */
+	if (hmcdrv_cache_listed(path))
+		return NULL;
+
 	/* in very, very rare cases we must scan the parent again,
 	 * recursive up to the root directory
 	 */
@@ -1201,26 +1410,202 @@ static int hmcdrv_fuse_open(const char *UNUSED(path), struct fuse_file_info *fi)
 }
 
 
+/*
+ * search for a file content block in cache
+ */
+static struct hmcdrv_fuse_block *hmcdrv_block_find(struct hmcdrv_fuse_file *fp,
+						   off_t offset)
+{
+	struct hmcdrv_fuse_block *blk;
+	int i;
+
+	for (i = 0; i < HMCDRV_FUSE_BLKCNT; ++i) {
+		blk = &hmcdrv_fuse_content.blk[i];
+
+		if ((blk->offset == offset) &&
+		    (blk->mtime == fp->st.st_mtime) &&
+		    (strcmp(blk->path, HMCDRV_FUSE_PATH(fp)) == 0)) {
+			blk->used = ++hmcdrv_fuse_content.stamp;
+			return blk;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+ * read a file content block with a single FTP 'get' into the least
+ * recently used cache block
+ *
+ * Return: pointer to block, or NULL on error (with 'rc' set)
+ */
+static struct hmcdrv_fuse_block *hmcdrv_block_get(struct hmcdrv_fuse_file *fp,
+						  off_t offset, int *rc)
+{
+	struct hmcdrv_fuse_block *blk = hmcdrv_block_find(fp, offset);
+	ssize_t len;
+	int i;
+
+	if (blk != NULL)
+		return blk;
+
+	blk = &hmcdrv_fuse_content.blk[0];
+
+	for (i = 1; i < HMCDRV_FUSE_BLKCNT; ++i) {
+		if (hmcdrv_fuse_content.blk[i].used < blk->used)
+			blk = &hmcdrv_fuse_content.blk[i];
+	}
+
+	if (blk->data == NULL) {
+		blk->data = malloc(HMCDRV_FUSE_BLKSIZE);
+
+		if (blk->data == NULL) {
+			*rc = -ENOMEM;
+			return NULL;
+		}
+	}
+
+	blk->path[0] = '\0';
+	blk->len = 0;
+
+	while (blk->len < HMCDRV_FUSE_BLKSIZE) {
+		len = hmcdrv_ftp_cmd(fp, HMCDRV_FUSE_CMDID_GET,
+				     blk->data + blk->len,
+				     HMCDRV_FUSE_BLKSIZE - blk->len,
+				     offset + blk->len);
+
+		if (len < 0) {
+			*rc = len;
+			return NULL;
+		}
+
+		if (len == 0) /* end of file */
+			break;
+
+		blk->len += len;
+	}
+
+	util_strlcpy(blk->path, HMCDRV_FUSE_PATH(fp), sizeof(blk->path));
+	blk->mtime = fp->st.st_mtime;
+	blk->offset = offset;
+	blk->used = ++hmcdrv_fuse_content.stamp;
+	return blk;
+}
+
+
+/*
+ * release cache access mutex (cancellation cleanup handler)
+ */
+static void hmcdrv_rdahead_unlock(void *mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+
+/*
+ * read-ahead handler thread
+ *
+ * Note: The thread can only be canceled while waiting for a request.
+ */
+static void *hmcdrv_rdahead(void *UNUSED(arg))
+{
+	struct hmcdrv_fuse_block *blk;
+	struct hmcdrv_fuse_file *fp;
+	int rc;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	pthread_mutex_lock(&hmcdrv_ctx.mutex);
+	pthread_cleanup_push(hmcdrv_rdahead_unlock, &hmcdrv_ctx.mutex);
+
+	while (1) {
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+
+		while (hmcdrv_fuse_content.rdcnt == 0)
+			pthread_cond_wait(&hmcdrv_ctx.rdcond,
+					  &hmcdrv_ctx.mutex);
+
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		--hmcdrv_fuse_content.rdcnt;
+		fp = hmcdrv_file_get(hmcdrv_fuse_content.rdpath);
+		blk = NULL;
+
+		if (fp != NULL)
+			blk = hmcdrv_block_get(fp,
+					       hmcdrv_fuse_content.rdoffset,
+					       &rc);
+
+		if ((blk == NULL) || (blk->len < HMCDRV_FUSE_BLKSIZE))
+			hmcdrv_fuse_content.rdcnt = 0; /* stop at end of file */
+
+		hmcdrv_fuse_content.rdoffset += HMCDRV_FUSE_BLKSIZE;
+
+		/* let FUSE read requests in between two blocks
+		 */
+		pthread_mutex_unlock(&hmcdrv_ctx.mutex);
+		pthread_mutex_lock(&hmcdrv_ctx.mutex);
+	}
+
+	pthread_cleanup_pop(1);
+	return NULL;
+}
+
+
 /*
  * read a file on FUSE.HMCDRVFS filesystem
+ *
+ * Note: All data is read in blocks of HMCDRV_FUSE_BLKSIZE bytes via the
+ *       content cache. On sequential reads the following blocks are read
+ *       ahead by the read-ahead thread.
  */
 static int hmcdrv_fuse_read(const char *path, char *buf, size_t size,
 			    off_t offset, struct fuse_file_info *UNUSED(fi))
 {
+	struct hmcdrv_fuse_block *blk = NULL;
 	struct hmcdrv_fuse_file *fp;
-	int rc;
+	size_t done = 0, len;
+	off_t blkofs = 0;
+	int rc = 0;
 
 	pthread_mutex_lock(&hmcdrv_ctx.mutex);
 	fp = hmcdrv_file_get(path);
 
-	if (fp == NULL)
-		rc = -ENOENT;
-	else
-		rc = hmcdrv_ftp_cmd(fp, HMCDRV_FUSE_CMDID_GET,
-				    buf, size, offset);
+	if (fp == NULL) {
+		pthread_mutex_unlock(&hmcdrv_ctx.mutex);
+		return -ENOENT;
+	}
+
+	while (done < size) {
+		blkofs = (offset + done) & ~((off_t) HMCDRV_FUSE_BLKSIZE - 1);
+		blk = hmcdrv_block_get(fp, blkofs, &rc);
+
+		if (blk == NULL)
+			break;
+
+		if ((size_t) (offset + done - blkofs) >= blk->len)
+			break; /* end of file */
+
+		len = MIN(size - done, blk->len - (offset + done - blkofs));
+		memcpy(buf + done, blk->data + (offset + done - blkofs), len);
+		done += len;
+	}
+
+	if ((done > 0) && hmcdrv_ctx.rdahead &&
+	    (offset == hmcdrv_fuse_content.seqnext) &&
+	    (strcmp(path, hmcdrv_fuse_content.seqpath) == 0) &&
+	    (blk != NULL) && (blk->len == HMCDRV_FUSE_BLKSIZE)) {
+		util_strlcpy(hmcdrv_fuse_content.rdpath, path,
+			     sizeof(hmcdrv_fuse_content.rdpath));
+		hmcdrv_fuse_content.rdoffset = blkofs + HMCDRV_FUSE_BLKSIZE;
+		hmcdrv_fuse_content.rdcnt = HMCDRV_FUSE_RDAHEAD;
+		pthread_cond_signal(&hmcdrv_ctx.rdcond);
+	}
 
+	util_strlcpy(hmcdrv_fuse_content.seqpath, path,
+		     sizeof(hmcdrv_fuse_content.seqpath));
+	hmcdrv_fuse_content.seqnext = offset + done;
 	pthread_mutex_unlock(&hmcdrv_ctx.mutex);
-	return rc;
+	return (done > 0) ? (int) done : rc;
 }
 
 
@@ -1236,12 +1621,21 @@ static void *hmcdrv_fuse_init(struct fuse_conn_info *UNUSED(conn))
 {
 	pthread_mutexattr_t attr;
 
-	memset(hmcdrv_fuse_cache, 0, sizeof(hmcdrv_fuse_cache));
+	memset(&hmcdrv_fuse_cache, 0, sizeof(hmcdrv_fuse_cache));
+	memset(&hmcdrv_fuse_content, 0, sizeof(hmcdrv_fuse_content));
 	openlog(HMCDRV_FUSE_LOGNAME, LOG_PID, LOG_DAEMON);
 
-	if (pthread_mutexattr_init(&attr) != 0)
+	hmcdrv_fuse_cache.table = calloc(HMCDRV_FUSE_CACHE_SIZE,
+					 sizeof(*hmcdrv_fuse_cache.table));
+
+	if (hmcdrv_fuse_cache.table == NULL)
 		goto err_out;
 
+	hmcdrv_fuse_cache.size = HMCDRV_FUSE_CACHE_SIZE;
+
+	if (pthread_mutexattr_init(&attr) != 0)
+		goto err_table;
+
 	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
 	hmcdrv_ctx.fd = open(HMCDRV_FUSE_FTPDEV, O_RDWR);
 
@@ -1256,6 +1650,13 @@ static void *hmcdrv_fuse_init(struct fuse_conn_info *UNUSED(conn))
 	if (pthread_create(&hmcdrv_ctx.tid, NULL,
 			   hmcdrv_cache_aging, NULL) == 0) {
 
+		/* without read-ahead thread all data is read on demand
+		 */
+		if ((pthread_cond_init(&hmcdrv_ctx.rdcond, NULL) == 0) &&
+		    (pthread_create(&hmcdrv_ctx.rdtid, NULL,
+				    hmcdrv_rdahead, NULL) == 0))
+			hmcdrv_ctx.rdahead = 1;
+
 		pthread_mutexattr_destroy(&attr);
 		return &hmcdrv_ctx.tid;
 	}
@@ -1264,6 +1665,9 @@ err_mutex:
 	close(hmcdrv_ctx.fd);
 err_dev:
 	pthread_mutexattr_destroy(&attr);
+err_table:
+	free(hmcdrv_fuse_cache.table);
+	hmcdrv_fuse_cache.table = NULL;
 err_out:
 	HMCDRV_FUSE_LOG(LOG_ERR, "Initialization failed: %s",
 			strerror(errno));
@@ -1284,20 +1688,28 @@ static void hmcdrv_fuse_exit(void *arg)
 	if (arg != NULL)
 		pthread_cancel(*(pthread_t *) arg);
 
+	if (hmcdrv_ctx.rdahead) {
+		pthread_cancel(hmcdrv_ctx.rdtid);
+		pthread_join(hmcdrv_ctx.rdtid, NULL);
+		pthread_cond_destroy(&hmcdrv_ctx.rdcond);
+		hmcdrv_ctx.rdahead = 0;
+	}
+
 	pthread_mutex_lock(&hmcdrv_ctx.mutex);
 
-	for (i = 0; i < HMCDRV_FUSE_CACHE_SIZE; ++i) {
-		fp = hmcdrv_fuse_cache[i];
+	for (i = 0; i < HMCDRV_FUSE_BLKCNT; ++i)
+		free(hmcdrv_fuse_content.blk[i].data);
 
-		while (fp != NULL) {
-			next = fp->next;
-			hmcdrv_cache_symlink(fp, NULL);
-			free(fp);
-			fp = next;
-		}
+	memset(&hmcdrv_fuse_content, 0, sizeof(hmcdrv_fuse_content));
+
+	for (fp = hmcdrv_fuse_cache.lru_first; fp != NULL; fp = next) {
+		next = fp->lru_next;
+		hmcdrv_cache_symlink(fp, NULL);
+		free(fp);
 	}
 
-	memset(hmcdrv_fuse_cache, 0, sizeof(hmcdrv_fuse_cache));
+	free(hmcdrv_fuse_cache.table);
+	memset(&hmcdrv_fuse_cache, 0, sizeof(hmcdrv_fuse_cache));
 	pthread_mutex_destroy(&hmcdrv_ctx.mutex);
 	closelog();
 
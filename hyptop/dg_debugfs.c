@@ -14,6 +14,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include "dg_debugfs.h"
 #include "helper.h"
@@ -91,3 +92,44 @@ int dg_debugfs_open(const char *file)
 	else
 		return fh;
 }
+
+/*
+ * Read hypervisor data from debugfs file
+ *
+ * All files start with a header of "hdr_size" bytes, whose first member
+ * is the length of the data following the header. The kernel creates a new
+ * snapshot whenever the file is read from offset zero, so the file is
+ * opened only once. The buffer is kept for the next read and grows
+ * geometrically if the data does not fit.
+ */
+void *dg_debugfs_read(struct dg_debugfs_file *file, size_t hdr_size)
+{
+	size_t real_buf_size;
+	ssize_t rc;
+
+	if (file->fh < 0) {
+		file->fh = dg_debugfs_open(file->name);
+		if (file->fh < 0)
+			ERR_EXIT_ERRNO("Could not open file: %s", file->name);
+	}
+	if (file->buf_size < hdr_size) {
+		ht_free(file->buf);
+		file->buf = ht_alloc(hdr_size);
+		file->buf_size = hdr_size;
+	}
+	do {
+		rc = pread(file->fh, file->buf, file->buf_size, 0);
+		if (rc == -1)
+			ERR_EXIT_ERRNO("Reading hypervisor data failed");
+		real_buf_size = *((u64 *) file->buf) + hdr_size;
+		if ((size_t) rc == real_buf_size)
+			break;
+		/* Buffer too small: Grow it and read a new snapshot */
+		ht_free(file->buf);
+		file->buf_size *= 2;
+		if (file->buf_size < real_buf_size)
+			file->buf_size = real_buf_size;
+		file->buf = ht_alloc(file->buf_size);
+	} while (1);
+	return file->buf;
+}
@@ -21,6 +21,26 @@ extern int dg_debugfs_vm_init(void);
 extern int dg_debugfs_lpar_init(void);
 extern int dg_debugfs_open(const char *file);
 
+extern struct sd_dg dg_debugfs_lpar_dg;
+extern struct sd_dg dg_debugfs_vm_dg;
+
+/*
+ * Debugfs file that is kept open together with its read buffer
+ */
+struct dg_debugfs_file {
+	const char	*name;
+	int		fh;
+	void		*buf;
+	size_t		buf_size;
+};
+
+#define DG_DEBUGFS_FILE_INIT(file_name) { \
+	.name = file_name, \
+	.fh = -1, \
+}
+
+extern void *dg_debugfs_read(struct dg_debugfs_file *file, size_t hdr_size);
+
 /*
  * z/VM diag 0C prototypes
  */
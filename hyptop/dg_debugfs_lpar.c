@@ -27,7 +27,7 @@
 #define DEBUGFS_FILE	"diag_204"
 
 static u64 l_update_time_us;
-static long l_204_buf_size;
+static struct dg_debugfs_file l_204_file = DG_DEBUGFS_FILE_INIT(DEBUGFS_FILE);
 
 /*
  * Diag data structure definition
@@ -214,24 +214,10 @@ struct l_debugfs_d204 {
 static void l_read_debugfs(struct l_debugfs_d204_hdr **hdr,
 			   struct l_x_info_blk_hdr **data)
 {
-	long real_buf_size;
-	ssize_t rc;
 	void *buf;
-	int fh;
 
-	do {
-		fh = dg_debugfs_open(DEBUGFS_FILE);
-		*hdr = buf = ht_alloc(l_204_buf_size);
-		rc = read(fh, buf, l_204_buf_size);
-		if (rc == -1)
-			ERR_EXIT_ERRNO("Reading hypervisor data failed");
-		close(fh);
-		real_buf_size = (*hdr)->len + sizeof(struct l_debugfs_d204_hdr);
-		if (rc == real_buf_size)
-			break;
-		l_204_buf_size = real_buf_size;
-		ht_free(buf);
-	} while (1);
+	buf = dg_debugfs_read(&l_204_file, sizeof(struct l_debugfs_d204_hdr));
+	*hdr = buf;
 	*data = buf + sizeof(struct l_debugfs_d204_hdr);
 }
 
@@ -257,7 +243,6 @@ static void l_sd_sys_root_fill(struct sd_sys *sys)
 		 * Got old snapshot from kernel. Wait some time until
 		 * new snapshot is available.
 		 */
-		ht_free(hdr);
 		usleep(DBFS_WAIT_TIME_US);
 	} while (1);
 	sys_hdr = ((void *) time_hdr) + sizeof(struct l_x_info_blk_hdr);
@@ -273,7 +258,6 @@ static void l_sd_sys_root_fill(struct sd_sys *sys)
 
 	if (time_hdr->flags & LPAR_PHYS_FLG)
 		l_sd_sys_root_cpu_phys_fill(sys, (void *) sys_hdr);
-	ht_free(hdr);
 	sd_sys_commit(sys);
 }
 
@@ -302,6 +286,7 @@ static struct sd_sys_item *l_sys_item_vec[] = {
 	&sd_sys_item_thread,
 	&sd_sys_item_mgm,
 	&sd_sys_item_online,
+	&sd_sys_item_cpu_trend,
 	NULL,
 };
 
@@ -356,7 +341,7 @@ static struct sd_cpu_type *l_cpu_type_vec[] = {
 /*
  * Define data gatherer structure
  */
-static struct sd_dg l_sd_dg = {
+struct sd_dg dg_debugfs_lpar_dg = {
 	.update_sys		= l_sd_update,
 	.cpu_type_vec		= l_cpu_type_vec,
 	.sys_item_vec		= l_sys_item_vec,
@@ -372,12 +357,10 @@ int dg_debugfs_lpar_init(void)
 {
 	int fh;
 
-	l_204_buf_size = sizeof(struct l_debugfs_d204_hdr);
 	fh = dg_debugfs_open(DEBUGFS_FILE);
 	if (fh < 0)
 		return fh;
-	else
-		close(fh);
-	sd_dg_register(&l_sd_dg, 1);
+	l_204_file.fh = fh;
+	sd_dg_register(&dg_debugfs_lpar_dg, 1);
 	return 0;
 }
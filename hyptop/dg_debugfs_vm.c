@@ -26,7 +26,7 @@
 #define VM_CPU_ID_STOPPED	"1"
 
 static u64 l_update_time_us;
-static long l_2fc_buf_size;
+static struct dg_debugfs_file l_2fc_file = DG_DEBUGFS_FILE_INIT(DEBUGFS_FILE);
 static int l_use_debugfs_vmd0c;
 static char l_guest_name[64];
 
@@ -186,24 +186,10 @@ static void l_sd_sys_fill(struct sd_sys *guest, struct l_diag2fc_data *data)
 static void l_read_debugfs(struct l_debugfs_d2fc_hdr **hdr,
 			   struct l_diag2fc_data **data)
 {
-	long real_buf_size;
-	ssize_t rc;
 	void *buf;
-	int fh;
 
-	do {
-		fh = dg_debugfs_open(DEBUGFS_FILE);
-		*hdr = buf = ht_alloc(l_2fc_buf_size);
-		rc = read(fh, buf, l_2fc_buf_size);
-		if (rc == -1)
-			ERR_EXIT_ERRNO("Reading hypervisor data failed");
-		close(fh);
-		real_buf_size = (*hdr)->len + sizeof(struct l_debugfs_d2fc_hdr);
-		if (rc == real_buf_size)
-			break;
-		l_2fc_buf_size = real_buf_size;
-		ht_free(buf);
-	} while (1);
+	buf = dg_debugfs_read(&l_2fc_file, sizeof(struct l_debugfs_d2fc_hdr));
+	*hdr = buf;
 	*data = buf + sizeof(struct l_debugfs_d2fc_hdr);
 }
 
@@ -227,7 +213,6 @@ static void l_sd_sys_root_fill(struct sd_sys *sys)
 		 * Got old snapshot from kernel. Wait some time until
 		 * new snapshot is available.
 		 */
-		ht_free(hdr);
 		usleep(DBFS_WAIT_TIME_US);
 	} while (1);
 
@@ -253,7 +238,6 @@ static void l_sd_sys_root_fill(struct sd_sys *sys)
 			guest = sd_sys_new(sys, guest_name);
 		l_sd_sys_fill(guest, data);
 	}
-	ht_free(hdr);
 	sd_sys_commit(sys);
 }
 
@@ -284,6 +268,7 @@ static struct sd_sys_item *l_sys_item_vec[] = {
 	&sd_sys_item_mem_max,
 	&sd_sys_item_weight_cur,
 	&sd_sys_item_weight_max,
+	&sd_sys_item_cpu_trend,
 	NULL,
 };
 
@@ -332,7 +317,7 @@ static struct sd_cpu_type *l_cpu_type_vec[] = {
 /*
  * Define data gatherer structure
  */
-static struct sd_dg dg_debugfs_vm_dg = {
+struct sd_dg dg_debugfs_vm_dg = {
 	.update_sys		= l_sd_update,
 	.cpu_type_vec		= l_cpu_type_vec,
 	.sys_item_vec		= l_sys_item_vec,
@@ -354,9 +339,7 @@ int dg_debugfs_vm_init(void)
 	fh = dg_debugfs_open(DEBUGFS_FILE);
 	if (fh < 0)
 		return fh;
-	else
-		close(fh);
-	l_2fc_buf_size = sizeof(struct l_debugfs_d2fc_hdr);
+	l_2fc_file.fh = fh;
 	l_guest_name_init();
 	sd_dg_register(&dg_debugfs_vm_dg, 0);
 	return 0;
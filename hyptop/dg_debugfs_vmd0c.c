@@ -21,7 +21,7 @@
 
 #define DEBUGFS_FILE	"diag_0c"
 
-static long l_0c_buf_size;
+static struct dg_debugfs_file l_0c_file = DG_DEBUGFS_FILE_INIT(DEBUGFS_FILE);
 
 /*
  * Diag 0c entry structure definition
@@ -80,26 +80,10 @@ static void l_sd_cpu_fill(struct sd_sys *sys, unsigned int cpu_nr,
 static void l_read_debugfs(struct hypfs_diag0c_hdr **hdr,
 			   struct hypfs_diag0c_entry **entry)
 {
-	long real_buf_size;
-	ssize_t rc;
 	void *buf;
-	int fh;
 
-	do {
-		fh = dg_debugfs_open(DEBUGFS_FILE);
-		if (fh < 0)
-			ERR_EXIT_ERRNO("Could not open file: %s", DEBUGFS_FILE);
-		*hdr = buf = ht_alloc(l_0c_buf_size);
-		rc = read(fh, buf, l_0c_buf_size);
-		if (rc == -1)
-			ERR_EXIT_ERRNO("Reading hypervisor data failed");
-		close(fh);
-		real_buf_size = (*hdr)->len + sizeof(struct hypfs_diag0c_hdr);
-		if (rc == real_buf_size)
-			break;
-		l_0c_buf_size = real_buf_size;
-		ht_free(buf);
-	} while (1);
+	buf = dg_debugfs_read(&l_0c_file, sizeof(struct hypfs_diag0c_hdr));
+	*hdr = buf;
 	*entry = buf + sizeof(struct hypfs_diag0c_hdr);
 }
 
@@ -143,8 +127,6 @@ int dg_debugfs_vmd0c_init(void)
 	fh = dg_debugfs_open(DEBUGFS_FILE);
 	if (fh < 0)
 		return -1;
-	else
-		close(fh);
-	l_0c_buf_size = sizeof(struct hypfs_diag0c_hdr);
+	l_0c_file.fh = fh;
 	return 0;
 }
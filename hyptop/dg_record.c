@@ -0,0 +1,251 @@
+/*
+ * hyptop - Show hypervisor performance data on System z
+ *
+ * Record system data to a file and replay it as data gatherer
+ *
+ * Copyright IBM Corp. 2010, 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "dg_debugfs.h"
+#include "dg_record.h"
+#include "helper.h"
+#include "hyptop.h"
+#include "opts.h"
+#include "sd.h"
+
+static FILE *l_fh;
+static const char *l_file;
+
+/*
+ * Write data to record file
+ */
+static void l_write(const void *data, size_t size)
+{
+	if (fwrite(data, size, 1, l_fh) != 1)
+		ERR_EXIT_ERRNO("Could not write to \"%s\"", l_file);
+}
+
+/*
+ * Read data from record file, return 0 at end of file
+ */
+static int l_read(void *data, size_t size)
+{
+	if (fread(data, size, 1, l_fh) == 1)
+		return 1;
+	if (ferror(l_fh))
+		ERR_EXIT_ERRNO("Could not read from \"%s\"", l_file);
+	return 0;
+}
+
+/*
+ * Write CPU
+ */
+static void l_cpu_write(struct sd_cpu *cpu)
+{
+	struct dg_record_cpu rec;
+
+	memset(&rec, 0, sizeof(rec));
+	util_strlcpy(rec.id, cpu->id, sizeof(rec.id));
+	util_strlcpy(rec.type, sd_cpu_type_str(cpu), sizeof(rec.type));
+	rec.cnt = cpu->cnt;
+	rec.state = cpu->state;
+	rec.info = *cpu->d_cur;
+	l_write(&rec, sizeof(rec));
+}
+
+/*
+ * Write system with all its CPUs and child systems
+ */
+static void l_sys_write(struct sd_sys *sys)
+{
+	struct dg_record_sys rec;
+	struct sd_sys *child;
+	struct sd_cpu *cpu;
+
+	memset(&rec, 0, sizeof(rec));
+	util_strlcpy(rec.id, sys->id, sizeof(rec.id));
+	util_strlcpy(rec.os_name, sys->name.os, sizeof(rec.os_name));
+	rec.threads_per_core = sys->threads_per_core;
+	rec.update_time_us = sys->update_time_us;
+	rec.mem = sys->mem;
+	rec.weight = sys->weight;
+	rec.cpu_cnt = sys->cpu_cnt;
+	rec.child_cnt = sys->child_cnt;
+	l_write(&rec, sizeof(rec));
+
+	sd_cpu_iterate(sys, cpu)
+		l_cpu_write(cpu);
+	sd_sys_iterate(sys, child)
+		l_sys_write(child);
+}
+
+/*
+ * Record system data until the specified number of iterations is reached
+ *
+ * Only the raw data is written, no fields are computed and no tables
+ * are formatted. Hence short delays are possible.
+ */
+void dg_record_run(const char *file)
+{
+	struct timespec ts = {g.o.delay_s, g.o.delay_us * 1000};
+	struct dg_record_hdr hdr;
+
+	l_file = file;
+	if (strcmp(file, "-") == 0) {
+		l_fh = stdout;
+	} else {
+		l_fh = fopen(file, "w");
+		if (!l_fh)
+			ERR_EXIT_ERRNO("Could not open \"%s\"", file);
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, DG_RECORD_MAGIC, sizeof(hdr.magic));
+	hdr.version = DG_RECORD_VERSION;
+	if (sd.dg == &dg_debugfs_lpar_dg)
+		hdr.dg = DG_RECORD_DG_LPAR;
+	else
+		hdr.dg = DG_RECORD_DG_VM;
+	hdr.has_core_data = sd_dg_has_core_data();
+	l_write(&hdr, sizeof(hdr));
+
+	while (1) {
+		l_sys_write(sd_sys_root_get());
+		if (fflush(l_fh))
+			ERR_EXIT_ERRNO("Could not write to \"%s\"", file);
+		opts_iterations_next();
+		nanosleep(&ts, NULL);
+		sd_update();
+	}
+}
+
+/*
+ * Read CPU and add it to system "sys"
+ */
+static int l_cpu_read(struct sd_sys *sys)
+{
+	struct dg_record_cpu rec;
+	struct sd_cpu *cpu;
+
+	if (!l_read(&rec, sizeof(rec)))
+		return 0;
+	rec.id[sizeof(rec.id) - 1] = 0;
+	rec.type[sizeof(rec.type) - 1] = 0;
+	cpu = sd_cpu_get(sys, rec.id);
+	if (!cpu)
+		cpu = sd_cpu_new(sys, rec.id, rec.type, rec.cnt);
+	if (!cpu->type)
+		ERR_EXIT("Invalid CPU type \"%s\" in \"%s\"\n", rec.type,
+			 l_file);
+	*cpu->d_cur = rec.info;
+	sd_cpu_cnt(cpu) = rec.cnt;
+	sd_cpu_state_set(cpu, rec.state);
+	sd_cpu_commit(cpu);
+	return 1;
+}
+
+/*
+ * Read system with all its CPUs and child systems
+ *
+ * The root system is passed as "sys", child systems are looked up by ID
+ * in "parent".
+ */
+static int l_sys_read(struct sd_sys *parent, struct sd_sys *sys)
+{
+	struct dg_record_sys rec;
+	unsigned int i;
+
+	if (!l_read(&rec, sizeof(rec)))
+		return 0;
+	rec.id[sizeof(rec.id) - 1] = 0;
+	rec.os_name[sizeof(rec.os_name) - 1] = 0;
+	if (!sys) {
+		sys = sd_sys_get(parent, rec.id);
+		if (!sys)
+			sys = sd_sys_new(parent, rec.id);
+	}
+	util_strlcpy(sys->name.os, rec.os_name, sizeof(sys->name.os));
+	sys->threads_per_core = rec.threads_per_core;
+	sys->update_time_us = rec.update_time_us;
+	sys->mem = rec.mem;
+	sys->weight = rec.weight;
+	for (i = 0; i < rec.cpu_cnt; i++) {
+		if (!l_cpu_read(sys))
+			goto fail;
+	}
+	for (i = 0; i < rec.child_cnt; i++) {
+		if (!l_sys_read(sys, NULL))
+			goto fail;
+	}
+	sd_sys_commit(sys);
+	return 1;
+fail:
+	ERR_EXIT("Record file \"%s\" is truncated\n", l_file);
+}
+
+/*
+ * Update system data with next record, exit at end of file
+ */
+static void l_sd_update(void)
+{
+	struct sd_sys *root = sd_sys_root_get();
+	int rc;
+
+	sd_sys_update_start(root);
+	rc = l_sys_read(NULL, root);
+	sd_sys_update_end(root, root->update_time_us);
+	if (!rc)
+		hyptop_exit(0);
+}
+
+/*
+ * Replay data gatherer: Uses the items and CPU types of the data gatherer
+ * that has written the record file.
+ */
+static struct sd_dg l_sd_dg = {
+	.update_sys	= l_sd_update,
+};
+
+/*
+ * Initialize replay data gatherer
+ */
+int dg_record_replay_init(const char *file)
+{
+	struct dg_record_hdr hdr;
+	struct sd_dg *dg;
+
+	l_file = file;
+	l_fh = fopen(file, "r");
+	if (!l_fh)
+		ERR_EXIT_ERRNO("Could not open \"%s\"", file);
+	if (!l_read(&hdr, sizeof(hdr)) ||
+	    memcmp(hdr.magic, DG_RECORD_MAGIC, sizeof(hdr.magic)) != 0)
+		ERR_EXIT("File \"%s\" is no hyptop record file\n", file);
+	if (hdr.version != DG_RECORD_VERSION)
+		ERR_EXIT("Record file \"%s\" has unsupported version %u\n",
+			 file, hdr.version);
+	switch (hdr.dg) {
+	case DG_RECORD_DG_LPAR:
+		dg = &dg_debugfs_lpar_dg;
+		break;
+	case DG_RECORD_DG_VM:
+		dg = &dg_debugfs_vm_dg;
+		break;
+	default:
+		ERR_EXIT("Record file \"%s\" has unknown data gatherer %u\n",
+			 file, hdr.dg);
+	}
+	l_sd_dg.cpu_type_vec = dg->cpu_type_vec;
+	l_sd_dg.sys_item_vec = dg->sys_item_vec;
+	l_sd_dg.sys_item_enable_vec = dg->sys_item_enable_vec;
+	l_sd_dg.cpu_item_vec = dg->cpu_item_vec;
+	l_sd_dg.cpu_item_enable_vec = dg->cpu_item_enable_vec;
+	sd_dg_register(&l_sd_dg, hdr.has_core_data);
+	return 0;
+}
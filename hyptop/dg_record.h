@@ -0,0 +1,69 @@
+/*
+ * hyptop - Show hypervisor performance data on System z
+ *
+ * Record system data to a file and replay it as data gatherer
+ *
+ * Copyright IBM Corp. 2010, 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef DG_RECORD_H
+#define DG_RECORD_H
+
+#include "helper.h"
+#include "sd.h"
+
+/*
+ * Record file format
+ *
+ * The file starts with a header that identifies the data gatherer that
+ * produced the data. For each update follows the root system in the
+ * following recursive format:
+ *
+ *   struct dg_record_sys
+ *   struct dg_record_cpu   (sys.cpu_cnt times)
+ *   <child systems>        (sys.child_cnt times, each in the same format)
+ *
+ * The raw CPU times are recorded, so all fields can be computed on replay.
+ * Values are stored in the byte order of the recording system.
+ */
+#define DG_RECORD_MAGIC		"HYPTOPRC"
+#define DG_RECORD_VERSION	1
+
+enum dg_record_dg {
+	DG_RECORD_DG_LPAR	= 1,
+	DG_RECORD_DG_VM		= 2,
+};
+
+struct dg_record_hdr {
+	char	magic[8];
+	u32	version;
+	u32	dg;
+	u32	has_core_data;
+} __attribute__ ((packed));
+
+struct dg_record_sys {
+	char			id[SD_SYS_ID_SIZE];
+	char			os_name[9];
+	u32			threads_per_core;
+	u64			update_time_us;
+	struct sd_mem		mem;
+	struct sd_weight	weight;
+	u32			cpu_cnt;
+	u32			child_cnt;
+} __attribute__ ((packed));
+
+struct dg_record_cpu {
+	char			id[9];
+	char			type[CPU_TYPE_ID_LEN];
+	u16			cnt;
+	u8			state;
+	struct sd_cpu_info	info;
+} __attribute__ ((packed));
+
+extern void __noreturn dg_record_run(const char *file);
+extern int dg_record_replay_init(const char *file);
+
+#endif /* DG_RECORD_H */
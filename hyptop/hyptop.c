@@ -17,8 +17,10 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "dg_debugfs.h"
+#include "dg_record.h"
 #include "helper.h"
 #include "hyptop.h"
 #include "opts.h"
@@ -69,26 +71,36 @@ static enum hyptop_win_action l_process_input(struct hyptop_win *win)
  * Process input with timeout
  */
 static enum hyptop_win_action l_process_input_timeout(time_t time_s,
-						      long time_us)
+						      long time_us, int update_fd)
 {
 	struct timeval tv;
 	fd_set fds;
+	char buf[64];
 	int rc;
 
 	while (1) {
 		FD_ZERO(&fds);
 		FD_SET(0, &fds);
+		if (update_fd != -1)
+			FD_SET(update_fd, &fds);
 		tv.tv_sec = time_s;
 		tv.tv_usec = time_us;
-		rc = select(1, &fds, NULL, NULL, &tv);
+		rc = select(MAX(update_fd, 0) + 1, &fds, NULL, NULL, &tv);
 		switch (rc) {
 		case 0:
 			/* Timeout */
 			return WIN_KEEP;
 		case 1:
+		case 2:
 			/* Input */
-			if (l_process_input(g.w.cur) == WIN_SWITCH)
+			if (FD_ISSET(0, &fds) &&
+			    l_process_input(g.w.cur) == WIN_SWITCH)
 				return WIN_SWITCH;
+			/* New data from update thread */
+			if (update_fd != -1 && FD_ISSET(update_fd, &fds)) {
+				while (read(update_fd, buf, sizeof(buf)) > 0) {}
+				return WIN_KEEP;
+			}
 			continue;
 		case -1:
 			if (errno != EINTR)
@@ -126,8 +138,12 @@ enum hyptop_win_action hyptop_process_input_timeout(void)
 	if (g.o.batch_mode_specified) {
 		opts_iterations_next();
 		rc = l_sleep(g.o.delay_s, g.o.delay_us);
+	} else if (sd_update_thread_fd() != -1) {
+		/* Wait for input or the next update of the update thread */
+		rc = l_process_input_timeout(-1U, 0, sd_update_thread_fd());
+		opts_iterations_next();
 	} else {
-		rc = l_process_input_timeout(g.o.delay_s, g.o.delay_us);
+		rc = l_process_input_timeout(g.o.delay_s, g.o.delay_us, -1);
 		opts_iterations_next();
 	}
 	return rc;
@@ -138,7 +154,7 @@ enum hyptop_win_action hyptop_process_input_timeout(void)
  */
 enum hyptop_win_action hyptop_process_input(void)
 {
-	return l_process_input_timeout(-1U, 0);
+	return l_process_input_timeout(-1U, 0, -1);
 }
 
 /*
@@ -252,6 +268,10 @@ fail:
 #ifdef WITH_HYPFS
 static void l_dg_init(void)
 {
+	if (g.o.replay_file) {
+		dg_record_replay_init(g.o.replay_file);
+		return;
+	}
 	if (dg_debugfs_init(0) == 0)
 		return;
 	if (dg_hypfs_init() == 0)
@@ -261,7 +281,10 @@ static void l_dg_init(void)
 #else
 static void l_dg_init(void)
 {
-	dg_debugfs_init(1);
+	if (g.o.replay_file)
+		dg_record_replay_init(g.o.replay_file);
+	else
+		dg_debugfs_init(1);
 }
 #endif
 
@@ -364,7 +387,11 @@ int main(int argc, char *argv[])
 	sd_init();
 	l_dg_init();
 	opt_verify_systems();
+	if (g.o.record_file)
+		dg_record_run(g.o.record_file);
 	l_term_init();
+	if (!g.o.batch_mode_specified)
+		sd_update_thread_start();
 
 	win_sys_list_init();
 	win_sys_init();
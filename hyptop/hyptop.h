@@ -60,6 +60,9 @@ struct hyptop_opts {
 
 	int				delay_s;
 	int				delay_us;
+
+	char				*record_file;
+	char				*replay_file;
 };
 
 /*
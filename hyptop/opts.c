@@ -39,7 +39,9 @@ static char HELP_TEXT[] =
 "-t, --cpu_types TYPE[,..]       CPU types used for time calculations\n"
 "-b, --batch_mode                Use batch mode (no curses)\n"
 "-d, --delay SECONDS             Delay time between screen updates\n"
-"-n, --iterations NUMBER         Number of iterations before ending\n";
+"-n, --iterations NUMBER         Number of iterations before ending\n"
+"-r, --record FILE               Record data to FILE instead of showing it\n"
+"-R, --replay FILE               Show data recorded in FILE\n";
 
 /*
  * Initialize default settings
@@ -99,13 +101,14 @@ static int l_number_check(const char *str)
  */
 static void l_delay_set(char *delay_string)
 {
-	int secs;
+	double secs;
+	char *end;
 
-	l_number_check(delay_string);
-	if (sscanf(delay_string, "%i", &secs) != 1)
+	secs = strtod(delay_string, &end);
+	if (!isdigit(*delay_string) || *end != 0 || secs > INT_MAX)
 		ERR_EXIT("The delay value \"%s\" is invalid\n", delay_string);
 	g.o.delay_s = secs;
-	g.o.delay_us = 0;
+	g.o.delay_us = (secs - g.o.delay_s) * 1000000;
 }
 
 /*
@@ -271,11 +274,33 @@ static void l_batch_mode_set(void)
 	g.o.batch_mode_specified = 1;
 }
 
+/*
+ * Set the "--record" option
+ */
+static void l_record_set(char *str)
+{
+	g.o.record_file = str;
+}
+
+/*
+ * Set the "--replay" option
+ */
+static void l_replay_set(char *str)
+{
+	g.o.replay_file = str;
+}
+
 /*
  * Make option consisteny checks at end of command line parsing
  */
 static void l_parse_finish(void)
 {
+	if (g.o.record_file && g.o.replay_file)
+		ERR_EXIT("Options \"--record\" and \"--replay\" cannot be "
+			 "combined\n");
+	if (g.o.record_file && g.o.batch_mode_specified)
+		ERR_EXIT("Options \"--record\" and \"--batch_mode\" cannot "
+			 "be combined\n");
 	if (g.o.iterations_specified && g.o.iterations == 0)
 		hyptop_exit(0);
 	if (g.o.cur_win != &win_sys)
@@ -305,9 +330,11 @@ void opts_parse(int argc, char *argv[])
 		{ "fields",      required_argument, NULL, 'f'},
 		{ "sort_field",  required_argument, NULL, 'S'},
 		{ "cpu_types",   required_argument, NULL, 't'},
+		{ "record",      required_argument, NULL, 'r'},
+		{ "replay",      required_argument, NULL, 'R'},
 		{ NULL,          0,                 NULL, 0  }
 	};
-	static const char option_string[] = "vhbd:w:s:n:f:t:S:";
+	static const char option_string[] = "vhbd:w:s:n:f:t:S:r:R:";
 
 	l_init_defaults();
 	while (1) {
@@ -346,6 +373,12 @@ void opts_parse(int argc, char *argv[])
 		case 'S':
 			l_sort_field_set(optarg);
 			break;
+		case 'r':
+			l_record_set(optarg);
+			break;
+		case 'R':
+			l_replay_set(optarg);
+			break;
 		default:
 			l_std_usage_exit();
 		}
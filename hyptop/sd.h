@@ -60,6 +60,32 @@ struct sd_sys_name {
 
 struct sd_sys;
 
+/*
+ * SD hash: Index of systems or CPUs by ID
+ */
+struct sd_hash_node {
+	struct sd_hash_node	*next;
+	const char		*id;
+};
+
+struct sd_hash {
+	struct sd_hash_node	**bucket_vec;
+	u32			bucket_cnt;
+	u32			node_cnt;
+};
+
+/*
+ * SD history: CPU time per second of the last updates
+ */
+#define SD_SYS_HIST_CNT		20
+
+struct sd_sys_hist {
+	u64	cpu_diff_us[SD_SYS_HIST_CNT];
+	u32	idx;
+	u32	cnt;
+	char	cpu_trend[SD_SYS_HIST_CNT + 1];
+};
+
 /*
  * SD info
  */
@@ -75,19 +101,23 @@ struct sd_cpu;
  */
 struct sd_sys {
 	struct util_list_node	list;
+	struct sd_hash_node	hash;
 	struct sd_info		i;
 	u64			update_time_us;
 	u32			child_cnt;
 	u32			child_cnt_active;
 	struct util_list	child_list;
+	struct sd_hash		child_hash;
 	u32			cpu_cnt;
 	u32			cpu_cnt_active;
 	struct util_list	cpu_list;
+	struct sd_hash		cpu_hash;
 	u32			threads_per_core;
 	char			id[SD_SYS_ID_SIZE];
 	struct sd_sys_name	name;
 	struct sd_mem		mem;
 	struct sd_weight	weight;
+	struct sd_sys_hist	hist;
 };
 
 #define sd_sys_id(sys) ((sys)->id)
@@ -192,6 +222,7 @@ enum sd_cpu_state {
 
 struct sd_cpu {
 	struct util_list_node	list;
+	struct sd_hash_node	hash;
 	struct sd_info		i;
 	char			id[9];
 	struct sd_cpu_type	*type;
@@ -426,6 +457,8 @@ extern struct sd_sys_item sd_sys_item_weight_max;
 
 extern struct sd_sys_item sd_sys_item_os_name;
 
+extern struct sd_sys_item sd_sys_item_cpu_trend;
+
 extern struct sd_sys_item sd_sys_item_samples_total;
 extern struct sd_sys_item sd_sys_item_samples_cpu_using;
 
@@ -499,6 +532,10 @@ static inline s64 l_cpu_info_s64(struct sd_cpu_info *info,
  */
 void sd_update(void);
 extern void sd_init(void);
+extern void sd_update_thread_start(void);
+extern int sd_update_thread_fd(void);
+extern void sd_lock(void);
+extern void sd_unlock(void);
 
 static inline u64 l_sub_64(u64 x, u64 y)
 {
@@ -10,8 +10,13 @@
  * it under the terms of the MIT license. See LICENSE for details.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "helper.h"
 #include "hyptop.h"
@@ -27,6 +32,8 @@ static int		l_sys_item_cnt;
 static int		l_cpu_item_cnt;
 static int		l_has_core_data;
 static struct sd_sys	*l_root_sys;
+static pthread_mutex_t	l_lock = PTHREAD_MUTEX_INITIALIZER;
+static int		l_update_thread_pipe[2] = {-1, -1};
 
 /*
  * External globals for system data
@@ -137,12 +144,137 @@ static void l_cpu_types_init(void)
 	l_opts_cpu_types_init();
 }
 
+/*
+ * Add CPU time per second of last update to history of system
+ */
+static void l_sys_hist_update(struct sd_sys *sys)
+{
+	static const char trend_chars[] = " .:-=+*#";
+	struct sd_sys_hist *hist = &sys->hist;
+	u64 val, cap;
+	u32 i, idx;
+	int level;
+
+	hist->cpu_diff_us[hist->idx] =
+		sd_sys_item_u64(sys, &sd_sys_item_cpu_diff);
+	hist->idx = (hist->idx + 1) % SD_SYS_HIST_CNT;
+	if (hist->cnt < SD_SYS_HIST_CNT)
+		hist->cnt++;
+
+	/* One character per update relative to the CPU capacity */
+	cap = sd_sys_item_u64(sys, &sd_sys_item_cpu_cnt) * 1000000;
+	idx = (hist->idx + SD_SYS_HIST_CNT - hist->cnt) % SD_SYS_HIST_CNT;
+	for (i = 0; i < hist->cnt; i++) {
+		val = hist->cpu_diff_us[(idx + i) % SD_SYS_HIST_CNT];
+		if (val == 0 || cap == 0)
+			level = 0;
+		else if (val >= cap)
+			level = 7;
+		else
+			level = 1 + val * 6 / cap;
+		hist->cpu_trend[i] = trend_chars[level];
+	}
+	hist->cpu_trend[i] = 0;
+}
+
+/*
+ * Update history of system and all its child systems
+ */
+static void l_hist_update(struct sd_sys *sys)
+{
+	struct sd_sys *child;
+
+	l_sys_hist_update(sys);
+	sd_sys_iterate(sys, child)
+		l_hist_update(child);
+}
+
 /*
  * Update system data using the data gatherer
  */
-void sd_update(void)
+static void l_update(void)
 {
 	sd.dg->update_sys();
+	l_hist_update(l_root_sys);
+}
+
+/*
+ * Update system data, unless the update thread does this
+ */
+void sd_update(void)
+{
+	if (l_update_thread_pipe[0] != -1)
+		return;
+	l_update();
+}
+
+/*
+ * Lock system data against the update thread
+ */
+void sd_lock(void)
+{
+	pthread_mutex_lock(&l_lock);
+}
+
+/*
+ * Unlock system data
+ */
+void sd_unlock(void)
+{
+	pthread_mutex_unlock(&l_lock);
+}
+
+/*
+ * Update thread: Update system data periodically and notify the main
+ * thread via pipe after each update
+ */
+static void *l_update_thread(void *arg)
+{
+	struct timespec ts = {g.o.delay_s, g.o.delay_us * 1000};
+	char c = 0;
+	(void) arg;
+
+	while (1) {
+		nanosleep(&ts, NULL);
+		sd_lock();
+		l_update();
+		sd_unlock();
+		if (write(l_update_thread_pipe[1], &c, 1) == -1 &&
+		    errno != EAGAIN)
+			ERR_EXIT_ERRNO("Could not notify about update");
+	}
+	return NULL;
+}
+
+/*
+ * Start the update thread, so that slow data gatherers do not delay
+ * user input
+ */
+void sd_update_thread_start(void)
+{
+	sigset_t set, old_set;
+	pthread_t thread;
+
+	if (pipe(l_update_thread_pipe) ||
+	    fcntl(l_update_thread_pipe[0], F_SETFL, O_NONBLOCK) ||
+	    fcntl(l_update_thread_pipe[1], F_SETFL, O_NONBLOCK))
+		ERR_EXIT_ERRNO("Could not create pipe");
+	/* Signals like SIGWINCH have to be handled by the main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old_set);
+	errno = pthread_create(&thread, NULL, l_update_thread, NULL);
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+	if (errno)
+		ERR_EXIT_ERRNO("Could not start update thread");
+}
+
+/*
+ * Return file descriptor that gets readable after each update of the
+ * update thread, or -1 if the update thread is not running
+ */
+int sd_update_thread_fd(void)
+{
+	return l_update_thread_pipe[0];
 }
 
 /*
@@ -181,19 +313,124 @@ int sd_dg_has_core_data(void)
 }
 
 /*
- * Get CPU from sys by ID
+ * Initial number of hash buckets, grows with the number of nodes
  */
-struct sd_cpu *sd_cpu_get(struct sd_sys *sys, const char* id)
+#define L_HASH_BUCKET_CNT_MIN	16
+
+/*
+ * Get entry that contains hash node
+ */
+#define l_hash_entry(node, type) \
+	((type *)((char *)(node) - offsetof(type, hash)))
+
+/*
+ * Compute hash value of ID (FNV-1a)
+ */
+static u32 l_hash_fn(const char *id)
 {
-	struct sd_cpu *cpu;
+	u32 val = 2166136261U;
+
+	while (*id) {
+		val ^= (unsigned char) *id++;
+		val *= 16777619U;
+	}
+	return val;
+}
+
+/*
+ * Resize bucket vector of hash and redistribute its nodes
+ */
+static void l_hash_resize(struct sd_hash *hash, u32 bucket_cnt)
+{
+	struct sd_hash_node **bucket_vec, *node, *next;
+	u32 i, idx;
+
+	bucket_vec = ht_zalloc(bucket_cnt * sizeof(*bucket_vec));
+	for (i = 0; i < hash->bucket_cnt; i++) {
+		for (node = hash->bucket_vec[i]; node; node = next) {
+			next = node->next;
+			idx = l_hash_fn(node->id) & (bucket_cnt - 1);
+			node->next = bucket_vec[idx];
+			bucket_vec[idx] = node;
+		}
+	}
+	ht_free(hash->bucket_vec);
+	hash->bucket_vec = bucket_vec;
+	hash->bucket_cnt = bucket_cnt;
+}
+
+/*
+ * Add node with ID to hash
+ */
+static void l_hash_add(struct sd_hash *hash, struct sd_hash_node *node,
+		       const char *id)
+{
+	u32 idx;
+
+	if (hash->node_cnt >= hash->bucket_cnt)
+		l_hash_resize(hash, hash->bucket_cnt ?
+			      hash->bucket_cnt * 2 : L_HASH_BUCKET_CNT_MIN);
+	idx = l_hash_fn(id) & (hash->bucket_cnt - 1);
+	node->id = id;
+	node->next = hash->bucket_vec[idx];
+	hash->bucket_vec[idx] = node;
+	hash->node_cnt++;
+}
+
+/*
+ * Remove node from hash
+ */
+static void l_hash_remove(struct sd_hash *hash, struct sd_hash_node *node)
+{
+	struct sd_hash_node **ptr;
+
+	ptr = &hash->bucket_vec[l_hash_fn(node->id) & (hash->bucket_cnt - 1)];
+	for (; *ptr; ptr = &(*ptr)->next) {
+		if (*ptr == node) {
+			*ptr = node->next;
+			hash->node_cnt--;
+			return;
+		}
+	}
+}
 
-	util_list_iterate(&sys->cpu_list, cpu) {
-		if (strcmp(cpu->id, id) == 0)
-			return cpu;
+/*
+ * Find node by ID in hash
+ */
+static struct sd_hash_node *l_hash_find(struct sd_hash *hash, const char *id)
+{
+	struct sd_hash_node *node;
+
+	if (!hash->node_cnt)
+		return NULL;
+	node = hash->bucket_vec[l_hash_fn(id) & (hash->bucket_cnt - 1)];
+	for (; node; node = node->next) {
+		if (strcmp(node->id, id) == 0)
+			return node;
 	}
 	return NULL;
 }
 
+/*
+ * Free bucket vector of hash
+ */
+static void l_hash_free(struct sd_hash *hash)
+{
+	ht_free(hash->bucket_vec);
+	memset(hash, 0, sizeof(*hash));
+}
+
+/*
+ * Get CPU from sys by ID
+ */
+struct sd_cpu *sd_cpu_get(struct sd_sys *sys, const char* id)
+{
+	struct sd_hash_node *node;
+
+	node = l_hash_find(&sys->cpu_hash, id);
+	return node ? l_hash_entry(node, struct sd_cpu) : NULL;
+}
+
 /*
  * Get CPU type by ID
  */
@@ -225,6 +462,7 @@ struct sd_cpu *sd_cpu_new(struct sd_sys *parent, const char *id,
 	cpu->cnt = cnt;
 
 	util_list_add_tail(&parent->cpu_list, cpu);
+	l_hash_add(&parent->cpu_hash, &cpu->hash, cpu->id);
 
 	return cpu;
 }
@@ -234,13 +472,10 @@ struct sd_cpu *sd_cpu_new(struct sd_sys *parent, const char *id,
  */
 struct sd_sys *sd_sys_get(struct sd_sys *parent, const char* id)
 {
-	struct sd_sys *sys;
+	struct sd_hash_node *node;
 
-	util_list_iterate(&parent->child_list, sys) {
-		if (strcmp(sys->id, id) == 0)
-			return sys;
-	}
-	return NULL;
+	node = l_hash_find(&parent->child_hash, id);
+	return node ? l_hash_entry(node, struct sd_sys) : NULL;
 }
 
 /*
@@ -259,6 +494,7 @@ struct sd_sys *sd_sys_new(struct sd_sys *parent, const char *id)
 		sys_new->i.parent = parent;
 		parent->child_cnt++;
 		util_list_add_tail(&parent->child_list, sys_new);
+		l_hash_add(&parent->child_hash, &sys_new->hash, sys_new->id);
 	}
 	sys_new->threads_per_core = 1;
 	return sys_new;
@@ -269,6 +505,8 @@ struct sd_sys *sd_sys_new(struct sd_sys *parent, const char *id)
  */
 static void sd_sys_free(struct sd_sys *sys)
 {
+	l_hash_free(&sys->child_hash);
+	l_hash_free(&sys->cpu_hash);
 	ht_free(sys);
 }
 
@@ -330,6 +568,7 @@ static void l_cpu_update_end(struct sd_sys *sys)
 		if (!cpu->i.active) {
 			/* CPU has not been updated, remove it */
 			util_list_remove(&sys->cpu_list, cpu);
+			l_hash_remove(&sys->cpu_hash, &cpu->hash);
 			sd_cpu_free(cpu);
 			continue;
 		}
@@ -350,6 +589,7 @@ static void l_sys_update_end(struct sd_sys *sys)
 		if (!child->i.active) {
 			/* child has not been updated, remove it */
 			util_list_remove(&sys->child_list, child);
+			l_hash_remove(&sys->child_hash, &child->hash);
 			sd_sys_free(child);
 			continue;
 		}
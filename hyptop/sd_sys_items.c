@@ -399,3 +399,10 @@ struct sd_sys_item sd_sys_item_weight_max = {
 	.desc	= "Maximum weight",
 	.fn_u64	= l_sys_item_u64,
 };
+
+struct sd_sys_item sd_sys_item_cpu_trend = {
+	.table_col = TABLE_COL_STR_LEFT('d', "trend"),
+	.offset = SD_SYSTEM_OFFSET(hist.cpu_trend),
+	.type	= SD_TYPE_STR,
+	.desc	= "CPU time history",
+};
@@ -376,6 +376,9 @@ static void l_row_last_agg(struct table *t, struct table_row *table_row)
 
 /*
  * Format row: Invoke unit callback and adjust max width of column
+ *
+ * Disabled columns are not printed and therefore skipped. After enabling
+ * a column, table_rebuild() has to be called.
  */
 static void l_row_format(struct table *t, struct table_row *row)
 {
@@ -384,6 +387,8 @@ static void l_row_format(struct table *t, struct table_row *row)
 
 	table_col_iterate(t, col, col_nr) {
 		struct table_entry *e = &row->entries[col_nr];
+		if (!col->p->enabled)
+			continue;
 		if (col->agg == TABLE_COL_AGG_NONE && row == t->row_last)
 			len = 0;
 		else
@@ -410,36 +415,26 @@ static void l_row_last_calc(struct table *t)
 	l_row_format(t, t->row_last);
 }
 
+static void l_table_sort(struct table *t);
+
 /*
  * Finish table after all rows have been added
  */
 void table_finish(struct table *t)
 {
+	if (t->attr_sorted_table)
+		l_table_sort(t);
 	l_row_last_calc(t);
 	t->ready = 1;
 }
 
 /*
- * Add new row to table
+ * Add new row to table, the rows are sorted by table_finish()
  */
 void table_row_add(struct table *t, struct table_row *row)
 {
-	struct table_row *tmp;
-
 	l_row_format(t, row);
-
-	if (util_list_is_empty(&t->row_list) || !t->attr_sorted_table) {
-		util_list_add_tail(&t->row_list, row);
-	} else {
-		util_list_iterate(&t->row_list, tmp) {
-			if (l_row_less_than(t, tmp, row))
-				break;
-		}
-		if (tmp)
-			util_list_add_prev(&t->row_list, row, tmp);
-		else
-			util_list_add_tail(&t->row_list, row);
-	}
+	util_list_add_tail(&t->row_list, row);
 	if (l_row_is_marked(t, row)) {
 		row->marked = 1;
 		t->row_cnt_marked++;
@@ -465,10 +460,12 @@ void table_rebuild(struct table *t)
 
 /*
  * Compare callback for linked list sorting (ordering: large to small)
+ *
+ * Rows with equal values keep their order.
  */
 static int l_row_cmp_fn(void *a, void *b, void *data)
 {
-	return l_row_less_than(data, a, b) ? 1 : -1;
+	return l_row_less_than(data, a, b) ? 1 : 0;
 }
 
 /*
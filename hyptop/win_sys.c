@@ -175,15 +175,19 @@ static int l_table_create(void)
 	struct sd_cpu *cpu;
 	int i;
 
+	sd_lock();
 	parent = sd_sys_get(sd_sys_root_get(), l_sys_id);
-	if (!parent)
+	if (!parent) {
+		sd_unlock();
 		return -ENODEV;
+	}
 	table_row_del_all(l_t);
 	sd_cpu_iterate(parent, cpu) {
 		for (i = 0; i < cpu->cnt; i++)
 			l_cpu_add(cpu);
 	}
 	table_finish(l_t);
+	sd_unlock();
 	return 0;
 }
 
@@ -308,14 +312,14 @@ static void l_run(struct hyptop_win *win)
 			win_back();
 			return;
 		}
-		hyptop_update_term();
-		action = hyptop_process_input_timeout();
-		if (action == WIN_SWITCH)
-			return;
-
-		/* No updates in select mode */
-		if (!table_mode_select(l_t))
-			sd_update();
+		do {
+			hyptop_update_term();
+			action = hyptop_process_input_timeout();
+			if (action == WIN_SWITCH)
+				return;
+			/* No updates in select mode */
+		} while (table_mode_select(l_t));
+		sd_update();
 	}
 }
 
@@ -189,6 +189,7 @@ static void l_table_create(void)
 {
 	struct sd_sys *parent, *guest;
 
+	sd_lock();
 	table_row_del_all(l_t);
 	parent = sd_sys_root_get();
 	sd_sys_iterate(parent, guest) {
@@ -197,6 +198,7 @@ static void l_table_create(void)
 		l_sys_add(guest);
 	}
 	table_finish(l_t);
+	sd_unlock();
 }
 
 /*
@@ -312,13 +314,14 @@ static void l_run(struct hyptop_win *win)
 	table_rebuild(l_t);
 	while (1) {
 		l_table_create();
-		hyptop_update_term();
-		action = hyptop_process_input_timeout();
-		if (action == WIN_SWITCH)
-			return;
-		/* No updates in select mode */
-		if (!table_mode_select(l_t))
-			sd_update();
+		do {
+			hyptop_update_term();
+			action = hyptop_process_input_timeout();
+			if (action == WIN_SWITCH)
+				return;
+			/* No updates in select mode */
+		} while (table_mode_select(l_t));
+		sd_update();
 	}
 }
 
@@ -783,8 +783,8 @@ int ekmf_clone_template_info(const struct ekmf_template_info *src,
 void ekmf_free_template_info(struct ekmf_template_info *template);
 
 /**
- * Callback function used with the ekmf_list_keys function. This
- * callback is called for each ky found.
+ * Callback function used with the ekmf_list_keys and ekmf_get_key_infos
+ * functions. This callback is called for each ky found.
  *
  * @param curl_handle      a CURL handle that can be used to perform further
  *                         EKMFWeb functions within the callback.
@@ -876,6 +876,50 @@ int ekmf_get_key_info(const struct ekmf_config *config, CURL **curl_handle,
 		      const char *key_uuid, struct ekmf_key_info **key,
 		      char **error_msg, bool verbose);
 
+/**
+ * Get information about multiple keys by their UUIDs. Up to max_parallel
+ * keys are retrieved concurrently, each using its own CURL handle and its
+ * own connection to the server. The key callback is called for each key as
+ * soon as its information has been received, thus the keys are not
+ * necessarily passed to the callback in the order of the key_uuids array.
+ * The callback is never called concurrently.
+ *
+ * To perform a single request, set curl_handle to NULL. This will cause the
+ * function to initialize a new CURL handle, use it, and destroy it.
+ * If you plan to perform multiple requests to the same host, supply the address
+ * of a CURL pointer that is initially NULL. This function will then initialize
+ * a new CURL handle on the first call. On subsequent calls, pass in the address
+ * of the same CURL pointer so that the CURL handle is reused. After the last
+ * request, the CURL handle must be destroyed by calling ekmf_curl_destroy).
+ *
+ * @param config            the configuration structure
+ * @param curl_handle       address of a CURL handle used for reusing the same
+ *                          CURL handle with multiple requests.
+ * @param key_uuids         an array of UUIDs of the keys to get info for
+ * @param num_keys          the number of UUIDs in key_uuids
+ * @param max_parallel      the maximum number of keys to retrieve
+ *                          concurrently, or 0 to use the default
+ * @param key_cb            a callback function that is called for each key
+ * @param private           a pointer that is passed as-is to the callback
+ * @param error_msg         on return: If not NULL, then a textual error message
+ *                          is returned in case of a failing request. The caller
+ *                          must free the error string when it is not NULL.
+ * @param verbose           if true, verbose messages are printed
+ *
+ * @returns zero for success, a negative errno in case of an error.
+ *          -EACCES is returned, if no or no valid login token is available.
+ *          -EPERM is returned if the login token does not have permission to
+ *          get the key info.
+ *          -ENOENT is returned if one of the keys does not exist.
+ *          If the callback returns nonzero, then no further keys are
+ *          passed to the callback, and the return code of the callback is
+ *          returned.
+ */
+int ekmf_get_key_infos(const struct ekmf_config *config, CURL **curl_handle,
+		       const char **key_uuids, size_t num_keys,
+		       unsigned int max_parallel, ekmf_key_cb_t key_cb,
+		       void *private, char **error_msg, bool verbose);
+
 /**
  * Changes the state of a key identified by its UUID. To update a key,
  * the timestamp from the last update is required. This can be found in
@@ -234,7 +234,7 @@ struct dscb {
 	 *  An empty DSCB record (format-0 DSCB) contains 140 zeros, so
 	 *  here the format id is 0x00.
 	 */
-	char fmtid;
+	unsigned char fmtid;
 	/** @brief The residual data part of the DSCB
 	 *
 	 *  The contents depends on the format.
@@ -393,12 +393,20 @@ struct dasd {
 	unsigned int cylinders;
 	/** @brief Device geometry. How many heads does the DASD have. */
 	unsigned int heads;
+	/** @brief The device is a regular file that contains a DASD image
+	 *  with RAWTRACKSIZE bytes per track */
+	int is_image;
 	/** @brief The VTOC data that has been read from this device */
 	struct raw_vtoc *rawvtoc;
 	/** @brief The volume label that has been read from this device */
 	volume_label_t *vlabel;
 	/** @brief Detailed error messages in case of a problem */
 	struct errorlog *log;
+	/** @brief The zdsroot this DASD has been added to */
+	struct zdsroot *root;
+	/** @brief Data sets found by lzds_dasd_scan_datasets that have not
+	 *  yet been added to the zdsroot */
+	struct util_list *scanned_datasets;
 };
 
 /**
@@ -492,6 +500,12 @@ int lzds_zdsroot_alloc(struct zdsroot **root);
  */
 void lzds_zdsroot_free(struct zdsroot *root);
 
+/**
+ * @brief Set the size of the raw track cache that is shared by all
+ *        dshandles.
+ */
+int lzds_zdsroot_set_track_cache(struct zdsroot *root, unsigned int tracks);
+
 /**
  * @brief Add a DASD device to the zdsroot.
  */
@@ -570,6 +584,11 @@ void lzds_dasd_get_cylinders(struct dasd *dasd, unsigned int *cylinders);
  */
 void lzds_dasd_get_heads(struct dasd *dasd, unsigned int *heads);
 
+/**
+ * @brief Find out if this DASD is an image file instead of a device.
+ */
+void lzds_dasd_get_is_image(struct dasd *dasd, int *is_image);
+
 /**
  * @brief Allocate a new dasd context structure for given data set.
  */
@@ -796,6 +815,11 @@ int lzds_dshandle_set_keepRDW(struct dshandle *dsh, int keepRDW);
  */
 void lzds_dshandle_get_keepRDW(struct dshandle *dsh, int *keepRDW);
 
+/**
+ * @brief Enable or disable reading ahead the next track frame.
+ */
+int lzds_dshandle_set_readahead(struct dshandle *dsh, int readahead);
+
 /**
  * @brief Prepares the dsh and the related devices for read operations.
  */
@@ -823,6 +847,12 @@ int lzds_dshandle_lseek(struct dshandle *dsh, long long offset,
  */
 void lzds_dshandle_get_offset(struct dshandle *dsh, long long *offset);
 
+/**
+ * @brief Read data from the given offset of the data set.
+ */
+int lzds_dshandle_pread(struct dshandle *dsh, char *buf, size_t size,
+			long long offset, ssize_t *rcsize);
+
 /**
  * @brief Get the errorlog.
  */
@@ -853,6 +883,23 @@ void lzds_pdsmember_get_name(struct pdsmember *member, char **name);
 int lzds_zdsroot_extract_datasets_from_dasd(struct zdsroot *root,
 					    struct dasd *dasd);
 
+/**
+ * @brief Find the data sets in the rawvtoc stored in the dasd and analyse
+ *        their PDS directories, without adding them to the zdsroot yet.
+ */
+int lzds_dasd_scan_datasets(struct dasd *dasd);
+
+/**
+ * @brief Read PDS member lists from a cache file, to be used instead of
+ *        reading the PDS directories.
+ */
+int lzds_zdsroot_read_member_cache(struct zdsroot *root, const char *filename);
+
+/**
+ * @brief Write the member lists of all PDS in the zdsroot to a cache file.
+ */
+int lzds_zdsroot_write_member_cache(struct zdsroot *root, const char *filename);
+
 
 void lzds_dslist_free(struct zdsroot *root);
 
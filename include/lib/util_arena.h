@@ -0,0 +1,55 @@
+/**
+ * @defgroup util_arena_h util_arena: Arena allocator interface
+ * @{
+ * @brief Allocate many short-lived objects and free them all at once
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef LIB_UTIL_ARENA_H
+#define LIB_UTIL_ARENA_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/**
+ * Opaque handle for an arena
+ *
+ * Memory is handed out from large chunks by advancing a pointer. Single
+ * objects cannot be freed; instead all objects allocated after a mark
+ * or all objects of the arena are released at once.
+ */
+struct util_arena;
+
+/**
+ * Position in an arena as returned by util_arena_mark()
+ */
+struct util_arena_mark {
+	/** Chunk that was current when the mark was taken */
+	void *chunk;
+	/** Number of used bytes in that chunk */
+	size_t used;
+};
+
+struct util_arena *util_arena_new(size_t chunk_size);
+void util_arena_free(struct util_arena *arena);
+void util_arena_reset(struct util_arena *arena);
+
+struct util_arena_mark util_arena_mark(struct util_arena *arena);
+void util_arena_release(struct util_arena *arena,
+			struct util_arena_mark mark);
+
+void *util_arena_alloc(struct util_arena *arena, size_t size);
+void *util_arena_zalloc(struct util_arena *arena, size_t size);
+char *util_arena_strdup(struct util_arena *arena, const char *str);
+char *util_arena_strndup(struct util_arena *arena, const char *str,
+			 size_t len);
+char *util_arena_vasprintf(struct util_arena *arena, const char *fmt,
+			   va_list ap);
+char *util_arena_asprintf(struct util_arena *arena, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+#endif /** LIB_UTIL_ARENA_H @} */
@@ -0,0 +1,76 @@
+/**
+ * @defgroup util_hash_h util_hash: Hash table interface
+ * @{
+ * @brief Open-addressing hash table with string or integer keys
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef LIB_UTIL_HASH_H
+#define LIB_UTIL_HASH_H
+
+#include <stdbool.h>
+
+/**
+ * Opaque handle for a hash table
+ *
+ * Entries are stored in one contiguous slot array that is probed linearly.
+ * The table grows automatically when it becomes too full.
+ */
+struct util_hash;
+
+/**
+ * Key type of a hash table
+ */
+enum util_hash_type {
+	/** Keys are strings; the hash table keeps its own copy of each key */
+	UTIL_HASH_KEY_STR,
+	/** Keys are unsigned long integers */
+	UTIL_HASH_KEY_INT,
+};
+
+/**
+ * Iterator for util_hash_iterate()
+ */
+struct util_hash_iter {
+	/** Internal position in the slot array */
+	unsigned long pos;
+	/** Key of the current entry for UTIL_HASH_KEY_STR tables */
+	const char *key_str;
+	/** Key of the current entry for UTIL_HASH_KEY_INT tables */
+	unsigned long key_int;
+	/** Value of the current entry */
+	void *value;
+};
+
+struct util_hash *util_hash_new(enum util_hash_type type,
+				unsigned long size_hint);
+void util_hash_free(struct util_hash *hash, void (*free_fn)(void *value));
+unsigned long util_hash_len(struct util_hash *hash);
+
+void *util_hash_get_str(struct util_hash *hash, const char *key);
+bool util_hash_contains_str(struct util_hash *hash, const char *key);
+void *util_hash_set_str(struct util_hash *hash, const char *key, void *value);
+void *util_hash_remove_str(struct util_hash *hash, const char *key);
+
+void *util_hash_get_int(struct util_hash *hash, unsigned long key);
+bool util_hash_contains_int(struct util_hash *hash, unsigned long key);
+void *util_hash_set_int(struct util_hash *hash, unsigned long key,
+			void *value);
+void *util_hash_remove_int(struct util_hash *hash, unsigned long key);
+
+bool util_hash_iter_next(struct util_hash *hash, struct util_hash_iter *it);
+
+/**
+ * Iterate over all entries of a hash table in unspecified order
+ *
+ * The current entry may be removed while iterating, but no entries
+ * must be added.
+ */
+#define util_hash_iterate(hash, it) \
+	for ((it)->pos = 0; util_hash_iter_next(hash, it); )
+
+#endif /** LIB_UTIL_HASH_H @} */
@@ -18,6 +18,7 @@ struct util_list {
 	unsigned long offset;		/* Offset of struct util_list_node */
 	struct util_list_node *start;	/* First element */
 	struct util_list_node *end;	/* Last element */
+	unsigned long len;		/* Number of elements */
 };
 
 struct util_list_node {
@@ -39,6 +39,16 @@ struct util_proc_mnt_entry {
 	char *passno;
 };
 
+/**
+ * Line of a /proc file in "key value" or "key: value" format
+ */
+struct util_proc_kv {
+	/** Key without trailing colon */
+	const char *key;
+	/** Rest of the line without leading blanks */
+	const char *value;
+};
+
 int util_proc_part_get_entry(dev_t device, struct util_proc_part_entry *entry);
 void util_proc_part_free_entry(struct util_proc_part_entry *entry);
 int util_proc_dev_get_entry(dev_t dev, int blockdev,
@@ -48,4 +58,10 @@ int util_proc_mnt_get_entry(const char *file_name, const char *spec,
 			    struct util_proc_mnt_entry *entry);
 void util_proc_mnt_free_entry(struct util_proc_mnt_entry *entry);
 
+int util_proc_kv_parse(char *buf, size_t len, struct util_proc_kv *kv,
+		       int max);
+const char *util_proc_kv_get(const struct util_proc_kv *kv, int num,
+			     const char *key, int *pos);
+int util_proc_fields(char *line, char **field, int max);
+
 #endif /* LIB_UTIL_PROC_H */
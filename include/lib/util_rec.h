@@ -58,13 +58,16 @@ struct util_rec *util_rec_new_long(const char *hdr_sep, const char *col_sep,
 				   const char *key, int key_size, int val_size);
 void util_rec_free(struct util_rec *rec);
 
-void util_rec_def(struct util_rec *rec, const char *key,
-		  enum util_rec_align align, int width, const char *hdr);
+struct util_rec_fld *util_rec_def(struct util_rec *rec, const char *key,
+				  enum util_rec_align align, int width,
+				  const char *hdr);
 void util_rec_set(struct util_rec *rec, const char *key, const char *fmt, ...);
+void util_rec_fld_set(struct util_rec_fld *fld, const char *fmt, ...);
 void util_rec_set_argz(struct util_rec *rec, const char *key, const char *argz,
 		       size_t len);
 
 const char *util_rec_get(struct util_rec *rec, const char *key);
+const char *util_rec_fld_get(struct util_rec_fld *fld);
 
 void util_rec_print_hdr(struct util_rec *rec);
 void util_rec_print(struct util_rec *rec);
@@ -0,0 +1,35 @@
+/**
+ * @defgroup util_ring_h util_ring: Ring buffer interface
+ * @{
+ * @brief Bounded lock-free queue for passing pointers between threads
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef LIB_UTIL_RING_H
+#define LIB_UTIL_RING_H
+
+#include <stdbool.h>
+
+/**
+ * Opaque handle for a ring buffer
+ *
+ * Any number of threads may add and remove entries concurrently. The
+ * non-blocking functions never take a lock. The blocking functions sleep
+ * on a futex while the ring buffer is full or empty.
+ */
+struct util_ring;
+
+struct util_ring *util_ring_new(unsigned long size);
+void util_ring_free(struct util_ring *ring);
+
+bool util_ring_try_push(struct util_ring *ring, void *item);
+bool util_ring_try_pop(struct util_ring *ring, void **item);
+
+void util_ring_push(struct util_ring *ring, void *item);
+void *util_ring_pop(struct util_ring *ring);
+
+#endif /** LIB_UTIL_RING_H @} */
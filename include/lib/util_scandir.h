@@ -14,6 +14,27 @@
 
 #include <dirent.h>
 
+/**
+ * Entry type filter flags for util_scandir_open() and util_scandir_iterate()
+ *
+ * A type mask of 0 selects entries of any type.
+ */
+#define UTIL_SCANDIR_TYPE_DIR	0x1	/**< Directories */
+#define UTIL_SCANDIR_TYPE_REG	0x2	/**< Regular files */
+#define UTIL_SCANDIR_TYPE_LNK	0x4	/**< Symbolic links */
+#define UTIL_SCANDIR_TYPE_OTHER	0x8	/**< All other types */
+
+/**
+ * Opaque handle for iterating over directory entries
+ */
+struct util_scandir_iter;
+
+/**
+ * Callback for util_scandir_iterate(), returns 0 to continue with the next
+ * entry or a non-zero value to stop
+ */
+typedef int (*util_scandir_cb)(const struct dirent *de, void *data);
+
 int util_scandir_hexsort(const struct dirent **de1, const struct dirent **de2);
 int util_scandir(struct dirent ***namelist,
 			int compar_fn(const struct dirent **,
@@ -22,4 +43,13 @@ int util_scandir(struct dirent ***namelist,
 			const char *pattern, ...);
 void util_scandir_free(struct dirent **de_vec, int count);
 
+struct util_scandir_iter *util_scandir_open(const char *path,
+					    unsigned int types,
+					    const char *fmt, ...);
+const struct dirent *util_scandir_next(struct util_scandir_iter *iter);
+void util_scandir_close(struct util_scandir_iter *iter);
+int util_scandir_iterate(const char *path, unsigned int types,
+			 util_scandir_cb cb, void *data,
+			 const char *fmt, ...);
+
 #endif /** LIB_UTIL_SCANDIR_H @} */
@@ -0,0 +1,38 @@
+/**
+ * @defgroup util_sysfs_h util_sysfs: Sysfs attribute interface
+ * @{
+ * @brief Read sysfs attributes with caching and batching
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef LIB_UTIL_SYSFS_H
+#define LIB_UTIL_SYSFS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * Opaque handle for a sysfs attribute that is kept open
+ */
+struct util_sysfs_attr;
+
+char *util_sysfs_read_str(const char *fmt, ...);
+int util_sysfs_read_ul(unsigned long *val, int base, const char *fmt, ...);
+int util_sysfs_read_batch(const char *dir, const char * const names[],
+			  char *values[], int count);
+int util_sysfs_write_str(const char *str, const char *fmt, ...);
+
+void util_sysfs_invalidate(const char *fmt, ...);
+void util_sysfs_invalidate_all(void);
+void util_sysfs_exit(void);
+
+struct util_sysfs_attr *util_sysfs_attr_open(const char *fmt, ...);
+ssize_t util_sysfs_attr_read(struct util_sysfs_attr *attr, char *buf,
+			     size_t size);
+void util_sysfs_attr_close(struct util_sysfs_attr *attr);
+
+#endif /** LIB_UTIL_SYSFS_H @} */
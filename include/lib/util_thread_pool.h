@@ -0,0 +1,48 @@
+/**
+ * @defgroup util_thread_pool_h util_thread_pool: Thread pool interface
+ * @{
+ * @brief Run independent work items in parallel
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef LIB_UTIL_THREAD_POOL_H
+#define LIB_UTIL_THREAD_POOL_H
+
+#include <stdbool.h>
+
+/**
+ * Opaque handle for a thread pool
+ *
+ * Work items are queued with util_thread_pool_add() and run by a fixed
+ * number of worker threads in the order they were queued.
+ */
+struct util_thread_pool;
+
+/**
+ * Work item function, returns 0 on success or an error code
+ */
+typedef int (*util_thread_pool_fn)(void *data);
+
+/**
+ * Loop body function for util_parallel_for(), returns 0 on success or an
+ * error code
+ */
+typedef int (*util_parallel_for_fn)(unsigned long i, void *data);
+
+struct util_thread_pool *util_thread_pool_new(int num_threads);
+void util_thread_pool_add(struct util_thread_pool *pool,
+			  util_thread_pool_fn fn, void *data);
+int util_thread_pool_wait(struct util_thread_pool *pool,
+			  unsigned long *failed);
+void util_thread_pool_cancel(struct util_thread_pool *pool);
+bool util_thread_pool_cancelled(struct util_thread_pool *pool);
+void util_thread_pool_free(struct util_thread_pool *pool);
+
+int util_parallel_for(unsigned long start, unsigned long end,
+		      int num_threads, util_parallel_for_fn fn, void *data);
+
+#endif /** LIB_UTIL_THREAD_POOL_H @} */
@@ -18,6 +18,7 @@ extern "C" {
 
 #define	VMCP_DEVICE_NODE	"/dev/vmcp"	/* VMCP device name */
 #define	VMCP_DEFAULT_BUFSZ	0x4000		/* VMCP default buffer size */
+#define	VMCP_MAX_BUFSZ		0x100000	/* VMCP maximum buffer size */
 
 /*
  * Error codes returned by vmcp() function. This enables the caller
@@ -38,12 +39,18 @@ struct vmcp_parm {
 	const char *cpcmd;
 	unsigned int buffer_size;
 	bool do_upper;
+	bool auto_size;
 	int cprc;
 	char *response;
 	unsigned int response_size;
 };
 
 int vmcp(struct vmcp_parm *cp);
+int vmcp_open(void);
+int vmcp_fd(int fd, struct vmcp_parm *cp);
+void vmcp_close(int fd);
+int vmcp_batch(struct vmcp_parm *cmd_vec, int *rc_vec, unsigned int count,
+	       unsigned int handles);
 
 #ifdef __cplusplus
 }
@@ -12,5 +12,7 @@
 
 int vmdump_convert(const char* inputFileName, const char* outputFileName,
 		   const char* progName);
+int vmdump_convert_elf(const char* inputFileName, const char* outputFileName,
+		       const char* progName);
 
 #endif /* LIB_VMDUMP_H */
@@ -0,0 +1,32 @@
+/*
+ * Static tracepoints (USDT)
+ *
+ * Copyright IBM Corp. 2026
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef LIB_ZT_PROBE_H
+#define LIB_ZT_PROBE_H
+
+/*
+ * ZT_PROBE(provider, name, args...) defines a USDT probe for tracing tools
+ * like bpftrace, perf, or SystemTap. When built with "make HAVE_SDT=1", a
+ * probe is a single nop instruction until a tracer attaches to it, and the
+ * arguments are passed to the tracer. Otherwise the probe and its arguments
+ * are compiled out. Use at most 12 arguments that are cheap to evaluate.
+ *
+ * Example: Print the distribution of zgetdump read sizes
+ *
+ *   bpftrace -e 'usdt:/usr/bin/zgetdump:zgetdump:dfo_read { @ = hist(arg1); }'
+ */
+#ifdef HAVE_SDT
+#include <sys/sdt.h>
+#define ZT_PROBE(provider, name, ...) \
+	STAP_PROBEV(provider, name, ##__VA_ARGS__)
+#else
+#define ZT_PROBE(provider, name, ...) do { } while (0)
+#endif
+
+#endif /* LIB_ZT_PROBE_H */
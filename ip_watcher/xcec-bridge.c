@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -45,6 +46,10 @@
 
 #define BUFFER_LEN 65536
 
+#define BATCH_LEN 32	/* frames received and sent per system call */
+
+#define EPOLL_EVENTS 16
+
 int so_sndbuf=(8*1024*1024);
 
 int do_unicast_bridging=0;
@@ -62,17 +67,27 @@ struct int_sock {
 	struct int_sock *next;
 };
 
-fd_set work_fd_set; /* used in and changed by select */
-
 struct set {
-	fd_set fds;
-	int highest_fd;
+	int epoll_fd;
 
 	struct int_sock *i_s_list;
 };
 
 struct set select_set;
 
+/* frames of one recvmmsg call and the sendmmsg headers to forward them */
+struct batch {
+	struct mmsghdr r_msgs[BATCH_LEN];
+	struct iovec r_iov[BATCH_LEN];
+	struct sockaddr_ll r_addr[BATCH_LEN];
+	struct mmsghdr s_msgs[BATCH_LEN];
+	struct iovec s_iov[BATCH_LEN];
+	struct sockaddr_in s_addr[BATCH_LEN];
+	char buffer[BATCH_LEN][BUFFER_LEN];
+};
+
+struct batch batch;
+
 volatile int update_interface_trigger=0;
 
 int open_incoming_socket(char *dev_name)
@@ -301,6 +316,7 @@ void update_interfaces()
 	struct int_sock *new_list=NULL;
 	struct int_sock *i=NULL,*j,*prev;
 	struct int_sock *new_int=NULL;
+	struct epoll_event event;
 	int i_fd,o_fd;
 
 	/* if all interfaces are '+'-interfaces, we bridge broadcast */
@@ -311,31 +327,28 @@ void update_interfaces()
 	if (read_sys(&new_list))
 		return;
 
-	for (i=select_set.i_s_list;i;i=i->next) {
-		if (!interface_in_list(i,new_list)) {
-			/* remove interface i */
-			j=select_set.i_s_list;
-			prev=NULL;
-			while (j) {
-				if (!strncmp(j->dev_name,i->dev_name,
-					     DEV_NAME_SIZE)) {
-					if (!prev) {
-						select_set.i_s_list=j->next;
-					} else {
-						prev->next=j->next;
-					}
-					prev=j;
-					j=j->next;
-					free(j);
-				} else {
-					j=j->next;
-				}
-			}
-			/* and close the socket */
-			close(i->i_fd);
-			close(i->o_fd);
-			syslog(LOG_INFO,"removed interface %s",i->dev_name);
+	prev=NULL;
+	i=select_set.i_s_list;
+	while (i) {
+		if (interface_in_list(i,new_list)) {
+			prev=i;
+			i=i->next;
+			continue;
+		}
+		/* remove interface i */
+		if (!prev) {
+			select_set.i_s_list=i->next;
+		} else {
+			prev->next=i->next;
 		}
+		/* and close the socket */
+		epoll_ctl(select_set.epoll_fd,EPOLL_CTL_DEL,i->i_fd,NULL);
+		close(i->i_fd);
+		close(i->o_fd);
+		syslog(LOG_INFO,"removed interface %s",i->dev_name);
+		j=i->next;
+		free(i);
+		i=j;
 	}
 
 	for (i=new_list;i;i=i->next) {
@@ -361,10 +374,24 @@ void update_interfaces()
 				continue;
 			}
 
+			event.events=EPOLLIN;
+			event.data.ptr=new_int;
+			if (epoll_ctl(select_set.epoll_fd,EPOLL_CTL_ADD,
+				      i_fd,&event)==-1) {
+				syslog(LOG_ERR,"can't add interface %s " \
+				       "to epoll set: %s",i->dev_name,
+				       strerror(errno));
+				close(o_fd);
+				close(i_fd);
+				free(new_int);
+				continue;
+			}
+
 			util_strlcpy(new_int->dev_name, i->dev_name, DEV_NAME_SIZE);
 			new_int->i_fd=i_fd;
 			new_int->o_fd=o_fd;
 			new_int->features=i->features;
+			new_int->mtu_warning=0;
 			new_int->next=select_set.i_s_list;
 			select_set.i_s_list=new_int;
 			syslog(LOG_INFO,"added interface %s",i->dev_name);
@@ -377,83 +404,54 @@ void update_interfaces()
 		free(new_list);
 		new_list=i;
 	}
-
-	/* prepare the fd_set for select */
-	FD_ZERO(&select_set.fds);
-	for (i=select_set.i_s_list;i;i=i->next) {
-		FD_SET(i->i_fd,&select_set.fds);
-		select_set.highest_fd=(i->i_fd>select_set.highest_fd)?
-			i->i_fd:select_set.highest_fd;
-	}
 }
 
-void process_packet(struct int_sock *i_s)
+/* check whether a received frame has to be bridged */
+int packet_is_bridged(struct sockaddr_ll *s_ll,int buffer_len)
 {
-	int retval;
-	char buffer[BUFFER_LEN];
-	int buffer_len;
-	struct int_sock *i_s_item;
-	struct sockaddr_ll s_ll;
-	struct sockaddr_in s_in;
-	socklen_t sll_len;
-
-	sll_len=(socklen_t)sizeof(struct sockaddr_ll);
-	buffer_len=recvfrom(i_s->i_fd,buffer,BUFFER_LEN,0,
-			    (struct sockaddr *)&s_ll,&sll_len);
-	if (buffer_len==-1) {
-		syslog(LOG_WARNING,"recvfrom failed on %s: %s\n",
-		       i_s->dev_name,strerror(errno));
-		return;
-	}
-
-	/* nothing read */
-	if (buffer_len==0)
-		return;
+	/* nothing read or no complete IP header */
+	if (buffer_len<ETH_HLEN+20)
+		return 0;
 
 	/* no packets that came from our own stack... that could lead to
 	 * traffic loops */
-	if (s_ll.sll_pkttype==PACKET_OUTGOING)
-		return;
+	if (s_ll->sll_pkttype==PACKET_OUTGOING)
+		return 0;
 
 	/* only do unicast bridging when required */
-	if ( (s_ll.sll_pkttype==PACKET_HOST) &&
+	if ( (s_ll->sll_pkttype==PACKET_HOST) &&
 	     (!do_unicast_bridging) )
-		return;
+		return 0;
 
 	/* only do multicast bridging when required */
-	if ( (s_ll.sll_pkttype==PACKET_MULTICAST) &&
+	if ( (s_ll->sll_pkttype==PACKET_MULTICAST) &&
 	     (!do_multicast_bridging) )
-		return;
+		return 0;
 
 	/* broadcast is critical, see comment above */
 	if (!do_broadcast_bridging) {
-		if (s_ll.sll_pkttype==PACKET_BROADCAST)
-			return;
+		if (s_ll->sll_pkttype==PACKET_BROADCAST)
+			return 0;
 	}
 
 	/* only do v4 at this time */
-	if (s_ll.sll_protocol!=ETH_P_IP)
-		return;
+	if (s_ll->sll_protocol!=ETH_P_IP)
+		return 0;
 
-	/* forward buffer to each interface ... */
-	for (i_s_item=select_set.i_s_list;i_s_item;i_s_item=i_s_item->next) {
-		/* ... but i_s */
-		if (i_s_item==i_s) continue;
+	return 1;
+}
 
-		s_ll.sll_ifindex=0;
-		s_in.sin_family=AF_INET;
-		s_in.sin_port=0;
-		if (s_ll.sll_pkttype==PACKET_BROADCAST) {
-			s_in.sin_addr.s_addr=INADDR_BROADCAST;
-		} else {
-			memcpy(&s_in.sin_addr, &buffer[16 + ETH_HLEN], 4);
-		}
+/* send the first count packets of the batch to interface i_s_item */
+void send_packets(struct int_sock *i_s_item,int count)
+{
+	int retval,idx=0,k;
+	int buffer_len;
 
-		retval=sendto(i_s_item->o_fd, buffer + ETH_HLEN,
-				buffer_len - ETH_HLEN, 0,
-				(struct sockaddr *)&s_in,
-				sizeof(struct sockaddr_in));
+	while (idx<count) {
+		retval=sendmmsg(i_s_item->o_fd,&batch.s_msgs[idx],
+				count-idx,0);
 		if (retval==-1) {
+			buffer_len=batch.s_iov[idx].iov_len+ETH_HLEN;
 			if ( (errno==EMSGSIZE) && (!i_s_item->mtu_warning) ) {
 				syslog(LOG_WARNING,"MTU of %s too small " \
 				       "to forward packet with size of %i" \
@@ -461,15 +459,96 @@ void process_packet(struct int_sock *i_s)
 				       i_s_item->dev_name,buffer_len);
 				i_s_item->mtu_warning=1;
 			} else {
-				syslog(LOG_WARNING,"sendto failed on %s: " \
+				syslog(LOG_WARNING,"sendmmsg failed on %s: " \
 				       "%s\n",i_s_item->dev_name,
 				       strerror(errno));
 			}
-		} else if (retval != (buffer_len - ETH_HLEN)) {
-			syslog(LOG_WARNING,"sendto sent only %i instead " \
-			       "of %i bytes on %s\n",
-			       retval,buffer_len,i_s->dev_name);
+			/* drop the failing packet, go on with the rest */
+			idx++;
+			continue;
+		}
+		for (k=idx;k<idx+retval;k++) {
+			if (batch.s_msgs[k].msg_len!=batch.s_iov[k].iov_len)
+				syslog(LOG_WARNING,"sendmmsg sent only %u " \
+				       "instead of %zu bytes on %s\n",
+				       batch.s_msgs[k].msg_len,
+				       batch.s_iov[k].iov_len,
+				       i_s_item->dev_name);
+		}
+		idx+=retval;
+	}
+}
+
+void process_packets(struct int_sock *i_s)
+{
+	struct int_sock *i_s_item;
+	struct sockaddr_ll *s_ll;
+	struct sockaddr_in *s_in;
+	char *buffer;
+	int count,fwd=0,k;
+
+	for (k=0;k<BATCH_LEN;k++)
+		batch.r_msgs[k].msg_hdr.msg_namelen=
+			(socklen_t)sizeof(struct sockaddr_ll);
+
+	/* take everything queued up to BATCH_LEN frames; the remainder is
+	 * reported again by epoll after the other interfaces had their
+	 * turn */
+	count=recvmmsg(i_s->i_fd,batch.r_msgs,BATCH_LEN,MSG_DONTWAIT,NULL);
+	if (count==-1) {
+		if (errno!=EAGAIN && errno!=EWOULDBLOCK)
+			syslog(LOG_WARNING,"recvmmsg failed on %s: %s\n",
+			       i_s->dev_name,strerror(errno));
+		return;
+	}
+
+	for (k=0;k<count;k++) {
+		s_ll=&batch.r_addr[k];
+		buffer=batch.buffer[k];
+		if (!packet_is_bridged(s_ll,batch.r_msgs[k].msg_len))
+			continue;
+
+		s_in=&batch.s_addr[fwd];
+		s_in->sin_family=AF_INET;
+		s_in->sin_port=0;
+		if (s_ll->sll_pkttype==PACKET_BROADCAST) {
+			s_in->sin_addr.s_addr=INADDR_BROADCAST;
+		} else {
+			memcpy(&s_in->sin_addr, &buffer[16 + ETH_HLEN], 4);
 		}
+		batch.s_iov[fwd].iov_base=buffer+ETH_HLEN;
+		batch.s_iov[fwd].iov_len=batch.r_msgs[k].msg_len-ETH_HLEN;
+		fwd++;
+	}
+
+	if (!fwd)
+		return;
+
+	/* forward batch to each interface ... */
+	for (i_s_item=select_set.i_s_list;i_s_item;i_s_item=i_s_item->next) {
+		/* ... but i_s */
+		if (i_s_item==i_s) continue;
+		send_packets(i_s_item,fwd);
+	}
+}
+
+/* connect the static message headers with their buffers */
+void init_batch(void)
+{
+	int k;
+
+	for (k=0;k<BATCH_LEN;k++) {
+		batch.r_iov[k].iov_base=batch.buffer[k];
+		batch.r_iov[k].iov_len=BUFFER_LEN;
+		batch.r_msgs[k].msg_hdr.msg_name=&batch.r_addr[k];
+		batch.r_msgs[k].msg_hdr.msg_iov=&batch.r_iov[k];
+		batch.r_msgs[k].msg_hdr.msg_iovlen=1;
+
+		batch.s_msgs[k].msg_hdr.msg_name=&batch.s_addr[k];
+		batch.s_msgs[k].msg_hdr.msg_namelen=
+			(socklen_t)sizeof(struct sockaddr_in);
+		batch.s_msgs[k].msg_hdr.msg_iov=&batch.s_iov[k];
+		batch.s_msgs[k].msg_hdr.msg_iovlen=1;
 	}
 }
 
@@ -477,12 +556,12 @@ void action_handler(int UNUSED(s))
 {
 	update_interface_trigger=1;
 	syslog(LOG_DEBUG,"signal caught");
-	/* select will return, interfaces will be re-checked */
+	/* epoll_wait will return, interfaces will be re-checked */
 }
 
 int main(int argc,char *argv[]) {
-	struct int_sock *i_s;
-	int retval,r;
+	struct epoll_event events[EPOLL_EVENTS];
+	int retval,r,k;
 	struct sigaction s_a;
 
 	if ( (argc>1) && (!strncmp(argv[1],"also_unicast",12)) ) {
@@ -494,9 +573,14 @@ int main(int argc,char *argv[]) {
 
 	openlog("xcec-bridge",LOG_NDELAY,LOGGING_FACILITY);
 
-	FD_ZERO(&select_set.fds);
 	select_set.i_s_list=NULL;
-	select_set.highest_fd=0;
+	select_set.epoll_fd=epoll_create1(EPOLL_CLOEXEC);
+	if (select_set.epoll_fd==-1) {
+		syslog(LOG_ERR,"can't create epoll instance: %s -- exiting",
+		       strerror(errno));
+		return 1;
+	}
+	init_batch();
 
 	s_a.sa_handler=action_handler;
 	if (sigemptyset(&s_a.sa_mask)) {
@@ -539,9 +623,7 @@ int main(int argc,char *argv[]) {
 			while (sigprocmask(SIG_UNBLOCK,&s_a.sa_mask,NULL)) ;
 		}
 
-		memcpy(&work_fd_set,&select_set.fds,sizeof(fd_set));
-		retval=select(select_set.highest_fd+1,&work_fd_set,
-		     	      NULL,NULL,NULL);
+		retval=epoll_wait(select_set.epoll_fd,events,EPOLL_EVENTS,-1);
 		r=sigprocmask(SIG_BLOCK,&s_a.sa_mask,NULL);
 		if (r) {
 			syslog(LOG_INFO,"sigprocmask (block): %s",
@@ -552,6 +634,8 @@ int main(int argc,char *argv[]) {
 
 			/* when blocked: */
 			update_interfaces();
+			continue; /* events may refer to removed interfaces,
+				     epoll reports pending packets again */
 		}
 
 		/* a signal came in after we unblocked
@@ -562,25 +646,21 @@ int main(int argc,char *argv[]) {
 		 */
 		if (update_interface_trigger) {
 			update_interfaces();
+			continue; /* see above */
 		}
 
 		if (retval==-1) {
 			if (errno==EINTR) {
 				update_interfaces();
 			} else if (errno) {
-				syslog(LOG_WARNING,"select returned with %s",
+				syslog(LOG_WARNING,"epoll_wait returned with %s",
 				       strerror(errno));
 			}
-			continue; /* fds are undefined -> no packets came
-				     in at this time */
+			continue; /* no packets came in at this time */
 		}
 
-		/* check all fds regardless of retval */
-		for (i_s=select_set.i_s_list;i_s;i_s=i_s->next) {
-			if (FD_ISSET(i_s->i_fd,&work_fd_set)) {
-				process_packet(i_s);
-			}
-		}
+		for (k=0;k<retval;k++)
+			process_packets(events[k].data.ptr);
 	}
 
 	/* cleanup... no. */
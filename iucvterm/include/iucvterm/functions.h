@@ -21,6 +21,10 @@
 /* Message buffer: message header + 4096 bytes of data */
 #define MSG_BUFFER_SIZE		(MSG_DATA_OFFSET + (4096))
 
+/* Message buffer for coalesced terminal output: header + 32 KiB of data.
+ * Receivers split larger messages into chunks of their own buffer size. */
+#define MSG_TX_BUFFER_SIZE	(MSG_DATA_OFFSET + (32768))
+
 /* Error macros */
 #define print_error(s)		program_error(PRG_COMPONENT, (s))
 #define iucvtty_error(m)					\
@@ -51,6 +55,7 @@ extern int iucvtty_tx_winsize(int, int);
 extern int iucvtty_tx_data(int, int, struct iucvtty_msg *, size_t);
 extern int iucvtty_tx_error(int, uint32_t);
 extern int iucvtty_copy_data(int, struct iucvtty_msg *);
+extern int iucvtty_splice_data(int, int, size_t *);
 extern int iucvtty_read_data(int, struct iucvtty_msg *, size_t);
 
 extern int iucvtty_read_msg(int, struct iucvtty_msg *, size_t, size_t *);
@@ -9,6 +9,7 @@
  * it under the terms of the MIT license. See LICENSE for details.
  */
 #include <errno.h>
+#include <fcntl.h>
 #include <regex.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -261,6 +262,32 @@ int iucvtty_copy_data(int dest, struct iucvtty_msg *msg)
 	return 0;
 }
 
+/**
+ * iucvtty_splice_data() - Move IUCV message data residual without copying
+ * @dest:	Pipe to move data to
+ * @from:	File descriptor to read data from
+ * @residual:	Residual of an iucv tty message received by iucvtty_read_msg()
+ *
+ * Moves up to @residual bytes of message data from @from to the pipe @dest
+ * within the kernel and updates @residual accordingly.  This replaces the
+ * next iucvtty_read_msg() and iucvtty_copy_data() calls for the remaining
+ * data of a large data message.
+ * Note: The @residual parameter shall not be NULL.
+ */
+int iucvtty_splice_data(int dest, int from, size_t *residual)
+{
+	ssize_t r;
+
+	do {
+		r = splice(from, NULL, dest, NULL, *residual, SPLICE_F_MOVE);
+	} while (r == -1 && errno == EINTR);
+	if (r <= 0)
+		return -1;
+	*residual -= r;
+
+	return 0;
+}
+
 /**
  * iucvtty_skip_msg_residual() - Skip (receive & forget) count number of bytes
  * @fd:		File descriptor
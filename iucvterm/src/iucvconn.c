@@ -14,7 +14,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <syslog.h>
 #include <termios.h>
@@ -141,9 +143,11 @@ static enum esc_action_t get_action(const struct iucvtty_msg *msg,
 static int iucvtty_worker(int terminal, const struct iucvterm_cfg *cfg)
 {
 	struct iucvtty_msg *msg;
-	fd_set set;
+	struct epoll_event ev, events[2];
+	struct stat sb;
 	size_t chunk;
-	int in_esc_mode;
+	int in_esc_mode, use_splice, epfd, nev, i;
+	int ready_term, ready_stdin, stdin_file;
 	enum esc_action_t action;
 
 	/* setup buffers */
@@ -153,6 +157,26 @@ static int iucvtty_worker(int terminal, const struct iucvterm_cfg *cfg)
 		return -1;
 	}
 
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1) {
+		print_error("Creating an epoll instance failed");
+		free(msg);
+		return -1;
+	}
+	ev.events = EPOLLIN;
+	ev.data.fd = terminal;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, terminal, &ev);
+	ev.data.fd = STDIN_FILENO;
+	/* regular files cannot be polled and are always readable */
+	stdin_file = epoll_ctl(epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) &&
+		     errno == EPERM;
+
+	/* Terminal output that does not fit into the message buffer is moved
+	 * to stdout without copying, if stdout is a pipe and the output is not
+	 * recorded in a session log */
+	use_splice = cfg->sessionlog == NULL &&
+		     fstat(STDOUT_FILENO, &sb) == 0 && S_ISFIFO(sb.st_mode);
+
 	/* multiplex i/o between login program and socket */
 	chunk = 0;
 	in_esc_mode = 0;	/* escape mode state */
@@ -163,18 +187,27 @@ static int iucvtty_worker(int terminal, const struct iucvterm_cfg *cfg)
 			resize_tty = 0;	/* clear signal flag */
 		}
 
-		FD_ZERO(&set);
-		FD_SET(terminal, &set);
-		FD_SET(STDIN_FILENO, &set);
-
-		if (select(MAX(STDIN_FILENO, terminal) + 1, &set,
-			   NULL, NULL, NULL) == -1) {
+		nev = epoll_wait(epfd, events, 2, stdin_file ? 0 : -1);
+		if (nev == -1) {
 			if (errno == EINTR)
 				continue;
 			break;
 		}
+		ready_term = 0;
+		ready_stdin = stdin_file;
+		for (i = 0; i < nev; i++) {
+			if (events[i].data.fd == terminal)
+				ready_term = 1;
+			else
+				ready_stdin = 1;
+		}
 
-		if (FD_ISSET(terminal, &set)) {
+		if (ready_term && chunk && use_splice &&
+		    msg->type == MSG_TYPE_DATA) {
+			if (iucvtty_splice_data(STDOUT_FILENO, terminal,
+						&chunk))
+				break;
+		} else if (ready_term) {
 			if (iucvtty_read_msg(terminal, msg,
 					     MSG_BUFFER_SIZE, &chunk))
 				break;
@@ -190,7 +223,7 @@ static int iucvtty_worker(int terminal, const struct iucvterm_cfg *cfg)
 			}
 		}
 
-		if (FD_ISSET(STDIN_FILENO, &set)) {
+		if (ready_stdin) {
 			if (iucvtty_read_data(STDIN_FILENO, msg,
 					      MSG_BUFFER_SIZE))
 				break;
@@ -227,6 +260,7 @@ static int iucvtty_worker(int terminal, const struct iucvterm_cfg *cfg)
 	}
 
 out_worker_loop:
+	close(epfd);
 	free(msg);
 	return 0;
 }
@@ -15,11 +15,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 #include <utmp.h>
 
@@ -34,6 +35,7 @@
 #define PRG_COMPONENT           SYSLOG_IDENT
 #define TERM_BUFSIZE		256
 #define TERM_DEFAULT		"linux"
+#define TX_FLUSH_DELAY_NS	5000000		/* 5 ms */
 
 
 static volatile sig_atomic_t sig_shutdown;
@@ -63,6 +65,60 @@ static int exec_login_prog(char *cmd[])
 	return rc;
 }
 
+/**
+ * now_ns() - Return monotonic time stamp in nanoseconds
+ */
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * iucvtty_tx_append() - Append terminal output to a pending message
+ * @from:	File descriptor to read data from
+ * @msg:	Pending iucv tty message
+ * @len:	Size of message buffer
+ *
+ * Reads as much data from @from as fits behind the data already pending
+ * in @msg.
+ */
+static int iucvtty_tx_append(int from, struct iucvtty_msg *msg, size_t len)
+{
+	ssize_t r;
+
+	do {
+		r = read(from, msg->data + msg->datalen,
+			 len - MSG_DATA_OFFSET - msg->datalen);
+	} while (r == -1 && errno == EINTR);
+	if (r <= 0)
+		return -1;
+	msg->type     = MSG_TYPE_DATA;
+	msg->datalen += (uint16_t) r;
+
+	return 0;
+}
+
+/**
+ * iucvtty_tx_flush() - Send pending terminal output
+ * @dest:	File descriptor to send data to
+ * @msg:	Pending iucv tty message
+ * @last:	Time stamp of the last flush, updated
+ */
+static int iucvtty_tx_flush(int dest, struct iucvtty_msg *msg, uint64_t *last)
+{
+	int rc = 0;
+
+	if (msg->datalen)
+		rc = iucvtty_write_msg(dest, msg);
+	msg->datalen = 0;
+	*last = now_ns();
+
+	return rc;
+}
+
 /**
  * iucvtty_worker() - Handle an incoming client connection
  * @client:	Client file descriptor
@@ -74,11 +130,14 @@ static int iucvtty_worker(int client, int master, int slave,
 			  const struct iucvterm_cfg *cfg)
 {
 	int rc;
-	struct iucvtty_msg *msg;
+	struct iucvtty_msg *msg, *txmsg;
 	pid_t child;
-	fd_set set;
+	struct epoll_event ev, events[2];
+	int epfd, nev, timeout, i;
+	int ready_client, ready_master;
 	size_t chunk;
 	char term_env[TERM_BUFSIZE];
+	uint64_t now, last_flush, deadline;
 
 
 	/* flush pending terminal data */
@@ -115,28 +174,63 @@ static int iucvtty_worker(int client, int master, int slave,
 
 	/* setup buffers */
 	msg = malloc(MSG_BUFFER_SIZE);
-	if (msg == NULL) {
+	txmsg = malloc(MSG_TX_BUFFER_SIZE);
+	if (msg == NULL || txmsg == NULL) {
 		print_error("Allocating memory for the data buffer failed");
+		free(msg);
+		free(txmsg);
 		rc = 2;
 		goto out_kill_login;
 	}
+	txmsg->datalen = 0;
 
-	/* multiplex i/o between login program and socket. */
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1) {
+		print_error("Creating an epoll instance failed");
+		free(msg);
+		free(txmsg);
+		rc = 2;
+		goto out_kill_login;
+	}
+	ev.events = EPOLLIN;
+	ev.data.fd = client;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, client, &ev);
+	ev.data.fd = master;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, master, &ev);
+
+	/* multiplex i/o between login program and socket.
+	 *
+	 * Terminal output is coalesced into large messages: Output that
+	 * arrives after an idle period (e.g. the echo of a keystroke) is sent
+	 * at once.  Output that follows within TX_FLUSH_DELAY_NS is collected
+	 * until the message buffer is full or the delay expired. */
 	rc = 0;
 	chunk = 0;
+	deadline = 0;
+	last_flush = 0;
 	while (!sig_shutdown) {
-		FD_ZERO(&set);
-		FD_SET(client, &set);
-		FD_SET(master, &set);
-
-		if (select(MAX(master, client) + 1, &set,
-			   NULL, NULL, NULL) == -1) {
+		timeout = -1;
+		if (deadline) {
+			now = now_ns();
+			now = (deadline > now) ? deadline - now : 0;
+			/* round up to full milliseconds */
+			timeout = (now + 999999) / 1000000;
+		}
+		nev = epoll_wait(epfd, events, 2, timeout);
+		if (nev == -1) {
 			if (errno == EINTR)
 				continue;
 			break;
 		}
+		ready_client = ready_master = 0;
+		for (i = 0; i < nev; i++) {
+			if (events[i].data.fd == client)
+				ready_client = 1;
+			else
+				ready_master = 1;
+		}
 
-		if (FD_ISSET(client, &set)) {
+		if (ready_client) {
 			if (iucvtty_read_msg(client, msg,
 					     MSG_BUFFER_SIZE, &chunk))
 				break;
@@ -160,11 +254,33 @@ static int iucvtty_worker(int client, int master, int slave,
 			}
 		}
 
-		if (FD_ISSET(master, &set))
-			if (iucvtty_tx_data(client, master,
-					    msg, MSG_BUFFER_SIZE))
+		if (ready_master) {
+			if (iucvtty_tx_append(master, txmsg,
+					      MSG_TX_BUFFER_SIZE))
+				break;
+			now = now_ns();
+			if (msg_size(txmsg) == MSG_TX_BUFFER_SIZE ||
+			    (!deadline &&
+			     now - last_flush >= TX_FLUSH_DELAY_NS)) {
+				if (iucvtty_tx_flush(client, txmsg,
+						     &last_flush))
+					break;
+				deadline = 0;
+			} else if (!deadline) {
+				deadline = now + TX_FLUSH_DELAY_NS;
+			}
+		}
+
+		if (deadline && now_ns() >= deadline) {
+			if (iucvtty_tx_flush(client, txmsg, &last_flush))
 				break;
+			deadline = 0;
+		}
 	}
+	/* send remaining output, e.g. after the login program ended */
+	iucvtty_tx_flush(client, txmsg, &last_flush);
+	close(epfd);
+	free(txmsg);
 	free(msg);
 
 out_kill_login:
@@ -11,6 +11,7 @@
 #include <strings.h>
 #include <errno.h>
 #include <err.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <sys/stat.h>
 #include <time.h>
@@ -67,6 +68,7 @@
 #define EKMF_URI_TEMPLATE_SEQNO		"/api/v1/templates/%s/sequenceNumber"
 
 #define LIST_ELEMENTS_PER_PAGE		20
+#define KEY_INFOS_PARALLEL		4
 #define TEMPLATE_STATE_ACTIVE		"ACTIVE"
 #define KEY_STATE_ACTIVE		"ACTIVE"
 #define KEY_ALGORITHM_AES		"AES"
@@ -137,6 +139,48 @@ struct curl_sslctx_cb_data {
 	bool verbose;
 };
 
+/*
+ * CURL handles of requests performed without a caller supplied CURL handle
+ * are kept in a pool, instead of destroying them after each request. All
+ * CURL handles of the library use a common share object for the connection
+ * cache, the TLS session cache and the DNS cache. This keeps the connection
+ * to the EKMF Web server alive across requests, and a new connection can
+ * resume a previous TLS session instead of performing a full handshake.
+ */
+#define CURL_POOL_SIZE		8
+
+static pthread_mutex_t curl_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t curl_share_mutex =
+					PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static CURL *curl_pool[CURL_POOL_SIZE];
+static unsigned int curl_pool_count;
+static CURLSH *curl_share;
+static bool curl_share_failed;
+
+/*
+ * The login token is stored in a file, so that all processes using the same
+ * configuration share it. The most recently read token is additionally kept
+ * in memory, together with its validity period, so that a burst of requests
+ * does not read and parse the token file again for every request. The file
+ * is checked for modifications before each use of the cached token.
+ */
+struct login_token_cache {
+	char *file_name;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	struct timespec ctime;
+	char *token;
+	bool has_exp;
+	int64_t exp;
+	bool has_nbf;
+	int64_t nbf;
+};
+
+static pthread_mutex_t login_token_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct login_token_cache login_token_cache;
+
 #define CURL_CERTINFO_CERT	"Cert:"
 #define HTTP_HDR_CONTENT_TYPE	"Content-Type:"
 
@@ -663,6 +707,74 @@ static CURLcode _ekmf_sslctx_cb(CURL *UNUSED(curl), void *sslctx, void *parm)
 	return CURLE_OK;
 }
 
+static void _ekmf_curl_share_lock(CURL *UNUSED(curl),
+				  curl_lock_data UNUSED(data),
+				  curl_lock_access UNUSED(access),
+				  void *UNUSED(userptr))
+{
+	pthread_mutex_lock(&curl_share_mutex);
+}
+
+static void _ekmf_curl_share_unlock(CURL *UNUSED(curl),
+				    curl_lock_data UNUSED(data),
+				    void *UNUSED(userptr))
+{
+	pthread_mutex_unlock(&curl_share_mutex);
+}
+
+/**
+ * Returns the CURL share object used by all CURL handles of the library. It
+ * is created on first use. If it can not be created, NULL is returned and
+ * the requests are performed without sharing.
+ */
+static CURLSH *_ekmf_get_curl_share(bool verbose)
+{
+	CURLSH *share;
+	int rc;
+
+	pthread_mutex_lock(&curl_pool_mutex);
+	if (curl_share != NULL || curl_share_failed)
+		goto out;
+
+	share = curl_share_init();
+	if (share == NULL) {
+		pr_verbose(verbose, "curl_share_init failed");
+		curl_share_failed = true;
+		goto out;
+	}
+
+	rc = curl_share_setopt(share, CURLSHOPT_LOCKFUNC,
+			       _ekmf_curl_share_lock);
+	if (rc == CURLSHE_OK)
+		rc = curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC,
+				       _ekmf_curl_share_unlock);
+	if (rc == CURLSHE_OK)
+		rc = curl_share_setopt(share, CURLSHOPT_SHARE,
+				       CURL_LOCK_DATA_SSL_SESSION);
+	if (rc == CURLSHE_OK)
+		rc = curl_share_setopt(share, CURLSHOPT_SHARE,
+				       CURL_LOCK_DATA_DNS);
+#if LIBCURL_VERSION_NUM >= 0x073900
+	if (rc == CURLSHE_OK)
+		rc = curl_share_setopt(share, CURLSHOPT_SHARE,
+				       CURL_LOCK_DATA_CONNECT);
+#endif
+	if (rc != CURLSHE_OK) {
+		pr_verbose(verbose, "curl_share_setopt failed: %s",
+			   curl_share_strerror(rc));
+		curl_share_cleanup(share);
+		curl_share_failed = true;
+		goto out;
+	}
+
+	curl_share = share;
+
+out:
+	share = curl_share;
+	pthread_mutex_unlock(&curl_pool_mutex);
+	return share;
+}
+
 /**
  * Perform an HTTP request to the url constructed from the base_url in config
  * and th uri specified using the specified HTTP request.
@@ -713,6 +825,7 @@ static int _ekmf_perform_request(const struct ekmf_config *config,
 	char *url = NULL;
 	const char *str;
 	struct stat sb;
+	CURLSH *share;
 	char *auth_hdr;
 	int i, rc;
 
@@ -742,6 +855,25 @@ static int _ekmf_perform_request(const struct ekmf_config *config,
 	rc = curl_easy_setopt(curl, CURLOPT_URL, url);
 	CURL_ERROR_CHECK(rc, "curl_easy_setopt CURLOPT_URL", verbose, out);
 
+	share = _ekmf_get_curl_share(verbose);
+	if (share != NULL) {
+		rc = curl_easy_setopt(curl, CURLOPT_SHARE, share);
+		CURL_ERROR_CHECK(rc, "curl_easy_setopt CURLOPT_SHARE", verbose,
+				 out);
+	}
+
+	rc = curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	CURL_ERROR_CHECK(rc, "curl_easy_setopt CURLOPT_TCP_KEEPALIVE", verbose,
+			 out);
+
+	/* Use HTTP/2 if the server supports it, fall back to HTTP/1.1 */
+	if (curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2) {
+		rc = curl_easy_setopt(curl, CURLOPT_HTTP_VERSION,
+				      CURL_HTTP_VERSION_2TLS);
+		CURL_ERROR_CHECK(rc, "curl_easy_setopt CURLOPT_HTTP_VERSION",
+				 verbose, out);
+	}
+
 	rc = curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER,
 			 config->tls_verify_peer ? 1L : 0L);
 	CURL_ERROR_CHECK(rc, "curl_easy_setopt CURLOPT_SSL_VERIFYPEER", verbose,
@@ -1037,17 +1169,25 @@ out:
 
 /**
  * Allocates or reuses a CURL handle. If curl_handle is not NULL, and
- * points to a non-NULL CURL handle, it is used, otherwise a new CURL handle
- * is allocated.
+ * points to a non-NULL CURL handle, it is used, otherwise a CURL handle is
+ * taken from the pool, or a new CURL handle is allocated.
  */
 static int _ekmf_get_curl_handle(CURL **curl_handle, CURL **curl)
 {
 	if (curl == NULL)
 		return -EINVAL;
 
+	*curl = NULL;
 	if (curl_handle != NULL)
 		*curl = *curl_handle;
 
+	if (*curl == NULL) {
+		pthread_mutex_lock(&curl_pool_mutex);
+		if (curl_pool_count > 0)
+			*curl = curl_pool[--curl_pool_count];
+		pthread_mutex_unlock(&curl_pool_mutex);
+	}
+
 	if (*curl == NULL)
 		*curl = curl_easy_init();
 
@@ -1060,19 +1200,43 @@ static int _ekmf_get_curl_handle(CURL **curl_handle, CURL **curl)
 /**
  * Releases a CURL handle. If curl_handle is not NULL, then the used CURL
  * handle is passed back via *curl_handle. If curl_handle is NULL, then the
- * used CURL handle is destroyed.
+ * used CURL handle is returned to the pool, or destroyed if the pool is full.
  */
 static void _ekmf_release_curl_handle(CURL **curl_handle, CURL *curl)
 {
 	if (curl == NULL)
 		return;
 
-	if (curl_handle != NULL)
+	if (curl_handle != NULL) {
 		*curl_handle = curl;
-	else
+		return;
+	}
+
+	pthread_mutex_lock(&curl_pool_mutex);
+	if (curl_pool_count < CURL_POOL_SIZE) {
+		curl_pool[curl_pool_count++] = curl;
+		curl = NULL;
+	}
+	pthread_mutex_unlock(&curl_pool_mutex);
+
+	if (curl != NULL)
 		curl_easy_cleanup(curl);
 }
 
+/**
+ * Destroys the pooled CURL handles and the CURL share object
+ */
+static void _ekmf_curl_pool_cleanup(void)
+{
+	pthread_mutex_lock(&curl_pool_mutex);
+	while (curl_pool_count > 0)
+		curl_easy_cleanup(curl_pool[--curl_pool_count]);
+	if (curl_share != NULL)
+		curl_share_cleanup(curl_share);
+	curl_share = NULL;
+	pthread_mutex_unlock(&curl_pool_mutex);
+}
+
 /**
  * Print the certificate(s) contained in the specified PEM file.
  *
@@ -1112,6 +1276,104 @@ int ekmf_print_certificates(const char *cert_pem, bool verbose)
 	return rc;
 }
 
+/**
+ * Returns true if the cached login token belongs to the token file with the
+ * specified name and status. Must be called with login_token_mutex held.
+ */
+static bool _ekmf_login_token_cached(const char *file_name,
+				     const struct stat *sb)
+{
+	struct login_token_cache *c = &login_token_cache;
+
+	return c->file_name != NULL && strcmp(c->file_name, file_name) == 0 &&
+	       c->dev == sb->st_dev && c->ino == sb->st_ino &&
+	       c->size == sb->st_size &&
+	       c->mtime.tv_sec == sb->st_mtim.tv_sec &&
+	       c->mtime.tv_nsec == sb->st_mtim.tv_nsec &&
+	       c->ctime.tv_sec == sb->st_ctim.tv_sec &&
+	       c->ctime.tv_nsec == sb->st_ctim.tv_nsec;
+}
+
+/**
+ * Replaces the cached login token. Takes ownership of token. Must be called
+ * with login_token_mutex held.
+ */
+static void _ekmf_login_token_cache_set(const char *file_name,
+					const struct stat *sb, char *token,
+					bool has_exp, int64_t exp,
+					bool has_nbf, int64_t nbf)
+{
+	struct login_token_cache *c = &login_token_cache;
+	char *name;
+
+	name = strdup(file_name);
+	if (name == NULL) {
+		free(token);
+		return;
+	}
+
+	free(c->file_name);
+	free(c->token);
+	c->file_name = name;
+	c->dev = sb->st_dev;
+	c->ino = sb->st_ino;
+	c->size = sb->st_size;
+	c->mtime = sb->st_mtim;
+	c->ctime = sb->st_ctim;
+	c->token = token;
+	c->has_exp = has_exp;
+	c->exp = exp;
+	c->has_nbf = has_nbf;
+	c->nbf = nbf;
+}
+
+/**
+ * Checks the validity period of the cached login token and returns a copy
+ * of it, if it is valid and login_token is not NULL. Must be called with
+ * login_token_mutex held.
+ */
+static int _ekmf_login_token_cache_check(bool *valid, char **login_token,
+					 bool verbose)
+{
+	struct login_token_cache *c = &login_token_cache;
+	time_t now;
+
+	time(&now);
+	*valid = true;
+
+	if (c->has_exp && now > c->exp) {
+		pr_verbose(verbose, "JWT is expired");
+		*valid = false;
+	}
+
+	if (c->has_nbf && now <= c->nbf) {
+		pr_verbose(verbose, "JWT is not yet valid");
+		*valid = false;
+	}
+
+	if (login_token != NULL && *valid) {
+		*login_token = strdup(c->token);
+		if (*login_token == NULL) {
+			pr_verbose(verbose, "Failed to allocate a buffer");
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Frees the cached login token
+ */
+static void _ekmf_login_token_cache_cleanup(void)
+{
+	pthread_mutex_lock(&login_token_mutex);
+	free(login_token_cache.file_name);
+	free(login_token_cache.token);
+	memset(&login_token_cache, 0, sizeof(login_token_cache));
+	pthread_mutex_unlock(&login_token_mutex);
+}
+
 /**
  * Checks if the login token stored in the file denoted by field login_token
  * of the config structure is valid or not. The file (if existent) contains a
@@ -1120,6 +1382,8 @@ int ekmf_print_certificates(const char *cert_pem, bool verbose)
  * not-before time ("nbf" claim).
  * Note: The signature (if any) of the JWT is not checked, nor any other JWT
  * fields.
+ * The token file is only read and parsed again when it was modified since
+ * the previous call.
  *
  * @param config            the configuration structure
  * @param valid             On return: true if the token is valid, false if not
@@ -1136,21 +1400,20 @@ int ekmf_check_login_token(const struct ekmf_config *config, bool *valid,
 	json_object *jwt_payload = NULL;
 	json_object *exp_claim = NULL;
 	json_object *nbf_claim = NULL;
+	bool has_exp = false, has_nbf = false;
+	int64_t exp = 0, nbf = 0;
 	char *token = NULL;
 	size_t count, size;
-	int64_t exp, nbf;
 	FILE *fp = NULL;
 	struct stat sb;
 	int rc = 0;
-	time_t now;
 
 	if (config == NULL || valid == NULL)
 		return -EINVAL;
 
-	if (config->login_token == NULL) {
-		*valid = false;
+	*valid = false;
+	if (config->login_token == NULL)
 		return 0;
-	}
 
 	if (login_token != NULL)
 		*login_token = NULL;
@@ -1164,6 +1427,16 @@ int ekmf_check_login_token(const struct ekmf_config *config, bool *valid,
 			   config->login_token, strerror(-rc));
 		return rc;
 	}
+
+	pthread_mutex_lock(&login_token_mutex);
+	if (_ekmf_login_token_cached(config->login_token, &sb)) {
+		pr_verbose(verbose, "Using cached login token");
+		rc = _ekmf_login_token_cache_check(valid, login_token, verbose);
+		pthread_mutex_unlock(&login_token_mutex);
+		return rc;
+	}
+	pthread_mutex_unlock(&login_token_mutex);
+
 	size = sb.st_size;
 	if (size == 0) {
 		pr_verbose(verbose, "File %s is empty", config->login_token);
@@ -1198,9 +1471,6 @@ int ekmf_check_login_token(const struct ekmf_config *config, bool *valid,
 	fclose(fp);
 	fp = NULL;
 
-	time(&now);
-	*valid = true;
-
 	rc = parse_json_web_token(token, NULL, &jwt_payload, NULL, NULL);
 	if (rc != 0) {
 		pr_verbose(verbose, "parse_json_web_token failed");
@@ -1216,11 +1486,7 @@ int ekmf_check_login_token(const struct ekmf_config *config, bool *valid,
 			rc = -EIO;
 			goto out;
 		}
-
-		if (now > exp) {
-			pr_verbose(verbose, "JWT is expired");
-			*valid = false;
-		}
+		has_exp = true;
 	}
 
 	if (json_object_object_get_ex(jwt_payload, "nbf", &nbf_claim) &&
@@ -1232,17 +1498,15 @@ int ekmf_check_login_token(const struct ekmf_config *config, bool *valid,
 			rc = -EIO;
 			goto out;
 		}
-
-		if (now <= nbf) {
-			pr_verbose(verbose, "JWT is not yet valid");
-			*valid = false;
-		}
+		has_nbf = true;
 	}
 
-	if (login_token != NULL && *valid) {
-		*login_token = token;
-		token = NULL;
-	}
+	pthread_mutex_lock(&login_token_mutex);
+	_ekmf_login_token_cache_set(config->login_token, &sb, token,
+				    has_exp, exp, has_nbf, nbf);
+	token = NULL;
+	rc = _ekmf_login_token_cache_check(valid, login_token, verbose);
+	pthread_mutex_unlock(&login_token_mutex);
 
 out:
 	if (jwt_payload != NULL)
@@ -3837,6 +4101,210 @@ out:
 	return rc;
 }
 
+struct ekmf_key_infos_data_t {
+	const struct ekmf_config *config;
+	const char **key_uuids;
+	size_t num_keys;
+	size_t next;
+	ekmf_key_cb_t key_cb;
+	void *cb_private;
+	pthread_mutex_t mutex;
+	char *error_msg;
+	int rc;
+	bool verbose;
+};
+
+struct ekmf_key_infos_worker_t {
+	struct ekmf_key_infos_data_t *data;
+	CURL **curl_handle;
+	CURL *curl;
+	pthread_t thread;
+};
+
+/**
+ * Worker for ekmf_get_key_infos. Gets the info of the next key that is not
+ * yet retrieved by any other worker, until all keys are processed, or until
+ * any worker has failed. The key callback is called with the mutex held, so
+ * that the application callback is never called concurrently.
+ */
+static void *_ekmf_key_infos_worker(void *arg)
+{
+	struct ekmf_key_infos_worker_t *worker = arg;
+	struct ekmf_key_infos_data_t *data = worker->data;
+	struct ekmf_key_info *key;
+	char *error_msg = NULL;
+	bool stop;
+	size_t i;
+	int rc;
+
+	while (1) {
+		pthread_mutex_lock(&data->mutex);
+		i = data->next++;
+		stop = data->rc != 0 || i >= data->num_keys;
+		pthread_mutex_unlock(&data->mutex);
+		if (stop)
+			break;
+
+		key = NULL;
+		rc = ekmf_get_key_info(data->config, worker->curl_handle,
+				       data->key_uuids[i], &key, &error_msg,
+				       data->verbose);
+		if (rc != 0)
+			pr_verbose(data->verbose, "Failed to get key info for "
+				   "'%s'", data->key_uuids[i]);
+
+		pthread_mutex_lock(&data->mutex);
+		if (rc == 0 && data->rc == 0) {
+			rc = data->key_cb(*worker->curl_handle, key,
+					  data->cb_private);
+			if (rc != 0)
+				pr_verbose(data->verbose, "Key callback rc: %d",
+					   rc);
+		}
+		if (rc != 0 && data->rc == 0) {
+			data->rc = rc;
+			data->error_msg = error_msg;
+			error_msg = NULL;
+		}
+		pthread_mutex_unlock(&data->mutex);
+
+		if (key != NULL)
+			ekmf_free_key_info(key);
+		if (error_msg != NULL)
+			free(error_msg);
+		error_msg = NULL;
+	}
+
+	return NULL;
+}
+
+/**
+ * Get information about multiple keys by their UUIDs. Up to max_parallel
+ * keys are retrieved concurrently, each using its own CURL handle and its
+ * own connection to the server. The key callback is called for each key as
+ * soon as its information has been received, thus the keys are not
+ * necessarily passed to the callback in the order of the key_uuids array.
+ * The callback is never called concurrently.
+ *
+ * To perform a single request, set curl_handle to NULL. This will cause the
+ * function to initialize a new CURL handle, use it, and destroy it.
+ * If you plan to perform multiple requests to the same host, supply the address
+ * of a CURL pointer that is initially NULL. This function will then initialize
+ * a new CURL handle on the first call. On subsequent calls, pass in the address
+ * of the same CURL pointer so that the CURL handle is reused. After the last
+ * request, the CURL handle must be destroyed by calling ekmf_curl_destroy).
+ *
+ * @param config            the configuration structure
+ * @param curl_handle       address of a CURL handle used for reusing the same
+ *                          CURL handle with multiple requests.
+ * @param key_uuids         an array of UUIDs of the keys to get info for
+ * @param num_keys          the number of UUIDs in key_uuids
+ * @param max_parallel      the maximum number of keys to retrieve
+ *                          concurrently, or 0 to use the default
+ * @param key_cb            a callback function that is called for each key
+ * @param private           a pointer that is passed as-is to the callback
+ * @param error_msg         on return: If not NULL, then a textual error message
+ *                          is returned in case of a failing request. The caller
+ *                          must free the error string when it is not NULL.
+ * @param verbose           if true, verbose messages are printed
+ *
+ * @returns zero for success, a negative errno in case of an error.
+ *          -EACCES is returned, if no or no valid login token is available.
+ *          -EPERM is returned if the login token does not have permission to
+ *          get the key info.
+ *          -ENOENT is returned if one of the keys does not exist.
+ *          If the callback returns nonzero, then no further keys are
+ *          passed to the callback, and the return code of the callback is
+ *          returned.
+ */
+int ekmf_get_key_infos(const struct ekmf_config *config, CURL **curl_handle,
+		       const char **key_uuids, size_t num_keys,
+		       unsigned int max_parallel, ekmf_key_cb_t key_cb,
+		       void *private, char **error_msg, bool verbose)
+{
+	struct ekmf_key_infos_worker_t *workers = NULL;
+	struct ekmf_key_infos_data_t data = { 0 };
+	unsigned int num_workers, started, i;
+	CURL *curl = NULL;
+	int rc;
+
+	if (config == NULL || key_uuids == NULL || key_cb == NULL)
+		return -EINVAL;
+
+	if (num_keys == 0)
+		return 0;
+
+	if (max_parallel == 0)
+		max_parallel = KEY_INFOS_PARALLEL;
+	num_workers = num_keys < max_parallel ? num_keys : max_parallel;
+
+	workers = calloc(num_workers, sizeof(struct ekmf_key_infos_worker_t));
+	if (workers == NULL) {
+		pr_verbose(verbose, "calloc failed");
+		return -ENOMEM;
+	}
+
+	/*
+	 * Get the CURL handle of the calling thread before starting other
+	 * threads, so that a first CURL handle is initialized
+	 * single-threaded.
+	 */
+	if (curl_handle == NULL)
+		curl_handle = &curl;
+	rc = _ekmf_get_curl_handle(curl_handle, &curl);
+	if (rc != 0) {
+		pr_verbose(verbose, "Failed to get CURL handle");
+		rc = -EIO;
+		goto out;
+	}
+	*curl_handle = curl;
+
+	data.config = config;
+	data.key_uuids = key_uuids;
+	data.num_keys = num_keys;
+	data.key_cb = key_cb;
+	data.cb_private = private;
+	data.verbose = verbose;
+	pthread_mutex_init(&data.mutex, NULL);
+
+	/* The calling thread acts as worker 0 */
+	for (started = 1; started < num_workers; started++) {
+		workers[started].data = &data;
+		workers[started].curl_handle = &workers[started].curl;
+		if (pthread_create(&workers[started].thread, NULL,
+				   _ekmf_key_infos_worker,
+				   &workers[started]) != 0) {
+			pr_verbose(verbose, "pthread_create failed, continue "
+				   "with %u workers", started);
+			break;
+		}
+	}
+
+	workers[0].data = &data;
+	workers[0].curl_handle = curl_handle;
+	_ekmf_key_infos_worker(&workers[0]);
+
+	for (i = 1; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		_ekmf_release_curl_handle(NULL, workers[i].curl);
+	}
+
+	pthread_mutex_destroy(&data.mutex);
+
+	rc = data.rc;
+	if (error_msg != NULL && *error_msg == NULL)
+		*error_msg = data.error_msg;
+	else if (data.error_msg != NULL)
+		free(data.error_msg);
+
+out:
+	if (curl_handle == &curl)
+		_ekmf_release_curl_handle(NULL, curl);
+	free(workers);
+
+	return rc;
+}
+
 /**
  * Changes the state of a key identified by its UUID. To update a key,
  * the timestamp from the last update is required. This can be found in
@@ -5625,6 +6093,8 @@ void __attribute__ ((constructor)) ekmf_init(void)
  */
 void __attribute__ ((destructor)) ekmf_exit(void)
 {
+	_ekmf_curl_pool_cleanup();
+	_ekmf_login_token_cache_cleanup();
 	curl_global_cleanup();
 }
 
@@ -0,0 +1,408 @@
+/*
+ * util_bench - Microbenchmarks for libutil data structures
+ *
+ * Measure util_list, util_rec, util_file, and util_scandir and print the
+ * time and the number of memory allocations per operation.
+ *
+ * Copyright IBM Corp. 2026
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib/util_base.h"
+#include "lib/util_file.h"
+#include "lib/util_libc.h"
+#include "lib/util_list.h"
+#include "lib/util_opt.h"
+#include "lib/util_prg.h"
+#include "lib/util_rec.h"
+#include "lib/util_scandir.h"
+
+/* Minimum number of operations for each measurement */
+#define MIN_OPS		1000000UL
+
+static struct {
+	unsigned long max_entries;
+	unsigned long files;
+	const char *dir;
+	FILE *out;
+	unsigned long allocs;
+} l = {
+	.max_entries = 1000000,
+	.files = 10000,
+	.dir = "/dev/shm",
+};
+
+struct entry {
+	struct util_list_node node;
+	unsigned long key;
+};
+
+/* Start of one measurement */
+struct result {
+	double start;
+	unsigned long allocs;
+};
+
+/* Keeps the compiler from optimizing away measured loops */
+static volatile unsigned long sink;
+
+static struct util_opt opt_vec[] = {
+	UTIL_OPT_SECTION("OPTIONS"),
+	{
+		.option = { "entries", required_argument, NULL, 'n' },
+		.argument = "NUM",
+		.desc = "Maximum number of list entries (default 1000000)",
+	},
+	{
+		.option = { "files", required_argument, NULL, 'f' },
+		.argument = "NUM",
+		.desc = "Number of files for util_scandir (default 10000)",
+	},
+	{
+		.option = { "dir", required_argument, NULL, 'd' },
+		.argument = "DIR",
+		.desc = "Directory for temporary files, preferably on tmpfs "
+			"(default /dev/shm)",
+	},
+	UTIL_OPT_HELP,
+	UTIL_OPT_VERSION,
+	UTIL_OPT_END
+};
+
+static const struct util_prg prg = {
+	.desc = "Run microbenchmarks for libutil data structures",
+	.copyright_vec = {
+		{
+			.owner = "IBM Corp.",
+			.pub_first = 2026,
+			.pub_last = 2026,
+		},
+		UTIL_PRG_COPYRIGHT_END
+	}
+};
+
+/*
+ * Count all memory allocations, including those in the C library. The
+ * glibc allocator functions are exported as __libc_*().
+ */
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	l.allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	l.allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	l.allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+static unsigned long parse_num(const char *arg, const char *name)
+{
+	unsigned long val;
+	char *end;
+
+	errno = 0;
+	val = strtoul(arg, &end, 10);
+	if (errno || *end || arg[0] == '-' || !val)
+		errx(EXIT_FAILURE, "Invalid value for %s: %s", name, arg);
+	return val;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = util_opt_getopt_long(argc, argv)) != -1) {
+		switch (opt) {
+		case 'n':
+			l.max_entries = parse_num(optarg, "--entries");
+			break;
+		case 'f':
+			l.files = parse_num(optarg, "--files");
+			break;
+		case 'd':
+			l.dir = optarg;
+			break;
+		case 'h':
+			util_prg_print_help();
+			util_opt_print_help();
+			exit(EXIT_SUCCESS);
+		case 'v':
+			util_prg_print_version();
+			exit(EXIT_SUCCESS);
+		default:
+			util_opt_print_parse_error(opt, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (optind != argc)
+		errx(EXIT_FAILURE, "Too many arguments");
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void result_start(struct result *res)
+{
+	res->allocs = l.allocs;
+	res->start = now();
+}
+
+static void report(const char *name, unsigned long n, unsigned long ops,
+		   double elapsed, unsigned long allocs)
+{
+	fprintf(l.out, "%-24s %10lu %12.1f %12.3f\n", name, n,
+		elapsed / ops * 1e9, (double)allocs / ops);
+}
+
+static void result_print(struct result *res, const char *name,
+			 unsigned long n, unsigned long ops)
+{
+	report(name, n, ops, now() - res->start, l.allocs - res->allocs);
+}
+
+/*
+ * Return how often an operation on n elements is repeated
+ */
+static unsigned long repeat(unsigned long n)
+{
+	return MAX(1UL, MIN_OPS / n);
+}
+
+static int entry_cmp(void *a, void *b, void *UNUSED(data))
+{
+	struct entry *e1 = a, *e2 = b;
+
+	if (e1->key < e2->key)
+		return -1;
+	return e1->key > e2->key;
+}
+
+static void bench_list(unsigned long n)
+{
+	unsigned long i, r, rep = repeat(n), sum = 0, allocs = 0;
+	struct util_list list;
+	double elapsed = 0;
+	struct result res;
+	struct entry *vec, *e;
+
+	vec = util_malloc(n * sizeof(*vec));
+	util_list_init(&list, struct entry, node);
+
+	result_start(&res);
+	for (r = 0; r < rep; r++) {
+		util_list_init(&list, struct entry, node);
+		for (i = 0; i < n; i++)
+			util_list_add_tail(&list, &vec[i]);
+	}
+	result_print(&res, "util_list_add_tail", n, rep * n);
+
+	result_start(&res);
+	for (r = 0; r < rep; r++) {
+		util_list_iterate(&list, e)
+			sum += e->key;
+	}
+	result_print(&res, "util_list_iterate", n, rep * n);
+	sink = sum;
+
+	/* Sort random keys, the list is rebuilt outside of the measurement */
+	srandom(n);
+	rep = MAX(1UL, rep / 10);
+	for (r = 0; r < rep; r++) {
+		util_list_init(&list, struct entry, node);
+		for (i = 0; i < n; i++) {
+			vec[i].key = random();
+			util_list_add_tail(&list, &vec[i]);
+		}
+		result_start(&res);
+		util_list_sort(&list, entry_cmp, NULL);
+		elapsed += now() - res.start;
+		allocs += l.allocs - res.allocs;
+	}
+	report("util_list_sort", n, rep * n, elapsed, allocs);
+	free(vec);
+}
+
+static void bench_rec(void)
+{
+	unsigned long i, n = 100000;
+	struct util_rec *rec;
+	struct result res;
+
+	rec = util_rec_new_wide("-");
+	util_rec_def(rec, "name", UTIL_REC_ALIGN_LEFT, 16, "Name");
+	util_rec_def(rec, "id", UTIL_REC_ALIGN_RIGHT, 8, "ID");
+	util_rec_def(rec, "state", UTIL_REC_ALIGN_LEFT, 8, "State");
+	util_rec_def(rec, "size", UTIL_REC_ALIGN_RIGHT, 12, "Size");
+	util_rec_def(rec, "desc", UTIL_REC_ALIGN_LEFT, 24, "Description");
+
+	result_start(&res);
+	for (i = 0; i < n; i++) {
+		util_rec_set(rec, "name", "device%lu", i);
+		util_rec_set(rec, "id", "0.0.%04lx", i & 0xffff);
+		util_rec_set(rec, "state", "%s", (i & 1) ? "online" : "offline");
+		util_rec_set(rec, "size", "%lu", i * 4096);
+		util_rec_set(rec, "desc", "Benchmark record %lu", i);
+		util_rec_print(rec);
+	}
+	fflush(stdout);
+	result_print(&res, "util_rec_print (wide)", 5, n);
+	util_rec_free(rec);
+}
+
+static void bench_file(const char *dir)
+{
+	unsigned long i, n = 100000, val;
+	char path[PATH_MAX + 16], line[256];
+	struct result res;
+
+	snprintf(path, sizeof(path), "%s/value", dir);
+	if (util_file_write_ul(123456789, 10, "%s", path))
+		err(EXIT_FAILURE, "Could not write %s", path);
+
+	result_start(&res);
+	for (i = 0; i < n; i++) {
+		if (util_file_read_ul(&val, 10, "%s", path))
+			err(EXIT_FAILURE, "Could not read %s", path);
+	}
+	result_print(&res, "util_file_read_ul", 1, n);
+
+	result_start(&res);
+	for (i = 0; i < n; i++) {
+		if (util_file_read_line(line, sizeof(line), "%s", path))
+			err(EXIT_FAILURE, "Could not read %s", path);
+	}
+	result_print(&res, "util_file_read_line", 1, n);
+
+	result_start(&res);
+	for (i = 0; i < n; i++) {
+		if (util_file_read_va(path, "%lu", &val) != 1)
+			err(EXIT_FAILURE, "Could not read %s", path);
+	}
+	result_print(&res, "util_file_read_va", 1, n);
+	unlink(path);
+}
+
+static int count_cb(const struct dirent *UNUSED(de), void *data)
+{
+	(*(unsigned long *)data)++;
+	return 0;
+}
+
+static void bench_scandir(const char *dir, unsigned long files)
+{
+	unsigned long i, r, rep = MAX(1UL, 100000 / files), count;
+	struct util_scandir_iter *iter;
+	struct dirent **de_vec;
+	char path[PATH_MAX + 32];
+	struct result res;
+	int fd, num;
+
+	for (i = 0; i < files; i++) {
+		snprintf(path, sizeof(path), "%s/file%lu", dir, i);
+		fd = open(path, O_WRONLY | O_CREAT, 0644);
+		if (fd < 0)
+			err(EXIT_FAILURE, "Could not create %s", path);
+		close(fd);
+	}
+
+	result_start(&res);
+	for (r = 0; r < rep; r++) {
+		num = util_scandir(&de_vec, alphasort, dir, "file.*");
+		if (num < 0 || (unsigned long)num != files)
+			errx(EXIT_FAILURE, "Could not scan %s", dir);
+		util_scandir_free(de_vec, num);
+	}
+	result_print(&res, "util_scandir (sorted)", files, rep * files);
+
+	result_start(&res);
+	for (r = 0; r < rep; r++) {
+		count = 0;
+		iter = util_scandir_open(dir, UTIL_SCANDIR_TYPE_REG, "file.*");
+		if (!iter)
+			err(EXIT_FAILURE, "Could not open %s", dir);
+		while (util_scandir_next(iter))
+			count++;
+		util_scandir_close(iter);
+		if (count != files)
+			errx(EXIT_FAILURE, "Could not scan %s", dir);
+	}
+	result_print(&res, "util_scandir_next", files, rep * files);
+
+	result_start(&res);
+	for (r = 0; r < rep; r++) {
+		count = 0;
+		if (util_scandir_iterate(dir, 0, count_cb, &count, NULL) ||
+		    count != files)
+			errx(EXIT_FAILURE, "Could not scan %s", dir);
+	}
+	result_print(&res, "util_scandir_iterate", files, rep * files);
+
+	for (i = 0; i < files; i++) {
+		snprintf(path, sizeof(path), "%s/file%lu", dir, i);
+		unlink(path);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpdir[PATH_MAX];
+	unsigned long n;
+	int fd;
+
+	util_prg_init(&prg);
+	util_opt_init(opt_vec, NULL);
+	parse_args(argc, argv);
+
+	/* Keep the results on stdout and send util_rec output to /dev/null */
+	fd = dup(STDOUT_FILENO);
+	l.out = (fd < 0) ? NULL : fdopen(fd, "w");
+	if (!l.out || !freopen("/dev/null", "w", stdout))
+		err(EXIT_FAILURE, "Could not redirect standard output");
+	setvbuf(l.out, NULL, _IOLBF, 0);
+
+	snprintf(tmpdir, sizeof(tmpdir), "%s/util_bench.XXXXXX", l.dir);
+	if (!mkdtemp(tmpdir))
+		err(EXIT_FAILURE, "Could not create directory in %s", l.dir);
+
+	fprintf(l.out, "%-24s %10s %12s %12s\n", "benchmark", "n", "ns/op",
+		"allocs/op");
+	for (n = 100; n <= l.max_entries; n *= 10)
+		bench_list(n);
+	bench_rec();
+	bench_file(tmpdir);
+	bench_scandir(tmpdir, l.files);
+
+	if (rmdir(tmpdir))
+		warn("Could not remove %s", tmpdir);
+	fclose(l.out);
+	return EXIT_SUCCESS;
+}
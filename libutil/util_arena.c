@@ -0,0 +1,272 @@
+/*
+ * util - Utility function library
+ *
+ * Arena allocator
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/util_arena.h"
+#include "lib/util_libc.h"
+#include "lib/util_panic.h"
+
+#define ARENA_DEFAULT_CHUNK_SIZE	(64 * 1024)
+#define ARENA_ALIGN			16
+
+/*
+ * Memory chunk, chunks are linked from newest to oldest
+ */
+struct chunk {
+	struct chunk *prev;	/* Previously allocated chunk */
+	size_t size;		/* Size of data area */
+	size_t used;		/* Number of used bytes in data area */
+	char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+/*
+ * Arena structure (internal representation)
+ */
+/// @cond
+struct util_arena {
+	struct chunk *cur;	/* Current chunk */
+	size_t chunk_size;	/* Default size of new chunks */
+};
+/// @endcond
+
+/*
+ * Free all chunks newer than "stop"
+ */
+static void chunks_free(struct util_arena *arena, struct chunk *stop)
+{
+	struct chunk *chunk;
+
+	while (arena->cur != stop) {
+		chunk = arena->cur;
+		arena->cur = chunk->prev;
+		free(chunk);
+	}
+}
+
+/*
+ * Add new chunk that can hold at least "size" bytes
+ */
+static struct chunk *chunk_add(struct util_arena *arena, size_t size)
+{
+	struct chunk *chunk;
+
+	if (size < arena->chunk_size)
+		size = arena->chunk_size;
+	chunk = util_malloc(sizeof(*chunk) + size);
+	chunk->prev = arena->cur;
+	chunk->size = size;
+	chunk->used = 0;
+	arena->cur = chunk;
+	return chunk;
+}
+
+/**
+ * Create a new arena
+ *
+ * @param[in] chunk_size  Size of memory chunks or 0 for the default size
+ *
+ * @returns   Pointer to the created arena
+ */
+struct util_arena *util_arena_new(size_t chunk_size)
+{
+	struct util_arena *arena = util_zalloc(sizeof(*arena));
+
+	arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+	return arena;
+}
+
+/**
+ * Free an arena and all objects allocated from it
+ *
+ * @param[in] arena  Arena to free
+ */
+void util_arena_free(struct util_arena *arena)
+{
+	if (!arena)
+		return;
+	chunks_free(arena, NULL);
+	free(arena);
+}
+
+/**
+ * Release all objects of an arena
+ *
+ * The oldest chunk is kept for subsequent allocations.
+ *
+ * @param[in] arena  Arena to reset
+ */
+void util_arena_reset(struct util_arena *arena)
+{
+	struct chunk *first;
+
+	if (!arena->cur)
+		return;
+	for (first = arena->cur; first->prev; first = first->prev)
+		;
+	chunks_free(arena, first);
+	first->used = 0;
+}
+
+/**
+ * Return the current position of an arena
+ *
+ * @param[in] arena  Arena
+ *
+ * @returns   Mark to be passed to util_arena_release()
+ */
+struct util_arena_mark util_arena_mark(struct util_arena *arena)
+{
+	struct util_arena_mark mark;
+
+	mark.chunk = arena->cur;
+	mark.used = arena->cur ? arena->cur->used : 0;
+	return mark;
+}
+
+/**
+ * Release all objects allocated after a mark was taken
+ *
+ * Marks must be released in reverse order of their creation.
+ *
+ * @param[in] arena  Arena
+ * @param[in] mark   Mark returned by util_arena_mark()
+ */
+void util_arena_release(struct util_arena *arena,
+			struct util_arena_mark mark)
+{
+	chunks_free(arena, mark.chunk);
+	if (arena->cur)
+		arena->cur->used = mark.used;
+}
+
+/**
+ * Allocate memory from an arena or panic in case of failure
+ *
+ * The memory is aligned for any object type.
+ *
+ * @param[in] arena  Arena
+ * @param[in] size   Number of bytes to be allocated
+ *
+ * @returns   Pointer to memory buffer
+ */
+void *util_arena_alloc(struct util_arena *arena, size_t size)
+{
+	struct chunk *chunk = arena->cur;
+	size_t aligned;
+	void *ptr;
+
+	aligned = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+	util_assert(aligned >= size, "Arena allocation too large: %zu\n",
+		    size);
+	if (!chunk || chunk->size - chunk->used < aligned)
+		chunk = chunk_add(arena, aligned);
+	ptr = chunk->data + chunk->used;
+	chunk->used += aligned;
+	return ptr;
+}
+
+/**
+ * Allocate zero-initialized memory from an arena
+ *
+ * @param[in] arena  Arena
+ * @param[in] size   Number of bytes to be allocated
+ *
+ * @returns   Pointer to memory buffer
+ */
+void *util_arena_zalloc(struct util_arena *arena, size_t size)
+{
+	void *ptr = util_arena_alloc(arena, size);
+
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+/**
+ * Duplicate at most "len" characters of a string into an arena
+ *
+ * @param[in] arena  Arena
+ * @param[in] str    String to be duplicated
+ * @param[in] len    Maximum number of characters to copy
+ *
+ * @returns   Pointer to NUL-terminated copy
+ */
+char *util_arena_strndup(struct util_arena *arena, const char *str,
+			 size_t len)
+{
+	char *copy;
+
+	len = strnlen(str, len);
+	copy = util_arena_alloc(arena, len + 1);
+	memcpy(copy, str, len);
+	copy[len] = 0;
+	return copy;
+}
+
+/**
+ * Duplicate a string into an arena
+ *
+ * @param[in] arena  Arena
+ * @param[in] str    String to be duplicated
+ *
+ * @returns   Pointer to copy
+ */
+char *util_arena_strdup(struct util_arena *arena, const char *str)
+{
+	return util_arena_strndup(arena, str, strlen(str));
+}
+
+/**
+ * Print to string allocated from an arena
+ *
+ * @param[in] arena  Arena
+ * @param[in] fmt    Format string for generation of string
+ * @param[in] ap     Parameters for format string
+ *
+ * @returns   Pointer to formatted string
+ */
+char *util_arena_vasprintf(struct util_arena *arena, const char *fmt,
+			   va_list ap)
+{
+	va_list ap2;
+	char *str;
+	int len;
+
+	va_copy(ap2, ap);
+	len = vsnprintf(NULL, 0, fmt, ap2);
+	va_end(ap2);
+	util_assert(len >= 0, "Invalid format string: %s\n", fmt);
+	str = util_arena_alloc(arena, len + 1);
+	vsnprintf(str, len + 1, fmt, ap);
+	return str;
+}
+
+/**
+ * Print to string allocated from an arena
+ *
+ * @param[in] arena  Arena
+ * @param[in] fmt    Format string for generation of string
+ * @param[in] ...    Parameters for format string
+ *
+ * @returns   Pointer to formatted string
+ */
+char *util_arena_asprintf(struct util_arena *arena, const char *fmt, ...)
+{
+	va_list ap;
+	char *str;
+
+	va_start(ap, fmt);
+	str = util_arena_vasprintf(arena, fmt, ap);
+	va_end(ap);
+	return str;
+}
@@ -0,0 +1,430 @@
+/*
+ * util - Utility function library
+ *
+ * Open-addressing hash table
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/util_hash.h"
+#include "lib/util_libc.h"
+#include "lib/util_panic.h"
+
+#define HASH_MIN_SIZE	16
+
+/*
+ * Slot states
+ */
+enum slot_state {
+	SLOT_FREE,
+	SLOT_USED,
+	SLOT_DELETED,
+};
+
+/*
+ * Slot of the hash table
+ */
+struct slot {
+	unsigned long hash;	/* Hash value of the key */
+	union {
+		char *str;
+		unsigned long num;
+	} key;			/* Key of the entry */
+	void *value;		/* Value of the entry */
+	enum slot_state state;	/* Slot state */
+};
+
+/*
+ * Hash table structure (internal representation)
+ */
+/// @cond
+struct util_hash {
+	enum util_hash_type type;	/* Key type */
+	struct slot *slots;		/* Slot array */
+	unsigned long size;		/* Number of slots, a power of two */
+	unsigned long len;		/* Number of used slots */
+	unsigned long deleted;		/* Number of deleted slots */
+};
+/// @endcond
+
+/*
+ * Compute FNV-1a hash of a string
+ */
+static unsigned long hash_str(const char *str)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (; *str; str++) {
+		hash ^= (unsigned char) *str;
+		hash *= 0x100000001b3ULL;
+	}
+	return (unsigned long) hash;
+}
+
+/*
+ * Scramble integer key so that consecutive keys are spread over the table
+ */
+static unsigned long hash_int(unsigned long key)
+{
+	uint64_t hash = key;
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return (unsigned long) hash;
+}
+
+/*
+ * Verify that the hash table uses keys of the specified type
+ */
+static inline void check_type(struct util_hash *hash, enum util_hash_type type)
+{
+	util_assert(hash->type == type, "Wrong key type %d for hash table\n",
+		    type);
+}
+
+/*
+ * Check if slot contains the specified key
+ */
+static bool slot_match(struct util_hash *hash, struct slot *slot,
+		       unsigned long h, const void *key)
+{
+	if (slot->state != SLOT_USED || slot->hash != h)
+		return false;
+	if (hash->type == UTIL_HASH_KEY_STR)
+		return strcmp(slot->key.str, key) == 0;
+	return slot->key.num == *(const unsigned long *) key;
+}
+
+/*
+ * Find slot for key, return NULL if key is not in table
+ */
+static struct slot *slot_find(struct util_hash *hash, unsigned long h,
+			      const void *key)
+{
+	unsigned long mask = hash->size - 1, i;
+	struct slot *slot;
+
+	for (i = h & mask; ; i = (i + 1) & mask) {
+		slot = &hash->slots[i];
+		if (slot->state == SLOT_FREE)
+			return NULL;
+		if (slot_match(hash, slot, h, key))
+			return slot;
+	}
+}
+
+/*
+ * Allocate slot array with "size" slots and move all used slots to it
+ */
+static void rehash(struct util_hash *hash, unsigned long size)
+{
+	struct slot *old = hash->slots, *slot;
+	unsigned long old_size = hash->size, mask = size - 1, i, j;
+
+	hash->slots = util_zalloc(size * sizeof(struct slot));
+	hash->size = size;
+	hash->deleted = 0;
+	for (i = 0; i < old_size; i++) {
+		if (old[i].state != SLOT_USED)
+			continue;
+		for (j = old[i].hash & mask; ; j = (j + 1) & mask) {
+			slot = &hash->slots[j];
+			if (slot->state == SLOT_FREE)
+				break;
+		}
+		*slot = old[i];
+	}
+	free(old);
+}
+
+/*
+ * Make sure that at least one more entry can be added
+ *
+ * The table is kept at most 3/4 full, counting deleted slots, so that
+ * probe sequences stay short and always end at a free slot.
+ */
+static void reserve(struct util_hash *hash)
+{
+	if ((hash->len + hash->deleted + 1) * 4 <= hash->size * 3)
+		return;
+	if ((hash->len + 1) * 2 > hash->size)
+		rehash(hash, hash->size * 2);
+	else
+		rehash(hash, hash->size);
+}
+
+/*
+ * Add or replace entry, return previous value
+ */
+static void *hash_set(struct util_hash *hash, unsigned long h,
+		      const void *key, void *value)
+{
+	unsigned long mask, i;
+	struct slot *slot, *target = NULL;
+	void *old;
+
+	slot = slot_find(hash, h, key);
+	if (slot) {
+		old = slot->value;
+		slot->value = value;
+		return old;
+	}
+	reserve(hash);
+	mask = hash->size - 1;
+	for (i = h & mask; ; i = (i + 1) & mask) {
+		target = &hash->slots[i];
+		if (target->state != SLOT_USED)
+			break;
+	}
+	if (target->state == SLOT_DELETED)
+		hash->deleted--;
+	target->hash = h;
+	if (hash->type == UTIL_HASH_KEY_STR)
+		target->key.str = util_strdup(key);
+	else
+		target->key.num = *(const unsigned long *) key;
+	target->value = value;
+	target->state = SLOT_USED;
+	hash->len++;
+	return NULL;
+}
+
+/*
+ * Remove entry, return its value
+ */
+static void *hash_remove(struct util_hash *hash, unsigned long h,
+			 const void *key)
+{
+	struct slot *slot;
+
+	slot = slot_find(hash, h, key);
+	if (!slot)
+		return NULL;
+	if (hash->type == UTIL_HASH_KEY_STR)
+		free(slot->key.str);
+	slot->state = SLOT_DELETED;
+	hash->len--;
+	hash->deleted++;
+	return slot->value;
+}
+
+/**
+ * Create a new hash table
+ *
+ * @param[in] type       Key type
+ * @param[in] size_hint  Expected number of entries or 0 if unknown
+ *
+ * @returns   Pointer to the created hash table
+ */
+struct util_hash *util_hash_new(enum util_hash_type type,
+				unsigned long size_hint)
+{
+	struct util_hash *hash = util_zalloc(sizeof(*hash));
+	unsigned long size = HASH_MIN_SIZE;
+
+	while (size_hint * 4 > size * 3)
+		size *= 2;
+	hash->type = type;
+	hash->size = size;
+	hash->slots = util_zalloc(size * sizeof(struct slot));
+	return hash;
+}
+
+/**
+ * Free a hash table
+ *
+ * @param[in] hash     Hash table to free
+ * @param[in] free_fn  Function to free the values or NULL
+ */
+void util_hash_free(struct util_hash *hash, void (*free_fn)(void *value))
+{
+	unsigned long i;
+
+	if (!hash)
+		return;
+	for (i = 0; i < hash->size; i++) {
+		if (hash->slots[i].state != SLOT_USED)
+			continue;
+		if (hash->type == UTIL_HASH_KEY_STR)
+			free(hash->slots[i].key.str);
+		if (free_fn)
+			free_fn(hash->slots[i].value);
+	}
+	free(hash->slots);
+	free(hash);
+}
+
+/**
+ * Return the number of entries of a hash table
+ *
+ * @param[in] hash  Hash table
+ *
+ * @returns   Number of entries
+ */
+unsigned long util_hash_len(struct util_hash *hash)
+{
+	return hash->len;
+}
+
+/**
+ * Get the value for a string key
+ *
+ * @param[in] hash  Hash table with UTIL_HASH_KEY_STR keys
+ * @param[in] key   Key to look up
+ *
+ * @returns   Value or NULL if the key is not found
+ */
+void *util_hash_get_str(struct util_hash *hash, const char *key)
+{
+	struct slot *slot;
+
+	check_type(hash, UTIL_HASH_KEY_STR);
+	slot = slot_find(hash, hash_str(key), key);
+	return slot ? slot->value : NULL;
+}
+
+/**
+ * Check if a string key is in the hash table
+ *
+ * @param[in] hash  Hash table with UTIL_HASH_KEY_STR keys
+ * @param[in] key   Key to look up
+ *
+ * @returns   true if the key is found, false otherwise
+ */
+bool util_hash_contains_str(struct util_hash *hash, const char *key)
+{
+	check_type(hash, UTIL_HASH_KEY_STR);
+	return slot_find(hash, hash_str(key), key) != NULL;
+}
+
+/**
+ * Set the value for a string key
+ *
+ * A copy of the key is stored in the hash table.
+ *
+ * @param[in] hash   Hash table with UTIL_HASH_KEY_STR keys
+ * @param[in] key    Key of the entry
+ * @param[in] value  New value of the entry
+ *
+ * @returns   Previous value or NULL if the key was not in the hash table
+ */
+void *util_hash_set_str(struct util_hash *hash, const char *key, void *value)
+{
+	check_type(hash, UTIL_HASH_KEY_STR);
+	return hash_set(hash, hash_str(key), key, value);
+}
+
+/**
+ * Remove the entry for a string key
+ *
+ * @param[in] hash  Hash table with UTIL_HASH_KEY_STR keys
+ * @param[in] key   Key of the entry
+ *
+ * @returns   Value of the removed entry or NULL if the key was not found
+ */
+void *util_hash_remove_str(struct util_hash *hash, const char *key)
+{
+	check_type(hash, UTIL_HASH_KEY_STR);
+	return hash_remove(hash, hash_str(key), key);
+}
+
+/**
+ * Get the value for an integer key
+ *
+ * @param[in] hash  Hash table with UTIL_HASH_KEY_INT keys
+ * @param[in] key   Key to look up
+ *
+ * @returns   Value or NULL if the key is not found
+ */
+void *util_hash_get_int(struct util_hash *hash, unsigned long key)
+{
+	struct slot *slot;
+
+	check_type(hash, UTIL_HASH_KEY_INT);
+	slot = slot_find(hash, hash_int(key), &key);
+	return slot ? slot->value : NULL;
+}
+
+/**
+ * Check if an integer key is in the hash table
+ *
+ * @param[in] hash  Hash table with UTIL_HASH_KEY_INT keys
+ * @param[in] key   Key to look up
+ *
+ * @returns   true if the key is found, false otherwise
+ */
+bool util_hash_contains_int(struct util_hash *hash, unsigned long key)
+{
+	check_type(hash, UTIL_HASH_KEY_INT);
+	return slot_find(hash, hash_int(key), &key) != NULL;
+}
+
+/**
+ * Set the value for an integer key
+ *
+ * @param[in] hash   Hash table with UTIL_HASH_KEY_INT keys
+ * @param[in] key    Key of the entry
+ * @param[in] value  New value of the entry
+ *
+ * @returns   Previous value or NULL if the key was not in the hash table
+ */
+void *util_hash_set_int(struct util_hash *hash, unsigned long key,
+			void *value)
+{
+	check_type(hash, UTIL_HASH_KEY_INT);
+	return hash_set(hash, hash_int(key), &key, value);
+}
+
+/**
+ * Remove the entry for an integer key
+ *
+ * @param[in] hash  Hash table with UTIL_HASH_KEY_INT keys
+ * @param[in] key   Key of the entry
+ *
+ * @returns   Value of the removed entry or NULL if the key was not found
+ */
+void *util_hash_remove_int(struct util_hash *hash, unsigned long key)
+{
+	check_type(hash, UTIL_HASH_KEY_INT);
+	return hash_remove(hash, hash_int(key), &key);
+}
+
+/**
+ * Advance iterator to the next entry of a hash table
+ *
+ * @param[in]     hash  Hash table
+ * @param[in,out] it    Iterator, "pos" must be 0 for the first call
+ *
+ * @returns   true if "it" describes the next entry, false at the end
+ */
+bool util_hash_iter_next(struct util_hash *hash, struct util_hash_iter *it)
+{
+	struct slot *slot;
+
+	for (; it->pos < hash->size; it->pos++) {
+		slot = &hash->slots[it->pos];
+		if (slot->state != SLOT_USED)
+			continue;
+		if (hash->type == UTIL_HASH_KEY_STR) {
+			it->key_str = slot->key.str;
+			it->key_int = 0;
+		} else {
+			it->key_str = NULL;
+			it->key_int = slot->key.num;
+		}
+		it->value = slot->value;
+		it->pos++;
+		return true;
+	}
+	return false;
+}
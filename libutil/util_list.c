@@ -76,6 +76,7 @@ void util_list_add_tail(struct util_list *list, void *entry)
 		node->prev = list->end;
 	}
 	list->end = node;
+	list->len++;
 }
 
 /*
@@ -94,6 +95,7 @@ void util_list_add_head(struct util_list *list, void *entry)
 		node->next = list->start;
 	}
 	list->start = node;
+	list->len++;
 }
 
 /*
@@ -111,6 +113,7 @@ void util_list_add_next(struct util_list *list, void *entry, void *list_entry)
 	else
 		list->end = node;
 	list_node->next = node;
+	list->len++;
 }
 
 /*
@@ -128,6 +131,7 @@ void util_list_add_prev(struct util_list *list, void *entry, void *list_entry)
 	else
 		list->start = node;
 	list_node->prev = node;
+	list->len++;
 }
 
 /*
@@ -145,6 +149,7 @@ void util_list_remove(struct util_list *list, void *entry)
 		node->prev->next = node->next;
 	if (node->next)
 		node->next->prev = node->prev;
+	list->len--;
 }
 
 /*
@@ -204,50 +209,68 @@ void *util_list_prev(struct util_list *list, void *entry)
  */
 unsigned long util_list_len(struct util_list *list)
 {
-	unsigned long cnt = 0;
-	void *entry;
-
-	util_list_iterate(list, entry)
-		cnt++;
-	return cnt;
+	return list->len;
 }
 
 /*
- * Sort table (bubble sort)
+ * Sort list (stable bottom-up merge sort)
+ *
+ * Runs of "size" nodes are merged pairwise along the "next" pointers,
+ * doubling "size" on each pass. The "prev" pointers are fixed up while
+ * merging.
  */
 void util_list_sort(struct util_list *list, util_list_cmp_fn cmp_fn,
 		    void *data)
 {
-	struct util_list_node *node1, *node2;
-	unsigned long list_cnt, i, j;
-	void *entry1, *entry2;
+	struct util_list_node *start, *tail, *a, *b, *node;
+	unsigned long size, merges, a_len, b_len;
 
-	list_cnt = util_list_len(list);
-
-	for (i = 1; i < list_cnt; i++) {
-		node1 = list->start;
-		for (j = 0; j < list_cnt - i; j++) {
-			node2 = node1->next;
-			entry1 = n2e(list, node1);
-			entry2 = n2e(list, node2);
-			if (cmp_fn(entry1, entry2, data) > 0) {
-				node1->next = node2->next;
-				if (node1->next)
-					node1->next->prev = node1;
-				else
-					list->end = node1;
-				node2->next = node1;
-				node2->prev = node1->prev;
-				if (node2->prev)
-					node2->prev->next = node2;
+	start = list->start;
+	if (!start)
+		return;
+	for (size = 1; ; size *= 2) {
+		a = start;
+		start = tail = NULL;
+		merges = 0;
+		while (a) {
+			merges++;
+			/* Find start of second run */
+			b = a;
+			for (a_len = 0; a_len < size && b; a_len++)
+				b = b->next;
+			b_len = size;
+			/* Merge both runs, prefer first run on equal entries */
+			while (a_len > 0 || (b_len > 0 && b)) {
+				if (a_len == 0) {
+					node = b;
+					b = b->next;
+					b_len--;
+				} else if (b_len == 0 || !b ||
+					   cmp_fn(n2e(list, a), n2e(list, b),
+						  data) <= 0) {
+					node = a;
+					a = a->next;
+					a_len--;
+				} else {
+					node = b;
+					b = b->next;
+					b_len--;
+				}
+				if (tail)
+					tail->next = node;
 				else
-					list->start = node2;
-				node1->prev = node2;
-			} else {
-				node1 = node2;
+					start = node;
+				node->prev = tail;
+				tail = node;
 			}
+			a = b;
 		}
+		tail->next = NULL;
+		if (merges <= 1)
+			break;
 	}
+	list->start = start;
+	list->end = tail;
 }
 
 /*
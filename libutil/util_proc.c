@@ -471,3 +471,108 @@ out_free:
 	free_file_buffer(&file);
 	return rc;
 }
+
+/*
+ * Return true if character C separates fields of a /proc file line
+ */
+static inline int is_blank(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+/*
+ * Split a buffer with "key value" or "key: value" lines in one pass
+ *
+ * Lines are split in place: The key and the value of each line are
+ * terminated with a null byte and stored as pointers into BUF, so no memory
+ * is allocated. This format is used by /proc/meminfo, /proc/vmstat,
+ * /proc/stat, and /proc/<pid>/status, for example.
+ *
+ * At most MAX entries are stored in KV. Empty lines are skipped. Return the
+ * number of stored entries.
+ */
+int util_proc_kv_parse(char *buf, size_t len, struct util_proc_kv *kv, int max)
+{
+	char *line, *end, *eol, *p;
+	int num = 0;
+
+	end = buf + len;
+	for (line = buf; line < end && num < max; line = eol + 1) {
+		eol = memchr(line, '\n', end - line);
+		if (!eol)
+			eol = end;
+		if (eol == line)
+			continue;
+		*eol = 0;
+		/* Key ends at the first blank or colon */
+		for (p = line; p < eol && !is_blank(*p) && *p != ':'; p++)
+			;
+		kv[num].key = line;
+		if (p < eol)
+			*p++ = 0;
+		while (p < eol && is_blank(*p))
+			p++;
+		kv[num].value = p;
+		num++;
+	}
+	return num;
+}
+
+/*
+ * Return the value of KEY in the NUM entries of KV or NULL if not found
+ *
+ * If POS is not NULL, the search starts at entry *POS and *POS is set to
+ * the entry after the match. Looking up keys in the order in which they are
+ * listed in the file then takes constant time per key.
+ */
+const char *util_proc_kv_get(const struct util_proc_kv *kv, int num,
+			     const char *key, int *pos)
+{
+	int start = (pos && *pos < num) ? *pos : 0;
+	int i, j;
+
+	for (i = 0; i < num; i++) {
+		j = start + i;
+		if (j >= num)
+			j -= num;
+		if (strcmp(kv[j].key, key) == 0) {
+			if (pos)
+				*pos = j + 1;
+			return kv[j].value;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Split LINE into blank separated fields in place
+ *
+ * A field that starts with '(' extends to the last ')' of the line, so
+ * that the command name in /proc/<pid>/stat is returned as one field even
+ * if it contains blanks. At most MAX pointers are stored in FIELD. Return the
+ * number of stored fields.
+ */
+int util_proc_fields(char *line, char **field, int max)
+{
+	char *p = line, *close;
+	int num = 0;
+
+	while (num < max) {
+		while (is_blank(*p) || *p == '\n')
+			p++;
+		if (*p == 0)
+			break;
+		field[num++] = p;
+		if (*p == '(') {
+			close = strrchr(p, ')');
+			if (close)
+				p = close;
+		}
+		while (*p && !is_blank(*p) && *p != '\n')
+			p++;
+		if (*p == 0)
+			break;
+		*p++ = 0;
+	}
+	return num;
+}
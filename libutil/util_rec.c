@@ -17,6 +17,7 @@
 #include <string.h>
 
 #include "lib/util_base.h"
+#include "lib/util_hash.h"
 #include "lib/util_libc.h"
 #include "lib/util_list.h"
 #include "lib/util_panic.h"
@@ -73,7 +74,11 @@ struct rec_fmt {
 /// @cond
 struct util_rec {
 	struct util_list *list; /* List of the fields */
+	struct util_hash *index;/* Fields by key */
 	struct rec_fmt fmt;     /* Output format */
+	char *out;              /* Output buffer for one record */
+	size_t out_len;         /* Used bytes in output buffer */
+	size_t out_size;        /* Size of output buffer */
 };
 /// @endcond
 
@@ -87,13 +92,72 @@ struct util_list *__util_rec_get_list(struct util_rec *rec)
  */
 static struct util_rec_fld *rec_get_fld(struct util_rec *rec, const char *key)
 {
-	struct util_rec_fld *fld;
+	return util_hash_get_str(rec->index, key);
+}
 
-	util_list_iterate(rec->list, fld) {
-		if (!strcmp(fld->key, key))
-			return fld;
+/*
+ * Allocate a new record without output format
+ */
+static struct util_rec *rec_new(void)
+{
+	struct util_rec *rec = util_zalloc(sizeof(struct util_rec));
+
+	rec->list = util_list_new(struct util_rec_fld, node);
+	rec->index = util_hash_new(UTIL_HASH_KEY_STR, 0);
+	return rec;
+}
+
+/*
+ * Make room for "len" more bytes in the output buffer
+ */
+static char *out_reserve(struct util_rec *rec, size_t len)
+{
+	if (rec->out_len + len > rec->out_size) {
+		rec->out_size = MAX(rec->out_size * 2, rec->out_len + len);
+		rec->out = util_realloc(rec->out, rec->out_size);
 	}
-	return NULL;
+	return rec->out + rec->out_len;
+}
+
+/*
+ * Append "len" bytes of "str" to the output buffer
+ */
+static void out_add(struct util_rec *rec, const char *str, size_t len)
+{
+	memcpy(out_reserve(rec, len), str, len);
+	rec->out_len += len;
+}
+
+/*
+ * Append "count" copies of character "c" to the output buffer
+ */
+static void out_fill(struct util_rec *rec, char c, int count)
+{
+	if (count <= 0)
+		return;
+	memset(out_reserve(rec, count), c, count);
+	rec->out_len += count;
+}
+
+/*
+ * Append string to the output buffer, a NULL string is written as printf()
+ * would do it
+ */
+static void out_str(struct util_rec *rec, const char *str)
+{
+	if (!str)
+		str = "(null)";
+	out_add(rec, str, strlen(str));
+}
+
+/*
+ * Write output buffer to stdout with a single call
+ */
+static void out_flush(struct util_rec *rec)
+{
+	if (rec->out_len)
+		fwrite(rec->out, 1, rec->out_len, stdout);
+	rec->out_len = 0;
 }
 
 /**
@@ -117,9 +181,8 @@ const char *util_rec_fld_get_key(struct util_rec_fld *fld)
  */
 struct util_rec *util_rec_new_wide(const char *hdr_sep)
 {
-	struct util_rec *rec = util_malloc(sizeof(struct util_rec));
+	struct util_rec *rec = rec_new();
 
-	rec->list = util_list_new(struct util_rec_fld, node);
 	rec->fmt.type = REC_FMT_WIDE;
 	rec->fmt.d.wide_p.hdr_sep = util_strdup(hdr_sep);
 	rec->fmt.d.wide_p.argz_sep = ',';
@@ -138,6 +201,29 @@ static inline void rec_print_indention(int indent)
 	printf("%*s", indent, "");
 }
 
+/*
+ * Add the indentation characters to the output buffer
+ */
+static inline void rec_out_indention(struct util_rec *rec)
+{
+	out_fill(rec, ' ', rec->fmt.indent);
+}
+
+/*
+ * Add field value aligned to the field width to the output buffer
+ */
+static void rec_out_aligned(struct util_rec *rec, struct util_rec_fld *fld,
+			    const char *str, size_t len)
+{
+	int pad = fld->width - (int) len;
+
+	if (fld->align == UTIL_REC_ALIGN_RIGHT)
+		out_fill(rec, ' ', pad);
+	out_add(rec, str, len);
+	if (fld->align == UTIL_REC_ALIGN_LEFT)
+		out_fill(rec, ' ', pad);
+}
+
 /*
  * Print record separator in "wide" output format
  */
@@ -175,67 +261,75 @@ static void rec_print_wide_hdr(struct util_rec *rec)
 	const char *hdr_sep = rec->fmt.d.wide_p.hdr_sep;
 	int col_nr = 0, size = 0, field_count = 0;
 	struct util_rec_fld *fld;
-	char *buf;
 
-	rec_print_indention(rec->fmt.indent);
+	rec_out_indention(rec);
 	util_list_iterate(rec->list, fld) {
 		if (col_nr)
-			printf(" ");
+			out_add(rec, " ", 1);
 		if (fld->hdr) {
-			if (fld->align == UTIL_REC_ALIGN_LEFT)
-				printf("%-*s", fld->width, fld->hdr);
-			else
-				printf("%*s", fld->width, fld->hdr);
+			rec_out_aligned(rec, fld, fld->hdr, strlen(fld->hdr));
 			size += fld->width;
 			field_count++;
 		}
 		col_nr++;
 	}
-	printf("\n");
-	if (!hdr_sep)
-		return;
-	size += field_count - 1;
+	out_add(rec, "\n", 1);
 	if (hdr_sep) {
-		buf = util_malloc(size + 1);
-		memset(buf, (int)hdr_sep[0], size);
-		buf[size] = 0;
-		rec_print_indention(rec->fmt.indent);
-		printf("%s\n", buf);
-		free(buf);
+		size += field_count - 1;
+		rec_out_indention(rec);
+		out_fill(rec, hdr_sep[0], size);
+		out_add(rec, "\n", 1);
 	}
+	out_flush(rec);
 }
 
 /*
  * Print record field values in "wide" output format
+ *
+ * The complete line is assembled in the output buffer and written at once.
+ * Multiple argz entries are joined by the argz separator.
  */
 void rec_print_wide(struct util_rec *rec)
 {
 	const char argz_sep = rec->fmt.d.wide_p.argz_sep;
 	struct util_rec_fld *fld;
-	char argz_str[PAGE_SIZE];
+	size_t start, len;
 	int fld_count = 0;
 	char *entry;
 
-	rec_print_indention(rec->fmt.indent);
+	rec_out_indention(rec);
 	util_list_iterate(rec->list, fld) {
 		if (!fld->hdr)
 			continue;
 		if (fld_count)
-			printf(" ");
-		entry = fld->val;
+			out_add(rec, " ", 1);
 		if (argz_count(fld->val, fld->len) > 1) {
-			strcpy(argz_str, entry);
-			while ((entry = argz_next(fld->val, fld->len, entry)))
-				strcat(strncat(argz_str, &argz_sep, 1), entry);
-			entry = argz_str;
+			start = rec->out_len;
+			entry = fld->val;
+			out_str(rec, entry);
+			while ((entry = argz_next(fld->val, fld->len, entry))) {
+				out_add(rec, &argz_sep, 1);
+				out_str(rec, entry);
+			}
+			len = rec->out_len - start;
+			if (fld->align == UTIL_REC_ALIGN_RIGHT &&
+			    fld->width > (int) len) {
+				/* Move joined value behind the padding */
+				out_fill(rec, ' ', fld->width - len);
+				memmove(rec->out + rec->out_len - len,
+					rec->out + start, len);
+				memset(rec->out + start, ' ', fld->width - len);
+			} else if (fld->align == UTIL_REC_ALIGN_LEFT) {
+				out_fill(rec, ' ', fld->width - (int) len);
+			}
+		} else {
+			entry = fld->val ? fld->val : "(null)";
+			rec_out_aligned(rec, fld, entry, strlen(entry));
 		}
-		if (fld->align == UTIL_REC_ALIGN_LEFT)
-			printf("%-*s", fld->width, entry);
-		else
-			printf("%*s", fld->width, entry);
 		fld_count++;
 	}
-	printf("\n");
+	out_add(rec, "\n", 1);
+	out_flush(rec);
 }
 
 /*
@@ -260,9 +354,8 @@ static void rec_free_wide(struct util_rec *rec)
 struct util_rec *util_rec_new_long(const char *hdr_sep, const char *col_sep,
 				   const char *key, int key_size, int val_size)
 {
-	struct util_rec *rec = util_malloc(sizeof(struct util_rec));
+	struct util_rec *rec = rec_new();
 
-	rec->list = util_list_new(struct util_rec_fld, node);
 	rec->fmt.type = REC_FMT_LONG;
 	rec->fmt.d.long_p.hdr_sep = util_strdup(hdr_sep);
 	rec->fmt.d.long_p.col_sep = util_strdup(col_sep);
@@ -367,9 +460,8 @@ static void rec_free_long(struct util_rec *rec)
  */
 struct util_rec *util_rec_new_csv(const char *col_sep)
 {
-	struct util_rec *rec = util_malloc(sizeof(struct util_rec));
+	struct util_rec *rec = rec_new();
 
-	rec->list = util_list_new(struct util_rec_fld, node);
 	rec->fmt.type = REC_FMT_CSV;
 	rec->fmt.d.csv_p.col_sep = util_strdup(col_sep);
 	rec->fmt.d.csv_p.argz_sep = ' ';
@@ -386,16 +478,17 @@ void rec_print_csv_hdr(struct util_rec *rec)
 	struct util_rec_fld *fld;
 	int fld_count = 0;
 
-	rec_print_indention(rec->fmt.indent);
+	rec_out_indention(rec);
 	util_list_iterate(rec->list, fld) {
 		if (fld_count)
-			printf("%c", *col_sep);
+			out_add(rec, col_sep, 1);
 		if (fld->hdr) {
-			printf("%s", fld->hdr);
+			out_str(rec, fld->hdr);
 			fld_count++;
 		}
 	}
-	printf("\n");
+	out_add(rec, "\n", 1);
+	out_flush(rec);
 }
 
 /*
@@ -409,19 +502,22 @@ void rec_print_csv(struct util_rec *rec)
 	int fld_count = 0;
 	char *item = NULL;
 
-	rec_print_indention(rec->fmt.indent);
+	rec_out_indention(rec);
 	util_list_iterate(rec->list, fld) {
 		item = argz_next(fld->val, fld->len, item);
 		if (fld_count)
-			printf("%c", *col_sep);
+			out_add(rec, col_sep, 1);
 		if (fld->hdr) {
-			printf("%s", item);
-			while ((item = argz_next(fld->val, fld->len, item)))
-				printf("%c%s", argz_sep, item);
+			out_str(rec, item);
+			while ((item = argz_next(fld->val, fld->len, item))) {
+				out_add(rec, &argz_sep, 1);
+				out_str(rec, item);
+			}
 			fld_count++;
 		}
 	}
-	printf("\n");
+	out_add(rec, "\n", 1);
+	out_flush(rec);
 }
 
 /*
@@ -442,18 +538,26 @@ static void rec_free_csv(struct util_rec *rec)
  * @param[in] width  Width of field
  * @param[in] hdr    This information is printed in record headers. If it is
  *                   NULL, the field is prohibited form printing completely.
+ *
+ * @returns   Handle of the field for util_rec_fld_set() and util_rec_fld_get()
  */
-void util_rec_def(struct util_rec *rec, const char *key,
-		  enum util_rec_align align, int width, const char *hdr)
+struct util_rec_fld *util_rec_def(struct util_rec *rec, const char *key,
+				  enum util_rec_align align, int width,
+				  const char *hdr)
 {
 	struct util_rec_fld *fld = util_malloc(sizeof(struct util_rec_fld));
 
 	fld->key = util_strdup(key);
 	fld->hdr = util_strdup(hdr);
 	fld->val = NULL;
+	fld->len = 0;
 	fld->align = align;
 	fld->width = width;
 	util_list_add_tail(rec->list, fld);
+	/* For duplicate keys the first field is found by key */
+	if (!util_hash_contains_str(rec->index, key))
+		util_hash_set_str(rec->index, key, fld);
+	return fld;
 }
 
 /**
@@ -473,6 +577,8 @@ void util_rec_free(struct util_rec *rec)
 		free(fld);
 	}
 	util_list_free(rec->list);
+	util_hash_free(rec->index, NULL);
+	free(rec->out);
 	switch (rec->fmt.type) {
 	case REC_FMT_WIDE:
 		rec_free_wide(rec);
@@ -595,6 +701,39 @@ void util_rec_set(struct util_rec *rec, const char *key, const char *fmt, ...)
 	fld->len = strlen(str) + 1;
 }
 
+/**
+ * Set the value of a field returned by util_rec_def() to a formatted string
+ *
+ * This avoids the lookup of the field by its key.
+ *
+ * @param[in] fld  Field handle
+ * @param[in] fmt  Format string for generation of value string
+ * @param[in] ...  Parameters for format string
+ */
+void util_rec_fld_set(struct util_rec_fld *fld, const char *fmt, ...)
+{
+	va_list ap;
+	char *str;
+
+	util_assert(fmt != NULL, "Parameter 'fmt' pointer must not be NULL\n");
+	UTIL_VASPRINTF(&str, fmt, ap);
+	free(fld->val);
+	fld->val = str;
+	fld->len = strlen(str) + 1;
+}
+
+/**
+ * Return the string value of a field returned by util_rec_def()
+ *
+ * @param[in] fld  Field handle
+ *
+ * @returns   Pointer to the field value or NULL if the field is empty
+ */
+const char *util_rec_fld_get(struct util_rec_fld *fld)
+{
+	return fld->val;
+}
+
 /**
  * Return the string value of a desired field. If the field value stored in argz
  * format, pointer to the first argz element is returned.
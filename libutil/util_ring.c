@@ -0,0 +1,254 @@
+/*
+ * util - Utility function library
+ *
+ * Bounded lock-free ring buffer
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "lib/util_panic.h"
+#include "lib/util_ring.h"
+
+/* Cache line size of IBM Z, also large enough for other architectures */
+#define RING_CACHE_LINE	256
+
+/*
+ * Slot of the ring buffer
+ *
+ * The sequence number tells producers and consumers whether the slot is
+ * free for the current lap ("seq == pos") or holds an item for the current
+ * lap ("seq == pos + 1").
+ */
+struct slot {
+	unsigned long seq;
+	void *item;
+};
+
+/*
+ * Wait queue based on a futex word that is incremented on every change
+ */
+struct wait_queue {
+	unsigned int seq;
+	unsigned int waiters;
+} __attribute__((aligned(RING_CACHE_LINE)));
+
+/*
+ * Ring buffer structure (internal representation)
+ *
+ * Producer and consumer positions are in separate cache lines to avoid
+ * false sharing.
+ */
+/// @cond
+struct util_ring {
+	unsigned long tail __attribute__((aligned(RING_CACHE_LINE)));
+	unsigned long head __attribute__((aligned(RING_CACHE_LINE)));
+	struct wait_queue not_empty;
+	struct wait_queue not_full;
+	unsigned long mask __attribute__((aligned(RING_CACHE_LINE)));
+	struct slot *slots;
+};
+/// @endcond
+
+static void futex_wait(unsigned int *addr, unsigned int val)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(unsigned int *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+ * Wake up waiters after the state of the ring buffer has changed
+ *
+ * The fence pairs with the waiter count increment in the blocking
+ * functions: either the waiter sees the new state when checking again,
+ * or we see the waiter. Without waiters no shared cache line is written.
+ */
+static void wait_queue_signal(struct wait_queue *wq)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&wq->waiters, __ATOMIC_RELAXED))
+		return;
+	__atomic_add_fetch(&wq->seq, 1, __ATOMIC_SEQ_CST);
+	futex_wake(&wq->seq);
+}
+
+/**
+ * Create a new ring buffer
+ *
+ * @param[in] size  Minimum number of entries, rounded up to a power of two
+ *
+ * @returns   Pointer to the created ring buffer
+ */
+struct util_ring *util_ring_new(unsigned long size)
+{
+	struct util_ring *ring;
+	unsigned long i, cnt = 2;
+
+	while (cnt < size)
+		cnt *= 2;
+	if (posix_memalign((void **) &ring, RING_CACHE_LINE, sizeof(*ring)) ||
+	    posix_memalign((void **) &ring->slots, RING_CACHE_LINE,
+			   cnt * sizeof(struct slot)))
+		util_panic("Out of memory\n");
+	memset(ring, 0, offsetof(struct util_ring, slots));
+	ring->mask = cnt - 1;
+	for (i = 0; i < cnt; i++) {
+		ring->slots[i].seq = i;
+		ring->slots[i].item = NULL;
+	}
+	return ring;
+}
+
+/**
+ * Free a ring buffer
+ *
+ * Remaining entries are not freed.
+ *
+ * @param[in] ring  Ring buffer to free
+ */
+void util_ring_free(struct util_ring *ring)
+{
+	if (!ring)
+		return;
+	free(ring->slots);
+	free(ring);
+}
+
+/**
+ * Add an entry to a ring buffer if there is room
+ *
+ * @param[in] ring  Ring buffer
+ * @param[in] item  Entry to add
+ *
+ * @returns   true if the entry was added, false if the ring buffer is full
+ */
+bool util_ring_try_push(struct util_ring *ring, void *item)
+{
+	unsigned long pos, seq;
+	struct slot *slot;
+	long diff;
+
+	pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	while (1) {
+		slot = &ring->slots[pos & ring->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (long) (seq - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->tail, &pos,
+							pos + 1, true,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+		}
+	}
+	slot->item = item;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	wait_queue_signal(&ring->not_empty);
+	return true;
+}
+
+/**
+ * Remove the oldest entry from a ring buffer if there is one
+ *
+ * @param[in]  ring  Ring buffer
+ * @param[out] item  Removed entry
+ *
+ * @returns    true if an entry was removed, false if the ring buffer is empty
+ */
+bool util_ring_try_pop(struct util_ring *ring, void **item)
+{
+	unsigned long pos, seq;
+	struct slot *slot;
+	long diff;
+
+	pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	while (1) {
+		slot = &ring->slots[pos & ring->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (long) (seq - (pos + 1));
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&ring->head, &pos,
+							pos + 1, true,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return false;
+		} else {
+			pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		}
+	}
+	*item = slot->item;
+	__atomic_store_n(&slot->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+	wait_queue_signal(&ring->not_full);
+	return true;
+}
+
+/**
+ * Add an entry to a ring buffer, wait while the ring buffer is full
+ *
+ * @param[in] ring  Ring buffer
+ * @param[in] item  Entry to add
+ */
+void util_ring_push(struct util_ring *ring, void *item)
+{
+	struct wait_queue *wq = &ring->not_full;
+	unsigned int seq;
+
+	while (!util_ring_try_push(ring, item)) {
+		__atomic_add_fetch(&wq->waiters, 1, __ATOMIC_SEQ_CST);
+		seq = __atomic_load_n(&wq->seq, __ATOMIC_SEQ_CST);
+		/* Check again to not miss a wake-up before the seq load */
+		if (util_ring_try_push(ring, item)) {
+			__atomic_sub_fetch(&wq->waiters, 1, __ATOMIC_SEQ_CST);
+			return;
+		}
+		futex_wait(&wq->seq, seq);
+		__atomic_sub_fetch(&wq->waiters, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+/**
+ * Remove the oldest entry from a ring buffer, wait while it is empty
+ *
+ * @param[in] ring  Ring buffer
+ *
+ * @returns   Removed entry
+ */
+void *util_ring_pop(struct util_ring *ring)
+{
+	struct wait_queue *wq = &ring->not_empty;
+	unsigned int seq;
+	void *item;
+
+	while (!util_ring_try_pop(ring, &item)) {
+		__atomic_add_fetch(&wq->waiters, 1, __ATOMIC_SEQ_CST);
+		seq = __atomic_load_n(&wq->seq, __ATOMIC_SEQ_CST);
+		/* Check again to not miss a wake-up before the seq load */
+		if (util_ring_try_pop(ring, &item)) {
+			__atomic_sub_fetch(&wq->waiters, 1, __ATOMIC_SEQ_CST);
+			return item;
+		}
+		futex_wait(&wq->seq, seq);
+		__atomic_sub_fetch(&wq->waiters, 1, __ATOMIC_SEQ_CST);
+	}
+	return item;
+}
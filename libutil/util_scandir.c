@@ -11,9 +11,11 @@
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <regex.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -29,8 +31,32 @@
 struct util_scandir_filter {
 	regex_t reg_buf;
 };
+
+struct util_scandir_iter {
+	DIR *dirp;
+	unsigned int types;
+	bool use_regexp;
+	struct util_scandir_filter filter;
+};
 /// @endcond
 
+/*
+ * Compile POSIX extended regular expression "pattern"
+ */
+static void filter_init(struct util_scandir_filter *filter,
+			const char *pattern)
+{
+	char err_buf[256];
+	int rc;
+
+	rc = regcomp(&filter->reg_buf, pattern, REG_EXTENDED);
+	if (rc) {
+		regerror(rc, &filter->reg_buf, err_buf, sizeof(err_buf));
+		util_panic("Function regcomp(%s) failed: %s\n", pattern,
+			   err_buf);
+	}
+}
+
 /*
  * Check directory entry
  */
@@ -56,7 +82,7 @@ static int __scandir(struct dirent ***de_vec, const char *path,
 				      const struct dirent **))
 {
 	struct dirent *de, *de_new, **de_vec_new = NULL;
-	int count = 0;
+	int count = 0, size = 0;
 	DIR *dirp;
 
 	*de_vec = NULL;
@@ -68,7 +94,11 @@ static int __scandir(struct dirent ***de_vec, const char *path,
 			continue;
 		de_new = util_malloc(sizeof(*de_new));
 		*de_new = *de;
-		de_vec_new = realloc(de_vec_new, sizeof(void *) * (count + 1));
+		if (count == size) {
+			size = size ? size * 2 : 16;
+			de_vec_new = util_realloc(de_vec_new,
+						  sizeof(void *) * size);
+		}
 		de_vec_new[count++] = de_new;
 	}
 	closedir(dirp);
@@ -88,15 +118,9 @@ static int scandir_regexp(struct dirent ***de_vec, const char *path,
 					const struct dirent **))
 {
 	struct util_scandir_filter filter;
-	char err_buf[256];
-	int count, rc;
+	int count;
 
-	rc = regcomp(&filter.reg_buf, pattern, REG_EXTENDED);
-	if (rc) {
-		regerror(rc, &filter.reg_buf, err_buf, sizeof(err_buf));
-		util_panic("Function regcomp(%s) failed: %s\n", pattern,
-			   err_buf);
-	}
+	filter_init(&filter, pattern);
 	count = __scandir(de_vec, path, filter_regexp, &filter, compar_fn);
 	regfree(&filter.reg_buf);
 	return count;
@@ -174,3 +198,172 @@ void util_scandir_free(struct dirent **de_vec, int count)
 {
 	util_ptr_vec_free((void **) de_vec, count);
 }
+
+/*
+ * Return UTIL_SCANDIR_TYPE_* flag for directory entry
+ *
+ * File systems that do not provide d_type require a stat call.
+ */
+static unsigned int de_type(DIR *dirp, const struct dirent *de)
+{
+	unsigned char type = de->d_type;
+	struct stat sb;
+
+	if (type == DT_UNKNOWN) {
+		if (fstatat(dirfd(dirp), de->d_name, &sb, AT_SYMLINK_NOFOLLOW))
+			return UTIL_SCANDIR_TYPE_OTHER;
+		if (S_ISDIR(sb.st_mode))
+			type = DT_DIR;
+		else if (S_ISREG(sb.st_mode))
+			type = DT_REG;
+		else if (S_ISLNK(sb.st_mode))
+			type = DT_LNK;
+	}
+	switch (type) {
+	case DT_DIR:
+		return UTIL_SCANDIR_TYPE_DIR;
+	case DT_REG:
+		return UTIL_SCANDIR_TYPE_REG;
+	case DT_LNK:
+		return UTIL_SCANDIR_TYPE_LNK;
+	default:
+		return UTIL_SCANDIR_TYPE_OTHER;
+	}
+}
+
+/*
+ * Open directory for iteration with optional regular expression
+ */
+static struct util_scandir_iter *scandir_open(const char *path,
+					      unsigned int types,
+					      const char *pattern)
+{
+	struct util_scandir_iter *iter;
+	DIR *dirp;
+
+	dirp = opendir(path);
+	if (!dirp)
+		return NULL;
+	iter = util_zalloc(sizeof(*iter));
+	iter->dirp = dirp;
+	iter->types = types;
+	if (pattern) {
+		filter_init(&iter->filter, pattern);
+		iter->use_regexp = true;
+	}
+	return iter;
+}
+
+/**
+ * Open a directory for iterating over matching entries
+ *
+ * In contrast to util_scandir() entries are returned in directory order
+ * one at a time without being copied. The entries "." and ".." are always
+ * skipped. The entry type is checked before the name pattern so that
+ * entries of other types are skipped cheaply.
+ *
+ * @param[in] path   Path to the directory to scan
+ * @param[in] types  Mask of UTIL_SCANDIR_TYPE_* flags or 0 for all types
+ * @param[in] fmt    Format string, describes the search pattern as POSIX
+ *                   regex, or NULL to return all entries
+ * @param[in] ...    Values for format string
+ *
+ * @returns   Iterator handle or NULL if the directory cannot be opened
+ *            (errno is set)
+ */
+struct util_scandir_iter *util_scandir_open(const char *path,
+					    unsigned int types,
+					    const char *fmt, ...)
+{
+	struct util_scandir_iter *iter;
+	char *pattern = NULL;
+	va_list ap;
+
+	if (fmt)
+		UTIL_VASPRINTF(&pattern, fmt, ap);
+	iter = scandir_open(path, types, pattern);
+	free(pattern);
+	return iter;
+}
+
+/**
+ * Return next matching directory entry
+ *
+ * @param[in] iter  Iterator handle
+ *
+ * @returns   Directory entry that is valid until the next call or NULL if
+ *            there are no more entries
+ */
+const struct dirent *util_scandir_next(struct util_scandir_iter *iter)
+{
+	struct dirent *de;
+
+	while ((de = readdir(iter->dirp))) {
+		if (de->d_name[0] == '.' && (de->d_name[1] == 0 ||
+		    (de->d_name[1] == '.' && de->d_name[2] == 0)))
+			continue;
+		if (iter->types && !(de_type(iter->dirp, de) & iter->types))
+			continue;
+		if (iter->use_regexp && !filter_regexp(de, &iter->filter))
+			continue;
+		return de;
+	}
+	return NULL;
+}
+
+/**
+ * Close a directory iterator
+ *
+ * @param[in] iter  Iterator handle
+ */
+void util_scandir_close(struct util_scandir_iter *iter)
+{
+	if (!iter)
+		return;
+	closedir(iter->dirp);
+	if (iter->use_regexp)
+		regfree(&iter->filter.reg_buf);
+	free(iter);
+}
+
+/**
+ * Call a function for each matching directory entry
+ *
+ * See util_scandir_open() for how entries are selected.
+ *
+ * @param[in] path   Path to the directory to scan
+ * @param[in] types  Mask of UTIL_SCANDIR_TYPE_* flags or 0 for all types
+ * @param[in] cb     Callback function for each entry
+ * @param[in] data   Argument for callback function
+ * @param[in] fmt    Format string, describes the search pattern as POSIX
+ *                   regex, or NULL to select all entries
+ * @param[in] ...    Values for format string
+ *
+ * @returns   0 if all entries were processed, the non-zero return code of
+ *            the callback function that stopped the iteration, or -1 if the
+ *            directory cannot be opened
+ */
+int util_scandir_iterate(const char *path, unsigned int types,
+			 util_scandir_cb cb, void *data,
+			 const char *fmt, ...)
+{
+	struct util_scandir_iter *iter;
+	const struct dirent *de;
+	char *pattern = NULL;
+	va_list ap;
+	int rc = 0;
+
+	if (fmt)
+		UTIL_VASPRINTF(&pattern, fmt, ap);
+	iter = scandir_open(path, types, pattern);
+	free(pattern);
+	if (!iter)
+		return -1;
+	while ((de = util_scandir_next(iter))) {
+		rc = cb(de, data);
+		if (rc)
+			break;
+	}
+	util_scandir_close(iter);
+	return rc;
+}
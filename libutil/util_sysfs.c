@@ -0,0 +1,370 @@
+/*
+ * util - Utility function library
+ *
+ * Read sysfs attributes with caching and batching
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lib/util_base.h"
+#include "lib/util_hash.h"
+#include "lib/util_libc.h"
+#include "lib/util_path.h"
+#include "lib/util_sysfs.h"
+
+#define SYSFS_READ_SIZE	4096
+
+/*
+ * Sysfs attribute that is kept open for repeated reads
+ */
+/// @cond
+struct util_sysfs_attr {
+	int fd;		/* File descriptor of attribute */
+};
+/// @endcond
+
+/*
+ * Contents of attributes by path relative to the sysfs mount point
+ */
+static struct util_hash *sysfs_cache;
+
+/*
+ * Read complete contents of file descriptor starting at offset 0 and
+ * remove a trailing newline
+ */
+static char *fd_read(int fd)
+{
+	size_t size = SYSFS_READ_SIZE, len = 0;
+	char *buf = util_malloc(size);
+	ssize_t rc;
+
+	while (1) {
+		rc = pread(fd, buf + len, size - len - 1, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			free(buf);
+			return NULL;
+		}
+		if (rc == 0)
+			break;
+		len += rc;
+		if (len + 1 == size) {
+			size *= 2;
+			buf = util_realloc(buf, size);
+		}
+	}
+	if (len > 0 && buf[len - 1] == '\n')
+		len--;
+	buf[len] = 0;
+	return buf;
+}
+
+/*
+ * Return cached contents of attribute or NULL if it is not cached
+ */
+static const char *cache_get(const char *rel_path)
+{
+	if (!sysfs_cache)
+		return NULL;
+	return util_hash_get_str(sysfs_cache, rel_path);
+}
+
+/*
+ * Add contents of attribute to cache
+ */
+static void cache_add(const char *rel_path, const char *text)
+{
+	if (!sysfs_cache)
+		sysfs_cache = util_hash_new(UTIL_HASH_KEY_STR, 0);
+	free(util_hash_set_str(sysfs_cache, rel_path, util_strdup(text)));
+}
+
+/*
+ * Read attribute from cache or from sysfs
+ */
+static char *attr_read(const char *rel_path)
+{
+	const char *cached;
+	char *path, *text;
+	int fd;
+
+	cached = cache_get(rel_path);
+	if (cached)
+		return util_strdup(cached);
+	path = util_path_sysfs("%s", rel_path);
+	fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0)
+		return NULL;
+	text = fd_read(fd);
+	close(fd);
+	if (text)
+		cache_add(rel_path, text);
+	return text;
+}
+
+/**
+ * Read a sysfs attribute
+ *
+ * The attribute contents are cached until util_sysfs_invalidate() or
+ * util_sysfs_invalidate_all() is called or the attribute is written with
+ * util_sysfs_write_str().
+ *
+ * @param[in] fmt  Format string for path relative to the sysfs mount point
+ * @param[in] ...  Parameters for format string
+ *
+ * @returns   Attribute contents without trailing newline allocated with
+ *            malloc() or NULL in case of error (errno is set)
+ */
+char *util_sysfs_read_str(const char *fmt, ...)
+{
+	char *rel_path, *text;
+	va_list ap;
+
+	UTIL_VASPRINTF(&rel_path, fmt, ap);
+	text = attr_read(rel_path);
+	free(rel_path);
+	return text;
+}
+
+/**
+ * Read a sysfs attribute as unsigned long
+ *
+ * @param[out] val   Buffer for value
+ * @param[in]  base  Base for conversion, either 8, 10, or 16
+ * @param[in]  fmt   Format string for path relative to the sysfs mount point
+ * @param[in]  ...   Parameters for format string
+ *
+ * @retval     0     Integer has been read correctly
+ * @retval    -1     Error while reading attribute
+ */
+int util_sysfs_read_ul(unsigned long *val, int base, const char *fmt, ...)
+{
+	char *rel_path, *text, *end;
+	va_list ap;
+	int rc = -1;
+
+	UTIL_VASPRINTF(&rel_path, fmt, ap);
+	text = attr_read(rel_path);
+	free(rel_path);
+	if (!text)
+		return -1;
+	errno = 0;
+	*val = strtoul(text, &end, base);
+	if (errno == 0 && end != text)
+		rc = 0;
+	free(text);
+	return rc;
+}
+
+/**
+ * Read multiple attributes of one sysfs directory
+ *
+ * The directory is opened once and all attributes are opened relative to
+ * it. Cached attribute contents are used where available.
+ *
+ * @param[in]  dir     Directory path relative to the sysfs mount point
+ * @param[in]  names   Attribute names
+ * @param[out] values  Attribute contents allocated with malloc() or NULL
+ *                     for attributes that could not be read
+ * @param[in]  count   Number of attributes
+ *
+ * @returns    Number of attributes that have been read
+ */
+int util_sysfs_read_batch(const char *dir, const char * const names[],
+			  char *values[], int count)
+{
+	int i, fd, dir_fd = -1, read_cnt = 0;
+	char *path, *rel_path;
+	const char *cached;
+
+	for (i = 0; i < count; i++) {
+		values[i] = NULL;
+		util_asprintf(&rel_path, "%s/%s", dir, names[i]);
+		cached = cache_get(rel_path);
+		if (cached) {
+			values[i] = util_strdup(cached);
+			goto next;
+		}
+		if (dir_fd < 0) {
+			path = util_path_sysfs("%s", dir);
+			dir_fd = open(path, O_RDONLY | O_DIRECTORY);
+			free(path);
+			if (dir_fd < 0) {
+				free(rel_path);
+				break;
+			}
+		}
+		fd = openat(dir_fd, names[i], O_RDONLY);
+		if (fd < 0)
+			goto next;
+		values[i] = fd_read(fd);
+		close(fd);
+		if (values[i])
+			cache_add(rel_path, values[i]);
+next:
+		if (values[i])
+			read_cnt++;
+		free(rel_path);
+	}
+	for (; i < count; i++)
+		values[i] = NULL;
+	if (dir_fd >= 0)
+		close(dir_fd);
+	return read_cnt;
+}
+
+/**
+ * Write string to a sysfs attribute
+ *
+ * Writing to an attribute may change other attributes, therefore all
+ * cached attribute contents are invalidated.
+ *
+ * @param[in] str  String to write
+ * @param[in] fmt  Format string for path relative to the sysfs mount point
+ * @param[in] ...  Parameters for format string
+ *
+ * @retval    0    Write was successful
+ * @retval   -1    Error while writing attribute
+ */
+int util_sysfs_write_str(const char *str, const char *fmt, ...)
+{
+	char *rel_path, *path;
+	size_t len = strlen(str);
+	va_list ap;
+	ssize_t rc;
+	int fd;
+
+	util_sysfs_invalidate_all();
+	UTIL_VASPRINTF(&rel_path, fmt, ap);
+	path = util_path_sysfs("%s", rel_path);
+	free(rel_path);
+	fd = open(path, O_WRONLY | O_TRUNC);
+	free(path);
+	if (fd < 0)
+		return -1;
+	rc = write(fd, str, len);
+	if (close(fd) || rc < 0 || (size_t) rc != len)
+		return -1;
+	return 0;
+}
+
+/**
+ * Remove a sysfs attribute from the cache
+ *
+ * @param[in] fmt  Format string for path relative to the sysfs mount point
+ * @param[in] ...  Parameters for format string
+ */
+void util_sysfs_invalidate(const char *fmt, ...)
+{
+	char *rel_path;
+	va_list ap;
+
+	if (!sysfs_cache)
+		return;
+	UTIL_VASPRINTF(&rel_path, fmt, ap);
+	free(util_hash_remove_str(sysfs_cache, rel_path));
+	free(rel_path);
+}
+
+/**
+ * Remove all sysfs attributes from the cache
+ */
+void util_sysfs_invalidate_all(void)
+{
+	util_hash_free(sysfs_cache, free);
+	sysfs_cache = NULL;
+}
+
+/**
+ * Free all resources of the sysfs cache
+ */
+void util_sysfs_exit(void)
+{
+	util_sysfs_invalidate_all();
+}
+
+/**
+ * Open a sysfs attribute for repeated reads
+ *
+ * This is useful for attributes that are polled frequently. Reads of
+ * opened attributes are never cached.
+ *
+ * @param[in] fmt  Format string for path relative to the sysfs mount point
+ * @param[in] ...  Parameters for format string
+ *
+ * @returns   Attribute handle or NULL in case of error (errno is set)
+ */
+struct util_sysfs_attr *util_sysfs_attr_open(const char *fmt, ...)
+{
+	struct util_sysfs_attr *attr;
+	char *rel_path, *path;
+	va_list ap;
+	int fd;
+
+	UTIL_VASPRINTF(&rel_path, fmt, ap);
+	path = util_path_sysfs("%s", rel_path);
+	free(rel_path);
+	fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0)
+		return NULL;
+	attr = util_malloc(sizeof(*attr));
+	attr->fd = fd;
+	return attr;
+}
+
+/**
+ * Read current contents of an opened sysfs attribute
+ *
+ * The attribute is read from offset 0 with a single pread() and a trailing
+ * newline is removed. The result is always null-terminated.
+ *
+ * @param[in]  attr  Attribute handle
+ * @param[out] buf   Result buffer
+ * @param[in]  size  Size of the result buffer
+ *
+ * @returns    Length of string in buf or -1 in case of error
+ */
+ssize_t util_sysfs_attr_read(struct util_sysfs_attr *attr, char *buf,
+			     size_t size)
+{
+	ssize_t rc;
+
+	do {
+		rc = pread(attr->fd, buf, size - 1, 0);
+	} while (rc < 0 && errno == EINTR);
+	if (rc < 0) {
+		buf[0] = 0;
+		return -1;
+	}
+	if (rc > 0 && buf[rc - 1] == '\n')
+		rc--;
+	buf[rc] = 0;
+	return rc;
+}
+
+/**
+ * Close an opened sysfs attribute
+ *
+ * @param[in] attr  Attribute handle
+ */
+void util_sysfs_attr_close(struct util_sysfs_attr *attr)
+{
+	if (!attr)
+		return;
+	close(attr->fd);
+	free(attr);
+}
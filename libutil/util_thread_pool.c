@@ -0,0 +1,353 @@
+/*
+ * util - Utility function library
+ *
+ * Thread pool and parallel loop
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "lib/util_libc.h"
+#include "lib/util_list.h"
+#include "lib/util_thread_pool.h"
+
+/*
+ * Queued work item
+ */
+struct job {
+	struct util_list_node node;	/* Entry in job queue */
+	util_thread_pool_fn fn;		/* Function to run */
+	void *data;			/* Argument for function */
+};
+
+/*
+ * Thread pool structure (internal representation)
+ */
+/// @cond
+struct util_thread_pool {
+	pthread_mutex_t mutex;		/* Protects all following fields */
+	pthread_cond_t work_cond;	/* Signaled when work is queued */
+	pthread_cond_t done_cond;	/* Signaled when work is completed */
+	struct util_list queue;		/* Queued jobs */
+	unsigned long running;		/* Number of jobs being run */
+	int first_rc;			/* First error code since last wait */
+	unsigned long failed;		/* Number of failed jobs */
+	bool cancelled;			/* Queued jobs are discarded */
+	bool exit;			/* Workers should exit */
+	int num_threads;		/* Number of started worker threads */
+	pthread_t *threads;		/* Worker thread IDs */
+};
+/// @endcond
+
+/*
+ * Return the number of threads to use for "num_threads"
+ */
+static int get_num_threads(int num_threads)
+{
+	long cpus;
+
+	if (num_threads > 0)
+		return num_threads;
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? cpus : 1;
+}
+
+/*
+ * Run one job with the pool mutex held, the mutex is released while the
+ * job function runs
+ */
+static void run_job(struct util_thread_pool *pool, struct job *job)
+{
+	int rc;
+
+	util_list_remove(&pool->queue, job);
+	pool->running++;
+	pthread_mutex_unlock(&pool->mutex);
+	rc = job->fn(job->data);
+	free(job);
+	pthread_mutex_lock(&pool->mutex);
+	pool->running--;
+	if (rc) {
+		if (!pool->first_rc)
+			pool->first_rc = rc;
+		pool->failed++;
+	}
+	if (pool->running == 0 && util_list_is_empty(&pool->queue))
+		pthread_cond_broadcast(&pool->done_cond);
+}
+
+/*
+ * Worker thread: run queued jobs until the pool is freed
+ */
+static void *worker(void *arg)
+{
+	struct util_thread_pool *pool = arg;
+	struct job *job;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (1) {
+		job = util_list_start(&pool->queue);
+		if (job) {
+			run_job(pool, job);
+			continue;
+		}
+		if (pool->exit)
+			break;
+		pthread_cond_wait(&pool->work_cond, &pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+/**
+ * Create a new thread pool
+ *
+ * If worker threads cannot be started, queued jobs are run by the thread
+ * calling util_thread_pool_wait().
+ *
+ * @param[in] num_threads  Number of worker threads or 0 for one thread per
+ *                         online CPU
+ *
+ * @returns   Pointer to the created thread pool
+ */
+struct util_thread_pool *util_thread_pool_new(int num_threads)
+{
+	struct util_thread_pool *pool = util_zalloc(sizeof(*pool));
+	int i;
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	util_list_init(&pool->queue, struct job, node);
+	num_threads = get_num_threads(num_threads);
+	pool->threads = util_malloc(num_threads * sizeof(pthread_t));
+	for (i = 0; i < num_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, worker, pool))
+			break;
+	}
+	pool->num_threads = i;
+	return pool;
+}
+
+/**
+ * Queue a job for a thread pool
+ *
+ * Jobs that are queued after util_thread_pool_cancel() are discarded until
+ * the next call to util_thread_pool_wait().
+ *
+ * @param[in] pool  Thread pool
+ * @param[in] fn    Function to run
+ * @param[in] data  Argument for function
+ */
+void util_thread_pool_add(struct util_thread_pool *pool,
+			  util_thread_pool_fn fn, void *data)
+{
+	struct job *job;
+
+	pthread_mutex_lock(&pool->mutex);
+	if (!pool->cancelled) {
+		job = util_malloc(sizeof(*job));
+		job->fn = fn;
+		job->data = data;
+		util_list_add_tail(&pool->queue, job);
+		pthread_cond_signal(&pool->work_cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * Wait until all queued jobs of a thread pool have completed
+ *
+ * Afterwards the error state and the cancellation of the pool are reset.
+ *
+ * @param[in]  pool    Thread pool
+ * @param[out] failed  Number of jobs that returned an error, may be NULL
+ *
+ * @returns    Error code of the first failed job or 0 if all jobs succeeded
+ */
+int util_thread_pool_wait(struct util_thread_pool *pool,
+			  unsigned long *failed)
+{
+	struct job *job;
+	int rc;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->running || !util_list_is_empty(&pool->queue)) {
+		/* Without workers the jobs are run here */
+		job = util_list_start(&pool->queue);
+		if (job && pool->num_threads == 0)
+			run_job(pool, job);
+		else
+			pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	}
+	rc = pool->first_rc;
+	if (failed)
+		*failed = pool->failed;
+	pool->first_rc = 0;
+	pool->failed = 0;
+	pool->cancelled = false;
+	pthread_mutex_unlock(&pool->mutex);
+	return rc;
+}
+
+/**
+ * Cancel all jobs of a thread pool that have not yet been started
+ *
+ * Running jobs can check util_thread_pool_cancelled() to stop early.
+ *
+ * @param[in] pool  Thread pool
+ */
+void util_thread_pool_cancel(struct util_thread_pool *pool)
+{
+	struct job *job, *next;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->cancelled = true;
+	util_list_iterate_safe(&pool->queue, job, next) {
+		util_list_remove(&pool->queue, job);
+		free(job);
+	}
+	if (pool->running == 0)
+		pthread_cond_broadcast(&pool->done_cond);
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * Check if a thread pool has been cancelled
+ *
+ * @param[in] pool  Thread pool
+ *
+ * @returns   true if util_thread_pool_cancel() was called since the last
+ *            util_thread_pool_wait(), false otherwise
+ */
+bool util_thread_pool_cancelled(struct util_thread_pool *pool)
+{
+	bool cancelled;
+
+	pthread_mutex_lock(&pool->mutex);
+	cancelled = pool->cancelled;
+	pthread_mutex_unlock(&pool->mutex);
+	return cancelled;
+}
+
+/**
+ * Wait for all queued jobs, stop the worker threads and free a thread pool
+ *
+ * @param[in] pool  Thread pool
+ */
+void util_thread_pool_free(struct util_thread_pool *pool)
+{
+	int i;
+
+	if (!pool)
+		return;
+	util_thread_pool_wait(pool, NULL);
+	pthread_mutex_lock(&pool->mutex);
+	pool->exit = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+	for (i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool);
+}
+
+/*
+ * State shared by the threads of util_parallel_for()
+ */
+struct parallel_for {
+	util_parallel_for_fn fn;	/* Loop body */
+	void *data;			/* Argument for loop body */
+	unsigned long next;		/* Next index to process */
+	unsigned long end;		/* End of index range */
+	unsigned long err_index;	/* Lowest index with error */
+	int err_rc;			/* Error code for err_index */
+	pthread_mutex_t mutex;		/* Protects err_index and err_rc */
+};
+
+/*
+ * Process indices until the range is exhausted or an error occurred
+ */
+static void *parallel_for_thread(void *arg)
+{
+	struct parallel_for *pf = arg;
+	unsigned long i;
+	int rc;
+
+	while (1) {
+		i = __atomic_fetch_add(&pf->next, 1, __ATOMIC_RELAXED);
+		if (i >= pf->end)
+			break;
+		rc = pf->fn(i, pf->data);
+		if (!rc)
+			continue;
+		pthread_mutex_lock(&pf->mutex);
+		if (i < pf->err_index) {
+			pf->err_index = i;
+			pf->err_rc = rc;
+		}
+		pthread_mutex_unlock(&pf->mutex);
+		/* Stop handing out further indices */
+		__atomic_store_n(&pf->next, pf->end, __ATOMIC_RELAXED);
+		break;
+	}
+	return NULL;
+}
+
+/**
+ * Call a function for each index of a range in parallel
+ *
+ * No further indices are started after an error, indices that are already
+ * being processed are completed.
+ *
+ * @param[in] start        First index
+ * @param[in] end          Index after the last index
+ * @param[in] num_threads  Maximum number of threads or 0 for one thread per
+ *                         online CPU
+ * @param[in] fn           Function to call for each index
+ * @param[in] data         Argument for function
+ *
+ * @returns   Error code for the lowest failed index or 0 on success
+ */
+int util_parallel_for(unsigned long start, unsigned long end,
+		      int num_threads, util_parallel_for_fn fn, void *data)
+{
+	struct parallel_for pf;
+	pthread_t *threads;
+	int i, started;
+
+	if (start >= end)
+		return 0;
+	num_threads = get_num_threads(num_threads);
+	if ((unsigned long) num_threads > end - start)
+		num_threads = end - start;
+	pf.fn = fn;
+	pf.data = data;
+	pf.next = start;
+	pf.end = end;
+	pf.err_index = end;
+	pf.err_rc = 0;
+	pthread_mutex_init(&pf.mutex, NULL);
+	threads = util_malloc(num_threads * sizeof(pthread_t));
+	/* The calling thread is one of the threads */
+	for (started = 0; started < num_threads - 1; started++) {
+		if (pthread_create(&threads[started], NULL,
+				   parallel_for_thread, &pf))
+			break;
+	}
+	parallel_for_thread(&pf);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	pthread_mutex_destroy(&pf.mutex);
+	return pf.err_rc;
+}
@@ -43,63 +43,92 @@ static ssize_t read_buffer(int fd, char *buf, ssize_t count)
 	return done;
 }
 
+/*
+ * Set the response buffer size and issue CPCMD on the VMCP device FD.
+ * Return zero on success or a negative error number on failure.
+ */
+static int issue_cmd(int fd, const char *cpcmd, unsigned int buffer_size)
+{
+	if (ioctl(fd, VMCP_SETBUF, &buffer_size) == -1)
+		return VMCP_ERR_SETBUF;
+	if (write(fd, cpcmd, strlen(cpcmd)) == -1)
+		return VMCP_ERR_WRITE;
+	return VMCP_SUCCESS;
+}
+
 /**
- * Submit a command to z/VM CP and return the response, the size in bytes
- * of the response and CP command response code.
+ * Open the VMCP device for submitting a batch of commands
  *
- * The member response contains the response from CP. It is a pointer
- * to a malloc'ed buffer which must be freed by the caller when the return
- * code is zero or VMCP_ERR_TOOSMALL.
+ * The returned file descriptor can be used for any number of vmcp_fd()
+ * calls and must be released with vmcp_close().
  *
- * @param[in,out] cmd		Pointer to struct vmcp_parm.
- * @param[in] cpcmd		Pointer to CP command string.
- * @param[in] do_upper		If true convert cpcmd string to upper case.
- * @param[out] cprc		Return code of the CP command.
- * @param[out] response		Return buffer, has been allocated via malloc()
- *				must be freed by caller, see below.
- * @param[out] response_size	Size of the response in bytes, can be larger
- *				than buffer_size.
+ * @returns	File descriptor on success or VMCP_ERR_OPEN on failure
+ */
+int vmcp_open(void)
+{
+	int fd;
+
+	fd = open(VMCP_DEVICE_NODE, O_RDWR);
+	return (fd == -1) ? VMCP_ERR_OPEN : fd;
+}
+
+/**
+ * Close a VMCP device opened by vmcp_open()
  *
- * @returns	Zero on success or a negative error number on failure.
- * @retval VMCP_SUCCESS		Success valid members: cprc, response,
- *				response_size
- * @retval VMCP_ERR_OPEN	Error opening VMCP device, valid members: none
- * @retval VMCP_ERR_SETBUF	Error setting buffer, valid members: none
- * @retval VMCP_ERR_GETCODE	Error getting cp exit code, valid members: none
- * @retval VMCP_ERR_WRITE	Error write CP command, valid members: none
- * @retval VMCP_ERR_GETSIZE	Error reading response size,
- *				valid members: cprc
- * @retval VMCP_ERR_READ	Error reading resp
- * @retval VMCP_ERR_TOOSMALL	Error response buffer too small, response
- *				truncated, valid members: cprc, response,
- *				response_size
+ * @param[in] fd		File descriptor returned by vmcp_open()
  */
-int vmcp(struct vmcp_parm *cmd)
+void vmcp_close(int fd)
+{
+	close(fd);
+}
+
+/**
+ * Submit a command to z/VM CP using an open VMCP device
+ *
+ * Same as vmcp(), but uses the VMCP device FD opened by vmcp_open()
+ * instead of opening and closing the device for each command.
+ *
+ * If member auto_size is true, buffer_size is ignored on input. The
+ * maximum buffer size is used so that a response of any size up to
+ * VMCP_MAX_BUFSZ is returned completely. A CP command cannot be repeated
+ * safely, so the buffer cannot be sized after the response is known. If
+ * the kernel cannot allocate the maximum buffer, the default buffer size
+ * is used instead. The kernel reports that failure before the command is
+ * issued. On return, buffer_size contains the buffer size that was used.
+ * The response buffer itself is always allocated from the reported
+ * response size.
+ *
+ * @param[in] fd		File descriptor returned by vmcp_open()
+ * @param[in,out] cmd		Pointer to struct vmcp_parm, see vmcp()
+ *
+ * @returns	Zero on success or a negative error number on failure,
+ *		see vmcp(). VMCP_ERR_OPEN is not returned.
+ */
+int vmcp_fd(int fd, struct vmcp_parm *cmd)
 {
-	int rc = VMCP_SUCCESS, fd, len;
+	int rc = VMCP_SUCCESS, len;
 	char *cpcmd;
 
 	cmd->response = NULL;
 	cmd->response_size = 0;
 	cmd->cprc = 0;
 
-	fd = open(VMCP_DEVICE_NODE, O_RDWR);
-	if (fd == -1)
-		return VMCP_ERR_OPEN;
-
 	cpcmd = util_strdup(cmd->cpcmd);	/* Exits on failure */
 	if (cmd->do_upper)
 		util_str_toupper(cpcmd);
 
-	if (ioctl(fd, VMCP_SETBUF, &cmd->buffer_size) == -1) {
-		rc = VMCP_ERR_SETBUF;
-		goto fail;
+	if (cmd->auto_size) {
+		cmd->buffer_size = VMCP_MAX_BUFSZ;
+		rc = issue_cmd(fd, cpcmd, cmd->buffer_size);
+		if (rc == VMCP_ERR_WRITE && errno == ENOMEM) {
+			cmd->buffer_size = VMCP_DEFAULT_BUFSZ;
+			rc = issue_cmd(fd, cpcmd, cmd->buffer_size);
+		}
+	} else {
+		rc = issue_cmd(fd, cpcmd, cmd->buffer_size);
 	}
-
-	if (write(fd, cpcmd, strlen(cpcmd)) == -1) {
-		rc = VMCP_ERR_WRITE;
+	if (rc)
 		goto fail;
-	}
 
 	if (ioctl(fd, VMCP_GETCODE, &cmd->cprc) == -1) {
 		rc = VMCP_ERR_GETCODE;
@@ -128,7 +157,57 @@ int vmcp(struct vmcp_parm *cmd)
 	}
 
 fail:
-	close(fd);
 	free(cpcmd);
 	return rc;
 }
+
+/**
+ * Submit a command to z/VM CP and return the response, the size in bytes
+ * of the response and CP command response code.
+ *
+ * The member response contains the response from CP. It is a pointer
+ * to a malloc'ed buffer which must be freed by the caller when the return
+ * code is zero or VMCP_ERR_TOOSMALL.
+ *
+ * @param[in,out] cmd		Pointer to struct vmcp_parm.
+ * @param[in] cpcmd		Pointer to CP command string.
+ * @param[in] do_upper		If true convert cpcmd string to upper case.
+ * @param[in] auto_size		If true use the largest possible buffer,
+ *				see vmcp_fd().
+ * @param[in,out] buffer_size	Size of the response buffer in bytes, set
+ *				to the size used if auto_size is true.
+ * @param[out] cprc		Return code of the CP command.
+ * @param[out] response		Return buffer, has been allocated via malloc()
+ *				must be freed by caller, see below.
+ * @param[out] response_size	Size of the response in bytes, can be larger
+ *				than buffer_size.
+ *
+ * @returns	Zero on success or a negative error number on failure.
+ * @retval VMCP_SUCCESS		Success valid members: cprc, response,
+ *				response_size
+ * @retval VMCP_ERR_OPEN	Error opening VMCP device, valid members: none
+ * @retval VMCP_ERR_SETBUF	Error setting buffer, valid members: none
+ * @retval VMCP_ERR_GETCODE	Error getting cp exit code, valid members: none
+ * @retval VMCP_ERR_WRITE	Error write CP command, valid members: none
+ * @retval VMCP_ERR_GETSIZE	Error reading response size,
+ *				valid members: cprc
+ * @retval VMCP_ERR_READ	Error reading resp
+ * @retval VMCP_ERR_TOOSMALL	Error response buffer too small, response
+ *				truncated, valid members: cprc, response,
+ *				response_size
+ */
+int vmcp(struct vmcp_parm *cmd)
+{
+	int rc, fd;
+
+	cmd->response = NULL;
+	cmd->response_size = 0;
+	cmd->cprc = 0;
+
+	fd = vmcp_open();
+	if (fd < 0)
+		return fd;
+	rc = vmcp_fd(fd, cmd);
+	vmcp_close(fd);
+	return rc;
+}
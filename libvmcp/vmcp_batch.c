@@ -0,0 +1,118 @@
+/*
+ * vmcp - Batched z/VM CP command submission
+ *
+ * Copyright IBM Corp. 2026
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "lib/util_libc.h"
+#include "lib/vmcp.h"
+
+/*
+ * State shared by all handles of one batch
+ */
+struct batch {
+	struct vmcp_parm *cmd_vec;	/* Commands to be submitted */
+	int *rc_vec;			/* Return codes of vmcp_fd() */
+	unsigned int count;		/* Number of commands */
+	unsigned int next;		/* Next command to be submitted */
+};
+
+/*
+ * Handle that submits commands of a batch over one VMCP device
+ */
+struct batch_handle {
+	struct batch *batch;
+	pthread_t thread;
+	int fd;
+};
+
+/*
+ * Submit commands until the batch is exhausted
+ */
+static void *batch_handle_run(void *data)
+{
+	struct batch_handle *handle = data;
+	struct batch *batch = handle->batch;
+	unsigned int i;
+
+	while (1) {
+		i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+		if (i >= batch->count)
+			break;
+		batch->rc_vec[i] = vmcp_fd(handle->fd, &batch->cmd_vec[i]);
+	}
+	return NULL;
+}
+
+/**
+ * Submit a list of commands to z/VM CP
+ *
+ * Every command is submitted like with vmcp_fd(), the VMCP device is
+ * opened only once per handle. With more than one handle, the commands are
+ * distributed over several VMCP devices that are used concurrently and may
+ * complete in any order, so this must only be used for commands that do not
+ * depend on each other. The kernel still serializes the CP calls itself,
+ * only the system call overhead of the commands is overlapped.
+ *
+ * If not all of the requested handles can be opened, the commands are
+ * submitted with the handles that could be opened.
+ *
+ * @param[in,out] cmd_vec	Array of commands, see vmcp()
+ * @param[out] rc_vec		Return code of vmcp_fd() for each command
+ * @param[in] count		Number of commands in cmd_vec
+ * @param[in] handles		Maximum number of VMCP devices used
+ *				concurrently, 1 submits the commands in
+ *				list order
+ *
+ * @returns	Zero if all commands have been submitted, check rc_vec for
+ *		the individual results, or VMCP_ERR_OPEN if no VMCP
+ *		device could be opened.
+ */
+int vmcp_batch(struct vmcp_parm *cmd_vec, int *rc_vec, unsigned int count,
+	       unsigned int handles)
+{
+	struct batch batch = { cmd_vec, rc_vec, count, 0 };
+	struct batch_handle *handle_vec;
+	unsigned int i, opened = 0, started;
+
+	if (count == 0)
+		return VMCP_SUCCESS;
+	if (handles == 0)
+		handles = 1;
+	if (handles > count)
+		handles = count;
+
+	handle_vec = util_zalloc(sizeof(*handle_vec) * handles);
+	for (i = 0; i < handles; i++) {
+		handle_vec[opened].fd = vmcp_open();
+		if (handle_vec[opened].fd < 0)
+			break;
+		handle_vec[opened].batch = &batch;
+		opened++;
+	}
+	if (opened == 0) {
+		free(handle_vec);
+		return VMCP_ERR_OPEN;
+	}
+
+	/* The calling thread uses the first handle itself */
+	for (started = 1; started < opened; started++) {
+		if (pthread_create(&handle_vec[started].thread, NULL,
+				   batch_handle_run, &handle_vec[started]))
+			break;
+	}
+	batch_handle_run(&handle_vec[0]);
+	for (i = 1; i < started; i++)
+		pthread_join(handle_vec[i].thread, NULL);
+
+	for (i = 0; i < opened; i++)
+		vmcp_close(handle_vec[i].fd);
+	free(handle_vec);
+	return VMCP_SUCCESS;
+}
@@ -25,6 +25,7 @@ int main(void)
 	cp.cpcmd = "q osa";
 	cp.buffer_size = VMCP_DEFAULT_BUFSZ;
 	cp.do_upper = true;
+	cp.auto_size = false;
 
 	rc = vmcp(&cp);
 
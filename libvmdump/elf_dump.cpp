@@ -0,0 +1,228 @@
+/*
+ * vmdump - z/VM dump conversion library
+ *
+ * ELF dump class: ElfDump64
+ *
+ * Writes an s390x ELF core dump directly from a 64 bit VMDUMP. Pages
+ * that are not contained in the VMDUMP are written as file holes.
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <elf.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elf_dump.h"
+
+ElfDump64::ElfDump64(VMDump *dump, const RegisterContent64 &rc)
+	: referenceDump(dump), registerContent(rc)
+{
+}
+
+size_t ElfDump64::noteSize(const char *name, size_t descSize) const
+{
+	return sizeof(Elf64_Nhdr) + ((strlen(name) + 1 + 3) & ~3UL) +
+		((descSize + 3) & ~3UL);
+}
+
+/*
+ * Size of all notes of all CPUs
+ */
+size_t ElfDump64::notesSize(void) const
+{
+	size_t size;
+
+	size = noteSize("CORE", sizeof(struct _nt_prstatus)) +
+		noteSize("CORE", sizeof(struct _nt_fpregset)) +
+		noteSize("LINUX", sizeof(uint64_t)) +	/* NT_S390_TIMER */
+		noteSize("LINUX", sizeof(uint64_t)) +	/* NT_S390_TODCMP */
+		noteSize("LINUX", 16 * sizeof(uint64_t)) + /* NT_S390_CTRS */
+		noteSize("LINUX", sizeof(uint32_t));	/* NT_S390_PREFIX */
+	return size * registerContent.getNumCpus();
+}
+
+/*
+ * Add a note at ptr and return the position after the note.
+ * The header fields are big-endian, the descriptor is copied as is.
+ */
+char *ElfDump64::addNote(char *ptr, const char *name, uint32_t type,
+			 const void *desc, size_t descSize) const
+{
+	size_t nameSize = strlen(name) + 1;
+	Elf64_Nhdr nhdr;
+
+	nhdr.n_namesz = htobe32(nameSize);
+	nhdr.n_descsz = htobe32(descSize);
+	nhdr.n_type = htobe32(type);
+	memcpy(ptr, &nhdr, sizeof(nhdr));
+	ptr += sizeof(nhdr);
+	memcpy(ptr, name, nameSize);
+	ptr += (nameSize + 3) & ~3UL;
+	memcpy(ptr, desc, descSize);
+	ptr += (descSize + 3) & ~3UL;
+	return ptr;
+}
+
+/*
+ * Add the notes of a CPU. The register values are copied unchanged from
+ * the VMDUMP and are therefore already big-endian.
+ */
+char *ElfDump64::addCpuNotes(char *ptr, int cpu) const
+{
+	const RegisterSet64 &rs = registerContent.regSets[cpu];
+	struct _nt_fpregset fpregset;
+	struct _nt_prstatus prstatus;
+
+	memset(&prstatus, 0, sizeof(prstatus));
+	prstatus.pr_pid = htobe32(cpu + 1);
+	memcpy(prstatus.psw, rs.psw, sizeof(prstatus.psw));
+	memcpy(prstatus.gprs, rs.gprs, sizeof(prstatus.gprs));
+	memcpy(prstatus.acrs, rs.acrs, sizeof(prstatus.acrs));
+	prstatus.pr_fpvalid = htobe32(1);
+	ptr = addNote(ptr, "CORE", NT_PRSTATUS, &prstatus, sizeof(prstatus));
+
+	memset(&fpregset, 0, sizeof(fpregset));
+	memcpy(&fpregset.fpc, &rs.fpCr, sizeof(fpregset.fpc));
+	memcpy(fpregset.fprs, rs.fprs, sizeof(fpregset.fprs));
+	ptr = addNote(ptr, "CORE", NT_FPREGSET, &fpregset, sizeof(fpregset));
+
+	ptr = addNote(ptr, "LINUX", NT_S390_TIMER, &rs.cpuTimer,
+		      sizeof(rs.cpuTimer));
+	ptr = addNote(ptr, "LINUX", NT_S390_TODCMP, &rs.clkCmp,
+		      sizeof(rs.clkCmp));
+	ptr = addNote(ptr, "LINUX", NT_S390_CTRS, rs.crs, sizeof(rs.crs));
+	ptr = addNote(ptr, "LINUX", NT_S390_PREFIX, &rs.prefix,
+		      sizeof(rs.prefix));
+	return ptr;
+}
+
+void ElfDump64::writeBuf(int fd, const void *buf, size_t size) const
+{
+	if (write(fd, buf, size) != (ssize_t) size)
+		throw(DumpErrnoException("write failed"));
+}
+
+/*
+ * Skip size bytes in the output file. If the output is not seekable
+ * (e.g. a pipe), zeros are written instead.
+ */
+void ElfDump64::writeHole(int fd, uint64_t size) const
+{
+	static const char zeros[ELF_PAGE_SIZE] = {};
+	uint64_t len;
+
+	if (lseek(fd, size, SEEK_CUR) != (off_t) -1)
+		return;
+	if (errno != ESPIPE)
+		throw(DumpErrnoException("lseek failed"));
+	while (size > 0) {
+		len = size < sizeof(zeros) ? size : sizeof(zeros);
+		writeBuf(fd, zeros, len);
+		size -= len;
+	}
+}
+
+void ElfDump64::writeDump(const char *fileName)
+{
+	uint64_t memSize = referenceDump->getMemSize();
+	uint64_t pages = memSize / ELF_PAGE_SIZE;
+	uint64_t page = 0, run, max, memOffset;
+	ProgressBar progressBar;
+	size_t hdrSize, notesOffset;
+	Elf64_Ehdr *ehdr;
+	Elf64_Phdr *phdr;
+	char *hdr, *buf;
+	off_t end;
+	int cpu, fd;
+
+	if (fileName == NULL) {
+		fd = STDOUT_FILENO;
+	} else {
+		fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC,
+			  S_IRUSR | S_IWUSR);
+		if (fd == -1) {
+			char msg[1024];
+			sprintf(msg, "Open of dump '%s' failed.", fileName);
+			throw(DumpErrnoException(msg));
+		}
+	}
+
+	/* ELF header, one PT_NOTE and one PT_LOAD program header, notes */
+
+	notesOffset = sizeof(Elf64_Ehdr) + 2 * sizeof(Elf64_Phdr);
+	hdrSize = notesOffset + notesSize();
+	memOffset = (hdrSize + ELF_PAGE_SIZE - 1) & ~(ELF_PAGE_SIZE - 1);
+	hdr = new char[memOffset];
+	memset(hdr, 0, memOffset);
+
+	ehdr = (Elf64_Ehdr *) hdr;
+	memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+	ehdr->e_ident[EI_CLASS] = ELFCLASS64;
+	ehdr->e_ident[EI_DATA] = ELFDATA2MSB;
+	ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr->e_ident[EI_OSABI] = ELFOSABI_SYSV;
+	ehdr->e_type = htobe16(ET_CORE);
+	ehdr->e_machine = htobe16(EM_S390);
+	ehdr->e_version = htobe32(EV_CURRENT);
+	ehdr->e_phoff = htobe64(sizeof(Elf64_Ehdr));
+	ehdr->e_ehsize = htobe16(sizeof(Elf64_Ehdr));
+	ehdr->e_phentsize = htobe16(sizeof(Elf64_Phdr));
+	ehdr->e_phnum = htobe16(2);
+
+	phdr = (Elf64_Phdr *) (hdr + sizeof(Elf64_Ehdr));
+	phdr[0].p_type = htobe32(PT_NOTE);
+	phdr[0].p_offset = htobe64(notesOffset);
+	phdr[0].p_filesz = htobe64(hdrSize - notesOffset);
+	phdr[0].p_memsz = phdr[0].p_filesz;
+	phdr[1].p_type = htobe32(PT_LOAD);
+	phdr[1].p_flags = htobe32(PF_R | PF_W | PF_X);
+	phdr[1].p_offset = htobe64(memOffset);
+	phdr[1].p_filesz = htobe64(memSize);
+	phdr[1].p_memsz = htobe64(memSize);
+	phdr[1].p_align = htobe64(ELF_PAGE_SIZE);
+
+	buf = hdr + notesOffset;
+	for (cpu = 0; cpu < registerContent.getNumCpus(); cpu++)
+		buf = addCpuNotes(buf, cpu);
+
+	writeBuf(fd, hdr, memOffset);
+	delete[] hdr;
+
+	/* Memory: present pages are copied, absent pages become holes */
+
+	buf = new char[ELF_READ_PAGES * ELF_PAGE_SIZE];
+	referenceDump->seekMem(0);
+	while (page < pages) {
+		max = pages - page;
+		if (max > ELF_READ_PAGES)
+			max = ELF_READ_PAGES;
+		run = referenceDump->pageRun(page, max);
+		if (referenceDump->testPage(page)) {
+			referenceDump->readMem(buf, run * ELF_PAGE_SIZE);
+			writeBuf(fd, buf, run * ELF_PAGE_SIZE);
+		} else {
+			referenceDump->skipPages(run);
+			writeHole(fd, run * ELF_PAGE_SIZE);
+		}
+		page += run;
+		progressBar.displayProgress(page * ELF_PAGE_SIZE / (1024 * 1024),
+					    memSize / (1024 * 1024));
+	}
+	delete[] buf;
+
+	/* Set the file size in case the dump ends with a hole */
+	end = lseek(fd, 0, SEEK_CUR);
+	if (end != (off_t) -1 && ftruncate(fd, end) != 0)
+		throw(DumpErrnoException("ftruncate failed"));
+
+	fprintf(stderr, "\n");
+	if (fd != STDOUT_FILENO)
+		close(fd);
+}
@@ -0,0 +1,62 @@
+/*
+ * vmdump - z/VM dump conversion library
+ *
+ * ELF dump class: ElfDump64
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef ELF_DUMP_H
+#define ELF_DUMP_H
+
+#include "lib/zt_common.h"
+
+#include "register_content.h"
+#include "vm_dump.h"
+
+#define ELF_PAGE_SIZE	0x1000ULL
+#define ELF_READ_PAGES	256	/* Pages read from the source at once */
+
+class ElfDump64
+{
+public:
+	ElfDump64(VMDump *dump, const RegisterContent64 &rc);
+	virtual ~ElfDump64(void) {}
+	void writeDump(const char *fileName);
+private:
+	/* s390x NT_PRSTATUS note as used by the Linux kernel */
+	struct _nt_prstatus {
+		uint8_t  pad1[32];
+		uint32_t pr_pid;
+		uint8_t  pad2[76];
+		uint64_t psw[2];
+		uint64_t gprs[16];
+		uint32_t acrs[16];
+		uint64_t orig_gpr2;
+		uint32_t pr_fpvalid;
+		uint8_t  pad3[4];
+	} __packed;
+
+	/* s390x NT_FPREGSET note */
+	struct _nt_fpregset {
+		uint32_t fpc;
+		uint32_t pad;
+		uint64_t fprs[16];
+	} __packed;
+
+	size_t noteSize(const char *name, size_t descSize) const;
+	size_t notesSize(void) const;
+	char *addNote(char *ptr, const char *name, uint32_t type,
+		      const void *desc, size_t descSize) const;
+	char *addCpuNotes(char *ptr, int cpu) const;
+	void writeBuf(int fd, const void *buf, size_t size) const;
+	void writeHole(int fd, uint64_t size) const;
+
+	VMDump *referenceDump;
+	RegisterContent64 registerContent;
+};
+
+#endif /* ELF_DUMP_H */
@@ -10,6 +10,7 @@
  */
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <string.h>
 #include <unistd.h>
 #include <zlib.h>
@@ -64,18 +65,62 @@ int LKCDDump::compressGZIP(const char *old, uint32_t old_size, char *n,
 	return rc;
 }
 
+/*
+ * Compress pages of a job until all pages are taken
+ */
+void *LKCDDump::compressWorker(void *arg)
+{
+	struct compress_job *job = (struct compress_job *) arg;
+	unsigned int i;
+
+	while ((i = __sync_fetch_and_add(&job->next, 1)) < job->count) {
+		try {
+			job->size[i] = job->dump->compressGZIP(
+				job->in + i * DUMP_PAGE_SIZE, DUMP_PAGE_SIZE,
+				job->out + i * DUMP_PAGE_SIZE, DUMP_PAGE_SIZE);
+		} catch (DumpException &) {
+			job->failed = 1;
+			break;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Compress all pages of a job using up to "threads" threads
+ */
+void LKCDDump::compressPages(struct compress_job *job, int threads)
+{
+	pthread_t tids[DUMP_COMPRESS_THREADS];
+	int i, started = 0;
+
+	job->next = 0;
+	job->failed = 0;
+	for (i = 1; i < threads; i++) {
+		if (pthread_create(&tids[started], NULL, compressWorker, job))
+			break;
+		started++;
+	}
+	compressWorker(job);
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+	if (job->failed)
+		throw(DumpException("gzip call failed"));
+}
+
 void LKCDDump::writeDump(const char* fileName)
 {
 	char dump_header_buf[DUMP_HEADER_SIZE] = {};
-	char dump_page_buf[DUMP_BUFFER_SIZE];
-	char dpcpage[DUMP_PAGE_SIZE];
+	char *dump_page_buf;
 	uint32_t dp_size,dp_flags;
+	uint64_t chunk_len, page;
+	struct compress_job job;
 	ProgressBar progressBar;
-	char buf[DUMP_PAGE_SIZE];
 	struct _dump_page dp;
 	uint64_t mem_loc = 0;
 	ssize_t buf_loc = 0;
-	int size, fd;
+	char *chunk, *buf;
+	int size, fd, threads;
 
 	if (fileName == NULL) {
 		fd = STDOUT_FILENO;
@@ -103,55 +148,70 @@ void LKCDDump::writeDump(const char* fileName)
 
 	referenceDump->seekMem(0);
 
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1)
+		threads = 1;
+	if (threads > DUMP_COMPRESS_THREADS)
+		threads = DUMP_COMPRESS_THREADS;
+
+	/*
+	 * Pages are read in chunks, the pages of a chunk are compressed in
+	 * parallel, and then written in order
+	 */
+	chunk = new char[DUMP_READ_PAGES * DUMP_PAGE_SIZE];
+	job.dump = this;
+	job.in = chunk;
+	job.out = new char[DUMP_READ_PAGES * DUMP_PAGE_SIZE];
+	job.size = new int[DUMP_READ_PAGES];
+	dump_page_buf = new char[DUMP_READ_PAGES *
+				 (sizeof(dp) + DUMP_PAGE_SIZE)];
 	while (mem_loc < dumpHeader.memory_size) {
-		referenceDump->readMem(buf, DUMP_PAGE_SIZE);
-		copyRegsToPage(mem_loc,buf);
+		chunk_len = dumpHeader.memory_size - mem_loc;
+		if (chunk_len > DUMP_READ_PAGES * DUMP_PAGE_SIZE)
+			chunk_len = DUMP_READ_PAGES * DUMP_PAGE_SIZE;
+		referenceDump->readMem(chunk, chunk_len);
+		job.count = chunk_len / DUMP_PAGE_SIZE;
+		for (page = 0; page < job.count; page++)
+			copyRegsToPage(mem_loc + page * DUMP_PAGE_SIZE,
+				       chunk + page * DUMP_PAGE_SIZE);
+		compressPages(&job, threads);
 
-		memset(dpcpage, 0, DUMP_PAGE_SIZE);
-		/*
-		 * Get the new compressed page size
-		 */
-		size = compressGZIP((char *)buf, DUMP_PAGE_SIZE,
-				    (char *)dpcpage, DUMP_PAGE_SIZE);
+		/* Write the pages of the chunk in order */
+		buf_loc = 0;
+		for (page = 0; page < job.count; page++) {
+			buf = chunk + page * DUMP_PAGE_SIZE;
+			size = job.size[page];
 
-		/*
-		 * If compression failed or compressed was ineffective,
-		 * we write an uncompressed page
-		 */
-		if (size == GZIP_NOT_COMPRESSED) {
-			dp_flags = DUMP_DH_RAW;
-			dp_size  = DUMP_PAGE_SIZE;
-		} else {
-			dp_flags = DUMP_DH_COMPRESSED;
-			dp_size  = size;
+			/*
+			 * If compression failed or compressed was ineffective,
+			 * we write an uncompressed page
+			 */
+			if (size == GZIP_NOT_COMPRESSED) {
+				dp_flags = DUMP_DH_RAW;
+				dp_size  = DUMP_PAGE_SIZE;
+			} else {
+				dp_flags = DUMP_DH_COMPRESSED;
+				dp_size  = size;
+				buf = job.out + page * DUMP_PAGE_SIZE;
+			}
+			dp.address = mem_loc;
+			dp.size    = dp_size;
+			dp.flags   = dp_flags;
+			memcpy(dump_page_buf + buf_loc, &dp, sizeof(dp));
+			buf_loc += sizeof(dp);
+			memcpy(dump_page_buf + buf_loc, buf, dp_size);
+			buf_loc += dp_size;
+			mem_loc += DUMP_PAGE_SIZE;
 		}
-		dp.address = mem_loc;
-		dp.size    = dp_size;
-		dp.flags   = dp_flags;
-		memcpy((void *)(dump_page_buf + buf_loc),
-				(const void *)&dp, sizeof(dp));
-		buf_loc += sizeof(dp);
-		/*
-		 * Copy the page of memory
-		 */
-		if (dp_flags & DUMP_DH_COMPRESSED) {
-			/* Copy the compressed page */
-			memcpy((void *)(dump_page_buf + buf_loc),
-					(const void *)dpcpage, dp_size);
-		} else {
-			/* Copy directly from memory */
-			memcpy((void *)(dump_page_buf + buf_loc),
-					(const void *)buf, dp_size);
-		}
-		buf_loc += dp_size;
-		if(write(fd, dump_page_buf, buf_loc) != buf_loc){
+		if (write(fd, dump_page_buf, buf_loc) != buf_loc)
 			throw(DumpErrnoException("write failed"));
-		}
-		buf_loc = 0;
-		mem_loc += DUMP_PAGE_SIZE;
 		progressBar.displayProgress(mem_loc/(1024*1024),
 				dumpHeader.memory_size/(1024*1024));
 	}
+	delete[] dump_page_buf;
+	delete[] job.size;
+	delete[] job.out;
+	delete[] chunk;
 
 	/*
 	 * Write end marker
@@ -18,7 +18,6 @@
 #include "register_content.h"
 
 #define UTS_LEN 65
-#define DUMP_BUFFER_SIZE     0x2000  /* Size of dump buffer */
 
 /* Standard header definitions */
 #define DUMP_HEADER_SIZE    0x10000
@@ -41,6 +40,8 @@
 /* Dump page defines */
 #define DUMP_PAGE_SHIFT     12ULL
 #define DUMP_PAGE_SIZE      (1ULL << DUMP_PAGE_SHIFT)
+#define DUMP_READ_PAGES     256  /* Pages read from the source at once */
+#define DUMP_COMPRESS_THREADS 16 /* Maximum number of compress threads */
 
 #define GZIP_NOT_COMPRESSED -1
 
@@ -123,8 +124,20 @@ protected:
 	struct _lkcd_dump_header_asm dumpHeaderAsm;
 
 private:
+	struct compress_job {
+		LKCDDump *dump;
+		const char *in;		/* Uncompressed pages */
+		char *out;		/* Compressed pages, one page size each */
+		int *size;		/* Compressed size per page */
+		unsigned int count;	/* Number of pages */
+		unsigned int next;	/* Next page to compress */
+		int failed;
+	};
+
 	int compressGZIP(const char *old, uint32_t old_size, char *n,
 			uint32_t new_size);
+	static void *compressWorker(void *arg);
+	void compressPages(struct compress_job *job, int threads);
 	Dump *referenceDump;
 };
 
@@ -199,9 +199,49 @@ int VMDump::seekMem(uint64_t offset)
 	return 0;
 }
 
+/*
+ * Return the number of consecutive pages starting at page "bit" that have
+ * the same state (present or absent) in the bitmap, at most "max" pages.
+ * Full bytes and 64 bit words are compared at once.
+ */
+uint64_t VMDump::pageRun(uint64_t bit, uint64_t max) const
+{
+	int present = testPage(bit);
+	unsigned char fill = present ? 0xff : 0x00;
+	uint64_t word_fill = present ? ~0ULL : 0ULL;
+	uint64_t end = bit + max, pos = bit + 1;
+	uint64_t word;
+
+	/* Bits up to the next byte boundary */
+	while (pos < end && (pos % 8) != 0) {
+		if (!testPage(pos) != !present)
+			return pos - bit;
+		pos++;
+	}
+	/* Full bytes up to the next word boundary */
+	while (pos + 8 <= end && (pos % 64) != 0 &&
+	       (unsigned char) bitmap[pos / 8] == fill)
+		pos += 8;
+	/* Full words */
+	if ((pos % 64) == 0) {
+		while (pos + 64 <= end) {
+			memcpy(&word, &bitmap[pos / 8], sizeof(word));
+			if (word != word_fill)
+				break;
+			pos += 64;
+		}
+	}
+	/* Remaining bytes and bits */
+	while (pos + 8 <= end && (unsigned char) bitmap[pos / 8] == fill)
+		pos += 8;
+	while (pos < end && !testPage(pos) == !present)
+		pos++;
+	return pos - bit;
+}
+
 void VMDump::readMem(char* buf, int size)
 {
-	int i;
+	uint64_t pages, run;
 
 	if (pageOffset == 0)
 		dump_seek(fh, memoryStartRecord, SEEK_SET);
@@ -211,16 +251,35 @@ void VMDump::readMem(char* buf, int size)
 		"can only handle sizes which are multiples of page size"));
 	}
 
-	for(i = 0; i < size; i += 0x1000) {
-		if(testPage(pageOffset)) {
-			dump_read(buf + i, 0x1000, 1, fh);
-		} else {
-			memset(buf + i, 0, 0x1000);
-		}
-		pageOffset += 1;
+	/*
+	 * Present pages are stored consecutively in the dump, so each run
+	 * of present pages is read at once and each run of absent pages is
+	 * filled with zeros.
+	 */
+	pages = size / 0x1000;
+	while (pages > 0) {
+		run = pageRun(pageOffset, pages);
+		if (testPage(pageOffset))
+			dump_read(buf, run * 0x1000, 1, fh);
+		else
+			memset(buf, 0, run * 0x1000);
+		buf += run * 0x1000;
+		pageOffset += run;
+		pages -= run;
 	}
 }
 
+/*
+ * Skip absent pages. Absent pages have no data in the dump, so only the
+ * page offset is advanced.
+ */
+void VMDump::skipPages(uint64_t count)
+{
+	if (pageOffset == 0)
+		dump_seek(fh, memoryStartRecord, SEEK_SET);
+	pageOffset += count;
+}
+
 VMDump::~VMDump(void)
 {
 }
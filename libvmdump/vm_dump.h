@@ -83,6 +83,8 @@ public:
 	{
 		bitmap[bit/8] |= (1 << (7-(bit % 8)));
 	}
+	uint64_t pageRun(uint64_t bit, uint64_t max) const;
+	void skipPages(uint64_t count);
 protected:
 	/* Types */
 	struct _adsr {
@@ -1,7 +1,7 @@
 /*
  * vmdump - z/VM dump conversion library
  *
- * Dump convert function: Converts VMDUMP to LKCD dump
+ * Dump convert functions: Convert VMDUMP to LKCD or ELF dump
  *
  * Copyright IBM Corp. 2004, 2017
  *
@@ -9,6 +9,7 @@
  * it under the terms of the MIT license. See LICENSE for details.
  */
 
+#include "elf_dump.h"
 #include "lkcd_dump.h"
 #include "vm_dump.h"
 
@@ -70,3 +71,51 @@ int vmdump_convert(const char* inputFileName, const char* outputFileName,
 	}
 	return 0;
 }
+
+int vmdump_convert_elf(const char* inputFileName, const char* outputFileName,
+		       const char* progName)
+{
+	/* Do the conversion */
+	try {
+		switch(VMDump::getDumpType(inputFileName)){
+			case Dump::DT_VM64_BIG:
+			{
+				VMDump64Big* vmdump;
+				ElfDump64* elfdump;
+
+				vmdump = new VMDump64Big(inputFileName);
+				vmdump->printInfo();
+				elfdump = new ElfDump64(vmdump,
+						vmdump->getRegisterContent());
+				elfdump->writeDump(outputFileName);
+				delete vmdump;
+				delete elfdump;
+				break;
+			}
+			case Dump::DT_VM64:
+			{
+				ElfDump64* elfdump;
+				VMDump64* vmdump;
+
+				vmdump = new VMDump64(inputFileName);
+				vmdump->printInfo();
+				elfdump = new ElfDump64(vmdump,
+						vmdump->getRegisterContent());
+				elfdump->writeDump(outputFileName);
+				delete vmdump;
+				delete elfdump;
+				break;
+			}
+			case Dump::DT_VM32:
+				throw DumpException("ELF output is not supported "
+						    "for 32 bit vmdumps");
+			default:
+				throw DumpException("This is not a vmdump");
+		}
+	} catch (DumpException ex) {
+		printf("%s: %s\n", progName, ex.what());
+		fflush(stdout);
+		return 1;
+	}
+	return 0;
+}
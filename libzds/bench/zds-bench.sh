@@ -0,0 +1,108 @@
+#!/bin/bash
+#
+# zds-bench.sh - Measure libzds and zdsfs performance on DASD image files
+#
+# Create DASD image files with FB and VB data sets, then run zdsbench on
+# each image and time reading all data sets through a zdsfs mount.
+#
+# Copyright IBM Corp. 2026
+#
+# s390-tools is free software; you can redistribute it and/or modify
+# it under the terms of the MIT license. See LICENSE for details.
+#
+
+readonly SCRIPTNAME="${0##*/}"
+readonly RECFMS="FB VB"
+
+ZDSIMG=./zdsimg
+ZDSBENCH=./zdsbench
+ZDSFS=../../zdsfs/zdsfs
+PS=4
+TRACKS=150
+MEMBERS=100
+WORKDIR=
+
+print_error() {
+	echo "$SCRIPTNAME: $1" >&2
+	exit 1
+}
+
+print_usage() {
+	cat <<EOF
+Usage: $SCRIPTNAME [OPTIONS]
+
+Create DASD image files and measure libzds and zdsfs performance.
+
+OPTIONS
+ -g ZDSIMG    Image generator (default ./zdsimg)
+ -b ZDSBENCH  libzds benchmark (default ./zdsbench)
+ -z ZDSFS     zdsfs binary, skip zdsfs if not found (default ../../zdsfs/zdsfs)
+ -p NUM       Number of PS data sets (default 4)
+ -t NUM       Size of each PS data set in tracks (default 150)
+ -m NUM       Number of PDS members (default 100)
+ -w DIR       Directory for the image files (default: temporary)
+ -h           Print this help, then exit
+EOF
+}
+
+on_exit() {
+	if [ -n "$MNT" ] && mountpoint -q "$MNT"; then
+		fusermount -u "$MNT"
+	fi
+	[ -n "$TMP" ] && rm -rf "$TMP"
+}
+
+# Print elapsed seconds of a command
+elapsed() {
+	local TIMEFORMAT=%R
+
+	{ time "$@" > /dev/null 2>&1 ; } 2>&1
+}
+
+while getopts "g:b:z:p:t:m:w:h" opt; do
+	case $opt in
+	g) ZDSIMG=$OPTARG ;;
+	b) ZDSBENCH=$OPTARG ;;
+	z) ZDSFS=$OPTARG ;;
+	p) PS=$OPTARG ;;
+	t) TRACKS=$OPTARG ;;
+	m) MEMBERS=$OPTARG ;;
+	w) WORKDIR=$OPTARG ;;
+	h) print_usage; exit 0 ;;
+	*) print_usage >&2; exit 1 ;;
+	esac
+done
+
+[ -x "$ZDSIMG" ] || print_error "Generator $ZDSIMG not found"
+[ -x "$ZDSBENCH" ] || print_error "Benchmark $ZDSBENCH not found"
+
+if [ -z "$WORKDIR" ]; then
+	TMP="$(mktemp -d)" || print_error "Could not create temporary directory"
+	WORKDIR=$TMP
+fi
+trap on_exit EXIT
+MNT="$WORKDIR/mnt"
+mkdir -p "$MNT"
+
+for recfm in $RECFMS; do
+	img="$WORKDIR/bench-$recfm.img"
+	echo "Image with $recfm records:"
+	"$ZDSIMG" -r "$recfm" -p "$PS" -t "$TRACKS" -m "$MEMBERS" "$img" ||
+		print_error "Could not create image $img"
+	"$ZDSBENCH" "$img" || print_error "Benchmark failed on $img"
+	"$ZDSBENCH" -a -n 0 "$img" | sed -n 's/^Sequential read: /Read ahead:      /p'
+
+	# A "-" means that zdsfs is not available or could not mount
+	if [ -x "$ZDSFS" ] && "$ZDSFS" "$img" "$MNT" 2>/dev/null; then
+		t=$(elapsed sh -c "find '$MNT' -type f -exec cat {} + |
+			wc -c > '$WORKDIR/size'")
+		size=$(cat "$WORKDIR/size")
+		fusermount -u "$MNT"
+		awk -v s="$size" -v t="$t" 'BEGIN { if (t > 0)
+			printf "zdsfs read:       %10.1f MB/s (%d bytes in %.3f s)\n",
+			s / t / 1e6, s, t; else print "zdsfs read:                -" }'
+	else
+		echo "zdsfs read:                -"
+	fi
+	echo
+done
@@ -0,0 +1,317 @@
+/*
+ * zdsbench - Measure libzds performance on a DASD or DASD image file
+ *
+ * Time the VTOC scan, sequential reads of all data sets and PDS members,
+ * and random seeks with lzds_dshandle_lseek.
+ *
+ * Copyright IBM Corp. 2026
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lib/libzds.h"
+#include "lib/util_base.h"
+#include "lib/util_libc.h"
+#include "lib/util_opt.h"
+#include "lib/util_prg.h"
+
+#define READ_SIZE	(64 * 1024)
+
+static struct {
+	unsigned long seeks;
+	unsigned int tracks;
+	unsigned long long seekbuffer;
+	unsigned int seed;
+	int readahead;
+	const char *device;
+} l = {
+	.seeks = 1000,
+	.seekbuffer = 1024 * 1024,
+	.seed = 1,
+};
+
+static struct util_opt opt_vec[] = {
+	UTIL_OPT_SECTION("OPTIONS"),
+	{
+		.option = { "seeks", required_argument, NULL, 'n' },
+		.argument = "NUM",
+		.desc = "Number of random seeks per data set (default 1000)",
+	},
+	{
+		.option = { "tracks", required_argument, NULL, 't' },
+		.argument = "NUM",
+		.desc = "Tracks per frame of each dshandle (default 128)",
+	},
+	{
+		.option = { "seekbuffer", required_argument, NULL, 's' },
+		.argument = "BYTES",
+		.desc = "Seek buffer size (default 1048576)",
+	},
+	{
+		.option = { "seed", required_argument, NULL, 'r' },
+		.argument = "NUM",
+		.desc = "Seed for the random offsets (default 1)",
+	},
+	{
+		.option = { "readahead", no_argument, NULL, 'a' },
+		.desc = "Enable read ahead for sequential reads",
+	},
+	UTIL_OPT_HELP,
+	UTIL_OPT_VERSION,
+	UTIL_OPT_END
+};
+
+static const struct util_prg prg = {
+	.desc = "Measure libzds performance on a DASD or DASD image file",
+	.args = "DEVICE",
+	.copyright_vec = {
+		{
+			.owner = "IBM Corp.",
+			.pub_first = 2026,
+			.pub_last = 2026,
+		},
+		UTIL_PRG_COPYRIGHT_END
+	}
+};
+
+static unsigned long long parse_num(const char *arg, const char *name)
+{
+	unsigned long long val;
+	char *end;
+
+	errno = 0;
+	val = strtoull(arg, &end, 10);
+	if (errno || *end || arg[0] == '-')
+		errx(EXIT_FAILURE, "Invalid value for %s: %s", name, arg);
+	return val;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = util_opt_getopt_long(argc, argv)) != -1) {
+		switch (opt) {
+		case 'n':
+			l.seeks = parse_num(optarg, "--seeks");
+			break;
+		case 't':
+			l.tracks = parse_num(optarg, "--tracks");
+			break;
+		case 's':
+			l.seekbuffer = parse_num(optarg, "--seekbuffer");
+			break;
+		case 'r':
+			l.seed = parse_num(optarg, "--seed");
+			break;
+		case 'a':
+			l.readahead = 1;
+			break;
+		case 'h':
+			util_prg_print_help();
+			util_opt_print_help();
+			exit(EXIT_SUCCESS);
+		case 'v':
+			util_prg_print_version();
+			exit(EXIT_SUCCESS);
+		default:
+			util_opt_print_parse_error(opt, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (optind != argc - 1)
+		errx(EXIT_FAILURE, "Specify exactly one device");
+	l.device = argv[optind];
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct dshandle *dsh_open(struct dataset *ds, char *member, int ra)
+{
+	struct dshandle *dsh;
+	char *name;
+	int rc;
+
+	lzds_dataset_get_name(ds, &name);
+	rc = lzds_dataset_alloc_dshandle(ds, l.tracks, &dsh);
+	if (!rc)
+		rc = lzds_dshandle_set_seekbuffer(dsh, l.seekbuffer);
+	if (!rc && ra)
+		rc = lzds_dshandle_set_readahead(dsh, 1);
+	if (!rc && member)
+		rc = lzds_dshandle_set_member(dsh, member);
+	if (!rc)
+		rc = lzds_dshandle_open(dsh);
+	if (rc)
+		errx(EXIT_FAILURE, "Could not open %s%s%s%s: %s", name,
+		     member ? "(" : "", member ?: "", member ? ")" : "",
+		     strerror(rc));
+	return dsh;
+}
+
+static void dsh_close(struct dshandle *dsh)
+{
+	lzds_dshandle_close(dsh);
+	lzds_dshandle_free(dsh);
+}
+
+/*
+ * Read the open data set or member to the end and return the size
+ */
+static long long read_all(struct dshandle *dsh, char *buf)
+{
+	long long total = 0;
+	ssize_t count;
+	int rc;
+
+	do {
+		rc = lzds_dshandle_read(dsh, buf, READ_SIZE, &count);
+		if (rc)
+			errx(EXIT_FAILURE, "Could not read data set: %s",
+			     strerror(rc));
+		total += count;
+	} while (count);
+	return total;
+}
+
+/*
+ * Read data set, or all members of a PDS, and return the size
+ */
+static long long read_dataset(struct dataset *ds, char *buf)
+{
+	struct memberiterator *it;
+	struct pdsmember *member;
+	struct dshandle *dsh;
+	long long total = 0;
+	char *name;
+	int is_pds;
+
+	lzds_dataset_get_is_PDS(ds, &is_pds);
+	if (!is_pds) {
+		dsh = dsh_open(ds, NULL, l.readahead);
+		total = read_all(dsh, buf);
+		dsh_close(dsh);
+		return total;
+	}
+	if (lzds_dataset_alloc_memberiterator(ds, &it))
+		errx(EXIT_FAILURE, "Could not allocate member iterator");
+	while (!lzds_memberiterator_get_next_member(it, &member)) {
+		lzds_pdsmember_get_name(member, &name);
+		dsh = dsh_open(ds, name, l.readahead);
+		total += read_all(dsh, buf);
+		dsh_close(dsh);
+	}
+	lzds_memberiterator_free(it);
+	return total;
+}
+
+/*
+ * Seek to random offsets of a data set with size "size" and return the
+ * elapsed time. The data set is read once, so that the seek buffer is
+ * filled as for a file that has been accessed before.
+ */
+static double seek_dataset(struct dataset *ds, long long size, char *buf)
+{
+	struct dshandle *dsh;
+	long long off, rcoff;
+	unsigned long i;
+	double start;
+	int rc;
+
+	dsh = dsh_open(ds, NULL, 0);
+	read_all(dsh, buf);
+	start = now();
+	for (i = 0; i < l.seeks; i++) {
+		off = ((long long)random() * RAND_MAX + random()) % size;
+		rc = lzds_dshandle_lseek(dsh, off, &rcoff);
+		if (rc || rcoff != off)
+			errx(EXIT_FAILURE, "Could not seek to offset %lld: %s",
+			     off, strerror(rc));
+	}
+	start = now() - start;
+	dsh_close(dsh);
+	return start;
+}
+
+int main(int argc, char *argv[])
+{
+	double start, t_scan, t_read = 0, t_seek = 0;
+	long long size, total = 0;
+	unsigned int datasets = 0, seek_datasets = 0;
+	struct errorlog *log;
+	struct zdsroot *root;
+	struct dsiterator *it;
+	struct dataset *ds;
+	struct dasd *dasd;
+	int rc, value;
+	char *buf;
+
+	util_prg_init(&prg);
+	util_opt_init(opt_vec, NULL);
+	parse_args(argc, argv);
+	buf = util_malloc(READ_SIZE);
+	srandom(l.seed);
+
+	start = now();
+	if (lzds_zdsroot_alloc(&root))
+		errx(EXIT_FAILURE, "Could not allocate root structure");
+	rc = lzds_zdsroot_add_device(root, l.device, &dasd);
+	if (!rc)
+		rc = lzds_dasd_read_vlabel(dasd);
+	if (!rc)
+		rc = lzds_dasd_alloc_rawvtoc(dasd);
+	if (!rc)
+		rc = lzds_zdsroot_extract_datasets_from_dasd(root, dasd);
+	if (rc) {
+		lzds_zdsroot_get_errorlog(root, &log);
+		lzds_errorlog_fprint(log, stderr);
+		errx(EXIT_FAILURE, "Could not read VTOC of %s: %s", l.device,
+		     strerror(rc));
+	}
+	t_scan = now() - start;
+
+	if (lzds_zdsroot_alloc_dsiterator(root, &it))
+		errx(EXIT_FAILURE, "Could not allocate data set iterator");
+	while (!lzds_dsiterator_get_next_dataset(it, &ds)) {
+		lzds_dataset_get_is_supported(ds, &value);
+		if (!value)
+			continue;
+		start = now();
+		size = read_dataset(ds, buf);
+		t_read += now() - start;
+		total += size;
+		datasets++;
+		lzds_dataset_get_is_PDS(ds, &value);
+		if (value || !size || !l.seeks)
+			continue;
+		t_seek += seek_dataset(ds, size, buf);
+		seek_datasets++;
+	}
+	lzds_dsiterator_free(it);
+
+	printf("VTOC scan:        %10.3f ms (%u data sets)\n", t_scan * 1e3,
+	       datasets);
+	printf("Sequential read:  %10.1f MB/s (%lld bytes in %.3f s)\n",
+	       t_read > 0 ? total / t_read / 1e6 : 0, total, t_read);
+	if (seek_datasets)
+		printf("Random seek:      %10.1f us (%lu seeks)\n",
+		       t_seek / (seek_datasets * l.seeks) * 1e6,
+		       seek_datasets * l.seeks);
+	lzds_zdsroot_free(root);
+	free(buf);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,575 @@
+/*
+ * zdsimg - Create ECKD DASD image files for libzds and zdsfs benchmarks
+ *
+ * The image contains raw track images of RAWTRACKSIZE bytes per track,
+ * as read from a DASD in raw track access mode. It has a VOL1 label, a
+ * VTOC, and physical sequential (PS) and partitioned (PDS) data sets
+ * with fixed or variable blocked records.
+ *
+ * Copyright IBM Corp. 2026
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lib/libzds.h"
+#include "lib/util_base.h"
+#include "lib/util_libc.h"
+#include "lib/util_opt.h"
+#include "lib/util_prg.h"
+#include "lib/vtoc.h"
+
+#define HEADS		15	/* Tracks per cylinder */
+#define TRACK_CELLS	1729	/* Capacity of a 3390 track in cells */
+#define DSCBS_PER_TRACK	50	/* Format 1 DSCBs per 3390 track */
+#define DIR_ENTRIES	21	/* Member entries per directory block */
+#define DIR_PER_TRACK	46	/* Directory blocks per 3390 track */
+#define RECFM_FB	0x90
+#define RECFM_VB	0x50
+
+static struct {
+	unsigned int ps;
+	unsigned int ps_tracks;
+	unsigned int pds;
+	unsigned int members;
+	unsigned int member_blocks;
+	int recfm;
+	unsigned int lrecl;
+	unsigned int blksize;
+	const char *volser;
+	const char *file;
+	int fd;
+	unsigned long recno;	/* Number of the next logical record */
+} l = {
+	.ps = 4,
+	.ps_tracks = 150,
+	.pds = 1,
+	.members = 100,
+	.member_blocks = 4,
+	.recfm = RECFM_FB,
+	.volser = "BENCH0",
+};
+
+/* Raw track image that is being filled */
+struct track {
+	char *buf;
+	char *pos;		/* Position of the next record */
+	unsigned int trk;	/* Absolute track number */
+	unsigned int rec;	/* Number of the next record */
+	unsigned int cells;	/* Used track capacity */
+};
+
+static struct util_opt opt_vec[] = {
+	UTIL_OPT_SECTION("OPTIONS"),
+	{
+		.option = { "ps", required_argument, NULL, 'p' },
+		.argument = "NUM",
+		.desc = "Number of PS data sets (default 4)",
+	},
+	{
+		.option = { "tracks", required_argument, NULL, 't' },
+		.argument = "NUM",
+		.desc = "Size of each PS data set in tracks (default 150)",
+	},
+	{
+		.option = { "pds", required_argument, NULL, 'o' },
+		.argument = "NUM",
+		.desc = "Number of PDS data sets (default 1)",
+	},
+	{
+		.option = { "members", required_argument, NULL, 'm' },
+		.argument = "NUM",
+		.desc = "Number of members per PDS (default 100)",
+	},
+	{
+		.option = { "member-blocks", required_argument, NULL, 'b' },
+		.argument = "NUM",
+		.desc = "Number of blocks per member (default 4)",
+	},
+	{
+		.option = { "recfm", required_argument, NULL, 'r' },
+		.argument = "FB|VB",
+		.desc = "Record format of all data sets (default FB)",
+	},
+	{
+		.option = { "lrecl", required_argument, NULL, 'l' },
+		.argument = "NUM",
+		.desc = "Logical record length, the maximum for VB "
+			"(default 80 for FB, 255 for VB)",
+	},
+	{
+		.option = { "blksize", required_argument, NULL, 'k' },
+		.argument = "NUM",
+		.desc = "Block size (default 27920 for FB, 27998 for VB)",
+	},
+	{
+		.option = { "volser", required_argument, NULL, 's' },
+		.argument = "VOLSER",
+		.desc = "Volume serial (default BENCH0)",
+	},
+	UTIL_OPT_HELP,
+	UTIL_OPT_VERSION,
+	UTIL_OPT_END
+};
+
+static const struct util_prg prg = {
+	.desc = "Create an ECKD DASD image file with z/OS data sets",
+	.args = "FILE",
+	.copyright_vec = {
+		{
+			.owner = "IBM Corp.",
+			.pub_first = 2026,
+			.pub_last = 2026,
+		},
+		UTIL_PRG_COPYRIGHT_END
+	}
+};
+
+static unsigned int parse_num(const char *arg, const char *name)
+{
+	unsigned long val;
+	char *end;
+
+	errno = 0;
+	val = strtoul(arg, &end, 10);
+	if (errno || *end || arg[0] == '-' || val > 0xffff)
+		errx(EXIT_FAILURE, "Invalid value for %s: %s", name, arg);
+	return val;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = util_opt_getopt_long(argc, argv)) != -1) {
+		switch (opt) {
+		case 'p':
+			l.ps = parse_num(optarg, "--ps");
+			break;
+		case 't':
+			l.ps_tracks = parse_num(optarg, "--tracks");
+			break;
+		case 'o':
+			l.pds = parse_num(optarg, "--pds");
+			break;
+		case 'm':
+			l.members = parse_num(optarg, "--members");
+			break;
+		case 'b':
+			l.member_blocks = parse_num(optarg, "--member-blocks");
+			break;
+		case 'r':
+			if (strcasecmp(optarg, "FB") == 0)
+				l.recfm = RECFM_FB;
+			else if (strcasecmp(optarg, "VB") == 0)
+				l.recfm = RECFM_VB;
+			else
+				errx(EXIT_FAILURE, "Invalid record format: %s",
+				     optarg);
+			break;
+		case 'l':
+			l.lrecl = parse_num(optarg, "--lrecl");
+			break;
+		case 'k':
+			l.blksize = parse_num(optarg, "--blksize");
+			break;
+		case 's':
+			l.volser = optarg;
+			break;
+		case 'h':
+			util_prg_print_help();
+			util_opt_print_help();
+			exit(EXIT_SUCCESS);
+		case 'v':
+			util_prg_print_version();
+			exit(EXIT_SUCCESS);
+		default:
+			util_opt_print_parse_error(opt, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (optind != argc - 1)
+		errx(EXIT_FAILURE, "Specify exactly one image file");
+	l.file = argv[optind];
+
+	if (!l.lrecl)
+		l.lrecl = (l.recfm == RECFM_FB) ? 80 : 255;
+	if (!l.blksize)
+		l.blksize = (l.recfm == RECFM_FB) ? 27920 : 27998;
+	if (l.blksize > 56664)
+		errx(EXIT_FAILURE, "Block size must not exceed 56664");
+	if (l.recfm == RECFM_FB && (!l.lrecl || l.lrecl > l.blksize))
+		errx(EXIT_FAILURE, "Record length must be between 1 and the "
+		     "block size");
+	if (l.recfm == RECFM_VB && (l.lrecl < 16 || l.lrecl + 4 > l.blksize))
+		errx(EXIT_FAILURE, "Record length must be between 16 and the "
+		     "block size - 4");
+	if (l.ps_tracks < 2)
+		errx(EXIT_FAILURE, "PS data sets need at least 2 tracks");
+}
+
+static unsigned int ceil_quot(unsigned int d1, unsigned int d2)
+{
+	return (d1 + (d2 - 1)) / d2;
+}
+
+/*
+ * Return the 3390 track capacity in cells that a record uses, see
+ * recs_per_track() in fdasd
+ */
+static unsigned int rec_cells(unsigned int kl, unsigned int dl)
+{
+	unsigned int cells;
+
+	cells = 10 + 9 + ceil_quot(dl + 6 * (ceil_quot(dl + 6, 232) + 1), 34);
+	if (kl)
+		cells += 9 + ceil_quot(kl + 6 * (ceil_quot(kl + 6, 232) + 1),
+				       34);
+	return cells;
+}
+
+static void trk2cchh(unsigned int trk, cchh_t *cchh)
+{
+	vtoc_set_cchh(cchh, trk / HEADS, trk % HEADS);
+}
+
+static void trk_add(struct track *t, const void *key, unsigned int kl,
+		    const void *data, unsigned int dl)
+{
+	struct eckd_count *ecount = (struct eckd_count *)t->pos;
+
+	vtoc_set_cchhb(&ecount->recid, t->trk / HEADS, t->trk % HEADS,
+		       t->rec);
+	ecount->kl = kl;
+	ecount->dl = dl;
+	t->pos += sizeof(*ecount);
+	if (kl)
+		memcpy(t->pos, key, kl);
+	t->pos += kl;
+	if (dl && data)
+		memcpy(t->pos, data, dl);
+	t->pos += dl;
+	if (t->rec)
+		t->cells += rec_cells(kl, dl);
+	t->rec++;
+}
+
+/*
+ * Start a new track with record zero
+ */
+static void trk_start(struct track *t, unsigned int trk)
+{
+	memset(t->buf, 0, RAWTRACKSIZE);
+	t->pos = t->buf;
+	t->trk = trk;
+	t->rec = 0;
+	t->cells = 0;
+	trk_add(t, NULL, 0, NULL, 8);
+}
+
+static int trk_fits(struct track *t, unsigned int kl, unsigned int dl)
+{
+	if (t->cells + rec_cells(kl, dl) > TRACK_CELLS)
+		return 0;
+	return t->pos + 2 * sizeof(struct eckd_count) + kl + dl <=
+		t->buf + RAWTRACKSIZE;
+}
+
+/*
+ * Terminate the track with the end token and write it to the image
+ */
+static void trk_write(struct track *t)
+{
+	unsigned long long endtoken = ENDTOKEN;
+
+	memcpy(t->pos, &endtoken, sizeof(endtoken));
+	if (pwrite(l.fd, t->buf, RAWTRACKSIZE,
+		   (off_t)t->trk * RAWTRACKSIZE) != RAWTRACKSIZE)
+		err(EXIT_FAILURE, "Could not write %s", l.file);
+}
+
+/*
+ * Write empty tracks up to and including track "last"
+ */
+static void trk_fill(struct track *t, unsigned int last)
+{
+	while (t->trk < last) {
+		trk_start(t, t->trk + 1);
+		trk_write(t);
+	}
+}
+
+/*
+ * Fill logical record with EBCDIC text that contains the record number
+ */
+static void lrec_fill(char *rec, unsigned int len)
+{
+	char text[32];
+	int n;
+
+	memset(rec, 0x40, len);	/* EBCDIC blank */
+	n = snprintf(text, sizeof(text), "RECORD %08lu", l.recno++);
+	vtoc_ebcdic_enc(text, rec, MIN((unsigned int)n, len));
+}
+
+/*
+ * Build the next data block and return its length
+ */
+static unsigned int block_fill(char *block)
+{
+	struct segment_header *bdw, *rdw;
+	unsigned int len, pos;
+
+	if (l.recfm == RECFM_FB) {
+		for (pos = 0; pos + l.lrecl <= l.blksize; pos += l.lrecl)
+			lrec_fill(block + pos, l.lrecl);
+		return pos;
+	}
+	/* VB: block descriptor word followed by records with RDW */
+	pos = sizeof(*bdw);
+	for (;;) {
+		len = l.lrecl / 2 + l.recno % (l.lrecl - l.lrecl / 2 + 1);
+		if (pos + len > l.blksize)
+			break;
+		rdw = (struct segment_header *)(block + pos);
+		memset(rdw, 0, sizeof(*rdw));
+		rdw->length = len;
+		lrec_fill(block + pos + sizeof(*rdw), len - sizeof(*rdw));
+		pos += len;
+	}
+	bdw = (struct segment_header *)block;
+	memset(bdw, 0, sizeof(*bdw));
+	bdw->length = pos;
+	return pos;
+}
+
+/*
+ * Write "count" data blocks and an end-of-file record starting at the
+ * current position of track "t", but not beyond track "last". With
+ * count 0, fill all tracks up to "last". Return the relative track and
+ * the record of the first block in "ttr" if requested.
+ */
+static void data_write(struct track *t, char *block, unsigned int count,
+		       unsigned int first, unsigned int last, ttr_t *ttr)
+{
+	unsigned int len, n = 0;
+
+	for (;;) {
+		len = block_fill(block);
+		if (!trk_fits(t, 0, len) ||
+		    (t->trk == last && !trk_fits(t, 0, 2 * len))) {
+			if (t->trk == last)
+				break;
+			trk_write(t);
+			trk_start(t, t->trk + 1);
+		}
+		if (ttr && n == 0) {
+			ttr->tt = t->trk - first;
+			ttr->r = t->rec;
+		}
+		trk_add(t, NULL, 0, block, len);
+		if (++n == count)
+			break;
+	}
+	if (!trk_fits(t, 0, 0)) {
+		trk_write(t);
+		trk_start(t, t->trk + 1);
+	}
+	trk_add(t, NULL, 0, NULL, 0);
+}
+
+static void dsname_set(format1_label_t *f1, const char *name)
+{
+	char str[45];
+
+	snprintf(str, sizeof(str), "%-44s", name);
+	vtoc_ebcdic_enc(str, f1->DS1DSNAM, 44);
+}
+
+static void f1_init(format1_label_t *f1, const char *name, int dsorg,
+		    unsigned int first, unsigned int last)
+{
+	cchh_t lower, upper;
+	extent_t ext;
+	char volser[7];
+
+	trk2cchh(first, &lower);
+	trk2cchh(last, &upper);
+	vtoc_set_extent(&ext, 0x01, 0, &lower, &upper);
+	vtoc_init_format1_label(l.blksize, &ext, f1);
+	dsname_set(f1, name);
+	snprintf(volser, sizeof(volser), "%-6s", l.volser);
+	vtoc_ebcdic_enc(volser, (char *)f1->DS1DSSN, 6);
+	f1->DS1DSIND = 0x80;	/* Last volume of the data set */
+	f1->DS1DSRG1 = dsorg;
+	f1->DS1RECFM = l.recfm;
+	f1->DS1LRECL = l.lrecl;
+	f1->DS1BLKL = l.blksize;
+}
+
+static void member_name(char *name, unsigned int i)
+{
+	char str[16];
+
+	snprintf(str, sizeof(str), "MEM%05u", i % 100000);
+	vtoc_ebcdic_enc(str, name, 8);
+}
+
+/*
+ * Write a PDS with members to tracks first to last. The directory is
+ * written after the members, because it contains their start addresses.
+ */
+static void pds_write(struct track *t, char *block, unsigned int first,
+		      unsigned int last, unsigned int dir_tracks)
+{
+	unsigned int i, j, dir_blocks, used;
+	struct pds_member_entry *entry;
+	char key[8], dir[PDS_DIR_DL];
+	ttr_t *ttr;
+
+	ttr = util_malloc(l.members * sizeof(*ttr));
+	trk_start(t, first + dir_tracks);
+	for (i = 0; i < l.members; i++)
+		data_write(t, block, l.member_blocks, first, last, &ttr[i]);
+	trk_write(t);
+	trk_fill(t, last);
+
+	dir_blocks = ceil_quot(l.members + 1, DIR_ENTRIES);
+	trk_start(t, first);
+	for (i = 0, j = 0; j < dir_blocks; j++) {
+		memset(dir, 0, sizeof(dir));
+		used = sizeof(unsigned short);
+		for (; i < l.members && used + sizeof(*entry) <= sizeof(dir);
+		     i++) {
+			entry = (struct pds_member_entry *)(dir + used);
+			member_name(entry->name, i);
+			entry->track = ttr[i].tt;
+			entry->record = ttr[i].r;
+			memcpy(key, entry->name, sizeof(key));
+			used += sizeof(*entry);
+		}
+		if (j == dir_blocks - 1) {
+			/* The last block ends with the end entry */
+			memset(dir + used, 0xff, 8);
+			memset(key, 0xff, sizeof(key));
+			used += sizeof(*entry);
+		}
+		*(unsigned short *)dir = used;
+		if (!trk_fits(t, PDS_DIR_KL, PDS_DIR_DL)) {
+			trk_write(t);
+			trk_start(t, t->trk + 1);
+		}
+		trk_add(t, key, PDS_DIR_KL, dir, PDS_DIR_DL);
+	}
+	trk_write(t);
+	free(ttr);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int vtoc_tracks, dir_tracks, pds_tracks, next, cyls, i;
+	unsigned int datasets, blocks_per_track;
+	format1_label_t *f1;
+	format4_label_t f4;
+	volume_label_t vl;
+	struct track t;
+	cchh_t lower, upper;
+	char name[45], *block;
+
+	util_prg_init(&prg);
+	util_opt_init(opt_vec, NULL);
+	parse_args(argc, argv);
+
+	/* Compute the layout: VTOC from track 1, data sets from cylinder 1 */
+	datasets = l.ps + l.pds;
+	vtoc_tracks = ceil_quot(datasets + 1, DSCBS_PER_TRACK);
+	dir_tracks = ceil_quot(ceil_quot(l.members + 1, DIR_ENTRIES),
+			       DIR_PER_TRACK);
+	blocks_per_track = TRACK_CELLS / rec_cells(0, l.blksize);
+	if (!blocks_per_track)
+		errx(EXIT_FAILURE, "Block size too large");
+	/* Each member needs an extra end-of-file record */
+	pds_tracks = dir_tracks + 1 +
+		ceil_quot(l.members * (l.member_blocks + 1),
+			  blocks_per_track - 1);
+	next = ceil_quot(1 + vtoc_tracks, HEADS) * HEADS;
+	cyls = ceil_quot(next + l.ps * l.ps_tracks + l.pds * pds_tracks,
+			 HEADS);
+
+	l.fd = open(l.file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (l.fd < 0)
+		err(EXIT_FAILURE, "Could not open %s", l.file);
+	if (ftruncate(l.fd, (off_t)cyls * HEADS * RAWTRACKSIZE))
+		err(EXIT_FAILURE, "Could not set size of %s", l.file);
+	t.buf = util_malloc(RAWTRACKSIZE);
+	block = util_malloc(l.blksize);
+	f1 = util_zalloc((datasets + 1) * sizeof(*f1));
+
+	/* Data sets */
+	for (i = 0; i < l.ps; i++) {
+		snprintf(name, sizeof(name), "BENCH.PS%04u", i);
+		f1_init(&f1[i], name, 0x40, next, next + l.ps_tracks - 1);
+		trk_start(&t, next);
+		data_write(&t, block, 0, next, next + l.ps_tracks - 1, NULL);
+		trk_write(&t);
+		trk_fill(&t, next + l.ps_tracks - 1);
+		next += l.ps_tracks;
+	}
+	for (i = 0; i < l.pds; i++) {
+		snprintf(name, sizeof(name), "BENCH.PDS%04u", i);
+		f1_init(&f1[l.ps + i], name, 0x02, next,
+			next + pds_tracks - 1);
+		pds_write(&t, block, next, next + pds_tracks - 1, dir_tracks);
+		next += pds_tracks;
+	}
+
+	/* Track 0 with IPL records and volume label */
+	vtoc_volume_label_init(&vl);
+	vtoc_volume_label_set_key(&vl, "VOL1");
+	vtoc_volume_label_set_label(&vl, "VOL1");
+	vtoc_volume_label_set_volser(&vl, (char *)l.volser);
+	vtoc_set_cchhb(&vl.vtoc, VTOC_START_CC, VTOC_START_HH, 0x01);
+	memset(block, 0, 144);
+	trk_start(&t, 0);
+	trk_add(&t, block, 4, block, 24);
+	trk_add(&t, block, 4, block, 144);
+	trk_add(&t, &vl, 4, (char *)&vl + 4, 80);
+	trk_write(&t);
+
+	/* VTOC with format 4 DSCB, format 1 DSCBs and empty DSCBs */
+	memset(&f4, 0, sizeof(f4));
+	vtoc_init_format4_label(&f4, cyls, cyls, HEADS, DSCBS_PER_TRACK,
+				4096, DASD_3390_TYPE);
+	lower.cc = VTOC_START_CC;
+	lower.hh = VTOC_START_HH;
+	trk2cchh(vtoc_tracks, &upper);
+	vtoc_set_extent(&f4.DS4VTOCE, 0x01, 0x00, &lower, &upper);
+	trk_start(&t, 1);
+	trk_add(&t, &f4, 44, f4.DS4KEYCD + 44, sizeof(f4) - 44);
+	for (i = 0; i < vtoc_tracks * DSCBS_PER_TRACK - 1; i++) {
+		if (t.rec > DSCBS_PER_TRACK) {
+			trk_write(&t);
+			trk_start(&t, t.trk + 1);
+		}
+		trk_add(&t, &f1[MIN(i, datasets)], 44,
+			(char *)&f1[MIN(i, datasets)] + 44, sizeof(*f1) - 44);
+	}
+	trk_write(&t);
+
+	if (close(l.fd))
+		err(EXIT_FAILURE, "Could not write %s", l.file);
+	printf("%s: %u cylinders, %u PS data sets, %u PDS with %u members\n",
+	       l.file, cyls, l.ps, l.pds, l.members);
+	free(f1);
+	free(block);
+	free(t.buf);
+	return EXIT_SUCCESS;
+}
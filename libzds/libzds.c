@@ -12,13 +12,17 @@
  * it under the terms of the MIT license. See LICENSE for details.
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <linux/types.h>
 #include <malloc.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #ifdef HAVE_CURL
 #include <curl/curl.h>
 #endif /* HAVE_CURL */
@@ -28,6 +32,7 @@
 #include "lib/dasd_sys.h"
 #include "lib/libzds.h"
 #include "lib/vtoc.h"
+#include "lib/zt_probe.h"
 
 /** @cond PRIVATE */
 
@@ -109,6 +114,9 @@ struct pdsmember {
 	/** @brief Marks if pdsmember is an alias (we make no distinction
 	 *  between a regular member and an alias). */
 	unsigned char is_alias;
+	/** @brief Next member in the same bucket of the member hash of the
+	 *  data set */
+	struct pdsmember *hashnext;
 	/** @brief Detailed error messages in case of a problem */
 	struct errorlog *log;
 };
@@ -166,6 +174,15 @@ struct dataset {
 	/** @brief If a data set is a partitioned data set (PDS), then this
 	 *  contains a list of members, otherwise the list is empty */
 	struct util_list *memberlist;
+	/** @brief Hash buckets for member lookup by name */
+	struct pdsmember **memberhash;
+	/** @brief Number of hash buckets, 0 or a power of 2 */
+	unsigned int memberhashsize;
+	/** @brief Number of members in the member hash */
+	unsigned int membercount;
+	/** @brief Next data set in the same bucket of the data set hash of the
+	 *  zdsroot */
+	struct dataset *hashnext;
 	/** @brief Detailed error messages in case of a problem */
 	struct errorlog *log;
 };
@@ -191,11 +208,86 @@ struct dasditerator {
 	struct dasd *dasdi;
 };
 
+/**
+ * @brief An internal structure that holds one cached raw track image.
+ */
+struct cachedtrack {
+	/** @brief List head to store the track in the LRU list of the cache */
+	struct util_list_node list;
+	/** @brief Next track in the same hash bucket */
+	struct cachedtrack *hashnext;
+	/** @brief The DASD the track has been read from */
+	struct dasd *dasd;
+	/** @brief Track number on the DASD */
+	unsigned int track;
+	/** @brief The raw track image */
+	char *data;
+};
+
+/**
+ * @brief A cache of raw track images that is shared by all dshandles.
+ *
+ * Tracks are evicted in least recently used order. The most recently used
+ * track is at the head of the LRU list.
+ */
+struct trackcache {
+	/** @brief Serializes access from concurrent dshandles */
+	pthread_mutex_t mutex;
+	/** @brief Maximum number of cached tracks */
+	unsigned int maxtracks;
+	/** @brief Number of currently cached tracks */
+	unsigned int numtracks;
+	/** @brief Number of hash buckets, a power of 2 */
+	unsigned int hashsize;
+	/** @brief Hash buckets for track lookup */
+	struct cachedtrack **hash;
+	/** @brief LRU list of all cached tracks */
+	struct util_list *lru;
+};
+
+/**
+ * @brief An internal structure that holds the member list of a PDS, as
+ * read from a member cache file.
+ */
+struct cachedpds {
+	/** @brief Next entry in the same hash bucket */
+	struct cachedpds *hashnext;
+	/** @brief Hash of the volume serial and the format 1 DSCB of the PDS */
+	unsigned long long key;
+	/** @brief Data set name */
+	char name[MAXDSNAMELENGTH];
+	/** @brief Number of elements in the member array */
+	unsigned int count;
+	/** @brief Members in PDS directory order */
+	struct pdsmember *member;
+};
+
+/**
+ * @brief A cache of PDS member lists that is used to avoid reading the
+ * PDS directories when the data sets are scanned.
+ */
+struct membercache {
+	/** @brief Number of hash buckets, a power of 2 */
+	unsigned int hashsize;
+	/** @brief Hash buckets for PDS lookup */
+	struct cachedpds **hash;
+};
+
 struct zdsroot {
 	/** @brief list of dasds */
 	struct util_list *dasdlist;
 	/** @brief list of data sets */
 	struct util_list *datasetlist;
+	/** @brief Hash buckets for data set lookup by name */
+	struct dataset **dshash;
+	/** @brief Number of hash buckets, 0 or a power of 2 */
+	unsigned int dshashsize;
+	/** @brief Number of data sets in the data set hash */
+	unsigned int dscount;
+	/** @brief Shared raw track cache, NULL if disabled */
+	struct trackcache *trackcache;
+	/** @brief PDS member lists read from a cache file, NULL if none */
+	struct membercache *membercache;
 	/** @brief Detailed error messages in case of a problem */
 	struct errorlog *log;
 };
@@ -219,6 +311,51 @@ struct seekelement {
  */
 #define TRACK_BUFFER_DEFAULT 128
 
+/**
+ * @brief States of a read ahead request
+ */
+enum readahead_state {
+	/** @brief No read ahead request is outstanding */
+	READAHEAD_IDLE,
+	/** @brief The read ahead thread has been asked to read a track frame */
+	READAHEAD_PENDING,
+	/** @brief The requested track frame has been read */
+	READAHEAD_DONE,
+};
+
+/**
+ * @brief Internal structure for reading the next track frame of a dshandle
+ *        in a separate thread while the current frame is processed.
+ */
+struct readahead {
+	/** @brief The read ahead thread */
+	pthread_t thread;
+	/** @brief Flag that is set while the thread is running */
+	int running;
+	/** @brief Flag that tells the thread to terminate */
+	int stop;
+	/** @brief Protects all following fields */
+	pthread_mutex_t mutex;
+	/** @brief Signals changes of state and stop */
+	pthread_cond_t cond;
+	/** @brief Current state of the read ahead request */
+	enum readahead_state state;
+	/** @brief Result of the last read ahead request */
+	int rc;
+	/** @brief Data set part of the requested track frame */
+	int dsp_no;
+	/** @brief First track of the requested track frame */
+	unsigned int bufstarttrk;
+	/** @brief Last track of the requested track frame */
+	unsigned int bufendtrk;
+	/** @brief Track buffer that is swapped with the rawbuffer of the
+	 *  dshandle when the requested frame is used */
+	char *buffer;
+	/** @brief Separate dasdhandles, one per data set part, so that the
+	 *  thread does not interfere with the dasdhandles of the dshandle */
+	struct dasdhandle *dasdhandle[MAXVOLUMESPERDS];
+};
+
 struct dshandle {
 	/** @brief Data set this context relates to */
 	struct dataset *ds;
@@ -303,6 +440,23 @@ struct dshandle {
 	 *  Example: If skip is 2, then every 2'nd frame is stored.
 	 */
 	unsigned long long skip;
+
+	/** @brief Dense seek index: Data offset of each track, indexed by the
+	 *  track number relative to the begin of the data set. This is used
+	 *  instead of seekbuf if the seek buffer is large enough to hold one
+	 *  entry per track. NULL otherwise. */
+	long long *trackoffset;
+	/** @brief Total number of elements in trackoffset */
+	unsigned long long trackoffset_count;
+	/** @brief First valid element in trackoffset */
+	unsigned long long trackoffset_first;
+	/** @brief Element after the last valid element in trackoffset */
+	unsigned long long trackoffset_next;
+	/** @brief Relative track number of the first track in the rawbuffer */
+	unsigned long long frame_reltrk;
+
+	/** @brief Read ahead context, NULL if read ahead is disabled */
+	struct readahead *readahead;
 	/** @brief Detailed error messages in case of a problem */
 	struct errorlog *log;
 
@@ -317,6 +471,10 @@ struct dshandle {
 /******************************************************************************/
 
 static void dasd_free(struct dasd *dasd);
+static void dasd_free_scanned_datasets(struct dasd *dasd);
+static void trackcache_free(struct trackcache *cache);
+static void membercache_free(struct membercache *cache);
+static void readahead_free(struct readahead *ra);
 static void dataset_free_memberlist(struct dataset *ds);
 static void errorlog_free(struct errorlog *log);
 static void errorlog_clear(struct errorlog *log);
@@ -330,6 +488,168 @@ static int errorlog_add_message(struct errorlog **log,
 
 
 
+/* Prime and offset basis of the 64 bit FNV-1a hash function */
+#define FNV_PRIME	0x100000001b3ULL
+#define FNV_INIT	0xcbf29ce484222325ULL
+
+/**
+ * @brief Helper function that continues a FNV-1a hash with @a len bytes
+ *        at @a addr.
+ */
+static unsigned long long fnv1a(unsigned long long hash, const void *addr,
+				size_t len)
+{
+	const unsigned char *c = addr;
+
+	while (len-- > 0) {
+		hash ^= *c++;
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/* Initial number of hash buckets for data set and member lookup */
+#define NAMEHASH_INIT_SIZE	64
+
+/**
+ * @brief Helper function that returns the hash bucket for @a name in a
+ *        hash table with @a size buckets.
+ */
+static unsigned int namehash_bucket(const char *name, unsigned int size)
+{
+	return fnv1a(FNV_INIT, name, strlen(name)) & (size - 1);
+}
+
+/**
+ * @brief Helper function that returns the data set with the given name
+ *        from the data set hash of the zdsroot, or NULL if there is none.
+ */
+static struct dataset *zdsroot_lookup_dataset(struct zdsroot *root,
+					      const char *name)
+{
+	struct dataset *ds;
+
+	if (!root->dshashsize)
+		return NULL;
+	for (ds = root->dshash[namehash_bucket(name, root->dshashsize)]; ds;
+	     ds = ds->hashnext)
+		if (!strcmp(ds->name, name))
+			return ds;
+	return NULL;
+}
+
+/**
+ * @brief Adds a data set to the data set hash of the zdsroot.
+ *
+ * The hash table grows when the number of data sets exceeds the number of
+ * buckets. If a data set with the same name is already in the hash, the
+ * new data set is not added, so lookups return the first one, like a search
+ * through the data set list does.
+ *
+ * @param[in] root  The zdsroot that holds the data set hash.
+ * @param[in] ds    The data set that is to be added.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - ENOMEM  Could not allocate structure due to lack of memory.
+ */
+static int zdsroot_hash_dataset(struct zdsroot *root, struct dataset *ds)
+{
+	struct dataset **hash, *tmpds, *nextds;
+	unsigned int size, i, bucket;
+
+	if (zdsroot_lookup_dataset(root, ds->name))
+		return 0;
+	if (root->dscount >= root->dshashsize) {
+		size = root->dshashsize ? root->dshashsize * 2 :
+			NAMEHASH_INIT_SIZE;
+		hash = malloc(size * sizeof(*hash));
+		if (!hash)
+			return ENOMEM;
+		memset(hash, 0, size * sizeof(*hash));
+		for (i = 0; i < root->dshashsize; ++i) {
+			for (tmpds = root->dshash[i]; tmpds; tmpds = nextds) {
+				nextds = tmpds->hashnext;
+				bucket = namehash_bucket(tmpds->name, size);
+				tmpds->hashnext = hash[bucket];
+				hash[bucket] = tmpds;
+			}
+		}
+		free(root->dshash);
+		root->dshash = hash;
+		root->dshashsize = size;
+	}
+	bucket = namehash_bucket(ds->name, root->dshashsize);
+	ds->hashnext = root->dshash[bucket];
+	root->dshash[bucket] = ds;
+	root->dscount++;
+	return 0;
+}
+
+/**
+ * @brief Helper function that returns the member with the given name from
+ *        the member hash of the data set, or NULL if there is none.
+ */
+static struct pdsmember *dataset_lookup_member(struct dataset *ds,
+					       const char *name)
+{
+	struct pdsmember *member;
+
+	if (!ds->memberhashsize)
+		return NULL;
+	for (member = ds->memberhash[namehash_bucket(name,
+						     ds->memberhashsize)];
+	     member; member = member->hashnext)
+		if (!strcmp(member->name, name))
+			return member;
+	return NULL;
+}
+
+/**
+ * @brief Adds a member to the member list and the member hash of a data set.
+ *
+ * Works like zdsroot_hash_dataset, but for the members of a PDS.
+ *
+ * @param[in] ds      The data set that the member is added to.
+ * @param[in] member  The member that is to be added.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - ENOMEM  Could not allocate structure due to lack of memory.
+ */
+static int dataset_add_member_to_list(struct dataset *ds,
+				      struct pdsmember *member)
+{
+	struct pdsmember **hash, *tmpmember, *nextmember;
+	unsigned int size, i, bucket;
+
+	if (dataset_lookup_member(ds, member->name))
+		goto out;
+	if (ds->membercount >= ds->memberhashsize) {
+		size = ds->memberhashsize ? ds->memberhashsize * 2 :
+			NAMEHASH_INIT_SIZE;
+		hash = malloc(size * sizeof(*hash));
+		if (!hash)
+			return ENOMEM;
+		memset(hash, 0, size * sizeof(*hash));
+		for (i = 0; i < ds->memberhashsize; ++i) {
+			for (tmpmember = ds->memberhash[i]; tmpmember;
+			     tmpmember = nextmember) {
+				nextmember = tmpmember->hashnext;
+				bucket = namehash_bucket(tmpmember->name, size);
+				tmpmember->hashnext = hash[bucket];
+				hash[bucket] = tmpmember;
+			}
+		}
+		free(ds->memberhash);
+		ds->memberhash = hash;
+		ds->memberhashsize = size;
+	}
+	bucket = namehash_bucket(member->name, ds->memberhashsize);
+	member->hashnext = ds->memberhash[bucket];
+	ds->memberhash[bucket] = member;
+	ds->membercount++;
+out:
+	util_list_add_tail(ds->memberlist, member);
+	return 0;
+}
+
 /**
  * Since the zdsroot is the root for all the other data structures,
  * this should be one of the first functions to call.
@@ -377,6 +697,10 @@ void lzds_dslist_free(struct zdsroot *root)
 		errorlog_free(ds->log);
 		free(ds);
 	}
+	free(root->dshash);
+	root->dshash = NULL;
+	root->dshashsize = 0;
+	root->dscount = 0;
 }
 
 /**
@@ -400,10 +724,80 @@ void lzds_zdsroot_free(struct zdsroot *root)
 	util_list_free(root->dasdlist);
 	lzds_dslist_free(root);
 	util_list_free(root->datasetlist);
+	trackcache_free(root->trackcache);
+	membercache_free(root->membercache);
 	errorlog_free(root->log);
 	free(root);
 }
 
+/**
+ * @brief Subroutine of lzds_zdsroot_free and lzds_zdsroot_set_track_cache.
+ *        Frees the track cache and all cached tracks.
+ *
+ * @param[in] cache Pointer to the track cache that is to be freed.
+ */
+static void trackcache_free(struct trackcache *cache)
+{
+	struct cachedtrack *ct, *nextct;
+
+	if (!cache)
+		return;
+	util_list_iterate_safe(cache->lru, ct, nextct) {
+		util_list_remove(cache->lru, ct);
+		free(ct->data);
+		free(ct);
+	}
+	util_list_free(cache->lru);
+	pthread_mutex_destroy(&cache->mutex);
+	free(cache->hash);
+	free(cache);
+}
+
+/**
+ * All dshandles of data sets on DASDs in this root share one cache of raw
+ * track images. When several dshandles read the same tracks, for example
+ * when the same data set is opened more than once, only the first read
+ * operation needs to access the device. The memory for a cached track is
+ * allocated when the track is first read, so the cache does not use more
+ * memory than needed for the tracks that have actually been read.
+ *
+ * @note The cache size must not be changed while any dshandle is reading.
+ *
+ * @param[in] root   Reference to the zdsroot structure.
+ * @param[in] tracks Maximum number of raw tracks (RAWTRACKSIZE bytes each)
+ *                   that are kept in the cache. 0 disables the cache.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - ENOMEM  Could not allocate structure due to lack of memory.
+ */
+int lzds_zdsroot_set_track_cache(struct zdsroot *root, unsigned int tracks)
+{
+	struct trackcache *cache;
+
+	trackcache_free(root->trackcache);
+	root->trackcache = NULL;
+	if (!tracks)
+		return 0;
+
+	cache = malloc(sizeof(*cache));
+	if (!cache)
+		return ENOMEM;
+	memset(cache, 0, sizeof(*cache));
+	cache->maxtracks = tracks;
+	cache->hashsize = 1;
+	while (cache->hashsize < tracks && cache->hashsize < (1U << 20))
+		cache->hashsize <<= 1;
+	cache->hash = calloc(cache->hashsize, sizeof(*cache->hash));
+	if (!cache->hash) {
+		free(cache);
+		return ENOMEM;
+	}
+	cache->lru = util_list_new(struct cachedtrack, list);
+	pthread_mutex_init(&cache->mutex, NULL);
+	root->trackcache = cache;
+
+	return 0;
+}
+
 /**
  * @brief Subroutine of lzds_zdsroot_add_device
  *
@@ -418,14 +812,23 @@ void lzds_zdsroot_free(struct zdsroot *root)
 static int dasd_read_geometry(struct dasd *dasd)
 {
 	unsigned long long size_in_bytes;
+	struct stat sb;
 
 	errorlog_clear(dasd->log);
 
-	if (dasd_get_blocksize_in_bytes(dasd->device, &size_in_bytes) != 0)
+	/* A regular file is treated as image of a DASD in raw track
+	 * access format, with RAWTRACKSIZE bytes per track.
+	 */
+	if (!fstat(dasd->inusefd, &sb) && S_ISREG(sb.st_mode)) {
+		dasd->is_image = 1;
+		size_in_bytes = sb.st_size;
+	} else if (dasd_get_blocksize_in_bytes(dasd->device,
+					       &size_in_bytes) != 0) {
 		return errorlog_add_message(
 			&dasd->log, NULL, EIO,
 			"read geometry: could not get size from device %s\n",
 			dasd->device);
+	}
 
 	/* label_block and heads are simply hard coded with the correct values
 	 * for ECKD DASDs. This makes us independent from any DASD specific
@@ -500,6 +903,7 @@ int lzds_zdsroot_add_device(struct zdsroot *root, const char *devnode,
 		return ENOMEM;
 	memset(dasdtmp, 0, sizeof(*dasdtmp));
 	dasdtmp->device = strdup(devnode);
+	dasdtmp->root = root;
 	dasdtmp->inusefd = open(dasdtmp->device, O_RDONLY);
 	if (dasdtmp->inusefd < 0) {
 		errorlog_add_message(
@@ -543,6 +947,7 @@ void lzds_dasd_get_errorlog(struct dasd *dasd, struct errorlog **log)
  */
 static void dasd_free(struct dasd *dasd)
 {
+	dasd_free_scanned_datasets(dasd);
 	free(dasd->device);
 	free(dasd->vlabel);
 	if (dasd->rawvtoc) {
@@ -880,6 +1285,16 @@ void lzds_dasd_get_heads(struct dasd *dasd, unsigned int *heads)
 	*heads = dasd->heads;
 }
 
+/**
+ * @param[in]  dasd      The DASD that is checked
+ * @param[out] is_image  1 (true) if the DASD is an image file,
+ *                       0 (false) if it is a device
+ */
+void lzds_dasd_get_is_image(struct dasd *dasd, int *is_image)
+{
+	*is_image = dasd->is_image;
+}
+
 /**
  * @param[in] dasd Reference to struct dasd that represents
  *                 the DASD that we want to read from.
@@ -956,21 +1371,12 @@ int lzds_dasdhandle_close(struct dasdhandle *dasdh)
 }
 
 /**
- * @param[in]  dasdh The dasdhandle we are reading from
- * @param[in]  starttrck First track to read
- * @param[in]  endtrck Last track to read
- * @param[out] trackdata Target buffer we read into, must have at least the
- *                       size (endtrk - starttrk + 1) * RAWTRACKSIZE
- * @return     0 on success, otherwise one of the following error codes:
- *   - EINVAL  starttrck or endtrck are not within the boundaries of the
- *             underlying DASD device.
- *   - EPROTO  Could not read a full track image
- *   - EIO     Other I/O error
+ * @brief Subroutine of lzds_dasdhandle_read_tracks_to_buffer
  */
-int lzds_dasdhandle_read_tracks_to_buffer(struct dasdhandle *dasdh,
-					  unsigned int starttrck,
-					  unsigned int endtrck,
-					  char *trackdata)
+static int dasdhandle_read_tracks(struct dasdhandle *dasdh,
+				  unsigned int starttrck,
+				  unsigned int endtrck,
+				  char *trackdata)
 {
 	off_t trckseek;
 	ssize_t residual;
@@ -1027,6 +1433,183 @@ int lzds_dasdhandle_read_tracks_to_buffer(struct dasdhandle *dasdh,
 	return 0;
 }
 
+/**
+ * All raw track reads from a DASD go through this function. The USDT
+ * probes libzds:read_tracks and libzds:read_tracks_done report the
+ * track range and, on completion, the return code.
+ *
+ * @param[in]  dasdh The dasdhandle we are reading from
+ * @param[in]  starttrck First track to read
+ * @param[in]  endtrck Last track to read
+ * @param[out] trackdata Target buffer we read into, must have at least the
+ *                       size (endtrk - starttrk + 1) * RAWTRACKSIZE
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - EINVAL  starttrck or endtrck are not within the boundaries of the
+ *             underlying DASD device.
+ *   - EPROTO  Could not read a full track image
+ *   - EIO     Other I/O error
+ */
+int lzds_dasdhandle_read_tracks_to_buffer(struct dasdhandle *dasdh,
+					  unsigned int starttrck,
+					  unsigned int endtrck,
+					  char *trackdata)
+{
+	int rc;
+
+	ZT_PROBE(libzds, read_tracks, starttrck, endtrck);
+	rc = dasdhandle_read_tracks(dasdh, starttrck, endtrck, trackdata);
+	ZT_PROBE(libzds, read_tracks_done, starttrck, endtrck, rc);
+	return rc;
+}
+
+
+/**
+ * @brief Subroutine of dasdhandle_read_tracks_cached
+ *
+ * @param[in]  cache  The track cache, the cache mutex must be held.
+ * @param[in]  dasd   The DASD the track belongs to.
+ * @param[in]  track  The track number on the DASD.
+ * @return     Pointer to the hash bucket for the given track.
+ */
+static struct cachedtrack **trackcache_bucket(struct trackcache *cache,
+					      struct dasd *dasd,
+					      unsigned int track)
+{
+	unsigned long hash;
+
+	hash = ((unsigned long)dasd >> 4) * 31 + track;
+	return &cache->hash[hash & (cache->hashsize - 1)];
+}
+
+/**
+ * @brief Subroutine of dasdhandle_read_tracks_cached
+ *
+ * @param[in]  cache  The track cache, the cache mutex must be held.
+ * @param[in]  dasd   The DASD the track belongs to.
+ * @param[in]  track  The track number on the DASD.
+ * @return     Pointer to the cached track or NULL if it is not cached.
+ */
+static struct cachedtrack *trackcache_lookup(struct trackcache *cache,
+					     struct dasd *dasd,
+					     unsigned int track)
+{
+	struct cachedtrack *ct;
+
+	for (ct = *trackcache_bucket(cache, dasd, track); ct; ct = ct->hashnext)
+		if (ct->dasd == dasd && ct->track == track)
+			return ct;
+	return NULL;
+}
+
+/**
+ * @brief Subroutine of dasdhandle_read_tracks_cached
+ *
+ * Add a copy of a raw track image to the cache. If the cache is full, the
+ * least recently used track is replaced. Since the cache is only an
+ * optimization, a failed memory allocation is silently ignored.
+ *
+ * @param[in]  cache  The track cache, the cache mutex must be held.
+ * @param[in]  dasd   The DASD the track belongs to.
+ * @param[in]  track  The track number on the DASD.
+ * @param[in]  data   The raw track image.
+ */
+static void trackcache_insert(struct trackcache *cache, struct dasd *dasd,
+			      unsigned int track, char *data)
+{
+	struct cachedtrack *ct, **pp;
+
+	/* another dshandle may have added the track in the meantime */
+	if (trackcache_lookup(cache, dasd, track))
+		return;
+	if (cache->numtracks < cache->maxtracks) {
+		ct = malloc(sizeof(*ct));
+		if (!ct)
+			return;
+		memset(ct, 0, sizeof(*ct));
+		ct->data = malloc(RAWTRACKSIZE);
+		if (!ct->data) {
+			free(ct);
+			return;
+		}
+		cache->numtracks++;
+	} else {
+		ct = util_list_end(cache->lru);
+		util_list_remove(cache->lru, ct);
+		pp = trackcache_bucket(cache, ct->dasd, ct->track);
+		while (*pp != ct)
+			pp = &(*pp)->hashnext;
+		*pp = ct->hashnext;
+	}
+	ct->dasd = dasd;
+	ct->track = track;
+	memcpy(ct->data, data, RAWTRACKSIZE);
+	pp = trackcache_bucket(cache, dasd, track);
+	ct->hashnext = *pp;
+	*pp = ct;
+	util_list_add_head(cache->lru, ct);
+}
+
+/**
+ * @brief Read tracks through the track cache of the zdsroot
+ *
+ * Works like lzds_dasdhandle_read_tracks_to_buffer, but if the zdsroot
+ * has a track cache, tracks are taken from the cache where possible and
+ * only the remaining tracks are read from the device.
+ *
+ * @param[in]  dasdh The dasdhandle we are reading from
+ * @param[in]  starttrck First track to read
+ * @param[in]  endtrck Last track to read
+ * @param[out] trackdata Target buffer we read into, must have at least the
+ *                       size (endtrk - starttrk + 1) * RAWTRACKSIZE
+ * @return     0 on success, otherwise one of the error codes of
+ *             lzds_dasdhandle_read_tracks_to_buffer.
+ */
+static int dasdhandle_read_tracks_cached(struct dasdhandle *dasdh,
+					 unsigned int starttrck,
+					 unsigned int endtrck,
+					 char *trackdata)
+{
+	struct trackcache *cache;
+	struct cachedtrack *ct;
+	unsigned int trk, missend;
+	char *data;
+	int rc;
+
+	cache = dasdh->dasd->root ? dasdh->dasd->root->trackcache : NULL;
+	if (!cache)
+		return lzds_dasdhandle_read_tracks_to_buffer(
+			dasdh, starttrck, endtrck, trackdata);
+
+	trk = starttrck;
+	while (trk <= endtrck) {
+		data = trackdata + (size_t)(trk - starttrck) * RAWTRACKSIZE;
+		pthread_mutex_lock(&cache->mutex);
+		ct = trackcache_lookup(cache, dasdh->dasd, trk);
+		if (ct) {
+			util_list_remove(cache->lru, ct);
+			util_list_add_head(cache->lru, ct);
+			memcpy(data, ct->data, RAWTRACKSIZE);
+			pthread_mutex_unlock(&cache->mutex);
+			trk++;
+			continue;
+		}
+		/* read all adjacent tracks that are not cached at once */
+		missend = trk;
+		while (missend < endtrck &&
+		       !trackcache_lookup(cache, dasdh->dasd, missend + 1))
+			missend++;
+		pthread_mutex_unlock(&cache->mutex);
+		rc = lzds_dasdhandle_read_tracks_to_buffer(dasdh, trk, missend,
+							   data);
+		if (rc)
+			return rc;
+		pthread_mutex_lock(&cache->mutex);
+		for (; trk <= missend; trk++, data += RAWTRACKSIZE)
+			trackcache_insert(cache, dasdh->dasd, trk, data);
+		pthread_mutex_unlock(&cache->mutex);
+	}
+	return 0;
+}
 
 /******************************************************************************/
 /*      MID  level functions                                                  */
@@ -1574,6 +2157,8 @@ int lzds_dasd_alloc_rawvtoc(struct dasd *dasd)
 	struct raw_vtoc *rawvtoc = NULL;
 	int rc;
 
+	/* scanned data sets refer to the old rawvtoc */
+	dasd_free_scanned_datasets(dasd);
 	/* cleanup the old rawvtoc structures before we read new ones */
 	rawvtoc = dasd->rawvtoc;
 	dasd->rawvtoc = NULL;
@@ -1683,28 +2268,13 @@ int lzds_dsiterator_get_next_dataset(struct dsiterator *it, struct dataset **ds)
  *                  structure will be returned. If no data set was found, this
  *                  variable will be set to NULL
  * @return     0 on success, otherwise one of the following error codes:
- *   - ENOMEM  Could not internal structure due to lack of memory.
  *   - ENOENT  A dataset with the given name was not found.
  */
 int lzds_zdsroot_find_dataset(struct zdsroot *root, const char *name,
 			      struct dataset **ds)
 {
-	struct dsiterator *dsit;
-	struct dataset *tempds;
-	int rc;
-
 	errorlog_clear(root->log);
-	*ds = NULL;
-	rc = lzds_zdsroot_alloc_dsiterator(root, &dsit);
-	if (rc)
-		return ENOMEM;
-	while (!lzds_dsiterator_get_next_dataset(dsit, &tempds)) {
-		if (!strcmp(tempds->name, name)) {
-			*ds = tempds;
-			break;
-		}
-	}
-	lzds_dsiterator_free(dsit);
+	*ds = zdsroot_lookup_dataset(root, name);
 	if (!*ds)
 		return ENOENT;
 	return 0;
@@ -1987,7 +2557,10 @@ static int dataset_add_member(struct dataset *ds,
 	member->track = memberentry->track;
 	member->record = memberentry->record;
 	member->is_alias = memberentry->is_alias;
-	util_list_add_tail(ds->memberlist, member);
+	if (dataset_add_member_to_list(ds, member)) {
+		free(member);
+		return ENOMEM;
+	}
 	return 0;
 }
 
@@ -2010,6 +2583,10 @@ static void dataset_free_memberlist(struct dataset *ds)
 	}
 	util_list_free(ds->memberlist);
 	ds->memberlist = NULL;
+	free(ds->memberhash);
+	ds->memberhash = NULL;
+	ds->memberhashsize = 0;
+	ds->membercount = 0;
 }
 
 /**
@@ -2344,6 +2921,10 @@ static int zdsroot_merge_dataset(struct zdsroot *root, struct dataset *newds)
 		if (!rootds)
 			return ENOMEM;
 		memcpy(rootds, newds, sizeof(*rootds));
+		if (zdsroot_hash_dataset(root, rootds)) {
+			free(rootds);
+			return ENOMEM;
+		}
 		util_list_add_tail(root->datasetlist, rootds);
 	} else
 		return rc;
@@ -2351,77 +2932,519 @@ static int zdsroot_merge_dataset(struct zdsroot *root, struct dataset *newds)
 }
 
 /**
- * This function finds all data set descriptions in the VTOC of the
- * dasd and creates respective struct dataset representations. These
- * struct dataset are stored in the zdsroot and can later be traversed
- * using a dsiterator.  In case that it finds a dataset that is
- * already present in the zdsroot, it verifies that both are parts of
- * the same multivolume data set and then merges the new data with the
- * existing struct dataset.  If the conflicting data sets are indeed
- * individual data sets and not parts of a single one, the function
- * returns an error.
+ * @brief Frees a struct dataset that is not part of a zdsroot and
+ *        everything that belongs to it.
  *
- * @param[in]  root    The zdsroot that the dataset will be merged into.
- * @param[in]  dasd    The datasets found in this dasd will be merged.
- * @return     0 on success, otherwise one of the following error codes:
- *   - ENOMEM  Could not allocate structure due to lack of memory.
- *   - EPROTO  The data is not mergable because of conflicting entries,
- *             or invalid data in the VTOC of the dasd.
+ * @param[in] ds Pointer to the struct dataset that is to be freed.
  */
-int lzds_zdsroot_extract_datasets_from_dasd(struct zdsroot *root,
-					    struct dasd *dasd)
+static void dataset_free(struct dataset *ds)
 {
-	format1_label_t *f1;
-	struct dscb *dscb;
-	struct dscbiterator *it;
-	int rc;
-	struct dataset tmpds;
 	int i;
 
-	errorlog_clear(root->log);
-	memset(&tmpds, 0, sizeof(tmpds));
-	rc = lzds_raw_vtoc_alloc_dscbiterator(dasd->rawvtoc, &it);
-	if (rc)
-		return ENOMEM;
-	while (!lzds_dscbiterator_get_next_dscb(it, &dscb)) {
-		if (dscb->fmtid == 0xf1 || dscb->fmtid == 0xf8) {
-			f1 = (format1_label_t *)dscb;
-			rc = create_dataset_from_dscb(dasd, f1, &tmpds);
-			if (rc) {
-				errorlog_add_message(
-					&root->log, dasd->log, rc,
-					"extract data sets: "
-					"creating dataset failed for %s\n",
-					dasd->device);
-				break;
-			}
-			rc = dataset_member_analysis(&tmpds);
-			if (rc) {
-				errorlog_add_message(
-					&root->log, tmpds.log, rc,
-					"extract data sets: "
-					"member analysis failed for %s\n",
-					tmpds.name);
-				break;
-			}
-			rc = zdsroot_merge_dataset(root, &tmpds);
-			if (rc) {
-				errorlog_add_message(
-					&root->log, root->log, rc,
-					"extract data sets: "
-					"merge dataset failed for %s\n",
-					tmpds.name);
-				break;
-			}
+	dataset_free_memberlist(ds);
+	for (i = 0; i < MAXVOLUMESPERDS; ++i)
+		free(ds->dsp[i]);
+	errorlog_free(ds->log);
+	free(ds);
+}
+
+/**
+ * @brief Frees all data sets that have been found by lzds_dasd_scan_datasets
+ *        but have not been added to the zdsroot.
+ *
+ * @param[in] dasd The dasd that holds the list of scanned data sets.
+ */
+static void dasd_free_scanned_datasets(struct dasd *dasd)
+{
+	struct dataset *ds, *nextds;
+
+	if (!dasd->scanned_datasets)
+		return;
+	util_list_iterate_safe(dasd->scanned_datasets, ds, nextds) {
+		util_list_remove(dasd->scanned_datasets, ds);
+		dataset_free(ds);
+	}
+	util_list_free(dasd->scanned_datasets);
+	dasd->scanned_datasets = NULL;
+}
+
+/**
+ * @brief Subroutine of the member cache functions.
+ *
+ * The member list of a PDS is identified by the volume serial and by the
+ * complete format 1 DSCB of the data set. The DSCB contains, among other
+ * things, the extents and the last used track of the data set, so most
+ * changes to a PDS result in a different key.
+ *
+ * @param[in]  ds  The data set for which the key is computed.
+ * @param[out] key Reference to a variable in which the key is returned.
+ * @return     0 on success, ENOENT if the data set has no first part or
+ *             the volume label of its device has not been read.
+ */
+static int dataset_get_cache_key(struct dataset *ds, unsigned long long *key)
+{
+	struct datasetpart *dsp;
+
+	dsp = ds->dsp[0];
+	if (!dsp || !dsp->dasdi->vlabel)
+		return ENOENT;
+	*key = fnv1a(FNV_INIT, dsp->dasdi->vlabel->volid,
+		     sizeof(dsp->dasdi->vlabel->volid));
+	*key = fnv1a(*key, dsp->f1, sizeof(*dsp->f1));
+	return 0;
+}
+
+/**
+ * @brief Subroutine of lzds_dasd_scan_datasets.
+ *
+ * If the member cache of the zdsroot contains the member list of a PDS,
+ * create the member list of the data set from the cache instead of
+ * reading the PDS directory.
+ *
+ * @param[in]  ds  The dataset that the cached members will be added to.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - ENOENT  There is no matching entry in the member cache.
+ *   - ENOMEM  Could not allocate structure due to lack of memory.
+ */
+static int dataset_get_cached_members(struct dataset *ds)
+{
+	struct membercache *cache;
+	struct pdsmember *member;
+	struct cachedpds *pds;
+	unsigned long long key;
+	unsigned int i;
+
+	if (!ds->dsp[0] || !ds->dsp[0]->dasdi->root)
+		return ENOENT;
+	cache = ds->dsp[0]->dasdi->root->membercache;
+	if (!cache || dataset_get_cache_key(ds, &key))
+		return ENOENT;
+	for (pds = cache->hash[key & (cache->hashsize - 1)]; pds;
+	     pds = pds->hashnext)
+		if (pds->key == key && !strcmp(pds->name, ds->name))
+			break;
+	if (!pds)
+		return ENOENT;
+
+	dataset_free_memberlist(ds);
+	ds->memberlist = util_list_new(struct pdsmember, list);
+	for (i = 0; i < pds->count; ++i) {
+		member = malloc(sizeof(*member));
+		if (!member) {
+			dataset_free_memberlist(ds);
+			return ENOMEM;
+		}
+		memset(member, 0, sizeof(*member));
+		strcpy(member->name, pds->member[i].name);
+		member->track = pds->member[i].track;
+		member->record = pds->member[i].record;
+		member->is_alias = pds->member[i].is_alias;
+		if (dataset_add_member_to_list(ds, member)) {
+			free(member);
+			dataset_free_memberlist(ds);
+			return ENOMEM;
 		}
 	}
-	if (rc) {
-		dataset_free_memberlist(&tmpds);
-		for (i = 0; i < MAXVOLUMESPERDS; ++i)
-			free(tmpds.dsp[i]);
-		errorlog_free(tmpds.log);
+	return 0;
+}
+
+/**
+ * This function finds all data set descriptions in the VTOC of the
+ * dasd, creates respective struct dataset representations and reads
+ * the member lists of partitioned data sets. The data sets are kept
+ * with the dasd until they are added to the zdsroot by
+ * lzds_zdsroot_extract_datasets_from_dasd.
+ *
+ * Unlike lzds_zdsroot_extract_datasets_from_dasd, this function does
+ * not access the zdsroot. It can therefore be called for different
+ * dasds in parallel, to overlap the I/O that is needed to read the PDS
+ * directories of many devices.
+ *
+ * @pre The VTOC must have been read with lzds_dasd_alloc_rawvtoc.
+ *
+ * @param[in]  dasd    The dasd whose data sets will be scanned.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - ENOMEM  Could not allocate structure due to lack of memory.
+ *   - EINVAL  The VTOC has not yet been read.
+ *   - EPROTO  Invalid data in the VTOC of the dasd.
+ *   - EIO     An error happened while reading data from disk.
+ */
+int lzds_dasd_scan_datasets(struct dasd *dasd)
+{
+	struct util_list *list;
+	format1_label_t *f1;
+	struct dscb *dscb;
+	struct dscbiterator *it;
+	struct dataset *ds;
+	int rc;
+
+	dasd_free_scanned_datasets(dasd);
+	errorlog_clear(dasd->log);
+	if (!dasd->rawvtoc)
+		return errorlog_add_message(
+			&dasd->log, NULL, EINVAL,
+			"scan data sets: VTOC of %s has not been read\n",
+			dasd->device);
+	rc = lzds_raw_vtoc_alloc_dscbiterator(dasd->rawvtoc, &it);
+	if (rc)
+		return ENOMEM;
+	list = util_list_new(struct dataset, list);
+	while (!lzds_dscbiterator_get_next_dscb(it, &dscb)) {
+		if (dscb->fmtid != 0xf1 && dscb->fmtid != 0xf8)
+			continue;
+		f1 = (format1_label_t *)dscb;
+		ds = malloc(sizeof(*ds));
+		if (!ds) {
+			rc = ENOMEM;
+			break;
+		}
+		rc = create_dataset_from_dscb(dasd, f1, ds);
+		if (rc) {
+			errorlog_add_message(
+				&dasd->log, dasd->log, rc,
+				"scan data sets: "
+				"creating dataset failed for %s\n",
+				dasd->device);
+			dataset_free(ds);
+			break;
+		}
+		if (dataset_get_cached_members(ds))
+			rc = dataset_member_analysis(ds);
+		if (rc) {
+			errorlog_add_message(
+				&dasd->log, ds->log, rc,
+				"scan data sets: "
+				"member analysis failed for %s\n",
+				ds->name);
+			dataset_free(ds);
+			break;
+		}
+		util_list_add_tail(list, ds);
 	}
 	lzds_dscbiterator_free(it);
+	dasd->scanned_datasets = list;
+	if (rc)
+		dasd_free_scanned_datasets(dasd);
+	return rc;
+}
+
+/**
+ * This function finds all data set descriptions in the VTOC of the
+ * dasd and creates respective struct dataset representations. These
+ * struct dataset are stored in the zdsroot and can later be traversed
+ * using a dsiterator.  In case that it finds a dataset that is
+ * already present in the zdsroot, it verifies that both are parts of
+ * the same multivolume data set and then merges the new data with the
+ * existing struct dataset.  If the conflicting data sets are indeed
+ * individual data sets and not parts of a single one, the function
+ * returns an error.
+ * If the data sets of the dasd have already been found by
+ * lzds_dasd_scan_datasets, the VTOC is not scanned again.
+ *
+ * @param[in]  root    The zdsroot that the dataset will be merged into.
+ * @param[in]  dasd    The datasets found in this dasd will be merged.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - ENOMEM  Could not allocate structure due to lack of memory.
+ *   - EPROTO  The data is not mergable because of conflicting entries,
+ *             or invalid data in the VTOC of the dasd.
+ */
+int lzds_zdsroot_extract_datasets_from_dasd(struct zdsroot *root,
+					    struct dasd *dasd)
+{
+	struct dataset *ds, *nextds;
+	int rc;
+
+	errorlog_clear(root->log);
+	if (!dasd->scanned_datasets) {
+		rc = lzds_dasd_scan_datasets(dasd);
+		if (rc)
+			return errorlog_add_message(
+				&root->log, dasd->log, rc,
+				"extract data sets: "
+				"scanning data sets failed for %s\n",
+				dasd->device);
+	}
+	rc = 0;
+	util_list_iterate_safe(dasd->scanned_datasets, ds, nextds) {
+		util_list_remove(dasd->scanned_datasets, ds);
+		rc = zdsroot_merge_dataset(root, ds);
+		if (rc) {
+			errorlog_add_message(
+				&root->log, root->log, rc,
+				"extract data sets: "
+				"merge dataset failed for %s\n",
+				ds->name);
+			dataset_free(ds);
+			break;
+		}
+		/* the contents of ds now belong to the zdsroot */
+		free(ds);
+	}
+	dasd_free_scanned_datasets(dasd);
+	return rc;
+}
+
+/* First line of a member cache file, identifies the file format */
+#define MEMBERCACHE_HEADER "libzds member cache 1\n"
+
+/**
+ * @brief Subroutine of lzds_zdsroot_free and lzds_zdsroot_read_member_cache.
+ *        Frees the member cache and all cached member lists.
+ *
+ * @param[in] cache Pointer to the member cache that is to be freed.
+ */
+static void membercache_free(struct membercache *cache)
+{
+	struct cachedpds *pds, *next;
+	unsigned int i;
+
+	if (!cache)
+		return;
+	for (i = 0; i < cache->hashsize; ++i) {
+		for (pds = cache->hash[i]; pds; pds = next) {
+			next = pds->hashnext;
+			free(pds->member);
+			free(pds);
+		}
+	}
+	free(cache->hash);
+	free(cache);
+}
+
+/**
+ * @brief Subroutine of lzds_zdsroot_read_member_cache.
+ *
+ * Reads one PDS entry from a member cache file. An entry consists of a line
+ * "KEY COUNT DSNAME", followed by COUNT lines "MEMBER TRACK RECORD ALIAS".
+ *
+ * @param[in]  file The file to read from.
+ * @param[out] pds  Reference to a pointer variable in which the newly
+ *                  allocated entry will be returned, NULL at end of file.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - ENOMEM  Could not allocate structure due to lack of memory.
+ *   - EPROTO  The file content is not valid.
+ */
+static int membercache_read_pds(FILE *file, struct cachedpds **pds)
+{
+	unsigned int i, count, track, record, is_alias;
+	char name[MAXDSNAMELENGTH];
+	struct pdsmember *member;
+	unsigned long long key;
+	int rc;
+
+	*pds = NULL;
+	rc = fscanf(file, "%llx %u %44s", &key, &count, name);
+	if (rc == EOF)
+		return 0;
+	if (rc != 3 || count > 65535)
+		return EPROTO;
+	*pds = malloc(sizeof(**pds));
+	if (!*pds)
+		return ENOMEM;
+	memset(*pds, 0, sizeof(**pds));
+	(*pds)->key = key;
+	strcpy((*pds)->name, name);
+	(*pds)->member = malloc(count * sizeof(struct pdsmember) + 1);
+	if (!(*pds)->member)
+		return ENOMEM;
+	memset((*pds)->member, 0, count * sizeof(struct pdsmember));
+	for (i = 0; i < count; ++i) {
+		member = &(*pds)->member[i];
+		if (fscanf(file, "%8s %u %u %u", member->name, &track, &record,
+			   &is_alias) != 4 ||
+		    track > 0xffff || record > 0xff || is_alias > 1)
+			return EPROTO;
+		member->track = track;
+		member->record = record;
+		member->is_alias = is_alias;
+		(*pds)->count++;
+	}
+	return 0;
+}
+
+/**
+ * Reading the directories of partitioned data sets takes one or more
+ * track reads per PDS and makes up most of the time needed to extract
+ * the data sets from a dasd. With a member cache, the member list of a
+ * PDS is taken from the cache if the volume serial and the format 1 DSCB
+ * of the data set are unchanged, and the directory is not read.
+ *
+ * @note Some changes to a PDS, for example deleting or renaming a member,
+ * do not modify the format 1 DSCB. A member cache must therefore only be
+ * used if the data sets are not modified, or if such changes are
+ * acceptable to miss.
+ *
+ * The member cache is only used by the data set scan, so this function
+ * must be called before lzds_dasd_scan_datasets or
+ * lzds_zdsroot_extract_datasets_from_dasd and must not be called
+ * concurrently with them. Any previously read member cache is discarded.
+ * A member cache file that does not exist is treated as empty file.
+ *
+ * @param[in] root     Reference to the zdsroot structure.
+ * @param[in] filename Name of the member cache file, as written by
+ *                     lzds_zdsroot_write_member_cache.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - ENOMEM  Could not allocate structure due to lack of memory.
+ *   - EIO     The file could not be read.
+ *   - EPROTO  The file is not a valid member cache file.
+ */
+int lzds_zdsroot_read_member_cache(struct zdsroot *root, const char *filename)
+{
+	struct membercache *cache;
+	struct cachedpds *pds;
+	char header[sizeof(MEMBERCACHE_HEADER)];
+	unsigned int bucket;
+	FILE *file;
+	int rc;
+
+	errorlog_clear(root->log);
+	membercache_free(root->membercache);
+	root->membercache = NULL;
+
+	file = fopen(filename, "r");
+	if (!file) {
+		if (errno == ENOENT)
+			return 0;
+		return errorlog_add_message(
+			&root->log, NULL, EIO,
+			"read member cache: could not open %s: %s\n",
+			filename, strerror(errno));
+	}
+	cache = malloc(sizeof(*cache));
+	if (!cache) {
+		fclose(file);
+		return ENOMEM;
+	}
+	memset(cache, 0, sizeof(*cache));
+	cache->hashsize = 1024;
+	cache->hash = malloc(cache->hashsize * sizeof(*cache->hash));
+	if (!cache->hash) {
+		rc = ENOMEM;
+		goto out_err;
+	}
+	memset(cache->hash, 0, cache->hashsize * sizeof(*cache->hash));
+
+	if (!fgets(header, sizeof(header), file) ||
+	    strcmp(header, MEMBERCACHE_HEADER)) {
+		rc = errorlog_add_message(
+			&root->log, NULL, EPROTO,
+			"read member cache: %s is not a member cache file\n",
+			filename);
+		goto out_err;
+	}
+	do {
+		rc = membercache_read_pds(file, &pds);
+		if (pds) {
+			bucket = pds->key & (cache->hashsize - 1);
+			pds->hashnext = cache->hash[bucket];
+			cache->hash[bucket] = pds;
+		}
+	} while (!rc && pds);
+	if (!rc && ferror(file))
+		rc = EIO;
+	if (rc) {
+		rc = errorlog_add_message(
+			&root->log, NULL, rc,
+			"read member cache: could not read %s\n", filename);
+		goto out_err;
+	}
+	fclose(file);
+	root->membercache = cache;
+	return 0;
+
+out_err:
+	membercache_free(cache);
+	fclose(file);
+	return rc;
+}
+
+/**
+ * @brief Subroutine of lzds_zdsroot_write_member_cache.
+ *
+ * Check if all member names of a data set can be written to a member
+ * cache file.
+ */
+static int dataset_members_are_cachable(struct dataset *ds)
+{
+	struct pdsmember *member;
+	char *c;
+
+	util_list_iterate(ds->memberlist, member) {
+		if (!member->name[0])
+			return 0;
+		for (c = member->name; *c; ++c)
+			if (!isgraph((unsigned char)*c))
+				return 0;
+	}
+	return 1;
+}
+
+/**
+ * Writes the member lists of all partitioned data sets in the zdsroot to
+ * a member cache file that can be read with lzds_zdsroot_read_member_cache
+ * the next time the data sets are extracted. An existing file is replaced.
+ *
+ * @param[in] root     Reference to the zdsroot structure.
+ * @param[in] filename Name of the member cache file.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - ENOMEM  Could not allocate structure due to lack of memory.
+ *   - EIO     The file could not be written.
+ */
+int lzds_zdsroot_write_member_cache(struct zdsroot *root, const char *filename)
+{
+	struct pdsmember *member;
+	unsigned long long key;
+	struct dataset *ds;
+	char *tmpname;
+	FILE *file;
+	int fd, rc;
+
+	errorlog_clear(root->log);
+	rc = asprintf(&tmpname, "%s.XXXXXX", filename);
+	if (rc < 0)
+		return ENOMEM;
+	fd = mkstemp(tmpname);
+	file = fd < 0 ? NULL : fdopen(fd, "w");
+	if (!file) {
+		rc = errorlog_add_message(
+			&root->log, NULL, EIO,
+			"write member cache: could not create %s: %s\n",
+			tmpname, strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmpname);
+		}
+		free(tmpname);
+		return rc;
+	}
+
+	fputs(MEMBERCACHE_HEADER, file);
+	util_list_iterate(root->datasetlist, ds) {
+		if (!ds->memberlist || dataset_get_cache_key(ds, &key) ||
+		    !dataset_members_are_cachable(ds))
+			continue;
+		fprintf(file, "%016llx %lu %s\n", key,
+			util_list_len(ds->memberlist), ds->name);
+		util_list_iterate(ds->memberlist, member)
+			fprintf(file, "%s %u %u %u\n", member->name,
+				member->track, member->record,
+				member->is_alias ? 1 : 0);
+	}
+
+	rc = 0;
+	if (fclose(file))
+		rc = errorlog_add_message(
+			&root->log, NULL, EIO,
+			"write member cache: could not write %s: %s\n",
+			tmpname, strerror(errno));
+	else if (rename(tmpname, filename))
+		rc = errorlog_add_message(
+			&root->log, NULL, EIO,
+			"write member cache: could not replace %s: %s\n",
+			filename, strerror(errno));
+	if (rc)
+		unlink(tmpname);
+	free(tmpname);
 	return rc;
 }
 
@@ -2570,28 +3593,19 @@ void lzds_dataset_get_is_supported(struct dataset *ds, int *issupported)
  *                         pdsmember is returned. If no member is found, this
  *                         is set to NULL.
  * @return     0 on success, otherwise one of the following error codes:
- *   - ENOMEM  Could not allocate internal structure due to lack of memory.
+ *   - EINVAL  The data set is not a PDS.
  *   - ENOENT  No matching member was found.
  */
 int lzds_dataset_get_member_by_name(struct dataset *ds, char *membername,
 				    struct pdsmember **member)
 {
-	struct memberiterator *it;
-	struct pdsmember *tmpmember;
-	int rc;
-
 	errorlog_clear(ds->log);
 	*member = NULL;
-	rc = lzds_dataset_alloc_memberiterator(ds, &it);
-	if (rc)
-		return ENOMEM;
-	while (!lzds_memberiterator_get_next_member(it, &tmpmember)) {
-		if (!strcmp(tmpmember->name, membername)) {
-			*member = tmpmember;
-			break;
-		}
-	}
-	lzds_memberiterator_free(it);
+	if (!ds->memberlist)
+		return errorlog_add_message(
+			&ds->log, NULL, EINVAL,
+			"get member: data set is not a PDS\n");
+	*member = dataset_lookup_member(ds, membername);
 	if (!*member)
 		return ENOENT;
 	return 0;
@@ -2613,6 +3627,8 @@ void lzds_dshandle_free(struct dshandle *dsh)
 	free(dsh->rawbuffer);
 	if (dsh->seekbuf)
 		free(dsh->seekbuf);
+	free(dsh->trackoffset);
+	readahead_free(dsh->readahead);
 	errorlog_free(dsh->log);
 	free(dsh);
 }
@@ -2678,6 +3694,10 @@ int lzds_dataset_alloc_dshandle(struct dataset *ds,
  * For a given seek buffer size and the known number of tracks of the
  * data set, we can compute how many track frames we need to skip if
  * we and to store track frames in regular intervals.
+ * If the seek buffer size allows to store the offset of every track of
+ * the data set, a dense index is used instead. It is filled while the
+ * data set is read and allows to seek to any previously read offset by
+ * reading just one track frame.
  *
  * @param[in] dsh   The dshandle we want to modify.
  * @param[in] seek_buffer_size  The maximum number of bytes to be allocated
@@ -2702,6 +3722,11 @@ int lzds_dshandle_set_seekbuffer(struct dshandle *dsh,
 	dsh->seek_count = 0;
 	dsh->seek_current = 0;
 	dsh->skip = 0;
+	free(dsh->trackoffset);
+	dsh->trackoffset = NULL;
+	dsh->trackoffset_count = 0;
+	dsh->trackoffset_first = 0;
+	dsh->trackoffset_next = 0;
 
 	if (!seek_buffer_size)
 		return 0;
@@ -2709,6 +3734,18 @@ int lzds_dshandle_set_seekbuffer(struct dshandle *dsh,
 	ds = dsh->ds;
 	lzds_dataset_get_size_in_tracks(ds, &totaltracks);
 
+	/* prefer an entry per track if the buffer size allows it */
+	if (totaltracks && totaltracks <= seek_buffer_size / sizeof(long long)) {
+		dsh->trackoffset = malloc(totaltracks * sizeof(long long));
+		if (!dsh->trackoffset)
+			return ENOMEM;
+		dsh->trackoffset_count = totaltracks;
+		if (dsh->member)
+			dsh->trackoffset_first = dsh->member->track;
+		dsh->trackoffset_next = dsh->trackoffset_first;
+		return 0;
+	}
+
 	/* compute the total number of extents */
 	extents = 0;
 	for (i = 0; i < ds->dspcount; ++i)
@@ -2822,6 +3859,86 @@ void lzds_dshandle_get_keepRDW(struct dshandle *dsh, int *keepRDW)
 	*keepRDW = dsh->keepRDW;
 }
 
+/**
+ * @brief Subroutine of lzds_dshandle_set_readahead and lzds_dshandle_free.
+ *
+ * @param[in] ra Pointer to the read ahead context that is to be freed.
+ */
+static void readahead_free(struct readahead *ra)
+{
+	int i;
+
+	if (!ra)
+		return;
+	for (i = 0; i < MAXVOLUMESPERDS; ++i)
+		lzds_dasdhandle_free(ra->dasdhandle[i]);
+	pthread_cond_destroy(&ra->cond);
+	pthread_mutex_destroy(&ra->mutex);
+	free(ra->buffer);
+	free(ra);
+}
+
+/**
+ * With read ahead enabled, a separate thread reads the next track frame
+ * of the data set from the device while the current track frame is
+ * interpreted and copied to the user. This requires a second raw track
+ * buffer of the size tracks_per_frame * RAWTRACKSIZE.
+ *
+ * Read ahead improves the throughput of sequential reads. Random access
+ * does not benefit from it.
+ *
+ * @pre The dsh must not be open when this function is called.
+ *
+ * @param[in] dsh        The dshandle we want to modify.
+ * @param[in] readahead  Set this to 1 to enable read ahead or
+ *                       0 to disable it.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - ENOMEM  Could not allocate internal structure due to lack of memory.
+ *   - EBUSY   The handle is already open.
+ */
+int lzds_dshandle_set_readahead(struct dshandle *dsh, int readahead)
+{
+	struct readahead *ra;
+	int i, rc;
+
+	errorlog_clear(dsh->log);
+	if (dsh->is_open)
+		return errorlog_add_message(
+			&dsh->log, NULL, EBUSY,
+			"dshandle: cannot set read ahead while handle is "
+			"open\n");
+	if (!readahead) {
+		readahead_free(dsh->readahead);
+		dsh->readahead = NULL;
+		return 0;
+	}
+	if (dsh->readahead)
+		return 0;
+
+	ra = malloc(sizeof(*ra));
+	if (!ra)
+		return ENOMEM;
+	memset(ra, 0, sizeof(*ra));
+	pthread_mutex_init(&ra->mutex, NULL);
+	pthread_cond_init(&ra->cond, NULL);
+	/* track buffer must be page aligned for O_DIRECT */
+	ra->buffer = memalign(4096, dsh->rawbufmax);
+	if (!ra->buffer) {
+		readahead_free(ra);
+		return ENOMEM;
+	}
+	for (i = 0; i < dsh->ds->dspcount; ++i) {
+		rc = lzds_dasd_alloc_dasdhandle(dsh->ds->dsp[i]->dasdi,
+						&ra->dasdhandle[i]);
+		if (rc) {
+			readahead_free(ra);
+			return rc;
+		}
+	}
+	dsh->readahead = ra;
+	return 0;
+}
+
 /**
  * @brief Helper function that initializes the given handle so that it
  *        points to the beginning of the dataset or member.
@@ -2942,10 +4059,25 @@ static int initialize_buffer_positions_for_first_read(struct dshandle *dsh)
  */
 void lzds_dshandle_close(struct dshandle *dsh)
 {
+	struct readahead *ra = dsh->readahead;
 	int i;
-	for (i = 0; i < MAXVOLUMESPERDS; ++i)
+
+	if (ra && ra->running) {
+		pthread_mutex_lock(&ra->mutex);
+		ra->stop = 1;
+		pthread_cond_broadcast(&ra->cond);
+		pthread_mutex_unlock(&ra->mutex);
+		pthread_join(ra->thread, NULL);
+		ra->running = 0;
+		ra->stop = 0;
+		ra->state = READAHEAD_IDLE;
+	}
+	for (i = 0; i < MAXVOLUMESPERDS; ++i) {
 		if (dsh->dasdhandle[i])
 			lzds_dasdhandle_close(dsh->dasdhandle[i]);
+		if (ra && ra->dasdhandle[i])
+			lzds_dasdhandle_close(ra->dasdhandle[i]);
+	}
 	dsh->is_open = 0;
 }
 
@@ -3224,6 +4356,79 @@ retry:
 #endif /* HAVE_CURL */
 
 
+/**
+ * @brief Main function of the read ahead thread of a dshandle
+ *
+ * Waits for read ahead requests and reads the requested track frame
+ * into the read ahead buffer until it is told to stop.
+ *
+ * @param[in]  arg  The read ahead context of the dshandle.
+ * @return     Always NULL.
+ */
+static void *readahead_thread(void *arg)
+{
+	struct readahead *ra = arg;
+	unsigned int starttrk, endtrk;
+	int dsp_no, rc;
+
+	pthread_mutex_lock(&ra->mutex);
+	while (!ra->stop) {
+		if (ra->state != READAHEAD_PENDING) {
+			pthread_cond_wait(&ra->cond, &ra->mutex);
+			continue;
+		}
+		dsp_no = ra->dsp_no;
+		starttrk = ra->bufstarttrk;
+		endtrk = ra->bufendtrk;
+		pthread_mutex_unlock(&ra->mutex);
+		rc = dasdhandle_read_tracks_cached(ra->dasdhandle[dsp_no],
+						   starttrk, endtrk,
+						   ra->buffer);
+		pthread_mutex_lock(&ra->mutex);
+		ra->rc = rc;
+		ra->state = READAHEAD_DONE;
+		pthread_cond_broadcast(&ra->cond);
+	}
+	pthread_mutex_unlock(&ra->mutex);
+	return NULL;
+}
+
+/**
+ * @brief Subroutine of lzds_dshandle_open
+ *
+ * Open the dasdhandles of the read ahead context and start the read
+ * ahead thread.
+ *
+ * @param[in]  dsh  The dshandle that is to be opened.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - EIO     Could not open underlying device.
+ *   - EAGAIN  Could not start the read ahead thread.
+ */
+static int dshandle_start_readahead_thread(struct dshandle *dsh)
+{
+	struct readahead *ra = dsh->readahead;
+	int i, rc;
+
+	for (i = 0; i < dsh->ds->dspcount; ++i) {
+		rc = lzds_dasdhandle_open(ra->dasdhandle[i]);
+		if (rc)
+			return errorlog_add_message(
+				&dsh->log, ra->dasdhandle[i]->log, rc,
+				"data set open: error opening DASD "
+				"for read ahead of data set %s\n",
+				dsh->ds->name);
+	}
+	ra->state = READAHEAD_IDLE;
+	ra->stop = 0;
+	if (pthread_create(&ra->thread, NULL, readahead_thread, ra))
+		return errorlog_add_message(
+			&dsh->log, NULL, EAGAIN,
+			"data set open: could not start read ahead thread "
+			"for data set %s\n", dsh->ds->name);
+	ra->running = 1;
+	return 0;
+}
+
 /**
  * This makes the data set context ready for read operations.
  * All settings on the dsh must be done before it is opened.
@@ -3235,6 +4440,7 @@ retry:
  *   - ENOTSUP The dataset is of a type that is not supported.
  *   - EINVAL  Tried to open a PDS without setting a member before..
  *   - EIO     Could not open underlying device.
+ *   - EAGAIN  Could not start the read ahead thread.
  */
 int lzds_dshandle_open(struct dshandle *dsh)
 {
@@ -3268,6 +4474,9 @@ int lzds_dshandle_open(struct dshandle *dsh)
 			dsh->log, rc,
 			"data set open: error when initializing buffers"
 			" for data set %s\n", dsh->ds->name);
+	/* the dense seek index depends on the member */
+	dsh->trackoffset_first = dsh->member ? dsh->member->track : 0;
+	dsh->trackoffset_next = dsh->trackoffset_first;
 	for (i = 0; i < dsh->ds->dspcount; ++i) {
 		rc = lzds_dasdhandle_open(dsh->dasdhandle[i]);
 		if (rc) {
@@ -3280,6 +4489,13 @@ int lzds_dshandle_open(struct dshandle *dsh)
 			return rc;
 		}
 	}
+	if (dsh->readahead) {
+		rc = dshandle_start_readahead_thread(dsh);
+		if (rc) {
+			lzds_dshandle_close(dsh);
+			return rc;
+		}
+	}
 	dsh->is_open = 1;
 	return 0;
 }
@@ -3333,6 +4549,7 @@ static ssize_t parse_variable_record(struct dshandle *dsh, char *rec,
 	struct segment_header *blockhead;
 	struct segment_header *seghead;
 	size_t totaldatalength;
+	char *blockdata;
 
 	/* We must not rely on the data in rec, as it was read from disk and
 	 * may be broken. Wherever we interprete the data we must have sanity
@@ -3364,13 +4581,14 @@ static ssize_t parse_variable_record(struct dshandle *dsh, char *rec,
 			&dsh->log, NULL, EPROTO,
 			"variable record parser: block length to small\n");
 	data += sizeof(*blockhead);
+	blockdata = data;
 	residual = blocklength - sizeof(*blockhead);
 	while (residual) {
 		seghead = (struct segment_header *)data;
 		segmentlength = seghead->length;
 		if (seghead->nullsegment || !segmentlength) {
 			/* null segment found -> end of data in block */
-			return totaldatalength;
+			break;
 		}
 		/* If segmentlength is to small to contain the record descriptor
 		 * descriptor or to large to fit in the residual data area, then
@@ -3385,10 +4603,16 @@ static ssize_t parse_variable_record(struct dshandle *dsh, char *rec,
 				segmentlength,
 				(unsigned long)seghead - (unsigned long)rec);
 		residual -= segmentlength;
-		if (!keepRDW) {
-			data += sizeof(*seghead);
-			segmentlength -= sizeof(*seghead);
+		/* With RDWs, the segments are copied unchanged and are
+		 * adjacent in the block, so they are copied in one go below.
+		 */
+		if (keepRDW) {
+			totaldatalength += segmentlength;
+			data += segmentlength;
+			continue;
 		}
+		data += sizeof(*seghead);
+		segmentlength -= sizeof(*seghead);
 		/* Make sure that we do not copy data beyond the end of
 		 * the data buffer
 		 */
@@ -3403,9 +4627,66 @@ static ssize_t parse_variable_record(struct dshandle *dsh, char *rec,
 		totaldatalength += segmentlength;
 		data += segmentlength;
 	}
+	if (keepRDW && totaldatalength) {
+		if ((unsigned long)targetdata + totaldatalength >
+		    (unsigned long)dsh->databuffer + dsh->databufmax)
+			return - errorlog_add_message(
+				&dsh->log, NULL, EPROTO,
+				"variable record parser: "
+				"record to long for target buffer\n");
+		memcpy(targetdata, blockdata, totaldatalength);
+	}
 	return totaldatalength;
 }
 
+/**
+ * @brief subroutine of dshandle_extract_data_from_trackbuffer
+ *
+ * Add the data offset of a track to the dense seek index. The index is
+ * filled without gaps, so only the track that follows the last stored
+ * track is accepted.
+ *
+ * @param[in]  dsh     The dshandle that keeps track of the I/O operations.
+ * @param[in]  reltrk  Track number relative to the begin of the data set.
+ * @param[in]  offset  Data offset of the first data byte in this track.
+ */
+static void dshandle_store_trackoffset(struct dshandle *dsh,
+				       unsigned long long reltrk,
+				       long long offset)
+{
+	if (!dsh->trackoffset || reltrk != dsh->trackoffset_next ||
+	    reltrk >= dsh->trackoffset_count)
+		return;
+	dsh->trackoffset[reltrk] = offset;
+	dsh->trackoffset_next++;
+}
+
+/**
+ * @brief subroutine of lzds_dshandle_read
+ *
+ * Compute the number of the first track in the current track frame
+ * relative to the begin of the data set.
+ *
+ * @param[in]  dsh  The dshandle that keeps track of the I/O operations.
+ * @return     The relative track number.
+ */
+static unsigned long long dshandle_get_relative_track(struct dshandle *dsh)
+{
+	unsigned long long reltrk;
+	int i, j;
+
+	reltrk = dsh->bufstarttrk - dsh->extstarttrk;
+	for (i = 0; i <= dsh->dsp_no; ++i)
+		for (j = 0; j < MAXEXTENTS; ++j) {
+			if (i == dsh->dsp_no && j == dsh->ext_seq_no)
+				break;
+			reltrk += get_extent_size_in_tracks(
+				&dsh->ds->dsp[i]->ext[j],
+				dsh->ds->dsp[i]->dasdi);
+		}
+	return reltrk;
+}
+
 /**
  * @brief subroutine of lzds_dshandle_read
  *
@@ -3425,8 +4706,13 @@ static int dshandle_extract_data_from_trackbuffer(struct dshandle *dsh)
 	unsigned int record;
 	char DS1RECFM;
 	ssize_t tdsize;
+	int fixed, variable;
 
 	DS1RECFM = dsh->ds->dsp[0]->f1->DS1RECFM;
+	/* fixed or undefined record size */
+	fixed = DS1RECFM & 0x80;
+	/* variable records */
+	variable = !fixed && (DS1RECFM & 0x40);
 	trckcount = dsh->rawbufsize / RAWTRACKSIZE;
 	track = dsh->rawbuffer;
 	targetdata = dsh->databuffer;
@@ -3439,18 +4725,19 @@ static int dshandle_extract_data_from_trackbuffer(struct dshandle *dsh)
 	if (!dsh->startrecord)
 		dsh->startrecord = 1;
 	for (i = 0; i < trckcount && !dsh->eof_reached; ++i) {
+		dshandle_store_trackoffset(dsh, dsh->frame_reltrk + i,
+					   dsh->databufoffset +
+					   dsh->databufsize);
 		record = 0;
 		rawdata = track;
 		while (!dsh->eof_reached) {
 			tdsize = 0;
 			if (record >= dsh->startrecord) {
-				/* fixed or undefined record size */
-				if ((DS1RECFM & 0x80))
+				if (fixed)
 					tdsize = parse_fixed_record(dsh,
 								    rawdata,
 								    targetdata);
-				/* variable records */
-				if (!(DS1RECFM & 0x80) && (DS1RECFM & 0x40))
+				else if (variable)
 					tdsize = parse_variable_record(dsh,
 								       rawdata,
 								    targetdata,
@@ -3635,6 +4922,74 @@ static int dshandle_store_trackframe(struct dshandle *dsh)
 	return 0;
 }
 
+/**
+ * @brief subroutine of lzds_dshandle_read
+ *
+ * Read the tracks bufstarttrk to bufendtrk of the current data set part
+ * into the rawbuffer of dsh. If the frame has already been read by the
+ * read ahead thread, the read ahead buffer is swapped with the rawbuffer
+ * instead.
+ *
+ * @param[in]  dsh  The dshandle that keeps track of the I/O operations.
+ * @return     0 on success, otherwise one of the error codes of
+ *             lzds_dasdhandle_read_tracks_to_buffer.
+ */
+static int dshandle_read_trackframe(struct dshandle *dsh)
+{
+	struct readahead *ra = dsh->readahead;
+	char *tmp;
+	int hit;
+
+	if (ra && ra->running) {
+		pthread_mutex_lock(&ra->mutex);
+		while (ra->state == READAHEAD_PENDING)
+			pthread_cond_wait(&ra->cond, &ra->mutex);
+		hit = (ra->state == READAHEAD_DONE && !ra->rc &&
+		       ra->dsp_no == dsh->dsp_no &&
+		       ra->bufstarttrk == dsh->bufstarttrk &&
+		       ra->bufendtrk == dsh->bufendtrk);
+		ra->state = READAHEAD_IDLE;
+		pthread_mutex_unlock(&ra->mutex);
+		if (hit) {
+			tmp = dsh->rawbuffer;
+			dsh->rawbuffer = ra->buffer;
+			ra->buffer = tmp;
+			return 0;
+		}
+	}
+	/* Errors of the read ahead thread are reported by the regular read */
+	return dasdhandle_read_tracks_cached(dsh->dasdhandle[dsh->dsp_no],
+					     dsh->bufstarttrk, dsh->bufendtrk,
+					     dsh->rawbuffer);
+}
+
+/**
+ * @brief subroutine of lzds_dshandle_read
+ *
+ * Ask the read ahead thread to read the track frame that follows the
+ * current track frame of dsh.
+ *
+ * @param[in]  dsh  The dshandle that keeps track of the I/O operations.
+ */
+static void dshandle_start_readahead(struct dshandle *dsh)
+{
+	struct readahead *ra = dsh->readahead;
+	struct dshandle next;
+
+	if (!ra || !ra->running || dsh->eof_reached)
+		return;
+	next = *dsh;
+	if (!dshandle_prepare_for_next_read_tracks(&next))
+		return;
+	pthread_mutex_lock(&ra->mutex);
+	ra->dsp_no = next.dsp_no;
+	ra->bufstarttrk = next.bufstarttrk;
+	ra->bufendtrk = next.bufendtrk;
+	ra->state = READAHEAD_PENDING;
+	pthread_cond_broadcast(&ra->cond);
+	pthread_mutex_unlock(&ra->mutex);
+}
+
 /**
  * @param[in]  dsh    The dshandle that keeps track of the I/O operations.
  * @param[in]  buf    The target buffer for the read data.
@@ -3668,9 +5023,10 @@ int lzds_dshandle_read(struct dshandle *dsh, char *buf,
 				break; /* end of data in data set reached */
 			if (!dshandle_prepare_for_next_read_tracks(dsh))
 				break; /* end of data set extents reached */
-			rc = lzds_dasdhandle_read_tracks_to_buffer(
-				dsh->dasdhandle[dsh->dsp_no], dsh->bufstarttrk,
-				dsh->bufendtrk, dsh->rawbuffer);
+			if (dsh->trackoffset)
+				dsh->frame_reltrk =
+					dshandle_get_relative_track(dsh);
+			rc = dshandle_read_trackframe(dsh);
 			if (rc)
 				return errorlog_add_message(
 					&dsh->log,
@@ -3696,6 +5052,7 @@ int lzds_dshandle_read(struct dshandle *dsh, char *buf,
 					dsh->log, rc,
 					"data set read: storing track frame "
 					"%s\n", dsh->ds->name);
+			dshandle_start_readahead(dsh);
 		}
 		/* if databuf has data to copy */
 		if (dsh->bufpos < dsh->databufsize) {
@@ -3826,6 +5183,107 @@ static void dshandle_reset_buffer_position_to_seekelement(
 	return;
 }
 
+/**
+ * @brief subroutine of lzds_dshandle_lseek
+ *
+ * Find the last track in the dense seek index that starts before offset.
+ *
+ * @param[in]  dsh      The dshandle that keeps track of the I/O operations.
+ * @param[in]  offset   The data offset in the dataset that we want to reach.
+ * @param[out] reltrk   Reference to a variable in which the found track
+ *                      number relative to the begin of the data set is
+ *                      returned.
+ *
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - EINVAL  There is no dense seek index available.
+ */
+static int dshandle_find_trackoffset(struct dshandle *dsh, off_t offset,
+				     unsigned long long *reltrk)
+{
+	unsigned long long low, high, index;
+
+	if (!dsh->trackoffset || dsh->trackoffset_next <= dsh->trackoffset_first)
+		return EINVAL;
+	low = dsh->trackoffset_first;
+	high = dsh->trackoffset_next - 1;
+	while (low < high) {
+		index = (low + high + 1) / 2;
+		if (dsh->trackoffset[index] <= offset)
+			low = index;
+		else
+			high = index - 1;
+	}
+	*reltrk = low;
+	return 0;
+}
+
+/**
+ * @brief subroutine of lzds_dshandle_lseek
+ *
+ * Reset the internal buffers etc, so that the next read will read
+ * a track frame that starts with the given track.
+ *
+ * @param[in]  dsh      The dshandle that keeps track of the I/O operations.
+ * @param[in]  reltrk   Track number relative to the begin of the data set.
+ * @return     0 on success, otherwise one of the following error codes:
+ *   - EPROTO  The track is not part of the data set.
+ */
+static int dshandle_reset_buffer_position_to_track(struct dshandle *dsh,
+						   unsigned long long reltrk)
+{
+	unsigned long long tracksum, extentsize;
+	unsigned int starttrck, endtrck;
+	int i, j;
+
+	tracksum = 0;
+	for (i = 0; i < dsh->ds->dspcount; ++i)
+		for (j = 0; j < MAXEXTENTS; ++j) {
+			extentsize = get_extent_size_in_tracks(
+				&dsh->ds->dsp[i]->ext[j],
+				dsh->ds->dsp[i]->dasdi);
+			if (reltrk < tracksum + extentsize)
+				goto found;
+			tracksum += extentsize;
+		}
+	return errorlog_add_message(
+		&dsh->log, NULL, EPROTO,
+		"data set seek: track %llu is not part of data set %s\n",
+		reltrk, dsh->ds->name);
+
+found:
+	dsh->bufpos = 0;
+	dsh->databufsize = 0;
+	dsh->rawbufsize = 0;
+	dsh->eof_reached = 0;
+	dsh->databufoffset = dsh->trackoffset[reltrk];
+	dsh->dsp_no = i;
+	/* a member may start in the middle of its first track */
+	if (dsh->member && reltrk == dsh->member->track)
+		dsh->startrecord = dsh->member->record;
+	else
+		dsh->startrecord = 0;
+	/* Point dsh to the track before the target track, or to the end of
+	 * the previous extent if the target is the first track of an extent,
+	 * see initialize_buffer_positions_for_first_read.
+	 */
+	if (reltrk == tracksum) {
+		dsh->ext_seq_no = j - 1;
+		dsh->bufendtrk = 0;
+		dsh->extendtrk = 0;
+		return 0;
+	}
+	lzds_dasd_cchh2trk(dsh->ds->dsp[i]->dasdi,
+			   &dsh->ds->dsp[i]->ext[j].llimit, &starttrck);
+	lzds_dasd_cchh2trk(dsh->ds->dsp[i]->dasdi,
+			   &dsh->ds->dsp[i]->ext[j].ulimit, &endtrck);
+	dsh->ext_seq_no = j;
+	dsh->extstarttrk = starttrck;
+	dsh->extendtrk = endtrck;
+	dsh->bufstarttrk = starttrck;
+	dsh->bufendtrk = starttrck + (reltrk - tracksum) - 1;
+	return 0;
+}
+
 /**
  * It is not possible to seek beyond the end of the data, but an
  * attempt to do so is a common occurrence as we may not know the
@@ -3852,6 +5310,7 @@ int lzds_dshandle_lseek(struct dshandle *dsh, long long offset,
 	ssize_t rcsize;
 	int rc;
 	long long se_index;
+	unsigned long long reltrk;
 
 	errorlog_clear(dsh->log);
 	if (dsh->databufoffset <= offset &&
@@ -3862,7 +5321,19 @@ int lzds_dshandle_lseek(struct dshandle *dsh, long long offset,
 		return 0;
 	}
 	/* need to seek to some other track frame */
-	if (!dshandle_find_seekelement(dsh, offset, &se_index)) {
+	if (!dshandle_find_trackoffset(dsh, offset, &reltrk)) {
+		/* do not reset our context if the next track frame we read
+		 * from our current position does not start after the track
+		 * that contains offset */
+		if (!(dsh->databufoffset <= offset &&
+		      dsh->trackoffset[reltrk] <=
+		      dsh->databufoffset + dsh->databufsize)) {
+			rc = dshandle_reset_buffer_position_to_track(dsh,
+								     reltrk);
+			if (rc)
+				return rc;
+		}
+	} else if (!dshandle_find_seekelement(dsh, offset, &se_index)) {
 		/* do not reset our context if we can seek forward from
 		 * our current position */
 		if (!(dsh->seekbuf[se_index].databufoffset < dsh->databufoffset
@@ -3913,6 +5384,38 @@ void lzds_dshandle_get_offset(struct dshandle *dsh, long long *offset)
 	*offset = dsh->databufoffset + dsh->bufpos;
 }
 
+/**
+ * Read data from the given offset, independent of the current position.
+ * This is a combination of lzds_dshandle_lseek and lzds_dshandle_read,
+ * but seeking is skipped if the current position already matches the
+ * offset, so that sequential reads do not need to seek at all.
+ *
+ * @param[in]  dsh    The dshandle that keeps track of the I/O operations.
+ * @param[in]  buf    The target buffer for the read data.
+ * @param[in]  size   The number of bytes that are to be read.
+ * @param[in]  offset The data offset in the dataset to read from.
+ * @param[out] rcsize Reference to a variable in which the actual number
+ *                    of read bytes is returned.
+ *                    If this is 0, the end of the file is reached.
+ * @return     0 on success, otherwise one of the error codes of
+ *             lzds_dshandle_lseek and lzds_dshandle_read.
+ */
+int lzds_dshandle_pread(struct dshandle *dsh, char *buf, size_t size,
+			long long offset, ssize_t *rcsize)
+{
+	long long rcoffset;
+	int rc;
+
+	*rcsize = 0;
+	lzds_dshandle_get_offset(dsh, &rcoffset);
+	if (rcoffset != offset) {
+		rc = lzds_dshandle_lseek(dsh, offset, &rcoffset);
+		if (rc)
+			return rc;
+	}
+	return lzds_dshandle_read(dsh, buf, size, rcsize);
+}
+
 /**
  * @param[in]  dsh    The dshandle that keeps track of the I/O operations.
  * @param[out] log    Reference to a variable in which the errorlog
@@ -3982,6 +5485,9 @@ int lzds_analyse_open_count(struct zdsroot *root, int warn)
 	int rc = 0;
 
 	util_list_iterate(root->dasdlist, dasd) {
+		/* image files are not shared with other systems */
+		if (dasd->is_image)
+			continue;
 		value = dasd_get_host_access_count(dasd->device);
 
 		if (value < 0) {
@@ -12,6 +12,7 @@
 #include <getopt.h>
 #include <linux/types.h>
 #include <mntent.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -24,6 +25,9 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "lib/util_hash.h"
+#include "lib/util_libc.h"
+
 #include "mon_fsstatd.h"
 
 static int attach;
@@ -31,6 +35,8 @@ static int mw_dev;
 static char small_mon_record[SMALL_MON_RECORD_LEN];
 static char large_mon_record[LARGE_MON_RECORD_LEN];
 static long sample_interval = 60;
+static long change_delta;
+static long refresh_intervals = 10;
 
 static const char *pid_file = "/run/mon_fsstatd.pid";
 
@@ -42,6 +48,27 @@ struct mw_name_lens {
 	__u16  mw_total;
 };
 
+/*
+ * Cached mount table entry with the values last written for it
+ */
+struct fs_ent {
+	char *fsname;
+	char *dir;
+	char *type;
+	/* Mounts with equal key return equal statvfs data */
+	char *key;
+	struct mw_name_lens lens;
+	int mod_level;
+	int written;
+	int sampled;
+	struct statvfs buf;
+	struct statvfs last;
+};
+
+static struct fs_ent *fs_tbl;
+static int fs_cnt, fs_size;
+static int mountinfo_fd = -1;
+
 /*
  * Clean up when SIGTERM or SIGINT received
  */
@@ -128,13 +155,13 @@ static void stop_unused(int curr_max, int prev_max)
 /*
  * Calculate lengths of data to be written to monitor stream
  */
-static struct mw_name_lens fsstatd_get_lens(struct mntent *ent)
+static struct mw_name_lens fsstatd_get_lens(struct fs_ent *ent)
 {
 	struct mw_name_lens name_lens;
 
-	name_lens.mw_name_len = strlen(ent->mnt_fsname);
-	name_lens.mw_dir_len = strlen(ent->mnt_dir);
-	name_lens.mw_type_len = strlen(ent->mnt_type);
+	name_lens.mw_name_len = strlen(ent->fsname);
+	name_lens.mw_dir_len = strlen(ent->dir);
+	name_lens.mw_type_len = strlen(ent->type);
 	/* if name & dir too long to fit both, truncate them */
 	if (name_lens.mw_name_len +
 	    name_lens.mw_dir_len +
@@ -157,25 +184,46 @@ static struct mw_name_lens fsstatd_get_lens(struct mntent *ent)
 	return name_lens;
 }
 
+/*
+ * Check if the monitor record for ent fits into a small buffer
+ */
+static int fsstatd_is_small(struct fs_ent *ent)
+{
+	return ent->lens.mw_total + sizeof(struct monwrite_hdr) <=
+		sizeof(small_mon_record);
+}
+
+/*
+ * Assign the next free small or big buffer mod_level to ent
+ */
+static void fsstatd_assign_level(struct fs_ent *ent, int *small_maxp,
+				 int *big_maxp)
+{
+	if (fsstatd_is_small(ent)) {
+		ent->mod_level = *small_maxp;
+		*small_maxp += 2;
+	} else {
+		ent->mod_level = *big_maxp;
+		*big_maxp += 2;
+	}
+}
+
 /*
  * Write fs data for ent to monitor stream
  */
-static void fsstatd_write_ent(struct mntent *ent, time_t curr_time,
-			int *small_maxp, int *big_maxp, struct statvfs buf)
+static void fsstatd_write_ent(struct fs_ent *ent, time_t curr_time)
 {
 	struct monwrite_hdr *mw_hdrp;
 	struct fsstatd_hdr *mw_fshdrp;
 	struct fsstatd_data *mw_fsdatap;
+	struct statvfs buf = ent->buf;
 
 	char *mw_tmpp;
 	char *mw_bufp;
-	struct mw_name_lens mw_lens;
+	struct mw_name_lens mw_lens = ent->lens;
 	int write_len;
 
-	mw_lens = fsstatd_get_lens(ent);
-
-	if ((mw_lens.mw_total + sizeof(struct monwrite_hdr))
-	    <= sizeof(small_mon_record)) {
+	if (fsstatd_is_small(ent)) {
 		mw_bufp = small_mon_record;
 		memset(&small_mon_record, 0, sizeof(small_mon_record));
 		mw_hdrp = (struct monwrite_hdr *)mw_bufp;
@@ -183,8 +231,6 @@ static void fsstatd_write_ent(struct mntent *ent, time_t curr_time,
 		mw_hdrp->datalen = sizeof(small_mon_record) -
 				   sizeof(struct monwrite_hdr);
 		write_len = sizeof(small_mon_record);
-		mw_hdrp->mod_level = *small_maxp;
-		*small_maxp += 2;
 	} else {
 		mw_bufp = large_mon_record;
 		memset(&large_mon_record, 0, sizeof(large_mon_record));
@@ -192,9 +238,8 @@ static void fsstatd_write_ent(struct mntent *ent, time_t curr_time,
 		mw_hdrp->datalen = sizeof(large_mon_record) -
 				   sizeof(struct monwrite_hdr);
 		write_len = sizeof(large_mon_record);
-		mw_hdrp->mod_level = *big_maxp;
-		*big_maxp += 2;
 	}
+	mw_hdrp->mod_level = ent->mod_level;
 
 	/* fill in rest of monwrite_hdr */
 	mw_tmpp = mw_bufp;
@@ -213,15 +258,15 @@ static void fsstatd_write_ent(struct mntent *ent, time_t curr_time,
 	mw_tmpp += sizeof(struct fsstatd_hdr);
 	memcpy(mw_tmpp, &mw_lens.mw_name_len, sizeof(__u16));
 	mw_tmpp += sizeof(__u16);
-	strncpy(mw_tmpp, ent->mnt_fsname, mw_lens.mw_name_len);
+	strncpy(mw_tmpp, ent->fsname, mw_lens.mw_name_len);
 	mw_tmpp += mw_lens.mw_name_len;
 	memcpy(mw_tmpp, &mw_lens.mw_dir_len, sizeof(__u16));
 	mw_tmpp += sizeof(__u16);
-	strncpy(mw_tmpp, ent->mnt_dir, mw_lens.mw_dir_len);
+	strncpy(mw_tmpp, ent->dir, mw_lens.mw_dir_len);
 	mw_tmpp += mw_lens.mw_dir_len;
 	memcpy(mw_tmpp, &mw_lens.mw_type_len, sizeof(__u16));
 	mw_tmpp += sizeof(__u16);
-	strncpy(mw_tmpp, ent->mnt_type, mw_lens.mw_type_len);
+	strncpy(mw_tmpp, ent->type, mw_lens.mw_type_len);
 
 	/* fill in fsstatd_data */
 	mw_tmpp += mw_lens.mw_type_len;
@@ -238,6 +283,152 @@ static void fsstatd_write_ent(struct mntent *ent, time_t curr_time,
 
 	if (write(mw_dev, mw_bufp, write_len) == -1)
 		syslog(LOG_ERR, "write error: %s\n", strerror(errno));
+	ent->last = buf;
+	ent->written = 1;
+}
+
+/*
+ * Check for file system types without physical size data
+ */
+static int fsstatd_type_ignored(const char *type)
+{
+	return strncmp(type, "autofs", 6) == 0 ||
+		strncmp(type, "none", 4) == 0 ||
+		strncmp(type, "proc", 4) == 0 ||
+		strncmp(type, "subfs", 5) == 0 ||
+		strncmp(type, "nfsd", 4) == 0 ||
+		strncmp(type, "tmpfs", 5) == 0 ||
+		strncmp(type, "sysfs", 5) == 0 ||
+		strncmp(type, "pstore", 6) == 0 ||
+		strncmp(type, "cgroup", 6) == 0 ||
+		strncmp(type, "mqueue", 6) == 0 ||
+		strncmp(type, "devpts", 6) == 0 ||
+		strncmp(type, "debugfs", 7) == 0 ||
+		strncmp(type, "devtmpfs", 8) == 0 ||
+		strncmp(type, "configfs", 8) == 0 ||
+		strncmp(type, "selinuxfs", 9) == 0 ||
+		strncmp(type, "hugetlbfs", 9) == 0 ||
+		strncmp(type, "securityfs", 10) == 0 ||
+		strncmp(type, "rpc_pipefs", 10) == 0 ||
+		strncmp(type, "binfmt_misc", 11) == 0 ||
+		strncmp(type, "ignore", 6) == 0;
+}
+
+/*
+ * Free the cached mount table
+ */
+static void fs_tbl_clear(void)
+{
+	int i;
+
+	for (i = 0; i < fs_cnt; i++) {
+		free(fs_tbl[i].fsname);
+		free(fs_tbl[i].dir);
+		free(fs_tbl[i].type);
+		free(fs_tbl[i].key);
+	}
+	fs_cnt = 0;
+}
+
+/*
+ * Add a mount to the cached mount table
+ */
+static void fs_tbl_add(const char *fsname, const char *dir, const char *type,
+		       char *key)
+{
+	struct fs_ent *ent;
+
+	if (fsstatd_type_ignored(type)) {
+		free(key);
+		return;
+	}
+	if (fs_cnt == fs_size) {
+		fs_size = fs_size ? fs_size * 2 : 64;
+		fs_tbl = util_realloc(fs_tbl, fs_size * sizeof(*fs_tbl));
+	}
+	ent = &fs_tbl[fs_cnt++];
+	memset(ent, 0, sizeof(*ent));
+	ent->fsname = util_strdup(fsname);
+	ent->dir = util_strdup(dir);
+	ent->type = util_strdup(type);
+	ent->key = key;
+	ent->lens = fsstatd_get_lens(ent);
+}
+
+/*
+ * Decode octal escapes like "\040" used in /proc/self/mountinfo
+ */
+static char *mountinfo_unescape(char *str)
+{
+	char *from = str, *to = str;
+
+	while (*from) {
+		if (from[0] == '\\' && from[1] >= '0' && from[1] <= '3' &&
+		    from[2] >= '0' && from[2] <= '7' &&
+		    from[3] >= '0' && from[3] <= '7') {
+			*to++ = (from[1] - '0') << 6 | (from[2] - '0') << 3 |
+				(from[3] - '0');
+			from += 4;
+		} else {
+			*to++ = *from++;
+		}
+	}
+	*to = 0;
+	return str;
+}
+
+/*
+ * Read the mount table from /proc/self/mountinfo
+ *
+ * Line format: ID PARENT MAJ:MIN ROOT DIR OPTIONS [OPTIONAL...] - TYPE
+ *              SOURCE SUPER_OPTIONS
+ */
+static int fs_tbl_read_mountinfo(void)
+{
+	char *data = NULL, *line, *next, *field[6], *type, *fsname, *sep, *key;
+	size_t size = 0, len = 0;
+	ssize_t rc;
+	int i;
+
+	do {
+		if (len + 1 >= size) {
+			size = size ? size * 2 : 16384;
+			data = util_realloc(data, size);
+		}
+		rc = pread(mountinfo_fd, data + len, size - len - 1, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			syslog(LOG_ERR, "cannot read /proc/self/mountinfo: "
+			       "%s\n", strerror(errno));
+			free(data);
+			return -1;
+		}
+		len += rc;
+	} while (rc > 0);
+	data[len] = 0;
+
+	for (line = data; line && *line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = 0;
+		for (i = 0; i < 6; i++)
+			field[i] = strsep(&line, " ");
+		sep = strstr(line ? line : "", "- ");
+		if (!field[5] || !sep)
+			continue;
+		sep += 2;
+		type = strsep(&sep, " ");
+		fsname = strsep(&sep, " ");
+		if (!fsname)
+			continue;
+		/* Device, root directory and per-mount options */
+		util_asprintf(&key, "%s %s %s", field[2], field[3], field[5]);
+		fs_tbl_add(mountinfo_unescape(fsname),
+			   mountinfo_unescape(field[4]), type, key);
+	}
+	free(data);
+	return 0;
 }
 
 /*
@@ -305,15 +496,137 @@ notify_parent:
 		exit(startup_rc);
 }
 
-static int fsstatd_do_work(void)
+/*
+ * Read the mount table from /etc/mtab if /proc/self/mountinfo is not
+ * available
+ */
+static int fs_tbl_read_mtab(void)
 {
+	struct mntent *ent;
 	FILE *mnttab;
 
+	mnttab = fopen("/etc/mtab", "r");
+	if (mnttab == NULL) {
+		syslog(LOG_ERR, "cannot open /etc/mtab: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	ent = getmntent(mnttab);
+	if (ent == NULL) {
+		syslog(LOG_ERR, "getmntent error: %s\n",
+			strerror(errno));
+		fclose(mnttab);
+		return -1;
+	}
+	while (ent) {
+		fs_tbl_add(ent->mnt_fsname, ent->mnt_dir, ent->mnt_type, NULL);
+		ent = getmntent(mnttab);
+	}
+	fclose(mnttab);
+	return 0;
+}
+
+/*
+ * Check if the mount table has changed since it was last read
+ *
+ * Without /proc/self/mountinfo the mount table is always re-read.
+ */
+static int fs_tbl_changed(void)
+{
+	struct pollfd pfd;
+
+	if (mountinfo_fd < 0)
+		return 1;
+	pfd.fd = mountinfo_fd;
+	pfd.events = POLLPRI;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0) < 0)
+		return 1;
+	return pfd.revents & (POLLPRI | POLLERR);
+}
+
+/*
+ * Re-read the cached mount table
+ */
+static int fs_tbl_read(void)
+{
+	fs_tbl_clear();
+	if (mountinfo_fd >= 0)
+		return fs_tbl_read_mountinfo();
+	return fs_tbl_read_mtab();
+}
+
+/*
+ * Call statvfs once for each group of mounts that share device, root
+ * directory and mount options, e.g. repeated bind mounts
+ */
+static void fs_tbl_sample(void)
+{
+	struct util_hash *done;
+	struct fs_ent *ent, *prev;
+	int i;
+
+	done = util_hash_new(UTIL_HASH_KEY_STR, fs_cnt);
+	for (i = 0; i < fs_cnt; i++) {
+		ent = &fs_tbl[i];
+		prev = ent->key ? util_hash_get_str(done, ent->key) : NULL;
+		if (prev) {
+			ent->sampled = prev->sampled;
+			ent->buf = prev->buf;
+			continue;
+		}
+		ent->sampled = statvfs(ent->dir, &ent->buf) == 0;
+		if (!ent->sampled)
+			syslog(LOG_ERR, "statvfs error on %s: %s\n",
+				ent->dir, strerror(errno));
+		if (ent->key)
+			util_hash_set_str(done, ent->key, ent);
+	}
+	util_hash_free(done, NULL);
+}
+
+/*
+ * Check if a free count moved by more than the configured delta
+ */
+static int fs_value_moved(__u64 old, __u64 new, __u64 total)
+{
+	__u64 diff = old > new ? old - new : new - old;
+
+	return diff * 100 > (__u64) change_delta * total;
+}
+
+/*
+ * Check if the values of ent differ from the last written values
+ */
+static int fs_ent_changed(struct fs_ent *ent)
+{
+	struct statvfs *old = &ent->last, *new = &ent->buf;
+
+	if (old->f_bsize != new->f_bsize || old->f_frsize != new->f_frsize ||
+	    old->f_blocks != new->f_blocks || old->f_files != new->f_files ||
+	    old->f_flag != new->f_flag)
+		return 1;
+	return fs_value_moved(old->f_bfree, new->f_bfree, new->f_blocks) ||
+		fs_value_moved(old->f_bavail, new->f_bavail, new->f_blocks) ||
+		fs_value_moved(old->f_ffree, new->f_ffree, new->f_files) ||
+		fs_value_moved(old->f_favail, new->f_favail, new->f_files);
+}
+
+/*
+ * Check if a record should be written for ent
+ */
+static int fs_ent_wanted(struct fs_ent *ent)
+{
+	return ent->sampled && ent->buf.f_blocks > 0;
+}
+
+static int fsstatd_do_work(void)
+{
 	time_t curr_time;
-	struct statvfs buf;
-	struct mntent *ent;
+	struct fs_ent *ent;
 
-	int result;
+	int i, full;
+	int intervals = 0, loaded = 0;
 	int curr_small_max, prev_small_max;
 	int curr_big_max, prev_big_max;
 
@@ -323,63 +636,46 @@ static int fsstatd_do_work(void)
 	 */
 	prev_small_max = 0;
 	prev_big_max = 1;
+	mountinfo_fd = open("/proc/self/mountinfo", O_RDONLY);
 	syslog(LOG_INFO, "sample interval: %lu\n", sample_interval);
 	while (1) {
 		time(&curr_time);
-		mnttab = fopen("/etc/mtab", "r");
-		if (mnttab == NULL) {
-			syslog(LOG_ERR, "cannot open /etc/mtab: %s\n",
-				strerror(errno));
-			break;
+		full = ++intervals >= refresh_intervals;
+		if (!loaded || fs_tbl_changed()) {
+			if (fs_tbl_read())
+				break;
+			loaded = 1;
+			full = 1;
 		}
-		curr_small_max = 0;
-		curr_big_max = 1;
-
-		ent = getmntent(mnttab);
-		if (ent == NULL) {
-			syslog(LOG_ERR, "getmntent error: %s\n",
-				strerror(errno));
-			fclose(mnttab);
-			break;
+		fs_tbl_sample();
+		/* File systems that appear or disappear need new mod_levels */
+		for (i = 0; i < fs_cnt && !full; i++) {
+			if (fs_ent_wanted(&fs_tbl[i]) != fs_tbl[i].written)
+				full = 1;
 		}
 
-		while (ent) {
-			/* Only sample physical filesystem size data */
-			if ((strncmp(ent->mnt_type, "autofs", 6) == 0 ||
-			     strncmp(ent->mnt_type, "none", 4) == 0 ||
-			     strncmp(ent->mnt_type, "proc", 4) == 0 ||
-			     strncmp(ent->mnt_type, "subfs", 5) == 0 ||
-			     strncmp(ent->mnt_type, "nfsd", 4) == 0 ||
-			     strncmp(ent->mnt_type, "tmpfs", 5) == 0 ||
-			     strncmp(ent->mnt_type, "sysfs", 5) == 0 ||
-			     strncmp(ent->mnt_type, "pstore", 6) == 0 ||
-			     strncmp(ent->mnt_type, "cgroup", 6) == 0 ||
-			     strncmp(ent->mnt_type, "mqueue", 6) == 0 ||
-			     strncmp(ent->mnt_type, "devpts", 6) == 0 ||
-			     strncmp(ent->mnt_type, "debugfs", 7) == 0 ||
-			     strncmp(ent->mnt_type, "devtmpfs", 8) == 0 ||
-			     strncmp(ent->mnt_type, "configfs", 8) == 0 ||
-			     strncmp(ent->mnt_type, "selinuxfs", 9) == 0 ||
-			     strncmp(ent->mnt_type, "hugetlbfs", 9) == 0 ||
-			     strncmp(ent->mnt_type, "securityfs", 10) == 0 ||
-			     strncmp(ent->mnt_type, "rpc_pipefs", 10) == 0 ||
-			     strncmp(ent->mnt_type, "binfmt_misc", 11) == 0 ||
-			     strncmp(ent->mnt_type, "ignore", 6) == 0)) {
-				ent = getmntent(mnttab);
-				continue;
-			}
-			result = statvfs(ent->mnt_dir, &buf);
-			if (result != 0) {
-				syslog(LOG_ERR, "statvfs error on %s: %s\n",
-					ent->mnt_dir, strerror(errno));
-				ent = getmntent(mnttab);
-				continue;
+		if (!full) {
+			/* Monitor buffers keep their data until rewritten */
+			for (i = 0; i < fs_cnt; i++) {
+				ent = &fs_tbl[i];
+				if (ent->written && fs_ent_changed(ent))
+					fsstatd_write_ent(ent, curr_time);
 			}
+			sleep(sample_interval);
+			continue;
+		}
 
-			if (buf.f_blocks > 0)
-				fsstatd_write_ent(ent, curr_time,
-					&curr_small_max, &curr_big_max, buf);
-			ent = getmntent(mnttab);
+		intervals = 0;
+		curr_small_max = 0;
+		curr_big_max = 1;
+		for (i = 0; i < fs_cnt; i++) {
+			ent = &fs_tbl[i];
+			ent->written = 0;
+			if (!fs_ent_wanted(ent))
+				continue;
+			fsstatd_assign_level(ent, &curr_small_max,
+					     &curr_big_max);
+			fsstatd_write_ent(ent, curr_time);
 		}
 
 		if (curr_small_max < prev_small_max)
@@ -389,7 +685,6 @@ static int fsstatd_do_work(void)
 
 		prev_small_max = curr_small_max;
 		prev_big_max = curr_big_max;
-		fclose(mnttab);
 		sleep(sample_interval);
 	}
 	return 1;
@@ -427,6 +722,22 @@ static int parse_options(int argc, char **argv)
 				return(1);
 			}
 			break;
+		case 'd':
+			change_delta = strtol(optarg, NULL, 10);
+			if (change_delta < 0 || change_delta > 100) {
+				fprintf(stderr, "Error: Invalid delta "
+					"(needs to be between 0 and 100)\n");
+				return(1);
+			}
+			break;
+		case 'r':
+			refresh_intervals = strtol(optarg, NULL, 10);
+			if (refresh_intervals <= 0) {
+				fprintf(stderr, "Error: Invalid refresh "
+					"(needs to be greater than 0)\n");
+				return(1);
+			}
+			break;
 		default:
 			fprintf(stderr, "Try ' --help' for more"
 				" information.\n");
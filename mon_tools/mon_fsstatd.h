@@ -67,10 +67,12 @@ static struct option options[] = {
 	{"version", no_argument, NULL, 'v'},
 	{"attach", no_argument, NULL, 'a'},
 	{"interval", required_argument, NULL, 'i'},
+	{"delta", required_argument, NULL, 'd'},
+	{"refresh", required_argument, NULL, 'r'},
 	{NULL, 0, NULL, 0}
 };
 
-static const char opt_string[] = "+hvai:";
+static const char opt_string[] = "+hvai:d:r:";
 
 static const char help_text[] =
 	"mon_fsstatd: Daemon that writes file system utilization information\n"
@@ -82,6 +84,11 @@ static const char help_text[] =
 	"-h, --help               Print this help, then exit\n"
 	"-v, --version            Print version information, then exit\n"
 	"-a, --attach             Run in foreground\n"
-	"-i, --interval=<seconds> Sample interval\n";
+	"-i, --interval=<seconds> Sample interval\n"
+	"-d, --delta=<percent>    Only update a file system when free space or\n"
+	"                         inodes moved by more than <percent> of the\n"
+	"                         total (default 0)\n"
+	"-r, --refresh=<count>    Update all file systems every <count> sample\n"
+	"                         intervals (default 10)\n";
 #endif
 
@@ -13,6 +13,9 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <grp.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
 #include <linux/types.h>
 #include <pwd.h>
 #include <signal.h>
@@ -21,6 +24,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/dir.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 #include <sys/vfs.h>
@@ -29,8 +34,15 @@
 #include <unistd.h>
 #include <utmp.h>
 
+#include "lib/util_hash.h"
+#include "lib/util_libc.h"
+#include "lib/util_proc.h"
+
 #include "mon_procd.h"
 
+/* File descriptors that are not used for caching /proc files */
+#define FD_RESERVE 64
+
 struct name_lens_t {
 	__u16 ruser_len;
 	__u16 euser_len;
@@ -43,12 +55,20 @@ struct name_lens_t {
 static int num_cpus;
 static int curr_small_max, curr_big_max;
 static int prev_small_max, prev_big_max;
-static unsigned int pg_to_kb_shift, sort_tbl_size;
+static unsigned int pg_to_kb_shift;
 static float e_time;
 static struct timeval prev_time, curr_time;
 static struct cpudata_t cpudata;
 static struct proc_sum_t proc_sum;
-static struct task_sort_t *prev_sort_tbl, *curr_sort_tbl;
+static struct util_hash *task_tbl;
+static unsigned long task_gen;
+static struct task_state *top_tbl[MAX_TASK_REC];
+static unsigned int top_cnt;
+static unsigned long cached_fds, max_cached_fds;
+static int use_events;
+static int proc_cn_fd = -1;
+static int proc_cn_rescan;
+static char proc_cn_buf[BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
 static struct name_lens_t name_lens;
 
 static int attach;
@@ -56,6 +76,24 @@ static int mw_dev;
 static char *temp;
 static char fname[32];
 static char buf[BUF_SIZE];
+static struct util_proc_kv kv[BUF_SIZE / 4];
+
+/* Indexes of fields in /proc/<pid>/stat, see proc(5) */
+enum {
+	STAT_STATE = 2,
+	STAT_PPID = 3,
+	STAT_TTY = 6,
+	STAT_FLAGS = 8,
+	STAT_MAJFLT = 11,
+	STAT_UTIME = 13,
+	STAT_STIME = 14,
+	STAT_CUTIME = 15,
+	STAT_CSTIME = 16,
+	STAT_PRIORITY = 17,
+	STAT_NICE = 18,
+	STAT_PROCESSOR = 38,
+	STAT_FIELDS
+};
 static char mon_record[MAX_REC_LEN];
 static long sample_interval = 60;
 
@@ -207,7 +245,7 @@ static int read_file(char *fname, char *buf, int size)
 	int num, fp;
 
 	fp = open(fname, O_RDONLY);
-	if (!fp)
+	if (fp < 0)
 		return -1;
 
 	num = read(fp, buf, size);
@@ -221,6 +259,138 @@ static int read_file(char *fname, char *buf, int size)
 	return num;
 }
 
+/*
+ * Read a /proc file with "key value" lines into buf and split it into kv.
+ * Return the number of entries or -1 on error.
+*/
+static int read_kv_file(char *name)
+{
+	int num;
+
+	num = read_file(name, buf, sizeof(buf) - 1);
+	if (num <= 0)
+		return -1;
+	return util_proc_kv_parse(buf, num, kv, ARRAY_SIZE(kv));
+}
+
+/*
+ * Return the number at the start of the value of key in the num entries
+ * of kv. Log an error using file name fname if the key is missing.
+*/
+static unsigned long long kv_value(int num, int *pos, const char *key,
+				   const char *name)
+{
+	const char *value;
+
+	value = util_proc_kv_get(kv, num, key, pos);
+	if (!value) {
+		syslog(LOG_ERR, "no %s in %s\n", key, name);
+		return 0;
+	}
+	return strtoull(value, NULL, 10);
+}
+
+/*
+ * Read /proc/<pid>/<name> of a task into buf, terminated with '\0'
+ *
+ * The file is kept open in "fd" and re-read from offset 0 in the next
+ * interval as long as the number of cached file descriptors is below the
+ * limit. Once the task has exited, reads from the file fail.
+*/
+static int read_task_file(struct task_state *ts, int *fd, const char *name)
+{
+	int num;
+
+	snprintf(fname, sizeof(fname), "/proc/%u/%s", ts->pid, name);
+	if (*fd < 0) {
+		*fd = open(fname, O_RDONLY);
+		if (*fd < 0)
+			return -1;
+		cached_fds++;
+	}
+	num = pread(*fd, buf, sizeof(buf) - 1, 0);
+	if (num < 0 || cached_fds > max_cached_fds) {
+		close(*fd);
+		*fd = -1;
+		cached_fds--;
+		if (num < 0)
+			return -1;
+	}
+	buf[num] = '\0';
+	return num;
+}
+
+/*
+ * Raise the file descriptor limit so that /proc files of tasks can be kept
+ * open between intervals
+*/
+static void init_fd_cache(void)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl))
+		return;
+	if (rl.rlim_max != RLIM_INFINITY && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		if (setrlimit(RLIMIT_NOFILE, &rl))
+			getrlimit(RLIMIT_NOFILE, &rl);
+	}
+	if (rl.rlim_cur > FD_RESERVE)
+		max_cached_fds = rl.rlim_cur - FD_RESERVE;
+}
+
+/*
+ * Close cached files and forget everything known about a task
+*/
+static void task_state_reset(struct task_state *ts)
+{
+	if (ts->stat_fd >= 0) {
+		close(ts->stat_fd);
+		cached_fds--;
+	}
+	if (ts->statm_fd >= 0) {
+		close(ts->statm_fd);
+		cached_fds--;
+	}
+	ts->stat_fd = -1;
+	ts->statm_fd = -1;
+	ts->tics = 0;
+	ts->prev_tics = 0;
+	ts->comm[0] = '\0';
+	free(ts->cmdline);
+	ts->cmdline = NULL;
+	ts->cmdline_len = 0;
+}
+
+/*
+ * Get state of a task that was seen in an earlier interval or create it
+*/
+static struct task_state *task_state_get(__u32 pid)
+{
+	struct task_state *ts;
+
+	ts = util_hash_get_int(task_tbl, pid);
+	if (ts)
+		return ts;
+	ts = util_zalloc(sizeof(*ts));
+	ts->pid = pid;
+	ts->stat_fd = -1;
+	ts->statm_fd = -1;
+	util_hash_set_int(task_tbl, pid, ts);
+	return ts;
+}
+
+/*
+ * Free state of a task
+*/
+static void task_state_free(void *data)
+{
+	struct task_state *ts = data;
+
+	task_state_reset(ts);
+	free(ts);
+}
+
 /*
  * Get uptime
 */
@@ -328,14 +498,17 @@ static void cal_cpu(struct cpudata_t *cpudt, struct cpu_t *cpu)
 static void read_cpu(void)
 {
 	unsigned long long u, n, s, i, w, x, y, z;
+	const char *value;
+	int num;
 
-	if (read_file("/proc/stat", buf, sizeof(buf) - 1) <= 0)
+	num = read_kv_file("/proc/stat");
+	if (num < 0)
 		return;
 
 	u = n = s = i = w = x = y = z = 0;
-	temp = strstr(buf, "cpu");
-	if (temp)
-		sscanf(temp, "cpu %Lu %Lu %Lu %Lu %Lu %Lu %Lu %Lu",
+	value = util_proc_kv_get(kv, num, "cpu", NULL);
+	if (value)
+		sscanf(value, "%Lu %Lu %Lu %Lu %Lu %Lu %Lu %Lu",
 			&u, &n, &s, &i, &w, &x, &y, &z);
 	else
 		syslog(LOG_ERR, "no cpu in /proc/stat\n");
@@ -358,41 +531,19 @@ static void read_mem(void)
 {
 	unsigned long long mtotal, mfree, mbuf;
 	unsigned long long stotal, sfree, scached;
+	int num, pos = 0;
 
-	if (read_file("/proc/meminfo", buf, sizeof(buf) - 1) <= 0)
+	num = read_kv_file("/proc/meminfo");
+	if (num < 0)
 		return;
 
-	mtotal = mfree = mbuf = stotal = sfree = scached = 0;
-	temp = strstr(buf, "MemTotal");
-	if (temp)
-		sscanf(temp, "MemTotal: %Lu kB", &mtotal);
-	else
-		syslog(LOG_ERR, "no MemTotal in /proc/meminfo\n");
-	temp = strstr(buf, "MemFree");
-	if (temp)
-		sscanf(temp, "MemFree: %Lu kB", &mfree);
-	else
-		syslog(LOG_ERR, "no MemFree in /proc/meminfo\n");
-	temp = strstr(buf, "Buffers");
-	if (temp)
-		sscanf(temp, "Buffers: %Lu kB", &mbuf);
-	else
-		syslog(LOG_ERR, "no Buffers in /proc/meminfo\n");
-	temp = strstr(buf, "SwapTotal");
-	if (temp)
-		sscanf(temp, "SwapTotal: %Lu kB", &stotal);
-	else
-		syslog(LOG_ERR, "no SwapTotal in /proc/meminfo\n");
-	temp = strstr(buf, "SwapFree");
-	if (temp)
-		sscanf(temp, "SwapFree: %Lu kB", &sfree);
-	else
-		syslog(LOG_ERR, "no SwapFree in /proc/meminfo\n");
-	temp = strstr(buf, "Cached");
-	if (temp)
-		sscanf(temp, "Cached: %Lu kB", &scached);
-	else
-		syslog(LOG_ERR, "no Cached in /proc/meminfo\n");
+	/* Keys in the order listed in /proc/meminfo */
+	mtotal = kv_value(num, &pos, "MemTotal", "/proc/meminfo");
+	mfree = kv_value(num, &pos, "MemFree", "/proc/meminfo");
+	mbuf = kv_value(num, &pos, "Buffers", "/proc/meminfo");
+	scached = kv_value(num, &pos, "Cached", "/proc/meminfo");
+	stotal = kv_value(num, &pos, "SwapTotal", "/proc/meminfo");
+	sfree = kv_value(num, &pos, "SwapFree", "/proc/meminfo");
 
 	proc_sum.mem.total = (__u64)mtotal;
 	proc_sum.mem.free = (__u64)mfree;
@@ -410,31 +561,17 @@ static void read_mem(void)
 static void read_vmem(void)
 {
 	unsigned long long pgin, pgout, swpin, swpout;
+	int num, pos = 0;
 
-	if (read_file("/proc/vmstat", buf, sizeof(buf) - 1) <= 0)
+	num = read_kv_file("/proc/vmstat");
+	if (num < 0)
 		return;
 
-	pgin = pgout = swpin = swpout = 0;
-	temp = strstr(buf, "pgpgin");
-	if (temp)
-		sscanf(temp, "pgpgin %Lu", &pgin);
-	else
-		syslog(LOG_ERR, "no pgpgin in /proc/vmstat\n");
-	temp = strstr(buf, "pgpgout");
-	if (temp)
-		sscanf(temp, "pgpgout %Lu", &pgout);
-	else
-		syslog(LOG_ERR, "no pgpgout in /proc/vmstat\n");
-	temp = strstr(buf, "pswpin");
-	if (temp)
-		sscanf(temp, "pswpin %Lu", &swpin);
-	else
-		syslog(LOG_ERR, "no pswpin in /proc/vmstat\n");
-	temp = strstr(buf, "pswpout");
-	if (temp)
-		sscanf(temp, "pswpout %Lu", &swpout);
-	else
-		syslog(LOG_ERR, "no pswpout in /proc/vmstat\n");
+	/* Keys in the order listed in /proc/vmstat */
+	pgin = kv_value(num, &pos, "pgpgin", "/proc/vmstat");
+	pgout = kv_value(num, &pos, "pgpgout", "/proc/vmstat");
+	swpin = kv_value(num, &pos, "pswpin", "/proc/vmstat");
+	swpout = kv_value(num, &pos, "pswpout", "/proc/vmstat");
 
 	proc_sum.mem.pgpgin = (__u64)(pgin << pg_to_kb_shift);
 	proc_sum.mem.pgpgout = (__u64)(pgout << pg_to_kb_shift);
@@ -458,12 +595,11 @@ static void read_summary(void)
 /*
  * Get memory information for a task
 */
-static int read_statm(struct task_t *task)
+static int read_statm(struct task_t *task, struct task_state *ts)
 {
 	long size, res, sh, trs, lrs, drs, dt;
 
-	snprintf(fname, sizeof(fname), "/proc/%u/statm", task->pid);
-	if (read_file(fname, buf, sizeof(buf) - 1) == -1)
+	if (read_task_file(ts, &ts->statm_fd, "statm") == -1)
 		return 0;
 
 	sscanf(buf, "%ld %ld %ld %ld %ld %ld %ld",
@@ -485,24 +621,26 @@ static int read_statm(struct task_t *task)
 */
 static int read_status(struct task_t *task)
 {
-	int ruid, euid, egid;
+	int ruid, euid, egid, num, pos = 0;
 	char *lenp, *namep;
+	const char *value;
 	struct passwd *pwd;
 	struct group *grp;
 
 	snprintf(fname, sizeof(fname), "/proc/%u/status", task->pid);
-	if (read_file(fname, buf, sizeof(buf) - 1) == -1)
+	num = read_kv_file(fname);
+	if (num < 0)
 		return 0;
 
 	ruid = euid = egid = 0;
-	temp = strstr(buf, "Uid");
-	if (temp)
-		sscanf(temp, "Uid: %d %d", &ruid, &euid);
+	value = util_proc_kv_get(kv, num, "Uid", &pos);
+	if (value)
+		sscanf(value, "%d %d", &ruid, &euid);
 	else
 		syslog(LOG_ERR, "no Uid in /proc/%u/status\n", task->pid);
-	temp = strstr(buf, "Gid");
-	if (temp)
-		sscanf(temp, "Gid: %*d %d", &egid);
+	value = util_proc_kv_get(kv, num, "Gid", &pos);
+	if (value)
+		sscanf(value, "%*d %d", &egid);
 	else
 		syslog(LOG_ERR, "no Gid in /proc/%u/status\n", task->pid);
 	task->euid = (__u16)euid;
@@ -553,37 +691,14 @@ static int read_status(struct task_t *task)
 /*
  * Calculate percentage of CPU used by a task since last sampling
 */
-static void cal_task_pcpu(struct task_t *task, const unsigned long long tics)
+static void cal_task_pcpu(struct task_t *task, struct task_state *ts,
+			  const unsigned long long tics)
 {
-	unsigned int i, size;
 	__u64 etics;
 
-	if (proc_sum.task.total + 1 >= sort_tbl_size) {
-		sort_tbl_size = sort_tbl_size * 5 / 4 + 100;
-		size = sort_tbl_size * sizeof(struct task_sort_t);
-		curr_sort_tbl = realloc(curr_sort_tbl, size);
-		if (!curr_sort_tbl) {
-			fprintf(stderr, "Allocating memory failed - "
-			"reason %s\n", strerror(errno));
-			exit(1);
-		}
-		prev_sort_tbl = realloc(prev_sort_tbl, size);
-		if (!prev_sort_tbl) {
-			fprintf(stderr, "Allocating memory failed - "
-			"reason %s\n", strerror(errno));
-			exit(1);
-		}
-	}
-	curr_sort_tbl[proc_sum.task.total].pid = task->pid;
-	curr_sort_tbl[proc_sum.task.total].tics = (__u64)tics;
-
 	etics = (__u64)tics;
-	for (i = 0; i < sort_tbl_size; i++) {
-		if (prev_sort_tbl[i].pid == task->pid) {
-			etics -= prev_sort_tbl[i].tics;
-			break;
-		}
-	}
+	if (etics >= ts->prev_tics)
+		etics -= ts->prev_tics;
 	task->pcpu = (__u16)((etics * 10000 / Hertz) / (e_time * num_cpus));
 	if (task->pcpu > 9999)
 		task->pcpu = 9999;
@@ -592,20 +707,27 @@ static void cal_task_pcpu(struct task_t *task, const unsigned long long tics)
 /*
  * Get status information for a task from /proc/.../stat
 */
-static int read_stat(struct task_t *task)
+static int read_stat(struct task_t *task, struct task_state *ts)
 {
 	unsigned long long maj_flt = 0, utime = 0, stime = 0, cutime = 0,
 			   cstime = 0;
 	unsigned long flags = 0, pri = 0, nice = 0;
 	char *cmd_start, *cmd_end, *cmdlenp, *cmdp;
-	int ppid = 0, tty = 0, proc = 0, rc;
+	int ppid = 0, tty = 0, proc = 0, num;
+	char *field[STAT_FIELDS];
 
-	snprintf(fname, sizeof(fname), "/proc/%u/stat", task->pid);
-	if (read_file(fname, buf, sizeof(buf) - 1) == -1)
+	if (read_task_file(ts, &ts->stat_fd, "stat") == -1)
 		return 0;
 
-	cmd_start = strchr(buf, '(') + 1;
+	num = util_proc_fields(buf, field, ARRAY_SIZE(field));
+	if (num < 2 || field[1][0] != '(') {
+		syslog(LOG_ERR, "bad data in %s \n", fname);
+		return 0;
+	}
+	cmd_start = field[1] + 1;
 	cmd_end = strrchr(cmd_start, ')');
+	if (!cmd_end)
+		cmd_end = cmd_start;
 	name_lens.cmd_len = cmd_end - cmd_start;
 	cmdlenp = mon_record + sizeof(struct monwrite_hdr);
 	cmdlenp += sizeof(struct procd_hdr);
@@ -625,26 +747,22 @@ static int read_stat(struct task_t *task)
 	}
 	memcpy(cmdlenp, &name_lens.cmd_len, sizeof(__u16));
 
-	cmd_end += 2;
-	rc = sscanf(cmd_end,
-		"%c %d %*d %*d %d %*d "
-		"%lu %*s %*s %Lu %*s "
-		"%Lu %Lu %Lu %Lu "
-		"%ld %ld "
-		"%*d %*s "
-		"%*s %*s %*s "
-		"%*s %*s %*s %*s %*s %*s "
-		"%*s %*s %*s %*s "
-		"%*s %*s %*s "
-		"%*d %d "
-		"%*s %*s",
-		&task->state, &ppid, &tty,
-		&flags, &maj_flt,
-		&utime, &stime, &cutime, &cstime,
-		&pri, &nice,
-		&proc);
-	if (rc != 12)
+	if (num == STAT_FIELDS) {
+		task->state = field[STAT_STATE][0];
+		ppid = atoi(field[STAT_PPID]);
+		tty = atoi(field[STAT_TTY]);
+		flags = strtoul(field[STAT_FLAGS], NULL, 10);
+		maj_flt = strtoull(field[STAT_MAJFLT], NULL, 10);
+		utime = strtoull(field[STAT_UTIME], NULL, 10);
+		stime = strtoull(field[STAT_STIME], NULL, 10);
+		cutime = strtoull(field[STAT_CUTIME], NULL, 10);
+		cstime = strtoull(field[STAT_CSTIME], NULL, 10);
+		pri = strtol(field[STAT_PRIORITY], NULL, 10);
+		nice = strtol(field[STAT_NICE], NULL, 10);
+		proc = atoi(field[STAT_PROCESSOR]);
+	} else {
 		syslog(LOG_ERR, "bad data in %s \n", fname);
+	}
 	task->ppid = (__u32)ppid;
 	task->tty = (__u16)tty;
 	task->flags = (__u32)flags;
@@ -655,7 +773,7 @@ static int read_stat(struct task_t *task)
 	task->total_time = (__u64)((utime + stime) * 100 / Hertz);
 	task->ctotal_time = (__u64)((utime + stime + cutime + cstime) * 100
 				/ Hertz);
-	cal_task_pcpu(task, utime + stime);
+	cal_task_pcpu(task, ts, utime + stime);
 
 	return 1;
 }
@@ -728,20 +846,28 @@ static int read_wchan(struct task_t *task)
 /*
  * Get command line of a task
 */
-static int read_cmdline(struct task_t *task)
+static int read_cmdline(struct task_t *task, struct task_state *ts)
 {
 	int i, num;
 	char *cmdlnlenp, *cmdlinep;
 
-	snprintf(fname, sizeof(fname), "/proc/%u/cmdline", task->pid);
-	num = read_file(fname, buf, sizeof(buf) - 1);
-	if (num == -1)
-		return 0;
-	for (i = 0; i < num; i++) {
-		if (buf[i] < ' ' || buf[i] > '~')
-			buf[i] = ' ';
+	/* The command line only changes on exec, which also changes comm */
+	if (!ts->cmdline) {
+		snprintf(fname, sizeof(fname), "/proc/%u/cmdline", task->pid);
+		num = read_file(fname, buf, sizeof(buf) - 1);
+		if (num == -1)
+			return 0;
+		for (i = 0; i < num; i++) {
+			if (buf[i] < ' ' || buf[i] > '~')
+				buf[i] = ' ';
+		}
+		if (num > MAX_CMD_LEN)
+			num = MAX_CMD_LEN;
+		ts->cmdline = util_malloc(num + 1);
+		memcpy(ts->cmdline, buf, num);
+		ts->cmdline_len = num;
 	}
-	name_lens.cmdline_len = num;
+	name_lens.cmdline_len = ts->cmdline_len;
 	cmdlnlenp = mon_record + sizeof(struct monwrite_hdr);
 	cmdlnlenp += sizeof(struct procd_hdr);
 	cmdlnlenp += sizeof(struct task_t);
@@ -754,7 +880,7 @@ static int read_cmdline(struct task_t *task)
 
 	memcpy(cmdlnlenp, &name_lens.cmdline_len, sizeof(__u16));
 	if (name_lens.cmdline_len > 0)
-		memcpy(cmdlinep, buf, name_lens.cmdline_len);
+		memcpy(cmdlinep, ts->cmdline, name_lens.cmdline_len);
 	return 1;
 }
 
@@ -763,8 +889,63 @@ static int read_cmdline(struct task_t *task)
 */
 static int sort_usage(const void *et1, const void *et2)
 {
-	return ((struct task_sort_t *)et2)->cpu_mem_usage
-		- ((struct task_sort_t *)et1)->cpu_mem_usage;
+	return (*(struct task_state **)et2)->cpu_mem_usage
+		- (*(struct task_state **)et1)->cpu_mem_usage;
+}
+
+/*
+ * Restore min-heap order of top_tbl downwards from position i
+*/
+static void top_sift_down(unsigned int i)
+{
+	struct task_state *tmp;
+	unsigned int min, l;
+
+	while (1) {
+		min = i;
+		l = 2 * i + 1;
+		if (l < top_cnt && top_tbl[l]->cpu_mem_usage <
+		    top_tbl[min]->cpu_mem_usage)
+			min = l;
+		if (l + 1 < top_cnt && top_tbl[l + 1]->cpu_mem_usage <
+		    top_tbl[min]->cpu_mem_usage)
+			min = l + 1;
+		if (min == i)
+			return;
+		tmp = top_tbl[i];
+		top_tbl[i] = top_tbl[min];
+		top_tbl[min] = tmp;
+		i = min;
+	}
+}
+
+/*
+ * Keep the MAX_TASK_REC tasks with the highest usage in a min-heap
+*/
+static void top_add(struct task_state *ts)
+{
+	struct task_state *tmp;
+	unsigned int i, parent;
+
+	if (top_cnt < MAX_TASK_REC) {
+		i = top_cnt++;
+		top_tbl[i] = ts;
+		while (i > 0) {
+			parent = (i - 1) / 2;
+			if (top_tbl[parent]->cpu_mem_usage <=
+			    top_tbl[i]->cpu_mem_usage)
+				break;
+			tmp = top_tbl[i];
+			top_tbl[i] = top_tbl[parent];
+			top_tbl[parent] = tmp;
+			i = parent;
+		}
+		return;
+	}
+	if (ts->cpu_mem_usage <= top_tbl[0]->cpu_mem_usage)
+		return;
+	top_tbl[0] = ts;
+	top_sift_down(0);
 }
 
 /*
@@ -810,46 +991,203 @@ static void task_count(char oldst, char newst)
 /*
  * Read and calculate memory and cpu usages of a task
 */
-static void task_usage(struct task_t *task)
+static int task_usage(struct task_t *task, struct task_state *ts)
 {
-	long res;
-	unsigned long long utime, stime;
+	unsigned long long utime = 0, stime = 0;
+	char *cmd_start, *cmd_end;
+	long res = 0;
+	int len;
 
-	snprintf(fname, sizeof(fname), "/proc/%u/statm", task->pid);
-	if (read_file(fname, buf, sizeof(buf) - 1) == -1)
-		return;
+	if (read_task_file(ts, &ts->statm_fd, "statm") == -1)
+		return 0;
 	sscanf(buf, "%*s %ld %*s %*s %*s %*s %*s", &res);
 	task->resident = (__u64)(res << pg_to_kb_shift);
 	task->pmem = (__u16)(task->resident * 10000 / proc_sum.mem.total);
 
-	snprintf(fname, sizeof(fname), "/proc/%u/stat", task->pid);
-	if (read_file(fname, buf, sizeof(buf) - 1) == -1)
-		return;
-	sscanf(buf,
-		"%*s %*s "
-		"%c %*s %*s %*s %*s %*s "
+	if (read_task_file(ts, &ts->stat_fd, "stat") == -1)
+		return 0;
+	cmd_start = strchr(buf, '(');
+	cmd_end = cmd_start ? strrchr(cmd_start, ')') : NULL;
+	if (!cmd_end)
+		return 0;
+	cmd_start++;
+	sscanf(cmd_end + 2,
+		"%c %*s %*s %*s %*s "
 		"%*s %*s %*s %*s %*s "
-		"%Lu %Lu ",
+		"%*s %Lu %Lu ",
 		&task->state,
 		&utime, &stime);
-	cal_task_pcpu(task, utime + stime);
 
-	curr_sort_tbl[proc_sum.task.total].cpu_mem_usage = task->pcpu +
-		task->pmem;
-	curr_sort_tbl[proc_sum.task.total].state = task->state;
+	/* A changed command name means exec, forget the old command line */
+	len = cmd_end - cmd_start;
+	if (len > MAX_NAME_LEN)
+		len = MAX_NAME_LEN;
+	if (strncmp(ts->comm, cmd_start, len) || ts->comm[len]) {
+		memcpy(ts->comm, cmd_start, len);
+		ts->comm[len] = '\0';
+		free(ts->cmdline);
+		ts->cmdline = NULL;
+	}
+	ts->prev_tics = ts->tics;
+	ts->tics = utime + stime;
+	cal_task_pcpu(task, ts, ts->tics);
+
+	ts->cpu_mem_usage = task->pcpu + task->pmem;
+	ts->state = task->state;
 	task_count('\0', task->state);
 	proc_sum.task.total++;
+	return 1;
 }
 
 /*
- * read tasks information and write to monitor stream
+ * Subscribe to process events from the proc connector
 */
-static void read_tasks(void)
+static void proc_cn_open(void)
+{
+	struct sockaddr_nl addr;
+	struct {
+		struct nlmsghdr nlh;
+		struct cn_msg cn;
+		enum proc_cn_mcast_op op;
+	} __attribute__((packed)) msg;
+	int fd;
+
+	fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		    NETLINK_CONNECTOR);
+	if (fd < 0)
+		goto out_err;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = CN_IDX_PROC;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		goto out_close;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.nlh.nlmsg_len = sizeof(msg);
+	msg.nlh.nlmsg_type = NLMSG_DONE;
+	msg.cn.id.idx = CN_IDX_PROC;
+	msg.cn.id.val = CN_VAL_PROC;
+	msg.cn.len = sizeof(msg.op);
+	msg.op = PROC_CN_MCAST_LISTEN;
+	if (send(fd, &msg, sizeof(msg), 0) != sizeof(msg))
+		goto out_close;
+
+	proc_cn_fd = fd;
+	/* Tasks that existed before the subscription are found in /proc */
+	proc_cn_rescan = 1;
+	return;
+
+out_close:
+	close(fd);
+out_err:
+	syslog(LOG_ERR, "cannot subscribe to proc connector, scanning /proc: "
+	       "%s\n", strerror(errno));
+}
+
+/*
+ * Update the task table for one process event
+ *
+ * New processes get fresh state, also if their PID has been used by a
+ * process that exited unnoticed. Exited processes are detected when their
+ * /proc files can no longer be read, which also covers zombies.
+*/
+static void proc_cn_event(struct proc_event *ev)
+{
+	struct task_state *ts;
+
+	switch (ev->what) {
+	case PROC_EVENT_FORK:
+		/* Threads are accounted for in their process */
+		if (ev->event_data.fork.child_pid !=
+		    ev->event_data.fork.child_tgid)
+			break;
+		ts = task_state_get(ev->event_data.fork.child_tgid);
+		task_state_reset(ts);
+		break;
+	case PROC_EVENT_EXEC:
+		ts = util_hash_get_int(task_tbl,
+				       ev->event_data.exec.process_tgid);
+		if (ts) {
+			free(ts->cmdline);
+			ts->cmdline = NULL;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Process all queued proc connector events
+ *
+ * Returns 1 if events have been lost and /proc needs to be scanned,
+ * 0 otherwise
+*/
+static int proc_cn_read(void)
+{
+	struct nlmsghdr *nlh;
+	struct cn_msg *cn;
+	int len, rc;
+
+	while (1) {
+		len = recv(proc_cn_fd, proc_cn_buf, sizeof(proc_cn_buf), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				/* Socket buffer overrun */
+				proc_cn_rescan = 1;
+				continue;
+			}
+			break;
+		}
+		nlh = (struct nlmsghdr *)proc_cn_buf;
+		for (; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type != NLMSG_DONE)
+				continue;
+			cn = NLMSG_DATA(nlh);
+			if (cn->id.idx != CN_IDX_PROC ||
+			    cn->id.val != CN_VAL_PROC)
+				continue;
+			proc_cn_event((struct proc_event *)cn->data);
+		}
+	}
+	rc = proc_cn_rescan;
+	proc_cn_rescan = 0;
+	return rc;
+}
+
+/*
+ * Read usage of all tasks in the task table
+*/
+static void scan_task_tbl(void)
+{
+	struct util_hash_iter it;
+	struct task_state *ts;
+	struct task_t task;
+
+	util_hash_iterate(task_tbl, &it) {
+		ts = it.value;
+		memset(&task, 0, sizeof(struct task_t));
+		task.pid = ts->pid;
+		if (!task_usage(&task, ts)) {
+			util_hash_remove_int(task_tbl, it.key_int);
+			task_state_free(ts);
+			continue;
+		}
+		top_add(ts);
+	}
+}
+
+/*
+ * Read usage of all tasks found in /proc
+*/
+static void scan_proc_dir(void)
 {
-	int size;
-	unsigned int i = 0, j = 0;
 	DIR *proc_dir;
 	struct direct *entry;
+	struct task_state *ts;
+	struct util_hash_iter it;
 	struct task_t task;
 
 	proc_dir = opendir("/proc");
@@ -858,6 +1196,7 @@ static void read_tasks(void)
 		return;
 	}
 
+	task_gen++;
 	while ((entry = readdir(proc_dir))) {
 		if (!entry->d_name)
 			break;
@@ -865,23 +1204,59 @@ static void read_tasks(void)
 			continue;
 		memset(&task, 0, sizeof(struct task_t));
 		task.pid = atoi(entry->d_name);
-		task_usage(&task);
+		ts = task_state_get(task.pid);
+		if (!task_usage(&task, ts)) {
+			/* Cached files fail after exit, retry for reused PID */
+			task_state_reset(ts);
+			if (!task_usage(&task, ts)) {
+				util_hash_remove_int(task_tbl, ts->pid);
+				task_state_free(ts);
+				continue;
+			}
+		}
+		ts->gen = task_gen;
+		top_add(ts);
 	}
 	closedir(proc_dir);
 
-	if (proc_sum.task.total > MAX_TASK_REC)
-		qsort(curr_sort_tbl, proc_sum.task.total,
-			sizeof(struct task_sort_t), sort_usage);
+	/* Forget tasks that have exited */
+	util_hash_iterate(task_tbl, &it) {
+		ts = it.value;
+		if (ts->gen == task_gen)
+			continue;
+		util_hash_remove_int(task_tbl, it.key_int);
+		task_state_free(ts);
+	}
+}
+
+/*
+ * read tasks information and write to monitor stream
+*/
+static void read_tasks(void)
+{
+	int size;
+	unsigned int i = 0, j = 0;
+	struct task_state *ts;
+	struct task_t task;
+
+	top_cnt = 0;
+	if (proc_cn_fd >= 0 && !proc_cn_read())
+		scan_task_tbl();
+	else
+		scan_proc_dir();
+
+	qsort(top_tbl, top_cnt, sizeof(struct task_state *), sort_usage);
 
 	/* only write up to top 100 processes data to monitor stream */
-	while ((i < proc_sum.task.total) && (j < MAX_TASK_REC)) {
+	while (i < top_cnt) {
 		memset(&task, 0, sizeof(struct task_t));
 		memset(mon_record, 0, sizeof(mon_record));
-		task.pid = curr_sort_tbl[i].pid;
-		if (read_statm(&task) && read_status(&task) &&
-			read_wchan(&task) && read_stat(&task) &&
-			read_cmdline(&task)) {
-			task_count(curr_sort_tbl[i].state, task.state);
+		ts = top_tbl[i];
+		task.pid = ts->pid;
+		if (read_statm(&task, ts) && read_status(&task) &&
+			read_wchan(&task) && read_stat(&task, ts) &&
+			read_cmdline(&task, ts)) {
+			task_count(ts->state, task.state);
 			size = sizeof(struct task_t);
 			size += sizeof(struct name_lens_t);
 			size += name_lens.ruser_len + name_lens.euser_len;
@@ -890,7 +1265,7 @@ static void read_tasks(void)
 			procd_write_ent(&task, size, TASK_FLAG);
 			j++;
 		} else
-			task_count(curr_sort_tbl[i].state, '\0');
+			task_count(ts->state, '\0');
 		i++;
 	}
 	proc_sum.task.total -= i - j;
@@ -965,7 +1340,6 @@ static int procd_do_work(void)
 {
 	int pgsize;
 	struct timezone tz;
-	struct task_sort_t *tmp;
 
 	prev_small_max = 0;
 	prev_big_max = 1;
@@ -979,6 +1353,10 @@ static int procd_do_work(void)
 		pgsize >>= 1;
 		pg_to_kb_shift++;
 	}
+	init_fd_cache();
+	task_tbl = util_hash_new(UTIL_HASH_KEY_INT, 0);
+	if (use_events)
+		proc_cn_open();
 
 	syslog(LOG_INFO, "procd sample interval: %lu\n", sample_interval);
 	while (1) {
@@ -987,9 +1365,6 @@ static int procd_do_work(void)
 			(float)(curr_time.tv_usec - prev_time.tv_usec)
 			/ 1000000.0;
 		memset(&proc_sum, 0, sizeof(struct proc_sum_t));
-		tmp = prev_sort_tbl;
-		prev_sort_tbl = curr_sort_tbl;
-		curr_sort_tbl = tmp;
 		curr_small_max = 0;
 		curr_big_max = 1;
 		read_summary();
@@ -1034,6 +1409,9 @@ static int parse_options(int argc, char **argv)
 		case 'a':
 			attach = 1;
 			break;
+		case 'e':
+			use_events = 1;
+			break;
 		case 'i':
 			sample_interval = strtol(optarg, NULL, 10);
 			if (sample_interval <= 0) {
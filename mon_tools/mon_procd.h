@@ -144,11 +144,18 @@ struct cpudata_t {
 	__u64	steal_prev;
 };
 
-struct task_sort_t {
+struct task_state {
 	__u32	pid;
+	int	stat_fd;
+	int	statm_fd;
 	__u64	tics;
+	__u64	prev_tics;
 	__u16	cpu_mem_usage;
 	char	state;
+	unsigned long	gen;
+	char	comm[MAX_NAME_LEN + 1];
+	char	*cmdline;
+	__u16	cmdline_len;
 };
 
 static struct option options[] = {
@@ -156,10 +163,11 @@ static struct option options[] = {
 	{"version", no_argument, NULL, 'v'},
 	{"attach", no_argument, NULL, 'a'},
 	{"interval", required_argument, NULL, 'i'},
+	{"events", no_argument, NULL, 'e'},
 	{NULL, 0, NULL, 0}
 };
 
-static const char opt_string[] = "+hvai:";
+static const char opt_string[] = "+hvai:e";
 
 static const char help_text[] =
 	"mon_procd: Daemon that writes process data information\n"
@@ -172,6 +180,8 @@ static const char help_text[] =
 	"-v, --version            Print version information, then exit\n"
 	"-a, --attach             Run in foreground\n"
 	"-i, --interval=<seconds> Sample interval\n"
+	"-e, --events             Track processes with proc connector events\n"
+	"                         instead of scanning /proc\n"
 	"\n"
 	"Please report bugs to: linux390@de.ibm.com\n";
 #endif
@@ -27,6 +27,12 @@ TABLE_OID* oid_list_head;
 IF_LIST* if_list;
 int ifNumber;
 
+/* cache for GET data returned by IPAssists */
+int osa_cache_ttl = OSA_CACHE_TTL;
+volatile sig_atomic_t osa_cache_gen;
+static OSA_CACHE_ENTRY* osa_cache[OSA_CACHE_HASH_SIZE];
+
+static void refresh_osa_cache( unsigned int, void* );
 
 
 /**********************************************************************
@@ -51,6 +57,15 @@ void init_ibmOSAMib(void) {
   char*        buffer;          /* a data buffer */
   char         time_buf[TIME_BUF_SIZE]; /* date/time buffer */
 
+  /* refresh cached GET data from the agent main loop. The alarm must not  */
+  /* use SIGALRM, which is already used for deferred update_mib_info()   */
+  if ( osa_cache_ttl > 0 )
+    {
+      netsnmp_ds_set_boolean( NETSNMP_DS_LIBRARY_ID,
+			      NETSNMP_DS_LIB_ALARM_DONT_USE_SIG, 1 );
+      snmp_alarm_register( osa_cache_ttl, SA_REPEAT, refresh_osa_cache, NULL );
+    } /* end if */
+
   /* init head for Toplevel OID linked list */
   oid_list_head = init_oid_list();
   if ( oid_list_head == NULL )
@@ -613,62 +628,25 @@ unsigned char* var_DisplayStr( struct variable *vp,
 
 
 /**********************************************************************
- * do_GET_ioctl()
+ * issue_GET_ioctl()
  *  This function handles the communication with an OSA Express Card
  *  to query the appropriate MIB information from IPAssists.
  *  An ioctl is used in order to qet the appropriate information.
  *  parameters:
  *  IN    int ifIndex       - IF-MIB interface index 
- *  IN    oid    *name      - OID being returned
- *  IN    size_t len        - length of ret. OID
+ *  IN    char *device      - interface name of the OSA Express device
+ *  IN    char *oid_str     - OID being returned as string
  *  INOUT IPA_CMD_GET** cmd - GET command area
  *  returns:  cmd_len - return offset to returned data
  *           -1 -  ioctl() was not successful
  *********************************************************************/
-int do_GET_ioctl ( int ifIndex, oid *name, size_t len, IPA_CMD_GET **cmd )
+static int issue_GET_ioctl ( int ifIndex, char *device, char *oid_str,
+			     IPA_CMD_GET **cmd )
 {
   int  sd;                                   /* socket descriptor */
-  int  i, error_code;
-  char oid_str[MAX_OID_STR_LEN];             /* may hold an OID as string */
+  int  error_code;
   char time_buf[TIME_BUF_SIZE];              /* date/time buffer */
-  char device[IFNAME_MAXLEN] = "not_found";  /* device name for ioctl */
   struct ifreq ifr;                          /* request structure for ioctl */
-  
-  
-  /* search device name in in global interface list for ifIndex */
-  for ( i=0; i < ifNumber; i++ )
-    {
-      if ( if_list[i].ifIndex == ifIndex )
-	{
-	  strcpy( device, if_list[i].if_Name );
-	  break;
-	}
-    } /* end for */
-  
-  if ( strcmp( device, "not_found" ) == 0 )
-    {
-      get_time( time_buf );	    
-      snmp_log( LOG_ERR, "%s do_GET_ioctl(): "
-		"ifIndex %d is not recorded in "
-		"interface list\n"
-		"OSA Subagent MIB information may be incomplete!\n"
-		,time_buf, ifIndex );
-      return -1;
-    } 
-
-  /*
-   * query IPAssists for data appropriate to the OID that we just validated
-   */
-
-  /* convert Get/GetNext OID to a string used by IPA */
-  if( oid_to_str_conv ( name, len, oid_str ) == FALSE )
-    {
-      get_time( time_buf );	    
-      snmp_log( LOG_ERR, "%s do_GET_ioctl(): "
-		"cannot convert OID to string object\n"
-		"do_GET_ioctl(): rejected request\n", time_buf );
-      return -1;
-    } 
 
   /* allocate memory for Get/GetNext command area */
   *cmd = ( IPA_CMD_GET* ) malloc( GET_AREA_LEN ); 
@@ -841,6 +819,240 @@ int do_GET_ioctl ( int ifIndex, oid *name, size_t len, IPA_CMD_GET **cmd )
   free( *cmd );
   return -1;
 
+} /* end issue_GET_ioctl */
+
+
+/**********************************************************************
+ * hash_osa_cache()
+ *  Computes the GET data cache bucket for an interface and OID.
+ *  parameters:
+ *  IN    int ifIndex       - IF-MIB interface index
+ *  IN    char *oid_str     - OID as string
+ *  returns:  bucket number
+ *********************************************************************/
+static unsigned int hash_osa_cache ( int ifIndex, char *oid_str )
+{
+  unsigned int hash = 2166136261U ^ (unsigned int) ifIndex;
+
+  while ( *oid_str )
+    hash = ( hash ^ (unsigned char) *oid_str++ ) * 16777619U;
+
+  return hash % OSA_CACHE_HASH_SIZE;
+} /* end hash_osa_cache */
+
+
+/**********************************************************************
+ * store_osa_cache()
+ *  Saves the result of a successful GET ioctl in a cache entry.
+ *  Only the used part of the GET command area is kept.
+ *  parameters:
+ *  INOUT OSA_CACHE_ENTRY *entry - cache entry to be updated
+ *  IN    IPA_CMD_GET *cmd       - GET command area returned by ioctl
+ *  IN    int offset             - offset to returned data portion
+ *  returns:  0 - entry updated
+ *           -1 - data not cacheable or out of memory
+ *********************************************************************/
+static int store_osa_cache ( OSA_CACHE_ENTRY *entry, IPA_CMD_GET *cmd,
+			     int offset )
+{
+  IPA_GET_DATA *get_res;        /* pointer to offset where data portion starts */
+  IPA_CMD_GET  *copy;
+  long         len;
+
+  get_res = (IPA_GET_DATA*) (PTR_ALIGN4( (char*) cmd + offset ));
+  len = (char*) get_res->data - (char*) cmd + get_res->len;
+  if ( get_res->len < 0 || len > GET_AREA_LEN )
+    return -1;
+
+  copy = (IPA_CMD_GET*) realloc( entry->cmd, len );
+  if ( copy == NULL )
+    return -1;
+
+  memcpy( copy, cmd, len );
+  entry->cmd     = copy;
+  entry->cmd_len = len;
+  entry->offset  = offset;
+  entry->fetched = time( NULL );
+  return 0;
+} /* end store_osa_cache */
+
+
+/**********************************************************************
+ * free_osa_cache_entry()
+ *  Releases a GET data cache entry.
+ *  parameters:
+ *  IN    OSA_CACHE_ENTRY *entry - cache entry to be freed
+ *  returns: none
+ *********************************************************************/
+static void free_osa_cache_entry ( OSA_CACHE_ENTRY *entry )
+{
+  free( entry->oid_str );
+  free( entry->cmd );
+  free( entry );
+} /* end free_osa_cache_entry */
+
+
+/**********************************************************************
+ * refresh_osa_cache()
+ *  Alarm callback, that is called every osa_cache_ttl seconds from
+ *  the agent main loop. Entries that were requested since the last
+ *  call are queried again from IPAssists, all others are dropped.
+ *  parameters:
+ *  IN    unsigned int clientreg - alarm registration number, unused
+ *  IN    void *clientarg        - unused
+ *  returns: none
+ *********************************************************************/
+static void refresh_osa_cache ( unsigned int UNUSED(clientreg),
+				void *UNUSED(clientarg) )
+{
+  OSA_CACHE_ENTRY **pprev, *entry;
+  IPA_CMD_GET     *get_cmd;
+  int             i, offset;
+
+  for ( i=0; i < OSA_CACHE_HASH_SIZE; i++ )
+    {
+      pprev = &osa_cache[i];
+      while ( ( entry = *pprev ) != NULL )
+	{
+	  offset = -1;
+	  if ( entry->used && entry->gen == osa_cache_gen )
+	    {
+	      offset = issue_GET_ioctl( entry->ifIndex, entry->device,
+					entry->oid_str, &get_cmd );
+	      if ( offset >= 0 )
+		{
+		  if ( store_osa_cache( entry, get_cmd, offset ) != 0 )
+		    offset = -1;
+		  free( get_cmd );
+		} /* end if */
+	    } /* end if */
+
+	  if ( offset < 0 )
+	    {
+	      *pprev = entry->next;
+	      free_osa_cache_entry( entry );
+	      continue;
+	    } /* end if */
+
+	  entry->used = 0;
+	  pprev = &entry->next;
+	} /* end while */
+    } /* end for */
+} /* end refresh_osa_cache */
+
+
+/**********************************************************************
+ * do_GET_ioctl()
+ *  This function returns the MIB information for an OID of an OSA
+ *  Express Card. The data is taken from the GET data cache, if it is
+ *  not older than osa_cache_ttl seconds. Otherwise IPAssists is
+ *  queried and the result is recorded in the cache.
+ *  parameters:
+ *  IN    int ifIndex       - IF-MIB interface index 
+ *  IN    oid    *name      - OID being returned
+ *  IN    size_t len        - length of ret. OID
+ *  INOUT IPA_CMD_GET** cmd - GET command area, to be freed by caller
+ *  returns:  cmd_len - return offset to returned data
+ *           -1 -  ioctl() was not successful
+ *********************************************************************/
+int do_GET_ioctl ( int ifIndex, oid *name, size_t len, IPA_CMD_GET **cmd )
+{
+  int  i, offset;
+  unsigned int hash = 0;
+  char oid_str[MAX_OID_STR_LEN];             /* may hold an OID as string */
+  char time_buf[TIME_BUF_SIZE];              /* date/time buffer */
+  char device[IFNAME_MAXLEN] = "not_found";  /* device name for ioctl */
+  OSA_CACHE_ENTRY *entry = NULL;             /* GET data cache entry */
+
+  /* convert Get/GetNext OID to a string used by IPA */
+  if( oid_to_str_conv ( name, len, oid_str ) == FALSE )
+    {
+      get_time( time_buf );	    
+      snmp_log( LOG_ERR, "%s do_GET_ioctl(): "
+		"cannot convert OID to string object\n"
+		"do_GET_ioctl(): rejected request\n", time_buf );
+      return -1;
+    } 
+
+  /* look for cached data of this interface and OID */
+  if ( osa_cache_ttl > 0 )
+    {
+      hash = hash_osa_cache( ifIndex, oid_str );
+      for ( entry = osa_cache[hash]; entry != NULL; entry = entry->next )
+	{
+	  if ( entry->ifIndex == ifIndex && entry->gen == osa_cache_gen &&
+	       strcmp( entry->oid_str, oid_str ) == 0 )
+	    break;
+	} /* end for */
+
+      if ( entry != NULL )
+	{
+	  entry->used = 1;
+	  if ( time( NULL ) - entry->fetched < osa_cache_ttl )
+	    {
+	      *cmd = ( IPA_CMD_GET* ) malloc( GET_AREA_LEN );
+	      if ( *cmd != NULL )
+		{
+		  memcpy( *cmd, entry->cmd, entry->cmd_len );
+		  return entry->offset;
+		} /* end if */
+	    } /* end if */
+	  strcpy( device, entry->device );
+	} /* end if */
+    } /* end if */
+
+  /* search device name in in global interface list for ifIndex */
+  for ( i=0; entry == NULL && i < ifNumber; i++ )
+    {
+      if ( if_list[i].ifIndex == ifIndex )
+	{
+	  strcpy( device, if_list[i].if_Name );
+	  break;
+	}
+    } /* end for */
+  
+  if ( strcmp( device, "not_found" ) == 0 )
+    {
+      get_time( time_buf );	    
+      snmp_log( LOG_ERR, "%s do_GET_ioctl(): "
+		"ifIndex %d is not recorded in "
+		"interface list\n"
+		"OSA Subagent MIB information may be incomplete!\n"
+		,time_buf, ifIndex );
+      return -1;
+    } 
+
+  /*
+   * query IPAssists for data appropriate to the OID that we just validated
+   */
+  offset = issue_GET_ioctl( ifIndex, device, oid_str, cmd );
+  if ( offset < 0 || osa_cache_ttl <= 0 )
+    return offset;
+
+  /* record result in GET data cache */
+  if ( entry == NULL )
+    {
+      entry = ( OSA_CACHE_ENTRY* ) calloc( 1, sizeof( OSA_CACHE_ENTRY ) );
+      if ( entry == NULL )
+	return offset;
+      entry->oid_str = strdup( oid_str );
+      if ( entry->oid_str == NULL || store_osa_cache( entry, *cmd, offset ) )
+	{
+	  free_osa_cache_entry( entry );
+	  return offset;
+	} /* end if */
+      entry->ifIndex = ifIndex;
+      strcpy( entry->device, device );
+      entry->used = 1;
+      entry->gen  = osa_cache_gen;
+      entry->next = osa_cache[hash];
+      osa_cache[hash] = entry;
+    }
+  else
+    store_osa_cache( entry, *cmd, offset );
+
+  return offset;
+
 } /* end do_GET_ioctl */
 
 
@@ -30,4 +30,10 @@ WriteMethod   write_ibmOSAMib;          /* handle SET requests             */
 /* ioctl for Get/Getnext processing */
 int do_GET_ioctl ( int, oid*, size_t, IPA_CMD_GET** ); 
 
+/* lifetime of cached GET data in seconds, 0 disables the cache */
+extern int osa_cache_ttl;
+
+/* incremented whenever the interface list changes */
+extern volatile sig_atomic_t osa_cache_gen;
+
 #endif /* _MIBGROUP_IBMOSAMIB_H */
@@ -22,6 +22,12 @@
 #ifndef NETSNMP_DS_AGENT_X_SOCKET
 #define NETSNMP_DS_AGENT_X_SOCKET DS_AGENT_X_SOCKET
 #endif
+#ifndef NETSNMP_DS_LIBRARY_ID
+#define NETSNMP_DS_LIBRARY_ID DS_LIBRARY_ID
+#endif
+#ifndef NETSNMP_DS_LIB_ALARM_DONT_USE_SIG
+#define NETSNMP_DS_LIB_ALARM_DONT_USE_SIG DS_LIB_ALARM_DONT_USE_SIG
+#endif
 /* version number of this agent */
 
 /* default log file - don't change it here, use parameter -l */
@@ -45,6 +51,8 @@
 #define GET_AREA_LEN  MAX_GET_DATA + 512  /* size for GET command area length */
 #define TIME_BUF_SIZE 128   /* buffer size for date and time string */
 #define MAX_OID_STR_LEN   MAX_OID_LEN * 5 /* max OID string size */
+#define OSA_CACHE_TTL       5    /* default lifetime of cached GET data (sec) */
+#define OSA_CACHE_HASH_SIZE 1024 /* number of GET data cache hash buckets */
 /* definitions for 2.6 qeth */
 #define QETH_SYSFILE "/sys/bus/ccwgroup/drivers/qeth/notifier_register"
 #define SIOC_QETH_ADP_SET_SNMP_CONTROL	(SIOCDEVPRIVATE + 5)
@@ -200,3 +208,21 @@ typedef struct if_List
   int  ipa_ver;                      /* IPA microcode level */
 } IF_LIST;
 
+
+/*******************************************************************/
+/* cache for IPAssists GET results, one entry per ifIndex and OID  */
+/*******************************************************************/
+typedef struct osa_cache_entry
+{
+  int          ifIndex;                /* IF-MIB ifIndex */
+  char         device[IFNAME_MAXLEN];  /* interface name for ioctl */
+  char         *oid_str;               /* requested OID as string */
+  IPA_CMD_GET  *cmd;                   /* copy of GET command area */
+  int          cmd_len;                /* used length of GET command area */
+  int          offset;                 /* offset to returned data portion */
+  time_t       fetched;                /* time of last successful ioctl */
+  int          used;                   /* requested since last refresh */
+  int          gen;                    /* interface list generation */
+  struct osa_cache_entry *next;        /* ptr to next entry in bucket */
+} OSA_CACHE_ENTRY;
+
@@ -1186,6 +1186,9 @@ void update_mib_info ()
 	char*        buffer;          /* a data buffer */
 
 
+	/* invalidate cached GET data, ifIndex values may have been reassigned */
+	osa_cache_gen++;
+
 	/* Retrieve ifNumber/ifIndex/ifDescr newly from IF-MIB for all interfaces */
 	/* retrieve data in temporary list first */
 	if_num = query_IF_MIB( &tmp_list );
@@ -1745,7 +1748,7 @@ int get_time( char* buffer )
 
 static const char* usage_text[] = {
 "Usage:  osasnmpd [-h] [-v] [-l LOGFILE] [-A] [-f] [-L] [-P PIDFILE]",
-"                 [-x SOCKADDR]",
+"                 [-x SOCKADDR] [-c SECONDS]",
 "",
 "-h, --help              This usage message",
 "-v, --version           Version information",
@@ -1755,6 +1758,7 @@ static const char* usage_text[] = {
 "-f, --nofork            Do not fork() from the calling shell",
 "-P, --pidfile PIDFILE   Save the process ID of the subagent in PIDFILE",
 "-x, --sockaddr SOCKADDR Bind AgentX port to this address",
+"-c, --cache-ttl SECONDS Cache OSA-E MIB data for SECONDS (default 5, 0=off)",
 ""
 };
 
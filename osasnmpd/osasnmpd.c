@@ -103,10 +103,11 @@ static struct option longopts[] = {
 	{"logfile",required_argument,0,'l'},
 	{"pidfile",required_argument,0,'P'},
 	{"sockaddr",required_argument,0,'x'},
+	{"cache-ttl",required_argument,0,'c'},
 	{0,0,0,0}
 };
 
-#define OPTSTRING "hvALfl:A:P:x:"
+#define OPTSTRING "hvALfl:A:P:x:c:"
 
 /*
  * main routine
@@ -120,6 +121,7 @@ int main( int argc, char *argv[] )
 	FILE *PID;
 	struct sigaction act;
 	int res,c,longIndex,rc;
+	char *endptr;
 	unsigned char rel_a, rel_b, rel_c;
 	struct utsname buf;
 	char suffix[sizeof(buf.release)];
@@ -178,6 +180,16 @@ int main( int argc, char *argv[] )
 				netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID,
 					NETSNMP_DS_AGENT_X_SOCKET, optarg);
 				break;
+			case 'c':
+				osa_cache_ttl = strtol(optarg, &endptr, 10);
+				if (*optarg == '\0' || *endptr != '\0' ||
+				    osa_cache_ttl < 0) {
+					fprintf(stderr, "osasnmpd: invalid "
+						"cache lifetime '%s'\n",
+						optarg);
+					exit(1);
+				}
+				break;
 			default:
 				fprintf(stderr, "Try 'osasnmpd --help' for more"
 						" information.\n");
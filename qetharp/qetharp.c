@@ -17,9 +17,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <poll.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include "lib/zt_common.h"
@@ -161,35 +165,6 @@ out:
 	return;
 }
 
-static int
-get_arp_from_hipersockets(struct qeth_arp_query_user_data *udata,
-			  struct option_info *opin) 
-{
-	struct qeth_arp_qi_entry5 *entry;
-	struct qeth_arp_qi_entry5_short *entry_s;
-	__u32 bytes_done;
-	int i;
-
-        bytes_done = 6;
-	if (udata->mask_bits & QETH_QARP_STRIP_ENTRIES) {
-		for (i = 0; i < (int)udata->u.no_entries; i++) {
-			entry_s = (struct qeth_arp_qi_entry5_short *)
-				(((char *)udata) + bytes_done);
-			show_entry5(entry_s->IP_TYPE(), entry_s->ipaddr,opin);
-			bytes_done += entry_s->IP_TYPE() == IP_VERSION_4 ?
-				sizeof(struct qeth_arp_qi_entry5_short) :
-				sizeof(struct qeth_arp_qi_entry5_short_ipv6);
-		}
-	} else {
-		for (i = 0; i < (int)udata->u.no_entries; i++) {
-			entry = (struct qeth_arp_qi_entry5 *)
-				(((char *)udata) + 6 + i * sizeof(*entry));
-			show_entry5(entry->IP_TYPE(), entry->ipaddr, opin);
-		}
-	}
-	return 0;
-}
-
 static
 void show_entry7(__u8 ipaddr_type, __u8 *ip, __u8 *mac,
 		 unsigned short flags, struct option_info *opin)
@@ -229,9 +204,52 @@ out:
 	return;
 }
 
-static int
+static void
+fill_entry(struct qetharp_entry *e, __u8 ipaddr_type, __u8 *ip, __u8 *mac,
+	   unsigned short flags)
+{
+	memset(e, 0, sizeof(*e));
+	e->ipaddr_type = ipaddr_type;
+	memcpy(e->ipaddr, ip, ipaddr_type == IP_VERSION_4 ?
+	       IPV4_LENGTH : IPV6_LENGTH);
+	if (mac)
+		memcpy(e->macaddr, mac, MAC_LENGTH);
+	e->flags = flags;
+}
+
+static void
+get_arp_from_hipersockets(struct qeth_arp_query_user_data *udata,
+			  struct qetharp_table *table)
+{
+	struct qeth_arp_qi_entry5 *entry;
+	struct qeth_arp_qi_entry5_short *entry_s;
+	__u32 bytes_done;
+	int i;
+
+        bytes_done = 6;
+	if (udata->mask_bits & QETH_QARP_STRIP_ENTRIES) {
+		for (i = 0; i < (int)udata->u.no_entries; i++) {
+			entry_s = (struct qeth_arp_qi_entry5_short *)
+				(((char *)udata) + bytes_done);
+			fill_entry(&table->entry[i], entry_s->IP_TYPE(),
+				   entry_s->ipaddr, NULL, HIPERSOCKET_FLAGS);
+			bytes_done += entry_s->IP_TYPE() == IP_VERSION_4 ?
+				sizeof(struct qeth_arp_qi_entry5_short) :
+				sizeof(struct qeth_arp_qi_entry5_short_ipv6);
+		}
+	} else {
+		for (i = 0; i < (int)udata->u.no_entries; i++) {
+			entry = (struct qeth_arp_qi_entry5 *)
+				(((char *)udata) + 6 + i * sizeof(*entry));
+			fill_entry(&table->entry[i], entry->IP_TYPE(),
+				   entry->ipaddr, NULL, HIPERSOCKET_FLAGS);
+		}
+	}
+}
+
+static void
 get_arp_from_osacard(struct qeth_arp_query_user_data *udata,
-		     unsigned short flags, struct option_info *opin) 
+		     unsigned short flags, struct qetharp_table *table)
 {
 	struct qeth_arp_qi_entry7 *entry;
 	struct qeth_arp_qi_entry7_short *entry_s;
@@ -242,8 +260,8 @@ get_arp_from_osacard(struct qeth_arp_query_user_data *udata,
 		for (i = 0; i < (int)udata->u.no_entries; i++){
 			entry_s = (struct qeth_arp_qi_entry7_short *)
 				(((char *)udata) + 6 + bytes_done);
-			show_entry7(entry_s->IP_TYPE(), entry_s->ipaddr,
-				    entry_s->macaddr, flags, opin);
+			fill_entry(&table->entry[i], entry_s->IP_TYPE(),
+				   entry_s->ipaddr, entry_s->macaddr, flags);
 			bytes_done += entry_s->IP_TYPE() == IP_VERSION_4 ?
 				sizeof(struct qeth_arp_qi_entry7_short) :
 				sizeof(struct qeth_arp_qi_entry7_short_ipv6);
@@ -252,16 +270,263 @@ get_arp_from_osacard(struct qeth_arp_query_user_data *udata,
 		for (i = 0; i < (int)udata->u.no_entries; i++){ 	
 			entry = (struct qeth_arp_qi_entry7 *)
 				(((char *)udata) + 6 + bytes_done);
-			show_entry7(entry->IP_TYPE(), entry->ipaddr,
-				    entry->macaddr, flags, opin);
+			fill_entry(&table->entry[i], entry->IP_TYPE(),
+				   entry->ipaddr, entry->macaddr, flags);
 			bytes_done += entry->IP_TYPE() == IP_VERSION_4 ?
 				sizeof(struct qeth_arp_qi_entry7_short) :
 				sizeof(struct qeth_arp_qi_entry7_short_ipv6);
 		}
 	}
+}
+
+static void
+show_entry(struct qetharp_entry *e, struct option_info *opin)
+{
+	if (e->flags == HIPERSOCKET_FLAGS)
+		show_entry5(e->ipaddr_type, e->ipaddr, opin);
+	else
+		show_entry7(e->ipaddr_type, e->ipaddr, e->macaddr, e->flags,
+			    opin);
+}
+
+/*
+ * Read the ARP cache of the card into "table"
+ */
+static int
+qetharp_read_table(struct option_info *opin, struct qetharp_table *table)
+{
+	int sd;
+ 	struct ifreq ifr;
+	struct qeth_arp_query_user_data *udata;
+	int memsize, result = 0;
+	unsigned short mask_bits;
+
+	if ((sd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		perror("Socket failed: %m\n");
+		return 1;
+	}
+	strcpy(ifr.ifr_name, opin->dev_name);
+	memsize = QETH_QARP_USER_DATA_SIZE;
+	udata = malloc(QETH_QARP_USER_DATA_SIZE);
+	if (!udata) {
+		close(sd);
+		perror("\nUnsuccessful");
+		return 1;
+	}
+	memcpy(&udata->u.data_len, &memsize, sizeof(int));
+	udata->mask_bits = QETH_QARP_STRIP_ENTRIES;
+	if (opin->ipv6) {
+		udata->mask_bits |= QETH_QARP_WITH_IPV6;
+	}
+	ifr.ifr_ifru.ifru_data = (char *) udata;
+	if (ioctl(sd, SIOC_QETH_ARP_QUERY_INFO, &ifr) < 0) {
+		close(sd);
+		free(udata);
+		perror("\nUnsuccessful");
+		return 1;
+	}
+	close(sd);
+	table->cnt = 0;
+	if (!udata->u.no_entries) {
+		/* rational: mask_bits are not defined in that case */
+		goto out;
+	}
+	table->entry = realloc(table->entry,
+			       udata->u.no_entries * sizeof(*table->entry));
+	if (!table->entry) {
+		perror("\nUnsuccessful");
+		result = 1;
+		goto out;
+	}
+	mask_bits = udata->mask_bits & QETH_QARP_REQUEST_MASK;
+	if (mask_bits == HIPERSOCKET_FLAGS) 
+		get_arp_from_hipersockets(udata, table);
+	else if (mask_bits == OSACARD_FLAGS)
+		get_arp_from_osacard(udata, mask_bits, table);
+	else if (mask_bits == OSA_TR_FLAGS)
+		get_arp_from_osacard(udata, mask_bits, table);
+	else {
+		perror("\nReceived entries with invalid format");
+		result = 1;
+		goto out;
+	}
+	table->cnt = udata->u.no_entries;
+out:
+	free(udata);
+	return result;
+}
+
+/*
+ * Parse lookup key, which is an IPv4, IPv6, or MAC address
+ */
+static int
+parse_lookup(const char *key, struct qetharp_lookup *req)
+{
+	unsigned int m[MAC_LENGTH];
+	char c;
+	int i;
+
+	memset(req, 0, sizeof(*req));
+	if (inet_pton(AF_INET, key, req->addr) == 1) {
+		req->type = QETHARP_LOOKUP_IP;
+		req->ipaddr_type = IP_VERSION_4;
+		return 0;
+	}
+	if (inet_pton(AF_INET6, key, req->addr) == 1) {
+		req->type = QETHARP_LOOKUP_IP;
+		req->ipaddr_type = IP_VERSION_6;
+		return 0;
+	}
+	if (sscanf(key, "%x:%x:%x:%x:%x:%x%c", &m[0], &m[1], &m[2], &m[3],
+		   &m[4], &m[5], &c) == MAC_LENGTH) {
+		req->type = QETHARP_LOOKUP_MAC;
+		for (i = 0; i < MAC_LENGTH; i++) {
+			if (m[i] > 255)
+				return 1;
+			req->addr[i] = m[i];
+		}
+		return 0;
+	}
+	return 1;
+}
+
+static int
+entry_matches(struct qetharp_entry *e, struct qetharp_lookup *req)
+{
+	switch (req->type) {
+	case QETHARP_LOOKUP_IP:
+		return e->ipaddr_type == req->ipaddr_type &&
+			!memcmp(e->ipaddr, req->addr,
+				e->ipaddr_type == IP_VERSION_4 ?
+				IPV4_LENGTH : IPV6_LENGTH);
+	case QETHARP_LOOKUP_MAC:
+		return e->flags != HIPERSOCKET_FLAGS &&
+			!memcmp(e->macaddr, req->addr, MAC_LENGTH);
+	default:
+		return 1;
+	}
+}
+
+static void
+sock_path(char *path, size_t size, const char *dev_name)
+{
+	snprintf(path, size, QETHARP_SOCK_PATH, dev_name);
+}
+
+/*
+ * Ask a watching qetharp for the table, return -1 if none is running
+ */
+static int
+lookup_from_watch(struct option_info *opin, struct qetharp_lookup *req)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct qetharp_entry e;
+	ssize_t rc;
+	int sd;
+
+	sock_path(addr.sun_path, sizeof(addr.sun_path), opin->dev_name);
+	sd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sd < 0)
+		return -1;
+	if (connect(sd, (struct sockaddr *) &addr, sizeof(addr)) ||
+	    write(sd, req, sizeof(*req)) != sizeof(*req)) {
+		close(sd);
+		return -1;
+	}
+	if (opin->compact_output != OPTION_INFO_COMPACT_OUTPUT)
+		show_header();
+	while ((rc = recv(sd, &e, sizeof(e), MSG_WAITALL)) == sizeof(e))
+		show_entry(&e, opin);
+	close(sd);
+	if (rc < 0) {
+		perror("\nUnsuccessful");
+		return 1;
+	}
 	return 0;
 }
 
+static volatile sig_atomic_t watch_stop;
+
+static void
+watch_sig_handler(int UNUSED(sig))
+{
+	watch_stop = 1;
+}
+
+static void
+watch_serve(int sd, struct qetharp_table *table)
+{
+	struct qetharp_lookup req;
+	int cd, i;
+
+	cd = accept(sd, NULL, NULL);
+	if (cd < 0)
+		return;
+	if (recv(cd, &req, sizeof(req), MSG_WAITALL) == sizeof(req)) {
+		for (i = 0; i < table->cnt; i++) {
+			if (!entry_matches(&table->entry[i], &req))
+				continue;
+			if (write(cd, &table->entry[i],
+				  sizeof(table->entry[i])) < 0)
+				break;
+		}
+	}
+	close(cd);
+}
+
+/*
+ * Keep the ARP cache of the card in memory, refresh it periodically and
+ * answer lookup requests from the in-memory copy
+ */
+static int
+qetharp_watch(struct option_info *opin)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct qetharp_table table = { NULL, 0 };
+	struct sigaction sa = { .sa_handler = watch_sig_handler };
+	struct pollfd pfd;
+	time_t next = 0, now;
+	int sd, rc = 0;
+
+	sock_path(addr.sun_path, sizeof(addr.sun_path), opin->dev_name);
+	sd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sd < 0) {
+		perror("Socket failed: %m\n");
+		return 1;
+	}
+	unlink(addr.sun_path);
+	umask(077);
+	if (bind(sd, (struct sockaddr *) &addr, sizeof(addr)) ||
+	    listen(sd, 16)) {
+		fprintf(stderr, "\nError: cannot listen on %s: %s\n",
+			addr.sun_path, strerror(errno));
+		close(sd);
+		return 1;
+	}
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	pfd.fd = sd;
+	pfd.events = POLLIN;
+	while (!watch_stop) {
+		now = time(NULL);
+		if (now >= next) {
+			if (qetharp_read_table(opin, &table)) {
+				rc = 1;
+				break;
+			}
+			next = now + opin->interval;
+		}
+		if (poll(&pfd, 1, (next - now) * 1000) > 0)
+			watch_serve(sd, &table);
+	}
+	close(sd);
+	unlink(addr.sun_path);
+	free(table.entry);
+	return rc;
+}
+
 static int
 qetharp_purge(struct option_info *opin)
 {
@@ -393,66 +658,55 @@ qetharp_delete(struct option_info *opin)
 static int
 qetharp_query(struct option_info *opin)
 {
-	int sd;
- 	struct ifreq ifr;
-	struct qeth_arp_query_user_data *udata;
-	int memsize,result;
-	unsigned short mask_bits;
+	struct qetharp_table table = { NULL, 0 };
+	struct qetharp_lookup req;
+	int i, rc;
 
 	if (!opin->dev_name) {
 		printf("\nError: no interface specified!\n");
 		return 1;
 	}
-		
-	if ((sd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		perror("Socket failed: %m\n");
-		return 1;
-	}
-	strcpy(ifr.ifr_name, opin->dev_name);
-	memsize = QETH_QARP_USER_DATA_SIZE;
-	udata = malloc(QETH_QARP_USER_DATA_SIZE);
-	memcpy(&udata->u.data_len, &memsize, sizeof(int));
-	udata->mask_bits = QETH_QARP_STRIP_ENTRIES;
-	if (opin->ipv6) {
-		udata->mask_bits |= QETH_QARP_WITH_IPV6;
+	if (opin->lookup) {
+		if (parse_lookup(opin->lookup, &req)) {
+			printf("\nError: invalid lookup address specified!\n");
+			return 1;
+		}
+		/* Prefer the in-memory table of a watching qetharp */
+		rc = lookup_from_watch(opin, &req);
+		if (rc >= 0)
+			return rc;
+	} else {
+		req.type = QETHARP_LOOKUP_ALL;
 	}
-	ifr.ifr_ifru.ifru_data = (char *) udata;
-	if (ioctl(sd, SIOC_QETH_ARP_QUERY_INFO, &ifr) < 0) {
-		close(sd);
-		perror("\nUnsuccessful");
+	if (qetharp_read_table(opin, &table))
 		return 1;
-	}
 	if (opin->compact_output!=OPTION_INFO_COMPACT_OUTPUT) {
 		show_header();
 	}
-	if (!udata->u.no_entries) {
-		/* rational: mask_bits are not defined in that case */
-		return 0;
-	}
-	mask_bits = udata->mask_bits & QETH_QARP_REQUEST_MASK;
-	if (mask_bits == HIPERSOCKET_FLAGS) 
-	        result = get_arp_from_hipersockets(udata, opin);
-	else if (mask_bits == OSACARD_FLAGS)
-		result = get_arp_from_osacard(udata, mask_bits, opin);
-	else if (mask_bits == OSA_TR_FLAGS)
-		result = get_arp_from_osacard(udata, mask_bits, opin);
-	else {
-		perror("\nReceived entries with invalid format");
-		return 1;
+	for (i = 0; i < table.cnt; i++) {
+		if (entry_matches(&table.entry[i], &req))
+			show_entry(&table.entry[i], opin);
 	}
-	free(udata);
+	free(table.entry);
 
-	return result;
+	return 0;
 }
 
 static void
 qetharp_usage(void)
 {
-	printf("qetharp [-[nc6]q interface]|[-p interface]|\n" \
+	printf("qetharp [-[nc6]q interface [-l address]]|[-p interface]|\n" \
 	       "\t\t[-a interface -i ip-addr -m MAC-addr]|\n" \
-	       "\t\t[-d interface -i ip-addr] [-h] [-v ]\n\n");
+	       "\t\t[-d interface -i ip-addr]|\n" \
+	       "\t\t[-6w interface [-t seconds]] [-h] [-v ]\n\n");
 	printf("where:\n" \
 	       "\tq: prints ARP entries found on the card\n" \
+	       "\tl: in conjunction with the -q option it shows\n" \
+	       "\t\tonly entries with the given IP or MAC address\n" \
+	       "\tw: keeps the ARP entries of the card in memory and\n" \
+	       "\t\tanswers -q requests from the memory copy\n" \
+	       "\tt: in conjunction with the -w option it sets the\n" \
+	       "\t\trefresh interval in seconds (default 10)\n" \
 	       "\tn: in conjunction with the -q option it shows\n" \
 	       "\t\tnumerical addresses instead of trying to\n" \
 	       "\t\tresolve IP addresses to host names.\n" \
@@ -476,16 +730,31 @@ qetharp_parse_info(struct option_info *opin)
 		return 1;
 	}
 	if ((opin->purge_flag+opin->query_flag+
-	    opin->add_flag+opin->delete_flag)==0) {
+	    opin->add_flag+opin->delete_flag+opin->watch_flag)==0) {
 		qetharp_usage();
 		return 1;
 	}
 	if ((opin->purge_flag+opin->query_flag+
-	    opin->add_flag+opin->delete_flag)!=1) {
+	    opin->add_flag+opin->delete_flag+opin->watch_flag)!=1) {
 		printf("\nUse only one of the options '-a', " \
-		       "'-d', '-p' and 'q' per call.\n");
+		       "'-d', '-p', '-q' and '-w' per call.\n");
+		return 1;
+	}
+	if (opin->lookup && !opin->query_flag) {
+		printf("\nError in using '-l' option:\n" \
+		       "\t'-q' option missing!\n");
+		return 1;
+	}
+	if (opin->interval && !opin->watch_flag) {
+		printf("\nError in using '-t' option:\n" \
+		       "\t'-w' option missing!\n");
 		return 1;
 	}
+	if (opin->watch_flag) {
+		if (!opin->interval)
+			opin->interval = QETHARP_INTERVAL;
+		return qetharp_watch(opin);
+	}
 	if (opin->purge_flag &&
 	    (opin->query_flag || opin->host_resolution)) {
 		printf("\nError in using '-p' option:\n" \
@@ -503,7 +772,7 @@ qetharp_parse_info(struct option_info *opin)
 		return 1;
 	}
 	if ((opin->ipv6) &&
-	    !(opin->query_flag)) {
+	    !(opin->query_flag || opin->watch_flag)) {
 		printf("\nError in using '-6' option:\n" \
 		       "\t'-q' option missing!\n");
 		return 1;
@@ -589,6 +858,20 @@ int main(int argc, char **argv)
 			info.mac_addr = optarg;
 			info.mac_flag = OPTION_INFO_MAC;
 			break;
+		case 'w':
+			info.dev_name = optarg;
+			info.watch_flag = OPTION_INFO_WATCH;
+			break;
+		case 't':
+			info.interval = atoi(optarg);
+			if (info.interval <= 0) {
+				printf("\nError: invalid interval specified!\n");
+				exit(1);
+			}
+			break;
+		case 'l':
+			info.lookup = optarg;
+			break;
 		default:
 			fprintf(stderr, "Try 'qetharp --help' for more"
 					" information.\n");
@@ -53,7 +53,7 @@
  *            Declarations for parsing options       *
  *****************************************************/
 
-#define QETHARP_GETOPT_STRING "p:q:a:d:i:m:n6chv"
+#define QETHARP_GETOPT_STRING "p:q:a:d:i:m:w:t:l:n6chv"
 
 #define OPTION_INFO_QUERY              1
 #define OPTION_INFO_PURGE              1
@@ -64,6 +64,38 @@
 #define OPTION_INFO_IP                 1
 #define OPTION_INFO_MAC                1
 #define OPTION_INFO_IPV6               1
+#define OPTION_INFO_WATCH              1
+
+/*****************************************************
+ *            Declarations for watch mode            *
+ *****************************************************/
+
+#define QETHARP_SOCK_PATH	"/run/qetharp-%s.sock"
+#define QETHARP_INTERVAL	10	/* Default refresh interval (s) */
+
+#define QETHARP_LOOKUP_ALL	0
+#define QETHARP_LOOKUP_IP	1
+#define QETHARP_LOOKUP_MAC	2
+
+/* ARP table entry as kept in memory and sent to lookup clients */
+struct qetharp_entry {
+	__u8 ipaddr_type;
+	__u8 ipaddr[IPV6_LENGTH];
+	__u8 macaddr[MAC_LENGTH];
+	unsigned short flags;	/* HIPERSOCKET_FLAGS, OSACARD_FLAGS, ... */
+};
+
+struct qetharp_table {
+	struct qetharp_entry *entry;
+	int cnt;
+};
+
+/* Lookup request sent to a watching qetharp */
+struct qetharp_lookup {
+	int type;		/* QETHARP_LOOKUP_* */
+	__u8 ipaddr_type;
+	__u8 addr[IPV6_LENGTH];
+};
 
 /*****************************************************
  *            Declarations for version string        *
@@ -81,6 +113,9 @@ static struct option qetharp_options[]=
 	{ "delete",       1, 0, 'd'},
 	{ "ip",           1, 0, 'i'},
 	{ "mac",          1, 0, 'm'},
+	{ "watch",        1, 0, 'w'},
+	{ "interval",     1, 0, 't'},
+	{ "lookup",       1, 0, 'l'},
 	{ "help",         0, 0, 'h'},
 	{ "version",      0, 0, 'v'},
 	{0,0,0,0}
@@ -96,9 +131,12 @@ struct option_info {
 	int delete_flag;
 	int ip_flag;
 	int mac_flag;
+	int watch_flag;
+	int interval;
 	char *dev_name;
 	char *ip_addr;
 	char *mac_addr;
+	char *lookup;
 };
 
 #endif /* __QETHARP_H__ */
@@ -430,6 +430,215 @@ static void parse_descriptor(struct qeth_qoat_hdr *oat_hdr,
 	}
 }
 
+static void fmt_mac(char *buf, size_t size, __u8 *mac)
+{
+	snprintf(buf, size, "%02x:%02x:%02x:%02x:%02x:%02x",
+		 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+/*
+ * Convert descriptor entry to printable form, return -1 for unknown types
+ */
+static int entry_fill(__u32 des_type, char *ptr, struct qeth_oat_entry *e)
+{
+	struct qeth_qoat_des_ip6mc *ip6mc;
+	struct qeth_qoat_des_ip4mc *ip4mc;
+	struct qeth_qoat_des_ip6 *ip6;
+	struct qeth_qoat_des_ip4 *ip4;
+	struct qeth_qoat_des_aiq *aiq;
+
+	memset(e, 0, sizeof(*e));
+	switch (des_type) {
+	case OAT_DES_TYPE_IP4:
+		ip4 = (struct qeth_qoat_des_ip4 *)ptr;
+		e->type = "ip4";
+		inet_ntop(AF_INET, &ip4->ip4_address, e->address,
+			  sizeof(e->address));
+		e->info_name = "flags";
+		snprintf(e->info, sizeof(e->info), "0x%08x", ip4->flags);
+		break;
+	case OAT_DES_TYPE_IP4MC:
+		ip4mc = (struct qeth_qoat_des_ip4mc *)ptr;
+		e->type = "ip4mc";
+		inet_ntop(AF_INET, &ip4mc->ip4_mc_address, e->address,
+			  sizeof(e->address));
+		e->info_name = "mac";
+		fmt_mac(e->info, sizeof(e->info), ip4mc->ip4_mc_mac);
+		break;
+	case OAT_DES_TYPE_IP6:
+		ip6 = (struct qeth_qoat_des_ip6 *)ptr;
+		e->type = "ip6";
+		inet_ntop(AF_INET6, ip6->ip6_address, e->address,
+			  sizeof(e->address));
+		e->info_name = "flags";
+		snprintf(e->info, sizeof(e->info), "0x%08x", ip6->flags);
+		break;
+	case OAT_DES_TYPE_IP6MC:
+		ip6mc = (struct qeth_qoat_des_ip6mc *)ptr;
+		e->type = "ip6mc";
+		inet_ntop(AF_INET6, ip6mc->ip6_mc_address, e->address,
+			  sizeof(e->address));
+		e->info_name = "mac";
+		fmt_mac(e->info, sizeof(e->info), ip6mc->ip6_mc_mac);
+		break;
+	case OAT_DES_TYPE_VMAC:
+		e->type = "vmac";
+		fmt_mac(e->address, sizeof(e->address),
+			((struct qeth_qoat_des_vmac *)ptr)->vmac);
+		break;
+	case OAT_DES_TYPE_VLAN:
+		e->type = "vlan";
+		snprintf(e->address, sizeof(e->address), "%d",
+			 ((struct qeth_qoat_des_vlan *)ptr)->vlanid);
+		break;
+	case OAT_DES_TYPE_GMAC:
+		e->type = "gmac";
+		fmt_mac(e->address, sizeof(e->address),
+			((struct qeth_qoat_des_gmac *)ptr)->gmac);
+		break;
+	case OAT_DES_TYPE_AIQ:
+		aiq = (struct qeth_qoat_des_aiq *)ptr;
+		e->type = "aiq";
+		snprintf(e->address, sizeof(e->address), "0x%x",
+			 aiq->protocol);
+		e->info_name = "ports";
+		snprintf(e->info, sizeof(e->info), "%d %d", aiq->src_port,
+			 aiq->des_port);
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+	const struct qeth_oat_entry *e1 = a, *e2 = b;
+	int rc;
+
+	rc = strcmp(e1->type, e2->type);
+	if (rc)
+		return rc;
+	rc = strcmp(e1->address, e2->address);
+	if (rc)
+		return rc;
+	return strcmp(e1->info, e2->info);
+}
+
+static void list_add(struct qeth_oat_list *list, __u32 des_type, char *ptr)
+{
+	if (list->cnt == list->max) {
+		list->max = list->max ? list->max * 2 : 256;
+		list->entry = util_realloc(list->entry,
+					   list->max * sizeof(*list->entry));
+	}
+	if (entry_fill(des_type, ptr, &list->entry[list->cnt]) == 0)
+		list->cnt++;
+}
+
+/*
+ * Collect all descriptor entries of a query response into a sorted list
+ */
+static void collect_entries(char *buf, int len, struct qeth_oat_list *list)
+{
+	int buffer_processed, frame_processed, i;
+	struct qeth_qoat_ipa_reply *ipa_hdr;
+	struct qeth_qoat_hdr *oat_hdr;
+
+	list->cnt = 0;
+	buffer_processed = 0;
+	while (buffer_processed < len) {
+		ipa_hdr = (struct qeth_qoat_ipa_reply *)
+			(buf + buffer_processed);
+		if (ipa_hdr->len == 0)
+			break;
+		frame_processed = sizeof(struct qeth_qoat_ipa_reply);
+		while (frame_processed < ipa_hdr->len) {
+			oat_hdr = (struct qeth_qoat_hdr *)
+				(buf + buffer_processed + frame_processed);
+			if (oat_hdr->len == 0)
+				break;
+			frame_processed += oat_hdr->len;
+			if (oat_hdr->hdr_type != OAT_HDR_TYPE_DESCRIPTOR)
+				continue;
+			for (i = 0; i < oat_hdr->type.descriptor.reply_entry_count;
+			     i++) {
+				list_add(list, oat_hdr->type.descriptor.des_type,
+					 buf + buffer_processed +
+					 frame_processed);
+				frame_processed +=
+					oat_hdr->type.descriptor.reply_entry_len;
+			}
+		}
+		buffer_processed += ipa_hdr->len;
+	}
+	qsort(list->entry, list->cnt, sizeof(*list->entry), entry_cmp);
+}
+
+static void print_entry_json(struct qeth_oat_entry *e, const char *op)
+{
+	printf("{");
+	if (op)
+		printf("\"op\":\"%s\",", op);
+	printf("\"type\":\"%s\",\"address\":\"%s\"", e->type, e->address);
+	if (e->info_name)
+		printf(",\"%s\":\"%s\"", e->info_name, e->info);
+	printf("}");
+}
+
+static void print_entry(struct qeth_oat_entry *e, int json, const char *op)
+{
+	if (json) {
+		print_entry_json(e, op);
+		printf("\n");
+	} else {
+		printf("%s %-5s %-39s %s\n", strcmp(op, "add") ? "-" : "+",
+		       e->type, e->address, e->info);
+	}
+}
+
+static void print_json(char *buf, int len)
+{
+	struct qeth_oat_list list = {};
+	int i;
+
+	collect_entries(buf, len, &list);
+	printf("{\"entries\":[");
+	for (i = 0; i < list.cnt; i++) {
+		printf(i ? ",\n" : "\n");
+		print_entry_json(&list.entry[i], NULL);
+	}
+	printf("\n]}\n");
+	free(list.entry);
+}
+
+/*
+ * Print entries that were added to or removed from the sorted list "old"
+ */
+static void print_diff(struct qeth_oat_list *old, struct qeth_oat_list *new,
+		       int json)
+{
+	int i = 0, j = 0, rc;
+
+	while (i < old->cnt || j < new->cnt) {
+		if (i == old->cnt)
+			rc = 1;
+		else if (j == new->cnt)
+			rc = -1;
+		else
+			rc = entry_cmp(&old->entry[i], &new->entry[j]);
+		if (rc < 0) {
+			print_entry(&old->entry[i++], json, "del");
+		} else if (rc > 0) {
+			print_entry(&new->entry[j++], json, "add");
+		} else {
+			i++;
+			j++;
+		}
+	}
+	fflush(stdout);
+}
+
 static int print_IPA_error(int rc)
 {
 	switch (rc) {
@@ -513,12 +722,16 @@ static void parse_data(char *buf, int len)
 static void printusage()
 {
 	fprintf(stdout, "Usage: qethqoat [-h] [-v]\n"
-		"       qethqoat [-r] [-s scope] interface\n"
-		"       qethqoat -f file\n\n"
+		"       qethqoat [-r|-j] [-s scope] interface\n"
+		"       qethqoat [-j] -w seconds interface\n"
+		"       qethqoat [-j] -f file\n\n"
 		"Use qethqoat to query the OSA address table and display "
 		"physical and logical\ndevice information\n\n"
 		"-h,  --help     Displays the help information.\n"
 		"-r,  --raw      Writes raw data to stdout.\n"
+		"-j,  --json     Writes address table entries in JSON format.\n"
+		"-w,  --watch    Polls the address table at the given interval\n"
+		"                and writes added and removed entries.\n"
 		"-f,  --file     Reads input from file.\n"
 		"-v,  --version  Prints the version number.\n"
 		"-s,  --scope    Defines the scope of the query.\n"
@@ -530,23 +743,77 @@ static void printusage()
 static const struct option qethqoat_opts[] = {
 	{ "help",	0, 0, 'h'},
 	{ "raw",	0, 0, 'r'},
+	{ "json",	0, 0, 'j'},
+	{ "watch",	1, 0, 'w'},
 	{ "file",	1, 0, 'f'},
 	{ "version",	0, 0, 'v'},
 	{ "scope",	1, 0, 's'},
 	{ 0, 0, 0, 0}
 };
 
-static const char qethqoat_opts_str[] = "vhrf:s:";
+static const char qethqoat_opts_str[] = "vhrjw:f:s:";
+
+static int query_oat(struct qoat_opts *opts,
+		     struct qeth_query_oat_data *oat_data)
+{
+	struct ifreq ifr;
+	int sd, rc;
+
+	sd = socket(AF_INET, SOCK_STREAM, 0);
+	if (sd < 0) {
+		perror("qethqoat");
+		return 1;
+	}
+
+	util_strlcpy(ifr.ifr_name, opts->ifname, IFNAMSIZ);
+	oat_data->command = opts->scope;
+	oat_data->response_len = 0;
+	ifr.ifr_ifru.ifru_data = (void *)oat_data;
+
+	rc = ioctl(sd, SIOC_QETH_QUERY_OAT, &ifr);
+	if (rc) {
+		if (print_IPA_error(rc))
+			perror("qethqoat");
+		close(sd);
+		return 1;
+	}
+	close(sd);
+	return 0;
+}
+
+/*
+ * Poll the address table and print the changes of the descriptor entries
+ */
+static int watch_oat(struct qoat_opts *opts,
+		     struct qeth_query_oat_data *oat_data)
+{
+	struct qeth_oat_list list[2] = {};
+	int cur = 0;
+
+	while (1) {
+		if (query_oat(opts, oat_data))
+			break;
+		collect_entries((char *)(unsigned long)oat_data->ptr,
+				oat_data->response_len, &list[cur]);
+		print_diff(&list[!cur], &list[cur], opts->json);
+		cur = !cur;
+		sleep(opts->watch);
+	}
+	free(list[0].entry);
+	free(list[1].entry);
+	return 1;
+}
 
 int main(int argc, char **argv)
 {
 	struct qoat_opts opts;
-	int sd, c, rc, index;
-	struct ifreq ifr;
+	int c, rc, index;
 	struct qeth_query_oat_data oat_data;
 	size_t datalen = 131072;
 
 	opts.raw = 0;
+	opts.json = 0;
+	opts.watch = 0;
 	opts.scope = 1;
 	opts.file = NULL;
 	opts.ifname = NULL;
@@ -560,6 +827,17 @@ int main(int argc, char **argv)
 		case 'r':
 			opts.raw = 1;
 			break;
+		case 'j':
+			opts.json = 1;
+			break;
+		case 'w':
+			opts.watch = atoi(optarg);
+			if (opts.watch <= 0) {
+				fprintf(stderr, "qethqoat: Invalid interval "
+					"'%s'\n", optarg);
+				return 1;
+			}
+			break;
 		case 'f':
 			opts.file = optarg;
 			break;
@@ -575,6 +853,12 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if ((opts.raw && (opts.json || opts.watch)) ||
+	    (opts.watch && opts.file)) {
+		printusage();
+		return 1;
+	}
+
 	if (optind == argc) {
 		if (!opts.file) {	/* No -f file, interface name needed */
 			printusage();
@@ -601,6 +885,13 @@ int main(int argc, char **argv)
 	oat_data.buffer_len = datalen;
 	oat_data.response_len = 0;
 
+	if (opts.watch) {
+		/* Runs until interrupted or the query fails */
+		rc = watch_oat(&opts, &oat_data);
+		free((void *)(unsigned long)oat_data.ptr);
+		return rc;
+	}
+
 	if (opts.file) {
 		FILE *rf = fopen(opts.file, "r");
 		if (!rf) {
@@ -615,30 +906,18 @@ int main(int argc, char **argv)
 		goto parse;
 	}
 
-	sd = socket(AF_INET, SOCK_STREAM, 0);
-	if (sd < 0) {
-		perror("qethqoat");
-		free((void *)(unsigned long)oat_data.ptr);
-		return 1;
-	}
-
-	util_strlcpy(ifr.ifr_name, opts.ifname, IFNAMSIZ);
-	oat_data.command = opts.scope;
-	ifr.ifr_ifru.ifru_data = (void *)&oat_data;
-
-	rc = ioctl(sd, SIOC_QETH_QUERY_OAT, &ifr);
+	rc = query_oat(&opts, &oat_data);
 	if (rc) {
-		if (print_IPA_error(rc))
-			perror("qethqoat");
-		close(sd);
 		free((void *)(unsigned long)oat_data.ptr);
 		return 1;
 	}
-	close(sd);
 parse:
 	if (opts.raw) {
 		fwrite((char *)(unsigned long)oat_data.ptr,
 			sizeof(char), oat_data.response_len, stdout);
+	} else if (opts.json) {
+		print_json((char *)(unsigned long)oat_data.ptr,
+			   oat_data.response_len);
 	} else {
 		l_iconv_ebcdic_ascii = iconv_open("ISO-8859-1", "EBCDIC-US");
 		if (l_iconv_ebcdic_ascii == (iconv_t) -1) {
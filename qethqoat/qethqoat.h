@@ -12,6 +12,7 @@
 #define _QETHQOAT_H
 
 #include <linux/types.h>
+#include <netinet/in.h>
 
 #define SIOC_QETH_QUERY_OAT (SIOCDEVPRIVATE + 7)
 
@@ -216,8 +217,24 @@ struct qeth_print_hdr {
 	int aiq_h;
 };
 
+/* Address table entry in printable form, used for JSON and watch mode */
+struct qeth_oat_entry {
+	const char *type;
+	char address[INET6_ADDRSTRLEN];
+	const char *info_name;	/* Name of info field or NULL */
+	char info[32];
+};
+
+struct qeth_oat_list {
+	struct qeth_oat_entry *entry;
+	int cnt;
+	int max;
+};
+
 struct qoat_opts {
 	int raw;
+	int json;
+	int watch;		/* Poll interval in seconds, 0 = no watch mode */
 	char *ifname;
 	int scope;
 	char *file;
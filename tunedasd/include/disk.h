@@ -29,6 +29,8 @@ int disk_release (char* device);
 int disk_slock (char* device);
 int disk_query_reserve_status(char* device);
 int disk_profile (char* device, char* prof_item);
+int disk_profile_sample(char *devices[], int num, char *prof_item,
+			int interval, int count);
 int disk_reset_prof(char *device);
 int disk_reset_chpid(char *device, char *chpid);
 
@@ -17,6 +17,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "lib/dasd_sys.h"
@@ -612,6 +613,27 @@ static int disk_profile_item(dasd_profile_info_t dasd_profile_info,
 	return 0;
 }
 
+/*
+ * Read the profiling info of the device opened as fd.
+ */
+static int disk_read_profile(int fd, char *device,
+			     dasd_profile_info_t *dasd_profile_info)
+{
+	if (ioctl (fd, BIODASDPRRD, dasd_profile_info)) {
+		switch (errno) {
+		case EIO:		/* profiling is not active */
+			error_print ("Profiling (on device <%s>) is not "
+				     "active.", device);
+			break;
+		default:  		/* all other errors */
+			error_print ("Could not get profile info for device "
+				     "<%s>.", device);
+		}
+		return -1;
+	}
+	return 0;
+}
+
 /*
  * Get and print the profiling info of the device.
  */
@@ -629,16 +651,7 @@ disk_profile (char* device, char* prof_item)
 	}
 
 	/* Get the profile info */
-	if (ioctl (fd, BIODASDPRRD, &dasd_profile_info)) {
-		switch (errno) {
-		case EIO:		/* profiling is not active */
-			error_print ("Profiling (on device <%s>) is not "
-				     "active.", device);
-			break;
-		default:  		/* all other errors */
-			error_print ("Could not get profile info for device "
-				     "<%s>.", device);
-		}
+	if (disk_read_profile(fd, device, &dasd_profile_info)) {
 		close (fd);
 		return -1;
 	}
@@ -654,6 +667,94 @@ disk_profile (char* device, char* prof_item)
 }
 
 
+/*
+ * Calculate the difference of all profile counters between cur and prev.
+ * All counters are unsigned int, so wrapped counters are handled.
+ */
+static void disk_profile_delta(dasd_profile_info_t *delta,
+			       dasd_profile_info_t *cur,
+			       dasd_profile_info_t *prev)
+{
+	unsigned int *d = (unsigned int *) delta;
+	unsigned int *c = (unsigned int *) cur;
+	unsigned int *p = (unsigned int *) prev;
+	size_t i;
+
+	for (i = 0; i < sizeof(*delta) / sizeof(unsigned int); i++)
+		d[i] = c[i] - p[i];
+}
+
+/*
+ * Print the changes of the profiling info of all devices every interval
+ * seconds, count times or until interrupted if count is 0. The devices
+ * stay open, and intervals are measured from the start to avoid drift.
+ */
+int disk_profile_sample(char *devices[], int num, char *prof_item,
+			int interval, int count)
+{
+	dasd_profile_info_t *prev, cur, delta;
+	struct timespec next;
+	char stamp[32];
+	int *fds, i, n, rc = -1;
+	time_t now;
+
+	fds = malloc(num * sizeof(int));
+	prev = malloc(num * sizeof(dasd_profile_info_t));
+	if (!fds || !prev) {
+		error_print("Could not allocate memory");
+		free(fds);
+		free(prev);
+		return -1;
+	}
+	for (i = 0; i < num; i++)
+		fds[i] = -1;
+
+	for (i = 0; i < num; i++) {
+		fds[i] = open(devices[i], O_RDONLY);
+		if (fds[i] == -1) {
+			error_print("<%s> - %s", devices[i], strerror(errno));
+			goto out;
+		}
+		if (disk_read_profile(fds[i], devices[i], &prev[i]))
+			goto out;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (n = 0; count == 0 || n < count; n++) {
+		next.tv_sec += interval;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+				       NULL) == EINTR)
+			;
+		now = time(NULL);
+		strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S",
+			 localtime(&now));
+		for (i = 0; i < num; i++) {
+			if (disk_read_profile(fds[i], devices[i], &cur))
+				goto out;
+			disk_profile_delta(&delta, &cur, &prev[i]);
+			prev[i] = cur;
+			if (prof_item) {
+				printf("%s <%s> ", stamp, devices[i]);
+				disk_profile_item(delta, prof_item);
+			} else {
+				printf("\n%s <%s> last %d seconds:\n", stamp,
+				       devices[i], interval);
+				disk_profile_summary(delta);
+			}
+		}
+		fflush(stdout);
+	}
+	rc = 0;
+out:
+	for (i = 0; i < num; i++) {
+		if (fds[i] != -1)
+			close(fds[i]);
+	}
+	free(fds);
+	free(prev);
+	return rc;
+}
+
 /*
  * Reset the profiling counters of the device.
  */
@@ -8,6 +8,7 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -41,6 +42,8 @@ static const struct util_prg prg = {
 #define OPT_PATH_RESET_ALL	128
 #define OPT_ENABLE_STATS	129
 #define OPT_DISABLE_STATS	130
+#define OPT_INTERVAL		131
+#define OPT_COUNT		132
 
 static struct util_opt opt_vec[] = {
 	UTIL_OPT_SECTION("CACHING MODES (ECKD ONLY)"),
@@ -106,6 +109,19 @@ static struct util_opt opt_vec[] = {
 		.option = { "reset_prof", no_argument, NULL, 'R' },
 		.desc = "Reset profile info of device",
 	},
+	{
+		.option = { "interval", required_argument, NULL, OPT_INTERVAL },
+		.argument = "SECONDS",
+		.desc = "Print profile changes every SECONDS (only valid with "
+			"-P/--profile)",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
+	{
+		.option = { "count", required_argument, NULL, OPT_COUNT },
+		.argument = "NUM",
+		.desc = "Stop after NUM intervals (only valid with --interval)",
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
 	UTIL_OPT_SECTION("MISC"),
 	{
 		.option = { "path_reset", required_argument, NULL, 'p' },
@@ -124,7 +140,7 @@ static struct util_opt opt_vec[] = {
 	UTIL_OPT_END
 };
 
-#define CMD_KEYWORD_NUM		16
+#define CMD_KEYWORD_NUM		18
 #define DEVICES_NUM		256
 
 enum cmd_keyword_id {
@@ -144,6 +160,8 @@ enum cmd_keyword_id {
 	cmd_keyword_path_all,
 	cmd_keyword_enable_stats,
 	cmd_keyword_disable_stats,
+	cmd_keyword_interval,
+	cmd_keyword_count,
 };
 
 
@@ -167,7 +185,9 @@ static const struct {
 	{ "path_reset",     cmd_keyword_path },
 	{ "path_reset_all", cmd_keyword_path_all },
 	{ "enable-stats",   cmd_keyword_enable_stats },
-	{ "disable-stats",  cmd_keyword_disable_stats }
+	{ "disable-stats",  cmd_keyword_disable_stats },
+	{ "interval",       cmd_keyword_interval },
+	{ "count",          cmd_keyword_count }
 };	
 
 
@@ -180,26 +200,28 @@ enum cmd_key_state {
 
 /* Determines which combination of keywords are valid */
 static enum cmd_key_state cmd_key_table[CMD_KEYWORD_NUM][CMD_KEYWORD_NUM] = {
-	/*		      help vers get_ cach no_c rese rele sloc prof prof rese quer path path
-	 *		           ion  cach e    yl   rve  ase  k    ile  _ite t_pr y_re      _all
+	/*		      help vers get_ cach no_c rese rele sloc prof prof rese quer path path enab disa inte coun
+	 *		           ion  cach e    yl   rve  ase  k    ile  _ite t_pr y_re      _all le-s ble- rval t
 	 *		               	e                                  m    of  serv
 	 */
-	/* help  	 */ { req, opt, opt, opt, opt, opt, opt, opt, opt, opt, opt, inv, inv, inv, inv, inv },
-	/* version	 */ { inv, req, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
-	/* get_cache	 */ { opt, opt, req, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
-	/* cache 	 */ { opt, opt, inv, req, opt, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
-	/* no_cyl	 */ { opt, opt, inv, req, req, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
-	/* reserve	 */ { opt, opt, inv, inv, inv, req, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
-	/* release	 */ { opt, opt, inv, inv, inv, inv, req, inv, inv, inv, inv, inv, inv, inv, inv, inv },
-	/* slock 	 */ { opt, opt, inv, inv, inv, inv, inv, req, inv, inv, inv, inv, inv, inv, inv, inv },
-	/* profile	 */ { opt, opt, inv, inv, inv, inv, inv, inv, req, opt, inv, inv, inv, inv, inv, inv },
-	/* prof_item	 */ { opt, opt, inv, inv, inv, inv, inv, inv, req, req, inv, inv, inv, inv, inv, inv },
-	/* reset_prof	 */ { opt, opt, inv, inv, inv, inv, inv, inv, inv, inv, req, inv, inv, inv, inv, inv },
-	/* query_reserve */ { inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, req, inv, inv, inv, inv },
-	/* path          */ { inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, req, inv, inv, inv },
-	/* path_all      */ { inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, req, inv, inv },
-	/* enable-stats  */ { inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, req, inv },
-	/* disable-stats */ { inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, req },
+	/* help  	 */ { req, opt, opt, opt, opt, opt, opt, opt, opt, opt, opt, inv, inv, inv, inv, inv, inv, inv },
+	/* version	 */ { inv, req, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
+	/* get_cache	 */ { opt, opt, req, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
+	/* cache 	 */ { opt, opt, inv, req, opt, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
+	/* no_cyl	 */ { opt, opt, inv, req, req, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
+	/* reserve	 */ { opt, opt, inv, inv, inv, req, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
+	/* release	 */ { opt, opt, inv, inv, inv, inv, req, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
+	/* slock 	 */ { opt, opt, inv, inv, inv, inv, inv, req, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv },
+	/* profile	 */ { opt, opt, inv, inv, inv, inv, inv, inv, req, opt, inv, inv, inv, inv, inv, inv, opt, opt },
+	/* prof_item	 */ { opt, opt, inv, inv, inv, inv, inv, inv, req, req, inv, inv, inv, inv, inv, inv, opt, opt },
+	/* reset_prof	 */ { opt, opt, inv, inv, inv, inv, inv, inv, inv, inv, req, inv, inv, inv, inv, inv, inv, inv },
+	/* query_reserve */ { inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, req, inv, inv, inv, inv, inv, inv },
+	/* path          */ { inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, req, inv, inv, inv, inv, inv },
+	/* path_all      */ { inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, req, inv, inv, inv, inv },
+	/* enable-stats  */ { inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, req, inv, inv, inv },
+	/* disable-stats */ { inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, inv, req, inv, inv },
+	/* interval      */ { inv, inv, inv, inv, inv, inv, inv, inv, req, opt, inv, inv, inv, inv, inv, inv, req, opt },
+	/* count         */ { inv, inv, inv, inv, inv, inv, inv, inv, req, opt, inv, inv, inv, inv, inv, inv, req, req },
 };
 
 struct parameter {
@@ -345,6 +367,24 @@ store_option (struct command_line* cmdline, enum cmd_keyword_id keyword,
 }
 
 
+/*
+ * Check that the value of option NAME is a positive number.
+ */
+static int check_positive_number(const char *name, char *value)
+{
+	char *endptr;
+	long num;
+
+	errno = 0;
+	num = strtol(value, &endptr, 10);
+	if (errno || *endptr || num < 1 || num > INT_MAX) {
+		error_print("Invalid value '%s' for option '%s'", value, name);
+		return -1;
+	}
+	return 0;
+}
+
+
 /*
  * Parse the command line for valid parameters.
  */
@@ -439,6 +479,18 @@ static int get_command_line(int argc, char *argv[], struct command_line *line)
 			rc = store_option (&cmdline, cmd_keyword_query_reserve,
 					   optarg);
 			break;
+		case OPT_INTERVAL:
+			rc = check_positive_number("interval", optarg);
+			if (rc >= 0)
+				rc = store_option(&cmdline,
+						  cmd_keyword_interval, optarg);
+			break;
+		case OPT_COUNT:
+			rc = check_positive_number("count", optarg);
+			if (rc >= 0)
+				rc = store_option(&cmdline, cmd_keyword_count,
+						  optarg);
+			break;
 
 		case -1:
 			/* End of options string - start of devices list */
@@ -558,6 +610,12 @@ main (int argc, char* argv[])
 	if (rc) {
 		return 1;
 	}
+	if (cmdline.parm[cmd_keyword_count].kw_given &&
+	    !cmdline.parm[cmd_keyword_interval].kw_given) {
+		error_print("Option 'interval' required when specifying "
+			    "'count'");
+		return 1;
+	}
 
 	/* Check for priority options --help and --version */
 	if (cmdline.parm[cmd_keyword_help].kw_given) {
@@ -587,6 +645,16 @@ main (int argc, char* argv[])
 		return 1;
 	}
 
+	/* Sample the profiles of all devices at the same time */
+	if (cmdline.parm[cmd_keyword_interval].kw_given) {
+		return disk_profile_sample(&argv[cmdline.device_id],
+				argc - cmdline.device_id,
+				cmdline.parm[cmd_keyword_prof_item].data,
+				atoi(cmdline.parm[cmd_keyword_interval].data),
+				cmdline.parm[cmd_keyword_count].kw_given ?
+				atoi(cmdline.parm[cmd_keyword_count].data) : 0);
+	}
+
 	finalrc = 0;
 	while (cmdline.device_id < argc) {
 		rc = do_command (argv[cmdline.device_id], cmdline);
@@ -25,10 +25,11 @@ static struct option longopts[] = {
 	{"help",no_argument,0,'h'},
 	{"version",no_argument,0,'v'},
 	{"output",required_argument,0,'o'},
+	{"elf",no_argument,0,'e'},
 	{0,0,0,0}
 };
 
-#define OPTSTRING "f:o:vh"
+#define OPTSTRING "f:o:evh"
 extern char *optarg;
 
 /* Version info */
@@ -40,21 +41,26 @@ static const char copyright_notice[] = "Copyright IBM Corp. 2004, 2017";
 
 /* Usage information */
 static const char usage_text[] = \
-"Usage: vmconvert -f VMDUMPFILE [-o OUTPUTFILE]\n" \
-"       vmconvert VMDUMPFILE [OUTPUTFILE]\n" \
+"Usage: vmconvert -f VMDUMPFILE [-o OUTPUTFILE] [-e]\n" \
+"       vmconvert VMDUMPFILE [OUTPUTFILE] [-e]\n" \
 "\n" \
-"Convert a vmdump into a lkcd (linux kernel crash dumps) dump.\n" \
+"Convert a vmdump into a lkcd (linux kernel crash dumps) or ELF dump.\n" \
 "\n" \
 "-h, --help                 Print this help, then exit.\n" \
 "-v, --version              Print version information, then exit.\n" \
 "-f, --file VMDUMPFILE      The vmdump file VMDUMPFILE, which should be\n"\
 "                           converted.\n" \
 "-o, --output OUTPUTFILE    The converted lkcd dump file OUTPUTFILE.\n"\
-"                           The default file name is 'dump.lkcd'.\n";
+"                           The default file name is 'dump.lkcd', or\n"\
+"                           'dump.elf' with option --elf.\n" \
+"-e, --elf                  Write an ELF core dump instead of a lkcd dump.\n"\
+"                           Pages not contained in the vmdump are written\n"\
+"                           as file holes.\n";
 
 /* Globals */
 char inputFileName[1024];
 char outputFileName[1024] = "dump.lkcd";
+int elfOutput;
 
 void 
 parseOpts(int argc, char* argv[])
@@ -73,6 +79,9 @@ parseOpts(int argc, char* argv[])
 				strcpy(outputFileName, optarg);
 				outputFileSet = 1;
 				break;
+			case 'e':
+				elfOutput = 1;
+				break;
 			case 'h':
 				printf("%s", usage_text);
 				exit(0);
@@ -105,6 +114,9 @@ parseOpts(int argc, char* argv[])
 		}
 	}
 
+	if (elfOutput && !outputFileSet)
+		strcpy(outputFileName, "dump.elf");
+
 	if(!inputFileSet){
 		printf("%s: input file required - use '-f' option!\n",argv[0]);	
 		exit(1);
@@ -128,7 +140,11 @@ main(int argc, char* argv[])
 		if((strcmp(answer,"y") != 0) && (strcmp(answer,"yes") != 0))
 			exit(0);
 	}
-	rc = vmdump_convert(inputFileName, outputFileName, argv[0]);
+	if (elfOutput)
+		rc = vmdump_convert_elf(inputFileName, outputFileName,
+					argv[0]);
+	else
+		rc = vmdump_convert(inputFileName, outputFileName, argv[0]);
 	if (!rc)
 		printf("'%s' has been written successfully.\n", outputFileName);
 	return rc;
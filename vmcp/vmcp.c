@@ -47,6 +47,7 @@
 #define VMCP_OPT 4
 
 static int keep_case = 0;
+static int auto_size = 0;
 static int buffersize = VMCP_DEFAULT_BUFSZ;
 static char command[MAXCMDLEN + 1];
 
@@ -63,6 +64,11 @@ static struct util_opt opt_vec[] = {
 			"or megabytes (M). SIZE range from 4096 to 1048576 "
 			"bytes"
 	},
+	{
+		.option = { "autosize", no_argument, NULL, 'a' },
+		.desc = "Use the largest possible buffer, the response "
+			"is not truncated if it fits into 1048576 bytes"
+	},
 	UTIL_OPT_HELP,
 	UTIL_OPT_VERSION,
 	UTIL_OPT_END
@@ -110,8 +116,8 @@ static long parse_buffersize(char *string)
 	return bytes;
 }
 
-/* Parse tool parameters. Fill in global variables keep_case, buffersize and
- * command according to parameters. Return VMCP_OK on success, VMCP_OPT
+/* Parse tool parameters. Fill in global variables keep_case, auto_size,
+ * buffersize and command according to parameters. Return VMCP_OK on success, VMCP_OPT
  * in case of parameter errors. In case of --help or --version, print
  * respective text to stdout and exit. */
 static int parse_args(int argc, char **argv)
@@ -135,6 +141,9 @@ static int parse_args(int argc, char **argv)
 		case 'k':
 			keep_case = 1;
 			break;
+		case 'a':
+			auto_size = 1;
+			break;
 		case 'b':
 			buffersize = (int) parse_buffersize(optarg);
 			if (buffersize == -1) {
@@ -209,6 +218,7 @@ int main(int argc, char **argv)
 	cp.buffer_size = buffersize;
 	cp.cpcmd = command;
 	cp.do_upper = !keep_case;
+	cp.auto_size = auto_size;
 
 	ret = vmcp(&cp);
 
@@ -20,6 +20,7 @@
 #include <libgen.h>
 #include <signal.h>
 #include <iconv.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <sys/sysmacros.h>
@@ -78,6 +79,7 @@ struct vmur {
 	int   stdout_specified;
 	int   hold_specified;
 	int   convert_specified;
+	int   elf_specified;
 	enum  ur_action action;
 	int   devno;
 	int   ur_reclen;
@@ -85,6 +87,8 @@ struct vmur {
 	enum spoolfile_fmt spoolfile_fmt;
 	struct sigaction sigact;
 	iconv_t iconv;
+	unsigned char xlat[256];
+	int   xlat_valid;
 	int   lock_fd;
 	/* ur device spool state */
 	char  spool_restore_cmd[MAXCMDLEN];
@@ -185,6 +189,8 @@ static char HELP_TEXT[] =
 "-b, --blocked            Use blocked mode.\n"
 "-c, --convert            Specifies to convert VMDUMP file into a format\n"
 "                         appropriate for further analysis with (l)crash.\n"
+"-e, --elf                Convert VMDUMP file into an ELF dump. Requires\n"
+"                         option --convert.\n"
 "-O, --stdout             Write spool file to stdout.\n"
 "-f, --force              Overwrite files without prompt.\n"
 "-H, --hold               Hold spool file in reader after receive.\n"
@@ -279,6 +285,7 @@ static void cperr_exit(char *cpcmd, int cprc, char *buf)
 
 static void _cpcmd(char *cpcmd, char **resp, int *rc, int retry, int upper)
 {
+	static int vmcp_handle = -1;
 	struct vmcp_parm cp;
 	char cmd[MAXCMDLEN];
 	int ret;
@@ -286,16 +293,22 @@ static void _cpcmd(char *cpcmd, char **resp, int *rc, int retry, int upper)
 	strcpy(cmd, cpcmd);
 	cp.cpcmd = cmd;
 	cp.do_upper = upper;
+	cp.auto_size = false;
 	cp.buffer_size = VMCP_DEFAULT_BUFSZ;
 
+	/* All CP commands of one vmur run share one VMCP device */
+	if (vmcp_handle < 0) {
+		vmcp_handle = vmcp_open();
+		if (vmcp_handle < 0)
+			ERR_EXIT("Could not issue CP command: \"%s\"\n"
+				 "Ensure that vmcp kernel module is loaded!\n",
+				 cmd);
+	}
+
 retry:
-	ret = vmcp(&cp);
+	ret = vmcp_fd(vmcp_handle, &cp);
 
 	switch (ret) {
-	case VMCP_ERR_OPEN:
-		ERR_EXIT("Could not issue CP command: \"%s\"\n"
-			 "Ensure that vmcp kernel module is loaded!\n", cmd);
-
 	case VMCP_ERR_SETBUF:
 		goto fail;
 
@@ -778,12 +791,13 @@ static void parse_opts_receive(struct vmur *info, int argc, char *argv[])
 		{ "force",       no_argument,       NULL, 'f'},
 		{ "hold",        no_argument,       NULL, 'H'},
 		{ "convert",     no_argument,       NULL, 'c'},
+		{ "elf",         no_argument,       NULL, 'e'},
 		{ "device",      required_argument, NULL, 'd'},
 		{ "blocked",     required_argument, NULL, 'b'},
 		{ "class",       required_argument, NULL, 'C'},
 		{ 0,             0,                 0,    0  }
 	};
-	static const char option_string[] = "vhtOfHcd:b:C:";
+	static const char option_string[] = "vhtOfHced:b:C:";
 
 	strcpy(info->devnode, VMRDR_DEVICE_NODE);
 	while (1) {
@@ -816,6 +830,9 @@ static void parse_opts_receive(struct vmur *info, int argc, char *argv[])
 		case 'c':
 			++info->convert_specified;
 			break;
+		case 'e':
+			++info->elf_specified;
+			break;
 		case 'C':
 			set_spool_class(info, optarg, 1);
 			break;
@@ -835,6 +852,7 @@ static void parse_opts_receive(struct vmur *info, int argc, char *argv[])
 	CHECK_SPEC_MAX(info->hold_specified, 1, "hold");
 	CHECK_SPEC_MAX(info->stdout_specified, 1, "stdout");
 	CHECK_SPEC_MAX(info->convert_specified, 1, "convert");
+	CHECK_SPEC_MAX(info->elf_specified, 1, "elf");
 	CHECK_SPEC_MAX(info->spool_class_specified, 1, "class");
 
 	if (info->stdout_specified && info->file_name_specified)
@@ -843,6 +861,8 @@ static void parse_opts_receive(struct vmur *info, int argc, char *argv[])
 	    info->convert_specified > 1)
 		ERR_EXIT("Conflicting options: -b, -t and -c are mutually "
 			 "exclusive.\n");
+	if (info->elf_specified && !info->convert_specified)
+		ERR_EXIT("Option -e requires option -c.\n");
 	if (!info->spool_class_specified)
 		set_spool_class(info, "*", 1);
 }
@@ -1528,6 +1548,19 @@ enum spoolfile_fmt get_spoolfile_fmt(struct vmur *info,
 	return TYPE_NORMAL;
 }
 
+/*
+ * Translate a buffer with the single-byte code page table
+ */
+static void xlat_buf(struct vmur *info, char *out, const char *in, size_t len)
+{
+	const unsigned char *src = (const unsigned char *) in;
+	unsigned char *dst = (unsigned char *) out;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		dst[i] = info->xlat[src[i]];
+}
+
 /*
  * Convert record for text mode: Do EBCDIC->ASCII translation
  */
@@ -1542,6 +1575,12 @@ static int convert_text(struct vmur *info, struct splink_record *rec,
 	if ((rec->ccw.data_len == 1) && (data_ptr[0] == 0x40))
 		goto out; /* one blank -> just a newline */
 
+	if (info->xlat_valid) {
+		xlat_buf(info, *out_ptr, data_ptr, in_count);
+		*out_ptr += in_count;
+		goto out;
+	}
+
 	rc = iconv(info->iconv, &data_ptr, &in_count, out_ptr, &out_count);
 	if ((rc == -1) || (in_count != 0)) {
 		ERR("Code page translation EBCDIC-ASCII failed\n");
@@ -1641,37 +1680,45 @@ ssize_t convert_sfdata(struct vmur *info, struct splink_page *in, char *out)
 
 /*
  * Write normal spool file data.
+ *
+ * All pages are converted into one output buffer, which is written with
+ * a single system call.
  */
 int write_normal(struct vmur *info, struct splink_page *sfdata, int count,
 		 int fho)
 {
+	size_t size = 0, pos = 0;
 	char *outbuf;
-	int len, i;
+	ssize_t len;
+	int i, rc = 0;
 
-	for (i = 0; i < count; i++) {
-		struct splink_page *data;
+	for (i = 0; i < count; i++)
+		size += (info->file_reclen + 1) * sfdata[i].data_recs;
+	if (size == 0)
+		return 0;
 
-		data = &sfdata[i];
-		outbuf = (char *) malloc((info->file_reclen + 1) *
-					 data->data_recs);
-		if (!outbuf) {
-			ERR("Out of memory\n");
-			return -ENOMEM;
-		}
-		len = convert_sfdata(info, data, outbuf);
+	outbuf = (char *) malloc(size);
+	if (!outbuf) {
+		ERR("Out of memory\n");
+		return -ENOMEM;
+	}
+	for (i = 0; i < count; i++) {
+		len = convert_sfdata(info, &sfdata[i], outbuf + pos);
 		if (len < 0) {
 			ERR("Data conversion failed\n");
-			return -EINVAL;
-		}
-		if (write(fho, outbuf, len) == -1) {
-			ERR("Write to file %s failed: %s\n", info->file_name,
-			    strerror(errno));
-			return -errno;
+			rc = -EINVAL;
+			goto out;
 		}
-		free(outbuf);
+		pos += len;
 	}
-
-	return 0;
+	if (write(fho, outbuf, pos) == -1) {
+		rc = -errno;
+		ERR("Write to file %s failed: %s\n", info->file_name,
+		    strerror(errno));
+	}
+out:
+	free(outbuf);
+	return rc;
 }
 
 /*
@@ -1689,6 +1736,169 @@ int write_vmdump(struct vmur *info, struct splink_page *sfdata, int count,
 	return 0;
 }
 
+/*
+ * Double-buffered reader: A reader thread fills one batch of spool file
+ * pages while the caller converts and writes the other one.
+ */
+struct read_batch {
+	struct splink_page *pages;
+	ssize_t count;	/* Bytes read, 0 for end of file, -1 for error */
+	int err;	/* errno if count is -1 */
+	int filled;
+};
+
+struct reader {
+	int fd;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct read_batch batch[2];
+	int stop;
+};
+
+static void *reader_thread(void *arg)
+{
+	struct reader *rd = (struct reader *) arg;
+	struct read_batch *b;
+	ssize_t count;
+	int idx = 0;
+
+	while (1) {
+		b = &rd->batch[idx];
+		pthread_mutex_lock(&rd->lock);
+		while (b->filled && !rd->stop)
+			pthread_cond_wait(&rd->cond, &rd->lock);
+		pthread_mutex_unlock(&rd->lock);
+		if (rd->stop)
+			break;
+
+		count = read(rd->fd, b->pages,
+			     READ_BATCH_BLOCKS * sizeof(b->pages[0]));
+
+		pthread_mutex_lock(&rd->lock);
+		b->count = count;
+		b->err = (count == -1) ? errno : 0;
+		b->filled = 1;
+		pthread_cond_broadcast(&rd->cond);
+		pthread_mutex_unlock(&rd->lock);
+		if (count <= 0)
+			break;
+		idx ^= 1;
+	}
+	return NULL;
+}
+
+static int reader_start(struct reader *rd, int fd)
+{
+	int i;
+
+	memset(rd, 0, sizeof(*rd));
+	rd->fd = fd;
+	for (i = 0; i < 2; i++) {
+		rd->batch[i].pages = (struct splink_page *)
+			malloc(READ_BATCH_BLOCKS * sizeof(struct splink_page));
+		if (!rd->batch[i].pages) {
+			ERR("Out of memory\n");
+			free(rd->batch[0].pages);
+			return -ENOMEM;
+		}
+	}
+	pthread_mutex_init(&rd->lock, NULL);
+	pthread_cond_init(&rd->cond, NULL);
+	if (pthread_create(&rd->thread, NULL, reader_thread, rd)) {
+		ERR("Could not start reader thread\n");
+		free(rd->batch[0].pages);
+		free(rd->batch[1].pages);
+		return -EAGAIN;
+	}
+	return 0;
+}
+
+/*
+ * Wait for the next filled batch
+ */
+static struct read_batch *reader_get(struct reader *rd, int idx)
+{
+	struct read_batch *b = &rd->batch[idx];
+
+	pthread_mutex_lock(&rd->lock);
+	while (!b->filled)
+		pthread_cond_wait(&rd->cond, &rd->lock);
+	pthread_mutex_unlock(&rd->lock);
+	return b;
+}
+
+/*
+ * Hand a processed batch back to the reader thread
+ */
+static void reader_put(struct reader *rd, struct read_batch *b)
+{
+	pthread_mutex_lock(&rd->lock);
+	b->filled = 0;
+	pthread_cond_broadcast(&rd->cond);
+	pthread_mutex_unlock(&rd->lock);
+}
+
+static void reader_stop(struct reader *rd)
+{
+	pthread_mutex_lock(&rd->lock);
+	rd->stop = 1;
+	pthread_cond_broadcast(&rd->cond);
+	pthread_mutex_unlock(&rd->lock);
+	pthread_join(rd->thread, NULL);
+	pthread_cond_destroy(&rd->cond);
+	pthread_mutex_destroy(&rd->lock);
+	free(rd->batch[0].pages);
+	free(rd->batch[1].pages);
+}
+
+/*
+ * Convert and write spool file pages
+ */
+static int write_sfdata(struct vmur *info, enum spoolfile_fmt type,
+			struct splink_page *sfdata, ssize_t count, int fho)
+{
+	int blocks = count / sizeof(sfdata[0]);
+
+	if (type == TYPE_VMDUMP)
+		return write_vmdump(info, sfdata, blocks, fho);
+	return write_normal(info, sfdata, blocks, fho);
+}
+
+/*
+ * Read the remaining spool file data with the reader thread, convert it,
+ * and write it to the output file
+ */
+static int receive_sfdata(struct vmur *info, enum spoolfile_fmt type, int fhi,
+			  int fho)
+{
+	struct read_batch *b;
+	struct reader rd;
+	int idx = 0, rc;
+
+	rc = reader_start(&rd, fhi);
+	if (rc)
+		return rc;
+	while (1) {
+		b = reader_get(&rd, idx);
+		if (b->count == -1) {
+			ERR("Could not read from device %s\n%s\n",
+			    info->devnode, strerror(b->err));
+			rc = -b->err;
+			break;
+		}
+		if (b->count == 0)
+			break;
+		rc = write_sfdata(info, type, b->pages, b->count, fho);
+		if (rc)
+			break;
+		reader_put(&rd, b);
+		idx ^= 1;
+	}
+	reader_stop(&rd);
+	return rc;
+}
+
 /*
  * Clean up and restore spool options
  */
@@ -1709,6 +1919,19 @@ static void ur_receive_sig_handler(int UNUSED(sig), siginfo_t *UNUSED(sip),
 	ERR_EXIT("Operation terminated, spool file received incompletely.\n");
 }
 
+/*
+ * Convert the VMDUMP directly from the reader device into a LKCD or ELF
+ * dump, without an intermediate copy of the VMDUMP
+ */
+static int receive_convert(struct vmur *info)
+{
+	const char *out = info->stdout_specified ? NULL : info->file_name;
+
+	if (info->elf_specified)
+		return vmdump_convert_elf(info->devnode, out, prog_name);
+	return vmdump_convert(info->devnode, out, prog_name);
+}
+
 /*
  * Receive reader file.
  */
@@ -1756,12 +1979,7 @@ static void ur_receive(struct vmur *info)
 			goto fail;
 		} else {
 			close(fhi);
-			if (info->stdout_specified)
-				rc = vmdump_convert(info->devnode, NULL,
-						    prog_name);
-			else
-				rc = vmdump_convert(info->devnode,
-						    info->file_name, prog_name);
+			rc = receive_convert(info);
 			if (rc)
 				goto fail;
 			else
@@ -1796,25 +2014,11 @@ static void ur_receive(struct vmur *info)
 			goto fail;
 		}
 	}
-	while (count != 0) {
-		int blocks;
-
-		blocks = count / sizeof(sfdata[0]);
-		if (type == TYPE_VMDUMP)
-			rc = write_vmdump(info, &sfdata[0], blocks, fho);
-		else
-			rc = write_normal(info, &sfdata[0], blocks, fho);
-
-		if (rc)
+	if (count != 0) {
+		if (write_sfdata(info, type, &sfdata[0], count, fho))
 			goto fail;
-
-		/* read next records */
-		count = read(fhi, &sfdata, READ_BLOCKS * sizeof(sfdata[0]));
-		if (count == -1) {
-			ERR("Could not read from device %s\n%s\n",
-			    info->devnode, strerror(errno));
+		if (receive_sfdata(info, type, fhi, fho))
 			goto fail;
-		}
 	}
 	if (fho != STDOUT_FILENO)
 		close(fho);
@@ -1958,6 +2162,15 @@ static void ur_write_sig_handler(int UNUSED(sig), siginfo_t *UNUSED(sip),
 	ERR_EXIT("Operation terminated, no spool file created.\n");
 }
 
+/*
+ * Input buffer for read_line()
+ */
+static struct {
+	char buf[65536];
+	size_t pos;
+	size_t len;
+} line_in;
+
 /*
  * Read on line from fd not including newline
  */
@@ -1965,18 +2178,33 @@ static int read_line(int fd, char *buf, int len, int lf)
 {
 	int offs = 0;
 
-	memset(buf, 0, len);
 	do {
-		int rc;
-
-		rc = read(fd, buf + offs, 1);
-		if (rc < 0)
-			return -EIO;
-		if (rc == 0)
-			return -ENODATA;
-		if (*(buf + offs) == lf)
+		size_t avail;
+		char *p;
+
+		if (line_in.pos == line_in.len) {
+			ssize_t rc;
+
+			rc = read(fd, line_in.buf, sizeof(line_in.buf));
+			if (rc < 0)
+				return -EIO;
+			if (rc == 0)
+				return -ENODATA;
+			line_in.pos = 0;
+			line_in.len = rc;
+		}
+		avail = MIN(line_in.len - line_in.pos, (size_t) (len - offs));
+		p = (char *) memchr(line_in.buf + line_in.pos, lf, avail);
+		if (p) {
+			avail = p - (line_in.buf + line_in.pos);
+			memcpy(buf + offs, line_in.buf + line_in.pos, avail);
+			line_in.pos += avail + 1;
+			offs += avail;
 			goto found;
-		offs++;
+		}
+		memcpy(buf + offs, line_in.buf + line_in.pos, avail);
+		line_in.pos += avail;
+		offs += avail;
 	} while (offs < len);
 
 	return -EINVAL;
@@ -2022,6 +2250,12 @@ static int read_text_file(struct vmur *info, int fd, char *out_buf, size_t len)
 		}
 		line++;
 		memset(buf + line_len, pad, info->ur_reclen - line_len);
+		if (info->xlat_valid) {
+			/* Translated for all records at once below */
+			memcpy(&out_buf[pos], buf, info->ur_reclen);
+			pos += info->ur_reclen;
+			continue;
+		}
 		rec_len = out_len = info->ur_reclen;
 		in_ptr = buf;
 		out_ptr = &out_buf[pos];
@@ -2032,6 +2266,8 @@ static int read_text_file(struct vmur *info, int fd, char *out_buf, size_t len)
 		}
 		pos += info->ur_reclen;
 	} while (pos < len);
+	if (info->xlat_valid)
+		xlat_buf(info, out_buf, out_buf, pos);
 	free(buf);
 	return pos;
 fail:
@@ -2282,6 +2518,33 @@ static int ur_list(struct vmur *info)
 	return 0;
 }
 
+/*
+ * Build a translation table from iconv if both code pages are single-byte
+ * code pages. The table is then used instead of iconv for all records.
+ */
+static void setup_xlat(struct vmur *info)
+{
+	size_t in_count, out_count;
+	char in, out, *in_ptr, *out_ptr;
+	int i;
+
+	info->xlat_valid = 0;
+	for (i = 0; i < 256; i++) {
+		in = i;
+		in_ptr = &in;
+		out_ptr = &out;
+		in_count = out_count = 1;
+		if (iconv(info->iconv, &in_ptr, &in_count, &out_ptr,
+			  &out_count) == (size_t) -1 || in_count || out_count)
+			goto out;
+		info->xlat[i] = out;
+	}
+	info->xlat_valid = 1;
+out:
+	/* Reset the conversion state */
+	iconv(info->iconv, NULL, NULL, NULL, NULL);
+}
+
 /*
  * Initialize iconv: "from" -> "to"
  */
@@ -2291,6 +2554,7 @@ static void setup_iconv(struct vmur *info, const char *from, const char *to)
 	if (info->iconv == ((iconv_t) -1))
 		ERR_EXIT("Could not initialize conversion table %s->%s.\n",
 			 from, to);
+	setup_xlat(info);
 }
 
 int main(int argc, char **argv)
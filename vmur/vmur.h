@@ -61,6 +61,7 @@ do { \
 #define ASCII_CODE_PAGE  "ISO-8859-1"
 
 #define READ_BLOCKS 80
+#define READ_BATCH_BLOCKS 256
 
 enum spoolfile_fmt {
 	TYPE_NORMAL,
@@ -7,12 +7,18 @@
  * it under the terms of the MIT license. See LICENSE for details.
  */
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <regex.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "lib/ccw.h"
 #include "lib/util_base.h"
-#include "lib/util_file.h"
 #include "lib/util_libc.h"
 #include "lib/util_list.h"
 #include "lib/util_opt.h"
@@ -68,6 +74,25 @@ enum sch_type {
 	SUBCHANNEL_TYPE_EADM = 3,	/* EADM subchannels */
 };
 
+/* Subchannel type for subchannels without type attribute */
+#define SUBCHANNEL_TYPE_NONE	-1
+
+/* Subchannel data collected in one pass over the css bus */
+struct sch_info {
+	char *name;	/* Subchannel ID */
+	char *device;	/* ID of first CCW device or NULL */
+	int type;	/* Subchannel type or SUBCHANNEL_TYPE_NONE */
+};
+
+/* All subchannels of the system, sorted by subchannel ID */
+static struct sch_list {
+	bool done;		/* List has been filled in */
+	int dir_fd;		/* File descriptor of css devices directory */
+	int count;		/* Number of subchannels */
+	struct sch_info *vec;	/* Subchannel array */
+	regex_t id_re;		/* Compiled ID_FORMAT */
+} schs;
+
 /*
  * Private data
  */
@@ -301,18 +326,55 @@ static bool in_devtypes_list(char *dtype)
 	return false;
 }
 
+/*
+ * Read the first line of attribute "name" relative to directory "dir_fd"
+ *
+ * Like util_file_read_line(), but without building absolute path names and
+ * without stdio, which matters for many thousand subchannels.
+ *
+ * @returns 0 - Line without trailing newline stored in "buf"
+ *         -1 - Attribute could not be read or is empty
+ */
+static int read_attr(char *buf, size_t size, int dir_fd, const char *fmt, ...)
+{
+	char name[PATH_MAX], *end;
+	ssize_t len;
+	va_list ap;
+	int fd;
+
+	va_start(ap, fmt);
+	vsnprintf(name, sizeof(name), fmt, ap);
+	va_end(ap);
+
+	buf[0] = 0;
+	fd = openat(dir_fd, name, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len <= 0) {
+		buf[0] = 0;
+		return -1;
+	}
+	buf[len] = 0;
+	end = strchr(buf, '\n');
+	if (end)
+		*end = 0;
+	return (buf[0] == 0) ? -1 : 0;
+}
+
 /*
  * Fill in the device related entry fields (devtyp, cutype, use, avail)
  *
  * @returns 0 - devtype matches devtypes list, device information filled in
  *          1 - devtype does not match devtypes list, skip entry
  */
-static int fill_device_info(struct util_rec *rec, char *path, char *device)
+static int fill_device_info(struct util_rec *rec, int dir_fd, char *device)
 {
 	unsigned long int val_ul;
 	char buf[MAX_BUF_SIZE];
 
-	if (!path || !device) {
+	if (dir_fd < 0 || !device) {
 		if (cmd.opt_devtype && cmd.dev_count > 0)
 			return 1;
 		util_rec_set(rec, "devtyp", "");
@@ -323,8 +385,7 @@ static int fill_device_info(struct util_rec *rec, char *path, char *device)
 		return 0;
 	}
 
-	if (util_file_read_line(buf, sizeof(buf), "%s/%s/devtype",
-				path, device) == 0) {
+	if (read_attr(buf, sizeof(buf), dir_fd, "%s/devtype", device) == 0) {
 		if (strcmp(buf, "n/a") == 0)
 			/* Special case for 'n/a' devtype */
 			strncpy(buf, "0000/00", sizeof(buf));
@@ -340,8 +401,7 @@ static int fill_device_info(struct util_rec *rec, char *path, char *device)
 		util_rec_set(rec, "devtyp", "");
 	}
 
-	if (util_file_read_line(buf, sizeof(buf), "%s/%s/cutype",
-				path, device) == 0) {
+	if (read_attr(buf, sizeof(buf), dir_fd, "%s/cutype", device) == 0) {
 		if (cmd.opt_uppercase)
 			util_str_toupper(buf);
 		util_rec_set(rec, "cutype", "%s", buf);
@@ -349,7 +409,8 @@ static int fill_device_info(struct util_rec *rec, char *path, char *device)
 		util_rec_set(rec, "cutype", "");
 	}
 
-	if (util_file_read_ul(&val_ul, 10, "%s/%s/online", path, device) == 0) {
+	if (read_attr(buf, sizeof(buf), dir_fd, "%s/online", device) == 0 &&
+	    sscanf(buf, "%lu", &val_ul) == 1) {
 		if (val_ul == 1) {
 			snprintf(buf, sizeof(buf), "yes");
 			if (cmd.opt_uppercase)
@@ -363,8 +424,8 @@ static int fill_device_info(struct util_rec *rec, char *path, char *device)
 	}
 
 	if (cmd.opt_avail) {
-		if (util_file_read_line(buf, sizeof(buf), "%s/%s/availability",
-					path, device) == 0) {
+		if (read_attr(buf, sizeof(buf), dir_fd, "%s/availability",
+			      device) == 0) {
 			if (cmd.opt_uppercase)
 				util_str_toupper(buf);
 			util_rec_set(rec, "avail", "%s", buf);
@@ -394,33 +455,57 @@ static bool is_sch_vfio(char *path)
 	return false;
 }
 
+/*
+ * Remember the alphabetically first directory entry name
+ */
+static int first_name_cb(const struct dirent *de, void *data)
+{
+	char *name = data;
+
+	if (!name[0] || strcmp(de->d_name, name) < 0)
+		snprintf(name, MAX_BUF_SIZE, "%s", de->d_name);
+	return 0;
+}
+
+/*
+ * Find the alphabetically first sub-directory of "path" that matches
+ * "pattern" without sorting all entries
+ *
+ * @returns true - Sub-directory name stored in "name"
+ *          false - No matching sub-directory found
+ */
+static bool find_first_dir(char name[MAX_BUF_SIZE], const char *path,
+			   const char *pattern)
+{
+	name[0] = 0;
+	util_scandir_iterate(path, UTIL_SCANDIR_TYPE_DIR, first_name_cb, name,
+			     "%s", pattern);
+	return name[0] != 0;
+}
+
 /*
  * Fill in the MDEV id entry field
  *
  * @returns 0 - MDEV id information filled in
  *          1 - skip entry
  */
-static int fill_vfio_devid(struct util_rec *rec, char *path)
+static int fill_vfio_devid(struct util_rec *rec, struct sch_info *sch)
 {
-	char *device, buf[MAX_BUF_SIZE];
-	struct dirent **de_vec;
-	int count;
+	char buf[MAX_BUF_SIZE], *path;
 
-	if (!is_sch_vfio(path))
+	path = util_path_sysfs("bus/css/devices/%s", sch->name);
+	if (!is_sch_vfio(path)) {
+		free(path);
 		return 1;
+	}
 
 	/* Find and process mdev device directory */
-	count = util_scandir(&de_vec, alphasort, path, "%s", UUID_FORMAT);
-	if (count > 0) {
-		device = de_vec[0]->d_name;
-		snprintf(buf, sizeof(buf), "%s", device);
-	} else {
+	if (!find_first_dir(buf, path, UUID_FORMAT))
 		strncpy(buf, "none", sizeof(buf));
-	}
+	free(path);
 	if (cmd.opt_uppercase)
 		util_str_toupper(buf);
 	util_rec_set(rec, "mdev", "%s", buf);
-	util_scandir_free(de_vec, count);
 	return 0;
 }
 
@@ -430,16 +515,13 @@ static int fill_vfio_devid(struct util_rec *rec, char *path)
  * @returns 0 - CCW device id information filled in
  *          1 - skip entry
  */
-static int fill_io_devid(struct util_rec *rec, char *path)
+static int fill_io_devid(struct util_rec *rec, int dir_fd,
+			 struct sch_info *sch)
 {
-	char *device, buf[MAX_BUF_SIZE];
-	struct dirent **de_vec;
-	int count;
+	char *device = sch->device, buf[MAX_BUF_SIZE];
 
-	/* Find and process device directory */
-	count = util_scandir(&de_vec, alphasort, path, "%s", ID_FORMAT);
-	if (count > 0) {
-		device = de_vec[0]->d_name;
+	/* Process device directory */
+	if (device) {
 		if (cmd.opt_short) {
 			/* Display only 0.0.xxxx devices for --short */
 			if (strncmp(device, "0.0.", PREFIX_ID_LENGTH) != 0)
@@ -450,36 +532,31 @@ static int fill_io_devid(struct util_rec *rec, char *path)
 			snprintf(buf, sizeof(buf), "%s", device);
 		}
 		if (cmd.opt_devrange && cmd.rng_count > 0 &&
-		   !id_in_ranges_list(device)) {
-			util_scandir_free(de_vec, count);
+		   !id_in_ranges_list(device))
 			return 1;
-		}
-		if (fill_device_info(rec, path, device) != 0) {
-			util_scandir_free(de_vec, count);
+		if (fill_device_info(rec, dir_fd, device) != 0)
 			return 1;
-		}
 	} else {
-		if (cmd.opt_devrange && cmd.rng_count > 0) {
-			util_scandir_free(de_vec, count);
+		if (cmd.opt_devrange && cmd.rng_count > 0)
 			return 1;
-		}
 		strncpy(buf, "none", sizeof(buf));
-		fill_device_info(rec, NULL, NULL);
+		fill_device_info(rec, -1, NULL);
 	}
 	if (cmd.opt_uppercase)
 		util_str_toupper(buf);
 	util_rec_set(rec, "device", "%s", buf);
-	util_scandir_free(de_vec, count);
 	return 0;
 }
 
 /*
  * Print IO subchannel entry
  */
-static void print_sch_io(struct util_rec *rec, char *path, char *sch_dir)
+static void print_sch_io(struct util_rec *rec, int dir_fd,
+			 struct sch_info *sch)
 {
 	unsigned int pim, pam, pom;
 	char buf[MAX_BUF_SIZE];
+	char *sch_dir = sch->name;
 
 	/* Fill in subchannel ID */
 	if (cmd.opt_short) {
@@ -498,12 +575,12 @@ static void print_sch_io(struct util_rec *rec, char *path, char *sch_dir)
 		util_str_toupper(buf);
 	util_rec_set(rec, "subch", "%s", buf);
 	if (cmd.opt_vfio) {
-		if (fill_vfio_devid(rec, path) != 0)
+		if (fill_vfio_devid(rec, sch) != 0)
 			return;
-	} else if (fill_io_devid(rec, path) != 0)
+	} else if (fill_io_devid(rec, dir_fd, sch) != 0)
 		return;
 	/* Fill in PIM-PAM-POM data */
-	if (util_file_read_line(buf, sizeof(buf), "%s/pimpampom", path) == 0) {
+	if (read_attr(buf, sizeof(buf), dir_fd, "pimpampom") == 0) {
 		if (sscanf(buf, "%x %x %x", &pim, &pam, &pom) == 3) {
 			if (cmd.opt_uppercase) {
 				util_rec_set(rec, "pim", "%02X", pim);
@@ -526,8 +603,7 @@ static void print_sch_io(struct util_rec *rec, char *path, char *sch_dir)
 	}
 	/* Fill in VPM data */
 	if (cmd.opt_vpm) {
-		if (util_file_read_line(buf, sizeof(buf),
-					"%s/vpm", path) == 0) {
+		if (read_attr(buf, sizeof(buf), dir_fd, "vpm") == 0) {
 			if (cmd.opt_uppercase)
 				util_str_toupper(buf);
 			util_rec_set(rec, "vpm", "%s", buf);
@@ -541,7 +617,7 @@ static void print_sch_io(struct util_rec *rec, char *path, char *sch_dir)
 	 * we first read it as a single string, then eliminate blanks from it
 	 * and then break in two 8-char segments.
 	 */
-	if (util_file_read_line(buf, sizeof(buf), "%s/chpids", path) == 0) {
+	if (read_attr(buf, sizeof(buf), dir_fd, "chpids") == 0) {
 		misc_str_remove_symbol(buf, ' ');
 		if (cmd.opt_uppercase)
 			util_str_toupper(buf);
@@ -633,11 +709,12 @@ static void print_defunct_devices(struct util_rec *rec, char *path)
 {
 	char *device, buf[MAX_BUF_SIZE];
 	struct dirent **de_vec;
-	int i, count;
+	int i, count, dir_fd;
 
 	/* Process all the devices within defunct directory */
 	count = util_scandir(&de_vec, alphasort, path, "%s", ID_FORMAT);
-	for (i = 0; i < count; i++) {
+	dir_fd = open(path, O_RDONLY | O_DIRECTORY);
+	for (i = 0; dir_fd >= 0 && i < count; i++) {
 		device = de_vec[i]->d_name;
 		if (cmd.opt_short) {
 			/* Display only 0.0.xxxx devices for --short */
@@ -652,7 +729,7 @@ static void print_defunct_devices(struct util_rec *rec, char *path)
 		   !id_in_ranges_list(device))
 			continue;
 
-		if (fill_device_info(rec, path, device) != 0)
+		if (fill_device_info(rec, dir_fd, device) != 0)
 			continue;
 
 		if (cmd.opt_uppercase)
@@ -673,46 +750,160 @@ static void print_defunct_devices(struct util_rec *rec, char *path)
 
 		util_rec_print(rec);
 	}
+	if (dir_fd >= 0)
+		close(dir_fd);
 	util_scandir_free(de_vec, count);
 }
 
 /*
- * Loop through subchannel directories and print entries of specified type
+ * Find the alphabetically first CCW device below subchannel directory
+ * "sch_fd"
+ *
+ * @returns Newly allocated device ID or NULL if there is no device
  */
-static void print_subchannels_of_type(enum sch_type type_requested,
-				      struct util_rec *rec)
+static char *find_sch_device(int sch_fd)
+{
+	char *device = NULL;
+	struct dirent *de;
+	struct stat sb;
+	DIR *dir;
+	int fd;
+
+	fd = dup(sch_fd);
+	if (fd < 0)
+		return NULL;
+	dir = fdopendir(fd);
+	if (!dir) {
+		close(fd);
+		return NULL;
+	}
+	while ((de = readdir(dir))) {
+		if (regexec(&schs.id_re, de->d_name, 0, NULL, 0) != 0)
+			continue;
+		if (de->d_type == DT_UNKNOWN) {
+			if (fstatat(sch_fd, de->d_name, &sb,
+				    AT_SYMLINK_NOFOLLOW) != 0 ||
+			    !S_ISDIR(sb.st_mode))
+				continue;
+		} else if (de->d_type != DT_DIR) {
+			continue;
+		}
+		if (!device || strcmp(de->d_name, device) < 0) {
+			free(device);
+			device = util_strdup(de->d_name);
+		}
+	}
+	closedir(dir);
+	return device;
+}
+
+/*
+ * Collect type and CCW device of all subchannels with one directory scan
+ *
+ * The result is kept for all subchannel types that are listed. Per
+ * subchannel attributes are read relative to an open directory handle
+ * instead of building and resolving absolute sysfs paths each time.
+ */
+static void read_subchannels(void)
 {
 	unsigned long int type_ul;
 	struct dirent **de_vec;
-	char *path, *sch_dir;
-	int i, count;
+	struct sch_info *sch;
+	char buf[MAX_BUF_SIZE];
+	int i, count, sch_fd;
+	char *path;
+
+	if (schs.done)
+		return;
+	schs.done = true;
+	if (regcomp(&schs.id_re, ID_FORMAT, REG_EXTENDED | REG_NOSUB))
+		util_panic("Function regcomp(%s) failed\n", ID_FORMAT);
 
 	path = util_path_sysfs("bus/css/devices");
 	count = util_scandir(&de_vec, alphasort, path, "%s", ID_FORMAT);
+	schs.dir_fd = open(path, O_RDONLY | O_DIRECTORY);
 	free(path);
+	if (schs.dir_fd < 0)
+		count = 0;
+	schs.vec = util_zalloc(sizeof(*schs.vec) * (count + 1));
 	for (i = 0; i < count; i++) {
-		sch_dir = de_vec[i]->d_name;
-		path = util_path_sysfs("bus/css/devices/%s", sch_dir);
-		if (util_file_read_ul(&type_ul, 10, "%s/type", path) == 0) {
-			if (type_ul != type_requested)
-				continue;
-			if (type_ul == SUBCHANNEL_TYPE_IO)
-				print_sch_io(rec, path, sch_dir);
-			else if (type_ul == SUBCHANNEL_TYPE_CHSC)
-				print_sch_chsc(rec, sch_dir);
-			else if (type_ul == SUBCHANNEL_TYPE_EADM)
-				print_sch_eadm(rec, sch_dir);
-		} else {
+		sch = &schs.vec[schs.count];
+		sch_fd = openat(schs.dir_fd, de_vec[i]->d_name,
+				O_RDONLY | O_DIRECTORY);
+		if (sch_fd < 0)
+			continue;
+		sch->name = util_strdup(de_vec[i]->d_name);
 		/*
 		 * Subchannels with no type identifier treated as
 		 * IO subchannels
 		 */
-			if (type_requested == SUBCHANNEL_TYPE_IO)
-				print_sch_io(rec, path, sch_dir);
-		}
-		free(path);
+		if (read_attr(buf, sizeof(buf), sch_fd, "type") == 0 &&
+		    sscanf(buf, "%lu", &type_ul) == 1)
+			sch->type = type_ul;
+		else
+			sch->type = SUBCHANNEL_TYPE_NONE;
+		if (sch->type == SUBCHANNEL_TYPE_IO ||
+		    sch->type == SUBCHANNEL_TYPE_NONE)
+			sch->device = find_sch_device(sch_fd);
+		close(sch_fd);
+		schs.count++;
 	}
 	util_scandir_free(de_vec, count);
+}
+
+/*
+ * Release collected subchannel data
+ */
+static void free_subchannels(void)
+{
+	int i;
+
+	if (!schs.done)
+		return;
+	for (i = 0; i < schs.count; i++) {
+		free(schs.vec[i].name);
+		free(schs.vec[i].device);
+	}
+	free(schs.vec);
+	if (schs.dir_fd >= 0)
+		close(schs.dir_fd);
+	regfree(&schs.id_re);
+	memset(&schs, 0, sizeof(schs));
+}
+
+/*
+ * Loop through subchannels and print entries of specified type
+ */
+static void print_subchannels_of_type(enum sch_type type_requested,
+				      struct util_rec *rec)
+{
+	struct dirent **de_vec;
+	struct sch_info *sch;
+	int i, count, sch_fd;
+	char *path;
+
+	read_subchannels();
+	for (i = 0; i < schs.count; i++) {
+		sch = &schs.vec[i];
+		if (sch->type == SUBCHANNEL_TYPE_NONE) {
+			if (type_requested != SUBCHANNEL_TYPE_IO)
+				continue;
+		} else if (sch->type != (int) type_requested) {
+			continue;
+		}
+		if (type_requested == SUBCHANNEL_TYPE_IO) {
+			sch_fd = openat(schs.dir_fd, sch->name,
+					O_RDONLY | O_DIRECTORY);
+			if (sch_fd < 0)
+				continue;
+			print_sch_io(rec, sch_fd, sch);
+			close(sch_fd);
+		} else if (type_requested == SUBCHANNEL_TYPE_CHSC) {
+			print_sch_chsc(rec, sch->name);
+		} else if (type_requested == SUBCHANNEL_TYPE_EADM) {
+			print_sch_eadm(rec, sch->name);
+		}
+	}
 	/* Process defunct devices (if no subchannel range is specified) */
 	if (!cmd.opt_devrange && cmd.rng_count > 0)
 		return;
@@ -803,6 +994,7 @@ static void cmd_lscss(void)
 		print_subchannels_of_type(SUBCHANNEL_TYPE_IO, rec);
 		util_rec_free(rec);
 	}
+	free_subchannels();
 }
 
 /*
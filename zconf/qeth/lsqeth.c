@@ -36,6 +36,7 @@
 #include "lib/util_prg.h"
 #include "lib/util_rec.h"
 #include "lib/util_scandir.h"
+#include "lib/util_thread_pool.h"
 #include "lib/zt_common.h"
 #include "lib/vmcp.h"
 
@@ -44,6 +45,7 @@
 #define ID_FORMAT		"^[[:xdigit:]]{1,2}[.][[:xdigit:]][.][[:xdigit:]]{4}$"
 #define MAX_ID_LENGTH		10
 #define PAGE_SIZE		4096
+#define MAX_THREADS		16	/* Devices collected concurrently */
 
 /*
  * Private data
@@ -198,6 +200,7 @@ static void exec_cp(char **argz, size_t *argz_len, const char *fmt, ...)
 	cp.cpcmd = command;
 	cp.do_upper = false;
 	cp.buffer_size = VMCP_DEFAULT_BUFSZ;
+	cp.auto_size = false;
 	rc = vmcp(&cp);
 	free(command);
 
@@ -228,7 +231,7 @@ static void exec_cp(char **argz, size_t *argz_len, const char *fmt, ...)
  */
 static char *print_LAN(const char *cdev0)
 {
-	char *tok_vec[5], *tk, *result, *retstr, *devno, *entry;
+	char *tok_vec[5], *tk, *result, *retstr, *devno, *entry, *save;
 	char *tail = "not coupled";
 	size_t argz_len = 0;
 	char *argz = NULL;
@@ -242,19 +245,19 @@ static char *print_LAN(const char *cdev0)
 	/* Tokenize second line */
 	entry = argz_next(argz, argz_len, argz);
 	memset(tok_vec, 0, sizeof(tok_vec));
-	tk = strtok(entry, " \t");
+	tk = strtok_r(entry, " \t", &save);
 	for (i = 0; i < ARRAY_SIZE(tok_vec) && tk; i++) {
 		tok_vec[i] = tk;
-		tk = strtok(NULL, " \t");
+		tk = strtok_r(NULL, " \t", &save);
 	}
 	util_asprintf(&result, "%s %s %s", tok_vec[2], tok_vec[3], tok_vec[4]);
 	/* Tokenize first line */
 	entry = argz;
 	memset(tok_vec, 0, sizeof(tok_vec));
-	tk = strtok(entry, " \t");
+	tk = strtok_r(entry, " \t", &save);
 	for (i = 0; i < ARRAY_SIZE(tok_vec) && tk; i++) {
 		tok_vec[i] = tk;
-		tk = strtok(NULL, " \t");
+		tk = strtok_r(NULL, " \t", &save);
 	}
 	if (strncmp(result, "LAN", 3) == 0) {
 		if (strncmp(result + 5, "* Internal", 11) != 0)
@@ -418,9 +421,9 @@ static bool not_layer2_attr(const char *attr_name)
 }
 
 /*
- * Collect and print attributes for qeth-based device in sepcified format
+ * Collect attributes for qeth-based device in specified format
  */
-static void print_device(struct util_rec *rec, const char *device_id)
+static void collect_device(struct util_rec *rec, const char *device_id)
 {
 	char *path, *path_net, *if_name;
 	unsigned long int layer2 = 0;
@@ -469,13 +472,19 @@ static void print_device(struct util_rec *rec, const char *device_id)
 	}
 	free(if_name);
 	free(path);
-	/* Print the record */
-	if (!cmd.proc_format) {
-		/* Check if card_type attribute needs to be modified */
+	/* Check if card_type attribute needs to be modified */
+	if (!cmd.proc_format)
 		update_card_type(rec);
-		/* Print record header for each device in normal format output */
+}
+
+/*
+ * Print collected attributes for qeth-based device
+ */
+static void print_device(struct util_rec *rec)
+{
+	/* Print record header for each device in normal format output */
+	if (!cmd.proc_format)
 		util_rec_print_hdr(rec);
-	}
 	util_rec_print(rec);
 }
 
@@ -580,6 +589,50 @@ static struct util_rec *setup_rec()
 	return rec;
 }
 
+/*
+ * Devices whose attributes are collected concurrently
+ */
+struct dev_list {
+	struct dirent **de_vec;		/* Device IDs */
+	struct util_rec **rec_vec;	/* Collected records, NULL to skip */
+};
+
+static int collect_one(unsigned long i, void *data)
+{
+	struct dev_list *list = data;
+
+	if (list->rec_vec[i])
+		collect_device(list->rec_vec[i], list->de_vec[i]->d_name);
+	return 0;
+}
+
+/*
+ * Collect attributes of all devices in parallel and print them in order
+ *
+ * Reading sysfs attributes, the ethtool ioctl and the CP query of a device
+ * do not depend on other devices, so several devices are collected at once.
+ */
+static void process_devices(struct dirent **de_vec, int count)
+{
+	struct dev_list list = { de_vec, NULL };
+	int i;
+
+	list.rec_vec = util_zalloc(count * sizeof(*list.rec_vec));
+	for (i = 0; i < count; i++) {
+		/* Check if a symbolic link */
+		if (de_vec[i]->d_type == DT_LNK)
+			list.rec_vec[i] = setup_rec();
+	}
+	util_parallel_for(0, count, MAX_THREADS, collect_one, &list);
+	for (i = 0; i < count; i++) {
+		if (!list.rec_vec[i])
+			continue;
+		print_device(list.rec_vec[i]);
+		util_rec_free(list.rec_vec[i]);
+	}
+	free(list.rec_vec);
+}
+
 /*
  * Entry point
  */
@@ -588,7 +641,7 @@ int main(int argc, char *argv[])
 	char device[MAX_ID_LENGTH];
 	struct dirent **de_vec;
 	struct util_rec *rec;
-	int i, c = 0, count;
+	int c = 0, count;
 	char *path, *link;
 
 	util_prg_init(&prg);
@@ -635,7 +688,8 @@ int main(int argc, char *argv[])
 			/* Interface present */
 			snprintf(device, sizeof(device), "%s", basename(link));
 			free(link);
-			print_device(rec, device);
+			collect_device(rec, device);
+			print_device(rec);
 			free(rec);
 		} else {
 			errx(EXIT_FAILURE, "No such device: %s", argv[optind]);
@@ -646,15 +700,8 @@ int main(int argc, char *argv[])
 		count = util_scandir(&de_vec, alphasort, path, "%s",
 				     ID_FORMAT);
 		free(path);
-		for (i = 0; i < count; i++) {
-			/* Check if a symbolic link */
-			if (de_vec[i]->d_type != DT_LNK)
-				continue;
-			if (i > 0)
-				rec = setup_rec();
-			print_device(rec, de_vec[i]->d_name);
-			free(rec);
-		}
+		process_devices(de_vec, count);
+		util_rec_free(rec);
 		util_scandir_free(de_vec, count);
 	}
 	return EXIT_SUCCESS;
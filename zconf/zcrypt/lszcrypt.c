@@ -20,6 +20,7 @@
 #include "lib/util_proc.h"
 #include "lib/util_rec.h"
 #include "lib/util_scandir.h"
+#include "lib/util_thread_pool.h"
 #include "lib/zt_common.h"
 
 /*
@@ -31,6 +32,27 @@ struct lszcrypt_l {
 
 struct lszcrypt_l *lszcrypt_l = &l;
 
+/*
+ * Maximum number of threads that read device attributes
+ */
+#define MAX_THREADS	16
+
+/*
+ * Card or queue device whose attributes are collected in parallel
+ */
+struct dev_row {
+	char *grp_dev;		/* Card device path */
+	char *sub_dev;		/* Queue device name or NULL for card */
+	char card[16];		/* Card ID for card device */
+	struct util_rec *rec;
+};
+
+struct dev_rows {
+	struct dev_row *vec;
+	int count;
+	int max;
+};
+
 /*
  * Capabilities
  */
@@ -502,6 +524,9 @@ static void read_rec_default(struct util_rec *rec, const char *grp_dev)
 			} else
 				util_rec_set(rec, "online", "offline");
 		}
+	} else {
+		/* no online attribute */
+		util_rec_set(rec, "online", "-");
 	}
 
 	util_file_read_line(buf, sizeof(buf), "%s/request_count", grp_dev);
@@ -606,12 +631,108 @@ static void define_rec_verbose(struct util_rec *rec)
 	util_rec_def(rec, "driver", UTIL_REC_ALIGN_LEFT, 11, "DRIVER");
 }
 
+/*
+ * Create record with the *default* and *verbose* attributes
+ */
+static struct util_rec *new_rec(void)
+{
+	struct util_rec *rec = util_rec_new_wide("-");
+
+	define_rec_default(rec);
+	define_rec_verbose(rec);
+	return rec;
+}
+
+/*
+ * Add card or queue device to the list of collected devices
+ */
+static void add_row(struct dev_rows *rows, char *grp_dev, const char *sub_dev,
+		    const char *card)
+{
+	struct dev_row *row;
+
+	if (rows->count == rows->max) {
+		rows->max = rows->max ? rows->max * 2 : 256;
+		rows->vec = util_realloc(rows->vec,
+					 rows->max * sizeof(*rows->vec));
+	}
+	row = &rows->vec[rows->count++];
+	row->grp_dev = grp_dev;
+	row->sub_dev = sub_dev ? util_strdup(sub_dev) : NULL;
+	if (card)
+		util_strlcpy(row->card, card, sizeof(row->card));
+	row->rec = new_rec();
+}
+
+/*
+ * Add card device and its queue devices, the attributes are read later
+ */
+static void scan_device(struct dev_rows *rows, const char *device)
+{
+	struct dirent **dev_vec;
+	int i, count;
+	char *grp_dev;
+
+	grp_dev = util_path_sysfs("devices/ap/%s", device);
+	if (!util_path_is_dir(grp_dev))
+		errx(EXIT_FAILURE, "Error - cryptographic device %s does not exist.", device);
+
+	/*
+	 * If not verbose mode, skip devices which are not supported
+	 * by the zcrypt layer.
+	 */
+	if (l.verbose == 0 &&
+	    (!util_path_is_readable("%s/type", grp_dev) ||
+	     !util_path_is_readable("%s/online", grp_dev))) {
+		free(grp_dev);
+		return;
+	}
+	/* The card row owns grp_dev */
+	add_row(rows, grp_dev, NULL, &device[4]);
+
+	count = util_scandir(&dev_vec, alphasort, grp_dev, "..\\....");
+	if (count < 1)
+		errx(EXIT_FAILURE, "Error - no subdevices found for %s.\n", grp_dev);
+	for (i = 0; i < count; i++) {
+		if (l.verbose == 0 &&
+		    (!util_path_is_readable("%s/type", grp_dev) ||
+		     !util_path_is_readable("%s/%s/online", grp_dev,
+					    dev_vec[i]->d_name)))
+			continue;
+		add_row(rows, grp_dev, dev_vec[i]->d_name, NULL);
+	}
+	util_scandir_free(dev_vec, count);
+}
+
+/*
+ * Read the attributes of one card or queue device
+ */
+static int read_row(unsigned long i, void *data)
+{
+	struct dev_row *row = &((struct dev_rows *) data)->vec[i];
+
+	if (row->sub_dev) {
+		util_rec_set(row->rec, "card", row->sub_dev);
+		read_subdev_rec_default(row->rec, row->grp_dev, row->sub_dev);
+		read_subdev_rec_verbose(row->rec, row->grp_dev, row->sub_dev);
+	} else {
+		util_rec_set(row->rec, "card", row->card);
+		read_rec_default(row->rec, row->grp_dev);
+		read_rec_verbose(row->rec, row->grp_dev);
+	}
+	return 0;
+}
+
 /*
  * Show all devices
+ *
+ * Some attributes are read from the firmware, so the attributes of all
+ * devices are collected in parallel first and printed in order afterwards.
  */
 static void show_devices_all(void)
 {
 	struct util_rec *rec = util_rec_new_wide("-");
+	struct dev_rows rows = { NULL, 0, 0 };
 	struct dirent **dev_vec;
 	int i, count;
 	char *ap, *path;
@@ -630,10 +751,24 @@ static void show_devices_all(void)
 	count = util_scandir(&dev_vec, alphasort, path, "card[0-9a-fA-F]+");
 	if (count < 1)
 		errx(EXIT_FAILURE, "No crypto card devices found.");
-	util_rec_print_hdr(rec);
 	for (i = 0; i < count; i++)
-		show_device(rec, dev_vec[i]->d_name);
+		scan_device(&rows, dev_vec[i]->d_name);
+	util_scandir_free(dev_vec, count);
 	free(path);
+
+	util_parallel_for(0, rows.count, MAX_THREADS, read_row, &rows);
+
+	util_rec_print_hdr(rec);
+	for (i = 0; i < rows.count; i++) {
+		util_rec_print(rows.vec[i].rec);
+		util_rec_free(rows.vec[i].rec);
+		if (rows.vec[i].sub_dev)
+			free(rows.vec[i].sub_dev);
+		else
+			free(rows.vec[i].grp_dev);
+	}
+	free(rows.vec);
+	util_rec_free(rec);
 }
 
 /*
@@ -17,10 +17,13 @@
 #include <stdint.h>
 #include <signal.h>
 #include <time.h>
+#include <unistd.h>
 #include <asm/chsc.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/utsname.h>
 
 #include "lib/util_base.h"
@@ -287,6 +290,21 @@ const struct crypto_type crypto_types[NUM_CRYPTO_TYPES] = {
 };
 
 
+#define NUM_CMB_TYPES		256
+#define NUM_CMB_MODES		256
+#define NUM_CMB_COUNTERS	32
+
+/*
+ * Card and counter names of a crypto type and mode with the type mapping
+ * already applied. Built on first use and cached in g.type_info.
+ */
+struct type_info {
+	char card_name[250];
+	const char *counter_names[NUM_CMB_COUNTERS];
+	bool is_totals[NUM_CMB_COUNTERS];
+	char generic_names[NUM_CMB_COUNTERS][16];
+};
+
 struct type_mapping {
 	uint8_t from_type;
 	uint8_t from_mode;
@@ -320,6 +338,45 @@ struct interval_values {
 	double duration;
 };
 
+/*
+ * Binary history file format. All values are in host byte order.
+ * The file starts with a history_file_header, followed by one record per
+ * interval. Each record consists of a history_rec_header, followed by
+ * 'count' history_entry elements.
+ */
+#define HISTORY_MAGIC		0x5a435348	/* "ZCSH" */
+#define HISTORY_REC_MAGIC	0x5a435349	/* "ZCSI" */
+#define HISTORY_VERSION		1
+#define HISTORY_TOTALS		0xff	/* Counter index of the totals */
+#define HISTORY_DEFAULT_SIZE	1024	/* Default rotation size in KB */
+
+struct history_file_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t entry_size;
+	uint32_t interval;	/* Interval time in seconds */
+	uint32_t reserved;
+} __packed;
+
+struct history_rec_header {
+	uint32_t magic;
+	uint32_t count;		/* Number of entries that follow */
+	uint64_t time;		/* Seconds since the epoch */
+} __packed;
+
+struct history_entry {
+	uint8_t card;
+	uint8_t is_apqn;
+	uint16_t domain;
+	uint8_t type;		/* Crypto type (ct) of the CMB */
+	uint8_t mode;		/* Crypto mode (mt) of the CMB */
+	uint8_t counter;	/* Counter index or HISTORY_TOTALS */
+	uint8_t reserved;
+	uint64_t ops;		/* Operations in the interval */
+	uint32_t utilization;	/* Utilization in 1/1000000 */
+	uint32_t duration;	/* Average duration in nanoseconds */
+} __packed;
+
 struct print_func {
 	int (*print_initialize)(void);
 	int (*print_terminate)(void);
@@ -420,6 +477,24 @@ static int csv_print_counter_data(bool is_apqn, uint8_t card, uint8_t domain,
 				    const char *name,
 				    struct interval_values *vals);
 
+static int history_print_initialize(void);
+static int history_print_terminate(void);
+static int history_print_interval_header(unsigned long interval_count,
+					 const char *timestamp);
+static int history_print_interval_footer(void);
+static int history_print_counter_data(bool is_apqn, uint8_t card,
+				      uint8_t domain, const char *type,
+				      const char *timestamp, const char *name,
+				      struct interval_values *vals);
+
+static const struct print_func history_print = {
+	.print_initialize = history_print_initialize,
+	.print_terminate = history_print_terminate,
+	.print_interval_header = history_print_interval_header,
+	.print_interval_footer = history_print_interval_footer,
+	.print_counter_data = history_print_counter_data,
+};
+
 static const struct print_func csv_print = {
 	.print_initialize = csv_print_initialize,
 	.print_terminate = csv_print_terminate,
@@ -467,15 +542,28 @@ static struct zcryptstats_globals {
 	uint8_t max_domain;
 	struct device_selection *dev_selection;
 	struct type_mapping *type_mapping;
+	struct type_info **type_info[NUM_CMB_TYPES];
+	bool apqn_per_card;
 	struct card_data *cards[NUM_CARDS];
 	const struct print_func *print_funcs;
 	struct util_rec *device_rec;
 	struct util_rec *counter_rec;
 	bool first_device;
 	bool first_counter;
+	const struct chsc_cmb_header *cmb_header;
+	int counter_index;
+	char *history_file;
+	unsigned long history_size;
+	int history_fd;
+	struct history_entry *history_buf;
+	unsigned int history_count;
+	unsigned int history_alloc;
+	uint64_t history_time;
 } g = {
 	.interval = 10,
 	.chsc_fd = -1,
+	.history_size = HISTORY_DEFAULT_SIZE,
+	.history_fd = -1,
 	.print_funcs = &default_print,
 };
 
@@ -568,6 +656,23 @@ static struct util_opt opt_vec[] = {
 			"(APQNs). This option can not be specified together "
 			"with option --all"
 	},
+	{
+		.option = {"history", required_argument, NULL, 'H'},
+		.argument = "FILE",
+		.desc = "Appends the counter values of each interval in a "
+			"compact binary format to FILE instead of displaying "
+			"them. When FILE exceeds the size specified with "
+			"--history-size, it is renamed to FILE.1 and a new "
+			"FILE is started. This option can not be specified "
+			"together with option --output",
+	},
+	{
+		.option = {"history-size", required_argument, NULL, 'S'},
+		.argument = "KB",
+		.desc = "Specifies the size in kilobytes after which the "
+			"history file is rotated. If omitted, a default "
+			"size of 1024 kilobytes is used",
+	},
 	{
 		.option = {"verbose", 0, NULL, 'V'},
 		.desc = "Prints additional information messages during "
@@ -624,83 +729,122 @@ static struct type_mapping *find_type_mapping(uint8_t from_type,
 }
 
 /*
- * Get the name of the card for a crypto type and mode.
- * Note: This function might return the address of a static string variable.
- * It is only valid until this function is called again.
+ * Apply the type mapping to a crypto type and mode and return the
+ * corresponding crypto type, or NULL if the type is unknown.
  */
-static const char *get_card_name(uint8_t type, uint8_t mode)
+static const struct crypto_type *resolve_type(uint8_t *type, uint8_t *mode)
 {
 	const struct crypto_type *ct;
-	const struct crypto_mode *m;
-	static char temp_name[250];
 	struct type_mapping *map;
 
-	map = find_type_mapping(type, mode);
+	map = find_type_mapping(*type, *mode);
 	if (map != NULL) {
-		type = map->to_type;
-		mode = map->to_mode;
-	} else if (type >= NUM_CRYPTO_TYPES) {
-		type = CRYPTO_TYPE_TOLERATION;
+		*type = map->to_type;
+		*mode = map->to_mode;
+	} else if (*type >= NUM_CRYPTO_TYPES) {
+		*type = CRYPTO_TYPE_TOLERATION;
 	}
 
-	if (type >= NUM_CRYPTO_TYPES)
-		return "UNKNOWN ADAPTER TYPE";
+	if (*type >= NUM_CRYPTO_TYPES)
+		return NULL;
 
-	ct = &crypto_types[type];
+	ct = &crypto_types[*type];
 	if (ct->name == NULL || ct->modes == NULL || ct->num_modes == 0)
-		return "UNKNOWN ADAPTER TYPE";
-
-	if (mode >= ct->num_modes)
-		return ct->name;
+		return NULL;
 
-	m = &ct->modes[mode];
-	snprintf(temp_name, sizeof(temp_name) - 1, "%s%c (%s)", ct->name,
-		 m->indicatior_char, m->name != NULL ? m->name : "");
-	return temp_name;
+	return ct;
 }
 
 /*
- * Get the name of a counter for a crypto type, mode and index.
- * Note: This function might return the address of a static string variable.
- * It is only valid until this function is called again.
+ * Build the card and counter names for a crypto type and mode
  */
-static const char *get_counter_name(uint8_t type, uint8_t mode, uint8_t index)
+static void build_type_info(struct type_info *ti, uint8_t type, uint8_t mode)
 {
+	const struct crypto_mode *m = NULL;
 	const struct crypto_type *ct;
-	const struct crypto_mode *m;
-	static char temp_name[250];
-	struct type_mapping *map;
+	int i;
+
+	ct = resolve_type(&type, &mode);
+	if (ct == NULL) {
+		snprintf(ti->card_name, sizeof(ti->card_name),
+			 "UNKNOWN ADAPTER TYPE");
+	} else if (mode >= ct->num_modes) {
+		snprintf(ti->card_name, sizeof(ti->card_name), "%s",
+			 ct->name);
+	} else {
+		m = &ct->modes[mode];
+		snprintf(ti->card_name, sizeof(ti->card_name), "%s%c (%s)",
+			 ct->name, m->indicatior_char,
+			 m->name != NULL ? m->name : "");
+		if (m->counters == NULL || m->num_counters == 0)
+			m = NULL;
+	}
 
-	map = find_type_mapping(type, mode);
-	if (map != NULL) {
-		type = map->to_type;
-		mode = map->to_mode;
-	} else if (type >= NUM_CRYPTO_TYPES) {
-		type = CRYPTO_TYPE_TOLERATION;
+	for (i = 0; i < NUM_CMB_COUNTERS; i++) {
+		if (m != NULL && (unsigned int)i < m->num_counters) {
+			ti->counter_names[i] = m->counters[i].name;
+			ti->is_totals[i] = m->counters[i].is_totals;
+			continue;
+		}
+		snprintf(ti->generic_names[i], sizeof(ti->generic_names[i]),
+			 "COUNTER %u", i);
+		ti->counter_names[i] = ti->generic_names[i];
+		ti->is_totals[i] = false;
 	}
+}
 
-	if (type >= NUM_CRYPTO_TYPES)
-		goto generic;
+/*
+ * Get the cached card and counter names for a crypto type and mode.
+ * The type mapping list is only searched when a type/mode combination
+ * is seen for the first time.
+ */
+static const struct type_info *get_type_info(uint8_t type, uint8_t mode)
+{
+	struct type_info *ti;
 
-	ct = &crypto_types[type];
-	if (ct->name == NULL || ct->modes == NULL || ct->num_modes == 0)
-		goto generic;
+	if (g.type_info[type] == NULL)
+		g.type_info[type] = util_zalloc(NUM_CMB_MODES *
+						sizeof(struct type_info *));
 
-	if (mode >= ct->num_modes)
-		goto generic;
+	ti = g.type_info[type][mode];
+	if (ti == NULL) {
+		ti = util_zalloc(sizeof(struct type_info));
+		build_type_info(ti, type, mode);
+		g.type_info[type][mode] = ti;
+	}
 
-	m = &ct->modes[mode];
-	if (m->counters == NULL || m->num_counters == 0)
-		goto generic;
+	return ti;
+}
 
-	if (index >= m->num_counters)
-		goto generic;
+static void free_type_info(void)
+{
+	int type, mode;
 
-	return m->counters[index].name;
+	for (type = 0; type < NUM_CMB_TYPES; type++) {
+		if (g.type_info[type] == NULL)
+			continue;
+		for (mode = 0; mode < NUM_CMB_MODES; mode++)
+			free(g.type_info[type][mode]);
+		free(g.type_info[type]);
+		g.type_info[type] = NULL;
+	}
+}
 
-generic:
-	snprintf(temp_name, sizeof(temp_name) - 1, "COUNTER %u", index);
-	return temp_name;
+/*
+ * Get the name of the card for a crypto type and mode.
+ */
+static const char *get_card_name(uint8_t type, uint8_t mode)
+{
+	return get_type_info(type, mode)->card_name;
+}
+
+/*
+ * Get the name of a counter for a crypto type, mode and index.
+ * The index must be less than NUM_CMB_COUNTERS.
+ */
+static const char *get_counter_name(uint8_t type, uint8_t mode, uint8_t index)
+{
+	return get_type_info(type, mode)->counter_names[index];
 }
 
 /*
@@ -709,36 +853,7 @@ generic:
  */
 static bool is_counter_totals(uint8_t type, uint8_t mode, uint8_t index)
 {
-	const struct crypto_type *ct;
-	const struct crypto_mode *m;
-	struct type_mapping *map;
-
-	map = find_type_mapping(type, mode);
-	if (map != NULL) {
-		type = map->to_type;
-		mode = map->to_mode;
-	} else if (type >= NUM_CRYPTO_TYPES) {
-		type = CRYPTO_TYPE_TOLERATION;
-	}
-
-	if (type >= NUM_CRYPTO_TYPES)
-		return false;
-
-	ct = &crypto_types[type];
-	if (ct->name == NULL || ct->modes == NULL || ct->num_modes == 0)
-		return false;
-
-	if (mode >= ct->num_modes)
-		return false;
-
-	m = &ct->modes[mode];
-	if (m->counters == NULL || m->num_counters == 0)
-		return false;
-
-	if (index >= m->num_counters)
-		return false;
-
-	return m->counters[index].is_totals;
+	return get_type_info(type, mode)->is_totals[index];
 }
 
 /*
@@ -1166,9 +1281,13 @@ static int process_apqn_measurement_data(struct chsc_scdmd_area *scdmd_area)
 }
 
 /*
- * Get Crypto Measurement data on the APQN level
+ * Get Crypto Measurement data on the APQN level for all cards in the card
+ * mask with card indexes from first_card to last_card. The CHSC returns as
+ * many CMBs as fit into the response area and indicates with the p bit
+ * that the request must be continued.
  */
-static int get_apqn_measurement_data(uint8_t card)
+static int get_apqn_measurement_data(const uint32_t *card_mask,
+				     uint8_t first_card, uint8_t last_card)
 {
 	struct chsc_scdmd_area scdmd_area;
 	int rc;
@@ -1182,22 +1301,24 @@ static int get_apqn_measurement_data(uint8_t card)
 			scdmd_area.request.first_drid =
 						scdmd_area.response.crid;
 		} else {
-			scdmd_area.request.first_drid.ap_index = card;
+			scdmd_area.request.first_drid.ap_index = first_card;
 			scdmd_area.request.first_drid.domain_index =
 								g.min_domain;
 		}
-		scdmd_area.request.last_drid.ap_index = card;
+		scdmd_area.request.last_drid.ap_index = last_card;
 		scdmd_area.request.last_drid.domain_index = g.max_domain;
 		scdmd_area.request.s = 1;
-		scdmd_area.request.apsm[MASK_WORD_NO(card)] |= MASK_BIT(card);
+		memcpy(scdmd_area.request.apsm, card_mask,
+				sizeof(scdmd_area.request.apsm));
 		memcpy(scdmd_area.request.dsm, g.domain_mask,
 				sizeof(scdmd_area.request.dsm));
 
 		rc = ioctl(g.chsc_fd, CHSC_START_SYNC, &scdmd_area);
 		if (rc != 0) {
 			rc = -errno;
-			warnx("Failed to get APQN measurement data for card "
-			      "%02x: %s", card, strerror(errno));
+			warnx("Failed to get APQN measurement data for cards "
+			      "%02x-%02x: %s", first_card, last_card,
+			      strerror(errno));
 			break;
 		}
 
@@ -1205,17 +1326,13 @@ static int get_apqn_measurement_data(uint8_t card)
 		if (rc != 0) {
 			if (rc != -EOPNOTSUPP && rc != -ENODEV) {
 				warnx("Failed to get APQN crypto measurement "
-				      "data for card %02x: %s", card,
-				      strerror(-rc));
+				      "data for cards %02x-%02x: %s",
+				      first_card, last_card, strerror(-rc));
 			} else {
 				pr_verbose("Failed to get APQN crypto "
-					   "measurement data for card %02x: %s",
-					   card, strerror(-rc));
-				/*
-				 * ignore return code other than -EOPNOTSUPP
-				 * and -ENODEV
-				 */
-				rc = 0;
+					   "measurement data for cards "
+					   "%02x-%02x: %s", first_card,
+					   last_card, strerror(-rc));
 			}
 			break;
 		}
@@ -1229,10 +1346,60 @@ static int get_apqn_measurement_data(uint8_t card)
 }
 
 /*
- * Process the card measurement data and extract the CMBs
+ * Get Crypto Measurement data on the APQN level for all selected cards.
+ * The data of all cards is requested with a single (continued) CHSC. If
+ * that is rejected, fall back to one CHSC per card for this and all
+ * following intervals.
+ */
+static int get_all_apqn_measurement_data(const uint32_t *card_mask)
+{
+	uint32_t single_mask[8];
+	int card, first = -1, last = -1;
+	int rc;
+
+	for (card = g.min_card; card <= g.max_card; card++) {
+		if ((card_mask[MASK_WORD_NO(card)] & MASK_BIT(card)) == 0)
+			continue;
+		if (first < 0)
+			first = card;
+		last = card;
+	}
+	if (first < 0)
+		return 0;
+
+	if (!g.apqn_per_card) {
+		rc = get_apqn_measurement_data(card_mask, first, last);
+		if (rc != -EOPNOTSUPP && rc != -ENODEV)
+			return rc;
+		if (first == last)
+			return 0;
+
+		pr_verbose("Requesting APQN measurement data per card");
+		g.apqn_per_card = true;
+	}
+
+	for (card = first; card <= last; card++) {
+		if ((card_mask[MASK_WORD_NO(card)] & MASK_BIT(card)) == 0)
+			continue;
+
+		memset(single_mask, 0, sizeof(single_mask));
+		single_mask[MASK_WORD_NO(card)] = MASK_BIT(card);
+		rc = get_apqn_measurement_data(single_mask, card, card);
+		/* ignore return code -EOPNOTSUPP and -ENODEV */
+		if (rc != 0 && rc != -EOPNOTSUPP && rc != -ENODEV)
+			return rc;
+	}
+
+	return 0;
+}
+
+/*
+ * Process the card measurement data and extract the CMBs. Cards that
+ * passed the device filter are added to the APQN card mask.
  */
 static int process_card_measurement_data(struct chsc_scmd_area *scmd_area,
-					 uint8_t *last_card)
+					 uint8_t *last_card,
+					 uint32_t *apqn_mask)
 {
 	size_t size = scmd_area->response.header.length -
 				sizeof(struct chsc_scmd_response);
@@ -1250,25 +1417,24 @@ static int process_card_measurement_data(struct chsc_scmd_area *scmd_area,
 		if (rc == -ENODEV)
 			continue;
 
-		if (!g.no_apqn) {
-			rc = get_apqn_measurement_data(*last_card);
-			if (rc != 0)
-				return rc;
-		}
+		apqn_mask[MASK_WORD_NO(*last_card)] |= MASK_BIT(*last_card);
 	}
 
 	return 0;
 }
 
 /*
- * Get Crypto Measurement data on the card level
+ * Get Crypto Measurement data on the card level, followed by the data on
+ * the APQN level for all cards found.
  */
 static int get_card_measurement_data(void)
 {
 	struct chsc_scmd_area scmd_area;
+	uint32_t apqn_mask[8];
 	uint8_t last_card = 0;
 	int rc;
 
+	memset(apqn_mask, 0, sizeof(apqn_mask));
 	memset(&scmd_area, 0, sizeof(scmd_area));
 	do {
 		scmd_area.request.header.code = 0x102e;
@@ -1293,7 +1459,8 @@ static int get_card_measurement_data(void)
 			break;
 		}
 
-		rc = process_card_measurement_data(&scmd_area, &last_card);
+		rc = process_card_measurement_data(&scmd_area, &last_card,
+						   apqn_mask);
 		if (rc != 0)
 			break;
 
@@ -1301,6 +1468,9 @@ static int get_card_measurement_data(void)
 			scmd_area.request.fcs = last_card + 1;
 	} while (scmd_area.response.p && last_card < g.max_card);
 
+	if (rc == 0 && !g.no_apqn)
+		rc = get_all_apqn_measurement_data(apqn_mask);
+
 	return rc;
 }
 
@@ -1767,6 +1937,189 @@ static int csv_print_counter_data(bool is_apqn, uint8_t card, uint8_t domain,
 	return 0;
 }
 
+/*
+ * Write the file header to a new or empty history file
+ */
+static int history_write_header(void)
+{
+	struct history_file_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = HISTORY_MAGIC;
+	hdr.version = HISTORY_VERSION;
+	hdr.entry_size = sizeof(struct history_entry);
+	hdr.interval = g.interval;
+
+	if (write(g.history_fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		warnx("Failed to write history file '%s': %s",
+		      g.history_file, strerror(errno));
+		return -EIO;
+	}
+	return 0;
+}
+
+/*
+ * Open the history file for appending. A file header is written if the
+ * file is empty.
+ */
+static int history_open(void)
+{
+	struct stat sb;
+
+	g.history_fd = open(g.history_file, O_WRONLY | O_CREAT | O_APPEND,
+			    0644);
+	if (g.history_fd < 0) {
+		warnx("Failed to open history file '%s': %s",
+		      g.history_file, strerror(errno));
+		return -errno;
+	}
+
+	if (fstat(g.history_fd, &sb) != 0) {
+		warnx("Failed to access history file '%s': %s",
+		      g.history_file, strerror(errno));
+		return -errno;
+	}
+
+	if (sb.st_size == 0)
+		return history_write_header();
+
+	return 0;
+}
+
+/*
+ * Rename the history file to FILE.1 and start a new one if it has
+ * reached the rotation size
+ */
+static int history_rotate(void)
+{
+	struct stat sb;
+	char *old;
+	int rc;
+
+	if (fstat(g.history_fd, &sb) != 0)
+		return -errno;
+	if ((unsigned long)sb.st_size < g.history_size * 1024)
+		return 0;
+
+	util_asprintf(&old, "%s.1", g.history_file);
+	rc = rename(g.history_file, old);
+	if (rc != 0) {
+		rc = -errno;
+		warnx("Failed to rename history file '%s' to '%s': %s",
+		      g.history_file, old, strerror(errno));
+		free(old);
+		return rc;
+	}
+	pr_verbose("History file '%s' rotated to '%s'", g.history_file, old);
+	free(old);
+
+	close(g.history_fd);
+	return history_open();
+}
+
+/*
+ * Initialize the binary history format
+ */
+static int history_print_initialize(void)
+{
+	g.history_alloc = 64;
+	g.history_buf = util_malloc(g.history_alloc *
+				    sizeof(struct history_entry));
+
+	return history_open();
+}
+
+/*
+ * Terminate the binary history format
+ */
+static int history_print_terminate(void)
+{
+	if (g.history_fd >= 0)
+		close(g.history_fd);
+	g.history_fd = -1;
+	free(g.history_buf);
+	g.history_buf = NULL;
+
+	return 0;
+}
+
+/*
+ * Start collecting the entries of an interval
+ */
+static int history_print_interval_header(unsigned long UNUSED(interval_count),
+					 const char *UNUSED(timestamp))
+{
+	g.history_count = 0;
+	g.history_time = time(NULL);
+	return 0;
+}
+
+/*
+ * Write the record of an interval with a single write
+ */
+static int history_print_interval_footer(void)
+{
+	struct history_rec_header hdr;
+	struct iovec iov[2];
+	ssize_t len;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = HISTORY_REC_MAGIC;
+	hdr.count = g.history_count;
+	hdr.time = g.history_time;
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = g.history_buf;
+	iov[1].iov_len = g.history_count * sizeof(struct history_entry);
+
+	len = writev(g.history_fd, iov, 2);
+	if (len != (ssize_t)(iov[0].iov_len + iov[1].iov_len)) {
+		warnx("Failed to write history file '%s': %s",
+		      g.history_file, len < 0 ? strerror(errno) :
+		      "Short write");
+		return -EIO;
+	}
+
+	return history_rotate();
+}
+
+/*
+ * Add the counter data to the record of the current interval
+ */
+static int history_print_counter_data(bool is_apqn, uint8_t card,
+				      uint8_t domain,
+				      const char *UNUSED(type),
+				      const char *UNUSED(timestamp),
+				      const char *UNUSED(name),
+				      struct interval_values *vals)
+{
+	struct history_entry *e;
+	double duration;
+
+	if (g.history_count >= g.history_alloc) {
+		g.history_alloc *= 2;
+		g.history_buf = util_realloc(g.history_buf, g.history_alloc *
+					     sizeof(struct history_entry));
+	}
+
+	e = &g.history_buf[g.history_count++];
+	memset(e, 0, sizeof(*e));
+	e->card = card;
+	e->is_apqn = is_apqn;
+	e->domain = domain;
+	e->type = g.cmb_header->ct;
+	e->mode = g.cmb_header->mt;
+	e->counter = g.counter_index < 0 ? HISTORY_TOTALS : g.counter_index;
+	e->ops = vals->count;
+	e->utilization = (uint32_t)MIN(vals->utilization * 1000000.0,
+				       (double)UINT32_MAX);
+	duration = vals->duration * 1000000000.0;
+	e->duration = (uint32_t)MIN(duration, (double)UINT32_MAX);
+
+	return 0;
+}
+
 /*
  * Calculates number of ops, utilization, duration and rate of an
  * interval from the timer values, scale and interval time.
@@ -1818,8 +2171,9 @@ static int print_interval_data(struct interval_data *data,
 	memset(&total_previous, 0, sizeof(total_previous));
 
 	g.first_counter = true;
+	g.cmb_header = &data->current.header;
 
-	for (i = 0; i < 32 &&
+	for (i = 0; i < NUM_CMB_COUNTERS &&
 	     offsetofend(struct chsc_cmb_area, entries[i]) <= len; i++) {
 		if (data->current.header.v & mask) {
 			if (is_counter_totals(data->current.header.ct,
@@ -1847,6 +2201,7 @@ static int print_interval_data(struct interval_data *data,
 
 			counter = get_counter_name(data->current.header.ct,
 						   data->current.header.mt, i);
+			g.counter_index = i;
 
 			rc = pr_call(print_counter_data)(
 					data->current.header.format == 1,
@@ -1870,6 +2225,7 @@ static int print_interval_data(struct interval_data *data,
 				     data->current.header.s, interval_time,
 				     &vals);
 
+		g.counter_index = -1;
 		rc = pr_call(print_counter_data)(
 				data->current.header.format == 1,
 				data->current.header.ax,
@@ -2342,6 +2698,20 @@ int main(int argc, char *argv[])
 		case 'O':
 			g.only_online = true;
 			break;
+		case 'H':
+			g.history_file = optarg;
+			break;
+		case 'S':
+			g.history_size = strtoul(optarg, &endp, 0);
+			if (*optarg == '\0' || *endp != '\0' ||
+			    g.history_size == 0 ||
+			    (g.history_size == ULONG_MAX && errno == ERANGE)) {
+				warnx("Invalid value for '--history-size'|"
+				      "'-S': '%s'", optarg);
+				util_prg_print_parse_error();
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'V':
 			g.verbose = true;
 			break;
@@ -2368,6 +2738,15 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	if (g.history_file != NULL) {
+		if (g.print_funcs != &default_print) {
+			warnx("Either --history or --output can be specified, "
+			      "but not both");
+			return EXIT_FAILURE;
+		}
+		g.print_funcs = &history_print;
+	}
+
 	if (g.only_online && g.all) {
 		warnx("Either --only-online or --all can be specified, "
 		      "but not both");
@@ -2420,6 +2799,7 @@ out:
 		close(g.chsc_fd);
 	free_device_selection();
 	free_type_mapping();
+	free_type_info();
 	free_interval_data();
 
 	return rc;
@@ -75,6 +75,32 @@ struct device_list {
 	unsigned int modified:1;
 };
 
+/**
+ * struct device_write_job - Deferred write of active device settings
+ * @node: Node for adding this job to a list
+ * @dev: Device to which the settings belong
+ * @data: Arbitrary data used by the caller
+ * @config: Configuration set used by the caller
+ * @paths: Attribute paths in the order in which they must be written
+ * @texts: Text to write to the attribute at the corresponding path
+ * @num: Number of attribute writes
+ * @rc: Result of the writes
+ * @failed: Index of the write that failed
+ * @err: Error number of the failed write
+ */
+struct device_write_job {
+	struct util_list_node node;
+	struct device *dev;
+	void *data;
+	config_t config;
+	char **paths;
+	char **texts;
+	int num;
+	exit_code_t rc;
+	int failed;
+	int err;
+};
+
 struct device *device_new(struct subtype *, const char *);
 void device_free(struct device *);
 void device_reset(struct device *, config_t);
@@ -86,8 +112,14 @@ exit_code_t device_apply_settings(struct device *, config_t,
 				  struct util_list *);
 void device_add_modules(struct util_list *, struct device *);
 char *device_read_active_attrib(struct device *, const char *);
+void device_add_active_attrib_paths(struct subtype *, const char *,
+				    read_scope_t, struct util_list *);
 void device_read_active_settings(struct device *, read_scope_t);
 exit_code_t device_write_active_settings(struct device *);
+void device_defer_active_writes(struct util_list *);
+exit_code_t device_write_job_run(struct device_write_job *);
+void device_write_jobs_run(struct util_list *, int);
+void device_write_job_free(struct device_write_job *);
 exit_code_t device_check_settings(struct device *, config_t, err_t);
 
 struct device_list *device_list_new(struct subtype *);
@@ -31,9 +31,12 @@ struct export_object {
 	} ptr;
 };
 
+/* Called for each complete object read by export_read(). */
+typedef void (*export_cb_t)(struct export_object *, void *);
+
 struct export_object *object_new(export_t type, void *ptr);
 exit_code_t export_write_device(FILE *, struct device *, config_t, int *);
 exit_code_t export_write_devtype(FILE *, struct devtype *, config_t, int *);
-exit_code_t export_read(FILE *, const char *, struct util_list *);
+exit_code_t export_read(FILE *, const char *, export_cb_t, void *);
 
 #endif /* EXPORT_H */
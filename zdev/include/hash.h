@@ -13,9 +13,13 @@
 #include "lib/util_list.h"
 
 /* A hash is a list of entries. Each entry provides an ID. A hashing function
- * maps the ID to an integer bucket number. When adding entries to a hash, the
- * entry is stored in a list associated with this bucket number. This approach
- * can greatly reduce the effort needed to find an entry in a hash by ID. */
+ * maps the ID to an integer hash value from which a bucket number is derived.
+ * When adding entries to a hash, the entry is stored in a list associated with
+ * this bucket number. This approach can greatly reduce the effort needed to
+ * find an entry in a hash by ID. The number of buckets is doubled whenever the
+ * average number of entries per bucket exceeds HASH_MAX_LOAD. */
+
+#define HASH_MAX_LOAD	2
 
 /* Return the ID of an entry. */
 typedef const void *(*hash_id_fn_t)(void *);
@@ -23,21 +27,23 @@ typedef const void *(*hash_id_fn_t)(void *);
 /* Check if two IDs are identical. */
 typedef int (*hash_cmp_fn_t)(const void *, const void *);
 
-/* Return the bucket number for an ID. */
-typedef int (*hash_fn_t)(const void *);
+/* Return the hash value for an ID. */
+typedef unsigned int (*hash_fn_t)(const void *);
 
 /**
  * hash - A hash supported list
  * @list: Sequential list of entries
  * @buckets: Number of hash buckets
+ * @entries: Number of entries
  * @get_id: Return the ID of an entry
  * @cmp_id: Return 0 if two IDs are identical
- * @get_hash: Function that returns a hash index for an ID
+ * @get_hash: Function that returns a hash value for an ID
  * @hash: Lists per hash index
  */
 struct hash {
 	struct util_list list;
 	int buckets;
+	int entries;
 	hash_id_fn_t get_id;
 	hash_cmp_fn_t cmp_id;
 	hash_fn_t get_hash;
@@ -61,5 +67,7 @@ void hash_add(struct hash *hash, void *entry);
 void hash_remove(struct hash *hash, void *entry);
 void *hash_find_by_id(struct hash *hash, const void *id);
 void hash_print(struct hash *hash, int ind);
+int hash_cmp_str(const void *a, const void *b);
+unsigned int hash_str(const void *id);
 
 #endif /* HASH_H */
@@ -175,6 +175,7 @@ bool file_is_devnode(const char *);
 exit_code_t remove_file(const char *);
 exit_code_t misc_read_fd(FILE *fd, void **buffer, size_t *size_ptr);
 char *misc_read_text_file(const char *, int, err_t);
+void misc_prefetch_text_files(struct util_list *, int);
 char *misc_read_cmd_output(const char *, int, err_t);
 char *config_read_cmd_output(const char *, int, err_t);
 exit_code_t misc_write_text_file(const char *, const char *, err_t);
@@ -52,8 +52,9 @@ extern struct namespace *namespaces[NUM_NAMESPACES + 1];
  * @cmp_parsed_ids: Compare two parsed device IDs (same return codes as strcmp)
  * @qsort_cmp: Compare two device IDs for strlist_sort_unique
  *
- * @hash_buckets: Optional: Number of hash buckets to use for device ID hashes
- * @hash_parsed_id: Optional: Return hash bucket for specified ID in parsed
+ * @hash_buckets: Optional: Initial number of hash buckets to use for device ID
+ *                hashes
+ * @hash_parsed_id: Optional: Return hash value for specified ID in parsed
  *                  format
  *
  * @is_id_range_valid: Check if string is a valid range of device IDs
@@ -91,7 +92,7 @@ struct namespace {
 
 	/* ID Hash. */
 	int		hash_buckets;
-	int		(*hash_parsed_id)(const void *);
+	unsigned int	(*hash_parsed_id)(const void *);
 
 	/* Ranges. */
 	exit_code_t	(*is_id_range_valid)(const char *, err_t);
@@ -33,6 +33,8 @@
 
 #define PATH_ROOT		"/"
 #define PATH_ROOT_SCRIPT	TOOLS_LIBDIR "/zdev-root-update"
+#define PATH_ROOT_HASH		"/var/lib/zdev/root-update.hash"
+#define PATH_ROOT_LOCK		"/run/zdev-root-update.lock"
 
 struct devtype;
 struct zfcp_lun_devid;
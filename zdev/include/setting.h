@@ -60,6 +60,8 @@ struct setting_list {
 struct setting *setting_new(struct attrib *, const char *, const char *);
 struct setting *setting_copy(const struct setting *);
 bool setting_is_set(struct setting *);
+char *setting_get_write_text(const char *, struct setting *,
+			     const char *);
 exit_code_t setting_write(const char *, struct setting *s);
 void setting_print(struct setting *, int);
 
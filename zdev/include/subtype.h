@@ -59,6 +59,8 @@ typedef exit_code_t (*subtype_cb_t)(struct subtype *st, const char *id,
  * @unknown_dev_attribs: Allow specification of unknown device attributes
  * @support_definable: Allow definition of devices
  * @generic: This is a generic subtype that is intended as a fallback only
+ * @parallel_active: Active settings of devices of this subtype can be
+ *                   written in parallel with those of other devices
  *
  * @devices: Devices of this subtype
  *
@@ -145,6 +147,7 @@ struct subtype {
 	unsigned int	unknown_dev_attribs:1;
 	unsigned int	support_definable:1;
 	unsigned int	generic:1;
+	unsigned int	parallel_active:1;
 
 	/* Dynamic data. */
 	struct device_list *devices;
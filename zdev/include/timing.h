@@ -0,0 +1,42 @@
+/*
+ * zdev - Modify and display the persistent configuration of devices
+ *
+ * Copyright IBM Corp. 2016, 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+
+struct subtype;
+
+/* Phases for which the time spent is accumulated. */
+typedef enum {
+	timing_attr_read,
+	timing_attr_write,
+	timing_cio_settle,
+	timing_udev_settle,
+	timing_udev_rules,
+	timing_modprobe,
+	timing_root_update,
+	TIMING_NUM_PHASES,
+} timing_phase_t;
+
+extern int timing_enabled;
+
+void timing_init(void);
+void timing_exit(void);
+void timing_print(void);
+
+void timing_begin(timing_phase_t phase);
+void timing_end(void);
+
+uint64_t timing_device_begin(void);
+void timing_device_end(struct subtype *st, const char *id, const char *op,
+		       uint64_t start);
+
+#endif /* TIMING_H */
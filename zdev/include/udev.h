@@ -10,14 +10,18 @@
 #ifndef UDEV_H
 #define UDEV_H
 
+#include <stdio.h>
+
 #include "lib/util_list.h"
 #include "exit_code.h"
+#include "misc.h"
 
 struct attrib;
 struct setting_list;
 
 extern int udev_need_settle;
 extern int udev_no_settle;
+extern int udev_batch_rules;
 
 /* Single key-operator-value entry in a udev rule line.*/
 struct udev_entry_node {
@@ -34,9 +38,10 @@ struct udev_line_node {
 	char *line;
 };
 
-/* Udev rule file. */
+/* Udev rule file. Files may be shared, @refs counts the number of users. */
 struct udev_file {
 	struct util_list lines;
+	int refs;
 };
 
 exit_code_t udev_read_file(const char *, struct udev_file **);
@@ -50,6 +55,14 @@ exit_code_t udev_remove_rule(const char *type, const char *id, bool autoconf);
 
 void udev_settle(void);
 
+FILE *udev_rule_fopen(const char *);
+int udev_rule_fclose(FILE *);
+exit_code_t udev_rule_remove(const char *);
+bool udev_rule_exists(const char *);
+char *udev_rule_read(const char *, err_t);
+exit_code_t udev_flush_rules(void);
+void udev_exit(void);
+
 void udev_add_internal_from_entry(struct setting_list *list,
 				  struct udev_entry_node *entry,
 				  struct attrib **attribs);
@@ -27,6 +27,7 @@
 #include "namespace.h"
 #include "path.h"
 #include "setting.h"
+#include "timing.h"
 #include "udev.h"
 #include "udev_ccw.h"
 
@@ -319,11 +320,11 @@ static int ccw_qsort_cmp(const void *a_ptr, const void *b_ptr)
 	return ccw_cmp_ids(a, b);
 }
 
-static int ccw_hash_by_parsed_id(const void *devid_ptr)
+static unsigned int ccw_hash_by_parsed_id(const void *devid_ptr)
 {
 	const struct ccw_devid *devid = devid_ptr;
 
-	return devid->devno & 0xff;
+	return devid->cssid << 20 | devid->ssid << 16 | devid->devno;
 }
 
 /* Return distance between CCW device IDs %a and %b in number of CCW device
@@ -492,19 +493,153 @@ int ccw_cmp_devids(struct ccw_devid *a, struct ccw_devid *b)
 	return ccw_cmp_parsed_ids(a, b);
 }
 
+/*
+ * CCW device ID sets.
+ *
+ * A set contains one bitmap of DEVNO_MAX + 1 bits per subchannel set. Bitmaps
+ * are only allocated for subchannel sets that contain at least one ID. Ranges
+ * of device numbers are set, tested and searched one word at a time.
+ */
+
+#define BITS_PER_WORD	(sizeof(unsigned long) * CHAR_BIT)
+#define DEVNO_WORDS	((DEVNO_MAX + 1) / BITS_PER_WORD)
+
+struct ccw_idset {
+	unsigned long *map[CSSID_MAX + 1][SSID_MAX + 1];
+};
+
+static struct ccw_idset *idset_new(void)
+{
+	return misc_malloc(sizeof(struct ccw_idset));
+}
+
+static void idset_free(struct ccw_idset *set)
+{
+	unsigned int cssid, ssid;
+
+	if (!set)
+		return;
+	for (cssid = 0; cssid <= CSSID_MAX; cssid++) {
+		for (ssid = 0; ssid <= SSID_MAX; ssid++)
+			free(set->map[cssid][ssid]);
+	}
+	free(set);
+}
+
+/* Set bits @from to @to in @map if @set is true. Otherwise return true if any
+ * of these bits is set. */
+static bool map_range(unsigned long *map, unsigned int from, unsigned int to,
+		      bool set)
+{
+	unsigned int w = from / BITS_PER_WORD, last = to / BITS_PER_WORD;
+	unsigned long mask;
+
+	for (; w <= last; w++) {
+		mask = ~0UL;
+		if (w == from / BITS_PER_WORD)
+			mask &= ~0UL << (from % BITS_PER_WORD);
+		if (w == last)
+			mask &= ~0UL >> (BITS_PER_WORD - 1 - to % BITS_PER_WORD);
+		if (set)
+			map[w] |= mask;
+		else if (map[w] & mask)
+			return true;
+	}
+
+	return false;
+}
+
+/* Return the first bit number starting at @start in @map that has value
+ * @value, or DEVNO_MAX + 1 if there is none. */
+static unsigned int map_find(unsigned long *map, unsigned int start,
+			     bool value)
+{
+	unsigned long invert = value ? 0 : ~0UL, word;
+	unsigned int w;
+
+	if (start > DEVNO_MAX)
+		return DEVNO_MAX + 1;
+	w = start / BITS_PER_WORD;
+	word = (map[w] ^ invert) & (~0UL << (start % BITS_PER_WORD));
+	while (!word) {
+		if (++w >= DEVNO_WORDS)
+			return DEVNO_MAX + 1;
+		word = map[w] ^ invert;
+	}
+
+	return w * BITS_PER_WORD + __builtin_ctzl(word);
+}
+
+/* Add all IDs in range @from to @to to @set if @add is true. Otherwise return
+ * true if any ID in the range is part of @set. */
+static bool idset_range(struct ccw_idset *set, struct ccw_devid *from,
+			struct ccw_devid *to, bool add)
+{
+	unsigned int cssid, ssid, first_ssid, last_ssid, lo, hi;
+	unsigned long **map;
+
+	for (cssid = from->cssid; cssid <= to->cssid; cssid++) {
+		first_ssid = (cssid == from->cssid) ? from->ssid : 0;
+		last_ssid = (cssid == to->cssid) ? to->ssid : SSID_MAX;
+		for (ssid = first_ssid; ssid <= last_ssid; ssid++) {
+			lo = (cssid == from->cssid && ssid == from->ssid) ?
+			     from->devno : 0;
+			hi = (cssid == to->cssid && ssid == to->ssid) ?
+			     to->devno : DEVNO_MAX;
+			if (lo > hi)
+				continue;
+			map = &set->map[cssid][ssid];
+			if (!*map) {
+				if (!add)
+					continue;
+				*map = misc_malloc(DEVNO_WORDS *
+						   sizeof(unsigned long));
+			}
+			if (map_range(*map, lo, hi, add))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static void idset_add(struct ccw_idset *set, struct ccw_devid *id)
+{
+	idset_range(set, id, id, true);
+}
+
+static void idset_add_range(struct ccw_idset *set, struct ccw_devid *from,
+			    struct ccw_devid *to)
+{
+	idset_range(set, from, to, true);
+}
+
+static bool idset_contains(struct ccw_idset *set, struct ccw_devid *id)
+{
+	return idset_range(set, id, id, false);
+}
+
+static bool idset_intersects(struct ccw_idset *set, struct ccw_devid *from,
+			     struct ccw_devid *to)
+{
+	return idset_range(set, from, to, false);
+}
+
 /*
  * cio_ignore handling.
  */
 
 static char *proc_cio_ignore;
-static struct util_list *ignore_once_list;
+static struct ccw_idset *cio_ignore_set;
+static struct ccw_idset *ignore_once_set;
 static struct util_list *devinfos;
 
 /* Release memory used by CCW module. */
 void ccw_exit(void)
 {
 	free(proc_cio_ignore);
-	strlist_free(ignore_once_list);
+	idset_free(cio_ignore_set);
+	idset_free(ignore_once_set);
 	ptrlist_free(devinfos, 1);
 }
 
@@ -520,7 +655,9 @@ void cio_settle(int force)
 		return;
 
 	path = path_get_proc("cio_settle");
+	timing_begin(timing_cio_settle);
 	misc_write_text_file(path, "\n", err_ignore);
+	timing_end();
 	free(path);
 	done = 1;
 }
@@ -661,6 +798,44 @@ static char *read_cio_ignore(void)
 	return proc_cio_ignore;
 }
 
+/* Ensure that the cio_ignore file is re-read. */
+static void reset_cio_ignore(void)
+{
+	free(proc_cio_ignore);
+	proc_cio_ignore = NULL;
+	idset_free(cio_ignore_set);
+	cio_ignore_set = NULL;
+}
+
+/* Return the set of IDs on the cio_ignore blacklist. */
+static struct ccw_idset *get_cio_ignore_set(void)
+{
+	char *copy, *next, *curr;
+	struct ccw_devid from, to;
+
+	if (cio_ignore_set)
+		return cio_ignore_set;
+	if (!read_cio_ignore())
+		return NULL;
+
+	cio_ignore_set = idset_new();
+	copy = misc_strdup(proc_cio_ignore);
+	next = copy;
+	while ((curr = strsep(&next, "\n"))) {
+		if (*curr == 0)
+			break;
+		/* Single ID: xx.y.zzzz */
+		if (ccw_parse_devid_simple(&from, curr))
+			idset_add(cio_ignore_set, &from);
+		/* ID range: xx.y.zzzz-xx.y.zzzz */
+		else if (ccw_parse_devid_range_simple(&from, &to, curr))
+			idset_add_range(cio_ignore_set, &from, &to);
+	}
+	free(copy);
+
+	return cio_ignore_set;
+}
+
 /* Check if there is a CCW device blacklist active. */
 bool ccw_is_blacklist_active(void)
 {
@@ -673,9 +848,8 @@ bool ccw_is_blacklist_active(void)
 
 static bool is_ignored(const char *str, int is_range)
 {
-	char *copy, *next, *curr;
-	bool rc = false;
-	struct ccw_devid id, id2, from, to;
+	struct ccw_idset *set;
+	struct ccw_devid id, id2;
 
 	if (is_range) {
 		if (!ccw_parse_devid_range_simple(&id, &id2, str))
@@ -686,50 +860,14 @@ static bool is_ignored(const char *str, int is_range)
 	}
 
 	/* Read /proc/cio_ignore. */
-	if (!read_cio_ignore())
+	set = get_cio_ignore_set();
+	if (!set)
 		return false;
 
-	/* Iterate over each line. */
-	copy = misc_strdup(proc_cio_ignore);
-	next = copy;
-	while ((curr = strsep(&next, "\n"))) {
-		if (*curr == 0)
-			break;
-		if (ccw_parse_devid_simple(&from, curr)) {
-			/* Single ID: xx.y.zzzz */
-			if (is_range) {
-				/* Is FROM within ID-ID2? */
-				if (!ccw_devid_in_range(&from, &id, &id2))
-					continue;
-			} else {
-				/* Is FROM the same as ID? */
-				if (ccw_cmp_parsed_ids(&id, &from) != 0)
-					continue;
-			}
-			goto found;
-		}
-		if (!ccw_parse_devid_range_simple(&from, &to, curr))
-			continue;
+	if (is_range)
+		return idset_intersects(set, &id, &id2);
 
-		/* ID range: xx.y.zzzz-xx.y.zzzz */
-		if (is_range) {
-			/* Does FROM-TO intersect with ID-ID2 ? */
-			if (ccw_cmp_parsed_ids(&to, &id) < 0 ||
-			    ccw_cmp_parsed_ids(&from, &id2) > 0)
-				continue;
-		} else {
-			/* Is ID inside FROM-TO? */
-			if (!ccw_devid_in_range(&id, &from, &to))
-				continue;
-		}
-
-found:
-		rc = true;
-		break;
-	}
-	free(copy);
-
-	return rc;
+	return idset_contains(set, &id);
 }
 
 /* Determine if the specified CCW device ID is on the cio_ignore blacklist. */
@@ -749,21 +887,20 @@ bool ccw_is_id_range_blacklisted(const char *range)
  * only once. */
 void ccw_unblacklist_id(const char *id)
 {
+	struct ccw_devid devid;
 	char *normid, *path, *line;
 
 	/* Ensure that this is only attempted once. */
-	normid = ccw_normalize_id(id);
-	if (!normid)
+	if (!ccw_parse_devid_simple(&devid, id))
 		return;
-	if (!ignore_once_list)
-		ignore_once_list = strlist_new();
-	if (strlist_find(ignore_once_list, normid)) {
-		free(normid);
+	if (!ignore_once_set)
+		ignore_once_set = idset_new();
+	if (idset_contains(ignore_once_set, &devid))
 		return;
-	}
+	idset_add(ignore_once_set, &devid);
 
+	normid = ccw_devid_to_str(&devid);
 	verb("Removing CCW device %s from the CIO blacklist\n", normid);
-	strlist_add(ignore_once_list, normid);
 	free(normid);
 
 	path = path_get_proc("cio_ignore");
@@ -773,10 +910,7 @@ void ccw_unblacklist_id(const char *id)
 	cio_settle(1);
 	free(line);
 	free(path);
-	free(proc_cio_ignore);
-
-	/* Ensure that cio_ignore file is re-read. */
-	proc_cio_ignore = NULL;
+	reset_cio_ignore();
 }
 
 /* Remove a CCW device ID range from the CIO blacklist. */
@@ -796,80 +930,17 @@ void ccw_unblacklist_id_range(const char *range)
 	udev_settle();
 	free(line);
 	free(path);
-	free(proc_cio_ignore);
-
-	/* Ensure that cio_ignore file is re-read. */
-	proc_cio_ignore = NULL;
-}
-
-static char ***id_bitmap_new(void)
-{
-	return misc_malloc(sizeof(char **) * CSSID_MAX);
-}
-
-static void id_bitmap_free(char ***id_bitmap)
-{
-	unsigned int cssid, ssid;
-
-	for (cssid = 0; cssid < CSSID_MAX; cssid++) {
-		if (!id_bitmap[cssid])
-			continue;
-		for (ssid = 0; ssid < SSID_MAX; ssid++)
-			free(id_bitmap[cssid][ssid]);
-		free(id_bitmap[cssid]);
-	}
-
-	free(id_bitmap);
-}
-
-#define BITS_PER_CHAR	8
-
-static void id_bitmap_set(char ***id_bitmap, unsigned int cssid,
-			  unsigned int ssid, unsigned int devno)
-{
-	unsigned int offset, bit;
-
-	if (!id_bitmap[cssid])
-		id_bitmap[cssid] = misc_malloc(sizeof(char *) * (SSID_MAX + 1));
-	if (!id_bitmap[cssid][ssid]) {
-		id_bitmap[cssid][ssid] = misc_malloc(sizeof(char) *
-						     (DEVNO_MAX + 1) /
-						     BITS_PER_CHAR);
-	}
-
-	offset = devno / BITS_PER_CHAR;
-	bit = devno % BITS_PER_CHAR;
-
-	id_bitmap[cssid][ssid][offset] |= 1 << bit;
-}
-
-static bool id_bitmap_get(char ***id_bitmap, unsigned int cssid,
-			  unsigned int ssid, unsigned int devno)
-{
-	unsigned int offset, bit;
-
-	if (!id_bitmap[cssid])
-		return false;
-	if (!id_bitmap[cssid][ssid])
-		return false;
-
-	offset = devno / BITS_PER_CHAR;
-	bit = devno % BITS_PER_CHAR;
-
-	if (id_bitmap[cssid][ssid][offset] & 1 << bit)
-		return true;
-
-	return false;
+	reset_cio_ignore();
 }
 
 static exit_code_t collect_cb(struct subtype *st, const char *id,
 			      config_t config, void *data)
 {
-	char ***id_bitmap = data;
+	struct ccw_idset *set = data;
 	struct ccw_devid devid;
 
 	if (ccw_parse_devid_simple(&devid, id))
-		id_bitmap_set(id_bitmap, devid.cssid, devid.ssid, devid.devno);
+		idset_add(set, &devid);
 
 	return EXIT_OK;
 }
@@ -877,31 +948,28 @@ static exit_code_t collect_cb(struct subtype *st, const char *id,
 static exit_code_t collect_group_cb(struct subtype *st, const char *id,
 				    config_t config, void *data)
 {
-	char ***id_bitmap = data;
+	struct ccw_idset *set = data;
 	struct ccwgroup_devid devid;
 	unsigned int i;
 
 	if (ccwgroup_parse_devid_simple(&devid, id)) {
-		for (i = 0; i < devid.num; i++) {
-			id_bitmap_set(id_bitmap, devid.devid[i].cssid,
-				      devid.devid[i].ssid,
-				      devid.devid[i].devno);
-		}
+		for (i = 0; i < devid.num; i++)
+			idset_add(set, &devid.devid[i]);
 	}
 
 	return EXIT_OK;
 }
 
-/* Set bits for all persistently configured CCW devices. */
-static char ***id_bitmap_collect(bool autoconf)
+/* Return set of all persistently configured CCW devices. */
+static struct ccw_idset *idset_collect(bool autoconf)
 {
-	char ***id_bitmap;
+	struct ccw_idset *set;
 	int i, j;
 	struct devtype *dt;
 	struct subtype *st;
 	config_t config = autoconf ? config_autoconf : config_persistent;
 
-	id_bitmap = id_bitmap_new();
+	set = idset_new();
 
 	/* Search all subtypes. */
 	for (i = 0; (dt = devtypes[i]); i++) {
@@ -909,20 +977,19 @@ static char ***id_bitmap_collect(bool autoconf)
 			/* Collect CCW device IDs. */
 			if (st->namespace == &ccw_namespace) {
 				subtype_for_each_id(st, config,
-						    collect_cb, id_bitmap);
+						    collect_cb, set);
 			}
 			/* Collect CCWGROUP device IDs. Since there may be
 			 * multiple namespaces, we need to make use of this
 			 * hack. */
 			if (ccwgroup_compatible_namespace(st->namespace)) {
 				subtype_for_each_id(st, config,
-						    collect_group_cb,
-						    id_bitmap);
+						    collect_group_cb, set);
 			}
 		}
 	}
 
-	return id_bitmap;
+	return set;
 }
 
 struct ccw_devid_range {
@@ -956,50 +1023,34 @@ static void range_add(struct util_list *list, struct ccw_devid *from,
 
 static struct util_list *cio_ignore_get_ranges(bool autoconf)
 {
-	char ***id_bitmap;
+	struct ccw_idset *set;
 	unsigned int cssid, ssid, devno;
+	unsigned long *map;
 	struct util_list *ranges;
-	struct ccw_devid a, b;
-	struct ccw_devid *first, *last;
+	struct ccw_devid from, to;
 
 	ranges = strlist_new();
 
-	id_bitmap = id_bitmap_collect(autoconf);
-	for (cssid = 0; cssid < CSSID_MAX; cssid++) {
-		if (!id_bitmap[cssid])
-			continue;
-		for (ssid = 0; ssid < SSID_MAX; ssid++) {
-			if (!id_bitmap[cssid][ssid])
+	set = idset_collect(autoconf);
+	for (cssid = 0; cssid <= CSSID_MAX; cssid++) {
+		for (ssid = 0; ssid <= SSID_MAX; ssid++) {
+			map = set->map[cssid][ssid];
+			if (!map)
 				continue;
-			first = NULL;
-			last = NULL;
-			for (devno = 0; devno < DEVNO_MAX; devno++) {
-				if (!id_bitmap_get(id_bitmap, cssid, ssid,
-						   devno)) {
-					if (first) {
-						range_add(ranges, first, last);
-						first = NULL;
-						last = NULL;
-					}
-					continue;
-				}
-				if (first) {
-					last = &b;
-					last->cssid = cssid;
-					last->ssid = ssid;
-					last->devno = devno;
-				} else {
-					first = &a;
-					first->cssid = cssid;
-					first->ssid = ssid;
-					first->devno = devno;
-				}
+			from.cssid = to.cssid = cssid;
+			from.ssid = to.ssid = ssid;
+			devno = map_find(map, 0, true);
+			while (devno <= DEVNO_MAX) {
+				from.devno = devno;
+				devno = map_find(map, devno, false);
+				to.devno = devno - 1;
+				range_add(ranges, &from,
+					  from.devno == to.devno ? NULL : &to);
+				devno = map_find(map, devno, true);
 			}
-			if (first)
-				range_add(ranges, first, last);
 		}
 	}
-	id_bitmap_free(id_bitmap);
+	idset_free(set);
 
 	return ranges;
 }
@@ -41,6 +41,7 @@
 #include "subtype.h"
 #include "table_attribs.h"
 #include "table_types.h"
+#include "timing.h"
 #include "udev.h"
 #include "zfcp_lun.h"
 
@@ -97,6 +98,8 @@ struct options {
 	unsigned int verbose:1;
 	unsigned int quiet:1;
 	unsigned int no_settle:1;
+	int jobs;
+	unsigned int timing:1;
 };
 
 /* Makefile converts chzdev_usage.txt into C file which we include here. */
@@ -140,6 +143,8 @@ enum {
 	OPT_QUIET		= 'q',
 	OPT_NO_SETTLE		= (OPT_ANONYMOUS_BASE+__COUNTER__),
 	OPT_AUTO_CONF		= (OPT_ANONYMOUS_BASE+__COUNTER__),
+	OPT_JOBS		= 'j',
+	OPT_TIMING		= (OPT_ANONYMOUS_BASE+__COUNTER__),
 };
 
 static struct opts_conflict conflict_list[] = {
@@ -225,11 +230,13 @@ static const struct option opt_list[] = {
 	{ "verbose",		no_argument,	NULL, OPT_VERBOSE },
 	{ "quiet",		no_argument,	NULL, OPT_QUIET },
 	{ "no-settle",		no_argument,	NULL, OPT_NO_SETTLE },
+	{ "jobs",		required_argument, NULL, OPT_JOBS },
+	{ "timing",		no_argument,	NULL, OPT_TIMING },
 	{ NULL,			no_argument,	NULL, 0 },
 };
 
 /* Command line abbreviations. */
-static const char opt_str[] = ":edlHLapr:RfyhvVqt";
+static const char opt_str[] = ":edlHLapr:RfyhvVqtj:";
 
 /* Count of persistently modified devices. */
 static int pers_mod_devs;
@@ -241,6 +248,7 @@ static int pers_mod_devtypes;
 static void init_options(struct options *opts)
 {
 	memset(opts, 0, sizeof(struct options));
+	opts->jobs = 1;
 	opts->select = select_opts_new();
 	opts->positional = strlist_new();
 	opts->settings = strlist_new();
@@ -760,6 +768,7 @@ static exit_code_t parse_options(struct options *opts, int argc, char *argv[])
 	exit_code_t rc;
 	int opt;
 	int specified[OPTS_MAX + 1];
+	char *end;
 
 	/* Suppress getopt error messages. */
 	memset(specified, 0, sizeof(specified));
@@ -955,6 +964,20 @@ static exit_code_t parse_options(struct options *opts, int argc, char *argv[])
 			opts->no_settle = 1;
 			break;
 
+		case OPT_JOBS:
+			/* --jobs NUM */
+			opts->jobs = strtol(optarg, &end, 10);
+			if (*optarg == 0 || *end != 0 || opts->jobs < 1) {
+				syntax("Invalid number of jobs '%s'\n", optarg);
+				return EXIT_USAGE_ERROR;
+			}
+			break;
+
+		case OPT_TIMING:
+			/* --timing */
+			opts->timing = 1;
+			break;
+
 		case ':':
 			/* Missing option argument. */
 			syntax("Option '%s' requires an argument\n",
@@ -1794,18 +1817,107 @@ static void unblacklist_ranges(struct selected_dev_node *sel,
 	*param_ptr = param;
 }
 
+/* Number of devices per job, for which active settings are written before
+ * the results are reported. */
+#define JOBS_BATCH_FACTOR	4
+
+/* Determine if active settings of devices of subtype @st can be written in
+ * parallel. */
+static bool defer_active_writes(struct options *opts, struct subtype *st)
+{
+	return opts->jobs > 1 && !dryrun && SCOPE_ACTIVE(opts->config) &&
+	       st->parallel_active;
+}
+
+/* Return the result of write job @job and queue an error message on
+ * failure. */
+static exit_code_t get_write_job_result(struct device_write_job *job)
+{
+	if (job->rc) {
+		delayed_err("Could not write file %s: %s\n",
+			    job->paths[job->failed], strerror(job->err));
+	}
+
+	return job->rc;
+}
+
+/* Run all deferred writes in @jobs in parallel and report the results. */
+static exit_code_t flush_write_jobs(struct options *opts,
+				    struct util_list *jobs, int *found_ptr)
+{
+	struct device_write_job *job, *n;
+	exit_code_t rc, drc = EXIT_OK;
+
+	if (util_list_is_empty(jobs))
+		return EXIT_OK;
+
+	device_write_jobs_run(jobs, opts->jobs);
+	util_list_iterate_safe(jobs, job, n) {
+		util_list_remove(jobs, job);
+		rc = get_write_job_result(job);
+		rc = print_config_result(job->data, job->dev, opts,
+					 job->config, rc, 0, 1);
+		if (rc && !drc)
+			drc = rc;
+		if (rc == EXIT_OK && found_ptr)
+			(*found_ptr)++;
+		device_write_job_free(job);
+	}
+
+	return drc;
+}
+
+/* Queue the result for device @dev in @jobs after its active settings were
+ * configured with deferred writes. @last is the last job in @jobs before the
+ * device was configured. @data and @config are passed to
+ * print_config_result() when @jobs is flushed. Return %true if the result
+ * was queued. Otherwise run the queued writes of @dev immediately, update
+ * @rc_ptr accordingly and return %false. */
+static bool defer_result(struct util_list *jobs, struct device_write_job *last,
+			 struct device *dev, void *data, config_t config,
+			 exit_code_t *rc_ptr)
+{
+	struct device_write_job *job;
+
+	job = util_list_end(jobs);
+	if (job == last)
+		job = NULL;
+	if (*rc_ptr == EXIT_OK && !delayed_messages_available()) {
+		/* Keep results in order of processing. */
+		if (!job) {
+			job = misc_malloc(sizeof(*job));
+			job->dev = dev;
+			util_list_add_tail(jobs, job);
+		}
+		job->data = data;
+		job->config = config;
+		return true;
+	}
+	/* Messages must be printed with this device. */
+	if (job) {
+		util_list_remove(jobs, job);
+		if (device_write_job_run(job) && *rc_ptr == EXIT_OK)
+			*rc_ptr = get_write_job_result(job);
+		device_write_job_free(job);
+	}
+
+	return false;
+}
+
 /* Handle device configuration. */
 static exit_code_t configure_devices(struct options *opts, int specified,
 				     int *found_ptr)
 {
-	struct util_list *selected;
+	struct util_list *selected, *jobs;
 	struct selected_dev_node *sel;
+	struct device_write_job *job;
 	exit_code_t rc, drc = EXIT_OK;
-	int existing, proc;
+	int existing, proc, defer;
 	struct namespace *ns;
 	const char *param;
 	struct device *dev;
 	config_t config = opts->config;
+	uint64_t start;
 
 	/* Determine list of selected devices. */
 	if ((!SCOPE_ACTIVE(config) &&
@@ -1815,6 +1927,7 @@ static exit_code_t configure_devices(struct options *opts, int specified,
 	else
 		existing = 1;
 	selected = selected_dev_list_new();
+	jobs = util_list_new(struct device_write_job, node);
 	rc = select_devices(opts->select, selected, existing, 1, 0,
 			    opts->config, scope_known, err_print);
 	if (rc)
@@ -1835,6 +1948,18 @@ static exit_code_t configure_devices(struct options *opts, int specified,
 	util_list_iterate(selected, sel) {
 		dev = NULL;
 		proc = 0;
+		defer = sel->st && defer_active_writes(opts, sel->st);
+
+		/* Devices of other subtypes might depend on the deferred
+		 * writes. */
+		if (!defer || util_list_len(jobs) >=
+			      (unsigned long) opts->jobs * JOBS_BATCH_FACTOR) {
+			rc = flush_write_jobs(opts, jobs, found_ptr);
+			if (rc && !drc)
+				drc = rc;
+		}
+
+		start = timing_device_begin();
 		rc = sel->rc;
 		if (rc) {
 			proc = 1;
@@ -1855,6 +1980,9 @@ static exit_code_t configure_devices(struct options *opts, int specified,
 			goto next;
 
 		/* Configure actual target device. */
+		job = util_list_end(jobs);
+		if (defer)
+			device_defer_active_writes(jobs);
 		if (opts->apply) {
 			rc = cfg_apply(sel->st, sel->id, 0, &dev, &proc,
 				       opts->auto_conf);
@@ -1862,8 +1990,19 @@ static exit_code_t configure_devices(struct options *opts, int specified,
 			rc = cfg_configure(sel->st, sel->id, opts, 0,
 					   0, &dev, &proc);
 		}
+		device_defer_active_writes(NULL);
+
+		/* Report the result after the queued writes were run. */
+		if (defer && proc &&
+		    defer_result(jobs, job, dev, sel, opts->config, &rc)) {
+			timing_device_end(sel->st, sel->id, "configure", start);
+			subtype_rem_combined(sel->st, dev, sel, selected);
+			continue;
+		}
 
 next:
+		timing_device_end(sel->st, sel->id, "configure", start);
+
 		/* Print results. */
 		rc = print_config_result(sel, dev, opts, opts->config, rc, 0,
 					 proc);
@@ -1883,8 +2022,12 @@ next:
 			subtype_rem_combined(sel->st, dev, sel, selected);
 		}
 	}
+	rc = flush_write_jobs(opts, jobs, found_ptr);
+	if (rc && !drc)
+		drc = rc;
 
 out:
+	util_list_free(jobs);
 	selected_dev_list_free(selected);
 
 	return drc ? drc : rc;
@@ -2025,6 +2168,7 @@ static exit_code_t deconfigure_devices(struct options *opts)
 	exit_code_t rc, drc = EXIT_OK;
 	int proc;
 	struct device *dev;
+	uint64_t start;
 
 	/* Determine list of selected devices. */
 	selected = selected_dev_list_new();
@@ -2042,6 +2186,7 @@ static exit_code_t deconfigure_devices(struct options *opts)
 	util_list_iterate(selected, sel) {
 		dev = NULL;
 		proc = 0;
+		start = timing_device_begin();
 
 		if (sel->rc) {
 			rc = EXIT_DEVICE_NOT_FOUND;
@@ -2054,6 +2199,8 @@ static exit_code_t deconfigure_devices(struct options *opts)
 					    &dev, &proc);
 
 next:
+		timing_device_end(sel->st, sel->id, "deconfigure", start);
+
 		/* Print results. */
 		rc = print_config_result(sel, dev, opts, opts->config, rc, 0,
 					 proc);
@@ -2671,12 +2818,17 @@ out:
 	return rc;
 }
 
-static exit_code_t import_device(struct device *dev, struct options *opts)
+/* Import configuration of device @dev. If @jobs is specified, writes of active
+ * settings are deferred to @jobs. */
+static exit_code_t import_device(struct device *dev, struct options *opts,
+				 struct util_list *jobs)
 {
 	struct subtype *st = dev->subtype;
+	struct device_write_job *job = NULL;
 	exit_code_t rc;
 	config_t config;
 	int proc = 0, active, persistent, autoconf;
+	uint64_t start;
 
 	if (SCOPE_ACTIVE(opts->config))
 		active = (dev->active.exists || dev->active.definable);
@@ -2696,15 +2848,28 @@ static exit_code_t import_device(struct device *dev, struct options *opts)
 		return EXIT_OK;
 	}
 	config = get_config(active, persistent, autoconf);
+	start = timing_device_begin();
 
 	/* First check for prerequisite devices that need to be configured. */
 	rc = cfg_prereqs(st, dev->id, opts, config, 0);
 	if (rc)
 		goto out;
 
+	if (jobs) {
+		job = util_list_end(jobs);
+		device_defer_active_writes(jobs);
+	}
 	rc = cfg_import(st, dev->id, config, 0, NULL, &proc);
+	device_defer_active_writes(NULL);
+
+	/* Report the result after the queued writes were run. */
+	if (jobs && proc && defer_result(jobs, job, dev, NULL, config, &rc)) {
+		timing_device_end(st, dev->id, "import", start);
+		return EXIT_OK;
+	}
 
 out:
+	timing_device_end(st, dev->id, "import", start);
 	rc = print_config_result(NULL, dev, opts, config, rc, 0, proc);
 
 	return rc;
@@ -2771,41 +2936,68 @@ static bool import_devtype_selected(struct devtype *dt, struct options *opts)
 	return true;
 }
 
-/* Remove export objects from @objects which are not matched by selection
- * options. */
-static void apply_selection_to_import(struct util_list *objects,
-				      struct options *opts)
-{
-	struct ptrlist_node *p, *n;
-	struct export_object *obj;
-
-	util_list_iterate_safe(objects, p, n) {
-		obj = p->ptr;
-		if (obj->type == export_device) {
-			if (import_device_selected(obj->ptr.dev, opts))
-				continue;
-		} else if (obj->type == export_devtype) {
-			if (import_devtype_selected(obj->ptr.dt, opts))
-				continue;
-		}
+/* struct import_data - State of an import
+ * @opts: Command line options
+ * @jobs: Deferred writes of active device settings
+ * @found: Set if any configuration object was read
+ * @selected: Set if any configuration object matched the selection options
+ * @drc: First non-zero exit code of applying configuration objects */
+struct import_data {
+	struct options *opts;
+	struct util_list *jobs;
+	int found;
+	int selected;
+	exit_code_t drc;
+};
 
-		util_list_remove(objects, p);
-		free(p->ptr);
-		free(p);
+/* Apply configuration object @obj if it is matched by selection options. */
+static void import_object(struct export_object *obj, void *data)
+{
+	struct import_data *imp = data;
+	struct options *opts = imp->opts;
+	struct device *dev = NULL;
+	exit_code_t rc = EXIT_OK;
+	int defer;
+
+	imp->found = 1;
+	if (obj->type == export_device) {
+		dev = obj->ptr.dev;
+		if (!import_device_selected(dev, opts))
+			return;
+	} else if (!import_devtype_selected(obj->ptr.dt, opts))
+		return;
+	imp->selected = 1;
+
+	/* Devices of other subtypes and device types might depend on the
+	 * deferred writes. */
+	defer = dev && defer_active_writes(opts, dev->subtype);
+	if (!defer || util_list_len(imp->jobs) >=
+		      (unsigned long) opts->jobs * JOBS_BATCH_FACTOR)
+		rc = flush_write_jobs(opts, imp->jobs, NULL);
+	if (rc && !imp->drc)
+		imp->drc = rc;
+
+	/* An object may occur again further down in the input. */
+	if (dev) {
+		dev->processed = 0;
+		rc = import_device(dev, opts, defer ? imp->jobs : NULL);
+	} else {
+		obj->ptr.dt->processed = 0;
+		rc = import_devtype(obj->ptr.dt, opts->config);
 	}
+	if (rc && !imp->drc)
+		imp->drc = rc;
 }
 
-/* Import configuration data. */
+/* Import configuration data. Objects are applied while the input is read. */
 static exit_code_t do_import(struct options *opts)
 {
 	FILE *fd;
-	exit_code_t rc;
-	struct util_list *objects;
+	exit_code_t rc, rc2;
+	struct util_list *objects = NULL;
 	struct ptrlist_node *p;
-	struct export_object *obj;
-	exit_code_t drc = EXIT_OK;
+	struct import_data imp;
 	const char *filename;
-	int found;
 	bool is_firmware;
 
 	/* Open input stream. */
@@ -2827,20 +3019,30 @@ static exit_code_t do_import(struct options *opts)
 	info("Importing data from %s%s\n", filename,
 	     is_firmware ? " (firmware format)" : "");
 
-	/* Read data. */
-	objects = ptrlist_new();
-	if (is_firmware)
+	memset(&imp, 0, sizeof(imp));
+	imp.opts = opts;
+	imp.jobs = util_list_new(struct device_write_job, node);
+
+	/* Read and apply data. */
+	if (is_firmware) {
+		objects = ptrlist_new();
 		rc = firmware_read(fd, filename, -1, opts->config, objects);
-	else
-		rc = export_read(fd, filename, objects);
+		if (rc == EXIT_OK) {
+			util_list_iterate(objects, p)
+				import_object(p->ptr, &imp);
+		}
+	} else
+		rc = export_read(fd, filename, import_object, &imp);
+
+	/* Report results of remaining deferred writes. */
+	rc2 = flush_write_jobs(opts, imp.jobs, NULL);
+	if (rc2 && !imp.drc)
+		imp.drc = rc2;
 	if (rc)
 		goto out;
 
-	found = !util_list_is_empty(objects);
-	apply_selection_to_import(objects, opts);
-
-	if (util_list_is_empty(objects)) {
-		if (found) {
+	if (!imp.selected) {
+		if (imp.found) {
 			error("%s: Imported configuration data did not match "
 			      "selection\n", filename);
 			rc = EXIT_EMPTY_SELECTION;
@@ -2848,26 +3050,16 @@ static exit_code_t do_import(struct options *opts)
 			info("%s: No settings found to import\n", filename);
 			rc = EXIT_OK;
 		}
-		goto out;
-	}
-
-	util_list_iterate(objects, p) {
-		obj = p->ptr;
-		if (obj->type == export_devtype)
-			rc = import_devtype(obj->ptr.dt, opts->config);
-		else
-			rc = import_device(obj->ptr.dev, opts);
-		if (rc && !drc)
-			drc = rc;
 	}
 
 out:
+	util_list_free(imp.jobs);
 	ptrlist_free(objects, 1);
 	/* Close stream. */
 	if (fd != stdin)
 		fclose(fd);
 
-	return drc ? drc : rc;
+	return imp.drc ? imp.drc : rc;
 }
 
 static bool opts_stdout_data(struct options *opts)
@@ -2949,7 +3141,7 @@ static exit_code_t do_apply(struct options *opts)
 
 int main(int argc, char *argv[])
 {
-	exit_code_t rc, drc = EXIT_OK;
+	exit_code_t rc, rc2, drc = EXIT_OK;
 	struct options opts;
 
 	debug_init(argc, argv);
@@ -2975,7 +3167,10 @@ int main(int argc, char *argv[])
 	yes	= opts.yes;
 	dryrun	= opts.dryrun;
 	udev_no_settle = opts.no_settle;
+	udev_batch_rules = !dryrun;
+	timing_enabled = opts.timing;
 	path_set_base(opts.base);
+	timing_init();
 
 	if (dryrun)
 		info("Starting dry-run, configuration will not be changed\n");
@@ -3014,6 +3209,11 @@ int main(int argc, char *argv[])
 		break;
 	}
 
+	/* Write udev rules collected during the main action. */
+	rc2 = udev_flush_rules();
+	if (rc2 && !rc)
+		rc = rc2;
+
 	if (rc) {
 		if (!drc)
 			drc = rc;
@@ -3035,6 +3235,7 @@ int main(int argc, char *argv[])
 out:
 	/* Write out any remaining messages. */
 	delayed_print(0);
+	timing_print();
 
 	/* Clean-up. */
 	free_options(&opts);
@@ -3046,11 +3247,13 @@ out:
 	inuse_exit();
 	misc_exit();
 	module_exit();
+	timing_exit();
 	rc = namespace_exit();
 	if (rc && !drc)
 		drc = rc;
 	path_exit();
 	scsi_exit();
+	udev_exit();
 
 	if (found_forceable && !force) {
 		info("Note: You can use --force to override safety checks "
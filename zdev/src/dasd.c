@@ -637,6 +637,7 @@ struct subtype dasd_subtype_eckd = {
 		&internal_attr_early,
 	),
 	.unknown_dev_attribs	= 1,
+	.parallel_active	= 1,
 
 	.check_pre_configure	= &dasd_st_check_pre_configure,
 	.add_modules		= &dasd_st_add_modules,
@@ -673,6 +674,7 @@ struct subtype dasd_subtype_fba = {
 		&internal_attr_early,
 	),
 	.unknown_dev_attribs	= 1,
+	.parallel_active	= 1,
 
 	.check_pre_configure	= &dasd_st_check_pre_configure,
 	.add_modules		= &dasd_st_add_modules,
@@ -7,11 +7,14 @@
  * it under the terms of the MIT license. See LICENSE for details.
  */
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
+#include "lib/util_libc.h"
 #include "lib/util_path.h"
 
 #include "attrib.h"
@@ -483,6 +486,34 @@ out:
 	return names;
 }
 
+/* Add the paths of all attributes that are read according to @scope for the
+ * device with ID @id of subtype @st to strlist @paths. */
+void device_add_active_attrib_paths(struct subtype *st, const char *id,
+				    read_scope_t scope, struct util_list *paths)
+{
+	struct util_list *names;
+	struct strlist_node *str;
+	struct device *dev;
+	char *path;
+
+	dev = device_new(st, id);
+	if (!dev)
+		return;
+	names = get_attrib_names(dev, scope);
+	util_list_iterate(names, str) {
+		if (strcmp(str->str, "uevent") == 0 ||
+		    ends_with(str->str, "/uevent"))
+			continue;
+		path = subtype_get_active_attrib_path(st, dev, str->str);
+		if (!path)
+			continue;
+		strlist_add(paths, "%s", path);
+		free(path);
+	}
+	strlist_free(names);
+	device_free(dev);
+}
+
 /* Read settings according to @scope for device @dev from active
  * configuration and add them to dev->active.settings. */
 void device_read_active_settings(struct device *dev, read_scope_t scope)
@@ -542,9 +573,75 @@ next:
 	strlist_free(names);
 }
 
+/* List of struct device_write_job for deferred active writes or %NULL. */
+static struct util_list *write_jobs;
+
+/* Add a write of @value to the attribute at @path to @job if needed. */
+static void job_add_write(struct device_write_job *job, const char *path,
+			  struct setting *s, const char *value)
+{
+	char *text;
+
+	text = setting_get_write_text(path, s, value);
+	if (!text)
+		return;
+	job->paths = util_realloc(job->paths, sizeof(char *) * (job->num + 1));
+	job->texts = util_realloc(job->texts, sizeof(char *) * (job->num + 1));
+	job->paths[job->num] = misc_strdup(path);
+	job->texts[job->num] = text;
+	job->num++;
+}
+
+/* Queue the writes of modified settings in @dev->active.settings in the
+ * order defined by @list as job to the list of deferred writes. */
+static exit_code_t queue_active_settings(struct device *dev,
+					 struct util_list *list)
+{
+	struct subtype *st = dev->subtype;
+	struct device_write_job *job;
+	struct strlist_node *str;
+	struct ptrlist_node *p;
+	struct setting *s;
+	char *path;
+
+	job = misc_malloc(sizeof(struct device_write_job));
+	job->dev = dev;
+
+	util_list_iterate(list, p) {
+		s = p->ptr;
+		if (!s->modified || s->removed)
+			continue;
+		if ((s->attrib && s->attrib->internal) ||
+		    internal_by_name(s->name))
+			continue;
+
+		path = subtype_get_active_attrib_path(st, dev, s->name);
+		if (!path) {
+			delayed_err("Could not determine path for attribute "
+				    "'%s'\n", s->name);
+			device_write_job_free(job);
+			return EXIT_SETTING_NOT_FOUND;
+		}
+		if (s->values) {
+			util_list_iterate(s->values, str)
+				job_add_write(job, path, s, str->str);
+		} else
+			job_add_write(job, path, s, s->value);
+		free(path);
+	}
+
+	if (job->num > 0)
+		util_list_add_tail(write_jobs, job);
+	else
+		device_write_job_free(job);
+
+	return EXIT_OK;
+}
+
 /* Apply modified settings in @dev->active.settings to active configuration.
  * Abort on first error. This requires that @dev defines
- * get_active_attrib_path. */
+ * get_active_attrib_path. If deferred writes were enabled, only queue the
+ * writes. */
 exit_code_t device_write_active_settings(struct device *dev)
 {
 	struct subtype *st = dev->subtype;
@@ -557,6 +654,11 @@ exit_code_t device_write_active_settings(struct device *dev)
 	/* Get order of applying attributes. */
 	list = setting_list_get_sorted(dev->active.settings);
 
+	if (write_jobs) {
+		rc = queue_active_settings(dev, list);
+		goto out;
+	}
+
 	/* Apply settings in order. */
 	util_list_iterate(list, p) {
 		s = p->ptr;
@@ -579,6 +681,7 @@ exit_code_t device_write_active_settings(struct device *dev)
 			break;
 	}
 
+out:
 	ptrlist_free(list, 0);
 
 	/* Changing device configuration could generate uevents. */
@@ -587,6 +690,106 @@ exit_code_t device_write_active_settings(struct device *dev)
 	return rc;
 }
 
+/* Enable deferred writes of active settings: device_write_active_settings()
+ * adds a struct device_write_job to @jobs instead of writing to sysfs. Pass
+ * %NULL to write settings immediately again. */
+void device_defer_active_writes(struct util_list *jobs)
+{
+	write_jobs = jobs;
+}
+
+/* Perform the writes of @job in order and stop at the first error. This
+ * function does not print messages so that it can be run in a separate
+ * thread. */
+exit_code_t device_write_job_run(struct device_write_job *job)
+{
+	int i;
+
+	job->rc = EXIT_OK;
+	for (i = 0; i < job->num; i++) {
+		if (misc_write_text_file_retry(job->paths[i], job->texts[i],
+					       err_ignore)) {
+			job->rc = EXIT_SETTING_FAILED;
+			job->failed = i;
+			job->err = errno;
+			break;
+		}
+	}
+
+	return job->rc;
+}
+
+struct write_jobs_ctx {
+	pthread_mutex_t lock;
+	struct util_list *jobs;
+	struct device_write_job *next;
+};
+
+static void *write_jobs_thread(void *data)
+{
+	struct write_jobs_ctx *ctx = data;
+	struct device_write_job *job;
+
+	while (1) {
+		pthread_mutex_lock(&ctx->lock);
+		job = ctx->next;
+		if (job)
+			ctx->next = util_list_next(ctx->jobs, job);
+		pthread_mutex_unlock(&ctx->lock);
+		if (!job)
+			break;
+		device_write_job_run(job);
+	}
+
+	return NULL;
+}
+
+/* Run all struct device_write_jobs in list @jobs using up to @num_threads
+ * threads. Jobs of different devices are run in parallel while the writes
+ * of each job are performed in order. */
+void device_write_jobs_run(struct util_list *jobs, int num_threads)
+{
+	struct write_jobs_ctx ctx;
+	pthread_t *threads;
+	int i, started = 0;
+
+	pthread_mutex_init(&ctx.lock, NULL);
+	ctx.jobs = jobs;
+	ctx.next = util_list_start(jobs);
+
+	/* The calling thread also processes jobs. */
+	if (num_threads > (int) util_list_len(jobs))
+		num_threads = util_list_len(jobs);
+	threads = misc_malloc(sizeof(pthread_t) * (num_threads + 1));
+	for (i = 1; i < num_threads; i++) {
+		if (pthread_create(&threads[started], NULL, write_jobs_thread,
+				   &ctx))
+			break;
+		started++;
+	}
+	write_jobs_thread(&ctx);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	pthread_mutex_destroy(&ctx.lock);
+}
+
+void device_write_job_free(struct device_write_job *job)
+{
+	int i;
+
+	if (!job)
+		return;
+	for (i = 0; i < job->num; i++) {
+		free(job->paths[i]);
+		free(job->texts[i]);
+	}
+	free(job->paths);
+	free(job->texts);
+	free(job);
+}
+
 /* Check if there are any conflicts in the settings list of @dev for the
  * specified configuration. */
 exit_code_t device_check_settings(struct device *dev, config_t config,
@@ -532,19 +532,37 @@ static bool check_section(const char *filename, int lineno,
 	return true;
 }
 
-/* Read configuration objects from @fd. Add pointer to newly allocated
- * struct export_objects to ptrlist @objects. */
-exit_code_t export_read(FILE *fd, const char *filename,
-			struct util_list *objects)
+/* Pass the object for device type @dt or device @dev to @cb. */
+static void emit_object(struct devtype *dt, struct device *dev,
+			export_cb_t cb, void *data)
+{
+	struct export_object obj;
+
+	if (dt) {
+		obj.type = export_devtype;
+		obj.ptr.dt = dt;
+	} else if (dev) {
+		obj.type = export_device;
+		obj.ptr.dev = dev;
+	} else
+		return;
+	cb(&obj, data);
+}
+
+/* Read configuration objects from @fd. Call @cb with @data for each object
+ * as soon as all of its consecutive sections have been read, so that large
+ * files can be processed without keeping all objects in memory. */
+exit_code_t export_read(FILE *fd, const char *filename, export_cb_t cb,
+			void *data)
 {
 	char *line, *l, *key, *value;
 	struct export_header *hdr;
 	size_t end;
 	exit_code_t rc = EXIT_OK;
-	struct devtype *dt;
+	struct devtype *dt, *prev_dt;
 	int lineno;
 	config_t config = config_all;
-	struct device *dev;
+	struct device *dev, *prev_dev;
 
 	lineno = 0;
 	line = NULL;
@@ -567,16 +585,14 @@ exit_code_t export_read(FILE *fd, const char *filename,
 			}
 			/* Found [<config> <subtype> <devid>] or
 			 * [<config> <devtype>]. */
+			prev_dt = dt;
+			prev_dev = dev;
 			rc = handle_header(filename, lineno, hdr, &dt, &dev);
 			config = hdr->config;
 			header_free(hdr);
-			if (dt) {
-				ptrlist_add(objects, object_new(export_devtype,
-								dt));
-			} else if (dev) {
-				ptrlist_add(objects, object_new(export_device,
-								dev));
-			}
+			/* Sections for the same object are combined. */
+			if (rc == EXIT_OK && (dt != prev_dt || dev != prev_dev))
+				emit_object(prev_dt, prev_dev, cb, data);
 		} else if (parse_setting(l, &key, &value)) {
 			/* Found <key>=<value>. */
 			if (!dt && !dev) {
@@ -607,5 +623,10 @@ err:
 	if (rc)
 		return rc;
 
-	return ferror(fd) ? EXIT_RUNTIME_ERROR : EXIT_OK;
+	if (ferror(fd))
+		return EXIT_RUNTIME_ERROR;
+
+	emit_object(dt, dev, cb, data);
+
+	return EXIT_OK;
 }
@@ -188,6 +188,7 @@ static struct subtype generic_ccw_subtype = {
 	),
 	.unknown_dev_attribs	= 1,
 	.generic		= 1,
+	.parallel_active	= 1,
 
 	.exists_active		= &generic_ccw_st_exists_active,
 	.add_active_ids		= &generic_ccw_st_add_active_ids,
@@ -69,14 +69,44 @@ void hash_free(struct hash *hash, void (*free_fn)(void *))
 	free(hash);
 }
 
+static int get_bucket(struct hash *hash, const void *id)
+{
+	return hash->get_hash(id) % (unsigned int) hash->buckets;
+}
+
+/* Double the number of buckets and redistribute all entries. */
+static void resize(struct hash *hash)
+{
+	void *entry;
+	int i;
+
+	for (i = 0; i < hash->buckets; i++)
+		ptrlist_free(hash->hash[i], 0);
+	free(hash->hash);
+
+	hash->buckets *= 2;
+	hash->hash = misc_malloc(sizeof(struct util_list) * hash->buckets);
+	for (i = 0; i < hash->buckets; i++)
+		hash->hash[i] = ptrlist_new();
+
+	util_list_iterate(&hash->list, entry)
+		ptrlist_add(hash->hash[get_bucket(hash, hash->get_id(entry))],
+			    entry);
+}
+
 /* Add a new entry to the hash. */
 void hash_add(struct hash *hash, void *entry)
 {
 	int bucket;
 
 	util_list_add_tail(&hash->list, entry);
+	hash->entries++;
 	if (hash->buckets > 0) {
-		bucket = hash->get_hash(hash->get_id(entry));
+		if (hash->entries > hash->buckets * HASH_MAX_LOAD) {
+			resize(hash);
+			return;
+		}
+		bucket = get_bucket(hash, hash->get_id(entry));
 		ptrlist_add(hash->hash[bucket], entry);
 	}
 }
@@ -87,8 +117,9 @@ void hash_remove(struct hash *hash, void *entry)
 	int bucket;
 
 	util_list_remove(&hash->list, entry);
+	hash->entries--;
 	if (hash->buckets > 0) {
-		bucket = hash->get_hash(hash->get_id(entry));
+		bucket = get_bucket(hash, hash->get_id(entry));
 		ptrlist_remove(hash->hash[bucket], entry);
 	}
 }
@@ -100,6 +131,7 @@ void hash_print(struct hash *hash, int ind)
 	indent(ind, "hash at %p\n", hash);
 	ind += 2;
 	indent(ind, "buckets=%d\n", hash->buckets);
+	indent(ind, "entries=%d\n", hash->entries);
 	indent(ind, "get_id=%p\n", hash->get_id);
 	indent(ind, "cmp_id=%p\n", hash->cmp_id);
 	indent(ind, "get_hash=%p\n", hash->get_hash);
@@ -110,6 +142,24 @@ void hash_print(struct hash *hash, int ind)
 	}
 }
 
+/* Compare two string IDs. */
+int hash_cmp_str(const void *a, const void *b)
+{
+	return strcmp(a, b);
+}
+
+/* Return hash value for a string ID. */
+unsigned int hash_str(const void *id)
+{
+	const unsigned char *c;
+	unsigned int h = 5381;
+
+	for (c = id; *c; c++)
+		h = h * 33 + *c;
+
+	return h;
+}
+
 /* Find entry by ID. @cmp_fn compares two IDs and returns 0 when IDs match. */
 void *hash_find_by_id(struct hash *hash, const void *id)
 {
@@ -117,7 +167,7 @@ void *hash_find_by_id(struct hash *hash, const void *id)
 	struct ptrlist_node *p;
 
 	if (hash->buckets > 0) {
-		bucket = hash->get_hash(id);
+		bucket = get_bucket(hash, id);
 		util_list_iterate(hash->hash[bucket], p) {
 			if (hash->cmp_id(hash->get_id(p->ptr), id) == 0)
 				return p->ptr;
@@ -15,64 +15,76 @@
 #include "blkinfo.h"
 #include "device.h"
 #include "devnode.h"
+#include "hash.h"
 #include "inuse.h"
 #include "misc.h"
 #include "path.h"
 #include "select.h"
 #include "subtype.h"
 
-/* struct resource - A resource that is currently in use
- * @st: Subtype of device providing resource
- * @id: ID of device providing resource
- * @name: Name of the resource, e.g. the mount point. */
+#define RESOURCE_BUCKETS	64
+
+/* struct resource - Resources that are currently in use
+ * @node: Entry in resource hash
+ * @key: Subtype name and ID of device providing resources
+ * @names: strlist of names of the resources, e.g. the mount points. */
 struct resource {
-	struct subtype *st;
-	char *id;
-	char *name;
+	struct util_list_node node;
+	char *key;
+	struct util_list *names;
 };
 
-/* ptrlist of struct resources. */
-static struct util_list *resources;
+/* Hash of struct resources indexed by subtype and device ID. */
+static struct hash *resources;
 
-/* Return a newly allocated struct resource. */
-static struct resource *resource_new(struct subtype *st, const char *id,
-				     const char *name)
+static char *get_key(struct subtype *st, const char *id)
 {
-	struct resource *res;
+	return misc_asprintf("%s %s", st->name, id);
+}
 
-	res = misc_malloc(sizeof(struct resource));
-	res->st = st;
-	res->id = misc_strdup(id);
-	res->name = misc_strdup(name);
+static const void *resource_get_id(void *ptr)
+{
+	struct resource *res = ptr;
 
-	return res;
+	return res->key;
 }
 
-/* Release all resources associated with @res. */
-static void resource_free(struct resource *res)
+/* Release all resources associated with @ptr. */
+static void resource_free(void *ptr)
 {
-	if (!res)
-		return;
-	free(res->id);
-	free(res->name);
+	struct resource *res = ptr;
+
+	free(res->key);
+	strlist_free(res->names);
 	free(res);
 }
 
 /* Release all allocated resources. */
 void inuse_exit(void)
 {
-	struct ptrlist_node *p, *n;
-	struct resource *res;
-
 	if (!resources)
 		return;
-	util_list_iterate_safe(resources, p, n) {
-		util_list_remove(resources, p);
-		res = p->ptr;
-		resource_free(res);
-		free(p);
-	}
-	free(resources);
+	hash_free(resources, resource_free);
+	resources = NULL;
+}
+
+/* Record that resource @name is provided by device @id of subtype @st. */
+static void resource_add(struct hash *hash, struct subtype *st,
+			 const char *id, const char *name)
+{
+	struct resource *res;
+	char *key;
+
+	key = get_key(st, id);
+	res = hash_find_by_id(hash, key);
+	if (!res) {
+		res = misc_malloc(sizeof(struct resource));
+		res->key = key;
+		res->names = strlist_new();
+		hash_add(hash, res);
+	} else
+		free(key);
+	strlist_add_unique(res->names, "%s", name);
 }
 
 /* Return newly allocated strlist containing names of mountpoints for all
@@ -111,11 +123,10 @@ out:
 	return list;
 }
 
-static void add_mounts(struct util_list *list)
+static void add_mounts(struct hash *hash)
 {
 	struct util_list *mountpoints;
 	struct strlist_node *mp;
-	struct resource *res;
 	struct util_list *selected;
 	struct selected_dev_node *sel;
 	char *r;
@@ -136,9 +147,8 @@ static void add_mounts(struct util_list *list)
 				continue;
 
 			r = misc_asprintf("Mount point %s", mp->str);
-			res = resource_new(sel->st, sel->id, r);
+			resource_add(hash, sel->st, sel->id, r);
 			free(r);
-			ptrlist_add(list, res);
 
 			/* Expand list to also contain prereq-devices. */
 			subtype_add_prereqs(sel->st, sel->id, selected);
@@ -192,12 +202,11 @@ out:
 	return list;
 }
 
-static void add_swap(struct util_list *list)
+static void add_swap(struct hash *hash)
 {
 	struct util_list *swapdevs;
 	struct ptrlist_node *swap;
 	struct devnode *devnode;
-	struct resource *res;
 	struct util_list *selected;
 	struct selected_dev_node *sel;
 	char *r;
@@ -220,9 +229,8 @@ static void add_swap(struct util_list *list)
 				continue;
 
 			r = misc_asprintf("Swap device %s", devnode->name);
-			res = resource_new(sel->st, sel->id, r);
+			resource_add(hash, sel->st, sel->id, r);
 			free(r);
-			ptrlist_add(list, res);
 
 			/* Expand list to also contain prereq-devices. */
 			subtype_add_prereqs(sel->st, sel->id, selected);
@@ -236,52 +244,70 @@ next:
 }
 
 
-/* Determine IPv4 and IPv6 addresses of networking interface @name. */
-static void add_ip_addresses(struct util_list *addrs, const char *name)
+/* Return the output of "ip address show" for all networking interfaces in
+ * one-line format. */
+static char *get_ip_addresses(void)
 {
-	char *cmd, *text, *next, *curr, **argv;
-	int argc;
+	char *cmd, *text;
 
-	cmd = misc_asprintf("%s address show %s 2>/dev/null", PATH_IP, name);
+	cmd = misc_asprintf("%s -o address show 2>/dev/null", PATH_IP);
 	text = misc_read_cmd_output(cmd, 0, err_ignore);
-	if (!text)
-		goto out;
+	free(cmd);
 
-	next = text;
+	return text;
+}
+
+/* Determine IPv4 and IPv6 addresses of networking interface @name from
+ * @text. */
+static void add_ip_addresses(struct util_list *addrs, const char *text,
+			     const char *name)
+{
+	char *copy, *next, *curr, *at, **argv;
+	int argc;
+
+	copy = misc_strdup(text);
+	next = copy;
 	while ((curr = strsep(&next, "\n"))) {
+		/* Format: <index>: <name> inet|inet6 <address> ... */
 		line_split(curr, &argc, &argv);
-		if (argc < 2)
+		if (argc < 4)
+			goto next;
+		at = strchr(argv[1], '@');
+		if (at)
+			*at = 0;
+		if (strcmp(argv[1], name) != 0)
 			goto next;
-		if (strcmp(argv[0], "inet") == 0)
-			strlist_add(addrs, "IPv4 address %s", argv[1]);
-		else if (strcmp(argv[0], "inet6") == 0)
-			strlist_add(addrs, "IPv6 address %s", argv[1]);
+		if (strcmp(argv[2], "inet") == 0)
+			strlist_add(addrs, "IPv4 address %s", argv[3]);
+		else if (strcmp(argv[2], "inet6") == 0)
+			strlist_add(addrs, "IPv6 address %s", argv[3]);
 next:
 		line_free(argc, argv);
-
 	}
-
-out:
-	free(text);
-	free(cmd);
+	free(copy);
 }
 
-/* Add struct resources to @list for each device providing an interface with
+/* Add struct resources to @hash for each device providing an interface with
  * IP address. */
-static void add_network(struct util_list *list)
+static void add_network(struct hash *hash)
 {
-	char *path;
+	char *path, *text;
 	struct util_list *interfaces, *addrs, *selected;
 	struct strlist_node *net, *addr;
 	struct selected_dev_node *sel;
-	struct resource *res;
 
 	path = path_get_sys_class("net", NULL);
 	interfaces = strlist_new();
+	text = NULL;
 
 	if (!misc_read_dir(path, interfaces, NULL, NULL))
 		goto out;
 
+	/* Determine IP addresses of all interfaces at once. */
+	text = get_ip_addresses();
+	if (!text)
+		goto out;
+
 	/* Process all known networking interfaces. */
 	util_list_iterate(interfaces, net) {
 		/* Skip loopback. */
@@ -292,7 +318,7 @@ static void add_network(struct util_list *list)
 
 		/* Determine IP addresses. */
 		addrs = strlist_new();
-		add_ip_addresses(addrs, net->str);
+		add_ip_addresses(addrs, text, net->str);
 		if (util_list_is_empty(addrs))
 			goto next;
 
@@ -309,10 +335,8 @@ static void add_network(struct util_list *list)
 				continue;
 
 			/* Add one resource per IP address provided. */
-			util_list_iterate(addrs, addr) {
-				res = resource_new(sel->st, sel->id, addr->str);
-				ptrlist_add(list, res);
-			}
+			util_list_iterate(addrs, addr)
+				resource_add(hash, sel->st, sel->id, addr->str);
 
 			/* Expand list to also contain prereq-devices. */
 			subtype_add_prereqs(sel->st, sel->id, selected);
@@ -324,31 +348,33 @@ next:
 	}
 
 out:
+	free(text);
 	strlist_free(interfaces);
 	free(path);
 }
 
-/* Return a ptrlist of struct resources of Linux devices which are in use
+/* Return a hash of struct resources of Linux devices which are in use
  * by the system. The following devices are considered:
  *  - block devices providing a mounted file system
  *  - block devices providing swap space
  *  - networking interfaces providing an IP address. */
-static struct util_list *get_resources(void)
+static struct hash *get_resources(void)
 {
-	struct util_list *list;
+	struct hash *hash;
 
-	list = ptrlist_new();
+	hash = hash_new(RESOURCE_BUCKETS, resource_get_id, hash_cmp_str,
+			hash_str, struct resource, node);
 
 	/* Add all devices providing mounted file systems. */
-	add_mounts(list);
+	add_mounts(hash);
 
 	/* Add all devices providing swap space. */
-	add_swap(list);
+	add_swap(hash);
 
 	/* Add all devices providing networking interfaces in the up state. */
-	add_network(list);
+	add_network(hash);
 
-	return list;
+	return hash;
 }
 
 /* Return a strlist of names of resources that are provided by device @dev
@@ -357,29 +383,23 @@ struct util_list *inuse_get_resources(struct device *dev)
 {
 	struct subtype *st = dev->subtype;
 	struct resource *res;
-	struct ptrlist_node *p;
-	struct util_list *list;
+	char *key;
 
 	/* Filter out offline devices. */
 	if (subtype_online_get(st, dev, config_active) != 1)
 		return NULL;
 
-	/* Match device against list of devices that are in use. */
+	/* Determine devices that are in use once per invocation. */
 	if (!resources)
 		resources = get_resources();
 
-	list = strlist_new();
-	util_list_iterate(resources, p) {
-		res = p->ptr;
-		if (res->st == dev->subtype && strcmp(res->id, dev->id) == 0)
-			strlist_add_unique(list, "%s", res->name);
-	}
+	key = get_key(st, dev->id);
+	res = hash_find_by_id(resources, key);
+	free(key);
 
 	/* Make handling of empty lists easier for caller. */
-	if (util_list_is_empty(list)) {
-		strlist_free(list);
-		list = NULL;
-	}
+	if (!res || util_list_is_empty(res->names))
+		return NULL;
 
-	return list;
+	return strlist_copy(res->names);
 }
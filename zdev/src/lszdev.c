@@ -31,6 +31,8 @@
 #include "subtype.h"
 #include "table.h"
 #include "table_types.h"
+#include "timing.h"
+#include "udev.h"
 
 /* Main program action. */
 typedef enum {
@@ -66,6 +68,7 @@ struct options {
 	unsigned int pairs:1;
 	unsigned int verbose:1;
 	unsigned int quiet:1;
+	unsigned int timing:1;
 };
 
 /* Makefile converts lszdev_usage.txt into C file which we include here. */
@@ -100,6 +103,7 @@ enum {
 	OPT_QUIET		= 'q',
 	OPT_PAIRS		= 'P',
 	OPT_AUTO_CONF		= (OPT_ANONYMOUS_BASE+__COUNTER__),
+	OPT_TIMING		= (OPT_ANONYMOUS_BASE+__COUNTER__),
 };
 
 static struct opts_conflict conflict_list[] = {
@@ -159,6 +163,7 @@ static const struct option opt_list[] = {
 	{ "pairs",		no_argument,	NULL, OPT_PAIRS },
 	{ "verbose",		no_argument,	NULL, OPT_VERBOSE },
 	{ "quiet",		no_argument,	NULL, OPT_QUIET },
+	{ "timing",		no_argument,	NULL, OPT_TIMING },
 	{ NULL,			no_argument,	NULL, 0 },
 };
 
@@ -661,6 +666,11 @@ static exit_code_t parse_options(struct options *opts, int argc, char *argv[])
 			opts->quiet = 1;
 			break;
 
+		case OPT_TIMING:
+			/* --timing */
+			opts->timing = 1;
+			break;
+
 		case ':':
 			/* Missing option argument. */
 			syntax("Option '%s' requires an argument\n",
@@ -992,6 +1002,30 @@ static read_scope_t get_scope(struct options *opts)
 	return scope_mandatory;
 }
 
+/* Number of threads used to read device attributes in parallel. */
+#define PREFETCH_THREADS	16
+
+/* Read the active attributes of all selected devices in parallel to speed
+ * up subsequent sequential processing. */
+static void prefetch_attribs(struct util_list *selected, config_t config,
+			     read_scope_t scope)
+{
+	struct selected_dev_node *sel;
+	struct util_list *paths;
+
+	if (!SCOPE_ACTIVE(config) || util_list_len(selected) < 2)
+		return;
+
+	paths = strlist_new();
+	util_list_iterate(selected, sel) {
+		if (sel->rc || !sel->st)
+			continue;
+		device_add_active_attrib_paths(sel->st, sel->id, scope, paths);
+	}
+	misc_prefetch_text_files(paths, PREFETCH_THREADS);
+	strlist_free(paths);
+}
+
 /* Build list of items in table from list of selected struct devices. */
 static struct util_list *dev_table_build(struct options *opts,
 					 exit_code_t *rc_ptr)
@@ -1003,6 +1037,7 @@ static struct util_list *dev_table_build(struct options *opts,
 	read_scope_t scope;
 	exit_code_t rc;
 	config_t config = opts->config;
+	uint64_t start;
 
 	scope = get_scope(opts);
 	selected = selected_dev_list_new();
@@ -1017,13 +1052,17 @@ static struct util_list *dev_table_build(struct options *opts,
 	if (rc)
 		goto out;
 	devices = ptrlist_new();
+	prefetch_attribs(selected, opts->config, scope);
 
 	/* Process selected devices. */
 	util_list_iterate(selected, sel) {
 		if (sel->rc)
 			continue;
-		if (subtype_read_device(sel->st, sel->id, opts->config, scope,
-					&dev))
+		start = timing_device_begin();
+		rc = subtype_read_device(sel->st, sel->id, opts->config, scope,
+					 &dev);
+		timing_device_end(sel->st, sel->id, "read", start);
+		if (rc)
 			continue;
 
 		if (dev->processed)
@@ -1486,6 +1525,7 @@ static exit_code_t do_info_devices(struct options *opts)
 	exit_code_t rc, drc = EXIT_OK;
 	read_scope_t scope;
 	config_t config = opts->config;
+	uint64_t start;
 
 	if (opts->info > 1)
 		scope = scope_all;
@@ -1508,8 +1548,10 @@ static exit_code_t do_info_devices(struct options *opts)
 	util_list_iterate(selected, sel) {
 		if (sel->rc)
 			continue;
+		start = timing_device_begin();
 		rc = subtype_read_device(sel->st, sel->id, opts->config,
 					 scope, &dev);
+		timing_device_end(sel->st, sel->id, "read", start);
 		if (rc) {
 			if (!drc)
 				drc = rc;
@@ -1558,7 +1600,9 @@ int main(int argc, char *argv[])
 	/* Set globals. */
 	verbose		= opts.verbose;
 	quiet		= opts.quiet;
+	timing_enabled	= opts.timing;
 	path_set_base(opts.base);
+	timing_init();
 	if (opts.pairs)
 		set_stdout_data();
 
@@ -1601,6 +1645,7 @@ int main(int argc, char *argv[])
 out:
 	/* Write out any remaining messages. */
 	delayed_print(0);
+	timing_print();
 
 	/* Clean-up. */
 	free_options(&opts);
@@ -1612,11 +1657,13 @@ out:
 	inuse_exit();
 	misc_exit();
 	module_exit();
+	timing_exit();
 	rc = namespace_exit();
 	if (rc && !drc)
 		drc = rc;
 	path_exit();
 	scsi_exit();
+	udev_exit();
 
 	return drc ? drc : rc;
 }
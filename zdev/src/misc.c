@@ -12,6 +12,7 @@
 #include <errno.h>
 #include <execinfo.h>
 #include <limits.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdint.h>
@@ -26,11 +27,15 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "lib/util_scandir.h"
+
 #include "dasd.h"
 #include "device.h"
 #include "devtype.h"
+#include "hash.h"
 #include "misc.h"
 #include "path.h"
+#include "timing.h"
 
 #define DRYRUN_HEADER_BEGIN	((char) 0x01)
 #define DRYRUN_HEADER_END	((char) 0x02)
@@ -243,10 +248,14 @@ static void dryrun_print(void)
 	free(txt);
 }
 
+static void text_cache_free(void);
+static void text_cache_invalidate(void);
+
 void misc_exit(void)
 {
 	strlist_free(delayed_messages);
 	strlist_free(warn_once_messages);
+	text_cache_free();
 	if (dryrun_file) {
 		if (verbose)
 			dryrun_print();
@@ -520,6 +529,7 @@ int misc_system(err_t err, const char *fmt, ...)
 	}
 
 	debug("Running command: %s\n", cmd);
+	text_cache_invalidate();
 	rc = system(cmd);
 	debug("rc=%d\n", rc);
 
@@ -569,34 +579,34 @@ exit_code_t misc_mktemp(char **filename, int *fd)
 	return EXIT_OK;
 }
 
+struct read_dir_cb_data {
+	struct util_list *list;
+	bool (*filter)(const char *, void *);
+	void *data;
+};
+
+/* Add a directory entry to the strlist if it passes the filter. */
+static int read_dir_cb(const struct dirent *de, void *data)
+{
+	struct read_dir_cb_data *cb_data = data;
+
+	if (!cb_data->filter || cb_data->filter(de->d_name, cb_data->data))
+		strlist_add(cb_data->list, de->d_name);
+
+	return 0;
+}
+
 /* Read a directory and add all contained filenames except . and .. to strlist
  * LIST. Apply FILTER callback to filenames if supplied. */
 bool misc_read_dir(const char *path, struct util_list *list,
 		   bool (*filter)(const char *, void *), void *data)
 {
-	DIR *dir;
-	struct dirent *de;
+	struct read_dir_cb_data cb_data = { list, filter, data };
 
 	debug("Reading contents of directory %s\n", path);
-	dir = opendir(path);
-	if (!dir)
-		return false;
 
-	while ((de = readdir(dir))) {
-		if (de->d_name[0] == '.') {
-			if (de->d_name[1] == 0)
-				continue;
-			if (de->d_name[1] == '.' && de->d_name[2] == 0)
-				continue;
-		}
-		if (filter && !filter(de->d_name, data))
-			continue;
-		strlist_add(list, de->d_name);
-	}
-
-	closedir(dir);
-
-	return true;
+	return util_scandir_iterate(path, 0, read_dir_cb, &cb_data,
+				    NULL) == 0;
 }
 
 /* Print a text string indented by I spaces. */
@@ -968,19 +978,243 @@ exit_code_t remove_file(const char *path)
 	return EXIT_RUNTIME_ERROR;
 }
 
+/* Contents of a text file read by misc_prefetch_text_files() or a sysfs
+ * file read by misc_read_text_file(). @gen is the value of text_cache_gen
+ * when the file was read. */
+struct text_cache_node {
+	struct util_list_node node;
+	char *path;
+	char *text;
+	int err;
+	unsigned long gen;
+};
+
+#define TEXT_CACHE_BUCKETS	4096
+
+/* Cache of text files or %NULL. */
+static struct hash *text_cache;
+
+/* Incremented whenever a file is written or a command is run. Since this
+ * might modify any sysfs attribute, all cached contents become invalid. */
+static unsigned long text_cache_gen;
+
+/* Path prefix of sysfs files for which read results are cached. */
+static char *text_cache_prefix;
+
+static void text_cache_invalidate(void)
+{
+	__atomic_add_fetch(&text_cache_gen, 1, __ATOMIC_RELAXED);
+}
+
+static unsigned long text_cache_get_gen(void)
+{
+	return __atomic_load_n(&text_cache_gen, __ATOMIC_RELAXED);
+}
+
+static const void *text_cache_get_id(void *ptr)
+{
+	struct text_cache_node *t = ptr;
+
+	return t->path;
+}
+
+static void text_cache_node_free(void *ptr)
+{
+	struct text_cache_node *t = ptr;
+
+	free(t->path);
+	free(t->text);
+	free(t);
+}
+
+static void text_cache_free(void)
+{
+	free(text_cache_prefix);
+	text_cache_prefix = NULL;
+	if (!text_cache)
+		return;
+	hash_free(text_cache, text_cache_node_free);
+	text_cache = NULL;
+}
+
+static void text_cache_init(void)
+{
+	if (text_cache)
+		return;
+	text_cache = hash_new(TEXT_CACHE_BUCKETS, text_cache_get_id,
+			      hash_cmp_str, hash_str, struct text_cache_node,
+			      node);
+}
+
+/* Remember @text as the contents of sysfs file @path. */
+static void text_cache_store(const char *path, const char *text)
+{
+	struct text_cache_node *t;
+
+	if (!text_cache_prefix)
+		text_cache_prefix = path_get("/sys/");
+	if (!starts_with(path, text_cache_prefix))
+		return;
+
+	text_cache_init();
+	t = hash_find_by_id(text_cache, path);
+	if (!t) {
+		t = misc_malloc(sizeof(struct text_cache_node));
+		t->path = misc_strdup(path);
+		hash_add(text_cache, t);
+	}
+	free(t->text);
+	t->text = misc_strdup(text);
+	t->err = 0;
+	t->gen = text_cache_get_gen();
+}
+
+struct prefetch_ctx {
+	pthread_mutex_t lock;
+	struct text_cache_node **nodes;
+	int num;
+	int next;
+};
+
+static void *prefetch_thread(void *data)
+{
+	struct prefetch_ctx *ctx = data;
+	struct text_cache_node *t;
+	FILE *fd;
+	int i;
+
+	while (1) {
+		pthread_mutex_lock(&ctx->lock);
+		i = ctx->next++;
+		pthread_mutex_unlock(&ctx->lock);
+		if (i >= ctx->num)
+			break;
+		t = ctx->nodes[i];
+		t->gen = text_cache_get_gen();
+		fd = fopen(t->path, "r");
+		if (fd) {
+			t->text = read_fd(fd, 0);
+			if (!t->text)
+				t->err = errno;
+			fclose(fd);
+		} else
+			t->err = errno;
+	}
+
+	return NULL;
+}
+
+/* Read the text files specified by strlist @paths using up to @num_threads
+ * threads in parallel. Subsequent calls to misc_read_text_file() for these
+ * files return the cached contents. Use this only while the files are not
+ * modified. */
+void misc_prefetch_text_files(struct util_list *paths, int num_threads)
+{
+	struct prefetch_ctx ctx;
+	struct strlist_node *s;
+	struct text_cache_node *t;
+	pthread_t *threads;
+	int i, started = 0;
+
+	text_cache_init();
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.nodes = misc_malloc(sizeof(struct text_cache_node *) *
+				(util_list_len(paths) + 1));
+	util_list_iterate(paths, s) {
+		if (hash_find_by_id(text_cache, s->str))
+			continue;
+		t = misc_malloc(sizeof(struct text_cache_node));
+		t->path = misc_strdup(s->str);
+		ctx.nodes[ctx.num++] = t;
+	}
+	debug("Prefetching %d files\n", ctx.num);
+
+	/* The calling thread also reads files. */
+	pthread_mutex_init(&ctx.lock, NULL);
+	if (num_threads > ctx.num)
+		num_threads = ctx.num;
+	threads = misc_malloc(sizeof(pthread_t) * (num_threads + 1));
+	for (i = 1; i < num_threads; i++) {
+		if (pthread_create(&threads[started], NULL, prefetch_thread,
+				   &ctx))
+			break;
+		started++;
+	}
+	prefetch_thread(&ctx);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&ctx.lock);
+
+	for (i = 0; i < ctx.num; i++) {
+		t = ctx.nodes[i];
+		/* Another path in the list may have referred to the same
+		 * file. */
+		if (hash_find_by_id(text_cache, t->path))
+			text_cache_node_free(t);
+		else
+			hash_add(text_cache, t);
+	}
+	free(threads);
+	free(ctx.nodes);
+}
+
+/* Return a copy of the cached contents of @path in @buffer_ptr. Return
+ * %false if @path is not cached or if the cached contents are outdated. */
+static bool text_cache_read(const char *path, int chomp, char **buffer_ptr)
+{
+	struct text_cache_node *t;
+	char *buffer;
+	size_t len;
+
+	if (!text_cache)
+		return false;
+	t = hash_find_by_id(text_cache, path);
+	if (!t || t->gen != text_cache_get_gen())
+		return false;
+
+	debug("Using cached contents of file %s\n", path);
+	if (!t->text) {
+		errno = t->err;
+		*buffer_ptr = NULL;
+		return true;
+	}
+	buffer = misc_strdup(t->text);
+	len = strlen(buffer);
+	if (chomp && len > 0 && buffer[len - 1] == '\n')
+		buffer[len - 1] = 0;
+	*buffer_ptr = buffer;
+
+	return true;
+}
+
 /* Read file as text and return NULL-terminated contents. Remove trailing
- * newline if CHOMP is specified. Handle error messages according to @err. */
+ * newline if CHOMP is specified. Handle error messages according to @err.
+ * The contents of sysfs files are cached until the next file write or
+ * command invocation. */
 char *misc_read_text_file(const char *path, int chomp, err_t err)
 {
 	char *buffer = NULL;
+	size_t len;
 	FILE *fd;
 
+	if (text_cache_read(path, chomp, &buffer))
+		goto out;
+
+	timing_begin(timing_attr_read);
 	fd = misc_fopen(path, "r");
-	if (!fd)
+	if (fd) {
+		buffer = read_fd(fd, 0);
+		misc_fclose(fd);
+	}
+	timing_end();
+	if (!buffer)
 		goto out;
 
-	buffer = read_fd(fd, chomp);
-	misc_fclose(fd);
+	text_cache_store(path, buffer);
+	len = strlen(buffer);
+	if (chomp && len > 0 && buffer[len - 1] == '\n')
+		buffer[len - 1] = 0;
 
 out:
 	if (!buffer) {
@@ -1046,6 +1280,7 @@ static int write_text(const char *path, const char *text, err_t err)
 	FILE *fd;
 	int rc;
 
+	timing_begin(timing_attr_write);
 	fd = misc_fopen(path, "w");
 	if (!fd)
 		goto err;
@@ -1055,6 +1290,7 @@ static int write_text(const char *path, const char *text, err_t err)
 		fd = NULL;
 		goto err;
 	}
+	timing_end();
 
 	return 0;
 
@@ -1068,6 +1304,7 @@ err:
 	}
 	if (fd)
 		misc_fclose(fd);
+	timing_end();
 
 	return rc;
 }
@@ -1547,6 +1784,8 @@ int get_columns(void)
 FILE *misc_fopen(const char *path, const char *mode)
 {
 	debug("Opening file %s for mode %s\n", path, mode);
+	if (strcmp(mode, "r") != 0)
+		text_cache_invalidate();
 
 	/* Redirect writes in case of --dry-run. */
 	if (dryrun && (strchr(mode, 'w') || strchr(mode, 'a'))) {
@@ -1564,6 +1803,7 @@ FILE *misc_fopen(const char *path, const char *mode)
 FILE *misc_popen(const char *command, const char *type)
 {
 	debug("Opening pipe to command %s type %s\n", command, type);
+	text_cache_invalidate();
 
 	/* Ignore command in case of --dry-run. */
 	if (dryrun) {
@@ -20,6 +20,7 @@
 #include "module.h"
 #include "path.h"
 #include "setting.h"
+#include "timing.h"
 #include "udev.h"
 
 static struct util_list *tried_loading;
@@ -72,7 +73,9 @@ static exit_code_t module_unload(const char *mod, err_t err)
 	}
 
 	mp = path_get_modprobe();
+	timing_begin(timing_modprobe);
 	rc = misc_system(err, "%s -r %s", mp, mod);
+	timing_end();
 	free(mp);
 	if (rc != 0)
 		return EXIT_MOD_UNLOAD_FAILED;
@@ -90,6 +93,7 @@ static exit_code_t do_load(const char *mod, char *params, err_t err)
 
 	rc = EXIT_OK;
 	mp = path_get_modprobe();
+	timing_begin(timing_modprobe);
 	if (params) {
 		/* Note: We need to pass an empty configuration file to
 		 * modprobe or the persistent parameters in /etc/modprobe.d
@@ -110,6 +114,7 @@ static exit_code_t do_load(const char *mod, char *params, err_t err)
 	}
 
 out:
+	timing_end();
 	free(mp);
 
 	return rc;
@@ -7,8 +7,11 @@
  * it under the terms of the MIT license. See LICENSE for details.
  */
 
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
 
 #include "lib/util_path.h"
 
@@ -21,6 +24,7 @@
 #include "select.h"
 #include "setting.h"
 #include "subtype.h"
+#include "timing.h"
 
 static bool is_early_removed(struct device *dev)
 {
@@ -58,6 +62,104 @@ static void add_early_removed(struct util_list *selected)
 	}
 }
 
+#define FNV_OFFSET	0xcbf29ce484222325ULL
+#define FNV_PRIME	0x100000001b3ULL
+
+static void fnv_add(unsigned long long *hash, const char *str)
+{
+	do {
+		*hash ^= (unsigned char) *str;
+		*hash *= FNV_PRIME;
+	} while (*str++);
+}
+
+/* Check if a udev rule file name refers to one of the bus IDs in DATA. */
+static bool is_root_rule(const char *name, void *data)
+{
+	struct util_list *ids = data;
+	struct strlist_node *s;
+
+	if (!starts_with(name, UDEV_PREFIX "-") ||
+	    !ends_with(name, UDEV_SUFFIX))
+		return false;
+	util_list_iterate(ids, s) {
+		if (strstr(name, s->str))
+			return true;
+	}
+	return false;
+}
+
+/* Return a hash over the persistent configuration that ends up in the
+ * initial RAM-disk for the selected devices: the list of devices, their
+ * udev rules and the modprobe settings of their device types. */
+static char *get_root_hash(struct util_list *selected, const char *params)
+{
+	struct util_list *ids, *names, *files;
+	unsigned long long hash = FNV_OFFSET;
+	struct selected_dev_node *sel;
+	struct strlist_node *s;
+	struct devtype *dt;
+	char *dir, *path, *text;
+
+	ids = strlist_new();
+	files = strlist_new();
+	util_list_iterate(selected, sel) {
+		dt = sel->st->devtype;
+		/* Use the bus ID part of IDs like zfcp LUN or qeth group IDs */
+		strlist_add_unique(ids, "%.*s", (int) strcspn(sel->id, ":"),
+				   sel->id);
+		path = path_get_modprobe_conf(dt);
+		strlist_add_unique(files, "%s", path);
+		free(path);
+		path = path_get_udev_rule(dt->name, NULL, false);
+		strlist_add_unique(files, "%s", path);
+		free(path);
+	}
+
+	names = strlist_new();
+	dir = path_get_udev_rules(false);
+	misc_read_dir(dir, names, is_root_rule, ids);
+	util_list_iterate(names, s)
+		strlist_add_unique(files, "%s/%s", dir, s->str);
+	free(dir);
+	strlist_free(names);
+	strlist_sort_unique(files, str_cmp);
+
+	fnv_add(&hash, params);
+	util_list_iterate(files, s) {
+		text = misc_read_text_file(s->str, 0, err_ignore);
+		if (!text)
+			continue;
+		fnv_add(&hash, s->str);
+		fnv_add(&hash, text);
+		free(text);
+	}
+	strlist_free(files);
+	strlist_free(ids);
+
+	return misc_asprintf("%016llx\n", hash);
+}
+
+/* Serialize initial RAM-disk updates of concurrent chzdev calls. A call that
+ * waited for another one finds the stored hash updated and can skip its own
+ * update if the configuration it changed was already included. */
+static int root_lock(void)
+{
+	char *path;
+	int fd;
+
+	path = path_get("%s", PATH_ROOT_LOCK);
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	free(path);
+	if (fd == -1)
+		return -1;
+	if (flock(fd, LOCK_EX) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
 /* Determine if initial RAM-disk needs updating. If so, run the corresponding
  * scripts if available. */
 exit_code_t root_check(void)
@@ -65,11 +167,12 @@ exit_code_t root_check(void)
 	struct util_list *selected, *params, *mod = NULL;
 	struct selected_dev_node *sel;
 	struct device *dev;
-	char *params_str;
+	char *params_str = NULL, *hash = NULL, *old_hash, *hash_path = NULL;
 	exit_code_t rc = EXIT_OK;
 	struct strlist_node *s;
 	struct devtype *dt;
 	struct select_opts *select;
+	int rc2, lock_fd = -1;
 
 	debug("Checking for required initial RAM-disk update\n");
 
@@ -117,6 +220,31 @@ exit_code_t root_check(void)
 
 	if (util_list_is_empty(mod))
 		goto out;
+
+	/* Build the command line. */
+	params = strlist_new();
+	util_list_iterate(selected, sel) {
+		strlist_add(params, "%s", sel->st->name);
+		strlist_add(params, "%s", sel->id);
+	}
+	params_str = strlist_flatten(params, " ");
+	strlist_free(params);
+
+	/* Skip the update if the configuration is the same as for the last
+	 * update, for example when chzdev is called repeatedly with the same
+	 * settings. */
+	lock_fd = root_lock();
+	hash = get_root_hash(selected, params_str);
+	hash_path = path_get("%s", PATH_ROOT_HASH);
+	old_hash = misc_read_text_file(hash_path, 0, err_ignore);
+	if (!force && old_hash && strcmp(old_hash, hash) == 0) {
+		verb("Note: Initial RAM-disk already contains the root device "
+		     "configuration\n");
+		free(old_hash);
+		goto out;
+	}
+	free(old_hash);
+
 	info("Note: The initial RAM-disk must be updated for these changes to take effect:\n");
 	util_list_iterate(mod, s)
 		info("       - %s\n", s->str);
@@ -133,25 +261,25 @@ exit_code_t root_check(void)
 		goto out;
 	}
 
-	/* Build the command line. */
-	params = strlist_new();
-	util_list_iterate(selected, sel) {
-		strlist_add(params, "%s", sel->st->name);
-		strlist_add(params, "%s", sel->id);
-	}
-	params_str = strlist_flatten(params, " ");
-	strlist_free(params);
-
 	/* Run update command. */
-	if (misc_system(err_delayed_print, "%s %s", PATH_ROOT_SCRIPT,
-			params_str) != 0) {
+	timing_begin(timing_root_update);
+	rc2 = misc_system(err_delayed_print, "%s %s", PATH_ROOT_SCRIPT,
+			  params_str);
+	timing_end();
+	if (rc2 != 0) {
 		error("Failure while updating initial RAM-disk\n");
 		delayed_print(DELAY_INDENT);
 		rc = EXIT_RUNTIME_ERROR;
+	} else if (path_create(hash_path) == EXIT_OK) {
+		misc_write_text_file(hash_path, hash, err_ignore);
 	}
-	free(params_str);
 
 out:
+	if (lock_fd != -1)
+		close(lock_fd);
+	free(hash_path);
+	free(hash);
+	free(params_str);
 	strlist_free(mod);
 	selected_dev_list_free(selected);
 
@@ -125,14 +125,15 @@ static void setting_set_actual(struct setting *s, const char *value)
 	}
 }
 
-/* Write a single setting value to a sysfs attribute. */
-static exit_code_t write_setting_value(const char *path, struct setting *s,
-				       const char *value)
+/* Return a newly allocated string containing the text that needs to be
+ * written to the sysfs attribute at @path to set @value for setting @s, or
+ * %NULL if the attribute already has this value. */
+char *setting_get_write_text(const char *path, struct setting *s,
+			     const char *value)
 {
 	struct attrib *a = s->attrib;
 	int newline, rewrite, unstable, writeonly;
-	exit_code_t rc = EXIT_OK;
-	char *currvalue = NULL, *newvalue = NULL;
+	char *currvalue = NULL;
 
 	newline = a ? a->newline : 0;
 	rewrite = a ? a->rewrite : 0;
@@ -155,24 +156,35 @@ static exit_code_t write_setting_value(const char *path, struct setting *s,
 	/* Check if value is already set. */
 	if (s->actual_values) {
 		if (strlist_find(s->actual_values, value))
-			goto out;
+			return NULL;
 	} else if (s->actual_value) {
 		if (strcmp(s->actual_value, value) == 0)
-			goto out;
+			return NULL;
 	}
 
 do_write:
 	/* Ensure newline if required. */
 	if (newline && !ends_with(value, "\n"))
-		newvalue = misc_asprintf("%s\n", value);
+		return misc_asprintf("%s\n", value);
+
+	return misc_strdup(value);
+}
+
+/* Write a single setting value to a sysfs attribute. */
+static exit_code_t write_setting_value(const char *path, struct setting *s,
+				       const char *value)
+{
+	exit_code_t rc = EXIT_OK;
+	char *text;
+
+	text = setting_get_write_text(path, s, value);
+	if (!text)
+		return EXIT_OK;
 
-	rc = misc_write_text_file_retry(path, newvalue ? newvalue : value,
-					err_delayed_print);
+	rc = misc_write_text_file_retry(path, text, err_delayed_print);
 	if (rc)
 		rc = EXIT_SETTING_FAILED;
-
-out:
-	free(newvalue);
+	free(text);
 
 	return rc;
 }
@@ -0,0 +1,217 @@
+/*
+ * zdev - Modify and display the persistent configuration of devices
+ *
+ * Copyright IBM Corp. 2016, 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "devtype.h"
+#include "misc.h"
+#include "subtype.h"
+#include "timing.h"
+
+#define TIMING_MAX_TYPES	16
+#define TIMING_NUM_SLOWEST	5
+#define TIMING_ID_LEN		64
+
+int timing_enabled;
+
+static const char *phase_names[TIMING_NUM_PHASES] = {
+	[timing_attr_read]	= "Attribute reads",
+	[timing_attr_write]	= "Attribute writes",
+	[timing_cio_settle]	= "CIO settle",
+	[timing_udev_settle]	= "udev settle",
+	[timing_udev_rules]	= "udev rule updates",
+	[timing_modprobe]	= "Kernel module loading",
+	[timing_root_update]	= "Root device update",
+};
+
+/* Accumulated time in nanoseconds per phase. Updated atomically since
+ * attribute writes may be performed by multiple threads. */
+static uint64_t phase_ns[TIMING_NUM_PHASES];
+static unsigned long phase_count[TIMING_NUM_PHASES];
+
+/* Per-thread active phase. Time spent in nested phases, e.g. the attribute
+ * write that triggers a CIO settle, is accounted to the outermost phase. */
+static __thread timing_phase_t active;
+static __thread int depth;
+static __thread uint64_t mark;
+
+/* struct timing_type - Accumulated time of device operations per devtype
+ * @name: Devtype name
+ * @ns: Accumulated time in nanoseconds
+ * @count: Number of device operations */
+struct timing_type {
+	const char *name;
+	uint64_t ns;
+	unsigned long count;
+};
+
+/* struct timing_op - A single device operation
+ * @ns: Duration in nanoseconds
+ * @id: Subtype name and device ID
+ * @op: Operation name */
+struct timing_op {
+	uint64_t ns;
+	char id[TIMING_ID_LEN];
+	const char *op;
+};
+
+static pthread_mutex_t timing_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct timing_type types[TIMING_MAX_TYPES];
+static int num_types;
+static struct timing_op slowest[TIMING_NUM_SLOWEST];
+static uint64_t start_ns;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void timing_init(void)
+{
+	start_ns = now_ns();
+}
+
+void timing_exit(void)
+{
+	memset(phase_ns, 0, sizeof(phase_ns));
+	memset(phase_count, 0, sizeof(phase_count));
+	memset(types, 0, sizeof(types));
+	memset(slowest, 0, sizeof(slowest));
+	num_types = 0;
+}
+
+/* Start accounting time to @phase until the matching call to timing_end(). */
+void timing_begin(timing_phase_t phase)
+{
+	if (!timing_enabled || depth++ > 0)
+		return;
+	active = phase;
+	mark = now_ns();
+	__atomic_add_fetch(&phase_count[phase], 1, __ATOMIC_RELAXED);
+}
+
+/* Stop accounting time to the phase started by timing_begin(). */
+void timing_end(void)
+{
+	if (!timing_enabled || depth == 0 || --depth > 0)
+		return;
+	__atomic_add_fetch(&phase_ns[active], now_ns() - mark,
+			   __ATOMIC_RELAXED);
+}
+
+/* Return the start time of a device operation. */
+uint64_t timing_device_begin(void)
+{
+	if (!timing_enabled)
+		return 0;
+
+	return now_ns();
+}
+
+static struct timing_type *get_type(const char *name)
+{
+	int i;
+
+	for (i = 0; i < num_types; i++) {
+		if (strcmp(types[i].name, name) == 0)
+			return &types[i];
+	}
+	if (num_types >= TIMING_MAX_TYPES)
+		return NULL;
+	types[num_types].name = name;
+
+	return &types[num_types++];
+}
+
+/* Record the duration of operation @op on device @id of subtype @st which
+ * was started at @start. */
+void timing_device_end(struct subtype *st, const char *id, const char *op,
+		       uint64_t start)
+{
+	struct timing_type *type;
+	uint64_t ns;
+	int i;
+
+	if (!timing_enabled || !st)
+		return;
+	ns = now_ns() - start;
+
+	pthread_mutex_lock(&timing_mutex);
+	type = get_type(st->devtype->name);
+	if (type) {
+		type->ns += ns;
+		type->count++;
+	}
+	/* Keep slowest operations sorted by descending duration. */
+	for (i = TIMING_NUM_SLOWEST; i > 0 && slowest[i - 1].ns < ns; i--) {
+		if (i < TIMING_NUM_SLOWEST)
+			slowest[i] = slowest[i - 1];
+	}
+	if (i < TIMING_NUM_SLOWEST) {
+		slowest[i].ns = ns;
+		slowest[i].op = op;
+		snprintf(slowest[i].id, sizeof(slowest[i].id), "%s %s",
+			 st->name, id);
+	}
+	pthread_mutex_unlock(&timing_mutex);
+}
+
+static double ms(uint64_t ns)
+{
+	return ns / 1000000.0;
+}
+
+/* Print a summary of where time was spent to stderr. */
+void timing_print(void)
+{
+	uint64_t total, sum = 0;
+	int i;
+
+	if (!timing_enabled)
+		return;
+	total = now_ns() - start_ns;
+
+	fprintf(stderr, "Timing summary:\n");
+	fprintf(stderr, "  %-24s %12s %8s\n", "PHASE", "TIME(ms)", "COUNT");
+	for (i = 0; i < TIMING_NUM_PHASES; i++) {
+		sum += phase_ns[i];
+		if (phase_count[i] == 0)
+			continue;
+		fprintf(stderr, "  %-24s %12.3f %8lu\n", phase_names[i],
+			ms(phase_ns[i]), phase_count[i]);
+	}
+	fprintf(stderr, "  %-24s %12.3f\n", "Other",
+		ms(sum < total ? total - sum : 0));
+	fprintf(stderr, "  %-24s %12.3f\n", "Total", ms(total));
+
+	if (num_types > 0) {
+		fprintf(stderr, "\n  %-24s %12s %8s\n", "DEVICE TYPE",
+			"TIME(ms)", "DEVICES");
+		for (i = 0; i < num_types; i++) {
+			fprintf(stderr, "  %-24s %12.3f %8lu\n", types[i].name,
+				ms(types[i].ns), types[i].count);
+		}
+	}
+
+	if (slowest[0].ns > 0) {
+		fprintf(stderr, "\n  %-24s %12s %8s\n", "SLOWEST DEVICE",
+			"TIME(ms)", "ACTION");
+		for (i = 0; i < TIMING_NUM_SLOWEST && slowest[i].ns > 0; i++) {
+			fprintf(stderr, "  %-24s %12.3f %8s\n", slowest[i].id,
+				ms(slowest[i].ns), slowest[i].op);
+		}
+	}
+}
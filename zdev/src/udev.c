@@ -18,14 +18,80 @@
 #include "attrib.h"
 #include "ccw.h"
 #include "device.h"
+#include "hash.h"
 #include "misc.h"
 #include "path.h"
 #include "setting.h"
+#include "timing.h"
 #include "udev.h"
 
 int udev_need_settle = 0;
 int udev_no_settle;
 
+/* If set, changes to udev rule files are kept in memory until
+ * udev_flush_rules() is called. */
+int udev_batch_rules;
+
+/* Pending change of a udev rule file. */
+struct udev_rule_node {
+	struct util_list_node node;
+	char *path;
+	char *text;
+	size_t size;
+	FILE *fd;
+	unsigned int remove:1;
+};
+
+static struct util_list *pending_rules;
+
+#define FILE_CACHE_BUCKETS	256
+
+/* Parsed udev rule file. */
+struct udev_file_node {
+	struct util_list_node node;
+	char *path;
+	struct udev_file *file;
+};
+
+/* Cache of parsed udev rule files indexed by path or %NULL. */
+static struct hash *file_cache;
+
+static struct udev_rule_node *pending_rule_find(const char *path)
+{
+	struct udev_rule_node *rule;
+
+	if (!pending_rules)
+		return NULL;
+	util_list_iterate(pending_rules, rule) {
+		if (strcmp(rule->path, path) == 0)
+			return rule;
+	}
+
+	return NULL;
+}
+
+/* Return the pending change for @path. Create a new one if necessary. */
+static struct udev_rule_node *pending_rule_get(const char *path)
+{
+	struct udev_rule_node *rule;
+
+	rule = pending_rule_find(path);
+	if (rule) {
+		free(rule->text);
+		rule->text = NULL;
+		rule->size = 0;
+		rule->remove = 0;
+		return rule;
+	}
+	if (!pending_rules)
+		pending_rules = util_list_new(struct udev_rule_node, node);
+	rule = misc_malloc(sizeof(struct udev_rule_node));
+	rule->path = misc_strdup(path);
+	util_list_add_tail(pending_rules, rule);
+
+	return rule;
+}
+
 /* Create a newly allocated udev entry. */
 static struct udev_entry_node *udev_entry_node_new(const char *key,
 						   const char *op,
@@ -85,6 +151,7 @@ static struct udev_file *udev_file_new(void)
 
 	file = misc_malloc(sizeof(struct udev_file));
 	util_list_init(&file->lines, struct udev_line_node, node);
+	file->refs = 1;
 
 	return file;
 }
@@ -94,7 +161,7 @@ void udev_free_file(struct udev_file *file)
 {
 	struct udev_line_node *l, *n;
 
-	if (!file)
+	if (!file || --file->refs > 0)
 		return;
 	util_list_iterate_safe(&file->lines, l, n) {
 		util_list_remove(&file->lines, l);
@@ -316,14 +383,84 @@ ok:
 	return result;
 }
 
-/* Read the contents of a udev rule file. */
+static const void *file_node_get_id(void *ptr)
+{
+	struct udev_file_node *f = ptr;
+
+	return f->path;
+}
+
+static void file_node_free(void *ptr)
+{
+	struct udev_file_node *f = ptr;
+
+	free(f->path);
+	udev_free_file(f->file);
+	free(f);
+}
+
+/* Remove the parsed contents of the udev rule file at @path from the cache. */
+static void file_cache_drop(const char *path)
+{
+	struct udev_file_node *f;
+
+	if (!file_cache)
+		return;
+	f = hash_find_by_id(file_cache, path);
+	if (!f)
+		return;
+	hash_remove(file_cache, f);
+	file_node_free(f);
+}
+
+/* Add parsed udev rule file @file for @path to the cache. */
+static void file_cache_add(const char *path, struct udev_file *file)
+{
+	struct udev_file_node *f;
+
+	if (!file_cache) {
+		file_cache = hash_new(FILE_CACHE_BUCKETS, file_node_get_id,
+				      hash_cmp_str, hash_str,
+				      struct udev_file_node, node);
+	}
+	f = misc_malloc(sizeof(struct udev_file_node));
+	f->path = misc_strdup(path);
+	f->file = file;
+	file->refs++;
+	hash_add(file_cache, f);
+}
+
+/* Release all cached udev rule data. */
+void udev_exit(void)
+{
+	if (!file_cache)
+		return;
+	hash_free(file_cache, file_node_free);
+	file_cache = NULL;
+}
+
+/* Read the contents of a udev rule file. Files without pending changes are
+ * parsed only once per invocation. The resulting @file_ptr must be released
+ * using udev_free_file(). */
 exit_code_t udev_read_file(const char *path, struct udev_file **file_ptr)
 {
 	char *text, *curr, *next;
 	struct udev_file *file;
+	struct udev_file_node *f;
+	bool pending;
 	int once = 0;
 
-	text = misc_read_text_file(path, 0, err_print);
+	pending = pending_rule_find(path);
+	if (!pending && file_cache) {
+		f = hash_find_by_id(file_cache, path);
+		if (f) {
+			f->file->refs++;
+			*file_ptr = f->file;
+			return EXIT_OK;
+		}
+	}
+
+	text = udev_rule_read(path, err_print);
 	if (!text)
 		return EXIT_RUNTIME_ERROR;
 	file = udev_file_new();
@@ -341,6 +478,8 @@ exit_code_t udev_read_file(const char *path, struct udev_file **file_ptr)
 	}
 
 	free(text);
+	if (!pending)
+		file_cache_add(path, file);
 	*file_ptr = file;
 
 	return EXIT_OK;
@@ -383,6 +522,8 @@ void udev_get_device_ids(const char *type, struct util_list *list,
 	struct strlist_node *s;
 	size_t plen, len;
 
+	udev_flush_rules();
+
 	prefix = misc_asprintf("%s-%s-", UDEV_PREFIX, type);
 	plen = strlen(prefix);
 	path = path_get_udev_rules(autoconf);
@@ -410,8 +551,7 @@ exit_code_t udev_remove_rule(const char *type, const char *id, bool autoconf)
 	exit_code_t rc = EXIT_OK;
 
 	path = path_get_udev_rule(type, id, autoconf);
-	if (util_path_is_reg_file(path))
-		rc = remove_file(path);
+	rc = udev_rule_remove(path);
 	free(path);
 
 	return rc;
@@ -422,7 +562,151 @@ void udev_settle(void)
 {
 	if (udev_no_settle)
 		return;
+	timing_begin(timing_udev_settle);
 	misc_system(err_ignore, "%s settle", PATH_UDEVADM);
+	timing_end();
+}
+
+/* Open the udev rule file at @path for writing. */
+FILE *udev_rule_fopen(const char *path)
+{
+	struct udev_rule_node *rule;
+
+	if (!udev_batch_rules) {
+		file_cache_drop(path);
+		return misc_fopen(path, "w");
+	}
+
+	rule = pending_rule_get(path);
+	rule->fd = open_memstream(&rule->text, &rule->size);
+
+	return rule->fd;
+}
+
+/* Close a udev rule file opened with udev_rule_fopen(). */
+int udev_rule_fclose(FILE *fd)
+{
+	struct udev_rule_node *rule;
+
+	if (pending_rules) {
+		util_list_iterate(pending_rules, rule) {
+			if (rule->fd != fd)
+				continue;
+			rule->fd = NULL;
+			return fclose(fd);
+		}
+	}
+
+	return misc_fclose(fd);
+}
+
+/* Remove the udev rule file at @path if it exists. */
+exit_code_t udev_rule_remove(const char *path)
+{
+	struct udev_rule_node *rule;
+
+	if (!udev_batch_rules) {
+		file_cache_drop(path);
+		if (!util_path_is_reg_file(path))
+			return EXIT_OK;
+		return remove_file(path);
+	}
+
+	if (!udev_rule_exists(path))
+		return EXIT_OK;
+	rule = pending_rule_get(path);
+	rule->remove = 1;
+
+	return EXIT_OK;
+}
+
+/* Check if the udev rule file at @path exists, taking pending changes into
+ * account. */
+bool udev_rule_exists(const char *path)
+{
+	struct udev_rule_node *rule;
+
+	rule = pending_rule_find(path);
+	if (rule)
+		return !rule->remove;
+
+	return util_path_is_reg_file(path);
+}
+
+/* Read the contents of the udev rule file at @path, taking pending changes
+ * into account. Handle error messages according to @err. */
+char *udev_rule_read(const char *path, err_t err)
+{
+	struct udev_rule_node *rule;
+
+	rule = pending_rule_find(path);
+	if (!rule)
+		return misc_read_text_file(path, 0, err);
+	if (rule->remove) {
+		err_t_print(err, "Could not read file %s: %s\n", path,
+			    strerror(ENOENT));
+		return NULL;
+	}
+
+	return misc_strdup(rule->text ? rule->text : "");
+}
+
+/* Write all pending udev rule file changes. */
+exit_code_t udev_flush_rules(void)
+{
+	struct udev_rule_node *rule, *n;
+	exit_code_t rc = EXIT_OK, rc2;
+	FILE *fd;
+
+	if (!pending_rules)
+		return EXIT_OK;
+
+	timing_begin(timing_udev_rules);
+	util_list_iterate_safe(pending_rules, rule, n) {
+		util_list_remove(pending_rules, rule);
+		file_cache_drop(rule->path);
+		rc2 = EXIT_OK;
+		if (rule->remove) {
+			if (util_path_is_reg_file(rule->path))
+				rc2 = remove_file(rule->path);
+			goto next;
+		}
+
+		debug("Writing udev rule file %s\n", rule->path);
+		if (!util_path_exists(rule->path)) {
+			rc2 = path_create(rule->path);
+			if (rc2)
+				goto next;
+		}
+		fd = misc_fopen(rule->path, "w");
+		if (!fd) {
+			error("Could not write to file %s: %s\n", rule->path,
+			      strerror(errno));
+			rc2 = EXIT_RUNTIME_ERROR;
+			goto next;
+		}
+		if (rule->size > 0 &&
+		    fwrite(rule->text, rule->size, 1, fd) != 1) {
+			error("Could not write to file %s: %s\n", rule->path,
+			      strerror(errno));
+			rc2 = EXIT_RUNTIME_ERROR;
+		}
+		if (misc_fclose(fd)) {
+			warn("Could not close file %s: %s\n", rule->path,
+			     strerror(errno));
+		}
+next:
+		if (rc2 && !rc)
+			rc = rc2;
+		free(rule->text);
+		free(rule->path);
+		free(rule);
+	}
+	util_list_free(pending_rules);
+	pending_rules = NULL;
+	timing_end();
+
+	return rc;
 }
 
 /* Extract internal attribute settings from @entry and add to @list.
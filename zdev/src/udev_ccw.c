@@ -36,7 +36,7 @@ bool udev_ccw_exists(const char *type, const char *id, bool autoconf)
 		return false;
 
 	path = path_get_udev_rule(type, normid, autoconf);
-	rc = util_path_is_reg_file(path);
+	rc = udev_rule_exists(path);
 	free(path);
 	free(normid);
 
@@ -172,7 +172,7 @@ exit_code_t udev_ccw_write_device(struct device *dev, bool autoconf)
 			goto out;
 	}
 
-	fd = misc_fopen(path, "w");
+	fd = udev_rule_fopen(path);
 	if (!fd) {
 		error("Could not write to file %s: %s\n", path,
 		      strerror(errno));
@@ -216,7 +216,7 @@ exit_code_t udev_ccw_write_device(struct device *dev, bool autoconf)
 	fprintf(fd, "\n");
 	fprintf(fd, "LABEL=\"%s\"\n", end_label);
 
-	if (misc_fclose(fd))
+	if (udev_rule_fclose(fd))
 		warn("Could not close file %s: %s\n", path, strerror(errno));
 
 out:
@@ -56,7 +56,7 @@ bool udev_ccwgroup_exists(const char *type, const char *id, bool autoconf)
 	path = get_rule_path(type, id, autoconf);
 	if (!path)
 		return false;
-	rc = util_path_is_reg_file(path);
+	rc = udev_rule_exists(path);
 	free(path);
 
 	return rc;
@@ -238,7 +238,7 @@ exit_code_t udev_ccwgroup_write_device(struct device *dev, bool autoconf)
 			goto out;
 	}
 
-	fd = misc_fopen(path, "w");
+	fd = udev_rule_fopen(path);
 	if (!fd) {
 		error("Could not write to file %s: %s\n", path,
 		      strerror(errno));
@@ -308,7 +308,7 @@ exit_code_t udev_ccwgroup_write_device(struct device *dev, bool autoconf)
 	fprintf(fd, "\n");
 	fprintf(fd, "LABEL=\"%s\"\n", end_label);
 
-	if (misc_fclose(fd))
+	if (udev_rule_fclose(fd))
 		warn("Could not close file %s: %s\n", path, strerror(errno));
 
 out:
@@ -385,6 +385,8 @@ void udev_ccwgroup_add_device_ids(const char *type, struct util_list *list,
 	struct get_ids_cb_data cb_data;
 	char *path;
 
+	udev_flush_rules();
+
 	path = path_get_udev_rules(autoconf);
 	cb_data.prefix = misc_asprintf("%s-%s-", UDEV_PREFIX, type);
 	cb_data.ids = list;
@@ -408,8 +410,7 @@ exit_code_t udev_ccwgroup_remove_rule(const char *type, const char *id,
 		return EXIT_INVALID_ID;
 
 	path = path_get_udev_rule(type, partial_id, autoconf);
-	if (util_path_is_reg_file(path))
-		rc = remove_file(path);
+	rc = udev_rule_remove(path);
 	free(path);
 	free(partial_id);
 
@@ -442,6 +442,8 @@ void udev_zfcp_lun_add_device_ids(struct util_list *list, bool autoconf)
 	struct lun_cb_data cb_data;
 	char *path;
 
+	udev_flush_rules();
+
 	cb_data.prefix = misc_asprintf("%s-%s-", UDEV_PREFIX, ZFCP_LUN_NAME);
 	cb_data.list = list;
 	path = path_get_udev_rules(autoconf);
@@ -523,7 +525,7 @@ exit_code_t udev_zfcp_lun_read_device(struct device *dev, bool autoconf)
 
 	/* Check for single lun file first then try multi lun file. */
 	path = get_single_zfcp_lun_path(dev->id, autoconf);
-	if (!util_path_exists(path)) {
+	if (!udev_rule_exists(path)) {
 		free(path);
 		path = get_zfcp_lun_path(dev->id, autoconf);
 	}
@@ -591,7 +593,7 @@ static exit_code_t write_luns_rule(const char *path, struct util_list *list)
 			goto out;
 	}
 
-	fd = misc_fopen(path, "w");
+	fd = udev_rule_fopen(path);
 	if (!fd) {
 		error("Could not write to file %s: %s\n", path,
 		      strerror(errno));
@@ -686,7 +688,7 @@ static exit_code_t write_luns_rule(const char *path, struct util_list *list)
 
 	fprintf(fd, "\nLABEL=\"%s%s\"\n", LABEL_END, hba_id);
 
-	if (misc_fclose(fd))
+	if (udev_rule_fclose(fd))
 		warn("Could not close file %s: %s\n", path, strerror(errno));
 
 out:
@@ -717,7 +719,7 @@ static exit_code_t update_lun_rule(const char *id, struct device_state *state,
 
 	/* Get previous rule data. */
 	luns = zfcp_lun_node_list_new();
-	exists = util_path_is_reg_file(path);
+	exists = udev_rule_exists(path);
 	if (exists)
 		udev_read_zfcp_lun_rule(path, luns);
 
@@ -735,7 +737,7 @@ static exit_code_t update_lun_rule(const char *id, struct device_state *state,
 	if (util_list_is_empty(luns)) {
 		/* Remove empty file. */
 		if (exists)
-			rc = remove_file(path);
+			rc = udev_rule_remove(path);
 	} else {
 		/* Write updated rules file. */
 		rc = write_luns_rule(path, luns);
@@ -790,7 +792,7 @@ bool udev_zfcp_lun_exists(const char *id, bool autoconf)
 
 	/* Check for single lun rule file first. */
 	path = get_single_zfcp_lun_path(id, autoconf);
-	if (util_path_exists(path)) {
+	if (udev_rule_exists(path)) {
 		rc = true;
 		goto out;
 	}
@@ -798,7 +800,7 @@ bool udev_zfcp_lun_exists(const char *id, bool autoconf)
 
 	/* Check multi lun rule file next. */
 	path = get_zfcp_lun_path(id, autoconf);
-	rule = misc_read_text_file(path, 1, err_ignore);
+	rule = udev_rule_read(path, err_ignore);
 	if (!rule)
 		goto out;
 
@@ -14,6 +14,7 @@
 #include <fcntl.h>
 #include <fuse.h>
 #include <fuse_opt.h>
+#include <iconv.h>
 #include <limits.h>
 #include <malloc.h>
 #include <pthread.h>
@@ -39,16 +40,33 @@
 /* defaults for file and directory permissions (octal) */
 #define DEF_FILE_PERM 0440
 #define DEF_DIR_PERM 0550
+
+/*
+ * Preferred I/O size reported for data set files. Tools like cp and dd use
+ * st_blksize as their read size, so a large value saves system calls. The
+ * kernel splits each read into FUSE requests of at most max_read bytes.
+ */
+#define ZDSFS_BLKSIZE (1024 * 1024)
 /* default timer interval 9 minutes, enq times out after 10 minutes */
 #define DEFAULT_KEEPALIVE_SEC	         540
+/* default code pages for -o ascii */
+#define CODEPAGE_FROM	"CP1047"
+#define CODEPAGE_TO	"ISO-8859-1"
 
 struct zdsfs_info {
 	int devcount;
 	int allow_inclomplete_multi_volume;
 	int keepRDW;
+	int readahead;
+	int ascii;
+	char *codepage_from;
+	char *codepage_to;
+	unsigned char convtable[256]; /* translation table for -o ascii */
 	int host_count;
 	unsigned int tracks_per_frame;
 	unsigned long long seek_buffer_size;
+	unsigned int track_cache_size;
+	char *metacache; /* file that caches PDS member lists */
 	struct zdsroot *zdsroot;
 
 	char *metadata;  /* buffer that contains the content of metadata.txt */
@@ -74,9 +92,27 @@ struct dsh_node {
 	struct dshandle *dsh;
 };
 
-struct zdsfs_file_info {
+/*
+ * Maximum number of dshandles per open file. Concurrent reads of the same
+ * file at different offsets are done with separate dshandles, so that they
+ * do not have to wait for each other and do not destroy each others read
+ * position.
+ */
+#define MAX_READERS 4
+
+struct zdsfs_reader {
 	struct dshandle *dsh;
+	int busy;	/* a read is in progress on this dshandle */
+};
+
+struct zdsfs_file_info {
+	struct dshandle *dsh;	/* first dshandle, holds the ENQ */
+	struct dataset *ds;
+	char *path;
 	pthread_mutex_t mutex;
+	pthread_cond_t cond;	/* signaled when a reader becomes idle */
+	struct zdsfs_reader reader[MAX_READERS];
+	int nr_readers;
 
 	int is_metadata_file;
 	size_t metaread; /* how many bytes have already been read */
@@ -301,12 +337,14 @@ static int zdsfs_getattr(const char *path, struct stat *stbuf)
 		stbuf->st_nlink = 1;
 		/* the member cannot be bigger than the data set */
 		stbuf->st_size = dssize;
+		stbuf->st_blksize = ZDSFS_BLKSIZE;
 		return 0;
 	} else { /* normal data set */
 		stbuf->st_mode = S_IFREG | DEF_FILE_PERM;
 		stbuf->st_nlink = 1;
 		stbuf->st_size = dssize;
 		stbuf->st_blocks = tracks * 16 * 8;
+		stbuf->st_blksize = ZDSFS_BLKSIZE;
 		stbuf->st_atime = time;
 		stbuf->st_mtime = time;
 		stbuf->st_ctime = time;
@@ -314,45 +352,146 @@ static int zdsfs_getattr(const char *path, struct stat *stbuf)
 	return 0;
 }
 
-static void zdsfs_read_device(struct dasd *newdasd, const char *device)
+/* Maximum number of devices that are scanned in parallel */
+#define MAX_SCAN_THREADS 16
+
+struct zdsfs_scan {
+	pthread_mutex_t mutex;
+	struct dasd **dasd;	/* devices to scan */
+	const char **step;	/* failed step, NULL on success */
+	int *rc;
+	int count;
+	int next;		/* next device to scan */
+};
+
+/*
+ * Read the VTOC and the PDS directories of a single device. This only
+ * accesses data that belongs to the device, so it is done for several
+ * devices in parallel.
+ */
+static const char *zdsfs_scan_device(struct dasd *dasd, int *rcp)
 {
-	struct errorlog *log;
-	int rc;
+	int rc, is_image;
 
-	rc = dasd_disk_reserve(device);
+	/* image files cannot be reserved */
+	lzds_dasd_get_is_image(dasd, &is_image);
+	rc = is_image ? 0 : dasd_disk_reserve(dasd->device);
 	if (rc) {
-		fprintf(stderr, "error when reserving device %s: %s\n",
-			device, strerror(rc));
-		lzds_dasd_get_errorlog(newdasd, &log);
-		lzds_errorlog_fprint(log, stderr);
-		exit(1);
+		*rcp = rc;
+		return "reserving device";
 	}
-	rc = lzds_dasd_alloc_rawvtoc(newdasd);
+	rc = lzds_dasd_alloc_rawvtoc(dasd);
 	if (rc) {
-		fprintf(stderr, "error when reading VTOC from device %s: %s\n",
-			device, strerror(rc));
-		lzds_dasd_get_errorlog(newdasd, &log);
-		lzds_errorlog_fprint(log, stderr);
-		exit(1);
+		*rcp = rc;
+		return "reading VTOC from device";
 	}
-	rc = lzds_zdsroot_extract_datasets_from_dasd(zdsfsinfo.zdsroot,
-						     newdasd);
+	rc = lzds_dasd_scan_datasets(dasd);
 	if (rc) {
-		fprintf(stderr,
-			"error when extracting data sets from dasd %s: %s\n",
-			device, strerror(rc));
-		lzds_zdsroot_get_errorlog(zdsfsinfo.zdsroot, &log);
-		lzds_errorlog_fprint(log, stderr);
-		exit(1);
+		*rcp = rc;
+		return "extracting data sets from dasd";
 	}
-	rc = dasd_disk_release(device);
+	rc = is_image ? 0 : dasd_disk_release(dasd->device);
 	if (rc) {
-		fprintf(stderr, "error when releasing device %s: %s\n",
-			device, strerror(rc));
-		lzds_dasd_get_errorlog(newdasd, &log);
-		lzds_errorlog_fprint(log, stderr);
+		*rcp = rc;
+		return "releasing device";
+	}
+	return NULL;
+}
+
+static void *zdsfs_scan_thread(void *arg)
+{
+	struct zdsfs_scan *scan = arg;
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&scan->mutex);
+		i = scan->next++;
+		pthread_mutex_unlock(&scan->mutex);
+		if (i >= scan->count)
+			break;
+		scan->step[i] = zdsfs_scan_device(scan->dasd[i], &scan->rc[i]);
+	}
+	return NULL;
+}
+
+/*
+ * Read the VTOCs of all devices and add the data sets to the zdsroot.
+ * Devices are scanned in parallel, but the data sets are added in the
+ * order of the devices, so that the result does not depend on timing.
+ */
+static void zdsfs_read_devices(void)
+{
+	pthread_t thread[MAX_SCAN_THREADS];
+	struct dasditerator *dasdit;
+	struct zdsfs_scan scan;
+	struct errorlog *log;
+	struct dasd *dasd;
+	int i, nthreads, rc;
+
+	memset(&scan, 0, sizeof(scan));
+	scan.dasd = util_zalloc(zdsfsinfo.devcount * sizeof(*scan.dasd));
+	scan.step = util_zalloc(zdsfsinfo.devcount * sizeof(*scan.step));
+	scan.rc = util_zalloc(zdsfsinfo.devcount * sizeof(*scan.rc));
+	pthread_mutex_init(&scan.mutex, NULL);
+
+	rc = lzds_zdsroot_alloc_dasditerator(zdsfsinfo.zdsroot, &dasdit);
+	if (rc) {
+		fprintf(stderr, "Could not allocate internal structures\n");
 		exit(1);
 	}
+	while (!lzds_dasditerator_get_next_dasd(dasdit, &dasd) &&
+	       scan.count < zdsfsinfo.devcount)
+		scan.dasd[scan.count++] = dasd;
+	lzds_dasditerator_free(dasdit);
+
+	nthreads = MIN(scan.count, MAX_SCAN_THREADS);
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&thread[i], NULL, zdsfs_scan_thread, &scan))
+			break;
+	}
+	nthreads = i;
+	/* without threads, scan in this thread */
+	if (!nthreads)
+		zdsfs_scan_thread(&scan);
+	for (i = 0; i < nthreads; i++)
+		pthread_join(thread[i], NULL);
+
+	for (i = 0; i < scan.count; i++) {
+		dasd = scan.dasd[i];
+		if (scan.step[i]) {
+			fprintf(stderr, "error when %s %s: %s\n",
+				scan.step[i], dasd->device,
+				strerror(scan.rc[i]));
+			lzds_dasd_get_errorlog(dasd, &log);
+			lzds_errorlog_fprint(log, stderr);
+			exit(1);
+		}
+		rc = lzds_zdsroot_extract_datasets_from_dasd(zdsfsinfo.zdsroot,
+							     dasd);
+		if (rc) {
+			fprintf(stderr,
+				"error when extracting data sets from dasd %s: %s\n",
+				dasd->device, strerror(rc));
+			lzds_zdsroot_get_errorlog(zdsfsinfo.zdsroot, &log);
+			lzds_errorlog_fprint(log, stderr);
+			exit(1);
+		}
+	}
+	if (zdsfsinfo.metacache) {
+		rc = lzds_zdsroot_write_member_cache(zdsfsinfo.zdsroot,
+						     zdsfsinfo.metacache);
+		if (rc) {
+			fprintf(stderr, "Warning: could not write meta data "
+				"cache %s: %s\n", zdsfsinfo.metacache,
+				strerror(rc));
+			lzds_zdsroot_get_errorlog(zdsfsinfo.zdsroot, &log);
+			lzds_errorlog_fprint(log, stderr);
+		}
+	}
+	pthread_mutex_destroy(&scan.mutex);
+	free(scan.dasd);
+	free(scan.step);
+	free(scan.rc);
 }
 
 
@@ -405,19 +544,10 @@ static int zdsfs_statfs(const char *UNUSED(path), struct statvfs *statvfs)
 
 static int zdsfs_update_vtoc(void)
 {
-	struct dasditerator *dasdit;
-	struct dasd *dasd;
 	int rc;
 
 	lzds_dslist_free(zdsfsinfo.zdsroot);
-	rc = lzds_zdsroot_alloc_dasditerator(zdsfsinfo.zdsroot, &dasdit);
-	if (rc)
-		return -ENOMEM;
-
-	while (!lzds_dasditerator_get_next_dasd(dasdit, &dasd))
-		zdsfs_read_device(dasd, dasd->device);
-
-	lzds_dasditerator_free(dasdit);
+	zdsfs_read_devices();
 	rc = zdsfs_verify_datasets();
 	if (rc)
 		return rc;
@@ -532,6 +662,71 @@ static int zdsfs_test_restserver(void)
 }
 
 
+/*
+ * Allocate a dshandle for data set ds with all settings that are needed to
+ * read the file at path. The dshandle is not opened.
+ */
+static int zdsfs_alloc_dshandle(struct dataset *ds, const char *path,
+				struct dshandle **dshp)
+{
+	char normds[45];
+	struct dshandle *dsh;
+	struct errorlog *log;
+	int rc, ispds;
+
+	rc = lzds_dataset_alloc_dshandle(ds, zdsfsinfo.tracks_per_frame, &dsh);
+	if (rc)
+		return -rc;
+
+	rc = lzds_dshandle_set_seekbuffer(dsh, zdsfsinfo.seek_buffer_size);
+	if (rc) {
+		fprintf(stderr,	"Error when preparing seek buffer:\n");
+		goto error;
+	}
+	/* if the data set is a PDS, then the path must contain a valid
+	 * member name, and the context must be set to this member
+	 */
+	lzds_dataset_get_is_PDS(ds, &ispds);
+	if (ispds) {
+		path_to_member_name(path, normds, sizeof(normds));
+		rc = lzds_dshandle_set_member(dsh, normds);
+		if (rc) {
+			fprintf(stderr,	"Error when preparing member:\n");
+			goto error;
+		}
+	}
+	rc = lzds_dshandle_set_keepRDW(dsh, zdsfsinfo.keepRDW);
+	if (rc) {
+		fprintf(stderr,	"Error when preparing RDW setting:\n");
+		goto error;
+	}
+	rc = lzds_dshandle_set_readahead(dsh, zdsfsinfo.readahead);
+	if (rc) {
+		fprintf(stderr,	"Error when preparing read ahead:\n");
+		goto error;
+	}
+	*dshp = dsh;
+	return 0;
+
+error:
+	lzds_dshandle_get_errorlog(dsh, &log);
+	lzds_errorlog_fprint(log, stderr);
+	lzds_dshandle_free(dsh);
+	return -rc;
+}
+
+static void zdsfs_free_file_info(struct zdsfs_file_info *zfi)
+{
+	int rc;
+
+	rc = pthread_mutex_destroy(&zfi->mutex);
+	if (rc)
+		fprintf(stderr,	"Error: could not destroy mutex, rc=%d\n", rc);
+	pthread_cond_destroy(&zfi->cond);
+	free(zfi->path);
+	free(zfi);
+}
+
 static int zdsfs_open(const char *path, struct fuse_file_info *fi)
 {
 	char normds[45];
@@ -539,7 +734,7 @@ static int zdsfs_open(const char *path, struct fuse_file_info *fi)
 	struct dataset *ds;
 	struct zdsfs_file_info *zfi;
 	int rc;
-	int ispds, issupported;
+	int issupported;
 	struct errorlog *log;
 
 	if ((fi->flags & 3) != O_RDONLY)
@@ -554,14 +749,18 @@ static int zdsfs_open(const char *path, struct fuse_file_info *fi)
 	zfi = malloc(sizeof(*zfi));
 	if (!zfi)
 		return -ENOMEM;
+	memset(zfi, 0, sizeof(*zfi));
 	rc = pthread_mutex_init(&zfi->mutex, NULL);
-	if (rc)
-		goto error1;
+	if (rc) {
+		free(zfi);
+		return -ENOMEM;
+	}
+	pthread_cond_init(&zfi->cond, NULL);
 
 	if (strcmp(path, "/"METADATAFILE) == 0) {
 		rc = zdsfs_update_vtoc();
 		if (rc)
-			return rc;
+			goto error1;
 		zfi->dsh = NULL;
 		zfi->is_metadata_file = 1;
 		zfi->metaread = 0;
@@ -583,43 +782,9 @@ static int zdsfs_open(const char *path, struct fuse_file_info *fi)
 		goto error1;
 	}
 
-	rc = lzds_dataset_alloc_dshandle(ds, zdsfsinfo.tracks_per_frame, &dsh);
-	if (rc) {
-		rc = -rc;
+	rc = zdsfs_alloc_dshandle(ds, path, &dsh);
+	if (rc)
 		goto error1;
-	}
-
-	rc = lzds_dshandle_set_seekbuffer(dsh, zdsfsinfo.seek_buffer_size);
-	if (rc) {
-		fprintf(stderr,	"Error when preparing seek buffer:\n");
-		lzds_dshandle_get_errorlog(dsh, &log);
-		lzds_errorlog_fprint(log, stderr);
-		rc = -rc;
-		goto error2;
-	}
-	/* if the data set is a PDS, then the path must contain a valid
-	 * member name, and the context must be set to this member
-	 */
-	lzds_dataset_get_is_PDS(ds, &ispds);
-	if (ispds) {
-		path_to_member_name(path, normds, sizeof(normds));
-		rc = lzds_dshandle_set_member(dsh, normds);
-		if (rc) {
-			fprintf(stderr,	"Error when preparing member:\n");
-			lzds_dshandle_get_errorlog(dsh, &log);
-			lzds_errorlog_fprint(log, stderr);
-			rc = -rc;
-			goto error2;
-		}
-	}
-	rc = lzds_dshandle_set_keepRDW(dsh, zdsfsinfo.keepRDW);
-	if (rc) {
-		fprintf(stderr,	"Error when preparing RDW setting:\n");
-		lzds_dshandle_get_errorlog(dsh, &log);
-		lzds_errorlog_fprint(log, stderr);
-		rc = -rc;
-		goto error2;
-	}
 
 retry:
 	if (zdsfsinfo.restapi && zdsfsinfo.active_server >= 0) {
@@ -650,6 +815,10 @@ retry:
 	zfi->is_metadata_file = 0;
 	zfi->metaread = 0;
 	zfi->dsh = dsh;
+	zfi->ds = ds;
+	zfi->path = util_strdup(path);
+	zfi->reader[0].dsh = dsh;
+	zfi->nr_readers = 1;
 	fi->fh = (uint64_t)(unsigned long)zfi;
 	return 0;
 
@@ -658,7 +827,7 @@ error3:
 error2:
 	lzds_dshandle_free(dsh);
 error1:
-	free(zfi);
+	zdsfs_free_file_info(zfi);
 	return rc;
 
 }
@@ -666,7 +835,7 @@ error1:
 static int zdsfs_release(const char *UNUSED(path), struct fuse_file_info *fi)
 {
 	struct zdsfs_file_info *zfi;
-	int rc;
+	int i;
 
 	if (!fi->fh)
 		return -EINVAL;
@@ -674,24 +843,94 @@ static int zdsfs_release(const char *UNUSED(path), struct fuse_file_info *fi)
 	if (zfi->dsh) {
 		lzds_rest_release_enq(zfi->dsh,
 				      zdsfsinfo.server[zdsfsinfo.active_server]);
-		lzds_dshandle_close(zfi->dsh);
 		dshlist_remove(open_dsh, zfi->dsh);
-		lzds_dshandle_free(zfi->dsh);
 	}
-	rc = pthread_mutex_destroy(&zfi->mutex);
-	if (rc)
-		fprintf(stderr,	"Error: could not destroy mutex, rc=%d\n", rc);
-	free(zfi);
+	for (i = 0; i < zfi->nr_readers; i++) {
+		lzds_dshandle_close(zfi->reader[i].dsh);
+		lzds_dshandle_free(zfi->reader[i].dsh);
+	}
+	zdsfs_free_file_info(zfi);
 	return 0;
 }
 
+/*
+ * Get an idle reader for a read at offset. A reader that is positioned
+ * at offset is preferred, because it can continue without seeking. Next
+ * best is the reader with the closest position before offset. If all
+ * readers are busy, a new one is added, up to MAX_READERS. The additional
+ * dshandles share the ENQ of the first one.
+ * Must be called with zfi->mutex held.
+ */
+static struct zdsfs_reader *zdsfs_get_reader(struct zdsfs_file_info *zfi,
+					     off_t offset)
+{
+	struct zdsfs_reader *best, *r;
+	long long pos, bestpos;
+	struct dshandle *dsh;
+	struct errorlog *log;
+	int i;
+
+	for (;;) {
+		best = NULL;
+		bestpos = -1;
+		for (i = 0; i < zfi->nr_readers; i++) {
+			r = &zfi->reader[i];
+			if (r->busy)
+				continue;
+			lzds_dshandle_get_offset(r->dsh, &pos);
+			if (pos > offset)
+				pos = -1;
+			if (!best || pos > bestpos) {
+				best = r;
+				bestpos = pos;
+			}
+		}
+		if (best)
+			return best;
+		if (zfi->nr_readers < MAX_READERS &&
+		    !zdsfs_alloc_dshandle(zfi->ds, zfi->path, &dsh)) {
+			if (!lzds_dshandle_open(dsh)) {
+				r = &zfi->reader[zfi->nr_readers++];
+				r->dsh = dsh;
+				return r;
+			}
+			fprintf(stderr,	"Error when opening data set:\n");
+			lzds_dshandle_get_errorlog(dsh, &log);
+			lzds_errorlog_fprint(log, stderr);
+			lzds_dshandle_free(dsh);
+		}
+		/* wait for one of the existing readers */
+		pthread_cond_wait(&zfi->cond, &zfi->mutex);
+	}
+}
+
+/*
+ * Translate len bytes in buf with the code page conversion table.
+ * Each byte is translated to exactly one byte, so file sizes and
+ * offsets are the same with and without conversion.
+ */
+static void zdsfs_convert(char *buf, size_t len)
+{
+#ifdef __s390x__
+	/* TRANSLATE handles up to 256 bytes per instruction */
+	for (; len >= 256; len -= 256, buf += 256)
+		asm volatile("tr	0(256,%[buf]),0(%[table])"
+			     :
+			     : [buf] "a" (buf),
+			       [table] "a" (zdsfsinfo.convtable)
+			     : "memory");
+#endif
+	for (; len; --len, ++buf)
+		*buf = zdsfsinfo.convtable[(unsigned char)*buf];
+}
+
 static int zdsfs_read(const char *UNUSED(path), char *buf, size_t size,
 		      off_t offset, struct fuse_file_info *fi)
 {
 	struct zdsfs_file_info *zfi;
+	struct zdsfs_reader *reader;
 	ssize_t count;
 	int rc, rc2;
-	long long rcoffset;
 	struct errorlog *log;
 
 	if (!fi->fh)
@@ -703,7 +942,6 @@ static int zdsfs_read(const char *UNUSED(path), char *buf, size_t size,
 		fprintf(stderr,	"Error: could not lock mutex, rc=%d\n", rc2);
 		return -EIO;
 	}
-	rc = 0;
 	if (zfi->is_metadata_file) {
 		if (zfi->metaread >= zdsfsinfo.metaused) {
 			pthread_mutex_unlock(&zfi->mutex);
@@ -714,22 +952,32 @@ static int zdsfs_read(const char *UNUSED(path), char *buf, size_t size,
 			count = size;
 		memcpy(buf, &zdsfsinfo.metadata[zfi->metaread], count);
 		zfi->metaread += count;
-	} else {
-		lzds_dshandle_get_offset(zfi->dsh, &rcoffset);
-		if (rcoffset != offset)
-			rc = lzds_dshandle_lseek(zfi->dsh, offset, &rcoffset);
-		if (!rc)
-			rc = lzds_dshandle_read(zfi->dsh, buf, size, &count);
+		pthread_mutex_unlock(&zfi->mutex);
+		return count;
 	}
-	rc2 = pthread_mutex_unlock(&zfi->mutex);
-	if (rc2)
-		fprintf(stderr,	"Error: could not unlock mutex, rc=%d\n", rc2);
+	/* the data set is read without holding the mutex, so that
+	 * concurrent reads with other readers are possible */
+	reader = zdsfs_get_reader(zfi, offset);
+	reader->busy = 1;
+	pthread_mutex_unlock(&zfi->mutex);
+
+	rc = lzds_dshandle_pread(reader->dsh, buf, size, offset, &count);
 	if (rc) {
 		fprintf(stderr,	"Error when reading from data set:\n");
-		lzds_dshandle_get_errorlog(zfi->dsh, &log);
+		lzds_dshandle_get_errorlog(reader->dsh, &log);
 		lzds_errorlog_fprint(log, stderr);
-		return -rc;
+	} else if (zdsfsinfo.ascii) {
+		zdsfs_convert(buf, count);
 	}
+
+	pthread_mutex_lock(&zfi->mutex);
+	reader->busy = 0;
+	pthread_cond_signal(&zfi->cond);
+	rc2 = pthread_mutex_unlock(&zfi->mutex);
+	if (rc2)
+		fprintf(stderr,	"Error: could not unlock mutex, rc=%d\n", rc2);
+	if (rc)
+		return -rc;
 	return count;
 }
 
@@ -1011,6 +1259,8 @@ enum {
 	KEY_DEVFILE,
 	KEY_TRACKS,
 	KEY_SEEKBUFFER,
+	KEY_TRACKCACHE,
+	KEY_METACACHE,
 	KEY_CONFIG,
 	KEY_SERVER,
 };
@@ -1025,9 +1275,15 @@ static const struct fuse_opt zdsfs_opts[] = {
 	FUSE_OPT_KEY("-l %s",		KEY_DEVFILE),
 	FUSE_OPT_KEY("tracks=",         KEY_TRACKS),
 	FUSE_OPT_KEY("seekbuffer=",     KEY_SEEKBUFFER),
+	FUSE_OPT_KEY("trackcache=",     KEY_TRACKCACHE),
+	FUSE_OPT_KEY("metacache=",      KEY_METACACHE),
 	FUSE_OPT_KEY("-c %s",           KEY_CONFIG),
 	FUSE_OPT_KEY("restserver=",     KEY_SERVER),
 	ZDSFS_OPT("rdw",                keepRDW, 1),
+	ZDSFS_OPT("readahead",          readahead, 1),
+	ZDSFS_OPT("ascii",              ascii, 1),
+	ZDSFS_OPT("codepage_from=%s",   codepage_from, 0),
+	ZDSFS_OPT("codepage_to=%s",     codepage_to, 0),
 	ZDSFS_OPT("ignore_incomplete",  allow_inclomplete_multi_volume, 1),
 	ZDSFS_OPT("check_host_count",   host_count, 1),
 	ZDSFS_OPT("restapi",            restapi, 1),
@@ -1053,12 +1309,23 @@ static void usage(const char *progname)
 "    -c config_file         Text file that contains configuration options\n"
 "                           for zdsfs\n"
 "    -o rdw                 Keep record descriptor words in byte stream\n"
+"    -o readahead           Read the next track buffer in the background\n"
+"                           during sequential reads\n"
+"    -o ascii               Convert the data from EBCDIC to ASCII\n"
+"    -o codepage_from=CP    Code page of the data for -o ascii (default\n"
+"                           "CODEPAGE_FROM")\n"
+"    -o codepage_to=CP      Single byte target code page for -o ascii\n"
+"                           (default "CODEPAGE_TO")\n"
 "    -o ignore_incomplete   Continue processing even if parts of a multi"
 " volume\n"
 "                           data set are missing\n"
 "    -o tracks=N            Size of the track buffer in tracks (default 128)\n"
 "    -o seekbuffer=S        Upper limit in bytes for the seek history buffer\n"
 "                           size (default 1048576)\n"
+"    -o trackcache=N        Number of tracks in the track cache shared by all\n"
+"                           open files (default 0, no cache)\n"
+"    -o metacache=FILE      Cache PDS member lists in FILE to speed up the\n"
+"                           next mount\n"
 "    -o check_host_count    Stop processing if the device is used by another\n"
 "                           operating system instance\n"
 "    -o restapi             Enable using z/OSMF REST services for coordinated\n"
@@ -1091,7 +1358,6 @@ static void zdsfs_process_device(const char *device)
 		lzds_errorlog_fprint(log, stderr);
 		exit(1);
 	}
-	zdsfs_read_device(newdasd, device);
 }
 
 static void zdsfs_process_device_file(const char *devfile)
@@ -1158,7 +1424,7 @@ static void zdsfs_process_device_file(const char *devfile)
 				" device list, %s\n", token, strerror(errno));
 			exit(1);
 		}
-		if (S_ISBLK(sb.st_mode))
+		if (S_ISBLK(sb.st_mode) || S_ISREG(sb.st_mode))
 			zdsfs_process_device(token);
 	}
 	free(buffer);
@@ -1231,6 +1497,7 @@ static int zdsfs_process_args(void *UNUSED(data), const char *arg, int key,
 	struct stat sb;
 	unsigned long tracks_per_frame;
 	unsigned long long seek_buffer_size;
+	unsigned long track_cache_size;
 	const char *value;
 	char *endptr;
 
@@ -1243,7 +1510,8 @@ static int zdsfs_process_args(void *UNUSED(data), const char *arg, int key,
 				arg, strerror(errno));
 			return 1;
 		}
-		if (S_ISBLK(sb.st_mode)) {
+		/* a regular file is a DASD image */
+		if (S_ISBLK(sb.st_mode) || S_ISREG(sb.st_mode)) {
 			zdsfs_process_device(arg);
 			return 0;
 		}
@@ -1288,6 +1556,25 @@ static int zdsfs_process_args(void *UNUSED(data), const char *arg, int key,
 		}
 		zdsfsinfo.seek_buffer_size = seek_buffer_size;
 		return 0;
+	case KEY_TRACKCACHE:
+		value = arg + strlen("trackcache=");
+		/* strtoul does not complain about negative values  */
+		if (*value == '-') {
+			errno = EINVAL;
+		} else {
+			errno = 0;
+			track_cache_size = strtoul(value, &endptr, 10);
+		}
+		if (!errno && track_cache_size <= UINT_MAX)
+			zdsfsinfo.track_cache_size = track_cache_size;
+		else
+			errno = ERANGE;
+		if (errno || (endptr && (*endptr != '\0'))) {
+			fprintf(stderr, "Invalid value '%s' for option "
+				"'trackcache'\n", value);
+			exit(1);
+		}
+		return 0;
 	case KEY_HELP:
 		usage(outargs->argv[0]);
 
@@ -1309,6 +1596,9 @@ static int zdsfs_process_args(void *UNUSED(data), const char *arg, int key,
 			", program version %s\n", RELEASE_STRING);
 		fprintf(stdout, "Copyright IBM Corp. 2013, 2017\n");
 		exit(0);
+	case KEY_METACACHE:
+		zdsfsinfo.metacache = util_strdup(arg + strlen("metacache="));
+		return 0;
 	case KEY_CONFIG:
 		/* note that arg starts with "-c" */
 		zdsfsinfo.configfile = util_strdup(arg + 2);
@@ -1328,9 +1618,54 @@ static int zdsfs_process_args(void *UNUSED(data), const char *arg, int key,
 }
 
 
+/*
+ * Build the translation table for -o ascii. iconv is only used here,
+ * reads translate the data with the table.
+ */
+static void zdsfs_setup_conversion(void)
+{
+	size_t inleft, outleft;
+	char in, out[8], *inp, *outp;
+	iconv_t conv;
+	int i;
+
+	if (!zdsfsinfo.codepage_from)
+		zdsfsinfo.codepage_from = CODEPAGE_FROM;
+	if (!zdsfsinfo.codepage_to)
+		zdsfsinfo.codepage_to = CODEPAGE_TO;
+	conv = iconv_open(zdsfsinfo.codepage_to, zdsfsinfo.codepage_from);
+	if (conv == (iconv_t)-1) {
+		fprintf(stderr, "Cannot convert from code page %s to %s: %s\n",
+			zdsfsinfo.codepage_from, zdsfsinfo.codepage_to,
+			strerror(errno));
+		exit(1);
+	}
+	for (i = 0; i < 256; i++) {
+		in = i;
+		inp = &in;
+		inleft = 1;
+		outp = out;
+		outleft = sizeof(out);
+		iconv(conv, NULL, NULL, NULL, NULL);
+		if (iconv(conv, &inp, &inleft, &outp, &outleft) == (size_t)-1) {
+			/* character has no representation in target */
+			zdsfsinfo.convtable[i] = '?';
+			continue;
+		}
+		if (outp - out != 1) {
+			fprintf(stderr, "Code page %s is not a single byte "
+				"code page\n", zdsfsinfo.codepage_to);
+			exit(1);
+		}
+		zdsfsinfo.convtable[i] = out[0];
+	}
+	iconv_close(conv);
+}
+
 int main(int argc, char *argv[])
 {
 	struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+	struct errorlog *log;
 	int rc;
 
 	timer_running = 0;
@@ -1356,12 +1691,42 @@ int main(int argc, char *argv[])
 	}
 	zdsfs_process_config_file(zdsfsinfo.configfile);
 
+	rc = lzds_zdsroot_set_track_cache(zdsfsinfo.zdsroot,
+					  zdsfsinfo.track_cache_size);
+	if (rc) {
+		fprintf(stderr, "Could not allocate track cache\n");
+		exit(1);
+	}
+	if (!zdsfsinfo.ascii &&
+	    (zdsfsinfo.codepage_from || zdsfsinfo.codepage_to)) {
+		fprintf(stderr, "Options codepage_from and codepage_to "
+			"require option ascii\n");
+		exit(1);
+	}
+	if (zdsfsinfo.ascii && zdsfsinfo.keepRDW) {
+		fprintf(stderr, "Options ascii and rdw cannot be combined\n");
+		exit(1);
+	}
+	if (zdsfsinfo.ascii)
+		zdsfs_setup_conversion();
+	if (zdsfsinfo.metacache) {
+		rc = lzds_zdsroot_read_member_cache(zdsfsinfo.zdsroot,
+						    zdsfsinfo.metacache);
+		if (rc) {
+			fprintf(stderr, "Warning: ignoring meta data cache "
+				"%s: %s\n", zdsfsinfo.metacache, strerror(rc));
+			lzds_zdsroot_get_errorlog(zdsfsinfo.zdsroot, &log);
+			lzds_errorlog_fprint(log, stderr);
+		}
+	}
+
 	if (!zdsfsinfo.devcount) {
 		fprintf(stderr, "Please specify a block device\n");
 		fprintf(stderr, "Try '%s --help' for more information\n",
 			argv[0]);
 		exit(1);
 	}
+	zdsfs_read_devices();
 
 	if (zdsfsinfo.host_count) {
 		/* check, print error and exit if multiple online */
@@ -1397,6 +1762,7 @@ cleanup:
 	curl_global_cleanup();
 	dshlist_free(open_dsh);
 	lzds_zdsroot_free(zdsfsinfo.zdsroot);
+	free(zdsfsinfo.metacache);
 
 	fuse_opt_free_args(&args);
 	return rc;
@@ -0,0 +1,286 @@
+/*
+ * zgdgen - Generate synthetic ELF dumps for zgetdump benchmarks
+ *
+ * The generated dump has a configurable memory size, number of memory
+ * chunks, number of CPUs and share of zero pages. It is a valid s390x
+ * ELF core dump that can be read and converted by zgetdump.
+ *
+ * Copyright IBM Corp. 2026
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <elf.h>
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/util_base.h"
+#include "lib/util_libc.h"
+#include "lib/util_opt.h"
+#include "lib/util_prg.h"
+
+#include "df_elf.h"
+
+#define PAGE_SIZE	4096UL
+#define LC_SIZE		0x2000UL	/* Size of 64 bit lowcore */
+
+static struct {
+	unsigned long size_mib;
+	unsigned long chunks;
+	unsigned long cpus;
+	unsigned long zero_pct;
+	const char *file;
+} l = {
+	.size_mib = 64,
+	.chunks = 1,
+	.cpus = 2,
+	.zero_pct = 0,
+};
+
+static struct util_opt opt_vec[] = {
+	UTIL_OPT_SECTION("OPTIONS"),
+	{
+		.option = { "size", required_argument, NULL, 's' },
+		.argument = "MIB",
+		.desc = "Memory size of the dump in MiB (default 64)",
+	},
+	{
+		.option = { "chunks", required_argument, NULL, 'c' },
+		.argument = "NUM",
+		.desc = "Split memory into NUM chunks separated by holes "
+			"(default 1)",
+	},
+	{
+		.option = { "cpus", required_argument, NULL, 'p' },
+		.argument = "NUM",
+		.desc = "Number of CPUs in the dump (default 2)",
+	},
+	{
+		.option = { "zero", required_argument, NULL, 'z' },
+		.argument = "PERCENT",
+		.desc = "Percentage of memory pages that contain zeros "
+			"(default 0)",
+	},
+	UTIL_OPT_HELP,
+	UTIL_OPT_VERSION,
+	UTIL_OPT_END
+};
+
+static const struct util_prg prg = {
+	.desc = "Generate a synthetic s390x ELF dump for zgetdump benchmarks",
+	.args = "FILE",
+	.copyright_vec = {
+		{
+			.owner = "IBM Corp.",
+			.pub_first = 2026,
+			.pub_last = 2026,
+		},
+		UTIL_PRG_COPYRIGHT_END
+	}
+};
+
+static unsigned long parse_num(const char *arg, const char *name)
+{
+	unsigned long val;
+	char *end;
+
+	errno = 0;
+	val = strtoul(arg, &end, 10);
+	if (errno || *end || arg[0] == '-')
+		errx(EXIT_FAILURE, "Invalid value for %s: %s", name, arg);
+	return val;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = util_opt_getopt_long(argc, argv)) != -1) {
+		switch (opt) {
+		case 's':
+			l.size_mib = parse_num(optarg, "--size");
+			break;
+		case 'c':
+			l.chunks = parse_num(optarg, "--chunks");
+			break;
+		case 'p':
+			l.cpus = parse_num(optarg, "--cpus");
+			break;
+		case 'z':
+			l.zero_pct = parse_num(optarg, "--zero");
+			break;
+		case 'h':
+			util_prg_print_help();
+			util_opt_print_help();
+			exit(EXIT_SUCCESS);
+		case 'v':
+			util_prg_print_version();
+			exit(EXIT_SUCCESS);
+		default:
+			util_opt_print_parse_error(opt, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (optind != argc - 1)
+		errx(EXIT_FAILURE, "Specify exactly one output file");
+	l.file = argv[optind];
+	if (!l.size_mib || !l.chunks || !l.cpus)
+		errx(EXIT_FAILURE, "Size, chunks, and CPUs must not be zero");
+	if (l.zero_pct > 100)
+		errx(EXIT_FAILURE, "Zero page percentage must be <= 100");
+}
+
+/*
+ * Add ELF note to buffer and return pointer behind the note
+ */
+static void *nt_add(void *buf, Elf64_Word type, const void *desc, int d_len,
+		    const char *name)
+{
+	Elf64_Nhdr *note = buf;
+	size_t len;
+
+	note->n_namesz = strlen(name) + 1;
+	note->n_descsz = d_len;
+	note->n_type = type;
+	len = sizeof(*note);
+	memcpy(buf + len, name, note->n_namesz);
+	len = ROUNDUP(len + note->n_namesz, 4);
+	memcpy(buf + len, desc, d_len);
+	len = ROUNDUP(len + d_len, 4);
+	return buf + len;
+}
+
+/*
+ * Add notes for all CPUs. Each CPU gets its own lowcore at the start
+ * of the first memory chunk.
+ */
+static size_t notes_init(void *buf)
+{
+	struct nt_fpregset_64 fpregset;
+	struct nt_prstatus_64 prstatus;
+	void *ptr = buf;
+	u32 prefix;
+	unsigned long i;
+
+	for (i = 0; i < l.cpus; i++) {
+		memset(&prstatus, 0, sizeof(prstatus));
+		prstatus.pr_pid = i + 1;
+		prstatus.gprs[15] = i;
+		memset(&fpregset, 0, sizeof(fpregset));
+		prefix = i * LC_SIZE;
+		ptr = nt_add(ptr, NT_PRSTATUS, &prstatus, sizeof(prstatus),
+			     "CORE");
+		ptr = nt_add(ptr, NT_FPREGSET, &fpregset, sizeof(fpregset),
+			     "CORE");
+		ptr = nt_add(ptr, NT_S390_PREFIX, &prefix, sizeof(prefix),
+			     "LINUX");
+	}
+	return ptr - buf;
+}
+
+/*
+ * Fill page with a pattern derived from its address, or with zeros. Of
+ * each 100 pages the first zero_pct pages are zero pages.
+ */
+static void page_fill(u64 *page, u64 addr, unsigned long pg_num)
+{
+	unsigned long i;
+
+	if (pg_num % 100 < l.zero_pct) {
+		memset(page, 0, PAGE_SIZE);
+		return;
+	}
+	for (i = 0; i < PAGE_SIZE / sizeof(u64); i++)
+		page[i] = addr + i * sizeof(u64);
+}
+
+static void write_all(FILE *fh, const void *buf, size_t size)
+{
+	if (fwrite(buf, size, 1, fh) != 1)
+		err(EXIT_FAILURE, "Could not write %s", l.file);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long pages, chunk_pages, pg, pg_num = 0, i;
+	size_t notes_size, hdr_size;
+	Elf64_Phdr *phdr;
+	Elf64_Ehdr ehdr;
+	void *notes;
+	u64 *page;
+	FILE *fh;
+	u64 off;
+
+	util_prg_init(&prg);
+	util_opt_init(opt_vec, NULL);
+	parse_args(argc, argv);
+
+	pages = l.size_mib * (1024 * 1024 / PAGE_SIZE);
+	chunk_pages = pages / l.chunks;
+	if (chunk_pages * PAGE_SIZE < l.cpus * LC_SIZE)
+		errx(EXIT_FAILURE, "Chunks too small for %lu lowcores",
+		     l.cpus);
+
+	notes = util_zalloc(l.cpus * 1024);
+	notes_size = notes_init(notes);
+	hdr_size = sizeof(ehdr) + (l.chunks + 1) * sizeof(*phdr);
+
+	memset(&ehdr, 0, sizeof(ehdr));
+	memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+	ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+	ehdr.e_ident[EI_DATA] = ELFDATA2MSB;
+	ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+	ehdr.e_type = ET_CORE;
+	ehdr.e_machine = EM_S390;
+	ehdr.e_version = EV_CURRENT;
+	ehdr.e_phoff = sizeof(ehdr);
+	ehdr.e_ehsize = sizeof(ehdr);
+	ehdr.e_phentsize = sizeof(*phdr);
+	ehdr.e_phnum = l.chunks + 1;
+
+	/* Chunk i covers [2 * i * chunk size, (2 * i + 1) * chunk size) */
+	phdr = util_zalloc((l.chunks + 1) * sizeof(*phdr));
+	phdr[0].p_type = PT_NOTE;
+	phdr[0].p_offset = hdr_size;
+	phdr[0].p_filesz = notes_size;
+	off = ROUNDUP(hdr_size + notes_size, PAGE_SIZE);
+	for (i = 0; i < l.chunks; i++) {
+		phdr[i + 1].p_type = PT_LOAD;
+		phdr[i + 1].p_flags = PF_R | PF_W | PF_X;
+		phdr[i + 1].p_offset = off;
+		phdr[i + 1].p_paddr = 2 * i * chunk_pages * PAGE_SIZE;
+		phdr[i + 1].p_vaddr = phdr[i + 1].p_paddr;
+		phdr[i + 1].p_filesz = chunk_pages * PAGE_SIZE;
+		phdr[i + 1].p_memsz = phdr[i + 1].p_filesz;
+		off += phdr[i + 1].p_filesz;
+	}
+
+	fh = fopen(l.file, "w");
+	if (!fh)
+		err(EXIT_FAILURE, "Could not open %s", l.file);
+	write_all(fh, &ehdr, sizeof(ehdr));
+	write_all(fh, phdr, (l.chunks + 1) * sizeof(*phdr));
+	write_all(fh, notes, notes_size);
+	page = util_zalloc(PAGE_SIZE);
+	pg = phdr[1].p_offset - hdr_size - notes_size;
+	if (pg)
+		write_all(fh, page, pg);
+	for (i = 0; i < l.chunks; i++) {
+		for (pg = 0; pg < chunk_pages; pg++, pg_num++) {
+			page_fill(page, phdr[i + 1].p_paddr + pg * PAGE_SIZE,
+				  pg_num);
+			write_all(fh, page, PAGE_SIZE);
+		}
+	}
+	if (fclose(fh))
+		err(EXIT_FAILURE, "Could not write %s", l.file);
+	free(page);
+	free(phdr);
+	free(notes);
+	return EXIT_SUCCESS;
+}
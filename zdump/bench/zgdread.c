@@ -0,0 +1,158 @@
+/*
+ * zgdread - Random read workload for zgetdump benchmarks
+ *
+ * Read blocks at random offsets of a file, for example a dump file
+ * mounted with "zgetdump --mount", and print the elapsed time.
+ *
+ * Copyright IBM Corp. 2026
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "lib/util_base.h"
+#include "lib/util_libc.h"
+#include "lib/util_opt.h"
+#include "lib/util_prg.h"
+
+static struct {
+	unsigned long count;
+	unsigned long block;
+	unsigned int seed;
+	const char *file;
+} l = {
+	.count = 10000,
+	.block = 4096,
+	.seed = 1,
+};
+
+static struct util_opt opt_vec[] = {
+	UTIL_OPT_SECTION("OPTIONS"),
+	{
+		.option = { "count", required_argument, NULL, 'n' },
+		.argument = "NUM",
+		.desc = "Number of reads (default 10000)",
+	},
+	{
+		.option = { "block", required_argument, NULL, 'b' },
+		.argument = "BYTES",
+		.desc = "Size of each read (default 4096)",
+	},
+	{
+		.option = { "seed", required_argument, NULL, 'r' },
+		.argument = "NUM",
+		.desc = "Seed for the random offsets (default 1)",
+	},
+	UTIL_OPT_HELP,
+	UTIL_OPT_VERSION,
+	UTIL_OPT_END
+};
+
+static const struct util_prg prg = {
+	.desc = "Read a file at random offsets and print the elapsed time",
+	.args = "FILE",
+	.copyright_vec = {
+		{
+			.owner = "IBM Corp.",
+			.pub_first = 2026,
+			.pub_last = 2026,
+		},
+		UTIL_PRG_COPYRIGHT_END
+	}
+};
+
+static unsigned long parse_num(const char *arg, const char *name)
+{
+	unsigned long val;
+	char *end;
+
+	errno = 0;
+	val = strtoul(arg, &end, 10);
+	if (errno || *end || arg[0] == '-')
+		errx(EXIT_FAILURE, "Invalid value for %s: %s", name, arg);
+	return val;
+}
+
+static void parse_args(int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = util_opt_getopt_long(argc, argv)) != -1) {
+		switch (opt) {
+		case 'n':
+			l.count = parse_num(optarg, "--count");
+			break;
+		case 'b':
+			l.block = parse_num(optarg, "--block");
+			break;
+		case 'r':
+			l.seed = parse_num(optarg, "--seed");
+			break;
+		case 'h':
+			util_prg_print_help();
+			util_opt_print_help();
+			exit(EXIT_SUCCESS);
+		case 'v':
+			util_prg_print_version();
+			exit(EXIT_SUCCESS);
+		default:
+			util_opt_print_parse_error(opt, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (optind != argc - 1)
+		errx(EXIT_FAILURE, "Specify exactly one input file");
+	l.file = argv[optind];
+	if (!l.block)
+		errx(EXIT_FAILURE, "Block size must not be zero");
+}
+
+int main(int argc, char *argv[])
+{
+	struct timespec start, end;
+	unsigned long i, blocks;
+	struct stat sb;
+	double elapsed;
+	off_t off;
+	void *buf;
+	int fd;
+
+	util_prg_init(&prg);
+	util_opt_init(opt_vec, NULL);
+	parse_args(argc, argv);
+
+	fd = open(l.file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &sb))
+		err(EXIT_FAILURE, "Could not open %s", l.file);
+	blocks = sb.st_size / l.block;
+	if (!blocks)
+		errx(EXIT_FAILURE, "File %s is smaller than one block", l.file);
+	buf = util_malloc(l.block);
+	srandom(l.seed);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < l.count; i++) {
+		off = (off_t)(random() % blocks) * l.block;
+		if (pread(fd, buf, l.block, off) != (ssize_t)l.block)
+			err(EXIT_FAILURE, "Could not read %s at offset %lld",
+			    l.file, (long long)off);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%.3f\n", elapsed);
+	free(buf);
+	close(fd);
+	return EXIT_SUCCESS;
+}
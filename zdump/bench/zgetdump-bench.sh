@@ -0,0 +1,143 @@
+#!/bin/bash
+#
+# zgetdump-bench.sh - Measure zgetdump conversion and read performance
+#
+# Generate synthetic dumps in the ELF, s390 single-volume and kdump
+# formats, then time the conversion to each output format, random reads
+# on mounted dumps, and random reads on a dump with many memory chunks.
+#
+# Copyright IBM Corp. 2026
+#
+# s390-tools is free software; you can redistribute it and/or modify
+# it under the terms of the MIT license. See LICENSE for details.
+#
+
+readonly SCRIPTNAME="${0##*/}"
+readonly FORMATS="elf s390 kdump"
+
+ZGETDUMP=zgetdump
+ZGDGEN=./zgdgen
+SIZE=256
+CHUNKS=256
+READS=10000
+WORKDIR=
+
+print_error() {
+	echo "$SCRIPTNAME: $1" >&2
+	exit 1
+}
+
+print_usage() {
+	cat <<EOF
+Usage: $SCRIPTNAME [OPTIONS]
+
+Generate synthetic dumps and measure zgetdump performance.
+
+OPTIONS
+ -z ZGETDUMP  zgetdump binary to measure (default zgetdump)
+ -g ZGDGEN    Dump generator (default ./zgdgen)
+ -s MIB       Memory size of the generated dumps (default 256)
+ -c NUM       Number of memory chunks for the chunk lookup test (default 256)
+ -n NUM       Number of random reads on mounted dumps (default 10000)
+ -w DIR       Directory for the generated dumps (default: temporary)
+ -h           Print this help, then exit
+EOF
+}
+
+on_exit() {
+	if [ -n "$MNT" ] && mountpoint -q "$MNT"; then
+		"$ZGETDUMP" -u "$MNT"
+	fi
+	[ -n "$TMP" ] && rm -rf "$TMP"
+}
+
+# Print elapsed seconds of a command, write its output to file OUT
+elapsed() {
+	local out=$1 TIMEFORMAT=%R
+
+	shift
+	{ time "$@" > "$out" 2>/dev/null ; } 2>&1
+}
+
+# Print throughput in MiB/s for SIZE MiB and elapsed seconds
+rate() {
+	awk -v s="$2" -v t="$1" \
+		'BEGIN { if (t > 0) printf "%.1f", s / t; else print "-" }'
+}
+
+while getopts "z:g:s:c:n:w:h" opt; do
+	case $opt in
+	z) ZGETDUMP=$OPTARG ;;
+	g) ZGDGEN=$OPTARG ;;
+	s) SIZE=$OPTARG ;;
+	c) CHUNKS=$OPTARG ;;
+	n) READS=$OPTARG ;;
+	w) WORKDIR=$OPTARG ;;
+	h) print_usage; exit 0 ;;
+	*) print_usage >&2; exit 1 ;;
+	esac
+done
+ZGDREAD="$(dirname "$ZGDGEN")/zgdread"
+
+[ "$(uname -m)" = "s390x" ] || print_error "zgetdump requires s390x"
+[ -x "$ZGDGEN" ] || print_error "Generator $ZGDGEN not found"
+[ -x "$ZGDREAD" ] || print_error "Read tool $ZGDREAD not found"
+
+if [ -z "$WORKDIR" ]; then
+	TMP="$(mktemp -d)" || print_error "Could not create temporary directory"
+	WORKDIR=$TMP
+fi
+trap on_exit EXIT
+
+echo "Generating ${SIZE} MiB dumps in $WORKDIR"
+"$ZGDGEN" -s "$SIZE" -z 25 "$WORKDIR/in.elf" ||
+	print_error "Could not generate ELF dump"
+"$ZGDGEN" -s "$SIZE" -c "$CHUNKS" -z 25 "$WORKDIR/in-chunks.elf" ||
+	print_error "Could not generate ELF dump with $CHUNKS chunks"
+for fmt in s390 kdump; do
+	"$ZGETDUMP" -f $fmt "$WORKDIR/in.elf" > "$WORKDIR/in.$fmt" ||
+		print_error "Could not generate $fmt dump"
+done
+INPUTS="in.elf in.s390 in.kdump in-chunks.elf"
+
+echo
+echo "Conversion (seconds, MiB/s):"
+printf "%-16s" "input"
+for fmt in $FORMATS; do
+	printf "%20s" "$fmt"
+done
+echo
+for in in $INPUTS; do
+	printf "%-16s" "$in"
+	for fmt in $FORMATS; do
+		t=$(elapsed "$WORKDIR/out" "$ZGETDUMP" -f $fmt "$WORKDIR/$in")
+		printf "%12s %7s" "$t" "$(rate "$t" "$SIZE")"
+		rm -f "$WORKDIR/out"
+	done
+	echo
+done
+
+# Random reads on in-chunks.elf compared to in.elf show the cost of the
+# memory chunk lookup. A "-" means that mounting is not supported.
+echo
+echo "Random 4 KiB reads on mounted dumps ($READS reads, seconds):"
+printf "%-16s" "input"
+for fmt in $FORMATS; do
+	printf "%10s" "$fmt"
+done
+echo
+MNT="$WORKDIR/mnt"
+mkdir -p "$MNT"
+for in in $INPUTS; do
+	printf "%-16s" "$in"
+	for fmt in $FORMATS; do
+		if "$ZGETDUMP" -m "$WORKDIR/$in" -f $fmt "$MNT" 2>/dev/null; then
+			t=$("$ZGDREAD" -n "$READS" "$MNT/dump.$fmt")
+			"$ZGETDUMP" -u "$MNT"
+		else
+			t="-"
+		fi
+		printf "%10s" "$t"
+	done
+	echo
+done
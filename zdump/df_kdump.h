@@ -0,0 +1,90 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * kdump (diskdump) dump format definitions
+ *
+ * Copyright IBM Corp. 2001, 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef DF_KDUMP_H
+#define DF_KDUMP_H
+
+#include <linux/utsname.h>
+#include <sys/time.h>
+
+#include "lib/zt_common.h"
+
+#define DF_KDUMP_SIGNATURE		"KDUMP   "
+#define DF_KDUMP_HDR_VERSION		6
+
+#define DF_KDUMP_DH_COMPRESSED_ZLIB	0x1	/* Page is zlib compressed */
+
+/*
+ * kdump (diskdump) main header
+ */
+struct df_kdump_hdr {
+	char			signature[8];
+	int			header_version;
+	struct new_utsname	utsname;
+	struct timeval		timestamp;
+	unsigned int		status;
+	int			block_size;
+	int			sub_hdr_size;
+	unsigned int		bitmap_blocks;
+	unsigned int		max_mapnr;
+	unsigned int		total_ram_blocks;
+	unsigned int		device_blocks;
+	unsigned int		written_blocks;
+	unsigned int		current_cpu;
+	int			nr_cpus;
+	void			*tasks[0];
+};
+
+/*
+ * kdump sub header
+ */
+struct df_kdump_sub_hdr {
+	unsigned long	phys_base;
+	int		dump_level;
+	int		split;
+	unsigned long	start_pfn;
+	unsigned long	end_pfn;
+	off_t		offset_vmcoreinfo;	/* Version 3 and later */
+	unsigned long	size_vmcoreinfo;
+	off_t		offset_note;		/* Version 4 and later */
+	unsigned long	size_note;
+	off_t		offset_eraseinfo;	/* Version 5 and later */
+	unsigned long	size_eraseinfo;
+	u64		start_pfn_64;		/* Version 6 and later */
+	u64		end_pfn_64;
+	u64		max_mapnr_64;
+};
+
+/*
+ * kdump page descriptor
+ */
+struct df_kdump_page_desc {
+	off_t		offset;		/* Offset of page data in dump */
+	unsigned int	size;		/* Size of page data */
+	unsigned int	flags;		/* DF_KDUMP_DH_xxx flags */
+	u64		page_flags;	/* Page flags */
+};
+
+/*
+ * makedumpfile flattened format header
+ */
+struct df_kdump_flat_hdr {
+	char	signature[16];
+	u64	type;
+	u64	version;
+};
+
+struct df_kdump_flat_data_hdr {
+	s64	offs;
+	s64	size;
+};
+
+#endif /* DF_KDUMP_H */
@@ -142,5 +142,7 @@ extern void dt_s390mv_info(void);
 extern int dfi_s390_init_gen(bool extended);
 extern int dfi_s390mv_init_gen(bool extended);
 extern void dfi_s390mv_info(void);
+extern int dfi_s390mv_check(void);
+extern void dfi_s390mv_exit(void);
 
 #endif /* DF_S390_H */
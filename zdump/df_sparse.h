@@ -0,0 +1,45 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * Sparse zfcpdump partition dump format definitions
+ *
+ * Copyright IBM Corp. 2026
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef DF_SPARSE_H
+#define DF_SPARSE_H
+
+#include "lib/zt_common.h"
+
+#define DF_SPARSE_MAGIC		0x5a53504152534544ULL /* ZSPARSED */
+#define DF_SPARSE_VERSION	1
+#define DF_SPARSE_HDR_SIZE	0x1000
+
+/*
+ * Sparse dump header
+ *
+ * The sparse dump contains the ELF headers and notes of the /proc/vmcore
+ * file written by zfcpdump unchanged. The rest of the vmcore file is
+ * split into pages and only pages that are not zero are stored in the
+ * data area. Bit n of the bitmap (byte n / 8, bit n % 8 starting with the
+ * least significant bit) is set if the vmcore page at load_off + n *
+ * page_size is stored.
+ */
+struct df_sparse_hdr {
+	u64	magic;
+	u32	version;
+	u32	page_size;
+	u64	elf_off;	/* ELF headers and notes in dump */
+	u64	elf_size;
+	u64	load_off;	/* Start of sparse area in vmcore */
+	u64	load_size;
+	u64	bitmap_off;	/* Bitmap of stored pages in dump */
+	u64	bitmap_size;
+	u64	data_off;	/* Stored pages in dump */
+	u64	page_cnt;
+} __packed;
+
+#endif /* DF_SPARSE_H */
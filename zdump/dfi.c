@@ -10,10 +10,13 @@
  */
 
 #include <time.h>
+#include <zlib.h>
+
 #include "zgetdump.h"
 
 #define TIME_FMT_STR "%a, %d %b %Y %H:%M:%S %z"
 #define PROGRESS_HASH_CNT 50
+#define ZERO_EXCLUDE_BLK_SIZE MIB
 
 /*
  * DFI vector - ensure that tape is the first in the list and devmem the second!
@@ -26,6 +29,7 @@ static struct dfi *dfi_vec[] = {
 	&dfi_s390_ext,
 	&dfi_s390,
 	&dfi_lkcd,
+	&dfi_sparse,
 	&dfi_elf,
 	&dfi_kdump,
 	&dfi_kdump_flat,
@@ -52,6 +56,8 @@ struct cpus {
  */
 struct mem {
 	struct dfi_mem_chunk	*chunk_cache;
+	struct dfi_mem_chunk	**chunk_vec;	/* Sorted lookup index */
+	unsigned int		chunk_vec_cnt;
 	u64			start_addr;
 	u64			end_addr;
 	unsigned int		chunk_cnt;
@@ -116,6 +122,8 @@ static void mem_init(struct mem *mem)
 {
 	mem->start_addr = U64_MAX;
 	mem->end_addr = 0;
+	mem->chunk_vec = NULL;
+	mem->chunk_vec_cnt = 0;
 	util_list_init(&mem->chunk_list, struct dfi_mem_chunk, list);
 }
 
@@ -130,6 +138,51 @@ static int mem_chunk_cmp_fn(void *a, void *b, void *UNUSED(data))
 	return mem_chunk1->start < mem_chunk2->start ? -1 : 1;
 }
 
+/*
+ * Memory chunk compare function for index sorting
+ */
+static int mem_chunk_vec_cmp_fn(const void *a, const void *b)
+{
+	const struct dfi_mem_chunk *mem_chunk1 = *(struct dfi_mem_chunk **) a;
+	const struct dfi_mem_chunk *mem_chunk2 = *(struct dfi_mem_chunk **) b;
+
+	if (mem_chunk1->start == mem_chunk2->start)
+		return 0;
+	return mem_chunk1->start < mem_chunk2->start ? -1 : 1;
+}
+
+/*
+ * Invalidate the memory chunk lookup index
+ */
+static void mem_index_invalidate(struct mem *mem)
+{
+	zg_free(mem->chunk_vec);
+	mem->chunk_vec = NULL;
+	mem->chunk_vec_cnt = 0;
+}
+
+/*
+ * Build the memory chunk lookup index
+ *
+ * The index is an array of all memory chunks sorted by start address
+ * that allows to find the chunk for an address with binary search.
+ */
+static void mem_index_build(struct mem *mem)
+{
+	struct dfi_mem_chunk *mem_chunk;
+	unsigned int i = 0;
+
+	mem_index_invalidate(mem);
+	if (mem->chunk_cnt == 0)
+		return;
+	mem->chunk_vec = zg_alloc(mem->chunk_cnt * sizeof(*mem->chunk_vec));
+	util_list_iterate(&mem->chunk_list, mem_chunk)
+		mem->chunk_vec[i++] = mem_chunk;
+	qsort(mem->chunk_vec, i, sizeof(*mem->chunk_vec),
+	      mem_chunk_vec_cmp_fn);
+	mem->chunk_vec_cnt = i;
+}
+
 /*
  * Update DFI memory chunks
  */
@@ -144,6 +197,8 @@ static void mem_update(struct mem *mem)
 		mem->start_addr = MIN(mem->start_addr, mem_chunk->start);
 		mem->end_addr = MAX(mem->end_addr, mem_chunk->end);
 	}
+	mem->chunk_cache = util_list_start(&mem->chunk_list);
+	mem_index_build(mem);
 }
 
 /*
@@ -296,6 +351,8 @@ static void mem_chunk_create(struct mem *mem, u64 start, u64 size, void *data,
 	mem->end_addr = MAX(mem->end_addr, mem_chunk->end);
 	mem->chunk_cache = mem_chunk;
 	mem->chunk_cnt++;
+	/* The index is rebuilt on the next lookup */
+	mem_index_invalidate(mem);
 }
 
 /*
@@ -308,20 +365,37 @@ static int mem_chunk_has_addr(struct dfi_mem_chunk *mem_chunk, u64 addr)
 
 /*
  * Find memory chunk that contains address
+ *
+ * First check the last found chunk, then do a binary search on the
+ * sorted chunk index for the last chunk that starts at or below "addr".
  */
 static struct dfi_mem_chunk *mem_chunk_find(struct mem *mem, u64 addr)
 {
 	struct dfi_mem_chunk *mem_chunk;
+	unsigned int low, high, mid;
 
-	if (mem_chunk_has_addr(mem->chunk_cache, addr))
+	if (mem->chunk_cache && mem_chunk_has_addr(mem->chunk_cache, addr))
 		return mem->chunk_cache;
-	util_list_iterate(&mem->chunk_list, mem_chunk) {
-		if (mem_chunk_has_addr(mem_chunk, addr)) {
-			mem->chunk_cache = mem_chunk;
-			return mem_chunk;
-		}
+	if (mem->chunk_cnt == 0)
+		return NULL;
+	if (!mem->chunk_vec)
+		mem_index_build(mem);
+	if (addr < mem->start_addr || addr > mem->end_addr)
+		return NULL;
+	low = 0;
+	high = mem->chunk_vec_cnt;
+	while (high - low > 1) {
+		mid = low + (high - low) / 2;
+		if (mem->chunk_vec[mid]->start <= addr)
+			low = mid;
+		else
+			high = mid;
 	}
-	return NULL;
+	mem_chunk = mem->chunk_vec[low];
+	if (!mem_chunk_has_addr(mem_chunk, addr))
+		return NULL;
+	mem->chunk_cache = mem_chunk;
+	return mem_chunk;
 }
 
 /*
@@ -1046,7 +1120,11 @@ static void mem_unmap(u64 start, u64 size)
 free:
 		util_list_remove(&l.mem_virt.chunk_list, mem_chunk);
 		l.mem_virt.chunk_cnt--;
-		if (mem_chunk->data && mem_chunk->free_fn)
+		if (l.mem_virt.chunk_cache == mem_chunk)
+			l.mem_virt.chunk_cache = NULL;
+		mem_index_invalidate(&l.mem_virt);
+		/* Only map chunks own their data, others share it with phys */
+		if (mem_chunk_is_map(mem_chunk) && mem_chunk->free_fn)
 			mem_chunk->free_fn(mem_chunk->data);
 		zg_free(mem_chunk);
 	}
@@ -1074,6 +1152,9 @@ static void kdump_init(void)
 {
 	unsigned long base, size;
 
+	/* Dumps created with "--range" might not contain the lowcore */
+	if (!dfi_mem_range_valid(0x10418, sizeof(base) + sizeof(size)))
+		return;
 	dfi_mem_phys_read(0x10418, &base, sizeof(base));
 	dfi_mem_phys_read(0x10420, &size, sizeof(size));
 	if (base == 0 || size == 0)
@@ -1171,6 +1252,104 @@ static void livedump_init(void)
 		dfi_attr_dump_method_set(DFI_DUMP_METHOD_LIVE);
 }
 
+/*
+ * Compare function for sorting "--range" options by start address
+ */
+static int range_cmp_fn(const void *a, const void *b)
+{
+	const struct opts_range *r1 = a, *r2 = b;
+
+	if (r1->start < r2->start)
+		return -1;
+	return r1->start > r2->start;
+}
+
+/*
+ * Remove all memory outside of the ranges specified with "--range"
+ */
+static void mem_range_select(void)
+{
+	struct opts_range *range_vec = g.opts.range_vec;
+	u64 addr = 0;
+	int i;
+
+	qsort(range_vec, g.opts.range_cnt, sizeof(range_vec[0]), range_cmp_fn);
+	for (i = 0; i < g.opts.range_cnt; i++) {
+		if (range_vec[i].start > addr)
+			mem_unmap(addr, range_vec[i].start - addr);
+		if (range_vec[i].end == U64_MAX)
+			return;
+		addr = MAX(addr, range_vec[i].end + 1);
+	}
+	mem_unmap(addr, U64_MAX - addr);
+}
+
+/*
+ * Remove all memory blocks that contain only zeros ("--exclude zero")
+ *
+ * The memory is scanned in blocks of ZERO_EXCLUDE_BLK_SIZE to avoid
+ * splitting the memory into too many chunks.
+ */
+static void mem_zero_exclude(void)
+{
+	struct opts_range *zero_vec = NULL;
+	struct dfi_mem_chunk *mem_chunk;
+	unsigned int i, cnt = 0, max = 0;
+	u64 off, len, addr, size;
+	char *buf;
+
+	buf = zg_alloc(ZERO_EXCLUDE_BLK_SIZE);
+	zg_progress_init("Scanning dump for zero memory", l.mem_virt.end_addr);
+	util_list_iterate(&l.mem_virt.chunk_list, mem_chunk) {
+		size = mem_chunk->end - mem_chunk->start + 1;
+		for (off = 0; off < size; off += len) {
+			len = MIN(size - off, (u64) ZERO_EXCLUDE_BLK_SIZE);
+			mem_chunk->read_fn(mem_chunk, off, buf, len);
+			if (!zg_buf_is_zero(buf, len))
+				continue;
+			addr = mem_chunk->start + off;
+			if (cnt && zero_vec[cnt - 1].end + 1 == addr) {
+				zero_vec[cnt - 1].end = addr + len - 1;
+				continue;
+			}
+			if (cnt == max) {
+				max = max ? max * 2 : 64;
+				zero_vec = zg_realloc(zero_vec,
+						      max * sizeof(*zero_vec));
+			}
+			zero_vec[cnt].start = addr;
+			zero_vec[cnt].end = addr + len - 1;
+			cnt++;
+		}
+		zg_progress(mem_chunk->end);
+	}
+	STDERR("\n");
+	for (i = 0; i < cnt; i++)
+		mem_unmap(zero_vec[i].start,
+			  zero_vec[i].end - zero_vec[i].start + 1);
+	zg_free(zero_vec);
+	zg_free(buf);
+}
+
+/*
+ * Apply "--range" and "--exclude" options
+ */
+static void mem_select_init(void)
+{
+	if (!g.opts.range_cnt && !g.opts.exclude_zero)
+		return;
+	if (!dfi_feat_seek())
+		ERR_EXIT("The \"--range\" and \"--exclude\" options are not "
+			 "possible with %s dumps", dfi_name());
+	if (g.opts.range_cnt)
+		mem_range_select();
+	if (g.opts.exclude_zero)
+		mem_zero_exclude();
+	if (dfi_mem_range() == 0)
+		ERR_EXIT("No dump memory left after applying the \"--range\" "
+			 "and \"--exclude\" options");
+}
+
 /*
  * Open the dump
  *
@@ -1218,6 +1397,8 @@ int dfi_init(void)
 			utsname_init();
 			livedump_init();
 		}
+		if (rc == 0)
+			mem_select_init();
 		if (rc == 0 || rc == -EINVAL)
 			return rc;
 		zg_close(g.fh);
@@ -1226,6 +1407,43 @@ int dfi_init(void)
 	ERR_EXIT("No valid dump found on \"%s\"", g.opts.device);
 }
 
+/*
+ * Read all memory chunks that are stored in the dump
+ */
+static int mem_check(void)
+{
+	struct dfi_mem_chunk *mem_chunk;
+	uLong crc = crc32(0, NULL, 0);
+	u64 off, len, size, total = 0;
+	void *buf = zg_alloc(MIB);
+
+	dfi_mem_chunk_iterate(mem_chunk) {
+		if (mem_chunk->read_fn == dfi_mem_chunk_read_zero)
+			continue;
+		size = mem_chunk->end - mem_chunk->start + 1;
+		for (off = 0; off < size; off += len) {
+			len = MIN(size - off, (u64) MIB);
+			mem_chunk->read_fn(mem_chunk, off, buf, len);
+			crc = crc32(crc, buf, len);
+		}
+		total += size;
+	}
+	zg_free(buf);
+	STDERR("\nDump data check:\n");
+	STDERR("  %llu MB read, CRC32 %08lx\n", TO_MIB(total), crc);
+	return 0;
+}
+
+/*
+ * Verify that all dump data can be read (--check option)
+ */
+int dfi_check(void)
+{
+	if (l.dfi->check)
+		return l.dfi->check();
+	return mem_check();
+}
+
 /*
  * Cleanup input dump format.
  */
@@ -12,6 +12,7 @@
 #ifndef DFI_H
 #define DFI_H
 
+#include <elf.h>
 #include <linux/utsname.h>
 
 #include "lib/zt_common.h"
@@ -251,6 +252,14 @@ extern int dfi_feat_copy(void);
  */
 extern unsigned long dfi_kdump_base(void);
 
+/*
+ * DFI ELF functions
+ */
+typedef int (*dfi_elf_load_add_fn)(Elf64_Phdr *phdr);
+
+extern int dfi_elf_hdr_init(u64 off, dfi_elf_load_add_fn load_add_fn,
+			    unsigned int *version);
+
 /*
  * DFI vmcoreinfo functions
  */
@@ -271,12 +280,14 @@ struct dfi {
 	int		(*init)(void);
 	void		(*exit)(void);
 	void		(*info_dump)(void);
+	int		(*check)(void);
 	int		feat_bits;
 };
 
 extern const char *dfi_name(void);
 extern int dfi_init(void);
 extern void dfi_exit(void);
+extern int dfi_check(void);
 
 /*
  * Dump access
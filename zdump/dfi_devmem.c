@@ -36,31 +36,47 @@ static void add_live_magic(void *buf, u64 off, u64 cnt)
 /*
  * "devmem" mem chunk read callback
  *
- * This functions reads page wise in order to detect unreadable pages
+ * The memory is read in large blocks. Pages that cannot be read, which can
+ * happen when using CMM, make the read fail with EFAULT. In that case the
+ * page at the current position is read separately and zero-filled if it is
+ * unreadable, then large block reads continue after it.
  */
 static void dfi_devmem_mem_chunk_read(struct dfi_mem_chunk *mem_chunk, u64 off,
 				      void *buf, u64 cnt)
 {
-	u64 copied = 0, len = PAGE_SIZE;
-	(void) mem_chunk;
+	u64 copied = 0, addr, len;
+	ssize_t rc;
 
-	if (off % PAGE_SIZE)
-		len = MIN(len, PAGE_SIZE - off % PAGE_SIZE);
-	len = MIN(len, cnt);
-	do {
-		zg_seek(g.fh, mem_chunk->start + off + copied, ZG_CHECK);
-		if (zg_read(g.fh, buf + copied, len, ZG_CHECK_NONE) < 0) {
-			if (errno == EFAULT) {
-				/* This can happen when using CMM */
-				memset(buf + copied, 0, len);
-			} else {
+	/* The device is never mapped, so read it directly */
+	while (copied < cnt) {
+		addr = mem_chunk->start + off + copied;
+		rc = pread(g.fh->fh, buf + copied, cnt - copied, addr);
+		if (rc > 0) {
+			copied += rc;
+			continue;
+		}
+		if (rc == 0)
+			ERR_EXIT("Unexpected end of file for %s",
+				 g.opts.device);
+		if (errno == EINTR)
+			continue;
+		if (errno != EFAULT)
+			ERR_EXIT_ERRNO("Could not read %s", g.opts.device);
+		/* The first page of the block is unreadable or partially
+		 * readable, so read it on its own */
+		len = MIN(PAGE_SIZE - addr % PAGE_SIZE, cnt - copied);
+		do {
+			rc = pread(g.fh->fh, buf + copied, len, addr);
+		} while (rc < 0 && errno == EINTR);
+		if (rc < 0) {
+			if (errno != EFAULT)
 				ERR_EXIT_ERRNO("Could not read %s",
 					       g.opts.device);
-			}
+			rc = 0;
 		}
+		memset(buf + copied + rc, 0, len - rc);
 		copied += len;
-		len = MIN(PAGE_SIZE, cnt - copied);
-	} while (len);
+	}
 	add_live_magic(buf, mem_chunk->start + off, cnt);
 }
 
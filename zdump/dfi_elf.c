@@ -42,16 +42,20 @@ static int pt_load_add(Elf64_Phdr *phdr)
 		STDERR("Dump file \"%s\" is a user space core dump\n",
 		      g.opts.device);
 	}
-	if (phdr->p_filesz == 0) {
-		/* Add zero memory chunk */
-		dfi_mem_chunk_add(phdr->p_paddr, phdr->p_memsz, NULL,
-				  dfi_mem_chunk_read_zero, NULL);
-	} else {
+	if (phdr->p_filesz > phdr->p_memsz)
+		return -EINVAL;
+	if (phdr->p_filesz != 0) {
 		off_ptr = zg_alloc(sizeof(*off_ptr));
 		*off_ptr = phdr->p_offset;
-		dfi_mem_chunk_add(phdr->p_paddr, phdr->p_memsz, off_ptr,
+		dfi_mem_chunk_add(phdr->p_paddr, phdr->p_filesz, off_ptr,
 				  dfi_elf_mem_chunk_read_fn, zg_free);
 	}
+	if (phdr->p_filesz != phdr->p_memsz) {
+		/* Add zero memory chunk for memory not contained in file */
+		dfi_mem_chunk_add(phdr->p_paddr + phdr->p_filesz,
+				  phdr->p_memsz - phdr->p_filesz, NULL,
+				  dfi_mem_chunk_read_zero, NULL);
+	}
 	if (phdr->p_offset + phdr->p_filesz > zg_size(g.fh))
 		return -EINVAL;
 	return 0;
@@ -200,7 +204,7 @@ static int nt_s390_vxrs_high_read(struct dfi_cpu *cpu, Elf64_Nhdr *note)
 /*
  * Add all notes for notes phdr
  */
-static int pt_notes_add(Elf64_Phdr *phdr)
+static int pt_notes_add(Elf64_Phdr *phdr, u64 off)
 {
 	u64 start_off = zg_tell(g.fh, ZG_CHECK);
 	struct dfi_cpu *cpu_current = NULL;
@@ -208,7 +212,7 @@ static int pt_notes_add(Elf64_Phdr *phdr)
 	Elf64_Nhdr note;
 	int rc;
 
-	zg_seek(g.fh, phdr->p_offset, ZG_CHECK);
+	zg_seek(g.fh, off + phdr->p_offset, ZG_CHECK);
 	notes_start_off = zg_tell(g.fh, ZG_CHECK);
 	while (zg_tell(g.fh, ZG_CHECK) - notes_start_off < phdr->p_filesz) {
 		rc = zg_read(g.fh, &note, sizeof(note), ZG_CHECK_ERR);
@@ -267,10 +271,11 @@ static int pt_notes_add(Elf64_Phdr *phdr)
 /*
  * Read ELF header
  */
-static int read_elf_hdr(Elf64_Ehdr *ehdr)
+static int read_elf_hdr(Elf64_Ehdr *ehdr, u64 off)
 {
-	if (zg_size(g.fh) < sizeof(*ehdr))
+	if (zg_size(g.fh) < off + sizeof(*ehdr))
 		return -ENODEV;
+	zg_seek(g.fh, off, ZG_CHECK);
 	zg_read(g.fh, ehdr, sizeof(*ehdr), ZG_CHECK);
 	if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0)
 		return -ENODEV;
@@ -282,15 +287,17 @@ static int read_elf_hdr(Elf64_Ehdr *ehdr)
 }
 
 /*
- * Initialize ELF input dump format
+ * Read ELF header at offset "off" and add CPUs from the notes. Memory
+ * chunks for the loads are added by "load_add_fn".
  */
-static int dfi_elf_init(void)
+int dfi_elf_hdr_init(u64 off, dfi_elf_load_add_fn load_add_fn,
+		     unsigned int *version)
 {
 	Elf64_Ehdr ehdr;
 	Elf64_Phdr phdr;
 	int i;
 
-	if (read_elf_hdr(&ehdr) != 0)
+	if (read_elf_hdr(&ehdr, off) != 0)
 		return -ENODEV;
 
 	df_elf_ensure_s390x();
@@ -301,18 +308,33 @@ static int dfi_elf_init(void)
 		zg_read(g.fh, &phdr, sizeof(phdr), ZG_CHECK);
 		switch (phdr.p_type) {
 		case PT_LOAD:
-			if (pt_load_add(&phdr))
+			if (load_add_fn(&phdr))
 				return -EINVAL;
 			break;
 		case PT_NOTE:
-			if (pt_notes_add(&phdr))
+			if (pt_notes_add(&phdr, off))
 				return -EINVAL;
 			break;
 		default:
 			break;
 		}
 	}
-	dfi_attr_version_set(ehdr.e_ident[EI_VERSION]);
+	*version = ehdr.e_ident[EI_VERSION];
+	return 0;
+}
+
+/*
+ * Initialize ELF input dump format
+ */
+static int dfi_elf_init(void)
+{
+	unsigned int version;
+	int rc;
+
+	rc = dfi_elf_hdr_init(0, pt_load_add, &version);
+	if (rc)
+		return rc;
+	dfi_attr_version_set(version);
 	return 0;
 }
 
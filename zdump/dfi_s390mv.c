@@ -13,6 +13,7 @@
 #include <err.h>
 #include <fcntl.h>
 #include <linux/fs.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -20,6 +21,7 @@
 #include <sys/sysmacros.h>
 #include <time.h>
 #include <unistd.h>
+#include <zlib.h>
 
 #include "lib/util_file.h"
 #include "lib/util_path.h"
@@ -27,6 +29,45 @@
 #include "zgetdump.h"
 #include "dfi_s390mv.h"
 
+#define RA_BUF_SIZE	MIB
+#define RA_BUF_CNT_MAX	8
+#define RA_MEM_MAX	(64 * MIB)
+
+/*
+ * Volume readahead
+ *
+ * When copying a dump, each volume gets a thread that reads the dump data
+ * of the volume into a window of "buf_cnt" blocks ahead of the copy. The
+ * threads of all volumes run in parallel, so the next volumes are already
+ * read while the current one is copied.
+ */
+struct vol_ra {
+	pthread_t	thread;
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	char		*buf_vec[RA_BUF_CNT_MAX];
+	unsigned int	buf_cnt;
+	int		active;
+	int		stop;		/* Set to terminate the thread */
+	off_t		start;		/* Device offset of readahead area */
+	u64		size;		/* Size of readahead area */
+	u64		blk_cnt;	/* Number of blocks in readahead area */
+	u64		blk_first;	/* First block of window */
+	u64		blk_fill;	/* Next block to be filled */
+	u64		gen;		/* Incremented when window is moved */
+};
+
+/*
+ * Volume data check (--check option)
+ */
+struct vol_check {
+	pthread_t	thread;
+	u64		bytes;		/* Number of bytes read */
+	uLong		crc;		/* CRC32 of the data read */
+	int		err;		/* errno of failed read or 0 */
+	off_t		err_off;	/* Device offset of failed read */
+};
+
 /*
  * Volume information
  */
@@ -38,6 +79,7 @@ struct vol {
 	enum dev_sign		sign;
 	off_t			part_off;
 	u64			part_size;
+	off_t			data_end;
 	u64			mem_start;
 	u64			mem_end;
 	char			bus_id[10];
@@ -45,6 +87,8 @@ struct vol {
 	u16			blk_size;
 	struct df_s390_dumper	dumper;
 	struct df_s390_hdr	hdr;
+	struct vol_ra		ra;
+	struct vol_check	check;
 };
 
 /*
@@ -211,6 +255,256 @@ static void vol_read(struct vol *vol)
 	zg_read(vol->fh, &vol->hdr, DF_S390_HDR_SIZE, ZG_CHECK);
 }
 
+/*
+ * Read block of readahead area without changing the file position
+ */
+static void vol_ra_blk_read(struct vol *vol, u64 blk, char *buf)
+{
+	struct vol_ra *ra = &vol->ra;
+	u64 cnt, copied = 0;
+	off_t off;
+	ssize_t rc;
+
+	off = ra->start + blk * RA_BUF_SIZE;
+	cnt = MIN((u64) RA_BUF_SIZE, ra->size - blk * RA_BUF_SIZE);
+	do {
+		rc = pread(vol->fh->fh, buf + copied, cnt - copied,
+			   off + copied);
+		if (rc == -1)
+			ERR_EXIT_ERRNO("Could not read \"%s\"", vol->fh->path);
+		if (rc == 0)
+			ERR_EXIT("Unexpected end of file for \"%s\"",
+				 vol->fh->path);
+		copied += rc;
+	} while (copied != cnt);
+}
+
+/*
+ * Volume readahead thread: Fill the blocks of the readahead window
+ */
+static void *vol_ra_thread(void *arg)
+{
+	struct vol *vol = arg;
+	struct vol_ra *ra = &vol->ra;
+	u64 blk, gen;
+
+	pthread_mutex_lock(&ra->mutex);
+	while (1) {
+		while (!ra->stop && (ra->blk_fill == ra->blk_cnt ||
+				     ra->blk_fill == ra->blk_first + ra->buf_cnt))
+			pthread_cond_wait(&ra->cond, &ra->mutex);
+		if (ra->stop)
+			break;
+		blk = ra->blk_fill;
+		gen = ra->gen;
+		pthread_mutex_unlock(&ra->mutex);
+
+		vol_ra_blk_read(vol, blk, ra->buf_vec[blk % ra->buf_cnt]);
+
+		pthread_mutex_lock(&ra->mutex);
+		/* Discard block if the window has been moved meanwhile */
+		if (gen == ra->gen)
+			ra->blk_fill = blk + 1;
+		pthread_cond_broadcast(&ra->cond);
+	}
+	pthread_mutex_unlock(&ra->mutex);
+	return NULL;
+}
+
+/*
+ * Copy data from the readahead window
+ *
+ * Blocks before the requested data are released. If the data is beyond
+ * the window, the window is moved forward.
+ */
+static void vol_ra_copy(struct vol *vol, off_t off, void *buf, u64 cnt)
+{
+	struct vol_ra *ra = &vol->ra;
+	u64 blk, blk_off, len;
+
+	while (cnt) {
+		blk = off / RA_BUF_SIZE;
+		blk_off = off % RA_BUF_SIZE;
+		len = MIN(cnt, RA_BUF_SIZE - blk_off);
+
+		pthread_mutex_lock(&ra->mutex);
+		if (blk >= ra->blk_first + ra->buf_cnt) {
+			ra->blk_first = ra->blk_fill = blk;
+			ra->gen++;
+		} else {
+			ra->blk_first = blk;
+		}
+		pthread_cond_broadcast(&ra->cond);
+		while (ra->blk_fill <= blk)
+			pthread_cond_wait(&ra->cond, &ra->mutex);
+		pthread_mutex_unlock(&ra->mutex);
+
+		memcpy(buf, ra->buf_vec[blk % ra->buf_cnt] + blk_off, len);
+		buf += len;
+		off += len;
+		cnt -= len;
+	}
+}
+
+/*
+ * Read dump data from volume
+ *
+ * Use the readahead window for data that has not been released yet,
+ * otherwise read from the device.
+ */
+static void vol_data_read(struct vol *vol, off_t off, void *buf, u64 cnt)
+{
+	struct vol_ra *ra = &vol->ra;
+
+	/* Only this thread changes "blk_first", so no lock is needed here */
+	if (ra->active && off >= ra->start &&
+	    off + cnt <= ra->start + ra->size &&
+	    (u64) (off - ra->start) >= ra->blk_first * RA_BUF_SIZE) {
+		vol_ra_copy(vol, off - ra->start, buf, cnt);
+		return;
+	}
+	zg_seek(vol->fh, off, ZG_CHECK);
+	zg_read(vol->fh, buf, cnt, ZG_CHECK);
+}
+
+/*
+ * Start readahead threads for all active volumes
+ */
+static void vol_ra_start_all(void)
+{
+	unsigned int i, j, vol_cnt = 0, buf_cnt;
+	struct vol_ra *ra;
+	struct vol *vol;
+
+	for (i = 0; i < l.table.vol_cnt; i++) {
+		if (l.vol_vec[i].sign == SIGN_ACTIVE)
+			vol_cnt++;
+	}
+	if (vol_cnt == 0)
+		return;
+	buf_cnt = RA_MEM_MAX / RA_BUF_SIZE / vol_cnt;
+	buf_cnt = MAX(MIN(buf_cnt, (unsigned int) RA_BUF_CNT_MAX), 2U);
+
+	for (i = 0; i < l.table.vol_cnt; i++) {
+		vol = &l.vol_vec[i];
+		ra = &vol->ra;
+		if (vol->sign != SIGN_ACTIVE)
+			continue;
+		ra->start = vol->part_off + DF_S390_HDR_SIZE;
+		if (vol->data_end <= ra->start)
+			continue;
+		ra->size = vol->data_end - ra->start;
+		ra->blk_cnt = ROUNDUP(ra->size, RA_BUF_SIZE) / RA_BUF_SIZE;
+		ra->buf_cnt = buf_cnt;
+		for (j = 0; j < buf_cnt; j++)
+			ra->buf_vec[j] = zg_alloc(RA_BUF_SIZE);
+		pthread_mutex_init(&ra->mutex, NULL);
+		pthread_cond_init(&ra->cond, NULL);
+		if (pthread_create(&ra->thread, NULL, vol_ra_thread, vol))
+			ERR_EXIT_ERRNO("Could not create readahead thread");
+		ra->active = 1;
+	}
+}
+
+/*
+ * Stop readahead threads of all volumes and free the readahead windows
+ */
+static void vol_ra_stop_all(void)
+{
+	struct vol_ra *ra;
+	unsigned int i, j;
+
+	for (i = 0; i < l.table.vol_cnt; i++) {
+		ra = &l.vol_vec[i].ra;
+		if (!ra->active)
+			continue;
+		pthread_mutex_lock(&ra->mutex);
+		ra->stop = 1;
+		pthread_cond_broadcast(&ra->cond);
+		pthread_mutex_unlock(&ra->mutex);
+		pthread_join(ra->thread, NULL);
+		pthread_cond_destroy(&ra->cond);
+		pthread_mutex_destroy(&ra->mutex);
+		for (j = 0; j < ra->buf_cnt; j++)
+			zg_free(ra->buf_vec[j]);
+		ra->active = 0;
+	}
+}
+
+/*
+ * Volume check thread: Read all dump data of the volume
+ */
+static void *vol_check_thread(void *arg)
+{
+	struct vol *vol = arg;
+	struct vol_check *check = &vol->check;
+	off_t off = vol->part_off + DF_S390_HDR_SIZE;
+	u64 cnt;
+	ssize_t rc;
+	char *buf;
+
+	buf = zg_alloc(RA_BUF_SIZE);
+	check->crc = crc32(0, NULL, 0);
+	while (off < vol->data_end) {
+		cnt = MIN((u64) RA_BUF_SIZE, (u64) (vol->data_end - off));
+		rc = pread(vol->fh->fh, buf, cnt, off);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc <= 0) {
+			check->err = rc ? errno : EIO;
+			check->err_off = off;
+			break;
+		}
+		check->crc = crc32(check->crc, (Bytef *) buf, rc);
+		check->bytes += rc;
+		off += rc;
+	}
+	zg_free(buf);
+	return NULL;
+}
+
+/*
+ * Read the dump data of all active volumes in parallel
+ *
+ * Volume headers and the end marker have already been verified when
+ * the dump was opened.
+ */
+int dfi_s390mv_check(void)
+{
+	struct vol_check *check;
+	unsigned int i;
+	struct vol *vol;
+	int rc = 0;
+
+	for (i = 0; i < l.table.vol_cnt; i++) {
+		vol = &l.vol_vec[i];
+		if (vol->sign != SIGN_ACTIVE)
+			continue;
+		if (pthread_create(&vol->check.thread, NULL, vol_check_thread,
+				   vol))
+			ERR_EXIT_ERRNO("Could not create check thread");
+	}
+	STDERR("\nDump data check:\n");
+	for (i = 0; i < l.table.vol_cnt; i++) {
+		vol = &l.vol_vec[i];
+		check = &vol->check;
+		if (vol->sign != SIGN_ACTIVE)
+			continue;
+		pthread_join(check->thread, NULL);
+		STDERR("  Volume %i: %s: ", vol->nr, vol->bus_id);
+		if (check->err) {
+			STDERR("Read error at offset 0x%llx: %s\n",
+			       (unsigned long long) check->err_off,
+			       strerror(check->err));
+			rc = -EIO;
+			continue;
+		}
+		STDERR("%llu MB read, CRC32 %08lx\n", TO_MIB(check->bytes),
+		       check->crc);
+	}
+	return rc;
+}
+
 /*
  * Read memory chunk
  */
@@ -219,8 +513,7 @@ static void dfi_s390mv_mem_read(struct dfi_mem_chunk *mem_chunk, u64 off,
 {
 	struct vol *vol = mem_chunk->data;
 
-	zg_seek(vol->fh, vol->part_off + off + DF_S390_HDR_SIZE, ZG_CHECK);
-	zg_read(vol->fh, buf, cnt, ZG_CHECK);
+	vol_data_read(vol, vol->part_off + off + DF_S390_HDR_SIZE, buf, cnt);
 }
 
 /*
@@ -232,8 +525,7 @@ static void dfi_s390mv_ext_mem_read(struct dfi_mem_chunk *mem_chunk, u64 off,
 	struct vol_mem_chunk *vol_mem_chunk = mem_chunk->data;
 	struct vol *vol = vol_mem_chunk->vol;
 
-	zg_seek(vol->fh, vol_mem_chunk->off + off, ZG_CHECK);
-	zg_read(vol->fh, buf, cnt, ZG_CHECK);
+	vol_data_read(vol, vol_mem_chunk->off + off, buf, cnt);
 }
 
 /*
@@ -335,6 +627,8 @@ static void mem_chunks_add(void)
 		dfi_mem_chunk_add_vol(vol->mem_start,
 				      vol->mem_end - vol->mem_start + 1,
 				      vol, dfi_s390mv_mem_read, NULL, vol->nr);
+		vol->data_end = vol->part_off + DF_S390_HDR_SIZE +
+			vol->mem_end - vol->mem_start + 1;
 	}
 }
 
@@ -385,6 +679,7 @@ static int mem_chunks_add_ext(void)
 			dump_size += dump_segm.len;
 			off = zg_seek_cur(vol->fh, dump_segm.len,
 					  ZG_CHECK_NONE);
+			vol->data_end = off;
 			if (dump_segm.stop_marker)
 				break;
 		}
@@ -592,6 +887,8 @@ int dfi_s390mv_init_gen(bool extended)
 		return -EINVAL;
 	df_s390_cpu_info_add(&l.hdr, l.hdr.mem_end);
 	df_s390_em_add(&l.em);
+	if (g.opts.action == ZG_ACTION_STDOUT)
+		vol_ra_start_all();
 	return 0;
 }
 
@@ -611,6 +908,14 @@ void dfi_s390mv_info(void)
 	vol_print_all();
 }
 
+/*
+ * Cleanup s390 multi-volume input dump (dfi operation)
+ */
+void dfi_s390mv_exit(void)
+{
+	vol_ra_stop_all();
+}
+
 /*
  * Initialize s390 multi-volume dump tool generic function
  */
@@ -643,5 +948,7 @@ struct dfi dfi_s390mv = {
 	.name		= "s390mv",
 	.init		= dfi_s390mv_init,
 	.info_dump	= dfi_s390mv_info,
+	.check		= dfi_s390mv_check,
+	.exit		= dfi_s390mv_exit,
 	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK,
 };
@@ -26,5 +26,7 @@ struct dfi dfi_s390mv_ext = {
 	.name		= "s390mv_ext",
 	.init		= dfi_s390mv_ext_init,
 	.info_dump	= dfi_s390mv_info,
+	.check		= dfi_s390mv_check,
+	.exit		= dfi_s390mv_exit,
 	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK,
 };
@@ -10,6 +10,7 @@
  */
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/mtio.h>
@@ -21,6 +22,27 @@
 #include "zgetdump.h"
 
 #define TAPE_BLK_SIZE	32768	/* Defined by zipl tape dumper */
+#define RA_BUF_CNT	64	/* Blocks in the streaming ring */
+
+/*
+ * Streaming readahead
+ *
+ * When copying a dump, a thread reads the memory blocks sequentially into
+ * a ring of "RA_BUF_CNT" blocks ahead of the copy. The tape is only
+ * repositioned when the copy reads a block that is not in the ring.
+ */
+struct tape_ra {
+	pthread_t	thread;
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	char		*buf_vec[RA_BUF_CNT];
+	int		enabled;
+	int		active;
+	int		stop;
+	u64		blk_last;	/* Last memory block of the dump */
+	u64		blk_first;	/* First block of ring */
+	u64		blk_fill;	/* Next block to be filled */
+};
 
 /*
  * File local static data
@@ -29,12 +51,14 @@
  * blk_buf:      Content of the last read memory block
  * blk:          The next block number that will be read relative to blk_start
  * blk_start:    The absolute block number on the tape where the dump starts
+ * ra:           Streaming readahead for copying the dump
  */
 static struct {
-	char	blk_buf[TAPE_BLK_SIZE];
-	u64	blk_buf_addr;
-	u64	blk;
-	int	blk_start;
+	char		blk_buf[TAPE_BLK_SIZE];
+	u64		blk_buf_addr;
+	u64		blk;
+	int		blk_start;
+	struct tape_ra	ra;
 } l;
 
 /*
@@ -99,6 +123,115 @@ static void seek_blk(u64 blk)
 	l.blk = blk;
 }
 
+/*
+ * Readahead thread: Fill the ring with the following memory blocks
+ */
+static void *tape_ra_thread(void *arg)
+{
+	struct tape_ra *ra = &l.ra;
+	u64 blk;
+
+	(void) arg;
+	pthread_mutex_lock(&ra->mutex);
+	while (!ra->stop) {
+		if (ra->blk_fill > ra->blk_last ||
+		    ra->blk_fill == ra->blk_first + RA_BUF_CNT) {
+			pthread_cond_wait(&ra->cond, &ra->mutex);
+			continue;
+		}
+		blk = ra->blk_fill;
+		pthread_mutex_unlock(&ra->mutex);
+
+		zg_read(g.fh, ra->buf_vec[blk % RA_BUF_CNT], TAPE_BLK_SIZE,
+			ZG_CHECK);
+
+		pthread_mutex_lock(&ra->mutex);
+		ra->blk_fill = blk + 1;
+		pthread_cond_broadcast(&ra->cond);
+	}
+	pthread_mutex_unlock(&ra->mutex);
+	return NULL;
+}
+
+/*
+ * Start streaming at the current tape position
+ */
+static void tape_ra_start(void)
+{
+	struct tape_ra *ra = &l.ra;
+
+	ra->blk_first = ra->blk_fill = l.blk;
+	ra->stop = 0;
+	if (pthread_create(&ra->thread, NULL, tape_ra_thread, NULL))
+		ERR_EXIT_ERRNO("Could not create readahead thread");
+	ra->active = 1;
+}
+
+/*
+ * Stop streaming and take over the tape position of the readahead thread
+ */
+static void tape_ra_stop(void)
+{
+	struct tape_ra *ra = &l.ra;
+
+	if (!ra->active)
+		return;
+	ra->active = 0;
+	/* An error exit of the readahead thread itself cannot join */
+	if (pthread_equal(pthread_self(), ra->thread))
+		return;
+	pthread_mutex_lock(&ra->mutex);
+	ra->stop = 1;
+	pthread_cond_broadcast(&ra->cond);
+	pthread_mutex_unlock(&ra->mutex);
+	pthread_join(ra->thread, NULL);
+	l.blk = ra->blk_fill;
+}
+
+/*
+ * Enable streaming for copying the dump
+ */
+static void tape_ra_init(u64 mem_size)
+{
+	struct tape_ra *ra = &l.ra;
+	int i;
+
+	ra->blk_last = ROUNDUP(mem_size, TAPE_BLK_SIZE) / TAPE_BLK_SIZE;
+	for (i = 0; i < RA_BUF_CNT; i++)
+		ra->buf_vec[i] = zg_alloc(TAPE_BLK_SIZE);
+	pthread_mutex_init(&ra->mutex, NULL);
+	pthread_cond_init(&ra->cond, NULL);
+	ra->enabled = 1;
+}
+
+/*
+ * Get memory block from the ring, return -1 if streaming is not enabled
+ *
+ * If the block is not in the ring, the tape is repositioned once and
+ * streaming restarts with that block.
+ */
+static int tape_ra_read(u64 blk)
+{
+	struct tape_ra *ra = &l.ra;
+
+	if (!ra->enabled || blk > ra->blk_last)
+		return -1;
+	if (!ra->active || blk < ra->blk_first ||
+	    blk >= ra->blk_first + RA_BUF_CNT) {
+		tape_ra_stop();
+		seek_blk(blk);
+		tape_ra_start();
+	}
+	pthread_mutex_lock(&ra->mutex);
+	ra->blk_first = blk;
+	pthread_cond_broadcast(&ra->cond);
+	while (ra->blk_fill <= blk)
+		pthread_cond_wait(&ra->cond, &ra->mutex);
+	pthread_mutex_unlock(&ra->mutex);
+	memcpy(l.blk_buf, ra->buf_vec[blk % RA_BUF_CNT], TAPE_BLK_SIZE);
+	return 0;
+}
+
 /*
  * Read memory from cartridge
  */
@@ -113,11 +246,13 @@ static void df_s390tape_mem_read(struct dfi_mem_chunk *mem_chunk, u64 addr,
 		blk = addr / TAPE_BLK_SIZE + 1;
 		if (addr >= l.blk_buf_addr + TAPE_BLK_SIZE ||
 		    addr < l.blk_buf_addr) {
-			seek_blk(blk);
-			zg_read(g.fh, l.blk_buf, sizeof(l.blk_buf),
-				ZG_CHECK);
-			l.blk_buf_addr = (l.blk - 1) * TAPE_BLK_SIZE;
-			l.blk++;
+			if (tape_ra_read(blk) != 0) {
+				seek_blk(blk);
+				zg_read(g.fh, l.blk_buf, sizeof(l.blk_buf),
+					ZG_CHECK);
+				l.blk++;
+			}
+			l.blk_buf_addr = (blk - 1) * TAPE_BLK_SIZE;
 		}
 		off = addr - l.blk_buf_addr;
 		size = MIN(cnt - copied, TAPE_BLK_SIZE - off);
@@ -167,6 +302,8 @@ static int vol_init(void)
 	/* Init memory read & CPU info */
 	mem_read_init();
 	df_s390_cpu_info_add(&hdr, hdr.mem_size - 1);
+	if (g.opts.action == ZG_ACTION_STDOUT)
+		tape_ra_init(hdr.mem_size);
 	return 0;
 }
 
@@ -175,6 +312,7 @@ static int vol_init(void)
  */
 static void  dfi_s390tape_exit(void)
 {
+	tape_ra_stop();
 	seek_blk(0);
 }
 
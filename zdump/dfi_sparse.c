@@ -0,0 +1,189 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * Sparse zfcpdump partition dump input format
+ *
+ * Copyright IBM Corp. 2026
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <elf.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zgetdump.h"
+
+#define IDX_BYTES	8	/* One index entry per IDX_BYTES bitmap bytes */
+
+/*
+ * File local static data
+ */
+static struct {
+	struct df_sparse_hdr	hdr;
+	u8			*bitmap;
+	u64			*bitmap_idx;	/* Stored pages before entry */
+} l;
+
+/*
+ * Return number of set bits in byte
+ */
+static inline unsigned int byte_weight(u8 byte)
+{
+	return __builtin_popcount(byte);
+}
+
+/*
+ * Find the dump offset for vmcore page "pg_num". Return 0 for zero pages.
+ */
+static u64 page_off(u64 pg_num)
+{
+	u64 byte = pg_num / 8, cnt, i;
+	u8 mask = 1U << (pg_num % 8);
+
+	if (!(l.bitmap[byte] & mask))
+		return 0;
+	cnt = l.bitmap_idx[byte / IDX_BYTES];
+	for (i = byte - byte % IDX_BYTES; i < byte; i++)
+		cnt += byte_weight(l.bitmap[i]);
+	cnt += byte_weight(l.bitmap[byte] & (mask - 1));
+	return l.hdr.data_off + cnt * l.hdr.page_size;
+}
+
+/*
+ * Read memory for given memory chunk
+ */
+static void dfi_sparse_mem_chunk_read_fn(struct dfi_mem_chunk *mem_chunk,
+					 u64 off, void *buf, u64 cnt)
+{
+	u64 vmcore_off = *((u64 *) mem_chunk->data) + off;
+	u64 pg_num, pg_off, dump_off, len;
+
+	while (cnt) {
+		pg_num = (vmcore_off - l.hdr.load_off) / l.hdr.page_size;
+		pg_off = (vmcore_off - l.hdr.load_off) % l.hdr.page_size;
+		len = MIN(cnt, l.hdr.page_size - pg_off);
+		dump_off = page_off(pg_num);
+		if (dump_off) {
+			zg_seek(g.fh, dump_off + pg_off, ZG_CHECK);
+			zg_read(g.fh, buf, len, ZG_CHECK);
+		} else {
+			memset(buf, 0, len);
+		}
+		vmcore_off += len;
+		buf += len;
+		cnt -= len;
+	}
+}
+
+/*
+ * Add load (memory chunk) to DFI dump
+ */
+static int pt_load_add(Elf64_Phdr *phdr)
+{
+	u64 *off_ptr;
+
+	if (phdr->p_filesz > phdr->p_memsz)
+		return -EINVAL;
+	if (phdr->p_filesz != 0) {
+		if (phdr->p_offset < l.hdr.load_off ||
+		    phdr->p_offset + phdr->p_filesz >
+		    l.hdr.load_off + l.hdr.load_size)
+			return -EINVAL;
+		off_ptr = zg_alloc(sizeof(*off_ptr));
+		*off_ptr = phdr->p_offset;
+		dfi_mem_chunk_add(phdr->p_paddr, phdr->p_filesz, off_ptr,
+				  dfi_sparse_mem_chunk_read_fn, zg_free);
+	}
+	if (phdr->p_filesz != phdr->p_memsz) {
+		dfi_mem_chunk_add(phdr->p_paddr + phdr->p_filesz,
+				  phdr->p_memsz - phdr->p_filesz, NULL,
+				  dfi_mem_chunk_read_zero, NULL);
+	}
+	return 0;
+}
+
+/*
+ * Read bitmap and build index for page lookup
+ */
+static int bitmap_init(void)
+{
+	u64 i, page_max, cnt = 0;
+
+	page_max = ROUNDUP(l.hdr.load_size, l.hdr.page_size) / l.hdr.page_size;
+	if (l.hdr.bitmap_size < ROUNDUP(page_max, 8) / 8)
+		return -EINVAL;
+	l.bitmap = zg_alloc(l.hdr.bitmap_size);
+	zg_seek(g.fh, l.hdr.bitmap_off, ZG_CHECK);
+	zg_read(g.fh, l.bitmap, l.hdr.bitmap_size, ZG_CHECK);
+
+	l.bitmap_idx = zg_alloc(ROUNDUP(l.hdr.bitmap_size, IDX_BYTES) /
+				IDX_BYTES * sizeof(u64));
+	for (i = 0; i < l.hdr.bitmap_size; i++) {
+		if (i % IDX_BYTES == 0)
+			l.bitmap_idx[i / IDX_BYTES] = cnt;
+		cnt += byte_weight(l.bitmap[i]);
+	}
+	if (cnt != l.hdr.page_cnt)
+		return -EINVAL;
+	if (l.hdr.data_off + cnt * l.hdr.page_size > zg_size(g.fh))
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * Read sparse dump header
+ */
+static int read_sparse_hdr(void)
+{
+	if (zg_size(g.fh) < DF_SPARSE_HDR_SIZE)
+		return -ENODEV;
+	zg_read(g.fh, &l.hdr, sizeof(l.hdr), ZG_CHECK);
+	if (l.hdr.magic != DF_SPARSE_MAGIC)
+		return -ENODEV;
+	if (l.hdr.version != DF_SPARSE_VERSION)
+		ERR_EXIT("Unsupported sparse dump version: %u", l.hdr.version);
+	if (l.hdr.page_size == 0)
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * Initialize sparse input dump format
+ */
+static int dfi_sparse_init(void)
+{
+	unsigned int version;
+	int rc;
+
+	rc = read_sparse_hdr();
+	if (rc)
+		return rc;
+	if (bitmap_init())
+		return -EINVAL;
+	rc = dfi_elf_hdr_init(l.hdr.elf_off, pt_load_add, &version);
+	if (rc)
+		return -EINVAL;
+	dfi_attr_version_set(l.hdr.version);
+	return 0;
+}
+
+/*
+ * Cleanup sparse input dump format
+ */
+static void dfi_sparse_exit(void)
+{
+	zg_free(l.bitmap);
+	zg_free(l.bitmap_idx);
+}
+
+/*
+ * Sparse DFI operations
+ */
+struct dfi dfi_sparse = {
+	.name		= "sparse",
+	.init		= dfi_sparse_init,
+	.exit		= dfi_sparse_exit,
+	.feat_bits	= DFI_FEAT_COPY | DFI_FEAT_SEEK,
+};
@@ -10,6 +10,9 @@
  */
 
 #include <time.h>
+
+#include "lib/zt_probe.h"
+
 #include "zgetdump.h"
 
 #define dfo_chunk_iterate(dfo_chunk) \
@@ -21,9 +24,19 @@
 static struct dfo *dfo_vec[] = {
 	&dfo_s390,
 	&dfo_elf,
+	&dfo_kdump,
 	NULL,
 };
 
+/*
+ * Segment of the output dump that is provided by exactly one dump chunk
+ */
+struct dfo_seg {
+	u64			start;	/* First offset of segment */
+	u64			end;	/* Last offset of segment */
+	struct dfo_chunk	*chunk;	/* Dump chunk that provides the data */
+};
+
 /*
  * Dump (output) information
  */
@@ -32,6 +45,9 @@ struct dump {
 	u64		size;		/* Size of dump in bytes */
 	unsigned int	chunk_cnt;	/* Number of dump chunks */
 	struct util_list	chunk_list;	/* DFO chunk list */
+	struct dfo_seg	*seg_vec;	/* Segments sorted by offset */
+	unsigned int	seg_cnt;	/* Number of segments */
+	unsigned int	seg_cursor;	/* Index of last found segment */
 };
 
 /*
@@ -57,6 +73,10 @@ void dfo_chunk_add(u64 start, u64 size, void *data, dfo_chunk_read_fn read_fn)
 	util_list_add_head(&l.dump.chunk_list, dfo_chunk);
 	l.dump.chunk_cnt++;
 	l.dump.size = MAX(l.dump.size, dfo_chunk->end + 1);
+	/* The segment table is rebuilt on the next read */
+	zg_free(l.dump.seg_vec);
+	l.dump.seg_vec = NULL;
+	l.dump.seg_cnt = 0;
 }
 
 /*
@@ -114,6 +134,22 @@ int dfo_set(const char *dfo_name)
 	return -ENODEV;
 }
 
+/*
+ * Does output dump format have to be written directly to a file?
+ */
+int dfo_feat_write(void)
+{
+	return l.dfo->write != NULL;
+}
+
+/*
+ * Write output dump directly to file
+ */
+void dfo_write(int fd)
+{
+	l.dfo->write(fd);
+}
+
 /*
  * Initialize output dump format
  */
@@ -126,42 +162,212 @@ void dfo_init(void)
 }
 
 /*
- * Find dump chunk for offset "off"
- *
- * This function is a bit hacky. DFO chunks can overlap. If two DFO chunks
- * overlap, the last registered chunk wins. The dfo_chunk_find() function
- * reflects that by returning the first memory chunk that is found in
- * the dfo chunk list.
- *
- * In addition to that it calculates the "virtual end" of that chunk. An
- * overlapping chunk can limit the "virtual end" of an underlying chunk so
- * that the "virtual end" of that chunk is lower than the "real end".
+ * Compare function for sorting u64 values
+ */
+static int u64_cmp_fn(const void *a, const void *b)
+{
+	u64 val1 = *(const u64 *) a, val2 = *(const u64 *) b;
+
+	if (val1 == val2)
+		return 0;
+	return val1 < val2 ? -1 : 1;
+}
+
+/*
+ * Dump chunk with registration priority
+ */
+struct chunk_prio {
+	struct dfo_chunk	*chunk;
+	unsigned int		prio;
+};
+
+/*
+ * Compare function for sorting dump chunks by start offset
+ */
+static int chunk_start_cmp_fn(const void *a, const void *b)
+{
+	const struct chunk_prio *entry1 = a, *entry2 = b;
+
+	return u64_cmp_fn(&entry1->chunk->start, &entry2->chunk->start);
+}
+
+/*
+ * Max-heap of active dump chunks ordered by registration priority
+ */
+struct chunk_heap {
+	struct chunk_prio	*vec;
+	unsigned int		cnt;
+};
+
+static void chunk_heap_swap(struct chunk_heap *heap, unsigned int i,
+			    unsigned int j)
+{
+	struct chunk_prio tmp = heap->vec[i];
+
+	heap->vec[i] = heap->vec[j];
+	heap->vec[j] = tmp;
+}
+
+static void chunk_heap_push(struct chunk_heap *heap, struct chunk_prio *entry)
+{
+	unsigned int i = heap->cnt++;
+
+	heap->vec[i] = *entry;
+	while (i > 0 && heap->vec[(i - 1) / 2].prio < heap->vec[i].prio) {
+		chunk_heap_swap(heap, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void chunk_heap_pop(struct chunk_heap *heap)
+{
+	unsigned int i = 0, max, child;
+
+	chunk_heap_swap(heap, 0, --heap->cnt);
+	while (1) {
+		max = i;
+		for (child = 2 * i + 1; child <= 2 * i + 2; child++) {
+			if (child < heap->cnt &&
+			    heap->vec[child].prio > heap->vec[max].prio)
+				max = child;
+		}
+		if (max == i)
+			break;
+		chunk_heap_swap(heap, i, max);
+		i = max;
+	}
+}
+
+/*
+ * Build segment table for dump chunks
  *
- * Example:
+ * DFO chunks can overlap. If two DFO chunks overlap, the last registered
+ * chunk wins. Example:
  *
  * chunk 1.:      |------|
  * chunk 2.: |---------------------|
- * off.....: ^
- * virt end:      ^
- * real end:                       ^
+ * segments: |2222|111111|222222222|
  *
- * In this case chunk 2 will be returned and "end" is set to the start of
- * chunk 1.
+ * To get fast lookups, we resolve the overlaps once and split the dump
+ * into non-overlapping segments that are sorted by offset. For this we
+ * sweep over all chunk boundaries and keep the active chunks in a heap
+ * ordered by registration priority. Expired chunks are removed lazily
+ * from the top of the heap.
  */
-static struct dfo_chunk *dfo_chunk_find(u64 off, u64 *end)
+static void seg_vec_build(void)
 {
+	unsigned int i, j, bnd_cnt = 0, chunk_cnt = l.dump.chunk_cnt;
+	struct chunk_prio *chunk_vec;
 	struct dfo_chunk *dfo_chunk;
+	struct chunk_heap heap;
+	struct dfo_seg *seg;
+	u64 *bnd_vec;
 
-	*end = U64_MAX;
+	l.dump.seg_vec = zg_alloc((2 * chunk_cnt + 1) * sizeof(*seg));
+	l.dump.seg_cnt = 0;
+	l.dump.seg_cursor = 0;
+	if (chunk_cnt == 0)
+		return;
+	chunk_vec = zg_alloc(chunk_cnt * sizeof(*chunk_vec));
+	bnd_vec = zg_alloc(2 * chunk_cnt * sizeof(*bnd_vec));
+	heap.vec = zg_alloc(chunk_cnt * sizeof(*heap.vec));
+	heap.cnt = 0;
+
+	/* The chunk list is in reverse registration order */
+	i = chunk_cnt;
 	dfo_chunk_iterate(dfo_chunk) {
-		if (dfo_chunk->start <= off && dfo_chunk->end >= off) {
-			*end = MIN(*end, dfo_chunk->end);
-			return dfo_chunk;
-		} else if (dfo_chunk->start > off) {
-			*end = MIN(*end, dfo_chunk->start - 1);
+		i--;
+		chunk_vec[i].chunk = dfo_chunk;
+		chunk_vec[i].prio = i;
+		bnd_vec[bnd_cnt++] = dfo_chunk->start;
+		bnd_vec[bnd_cnt++] = dfo_chunk->end + 1;
+	}
+	qsort(chunk_vec, chunk_cnt, sizeof(*chunk_vec), chunk_start_cmp_fn);
+	qsort(bnd_vec, bnd_cnt, sizeof(*bnd_vec), u64_cmp_fn);
+
+	j = 0;
+	for (i = 0; i < bnd_cnt - 1; i++) {
+		if (bnd_vec[i] == bnd_vec[i + 1])
+			continue;
+		/* Add all chunks that start at or before this boundary */
+		while (j < chunk_cnt && chunk_vec[j].chunk->start <= bnd_vec[i])
+			chunk_heap_push(&heap, &chunk_vec[j++]);
+		/* Remove expired chunks */
+		while (heap.cnt && heap.vec[0].chunk->end < bnd_vec[i])
+			chunk_heap_pop(&heap);
+		if (!heap.cnt)
+			continue;
+		dfo_chunk = heap.vec[0].chunk;
+		seg = &l.dump.seg_vec[l.dump.seg_cnt];
+		if (l.dump.seg_cnt && seg[-1].chunk == dfo_chunk &&
+		    seg[-1].end + 1 == bnd_vec[i]) {
+			seg[-1].end = bnd_vec[i + 1] - 1;
+			continue;
 		}
+		seg->start = bnd_vec[i];
+		seg->end = bnd_vec[i + 1] - 1;
+		seg->chunk = dfo_chunk;
+		l.dump.seg_cnt++;
+	}
+	zg_free(heap.vec);
+	zg_free(bnd_vec);
+	zg_free(chunk_vec);
+}
+
+/*
+ * Find segment for offset "off"
+ *
+ * The last found segment and its successor are checked first to make
+ * sequential reads cheap. Otherwise a binary search is done.
+ */
+static struct dfo_seg *seg_find(u64 off)
+{
+	unsigned int low, high, mid, cursor;
+	struct dfo_seg *seg;
+
+	if (!l.dump.seg_vec)
+		seg_vec_build();
+	if (l.dump.seg_cnt == 0)
+		return NULL;
+	cursor = l.dump.seg_cursor;
+	for (mid = cursor; mid < cursor + 2 && mid < l.dump.seg_cnt; mid++) {
+		seg = &l.dump.seg_vec[mid];
+		if (seg->start <= off && seg->end >= off)
+			goto found;
+	}
+	low = 0;
+	high = l.dump.seg_cnt;
+	while (high - low > 1) {
+		mid = low + (high - low) / 2;
+		if (l.dump.seg_vec[mid].start <= off)
+			low = mid;
+		else
+			high = mid;
 	}
-	return NULL;
+	mid = low;
+	seg = &l.dump.seg_vec[mid];
+	if (seg->start > off || seg->end < off)
+		return NULL;
+found:
+	l.dump.seg_cursor = mid;
+	return seg;
+}
+
+/*
+ * Find dump chunk for offset "off"
+ *
+ * Returns the dump chunk that provides the data for "off" and sets "end"
+ * to the last offset up to which this chunk is valid. Because of overlapping
+ * chunks this "virtual end" can be lower than the "real end" of the chunk.
+ */
+static struct dfo_chunk *dfo_chunk_find(u64 off, u64 *end)
+{
+	struct dfo_seg *seg = seg_find(off);
+
+	if (!seg)
+		return NULL;
+	*end = seg->end;
+	return seg->chunk;
 }
 
 /*
@@ -181,6 +387,7 @@ u64 dfo_read(void *buf, u64 cnt)
 	u64 copied = 0, end, size;
 	u64 off = l.dump.off;
 
+	ZT_PROBE(zgetdump, dfo_read, off, cnt);
 	while (copied != cnt) {
 		dfo_chunk = dfo_chunk_find(off, &end);
 		if (!dfo_chunk)
@@ -192,6 +399,7 @@ u64 dfo_read(void *buf, u64 cnt)
 		off += size;
 	}
 out:
+	ZT_PROBE(zgetdump, dfo_read_done, l.dump.off, copied);
 	l.dump.off = off;
 	return copied;
 }
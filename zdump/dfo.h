@@ -43,13 +43,24 @@ extern u64 dfo_size(void);
 extern const char *dfo_name(void);
 extern void dfo_init(void);
 extern int dfo_set(const char *dfo_name);
+extern int dfo_feat_write(void);
+extern void dfo_write(int fd);
+
+/*
+ * ELF notes for other output formats
+ */
+extern void *dfo_elf_notes_create(u32 *size);
 
 /*
  * DFO operations
+ *
+ * Output formats that cannot provide the dump via dump chunks implement
+ * the "write" callback that directly writes the dump to a seekable file.
  */
 struct dfo {
 	const char	*name;
 	void		(*init)(void);
+	void		(*write)(int fd);
 };
 
 #endif /* DFO_H */
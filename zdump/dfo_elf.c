@@ -21,6 +21,7 @@
 #define HDR_PER_CPU_SIZE	0x4a0
 #define HDR_PER_MEMC_SIZE	0x100
 #define HDR_BASE_SIZE		0x2000
+#define ZERO_SCAN_BLK_SIZE	(64 * KIB)
 
 /*
  * File local static data
@@ -58,6 +59,50 @@ static void *ehdr_init(Elf64_Ehdr *ehdr)
 	return ehdr + 1;
 }
 
+/*
+ * Return size of memory chunk without trailing zero pages
+ *
+ * The memory chunk is scanned backwards in blocks until the first
+ * non-zero page is found. This is only done with "--sparse" and not for
+ * tapes, where reading backwards would be very slow.
+ */
+static u64 mem_chunk_filesz(struct dfi_mem_chunk *mem_chunk)
+{
+	u64 size = mem_chunk->end - mem_chunk->start + 1;
+	u64 blk_size, off, len;
+	char *buf;
+
+	if (mem_chunk->read_fn == dfi_mem_chunk_read_zero)
+		return 0;
+	if (!g.opts.sparse_specified || zg_type(g.fh) == ZG_TYPE_TAPE)
+		return size;
+	buf = zg_alloc(ZERO_SCAN_BLK_SIZE);
+	while (size > 0) {
+		blk_size = size % ZERO_SCAN_BLK_SIZE;
+		if (blk_size == 0)
+			blk_size = ZERO_SCAN_BLK_SIZE;
+		off = size - blk_size;
+		mem_chunk->read_fn(mem_chunk, off, buf, blk_size);
+		if (zg_buf_is_zero(buf, blk_size)) {
+			size = off;
+			continue;
+		}
+		/* Find last non-zero page in block */
+		while (blk_size > 0) {
+			len = blk_size % PAGE_SIZE;
+			if (len == 0)
+				len = PAGE_SIZE;
+			if (!zg_buf_is_zero(buf + blk_size - len, len))
+				break;
+			blk_size -= len;
+		}
+		size = off + blk_size;
+		break;
+	}
+	zg_free(buf);
+	return size;
+}
+
 /*
  * Initialize ELF loads
  */
@@ -72,11 +117,8 @@ static u64 loads_init(Elf64_Phdr *phdr, u64 loads_offset)
 		phdr->p_vaddr = mem_chunk->start;
 		phdr->p_paddr = mem_chunk->start;
 		phdr->p_memsz = mem_chunk->end - mem_chunk->start + 1;
-		if (mem_chunk->read_fn == dfi_mem_chunk_read_zero)
-			/* Zero memory chunk */
-			phdr->p_filesz = 0;
-		else
-			phdr->p_filesz = phdr->p_memsz;
+		/* Zero memory chunks and trailing zeros are not written */
+		phdr->p_filesz = mem_chunk_filesz(mem_chunk);
 		phdr->p_flags = PF_R | PF_W | PF_X;
 		phdr->p_align = PAGE_SIZE;
 		loads_offset += phdr->p_filesz;
@@ -236,11 +278,10 @@ static void *nt_vmcoreinfo(void *ptr)
 }
 
 /*
- * Initialize notes
+ * Add all notes to buffer
  */
-static void *notes_init(Elf64_Phdr *phdr, void *ptr, u64 notes_offset)
+static void *notes_add(void *ptr)
 {
-	void *ptr_start = ptr;
 	struct dfi_cpu *cpu;
 
 	ptr = nt_prpsinfo(ptr);
@@ -262,7 +303,17 @@ static void *notes_init(Elf64_Phdr *phdr, void *ptr, u64 notes_offset)
 		}
 	}
 out:
-	ptr = nt_vmcoreinfo(ptr);
+	return nt_vmcoreinfo(ptr);
+}
+
+/*
+ * Initialize notes
+ */
+static void *notes_init(Elf64_Phdr *phdr, void *ptr, u64 notes_offset)
+{
+	void *ptr_start = ptr;
+
+	ptr = notes_add(ptr);
 	memset(phdr, 0, sizeof(*phdr));
 	phdr->p_type = PT_NOTE;
 	phdr->p_offset = notes_offset;
@@ -270,10 +321,27 @@ out:
 	return ptr;
 }
 
+/*
+ * Create buffer with ELF notes for other output formats
+ */
+void *dfo_elf_notes_create(u32 *size)
+{
+	void *buf, *ptr;
+	u32 alloc_size;
+
+	alloc_size = HDR_BASE_SIZE + dfi_cpu_cnt() * HDR_PER_CPU_SIZE;
+	buf = zg_alloc(alloc_size);
+	ptr = notes_add(buf);
+	*size = PTR_DIFF(ptr, buf);
+	if (*size > alloc_size)
+		ABORT("notes_size=%u alloc_size=%u", *size, alloc_size);
+	return buf;
+}
+
 /*
  * Setup dump chunks
  */
-static void dump_chunks_init(void)
+static void dump_chunks_init(Elf64_Phdr *phdr)
 {
 	struct dfi_mem_chunk *mem_chunk;
 	u64 off = 0;
@@ -281,12 +349,15 @@ static void dump_chunks_init(void)
 	dfo_chunk_add(0, l.hdr_size, l.hdr, dfo_chunk_buf_fn);
 	off = l.hdr_size;
 	dfi_mem_chunk_iterate(mem_chunk) {
-		if (mem_chunk->read_fn == dfi_mem_chunk_read_zero)
+		if (phdr->p_filesz == 0) {
 			/* Zero memory chunk */
+			phdr++;
 			continue;
-		dfo_chunk_add(off, mem_chunk->size, mem_chunk,
+		}
+		dfo_chunk_add(off, phdr->p_filesz, mem_chunk,
 				   dfo_chunk_mem_fn);
-		off += mem_chunk->size;
+		off += phdr->p_filesz;
+		phdr++;
 	}
 }
 
@@ -332,7 +403,7 @@ static void dfo_elf_init(void)
 	l.hdr_size = hdr_off;
 	if (l.hdr_size > alloc_size)
 		ABORT("hdr_size=%u alloc_size=%u", l.hdr_size, alloc_size);
-	dump_chunks_init();
+	dump_chunks_init(phdr_loads);
 }
 
 /*
@@ -0,0 +1,370 @@
+/*
+ * zgetdump - Tool for copying and converting System z dumps
+ *
+ * kdump (diskdump) compressed dump output format
+ *
+ * Copyright IBM Corp. 2001, 2018
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "zgetdump.h"
+
+#define BLK_SIZE	PAGE_SIZE
+#define DESC_BUF_CNT	1024
+#define DATA_BUF_SIZE	MIB
+
+/*
+ * File local static data
+ */
+static struct {
+	struct df_kdump_hdr	hdr;
+	struct df_kdump_sub_hdr	shdr;
+	void			*sub_hdr_buf;	/* Sub header, vmcoreinfo, notes */
+	u64			sub_hdr_buf_size;
+	u8			*bitmap;	/* Bitmap of dumped pages */
+	u64			bitmap_size;	/* Size of one bitmap */
+	u64			max_mapnr;	/* Number of page frames */
+	u64			page_cnt;	/* Number of dumped pages */
+	u64			bitmap_off;
+	u64			desc_off;
+	u64			data_off;
+} l;
+
+/*
+ * Buffered writer for page descriptors and page data
+ */
+struct kdump_writer {
+	int				fd;
+	struct df_kdump_page_desc	*desc_buf;
+	unsigned int			desc_cnt;
+	u64				desc_off;
+	char				*data_buf;
+	u64				data_len;
+	u64				data_off;
+};
+
+/*
+ * Write buffer at offset
+ */
+static void write_at(int fd, const void *buf, u64 cnt, u64 off)
+{
+	u64 written = 0;
+	ssize_t rc;
+
+	while (written < cnt) {
+		rc = pwrite(fd, buf + written, cnt - written, off + written);
+		if (rc == -1)
+			ERR_EXIT_ERRNO("Error: Write failed");
+		if (rc == 0)
+			ERR_EXIT("Error: Could not write full block");
+		written += rc;
+	}
+}
+
+/*
+ * Set bit for page frame in bitmap
+ */
+static void bitmap_set(u64 pfn)
+{
+	l.bitmap[pfn / 8] |= 1 << (pfn % 8);
+}
+
+/*
+ * Check bit for page frame in bitmap
+ */
+static int bitmap_test(u64 pfn)
+{
+	return l.bitmap[pfn / 8] & (1 << (pfn % 8));
+}
+
+/*
+ * Mark all page frames that are covered by memory chunks
+ */
+static void bitmap_init(void)
+{
+	struct dfi_mem_chunk *mem_chunk;
+	u64 pfn;
+
+	l.bitmap_size = ROUNDUP(ROUNDUP(l.max_mapnr, 8) / 8, BLK_SIZE);
+	if (l.bitmap_size == 0)
+		l.bitmap_size = BLK_SIZE;
+	l.bitmap = zg_alloc(l.bitmap_size);
+	dfi_mem_chunk_iterate(mem_chunk) {
+		for (pfn = mem_chunk->start / PAGE_SIZE;
+		     pfn <= mem_chunk->end / PAGE_SIZE; pfn++) {
+			if (bitmap_test(pfn))
+				continue;
+			bitmap_set(pfn);
+			l.page_cnt++;
+		}
+	}
+}
+
+/*
+ * Initialize sub header with vmcoreinfo and ELF notes
+ */
+static void sub_hdr_init(void)
+{
+	char *vmcoreinfo = dfi_vmcoreinfo_get();
+	u64 vmcoreinfo_size = 0, off;
+	u32 notes_size;
+	void *notes;
+
+	if (vmcoreinfo)
+		vmcoreinfo_size = strlen(vmcoreinfo);
+	notes = dfo_elf_notes_create(&notes_size);
+
+	l.shdr.phys_base = 0;
+	l.shdr.dump_level = 0;
+	l.shdr.split = 0;
+	l.shdr.start_pfn = 0;
+	l.shdr.end_pfn = l.max_mapnr;
+	l.shdr.start_pfn_64 = 0;
+	l.shdr.end_pfn_64 = l.max_mapnr;
+	l.shdr.max_mapnr_64 = l.max_mapnr;
+	off = sizeof(l.shdr);
+	l.shdr.offset_vmcoreinfo = BLK_SIZE + off;
+	l.shdr.size_vmcoreinfo = vmcoreinfo_size;
+	off += vmcoreinfo_size;
+	l.shdr.offset_note = BLK_SIZE + off;
+	l.shdr.size_note = notes_size;
+	off += notes_size;
+
+	l.sub_hdr_buf_size = ROUNDUP(off, BLK_SIZE);
+	l.sub_hdr_buf = zg_alloc(l.sub_hdr_buf_size);
+	memcpy(l.sub_hdr_buf, &l.shdr, sizeof(l.shdr));
+	if (vmcoreinfo)
+		memcpy(l.sub_hdr_buf + l.shdr.offset_vmcoreinfo - BLK_SIZE,
+		       vmcoreinfo, vmcoreinfo_size);
+	memcpy(l.sub_hdr_buf + l.shdr.offset_note - BLK_SIZE, notes,
+	       notes_size);
+	zg_free(notes);
+}
+
+/*
+ * Initialize main header
+ */
+static void hdr_init(void)
+{
+	struct new_utsname *utsname = dfi_attr_utsname();
+
+	memcpy(l.hdr.signature, DF_KDUMP_SIGNATURE, sizeof(l.hdr.signature));
+	l.hdr.header_version = DF_KDUMP_HDR_VERSION;
+	if (utsname) {
+		l.hdr.utsname = *utsname;
+	} else {
+		strcpy(l.hdr.utsname.sysname, "Linux");
+		strcpy(l.hdr.utsname.machine, "s390x");
+	}
+	if (dfi_attr_time())
+		l.hdr.timestamp = *dfi_attr_time();
+	l.hdr.status = DF_KDUMP_DH_COMPRESSED_ZLIB;
+	l.hdr.block_size = BLK_SIZE;
+	l.hdr.sub_hdr_size = l.sub_hdr_buf_size / BLK_SIZE;
+	l.hdr.bitmap_blocks = 2 * l.bitmap_size / BLK_SIZE;
+	l.hdr.max_mapnr = MIN(l.max_mapnr, UINT_MAX);
+	l.hdr.nr_cpus = dfi_cpu_cnt();
+	l.hdr.current_cpu = 0;
+}
+
+/*
+ * Initialize kdump output dump format
+ *
+ * Dump layout (in blocks):
+ *
+ * | header | sub header | bitmap 1 | bitmap 2 | page descs | page data |
+ *
+ * The sub header contains the vmcoreinfo and the ELF notes. Both bitmaps
+ * are identical because no pages are excluded.
+ */
+static void dfo_kdump_init(void)
+{
+	struct dfi_mem_chunk *mem_chunk = dfi_mem_chunk_last();
+
+	if (dfi_arch() != DFI_ARCH_64)
+		ERR_EXIT("Error: The kdump dump format is only supported for "
+			 "s390x source dumps");
+	if (mem_chunk)
+		l.max_mapnr = PAGE_ALIGN(mem_chunk->end + 1) / PAGE_SIZE;
+	bitmap_init();
+	sub_hdr_init();
+	hdr_init();
+	l.bitmap_off = BLK_SIZE + l.sub_hdr_buf_size;
+	l.desc_off = l.bitmap_off + 2 * l.bitmap_size;
+	l.data_off = l.desc_off + l.page_cnt * sizeof(struct df_kdump_page_desc);
+}
+
+/*
+ * Read page, memory not covered by memory chunks is zero
+ */
+static void page_read(u64 addr, char *buf)
+{
+	struct dfi_mem_chunk *mem_chunk;
+	u64 off = 0, size;
+
+	if (dfi_mem_range_valid(addr, PAGE_SIZE)) {
+		dfi_mem_read(addr, buf, PAGE_SIZE);
+		return;
+	}
+	memset(buf, 0, PAGE_SIZE);
+	while (off < PAGE_SIZE) {
+		mem_chunk = dfi_mem_chunk_find(addr + off);
+		if (!mem_chunk) {
+			off++;
+			continue;
+		}
+		size = MIN(PAGE_SIZE - off, mem_chunk->end - (addr + off) + 1);
+		dfi_mem_read(addr + off, buf + off, size);
+		off += size;
+	}
+}
+
+/*
+ * Flush buffered page descriptors and page data
+ */
+static void writer_flush(struct kdump_writer *w)
+{
+	u64 desc_size = w->desc_cnt * sizeof(*w->desc_buf);
+
+	write_at(w->fd, w->desc_buf, desc_size, w->desc_off);
+	w->desc_off += desc_size;
+	w->desc_cnt = 0;
+	write_at(w->fd, w->data_buf, w->data_len, w->data_off);
+	w->data_off += w->data_len;
+	w->data_len = 0;
+}
+
+/*
+ * Add page data and return page descriptor for it
+ */
+static void writer_data_add(struct kdump_writer *w,
+			    struct df_kdump_page_desc *desc,
+			    const void *buf, unsigned int size,
+			    unsigned int flags)
+{
+	if (w->data_len + size > DATA_BUF_SIZE)
+		writer_flush(w);
+	memcpy(w->data_buf + w->data_len, buf, size);
+	desc->offset = w->data_off + w->data_len;
+	desc->size = size;
+	desc->flags = flags;
+	desc->page_flags = 0;
+	w->data_len += size;
+}
+
+/*
+ * Add page descriptor
+ */
+static void writer_desc_add(struct kdump_writer *w,
+			    struct df_kdump_page_desc *desc)
+{
+	if (w->desc_cnt == DESC_BUF_CNT)
+		writer_flush(w);
+	w->desc_buf[w->desc_cnt++] = *desc;
+}
+
+/*
+ * Compress page and add it to the page data
+ *
+ * If compression does not reduce the size, the page is stored
+ * uncompressed.
+ */
+static void page_add(struct kdump_writer *w, struct df_kdump_page_desc *desc,
+		     const char *page_buf, Bytef *zbuf, uLongf zbuf_size)
+{
+	uLongf zlen = zbuf_size;
+	int rc;
+
+	rc = compress2(zbuf, &zlen, (const Bytef *) page_buf, PAGE_SIZE,
+		       Z_BEST_SPEED);
+	if (rc == Z_OK && zlen < PAGE_SIZE)
+		writer_data_add(w, desc, zbuf, zlen,
+				DF_KDUMP_DH_COMPRESSED_ZLIB);
+	else
+		writer_data_add(w, desc, page_buf, PAGE_SIZE, 0);
+}
+
+/*
+ * Write all dumped pages
+ *
+ * All zero pages share one page descriptor that is written at the start
+ * of the page data area.
+ */
+static void pages_write(int fd)
+{
+	struct df_kdump_page_desc desc, desc_zero;
+	uLongf zbuf_size = compressBound(PAGE_SIZE);
+	struct kdump_writer w;
+	char *page_buf;
+	Bytef *zbuf;
+	u64 pfn;
+
+	memset(&w, 0, sizeof(w));
+	w.fd = fd;
+	w.desc_buf = zg_alloc(DESC_BUF_CNT * sizeof(*w.desc_buf));
+	w.desc_off = l.desc_off;
+	w.data_buf = zg_alloc(DATA_BUF_SIZE);
+	w.data_off = l.data_off;
+	page_buf = zg_alloc(PAGE_SIZE);
+	zbuf = zg_alloc(zbuf_size);
+
+	page_add(&w, &desc_zero, page_buf, zbuf, zbuf_size);
+	zg_progress_init("Copying dump", l.max_mapnr * PAGE_SIZE);
+	for (pfn = 0; pfn < l.max_mapnr; pfn++) {
+		if (l.bitmap[pfn / 8] == 0) {
+			/* Skip holes fast */
+			pfn |= 7;
+			continue;
+		}
+		if (!bitmap_test(pfn))
+			continue;
+		page_read(pfn * PAGE_SIZE, page_buf);
+		if (zg_buf_is_zero(page_buf, PAGE_SIZE))
+			desc = desc_zero;
+		else
+			page_add(&w, &desc, page_buf, zbuf, zbuf_size);
+		writer_desc_add(&w, &desc);
+		zg_progress(pfn * PAGE_SIZE);
+	}
+	writer_flush(&w);
+	zg_progress(l.max_mapnr * PAGE_SIZE);
+	if (ftruncate(fd, w.data_off) == -1)
+		ERR_EXIT_ERRNO("Error: Could not set size of output file");
+
+	zg_free(zbuf);
+	zg_free(page_buf);
+	zg_free(w.data_buf);
+	zg_free(w.desc_buf);
+}
+
+/*
+ * Write kdump dump to file
+ */
+static void dfo_kdump_write(int fd)
+{
+	char *blk = zg_alloc(BLK_SIZE);
+
+	memcpy(blk, &l.hdr, sizeof(l.hdr));
+	write_at(fd, blk, BLK_SIZE, 0);
+	write_at(fd, l.sub_hdr_buf, l.sub_hdr_buf_size, BLK_SIZE);
+	write_at(fd, l.bitmap, l.bitmap_size, l.bitmap_off);
+	write_at(fd, l.bitmap, l.bitmap_size, l.bitmap_off + l.bitmap_size);
+	zg_free(blk);
+	pages_write(fd);
+}
+
+/*
+ * kdump DFO operations
+ */
+struct dfo dfo_kdump = {
+	.name		= "kdump",
+	.init		= dfo_kdump_init,
+	.write		= dfo_kdump_write,
+};
@@ -151,6 +151,16 @@ static void add_cpu_to_dfo(struct dfi_cpu *cpu)
 		      DFI_VX_SA_SIZE, vx_regs, dfo_s390_dump_chunk_vx_fn);
 }
 
+/*
+ * Return memory size including holes at the start of memory
+ */
+static u64 mem_size(void)
+{
+	struct dfi_mem_chunk *mem_chunk = dfi_mem_chunk_last();
+
+	return mem_chunk ? mem_chunk->end + 1 : 0;
+}
+
 /*
  * Add memory chunk to dump layout
  */
@@ -162,6 +172,10 @@ static void add_mem_chunk_to_dfo(struct dfi_mem_chunk *mem_chunk)
 		dfo_chunk_add(mem_chunk_prev->end + 1 + DF_S390_HDR_SIZE,
 			      mem_chunk->start - mem_chunk_prev->end - 1,
 			      NULL, dfo_chunk_zero_fn);
+	/* The s390 format has no holes, so memory always starts at zero */
+	if (!mem_chunk_prev && mem_chunk->start != 0)
+		dfo_chunk_add(DF_S390_HDR_SIZE, mem_chunk->start, NULL,
+			      dfo_chunk_zero_fn);
 
 	dfo_chunk_add(mem_chunk->start + DF_S390_HDR_SIZE, mem_chunk->size,
 		      mem_chunk, dfo_chunk_mem_fn);
@@ -180,7 +194,7 @@ static void dump_chunks_init(void)
 		add_mem_chunk_to_dfo(mem_chunk);
 	dfi_cpu_iterate(cpu)
 		add_cpu_to_dfo(cpu);
-	dfo_chunk_add(dfi_mem_range() + DF_S390_HDR_SIZE,
+	dfo_chunk_add(mem_size() + DF_S390_HDR_SIZE,
 			   DF_S390_EM_SIZE,
 			   &l.em, dfo_chunk_buf_fn);
 }
@@ -202,7 +216,7 @@ static void df_s390_dump_init(void)
 	else
 		dh->version = 5;
 	dh->mem_start = 0;
-	dh->mem_size = dh->mem_end = dfi_mem_range();
+	dh->mem_size = dh->mem_end = mem_size();
 	dh->num_pages = dh->mem_size / PAGE_SIZE;
 	dh->arch = df_s390_from_dfi_arch(dfi_arch());
 	if (dfi_attr_build_arch())
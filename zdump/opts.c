@@ -21,9 +21,9 @@
  * Text for --help option
  */
 static char help_text[] =
-"Usage: zgetdump    DUMP [-s SYS] [-f FMT] > DUMP_FILE\n"
-"                -m DUMP [-s SYS] [-f FMT] DIR\n"
-"                -i DUMP [-s SYS]\n"
+"Usage: zgetdump    DUMP [-s SYS] [-r RANGE] [-e CLASS] [-f FMT] [-S] > DUMP_FILE\n"
+"                -m DUMP [-s SYS] [-r RANGE] [-e CLASS] [-f FMT] DIR\n"
+"                -i DUMP [-c] [-s SYS] [-r RANGE] [-e CLASS]\n"
 "                -d DUMPDEV\n"
 "                -u DIR\n"
 "\n"
@@ -42,11 +42,16 @@ static char help_text[] =
 "-m, --mount    Mount DUMP to mount point DIR\n"
 "-u, --umount   Unmount dump from mount point DIR\n"
 "-i, --info     Print DUMP information\n"
-"-f, --fmt      Specify target dump format FMT (\"elf\" or \"s390\")\n"
+"-c, --check    Read all DUMP data when printing DUMP information\n"
+"-f, --fmt      Specify target dump format FMT (\"elf\", \"s390\", or \"kdump\")\n"
 "-s, --select   Select system data SYS (\"kdump\", \"prod\", or \"all\")\n"
+"-S, --sparse   Write zero pages as holes when copying to a regular file\n"
+"-r, --range    Select memory range RANGE (\"START-END\", hexadecimal)\n"
+"-e, --exclude  Exclude memory of class CLASS (\"zero\")\n"
 "-d, --device   Print DUMPDEV (dump device) information\n"
 "-v, --version  Print version information, then exit\n"
 "-V, --verbose  Show detailed layout of memory map on printing DUMP information\n"
+"               and throughput and latency statistics when copying DUMP\n"
 "-h, --help     Print this help, then exit\n";
 
 static const char copyright_str[] = "Copyright IBM Corp. 2001, 2018";
@@ -129,6 +134,41 @@ static void select_set(const char *select)
 	g.opts.select_specified = 1;
 }
 
+/*
+ * Add "--range" option
+ */
+static void range_add(const char *range)
+{
+	struct opts_range *r;
+	char *end;
+
+	if (g.opts.range_cnt == OPTS_RANGE_MAX)
+		ERR_EXIT("Too many memory ranges specified (maximum %d)",
+			 OPTS_RANGE_MAX);
+	r = &g.opts.range_vec[g.opts.range_cnt];
+	r->start = strtoull(range, &end, 16);
+	if (end == range || *end != '-')
+		goto fail;
+	r->end = strtoull(end + 1, &end, 16);
+	if (*end != '\0' || end[-1] == '-' || r->end < r->start)
+		goto fail;
+	g.opts.range_cnt++;
+	return;
+fail:
+	ERR_EXIT("Invalid range argument \"%s\" specified", range);
+}
+
+/*
+ * Set "--exclude" option
+ */
+static void exclude_set(const char *class)
+{
+	if (strcmp(class, "zero") == 0)
+		g.opts.exclude_zero = 1;
+	else
+		ERR_EXIT("Invalid exclude argument \"%s\" specified", class);
+}
+
 /*
  * Set mount point
  */
@@ -185,9 +225,26 @@ static void verify_opts(void)
 			ERR_EXIT("The \"--select\" option can only be "
 				 "specified for info, mount, or copy");
 	}
+	if (g.opts.range_cnt || g.opts.exclude_zero) {
+		if (g.opts.action != ZG_ACTION_MOUNT &&
+		    g.opts.action != ZG_ACTION_STDOUT &&
+		    g.opts.action != ZG_ACTION_DUMP_INFO)
+			ERR_EXIT("The \"--range\" and \"--exclude\" options can "
+				 "only be specified for info, mount, or copy");
+	}
+	if (g.opts.sparse_specified && g.opts.action != ZG_ACTION_STDOUT)
+		ERR_EXIT("The \"--sparse\" option can only be specified "
+			 "for copy");
+	if (g.opts.check_specified && g.opts.action != ZG_ACTION_DUMP_INFO)
+		ERR_EXIT("The \"--check\" option can only be specified "
+			 "together with \"--info\"");
 	if (!g.opts.fmt_specified)
 		return;
 
+	if (g.opts.action == ZG_ACTION_MOUNT && dfo_feat_write())
+		ERR_EXIT("The \"%s\" target format cannot be used for mount",
+			 g.opts.fmt);
+
 	if (g.opts.action == ZG_ACTION_DUMP_INFO)
 		ERR_EXIT("The \"--fmt\" option cannot be specified "
 			 "together with \"--info\"");
@@ -246,6 +303,7 @@ void opts_parse(int argc, char *argv[])
 		{"help",    no_argument,       NULL, 'h'},
 		{"version", no_argument,       NULL, 'v'},
 		{"info",    no_argument,       NULL, 'i'},
+		{"check",   no_argument,       NULL, 'c'},
 		{"device",  no_argument,       NULL, 'd'},
 		{"mount",   no_argument,       NULL, 'm'},
 		{"umount",  no_argument,       NULL, 'u'},
@@ -253,9 +311,12 @@ void opts_parse(int argc, char *argv[])
 		{"select",  required_argument, NULL, 's'},
 		{"debug",   no_argument,       NULL, 'X'},
 		{"verbose", no_argument,       NULL, 'V'},
+		{"sparse",  no_argument,       NULL, 'S'},
+		{"range",   required_argument, NULL, 'r'},
+		{"exclude", required_argument, NULL, 'e'},
 		{NULL,      0,                 NULL,  0 }
 	};
-	static const char optstr[] = "hvVidmus:f:X";
+	static const char optstr[] = "hvVicdmuSs:f:r:e:X";
 
 	init_defaults();
 	while ((opt = getopt_long(argc, argv, optstr, long_opts, &idx)) != -1) {
@@ -270,6 +331,9 @@ void opts_parse(int argc, char *argv[])
 		case 'i':
 			action_set(ZG_ACTION_DUMP_INFO);
 			break;
+		case 'c':
+			g.opts.check_specified = 1;
+			break;
 		case 'd':
 			action_set(ZG_ACTION_DEVICE_INFO);
 			break;
@@ -285,6 +349,15 @@ void opts_parse(int argc, char *argv[])
 		case 's':
 			select_set(optarg);
 			break;
+		case 'S':
+			g.opts.sparse_specified = 1;
+			break;
+		case 'r':
+			range_add(optarg);
+			break;
+		case 'e':
+			exclude_set(optarg);
+			break;
 		case 'X':
 			g.opts.debug_specified = 1;
 			break;
@@ -9,31 +9,377 @@
  * it under the terms of the MIT license. See LICENSE for details.
  */
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
 #include "zgetdump.h"
 
-int stdout_write_dump(void)
+#define PIPE_BUF_SIZE		MIB
+#define PIPE_BUF_CNT		8
+#define PIPE_PAGE_CNT		(PIPE_BUF_SIZE / PAGE_SIZE)
+#define PIPE_WORKER_MAX		4
+
+/*
+ * Copy pipeline
+ *
+ * The reader thread fills the buffers of a ring with dfo_read(). With
+ * "--sparse" worker threads check the pages of filled buffers for zeros.
+ * The main thread writes the buffers in order to stdout. This allows to
+ * overlap dump device reads with the output writes.
+ */
+enum pipe_buf_state {
+	PIPE_BUF_FREE,		/* Can be filled by reader */
+	PIPE_BUF_READ,		/* Filled by reader */
+	PIPE_BUF_BUSY,		/* Processed by worker */
+	PIPE_BUF_DONE,		/* Ready for writing */
+};
+
+/*
+ * Latency statistics for one pipeline stage
+ */
+struct pipe_stat {
+	u64	cnt;
+	u64	usec_total;
+	u64	usec_max;
+};
+
+struct pipe_buf {
+	enum pipe_buf_state	state;
+	char			*data;
+	u64			cnt;
+	u8			zero_map[PIPE_PAGE_CNT];
+};
+
+static struct {
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	struct pipe_buf	buf_vec[PIPE_BUF_CNT];
+	u64		seq_read;	/* Next buffer to be filled */
+	u64		seq_work;	/* Next buffer for workers */
+	u64		seq_end;	/* Number of buffers of dump */
+	int		worker_cnt;
+	struct pipe_stat stat_read;	/* dfo_read() of reader */
+	struct pipe_stat stat_work;	/* Zero page detection of workers */
+	struct pipe_stat stat_write;	/* write() of writer */
+	struct pipe_stat stat_stall;	/* Writer waiting for buffers */
+} l;
+
+/*
+ * Return monotonic time in microseconds
+ */
+static u64 time_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Account one operation that has been started at "usec_start"
+ */
+static void pipe_stat_add(struct pipe_stat *stat, u64 usec_start)
+{
+	u64 usec = time_usec() - usec_start;
+
+	stat->cnt++;
+	stat->usec_total += usec;
+	stat->usec_max = MAX(stat->usec_max, usec);
+}
+
+/*
+ * Print statistics for one pipeline stage
+ */
+static void pipe_stat_print(const char *name, struct pipe_stat *stat)
+{
+	if (stat->cnt == 0)
+		return;
+	STDERR("  %s: %llu ops, %llu.%03llu s total, avg %llu us, "
+	       "max %llu us\n", name, stat->cnt, stat->usec_total / 1000000,
+	       (stat->usec_total / 1000) % 1000, stat->usec_total / stat->cnt,
+	       stat->usec_max);
+}
+
+/*
+ * Print copy statistics for "--verbose"
+ *
+ * The throughput is computed from the processed dump size "size", the
+ * size of the output file is "size_out".
+ */
+static void stat_print(u64 size, u64 size_out, u64 usec)
+{
+	u64 mib_per_sec = usec ? size * 1000000 / usec / MIB : 0;
+
+	STDERR("\n");
+	STDERR("Statistics:\n");
+	STDERR("  Copied.......: %llu MB in %llu.%03llu s (%llu MB/s)\n",
+	       TO_MIB(size), usec / 1000000, (usec / 1000) % 1000,
+	       mib_per_sec);
+	if (size_out != size)
+		STDERR("  Output size..: %llu MB\n", TO_MIB(size_out));
+	pipe_stat_print("Read.........", &l.stat_read);
+	pipe_stat_print("Zero check...", &l.stat_work);
+	pipe_stat_print("Write........", &l.stat_write);
+	pipe_stat_print("Write stall..", &l.stat_stall);
+}
+
+/*
+ * Check that stdout is a regular file where we can seek
+ */
+static void regular_file_check(const char *what)
+{
+	struct stat st;
+	int flags;
+
+	if (fstat(STDOUT_FILENO, &st) == -1)
+		ERR_EXIT_ERRNO("Error: Could not access standard output");
+	if (!S_ISREG(st.st_mode))
+		ERR_EXIT("%s requires a regular file as standard output", what);
+	flags = fcntl(STDOUT_FILENO, F_GETFL);
+	if (flags == -1)
+		ERR_EXIT_ERRNO("Error: Could not access standard output");
+	if (flags & O_APPEND)
+		ERR_EXIT("%s cannot be used when appending to the output file",
+			 what);
+}
+
+/*
+ * Write buffer to stdout
+ */
+static void buf_write(const char *buf, u64 cnt)
 {
-	u64 cnt, written = 0;
-	char buf[32768];
 	ssize_t rc;
 
+	rc = write(STDOUT_FILENO, buf, cnt);
+	if (rc == -1)
+		ERR_EXIT_ERRNO("Error: Write failed");
+	if (rc != (ssize_t) cnt)
+		ERR_EXIT("Error: Could not write full block");
+}
+
+/*
+ * Write buffer to stdout and skip zero pages with lseek()
+ *
+ * The "zero_map" contains one entry per page that is set for zero pages.
+ * Returns 1 if the buffer ends with a hole, otherwise 0.
+ */
+static int buf_write_sparse(const char *buf, u64 cnt, const u8 *zero_map)
+{
+	u64 off = 0, run_off;
+	int zero, hole = 0;
+
+	while (off < cnt) {
+		run_off = off;
+		zero = zero_map[off / PAGE_SIZE];
+		/* Find run of pages with the same zero state */
+		do {
+			off = MIN(off + PAGE_SIZE, cnt);
+		} while (off < cnt && zero_map[off / PAGE_SIZE] == zero);
+		if (zero) {
+			if (lseek(STDOUT_FILENO, off - run_off, SEEK_CUR) == -1)
+				ERR_EXIT_ERRNO("Error: Seek failed");
+		} else {
+			buf_write(buf + run_off, off - run_off);
+		}
+		hole = zero;
+	}
+	return hole;
+}
+
+/*
+ * Set the final file size if the sparse dump ends with a hole
+ */
+static void sparse_finish(void)
+{
+	off_t off;
+
+	off = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+	if (off == -1)
+		ERR_EXIT_ERRNO("Error: Seek failed");
+	if (ftruncate(STDOUT_FILENO, off) == -1)
+		ERR_EXIT_ERRNO("Error: Could not set size of output file");
+}
+
+/*
+ * Fill zero map for pipeline buffer
+ */
+static void pipe_buf_zero_map(struct pipe_buf *buf)
+{
+	u64 off, len;
+
+	for (off = 0; off < buf->cnt; off += PAGE_SIZE) {
+		len = MIN(PAGE_SIZE, buf->cnt - off);
+		buf->zero_map[off / PAGE_SIZE] =
+			zg_buf_is_zero(buf->data + off, len);
+	}
+}
+
+/*
+ * Pipeline reader thread: Fill buffers with output dump data
+ */
+static void *pipe_reader(void *UNUSED(arg))
+{
+	struct pipe_buf *buf;
+	u64 seq, cnt, usec;
+
+	for (seq = 0; seq < l.seq_end; seq++) {
+		buf = &l.buf_vec[seq % PIPE_BUF_CNT];
+		pthread_mutex_lock(&l.mutex);
+		while (buf->state != PIPE_BUF_FREE)
+			pthread_cond_wait(&l.cond, &l.mutex);
+		pthread_mutex_unlock(&l.mutex);
+
+		cnt = MIN((u64) PIPE_BUF_SIZE, dfo_size() - seq * PIPE_BUF_SIZE);
+		usec = time_usec();
+		buf->cnt = dfo_read(buf->data, cnt);
+		pipe_stat_add(&l.stat_read, usec);
+		if (buf->cnt != cnt)
+			ABORT("dfo_read: cnt=%llu expected=%llu", buf->cnt, cnt);
+
+		pthread_mutex_lock(&l.mutex);
+		buf->state = l.worker_cnt ? PIPE_BUF_READ : PIPE_BUF_DONE;
+		l.seq_read = seq + 1;
+		pthread_cond_broadcast(&l.cond);
+		pthread_mutex_unlock(&l.mutex);
+	}
+	return NULL;
+}
+
+/*
+ * Pipeline worker thread: Check pages of filled buffers for zeros
+ */
+static void *pipe_worker(void *UNUSED(arg))
+{
+	struct pipe_buf *buf;
+	u64 usec;
+
+	pthread_mutex_lock(&l.mutex);
+	while (1) {
+		while (l.seq_work < l.seq_end && l.seq_work == l.seq_read)
+			pthread_cond_wait(&l.cond, &l.mutex);
+		if (l.seq_work == l.seq_end)
+			break;
+		buf = &l.buf_vec[l.seq_work % PIPE_BUF_CNT];
+		buf->state = PIPE_BUF_BUSY;
+		l.seq_work++;
+		pthread_mutex_unlock(&l.mutex);
+
+		usec = time_usec();
+		pipe_buf_zero_map(buf);
+
+		pthread_mutex_lock(&l.mutex);
+		pipe_stat_add(&l.stat_work, usec);
+		buf->state = PIPE_BUF_DONE;
+		pthread_cond_broadcast(&l.cond);
+	}
+	pthread_mutex_unlock(&l.mutex);
+	return NULL;
+}
+
+/*
+ * Return number of worker threads for the pipeline
+ */
+static int pipe_worker_cnt(void)
+{
+	long cpus;
+
+	if (!g.opts.sparse_specified)
+		return 0;
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 2)
+		return 1;
+	return MIN(cpus - 1, PIPE_WORKER_MAX);
+}
+
+/*
+ * Copy dump to stdout using the pipeline
+ */
+static void pipe_copy(void)
+{
+	pthread_t reader, worker_vec[PIPE_WORKER_MAX];
+	u64 seq, usec, written = 0;
+	struct pipe_buf *buf;
+	int i, hole = 0;
+
+	pthread_mutex_init(&l.mutex, NULL);
+	pthread_cond_init(&l.cond, NULL);
+	for (i = 0; i < PIPE_BUF_CNT; i++) {
+		l.buf_vec[i].data = zg_alloc(PIPE_BUF_SIZE);
+		l.buf_vec[i].state = PIPE_BUF_FREE;
+	}
+	l.seq_end = ROUNDUP(dfo_size(), PIPE_BUF_SIZE) / PIPE_BUF_SIZE;
+	l.worker_cnt = pipe_worker_cnt();
+
+	if (pthread_create(&reader, NULL, pipe_reader, NULL))
+		ERR_EXIT_ERRNO("Error: Could not create reader thread");
+	for (i = 0; i < l.worker_cnt; i++) {
+		if (pthread_create(&worker_vec[i], NULL, pipe_worker, NULL))
+			ERR_EXIT_ERRNO("Error: Could not create worker thread");
+	}
+
+	for (seq = 0; seq < l.seq_end; seq++) {
+		buf = &l.buf_vec[seq % PIPE_BUF_CNT];
+		usec = time_usec();
+		pthread_mutex_lock(&l.mutex);
+		while (buf->state != PIPE_BUF_DONE)
+			pthread_cond_wait(&l.cond, &l.mutex);
+		pthread_mutex_unlock(&l.mutex);
+		pipe_stat_add(&l.stat_stall, usec);
+
+		usec = time_usec();
+		if (g.opts.sparse_specified)
+			hole = buf_write_sparse(buf->data, buf->cnt,
+						buf->zero_map);
+		else
+			buf_write(buf->data, buf->cnt);
+		pipe_stat_add(&l.stat_write, usec);
+		written += buf->cnt;
+		zg_progress(written);
+
+		pthread_mutex_lock(&l.mutex);
+		buf->state = PIPE_BUF_FREE;
+		pthread_cond_broadcast(&l.cond);
+		pthread_mutex_unlock(&l.mutex);
+	}
+
+	pthread_join(reader, NULL);
+	for (i = 0; i < l.worker_cnt; i++)
+		pthread_join(worker_vec[i], NULL);
+	for (i = 0; i < PIPE_BUF_CNT; i++)
+		zg_free(l.buf_vec[i].data);
+	if (hole)
+		sparse_finish();
+}
+
+int stdout_write_dump(void)
+{
+	u64 size, size_out, usec_start;
+	off_t off;
+
 	if (!dfi_feat_copy())
 		ERR_EXIT("Copying not possible for %s dumps", dfi_name());
+	if (dfo_feat_write())
+		regular_file_check("The selected target format");
+	else if (g.opts.sparse_specified)
+		regular_file_check("The \"--sparse\" option");
 	STDERR("Format Info:\n");
 	STDERR("  Source: %s\n", dfi_name());
 	STDERR("  Target: %s\n", dfo_name());
 	STDERR("\n");
-	zg_progress_init("Copying dump", dfo_size());
-	do {
-		cnt = dfo_read(buf, sizeof(buf));
-		rc = write(STDOUT_FILENO, buf, cnt);
-		if (rc == -1)
-			ERR_EXIT_ERRNO("Error: Write failed");
-		if (rc != (ssize_t) cnt)
-			ERR_EXIT("Error: Could not write full block");
-		written += cnt;
-		zg_progress(written);
-	} while (written != dfo_size());
+	usec_start = time_usec();
+	if (dfo_feat_write()) {
+		dfo_write(STDOUT_FILENO);
+		off = lseek(STDOUT_FILENO, 0, SEEK_END);
+		size = dfi_mem_range();
+		size_out = off == -1 ? 0 : off;
+	} else {
+		zg_progress_init("Copying dump", dfo_size());
+		pipe_copy();
+		size = size_out = dfo_size();
+	}
+	if (g.opts.verbose_specified)
+		stat_print(size, size_out, time_usec() - usec_start);
 	STDERR("\n");
 	STDERR("Success: Dump has been copied\n");
 	return 0;
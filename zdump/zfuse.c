@@ -22,19 +22,150 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "lib/util_list.h"
+
 #include "zgetdump.h"
 
 #define DUMP_PATH_MAX	100
 
+#define CACHE_BLK_SIZE	(128 * KIB)
+#define CACHE_BLK_CNT	256	/* 32 MiB cache */
+#define CACHE_HASH_SIZE	512
+#define RA_BLK_MAX	16	/* 2 MiB maximum readahead */
+
+/*
+ * Dump block cache
+ *
+ * Reads are served from a cache of dump blocks with LRU replacement.
+ * For sequential reads the readahead window is doubled with each read up
+ * to RA_BLK_MAX blocks, so that large parts of the dump are read in one
+ * go.
+ */
+struct cache_blk {
+	struct util_list_node	list;		/* LRU list */
+	struct cache_blk	*hash_next;
+	u64			nr;
+	char			*data;
+};
+
 /*
  * File local static data
  */
 static struct {
-	char		path[DUMP_PATH_MAX];
-	struct stat	stat_root;
-	struct stat	stat_dump;
+	char			path[DUMP_PATH_MAX];
+	struct stat		stat_root;
+	struct stat		stat_dump;
+	struct util_list	cache_lru;
+	struct cache_blk	*cache_hash[CACHE_HASH_SIZE];
+	unsigned int		cache_cnt;
+	u64			ra_next;	/* End of last read */
+	unsigned int		ra_blk_cnt;	/* Readahead window */
 } l;
 
+/*
+ * Find block in cache
+ */
+static struct cache_blk *cache_lookup(u64 nr)
+{
+	struct cache_blk *blk;
+
+	blk = l.cache_hash[nr % CACHE_HASH_SIZE];
+	while (blk && blk->nr != nr)
+		blk = blk->hash_next;
+	return blk;
+}
+
+/*
+ * Remove block from cache hash
+ */
+static void cache_hash_remove(struct cache_blk *blk)
+{
+	struct cache_blk **ptr = &l.cache_hash[blk->nr % CACHE_HASH_SIZE];
+
+	while (*ptr != blk)
+		ptr = &(*ptr)->hash_next;
+	*ptr = blk->hash_next;
+}
+
+/*
+ * Get block for new data: Allocate a new one or reuse the least recently
+ * used one
+ */
+static struct cache_blk *cache_blk_get(void)
+{
+	struct cache_blk *blk;
+
+	if (l.cache_cnt < CACHE_BLK_CNT) {
+		blk = zg_alloc(sizeof(*blk));
+		blk->data = zg_alloc(CACHE_BLK_SIZE);
+		l.cache_cnt++;
+		return blk;
+	}
+	blk = util_list_end(&l.cache_lru);
+	util_list_remove(&l.cache_lru, blk);
+	cache_hash_remove(blk);
+	return blk;
+}
+
+/*
+ * Read up to "cnt" blocks starting with block "nr" into the cache
+ *
+ * Readahead stops at the first block that is already cached.
+ */
+static struct cache_blk *cache_fill(u64 nr, unsigned int cnt)
+{
+	u64 blk_cnt = ROUNDUP(dfo_size(), CACHE_BLK_SIZE) / CACHE_BLK_SIZE;
+	struct cache_blk *blk, *first = NULL;
+	unsigned int i;
+	u64 off;
+
+	dfo_seek(nr * CACHE_BLK_SIZE);
+	for (i = 0; i < cnt && nr + i < blk_cnt; i++) {
+		if (i > 0 && cache_lookup(nr + i))
+			break;
+		blk = cache_blk_get();
+		blk->nr = nr + i;
+		off = blk->nr * CACHE_BLK_SIZE;
+		dfo_read(blk->data, MIN((u64) CACHE_BLK_SIZE, dfo_size() - off));
+		blk->hash_next = l.cache_hash[blk->nr % CACHE_HASH_SIZE];
+		l.cache_hash[blk->nr % CACHE_HASH_SIZE] = blk;
+		util_list_add_head(&l.cache_lru, blk);
+		if (!first)
+			first = blk;
+	}
+	return first;
+}
+
+/*
+ * Read dump data through the cache
+ */
+static void cache_read(char *buf, u64 off, u64 cnt)
+{
+	struct cache_blk *blk;
+	u64 nr, blk_off, len;
+
+	if (off == l.ra_next)
+		l.ra_blk_cnt = MIN(l.ra_blk_cnt * 2, (unsigned int) RA_BLK_MAX);
+	else
+		l.ra_blk_cnt = 1;
+	l.ra_next = off + cnt;
+
+	while (cnt) {
+		nr = off / CACHE_BLK_SIZE;
+		blk_off = off % CACHE_BLK_SIZE;
+		len = MIN(cnt, CACHE_BLK_SIZE - blk_off);
+		blk = cache_lookup(nr);
+		if (!blk)
+			blk = cache_fill(nr, l.ra_blk_cnt);
+		util_list_remove(&l.cache_lru, blk);
+		util_list_add_head(&l.cache_lru, blk);
+		memcpy(buf, blk->data + blk_off, len);
+		buf += len;
+		off += len;
+		cnt -= len;
+	}
+}
+
 /*
  * Initialize default values for stat buffer
  */
@@ -133,8 +264,10 @@ static int zfuse_read(const char *path, char *buf, size_t size, off_t offset,
 
 	if (strcmp(path, l.path) != 0)
 		return -ENOENT;
-	dfo_seek(offset);
-	dfo_read(buf, size);
+	if ((u64) offset >= dfo_size())
+		return 0;
+	size = MIN(size, dfo_size() - offset);
+	cache_read(buf, offset, size);
 	return size;
 }
 
@@ -208,6 +341,8 @@ int zfuse_mount_dump(void)
 	add_argv_fuse(&args);
 	stat_root_init();
 	stat_dump_init();
+	util_list_init(&l.cache_lru, struct cache_blk, list);
+	l.ra_blk_cnt = 1;
 	snprintf(l.path, sizeof(l.path), "/dump.%s", dfo_name());
 	return fuse_main(args.argc, args.argv, &zfuse_ops);
 }
@@ -11,9 +11,12 @@
 
 #include <limits.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/sysmacros.h>
 #include <sys/time.h>
 
+#include "lib/zt_probe.h"
+
 #include "zgetdump.h"
 
 #define MAX_EXIT_FN	10
@@ -119,6 +122,18 @@ char *zg_strdup(const char *str)
 	return new_str;
 }
 
+/*
+ * Check if buffer contains only zeros
+ */
+int zg_buf_is_zero(const void *buf, size_t len)
+{
+	const char *ptr = buf;
+
+	if (len == 0)
+		return 1;
+	return ptr[0] == 0 && memcmp(ptr, ptr + 1, len - 1) == 0;
+}
+
 /*
  * Free memory
  */
@@ -143,6 +158,30 @@ const struct stat *zg_stat(struct zg_fh *zg_fh)
 	return &zg_fh->sb;
 }
 
+/*
+ * Map regular files that are opened read-only
+ *
+ * Reads are then done by copying from the mapping which saves the
+ * read() and lseek() system calls. If the file cannot be mapped, we
+ * fall back to read().
+ */
+static void map_init(struct zg_fh *zg_fh, int flags)
+{
+	void *map;
+
+	if (!S_ISREG(zg_fh->sb.st_mode) || (flags & O_ACCMODE) != O_RDONLY)
+		return;
+	if (zg_fh->sb.st_size <= 0 ||
+	    (u64) zg_fh->sb.st_size != (size_t) zg_fh->sb.st_size)
+		return;
+	map = mmap(NULL, zg_fh->sb.st_size, PROT_READ, MAP_PRIVATE,
+		   zg_fh->fh, 0);
+	if (map == MAP_FAILED)
+		return;
+	zg_fh->map = map;
+	zg_fh->pos = 0;
+}
+
 /*
  * Open file
  */
@@ -170,6 +209,7 @@ struct zg_fh *zg_open(const char *path, int flags, enum zg_check check)
 		if (lseek(zg_fh->fh, 0, SEEK_SET) == (off_t)-1)
 			goto fail;
 	}
+	map_init(zg_fh, flags);
 	return zg_fh;
 
 fail:
@@ -182,6 +222,8 @@ fail:
  */
 void zg_close(struct zg_fh *zg_fh)
 {
+	if (zg_fh->map)
+		munmap((void *) zg_fh->map, zg_fh->sb.st_size);
 	close(zg_fh->fh);
 	free(zg_fh);
 }
@@ -189,11 +231,23 @@ void zg_close(struct zg_fh *zg_fh)
 /*
  * Read file
  */
-ssize_t zg_read(struct zg_fh *zg_fh, void *buf, size_t cnt, enum zg_check check)
+static ssize_t do_read(struct zg_fh *zg_fh, void *buf, size_t cnt,
+		       enum zg_check check)
 {
 	size_t copied = 0;
 	ssize_t rc;
 
+	if (zg_fh->map) {
+		if (zg_fh->pos < zg_fh->sb.st_size)
+			copied = MIN((u64) cnt,
+				     (u64) (zg_fh->sb.st_size - zg_fh->pos));
+		if (copied != cnt && check == ZG_CHECK)
+			ERR_EXIT("Unexpected end of file for \"%s\"",
+				 zg_fh->path);
+		memcpy(buf, zg_fh->map + zg_fh->pos, copied);
+		zg_fh->pos += copied;
+		return copied;
+	}
 	do {
 		rc = read(zg_fh->fh, buf + copied, cnt - copied);
 		if (rc == -1) {
@@ -212,6 +266,20 @@ ssize_t zg_read(struct zg_fh *zg_fh, void *buf, size_t cnt, enum zg_check check)
 	return copied;
 }
 
+/*
+ * Read file and report the read with USDT probes. The file position is
+ * only reported for mapped files, otherwise it is -1.
+ */
+ssize_t zg_read(struct zg_fh *zg_fh, void *buf, size_t cnt, enum zg_check check)
+{
+	ssize_t rc;
+
+	ZT_PROBE(zgetdump, zg_read, zg_fh->map ? zg_fh->pos : -1, cnt);
+	rc = do_read(zg_fh, buf, cnt, check);
+	ZT_PROBE(zgetdump, zg_read_done, cnt, rc);
+	return rc;
+}
+
 /*
  * Read line
  */
@@ -224,7 +292,10 @@ ssize_t zg_gets(struct zg_fh *zg_fh, void *ptr, size_t cnt, enum zg_check check)
 	if (cnt == 0)
 		return 0;
 	do {
-		rc = read(zg_fh->fh, &buf[copied], 1);
+		if (zg_fh->map)
+			rc = zg_read(zg_fh, &buf[copied], 1, ZG_CHECK_NONE);
+		else
+			rc = read(zg_fh->fh, &buf[copied], 1);
 		if (rc == -1) {
 			if (check == ZG_CHECK_NONE)
 				return rc;
@@ -246,6 +317,19 @@ u64 zg_size(struct zg_fh *zg_fh)
 	return zg_fh->sb.st_size;
 }
 
+/*
+ * Set file position for mapped file
+ */
+static off_t map_seek(struct zg_fh *zg_fh, off_t pos)
+{
+	if (pos < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	zg_fh->pos = pos;
+	return pos;
+}
+
 /*
  * Return file position
  */
@@ -253,6 +337,8 @@ off_t zg_tell(struct zg_fh *zg_fh, enum zg_check check)
 {
 	off_t rc;
 
+	if (zg_fh->map)
+		return zg_fh->pos;
 	rc = lseek(zg_fh->fh, 0, SEEK_CUR);
 	if (rc == -1 && check != ZG_CHECK_NONE)
 		ERR_EXIT_ERRNO("Could not get file position for \"%s\"",
@@ -267,7 +353,10 @@ off_t zg_seek_end(struct zg_fh *zg_fh, off_t off, enum zg_check check)
 {
 	off_t rc;
 
-	rc = lseek(zg_fh->fh, off, SEEK_END);
+	if (zg_fh->map)
+		rc = map_seek(zg_fh, zg_fh->sb.st_size + off);
+	else
+		rc = lseek(zg_fh->fh, off, SEEK_END);
 	if (rc == -1 && check != ZG_CHECK_NONE)
 		ERR_EXIT_ERRNO("Could not seek \"%s\"", zg_fh->path);
 	return rc;
@@ -280,7 +369,10 @@ off_t zg_seek(struct zg_fh *zg_fh, off_t off, enum zg_check check)
 {
 	off_t rc;
 
-	rc = lseek(zg_fh->fh, off, SEEK_SET);
+	if (zg_fh->map)
+		rc = map_seek(zg_fh, off);
+	else
+		rc = lseek(zg_fh->fh, off, SEEK_SET);
 	if (rc == -1 && check != ZG_CHECK_NONE)
 		ERR_EXIT_ERRNO("Could not seek \"%s\"", zg_fh->path);
 	if (rc != off && check == ZG_CHECK)
@@ -295,7 +387,10 @@ off_t zg_seek_cur(struct zg_fh *zg_fh, off_t off, enum zg_check check)
 {
 	off_t rc;
 
-	rc = lseek(zg_fh->fh, off, SEEK_CUR);
+	if (zg_fh->map)
+		rc = map_seek(zg_fh, zg_fh->pos + off);
+	else
+		rc = lseek(zg_fh->fh, off, SEEK_CUR);
 	if (rc == -1 && check != ZG_CHECK_NONE)
 		ERR_EXIT_ERRNO("Could not seek \"%s\"", zg_fh->path);
 	return rc;
@@ -49,6 +49,7 @@ extern void *zg_alloc(unsigned int size);
 extern void *zg_realloc(void *ptr, unsigned int size);
 extern void zg_free(void *ptr);
 extern char *zg_strdup(const char *str);
+extern int zg_buf_is_zero(const void *buf, size_t len);
 
 /*
  * At exit functions
@@ -151,6 +152,8 @@ struct zg_fh {
 	const char	*path;
 	int		fh;
 	struct stat	sb;
+	const char	*map;	/* Mapping for regular files or NULL */
+	off_t		pos;	/* File position if mapped */
 };
 
 enum zg_type {
@@ -131,6 +131,10 @@ static int do_dump_info(void)
 	}
 	kdump_select_check();
 	dfi_info_print();
+	if (g.opts.check_specified && dfi_check() != 0) {
+		STDERR("\nERROR: Dump data cannot be read\n");
+		zg_exit(1);
+	}
 	dfi_exit();
 	return 0;
 }
@@ -13,13 +13,25 @@
 #define ZGETDUMP_H
 
 #include "df_elf.h"
+#include "df_kdump.h"
 #include "df_lkcd.h"
 #include "df_s390.h"
+#include "df_sparse.h"
 #include "dfi.h"
 #include "dfo.h"
 #include "dt.h"
 #include "zg.h"
 
+#define OPTS_RANGE_MAX	16
+
+/*
+ * Memory range for "--range" option
+ */
+struct opts_range {
+	u64	start;
+	u64	end;
+};
+
 /*
  * zgetdump options
  */
@@ -36,6 +48,11 @@ struct options {
 	const char	*select;
 	int		select_specified;
 	int		verbose_specified;
+	int		sparse_specified;
+	int		check_specified;
+	struct opts_range range_vec[OPTS_RANGE_MAX];
+	int		range_cnt;
+	int		exclude_zero;
 };
 
 extern const char *OPTS_SELECT_KDUMP;
@@ -81,6 +98,7 @@ extern struct dfi dfi_s390;
 extern struct dfi dfi_s390_ext;
 extern struct dfi dfi_lkcd;
 extern struct dfi dfi_elf;
+extern struct dfi dfi_sparse;
 extern struct dfi dfi_kdump;
 extern struct dfi dfi_kdump_flat;
 extern struct dfi dfi_devmem;
@@ -90,6 +108,7 @@ extern struct dfi dfi_devmem;
  */
 extern struct dfo dfo_s390;
 extern struct dfo dfo_elf;
+extern struct dfo dfo_kdump;
 
 /*
  * Supported s390 dumpers
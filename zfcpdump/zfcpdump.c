@@ -90,6 +90,10 @@ static int parse_parameter(char *parameter)
 				g.parm_debug = PARM_DEBUG_DFLT;
 			}
 		}
+	} else if (strcmp(token, PARM_SPARSE) == 0) {
+		/* Dump Sparse */
+		char *s = strtok(NULL, "=");
+		g.parm_sparse = (s == NULL) || (atoi(s) != 0);
 	}
 	return 0;
 }
@@ -139,6 +143,7 @@ static int parse_parmline(void)
 		}
 	}
 	PRINT_TRACE("dump debug: %d\n", g.parm_debug);
+	PRINT_TRACE("dump sparse: %d\n", g.parm_sparse);
 	close(fh);
 	return 0;
 }
@@ -55,6 +55,7 @@
 
 struct globals {
 	int	parm_debug;
+	int	parm_sparse;
 	char	parmline[CMDLINE_MAX_LEN];
 	struct	sigaction sigact;
 	char	dump_devno[16];
@@ -83,6 +84,8 @@ extern struct globals g;
 #define PARM_DEBUG_MIN	1
 #define PARM_DEBUG_MAX	6
 
+#define PARM_SPARSE	"dump_sparse"
+
 #define WAIT_TIME_END		3 /* seconds */
 #define WAIT_TIME_ONLINE	2 /* seconds */
 
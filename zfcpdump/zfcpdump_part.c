@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <linux/hdreg.h>
 #include <linux/reboot.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -40,6 +41,11 @@
 
 #define COPY_BUF_SIZE		0x10000UL
 #define COPY_TABLE_ENTRY_COUNT	4
+#define DIRECT_BUF_SIZE		0x100000UL
+#define DIRECT_ALIGN		PAGE_SIZE
+#define SPARSE_BITMAP_BUF_SIZE	PAGE_SIZE
+
+#define ROUNDUP(x, y)	((((x) + ((y) - 1)) / (y)) * (y))
 
 /*
  * Copy table entry
@@ -100,6 +106,44 @@ struct scsi_mbr {
 #define BOOT_INFO_DEV_TYPE_SCSI		0x02
 #define BOOT_INFO_BP_TYPE_DUMP		0x01
 
+/*
+ * Sparse dump header, see zdump/df_sparse.h
+ */
+struct sparse_dump_hdr {
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	page_size;
+	uint64_t	elf_off;
+	uint64_t	elf_size;
+	uint64_t	load_off;
+	uint64_t	load_size;
+	uint64_t	bitmap_off;
+	uint64_t	bitmap_size;
+	uint64_t	data_off;
+	uint64_t	page_cnt;
+} __packed;
+
+#define SPARSE_DUMP_MAGIC	0x5a53504152534544ULL /* ZSPARSED */
+#define SPARSE_DUMP_VERSION	1
+
+/*
+ * Double-buffered O_DIRECT writer: The writer thread writes one buffer
+ * to the partition while the next one is read from /proc/vmcore.
+ */
+struct direct_writer {
+	int		fd;
+	pthread_t	thread;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	void		*buf[2];
+	unsigned long	len[2];
+	off_t		off[2];
+	int		full[2];
+	int		idx;
+	int		stop;
+	int		err;
+};
+
 /*
  * Globals
  */
@@ -278,6 +322,355 @@ static int copy_table_entry_write(int fdin, int fdout,
 	return 0;
 }
 
+/*
+ * Write all buffers handed over to the writer thread
+ */
+static void *direct_writer_thread(void *arg)
+{
+	struct direct_writer *dw = arg;
+	unsigned long done;
+	ssize_t rc;
+	int idx = 0;
+
+	while (1) {
+		pthread_mutex_lock(&dw->lock);
+		while (!dw->full[idx] && !dw->stop)
+			pthread_cond_wait(&dw->cond, &dw->lock);
+		if (!dw->full[idx]) {
+			pthread_mutex_unlock(&dw->lock);
+			break;
+		}
+		pthread_mutex_unlock(&dw->lock);
+
+		for (done = 0; done < dw->len[idx] && !dw->err; done += rc) {
+			rc = pwrite(dw->fd, dw->buf[idx] + done,
+				    dw->len[idx] - done, dw->off[idx] + done);
+			if (rc <= 0) {
+				PRINT_PERR("Write to partition failed\n");
+				dw->err = -1;
+				rc = 0;
+				break;
+			}
+		}
+
+		pthread_mutex_lock(&dw->lock);
+		dw->full[idx] = 0;
+		pthread_cond_broadcast(&dw->cond);
+		pthread_mutex_unlock(&dw->lock);
+		idx ^= 1;
+	}
+	return NULL;
+}
+
+/*
+ * Open the partition with O_DIRECT and start the writer thread
+ */
+static int direct_writer_start(struct direct_writer *dw, const char *out)
+{
+	memset(dw, 0, sizeof(*dw));
+	dw->fd = open(out, O_WRONLY | O_DIRECT);
+	if (dw->fd < 0)
+		return -1;
+	if (posix_memalign(&dw->buf[0], DIRECT_ALIGN, DIRECT_BUF_SIZE))
+		goto out_close;
+	if (posix_memalign(&dw->buf[1], DIRECT_ALIGN, DIRECT_BUF_SIZE))
+		goto out_free;
+	pthread_mutex_init(&dw->lock, NULL);
+	pthread_cond_init(&dw->cond, NULL);
+	if (pthread_create(&dw->thread, NULL, direct_writer_thread, dw) == 0)
+		return 0;
+	free(dw->buf[1]);
+out_free:
+	free(dw->buf[0]);
+out_close:
+	close(dw->fd);
+	return -1;
+}
+
+/*
+ * Wait until the next buffer is free and return it
+ */
+static void *direct_writer_get(struct direct_writer *dw)
+{
+	pthread_mutex_lock(&dw->lock);
+	while (dw->full[dw->idx])
+		pthread_cond_wait(&dw->cond, &dw->lock);
+	pthread_mutex_unlock(&dw->lock);
+	return dw->err ? NULL : dw->buf[dw->idx];
+}
+
+/*
+ * Hand over the buffer returned by direct_writer_get() to the writer thread
+ */
+static void direct_writer_put(struct direct_writer *dw, unsigned long len,
+			      off_t off)
+{
+	pthread_mutex_lock(&dw->lock);
+	dw->len[dw->idx] = len;
+	dw->off[dw->idx] = off;
+	dw->full[dw->idx] = 1;
+	pthread_cond_broadcast(&dw->cond);
+	pthread_mutex_unlock(&dw->lock);
+	dw->idx ^= 1;
+}
+
+/*
+ * Wait until all buffers are written
+ */
+static int direct_writer_flush(struct direct_writer *dw)
+{
+	pthread_mutex_lock(&dw->lock);
+	while (dw->full[0] || dw->full[1])
+		pthread_cond_wait(&dw->cond, &dw->lock);
+	pthread_mutex_unlock(&dw->lock);
+	return dw->err;
+}
+
+static void direct_writer_stop(struct direct_writer *dw)
+{
+	pthread_mutex_lock(&dw->lock);
+	dw->stop = 1;
+	pthread_cond_broadcast(&dw->cond);
+	pthread_mutex_unlock(&dw->lock);
+	pthread_join(dw->thread, NULL);
+	fsync(dw->fd);
+	close(dw->fd);
+	free(dw->buf[0]);
+	free(dw->buf[1]);
+}
+
+/*
+ * Copy one copy table entry with the O_DIRECT writer. Parts of the entry
+ * that do not meet the O_DIRECT alignment are written via fdout.
+ */
+static int copy_table_entry_direct(int fdin, int fdout,
+				   struct direct_writer *dw,
+				   struct copy_table_entry *entry,
+				   unsigned long offset)
+{
+	unsigned long buf_size, bytes_left, off;
+	struct copy_table_entry tail;
+	ssize_t rc;
+	void *buf;
+
+	if ((entry->off + offset) % DIRECT_ALIGN)
+		return copy_table_entry_write(fdin, fdout, entry, offset);
+
+	off = entry->off;
+	bytes_left = entry->size - entry->size % DIRECT_ALIGN;
+	while (bytes_left > 0) {
+		buf_size = MIN(DIRECT_BUF_SIZE, bytes_left);
+		buf = direct_writer_get(dw);
+		if (!buf)
+			return -1;
+		rc = pread(fdin, buf, buf_size, off);
+		if (rc != (ssize_t) buf_size) {
+			PRINT_PERR("Read from /proc/vmcore failed\n");
+			direct_writer_flush(dw);
+			return -1;
+		}
+		direct_writer_put(dw, buf_size, off + offset);
+		bytes_left -= buf_size;
+		off += buf_size;
+		show_progress(buf_size);
+	}
+	if (direct_writer_flush(dw))
+		return -1;
+
+	/* Unaligned rest of the entry */
+	tail.off = off;
+	tail.size = entry->size % DIRECT_ALIGN;
+	return copy_table_entry_write(fdin, fdout, &tail, offset);
+}
+
+/*
+ * Check if page contains only zeros
+ */
+static int page_is_zero(const void *page)
+{
+	const unsigned long *word = page;
+	unsigned int i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(*word); i++) {
+		if (word[i])
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Write buffer with stored pages of the sparse dump. With the O_DIRECT
+ * writer "buf" is replaced by the next free writer buffer.
+ */
+static int sparse_data_write(int fdout, struct direct_writer *dw, void **buf,
+			     unsigned long len, off_t off)
+{
+	if (dw) {
+		direct_writer_put(dw, len, off);
+		*buf = direct_writer_get(dw);
+		return *buf ? 0 : -1;
+	}
+	if (pwrite(fdout, *buf, len, off) != (ssize_t) len) {
+		PRINT_PERR("Write to partition failed\n");
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Write bitmap bytes of the sparse dump
+ */
+static int sparse_bitmap_write(int fdout, void *buf, unsigned long len,
+			       off_t off)
+{
+	if (pwrite(fdout, buf, len, off) != (ssize_t) len) {
+		PRINT_PERR("Write to partition failed\n");
+		return -1;
+	}
+	memset(buf, 0, len);
+	return 0;
+}
+
+/*
+ * Copy dump in sparse format: Only pages of the vmcore memory loads that
+ * are not zero are written. The HSA is read first and the dump header is
+ * written last.
+ */
+static int copy_dump_sparse(int fdin, int fdout, struct direct_writer *dw,
+			    struct copy_table_entry *table,
+			    unsigned long offset)
+{
+	unsigned long buf_size, bytes_left, off, hsa_end, bm_done = 0;
+	unsigned long pg = 0, len = 0, data_done = 0, i;
+	unsigned char bitmap[SPARSE_BITMAP_BUF_SIZE] = {};
+	struct sparse_dump_hdr hdr = {};
+	struct copy_table_entry elf;
+	void *in_buf, *out_buf;
+	int hsa_released = 0;
+	int rc = -1;
+
+	hdr.magic = SPARSE_DUMP_MAGIC;
+	hdr.version = SPARSE_DUMP_VERSION;
+	hdr.page_size = PAGE_SIZE;
+	hdr.elf_off = PAGE_SIZE;
+	hdr.elf_size = table[0].off;
+	hdr.load_off = table[0].off;
+	hdr.load_size = g.vmcore_size - table[0].off;
+	hdr.bitmap_off = ROUNDUP(hdr.elf_off + hdr.elf_size, PAGE_SIZE);
+	hdr.bitmap_size = ROUNDUP(hdr.load_size, PAGE_SIZE * 8) /
+			  (PAGE_SIZE * 8);
+	hdr.data_off = ROUNDUP(hdr.bitmap_off + hdr.bitmap_size, PAGE_SIZE);
+	if (hdr.data_off > dump_sb.dump_size) {
+		PRINT_ERR("Disk too small: header=%lldMB (diskspace=%lldMB)\n",
+			  TO_MIB(hdr.data_off), TO_MIB(dump_sb.dump_size));
+		return -1;
+	}
+	if (posix_memalign(&in_buf, DIRECT_ALIGN, DIRECT_BUF_SIZE)) {
+		PRINT_ERR("Out of memory\n");
+		return -1;
+	}
+	if (dw)
+		out_buf = direct_writer_get(dw);
+	else if (posix_memalign(&out_buf, DIRECT_ALIGN, DIRECT_BUF_SIZE))
+		out_buf = NULL;
+	if (!out_buf) {
+		PRINT_ERR("Out of memory\n");
+		goto out_free;
+	}
+	hsa_end = table[0].off + table[0].size;
+	off = hdr.load_off;
+	bytes_left = hdr.load_size;
+	while (bytes_left > 0) {
+		if (!hsa_released && off >= hsa_end) {
+			release_hsa();
+			hsa_released = 1;
+		}
+		buf_size = MIN(DIRECT_BUF_SIZE, bytes_left);
+		if (!hsa_released)
+			buf_size = MIN(buf_size, hsa_end - off);
+		if (pread(fdin, in_buf, buf_size, off) !=
+		    (ssize_t) buf_size) {
+			PRINT_PERR("Read from /proc/vmcore failed\n");
+			goto out_free_out;
+		}
+		memset(in_buf + buf_size, 0,
+		       ROUNDUP(buf_size, PAGE_SIZE) - buf_size);
+		for (i = 0; i < buf_size; i += PAGE_SIZE, pg++) {
+			if (!page_is_zero(in_buf + i)) {
+				memcpy(out_buf + len, in_buf + i, PAGE_SIZE);
+				bitmap[(pg / 8) % sizeof(bitmap)] |=
+					1U << (pg % 8);
+				len += PAGE_SIZE;
+				hdr.page_cnt++;
+			}
+			if (len == DIRECT_BUF_SIZE) {
+				if (hdr.data_off + data_done + len >
+				    dump_sb.dump_size)
+					goto out_too_small;
+				if (sparse_data_write(fdout, dw, &out_buf, len,
+						      offset + hdr.data_off +
+						      data_done))
+					goto out_free_out;
+				data_done += len;
+				len = 0;
+			}
+			if ((pg + 1) % (sizeof(bitmap) * 8) == 0) {
+				if (sparse_bitmap_write(fdout, bitmap,
+							sizeof(bitmap),
+							offset + bm_done +
+							hdr.bitmap_off))
+					goto out_free_out;
+				bm_done += sizeof(bitmap);
+			}
+		}
+		bytes_left -= buf_size;
+		off += buf_size;
+		show_progress(buf_size);
+	}
+	if (!hsa_released)
+		release_hsa();
+	if (hdr.data_off + data_done + len > dump_sb.dump_size)
+		goto out_too_small;
+	if (len && sparse_data_write(fdout, dw, &out_buf, len,
+				     offset + hdr.data_off + data_done))
+		goto out_free_out;
+	if (dw && direct_writer_flush(dw))
+		goto out_free_out;
+	if (hdr.bitmap_size > bm_done &&
+	    sparse_bitmap_write(fdout, bitmap, hdr.bitmap_size - bm_done,
+				offset + hdr.bitmap_off + bm_done))
+		goto out_free_out;
+
+	/* ELF header and notes */
+	elf.off = 0;
+	elf.size = hdr.elf_size;
+	if (copy_table_entry_write(fdin, fdout, &elf, offset + hdr.elf_off))
+		goto out_free_out;
+
+	/* Write the header at last to make the dump valid */
+	memset(in_buf, 0, PAGE_SIZE);
+	memcpy(in_buf, &hdr, sizeof(hdr));
+	if (pwrite(fdout, in_buf, PAGE_SIZE, offset) != PAGE_SIZE) {
+		PRINT_PERR("Write to partition failed\n");
+		goto out_free_out;
+	}
+	PRINT(" %llu of %llu MB written (zero pages skipped)\n",
+	      TO_MIB(hdr.data_off + hdr.page_cnt * PAGE_SIZE),
+	      TO_MIB(g.vmcore_size));
+	rc = 0;
+	goto out_free_out;
+out_too_small:
+	PRINT_ERR("Disk too small: dump=%lldMB (diskspace=%lldMB)\n",
+		  TO_MIB(hdr.data_off + hdr.page_cnt * PAGE_SIZE),
+		  TO_MIB(dump_sb.dump_size));
+out_free_out:
+	if (!dw)
+		free(out_buf);
+out_free:
+	free(in_buf);
+	return rc;
+}
+
 /*
  * Copy dump using mmap (copy HSA first)
  */
@@ -286,6 +679,8 @@ static int copy_dump(const char *in, const char *out, unsigned long offset)
 	struct copy_table_entry table[COPY_TABLE_ENTRY_COUNT];
 	char busy_str[] = "zfcpdump busy";
 	int fdout, fdin, i, rc = -1;
+	struct direct_writer dw;
+	int direct;
 
 	fdin = open(in, O_RDONLY);
 	if (fdin < 0) {
@@ -294,7 +689,7 @@ static int copy_dump(const char *in, const char *out, unsigned long offset)
 	}
 	g.vmcore_size = lseek(fdin, (off_t) 0, SEEK_END);
 	lseek(fdin, 0L, SEEK_SET);
-	if (g.vmcore_size > dump_sb.dump_size) {
+	if (!g.parm_sparse && g.vmcore_size > dump_sb.dump_size) {
 		PRINT_ERR("Disk too small: dump=%lldMB (diskspace=%lldMB)\n",
 			  TO_MIB(g.vmcore_size), TO_MIB(dump_sb.dump_size));
 		goto out_close_fdin;
@@ -313,15 +708,38 @@ static int copy_dump(const char *in, const char *out, unsigned long offset)
 		goto out_close_fdin;
 	if (copy_table_init(fdin, table))
 		goto out_close_fdin;
+	/*
+	 * Bypass the page cache if possible, the zfcpdump kernel has
+	 * only little memory available
+	 */
+	direct = direct_writer_start(&dw, out) == 0;
+	if (!direct)
+		PRINT_WARN("Direct I/O not possible, using buffered I/O\n");
 	show_progress(0);
+	if (g.parm_sparse) {
+		rc = copy_dump_sparse(fdin, fdout,
+				      direct && offset % DIRECT_ALIGN == 0 ?
+				      &dw : NULL, table, offset);
+		goto out_stop_direct;
+	}
 	for (i = 0; i < COPY_TABLE_ENTRY_COUNT; i++) {
-		if (copy_table_entry_write(fdin, fdout, &table[i], offset))
-			goto out_close_fdout;
+		if (direct)
+			rc = copy_table_entry_direct(fdin, fdout, &dw,
+						     &table[i], offset);
+		else
+			rc = copy_table_entry_write(fdin, fdout, &table[i],
+						    offset);
+		if (rc) {
+			rc = -1;
+			goto out_stop_direct;
+		}
 		if (i == 0) /* 0 is the HSA */
 			release_hsa();
 	}
 	rc = 0;
-out_close_fdout:
+out_stop_direct:
+	if (direct)
+		direct_writer_stop(&dw);
 	if (csum_update(fdout))
 		rc = -1;
 	fsync(fdout);
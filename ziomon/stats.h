@@ -121,6 +121,40 @@ static inline void histlog2_account(__u32 *bucket, __u32 val,
 	bucket[index]++;
 }
 
+/**
+ * Estimate the 'q' quantile (0 < q < 1) of the values accounted in 'a',
+ * interpolating linearly within the bucket. 'min' and 'max' are the lowest
+ * and highest values accounted: They bound the estimate and close the last
+ * bucket. Since histograms merge without loss, so do the estimates.
+ */
+static inline double histlog2_quantile(const __u32 a[],
+				       const struct histlog2 *h, double q,
+				       __u64 min, __u64 max)
+{
+	double total = 0, cum = 0, rank, lo, hi, val;
+	int i;
+
+	for (i = 0; i < h->num; i++)
+		total += a[i];
+	if (total == 0)
+		return 0;
+
+	rank = q * total;
+	for (i = 0; i < h->num - 1 && cum + a[i] < rank; i++)
+		cum += a[i];
+	lo = i ? histlog2_upper_limit(i - 1, h) : (__u64)h->first;
+	hi = i < h->num - 1 ? histlog2_upper_limit(i, h) : max;
+	if (hi < lo)
+		hi = lo;
+	val = lo + (hi - lo) * (a[i] ? (rank - cum) / a[i] : 0);
+	if (val < min)
+		val = min;
+	if (val > max)
+		val = max;
+
+	return val;
+}
+
 static inline void histlog2_merge(struct histlog2 *h, __u32 *dst, const __u32 *src)
 {
 	int i;
@@ -13,9 +13,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "lib/zt_probe.h"
+
 #include "ziomon_dacc.h"
 #include "ziomon_msg_tools.h"
 #include "ziomon_util.h"
@@ -60,6 +64,19 @@ static int wrapped = -1;
 static int open_count = 0;
 #endif
 
+/* private mapping of the .log file opened by open_log_file() */
+static char *log_map;
+static size_t log_map_size;
+
+/* state of the .idx file as maintained by add_msg() */
+static struct {
+	FILE	*fp;
+	__u32	*cycles;	/* wrap cycle in which each entry was set */
+	long	 num_entries;
+	__u32	 cycle;
+	long	 last_pos;
+} index_state;
+
 
 /**
  * Calculate size of the message. In contrast to the message's
@@ -69,6 +86,139 @@ static __u32 get_total_msg_size(struct message *msg) {
 }
 
 
+/**
+ * Strip flags from the version in the file header */
+static __u32 get_format(__u32 ver)
+{
+	return ver & ~DATA_MGR_COMPACT;
+}
+
+
+static int is_compact_msg(__u32 type)
+{
+	return (type != ZIOMON_DACC_GARBAGE_MSG && (type & DACC_MSG_COMPACT));
+}
+
+
+static int put_varint(unsigned char *buf, __u32 val)
+{
+	int i = 0;
+
+	while (val >= 0x80) {
+		buf[i++] = (val & 0x7f) | 0x80;
+		val >>= 7;
+	}
+	buf[i++] = val;
+
+	return i;
+}
+
+
+static int get_varint(const unsigned char *buf, const unsigned char *end,
+		      __u32 *val)
+{
+	int i = 0, shift = 0;
+
+	*val = 0;
+	do {
+		if (buf + i >= end || shift > 28)
+			return -1;
+		*val |= (__u32)(buf[i] & 0x7f) << shift;
+		shift += 7;
+	} while (buf[i++] & 0x80);
+
+	return i;
+}
+
+
+/**
+ * Compact form of a message: the timestamp, the original length and each
+ * 32 bit word of the remaining data as a variable length integer, followed
+ * by the remaining bytes. Since most counters and histogram buckets are
+ * small or 0, this takes a fraction of the original size.
+ * Returns 0 if successful, >0 if the message is not worth compacting.
+ */
+static int compact_msg(struct message *msg, struct message *cmsg)
+{
+	const unsigned char *src = msg->data;
+	unsigned char *buf;
+	__u32 i, num_words, word, len = 8;
+
+	if (msg->length < 8 || (msg->type & DACC_MSG_COMPACT))
+		return 1;
+	num_words = (msg->length - 8) / 4;
+	buf = malloc(8 + 5 + num_words * 5 + 3);
+	if (!buf)
+		return 1;
+	memcpy(buf, src, 8);
+	len += put_varint(buf + len, msg->length);
+	for (i = 0; i < num_words; ++i) {
+		word = src[8 + 4 * i] << 24 | src[9 + 4 * i] << 16
+			| src[10 + 4 * i] << 8 | src[11 + 4 * i];
+		len += put_varint(buf + len, word);
+	}
+	memcpy(buf + len, src + 8 + 4 * num_words, (msg->length - 8) % 4);
+	len += (msg->length - 8) % 4;
+	if (len >= msg->length) {
+		free(buf);
+		return 1;
+	}
+	cmsg->length = len;
+	cmsg->type = msg->type | DACC_MSG_COMPACT;
+	cmsg->data = buf;
+
+	return 0;
+}
+
+
+/**
+ * Restore the original message from the compact form in 'data'.
+ * msg->data is replaced by an allocated buffer.
+ */
+static int expand_msg(struct message *msg, const void *data, __u32 length)
+{
+	const unsigned char *src = data, *end = src + length;
+	unsigned char *buf;
+	__u32 i, num_words, word, orig_len;
+	int rc, pos = 8;
+
+	if (length < 8 || (rc = get_varint(src + pos, end, &orig_len)) < 0
+	    || orig_len < 8)
+		goto err;
+	pos += rc;
+	buf = malloc(orig_len);
+	if (!buf)
+		goto err;
+	memcpy(buf, src, 8);
+	num_words = (orig_len - 8) / 4;
+	for (i = 0; i < num_words; ++i) {
+		if ((rc = get_varint(src + pos, end, &word)) < 0) {
+			free(buf);
+			goto err;
+		}
+		pos += rc;
+		buf[8 + 4 * i] = word >> 24;
+		buf[9 + 4 * i] = word >> 16;
+		buf[10 + 4 * i] = word >> 8;
+		buf[11 + 4 * i] = word;
+	}
+	if (src + pos + (orig_len - 8) % 4 != end) {
+		free(buf);
+		goto err;
+	}
+	memcpy(buf + 8 + 4 * num_words, src + pos, (orig_len - 8) % 4);
+	msg->length = orig_len;
+	msg->type &= ~DACC_MSG_COMPACT;
+	msg->data = buf;
+
+	return 0;
+
+err:
+	fprintf(stderr, "%s: Corrupt compact message\n", toolname);
+	return -1;
+}
+
+
 /**
  * Position at first _physical_ message, not necessarily the first
  * logical message */
@@ -184,6 +334,7 @@ static int read_message_header(FILE *fp, __u32 *length, __u32 *type)
 static int read_message(FILE *fp, struct message *msg, __u32 ver,
 			__u32 msgid_blkiomon)
 {
+	void *data;
 	int rc;
 
 	if ( (rc = read_message_header(fp, &msg->length, &msg->type)) )
@@ -200,7 +351,14 @@ static int read_message(FILE *fp, struct message *msg, __u32 ver,
 				" content\n", toolname, msg->length);
 			return -1;
 		}
-		if (ver == DATA_MGR_V2 && msgid_blkiomon != IS_NO_BLKIOMON_MSG
+		if (is_compact_msg(msg->type)) {
+			data = msg->data;
+			rc = expand_msg(msg, data, msg->length);
+			free(data);
+			if (rc)
+				return -1;
+		}
+		if (get_format(ver) == DATA_MGR_V2 && msgid_blkiomon != IS_NO_BLKIOMON_MSG
 		    && (msg->type == IS_BLKIOMON_MSG || msg->type == msgid_blkiomon))
 			conv_blkiomon_v2_to_v3(msg);
 	}
@@ -230,7 +388,9 @@ static int read_message_preview(FILE *fp, struct message_preview *msg,
 		}
 		swap_64(msg->timestamp);
 		fseek(fp, msg->length - 8, SEEK_CUR);
-		msg->is_blkiomon_v2 = (f_hdr->version == DATA_MGR_V2
+		msg->is_compact = is_compact_msg(msg->type);
+		msg->type &= ~DACC_MSG_COMPACT;
+		msg->is_blkiomon_v2 = (get_format(f_hdr->version) == DATA_MGR_V2
 				       && msg->type == f_hdr->msgid_blkiomon);
 	}
 	else
@@ -406,8 +566,60 @@ static int write_message(FILE *fp, struct message *msg)
 }
 
 
-int add_msg(FILE *fp, struct message *msg, struct file_header *f_hdr,
-	    struct message ***del_msg, int *num_del_msg)
+/**
+ * Record the message at pos in the .idx file in case it is the first
+ * message in its part of the .log file since the last wrap.
+ */
+static int update_index(long pos, struct message *msg)
+{
+	struct index_entry entry;
+	long i = pos / DACC_IDX_STRIDE;
+	__u32 *tmp;
+
+	if (!index_state.fp)
+		return 0;
+	if (pos < index_state.last_pos)
+		index_state.cycle++;
+	index_state.last_pos = pos;
+
+	if (i >= index_state.num_entries) {
+		tmp = realloc(index_state.cycles, 2 * (i + 1) * sizeof(__u32));
+		if (!tmp) {
+			fprintf(stderr, "%s: Memory allocation error\n",
+				toolname);
+			return -1;
+		}
+		memset(tmp + index_state.num_entries, 0,
+		       (2 * (i + 1) - index_state.num_entries) * sizeof(__u32));
+		index_state.cycles = tmp;
+		index_state.num_entries = 2 * (i + 1);
+	}
+	if (index_state.cycles[i] == index_state.cycle)
+		return 0;
+	index_state.cycles[i] = index_state.cycle;
+
+	vverbose_msg("index entry %ld at pos=%ld\n", i, pos);
+	entry.timestamp = *(__u64 *)(msg->data);	/* already BE */
+	entry.offset = pos;
+	entry.length = get_total_msg_size(msg);
+	entry.reserved = 0;
+	swap_64(entry.offset);
+	swap_32(entry.length);
+	if (fseek(index_state.fp, sizeof(struct index_header)
+		  + i * sizeof(struct index_entry), SEEK_SET)
+	    || fwrite(&entry, sizeof(entry), 1, index_state.fp) != 1) {
+		fprintf(stderr, "%s: Failed to write index entry\n",
+			toolname);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static int add_raw_msg(FILE *fp, struct message *msg,
+		       struct file_header *f_hdr, struct message ***del_msg,
+		       int *num_del_msg)
 {
 	__s32 add_garbage;
 	long cur_pos, old_pos = ftell(fp);
@@ -417,6 +629,9 @@ int add_msg(FILE *fp, struct message *msg, struct file_header *f_hdr,
 	if (add_garbage < 0)
 		return -1;
 
+	if (update_index(ftell(fp), msg))
+		return -5;
+
 	if (write_message(fp, msg) < 0)
 		return -2;
 
@@ -440,7 +655,22 @@ int add_msg(FILE *fp, struct message *msg, struct file_header *f_hdr,
 }
 
 
-int init_file(FILE *fp, struct file_header *f_hdr, long version)
+int add_msg(FILE *fp, struct message *msg, struct file_header *f_hdr,
+	    struct message ***del_msg, int *num_del_msg)
+{
+	struct message cmsg;
+	int rc;
+
+	if (!(f_hdr->version & DATA_MGR_COMPACT) || compact_msg(msg, &cmsg))
+		return add_raw_msg(fp, msg, f_hdr, del_msg, num_del_msg);
+	rc = add_raw_msg(fp, &cmsg, f_hdr, del_msg, num_del_msg);
+	free(cmsg.data);
+
+	return rc;
+}
+
+
+int init_file(FILE *fp, struct file_header *f_hdr, long version, int compact)
 {
 	f_hdr->magic = DATA_MGR_MAGIC;
 	if (version == 2)
@@ -452,6 +682,8 @@ int init_file(FILE *fp, struct file_header *f_hdr, long version)
 	                        toolname, version);
 		return -2;
 	}
+	if (compact)
+		f_hdr->version |= DATA_MGR_COMPACT;
 	f_hdr->first_msg_offset = 0;
 	f_hdr->end_time = 0;
 	f_hdr->begin_time = 0;
@@ -463,8 +695,41 @@ int init_file(FILE *fp, struct file_header *f_hdr, long version)
 }
 
 
+int init_index_file(FILE *fp)
+{
+	struct index_header hdr;
+
+	hdr.magic = DATA_MGR_MAGIC_IDX;
+	hdr.stride = DACC_IDX_STRIDE;
+	swap_32(hdr.magic);
+	swap_32(hdr.stride);
+	rewind(fp);
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+		fprintf(stderr, "%s: Failed to write index header\n",
+			toolname);
+		return -1;
+	}
+	index_state.fp = fp;
+	index_state.cycles = NULL;
+	index_state.num_entries = 0;
+	index_state.cycle = 1;
+	index_state.last_pos = sizeof(struct file_header) - sizeof(__u64);
+
+	return 0;
+}
+
+
+void close_index_file(FILE *fp)
+{
+	free(index_state.cycles);
+	memset(&index_state, 0, sizeof(index_state));
+	if (fp)
+		fclose(fp);
+}
+
+
 static int check_version(__u32 ver) {
-	if (ver != DATA_MGR_V2 && ver != DATA_MGR_V3) {
+	if (get_format(ver) != DATA_MGR_V2 && get_format(ver) != DATA_MGR_V3) {
 		fprintf(stderr, "%s: Wrong version: .log data is in version %u"
 			" format, while this tool only supports version %u"
 			" and %u.\n"
@@ -499,6 +764,47 @@ static int get_header(FILE *fp, struct file_header *hdr)
 }
 
 
+/**
+ * Map the .log file so that get_complete_msg() can return messages without
+ * copying them. The mapping is private and writable, so that users can
+ * convert the message data in place. If the mapping fails, messages are
+ * read into allocated buffers instead.
+ */
+static void map_log_file(FILE *fp)
+{
+	struct stat st;
+	void *map;
+
+	if (fstat(fileno(fp), &st) || st.st_size <= 0)
+		return;
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		   fileno(fp), 0);
+	if (map == MAP_FAILED) {
+		verbose_msg("could not map .log file, reading messages\n");
+		return;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	log_map = map;
+	log_map_size = st.st_size;
+}
+
+
+static void unmap_log_file(void)
+{
+	if (log_map)
+		munmap(log_map, log_map_size);
+	log_map = NULL;
+	log_map_size = 0;
+}
+
+
+static int is_mapped(void *data)
+{
+	return (log_map && (char *)data >= log_map
+		&& (char *)data < log_map + log_map_size);
+}
+
+
 int open_log_file(FILE **fp, const char *filename, struct file_header *fhdr)
 {
 	int rc = 0;
@@ -518,6 +824,7 @@ int open_log_file(FILE **fp, const char *filename, struct file_header *fhdr)
 		rc = -2;
 		goto out;
 	}
+	map_log_file(*fp);
 	if (get_next_msg_preview(*fp, &msg_prev, fhdr)) {
 		rc = -3;
 		goto out;
@@ -527,8 +834,10 @@ int open_log_file(FILE **fp, const char *filename, struct file_header *fhdr)
 
 out:
 	free(fname);
-	if (rc < 0)
+	if (rc < 0) {
+		unmap_log_file();
 		fclose(*fp);
+	}
 
 	return rc;
 }
@@ -537,6 +846,7 @@ out:
 void close_log_file(FILE *fp)
 {
 	wrapped = -1;
+	unmap_log_file();
 	if (fp)
 		fclose(fp);
 }
@@ -708,13 +1018,16 @@ int get_next_msg(FILE *fp, struct message *msg, struct file_header *f_hdr)
 {
 	int rc;
 
+	ZT_PROBE(ziomon, get_next_msg);
 	if (wrapped < 0)
 		wrapped = seek_initial_file_pos(fp, f_hdr);
 
 	do {
 		if (f_hdr->first_msg_offset != 0 && wrapped
-		    && ftell(fp) >= (long long)f_hdr->first_msg_offset)
-			return 1;	/* final msg read */
+		    && ftell(fp) >= (long long)f_hdr->first_msg_offset) {
+			rc = 1;	/* final msg read */
+			break;
+		}
 
 		rc = read_message(fp, msg, f_hdr->version, f_hdr->msgid_blkiomon);
 		if (rc > 0 && !wrapped) {
@@ -723,6 +1036,7 @@ int get_next_msg(FILE *fp, struct message *msg, struct file_header *f_hdr)
 			wrapped++;
 		}
 	} while (!rc && msg->type == ZIOMON_DACC_GARBAGE_MSG);
+	ZT_PROBE(ziomon, get_next_msg_done, rc, msg->type, msg->length);
 
 	return rc;
 }
@@ -760,12 +1074,178 @@ void rewind_to(FILE *fp, struct message_preview *msg)
 }
 
 
+/**
+ * Read all entries of the .idx file that refer to messages in the current
+ * contents of the .log file, in the order of their messages. Since messages
+ * are written in sequence, the result is sorted by timestamp.
+ * Returns the number of entries, or <0 if the index is not usable.
+ */
+static long read_index(const char *filename, struct file_header *f_hdr,
+		       struct index_entry **entries)
+{
+	struct index_entry *all = NULL, *e;
+	struct index_header hdr;
+	long num_all = 0, num = -1, i, start = 0, end;
+	char *fname;
+	FILE *fp;
+
+	fname = (char*)malloc(strlen(filename) + strlen(DACC_FILE_EXT_IDX) + 1);
+	sprintf(fname, "%s%s", filename, DACC_FILE_EXT_IDX);
+	fp = fopen(fname, "r");
+	free(fname);
+	if (!fp)
+		return -1;
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1)
+		goto out;
+	swap_32(hdr.magic);
+	swap_32(hdr.stride);
+	if (hdr.magic != DATA_MGR_MAGIC_IDX || hdr.stride != DACC_IDX_STRIDE)
+		goto out;
+	fseek(fp, 0, SEEK_END);
+	num_all = (ftell(fp) - sizeof(hdr)) / sizeof(struct index_entry);
+	if (num_all <= 0)
+		goto out;
+	all = malloc(num_all * sizeof(struct index_entry));
+	*entries = malloc((num_all + 1) * sizeof(struct index_entry));
+	fseek(fp, sizeof(hdr), SEEK_SET);
+	if (fread(all, sizeof(struct index_entry), num_all, fp)
+	    != (size_t)num_all) {
+		free(*entries);
+		goto out;
+	}
+
+	for (i = 0; i < num_all; ++i) {
+		swap_64(all[i].timestamp);
+		swap_64(all[i].offset);
+		swap_32(all[i].length);
+	}
+
+	/* after a wrap, the oldest message is at first_msg_offset, and the
+	   entry of that part of the file might belong to the newest message */
+	if (f_hdr->first_msg_offset) {
+		start = f_hdr->first_msg_offset / DACC_IDX_STRIDE;
+		end = start + num_all;
+	}
+	else
+		end = num_all - 1;
+	num = 0;
+	for (i = start; i <= end; ++i) {
+		e = &all[i % num_all];
+		if (e->offset == 0)
+			continue;
+		if (f_hdr->first_msg_offset && i % num_all == start
+		    && (i == start) != (e->offset >= f_hdr->first_msg_offset))
+			continue;
+		if (e->timestamp < f_hdr->begin_time
+		    || e->timestamp > f_hdr->end_time
+		    || (num > 0 && e->timestamp < (*entries)[num - 1].timestamp))
+			continue;
+		(*entries)[num++] = *e;
+	}
+
+out:
+	free(all);
+	fclose(fp);
+
+	return num;
+}
+/**
+ * Check whether the message described by an index entry is still in place.
+ */
+static int check_index_entry(FILE *fp, struct file_header *f_hdr,
+			     struct index_entry *entry)
+{
+	struct message_preview msg_prev;
+
+	if (fseek(fp, entry->offset, SEEK_SET)
+	    || read_message_preview(fp, &msg_prev, f_hdr))
+		return 0;
+
+	return (msg_prev.type != ZIOMON_DACC_GARBAGE_MSG
+		&& msg_prev.length + 8 == entry->length
+		&& msg_prev.timestamp == entry->timestamp);
+}
+
+
+int seek_msg_by_time(FILE *fp, const char *filename,
+		     struct file_header *f_hdr, __u64 timestamp)
+{
+	struct message_preview msg_prev;
+	struct index_entry *entries = NULL;
+	long num, lo, hi, mid;
+	int rc;
+
+	/* no need to forward if the next message is late enough */
+	rc = get_next_msg_preview(fp, &msg_prev, f_hdr);
+	if (rc)
+		return rc;
+	rewind_to(fp, &msg_prev);
+	if (msg_prev.timestamp >= timestamp)
+		return 0;
+
+	num = read_index(filename, f_hdr, &entries);
+	if (num < 0) {
+		verbose_msg("no usable %s file found\n", DACC_FILE_EXT_IDX);
+		return 1;
+	}
+
+	/* find the latest entry before timestamp */
+	lo = 0;
+	hi = num;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (entries[mid].timestamp < timestamp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	rc = 1;
+	for (--lo; lo >= 0 && entries[lo].timestamp > msg_prev.timestamp;
+	     --lo) {
+		if (check_index_entry(fp, f_hdr, &entries[lo])) {
+			rc = 0;
+			break;
+		}
+		vverbose_msg("skipping stale index entry at pos=%llu\n",
+			     (unsigned long long)entries[lo].offset);
+	}
+	if (rc) {
+		rewind_to(fp, &msg_prev);
+		free(entries);
+		return 1;
+	}
+
+	verbose_msg("index: forward to pos=%llu\n",
+		    (unsigned long long)entries[lo].offset);
+	fseek(fp, entries[lo].offset, SEEK_SET);
+	/* messages before first_msg_offset are only read after wrapping */
+	wrapped = (f_hdr->first_msg_offset == 0
+		   || entries[lo].offset < f_hdr->first_msg_offset);
+	free(entries);
+
+	return 0;
+}
+
+
 int get_complete_msg(FILE *fp, struct message_preview *msg_prev,
 		     struct message *msg)
 {
 	long pos = ftell(fp);
 	int rc;
 
+	if (log_map && msg_prev->type != ZIOMON_DACC_GARBAGE_MSG
+	    && (size_t)msg_prev->pos + 8 + msg_prev->length <= log_map_size) {
+		msg->length = msg_prev->length;
+		msg->type = msg_prev->type;
+		msg->data = log_map + msg_prev->pos + 8;
+		if (msg_prev->is_compact
+		    && expand_msg(msg, msg->data, msg->length))
+			return -1;
+		if (msg_prev->is_blkiomon_v2)
+			conv_blkiomon_v2_to_v3(msg);
+		return 0;
+	}
+
 	fseek(fp, msg_prev->pos, SEEK_SET);
 	if (msg_prev->is_blkiomon_v2)
 		// make sure message is converted
@@ -782,7 +1262,8 @@ int get_complete_msg(FILE *fp, struct message_preview *msg_prev,
 void discard_msg(struct message *msg)
 {
 	if (msg) {
-		free(msg->data);
+		if (!is_mapped(msg->data))
+			free(msg->data);
 		msg->data = NULL;
 	}
 }
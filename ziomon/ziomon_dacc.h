@@ -19,8 +19,13 @@
 
 #define DATA_MGR_MAGIC		0x64616d67
 #define DATA_MGR_MAGIC_AGGR	0x61676772
+#define DATA_MGR_MAGIC_IDX	0x69647820
 #define DATA_MGR_V2		2u
 #define DATA_MGR_V3		3u
+/* flag in the version of .log files with compact messages */
+#define DATA_MGR_COMPACT	0x10000u
+/* flag in the type of compact messages */
+#define DACC_MSG_COMPACT	0x40000000u
 
 
 /**
@@ -54,6 +59,8 @@ struct message_preview {
 	__u32	type;
 	__u64   timestamp;
 	__u32   is_blkiomon_v2; /* message is a v2 blkiomon msg */
+	__u32   is_compact;	/* message is stored in compact form,
+				   'length' is the length as stored */
 	long	pos;	/* position in file where msg starts */
 };
 
@@ -112,9 +119,10 @@ struct aggr_data {
 /**
  * Write the initial file header and forward to place where first message would
  * go init_size gives the total size of the header block in the file.
+ * Set 'compact' to store messages in compact form, see add_msg().
  * fp is assumed to have been opened.
  */
-int init_file(FILE *fp, struct file_header *f_hdr, long version);
+int init_file(FILE *fp, struct file_header *f_hdr, long version, int compact);
 
 
 /**
@@ -152,6 +160,51 @@ int open_data_files(FILE **fp, const char *filename, struct file_header *fhdr,
  * Must be called to close fp and reset internals */
 void close_data_files(FILE *fp);
 
+#define DACC_FILE_EXT_IDX	".idx"
+/* distance in Bytes between two entries in the .idx file */
+#define DACC_IDX_STRIDE		65536
+struct index_header {
+	__u32	magic;
+	__u32	stride;
+} __attribute__ ((packed));
+
+/**
+ * The .idx file holds one entry for each DACC_IDX_STRIDE Bytes of the .log
+ * file, describing the first message written to that part of the .log file.
+ * An entry with offset 0 is unused.
+ * Entries become stale as soon as the .log file wraps around and their
+ * messages are overwritten, hence readers must verify each entry against
+ * the .log file before using it.
+ */
+struct index_entry {
+	__u64	timestamp;
+	__u64	offset;		/* position of the message in the .log file */
+	__u32	length;		/* total size of the message */
+	__u32	reserved;
+} __attribute__ ((packed));
+
+/**
+ * Write the header of the .idx file and have add_msg() maintain its entries
+ * from now on.
+ * fp is assumed to have been opened.
+ */
+int init_index_file(FILE *fp);
+
+/**
+ * Must be called to close fp and reset internals */
+void close_index_file(FILE *fp);
+
+/**
+ * Forward fp to the latest message before 'timestamp' using the .idx file,
+ * so that get_next_msg() and get_next_msg_preview() do not have to read
+ * all messages in between. fp is never moved backwards.
+ * Returns 0 if successful, >0 if no usable index was found, in which case
+ * fp is left unchanged, and <0 in case of error.
+ * 'filename' is assumed to NOT carry the .log or .idx extension.
+ */
+int seek_msg_by_time(FILE *fp, const char *filename,
+		     struct file_header *f_hdr, __u64 timestamp);
+
 /**
  * Put a message into the file. Will automatically wrap around.
  * If existing messages have to be deleted to add the new message,
@@ -159,6 +212,10 @@ void close_data_files(FILE *fp);
  * del_msgs must be free'd, and the messages within have to be discarded
  * and free'd.
  * via discard_msg()
+ * Also updates the .idx file in case init_index_file() was called.
+ * In files with compact messages, the data following the timestamp is
+ * stored as variable length integers, one per 32 bit word. Readers get
+ * the original message back.
  * fp is assumed to have been opened.
  */
 int add_msg(FILE *fp, struct message *msg, struct file_header *f_hdr,
@@ -191,12 +248,17 @@ void rewind_to(FILE *fp, struct message_preview *msg);
 
 /**
  * Get complete message for a preview. Rewinds back to where it was at.
+ * For files opened with open_log_file(), the data of the message usually
+ * points into a private mapping of the file, which stays valid until the
+ * file is closed. The data may be converted in place, but then the message
+ * must not be read again.
  */
 int get_complete_msg(FILE *fp, struct message_preview *msg_prev,
 		     struct message *msg);
 
 /**
  * Frees the alloc'd portion of a message.
+ * Messages that point into a mapped file are left alone.
  */
 void discard_msg(struct message *msg);
 
@@ -30,6 +30,7 @@
 
 #include "ziomon_dacc.h"
 #include "ziomon_msg_tools.h"
+#include "ziomon_ring.h"
 #include "ziomon_tools.h"
 #include "ziomon_util.h"
 #include "ziomon_zfcpdd.h"
@@ -50,14 +51,19 @@ struct options {
 	long			msg_id_ioerr;
 	long			msg_id_blkiomon;
 	long			msg_id_zfcpdd;
+	struct ring		ring_utilization;
+	struct ring		ring_zfcpdd;
 	int			estimate;
 	int			interval_length;
 	int			force;
 	long                    version;
+	int			compact;
 	char   		       *outfile_name;
 	char   		       *outfile_name_agg;
+	char		       *outfile_name_idx;
 	FILE   		       *outfile;
 	FILE		       *outfile_agg;
+	FILE		       *outfile_idx;
 	struct aggr_data	agg_data;
 	long			size_limit;
 	short			wrapped;
@@ -74,16 +80,21 @@ static void init_opts(struct options *opts)
 	opts->msg_id_utilization = LONG_MIN;
 	opts->msg_id_ioerr = LONG_MIN;
 	opts->msg_id_zfcpdd = LONG_MIN;
+	opts->ring_utilization.buf = NULL;
+	opts->ring_zfcpdd.buf = NULL;
 	opts->outfile_name = NULL;
 	opts->outfile_name_agg = NULL;
 	opts->outfile = NULL;
 	opts->outfile_agg = NULL;
+	opts->outfile_name_idx = NULL;
+	opts->outfile_idx = NULL;
 	opts->size_limit = LONG_MAX;
 	opts->wrapped = 0;
 	opts->interval_length = -1;
 	opts->force = 0;
 	opts->estimate = 0;
 	opts->version = 3;
+	opts->compact = 0;
 }
 
 
@@ -96,10 +107,14 @@ static void deinit_opts(struct options *opts)
 				" while shutting down message queue: %s\n",
 				toolname, strerror(errno));
 	}
+	ring_destroy(&opts->ring_utilization);
+	ring_destroy(&opts->ring_zfcpdd);
 	if (opts->outfile)
 		fclose(opts->outfile);
 	free(opts->outfile_name);
 	free(opts->outfile_name_agg);
+	close_index_file(opts->outfile_idx);
+	free(opts->outfile_name_idx);
 	if (opts->outfile_agg) {
 		fclose(opts->outfile_agg);
 		discard_aggr_data_struct(&opts->agg_data);
@@ -108,7 +123,7 @@ static void deinit_opts(struct options *opts)
 
 
 static const char help_text[] =
-  "Usage: ziomon_mgr [-h] [-v] [-V] [-e] [-f] [-l <size>] [-x <version>]"
+  "Usage: ziomon_mgr [-h] [-v] [-V] [-e] [-f] [-c] [-l <size>] [-x <version>]"
   " -o <filename> -i <length>\n"
   "                  -Q <msgq-path> -q <msgq-id> -u <util-id> -r <ioerr-id>\n"
   "                  -b <blkiomon-id> -z <ziomon_zfcpdd-id>\n"
@@ -131,7 +146,8 @@ static const char help_text[] =
   "-z, --ziomon-zfcpdd-id  Specify the id for messages from ziomon_zfcpdd.\n"
   "-o, --output            Specify the name of the output file(s).\n"
   "-l, --size-limit        Maximum size of data collected in MB.\n"
-  "-x, --enforce-version   Enforce specific version for .log and .agg files.\n";
+  "-x, --enforce-version   Enforce specific version for .log and .agg files.\n"
+  "-c, --compact           Store messages in compact form in the .log file.\n";
 
 static void print_help(void)
 {
@@ -163,6 +179,12 @@ static int setup_msg_q(struct options *opts)
 
 	verbose_msg("message queue key is %d\n", util_q);
 
+	/* producers look for their rings once the message queue exists */
+	if (ring_create(&opts->ring_utilization, util_q,
+			opts->msg_id_utilization)
+	    || ring_create(&opts->ring_zfcpdd, util_q, opts->msg_id_zfcpdd))
+		return -1;
+
 	flags = IPC_CREAT | S_IRWXU;
 	if (!opts->force)
 		flags |= IPC_EXCL;
@@ -299,6 +321,7 @@ static int parse_params(int argc, char **argv, struct options *opts)
 		{ "enforce-version", required_argument, NULL, 'x'},
 		{ "output",          required_argument, NULL, 'o'},
 		{ "force",           no_argument,       NULL, 'f'},
+		{ "compact",         no_argument,       NULL, 'c'},
                 { 0,                 0,                 0,     0 }
 	};
 
@@ -307,7 +330,7 @@ static int parse_params(int argc, char **argv, struct options *opts)
 		return 1;
 	}
 
-	while ((c = getopt_long(argc, argv, "r:Q:q:u:b:z:i:l:o:x:Vhfev",
+	while ((c = getopt_long(argc, argv, "r:Q:q:u:b:z:i:l:o:x:Vhfecv",
 				long_options, &index)) != EOF) {
 		switch (c) {
 		case 'V':
@@ -399,10 +422,14 @@ static int parse_params(int argc, char **argv, struct options *opts)
 			}
 			opts->outfile_name_agg = malloc(strlen(optarg)
 					+ strlen(DACC_FILE_EXT_AGG) + 1);
+			opts->outfile_name_idx = malloc(strlen(optarg)
+					+ strlen(DACC_FILE_EXT_IDX) + 1);
 			sprintf(opts->outfile_name, "%s" DACC_FILE_EXT_LOG,
 				optarg);
 			sprintf(opts->outfile_name_agg, "%s" DACC_FILE_EXT_AGG,
 				optarg);
+			sprintf(opts->outfile_name_idx, "%s" DACC_FILE_EXT_IDX,
+				optarg);
 			break;
 		case 'l':
 			if (!optarg) {
@@ -441,6 +468,9 @@ static int parse_params(int argc, char **argv, struct options *opts)
 				return -1;
 			}
 			break;
+		case 'c':
+			opts->compact = 1;
+			break;
 		case 'v':
 			print_version();
 			return 1;
@@ -504,6 +534,13 @@ static int parse_params(int argc, char **argv, struct options *opts)
 		return -1;
 	}
 
+	opts->outfile_idx = fopen(opts->outfile_name_idx, "w+");
+	if (!opts->outfile_idx) {
+		fprintf(stderr, "%s: Could not open index"
+			" file: %s\n", toolname, strerror(errno));
+		return -1;
+	}
+
 	if (setup_msg_q(opts))
 		return -1;
 
@@ -517,6 +554,7 @@ static int parse_params(int argc, char **argv, struct options *opts)
 	verbose_msg("msg id blkiomon      : %ld\n", opts->msg_id_blkiomon);
 	verbose_msg("msg id ziomon_zfcpdd : %ld\n", opts->msg_id_zfcpdd);
 	verbose_msg("outfile name         : %s\n", opts->outfile_name);
+	verbose_msg("compact messages     : %d\n", opts->compact);
 	if (opts->size_limit == LONG_MAX)
 		verbose_msg("size limit           : no limit\n");
 	else
@@ -588,6 +626,49 @@ static int handle_msg(struct message *msg, struct options *opts)
 }
 
 
+/**
+ * Process all messages that the producers placed in their rings.
+ */
+static void drain_rings(struct options *opts)
+{
+	struct ring *rings[2] = { &opts->ring_utilization,
+				  &opts->ring_zfcpdd };
+	struct message msg;
+	__u32 type, length;
+	void *data;
+	int i, found;
+
+	do {
+		found = 0;
+		for (i = 0; i < 2; ++i) {
+			if (ring_peek(rings[i], &type, &data, &length))
+				continue;
+			msg.type = type;
+			msg.length = length;
+			msg.data = data;
+			handle_msg(&msg, opts);
+			ring_consume(rings[i]);
+			found = 1;
+		}
+	} while (found);
+}
+
+
+/**
+ * Returns >0 if there are messages left in the rings, in which case
+ * the caller must not wait on the message queue.
+ */
+static int prepare_wait(struct options *opts)
+{
+	int rc;
+
+	rc = ring_prepare_wait(&opts->ring_utilization);
+	rc |= ring_prepare_wait(&opts->ring_zfcpdd);
+
+	return rc;
+}
+
+
 int main(int argc, char **argv)
 {
 	int rc = 0;
@@ -618,11 +699,18 @@ int main(int argc, char **argv)
 	opts.f_hdr.msgid_zfcpdd = opts.msg_id_zfcpdd;
 	opts.f_hdr.size_limit = opts.size_limit;
 	opts.f_hdr.interval_length = opts.interval_length;
-	if (init_file(opts.outfile, &opts.f_hdr, opts.version))
+	if (init_file(opts.outfile, &opts.f_hdr, opts.version,
+		      opts.compact))
+		goto out;
+	if (init_index_file(opts.outfile_idx))
 		goto out;
 
 	verbose_msg("wait for messages...\n");
 	do {
+		if (prepare_wait(&opts)) {
+			drain_rings(&opts);
+			continue;
+		}
 		len = msgrcv(opts.msg_q, data, data_sz, 0, 0);
 		if (!keep_running)
 			break;
@@ -640,12 +728,17 @@ int main(int argc, char **argv)
 			verbose_msg("msgrcv() returned error %d\n", tmperr);
 			break;
 		}
-		msg.length = len;
-		msg.data = data + 1;
-		msg.type = *data;
-		handle_msg(&msg, &opts);
+		/* messages without data wake us up to process the rings */
+		if (len > 0) {
+			msg.length = len;
+			msg.data = data + 1;
+			msg.type = *data;
+			handle_msg(&msg, &opts);
+		}
+		drain_rings(&opts);
 
 	} while (keep_running);
+	drain_rings(&opts);
 
 out:
 	deinit_opts(&opts);
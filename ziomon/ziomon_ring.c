@@ -0,0 +1,238 @@
+/*
+ * FCP adapter trace utility
+ *
+ * Shared memory ring buffer between a message producer and ziomon_mgr
+ *
+ * Copyright IBM Corp. 2008, 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/msg.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ziomon_ring.h"
+
+
+#define ZIOMON_RING_MAGIC	0x72696e67
+/* type of the record that fills the end of the data area after a wrap */
+#define ZIOMON_RING_PADDING	0
+
+extern const char *toolname;
+
+/*
+ * head and tail are running byte counts, written only by the producer and
+ * the consumer respectively. They are kept in separate cache lines.
+ */
+struct ring_buf {
+	__u32	magic;
+	__u32	size;
+	__u64	head __attribute__ ((aligned(256)));
+	__u64	tail __attribute__ ((aligned(256)));
+	__u32	waiting;
+	char	data[] __attribute__ ((aligned(256)));
+};
+
+struct ring_rec {
+	__u32	len;	/* length of the data, excluding this header */
+	__u32	mtype;
+};
+
+
+static size_t get_rec_size(__u32 len)
+{
+	return sizeof(struct ring_rec) + ((len + 7) & ~7UL);
+}
+
+
+static void get_ring_name(struct ring *ring, key_t key, long msg_id)
+{
+	snprintf(ring->name, sizeof(ring->name), "/ziomon_%x_%ld",
+		 (unsigned int)key, msg_id);
+}
+
+
+static int map_ring(struct ring *ring, int fd)
+{
+	void *buf;
+
+	buf = mmap(NULL, sizeof(struct ring_buf) + ZIOMON_RING_SIZE,
+		   PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (buf == MAP_FAILED)
+		return -1;
+	ring->buf = buf;
+	ring->pending = 0;
+
+	return 0;
+}
+
+
+int ring_create(struct ring *ring, key_t key, long msg_id)
+{
+	int fd;
+
+	get_ring_name(ring, key, msg_id);
+	fd = shm_open(ring->name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		goto out_err;
+	/* discard any leftovers of a previous run */
+	if (ftruncate(fd, 0)
+	    || ftruncate(fd, sizeof(struct ring_buf) + ZIOMON_RING_SIZE)) {
+		close(fd);
+		goto out_unlink;
+	}
+	if (map_ring(ring, fd))
+		goto out_unlink;
+	ring->buf->size = ZIOMON_RING_SIZE;
+	ring->buf->head = 0;
+	ring->buf->tail = 0;
+	ring->buf->waiting = 0;
+	__atomic_store_n(&ring->buf->magic, ZIOMON_RING_MAGIC,
+			 __ATOMIC_RELEASE);
+
+	return 0;
+
+out_unlink:
+	shm_unlink(ring->name);
+out_err:
+	fprintf(stderr, "%s: Could not create shared memory %s: %s\n",
+		toolname, ring->name, strerror(errno));
+	ring->buf = NULL;
+
+	return -1;
+}
+
+
+void ring_destroy(struct ring *ring)
+{
+	if (!ring->buf)
+		return;
+	munmap(ring->buf, sizeof(struct ring_buf) + ZIOMON_RING_SIZE);
+	shm_unlink(ring->name);
+	ring->buf = NULL;
+}
+
+
+int ring_attach(struct ring *ring, key_t key, long msg_id)
+{
+	int fd;
+
+	get_ring_name(ring, key, msg_id);
+	ring->buf = NULL;
+	fd = shm_open(ring->name, O_RDWR, 0);
+	if (fd < 0)
+		return -1;
+	if (map_ring(ring, fd))
+		return -1;
+	if (__atomic_load_n(&ring->buf->magic, __ATOMIC_ACQUIRE)
+	    != ZIOMON_RING_MAGIC || ring->buf->size != ZIOMON_RING_SIZE) {
+		ring_detach(ring);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+void ring_detach(struct ring *ring)
+{
+	if (!ring->buf)
+		return;
+	munmap(ring->buf, sizeof(struct ring_buf) + ZIOMON_RING_SIZE);
+	ring->buf = NULL;
+}
+
+
+static void write_rec(struct ring_buf *buf, __u64 pos, __u32 mtype,
+		      const void *data, __u32 len)
+{
+	struct ring_rec *rec = (struct ring_rec *)(buf->data + pos % buf->size);
+
+	rec->len = len;
+	rec->mtype = mtype;
+	if (data)
+		memcpy(rec + 1, data, len);
+}
+
+
+int ring_send(struct ring *ring, int msg_q, long mtype, const void *data,
+	      size_t len)
+{
+	struct ring_buf *buf = ring->buf;
+	size_t size = get_rec_size(len), contig;
+	__u64 head = buf->head, tail;
+	long doorbell = mtype;
+
+	if (size > buf->size)
+		return 1;
+	tail = __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE);
+	contig = buf->size - head % buf->size;
+	if (head - tail + size + (contig < size ? contig : 0) > buf->size)
+		return 1;
+	if (contig < size) {
+		write_rec(buf, head, ZIOMON_RING_PADDING, NULL,
+			  contig - sizeof(struct ring_rec));
+		head += contig;
+	}
+	write_rec(buf, head, mtype, data, len);
+	__atomic_store_n(&buf->head, head + size, __ATOMIC_SEQ_CST);
+
+	/* wake up the consumer, see ring_prepare_wait() */
+	if (__atomic_exchange_n(&buf->waiting, 0, __ATOMIC_SEQ_CST)
+	    && msgsnd(msg_q, &doorbell, 0, IPC_NOWAIT) < 0
+	    && errno != EAGAIN)
+		return -1;
+
+	return 0;
+}
+
+
+int ring_peek(struct ring *ring, __u32 *mtype, void **data, __u32 *len)
+{
+	struct ring_buf *buf = ring->buf;
+	__u64 tail = buf->tail;
+	struct ring_rec *rec;
+
+	while (tail != __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE)) {
+		rec = (struct ring_rec *)(buf->data + tail % buf->size);
+		if (rec->mtype == ZIOMON_RING_PADDING) {
+			tail += get_rec_size(rec->len);
+			__atomic_store_n(&buf->tail, tail, __ATOMIC_RELEASE);
+			continue;
+		}
+		*mtype = rec->mtype;
+		*len = rec->len;
+		*data = rec + 1;
+		ring->pending = get_rec_size(rec->len);
+		return 0;
+	}
+
+	return 1;
+}
+
+
+void ring_consume(struct ring *ring)
+{
+	__atomic_store_n(&ring->buf->tail, ring->buf->tail + ring->pending,
+			 __ATOMIC_RELEASE);
+	ring->pending = 0;
+}
+
+
+int ring_prepare_wait(struct ring *ring)
+{
+	struct ring_buf *buf = ring->buf;
+
+	__atomic_store_n(&buf->waiting, 1, __ATOMIC_SEQ_CST);
+
+	return (__atomic_load_n(&buf->head, __ATOMIC_SEQ_CST) != buf->tail);
+}
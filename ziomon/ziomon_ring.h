@@ -0,0 +1,95 @@
+/*
+ * FCP adapter trace utility
+ *
+ * Shared memory ring buffer between a message producer and ziomon_mgr
+ *
+ * Copyright IBM Corp. 2008, 2017
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef ZIOMON_RING_H
+#define ZIOMON_RING_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <linux/types.h>
+
+
+/* size of the data area of each ring */
+#define ZIOMON_RING_SIZE	(4 * 1024 * 1024)
+
+/**
+ * Each producer gets its own ring in a POSIX shared memory object, created
+ * by ziomon_mgr and named after the key of the message queue and the
+ * message id of the producer. The producer copies its messages into the
+ * ring, and ziomon_mgr processes them directly from the ring.
+ *
+ * ziomon_mgr keeps waiting on the message queue, as it also receives the
+ * messages of blkiomon from there. Before it waits, it sets a flag in each
+ * ring. A producer that finds the flag set after adding a message sends a
+ * message without data to the queue to wake up ziomon_mgr. Hence a burst of
+ * messages requires a single wakeup only.
+ * If a ring is full or does not exist, producers send their messages to the
+ * message queue as before.
+ */
+struct ring_buf;
+
+struct ring {
+	struct ring_buf	*buf;
+	size_t		 pending;	/* size of message from ring_peek() */
+	char		 name[64];
+};
+
+
+/**
+ * Create the ring for the producer with message id 'msg_id'.
+ * Returns 0 if successful, <0 otherwise.
+ */
+int ring_create(struct ring *ring, key_t key, long msg_id);
+
+/**
+ * Remove the ring created via ring_create().
+ */
+void ring_destroy(struct ring *ring);
+
+/**
+ * Attach to the ring created by ziomon_mgr for message id 'msg_id'.
+ * Returns 0 if successful, <0 if the ring is not available.
+ */
+int ring_attach(struct ring *ring, key_t key, long msg_id);
+
+/**
+ * Detach from the ring attached via ring_attach().
+ */
+void ring_detach(struct ring *ring);
+
+/**
+ * Add a message of type 'mtype' with 'len' bytes of 'data' to the ring and
+ * wake up ziomon_mgr via 'msg_q' if it waits.
+ * Returns 0 if successful, >0 if the ring is full and <0 in case of error.
+ */
+int ring_send(struct ring *ring, int msg_q, long mtype, const void *data,
+	      size_t len);
+
+/**
+ * Retrieve the oldest message of the ring without removing it. 'data'
+ * points into the ring until ring_consume() is called.
+ * Returns 0 if successful, >0 if the ring is empty.
+ */
+int ring_peek(struct ring *ring, __u32 *mtype, void **data, __u32 *len);
+
+/**
+ * Remove the message retrieved via ring_peek() from the ring.
+ */
+void ring_consume(struct ring *ring);
+
+/**
+ * Announce that ziomon_mgr is about to wait on the message queue.
+ * Returns 0 if the ring is empty, so waiting is safe, or >0 if there
+ * are messages left to process.
+ */
+int ring_prepare_wait(struct ring *ring);
+
+#endif
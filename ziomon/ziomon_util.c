@@ -29,7 +29,9 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "lib/util_scandir.h"
 #include "lib/zt_common.h"
+#include "ziomon_ring.h"
 #include "ziomon_util.h"
 
 
@@ -275,6 +277,7 @@ void aggregate_ioerr_data(const struct ioerr_data *src, struct ioerr_data *tgt)
 
 static int keep_running;
 int verbose=0;
+static struct ring ring;
 
 
 struct util_data {
@@ -295,7 +298,9 @@ struct util_data {
 struct adapter_data {
 	int			host_nr;
 	char		       *path;
+	int			fd;	/* open handle of 'path' */
 	char		       *q_full_path;
+	int			q_full_fd;	/* open handle of 'q_full_path' */
 	int			status;	/* 0 if good != 0 in case of failure */
 	struct util_data	data;
 };
@@ -316,6 +321,7 @@ struct options {
 	int     num_luns;	/* number of luns */
 	char  **luns;		/* array of luns to monitor */
 	__u32  *luns_prev;	/* array of previous values of luns */
+	int    *luns_fd;	/* array of open handles of luns */
 	long  	duration;	/* overall duration in seconds */
 	long  	s_duration;	/* ssample duration in seconds */
 	long  	i_duration;	/* interval duration in seconds */
@@ -339,6 +345,7 @@ static void init_opts(struct options *opts)
 	opts->num_luns	   = 0;
 	opts->luns	   = NULL;
 	opts->luns_prev	   = NULL;
+	opts->luns_fd	   = NULL;
 	opts->msg_q_path   = NULL;
 	opts->msg_q_id	   = -1;
 	opts->msg_q	   = -1;
@@ -361,10 +368,15 @@ static void deinit_opts(struct options *opts)
 	}
 	for (i=0; i<opts->num_hosts_a; ++i)
 		free(opts->luns[i]);
+	for (i = 0; i < opts->num_luns && opts->luns_fd; ++i)
+		if (opts->luns_fd[i] >= 0)
+			close(opts->luns_fd[i]);
 	opts->num_hosts_a = 0;
 	opts->msg_q = -1;
+	ring_detach(&ring);
 	free(opts->luns);
 	free(opts->luns_prev);
+	free(opts->luns_fd);
 }
 
 
@@ -422,11 +434,15 @@ static int init_host_opts(struct options *opts, int num_hosts)
 	opts->luns = calloc(num_hosts, sizeof(char *));
 	free(opts->luns_prev);
 	opts->luns_prev = calloc(num_hosts, sizeof(__u32));
-	if (!opts->luns || !opts->luns_prev) {
+	free(opts->luns_fd);
+	opts->luns_fd = malloc(num_hosts * sizeof(int));
+	if (!opts->luns || !opts->luns_prev || !opts->luns_fd) {
 	     fprintf(stderr, "%s: malloc opts->luns: %s\n",
 			toolname, strerror(errno));
 	     return -1;
 	}
+	for (i = 0; i < num_hosts; ++i)
+		opts->luns_fd[i] = -1;
 	for (i = 0; i < num_hosts; ++i) {
 		opts->luns[i] = malloc(sizeof(char) * MAX_LUN_PATH_LEN + 1);
 		if (!opts->host_path[i]) {
@@ -443,23 +459,31 @@ static int init_host_opts(struct options *opts, int num_hosts)
 
 #define LINE_LEN	255
 
-static int read_attribute(char *path, char *line, int *status)
+/**
+ * Read the attribute at 'path'. The file is opened on first use only and
+ * kept open in '*fd' - sysfs regenerates the contents on each read from
+ * offset 0. In case of failure, the file is closed and reopened next time.
+ */
+static int read_attribute(char *path, int *fd, char *line, int *status)
 {
-	int fd;
+	ssize_t len;
 	int rc = 0;
 
-	fd = open(path, O_RDONLY);
-	if (fd < 0) {
-		rc = -1;		/* adapter gone */
-		goto out;
+	if (*fd < 0) {
+		*fd = open(path, O_RDONLY);
+		if (*fd < 0) {
+			rc = -1;		/* adapter gone */
+			goto out;
+		}
 	}
-	rc = read(fd, line, LINE_LEN);
-	if (rc < 0) {
+	len = pread(*fd, line, LINE_LEN - 1, 0);
+	if (len < 0) {
 		rc = -2;		/* I/O error */
+		close(*fd);
+		*fd = -1;
 		goto out;
 	}
-	rc = 0;
-	close(fd);
+	line[len] = '\0';
 out:
 	if (status)
 		*status = rc;
@@ -481,7 +505,8 @@ static int poll_utilization(struct adapters *all_adapters)
 		adpt = &all_adapters->adapters[i];
 		u_data = &adpt->data;
 		/* read utilization attribute */
-		if (read_attribute(adpt->path, line, &adpt->status)) {
+		if (read_attribute(adpt->path, &adpt->fd, line,
+				   &adpt->status)) {
 			grc++;
 			continue;
 		}
@@ -540,7 +565,8 @@ static int poll_queue_full(int init, struct adapters *all_adapters)
 		u_data = &adpt->data;
 
 		/* read queue_full attribute */
-		if (read_attribute(adpt->q_full_path, line, &adpt->status))
+		if (read_attribute(adpt->q_full_path, &adpt->q_full_fd, line,
+				   &adpt->status))
 			continue;
 		rc = sscanf(line, "%d %Lu", &queue_full_tmp, &queue_util_tmp);
 		if (rc == 1) {
@@ -597,7 +623,8 @@ static int poll_ioerr_cnt(int init, struct ioerr_data *data,
 		data->timestamp = time(NULL);
 	for (i=0; i<opts->num_luns; ++i) {
 		/* read ioerr_cnt attribute */
-		if (read_attribute(opts->luns[i], line, NULL)) {
+		if (read_attribute(opts->luns[i], &opts->luns_fd[i], line,
+				   NULL)) {
 			fprintf(stderr, "%s: Warning: Could not read %s\n",
 				toolname, opts->luns[i]);
 			grc++;
@@ -667,6 +694,8 @@ static int init_adapters(struct adapters *all_adapters, struct options *opts)
 					toolname, adapter->q_full_path);
 				rc++;
 			}
+			adapter->fd = -1;
+			adapter->q_full_fd = -1;
 			adapter->status = 0;
 		}
 		init_util_data(&all_adapters->adapters[i].data);
@@ -680,11 +709,17 @@ static int init_adapters(struct adapters *all_adapters, struct options *opts)
 
 static void deinit_adapters(struct adapters *all_adapters)
 {
+	struct adapter_data *adpt;
 	int i;
 
 	for (i = 0; i < all_adapters->num_adapters; ++i) {
-		free(all_adapters->adapters[i].path);
-		free(all_adapters->adapters[i].q_full_path);
+		adpt = &all_adapters->adapters[i];
+		if (adpt->fd >= 0)
+			close(adpt->fd);
+		if (adpt->q_full_fd >= 0)
+			close(adpt->q_full_fd);
+		free(adpt->path);
+		free(adpt->q_full_path);
 	}
 }
 
@@ -781,9 +816,33 @@ static int get_argument_long(long *param, char opt)
 }
 
 
-static int hostdir_filter(const struct dirent *dir)
+static int host_adapter_compare(const void *a, const void *b)
 {
-	return !strncmp(dir->d_name, "host", 4);
+	return (*(long *)a > *(long *)b);
+}
+
+
+struct host_list {
+	long *host_nr;
+	int num_hosts;
+};
+
+
+static int add_host(const struct dirent *de, void *data)
+{
+	struct host_list *hosts = data;
+	long *tmp;
+
+	tmp = realloc(hosts->host_nr, (hosts->num_hosts + 1) * sizeof(long));
+	if (!tmp) {
+		fprintf(stderr, "%s: realloc host_nr: %s\n",
+			toolname, strerror(errno));
+		return 1;
+	}
+	hosts->host_nr = tmp;
+	sscanf(de->d_name, "host%ld", &hosts->host_nr[hosts->num_hosts++]);
+
+	return 0;
 }
 
 
@@ -824,49 +883,43 @@ static int check_host_param(long *host_nr, char *host_path)
 static int find_all_hosts(struct options *opts)
 {
 	char *h_path = "/sys/class/scsi_host";
-	struct dirent **namelist;
-	int num_dirents;
-	int i, k;
+	struct host_list hosts = { NULL, 0 };
+	int i;
 	int rc = 0;
 
 	verbose_msg("no host adapter(s) specified, scanning...\n");
-	num_dirents = scandir(h_path, &namelist, hostdir_filter, alphasort);
-	if (num_dirents <= 0) {
+	/* Only collect host numbers, there is no need to keep the dirents */
+	if (util_scandir_iterate(h_path, 0, add_host, &hosts,
+				 "^host[0-9]+$") == 1) {
+		rc = -1;
+		goto out;
+	}
+	if (hosts.num_hosts == 0) {
 		fprintf(stderr, "%s: No host adapter(s) found\n", toolname);
 		rc = -3;
 		goto out;
 	}
+	qsort(hosts.host_nr, hosts.num_hosts, sizeof(long),
+	      host_adapter_compare);
 
-	if (init_host_opts(opts, num_dirents))
-		return -1;
-	opts->num_hosts = num_dirents;
-
-	for (i = 0; i < num_dirents; ++i) {
-		k = sscanf(namelist[i]->d_name, "host%ld", &opts->host_nr[i]);
-		if (k != 1) {
-			fprintf(stderr, "%s: Internal error while scanning"
-				" host adapter no\n", toolname);
-			rc = -4;
-		} else
-			check_host_param(&opts->host_nr[i],
-					 opts->host_path[i]);
+	if (init_host_opts(opts, hosts.num_hosts)) {
+		rc = -1;
+		goto out;
+	}
+	opts->num_hosts = hosts.num_hosts;
+
+	for (i = 0; i < hosts.num_hosts; ++i) {
+		opts->host_nr[i] = hosts.host_nr[i];
+		check_host_param(&opts->host_nr[i], opts->host_path[i]);
 	}
 
 out:
-	for (i = 0; i < num_dirents; i++)
-		free(namelist[i]);
-	free(namelist);
+	free(hosts.host_nr);
 
 	return rc;
 }
 
 
-static int host_adapter_compare(const void *a, const void *b)
-{
-	return (*(long *)a > *(long *)b);
-}
-
-
 static int setup_msg_q(struct options *opts)
 {
 	key_t util_q;
@@ -909,6 +962,8 @@ static int setup_msg_q(struct options *opts)
 		usleep(200000);
 	}
 	verbose_msg("message queue id is %d\n", opts->msg_q);
+	if (opts->msg_q >= 0 && ring_attach(&ring, util_q, opts->msg_id) == 0)
+		verbose_msg("using shared memory ring %s\n", ring.name);
 
 	if (opts->msg_q_path) {
 		verbose_msg("message queue path	: %s\n", opts->msg_q_path);
@@ -1154,7 +1209,15 @@ static int parse_params(int argc, char **argv, struct options *opts)
 
 static void send_message(int msg_q, void *data, size_t data_sz)
 {
-	if (msgsnd(msg_q, data, data_sz, 0) < 0) {
+	int rc = 1;
+
+	if (ring.buf)
+		rc = ring_send(&ring, msg_q, *(long *)data,
+			       (char *)data + sizeof(long), data_sz);
+	/* fall back to the message queue if the ring is full */
+	if (rc > 0)
+		rc = msgsnd(msg_q, data, data_sz, 0);
+	if (rc < 0) {
 		/* somehow we don't get this signal if queue is shut down
 		   though we should... */
 		if (errno == EIDRM) {
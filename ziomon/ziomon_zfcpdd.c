@@ -27,6 +27,7 @@
 #include "lib/zt_common.h"
 
 #include "blktrace.h"
+#include "ziomon_ring.h"
 #include "ziomon_zfcpdd.h"
 #include "blkiomon.h"
 
@@ -164,30 +165,73 @@ struct dhash {
 	struct dstat *head[DSTAT_HASH_SIZE];
 };
 
+/* trace event as queued for a shard */
+struct zfcpdd_event {
+	__u32 device;
+	struct zfcp_blk_drv_data dd;
+};
+
+#define SHARD_QUEUE_SIZE 4096
+#define SHARD_BATCH_SIZE 256
+#define SHARD_MAX 64
+
+/*
+ * Trace events are distributed to shards by the CPU that recorded them.
+ * Each shard accounts into its own pair of hash tables, which are merged
+ * at the end of an interval.
+ */
+struct shard {
+	pthread_t thread;
+	/* event queue, filled by the reader, drained by the shard thread */
+	pthread_mutex_t queue_mutex;
+	pthread_cond_t queue_cond;
+	struct zfcpdd_event *queue;
+	struct zfcpdd_event *spare;
+	int queue_cnt;
+	int done;
+	int failed;
+	/* events collected by the reader, not yet queued */
+	struct zfcpdd_event *batch;
+	int batch_cnt;
+	/* statistics, swapped by the interval thread */
+	pthread_mutex_t dstat_mutex;
+	struct dhash dstat_hash[2];
+	int dstat_curr;
+	/* statistic of the last accounted device, reset when dstat_curr changes */
+	struct dstat *dstat_last;
+};
+
+static struct shard *shards;
+static int shard_cnt = 1;
+
 static struct dstat *vacant_dstats_list = NULL;
-static struct dhash dstat_hash[2] = {};
-static int dstat_curr = 0;
+static pthread_mutex_t vacant_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static struct output binary, ascii;
 static FILE *ifp;
 static int interval;
 
-static pthread_mutex_t dstat_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int run = 1;
 static int main_run = 1;
 
 static char *msg_q_name = NULL;
 static int msg_q_id = -1, msg_q = -1;
 static long msg_id = LONG_MIN;
+static struct ring ring;
 
 static struct dstat *zfcpdd_dstat_alloc(void)
 {
-	struct dstat *dstat = vacant_dstats_list;
+	struct dstat *dstat;
 
+	pthread_mutex_lock(&vacant_mutex);
+	dstat = vacant_dstats_list;
 	if (dstat)
 		vacant_dstats_list = dstat->next;
-	else
+	pthread_mutex_unlock(&vacant_mutex);
+	if (!dstat)
 		dstat = malloc(sizeof(*dstat));
+	if (!dstat)
+		return NULL;
 	memset(dstat, 0, sizeof(*dstat));
 	init_abbrev_stat(&dstat->msg.stat.chan_lat);
 	init_abbrev_stat(&dstat->msg.stat.fabr_lat);
@@ -196,14 +240,21 @@ static struct dstat *zfcpdd_dstat_alloc(void)
 	return dstat;
 }
 
-static struct dstat *zfcpdd_dstat_find(struct dhash *hash,
-					  struct blk_io_trace *bit)
+static void zfcpdd_dstat_free(struct dstat *head, struct dstat *tail)
+{
+	pthread_mutex_lock(&vacant_mutex);
+	tail->next = vacant_dstats_list;
+	vacant_dstats_list = head;
+	pthread_mutex_unlock(&vacant_mutex);
+}
+
+static struct dstat *zfcpdd_dstat_find(struct dhash *hash, __u32 device)
 {
-	int i = bit->device % DSTAT_HASH_SIZE;
+	int i = device % DSTAT_HASH_SIZE;
 	struct dstat *dstat;
 
 	for (dstat = hash->head[i]; dstat; dstat = dstat->next)
-		if (dstat->msg.stat.device == bit->device)
+		if (dstat->msg.stat.device == device)
 			return dstat;
 	return NULL;
 }
@@ -214,8 +265,8 @@ static void zfcpdd_dstat_insert(struct dhash *hash, struct dstat *dstat)
 
 	dstat->next = hash->head[i];
 	hash->head[i] = dstat;
-	verbose_msg("insert: device=%d curr=%d hash=%p head=%p dstat=%p\n",
-		dstat->msg.stat.device, dstat_curr, hash, hash->head[i], dstat);
+	verbose_msg("insert: device=%d hash=%p head=%p dstat=%p\n",
+		dstat->msg.stat.device, hash, hash->head[i], dstat);
 }
 
 static __u64 hist_upper_limit(int index, struct hist_log2 *h)
@@ -225,10 +276,18 @@ static __u64 hist_upper_limit(int index, struct hist_log2 *h)
 
 static int hist_index(__u64 val, struct hist_log2 *h)
 {
+	__u64 q;
 	int i;
 
-	for (i = 0; i < (h->num - 1) && val > hist_upper_limit(i, h); i++);
-	return i;
+	if (val <= (__u64)h->first)
+		return 0;
+	/*
+	 * Smallest index i with val <= first + (delta << (i - 1)), that is
+	 * i = 1 + ceil(log2(q)) with q = ceil((val - first) / delta)
+	 */
+	q = (val - h->first - 1) / h->delta + 1;
+	i = 1 + (q > 1 ? 64 - __builtin_clzll(q - 1) : 0);
+	return MIN(i, h->num - 1);
 }
 
 static void zfcpdd_account_hist_log2(__u32 *bucket, __u64 val,
@@ -247,28 +306,31 @@ static void zfcpdd_account_outb(struct zfcpdd_dstat *stat,
 		stat->outb_max = dd->outb_usage;
 }
 
-static int zfcpdd_account(struct blk_io_trace *bit,
+/* Account one trace event, must be called with shard->dstat_mutex held */
+static int zfcpdd_account(struct shard *shard, __u32 device,
 			     struct zfcp_blk_drv_data *dd)
 {
+	struct dhash *hash = &shard->dstat_hash[shard->dstat_curr];
 	struct dstat *dstat;
 	struct zfcpdd_dstat *stat;
 
-	pthread_mutex_lock(&dstat_mutex);
-
-	dstat = zfcpdd_dstat_find(&dstat_hash[dstat_curr], bit);
+	/* Trace events usually come in runs for the same device */
+	dstat = shard->dstat_last;
+	if (!dstat || dstat->msg.stat.device != device)
+		dstat = zfcpdd_dstat_find(hash, device);
 	if (!dstat) {
 		dstat = zfcpdd_dstat_alloc();
 		if (!dstat) {
 			fprintf(stderr, "%s: could not alloc statistic: %s\n", toolname, strerror(errno));
-			pthread_mutex_unlock(&dstat_mutex);
 			return 1;
 		}
-		dstat->msg.stat.device = bit->device;
-		zfcpdd_dstat_insert(&dstat_hash[dstat_curr], dstat);
+		dstat->msg.stat.device = device;
+		zfcpdd_dstat_insert(hash, dstat);
 	}
+	shard->dstat_last = dstat;
 
-	verbose_msg("account: device=%d curr=%d hash=%p dstat=%p\n",
-		dstat->msg.stat.device, dstat_curr, &dstat_hash[dstat_curr], dstat);
+	verbose_msg("account: device=%d hash=%p dstat=%p\n",
+		dstat->msg.stat.device, hash, dstat);
 
 	stat = &dstat->msg.stat;
 	update_abbrev_stat(&stat->chan_lat, dd->chan_lat);
@@ -281,10 +343,158 @@ static int zfcpdd_account(struct blk_io_trace *bit,
 				    &flat);
 	stat->count++;
 
-	pthread_mutex_unlock(&dstat_mutex);
 	return 0;
 }
 
+/*
+ * Shard thread: account queued events in batches. The queue is double
+ * buffered so that the reader can fill one buffer while the other one
+ * is accounted.
+ */
+static void *zfcpdd_shard_thread(void *data)
+{
+	struct shard *shard = data;
+	struct zfcpdd_event *ev;
+	int i, cnt, rc = 0;
+
+	pthread_mutex_lock(&shard->queue_mutex);
+	while (!rc) {
+		while (!shard->queue_cnt && !shard->done)
+			pthread_cond_wait(&shard->queue_cond,
+					  &shard->queue_mutex);
+		if (!shard->queue_cnt)
+			break;
+		ev = shard->queue;
+		cnt = shard->queue_cnt;
+		shard->queue = shard->spare;
+		shard->spare = ev;
+		shard->queue_cnt = 0;
+		/* the reader might wait for free space */
+		pthread_cond_signal(&shard->queue_cond);
+		pthread_mutex_unlock(&shard->queue_mutex);
+
+		pthread_mutex_lock(&shard->dstat_mutex);
+		for (i = 0; i < cnt && !rc; i++)
+			rc = zfcpdd_account(shard, ev[i].device, &ev[i].dd);
+		pthread_mutex_unlock(&shard->dstat_mutex);
+
+		pthread_mutex_lock(&shard->queue_mutex);
+	}
+	if (rc) {
+		shard->failed = 1;
+		pthread_cond_signal(&shard->queue_cond);
+	}
+	pthread_mutex_unlock(&shard->queue_mutex);
+	return NULL;
+}
+
+/* Move the events collected by the reader to the shard queue */
+static int zfcpdd_shard_flush(struct shard *shard)
+{
+	int rc = 0;
+
+	if (!shard->batch_cnt)
+		return 0;
+	pthread_mutex_lock(&shard->queue_mutex);
+	while (shard->queue_cnt + shard->batch_cnt > SHARD_QUEUE_SIZE &&
+	       !shard->failed)
+		pthread_cond_wait(&shard->queue_cond, &shard->queue_mutex);
+	if (shard->failed) {
+		rc = 1;
+	} else {
+		memcpy(&shard->queue[shard->queue_cnt], shard->batch,
+		       shard->batch_cnt * sizeof(*shard->batch));
+		/* the shard thread only sleeps on an empty queue */
+		if (!shard->queue_cnt)
+			pthread_cond_signal(&shard->queue_cond);
+		shard->queue_cnt += shard->batch_cnt;
+	}
+	pthread_mutex_unlock(&shard->queue_mutex);
+	shard->batch_cnt = 0;
+	return rc;
+}
+
+static int zfcpdd_flush(void)
+{
+	int i, rc = 0;
+
+	if (shard_cnt == 1)
+		return 0;
+	for (i = 0; i < shard_cnt; i++)
+		rc |= zfcpdd_shard_flush(&shards[i]);
+	return rc;
+}
+
+/* Hand a trace event to its shard, account directly without shard threads */
+static int zfcpdd_queue(struct blk_io_trace *bit,
+			struct zfcp_blk_drv_data *dd)
+{
+	struct shard *shard = &shards[bit->cpu % shard_cnt];
+	struct zfcpdd_event *ev;
+	int rc;
+
+	if (shard_cnt == 1) {
+		pthread_mutex_lock(&shard->dstat_mutex);
+		rc = zfcpdd_account(shard, bit->device, dd);
+		pthread_mutex_unlock(&shard->dstat_mutex);
+		return rc;
+	}
+
+	ev = &shard->batch[shard->batch_cnt++];
+	ev->device = bit->device;
+	ev->dd = *dd;
+	if (shard->batch_cnt == SHARD_BATCH_SIZE)
+		return zfcpdd_shard_flush(shard);
+	return 0;
+}
+
+static int zfcpdd_shards_init(void)
+{
+	struct shard *shard;
+	int i;
+
+	shards = calloc(shard_cnt, sizeof(*shards));
+	if (!shards)
+		return 1;
+	for (i = 0; i < shard_cnt; i++) {
+		shard = &shards[i];
+		pthread_mutex_init(&shard->queue_mutex, NULL);
+		pthread_cond_init(&shard->queue_cond, NULL);
+		pthread_mutex_init(&shard->dstat_mutex, NULL);
+		if (shard_cnt == 1)
+			continue;
+		shard->queue = malloc((2 * SHARD_QUEUE_SIZE + SHARD_BATCH_SIZE) *
+				      sizeof(*shard->queue));
+		if (!shard->queue)
+			return 1;
+		shard->spare = shard->queue + SHARD_QUEUE_SIZE;
+		shard->batch = shard->spare + SHARD_QUEUE_SIZE;
+		if (pthread_create(&shard->thread, NULL, zfcpdd_shard_thread,
+				   shard))
+			return 1;
+	}
+	return 0;
+}
+
+/* Let shard threads account all queued events and wait for them */
+static void zfcpdd_shards_exit(void)
+{
+	struct shard *shard;
+	int i;
+
+	if (shard_cnt == 1)
+		return;
+	for (i = 0; i < shard_cnt; i++) {
+		shard = &shards[i];
+		pthread_mutex_lock(&shard->queue_mutex);
+		shard->done = 1;
+		pthread_cond_signal(&shard->queue_cond);
+		pthread_mutex_unlock(&shard->queue_mutex);
+	}
+	for (i = 0; i < shard_cnt; i++)
+		pthread_join(shards[i].thread, NULL);
+}
+
 static void dump_bit(struct blk_io_trace *bit, const char *descr)
 {
 	fprintf(stderr, "--- %s: %s ---\n", toolname, descr);
@@ -374,7 +584,13 @@ static int zfcpdd_output_msg_q(struct dstat *dstat)
 
 	dstat->msg.mtype = msg_id;
 	conv_dstat_to_BE(&dstat->msg.stat);
-	rc = msgsnd(msg_q, &dstat->msg, sizeof(dstat->msg.stat), 0);
+	rc = 1;
+	if (ring.buf)
+		rc = ring_send(&ring, msg_q, msg_id, &dstat->msg.stat,
+			       sizeof(dstat->msg.stat));
+	/* fall back to the message queue if the ring is full */
+	if (rc > 0)
+		rc = msgsnd(msg_q, &dstat->msg, sizeof(dstat->msg.stat), 0);
 	conv_dstat_from_BE(&dstat->msg.stat);
 
 	return rc;
@@ -397,7 +613,7 @@ static int zfcpdd_output(struct dstat *dstat)
 static void zfcpdd_consume(struct dhash *hash)
 {
 	int i;
-	struct dstat *dstat, *head, *tail;
+	struct dstat *dstat, *head, *tail = NULL;
 
 	for (i = 0; i < DSTAT_HASH_SIZE; i++) {
 		head = hash->head[i];
@@ -411,10 +627,29 @@ static void zfcpdd_consume(struct dhash *hash)
 			zfcpdd_output(dstat);
 			tail = dstat;
 		}
-		pthread_mutex_lock(&dstat_mutex);
-		tail->next = vacant_dstats_list;
-		vacant_dstats_list = head;
-		pthread_mutex_unlock(&dstat_mutex);
+		zfcpdd_dstat_free(head, tail);
+	}
+}
+
+/* Move finished statistics of a shard into hash, merging per device */
+static void zfcpdd_merge(struct dhash *hash, struct dhash *finished)
+{
+	struct dstat *dstat, *next, *tgt;
+	int i;
+
+	for (i = 0; i < DSTAT_HASH_SIZE; i++) {
+		for (dstat = finished->head[i]; dstat; dstat = next) {
+			next = dstat->next;
+			tgt = zfcpdd_dstat_find(hash, dstat->msg.stat.device);
+			if (tgt) {
+				aggregate_dstat(&dstat->msg.stat,
+						&tgt->msg.stat);
+				zfcpdd_dstat_free(dstat, dstat);
+			} else {
+				zfcpdd_dstat_insert(hash, dstat);
+			}
+		}
+		finished->head[i] = NULL;
 	}
 }
 
@@ -484,6 +719,8 @@ static int zfcpdd_open_msg_q(void)
 		if (msg_q >= 0)
 			break;
 	}
+	if (msg_q >= 0 && ring_attach(&ring, key, msg_id) == 0)
+		verbose_msg("using shared memory ring %s\n", ring.name);
 
 	return (msg_q >= 0 ? 0 : -1);
 }
@@ -495,32 +732,59 @@ static void zfcpdd_close_output(struct output *out)
 	free(out->buf);
 }
 
+#define FIFO_BUF_SIZE (128 * 1024)
+
+/*
+ * Read trace events in large chunks. Events collected for shard threads
+ * are queued before the reader might block, so that they are accounted
+ * in the interval they belong to.
+ */
 static int zfcpdd_do_fifo(void)
 {
-	struct blk_io_trace bit;
+	static char buf[FIFO_BUF_SIZE];
 	struct zfcp_blk_drv_data dd;
+	struct blk_io_trace bit;
+	size_t len = 0, pos = 0;
+	ssize_t rc;
 
-	while (fread(&bit, sizeof(bit), 1, ifp) == 1 && main_run) {
-		if (ferror(ifp)) {
-			clearerr(ifp);
-			fprintf(stderr, "%s: could not read trace: %s\n", toolname, strerror(errno));
-			break;
-		}
-		if (fread(&dd, bit.pdu_len, 1, ifp) != 1) {
-			clearerr(ifp);
-			fprintf(stderr, "%s: could not read trace payload: %s\n", toolname, strerror(errno));
-			break;
+	while (main_run) {
+		if (len - pos < sizeof(bit) ||
+		    len - pos < sizeof(bit) + ((struct blk_io_trace *)
+					       (buf + pos))->pdu_len) {
+			memmove(buf, buf + pos, len - pos);
+			len -= pos;
+			pos = 0;
+			if (zfcpdd_flush())
+				break;
+			rc = read(fileno(ifp), buf + len, sizeof(buf) - len);
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc < 0) {
+				fprintf(stderr, "%s: could not read trace: %s\n", toolname, strerror(errno));
+				break;
+			}
+			if (rc == 0) {
+				if (len >= sizeof(bit))
+					fprintf(stderr, "%s: could not read trace payload: %s\n", toolname, strerror(errno));
+				break;
+			}
+			len += rc;
+			continue;
 		}
+		memcpy(&bit, buf + pos, sizeof(bit));
+		pos += sizeof(bit);
 		if (bit.action & 0x40000000) {
 			if (bit.pdu_len != sizeof(dd)) {
-				clearerr(ifp);
 				dump_bit(&bit, "not a valid trace");
 				break;
 			}
-			if (zfcpdd_account(&bit, &dd))
+			memcpy(&dd, buf + pos, sizeof(dd));
+			if (zfcpdd_queue(&bit, &dd))
 				break;
 		}
+		pos += bit.pdu_len;
 	}
+	zfcpdd_flush();
 	if (main_run)
 		verbose_msg("pipe ended, exiting\n");
 
@@ -529,8 +793,10 @@ static int zfcpdd_do_fifo(void)
 
 static void *zfcpdd_interval(void *data)
 {
+	static struct dhash merged;
+	struct shard *shard;
 	struct timespec t;
-	int finished;
+	int i, finished;
 
 	clock_gettime(CLOCK_REALTIME, &t);
 
@@ -543,21 +809,26 @@ static void *zfcpdd_interval(void *data)
 			continue;
 		}
 
-		/* grab hash and make data gatherer build up another hash */
-		pthread_mutex_lock(&dstat_mutex);
-		finished = dstat_curr;
-		dstat_curr = dstat_curr ? 0 : 1;
-		pthread_mutex_unlock(&dstat_mutex);
+		/* grab hashes and make data gatherers build up other hashes */
+		for (i = 0; i < shard_cnt; i++) {
+			shard = &shards[i];
+			pthread_mutex_lock(&shard->dstat_mutex);
+			finished = shard->dstat_curr;
+			shard->dstat_curr = finished ? 0 : 1;
+			shard->dstat_last = NULL;
+			pthread_mutex_unlock(&shard->dstat_mutex);
 
-		zfcpdd_consume(&dstat_hash[finished]);
+			zfcpdd_merge(&merged, &shard->dstat_hash[finished]);
+		}
+		zfcpdd_consume(&merged);
 	}
 	return data;
 }
 
-#define S_OPTS "a:b:i:Q:q:m:Vvh"
+#define S_OPTS "a:b:i:Q:q:m:t:Vvh"
 
 static char usage_str[] = "[-v] [-V] [-h] [-b <file>] [-Q <msgq_path> -q <msgq_id>\n"
-	" -m <msg_id>] -i <interval>\n"
+	" -m <msg_id>] [-t <threads>] -i <interval>\n"
 	"\n"
 	"Collect device statistics from blktrace stream.\n"
 	"\n"
@@ -569,7 +840,8 @@ static char usage_str[] = "[-v] [-V] [-h] [-b <file>] [-Q <msgq_path> -q <msgq_i
 	"-q, --msg-queue-id    Specify the message queue id.\n"
 	"-a, --ascii           Specify the file name for ASCII output.\n"
 	"-b, --binary          Specify the file name for binary output.\n"
-	"-m, --msg-id          Specify the message id to use.\n";
+	"-m, --msg-id          Specify the message id to use.\n"
+	"-t, --threads         Number of threads to account trace data.\n";
 
 static struct option l_opts[] = {
 	{ "ascii",           required_argument, NULL, 'a' },
@@ -578,6 +850,7 @@ static struct option l_opts[] = {
 	{ "msg-queue",       required_argument, NULL, 'Q' },
 	{ "msg-queue-id",    required_argument, NULL, 'q' },
 	{ "msg-id",          required_argument, NULL, 'm' },
+	{ "threads",         required_argument, NULL, 't' },
 	{ "version",         no_argument,       NULL, 'v' },
 	{ "verbose",         no_argument,       NULL, 'V' },
 	{ "help",            no_argument,       NULL, 'h' },
@@ -620,6 +893,15 @@ int main(int argc, char *argv[])
 		case 'm':
 			msg_id = atoi(optarg);
 			break;
+		case 't':
+			shard_cnt = atoi(optarg);
+			if (shard_cnt < 1 || shard_cnt > SHARD_MAX) {
+				fprintf(stderr, "%s: error: number of threads "
+					"must be between 1 and %d\n", toolname,
+					SHARD_MAX);
+				return 1;
+			}
+			break;
 		case 'V':
 			verbose++;
 			break;
@@ -664,6 +946,10 @@ int main(int argc, char *argv[])
 		return 1;
 	if (zfcpdd_open_msg_q())
 		return 1;
+	if (zfcpdd_shards_init()) {
+		fprintf(stderr, "%s: could not set up accounting threads\n", toolname);
+		return 1;
+	}
 
 	/* setup thread which saves data to disk after the specified interval */
 	if (pthread_create(&interval_thread, NULL, zfcpdd_interval, NULL)) {
@@ -675,14 +961,13 @@ int main(int argc, char *argv[])
 
 	/* start cleanup */
 	fclose(ifp);
+	zfcpdd_shards_exit();
 	run = 0; /* thread control variable */
 	pthread_kill(interval_thread, SIGINT);
 	pthread_join(interval_thread, NULL);
 
-	/* acquire mutex before closing the file to avoid data corruption */
-	pthread_mutex_lock(&dstat_mutex);
+	/* the interval thread is gone, no more output can be written */
 	zfcpdd_close_output(&binary);
-	pthread_mutex_unlock(&dstat_mutex);
 
 	return 0;
 }
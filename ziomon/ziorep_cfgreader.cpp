@@ -14,13 +14,62 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <assert.h>
+#include <sys/stat.h>
 
 #include "ziorep_cfgreader.hpp"
 #include "ziorep_filters.hpp"
 #include "ziorep_utils.hpp"
 
+extern "C" {
+	#include "ziomon_dacc.h"
+}
+
 #define	ZIOREP_CFG_EXTENSION	".cfg"
 #define ZIOREP_CONFIG		"ziorep_config"
+#define ZIOREP_CFGBIN_EXT	".cfgbin"
+#define ZIOREP_CFGBIN_MAGIC	0x63666762
+#define ZIOREP_CFGBIN_VERSION	1
+#define ZIOREP_CFGBIN_NO_STRING	0xffffffff
+
+/**
+ * The .cfgbin file caches the devices of the .cfg file after parsing and
+ * filtering, so that successive runs skip ziorep_config and the scan of
+ * the data. It is written in host byte order and is only used if all
+ * source files match the header, otherwise it is rewritten. All members
+ * are naturally aligned, so the structures contain no padding.
+ */
+struct cfgbin_header {
+	__u32	magic;
+	__u32	version;
+	__u64	cfg_size;
+	__u64	cfg_mtime;
+	__u64	cfg_hash;	// FNV-1a hash of the .cfg file
+	__u64	log_size;	// devices were filtered against the data
+	__u64	log_mtime;
+	__u64	agg_size;
+	__u64	agg_mtime;
+	__u32	num_devices;
+	__u32	strtab_len;
+};
+
+/* followed by a string table that the string members point into */
+struct cfgbin_device {
+	__u32	chpid;
+	__u32	mm_internal;
+	struct hctl_ident	hctl_identifier;
+	__u32	subchannel;
+	__u32	devno;
+	__u64	wwpn;
+	__u64	lun;
+	__u32	mp_major;
+	__u32	mp_minor;
+	__u32	mp_mm;
+	__u32	major;
+	__u32	minor;
+	__u32	multipath_device;
+	__u32	device;
+	__u32	type;
+};
 
 extern const char *toolname;
 extern int verbose;
@@ -46,6 +95,14 @@ ConfigReader::ConfigReader(int *rc, const char *filename)
 		return;
 	}
 
+	if (read_cfgbin(filename) == 0) {
+		build_mm_index();
+		verbose_msg("ConfigReader: read %lu devices from %s%s\n",
+			    (long unsigned int)m_devices.size(), filename,
+			    ZIOREP_CFGBIN_EXT);
+		return;
+	}
+
 	if (extract_config_data(filename)) {
 		*rc = -2;
 		return;
@@ -108,10 +165,13 @@ ConfigReader::ConfigReader(int *rc, const char *filename)
 	}
 	init_device_info(&new_elem);
 
+	build_mm_index();
 	if (filter_unused_devices(filename)) {
 		*rc = -2;
 		goto out;
 	}
+	build_mm_index();
+	write_cfgbin(filename);
 
 	verbose_msg("ConfigReader: done\n");
 
@@ -444,6 +504,303 @@ void ConfigReader::mp_mm_not_found_error(__u32 mp_mm, int *rc) const
 }
 
 
+static char* get_filename(const char *fname, const char *ext)
+{
+	char *tmp;
+
+	tmp = (char*)malloc(strlen(fname) + strlen(ext) + 1);
+	sprintf(tmp, "%s%s", fname, ext);
+
+	return tmp;
+}
+
+
+/**
+ * Get size and modification time of a file, or 0 if it doesn't exist. */
+static int cfgbin_stat(const char *fname, const char *ext, __u64 *size,
+		       __u64 *mtime)
+{
+	struct stat st;
+	char *tmp;
+	int rc;
+
+	tmp = get_filename(fname, ext);
+	rc = stat(tmp, &st);
+	free(tmp);
+	if (rc) {
+		*size = 0;
+		*mtime = 0;
+		return (errno == ENOENT ? 0 : -1);
+	}
+	*size = st.st_size;
+	*mtime = st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+
+	return 0;
+}
+
+
+static int cfgbin_hash(const char *fname, __u64 *hash)
+{
+	unsigned char buf[65536];
+	size_t len, i;
+	char *tmp;
+	FILE *fp;
+	int rc = 0;
+
+	tmp = get_filename(fname, ZIOREP_CFG_EXTENSION);
+	fp = fopen(tmp, "r");
+	free(tmp);
+	if (!fp)
+		return -1;
+	*hash = 0xcbf29ce484222325ULL;
+	while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		for (i = 0; i < len; ++i) {
+			*hash ^= buf[i];
+			*hash *= 0x100000001b3ULL;
+		}
+	}
+	if (ferror(fp))
+		rc = -1;
+	fclose(fp);
+
+	return rc;
+}
+
+
+/**
+ * Fill in the header fields describing the source files,
+ * except for the hash. */
+static int cfgbin_sources(const char *fname, struct cfgbin_header *hdr)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = ZIOREP_CFGBIN_MAGIC;
+	hdr->version = ZIOREP_CFGBIN_VERSION;
+
+	if (cfgbin_stat(fname, ZIOREP_CFG_EXTENSION, &hdr->cfg_size,
+			&hdr->cfg_mtime)
+	    || cfgbin_stat(fname, DACC_FILE_EXT_LOG, &hdr->log_size,
+			   &hdr->log_mtime)
+	    || cfgbin_stat(fname, DACC_FILE_EXT_AGG, &hdr->agg_size,
+			   &hdr->agg_mtime))
+		return -1;
+
+	return 0;
+}
+
+
+static char* cfgbin_string(const char *strtab, __u32 len, __u32 off, int *rc)
+{
+	char *str;
+
+	if (off == ZIOREP_CFGBIN_NO_STRING)
+		return NULL;
+	if (off >= len) {
+		*rc = -1;
+		return NULL;
+	}
+	str = strdup(strtab + off);
+	if (!str)
+		*rc = -1;
+
+	return str;
+}
+
+
+int ConfigReader::read_cfgbin(const char *fname)
+{
+	struct cfgbin_header hdr, cur;
+	struct cfgbin_device *devs = NULL;
+	struct device_info info;
+	char *strtab = NULL;
+	char *tmp;
+	__u32 i;
+	FILE *fp;
+	int rc = -1;
+
+	if (cfgbin_sources(fname, &cur))
+		return -1;
+
+	tmp = get_filename(fname, ZIOREP_CFGBIN_EXT);
+	fp = fopen(tmp, "r");
+	free(tmp);
+	if (!fp) {
+		verbose_msg("No %s file found.\n", ZIOREP_CFGBIN_EXT);
+		return -1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1)
+		goto out;
+	cur.cfg_hash = hdr.cfg_hash;
+	cur.num_devices = hdr.num_devices;
+	cur.strtab_len = hdr.strtab_len;
+	if (memcmp(&hdr, &cur, sizeof(hdr)) != 0
+	    || cfgbin_hash(fname, &cur.cfg_hash)
+	    || cur.cfg_hash != hdr.cfg_hash) {
+		verbose_msg("%s file is stale, ignore\n", ZIOREP_CFGBIN_EXT);
+		goto out;
+	}
+	if (hdr.num_devices == 0 || hdr.strtab_len == 0)
+		goto out;
+
+	devs = (struct cfgbin_device*)malloc(hdr.num_devices * sizeof(*devs));
+	strtab = (char*)malloc(hdr.strtab_len);
+	if (!devs || !strtab
+	    || fread(devs, sizeof(*devs), hdr.num_devices, fp)
+	       != hdr.num_devices
+	    || fread(strtab, 1, hdr.strtab_len, fp) != hdr.strtab_len
+	    || strtab[hdr.strtab_len - 1] != '\0')
+		goto out;
+
+	rc = 0;
+	for (i = 0; i < hdr.num_devices && !rc; ++i) {
+		init_device_info(&info);
+		info.chpid = devs[i].chpid;
+		info.mm_internal = devs[i].mm_internal;
+		info.hctl_identifier = devs[i].hctl_identifier;
+		info.subchannel = devs[i].subchannel;
+		info.devno = devs[i].devno;
+		info.wwpn = devs[i].wwpn;
+		info.lun = devs[i].lun;
+		info.mp_major = devs[i].mp_major;
+		info.mp_minor = devs[i].mp_minor;
+		info.mp_mm = devs[i].mp_mm;
+		info.major = devs[i].major;
+		info.minor = devs[i].minor;
+		info.multipath_device = cfgbin_string(strtab, hdr.strtab_len,
+						devs[i].multipath_device, &rc);
+		info.device = cfgbin_string(strtab, hdr.strtab_len,
+					    devs[i].device, &rc);
+		info.type = cfgbin_string(strtab, hdr.strtab_len,
+					  devs[i].type, &rc);
+		if (!info.device || !info.type)
+			rc = -1;
+		m_devices.push_back(info);
+	}
+	if (rc) {
+		for (list<struct device_info>::iterator j = m_devices.begin();
+		      j != m_devices.end(); ++j)
+			free_device_info(&(*j));
+		m_devices.clear();
+	}
+
+out:
+	free(devs);
+	free(strtab);
+	fclose(fp);
+
+	return rc;
+}
+
+
+static __u32 cfgbin_add_string(const char *str, __u32 *len)
+{
+	__u32 off = *len;
+
+	if (!str)
+		return ZIOREP_CFGBIN_NO_STRING;
+	*len += strlen(str) + 1;
+
+	return off;
+}
+
+
+void ConfigReader::write_cfgbin(const char *fname) const
+{
+	struct cfgbin_header hdr;
+	struct cfgbin_device dev;
+	list<struct device_info>::const_iterator i;
+	const char *str[3];
+	char *tmp;
+	FILE *fp;
+	int j, rc = 0;
+
+	if (m_devices.empty() || cfgbin_sources(fname, &hdr)
+	    || cfgbin_hash(fname, &hdr.cfg_hash))
+		return;
+	hdr.num_devices = m_devices.size();
+
+	tmp = get_filename(fname, ZIOREP_CFGBIN_EXT);
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		verbose_msg("Could not create %s\n", tmp);
+		free(tmp);
+		return;
+	}
+	// header is rewritten once the size of the string table is known
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+		rc = -1;
+	for (i = m_devices.begin(); i != m_devices.end() && !rc; ++i) {
+		memset(&dev, 0, sizeof(dev));
+		dev.chpid = (*i).chpid;
+		dev.mm_internal = (*i).mm_internal;
+		dev.hctl_identifier = (*i).hctl_identifier;
+		dev.subchannel = (*i).subchannel;
+		dev.devno = (*i).devno;
+		dev.wwpn = (*i).wwpn;
+		dev.lun = (*i).lun;
+		dev.mp_major = (*i).mp_major;
+		dev.mp_minor = (*i).mp_minor;
+		dev.mp_mm = (*i).mp_mm;
+		dev.major = (*i).major;
+		dev.minor = (*i).minor;
+		dev.multipath_device = cfgbin_add_string((*i).multipath_device,
+							 &hdr.strtab_len);
+		dev.device = cfgbin_add_string((*i).device, &hdr.strtab_len);
+		dev.type = cfgbin_add_string((*i).type, &hdr.strtab_len);
+		if (fwrite(&dev, sizeof(dev), 1, fp) != 1)
+			rc = -1;
+	}
+	for (i = m_devices.begin(); i != m_devices.end() && !rc; ++i) {
+		str[0] = (*i).multipath_device;
+		str[1] = (*i).device;
+		str[2] = (*i).type;
+		for (j = 0; j < 3; ++j) {
+			if (str[j] && fwrite(str[j], strlen(str[j]) + 1, 1, fp)
+			    != 1)
+				rc = -1;
+		}
+	}
+	if (!rc && (fseek(fp, 0, SEEK_SET)
+		    || fwrite(&hdr, sizeof(hdr), 1, fp) != 1))
+		rc = -1;
+	if (fclose(fp) || rc) {
+		verbose_msg("Could not write %s\n", tmp);
+		remove(tmp);
+	}
+	else
+		verbose_msg("Cached devices in %s\n", tmp);
+	free(tmp);
+}
+
+
+void ConfigReader::build_mm_index()
+{
+	m_mm_index.clear();
+	// insert() keeps the first device, like the linear searches did
+	for (list<struct device_info>::const_iterator i = m_devices.begin();
+	      i != m_devices.end(); ++i)
+		m_mm_index.insert(std::make_pair((*i).mm_internal, &(*i)));
+}
+
+
+const struct ConfigReader::device_info*
+		ConfigReader::find_by_mm_internal(__u32 mm) const
+{
+	map<__u32, const struct device_info*>::const_iterator i;
+
+	i = m_mm_index.find(mm);
+	if (i == m_mm_index.end())
+		return NULL;
+
+	return i->second;
+}
+
+
+#define	search_by_mm(mm, ret)	{ \
+		const struct device_info *info = find_by_mm_internal(mm); \
+		if (info) \
+			return info->ret; \
+	}
+
 #define	search_for(att, crit, ret)	for (list<struct device_info>::const_iterator i = m_devices.begin(); \
 							i != m_devices.end(); ++i) { \
 						if ((*i).att == crit) \
@@ -488,7 +845,7 @@ __u32 ConfigReader::get_chpid_by_ident(const struct hctl_ident *ident, int *rc)
 
 __u32 ConfigReader::get_chpid_by_mm_internal(__u32 mm, int *rc) const
 {
-	search_for(mm_internal, mm, chpid);
+	search_by_mm(mm, chpid);
 
 	mm_internal_not_found_error(mm, rc);
 
@@ -529,7 +886,7 @@ __u32 ConfigReader::get_devno_by_ident(const struct hctl_ident *ident,
 
 __u32 ConfigReader::get_devno_by_mm_internal(__u32 mm, int *rc) const
 {
-	search_for(mm_internal, mm, devno);
+	search_by_mm(mm, devno);
 
 	mm_internal_not_found_error(mm, rc);
 
@@ -565,7 +922,7 @@ const char* ConfigReader::get_multipath_by_mp_mm(__u32 mp_mm, int *rc) const
 
 __u64 ConfigReader::get_wwpn_by_mm_internal(__u32 dev, int *rc) const
 {
-	search_for(mm_internal, dev, wwpn);
+	search_by_mm(dev, wwpn);
 
 	mm_internal_not_found_error(dev, rc);
 
@@ -585,7 +942,7 @@ __u64 ConfigReader::get_wwpn_by_ident(const struct hctl_ident *ident, int *rc) c
 
 __u32 ConfigReader::get_mp_mm_by_mm_internal(__u32 mm, int *rc) const
 {
-	search_for(mm_internal, mm, mp_mm);
+	search_by_mm(mm, mp_mm);
 
 	mm_internal_not_found_error(mm, rc);
 
@@ -605,7 +962,7 @@ __u32 ConfigReader::get_mp_mm_by_ident(const struct hctl_ident *ident, int *rc)
 
 __u64 ConfigReader::get_lun_by_mm_internal(__u32 mm, int *rc) const
 {
-	search_for(mm_internal, mm, lun);
+	search_by_mm(mm, lun);
 
 	mm_internal_not_found_error(mm, rc);
 
@@ -614,7 +971,7 @@ __u64 ConfigReader::get_lun_by_mm_internal(__u32 mm, int *rc) const
 
 const char* ConfigReader::get_dev_by_mm_internal(__u32 mm, int *rc) const
 {
-	search_for(mm_internal, mm, device);
+	search_by_mm(mm, device);
 
 	mm_internal_not_found_error(mm, rc);
 
@@ -645,11 +1002,10 @@ __u32 ConfigReader::get_mm_by_device(const char *dev, int *rc) const
 
 const struct hctl_ident* ConfigReader::get_ident_by_mm_internal(__u32 mm, int *rc) const
 {
-	for (list<struct device_info>::const_iterator i = m_devices.begin();
-		i != m_devices.end(); ++i) {
-		if ((*i).mm_internal == mm)
-			return &(*i).hctl_identifier;
-	}
+	const struct device_info *info = find_by_mm_internal(mm);
+
+	if (info)
+		return &info->hctl_identifier;;
 
 	mm_internal_not_found_error(mm, rc);
 
@@ -14,6 +14,7 @@
 
 #include <stdio.h>
 #include <list>
+#include <map>
 
 #include <linux/types.h>
 
@@ -24,6 +25,7 @@ extern "C" {
 
 
 using std::list;
+using std::map;
 
 
 /**
@@ -152,6 +154,13 @@ private:
 
 	bool cached_config_exists(const char *fname);
 
+	/** read the parsed and filtered devices from the .cfgbin file.
+	 * Returns 0 on success, !=0 if the file is missing or stale */
+	int read_cfgbin(const char *fname);
+
+	/** write the parsed and filtered devices to the .cfgbin file */
+	void write_cfgbin(const char *fname) const;
+
 	struct device_info {
 		// chpid, e.g. 43 (hex)
 		__u32	chpid;
@@ -192,6 +201,11 @@ private:
 	};
 	list<struct device_info>	m_devices;
 
+	/**
+	 * Lookup table for the devices by mm_internal, which is what
+	 * DeviceFilter and the collapsers query for each device. */
+	map<__u32, const struct device_info*>	m_mm_index;
+
 	/**
 	 * File holding the internal representation of the configuration
 	 * data. If m_cfg_cached is false, then it must be removed once
@@ -213,6 +227,10 @@ private:
 
 	void free_device_info(struct device_info *info);
 
+	void build_mm_index();
+
+	const struct device_info* find_by_mm_internal(__u32 mm) const;
+
 	int extract_adapter_info(char *p, struct device_info *info);
 
 	int extract_adapter_info_sub(char **tgt, char *p, char delim);
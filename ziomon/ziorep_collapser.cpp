@@ -42,75 +42,54 @@ Aggregator Collapser::get_criterion() const
 
 void Collapser::add_to_index(struct ident_mapping *new_mapping) const
 {
-	list<struct ident_mapping>::iterator i;
-
-	for (i = m_idents.begin(); i != m_idents.end()
-	      && compare_hctl_idents(&new_mapping->ident, &(*i).ident) >= 0;
-	      ++i) ;
-	if (i == m_idents.end() || compare_hctl_idents(&new_mapping->ident, &(*i).ident) != 0)
-		m_idents.insert(i, *new_mapping);
+	m_idents.insert(std::make_pair(new_mapping->ident, new_mapping->idx));
 }
 
 
 void Collapser::add_to_index(struct device_mapping *new_mapping) const
 {
-	list<struct device_mapping>::iterator i;
-
-	for (i = m_devices.begin(); i != m_devices.end()
-	      && new_mapping->device >= (*i).device;
-	      ++i) ;
-	if (i == m_devices.end() || (*i).device != new_mapping->device)
-		m_devices.insert(i, *new_mapping);
+	m_devices.insert(std::make_pair(new_mapping->device, new_mapping->idx));
 }
 
 
 void Collapser::add_to_index(struct host_id_mapping *new_mapping) const
 {
-	list<struct host_id_mapping>::iterator i;
-
-	for (i = m_host_ids.begin(); i != m_host_ids.end()
-	      && new_mapping->h >= (*i).h;
-	      ++i) ;
-	if (i == m_host_ids.end() || (*i).h != new_mapping->h)
-		m_host_ids.insert(i, *new_mapping);
+	m_host_ids.insert(std::make_pair(new_mapping->h, new_mapping->idx));
 }
 
 
 int Collapser::lookup_index(struct hctl_ident *identifier) const
 {
-	int rc;
+	unordered_map<struct hctl_ident, int, hctl_ident_hash,
+		      hctl_ident_equal>::const_iterator i;
 
-	for (list<struct ident_mapping>::const_iterator i = m_idents.begin();
-	      i != m_idents.end() && (rc = compare_hctl_idents(identifier, &(*i).ident)) >= 0; ++i ) {
-		if (rc == 0)
-			return (*i).idx;
-	}
+	i = m_idents.find(*identifier);
+	if (i == m_idents.end())
+		return -1;
 
-	return -1;
+	return i->second;
 }
 
 
 int Collapser::lookup_index(__u32 device) const
 {
-	for (list<struct device_mapping>::const_iterator i = m_devices.begin();
-	      i != m_devices.end() && device >= (*i).device; ++i ) {
-		if ((*i).device == device)
-			return (*i).idx;
-	}
+	unordered_map<__u32, int>::const_iterator i = m_devices.find(device);
+
+	if (i == m_devices.end())
+		return -1;
 
-	return -1;
+	return i->second;
 }
 
 
 int Collapser::lookup_index_by_host_id(__u32 h) const
 {
-	for (list<struct host_id_mapping>::const_iterator i = m_host_ids.begin();
-	      i != m_host_ids.end() && h >= (*i).h; ++i ) {
-		if ((*i).h == h)
-			return (*i).idx;
-	}
+	unordered_map<__u32, int>::const_iterator i = m_host_ids.find(h);
+
+	if (i == m_host_ids.end())
+		return -1;
 
-	return -1;
+	return i->second;
 }
 
 
@@ -230,31 +209,41 @@ AggregationCollapser::AggregationCollapser(ConfigReader &cfg,
 }
 
 
-int AggregationCollapser::get_index_u32(list<__u32> &lst, __u32 chpid)
+void AggregationCollapser::index_reference_values()
 {
 	int idx = 0;
 
-	for (list<__u32>::const_iterator i = lst.begin();
-	      i != lst.end(); ++i, ++idx) {
-		if (chpid == *i)
-			return idx;
-	}
+	for (list<__u32>::const_iterator i = m_reference_values_u32.begin();
+	      i != m_reference_values_u32.end(); ++i, ++idx)
+		m_reference_index_u32.insert(std::make_pair(*i, idx));
+	idx = 0;
+	for (list<__u64>::const_iterator i = m_reference_values_u64.begin();
+	      i != m_reference_values_u64.end(); ++i, ++idx)
+		m_reference_index_u64.insert(std::make_pair(*i, idx));
+}
+
+
+int AggregationCollapser::get_index_u32(__u32 val) const
+{
+	unordered_map<__u32, int>::const_iterator i;
 
-	return -1;
+	i = m_reference_index_u32.find(val);
+	if (i == m_reference_index_u32.end())
+		return -1;
+
+	return i->second;
 }
 
 
-int AggregationCollapser::get_index_u64(list<__u64> &lst, __u64 chpid)
+int AggregationCollapser::get_index_u64(__u64 val) const
 {
-	int idx = 0;
+	unordered_map<__u64, int>::const_iterator i;
 
-	for (list<__u64>::const_iterator i = lst.begin();
-	      i != lst.end(); ++i, ++idx) {
-		if (chpid == *i)
-			return idx;
-	}
+	i = m_reference_index_u64.find(val);
+	if (i == m_reference_index_u64.end())
+		return -1;
 
-	return -1;
+	return i->second;
 }
 
 
@@ -272,6 +261,7 @@ void AggregationCollapser::setup_by_chpid(ConfigReader &cfg,
 
 	// this is our master list for collapsing
 	dev_filt.get_eligible_chpids(cfg, m_reference_values_u32);
+	index_reference_values();
 
 	cfg.get_unique_mms(mms);
 	for (list<__u32>::const_iterator i = mms.begin();
@@ -282,7 +272,7 @@ void AggregationCollapser::setup_by_chpid(ConfigReader &cfg,
 		dev_mapping.idx = -1;
 		chpid = cfg.get_chpid_by_mm_internal(*i, &rc);
 		assert(rc == 0);
-		dev_mapping.idx = get_index_u32(m_reference_values_u32, chpid);
+		dev_mapping.idx = get_index_u32(chpid);
 		assert(dev_mapping.idx >= 0);
 		add_to_index(&dev_mapping);
 		vverbose_msg("    map mm %d to chpid %x (index %d)\n", *i,
@@ -298,8 +288,7 @@ void AggregationCollapser::setup_by_chpid(ConfigReader &cfg,
 		host_id_mapping.idx = -1;
 		chpid = cfg.get_chpid_by_host_id(*i, &rc);
 		assert(rc == 0);
-		host_id_mapping.idx = get_index_u32(m_reference_values_u32,
-						    chpid);
+		host_id_mapping.idx = get_index_u32(chpid);
 		assert(host_id_mapping.idx >= 0);
 		add_to_index(&host_id_mapping);
 		vverbose_msg("    map host id %d to chpid %x (index %d)\n", *i,
@@ -315,7 +304,7 @@ void AggregationCollapser::setup_by_chpid(ConfigReader &cfg,
 		ide_mapping.idx = -1;
 		chpid = cfg.get_chpid_by_ident(&(*i), &rc);
 		assert(rc == 0);
-		ide_mapping.idx = get_index_u32(m_reference_values_u32, chpid);
+		ide_mapping.idx = get_index_u32(chpid);
 		assert(ide_mapping.idx >= 0);
 		add_to_index(&ide_mapping);
 		vverbose_msg("    map device [%d:%d:%d:%d] to chpid %x (index %d)\n",
@@ -340,6 +329,7 @@ void AggregationCollapser::setup_by_devno(ConfigReader &cfg,
 	/* this is our master list for collapsing
 	*/
 	dev_filt.get_eligible_devnos(cfg, m_reference_values_u32);
+	index_reference_values();
 
 	cfg.get_unique_mms(mms);
 	for (list<__u32>::const_iterator i = mms.begin();
@@ -350,7 +340,7 @@ void AggregationCollapser::setup_by_devno(ConfigReader &cfg,
 		dev_mapping.idx = -1;
 		devno = cfg.get_devno_by_mm_internal(*i, &rc);
 		assert(rc == 0);
-		dev_mapping.idx = get_index_u32(m_reference_values_u32, devno);
+		dev_mapping.idx = get_index_u32(devno);
 		assert(dev_mapping.idx >= 0);
 		add_to_index(&dev_mapping);
 		vverbose_msg("    map mm %d to bus id %x.%x.%04x (index %d)\n", *i,
@@ -366,8 +356,7 @@ void AggregationCollapser::setup_by_devno(ConfigReader &cfg,
 		host_id_mapping.idx = -1;
 		devno = cfg.get_devno_by_host_id(*i, &rc);
 		assert(rc == 0);
-		host_id_mapping.idx = get_index_u32(m_reference_values_u32,
-						    devno);
+		host_id_mapping.idx = get_index_u32(devno);
 		assert(host_id_mapping.idx >= 0);
 		add_to_index(&host_id_mapping);
 		vverbose_msg("    map host id %d to bus id %x.%x.%04x"
@@ -384,7 +373,7 @@ void AggregationCollapser::setup_by_devno(ConfigReader &cfg,
 		ide_mapping.idx = -1;
 		devno = cfg.get_devno_by_ident(&(*i), &rc);
 		assert(rc == 0);
-		ide_mapping.idx = get_index_u32(m_reference_values_u32, devno);
+		ide_mapping.idx = get_index_u32(devno);
 		assert(ide_mapping.idx >= 0);
 		add_to_index(&ide_mapping);
 		vverbose_msg("    map device [%d:%d:%d:%d] to bus id %x.%x.%04x"
@@ -407,6 +396,7 @@ void AggregationCollapser::setup_by_wwpn(ConfigReader &cfg,
 
 	// this is our master list for collapsing
 	dev_filt.get_eligible_wwpns(cfg, m_reference_values_u64);
+	index_reference_values();
 
 	cfg.get_unique_mms(mms);
 	for (list<__u32>::const_iterator i = mms.begin();
@@ -417,7 +407,7 @@ void AggregationCollapser::setup_by_wwpn(ConfigReader &cfg,
 		dev_mapping.idx = -1;
 		wwpn = cfg.get_wwpn_by_mm_internal(*i, &rc);
 		assert(rc == 0);
-		dev_mapping.idx = get_index_u64(m_reference_values_u64, wwpn);
+		dev_mapping.idx = get_index_u64(wwpn);
 		assert(dev_mapping.idx >= 0);
 		add_to_index(&dev_mapping);
 		vverbose_msg("    map mm %d to wwpn %016Lx (index %d)\n", *i,
@@ -433,7 +423,7 @@ void AggregationCollapser::setup_by_wwpn(ConfigReader &cfg,
 		ide_mapping.idx = -1;
 		wwpn = cfg.get_wwpn_by_ident(&(*i), &rc);
 		assert(rc == 0);
-		ide_mapping.idx = get_index_u64(m_reference_values_u64, wwpn);
+		ide_mapping.idx = get_index_u64(wwpn);
 		assert(ide_mapping.idx >= 0);
 		add_to_index(&ide_mapping);
 		vverbose_msg("    map device [%d:%d:%d:%d] to wwpn %016Lx"
@@ -456,6 +446,7 @@ int AggregationCollapser::setup_by_multipath(ConfigReader &cfg,
 
 	// this is our master list for collapsing
 	dev_filt.get_eligible_mp_mms(cfg, m_reference_values_u32);
+	index_reference_values();
 
 	if (m_reference_values_u32.size() == 0) {
 		fprintf(stderr, "%s: No multipath devices in configuration"
@@ -479,7 +470,7 @@ int AggregationCollapser::setup_by_multipath(ConfigReader &cfg,
 			grc = -1;
 			continue;
 		}
-		dev_mapping.idx = get_index_u32(m_reference_values_u32, mp_mm);
+		dev_mapping.idx = get_index_u32(mp_mm);
 		assert(dev_mapping.idx >= 0);
 		add_to_index(&dev_mapping);
 		vverbose_msg("    map mm %d to mp_mm %x (index %d)\n", *i,
@@ -497,7 +488,7 @@ int AggregationCollapser::setup_by_multipath(ConfigReader &cfg,
 		ide_mapping.idx = -1;
 		mp_mm = cfg.get_mp_mm_by_ident(&(*i), &rc);
 		assert(rc == 0);
-		ide_mapping.idx = get_index_u32(m_reference_values_u32, mp_mm);
+		ide_mapping.idx = get_index_u32(mp_mm);
 		assert(ide_mapping.idx >= 0);
 		add_to_index(&ide_mapping);
 		vverbose_msg("    map device [%d:%d:%d:%d] to mp_mm %x"
@@ -14,6 +14,7 @@
 #define ZIOMON_COLLAPSER
 
 #include <list>
+#include <unordered_map>
 
 #include <linux/types.h>
 
@@ -21,6 +22,7 @@
 #include "ziorep_filters.hpp"
 
 using std::list;
+using std::unordered_map;
 
 
 enum Aggregator {
@@ -71,14 +73,15 @@ protected:
 		struct hctl_ident	ident;
 		int			idx;
 	};
-	/// Lookup list for matching a host id to an index, sorted ascending
-	mutable list<struct host_id_mapping>	m_host_ids;
+	/// Lookup table for matching a host id to an index
+	mutable unordered_map<__u32, int>	m_host_ids;
 
-	/// Lookup list for matching a device to an index, sorted ascending
-	mutable list<struct device_mapping>	m_devices;
+	/// Lookup table for matching a device to an index
+	mutable unordered_map<__u32, int>	m_devices;
 
-	/// Lookup list for matching an identifier to an index, sorted ascending
-	mutable list<struct ident_mapping>	m_idents;
+	/// Lookup table for matching an identifier to an index
+	mutable unordered_map<struct hctl_ident, int, hctl_ident_hash,
+			      hctl_ident_equal>	m_idents;
 
 	/// add entry, skips duplicates.
 	void add_to_index(struct ident_mapping *new_mapping) const;
@@ -169,8 +172,13 @@ private:
 	list<__u32>		m_reference_values_u32;
 	list<__u64>		m_reference_values_u64;
 
-	int get_index_u32(list<__u32> &lst, __u32 chpid);
-	int get_index_u64(list<__u64> &lst, __u64 chpid);
+	/// positions of the values in the reference lists
+	unordered_map<__u32, int>	m_reference_index_u32;
+	unordered_map<__u64, int>	m_reference_index_u64;
+
+	void index_reference_values();
+	int get_index_u32(__u32 val) const;
+	int get_index_u64(__u64 val) const;
 
 	void setup_by_chpid(ConfigReader &cfg, DeviceFilter &dev_filt);
 	void setup_by_devno(ConfigReader &cfg, DeviceFilter &dev_filt);
@@ -112,6 +112,22 @@ bool MsgTimeFilter::is_eligible(const struct message *msg) const
 }
 
 
+size_t hctl_ident_hash::operator()(const struct hctl_ident &i) const
+{
+	__u64 h = ((__u64)i.host << 48) ^ ((__u64)i.channel << 32)
+		  ^ ((__u64)i.target << 16) ^ i.lun;
+
+	return std::hash<__u64>()(h);
+}
+
+
+bool hctl_ident_equal::operator()(const struct hctl_ident &a,
+				  const struct hctl_ident &b) const
+{
+	return compare_hctl_idents(&a, &b) == 0;
+}
+
+
 void DeviceFilter::add_device(__u32 device, const struct hctl_ident *id) {
 	add_device(device);
 	add_device(id);
@@ -123,6 +139,8 @@ void DeviceFilter::add_device(__u32 device)
 {
 	list<__u32>::iterator i;
 
+	if (!m_device_set.insert(device).second)
+		return;
 	for (i = m_devices.begin(); i != m_devices.end() && device > *i; ++i) ;
 
 	if (m_devices.size() == 0 || *i != device)
@@ -134,6 +152,8 @@ void DeviceFilter::add_device(const struct hctl_ident *id)
 {
 	list<struct hctl_ident>::iterator i;
 
+	if (!m_ident_set.insert(*id).second)
+		return;
 	for (i = m_idents.begin(); i != m_idents.end()
 	      && compare_hctl_idents(id, &(*i)) > 0; ++i) ;
 
@@ -147,6 +167,8 @@ void DeviceFilter::add_host(__u32 host)
 {
 	list<__u32>::iterator i;
 
+	if (!m_host_id_set.insert(host).second)
+		return;
 	for (i = m_host_ids.begin(); i != m_host_ids.end() && host > *i; ++i) ;
 
 	if (m_host_ids.size() == 0 || i == m_host_ids.end() || *i != host)
@@ -192,42 +214,19 @@ bool DeviceFilter::is_eligible(const struct ioerr_cnt *cnt) const
 
 bool DeviceFilter::is_eligible_mm(__u32 mm) const
 {
-	for (list<__u32>::const_iterator i = m_devices.begin();
-	      i != m_devices.end() && mm >= *i; ++i) {
-		if (mm == *i)
-			return true;
-	}
-
-	return false;
+	return (m_device_set.find(mm) != m_device_set.end());
 }
 
 
 bool DeviceFilter::is_eligible_ident(const struct hctl_ident *ident) const
 {
-	int rc;
-
-	for (list<struct hctl_ident>::const_iterator i = m_idents.begin();
-	      i != m_idents.end(); ++i) {
-		rc = compare_hctl_idents(ident, &(*i));
-		if (rc == 0)
-			return true;
-		if (rc < 0)
-			break;
-	}
-
-	return false;
+	return (m_ident_set.find(*ident) != m_ident_set.end());
 }
 
 
 bool DeviceFilter::is_eligible_host_id(__u32 host) const
 {
-	for (list<__u32>::const_iterator i = m_host_ids.begin();
-	      i != m_host_ids.end() && host >= (*i); ++i) {
-		if (host == (*i))
-			return true;
-	}
-
-	return false;
+	return (m_host_id_set.find(host) != m_host_id_set.end());
 }
 
 
@@ -14,6 +14,7 @@
 
 #include <list>
 #include <set>
+#include <unordered_set>
 
 
 #include "ziorep_cfgreader.hpp"
@@ -21,6 +22,7 @@
 
 using std::list;
 using std::set;
+using std::unordered_set;
 
 extern "C" {
 #include "blkiomon.h"
@@ -28,6 +30,17 @@ extern "C" {
 }
 
 
+/// Hash and equality of device identifiers for unordered containers
+struct hctl_ident_hash {
+	size_t operator()(const struct hctl_ident &i) const;
+};
+
+struct hctl_ident_equal {
+	bool operator()(const struct hctl_ident &a,
+			const struct hctl_ident &b) const;
+};
+
+
 enum MsgTypes {
 	utilization,
 	ioerr,
@@ -151,6 +164,12 @@ private:
 	list<__u32>			m_host_ids;
 	/// ascending list of devices to keep - in sync with m_devices
 	list<struct hctl_ident>		m_idents;
+
+	/// lookup tables for the is_eligible_*() checks on each message
+	unordered_set<__u32>		m_device_set;
+	unordered_set<__u32>		m_host_id_set;
+	unordered_set<struct hctl_ident, hctl_ident_hash, hctl_ident_equal>
+					m_ident_set;
 };
 
 /**
@@ -45,6 +45,14 @@ Framer::Framer(__u64 begin, __u64 end, __u32 interval_length,
 	if (m_agg_data)
 		conv_aggr_data_msg_data_from_BE(m_agg_data);
 
+	// skip messages before the first frame
+	if (m_begin > m_fhdr.interval_length / 2
+	    && seek_msg_by_time(m_fp, m_filename, &m_fhdr,
+				m_begin - m_fhdr.interval_length / 2) < 0) {
+		*rc = -3;
+		return;
+	}
+
 	if (filter_types) {
 		m_type_filter = new MsgTypeFilter;
 		for (list<MsgTypes>::const_iterator i = filter_types->begin();
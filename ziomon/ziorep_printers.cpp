@@ -1257,3 +1257,90 @@ void DetailedTrafficPrinter::print_histogram_fabric_lat(FILE *fp,
 
 
 
+
+
+/* latency histograms in usecs, see stats.h for the layout */
+static const struct histlog2 d2c_lat_hist = {0, 8, BLKIOMON_D2C_BUCKETS};
+static const struct histlog2 chan_lat_hist = {0, 1, BLKIOMON_CHAN_LAT_BUCKETS};
+static const struct histlog2 fabr_lat_hist = {0, 8, BLKIOMON_FABR_LAT_BUCKETS};
+
+/* quantiles to print for each latency */
+static const double lat_quantiles[] = {0.5, 0.95, 0.99, 0.999};
+
+
+PercentileTrafficPrinter::PercentileTrafficPrinter(const ConfigReader *cfg,
+						   Collapser &col,
+						   bool csv_mode)
+: TrafficPrinter(cfg, col, csv_mode)
+{
+}
+
+
+void PercentileTrafficPrinter::print_topline(FILE *fp)
+{
+	if (m_csv) {
+		fprintf(fp, "timestamp,aggregated,");
+		print_topline_prefix1(fp);
+		fprintf(fp, ",I/O subsystem latency in us p50,I/O subsystem latency in us p95,"
+			"I/O subsystem latency in us p99,I/O subsystem latency in us p99.9,"
+			"channel latency in us p50,channel latency in us p95,"
+			"channel latency in us p99,channel latency in us p99.9,"
+			"fabric latency in us p50,fabric latency in us p95,"
+			"fabric latency in us p99,fabric latency in us p99.9\n");
+	}
+	else {
+		print_topline_prefix1(fp);
+		fprintf(fp, "|---I/O subs. lat. in us----|----channel lat. in us-----|-----fabric lat. in us-----|\n");
+		print_topline_prefix2(fp);
+		fprintf(fp, "    p50    p95    p99  p99.9    p50    p95    p99  p99.9    p50    p95    p99  p99.9\n");
+	}
+}
+
+
+void PercentileTrafficPrinter::print_percentiles(FILE *fp, const __u32 hist[],
+						const struct histlog2 *h,
+						__u64 min, __u64 max)
+{
+	for (unsigned int i = 0;
+	     i < sizeof(lat_quantiles) / sizeof(lat_quantiles[0]); ++i) {
+		print_delimiter(fp);
+		print_abbrev_num(fp, histlog2_quantile(hist, h,
+					lat_quantiles[i], min, max));
+	}
+}
+
+
+void PercentileTrafficPrinter::print_data_row(FILE *fp,
+			   const struct blkiomon_stat *blk_stat,
+			   const struct zfcpdd_dstat *zfcp_stat)
+{
+	__u32 d2c[BLKIOMON_D2C_BUCKETS];
+	__u32 chan[BLKIOMON_CHAN_LAT_BUCKETS];
+	__u32 fabr[BLKIOMON_FABR_LAT_BUCKETS];
+	struct minmax d2c_lat;
+
+	if (!blk_stat)
+		blk_stat = get_empty_blkiomon_stat();
+	if (!zfcp_stat)
+		zfcp_stat = get_empty_zfcpdd_dstat();
+
+	/* copy the histograms out of the packed structures */
+	memcpy(d2c, blk_stat->d2c_hist, sizeof(d2c));
+	memcpy(chan, zfcp_stat->chan_lat_hist, sizeof(chan));
+	memcpy(fabr, zfcp_stat->fabr_lat_hist, sizeof(fabr));
+
+	minmax_init(&d2c_lat);
+	minmax_merge(&d2c_lat, &blk_stat->d2c_r);
+	minmax_merge(&d2c_lat, &blk_stat->d2c_w);
+
+	print_percentiles(fp, d2c, &d2c_lat_hist,
+			  d2c_lat.num ? d2c_lat.min : 0,
+			  d2c_lat.num ? d2c_lat.max : 0);
+	print_percentiles(fp, chan, &chan_lat_hist,
+			  zfcp_stat->count ? zfcp_stat->chan_lat.min : 0,
+			  zfcp_stat->count ? zfcp_stat->chan_lat.max : 0);
+	print_percentiles(fp, fabr, &fabr_lat_hist,
+			  zfcp_stat->count ? zfcp_stat->fabr_lat.min : 0,
+			  zfcp_stat->count ? zfcp_stat->fabr_lat.max : 0);
+	fputc('\n', fp);
+}
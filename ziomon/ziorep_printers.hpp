@@ -218,5 +218,22 @@ private:
 				       const struct zfcpdd_dstat *stat);
 };
 
+
+class PercentileTrafficPrinter : public TrafficPrinter {
+public:
+	PercentileTrafficPrinter(const ConfigReader *cfg, Collapser &col,
+				 bool csv_mode);
+
+	virtual void print_topline(FILE *fp);
+
+private:
+	virtual void print_data_row(FILE *fp,
+			   const struct blkiomon_stat *blk_stat,
+			   const struct zfcpdd_dstat *zfcp_stat);
+	void print_percentiles(FILE *fp, const __u32 hist[],
+			       const struct histlog2 *h, __u64 min,
+			       __u64 max);
+};
+
 #endif
 
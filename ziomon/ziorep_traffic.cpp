@@ -41,14 +41,18 @@ struct options {
 	list<const char*>	mp_devices;
 	__u64			topline;
 	char*			filename;
+	list<char*>		filenames;
 	bool			print_summary;
 	bool			details;
+	bool			percentiles;
 	Aggregator		col_crit;
 	list<__u32>		chpids;
 	list<__u32>		devnos;
 	list<__u64>		wwpns;
 	list<__u64>		luns;
 	bool			csv_export;
+	bool			live;
+	bool			skip_history;
 };
 
 
@@ -61,8 +65,11 @@ static void init_opts(struct options *opts)
 	opts->filename		= NULL;
 	opts->print_summary	= false;
 	opts->details		= false;
+	opts->percentiles	= false;
 	opts->col_crit		= none;
 	opts->csv_export	= false;
+	opts->live		= false;
+	opts->skip_history	= false;
 }
 
 
@@ -70,8 +77,8 @@ static const char help_text[] =
     "Usage: ziorep_traffic [-V] [-v] [-h] [-b <begin>] [-e <end>]"
     " [-i <time>] [-s]\n"
     "                        [-c <chpid>] [-u <id>] [-t <num>] [-p <port>]\n"
-    "                        [-l <lun>] [-d <fdev> ] [-m <mdev>] [-x] [-D]\n"
-    "                        [-C a|u|p|m|A] <filename>\n\n"
+    "                        [-l <lun>] [-d <fdev> ] [-m <mdev>] [-x] [-D] [-P]\n"
+    "                        [-L] [-C a|u|p|m|A] <filename> [<filename>...]\n\n"
     "-h, --help              Print usage information and exit.\n"
     "-v, --version           Print version information and exit.\n"
     "-V, --verbose           Be verbose.\n"
@@ -98,9 +105,13 @@ static const char help_text[] =
     "-m, --mdev <mdev>       Select by multipath device,\n"
     "                        e.g. '-m 36005076303ffc1040002120'\n"
     "-D, --detailed          Print histograms instead of min/max/avg/stdev\n"
+    "-P, --percentiles       Print latency percentiles instead of\n"
+    "                        min/max/avg/stdev\n"
     "-x, --export-csv        Export data to files in CSV format.\n"
     "-t, --topline <num>     Repeat topline after every 'num' frames.\n"
-    "                        0 for no repeat (default).\n";
+    "                        0 for no repeat (default).\n"
+    "-L, --live              Follow data that is still being collected and\n"
+    "                        print each interval once it is complete.\n";
 
 
 static void print_help()
@@ -141,8 +152,10 @@ static int parse_params(int argc, char **argv, struct options *opts)
 		{ "device",          required_argument, NULL, 'd'},
 		{ "mdev",            required_argument, NULL, 'm'},
 		{ "detailed",        required_argument, NULL, 'D'},
+		{ "percentiles",     no_argument,       NULL, 'P'},
 		{ "export-csv",      no_argument,       NULL, 'x'},
 		{ "topline",         required_argument, NULL, 't'},
+		{ "live",            no_argument,       NULL, 'L'},
                 { 0,                 0,                 0,     0 }
 	};
 
@@ -152,7 +165,7 @@ static int parse_params(int argc, char **argv, struct options *opts)
 	}
 
 	assert(sizeof(long long int) == sizeof(__u64));
-	while ((c = getopt_long(argc, argv, "m:C:b:e:i:c:u:p:l:d:t:xDshvV",
+	while ((c = getopt_long(argc, argv, "m:C:b:e:i:c:u:p:l:d:t:xDPLshvV",
 				long_options, &index)) != EOF) {
 		switch (c) {
 		case 'V':
@@ -240,6 +253,9 @@ static int parse_params(int argc, char **argv, struct options *opts)
 		case 'D':
 			opts->details = true;
 			break;
+		case 'P':
+			opts->percentiles = true;
+			break;
 		case 't':
 			if (parse_topline_arg(optarg, &opts->topline))
 				return -1;
@@ -247,6 +263,9 @@ static int parse_params(int argc, char **argv, struct options *opts)
 		case 'x':
 			opts->csv_export = true;
 			break;
+		case 'L':
+			opts->live = true;
+			break;
 		case 'C':
 			rc = 0;
 			switch (*optarg) {
@@ -278,11 +297,13 @@ static int parse_params(int argc, char **argv, struct options *opts)
 			return -1;
 		}
 	}
-	if (optind == argc - 1)
-		opts->filename = argv[optind];
-	if (optind < argc - 1) {
-		fprintf(stderr, "%s: Multiple filenames"
-			" specified. Specify only a single one at a time.\n", toolname);
+	for (; optind < argc; ++optind)
+		opts->filenames.push_back(argv[optind]);
+	if (opts->filenames.size() == 1)
+		opts->filename = opts->filenames.front();
+	if (opts->live && opts->filenames.size() > 1) {
+		fprintf(stderr, "%s: Live mode supports a single"
+			" data set only.\n", toolname);
 		return -1;
 	}
 
@@ -373,10 +394,31 @@ static int check_opts(struct options *opts, ConfigReader **cfg)
 		opts->topline = 0;
 	}
 
+	if (opts->details && opts->percentiles) {
+		fprintf(stderr, "%s: Options '-D' and '-P' are mutually"
+			" exclusive.\n", toolname);
+		return -11;
+	}
+
+	if (opts->live) {
+		if (opts->print_summary || opts->end != UINT64_MAX) {
+			fprintf(stderr, "%s: Live mode cannot be combined with"
+				" '-s' or '-e'.\n", toolname);
+			return -9;
+		}
+		// start with the latest data unless told otherwise
+		opts->skip_history = (opts->begin == 0);
+	}
+
 	if (!opts->print_summary
 	    && adjust_timeframe(opts->filename, &opts->begin, &opts->end,
 			     &opts->interval))
 		rc = -8;
+	else if (opts->live && opts->interval == 0) {
+		fprintf(stderr, "%s: Live mode requires an interval"
+			" greater than 0.\n", toolname);
+		rc = -10;
+	}
 
 	return rc;
 }
@@ -493,6 +535,19 @@ static int print_report(struct options *opts, ConfigReader &cfg)
 		printer = new DetailedTrafficPrinter(&cfg, *col,
 						     opts->csv_export);
 	}
+	else if (opts->percentiles) {
+		if (opts->csv_export) {
+			fp = open_csv_output_file(opts->filename,
+						  "_traffic_percentiles.csv",
+						  &rc);
+			if (rc)
+				goto out;
+		}
+		else
+			fp = stdout;
+		printer = new PercentileTrafficPrinter(&cfg, *col,
+						       opts->csv_export);
+	}
 	else {
 		if (opts->csv_export) {
 			fp = open_csv_output_file(opts->filename,
@@ -507,7 +562,17 @@ static int print_report(struct options *opts, ConfigReader &cfg)
 						    opts->csv_export);
 	}
 
-	if ( (rc = print_report(fp, opts->begin, opts->end,
+	if (opts->live) {
+		list<struct live_report> reports;
+		struct live_report report = { fp, &type_flt, col, printer, 0 };
+
+		reports.push_back(report);
+		if (print_live_report(opts->begin, opts->interval,
+				      opts->filename, opts->topline,
+				      opts->skip_history, *dev_filt, reports))
+			rc = -3;
+	}
+	else if ( (rc = print_report(fp, opts->begin, opts->end,
 				opts->interval, opts->filename, opts->topline,
 				&type_flt, *dev_filt, *col, *printer)) < 0 )
 		rc = -3;
@@ -523,11 +588,36 @@ out:
 }
 
 
+/**
+ * Generate the report for a single data set. 'data' holds the options,
+ * which are copied since check_opts() adjusts them to the data.
+ */
+static int process_file(char *filename, void *data)
+{
+	struct options opts = *(struct options *)data;
+	ConfigReader *cfg = NULL;
+	int rc;
+
+	opts.filename = filename;
+	if ( (rc = check_opts(&opts, &cfg)) )
+		goto out;
+
+	if (opts.print_summary)
+		rc = print_summary_report(stdout, opts.filename, *cfg);
+	else
+		rc = print_report(&opts, *cfg);
+
+out:
+	delete cfg;
+
+	return rc;
+}
+
+
 int main(int argc, char **argv)
 {
 	int rc;
 	struct options opts;
-	ConfigReader *cfg = NULL;
 
 	verbose = 0;
 
@@ -537,17 +627,12 @@ int main(int argc, char **argv)
 			rc = 0;
 		goto out;
 	}
-	if ( (rc = check_opts(&opts, &cfg)) )
-		goto out;
 
-	if (opts.print_summary)
-		rc = print_summary_report(stdout, opts.filename, *cfg);
+	if (opts.filenames.size() > 1)
+		rc = run_per_file(opts.filenames, process_file, &opts);
 	else
-		rc = print_report(&opts, *cfg);
+		rc = process_file(opts.filename, &opts);
 
 out:
-	delete cfg;
-
 	return rc;
 }
-
@@ -47,8 +47,11 @@ struct options {
 	list<__u32>	chpids;
 	__u64		topline;
 	char*		filename;
+	list<char*>	filenames;
 	bool		print_summary;
 	bool		csv_export;
+	bool		live;
+	bool		skip_history;
 };
 
 
@@ -61,12 +64,15 @@ static void init_opts(struct options *opts)
 	opts->filename		= NULL;
 	opts->print_summary	= false;
 	opts->csv_export	= false;
+	opts->live		= false;
+	opts->skip_history	= false;
 }
 
 
 static const char help_text[] =
     "Usage: ziorep_utilization [-V] [-v] [-h] [-b <begin>] [-e <end>] [-i <time>]\n"
-    "                          [-x] [-s] [-c <chpid>] [-t <num>] <filename>\n\n"
+    "                          [-x] [-s] [-c <chpid>] [-t <num>] [-L]\n"
+    "                          <filename> [<filename>...]\n\n"
     "-h, --help              Print usage information and exit.\n"
     "-v, --version           Print version information and exit.\n"
     "-V, --verbose           Be verbose.\n"
@@ -87,7 +93,9 @@ static const char help_text[] =
     "                        E.g. '-c 32a'\n"
     "-x, --export-csv        Export data to files in CSV format.\n"
     "-t, --topline <num>     Repeat topline after every 'num' frames.\n"
-    "                        0 for no repeat (default).\n";
+    "                        0 for no repeat (default).\n"
+    "-L, --live              Follow data that is still being collected and\n"
+    "                        print each interval once it is complete.\n";
 
 
 static void print_help()
@@ -121,6 +129,7 @@ static int parse_params(int argc, char **argv, struct options *opts)
 		{ "chpid",           required_argument, NULL, 'c'},
 		{ "export-csv",      no_argument,       NULL, 'x'},
 		{ "topline",         required_argument, NULL, 't'},
+		{ "live",            no_argument,       NULL, 'L'},
                 { 0,                 0,                 0,     0 }
 	};
 
@@ -130,7 +139,7 @@ static int parse_params(int argc, char **argv, struct options *opts)
 	}
 
 	assert(sizeof(long long int) == sizeof(__u64));
-	while ((c = getopt_long(argc, argv, "b:e:i:c:t:xshvV",
+	while ((c = getopt_long(argc, argv, "b:e:i:c:t:xLshvV",
 				long_options, &index)) != EOF) {
 		switch (c) {
 		case 'V':
@@ -179,6 +188,9 @@ static int parse_params(int argc, char **argv, struct options *opts)
 		case 'x':
 			opts->csv_export = true;
 			break;
+		case 'L':
+			opts->live = true;
+			break;
 		case 't':
 			if (parse_topline_arg(optarg, &opts->topline))
 				return -1;
@@ -189,11 +201,13 @@ static int parse_params(int argc, char **argv, struct options *opts)
 			return -1;
 		}
 	}
-	if (optind == argc - 1)
-		opts->filename = argv[optind];
-	if (optind < argc - 1) {
-		fprintf(stderr, "%s: Multiple filenames"
-			" specified. Specify only a single one at a time.\n", toolname);
+	for (; optind < argc; ++optind)
+		opts->filenames.push_back(argv[optind]);
+	if (opts->filenames.size() == 1)
+		opts->filename = opts->filenames.front();
+	if (opts->live && opts->filenames.size() > 1) {
+		fprintf(stderr, "%s: Live mode supports a single"
+			" data set only.\n", toolname);
 		return -1;
 	}
 
@@ -253,10 +267,69 @@ static int check_opts(struct options *opts, ConfigReader **cfg)
 		opts->topline = 0;
 	}
 
+	if (opts->live) {
+		if (opts->print_summary || opts->end != UINT64_MAX) {
+			fprintf(stderr, "%s: Live mode cannot be combined with"
+				" '-s' or '-e'.\n", toolname);
+			return -9;
+		}
+		// start with the latest data unless told otherwise
+		opts->skip_history = (opts->begin == 0);
+	}
+
 	if (!opts->print_summary
 		&& adjust_timeframe(opts->filename, &opts->begin, &opts->end,
 			     &opts->interval))
 		rc = -3;
+	else if (opts->live && opts->interval == 0) {
+		fprintf(stderr, "%s: Live mode requires an interval"
+			" greater than 0.\n", toolname);
+		rc = -10;
+	}
+
+	return rc;
+}
+
+
+/**
+ * Print the physical and the virtual adapter reports for each new frame.
+ */
+static int print_live_reports(struct options *opts, DeviceFilter &dev_filt,
+			      Collapser &phys_col, Collapser &virt_col,
+			      Printer &phys_prnt, Printer &virt_prnt,
+			      list<MsgTypes> &type_flt)
+{
+	list<struct live_report> reports;
+	struct live_report phys = { stdout, &type_flt, &phys_col,
+				    &phys_prnt, 0 };
+	struct live_report virt = { stdout, NULL, &virt_col, &virt_prnt, 0 };
+	int rc;
+
+	if (opts->csv_export) {
+		phys.fp = open_csv_output_file(opts->filename,
+					       "_util_phys_adpt.csv", &rc);
+		if (!phys.fp)
+			return -1;
+		virt.fp = open_csv_output_file(opts->filename,
+					       "_util_virt_adpt.csv", &rc);
+		if (!virt.fp) {
+			fclose(phys.fp);
+			return -1;
+		}
+	}
+	reports.push_back(phys);
+	reports.push_back(virt);
+
+	rc = print_live_report(opts->begin, opts->interval, opts->filename,
+			       opts->topline, opts->skip_history, dev_filt,
+			       reports);
+	if (rc)
+		rc = -3;
+
+	if (opts->csv_export) {
+		fclose(phys.fp);
+		fclose(virt.fp);
+	}
 
 	return rc;
 }
@@ -297,6 +370,12 @@ static int print_reports(struct options *opts, ConfigReader &cfg)
 
 	type_flt.push_back(utilization);
 
+	if (opts->live) {
+		rc = print_live_reports(opts, dev_filt, noop_col, *col,
+					physPrnt, virtPrnt, type_flt);
+		goto out;
+	}
+
 	if (opts->csv_export) {
 		fp = open_csv_output_file(opts->filename,
 					  "_util_phys_adpt.csv", &rc);
@@ -346,20 +425,17 @@ out:
 }
 
 
-int main(int argc, char **argv)
+/**
+ * Generate the report for a single data set. 'data' holds the options,
+ * which are copied since check_opts() adjusts them to the data.
+ */
+static int process_file(char *filename, void *data)
 {
-	int rc;
-	struct options opts;
+	struct options opts = *(struct options *)data;
 	ConfigReader *cfg = NULL;
+	int rc;
 
-	verbose = 0;
-
-	init_opts(&opts);
-	if ( (rc = parse_params(argc, argv, &opts)) ) {
-		if (rc == 1)
-			rc = 0;
-		goto out;
-	}
+	opts.filename = filename;
 	if ( (rc = check_opts(&opts, &cfg)) )
 		goto out;
 
@@ -375,4 +451,25 @@ out:
 }
 
 
+int main(int argc, char **argv)
+{
+	int rc;
+	struct options opts;
 
+	verbose = 0;
+
+	init_opts(&opts);
+	if ( (rc = parse_params(argc, argv, &opts)) ) {
+		if (rc == 1)
+			rc = 0;
+		goto out;
+	}
+
+	if (opts.filenames.size() > 1)
+		rc = run_per_file(opts.filenames, process_file, &opts);
+	else
+		rc = process_file(opts.filename, &opts);
+
+out:
+	return rc;
+}
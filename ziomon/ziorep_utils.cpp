@@ -14,6 +14,11 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "ziorep_utils.hpp"
 #include "ziorep_cfgreader.hpp"
@@ -335,15 +340,19 @@ out:
 }
 
 
-int print_report(FILE *fp, __u64 begin, __u64 end, __u32 interval,
-				char *filename, __u64 topline,
-				list<MsgTypes> *filter_types,
-				DeviceFilter &dev_filter, Collapser &col,
-				Printer &printer)
+/**
+ * Print all frames from 'begin' to 'end'. 'frames_printed' holds the number
+ * of frames printed so far, which determines when to repeat the topline.
+ * Set 'force_topline' to print the topline before the first frame anyway.
+ * Returns <0 in case of error and 0 otherwise.
+ */
+static int print_frames(FILE *fp, __u64 begin, __u64 end, __u32 interval,
+			char *filename, __u64 topline,
+			list<MsgTypes> *filter_types,
+			DeviceFilter &dev_filter, Collapser &col,
+			Printer &printer, int *frames_printed,
+			bool force_topline)
 {
-	int frames_printed = 0;
-	bool first_time = true;
-	time_t t;
 	int rc = 0;
 	Frameset frameset(&col);
 	Framer framer(begin, end, interval,
@@ -353,6 +362,32 @@ int print_report(FILE *fp, __u64 begin, __u64 end, __u32 interval,
 	if (rc)
 		return -1;
 
+	while ( (rc = framer.get_next_frameset(frameset, true)) == 0 ) {
+		vverbose_msg("printing frameset %d\n", *frames_printed);
+		if (force_topline || *frames_printed == 0
+		    || (topline && *frames_printed % topline == 0)) {
+			force_topline = false;
+			printer.print_topline(fp);
+		}
+		if (printer.print_frame(fp, frameset, dev_filter) < 0)
+			return -1;
+		++(*frames_printed);
+	}
+
+	return (rc > 0 ? 0 : rc);
+}
+
+
+int print_report(FILE *fp, __u64 begin, __u64 end, __u32 interval,
+				char *filename, __u64 topline,
+				list<MsgTypes> *filter_types,
+				DeviceFilter &dev_filter, Collapser &col,
+				Printer &printer)
+{
+	int frames_printed = 0;
+	time_t t;
+	int rc;
+
 	if (topline && printer.print_csv()) {
 		fprintf(stderr, "%s: Warning: Cannot use '-t' with CSV mode,"
 			" ignoring\n", toolname);
@@ -368,19 +403,102 @@ int print_report(FILE *fp, __u64 begin, __u64 end, __u32 interval,
 	verbose_msg("    topline  : %llu\n", (long long unsigned int)topline);
 	verbose_msg("    csv mode : %d\n", printer.print_csv());
 
-	while ( (rc = framer.get_next_frameset(frameset, true)) == 0 ) {
-		vverbose_msg("printing frameset %d\n", frames_printed);
-		if (first_time || (topline && frames_printed % topline == 0)) {
-			first_time = false;
-			printer.print_topline(fp);
+	rc = print_frames(fp, begin, end, interval, filename, topline,
+			  filter_types, dev_filter, col, printer,
+			  &frames_printed, false);
+	if (rc < 0)
+		return rc;
+
+	return frames_printed;
+}
+
+
+static volatile sig_atomic_t live_running;
+
+static void live_handler(int sig)
+{
+	verbose_msg("interrupted by signal %u\n", sig);
+	live_running = 0;
+}
+
+
+int print_live_report(__u64 begin, __u32 interval, char *filename,
+		      __u64 topline, bool skip_history,
+		      DeviceFilter &dev_filter, list<struct live_report> &reports)
+{
+	struct file_header f_hdr;
+	struct aggr_data *agg;
+	FILE *fp;
+	__u64 num_frames, end;
+	bool started = false;
+	int rc = 0;
+
+	assert(interval > 0);
+	for (list<struct live_report>::iterator i = reports.begin();
+	      i != reports.end(); ++i) {
+		if (topline && i->printer->print_csv())
+			topline = 0;
+		i->frames_printed = 0;
+	}
+
+	live_running = 1;
+	signal(SIGINT, live_handler);
+	signal(SIGTERM, live_handler);
+
+	while (live_running) {
+		// reread the header to find out how far ziomon_mgr got
+		if (open_data_files(&fp, filename, &f_hdr, &agg)) {
+			rc = -1;
+			break;
 		}
-		if (printer.print_frame(fp, frameset, dev_filter) < 0)
-			return -1;
-		++frames_printed;
+		close_data_files(fp);
+		if (agg) {
+			// data that was moved to the .agg file is gone for good
+			if (begin <= agg->end_time && started)
+				fprintf(stderr, "%s: Warning: Data up to %s"
+					" was aggregated before it could be"
+					" reported, skipping.\n", toolname,
+					print_time_formatted(agg->end_time));
+			while (begin <= agg->end_time)
+				begin += interval;
+			discard_aggr_data_struct(agg);
+			free(agg);
+		}
+
+		/* messages with the latest timestamp might still be on their
+		   way, so a frame is complete once a later sample showed up */
+		if (f_hdr.end_time >= begin + interval) {
+			num_frames = (f_hdr.end_time - begin) / interval;
+			if (skip_history) {
+				begin += (num_frames - 1) * interval;
+				num_frames = 1;
+			}
+			end = begin + num_frames * interval
+				- f_hdr.interval_length;
+			verbose_msg("live report: %llu new frame(s)\n",
+				    (long long unsigned int)num_frames);
+			for (list<struct live_report>::iterator i =
+			      reports.begin(); i != reports.end(); ++i) {
+				rc = print_frames(i->fp, begin, end, interval,
+						  filename, topline,
+						  i->filter_types, dev_filter,
+						  *i->col, *i->printer,
+						  &i->frames_printed,
+						  reports.size() > 1);
+				if (rc < 0)
+					goto out;
+				fflush(i->fp);
+			}
+			begin = end + f_hdr.interval_length;
+		}
+		skip_history = false;
+		started = true;
+		sleep(f_hdr.interval_length);
 	}
 
-	if (rc > 0)
-		return frames_printed;
+out:
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
 
 	return rc;
 }
@@ -553,5 +671,130 @@ FILE* open_csv_output_file(const char *filename, const char *extension,
 }
 
 
+struct file_run {
+	char	*filename;
+	FILE	*out;
+	pid_t	 pid;
+	int	 rc;
+};
+
+
+static int start_file_run(struct file_run *run, int (*fn)(char *, void *),
+			  void *data)
+{
+	int rc;
+
+	run->out = tmpfile();
+	if (!run->out) {
+		fprintf(stderr, "%s: Could not create temporary file: %s\n",
+			toolname, strerror(errno));
+		return -1;
+	}
+	fflush(stdout);
+	run->pid = fork();
+	if (run->pid < 0) {
+		fprintf(stderr, "%s: Could not create process: %s\n",
+			toolname, strerror(errno));
+		return -1;
+	}
+	if (run->pid == 0) {
+		if (dup2(fileno(run->out), STDOUT_FILENO) < 0)
+			_exit(EXIT_FAILURE);
+		rc = fn(run->filename, data);
+		fflush(stdout);
+		_exit(rc ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+	verbose_msg("processing %s in process %d\n", run->filename, run->pid);
+
+	return 0;
+}
+
+
+static void print_file_run(FILE *fp, struct file_run *run, bool first)
+{
+	char buf[4096];
+	size_t len;
+
+	fseek(run->out, 0, SEEK_END);
+	if (ftell(run->out) > 0) {
+		if (!first)
+			fputc('\n', fp);
+		fprintf(fp, "%s:\n", run->filename);
+	}
+	rewind(run->out);
+	while ((len = fread(buf, 1, sizeof(buf), run->out)) > 0)
+		fwrite(buf, 1, len, fp);
+	fclose(run->out);
+	run->out = NULL;
+}
+
 
+int run_per_file(list<char *> &filenames, int (*fn)(char *, void *),
+		 void *data)
+{
+	vector<struct file_run> runs(filenames.size());
+	unsigned int next = 0, printed = 0, j;
+	long max_running = sysconf(_SC_NPROCESSORS_ONLN);
+	long running = 0;
+	int rc = 0, status;
+	pid_t pid;
+
+	if (max_running < 1)
+		max_running = 1;
+	j = 0;
+	for (list<char *>::const_iterator i = filenames.begin();
+	      i != filenames.end(); ++i, ++j) {
+		runs[j].filename = *i;
+		runs[j].out = NULL;
+		runs[j].pid = 0;
+		runs[j].rc = 1;
+	}
 
+	while (printed < runs.size()) {
+		while (rc == 0 && running < max_running && next < runs.size()) {
+			if (start_file_run(&runs[next], fn, data)) {
+				runs[next].rc = -1;
+				rc = -1;
+			}
+			else
+				running++;
+			next++;
+		}
+		/* print all finished runs that are next in order */
+		while (printed < next && runs[printed].rc <= 0) {
+			if (runs[printed].pid > 0)
+				print_file_run(stdout, &runs[printed],
+					       printed == 0);
+			else if (runs[printed].out)
+				fclose(runs[printed].out);
+			printed++;
+		}
+		if (running == 0)
+			break;
+		pid = wait(&status);
+		if (pid < 0) {
+			fprintf(stderr, "%s: Could not wait for process: %s\n",
+				toolname, strerror(errno));
+			return -1;
+		}
+		for (j = 0; j < next; ++j) {
+			if (runs[j].pid != pid)
+				continue;
+			running--;
+			if (WIFEXITED(status)
+			    && WEXITSTATUS(status) == EXIT_SUCCESS)
+				runs[j].rc = 0;
+			else {
+				fprintf(stderr, "%s: Processing of %s failed\n",
+					toolname, runs[j].filename);
+				runs[j].rc = -1;
+			}
+		}
+	}
+	for (j = 0; j < runs.size(); ++j) {
+		if (runs[j].rc)
+			rc = -1;
+	}
+
+	return rc;
+}
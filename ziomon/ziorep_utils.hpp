@@ -66,6 +66,28 @@ int print_report(FILE *fp, __u64 begin, __u64 end,
 				DeviceFilter &dev_filter, Collapser &col,
 				Printer &printer);
 
+/**
+ * A report printed by print_live_report(). */
+struct live_report {
+	FILE		*fp;
+	list<MsgTypes>	*filter_types;
+	Collapser	*col;
+	Printer		*printer;
+	int		 frames_printed;
+};
+
+/**
+ * Follow a data set that is still being written by ziomon_mgr and print
+ * each frame of the reports in 'reports' as soon as it is complete, until
+ * interrupted by SIGINT or SIGTERM. Starts at 'begin', or at the latest
+ * complete frame if 'skip_history' is set.
+ * Returns <0 in case of error and 0 otherwise.
+ */
+int print_live_report(__u64 begin, __u32 interval, char *filename,
+		      __u64 topline, bool skip_history,
+		      DeviceFilter &dev_filter,
+		      list<struct live_report> &reports);
+
 /**
  * Print summary of available data.
  * 'fp' is the file to write all output to, 'filename' the standard
@@ -83,6 +105,16 @@ int parse_topline_arg(char *str, __u64 *arg);
 FILE* open_csv_output_file(const char *filename, const char *extension,
 			   int *rc);
 
+/**
+ * Run 'fn' for each of the files in 'filenames' in a separate process,
+ * with as many processes in parallel as there are online CPUs. Output
+ * written to stdout is collected per file and printed in the order of
+ * 'filenames', each preceded by the name of the file.
+ * Returns 0 if 'fn' succeeded for all files, <0 otherwise.
+ */
+int run_per_file(list<char *> &filenames, int (*fn)(char *, void *),
+		 void *data);
+
 /**
  * accessors for internal representation of device and subchannel bus-IDs
  * packed:   takes channel subsystem, subchannel set, device number/subchannel
@@ -33,10 +33,13 @@ typedef unsigned long sector_t;
  *
  * block_count = (tr_count - 1) * 12 + 1
  *
- * Therefore: tr_count >= (block_count + 11) / 12
+ * Therefore: tr_count >= (block_count - 1 + 11) / 12 + 1
+ *
+ * The I/O size is a multiple of the track size, so that full tracks are
+ * written once the first I/O has reached a track boundary.
  */
-#define ECKD_BLK_PER_IO_TRK	128 /* 128 * 4 KB = up to 512 KB per I/O */
-#define ECKD_CCW_MAX_COUNT_TRK	12  /* (128 + 11) / 12 = 12 track I/O CCWs */
+#define ECKD_BLK_PER_IO_TRK	132 /* 11 tracks = up to 528 KB per I/O */
+#define ECKD_CCW_MAX_COUNT_TRK	12  /* (131 + 11) / 12 + 1 = 12 CCWs */
 
 /*
  * For record I/O we write one 4 KB block with one write CCW
@@ -464,6 +467,9 @@ unsigned long write_dump_segment(unsigned long blk,
 		/* Remaining blocks to write */
 		blk_count = m2b(segm->len) - (blk - start_blk);
 		blk_count = MIN(blk_count, eckd_blk_max);
+		/* End on a track boundary to write full tracks afterwards */
+		if (track_io && blk_count > device.bpt)
+			blk_count -= (blk + blk_count) % device.bpt;
 		writeblock(blk, addr, blk_count, zero_page);
 		progress_print(addr);
 		blk += blk_count;
@@ -121,6 +121,9 @@ blocknum_t disk_compact_blocklist(disk_blockptr_t* list, blocknum_t count,
 blocknum_t disk_get_blocklist_from_file(const char* filename,
 					disk_blockptr_t** blocklist,
 					struct disk_info* pinfo);
+blocknum_t disk_get_blocklist_from_range(int fd, off_t offset, size_t size,
+					 disk_blockptr_t** blocklist,
+					 struct disk_info* info);
 int disk_check_subchannel_set(int devno, dev_t device, char* dev_name);
 void disk_print_geo(struct disk_info *data);
 
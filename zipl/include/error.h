@@ -12,13 +12,20 @@
 #ifndef ERROR_H
 #define ERROR_H
 
+#include <stddef.h>
+
 #include "zipl.h"
 
+#define ERROR_STRING_SIZE	1024
+/* Size of the message returned by error_get() */
+#define ERROR_MESSAGE_SIZE	(2 * ERROR_STRING_SIZE + 2)
+
 
 void error_reason(const char* fmt, ...);
 void error_text(const char* fmt, ...);
 void error_clear_reason(void);
 void error_clear_text(void);
+void error_get(char* buffer, size_t size);
 void error_print(void);
 
 #endif /* not ERROR_H */
@@ -120,6 +120,7 @@ struct job_data {
 	int noninteractive;
 	int verbose;
 	int add_files;
+	int incremental;
 	int dry_run;
 	int command_line;
 	int is_secure;
@@ -28,6 +28,7 @@
 
 #define BOOTMAP_FILENAME		"bootmap"
 #define BOOTMAP_TEMPLATE_FILENAME	"bootmap_temp.XXXXXX"
+#define BOOTMAP_INDEX_FILENAME		"bootmap.index"
 
 #define DEFAULTBOOT_SECTION		"defaultboot"
 
@@ -38,6 +38,25 @@ static const char header_text[] = "zSeries bootmap file\n"
 /* Pointer to dedicated empty block in bootmap. */
 disk_blockptr_t empty_block;
 
+/* Header of the bootmap index file */
+#define BOOTMAP_INDEX_MAGIC	"zipl bootmap index 1"
+
+/* Component data stored in the bootmap file. In incremental mode the data
+ * of a component that is already contained in the bootmap file is found by
+ * its size and content hash and is not written again. */
+struct component_cache_entry {
+	off_t offset;
+	size_t size;
+	uint64_t hash;
+	int used;
+};
+
+static struct {
+	struct component_cache_entry *entry;
+	int num;
+	int enabled;
+} component_cache;
+
 
 /* Get size of a bootmap block pointer for disk with given INFO. */
 static int
@@ -141,55 +160,119 @@ check_secure_boot_support(void)
 }
 
 
+/* Return non-zero if block pointers A and B refer to the same block. */
+static int
+blockptr_equal(disk_blockptr_t *a, disk_blockptr_t *b, struct disk_info *info)
+{
+	uint8_t a_data[sizeof(struct linear_blockptr)];
+	uint8_t b_data[sizeof(struct linear_blockptr)];
+
+	memset(a_data, 0, sizeof(a_data));
+	memset(b_data, 0, sizeof(b_data));
+	bootmap_store_blockptr(a_data, a, info);
+	bootmap_store_blockptr(b_data, b, info);
+	return memcmp(a_data, b_data, sizeof(a_data)) == 0;
+}
+
+
 /* Write COUNT elements of the blocklist specified by LIST as a linked list
  * of segment table blocks to the file identified by file descriptor FD. Upon
  * success, return 0 and set SECTION_POINTER to point to the first block in
- * the resulting segment table. Return non-zero otherwise. */
+ * the resulting segment table. Return non-zero otherwise.
+ *
+ * All tables are stored in one contiguous range: the range is reserved and
+ * mapped with a single write, then filled with the linked tables and
+ * rewritten in place. */
 int
 add_segment_table(int fd, disk_blockptr_t* list, blocknum_t count,
 		  disk_blockptr_t* segment_pointer,
 		  struct disk_info* info)
 {
+	disk_blockptr_t *tables, *check;
 	disk_blockptr_t next;
-	void* buffer;
 	blocknum_t max_offset;
 	blocknum_t offset;
+	blocknum_t table_count;
+	blocknum_t table;
+	void* buffer;
+	void* block;
+	size_t size;
+	off_t pos;
 	int pointer_size;
 	int rc;
 
-	/* Allocate block memory */
-	buffer = misc_malloc(info->phy_block_size);
-	if (buffer == NULL)
-		return -1;
 	memset(&next, 0, sizeof(disk_blockptr_t));
-	memset(buffer, 0, info->phy_block_size);
+	if (count == 0) {
+		*segment_pointer = next;
+		return 0;
+	}
 	pointer_size = get_blockptr_size(info);
 	max_offset = info->phy_block_size / pointer_size - 1;
-	/* Fill segment tables, starting from the last one */
+	table_count = (count + max_offset - 1) / max_offset;
+	size = table_count * info->phy_block_size;
+	/* Allocate table memory */
+	buffer = misc_malloc(size);
+	if (buffer == NULL)
+		return -1;
+	memset(buffer, 0, size);
+	/* Reserve blocks for all tables */
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos == -1) {
+		error_text(strerror(errno));
+		free(buffer);
+		return -1;
+	}
+	pos = ALIGN(pos, info->phy_block_size);
+	if (disk_write_block_buffer(fd, 0, buffer, size, &tables,
+				    info) != table_count) {
+		free(buffer);
+		return -1;
+	}
+	/* Fill segment tables, starting from the last one which is stored
+	 * in the first block */
+	table = 0;
+	block = buffer;
 	for (offset = (count - 1) % max_offset; count > 0; count--, offset--) {
 		/* Replace holes with empty block if necessary*/
 		if (disk_is_zero_block(&list[count-1], info))
 			bootmap_store_blockptr(
-					VOID_ADD(buffer, offset * pointer_size),
+					VOID_ADD(block, offset * pointer_size),
 					&empty_block, info);
 		else
 			bootmap_store_blockptr(
-					VOID_ADD(buffer, offset * pointer_size),
+					VOID_ADD(block, offset * pointer_size),
 					&list[count-1], info);
 		if (offset > 0)
 			continue;
 		/* Finalize segment table */
 		offset = max_offset;
-		bootmap_store_blockptr(VOID_ADD(buffer, offset * pointer_size),
+		bootmap_store_blockptr(VOID_ADD(block, offset * pointer_size),
 				       &next, info);
-		rc = disk_write_block_aligned(fd, buffer, info->phy_block_size,
-					      &next, info);
-		if (rc) {
-			free(buffer);
-			return rc;
-		}
+		next = tables[table++];
+		block = VOID_ADD(block, info->phy_block_size);
 	}
+	/* Write all tables at once */
+	rc = misc_pwrite(fd, buffer, size, pos);
 	free(buffer);
+	if (rc) {
+		free(tables);
+		return rc;
+	}
+	/* Make sure that the rewrite did not move the reserved blocks */
+	if (disk_get_blocklist_from_range(fd, pos, size, &check,
+					  info) != table_count) {
+		free(tables);
+		return -1;
+	}
+	for (table = 0; table < table_count && rc == 0; table++)
+		rc = !blockptr_equal(&tables[table], &check[table], info);
+	free(check);
+	free(tables);
+	if (rc) {
+		error_reason("Segment table blocks moved while rewriting "
+			     "bootmap file");
+		return -1;
+	}
 	*segment_pointer = next;
 	return 0;
 }
@@ -290,6 +373,206 @@ struct component_loc {
 	size_t size;
 };
 
+/* Return FNV-1a hash of SIZE bytes at BUFFER. */
+static uint64_t
+component_hash(const void *buffer, size_t size)
+{
+	const unsigned char *data = buffer;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+
+static struct component_cache_entry *
+component_cache_find(size_t size, uint64_t hash)
+{
+	int i;
+
+	for (i = 0; i < component_cache.num; i++) {
+		if (component_cache.entry[i].size == size &&
+		    component_cache.entry[i].hash == hash)
+			return &component_cache.entry[i];
+	}
+	return NULL;
+}
+
+
+static int
+component_cache_add(off_t offset, size_t size, uint64_t hash, int used)
+{
+	struct component_cache_entry *entry;
+
+	entry = realloc(component_cache.entry, sizeof(*entry) *
+			(component_cache.num + 1));
+	if (entry == NULL) {
+		error_reason("Could not allocate memory");
+		return -1;
+	}
+	component_cache.entry = entry;
+	entry = &component_cache.entry[component_cache.num++];
+	entry->offset = offset;
+	entry->size = size;
+	entry->hash = hash;
+	entry->used = used;
+	return 0;
+}
+
+
+static void
+component_cache_free(void)
+{
+	free(component_cache.entry);
+	memset(&component_cache, 0, sizeof(component_cache));
+}
+
+
+/* Read the index of the bootmap file MAPNAME from IDXNAME. Return 0 if the
+ * index describes the current contents of the bootmap file, non-zero
+ * otherwise. */
+static int
+component_cache_load(const char *mapname, const char *idxname)
+{
+	unsigned long long dev, ino, offset, hash;
+	long long size, mtime_sec, mtime_nsec;
+	char magic[sizeof(BOOTMAP_INDEX_MAGIC)];
+	unsigned long long live = 0;
+	struct stat st;
+	size_t data_size;
+	FILE *fp;
+	int rc = -1;
+
+	if (stat(mapname, &st))
+		return -1;
+	fp = fopen(idxname, "r");
+	if (fp == NULL)
+		return -1;
+	if (fgets(magic, sizeof(magic), fp) == NULL ||
+	    strcmp(magic, BOOTMAP_INDEX_MAGIC) != 0)
+		goto out;
+	if (fscanf(fp, "%llu %llu %lld %lld %lld", &dev, &ino, &size,
+		   &mtime_sec, &mtime_nsec) != 5)
+		goto out;
+	/* The bootmap file must not have been changed since the index was
+	 * written */
+	if (dev != (unsigned long long) st.st_dev ||
+	    ino != (unsigned long long) st.st_ino ||
+	    size != (long long) st.st_size ||
+	    mtime_sec != (long long) st.st_mtim.tv_sec ||
+	    mtime_nsec != (long long) st.st_mtim.tv_nsec)
+		goto out;
+	while (fscanf(fp, "%llu %zu %llx", &offset, &data_size, &hash) == 3) {
+		if (component_cache_add(offset, data_size, hash, 0))
+			goto out;
+		live += data_size;
+	}
+	if (!feof(fp))
+		goto out;
+	/* Data that is no longer used is never removed from the bootmap
+	 * file. Build a new one if it makes up most of the file. */
+	if ((unsigned long long) st.st_size / 2 > live)
+		goto out;
+	rc = 0;
+out:
+	fclose(fp);
+	if (rc)
+		component_cache.num = 0;
+	return rc;
+}
+
+
+/* Write the index of the bootmap file FD to IDXNAME. Only component data
+ * that is used by the new bootmap is recorded. */
+static int
+component_cache_save(int fd, const char *idxname)
+{
+	struct component_cache_entry *entry;
+	char *tmpname;
+	struct stat st;
+	FILE *fp;
+	int i, rc;
+
+	if (fstat(fd, &st)) {
+		error_reason(strerror(errno));
+		return -1;
+	}
+	if (misc_asprintf(&tmpname, "%s.tmp", idxname))
+		return -1;
+	fp = fopen(tmpname, "w");
+	if (fp == NULL) {
+		error_reason(strerror(errno));
+		free(tmpname);
+		return -1;
+	}
+	fprintf(fp, "%s\n%llu %llu %lld %lld %lld\n", BOOTMAP_INDEX_MAGIC,
+		(unsigned long long) st.st_dev, (unsigned long long) st.st_ino,
+		(long long) st.st_size, (long long) st.st_mtim.tv_sec,
+		(long long) st.st_mtim.tv_nsec);
+	for (i = 0; i < component_cache.num; i++) {
+		entry = &component_cache.entry[i];
+		if (!entry->used)
+			continue;
+		fprintf(fp, "%llu %zu %016llx\n",
+			(unsigned long long) entry->offset, entry->size,
+			(unsigned long long) entry->hash);
+	}
+	rc = ferror(fp);
+	if (fclose(fp) || rc || rename(tmpname, idxname)) {
+		error_reason(strerror(errno));
+		remove(tmpname);
+		free(tmpname);
+		return -1;
+	}
+	free(tmpname);
+	return 0;
+}
+
+
+/* Write SIZE bytes at BUFFER to the bootmap file FD unless the same data
+ * is already stored in it. Return the number of blocks and set BLOCKLIST
+ * like disk_write_block_buffer(). */
+static blocknum_t
+write_component_data(int fd, const void *buffer, size_t size,
+		     disk_blockptr_t **blocklist, struct disk_info *info)
+{
+	struct component_cache_entry *entry;
+	blocknum_t count;
+	uint64_t hash;
+	off_t offset;
+
+	if (!component_cache.enabled)
+		return disk_write_block_buffer(fd, 0, buffer, size, blocklist,
+					       info);
+	hash = component_hash(buffer, size);
+	entry = component_cache_find(size, hash);
+	if (entry != NULL) {
+		entry->used = 1;
+		return disk_get_blocklist_from_range(fd, entry->offset, size,
+						     blocklist, info);
+	}
+	offset = lseek(fd, 0, SEEK_CUR);
+	if (offset == -1) {
+		error_reason(strerror(errno));
+		return 0;
+	}
+	/* disk_write_block_buffer() starts at the next block boundary */
+	offset = ALIGN(offset, info->phy_block_size);
+	count = disk_write_block_buffer(fd, 0, buffer, size, blocklist, info);
+	if (count == 0)
+		return 0;
+	if (component_cache_add(offset, size, hash, 1)) {
+		free(*blocklist);
+		return 0;
+	}
+	return count;
+}
+
+
 static int
 add_component_file(int fd, const char* filename, address_t load_address,
 		   size_t trailer, void *component, int add_files,
@@ -314,8 +597,7 @@ add_component_file(int fd, const char* filename, address_t load_address,
 		}
 		size -= trailer;
 		/* Write buffer */
-		count = disk_write_block_buffer(fd, 0, buffer,
-						size, &list, info);
+		count = write_component_data(fd, buffer, size, &list, info);
 		free(buffer);
 		if (count == 0) {
 			error_text("Could not write to bootmap file");
@@ -1088,20 +1370,57 @@ write_empty_block(int fd, disk_blockptr_t* block, struct disk_info* info)
 }
 
 
+/* Open the existing bootmap file for an incremental update. Return the file
+ * descriptor positioned at the end of the file and set FILENAME and
+ * OLD_SIZE, or -1 if a new bootmap file must be built. */
+static int
+bootmap_open_incremental(struct job_data *job, const char *idxname,
+			 char **filename, off_t *old_size)
+{
+	char *mapname;
+	int fd;
+
+	mapname = misc_make_path(job->target.bootmap_dir, BOOTMAP_FILENAME);
+	if (mapname == NULL)
+		return -1;
+	if (component_cache_load(mapname, idxname)) {
+		free(mapname);
+		return -1;
+	}
+	fd = open(mapname, O_RDWR);
+	if (fd == -1) {
+		component_cache.num = 0;
+		free(mapname);
+		return -1;
+	}
+	*old_size = lseek(fd, 0, SEEK_END);
+	if (*old_size == -1) {
+		component_cache.num = 0;
+		close(fd);
+		free(mapname);
+		return -1;
+	}
+	*filename = mapname;
+	return fd;
+}
+
+
 int
 bootmap_create(struct job_data *job, disk_blockptr_t *program_table,
 	       disk_blockptr_t *scsi_dump_sb_blockptr,
 	       disk_blockptr_t **stage1b_list, blocknum_t *stage1b_count,
 	       char **new_device, struct disk_info **new_info)
 {
+	char *device, *filename, *mapname, *idxname = NULL;
 	struct scsi_dump_sb scsi_sb;
-	char *device, *filename, *mapname;
 	disk_blockptr_t *stage2_list;
 	blocknum_t stage2_count;
 	struct disk_info *info;
+	int fd = -1, in_place = 0;
+	off_t old_size = 0;
 	size_t stage2_size;
 	void *stage2_data;
-	int fd, rc, part_ext;
+	int rc, part_ext;
 
 	/* Get full path of bootmap file */
 	if (job->id == job_dump_partition && !dry_run) {
@@ -1115,16 +1434,30 @@ bootmap_create(struct job_data *job, disk_blockptr_t *program_table,
 		}
 
 	} else {
-		filename = misc_make_path(job->target.bootmap_dir,
-					  BOOTMAP_TEMPLATE_FILENAME);
-		if (filename == NULL)
-			return -1;
-		/* Create temporary bootmap file */
-		fd = mkstemp(filename);
-		if (fd == -1) {
-			error_reason(strerror(errno));
-			error_text("Could not create file '%s':", filename);
-			goto out_free_filename;
+		/* Only files added to the bootmap file can be reused */
+		if (job->incremental && job->add_files && !dry_run) {
+			idxname = misc_make_path(job->target.bootmap_dir,
+						 BOOTMAP_INDEX_FILENAME);
+			if (idxname == NULL)
+				return -1;
+			component_cache.enabled = 1;
+			fd = bootmap_open_incremental(job, idxname, &filename,
+						      &old_size);
+			in_place = (fd != -1);
+		}
+		if (!in_place) {
+			filename = misc_make_path(job->target.bootmap_dir,
+						  BOOTMAP_TEMPLATE_FILENAME);
+			if (filename == NULL)
+				goto out_free_cache;
+			/* Create temporary bootmap file */
+			fd = mkstemp(filename);
+			if (fd == -1) {
+				error_reason(strerror(errno));
+				error_text("Could not create file '%s':",
+					   filename);
+				goto out_free_filename;
+			}
 		}
 	}
 	/* Retrieve target device information. Note that we have to
@@ -1177,6 +1510,9 @@ bootmap_create(struct job_data *job, disk_blockptr_t *program_table,
 		       filename,
 		       job->add_files ? " (files will be added to partition)"
 		       : "");
+	} else if (in_place) {
+		printf("Updating bootmap in '%s' (changed files will be added "
+		       "to bootmap file)\n", job->target.bootmap_dir);
 	} else {
 		printf("Building bootmap in '%s'%s\n", job->target.bootmap_dir,
 		       job->add_files ? " (files will be added to bootmap file)"
@@ -1218,8 +1554,8 @@ bootmap_create(struct job_data *job, disk_blockptr_t *program_table,
 		scsi_sb.dump_size = unused_size;
 	}
 
-	/* Write bootmap header */
-	if (misc_write(fd, header_text, sizeof(header_text))) {
+	/* Write bootmap header, an updated bootmap file already has one */
+	if (!in_place && misc_write(fd, header_text, sizeof(header_text))) {
 		error_text("Could not write to file '%s'", filename);
 		goto out_misc_free_temp_dev;
 	}
@@ -1290,6 +1626,9 @@ bootmap_create(struct job_data *job, disk_blockptr_t *program_table,
 	}
 	if (dry_run) {
 		misc_free_temp_file(filename);
+	} else if (in_place) {
+		/* The data has been appended, the previous bootmap is still
+		 * intact until the boot record is replaced */
 	} else if (job->id != job_dump_partition) {
 		/* Rename to final bootmap name */
 		mapname = misc_make_path(job->target.bootmap_dir,
@@ -1304,6 +1643,14 @@ bootmap_create(struct job_data *job, disk_blockptr_t *program_table,
 		}
 		free(mapname);
 	}
+	if (idxname != NULL && component_cache_save(fd, idxname)) {
+		fprintf(stderr, "Warning: Could not write bootmap index "
+			"'%s'\n", idxname);
+		error_clear_reason();
+		remove(idxname);
+	}
+	component_cache_free();
+	free(idxname);
 	*new_device = device;
 	*new_info = info;
 	close(fd);
@@ -1315,10 +1662,19 @@ out_misc_free_temp_dev:
 out_disk_free_info:
 	disk_free_info(info);
 out_close_fd:
+	/* Drop the appended data, the previous contents are unchanged */
+	if (in_place && ftruncate(fd, old_size))
+		fprintf(stderr, "Warning: Could not truncate file %s: %s\n",
+			filename, strerror(errno));
 	close(fd);
-	if (job->id != job_dump_partition)
+	if (in_place)
+		remove(idxname);
+	else if (job->id != job_dump_partition)
 		misc_free_temp_file(filename);
 out_free_filename:
 	free(filename);
+out_free_cache:
+	component_cache_free();
+	free(idxname);
 	return -1;
 }
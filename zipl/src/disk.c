@@ -662,6 +662,128 @@ disk_get_blocknum(int fd, int fd_is_basedisk, blocknum_t logical,
 }
 
 
+/* Number of extents retrieved with one FIEMAP call */
+#define FIEMAP_EXTENT_COUNT	256
+
+/* Retrieve the physical blocknumbers of the COUNT logical blocks starting at
+ * FIRST of the file identified by FD with as few FIEMAP calls as possible.
+ * LIST must be initialized with holes. Return 0 on success, 1 if FIEMAP is
+ * not available and -1 on errors. */
+static int
+disk_get_blocknums_fiemap(int fd, blocknum_t first, blocknum_t count,
+			  disk_blockptr_t* list, struct disk_info* info)
+{
+	struct fiemap_extent *extent;
+	blocknum_t phy_per_fs;
+	blocknum_t block, end;
+	blocknum_t mapped;
+	struct fiemap *fiemap;
+	struct statfs buf;
+	uint64_t start, length;
+	uint64_t logical;
+	unsigned int i;
+	int rc = -1;
+
+	/* Files on ReiserFS need unpacking, see disk_get_blocknum() */
+	if (fstatfs(fd, &buf) || buf.f_type == REISERFS_SUPER_MAGIC)
+		return 1;
+	phy_per_fs = info->fs_block_size / info->phy_block_size;
+	fiemap = misc_malloc(sizeof(struct fiemap) + FIEMAP_EXTENT_COUNT *
+			     sizeof(struct fiemap_extent));
+	if (!fiemap)
+		return -1;
+	/* fm_start, fm_length in bytes */
+	start = first * info->phy_block_size;
+	length = count * info->phy_block_size;
+	end = first + count;
+	while (length > 0) {
+		memset(fiemap, 0, sizeof(struct fiemap));
+		fiemap->fm_extent_count = FIEMAP_EXTENT_COUNT;
+		fiemap->fm_flags = FIEMAP_FLAG_SYNC;
+		fiemap->fm_start = start;
+		fiemap->fm_length = length;
+		if (ioctl(fd, FS_IOC_FIEMAP, (unsigned long)fiemap)) {
+			/* Use FIBMAP for each block instead */
+			rc = 1;
+			goto out;
+		}
+		/* Only holes are left */
+		if (fiemap->fm_mapped_extents == 0)
+			break;
+		for (i = 0; i < fiemap->fm_mapped_extents; i++) {
+			extent = &fiemap->fm_extents[i];
+			if (extent->fe_flags & FIEMAP_EXTENT_ENCODED) {
+				error_reason("File mapping is encoded");
+				goto out;
+			}
+			/* The extent may start prior to the requested range */
+			block = extent->fe_logical / info->phy_block_size;
+			if (block < first)
+				block = first;
+			for (; block < end; block++) {
+				logical = block * info->phy_block_size;
+				if (logical >= extent->fe_logical +
+					       extent->fe_length)
+					break;
+				/* Same calculation as in disk_get_blocknum() */
+				mapped = (extent->fe_physical + logical -
+					  extent->fe_logical) /
+					 info->fs_block_size;
+				if (mapped == 0)
+					continue;
+				disk_blockptr_from_blocknum(&list[block - first],
+					mapped * phy_per_fs +
+					block % phy_per_fs + info->geo.start,
+					info);
+			}
+		}
+		extent = &fiemap->fm_extents[fiemap->fm_mapped_extents - 1];
+		if (extent->fe_flags & FIEMAP_EXTENT_LAST)
+			break;
+		logical = extent->fe_logical + extent->fe_length;
+		if (logical >= start + length)
+			break;
+		length -= logical - start;
+		start = logical;
+	}
+	rc = 0;
+out:
+	free(fiemap);
+	return rc;
+}
+
+
+/* Store pointers to the disk blocks of the COUNT logical blocks starting at
+ * FIRST of the file identified by FD in LIST. FD_IS_BASEDISK and INFO are
+ * the same as for disk_get_blocknum(). Return 0 on success, non-zero
+ * otherwise. */
+static int
+disk_get_blockptrs(int fd, int fd_is_basedisk, blocknum_t first,
+		   blocknum_t count, disk_blockptr_t* list,
+		   struct disk_info* info)
+{
+	blocknum_t blocknum;
+	blocknum_t i;
+	int rc;
+
+	for (i = 0; i < count; i++)
+		disk_blockptr_from_blocknum(&list[i], 0, info);
+	/* Files: Get all extents at once */
+	if (info->fs_block_size != -1) {
+		rc = disk_get_blocknums_fiemap(fd, first, count, list, info);
+		if (rc <= 0)
+			return rc;
+	}
+	for (i = 0; i < count; i++) {
+		if (disk_get_blocknum(fd, fd_is_basedisk, first + i,
+				      &blocknum, info))
+			return -1;
+		disk_blockptr_from_blocknum(&list[i], blocknum, info);
+	}
+	return 0;
+}
+
+
 /* Return the cylinder on which the block number BLOCKNUM is stored on the
  * CHS device identified by INFO. */
 int
@@ -794,10 +916,8 @@ disk_write_block_buffer(int fd, int fd_is_basedisk, const void* buffer,
 {
 	disk_blockptr_t* list;
 	blocknum_t count;
-	blocknum_t i;
-	size_t written;
-	size_t chunk_size;
-	int rc;
+	off_t current_pos;
+	int align;
 
 	count = (bytecount + info->phy_block_size - 1) / info->phy_block_size;
 	list = (disk_blockptr_t *) misc_malloc(sizeof(disk_blockptr_t) *
@@ -806,20 +926,22 @@ disk_write_block_buffer(int fd, int fd_is_basedisk, const void* buffer,
 		close(fd);
 		return 0;
 	}
-	memset((void *) list, 0, sizeof(disk_blockptr_t) * count);
-	/* Build list */
-	for (i=0, written=0; i < count; i++, written += chunk_size) {
-		chunk_size = bytecount - written;
-		if (chunk_size > (size_t) info->phy_block_size)
-			chunk_size = info->phy_block_size;
-		rc = disk_write_block_aligned_base(fd, fd_is_basedisk,
-						   VOID_ADD(buffer, written),
-				chunk_size,
-				&list[i], info);
-		if (rc) {
-			free(list);
-			return 0;
-		}
+	/* Ensure block alignment of current file pos */
+	align = info->phy_block_size;
+	current_pos = lseek(fd, 0, SEEK_CUR);
+	if (current_pos != -1 && current_pos % align != 0)
+		current_pos = lseek(fd, align - current_pos % align, SEEK_CUR);
+	if (current_pos == -1) {
+		error_text(strerror(errno));
+		free(list);
+		return 0;
+	}
+	/* Write all blocks at once, then build list */
+	if (misc_write(fd, buffer, bytecount) ||
+	    disk_get_blockptrs(fd, fd_is_basedisk, current_pos / align, count,
+			       list, info)) {
+		free(list);
+		return 0;
 	}
 	*blocklist = list;
 	return count;
@@ -1008,6 +1130,16 @@ can_merge_blocks(disk_blockptr_t* first, disk_blockptr_t* second,
 		    (first->chs.sec + first->chs.blockct + 1 ==
 		     second->chs.sec))
 			return 1;
+		/* The boot loader reads with multi-track read commands, so
+		 * a run of blocks can continue on the next track of the same
+		 * cylinder. Track 0 has records of different sizes. */
+		if ((first->chs.cyl == second->chs.cyl) &&
+		    (first->chs.cyl != 0 || first->chs.head != 0) &&
+		    (first->chs.head * info->geo.sectors + first->chs.sec +
+		     first->chs.blockct + 1 ==
+		     second->chs.head * info->geo.sectors + second->chs.sec) &&
+		    (second->chs.sec == 1))
+			return 1;
 		break;
 	case disk_type_diag:
 		break;
@@ -1074,8 +1206,6 @@ disk_get_blocklist_from_file(const char* filename, disk_blockptr_t** blocklist,
 	struct stat stats;
 	int fd;
 	blocknum_t count;
-	blocknum_t i;
-	blocknum_t blocknum;
 
 	fd = open(filename, O_RDONLY);
 	if (fd == -1) {
@@ -1104,21 +1234,45 @@ disk_get_blocklist_from_file(const char* filename, disk_blockptr_t** blocklist,
 		close(fd);
 		return 0;
 	}
-	memset((void *) list, 0, sizeof(disk_blockptr_t) * count);
 	/* Build list */
-	for (i=0; i < count; i++) {
-		if (disk_get_blocknum(fd, 0, i, &blocknum, info)) {
-			free(list);
-			close(fd);
-			return 0;
-		}
-		disk_blockptr_from_blocknum(&list[i], blocknum, info);
+	if (disk_get_blockptrs(fd, 0, 0, count, list, info)) {
+		free(list);
+		close(fd);
+		return 0;
 	}
 	close(fd);
 	*blocklist = list;
 	return count;
 }
 
+/* Retrieve a list of pointers to the disk blocks that store SIZE bytes at
+ * OFFSET of the file identified by file descriptor FD. OFFSET must be aligned
+ * on a block size boundary. Upon success, return the number of blocks and set
+ * BLOCKLIST to point to the uncompacted list. Return zero otherwise. */
+blocknum_t
+disk_get_blocklist_from_range(int fd, off_t offset, size_t size,
+			      disk_blockptr_t** blocklist,
+			      struct disk_info* info)
+{
+	disk_blockptr_t* list;
+	blocknum_t first;
+	blocknum_t count;
+
+	first = offset / info->phy_block_size;
+	count = (size + info->phy_block_size - 1) / info->phy_block_size;
+	list = (disk_blockptr_t *) misc_malloc(sizeof(disk_blockptr_t) *
+					       count);
+	if (list == NULL)
+		return 0;
+	/* Build list */
+	if (disk_get_blockptrs(fd, 0, first, count, list, info)) {
+		free(list);
+		return 0;
+	}
+	*blocklist = list;
+	return count;
+}
+
 /* Check whether input device is in subchannel set 0.
  * Path to "dev" attribute containing the major/minor number depends on
  * whether option CONFIG_SYSFS_DEPRECATED is set or not */
@@ -15,13 +15,12 @@
 #include "error.h"
 
 
-#define ERROR_STRING_SIZE	1024
+/* Each thread has its own error messages */
+static __thread char error_reason_string[ERROR_STRING_SIZE];
+static __thread char error_text_string[ERROR_STRING_SIZE];
 
-static char error_reason_string[ERROR_STRING_SIZE];
-static char error_text_string[ERROR_STRING_SIZE];
-
-static int error_is_reason = 0;
-static int error_is_text = 0;
+static __thread int error_is_reason = 0;
+static __thread int error_is_text = 0;
 
 
 /* Specify the actual reason why an operation failed by providing a formatted
@@ -68,17 +67,28 @@ error_clear_text(void)
 }
 
 
-/* Print out the error reason and text message to stderr. */
+/* Store the error reason and text message in BUFFER of SIZE bytes. */
 void
-error_print(void)
+error_get(char* buffer, size_t size)
 {
 	if (error_is_text && error_is_reason) {
-		fprintf(stderr, "Error: %s: %s\n", error_text_string,
-			error_reason_string);
+		snprintf(buffer, size, "%s: %s", error_text_string,
+			 error_reason_string);
 	} else if (error_is_text)
-		fprintf(stderr, "Error: %s\n", error_text_string);
+		snprintf(buffer, size, "%s", error_text_string);
 	else if (error_is_reason)
-		fprintf(stderr, "Error: %s\n", error_reason_string);
+		snprintf(buffer, size, "%s", error_reason_string);
 	else
-		fprintf(stderr, "Error: An unspecified error occurred\n");
+		snprintf(buffer, size, "An unspecified error occurred");
+}
+
+
+/* Print out the error reason and text message to stderr. */
+void
+error_print(void)
+{
+	char buffer[ERROR_MESSAGE_SIZE];
+
+	error_get(buffer, sizeof(buffer));
+	fprintf(stderr, "Error: %s\n", buffer);
 }
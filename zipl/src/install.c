@@ -11,6 +11,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -1058,15 +1059,50 @@ install_dump(const char* device, struct job_target_data* target, uint64_t mem)
 }
 
 
+/* Installation of the dump record on one multi-volume dump target */
+struct mvdump_worker {
+	pthread_t thread;
+	const char *device;
+	struct disk_info *info;
+	const struct mvdump_parm_table *parm;
+	uint64_t mem;
+	uint8_t force;
+	char *tempdev;
+	int fd;
+	int rc;
+	char error[ERROR_MESSAGE_SIZE];
+};
+
+static void *
+install_mvdump_worker(void *arg)
+{
+	struct mvdump_worker *w = arg;
+
+	if (verbose)
+		printf("Installing dump record on target partition '%s'\n",
+		       w->device);
+	w->rc = install_mvdump_eckd_cdl(w->fd, w->info, w->mem, w->force,
+					*w->parm);
+	if (fsync(w->fd) && w->rc == 0) {
+		error_reason(strerror(errno));
+		error_text("Could not sync device file '%s'", w->device);
+		w->rc = -1;
+	}
+	if (w->rc)
+		error_get(w->error, sizeof(w->error));
+	return NULL;
+}
+
+
 int
 install_mvdump(char* const device[], struct job_target_data* target, int count,
 	       uint64_t mem, uint8_t force)
 {
+	struct mvdump_worker worker[MAX_DUMP_VOLUMES];
 	struct disk_info* info[MAX_DUMP_VOLUMES] = {0};
 	struct mvdump_parm_table parm;
-	char* tempdev;
 	uint64_t total_size = 0;
-	int rc = 0, i, j, fd;
+	int rc = 0, i, j, fd, started = 0, failed = 0;
 	struct timeval time;
 
 	memset(&parm, 0, sizeof(struct mvdump_parm_table));
@@ -1167,33 +1203,64 @@ install_mvdump(char* const device[], struct job_target_data* target, int count,
 		if (rc)
 			goto out;
 	}
+	/* Open all targets before writing to any of them */
+	memset(worker, 0, sizeof(worker));
 	for (i = 0; i < count; i++) {
-		rc = misc_temp_dev(info[i]->device, 1, &tempdev);
+		worker[i].device = device[i];
+		worker[i].info = info[i];
+		worker[i].parm = &parm;
+		worker[i].mem = mem;
+		worker[i].force = force;
+		worker[i].fd = -1;
+		rc = misc_temp_dev(info[i]->device, 1, &worker[i].tempdev);
 		if (rc) {
 			rc = -1;
-			goto out;
+			goto out_close;
 		}
-		fd = misc_open_exclusive(tempdev);
-		if (fd == -1) {
+		worker[i].fd = misc_open_exclusive(worker[i].tempdev);
+		if (worker[i].fd == -1) {
 			error_text("Could not open temporary device node '%s'",
-				   tempdev);
-			misc_free_temp_dev(tempdev);
+				   worker[i].tempdev);
 			rc = -1;
-			goto out;
+			goto out_close;
 		}
-		if (verbose)
-			printf("Installing dump record on target partition "
-			       "'%s'\n", device[i]);
-		rc = install_mvdump_eckd_cdl(fd, info[i], mem, force, parm);
-		misc_free_temp_dev(tempdev);
-
-		if (fsync(fd))
-			error_text("Could not sync device file '%s'", device);
-		if (close(fd))
-			error_text("Could not close device file '%s'", device);
-
-		if (rc)
-			goto out;
+	}
+	/* The targets are independent, install on all of them at once */
+	for (started = 0; started < count; started++) {
+		rc = pthread_create(&worker[started].thread, NULL,
+				    install_mvdump_worker, &worker[started]);
+		if (rc) {
+			error_reason(strerror(rc));
+			error_text("Could not start installation on '%s'",
+				   device[started]);
+			rc = -1;
+			break;
+		}
+	}
+	for (i = 0; i < started; i++) {
+		pthread_join(worker[i].thread, NULL);
+		if (worker[i].rc) {
+			fprintf(stderr, "Dump target '%s': %s\n", device[i],
+				worker[i].error);
+			failed++;
+		}
+	}
+	if (started == count) {
+		printf("Dump record installed on %d of %d target "
+		       "partitions.\n", count - failed, count);
+		if (failed) {
+			error_text("Could not install dump record on %d "
+				   "target partitions", failed);
+			rc = -1;
+		}
+	}
+out_close:
+	for (i = 0; i < count; i++) {
+		if (worker[i].fd != -1 && close(worker[i].fd))
+			fprintf(stderr, "Warning: Could not close device file "
+				"'%s'\n", device[i]);
+		if (worker[i].tempdev != NULL)
+			misc_free_temp_dev(worker[i].tempdev);
 	}
 out:
 	for (i = 0; i < count; i++)
@@ -51,6 +51,7 @@ static struct option options[] = {
 	{ "add-files",		no_argument,		NULL, 'a'},
 	{ "tape",		required_argument,	NULL, 'T'},
 	{ "dry-run",		no_argument,		NULL, '0'},
+	{ "incremental",	no_argument,		NULL, 'I'},
 	{ "force",		no_argument,		NULL, 'f'},
 	{ "kdump",		required_argument,	NULL, 'k'},
 	{ "secure",		required_argument,	NULL, 'S'},
@@ -79,6 +80,7 @@ struct command_line {
 	int version;
 	int verbose;
 	int add_files;
+	int incremental;
 	int dry_run;
 	int force;
 	int is_secure;
@@ -264,6 +266,9 @@ get_command_line(int argc, char* argv[], struct command_line* line)
 		case '0':
 			cmdline.dry_run = 1;
 			break;
+		case 'I':
+			cmdline.incremental = 1;
+			break;
 		case 'f':
 			cmdline.force = 1;
 			break;
@@ -1914,6 +1919,7 @@ job_get(int argc, char* argv[], struct job_data** data)
 	job->noninteractive = cmdline.noninteractive;
 	job->verbose = cmdline.verbose;
 	job->add_files = cmdline.add_files;
+	job->incremental = cmdline.incremental;
 	job->data.mvdump.force = cmdline.force;
 	job->dry_run = cmdline.dry_run;
 	job->is_secure =  SECURE_BOOT_UNDEFINED;
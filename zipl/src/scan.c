@@ -34,6 +34,7 @@
 #include <sys/stat.h>
 
 #include "lib/util_base.h"
+#include "lib/util_hash.h"
 
 #include "boot.h"
 #include "error.h"
@@ -914,6 +915,80 @@ scan_find_section(struct scan_token* scan, char* name, enum scan_id type,
 }
 
 
+/* Index of the section and menu headings of a scan array */
+struct scan_heading {
+	int index;			/* Index of heading token */
+	struct scan_heading *next;	/* Next heading with same name and type */
+};
+
+struct scan_index {
+	struct util_hash *section;	/* First section heading per name */
+	struct util_hash *menu;		/* First menu heading per name */
+	struct scan_heading *heading;	/* One entry per token */
+};
+
+
+/* Build heading index IDX for scanned tokens SCAN. Return zero on success,
+ * non-zero otherwise. */
+static int
+scan_index_build(struct scan_token* scan, struct scan_index* idx)
+{
+	struct scan_heading *heading;
+	int count;
+	int i;
+
+	for (count = 0; scan[count].id != scan_id_empty; count++)
+		;
+	idx->heading = misc_malloc(sizeof(struct scan_heading) * (count + 1));
+	if (idx->heading == NULL)
+		return -1;
+	idx->section = util_hash_new(UTIL_HASH_KEY_STR, count);
+	idx->menu = util_hash_new(UTIL_HASH_KEY_STR, 0);
+	/* Walk backwards so that each name list is in ascending order */
+	for (i = count - 1; i >= 0; i--) {
+		heading = &idx->heading[i];
+		heading->index = i;
+		if (scan[i].id == scan_id_section_heading) {
+			heading->next = util_hash_get_str(idx->section,
+					scan[i].content.section.name);
+			util_hash_set_str(idx->section,
+					  scan[i].content.section.name,
+					  heading);
+		} else if (scan[i].id == scan_id_menu_heading) {
+			heading->next = util_hash_get_str(idx->menu,
+					scan[i].content.menu.name);
+			util_hash_set_str(idx->menu, scan[i].content.menu.name,
+					  heading);
+		}
+	}
+	return 0;
+}
+
+
+static void
+scan_index_free(struct scan_index* idx)
+{
+	util_hash_free(idx->section, NULL);
+	util_hash_free(idx->menu, NULL);
+	free(idx->heading);
+}
+
+
+/* Same as scan_find_section() but use heading index IDX. */
+static int
+scan_index_find(struct scan_index* idx, char* name, enum scan_id type,
+		int offset)
+{
+	struct scan_heading *heading;
+
+	heading = util_hash_get_str(type == scan_id_menu_heading ?
+				    idx->menu : idx->section, name);
+	while (heading != NULL && heading->index < offset)
+		heading = heading->next;
+	return heading ? heading->index : -1;
+}
+
+
 /* Check whether a string contains a load address as comma separated hex
  * value at end of string. */
 static int
@@ -1362,7 +1437,7 @@ scan_get_section_keywords(struct scan_token* scan, int* index, char* name,
  * return zero and advance INDEX to point to the end of the section. Return
  * non-zero otherwise. */
 static int
-check_section(struct scan_token* scan, int* index)
+check_section(struct scan_token* scan, struct scan_index* idx, int* index)
 {
 	char* name;
 	char* keyword[SCAN_KEYWORD_NUM];
@@ -1373,7 +1448,7 @@ check_section(struct scan_token* scan, int* index)
 	
 	name = scan[*index].content.section.name;
 	/* Ensure unique section names */
-	line = scan_find_section(scan, name, scan_id_section_heading, *index+1);
+	line = scan_index_find(idx, name, scan_id_section_heading, *index + 1);
 	if (line >= 0) {
 		error_reason("Line %d: section name '%s' already specified",
 			     scan[line].line, name);
@@ -1438,7 +1513,7 @@ check_menu_keyword_data(char* keyword[], int* line, char* name,
  * success, return zero and advance INDEX to point to the end of the section.
  * Return non-zero otherwise. */
 static int
-check_menu(struct scan_token* scan, int* index)
+check_menu(struct scan_token* scan, struct scan_index* idx, int* index)
 {
 	char* keyword[SCAN_KEYWORD_NUM];
 	int keyword_line[SCAN_KEYWORD_NUM];
@@ -1455,8 +1530,7 @@ check_menu(struct scan_token* scan, int* index)
 	menu_name = scan[*index].content.menu.name;
 	menu_line = scan[*index].line;
 	/* Rule 15 */
-	i = scan_find_section(scan, menu_name, scan_id_menu_heading,
-			      *index + 1);
+	i = scan_index_find(idx, menu_name, scan_id_menu_heading, *index + 1);
 	if (i >= 0) {
 		error_reason("Line %d: menu name '%s' already specified",
 			     scan[i].line, menu_name);
@@ -1529,8 +1603,8 @@ check_menu(struct scan_token* scan, int* index)
 	for (i = 0; i < BOOT_MENU_ENTRIES; i++) {
 		if (!num[i])
 			continue;
-		if (scan_find_section(scan, num[i], scan_id_section_heading,
-				      0) < 0) {
+		if (scan_index_find(idx, num[i], scan_id_section_heading,
+				    0) < 0) {
 			error_reason("Line %d: section '%s' not found",
 				     num_line[i], num[i]);
 			return -1;
@@ -1604,31 +1678,32 @@ scan_id_name(enum scan_id id)
 int
 scan_check(struct scan_token* scan)
 {
+	struct scan_index idx;
 	int i;
 	int rc;
 
+	if (scan_index_build(scan, &idx))
+		return -1;
 	i = 0;
-	while (scan[i].id != scan_id_empty) {
+	rc = 0;
+	while (scan[i].id != scan_id_empty && rc == 0) {
 		switch (scan[i].id) {
 		case scan_id_section_heading:
-			rc = check_section(scan, &i);
-			if (rc)
-				return rc;
+			rc = check_section(scan, &idx, &i);
 			break;
 		case scan_id_menu_heading:
-			rc = check_menu(scan, &i);
-			if (rc)
-				return rc;
+			rc = check_menu(scan, &idx, &i);
 			break;
 		default:
 			/* Rule 1 */
 			error_reason("Line %d: %s not allowed outside of "
 				     "section", scan[i].line,
 				     scan_id_name(scan[i].id));
-			return -1;
+			rc = -1;
 		}
 	}
-	return 0;
+	scan_index_free(&idx);
+	return rc;
 }
 
 /*
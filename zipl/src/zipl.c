@@ -80,6 +80,8 @@ static const char* usage_text[] = {
 "-n, --noninteractive            Answer all confirmation questions with 'yes'",
 "-V, --verbose                   Provide more verbose output",
 "-a, --add-files                 Add all referenced files to bootmap file",
+"    --incremental               With --add-files only add changed files to",
+"                                the existing bootmap file",
 "    --dry-run                   Simulate run but don't modify IPL records",
 "-S, --secure SWITCH             Control the zIPL secure boot support.",
 "                                 auto (default):",
@@ -0,0 +1,545 @@
+/*
+ * zkey - Generate, re-encipher, and validate secure keys
+ *
+ * Benchmark of secure key operations
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#include <dlfcn.h>
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lib/util_base.h"
+#include "lib/util_libc.h"
+#include "lib/util_panic.h"
+#include "lib/util_rec.h"
+
+#include "bench.h"
+#include "cca.h"
+#include "ep11.h"
+#include "pkey.h"
+#include "utils.h"
+
+#define pr_verbose(verbose, fmt...)	do {				\
+						if (verbose)		\
+							warnx(fmt);	\
+					} while (0)
+
+enum bench_op {
+	BENCH_OP_GENERATE,
+	BENCH_OP_VALIDATE,
+	BENCH_OP_REENCIPHER,
+	BENCH_OP_VERIFICATION_PATTERN,
+	BENCH_OP_NUM,
+};
+
+static const char * const bench_op_names[BENCH_OP_NUM] = {
+	[BENCH_OP_GENERATE] = "generate",
+	[BENCH_OP_VALIDATE] = "validate",
+	[BENCH_OP_REENCIPHER] = "reencipher",
+	[BENCH_OP_VERIFICATION_PATTERN] = "verification-pattern",
+};
+
+/*
+ * Result of a worker process. It is placed in memory that is shared with
+ * the worker processes and is followed by the latencies of all workers.
+ */
+struct bench_worker_result {
+	unsigned long num_ok;
+	unsigned long num_failed;
+	u64 start_ns;
+	u64 end_ns;
+};
+
+struct bench_shared {
+	unsigned int ready;
+	struct bench_worker_result results[];
+};
+
+struct bench_apqn {
+	unsigned int card;
+	unsigned int domain;
+};
+
+struct bench_info {
+	int pkey_fd;
+	const char *key_type;
+	size_t keybits;
+	bool xts;
+	unsigned long count;
+	enum card_type cardtype;
+	struct bench_apqn *apqns;
+	size_t num_apqns;
+	char apqn[10];
+	const char *apqn_list[2];
+	u8 *secure_key;
+	size_t secure_key_size;
+	struct bench_shared *shared;
+	u64 *latencies;
+	struct util_rec *rec;
+	bool verbose;
+};
+
+/**
+ * Returns the current time of the monotonic clock in nanoseconds
+ */
+static u64 _bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Performs one operation on a copy of the secure key of the APQN
+ *
+ * @param[in] info       the benchmark info
+ * @param[in] op         the operation to perform
+ * @param[in] lib        the external library struct of the worker
+ * @param[in] key        a copy of the secure key that can be modified
+ *
+ * @returns 0 on success, a negative errno in case of an error
+ */
+static int _bench_operation(struct bench_info *info, enum bench_op op,
+			    struct ext_lib *lib, u8 *key)
+{
+	char vp[VERIFICATION_PATTERN_LEN];
+	size_t new_key_size;
+	bool apqn_selected;
+	u8 *new_key;
+	int rc;
+
+	switch (op) {
+	case BENCH_OP_GENERATE:
+		rc = generate_secure_key_random_buf(info->pkey_fd,
+						    info->keybits, info->xts,
+						    info->key_type,
+						    info->apqn_list, &new_key,
+						    &new_key_size, false);
+		if (rc == 0)
+			free(new_key);
+		return rc;
+	case BENCH_OP_VALIDATE:
+		return validate_secure_key(info->pkey_fd, key,
+					   info->secure_key_size, NULL, NULL,
+					   info->apqn_list, false);
+	case BENCH_OP_REENCIPHER:
+		return reencipher_secure_key(lib, key, info->secure_key_size,
+					     info->apqn,
+					     REENCIPHER_CURRENT_TO_NEW,
+					     &apqn_selected, false);
+	case BENCH_OP_VERIFICATION_PATTERN:
+		return generate_key_verification_pattern(key,
+							 info->secure_key_size,
+							 vp, sizeof(vp), false);
+	default:
+		return -EINVAL;
+	}
+}
+
+/**
+ * Main function of a benchmark worker process. It performs the operation
+ * the specified number of times and records the latency of each operation
+ * in the shared memory. A worker stops at the first failing operation.
+ *
+ * Each worker loads its own CCA or EP11 library, because selecting an APQN
+ * for the library affects the whole process. The operations start when all
+ * workers are ready, so that the library loading time is not measured.
+ *
+ * @param[in] info       the benchmark info
+ * @param[in] op         the operation to perform
+ * @param[in] worker     the number of the worker
+ * @param[in] jobs       the number of workers
+ *
+ * @returns the exit code of the worker process
+ */
+static int _bench_worker(struct bench_info *info, enum bench_op op,
+			 unsigned int worker, unsigned int jobs)
+{
+	struct bench_worker_result *result = &info->shared->results[worker];
+	u64 *latencies = &info->latencies[worker * info->count];
+	struct ep11_lib ep11 = { 0 };
+	struct cca_lib cca = { 0 };
+	struct ext_lib lib = { .cca = &cca, .ep11 = &ep11 };
+	unsigned long i;
+	u64 start;
+	int rc = 0;
+	u8 *key;
+
+	if (op == BENCH_OP_REENCIPHER) {
+		if (is_ep11_aes_key(info->secure_key, info->secure_key_size))
+			rc = load_ep11_library(&ep11, info->verbose);
+		else
+			rc = load_cca_library(&cca, info->verbose);
+	}
+
+	__atomic_add_fetch(&info->shared->ready, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&info->shared->ready, __ATOMIC_SEQ_CST) < jobs)
+		usleep(100);
+
+	key = util_malloc(info->secure_key_size);
+	result->start_ns = _bench_now_ns();
+	for (i = 0; rc == 0 && i < info->count; i++) {
+		memcpy(key, info->secure_key, info->secure_key_size);
+
+		start = _bench_now_ns();
+		rc = _bench_operation(info, op, &lib, key);
+		if (rc != 0)
+			break;
+		latencies[result->num_ok++] = _bench_now_ns() - start;
+	}
+	if (rc != 0) {
+		result->num_failed++;
+		pr_verbose(info->verbose, "Operation '%s' failed on APQN %s: "
+			   "%s", bench_op_names[op], info->apqn,
+			   strerror(-rc));
+	}
+	result->end_ns = _bench_now_ns();
+
+	free(key);
+	if (cca.lib_csulcca)
+		dlclose(cca.lib_csulcca);
+	if (ep11.lib_ep11) {
+		free_ep11_targets(&ep11);
+		dlclose(ep11.lib_ep11);
+	}
+	return rc != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int _bench_compare_latencies(const void *a, const void *b)
+{
+	u64 la = *(const u64 *)a, lb = *(const u64 *)b;
+
+	return la < lb ? -1 : la > lb;
+}
+
+/**
+ * Returns the latency at the specified percentile of the sorted latencies
+ * in milliseconds
+ */
+static double _bench_percentile(const u64 *latencies, unsigned long num,
+				unsigned int percent)
+{
+	unsigned long idx;
+
+	idx = (num * percent + 99) / 100;
+	if (idx > 0)
+		idx--;
+	return latencies[idx] / 1000000.0;
+}
+
+/**
+ * Prints the results of all workers of an operation
+ *
+ * @param[in] info       the benchmark info
+ * @param[in] op         the operation
+ * @param[in] jobs       the number of workers
+ */
+static void _bench_print_results(struct bench_info *info, enum bench_op op,
+				 unsigned int jobs)
+{
+	struct bench_worker_result *result;
+	unsigned long num_ok = 0, num_failed = 0;
+	u64 start = 0, end = 0, sum = 0;
+	u64 *latencies;
+	unsigned int i;
+	unsigned long k;
+
+	latencies = util_malloc(jobs * info->count * sizeof(u64));
+	for (i = 0; i < jobs; i++) {
+		result = &info->shared->results[i];
+		for (k = 0; k < result->num_ok; k++) {
+			latencies[num_ok++] = info->latencies[i * info->count +
+							      k];
+			sum += info->latencies[i * info->count + k];
+		}
+		num_failed += result->num_failed;
+		if (start == 0 || (result->start_ns != 0 &&
+				   result->start_ns < start))
+			start = result->start_ns;
+		if (result->end_ns > end)
+			end = result->end_ns;
+	}
+
+	util_rec_set(info->rec, "APQN", "%s", info->apqn);
+	util_rec_set(info->rec, "OP", "%s", bench_op_names[op]);
+	util_rec_set(info->rec, "JOBS", "%u", jobs);
+	util_rec_set(info->rec, "FAILED", "%lu", num_failed);
+	if (num_ok > 0 && end > start) {
+		qsort(latencies, num_ok, sizeof(u64),
+		      _bench_compare_latencies);
+		util_rec_set(info->rec, "OPS", "%.1f",
+			     num_ok * 1000000000.0 / (end - start));
+		util_rec_set(info->rec, "AVG", "%.3f",
+			     sum / 1000000.0 / num_ok);
+		util_rec_set(info->rec, "P50", "%.3f",
+			     _bench_percentile(latencies, num_ok, 50));
+		util_rec_set(info->rec, "P90", "%.3f",
+			     _bench_percentile(latencies, num_ok, 90));
+		util_rec_set(info->rec, "P99", "%.3f",
+			     _bench_percentile(latencies, num_ok, 99));
+		util_rec_set(info->rec, "MAX", "%.3f",
+			     latencies[num_ok - 1] / 1000000.0);
+	} else {
+		util_rec_set(info->rec, "OPS", "-");
+		util_rec_set(info->rec, "AVG", "-");
+		util_rec_set(info->rec, "P50", "-");
+		util_rec_set(info->rec, "P90", "-");
+		util_rec_set(info->rec, "P99", "-");
+		util_rec_set(info->rec, "MAX", "-");
+	}
+	util_rec_print(info->rec);
+	fflush(stdout);
+
+	free(latencies);
+}
+
+/**
+ * Runs an operation on the current APQN with the specified number of
+ * parallel worker processes and prints the results.
+ *
+ * @param[in] info       the benchmark info
+ * @param[in] op         the operation
+ * @param[in] jobs       the number of workers
+ *
+ * @returns 0 for success or a negative errno in case of an error
+ */
+static int _bench_run(struct bench_info *info, enum bench_op op,
+		      unsigned int jobs)
+{
+	unsigned int i, started = 0;
+	pid_t *pids;
+	int rc = 0;
+
+	memset(info->shared, 0, sizeof(struct bench_shared) +
+	       jobs * sizeof(struct bench_worker_result));
+
+	pr_verbose(info->verbose, "Running '%s' on APQN %s with %u workers",
+		   bench_op_names[op], info->apqn, jobs);
+
+	pids = util_zalloc(jobs * sizeof(pid_t));
+	fflush(stdout);
+	fflush(stderr);
+	for (i = 0; i < jobs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			rc = -errno;
+			break;
+		}
+		if (pids[i] == 0)
+			_exit(_bench_worker(info, op, i, jobs));
+		started++;
+	}
+	if (rc != 0) {
+		warnx("Failed to start a benchmark worker: %s", strerror(-rc));
+		/* Let the workers already started run */
+		__atomic_add_fetch(&info->shared->ready, jobs - started,
+				   __ATOMIC_SEQ_CST);
+	}
+
+	for (i = 0; i < started; i++)
+		waitpid(pids[i], NULL, 0);
+
+	if (rc == 0)
+		_bench_print_results(info, op, jobs);
+
+	free(pids);
+	return rc;
+}
+
+/**
+ * Checks if the NEW master key register of the current APQN is set, which
+ * is required to re-encipher a secure key from the CURRENT to the NEW master
+ * key.
+ */
+static bool _bench_has_new_mk(struct bench_info *info, unsigned int card,
+			      unsigned int domain)
+{
+	struct mk_info mk_info;
+
+	if (sysfs_get_mkvps(card, domain, &mk_info, info->verbose) != 0)
+		return false;
+
+	return mk_info.new_mk.mk_state == MK_STATE_FULL ||
+	       mk_info.new_mk.mk_state == MK_STATE_COMMITTED;
+}
+
+/**
+ * Runs all operations on an APQN with increasing numbers of parallel
+ * workers up to the specified maximum.
+ *
+ * @param[in] info       the benchmark info
+ * @param[in] apqn       the APQN
+ * @param[in] max_jobs   the maximum number of workers
+ *
+ * @returns 0 for success or a negative errno in case of an error
+ */
+static int _bench_apqn(struct bench_info *info, struct bench_apqn *apqn,
+		       unsigned int max_jobs)
+{
+	unsigned int jobs, op;
+	bool has_new_mk;
+	int rc;
+
+	sprintf(info->apqn, "%02x.%04x", apqn->card, apqn->domain);
+	info->apqn_list[0] = info->apqn;
+	info->apqn_list[1] = NULL;
+
+	rc = generate_secure_key_random_buf(info->pkey_fd, info->keybits,
+					    info->xts, info->key_type,
+					    info->apqn_list, &info->secure_key,
+					    &info->secure_key_size,
+					    info->verbose);
+	if (rc != 0) {
+		warnx("Failed to generate a secure key on APQN %s, skipping "
+		      "it", info->apqn);
+		return 0;
+	}
+
+	has_new_mk = _bench_has_new_mk(info, apqn->card, apqn->domain);
+	if (!has_new_mk)
+		warnx("The NEW master key register of APQN %s is not set, "
+		      "the '%s' operation is skipped", info->apqn,
+		      bench_op_names[BENCH_OP_REENCIPHER]);
+
+	for (op = 0; op < BENCH_OP_NUM && rc == 0; op++) {
+		if (op == BENCH_OP_REENCIPHER && !has_new_mk)
+			continue;
+
+		for (jobs = 1; rc == 0; jobs *= 2) {
+			if (jobs > max_jobs)
+				jobs = max_jobs;
+			rc = _bench_run(info, op, jobs);
+			if (jobs == max_jobs)
+				break;
+		}
+	}
+
+	free(info->secure_key);
+	info->secure_key = NULL;
+	return rc;
+}
+
+static int _bench_add_apqn(unsigned int card, unsigned int domain,
+			   void *handler_data)
+{
+	struct bench_info *info = handler_data;
+
+	if (sysfs_is_apqn_online(card, domain, info->cardtype) != 1) {
+		warnx("APQN %02x.%04x is not online or not of the correct "
+		      "type, skipping it", card, domain);
+		return 0;
+	}
+
+	info->apqns = util_realloc(info->apqns, (info->num_apqns + 1) *
+				   sizeof(struct bench_apqn));
+	info->apqns[info->num_apqns].card = card;
+	info->apqns[info->num_apqns].domain = domain;
+	info->num_apqns++;
+	return 0;
+}
+
+/**
+ * Measures the throughput and the latencies of secure key operations per
+ * APQN: generating a secure key by random, validating, re-enciphering from
+ * the CURRENT to the NEW master key, and generating the verification pattern
+ * of a secure key. Each operation is run by 1, 2, 4, ... up to max_jobs
+ * parallel worker processes, each performing the operation count times.
+ *
+ * @param[in] pkey_fd    the pkey file descriptor
+ * @param[in] apqns      a comma separated list of APQNs. If NULL is specified,
+ *                       or an empty string, then all online APQNs of the
+ *                       matching type are used.
+ * @param[in] key_type   the type of the secure keys
+ * @param[in] keybits    the cryptographic size of the keys in bits
+ * @param[in] xts        if true XTS keys are used
+ * @param[in] max_jobs   the maximum number of parallel workers
+ * @param[in] count      the number of operations per worker
+ * @param[in] verbose    if true, verbose messages are printed
+ *
+ * @returns 0 for success or a negative errno in case of an error
+ */
+int bench_secure_keys(int pkey_fd, const char *apqns, const char *key_type,
+		      size_t keybits, bool xts, unsigned int max_jobs,
+		      unsigned long count, bool verbose)
+{
+	struct bench_info info = { 0 };
+	size_t shared_size = 0, i;
+	int rc;
+
+	util_assert(pkey_fd != -1, "Internal error: pkey_fd is -1");
+	util_assert(key_type != NULL, "Internal error: key_type is NULL");
+	util_assert(max_jobs > 0, "Internal error: max_jobs is 0");
+	util_assert(count > 0, "Internal error: count is 0");
+
+	info.pkey_fd = pkey_fd;
+	info.key_type = key_type;
+	info.keybits = keybits;
+	info.xts = xts;
+	info.count = count;
+	info.verbose = verbose;
+	info.cardtype = get_card_type_for_keytype(key_type);
+
+	rc = handle_apqns(apqns, info.cardtype, _bench_add_apqn, &info,
+			  verbose);
+	if (rc != 0)
+		goto out;
+	if (info.num_apqns == 0) {
+		warnx("No APQN is available that can generate a secure key "
+		      "of type %s", key_type);
+		rc = -ENODEV;
+		goto out;
+	}
+
+	shared_size = sizeof(struct bench_shared) +
+		      max_jobs * sizeof(struct bench_worker_result) +
+		      max_jobs * count * sizeof(u64);
+	info.shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (info.shared == MAP_FAILED) {
+		rc = -errno;
+		info.shared = NULL;
+		warnx("Failed to set up the benchmark workers: %s",
+		      strerror(-rc));
+		goto out;
+	}
+	info.latencies = (u64 *)&info.shared->results[max_jobs];
+
+	info.rec = util_rec_new_wide("-");
+	util_rec_def(info.rec, "APQN", UTIL_REC_ALIGN_LEFT, 11, "CARD.DOMAIN");
+	util_rec_def(info.rec, "OP", UTIL_REC_ALIGN_LEFT, 20, "OPERATION");
+	util_rec_def(info.rec, "JOBS", UTIL_REC_ALIGN_RIGHT, 4, "JOBS");
+	util_rec_def(info.rec, "OPS", UTIL_REC_ALIGN_RIGHT, 9, "OPS/SEC");
+	util_rec_def(info.rec, "AVG", UTIL_REC_ALIGN_RIGHT, 9, "AVG MS");
+	util_rec_def(info.rec, "P50", UTIL_REC_ALIGN_RIGHT, 9, "P50 MS");
+	util_rec_def(info.rec, "P90", UTIL_REC_ALIGN_RIGHT, 9, "P90 MS");
+	util_rec_def(info.rec, "P99", UTIL_REC_ALIGN_RIGHT, 9, "P99 MS");
+	util_rec_def(info.rec, "MAX", UTIL_REC_ALIGN_RIGHT, 9, "MAX MS");
+	util_rec_def(info.rec, "FAILED", UTIL_REC_ALIGN_RIGHT, 6, "FAILED");
+	util_rec_print_hdr(info.rec);
+
+	for (i = 0; i < info.num_apqns && rc == 0; i++)
+		rc = _bench_apqn(&info, &info.apqns[i], max_jobs);
+
+out:
+	if (info.rec != NULL)
+		util_rec_free(info.rec);
+	if (info.shared != NULL)
+		munmap(info.shared, shared_size);
+	free(info.apqns);
+	return rc;
+}
@@ -0,0 +1,25 @@
+/*
+ * zkey - Generate, re-encipher, and validate secure keys
+ *
+ * Benchmark of secure key operations
+ *
+ * Copyright IBM Corp. 2021
+ *
+ * s390-tools is free software; you can redistribute it and/or modify
+ * it under the terms of the MIT license. See LICENSE for details.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BENCH_DEFAULT_JOBS	4
+#define BENCH_DEFAULT_COUNT	100
+
+int bench_secure_keys(int pkey_fd, const char *apqns, const char *key_type,
+		      size_t keybits, bool xts, unsigned int max_jobs,
+		      unsigned long count, bool verbose);
+
+#endif
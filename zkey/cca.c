@@ -568,6 +568,17 @@ int select_cca_adapter(struct cca_lib *cca, unsigned int card,
 	pr_verbose(verbose, "Select %02x.%04x for the CCA host library", card,
 		   domain);
 
+	/*
+	 * Selecting an APQN requires to reload the CCA host library, so keep
+	 * it, if the APQN is already selected.
+	 */
+	if (cca->lib_csulcca != NULL && cca->apqn_selected &&
+	    cca->selected_card == card && cca->selected_domain == domain) {
+		pr_verbose(verbose, "%02x.%04x is already selected", card,
+			   domain);
+		return 0;
+	}
+
 	rc = sysfs_get_serialnr(card, apqn_serialnr, verbose);
 	if (rc != 0) {
 		pr_verbose(verbose, "Failed to get the serial number: %s",
@@ -626,6 +637,10 @@ int select_cca_adapter(struct cca_lib *cca, unsigned int card,
 	if (!found)
 		return -ENODEV;
 
+	cca->apqn_selected = true;
+	cca->selected_card = card;
+	cca->selected_domain = domain;
+
 	pr_verbose(verbose, "Selected adapter %u (CRP%02d)", adapter, adapter);
 	return 0;
 }
@@ -115,6 +115,10 @@ struct cca_lib {
 	t_CSNBKTR2 dll_CSNBKTR2;
 	t_CSNBRKA dll_CSNBRKA;
 	struct cca_version version;
+	/* APQN selected by select_cca_adapter() */
+	bool apqn_selected;
+	unsigned int selected_card;
+	unsigned int selected_domain;
 };
 
 int load_cca_library(struct cca_lib *cca, bool verbose);
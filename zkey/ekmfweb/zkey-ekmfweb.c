@@ -16,6 +16,7 @@
 #include <string.h>
 #include <errno.h>
 #include <err.h>
+#include <time.h>
 #include <sys/utsname.h>
 
 #include <openssl/evp.h>
@@ -589,6 +590,540 @@ out:
 	return rc;
 }
 
+/**
+ * Builds the string used to validate the key metadata cache. It contains the
+ * server URL, the identity key, and the last used sequence numbers of the key
+ * templates. The sequence number of a template changes whenever a key is
+ * generated using that template.
+ *
+ * @param ph                the plugin handle
+ *
+ * @returns an allocated string, or NULL if a sequence number could not be
+ * obtained.
+ */
+static char *_cache_validation(struct plugin_handle *ph)
+{
+	const char *templates[] = { EKMFWEB_CONFIG_TEMPLATE_XTS1_ID,
+				    EKMFWEB_CONFIG_TEMPLATE_XTS2_ID,
+				    EKMFWEB_CONFIG_TEMPLATE_NONXTS_ID };
+	char *validation, *uuid, *tmp, *error_msg = NULL;
+	unsigned int seqno, i;
+	int rc;
+
+	tmp = properties_get(ph->properties, EKMFWEB_CONFIG_IDENTITY_KEY_ID);
+	util_asprintf(&validation, "%s %s", ph->ekmf_config.base_url,
+		      tmp != NULL ? tmp : "-");
+	free(tmp);
+
+	for (i = 0; i < ARRAY_SIZE(templates); i++) {
+		uuid = properties_get(ph->properties, templates[i]);
+		if (uuid == NULL)
+			continue;
+
+		rc = ekmf_get_last_seq_no(&ph->ekmf_config, &ph->curl_handle,
+					  uuid, &seqno, &error_msg,
+					  ph->verbose);
+		if (rc != 0) {
+			pr_verbose(ph, "Failed to get last used sequence "
+				   "number for template '%s': %s", uuid,
+				   error_msg != NULL ? error_msg :
+				   strerror(-rc));
+			_remove_login_token_if_error(ph, rc);
+			FREE_AND_SET_NULL(error_msg);
+			free(validation);
+			free(uuid);
+			return NULL;
+		}
+
+		util_asprintf(&tmp, "%s %s:%u", validation, uuid, seqno);
+		free(validation);
+		free(uuid);
+		validation = tmp;
+	}
+
+	return validation;
+}
+
+/**
+ * Opens the key metadata cache. The cache is loaded and validated once per
+ * plugin handle. If the cache is older than EKMFWEB_CACHE_TTL seconds, or if
+ * any key has been generated since it was written, then an empty cache is
+ * started.
+ *
+ * @param ph                the plugin handle
+ *
+ * @returns the cache, or NULL if the cache can not be used.
+ */
+static struct properties *_cache_open(struct plugin_handle *ph)
+{
+	char *file_name = NULL, *validation, *tmp;
+	struct properties *cache;
+	time_t now = time(NULL);
+	bool valid = false;
+	long created;
+	int rc;
+
+	if (ph->cache_checked)
+		return ph->cache;
+	ph->cache_checked = true;
+
+	if (!ph->config_complete)
+		return NULL;
+
+	validation = _cache_validation(ph);
+	if (validation == NULL)
+		return NULL;
+
+	util_asprintf(&file_name, "%s/%s", ph->config_path,
+		      EKMFWEB_CACHE_FILE);
+
+	cache = properties_new();
+	rc = properties_load(cache, file_name, true);
+	if (rc == 0) {
+		tmp = properties_get(cache, EKMFWEB_CACHE_VALIDATION);
+		valid = tmp != NULL && strcmp(tmp, validation) == 0;
+		free(tmp);
+
+		tmp = properties_get(cache, EKMFWEB_CACHE_CREATED);
+		if (tmp == NULL || sscanf(tmp, "%ld", &created) != 1 ||
+		    created > now || now - created >= EKMFWEB_CACHE_TTL)
+			valid = false;
+		free(tmp);
+	}
+
+	if (!valid) {
+		pr_verbose(ph, "Key metadata cache '%s' is outdated",
+			   file_name);
+		properties_free(cache);
+		cache = properties_new();
+
+		util_asprintf(&tmp, "%ld", (long)now);
+		properties_set(cache, EKMFWEB_CACHE_CREATED, tmp);
+		free(tmp);
+		properties_set(cache, EKMFWEB_CACHE_VALIDATION, validation);
+		ph->cache_modified = true;
+	} else {
+		pr_verbose(ph, "Key metadata cache '%s' loaded", file_name);
+	}
+
+	ph->cache = cache;
+
+	free(validation);
+	free(file_name);
+	return cache;
+}
+
+/**
+ * Closes the key metadata cache and saves it, if it was modified
+ *
+ * @param ph                the plugin handle
+ */
+static void _cache_close(struct plugin_handle *ph)
+{
+	char *file_name = NULL;
+	int rc;
+
+	if (ph->cache == NULL)
+		return;
+
+	if (ph->cache_modified) {
+		util_asprintf(&file_name, "%s/%s", ph->config_path,
+			      EKMFWEB_CACHE_FILE);
+
+		rc = properties_save(ph->cache, file_name, true);
+		if (rc == 0)
+			rc = _set_file_permission(ph, file_name);
+		if (rc != 0) {
+			pr_verbose(ph, "Failed to save key metadata cache "
+				   "'%s': %s", file_name, strerror(-rc));
+			remove(file_name);
+		}
+
+		free(file_name);
+	}
+
+	properties_free(ph->cache);
+	ph->cache = NULL;
+	ph->cache_modified = false;
+}
+
+/**
+ * Discards the key metadata cache. Called before a key is changed by the
+ * plugin. The cache is not used for the rest of the lifetime of the handle.
+ *
+ * @param ph                the plugin handle
+ */
+static void _cache_invalidate(struct plugin_handle *ph)
+{
+	char *file_name = NULL;
+
+	util_asprintf(&file_name, "%s/%s", ph->config_path,
+		      EKMFWEB_CACHE_FILE);
+	if (remove(file_name) != 0 && errno != ENOENT)
+		pr_verbose(ph, "Failed to remove key metadata cache '%s': %s",
+			   file_name, strerror(errno));
+	free(file_name);
+
+	if (ph->cache != NULL)
+		properties_free(ph->cache);
+	ph->cache = NULL;
+	ph->cache_checked = true;
+	ph->cache_modified = false;
+}
+
+/**
+ * Appends a base64 encoded field to a cache entry. Fields are separated by
+ * blanks, which do not occur in base64 encoded data.
+ *
+ * @param entry             the cache entry to append the field to, or NULL
+ *                          to start a new cache entry
+ * @param field             the field to append (can be NULL)
+ */
+static void _cache_add_field(char **entry, const char *field)
+{
+	char *encoded, *tmp;
+
+	encoded = _encode_passphrase(field != NULL ? field : "");
+	if (*entry == NULL) {
+		tmp = util_strdup(encoded != NULL ? encoded : "");
+	} else {
+		util_asprintf(&tmp, "%s %s", *entry,
+			      encoded != NULL ? encoded : "");
+		free(*entry);
+	}
+	free(encoded);
+	*entry = tmp;
+}
+
+/**
+ * Returns the next base64 decoded field of a cache entry
+ *
+ * @param pos               the position within the cache entry. It is
+ *                          updated to point to the next field.
+ *
+ * @returns an allocated string, or NULL if there is no further field
+ */
+static char *_cache_next_field(char **pos)
+{
+	char *field;
+
+	if (*pos == NULL)
+		return NULL;
+
+	field = strsep(pos, " ");
+	return _decode_passphrase(field);
+}
+
+/**
+ * Stores the metadata of a key in the key metadata cache
+ *
+ * @param ph                the plugin handle
+ * @param key_info          the key information to store
+ */
+static void _cache_store_key(struct plugin_handle *ph,
+			     const struct ekmf_key_info *key_info)
+{
+	char *name = NULL, *entry = NULL, num[32];
+	size_t i;
+
+	if (ph->cache == NULL)
+		return;
+
+	_cache_add_field(&entry, key_info->label);
+	_cache_add_field(&entry, key_info->state);
+	_cache_add_field(&entry, key_info->keystore_type);
+	_cache_add_field(&entry, key_info->key_type);
+	_cache_add_field(&entry, key_info->algorithm);
+	snprintf(num, sizeof(num), "%zu", key_info->key_size);
+	_cache_add_field(&entry, num);
+	_cache_add_field(&entry, key_info->export_control.export_allowed ?
+			 "1" : "0");
+	snprintf(num, sizeof(num), "%zu",
+		 key_info->export_control.num_exporting_keys);
+	_cache_add_field(&entry, num);
+	for (i = 0; i < key_info->export_control.num_exporting_keys; i++) {
+		_cache_add_field(&entry,
+			key_info->export_control.exporting_keys[i].uuid);
+		_cache_add_field(&entry,
+			key_info->export_control.exporting_keys[i].name);
+	}
+	snprintf(num, sizeof(num), "%zu", key_info->custom_tags.num_tags);
+	_cache_add_field(&entry, num);
+	for (i = 0; i < key_info->custom_tags.num_tags; i++) {
+		_cache_add_field(&entry, key_info->custom_tags.tags[i].name);
+		_cache_add_field(&entry, key_info->custom_tags.tags[i].value);
+	}
+
+	util_asprintf(&name, "%s%s", EKMFWEB_CACHE_KEY_PREFIX, key_info->uuid);
+
+	/* Longer lines can not be read by properties_load */
+	if (strlen(name) + strlen(entry) < EKMFWEB_CACHE_MAX_LINE &&
+	    properties_set(ph->cache, name, entry) == 0)
+		ph->cache_modified = true;
+	else
+		properties_remove(ph->cache, name);
+
+	free(name);
+	free(entry);
+}
+
+/**
+ * Gets the metadata of a key from the key metadata cache
+ *
+ * @param ph                the plugin handle
+ * @param key_uuid          the UUID of the key
+ *
+ * @returns an allocated key info struct that must be freed using
+ * ekmf_free_key_info, or NULL if the key is not in the cache.
+ */
+static struct ekmf_key_info *_cache_load_key(struct plugin_handle *ph,
+					     const char *key_uuid)
+{
+	char *name = NULL, *entry, *pos, *tmp;
+	struct ekmf_key_info *key_info;
+	unsigned long num;
+	bool valid = false;
+	size_t i;
+
+	if (ph->cache == NULL)
+		return NULL;
+
+	util_asprintf(&name, "%s%s", EKMFWEB_CACHE_KEY_PREFIX, key_uuid);
+	entry = properties_get(ph->cache, name);
+	free(name);
+	if (entry == NULL)
+		return NULL;
+
+	key_info = util_zalloc(sizeof(struct ekmf_key_info));
+	key_info->uuid = util_strdup(key_uuid);
+
+	pos = entry;
+	key_info->label = _cache_next_field(&pos);
+	key_info->state = _cache_next_field(&pos);
+	key_info->keystore_type = _cache_next_field(&pos);
+	key_info->key_type = _cache_next_field(&pos);
+	key_info->algorithm = _cache_next_field(&pos);
+	if (key_info->algorithm == NULL)
+		goto out;
+
+	tmp = _cache_next_field(&pos);
+	if (tmp == NULL)
+		goto out;
+	key_info->key_size = strtoul(tmp, NULL, 10);
+	free(tmp);
+
+	tmp = _cache_next_field(&pos);
+	if (tmp == NULL)
+		goto out;
+	key_info->export_control.export_allowed = strcmp(tmp, "1") == 0;
+	free(tmp);
+
+	tmp = _cache_next_field(&pos);
+	if (tmp == NULL)
+		goto out;
+	num = strtoul(tmp, NULL, 10);
+	free(tmp);
+	key_info->export_control.exporting_keys =
+		util_zalloc(sizeof(struct ekmf_exporting_key) * (num + 1));
+	for (i = 0; i < num; i++) {
+		key_info->export_control.exporting_keys[i].uuid =
+						_cache_next_field(&pos);
+		key_info->export_control.exporting_keys[i].name =
+						_cache_next_field(&pos);
+		key_info->export_control.num_exporting_keys++;
+		if (key_info->export_control.exporting_keys[i].name == NULL)
+			goto out;
+	}
+
+	tmp = _cache_next_field(&pos);
+	if (tmp == NULL)
+		goto out;
+	num = strtoul(tmp, NULL, 10);
+	free(tmp);
+	key_info->custom_tags.tags =
+		util_zalloc(sizeof(struct ekmf_tag) * (num + 1));
+	for (i = 0; i < num; i++) {
+		key_info->custom_tags.tags[i].name = _cache_next_field(&pos);
+		key_info->custom_tags.tags[i].value = _cache_next_field(&pos);
+		key_info->custom_tags.num_tags++;
+		if (key_info->custom_tags.tags[i].value == NULL)
+			goto out;
+	}
+
+	valid = pos == NULL;
+
+out:
+	free(entry);
+	if (!valid) {
+		pr_verbose(ph, "Key metadata cache entry for key '%s' is "
+			   "invalid", key_uuid);
+		ekmf_free_key_info(key_info);
+		return NULL;
+	}
+
+	return key_info;
+}
+
+/**
+ * Builds the identifier of a key list request from its filter criteria
+ *
+ * @param label_pattern     the label pattern (can be NULL)
+ * @param states            the state filter (can be NULL)
+ * @param tag_list          the custom tags filter
+ *
+ * @returns an allocated string
+ */
+static char *_cache_list_id(const char *label_pattern, const char *states,
+			    const struct ekmf_tag_list *tag_list)
+{
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digest_len, i;
+	char *query, *tmp, *id;
+
+	util_asprintf(&query, "%s\n%s", label_pattern != NULL ?
+		      label_pattern : "", states != NULL ? states : "");
+	for (i = 0; i < tag_list->num_tags; i++) {
+		util_asprintf(&tmp, "%s\n%s=%s", query,
+			      tag_list->tags[i].name,
+			      tag_list->tags[i].value != NULL ?
+					tag_list->tags[i].value : "");
+		free(query);
+		query = tmp;
+	}
+
+	if (EVP_Digest(query, strlen(query), digest, &digest_len,
+		       EVP_sha256(), NULL) != 1)
+		digest_len = 0;
+	free(query);
+
+	id = util_zalloc(digest_len * 2 + 1);
+	for (i = 0; i < digest_len; i++)
+		sprintf(&id[i * 2], "%02x", digest[i]);
+
+	return id;
+}
+
+/**
+ * Stores the UUIDs of the keys found by a key list request in the key
+ * metadata cache. The UUIDs are stored in chunks, so that the lines of the
+ * cache file do not get too long.
+ *
+ * @param ph                the plugin handle
+ * @param list_id           the identifier of the list request
+ * @param uuids             the UUIDs of the keys
+ * @param num_uuids         the number of UUIDs
+ */
+static void _cache_store_list(struct plugin_handle *ph, const char *list_id,
+			      char **uuids, size_t num_uuids)
+{
+	const char *chunk[EKMFWEB_CACHE_LIST_CHUNK + 1];
+	char *name = NULL, *value = NULL;
+	size_t i, k, num_chunks;
+
+	if (ph->cache == NULL || strlen(list_id) == 0)
+		return;
+
+	num_chunks = (num_uuids + EKMFWEB_CACHE_LIST_CHUNK - 1) /
+						EKMFWEB_CACHE_LIST_CHUNK;
+	for (i = 0; i < num_chunks; i++) {
+		for (k = 0; k < EKMFWEB_CACHE_LIST_CHUNK &&
+			    i * EKMFWEB_CACHE_LIST_CHUNK + k < num_uuids; k++)
+			chunk[k] = uuids[i * EKMFWEB_CACHE_LIST_CHUNK + k];
+		chunk[k] = NULL;
+
+		value = str_list_combine(chunk);
+		util_asprintf(&name, "%s%s.%zu", EKMFWEB_CACHE_LIST_PREFIX,
+			      list_id, i);
+		if (value == NULL || properties_set(ph->cache, name,
+						    value) != 0) {
+			free(name);
+			free(value);
+			return;
+		}
+		FREE_AND_SET_NULL(name);
+		FREE_AND_SET_NULL(value);
+	}
+
+	util_asprintf(&name, "%s%s", EKMFWEB_CACHE_LIST_PREFIX, list_id);
+	util_asprintf(&value, "%zu", num_chunks);
+	if (properties_set(ph->cache, name, value) == 0)
+		ph->cache_modified = true;
+	free(name);
+	free(value);
+}
+
+/**
+ * Gets the keys found by a key list request from the key metadata cache.
+ *
+ * @param ph                the plugin handle
+ * @param list_id           the identifier of the list request
+ * @param keys              On return: an allocated array of key info
+ *                          pointers. Each key info must be freed using
+ *                          ekmf_free_key_info.
+ * @param num_keys          On return: the number of keys in above array
+ *
+ * @returns 0 on success, or -ENOENT if the list is not in the cache
+ */
+static int _cache_load_list(struct plugin_handle *ph, const char *list_id,
+			    struct ekmf_key_info ***keys, size_t *num_keys)
+{
+	struct ekmf_key_info *key_info;
+	char *name = NULL, *value;
+	unsigned long num_chunks;
+	char **uuids;
+	size_t i, k;
+	int rc = 0;
+
+	*keys = NULL;
+	*num_keys = 0;
+
+	if (ph->cache == NULL || strlen(list_id) == 0)
+		return -ENOENT;
+
+	util_asprintf(&name, "%s%s", EKMFWEB_CACHE_LIST_PREFIX, list_id);
+	value = properties_get(ph->cache, name);
+	free(name);
+	if (value == NULL)
+		return -ENOENT;
+	num_chunks = strtoul(value, NULL, 10);
+	free(value);
+
+	for (i = 0; i < num_chunks && rc == 0; i++) {
+		util_asprintf(&name, "%s%s.%zu", EKMFWEB_CACHE_LIST_PREFIX,
+			      list_id, i);
+		value = properties_get(ph->cache, name);
+		FREE_AND_SET_NULL(name);
+		if (value == NULL) {
+			rc = -ENOENT;
+			break;
+		}
+
+		uuids = str_list_split(value);
+		free(value);
+		for (k = 0; uuids[k] != NULL; k++) {
+			key_info = _cache_load_key(ph, uuids[k]);
+			if (key_info == NULL) {
+				rc = -ENOENT;
+				break;
+			}
+			*keys = util_realloc(*keys, (*num_keys + 1) *
+					     sizeof(struct ekmf_key_info *));
+			(*keys)[(*num_keys)++] = key_info;
+		}
+		str_list_free_string_array(uuids);
+	}
+
+	if (rc != 0) {
+		for (i = 0; i < *num_keys; i++)
+			ekmf_free_key_info((*keys)[i]);
+		free(*keys);
+		*keys = NULL;
+		*num_keys = 0;
+	}
+
+	return rc;
+}
+
 /**
  * Initializes a KMS plugin for usage by zkey. When a repository is bound to a
  * KMS plugin, zkey calls this function when opening the repository.
@@ -680,6 +1215,7 @@ int kms_terminate(const kms_handle_t handle)
 
 	pr_verbose(ph, "Plugin terminated");
 
+	_cache_close(ph);
 	_free_ekmf_config(ph);
 	_unload_cca_library(ph);
 
@@ -3856,6 +4392,8 @@ int kms_configure(const kms_handle_t handle,
 
 	_clear_error(ph);
 
+	_cache_invalidate(ph);
+
 	if (apqns != NULL) {
 		if (num_apqns > 0) {
 			rc = _cross_check_apqns(ph, apqns, num_apqns);
@@ -4093,6 +4631,8 @@ int kms_deconfigure(const kms_handle_t handle)
 
 	_clear_error(ph);
 
+	_cache_invalidate(ph);
+
 	return 0;
 }
 
@@ -4772,6 +5312,8 @@ int kms_generate_key(const kms_handle_t handle, const char *key_type,
 		return -EINVAL;
 	}
 
+	_cache_invalidate(ph);
+
 	if (strcasecmp(key_type, KEY_TYPE_CCA_AESCIPHER) != 0) {
 		_set_error(ph, "Key type '%s' is not supported by EKMF Web",
 			   key_type);
@@ -4996,6 +5538,8 @@ int kms_set_key_properties(const kms_handle_t handle, const char *key_id,
 		return -EINVAL;
 	}
 
+	_cache_invalidate(ph);
+
 	rc = _properties_to_ekmf_tags(ph, properties, num_properties,
 				      &set_tag_list, false);
 	if (rc != 0)
@@ -5099,6 +5643,13 @@ int kms_get_key_properties(const kms_handle_t handle, const char *key_id,
 		return -EINVAL;
 	}
 
+	_cache_open(ph);
+	key_info = _cache_load_key(ph, key_id);
+	if (key_info != NULL) {
+		pr_verbose(ph, "Key '%s' found in key metadata cache", key_id);
+		goto found;
+	}
+
 	rc = ekmf_get_key_info(&ph->ekmf_config, &ph->curl_handle,
 			       key_id, &key_info, &error_msg, ph->verbose);
 	if (rc != 0) {
@@ -5108,6 +5659,9 @@ int kms_get_key_properties(const kms_handle_t handle, const char *key_id,
 		goto out;
 	}
 
+	_cache_store_key(ph, key_info);
+
+found:
 	rc = _ekmf_tags_to_properties(ph, &key_info->custom_tags, properties,
 				      num_properties);
 	if (rc != 0)
@@ -5307,6 +5861,8 @@ int kms_remove_key(const kms_handle_t handle, const char *key_id,
 	if (rc != 0)
 		goto out;
 
+	_cache_invalidate(ph);
+
 	rc = ekmf_set_key_state(&ph->ekmf_config, &ph->curl_handle,
 				key_id, state, key_info->updated_on,
 				&error_msg, ph->verbose);
@@ -5335,6 +5891,8 @@ struct list_data {
 	const char *exporting_key;
 	kms_list_callback callback;
 	void *private;
+	char **uuids;
+	size_t num_uuids;
 };
 
 /**
@@ -5422,6 +5980,14 @@ static int _list_callback(CURL *curl_handle, struct ekmf_key_info *key_info,
 		goto out;
 	if (strcmp(key_info->algorithm, EKMFWEB_KEY_ALGORITHM_AES) != 0)
 		goto out;
+
+	if (data->ph->cache != NULL) {
+		_cache_store_key(data->ph, key_info);
+		data->uuids = util_realloc(data->uuids, (data->num_uuids + 1) *
+					   sizeof(char *));
+		data->uuids[data->num_uuids++] = util_strdup(key_info->uuid);
+	}
+
 	if (!data->list_all && !_check_exportability(key_info,
 						     data->exporting_key))
 		goto out;
@@ -5493,13 +6059,15 @@ int kms_list_keys(const kms_handle_t handle, const char *label_pattern,
 		  kms_list_callback callback, void *private_data)
 {
 	struct ekmf_tag_list tag_list = { 0 };
+	struct ekmf_key_info **keys = NULL;
 	struct plugin_handle *ph = handle;
 	struct list_data data = { 0 };
 	char **state_list = NULL;
+	size_t i, num_keys = 0;
 	char *error_msg = NULL;
+	char *list_id = NULL;
 	char *states = NULL;
 	int rc = 0;
-	size_t i;
 
 	util_assert(handle != NULL, "Internal error: handle is NULL");
 	util_assert(num_properties == 0 || properties != NULL,
@@ -5584,6 +6152,18 @@ int kms_list_keys(const kms_handle_t handle, const char *label_pattern,
 	if (rc != 0)
 		goto out;
 
+	_cache_open(ph);
+	list_id = _cache_list_id(label_pattern, states, &tag_list);
+	if (_cache_load_list(ph, list_id, &keys, &num_keys) == 0) {
+		pr_verbose(ph, "Key list found in key metadata cache");
+		for (i = 0; i < num_keys && rc == 0; i++)
+			rc = _list_callback(ph->curl_handle, keys[i], &data);
+		if (rc != 0)
+			_set_error(ph, "Failed to list keys: %s",
+				   strerror(-rc));
+		goto out;
+	}
+
 	rc = ekmf_list_keys(&ph->ekmf_config, &ph->curl_handle,
 			    _list_callback, &data, label_pattern, states,
 			    &tag_list, &error_msg, ph->verbose);
@@ -5594,7 +6174,16 @@ int kms_list_keys(const kms_handle_t handle, const char *label_pattern,
 		goto out;
 	}
 
+	_cache_store_list(ph, list_id, data.uuids, data.num_uuids);
+
 out:
+	for (i = 0; i < num_keys; i++)
+		ekmf_free_key_info(keys[i]);
+	free(keys);
+	for (i = 0; i < data.num_uuids; i++)
+		free(data.uuids[i]);
+	free(data.uuids);
+	free(list_id);
 	if (states != NULL)
 		free(states);
 	if (state_list != NULL)
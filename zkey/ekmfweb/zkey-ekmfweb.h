@@ -32,6 +32,9 @@ struct plugin_handle {
 	struct ekmf_cca_lib cca;
 	struct ekmf_config ekmf_config;
 	CURL *curl_handle;
+	struct properties *cache;
+	bool cache_checked;
+	bool cache_modified;
 	char error_msg[1024];
 	bool verbose;
 };
@@ -43,6 +46,7 @@ struct plugin_handle {
 #define EKMFWEB_CONFIG_EKMFWEB_PUBKEY_FILE	"ekmfweb-pubkey.pem"
 #define EKMFWEB_CONFIG_IDENTITY_KEY_FILE	"identity-key.skey"
 #define EKMFWEB_CONFIG_IDENTITY_KEY_REENC_FILE	"identity-key.reenc"
+#define EKMFWEB_CACHE_FILE			"ekmfweb.cache"
 
 #define EKMFWEB_CONFIG_APQNS			"apqns"
 #define EKMFWEB_CONFIG_URL			"url"
@@ -81,6 +85,14 @@ struct plugin_handle {
 #define EKMFWEB_CONFIG_SESSION_RSA_SIGN_PSS	"session-rsa-sign-pss"
 #endif
 
+#define EKMFWEB_CACHE_CREATED			"created"
+#define EKMFWEB_CACHE_VALIDATION		"validation"
+#define EKMFWEB_CACHE_KEY_PREFIX		"key."
+#define EKMFWEB_CACHE_LIST_PREFIX		"list."
+#define EKMFWEB_CACHE_TTL			300
+#define EKMFWEB_CACHE_LIST_CHUNK		64
+#define EKMFWEB_CACHE_MAX_LINE			4000
+
 #define EKMFWEB_PASSCODE_URL			"/administration/passcode"
 #define EKMFWEB_TEMPLATE_STATE_ACTIVE		"ACTIVE"
 #define EKMFWEB_TEMPLATE_STATE_HISTORY		"HISTORY"
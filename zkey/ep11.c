@@ -171,9 +171,30 @@ int load_ep11_library(struct ep11_lib *ep11, bool verbose)
 	return get_ep11_version(ep11, verbose);
 }
 
+/**
+ * Frees an EP11 target handle, regardless of whether it is kept in the
+ * target cache
+ */
+static void _free_ep11_target(struct ep11_lib *ep11, target_t target)
+{
+	if (ep11->dll_m_rm_module != NULL) {
+		ep11->dll_m_rm_module(NULL, target);
+	} else {
+		/*
+		 * With the old target handling, target is a pointer to
+		 * ep11_target_t
+		 */
+		free((ep11_target_t *)target);
+	}
+}
+
 /**
  * Get an EP11 target handle for a specific APQN (card and domain)
  *
+ * Target handles are kept in the EP11 library structure, so that subsequent
+ * requests for the same APQN do not set up the target again. They are freed
+ * with free_ep11_targets().
+ *
  * @param[in] ep11          the EP11 library structure
  * @param[in] card          the card number
  * @param[in] domain        the domain number
@@ -188,11 +209,20 @@ int get_ep11_target_for_apqn(struct ep11_lib *ep11, unsigned int card,
 {
 	ep11_target_t *target_list;
 	struct XCP_Module module;
+	unsigned int i;
 	CK_RV rc;
 
 	util_assert(ep11 != NULL, "Internal error: ep11 is NULL");
 	util_assert(target != NULL, "Internal error: target is NULL");
 
+	for (i = 0; i < ep11->num_targets; i++) {
+		if (ep11->targets[i].card == card &&
+		    ep11->targets[i].domain == domain) {
+			*target = ep11->targets[i].target;
+			return 0;
+		}
+	}
+
 	*target = XCP_TGT_INIT;
 
 	if (ep11->dll_m_add_module != NULL) {
@@ -219,30 +249,52 @@ int get_ep11_target_for_apqn(struct ep11_lib *ep11, unsigned int card,
 		*target = (target_t)target_list;
 	}
 
+	if (ep11->num_targets < EP11_TARGET_CACHE_SIZE) {
+		ep11->targets[ep11->num_targets].card = card;
+		ep11->targets[ep11->num_targets].domain = domain;
+		ep11->targets[ep11->num_targets].target = *target;
+		ep11->num_targets++;
+	}
+
 	return 0;
 }
 
 /**
- * Free an EP11 target handle
+ * Free an EP11 target handle. Target handles that are kept in the EP11
+ * library structure are freed with free_ep11_targets() only.
  *
  * @param[in] ep11          the EP11 library structure
  * @param[in] target        the target handle to free
- *
- * @returns 0 on success, a negative errno in case of errors
  */
 void free_ep11_target_for_apqn(struct ep11_lib *ep11, target_t target)
 {
+	unsigned int i;
+
 	util_assert(ep11 != NULL, "Internal error: ep11 is NULL");
 
-	if (ep11->dll_m_rm_module != NULL) {
-		ep11->dll_m_rm_module(NULL, target);
-	} else {
-		/*
-		 * With the old target handling, target is a pointer to
-		 * ep11_target_t
-		 */
-		free((ep11_target_t *)target);
+	for (i = 0; i < ep11->num_targets; i++) {
+		if (ep11->targets[i].target == target)
+			return;
 	}
+
+	_free_ep11_target(ep11, target);
+}
+
+/**
+ * Free all EP11 target handles kept in the EP11 library structure. This
+ * must be called before the EP11 library is unloaded.
+ *
+ * @param[in] ep11          the EP11 library structure
+ */
+void free_ep11_targets(struct ep11_lib *ep11)
+{
+	unsigned int i;
+
+	util_assert(ep11 != NULL, "Internal error: ep11 is NULL");
+
+	for (i = 0; i < ep11->num_targets; i++)
+		_free_ep11_target(ep11, ep11->targets[i].target);
+	ep11->num_targets = 0;
 }
 
 struct find_mkvp_info {
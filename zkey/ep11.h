@@ -144,6 +144,14 @@ struct ep11_version {
 	unsigned int	major;
 };
 
+#define EP11_TARGET_CACHE_SIZE	16
+
+struct ep11_target_entry {
+	unsigned int	card;
+	unsigned int	domain;
+	target_t	target;
+};
+
 struct ep11_lib {
 	void *lib_ep11;
 	m_init_t dll_m_init;
@@ -154,6 +162,9 @@ struct ep11_lib {
 	xcpa_cmdblock_t dll_xcpa_cmdblock;
 	xcpa_internal_rv_t dll_xcpa_internal_rv;
 	struct ep11_version version;
+	/* Target handles kept by get_ep11_target_for_apqn() */
+	struct ep11_target_entry targets[EP11_TARGET_CACHE_SIZE];
+	unsigned int num_targets;
 };
 
 int load_ep11_library(struct ep11_lib *ep11, bool verbose);
@@ -164,6 +175,8 @@ int get_ep11_target_for_apqn(struct ep11_lib *ep11, unsigned int card,
 
 void free_ep11_target_for_apqn(struct ep11_lib *ep11, target_t target);
 
+void free_ep11_targets(struct ep11_lib *ep11);
+
 #define FLAG_SEL_EP11_MATCH_CUR_MKVP	0x01
 #define FLAG_SEL_EP11_NEW_MUST_BE_SET	0x80
 
@@ -11,9 +11,11 @@
 
 #include <argz.h>
 #include <dirent.h>
+#include <dlfcn.h>
 #include <err.h>
 #include <errno.h>
 #include <fnmatch.h>
+#include <poll.h>
 #include <regex.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,8 +23,10 @@
 #include <time.h>
 #include <unistd.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #include "lib/util_base.h"
 #include "lib/util_libc.h"
@@ -48,6 +52,8 @@ struct key_filenames {
 #define RENC_FILE_EXTENSION	".renc"
 
 #define LOCK_FILE_NAME		".lock"
+#define INDEX_FILE_NAME		".index"
+#define INDEX_FILE_VERSION	1
 
 #define VOLUME_TYPE_PLAIN	"plain"
 #define VOLUME_TYPE_LUKS2	"luks2"
@@ -941,6 +947,509 @@ static int _keystore_info_file_filter(const struct dirent *dirent)
 	return 0;
 }
 
+/*
+ * The keystore index caches the properties that are used to filter keys,
+ * so that filtered operations only load the properties of matching keys.
+ * An index entry is only used as long as the .info file of the key has the
+ * same inode, size, and modification time as recorded in the entry. The
+ * list of keys is read from the directory again if the modification time
+ * of the directory has changed.
+ */
+struct keystore_index_entry {
+	char *name;
+	char *volumes;
+	char *apqns;
+	char *volume_type;
+	char *key_type;
+	bool kms_bound;
+	bool cached;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+};
+
+struct keystore_index {
+	struct timespec dir_mtime;
+	struct keystore_index_entry *entries;
+	size_t num_entries;
+	bool dirty;
+};
+
+/**
+ * Frees the cached properties of an index entry
+ *
+ * @param[in] entry       the index entry
+ */
+static void _keystore_index_uncache_entry(struct keystore_index_entry *entry)
+{
+	free(entry->volumes);
+	free(entry->apqns);
+	free(entry->volume_type);
+	free(entry->key_type);
+	entry->volumes = NULL;
+	entry->apqns = NULL;
+	entry->volume_type = NULL;
+	entry->key_type = NULL;
+	entry->cached = false;
+}
+
+/**
+ * Frees all entries of the index
+ *
+ * @param[in] index       the index
+ */
+static void _keystore_index_free(struct keystore_index *index)
+{
+	size_t i;
+
+	for (i = 0; i < index->num_entries; i++) {
+		_keystore_index_uncache_entry(&index->entries[i]);
+		free(index->entries[i].name);
+	}
+	free(index->entries);
+	index->entries = NULL;
+	index->num_entries = 0;
+}
+
+/**
+ * Adds a new entry to the index
+ *
+ * @param[in] index       the index
+ * @param[in] name        the name of the key
+ *
+ * @returns the new entry
+ */
+static struct keystore_index_entry *_keystore_index_add(
+					struct keystore_index *index,
+					const char *name)
+{
+	struct keystore_index_entry *entry;
+
+	index->entries = util_realloc(index->entries,
+				      (index->num_entries + 1) *
+				      sizeof(struct keystore_index_entry));
+	entry = &index->entries[index->num_entries++];
+	memset(entry, 0, sizeof(*entry));
+	entry->name = util_strdup(name);
+	return entry;
+}
+
+/**
+ * Reads the index file of the keystore
+ *
+ * @param[in] keystore    the keystore
+ * @param[in] index       the index to fill
+ *
+ * @returns 0 for success, or a negative errno value if the index file does
+ *          not exist or is invalid. In the latter case the index is empty.
+ */
+static int _keystore_index_read(struct keystore *keystore,
+				struct keystore_index *index)
+{
+	struct keystore_index_entry *entry;
+	char *filename, *line = NULL;
+	char *fields[11], *ptr;
+	unsigned long long num;
+	unsigned int version;
+	size_t line_size = 0;
+	int i, rc = -EINVAL;
+	FILE *fp;
+
+	util_asprintf(&filename, "%s/%s", keystore->directory,
+		      INDEX_FILE_NAME);
+	fp = fopen(filename, "r");
+	if (fp == NULL) {
+		rc = -errno;
+		goto out;
+	}
+
+	if (getline(&line, &line_size, fp) < 0 ||
+	    sscanf(line, "zkey-index %u %ld %ld", &version,
+		   &index->dir_mtime.tv_sec, &index->dir_mtime.tv_nsec) != 3 ||
+	    version != INDEX_FILE_VERSION)
+		goto out_close;
+
+	while (getline(&line, &line_size, fp) >= 0) {
+		if (sscanf(line, "end %llu", &num) == 1) {
+			if (num == index->num_entries)
+				rc = 0;
+			break;
+		}
+		line[strcspn(line, "\n")] = '\0';
+		ptr = line;
+		for (i = 0; i < 11; i++) {
+			fields[i] = strsep(&ptr, "\t");
+			if (fields[i] == NULL)
+				goto out_close;
+		}
+
+		entry = _keystore_index_add(index, fields[0]);
+		entry->ino = strtoull(fields[1], NULL, 10);
+		entry->size = strtoll(fields[2], NULL, 10);
+		entry->mtime.tv_sec = strtol(fields[3], NULL, 10);
+		entry->mtime.tv_nsec = strtol(fields[4], NULL, 10);
+		entry->cached = strcmp(fields[5], "1") == 0;
+		if (!entry->cached)
+			continue;
+		entry->kms_bound = strcmp(fields[6], "1") == 0;
+		entry->volume_type = util_strdup(fields[7]);
+		entry->key_type = util_strdup(fields[8]);
+		entry->volumes = util_strdup(fields[9]);
+		entry->apqns = util_strdup(fields[10]);
+	}
+
+out_close:
+	fclose(fp);
+	free(line);
+	if (rc != 0) {
+		pr_verbose(keystore, "Index file '%s' is invalid", filename);
+		_keystore_index_free(index);
+	}
+out:
+	free(filename);
+	return rc;
+}
+
+/**
+ * Writes the index file of the keystore
+ *
+ * Entries of keys that were changed within the last seconds are written as
+ * not cached, because a further change within the granularity of the file
+ * time stamps would not be detected.
+ *
+ * @param[in] keystore    the keystore
+ * @param[in] index       the index to write
+ *
+ * @returns 0 for success, or a negative errno value in case of an error
+ */
+static int _keystore_index_write(struct keystore *keystore,
+				 struct keystore_index *index)
+{
+	struct keystore_index_entry *entry;
+	char *filename;
+	struct stat sb;
+	bool created;
+	time_t now;
+	size_t i;
+	FILE *fp;
+	int rc;
+
+	util_asprintf(&filename, "%s/%s", keystore->directory,
+		      INDEX_FILE_NAME);
+	created = !util_path_exists("%s", filename);
+	now = time(NULL);
+again:
+	fp = fopen(filename, "w");
+	if (fp == NULL) {
+		rc = -errno;
+		pr_verbose(keystore, "Failed to write index file '%s': %s",
+			   filename, strerror(-rc));
+		goto out;
+	}
+
+	fprintf(fp, "zkey-index %u %ld %ld\n", INDEX_FILE_VERSION,
+		index->dir_mtime.tv_sec, index->dir_mtime.tv_nsec);
+	for (i = 0; i < index->num_entries; i++) {
+		entry = &index->entries[i];
+		if (entry->cached && entry->mtime.tv_sec + 2 < now)
+			fprintf(fp, "%s\t%llu\t%lld\t%ld\t%ld\t1\t%d\t%s\t%s\t"
+				"%s\t%s\n", entry->name,
+				(unsigned long long)entry->ino,
+				(long long)entry->size, entry->mtime.tv_sec,
+				entry->mtime.tv_nsec, entry->kms_bound,
+				entry->volume_type, entry->key_type,
+				entry->volumes, entry->apqns);
+		else
+			fprintf(fp, "%s\t0\t0\t0\t0\t0\t0\t\t\t\t\n",
+				entry->name);
+	}
+	fprintf(fp, "end %zu\n", index->num_entries);
+
+	rc = fclose(fp) == 0 ? 0 : -errno;
+	if (rc != 0) {
+		pr_verbose(keystore, "Failed to write index file '%s': %s",
+			   filename, strerror(-rc));
+		goto out;
+	}
+
+	if (created) {
+		rc = _keystore_set_file_permission(keystore, filename);
+		if (rc != 0)
+			goto out;
+		/*
+		 * Creating the index file has changed the directory, write
+		 * the index once more with the new modification time.
+		 */
+		created = false;
+		if (stat(keystore->directory, &sb) == 0) {
+			index->dir_mtime = sb.st_mtim;
+			goto again;
+		}
+	}
+
+out:
+	free(filename);
+	return rc;
+}
+
+/**
+ * Checks if a string can be stored in the index file
+ */
+static bool _keystore_index_valid_string(const char *str)
+{
+	return strpbrk(str, "\t\n") == NULL;
+}
+
+/**
+ * Updates the cached properties of an index entry, if the .info file of the
+ * key has changed since the entry was cached.
+ *
+ * @param[in] keystore    the keystore
+ * @param[in] index       the index
+ * @param[in] entry       the entry to update
+ */
+static void _keystore_index_update_entry(struct keystore *keystore,
+					 struct keystore_index *index,
+					 struct keystore_index_entry *entry)
+{
+	struct key_filenames file_names = { NULL, NULL, NULL };
+	struct properties *key_props;
+	char *volumes, *apqns;
+	struct stat sb;
+
+	util_asprintf(&file_names.info_filename, "%s/%s%s",
+		      keystore->directory, entry->name, INFO_FILE_EXTENSION);
+	if (stat(file_names.info_filename, &sb) != 0) {
+		if (entry->cached)
+			index->dirty = true;
+		_keystore_index_uncache_entry(entry);
+		goto out;
+	}
+	if (entry->cached && entry->ino == sb.st_ino &&
+	    entry->size == sb.st_size &&
+	    entry->mtime.tv_sec == sb.st_mtim.tv_sec &&
+	    entry->mtime.tv_nsec == sb.st_mtim.tv_nsec)
+		goto out;
+
+	_keystore_index_uncache_entry(entry);
+	index->dirty = true;
+	entry->ino = sb.st_ino;
+	entry->size = sb.st_size;
+	entry->mtime = sb.st_mtim;
+
+	key_props = properties_new();
+	if (properties_load(key_props, file_names.info_filename, 1) != 0)
+		goto free_prop;
+
+	volumes = properties_get(key_props, PROP_NAME_VOLUMES);
+	apqns = properties_get(key_props, PROP_NAME_APQNS);
+	entry->volumes = volumes != NULL ? volumes : util_strdup("");
+	entry->apqns = apqns != NULL ? apqns : util_strdup("");
+	entry->volume_type = _keystore_get_volume_type(key_props);
+	entry->key_type = _keystore_get_key_type(key_props);
+	entry->kms_bound = _keystore_is_kms_bound_key(key_props, NULL);
+	entry->cached = true;
+
+	if (!_keystore_index_valid_string(entry->name) ||
+	    !_keystore_index_valid_string(entry->volumes) ||
+	    !_keystore_index_valid_string(entry->apqns) ||
+	    !_keystore_index_valid_string(entry->volume_type) ||
+	    !_keystore_index_valid_string(entry->key_type))
+		_keystore_index_uncache_entry(entry);
+
+free_prop:
+	properties_free(key_props);
+out:
+	_keystore_free_key_filenames(&file_names);
+}
+
+static int _keystore_index_entry_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct keystore_index_entry *)a)->name,
+		      ((const struct keystore_index_entry *)b)->name);
+}
+
+/**
+ * Reads the list of keys from the keystore directory. Entries of keys that
+ * still exist are kept, the entries are ordered like the directory entries.
+ *
+ * @param[in] keystore    the keystore
+ * @param[in] index       the index
+ *
+ * @returns 0 for success, or a negative errno value in case of an error
+ */
+static int _keystore_index_scan(struct keystore *keystore,
+				struct keystore_index *index)
+{
+	struct keystore_index_entry *old_entries, *entry, key;
+	struct dirent **namelist;
+	size_t num_old_entries;
+	int n, i, len;
+	bool *moved;
+	char *name;
+
+	n = scandir(keystore->directory, &namelist, _keystore_info_file_filter,
+		    alphasort);
+	if (n == -1) {
+		n = -errno;
+		pr_verbose(keystore, "scandir failed with: %s", strerror(-n));
+		return n;
+	}
+
+	old_entries = index->entries;
+	num_old_entries = index->num_entries;
+	qsort(old_entries, num_old_entries, sizeof(struct keystore_index_entry),
+	      _keystore_index_entry_cmp);
+	index->entries = NULL;
+	index->num_entries = 0;
+	moved = util_zalloc(num_old_entries * sizeof(bool) + 1);
+
+	for (i = 0; i < n; i++) {
+		name = namelist[i]->d_name;
+		len = strlen(name);
+		if (len > FILE_EXTENSION_LEN)
+			name[len - FILE_EXTENSION_LEN] = '\0';
+
+		key.name = name;
+		entry = bsearch(&key, old_entries, num_old_entries,
+				sizeof(struct keystore_index_entry),
+				_keystore_index_entry_cmp);
+		if (entry != NULL) {
+			index->entries = util_realloc(index->entries,
+					(index->num_entries + 1) *
+					sizeof(struct keystore_index_entry));
+			index->entries[index->num_entries++] = *entry;
+			moved[entry - old_entries] = true;
+		} else {
+			_keystore_index_add(index, name);
+		}
+		free(namelist[i]);
+	}
+	free(namelist);
+
+	/* Free entries of keys that no longer exist */
+	for (i = 0; i < (int)num_old_entries; i++) {
+		if (moved[i])
+			continue;
+		_keystore_index_uncache_entry(&old_entries[i]);
+		free(old_entries[i].name);
+	}
+	free(old_entries);
+	free(moved);
+
+	index->dirty = true;
+	return 0;
+}
+
+/**
+ * Reads the index of the keystore and brings it up to date.
+ *
+ * @param[in] keystore    the keystore
+ * @param[in] index       the index to fill
+ *
+ * @returns 0 for success, or a negative errno value in case of an error
+ */
+static int _keystore_index_refresh(struct keystore *keystore,
+				   struct keystore_index *index)
+{
+	struct stat sb;
+	size_t i;
+	int rc;
+
+	memset(index, 0, sizeof(*index));
+
+	if (stat(keystore->directory, &sb) != 0) {
+		rc = -errno;
+		pr_verbose(keystore, "stat failed with: %s", strerror(-rc));
+		return rc;
+	}
+
+	rc = _keystore_index_read(keystore, index);
+	if (rc != 0 || index->dir_mtime.tv_sec != sb.st_mtim.tv_sec ||
+	    index->dir_mtime.tv_nsec != sb.st_mtim.tv_nsec) {
+		pr_verbose(keystore, "Rebuilding the keystore index");
+		rc = _keystore_index_scan(keystore, index);
+		if (rc != 0) {
+			_keystore_index_free(index);
+			return rc;
+		}
+		index->dir_mtime = sb.st_mtim;
+	}
+
+	for (i = 0; i < index->num_entries; i++)
+		_keystore_index_update_entry(keystore, index,
+					     &index->entries[i]);
+
+	/* A failure to write the index is not fatal */
+	if (index->dirty)
+		_keystore_index_write(keystore, index);
+
+	return 0;
+}
+
+/**
+ * Checks if the cached properties of an index entry match the filters.
+ * Entries without cached properties always match, the properties of such
+ * keys are checked after they are loaded.
+ *
+ * @returns 1 for a match, 0 for not matched
+ */
+static int _keystore_index_match(struct keystore *keystore,
+				 struct keystore_index_entry *entry,
+				 char **vol_filter_list,
+				 char **apqn_filter_list,
+				 const char *volume_type,
+				 const char *key_type,
+				 bool local, bool kms_bound)
+{
+	if (!entry->cached)
+		return 1;
+
+	if (vol_filter_list != NULL &&
+	    _keystore_match_filter(entry->volumes, vol_filter_list,
+				   NULL) == 0) {
+		pr_verbose(keystore,
+			   "Key '%s' filtered out due to volumes filter",
+			   entry->name);
+		return 0;
+	}
+	if (apqn_filter_list != NULL &&
+	    _keystore_match_filter(entry->apqns, apqn_filter_list,
+				   _keystore_apqn_match) == 0) {
+		pr_verbose(keystore,
+			   "Key '%s' filtered out due to APQN filter",
+			   entry->name);
+		return 0;
+	}
+	if (volume_type != NULL &&
+	    strcasecmp(entry->volume_type, volume_type) != 0) {
+		pr_verbose(keystore,
+			   "Key '%s' filtered out due to volume type",
+			   entry->name);
+		return 0;
+	}
+	if (key_type != NULL && strcasecmp(entry->key_type, key_type) != 0) {
+		pr_verbose(keystore,
+			   "Key '%s' filtered out due to key type",
+			   entry->name);
+		return 0;
+	}
+	if (local && entry->kms_bound) {
+		pr_verbose(keystore,
+			   "Key '%s' filtered out because it is KMS "
+			   "bound", entry->name);
+		return 0;
+	}
+	if (kms_bound && !entry->kms_bound) {
+		pr_verbose(keystore,
+			   "Key '%s' filtered out because it is not "
+			   "KMS bound", entry->name);
+		return 0;
+	}
+
+	return 1;
+}
+
 typedef int (*process_key_t)(struct keystore *keystore,
 			     const char *name, struct properties *properties,
 			     struct key_filenames *file_names, void *private);
@@ -988,12 +1497,12 @@ static int _keystore_process_filtered(struct keystore *keystore,
 	struct key_filenames file_names = { NULL, NULL, NULL };
 	char **apqn_filter_list = NULL;
 	char **vol_filter_list = NULL;
+	struct keystore_index index;
 	struct properties *key_props;
-	struct dirent **namelist;
-	int n, i, rc = 0;
 	bool skip = 0;
+	int rc = 0;
 	char *name;
-	int len;
+	size_t i;
 
 	pr_verbose(keystore, "Process_filtered: name_filter = '%s', "
 		   "volume_filter = '%s', apqn_filter = '%s'",
@@ -1006,33 +1515,31 @@ static int _keystore_process_filtered(struct keystore *keystore,
 	if (apqn_filter != NULL)
 		apqn_filter_list = str_list_split(apqn_filter);
 
-	n = scandir(keystore->directory, &namelist, _keystore_info_file_filter,
-		    alphasort);
-	if (n == -1) {
-		rc = -errno;
-		pr_verbose(keystore, "scandir failed with: %s", strerror(-rc));
-		return rc;
-	}
-
-	for (i = 0; i < n ; i++) {
-		if (skip)
-			goto free;
+	rc = _keystore_index_refresh(keystore, &index);
+	if (rc != 0)
+		goto out;
 
-		name = namelist[i]->d_name;
-		len = strlen(name);
-		if (len > FILE_EXTENSION_LEN)
-			name[len - FILE_EXTENSION_LEN] = '\0';
+	for (i = 0; i < index.num_entries; i++) {
+		name = index.entries[i].name;
 
 		if (_keystore_match_name_filter(name, name_filter) == 0) {
 			pr_verbose(keystore,
 				   "Key '%s' filtered out due to name filter",
 				   name);
-			goto free;
+			continue;
+		}
+
+		if (_keystore_index_match(keystore, &index.entries[i],
+					  vol_filter_list, apqn_filter_list,
+					  volume_type, key_type, local,
+					  kms_bound) == 0) {
+			rc = 0;
+			continue;
 		}
 
 		rc = _keystore_get_key_filenames(keystore, name, &file_names);
 		if (rc != 0)
-			goto free;
+			continue;
 
 		rc = _keystore_ensure_keyfiles_exist(&file_names, name);
 		if (rc != 0)
@@ -1111,11 +1618,12 @@ free_prop:
 		properties_free(key_props);
 free_names:
 		_keystore_free_key_filenames(&file_names);
-free:
-		free(namelist[i]);
+		if (skip)
+			break;
 	}
-	free(namelist);
+	_keystore_index_free(&index);
 
+out:
 	if (vol_filter_list)
 		str_list_free_string_array(vol_filter_list);
 	if (apqn_filter_list)
@@ -3056,6 +3564,7 @@ struct reencipher_info {
 	struct reencipher_params params;
 	int pkey_fd;
 	struct ext_lib *lib;
+	unsigned int apqn_offset;
 	unsigned long num_reenciphered;
 	unsigned long num_failed;
 	unsigned long num_skipped;
@@ -3164,6 +3673,32 @@ static int _keystore_perform_reencipher(struct keystore *keystore,
 	return 0;
 }
 
+/**
+ * Rotates a list of APQNs, so that the APQN at position offset (modulo the
+ * number of APQNs) comes first.
+ *
+ * @param[in] apqn_list  the list of APQNs
+ * @param[in] offset     the number of positions to rotate the list
+ *
+ * @returns a comma separated string of the rotated APQNs. The caller must free
+ *          the string.
+ */
+static char *_keystore_rotate_apqns(char **apqn_list, unsigned int offset)
+{
+	const char **rotated;
+	unsigned int i, num;
+	char *apqns;
+
+	for (num = 0; apqn_list[num] != NULL; num++)
+		;
+	rotated = util_zalloc((num + 1) * sizeof(char *));
+	for (i = 0; i < num; i++)
+		rotated[i] = apqn_list[(i + offset) % num];
+	apqns = str_list_combine(rotated);
+	free(rotated);
+	return apqns;
+}
+
 /**
  * Processing function for the key re-enciphering function.
  *
@@ -3229,6 +3764,12 @@ static int _keystore_process_reencipher(struct keystore *keystore,
 	if (apqns != NULL)
 		apqn_list = str_list_split(apqns);
 
+	/* Parallel workers start with different APQNs of the key */
+	if (apqn_list != NULL && apqn_list[0] != NULL && info->apqn_offset > 0) {
+		free(apqns);
+		apqns = _keystore_rotate_apqns(apqn_list, info->apqn_offset);
+	}
+
 	rc = validate_secure_key(info->pkey_fd, secure_key, secure_key_size,
 				 &clear_key_bitsize, &is_old_mk,
 				 (const char **)apqn_list, keystore->verbose);
@@ -3347,6 +3888,570 @@ out:
 	return rc;
 }
 
+#define REENCIPHER_JOURNAL_NAME	".reencipher"
+
+struct reencipher_keys {
+	char **names;
+	size_t num_names;
+	size_t size;
+};
+
+/*
+ * Result of a key re-enciphered by a worker process. It is followed by the
+ * standard output and the standard error output of the worker for this key.
+ */
+struct reencipher_result {
+	size_t index;
+	int status; /* 0 = re-enciphered, 1 = skipped, < 0 = failed */
+	size_t out_len;
+	size_t err_len;
+};
+
+/**
+ * Processing function that collects the names of the keys to re-encipher.
+ *
+ * @param[in] keystore   the keystore (not used here)
+ * @param[in] name       the name of the key
+ * @param[in] properties the properties object of the key (not used here)
+ * @param[in] file_names the file names used by this key (not used here)
+ * @param[in] private    private data: struct reencipher_keys
+ *
+ * @returns 0
+ */
+static int _keystore_collect_reencipher_key(struct keystore *UNUSED(keystore),
+					    const char *name,
+					    struct properties
+							*UNUSED(properties),
+					    struct key_filenames
+							*UNUSED(file_names),
+					    void *private)
+{
+	struct reencipher_keys *keys = (struct reencipher_keys *)private;
+
+	if (keys->num_names >= keys->size) {
+		keys->size = keys->size ? keys->size * 2 : 64;
+		keys->names = util_realloc(keys->names,
+					   keys->size * sizeof(char *));
+	}
+	keys->names[keys->num_names++] = util_strdup(name);
+	return 0;
+}
+
+static int _keystore_compare_names(const void *a, const void *b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/**
+ * Opens the journal of a parallel re-enciphering run. The journal lists the
+ * keys that have already been re-enciphered successfully. If a journal of an
+ * interrupted run with the same re-enciphering parameters exists, then the
+ * keys listed in it are marked as done and the journal is continued.
+ * Otherwise a new journal is started.
+ *
+ * @param[in] keystore   the keystore
+ * @param[in] params     reenciphering parameters
+ * @param[in] keys       the keys to re-encipher, sorted by name
+ * @param[out] done      an array that receives which keys are already done
+ * @param[out] num_done  the number of keys that are already done
+ * @param[out] journal   the opened journal
+ *
+ * @returns 0 for success or a negative errno in case of an error
+ */
+static int _keystore_reencipher_journal_open(struct keystore *keystore,
+					     struct reencipher_params *params,
+					     struct reencipher_keys *keys,
+					     bool *done, size_t *num_done,
+					     FILE **journal)
+{
+	char *filename, *header, *line = NULL, **found;
+	size_t line_size = 0;
+	bool resume = false;
+	ssize_t len;
+	FILE *fp;
+	int rc;
+
+	*num_done = 0;
+	util_asprintf(&filename, "%s/%s", keystore->directory,
+		      REENCIPHER_JOURNAL_NAME);
+	util_asprintf(&header, "zkey-reencipher from-old=%d to-new=%d "
+		      "in-place=%d complete=%d\n", params->from_old,
+		      params->to_new, params->inplace, params->complete);
+
+	fp = fopen(filename, "r");
+	if (fp != NULL) {
+		len = getline(&line, &line_size, fp);
+		if (len > 0 && strcmp(line, header) == 0) {
+			resume = true;
+			while ((len = getline(&line, &line_size, fp)) > 0) {
+				if (line[len - 1] == '\n')
+					line[len - 1] = '\0';
+				found = bsearch(&line, keys->names,
+						keys->num_names,
+						sizeof(char *),
+						_keystore_compare_names);
+				if (found == NULL || done[found - keys->names])
+					continue;
+				done[found - keys->names] = true;
+				(*num_done)++;
+			}
+		} else {
+			pr_verbose(keystore, "Discarding the journal '%s' of a "
+				   "re-enciphering run with other parameters",
+				   filename);
+		}
+		fclose(fp);
+	}
+
+	fp = fopen(filename, resume ? "a" : "w");
+	if (fp == NULL) {
+		rc = -errno;
+		warnx("Failed to open the re-enciphering journal '%s': %s",
+		      filename, strerror(-rc));
+		goto out;
+	}
+	if (!resume) {
+		rc = _keystore_set_file_permission(keystore, filename);
+		if (rc != 0) {
+			fclose(fp);
+			goto out;
+		}
+		fputs(header, fp);
+		fflush(fp);
+	}
+
+	if (*num_done > 0) {
+		printf("Resuming an interrupted re-enciphering: %lu keys "
+		       "have already been re-enciphered and are skipped. "
+		       "Remove file '%s' to re-encipher them again.\n\n",
+		       *num_done, filename);
+	}
+
+	*journal = fp;
+	rc = 0;
+
+out:
+	free(line);
+	free(header);
+	free(filename);
+	return rc;
+}
+
+/**
+ * Removes the journal of a parallel re-enciphering run
+ *
+ * @param[in] keystore   the keystore
+ */
+static void _keystore_reencipher_journal_remove(struct keystore *keystore)
+{
+	char *filename;
+
+	util_asprintf(&filename, "%s/%s", keystore->directory,
+		      REENCIPHER_JOURNAL_NAME);
+	if (remove(filename) != 0 && errno != ENOENT)
+		pr_verbose(keystore, "Failed to remove '%s': %s", filename,
+			   strerror(errno));
+	free(filename);
+}
+
+static int _keystore_write_fully(int fd, const void *buf, size_t len)
+{
+	const char *pos = buf;
+	ssize_t rc;
+
+	while (len > 0) {
+		rc = write(fd, pos, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		pos += rc;
+		len -= rc;
+	}
+	return 0;
+}
+
+/*
+ * Returns 1 if len bytes have been read, 0 at end of file, or a negative
+ * errno in case of an error
+ */
+static int _keystore_read_fully(int fd, void *buf, size_t len)
+{
+	char *pos = buf;
+	ssize_t rc;
+
+	while (len > 0) {
+		rc = read(fd, pos, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (rc == 0)
+			return pos == buf ? 0 : -EIO;
+		pos += rc;
+		len -= rc;
+	}
+	return 1;
+}
+
+/**
+ * Re-enciphers a single key by name
+ *
+ * @param[in] keystore   the keystore
+ * @param[in] name       the name of the key
+ * @param[in] info       the re-encipher info
+ */
+static void _keystore_reencipher_by_name(struct keystore *keystore,
+					 const char *name,
+					 struct reencipher_info *info)
+{
+	struct key_filenames file_names = { NULL, NULL, NULL };
+	struct properties *key_props;
+	int rc;
+
+	rc = _keystore_get_key_filenames(keystore, name, &file_names);
+	if (rc != 0) {
+		info->num_failed++;
+		return;
+	}
+
+	key_props = properties_new();
+	rc = properties_load(key_props, file_names.info_filename, 1);
+	if (rc != 0) {
+		warnx("Key '%s' does not exist or is invalid", name);
+		info->num_failed++;
+	} else {
+		_keystore_process_reencipher(keystore, name, key_props,
+					     &file_names, info);
+	}
+
+	properties_free(key_props);
+	_keystore_free_key_filenames(&file_names);
+}
+
+/**
+ * Main function of a re-encipher worker process. It takes the next key that
+ * is not yet done from the shared key counter until all keys are taken, and
+ * reports the result and the output for each key through a pipe.
+ *
+ * Each worker loads its own CCA or EP11 library, because selecting an APQN
+ * for the library affects the whole process.
+ *
+ * @param[in] keystore   the keystore
+ * @param[in] info       the re-encipher info
+ * @param[in] keys       the keys to re-encipher
+ * @param[in] done       which keys are already done
+ * @param[in] next_key   the shared key counter
+ * @param[in] worker     the number of the worker
+ * @param[in] fd         the write end of the result pipe
+ *
+ * @returns the exit code of the worker process
+ */
+static int _keystore_reencipher_worker(struct keystore *keystore,
+				       struct reencipher_info *info,
+				       struct reencipher_keys *keys,
+				       bool *done, unsigned long *next_key,
+				       unsigned int worker, int fd)
+{
+	struct ep11_lib ep11 = { 0 };
+	struct cca_lib cca = { 0 };
+	struct ext_lib lib = { .cca = &cca, .ep11 = &ep11 };
+	FILE *real_stdout = stdout, *real_stderr = stderr;
+	struct reencipher_info winfo = *info;
+	struct reencipher_result result;
+	char *out = NULL, *err = NULL;
+	size_t index;
+	int rc = 0;
+
+	winfo.lib = &lib;
+	winfo.apqn_offset = worker;
+
+	while ((index = __atomic_fetch_add(next_key, 1, __ATOMIC_RELAXED)) <
+							keys->num_names) {
+		if (done[index])
+			continue;
+
+		memset(&result, 0, sizeof(result));
+		/* Collect the output, so that it is not mixed up with others */
+		stdout = open_memstream(&out, &result.out_len);
+		stderr = open_memstream(&err, &result.err_len);
+		if (stdout == NULL || stderr == NULL) {
+			stdout = real_stdout;
+			stderr = real_stderr;
+			warn("Failed to re-encipher key '%s'",
+			     keys->names[index]);
+			rc = -ENOMEM;
+			break;
+		}
+
+		winfo.num_reenciphered = 0;
+		winfo.num_skipped = 0;
+		winfo.num_failed = 0;
+		_keystore_reencipher_by_name(keystore, keys->names[index],
+					     &winfo);
+
+		fclose(stdout);
+		fclose(stderr);
+		stdout = real_stdout;
+		stderr = real_stderr;
+
+		result.index = index;
+		if (winfo.num_failed > 0)
+			result.status = -EIO;
+		else if (winfo.num_skipped > 0)
+			result.status = 1;
+		else
+			result.status = 0;
+
+		rc = _keystore_write_fully(fd, &result, sizeof(result));
+		if (rc == 0)
+			rc = _keystore_write_fully(fd, out, result.out_len);
+		if (rc == 0)
+			rc = _keystore_write_fully(fd, err, result.err_len);
+		free(out);
+		free(err);
+		if (rc != 0)
+			break;
+	}
+
+	close(fd);
+	if (cca.lib_csulcca)
+		dlclose(cca.lib_csulcca);
+	if (ep11.lib_ep11) {
+		free_ep11_targets(&ep11);
+		dlclose(ep11.lib_ep11);
+	}
+	return rc != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * Reads a result of a worker process, prints its output and accounts it.
+ *
+ * @param[in] keystore   the keystore
+ * @param[in] fd         the read end of the result pipe
+ * @param[in] info       the re-encipher info
+ * @param[in] keys       the keys to re-encipher
+ * @param[in] reported   which keys have been reported
+ * @param[in] journal    the journal
+ *
+ * @returns 1 if a result was processed, 0 if the worker has ended, or a
+ *          negative errno value in case of an error
+ */
+static int _keystore_reencipher_result(struct keystore *keystore, int fd,
+				       struct reencipher_info *info,
+				       struct reencipher_keys *keys,
+				       bool *reported, FILE *journal)
+{
+	struct reencipher_result result;
+	char *out, *err;
+	int rc;
+
+	rc = _keystore_read_fully(fd, &result, sizeof(result));
+	if (rc <= 0)
+		return rc;
+	if (result.index >= keys->num_names)
+		return -EIO;
+
+	out = util_malloc(result.out_len + 1);
+	err = util_malloc(result.err_len + 1);
+	rc = _keystore_read_fully(fd, out, result.out_len);
+	if (rc >= 0)
+		rc = _keystore_read_fully(fd, err, result.err_len);
+	if (rc < 0 || (rc == 0 && result.out_len + result.err_len > 0)) {
+		rc = -EIO;
+		goto out;
+	}
+
+	fwrite(out, 1, result.out_len, stdout);
+	fflush(stdout);
+	fwrite(err, 1, result.err_len, stderr);
+
+	reported[result.index] = true;
+	if (result.status < 0) {
+		info->num_failed++;
+	} else if (result.status > 0) {
+		info->num_skipped++;
+	} else {
+		info->num_reenciphered++;
+		fprintf(journal, "%s\n", keys->names[result.index]);
+		fflush(journal);
+	}
+	pr_verbose(keystore, "Key '%s' processed with status %d",
+		   keys->names[result.index], result.status);
+	rc = 1;
+
+out:
+	free(out);
+	free(err);
+	return rc;
+}
+
+/**
+ * Re-enciphers the selected keys in parallel worker processes.
+ *
+ * The keys successfully re-enciphered are recorded in a journal in the
+ * keystore directory. When a run is interrupted or some keys fail, the same
+ * command skips the keys already done. The journal is removed once all keys
+ * have been processed without failures.
+ *
+ * @param[in] keystore     the keystore
+ * @param[in] name_filter  the name filter to select the key (can be NULL)
+ * @param[in] apqn_filter  the APQN filter to select the key (can be NULL)
+ * @param[in] info         the re-encipher info
+ * @param[in] jobs         the number of worker processes
+ *
+ * @returns 0 for success or a negative errno in case of an error
+ */
+static int _keystore_reencipher_parallel(struct keystore *keystore,
+					 const char *name_filter,
+					 const char *apqn_filter,
+					 struct reencipher_info *info,
+					 unsigned int jobs)
+{
+	struct reencipher_keys keys = { NULL, 0, 0 };
+	unsigned long *next_key = MAP_FAILED;
+	unsigned int i, started = 0, active;
+	struct pollfd *fds = NULL;
+	bool *reported = NULL;
+	bool *done = NULL;
+	FILE *journal = NULL;
+	size_t k, num_done;
+	pid_t *pids = NULL;
+	int pfd[2];
+	int rc;
+
+	rc = _keystore_process_filtered(keystore, name_filter, NULL,
+					apqn_filter, NULL, NULL, false, false,
+					_keystore_collect_reencipher_key,
+					&keys);
+	if (rc != 0 || keys.num_names == 0)
+		goto out;
+
+	qsort(keys.names, keys.num_names, sizeof(char *),
+	      _keystore_compare_names);
+	done = util_zalloc(keys.num_names * sizeof(bool));
+	reported = util_zalloc(keys.num_names * sizeof(bool));
+
+	rc = _keystore_reencipher_journal_open(keystore, &info->params, &keys,
+					       done, &num_done, &journal);
+	if (rc != 0)
+		goto out;
+	if (num_done == keys.num_names)
+		goto out;
+	if (jobs > keys.num_names - num_done)
+		jobs = keys.num_names - num_done;
+
+	next_key = mmap(NULL, sizeof(*next_key), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (next_key == MAP_FAILED) {
+		rc = -errno;
+		warnx("Failed to set up the re-encipher workers: %s",
+		      strerror(-rc));
+		goto out;
+	}
+	*next_key = 0;
+
+	pr_verbose(keystore, "Re-enciphering %lu keys with %u workers",
+		   keys.num_names - num_done, jobs);
+
+	fds = util_zalloc(jobs * sizeof(struct pollfd));
+	pids = util_zalloc(jobs * sizeof(pid_t));
+	fflush(stdout);
+	fflush(stderr);
+	for (i = 0; i < jobs; i++) {
+		if (pipe(pfd) != 0) {
+			rc = -errno;
+			break;
+		}
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			rc = -errno;
+			close(pfd[0]);
+			close(pfd[1]);
+			break;
+		}
+		if (pids[i] == 0) {
+			close(pfd[0]);
+			while (i-- > 0)
+				close(fds[i].fd);
+			_exit(_keystore_reencipher_worker(keystore, info,
+							  &keys, done,
+							  next_key, started,
+							  pfd[1]));
+		}
+		close(pfd[1]);
+		fds[i].fd = pfd[0];
+		fds[i].events = POLLIN;
+		started++;
+	}
+	if (rc != 0) {
+		warnx("Failed to start a re-encipher worker: %s",
+		      strerror(-rc));
+		/* The workers already started process all keys */
+		if (started > 0)
+			rc = 0;
+	}
+
+	active = started;
+	while (active > 0) {
+		if (poll(fds, started, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = -errno;
+			warnx("Failed to wait for the re-encipher workers: %s",
+			      strerror(-rc));
+			break;
+		}
+		for (i = 0; i < started; i++) {
+			if (fds[i].fd < 0 || fds[i].revents == 0)
+				continue;
+			if (_keystore_reencipher_result(keystore, fds[i].fd,
+							info, &keys, reported,
+							journal) > 0)
+				continue;
+			close(fds[i].fd);
+			fds[i].fd = -1;
+			active--;
+		}
+	}
+
+	for (i = 0; i < started; i++) {
+		if (fds[i].fd >= 0)
+			close(fds[i].fd);
+		waitpid(pids[i], NULL, 0);
+	}
+
+	/* Keys taken by a worker that has ended abnormally */
+	for (k = 0; started > 0 && k < keys.num_names; k++) {
+		if (done[k] || reported[k])
+			continue;
+		warnx("Key '%s' was not re-enciphered", keys.names[k]);
+		info->num_failed++;
+	}
+
+	if (rc == 0 && started > 0 && info->num_failed == 0) {
+		fclose(journal);
+		journal = NULL;
+		_keystore_reencipher_journal_remove(keystore);
+	}
+
+out:
+	if (journal != NULL)
+		fclose(journal);
+	if (next_key != MAP_FAILED)
+		munmap(next_key, sizeof(*next_key));
+	for (k = 0; k < keys.num_names; k++)
+		free(keys.names[k]);
+	free(keys.names);
+	free(reported);
+	free(done);
+	free(pids);
+	free(fds);
+	return rc;
+}
+
 /**
  * Reenciphers a key in the keystore
  *
@@ -3362,6 +4467,9 @@ out:
  * @param[in] complete     if true, a pending re-encipherment is completed
  * @param[in] pkey_fd      the file descriptor of /dev/pkey
  * @param[in] lib          the external library struct
+ * @param[in] jobs         the number of worker processes that re-encipher
+ *                         keys in parallel. If 0, the keys are re-enciphered
+ *                         one after the other.
  * Note: if both fromOld and toNew are FALSE, then the reencipherement mode is
  *       detected automatically. If both are TRUE then the key is reenciphered
  *       from the OLD to the NEW master key.
@@ -3374,7 +4482,7 @@ int keystore_reencipher_key(struct keystore *keystore, const char *name_filter,
 			    const char *apqn_filter,
 			    bool from_old, bool to_new, bool inplace,
 			    bool staged, bool complete, int pkey_fd,
-			    struct ext_lib *lib)
+			    struct ext_lib *lib, unsigned int jobs)
 {
 	struct reencipher_info info;
 	int rc;
@@ -3391,13 +4499,20 @@ int keystore_reencipher_key(struct keystore *keystore, const char *name_filter,
 	info.params.complete = complete;
 	info.pkey_fd = pkey_fd;
 	info.lib = lib;
+	info.apqn_offset = 0;
 	info.num_failed = 0;
 	info.num_reenciphered = 0;
 	info.num_skipped = 0;
 
-	rc = _keystore_process_filtered(keystore, name_filter, NULL,
-					apqn_filter, NULL, NULL, false, false,
-					_keystore_process_reencipher, &info);
+	if (jobs > 0)
+		rc = _keystore_reencipher_parallel(keystore, name_filter,
+						   apqn_filter, &info, jobs);
+	else
+		rc = _keystore_process_filtered(keystore, name_filter, NULL,
+						apqn_filter, NULL, NULL, false,
+						false,
+						_keystore_process_reencipher,
+						&info);
 
 	if (rc != 0) {
 		pr_verbose(keystore, "Failed to re-encipher keys: %s",
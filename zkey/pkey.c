@@ -47,6 +47,23 @@
 
 #define INITIAL_APQN_ENTRIES	16
 
+/*
+ * The APQNs that PKEY_APQNS4K returns only depend on the type of the key and
+ * the master key it is enciphered with. Keys with the same type and master
+ * key verification pattern share one cached list of APQNs, so that
+ * validating many keys does not repeat the same IOCTL for every key.
+ */
+struct apqns4key_cache {
+	const char *key_type;
+	u8 mkvp[MKVP_LENGTH];
+	u32 flags;
+	struct pkey_apqn *apqns;
+	u32 apqn_entries;
+	struct apqns4key_cache *next;
+};
+
+static struct apqns4key_cache *apqns4key_cache;
+
 /**
  * Opens the pkey device and returns its file descriptor.
  *
@@ -733,6 +750,72 @@ out:
 	return rc;
 }
 
+/**
+ * Looks up the cached list of APQNs for a key
+ *
+ * @param[in] key           the key
+ * @param[in] keylen        the length of the key
+ * @param[in] flags         PKEY_FLAGS_MATCH_xxx flags
+ * @param[out] key_type     on return, the type of the key, or NULL if the
+ *                          key can not be cached
+ * @param[out] mkvp         on return, the master key verification pattern
+ *                          of the key
+ *
+ * @returns the cache entry, or NULL if the key is not cached
+ */
+static struct apqns4key_cache *apqns4key_cache_lookup(u8 *key, u32 keylen,
+						      u32 flags,
+						      const char **key_type,
+						      u8 *mkvp)
+{
+	struct apqns4key_cache *entry;
+
+	*key_type = get_key_type(key, keylen);
+	if (*key_type == NULL ||
+	    get_master_key_verification_pattern(key, keylen, mkvp,
+						false) != 0) {
+		*key_type = NULL;
+		return NULL;
+	}
+
+	for (entry = apqns4key_cache; entry != NULL; entry = entry->next) {
+		if (entry->key_type == *key_type && entry->flags == flags &&
+		    MKVP_EQ(entry->mkvp, mkvp))
+			return entry;
+	}
+	return NULL;
+}
+
+/**
+ * Adds a list of APQNs for a key to the cache
+ *
+ * @param[in] key_type      the type of the key
+ * @param[in] mkvp          the master key verification pattern of the key
+ * @param[in] flags         PKEY_FLAGS_MATCH_xxx flags
+ * @param[in] apqns         the list of APQNs returned by PKEY_APQNS4K
+ * @param[in] apqn_entries  the number of entries in the list of APQNs
+ */
+static void apqns4key_cache_add(const char *key_type, const u8 *mkvp,
+				u32 flags, const struct pkey_apqn *apqns,
+				u32 apqn_entries)
+{
+	struct apqns4key_cache *entry;
+
+	entry = util_zalloc(sizeof(*entry));
+	entry->key_type = key_type;
+	memcpy(entry->mkvp, mkvp, MKVP_LENGTH);
+	entry->flags = flags;
+	entry->apqn_entries = apqn_entries;
+	if (apqn_entries > 0) {
+		entry->apqns = util_malloc(apqn_entries *
+					   sizeof(struct pkey_apqn));
+		memcpy(entry->apqns, apqns,
+		       apqn_entries * sizeof(struct pkey_apqn));
+	}
+	entry->next = apqns4key_cache;
+	apqns4key_cache = entry;
+}
+
 /**
  * Build a list of APQNs in the form accepted by the pkey IOCTLs from the
  * List of APQNs as zero terminated array of pointers to C-strings that are
@@ -756,6 +839,9 @@ static int build_apqn_list_for_key(int pkey_fd, u8 *key, u32 keylen, u32 flags,
 				   u32 *apqn_entries, bool verbose)
 {
 	struct pkey_apqns4key apqns4key;
+	struct apqns4key_cache *cached;
+	const char *key_type;
+	u8 mkvp[MKVP_LENGTH];
 	int rc;
 
 	util_assert(pkey_fd != -1, "Internal error: pkey_fd is -1");
@@ -767,6 +853,18 @@ static int build_apqn_list_for_key(int pkey_fd, u8 *key, u32 keylen, u32 flags,
 	pr_verbose(verbose, "Build a list of APQNs for the key");
 
 	memset(&apqns4key, 0, sizeof(apqns4key));
+
+	cached = apqns4key_cache_lookup(key, keylen, flags, &key_type, mkvp);
+	if (cached != NULL) {
+		pr_verbose(verbose, "Using the cached list of APQNs");
+		apqns4key.apqn_entries = cached->apqn_entries;
+		apqns4key.apqns = util_malloc((cached->apqn_entries + 1) *
+					      sizeof(struct pkey_apqn));
+		memcpy(apqns4key.apqns, cached->apqns,
+		       cached->apqn_entries * sizeof(struct pkey_apqn));
+		goto filter;
+	}
+
 	apqns4key.key = key;
 	apqns4key.keylen = keylen;
 	apqns4key.flags = flags;
@@ -811,6 +909,11 @@ static int build_apqn_list_for_key(int pkey_fd, u8 *key, u32 keylen, u32 flags,
 		}
 	} while (rc != 0);
 
+	if (key_type != NULL)
+		apqns4key_cache_add(key_type, mkvp, flags, apqns4key.apqns,
+				    apqns4key.apqn_entries);
+
+filter:
 	if (apqns4key.apqn_entries == 0) {
 		pr_verbose(verbose, "No APQN available for the key");
 		rc = -ENODEV;
@@ -885,31 +988,36 @@ static size_t key_size_for_type(enum pkey_key_type type)
 }
 
 /**
- * Generate a secure key by random
+ * Generate a secure key by random into a buffer
  *
  * @param[in] pkey_fd       the pkey file descriptor
- * @param[in] keyfile       the file name of the secure key to generate
  * @param[in] keybits       the cryptographic size of the key in bits
  * @param[in] xts           if true an XTS key is generated
  * @param[in] key_type      the type of the key
  * @param[in] apqns         a zero terminated array of pointers to APQN-strings,
  *                          or NULL for AUTOSELECT
+ * @param[out] secure_key   On return: the secure key. Must be freed by the
+ *                          caller via free().
+ * @param[out] secure_key_size On return: the size of the secure key
  * @param[in] verbose       if true, verbose messages are printed
  *
  * @returns 0 on success, a negative errno in case of an error
  */
-int generate_secure_key_random(int pkey_fd, const char *keyfile,
-			       size_t keybits, bool xts, const char *key_type,
-			       const char **apqns, bool verbose)
+int generate_secure_key_random_buf(int pkey_fd, size_t keybits, bool xts,
+				   const char *key_type, const char **apqns,
+				   u8 **secure_key, size_t *secure_key_size,
+				   bool verbose)
 {
 	struct pkey_genseck2 genseck2;
-	size_t secure_key_size, size;
-	u8 *secure_key = NULL;
+	size_t size;
+	u8 *key;
 	int rc;
 
 	util_assert(pkey_fd != -1, "Internal error: pkey_fd is -1");
-	util_assert(keyfile != NULL, "Internal error: keyfile is NULL");
 	util_assert(key_type != NULL, "Internal error: key_type is NULL");
+	util_assert(secure_key != NULL, "Internal error: secure_key is NULL");
+	util_assert(secure_key_size != NULL,
+		    "Internal error: secure_key_size is NULL");
 
 	if (keybits == 0)
 		keybits = DEFAULT_KEYBITS;
@@ -950,10 +1058,10 @@ int generate_secure_key_random(int pkey_fd, const char *keyfile,
 	}
 
 	size = key_size_for_type(genseck2.type);
-	secure_key_size = DOUBLE_KEYSIZE_FOR_XTS(size, xts);
-	secure_key = util_zalloc(secure_key_size);
+	*secure_key_size = DOUBLE_KEYSIZE_FOR_XTS(size, xts);
+	key = util_zalloc(*secure_key_size);
 
-	genseck2.key = secure_key;
+	genseck2.key = key;
 	genseck2.keylen = size;
 
 	rc = pkey_genseck2(pkey_fd, &genseck2, verbose);
@@ -971,7 +1079,7 @@ int generate_secure_key_random(int pkey_fd, const char *keyfile,
 		 * Ensure to generate 2nd key with an APQN that has the same
 		 * master key that is used by the 1st key.
 		 */
-		rc = build_apqn_list_for_key(pkey_fd, secure_key, size,
+		rc = build_apqn_list_for_key(pkey_fd, key, size,
 					     PKEY_FLAGS_MATCH_CUR_MKVP, apqns,
 					     &genseck2.apqns,
 					     &genseck2.apqn_entries, verbose);
@@ -986,7 +1094,7 @@ int generate_secure_key_random(int pkey_fd, const char *keyfile,
 			goto out;
 		}
 
-		genseck2.key = secure_key + size;
+		genseck2.key = key + size;
 		genseck2.keylen = size;
 
 		rc = pkey_genseck2(pkey_fd, &genseck2, verbose);
@@ -999,10 +1107,47 @@ int generate_secure_key_random(int pkey_fd, const char *keyfile,
 
 	pr_verbose(verbose, "Successfully generated a secure key");
 
-	rc = write_secure_key(keyfile, secure_key, secure_key_size, verbose);
-
 out:
 	free(genseck2.apqns);
+	if (rc == 0)
+		*secure_key = key;
+	else
+		free(key);
+	return rc;
+}
+
+/**
+ * Generate a secure key by random
+ *
+ * @param[in] pkey_fd       the pkey file descriptor
+ * @param[in] keyfile       the file name of the secure key to generate
+ * @param[in] keybits       the cryptographic size of the key in bits
+ * @param[in] xts           if true an XTS key is generated
+ * @param[in] key_type      the type of the key
+ * @param[in] apqns         a zero terminated array of pointers to APQN-strings,
+ *                          or NULL for AUTOSELECT
+ * @param[in] verbose       if true, verbose messages are printed
+ *
+ * @returns 0 on success, a negative errno in case of an error
+ */
+int generate_secure_key_random(int pkey_fd, const char *keyfile,
+			       size_t keybits, bool xts, const char *key_type,
+			       const char **apqns, bool verbose)
+{
+	size_t secure_key_size;
+	u8 *secure_key;
+	int rc;
+
+	util_assert(keyfile != NULL, "Internal error: keyfile is NULL");
+
+	rc = generate_secure_key_random_buf(pkey_fd, keybits, xts, key_type,
+					    apqns, &secure_key,
+					    &secure_key_size, verbose);
+	if (rc != 0)
+		return rc;
+
+	rc = write_secure_key(keyfile, secure_key, secure_key_size, verbose);
+
 	free(secure_key);
 	return rc;
 }
@@ -1310,10 +1455,16 @@ int validate_secure_key(int pkey_fd,
 		if (is_old_mk &&
 		    (verifykey2.flags & PKEY_FLAGS_MATCH_CUR_MKVP))
 			*is_old_mk = false;
+
+		/* The remaining APQNs can not change the result anymore */
+		if (is_old_mk == NULL || !*is_old_mk)
+			break;
 	}
 
-	if (!valid)
+	if (!valid) {
+		free(list);
 		return -ENODEV;
+	}
 
 	pr_verbose(verbose, "Secure key validation completed successfully");
 
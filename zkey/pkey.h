@@ -292,6 +292,11 @@ struct ext_lib {
 
 int open_pkey_device(bool verbose);
 
+int generate_secure_key_random_buf(int pkey_fd, size_t keybits, bool xts,
+				   const char *key_type, const char **apqns,
+				   u8 **secure_key, size_t *secure_key_size,
+				   bool verbose);
+
 int generate_secure_key_random(int pkey_fd, const char *keyfile,
 			       size_t keybits, bool xts, const char *key_type,
 			       const char **apqns, bool verbose);
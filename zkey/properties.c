@@ -11,9 +11,12 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <openssl/evp.h>
 
@@ -23,16 +26,27 @@
 
 #include "properties.h"
 
+/*
+ * The properties are kept in a list to preserve their order in the file,
+ * and are additionally indexed by a hash table on their names.
+ */
 struct properties {
 	struct util_list list;
+	struct property **buckets;
+	unsigned int num_buckets;
+	unsigned int count;
 };
 
 struct property {
 	struct util_list_node node;
+	struct property *hash_next;
+	unsigned int hash;
 	char *name;
 	char *value;
 };
 
+#define PROPERTIES_MIN_BUCKETS	32
+
 #define SHA256_DIGEST_LEN	32
 #define INTEGRITY_KEY_NAME      "__hash__"
 
@@ -132,6 +146,9 @@ struct properties *properties_new(void)
 
 	util_list_init_offset(&properties->list,
 			      offsetof(struct property, node));
+	properties->num_buckets = PROPERTIES_MIN_BUCKETS;
+	properties->buckets = util_zalloc(properties->num_buckets *
+					  sizeof(struct property *));
 	return properties;
 }
 
@@ -153,31 +170,113 @@ void properties_free(struct properties *properties)
 		free(property);
 	}
 
+	free(properties->buckets);
 	free(properties);
 }
 
 /**
- * Find a property by its name in the list iof properties
+ * Calculates the hash of a property name (FNV-1a)
+ *
+ * @param[in]  name          the name of the property
+ *
+ * @returns the hash value
+ */
+static unsigned int properties_hash(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*name != '\0') {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * Doubles the number of hash buckets and re-hashes all properties
+ *
+ * @param[in]  properties    the properties object
+ */
+static void properties_grow(struct properties *properties)
+{
+	struct property *property;
+	unsigned int idx;
+
+	free(properties->buckets);
+	properties->num_buckets *= 2;
+	properties->buckets = util_zalloc(properties->num_buckets *
+					  sizeof(struct property *));
+
+	util_list_iterate(&properties->list, property) {
+		idx = property->hash & (properties->num_buckets - 1);
+		property->hash_next = properties->buckets[idx];
+		properties->buckets[idx] = property;
+	}
+}
+
+/**
+ * Find a property by its name in the hash table of properties
  *
  * @param[in]  properties    the properties object
  * @param[in]  name          the name of the property to find
+ * @param[in]  hash          the hash of the name
  *
  * @returns a pointer to the proerty when it has been found, or NULL if not
  */
 static struct property *properties_find(struct properties *properties,
-					const char *name)
+					const char *name, unsigned int hash)
 {
 	struct property *property;
 
-	property = util_list_start(&properties->list);
+	property = properties->buckets[hash & (properties->num_buckets - 1)];
 	while (property != NULL) {
-		if (strcmp(property->name, name) == 0)
+		if (property->hash == hash && strcmp(property->name, name) == 0)
 			return property;
-		property = util_list_next(&properties->list, property);
+		property = property->hash_next;
 	}
 	return NULL;
 }
 
+/**
+ * Adds or updates a property without checking the name and value
+ *
+ * @param[in]  properties    the properties object
+ * @param[in]  name          the name of the property
+ * @param[in]  value         the value of the property
+ *
+ * @returns a pointer to the property
+ */
+static struct property *properties_add(struct properties *properties,
+				       const char *name, const char *value)
+{
+	unsigned int hash = properties_hash(name);
+	struct property *property;
+	unsigned int idx;
+
+	property = properties_find(properties, name, hash);
+	if (property != NULL) {
+		free(property->value);
+		property->value = util_strdup(value);
+		return property;
+	}
+
+	if (properties->count >= properties->num_buckets)
+		properties_grow(properties);
+
+	property = util_zalloc(sizeof(struct property));
+	property->name = util_strdup(name);
+	property->value = util_strdup(value);
+	property->hash = hash;
+	util_list_add_tail(&properties->list, property);
+
+	idx = hash & (properties->num_buckets - 1);
+	property->hash_next = properties->buckets[idx];
+	properties->buckets[idx] = property;
+	properties->count++;
+
+	return property;
+}
+
 /**
  * Adds or updates a property
  *
@@ -204,16 +303,7 @@ int properties_set2(struct properties *properties,
 	if (strpbrk(value, RESTRICTED_PROPERTY_VALUE_CHARS) != NULL)
 		return -EINVAL;
 
-	property = properties_find(properties, name);
-	if (property != NULL) {
-		free(property->value);
-		property->value = util_strdup(value);
-	} else {
-		property = util_zalloc(sizeof(struct property));
-		property->name = util_strdup(name);
-		property->value = util_strdup(value);
-		util_list_add_tail(&properties->list, property);
-	}
+	property = properties_add(properties, name, value);
 	if (uppercase) {
 		for (i = 0; property->value[i] != '\0'; i++)
 			property->value[i] = toupper(property->value[i]);
@@ -255,7 +345,7 @@ char *properties_get(struct properties *properties, const char *name)
 	util_assert(properties != NULL, "Internal error: properties is NULL");
 	util_assert(name != NULL, "Internal error: name is NULL");
 
-	property = properties_find(properties, name);
+	property = properties_find(properties, name, properties_hash(name));
 	if (property == NULL)
 		return NULL;
 
@@ -272,15 +362,25 @@ char *properties_get(struct properties *properties, const char *name)
  */
 int properties_remove(struct properties *properties, const char *name)
 {
-	struct property *property;
+	struct property *property, **prev;
+	unsigned int hash;
 
 	util_assert(properties != NULL, "Internal error: properties is NULL");
 	util_assert(name != NULL, "Internal error: name is NULL");
 
-	property = properties_find(properties, name);
+	hash = properties_hash(name);
+	prev = &properties->buckets[hash & (properties->num_buckets - 1)];
+	for (property = *prev; property != NULL; property = *prev) {
+		if (property->hash == hash && strcmp(property->name, name) == 0)
+			break;
+		prev = &property->hash_next;
+	}
 	if (property == NULL)
 		return -ENOENT;
 
+	*prev = property->hash_next;
+	properties->count--;
+
 	free(property->name);
 	free(property->value);
 	util_list_remove(&properties->list, property);
@@ -289,7 +389,55 @@ int properties_remove(struct properties *properties, const char *name)
 }
 
 /**
- * Saves the properties to a file
+ * Creates a temporary file next to the file to save. If the file to save
+ * already exists, the temporary file gets its mode and group, so that
+ * replacing the file by the temporary file does not change its permissions.
+ *
+ * @param[in]  filename      the file name
+ * @param[out] tmp_filename  on return: the name of the temporary file. Must be
+ *                           freed by the caller.
+ *
+ * @returns the opened file, or NULL in case of an error
+ */
+static FILE *properties_create_tmp(const char *filename, char **tmp_filename)
+{
+	struct stat sb;
+	FILE *fp;
+	int fd;
+
+	util_asprintf(tmp_filename, "%s.%d.tmp", filename, getpid());
+
+	fd = open(*tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		goto error;
+
+	if (stat(filename, &sb) == 0) {
+		if (fchmod(fd, sb.st_mode & 07777) != 0)
+			goto error_close;
+		if (sb.st_gid != getegid() &&
+		    fchown(fd, (uid_t)-1, sb.st_gid) != 0)
+			goto error_close;
+	}
+
+	fp = fdopen(fd, "w");
+	if (fp == NULL)
+		goto error_close;
+	return fp;
+
+error_close:
+	close(fd);
+	unlink(*tmp_filename);
+error:
+	free(*tmp_filename);
+	*tmp_filename = NULL;
+	return NULL;
+}
+
+/**
+ * Saves the properties to a file. The properties are written to a temporary
+ * file first, which then atomically replaces the file. Thus, concurrent
+ * readers see either the old or the new properties, but never a partially
+ * written file.
  *
  * @param[in]  properties    the properties object
  * @param[in]  filename      the file name
@@ -305,14 +453,16 @@ int properties_save(struct properties *properties, const char *filename,
 	unsigned char digest[SHA256_DIGEST_LEN];
 	unsigned int digest_len = sizeof(digest);
 	struct property *property;
+	char *tmp_filename = NULL;
 	EVP_MD_CTX *ctx = NULL;
 	unsigned int i;
+	int rc = 0;
 	FILE *fp;
 
 	util_assert(properties != NULL, "Internal error: properties is NULL");
 	util_assert(filename != NULL, "Internal error: filename is NULL");
 
-	fp = fopen(filename, "w");
+	fp = properties_create_tmp(filename, &tmp_filename);
 	if (fp == NULL)
 		return -EIO;
 
@@ -345,8 +495,17 @@ int properties_save(struct properties *properties, const char *filename,
 		fprintf(fp, "%s=%s\n", INTEGRITY_KEY_NAME, digest_hex);
 	}
 
-	fclose(fp);
-	return 0;
+	if (fflush(fp) != 0 || ferror(fp) || fsync(fileno(fp)) != 0)
+		rc = -EIO;
+	if (fclose(fp) != 0)
+		rc = -EIO;
+	if (rc == 0 && rename(tmp_filename, filename) != 0)
+		rc = -EIO;
+	if (rc != 0)
+		unlink(tmp_filename);
+
+	free(tmp_filename);
+	return rc;
 }
 
 /**
@@ -368,8 +527,10 @@ int properties_load(struct properties *properties, const char *filename,
 	unsigned int digest_len = sizeof(digest);
 	char *digest_read = NULL;
 	EVP_MD_CTX *ctx = NULL;
-	char line[4096];
-	unsigned int len, i;
+	size_t line_size = 0;
+	char *line = NULL;
+	unsigned int i;
+	ssize_t len;
 	int rc = 0;
 	char *ch;
 	FILE *fp;
@@ -384,11 +545,10 @@ int properties_load(struct properties *properties, const char *filename,
 	if (check_integrity)
 		ctx = sha256_init();
 
-	while (fgets(line, sizeof(line), fp) != NULL) {
-		len = strlen(line);
-		if (line[len-1] == '\n')
-			line[len-1] = '\0';
-		ch = strchr(line, '=');
+	while ((len = getline(&line, &line_size, fp)) > 0) {
+		if (line[len - 1] == '\n')
+			line[--len] = '\0';
+		ch = memchr(line, '=', len);
 		if (ch == NULL) {
 			rc = -EPERM;
 			goto out;
@@ -399,6 +559,7 @@ int properties_load(struct properties *properties, const char *filename,
 
 		if (check_integrity) {
 			if (strcmp(line, INTEGRITY_KEY_NAME) == 0) {
+				free(digest_read);
 				digest_read = util_strdup(ch);
 				continue;
 			}
@@ -407,7 +568,7 @@ int properties_load(struct properties *properties, const char *filename,
 			sha256_update(ctx, ch, strlen(ch));
 		}
 
-		properties_set(properties, line, ch);
+		properties_add(properties, line, ch);
 	}
 
 	if (check_integrity) {
@@ -432,6 +593,7 @@ out:
 		sha256_final(ctx, NULL, NULL);
 	if (digest_read != NULL)
 		free(digest_read);
+	free(line);
 	fclose(fp);
 	return rc;
 }
@@ -24,6 +24,7 @@
 #include "lib/util_libc.h"
 #include "lib/util_rec.h"
 #include "lib/util_base.h"
+#include "lib/util_thread_pool.h"
 
  #include <openssl/crypto.h>
 
@@ -35,6 +36,166 @@
 							warnx(fmt);	\
 					} while (0)
 
+#define APQN_STATE_UNKNOWN	-2
+#define APQN_PREFETCH_THREADS	16
+#define APQN_STATE_IDX(cardtype)	((cardtype) == CARD_TYPE_ANY ? 0 : \
+					 (cardtype))
+
+/*
+ * Cached online and master key state of an APQN
+ */
+struct apqn_state {
+	unsigned int card;
+	unsigned int domain;
+	int online[3]; /* Indexed by APQN_STATE_IDX(cardtype) */
+	bool mkvps_cached;
+	int mkvps_rc;
+	struct mk_info mk_info;
+	struct apqn_state *next;
+};
+
+static bool apqn_state_cache_enabled;
+static struct apqn_state *apqn_state_cache;
+
+/**
+ * Enables or disables caching of the online and master key state of the
+ * APQNs. While enabled, the state of an APQN is read from the sysfs only
+ * once. Only enable it while the state is not expected to change, e.g. for
+ * the processing of one command. Disabling the cache drops all cached states.
+ *
+ * @param[in] enable    if true, the state of the APQNs is cached
+ */
+void sysfs_cache_apqn_state(bool enable)
+{
+	struct apqn_state *state;
+
+	apqn_state_cache_enabled = enable;
+	if (enable)
+		return;
+
+	while (apqn_state_cache != NULL) {
+		state = apqn_state_cache;
+		apqn_state_cache = state->next;
+		free(state);
+	}
+}
+
+/*
+ * Returns the cached state of an APQN, or NULL if caching is not enabled
+ */
+static struct apqn_state *get_apqn_state(unsigned int card,
+					 unsigned int domain)
+{
+	struct apqn_state *state;
+
+	if (!apqn_state_cache_enabled)
+		return NULL;
+
+	for (state = apqn_state_cache; state != NULL; state = state->next) {
+		if (state->card == card && state->domain == domain)
+			return state;
+	}
+
+	state = util_zalloc(sizeof(*state));
+	state->card = card;
+	state->domain = domain;
+	state->online[0] = APQN_STATE_UNKNOWN;
+	state->online[1] = APQN_STATE_UNKNOWN;
+	state->online[2] = APQN_STATE_UNKNOWN;
+	state->next = apqn_state_cache;
+	apqn_state_cache = state;
+	return state;
+}
+
+/*
+ * APQN states that are read in parallel by prefetch_apqn_states()
+ */
+struct apqn_prefetch {
+	struct apqn_state **states;
+	unsigned int count;
+	unsigned int max;
+	enum card_type cardtype;
+	bool verbose;
+};
+
+static void prefetch_add(struct apqn_prefetch *pf, unsigned int card,
+			 unsigned int domain)
+{
+	if (pf->count == pf->max) {
+		pf->max = pf->max ? pf->max * 2 : 128;
+		pf->states = util_realloc(pf->states,
+					  pf->max * sizeof(*pf->states));
+	}
+	pf->states[pf->count++] = get_apqn_state(card, domain);
+}
+
+static int prefetch_one(unsigned long i, void *data)
+{
+	struct apqn_prefetch *pf = data;
+	struct apqn_state *state = pf->states[i];
+	struct mk_info mk_info;
+
+	sysfs_is_apqn_online(state->card, state->domain, pf->cardtype);
+	sysfs_get_mkvps(state->card, state->domain, &mk_info, pf->verbose);
+	return 0;
+}
+
+/*
+ * Reads the online and master key state of the specified APQNs, or of all
+ * APQNs found in sysfs, into the APQN state cache. Reading the master key
+ * state involves a firmware query, so the APQNs are read in parallel.
+ *
+ * All cache entries are created before the threads are started, so the
+ * threads only look up existing entries and each entry is updated by
+ * one thread only.
+ */
+static void prefetch_apqn_states(const char *apqns, enum card_type cardtype,
+				 bool verbose)
+{
+	struct apqn_prefetch pf = { .cardtype = cardtype, .verbose = verbose };
+	struct dirent **cards, **domains;
+	unsigned int card, domain;
+	int i, j, n, m;
+	char *copy, *tok, *save, *path, *card_path;
+
+	if (!apqn_state_cache_enabled)
+		return;
+
+	path = util_path_sysfs("devices/ap");
+	if (apqns != NULL && strlen(apqns) > 0) {
+		copy = util_strdup(apqns);
+		for (tok = strtok_r(copy, ",", &save); tok != NULL;
+		     tok = strtok_r(NULL, ",", &save)) {
+			if (sscanf(tok, "%x.%x", &card, &domain) == 2)
+				prefetch_add(&pf, card, domain);
+		}
+		free(copy);
+	} else {
+		n = util_scandir(&cards, alphasort, path, "card[0-9a-fA-F]+");
+		for (i = 0; i < n; i++) {
+			util_asprintf(&card_path, "%s/%s", path,
+				      cards[i]->d_name);
+			m = util_scandir(&domains, alphasort, card_path,
+					 "[0-9a-fA-F]+\\.[0-9a-fA-F]+");
+			free(card_path);
+			for (j = 0; j < m; j++) {
+				if (sscanf(domains[j]->d_name, "%x.%x", &card,
+					   &domain) == 2)
+					prefetch_add(&pf, card, domain);
+			}
+			if (m > 0)
+				util_scandir_free(domains, m);
+		}
+		if (n > 0)
+			util_scandir_free(cards, n);
+	}
+	free(path);
+
+	util_parallel_for(0, pf.count, APQN_PREFETCH_THREADS, prefetch_one,
+			  &pf);
+	free(pf.states);
+}
+
 /**
  * Checks if the specified card is of the specified type and is online
  *
@@ -109,10 +270,16 @@ out:
 int sysfs_is_apqn_online(unsigned int card, unsigned int domain,
 			 enum card_type cardtype)
 {
+	struct apqn_state *state;
 	long int online;
 	char *dev_path;
 	int rc = 1;
 
+	state = get_apqn_state(card, domain);
+	if (state != NULL &&
+	    state->online[APQN_STATE_IDX(cardtype)] != APQN_STATE_UNKNOWN)
+		return state->online[APQN_STATE_IDX(cardtype)];
+
 	rc = sysfs_is_card_online(card, cardtype);
 	if (rc != 1)
 		return rc;
@@ -134,6 +301,8 @@ int sysfs_is_apqn_online(unsigned int card, unsigned int domain,
 
 out:
 	free(dev_path);
+	if (state != NULL)
+		state->online[APQN_STATE_IDX(cardtype)] = rc;
 	return rc;
 }
 
@@ -481,6 +650,7 @@ static int parse_ep11_mk_info(char *line, struct mk_info *mk_info)
 int sysfs_get_mkvps(unsigned int card, unsigned int domain,
 		    struct mk_info *mk_info, bool verbose)
 {
+	struct apqn_state *state;
 	enum card_type cardtype;
 	char *dev_path;
 	char *p, *end;
@@ -491,13 +661,21 @@ int sysfs_get_mkvps(unsigned int card, unsigned int domain,
 	if (mk_info == NULL)
 		return -EINVAL;
 
+	state = get_apqn_state(card, domain);
+	if (state != NULL && state->mkvps_cached) {
+		*mk_info = state->mk_info;
+		return state->mkvps_rc;
+	}
+
 	memset(mk_info, 0, sizeof(struct mk_info));
 	mk_info->new_mk.mk_state = MK_STATE_UNKNOWN;
 	mk_info->cur_mk.mk_state = MK_STATE_UNKNOWN;
 	mk_info->old_mk.mk_state = MK_STATE_UNKNOWN;
 
-	if (sysfs_is_apqn_online(card, domain, CARD_TYPE_ANY) != 1)
-		return -ENODEV;
+	if (sysfs_is_apqn_online(card, domain, CARD_TYPE_ANY) != 1) {
+		rc = -ENODEV;
+		goto cache;
+	}
 
 	cardtype = sysfs_get_card_type(card);
 
@@ -571,6 +749,12 @@ out:
 			   card, domain, strerror(-rc));
 
 	free(dev_path);
+cache:
+	if (state != NULL) {
+		state->mk_info = *mk_info;
+		state->mkvps_rc = rc;
+		state->mkvps_cached = true;
+	}
 	return rc;
 }
 
@@ -802,6 +986,7 @@ int print_mk_info(const char *apqns, enum card_type cardtype, bool verbose)
 	util_rec_def(info.rec, "TYPE", UTIL_REC_ALIGN_LEFT, 6, "TYPE");
 	util_rec_print_hdr(info.rec);
 
+	prefetch_apqn_states(apqns, cardtype, verbose);
 	rc = handle_apqns(apqns, cardtype, print_apqn_mk_info, &info, verbose);
 
 	util_rec_free(info.rec);
@@ -1077,6 +1262,7 @@ int cross_check_apqns(const char *apqns, u8 *mkvp, int min_level,
 		   min_fw_version != NULL ? min_fw_version->api_ordinal : 0,
 		   apqns != NULL ? apqns : "ANY");
 
+	prefetch_apqn_states(apqns, cardtype, verbose);
 	rc = handle_apqns(apqns, cardtype, cross_check_mk_info, &info, verbose);
 	if (rc != 0)
 		return rc;
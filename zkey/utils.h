@@ -16,6 +16,8 @@
 
 #include "pkey.h"
 
+void sysfs_cache_apqn_state(bool enable);
+
 int sysfs_is_card_online(unsigned int card, enum card_type cardtype);
 
 int sysfs_is_apqn_online(unsigned int card, unsigned int domain,
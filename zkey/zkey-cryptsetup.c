@@ -20,6 +20,7 @@
 #include <stdint.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <termios.h>
 
 #include <libcryptsetup.h>
@@ -103,6 +104,10 @@ static struct zkey_cryptsetup_globals {
 	bool inplace;
 	bool staged;
 	char *master_key_file;
+	char *device_list;
+	char *crypttab;
+	long int jobs;
+	char *journal;
 	bool batch_mode;
 	bool debug;
 	bool verbose;
@@ -211,6 +216,40 @@ static struct util_opt opt_vec[] = {
 		.desc = "Suppresses all confirmation questions. Use with care!",
 		.command = COMMAND_REENCIPHER,
 	},
+	{
+		.option = {"device-list", required_argument, NULL, 'L'},
+		.argument = "FILE-NAME",
+		.desc = "Re-enciphers the secure volume keys of all devices "
+			"listed in the specified file, one device per line. "
+			"The passphrase must be read from a file using option "
+			"'--key-file'|'-d'",
+		.command = COMMAND_REENCIPHER,
+	},
+	{
+		.option = {"crypttab", required_argument, NULL, 't'},
+		.argument = "FILE-NAME",
+		.desc = "Re-enciphers the secure volume keys of all devices "
+			"listed in the specified crypttab file, for example "
+			"as generated by 'zkey crypttab'. The passphrase must "
+			"be read from a file using option '--key-file'|'-d'",
+		.command = COMMAND_REENCIPHER,
+	},
+	{
+		.option = {"jobs", required_argument, NULL, 'j'},
+		.argument = "NUMBER",
+		.desc = "Specifies the number of devices that are "
+			"re-enciphered in parallel. The default is 1",
+		.command = COMMAND_REENCIPHER,
+	},
+	{
+		.option = {"journal", required_argument, NULL, 'J'},
+		.argument = "FILE-NAME",
+		.desc = "Records the devices that are successfully "
+			"re-enciphered in the specified file. A repeated run "
+			"with the same options skips the devices recorded in "
+			"the file",
+		.command = COMMAND_REENCIPHER,
+	},
 	/***********************************************************/
 	{
 		.flags = UTIL_OPT_FLAG_SECTION,
@@ -1854,6 +1893,356 @@ out:
 }
 
 
+/*
+ * Re-encipher the volume key of the opened device
+ */
+static int reencipher_device(void)
+{
+	int token;
+	int rc;
+
+	token = find_token(g.cd, PAES_REENC_TOKEN_NAME);
+
+	if (token < 0 && g.complete) {
+		warnx("Staged volume key re-enciphering is not pending for "
+		      "device '%s'", g.pos_arg);
+		return -ENOENT;
+	}
+
+	if (token < 0 || g.staged || g.inplace)
+		rc = reencipher_prepare(token);
+	else
+		rc = reencipher_complete(token);
+
+	return rc;
+}
+
+/*
+ * Read the devices to re-encipher from the device list or crypttab file.
+ * Devices specified as UUID=<uuid> or PARTUUID=<uuid> are resolved through
+ * /dev/disk.
+ */
+static int read_device_list(char ***devices, size_t *num_devices)
+{
+	const char *file = g.crypttab ? g.crypttab : g.device_list;
+	char *line = NULL, *save, *tok;
+	size_t line_size = 0, size = 0;
+	int field, rc = 0;
+	FILE *fp;
+
+	*devices = NULL;
+	*num_devices = 0;
+
+	fp = fopen(file, "r");
+	if (fp == NULL) {
+		rc = -errno;
+		warnx("Failed to open '%s': %s", file, strerror(-rc));
+		return rc;
+	}
+
+	while (getline(&line, &line_size, fp) > 0) {
+		tok = strchr(line, '#');
+		if (tok != NULL)
+			*tok = '\0';
+
+		/* The device is the second field of a crypttab entry */
+		tok = strtok_r(line, " \t\n", &save);
+		for (field = g.crypttab ? 1 : 0; field > 0 && tok != NULL;
+		     field--)
+			tok = strtok_r(NULL, " \t\n", &save);
+		if (tok == NULL)
+			continue;
+
+		if (*num_devices >= size) {
+			size = size ? size * 2 : 64;
+			*devices = util_realloc(*devices,
+						size * sizeof(char *));
+		}
+		if (strncmp(tok, "UUID=", 5) == 0)
+			util_asprintf(&(*devices)[*num_devices],
+				      "/dev/disk/by-uuid/%s", tok + 5);
+		else if (strncmp(tok, "PARTUUID=", 9) == 0)
+			util_asprintf(&(*devices)[*num_devices],
+				      "/dev/disk/by-partuuid/%s", tok + 9);
+		else
+			(*devices)[*num_devices] = util_strdup(tok);
+		(*num_devices)++;
+	}
+
+	free(line);
+	fclose(fp);
+
+	if (*num_devices == 0) {
+		warnx("No devices found in '%s'", file);
+		rc = -ENOENT;
+	}
+	return rc;
+}
+
+/*
+ * Open the journal of a multi-device re-enciphering, if one is specified.
+ * Devices recorded in a journal of an earlier run with the same options are
+ * marked as done, otherwise a new journal is started.
+ */
+static int open_journal(char **devices, size_t num_devices, bool *done,
+			size_t *num_done, FILE **journal)
+{
+	char *header, *line = NULL;
+	size_t line_size = 0, i;
+	bool resume = false;
+	ssize_t len;
+	FILE *fp;
+	int rc = 0;
+
+	*num_done = 0;
+	*journal = NULL;
+	if (g.journal == NULL)
+		return 0;
+
+	util_asprintf(&header, "zkey-cryptsetup-reencipher to-new=%d "
+		      "from-old=%d in-place=%d staged=%d complete=%d\n",
+		      g.tonew, g.fromold, g.inplace, g.staged, g.complete);
+
+	fp = fopen(g.journal, "r");
+	if (fp != NULL) {
+		len = getline(&line, &line_size, fp);
+		if (len > 0 && strcmp(line, header) == 0) {
+			resume = true;
+			while ((len = getline(&line, &line_size, fp)) > 0) {
+				if (line[len - 1] == '\n')
+					line[len - 1] = '\0';
+				for (i = 0; i < num_devices; i++) {
+					if (done[i] ||
+					    strcmp(devices[i], line) != 0)
+						continue;
+					done[i] = true;
+					(*num_done)++;
+				}
+			}
+		} else {
+			pr_verbose("Discarding journal '%s' of a "
+				   "re-enciphering with other options",
+				   g.journal);
+		}
+		fclose(fp);
+	}
+
+	fp = fopen(g.journal, resume ? "a" : "w");
+	if (fp == NULL) {
+		rc = -errno;
+		warnx("Failed to open journal '%s': %s", g.journal,
+		      strerror(-rc));
+		goto out;
+	}
+	if (!resume) {
+		fputs(header, fp);
+		fflush(fp);
+	}
+	if (*num_done > 0)
+		printf("Skipping %lu devices that are already re-enciphered "
+		       "according to journal '%s'\n\n", *num_done, g.journal);
+	*journal = fp;
+
+out:
+	free(line);
+	free(header);
+	return rc;
+}
+
+struct reencipher_job {
+	pid_t pid;
+	size_t device;
+	FILE *out;
+	FILE *err;
+};
+
+/*
+ * Start re-enciphering a device in a child process. The output of the child
+ * is collected in temporary files and printed when the child has ended, so
+ * that the output of concurrently processed devices is not mixed up.
+ *
+ * Each child process loads its own CCA or EP11 library, because selecting
+ * an APQN for the library affects the whole process. Confirmation questions
+ * are answered with 'no', unless '--batch-mode'|'-q' is specified.
+ */
+static int start_reencipher_job(struct reencipher_job *job, char *device)
+{
+	int fd, rc;
+
+	job->out = tmpfile();
+	job->err = tmpfile();
+	if (job->out == NULL || job->err == NULL) {
+		rc = -errno;
+		goto error;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	job->pid = fork();
+	if (job->pid < 0) {
+		rc = -errno;
+		goto error;
+	}
+	if (job->pid > 0)
+		return 0;
+
+	stdout = job->out;
+	stderr = job->err;
+	fd = open("/dev/null", O_RDONLY);
+	if (fd >= 0) {
+		dup2(fd, STDIN_FILENO);
+		close(fd);
+	}
+
+	g.pos_arg = device;
+	rc = open_device(g.pos_arg, &g.cd);
+	if (rc == 0) {
+		rc = reencipher_device();
+		crypt_free(g.cd);
+	}
+	if (g.cca.lib_csulcca)
+		dlclose(g.cca.lib_csulcca);
+
+	fflush(stdout);
+	fflush(stderr);
+	_exit(rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+
+error:
+	warnx("Failed to start re-enciphering device '%s': %s", device,
+	      strerror(-rc));
+	if (job->out != NULL)
+		fclose(job->out);
+	if (job->err != NULL)
+		fclose(job->err);
+	return rc;
+}
+
+/*
+ * Print the collected output of an ended child process
+ */
+static void copy_job_output(FILE *from, FILE *to)
+{
+	char buf[4096];
+	size_t len;
+
+	rewind(from);
+	while ((len = fread(buf, 1, sizeof(buf), from)) > 0)
+		fwrite(buf, 1, len, to);
+	fflush(to);
+	fclose(from);
+}
+
+/*
+ * Re-encipher the volume keys of multiple devices, using up to g.jobs
+ * child processes in parallel
+ */
+static int reencipher_devices(void)
+{
+	unsigned long num_reenciphered = 0, num_failed = 0;
+	size_t num_devices, num_done, next, i;
+	struct reencipher_job *jobs = NULL;
+	unsigned int running = 0, k;
+	FILE *journal = NULL;
+	char **devices;
+	bool *done = NULL;
+	int status, rc;
+	pid_t pid;
+
+	rc = read_device_list(&devices, &num_devices);
+	if (rc != 0)
+		goto out;
+
+	done = util_zalloc(num_devices * sizeof(bool));
+	rc = open_journal(devices, num_devices, done, &num_done, &journal);
+	if (rc != 0)
+		goto out;
+
+	if (g.jobs <= 0)
+		g.jobs = 1;
+	jobs = util_zalloc(g.jobs * sizeof(struct reencipher_job));
+
+	next = 0;
+	while (1) {
+		/* Start jobs for the next devices, unless interrupted */
+		while (!quit && running < g.jobs && next < num_devices) {
+			if (done[next]) {
+				next++;
+				continue;
+			}
+			for (k = 0; jobs[k].pid != 0; k++)
+				;
+			if (start_reencipher_job(&jobs[k],
+						 devices[next]) != 0) {
+				num_failed++;
+				next++;
+				continue;
+			}
+			jobs[k].device = next++;
+			running++;
+		}
+		if (running == 0)
+			break;
+
+		pid = wait(&status);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = -errno;
+			warnx("Failed to wait for the re-enciphering of the "
+			      "devices: %s", strerror(-rc));
+			break;
+		}
+		for (k = 0; k < g.jobs && jobs[k].pid != pid; k++)
+			;
+		if (k == g.jobs)
+			continue;
+
+		i = jobs[k].device;
+		copy_job_output(jobs[k].out, stdout);
+		copy_job_output(jobs[k].err, stderr);
+		jobs[k].pid = 0;
+		running--;
+
+		if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+			num_reenciphered++;
+			if (journal != NULL) {
+				fprintf(journal, "%s\n", devices[i]);
+				fflush(journal);
+			}
+		} else {
+			warnx("Failed to re-encipher the volume key of device "
+			      "'%s'", devices[i]);
+			num_failed++;
+		}
+	}
+
+	if (quit && next < num_devices)
+		warnx("Re-enciphering interrupted, %lu devices are not "
+		      "processed", num_devices - next);
+
+	printf("%lu devices re-enciphered, %lu devices skipped, %lu devices "
+	       "failed to re-encipher\n", num_reenciphered, num_done,
+	       num_failed);
+
+	if (rc == 0 && (num_failed > 0 || (quit && next < num_devices)))
+		rc = -EIO;
+	if (rc == 0 && journal != NULL) {
+		fclose(journal);
+		journal = NULL;
+		remove(g.journal);
+	}
+
+out:
+	if (journal != NULL)
+		fclose(journal);
+	for (i = 0; i < num_devices; i++)
+		free(devices[i]);
+	free(devices);
+	free(done);
+	free(jobs);
+	return rc;
+}
+
 /*
  * Command handler for 'reencipher'.
  *
@@ -1862,7 +2251,6 @@ out:
  */
 static int command_reencipher(void)
 {
-	int token;
 	int rc;
 
 	if (g.inplace && g.staged) {
@@ -1886,19 +2274,39 @@ static int command_reencipher(void)
 		}
 	}
 
-	token = find_token(g.cd, PAES_REENC_TOKEN_NAME);
+	if (g.device_list == NULL && g.crypttab == NULL) {
+		if (g.jobs > 0 || g.journal != NULL) {
+			warnx("Options '--jobs'|'-j' and '--journal'|'-J' are "
+			      "only valid together with '--device-list'|'-L' "
+			      "or '--crypttab'|'-t'");
+			util_prg_print_parse_error();
+			return EXIT_FAILURE;
+		}
 
-	if (token < 0 && g.complete) {
-		warnx("Staged volume key re-enciphering is not pending for "
-		      "device '%s'", g.pos_arg);
-		return EXIT_FAILURE;
+		rc = reencipher_device();
+		return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 	}
 
-	if (token < 0 || g.staged || g.inplace)
-		rc = reencipher_prepare(token);
-	else
-		rc = reencipher_complete(token);
+	if (g.device_list != NULL && g.crypttab != NULL) {
+		warnx("Options '--device-list'|'-L' and '--crypttab'|'-t' are "
+		      "mutual exclusive");
+		util_prg_print_parse_error();
+		return EXIT_FAILURE;
+	}
+	if (g.pos_arg != NULL) {
+		warnx("A device can not be specified together with option "
+		      "'--device-list'|'-L' or '--crypttab'|'-t'");
+		util_prg_print_parse_error();
+		return EXIT_FAILURE;
+	}
+	if (is_stdin(g.keyfile)) {
+		warnx("Option '--key-file'|'-d' must specify a file when "
+		      "re-enciphering multiple devices");
+		util_prg_print_parse_error();
+		return EXIT_FAILURE;
+	}
 
+	rc = reencipher_devices();
 	return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
@@ -2364,6 +2772,26 @@ int main(int argc, char *argv[])
 		case 'm':
 			g.master_key_file = optarg;
 			break;
+		case 'L':
+			g.device_list = optarg;
+			break;
+		case 't':
+			g.crypttab = optarg;
+			break;
+		case 'j':
+			g.jobs = strtol(optarg, &endp, 0);
+			if (*optarg == '\0' || *endp != '\0' ||
+			    g.jobs <= 0 ||
+			    (g.jobs == LONG_MAX && errno == ERANGE)) {
+				warnx("Invalid value for '--jobs'|'-j': '%s'",
+				      optarg);
+				util_prg_print_parse_error();
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'J':
+			g.journal = optarg;
+			break;
 		case 'q':
 			g.batch_mode = true;
 			break;
@@ -2426,7 +2854,9 @@ int main(int argc, char *argv[])
 		crypt_set_debug_level(CRYPT_DEBUG_ALL);
 #endif
 
-	if (command->open_device) {
+	/* Multiple devices are opened by the command itself */
+	if (command->open_device && g.device_list == NULL &&
+	    g.crypttab == NULL) {
 		if (g.pos_arg == NULL) {
 			misc_print_required_parm(command->pos_arg);
 			rc = EXIT_FAILURE;
@@ -2448,6 +2878,10 @@ int main(int argc, char *argv[])
 out:
 	if (g.cca.lib_csulcca)
 		dlclose(g.cca.lib_csulcca);
+	if (g.ep11.lib_ep11) {
+		free_ep11_targets(&g.ep11);
+		dlclose(g.ep11.lib_ep11);
+	}
 	if (g.pkey_fd >= 0)
 		close(g.pkey_fd);
 	if (g.cd)
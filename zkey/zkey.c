@@ -27,6 +27,7 @@
 #include "lib/util_prg.h"
 #include "lib/zt_common.h"
 
+#include "bench.h"
 #include "cca.h"
 #include "ep11.h"
 #include "keystore.h"
@@ -90,6 +91,8 @@ static struct zkey_globals {
 	bool open;
 	bool format;
 	bool refresh_properties;
+	long int jobs;
+	long int count;
 	struct ext_lib lib;
 	struct cca_lib cca;
 	struct ep11_lib ep11;
@@ -122,6 +125,7 @@ static struct zkey_globals {
 #define COMMAND_CRYPTTAB	"crypttab"
 #define COMMAND_CRYPTSETUP	"cryptsetup"
 #define COMMAND_CONVERT		"convert"
+#define COMMAND_BENCH		"bench"
 #define COMMAND_KMS		"kms"
 #define COMMAND_KMS_PLUGINS	"plugins"
 #define COMMAND_KMS_BIND	"bind"
@@ -156,6 +160,7 @@ static struct zkey_globals {
 #define OPT_NO_APQN_CHECK		262
 #define OPT_NO_VOLUME_CHECK		263
 #define OPT_REFRESH_PROPERTIES		264
+#define OPT_BENCH_COUNT			265
 
 /*
  * Configuration of command line options
@@ -338,6 +343,17 @@ static struct util_opt opt_vec[] = {
 			"associated with specific crypto cards",
 		.command = COMMAND_REENCIPHER,
 	},
+	{
+		.option = { "jobs", required_argument, NULL, 'j'},
+		.argument = "NUMBER",
+		.desc = "Number of keys in the repository that are "
+			"re-enciphered in parallel. The keys are distributed "
+			"across the associated APQNs. Keys that are "
+			"successfully re-enciphered are recorded, so that a "
+			"repeated run with the same options skips them after "
+			"an interruption or failure",
+		.command = COMMAND_REENCIPHER,
+	},
 	/***********************************************************/
 	{
 		.flags = UTIL_OPT_FLAG_SECTION,
@@ -863,6 +879,60 @@ static struct util_opt opt_vec[] = {
 		.command = COMMAND_CONVERT,
 	},
 	/***********************************************************/
+	{
+		.flags = UTIL_OPT_FLAG_SECTION,
+		.desc = "OPTIONS",
+		.command = COMMAND_BENCH,
+	},
+	{
+		.option = { "apqns", required_argument, NULL, 'a'},
+		.argument = "CARD.DOMAIN[,...]",
+		.desc = "Comma-separated pairs of crypto cards and domains "
+			"that are to be measured. When this option is omitted, "
+			"all online APQNs of the matching type are measured",
+		.command = COMMAND_BENCH,
+	},
+	{
+		.option = { "key-type", required_argument, NULL, 'K'},
+		.argument = "type",
+		.desc = "The type of the secure keys used for the "
+			"measurement. Possible values are '"
+			KEY_TYPE_CCA_AESDATA"', '"KEY_TYPE_CCA_AESCIPHER"' "
+			"and '"KEY_TYPE_EP11_AES"'. When this option is "
+			"omitted, the default is '"KEY_TYPE_CCA_AESDATA"'",
+		.command = COMMAND_BENCH,
+	},
+	{
+		.option = { "keybits", required_argument, NULL, 'k'},
+		.argument = "SIZE",
+		.desc = "Size of the AES keys used for the measurement in "
+			"bits. Default is 256 bits",
+		.command = COMMAND_BENCH,
+	},
+	{
+		.option = {"xts", 0, NULL, 'x'},
+		.desc = "Use secure AES keys for the XTS cipher mode",
+		.command = COMMAND_BENCH,
+	},
+	{
+		.option = { "jobs", required_argument, NULL, 'j'},
+		.argument = "NUMBER",
+		.desc = "Maximum number of operations that are run in "
+			"parallel per APQN. Each operation is measured with "
+			"1, 2, 4, and so on up to NUMBER parallel jobs. "
+			"Default is 4",
+		.command = COMMAND_BENCH,
+	},
+	{
+		.option = { "count", required_argument, NULL,
+			    OPT_BENCH_COUNT},
+		.argument = "NUMBER",
+		.desc = "Number of operations that each parallel job "
+			"performs. Default is 100",
+		.command = COMMAND_BENCH,
+		.flags = UTIL_OPT_FLAG_NOSHORT,
+	},
+	/***********************************************************/
 	{
 		.flags = UTIL_OPT_FLAG_SECTION,
 		.desc = "OPTIONS",
@@ -1181,6 +1251,7 @@ static int command_copy(void);
 static int command_crypttab(void);
 static int command_cryptsetup(void);
 static int command_convert(void);
+static int command_bench(void);
 static int command_kms_plugins(void);
 static int command_kms_bind(void);
 static int command_kms_unbind(void);
@@ -1461,6 +1532,18 @@ static struct zkey_command zkey_commands[] = {
 		.pos_arg = "[SECURE-KEY-FILE]",
 		.pos_arg_optional = 1,
 	},
+	{
+		.command = COMMAND_BENCH,
+		.abbrev_len = 2,
+		.function = command_bench,
+		.need_pkey_device = 1,
+		.short_desc = "Measure secure AES key operations",
+		.long_desc = "Measure the throughput and latencies of "
+			     "generating, validating, and re-enciphering "
+			     "secure AES keys, and of generating their "
+			     "verification patterns, per APQN",
+		.has_options = 1,
+	},
 	{
 		.command = COMMAND_KMS,
 		.abbrev_len = 2,
@@ -1792,6 +1875,12 @@ static int command_reencipher_file(void)
 		util_prg_print_parse_error();
 		return EXIT_FAILURE;
 	}
+	if (g.jobs > 0) {
+		warnx("Option '--jobs|-j' is not valid for "
+		      "re-enciphering a key outside of the repository");
+		util_prg_print_parse_error();
+		return EXIT_FAILURE;
+	}
 
 	/* Read the secure key to be re-enciphered */
 	secure_key = read_secure_key(g.pos_arg, &secure_key_size, g.verbose);
@@ -1934,7 +2023,7 @@ static int command_reencipher_repository(void)
 
 	rc = keystore_reencipher_key(g.keystore, g.name, g.apqns, g.fromold,
 				     g.tonew, g.inplace, g.staged, g.complete,
-				     g.pkey_fd, &g.lib);
+				     g.pkey_fd, &g.lib, g.jobs);
 
 	return rc != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -2496,6 +2585,30 @@ static int command_convert(void)
 	return EXIT_SUCCESS;
 }
 
+/*
+ * Command handler for 'bench'.
+ *
+ * Measures secure key operations per APQN
+ */
+static int command_bench(void)
+{
+	int rc;
+
+	if (g.key_type == NULL)
+		g.key_type = KEY_TYPE_CCA_AESDATA;
+	if (get_min_card_level_for_keytype(g.key_type) < 0) {
+		warnx("Invalid key-type specified: %s", g.key_type);
+		return EXIT_FAILURE;
+	}
+
+	rc = bench_secure_keys(g.pkey_fd, g.apqns, g.key_type, g.keybits,
+			       g.xts, g.jobs > 0 ? g.jobs : BENCH_DEFAULT_JOBS,
+			       g.count > 0 ? g.count : BENCH_DEFAULT_COUNT,
+			       g.verbose);
+
+	return rc != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 /*
  * Command handler for 'kms plugins'.
  *
@@ -2927,6 +3040,28 @@ int main(int argc, char *argv[])
 		case 'c':
 			g.clearkeyfile = optarg;
 			break;
+		case 'j':
+			g.jobs = strtol(optarg, &endp, 0);
+			if (*optarg == '\0' || *endp != '\0' ||
+			    g.jobs <= 0 || g.jobs > UINT_MAX ||
+			    (g.jobs == LONG_MAX && errno == ERANGE)) {
+				warnx("Invalid value for '--jobs'|'-j': "
+				      "'%s'", optarg);
+				util_prg_print_parse_error();
+				return EXIT_FAILURE;
+			}
+			break;
+		case OPT_BENCH_COUNT:
+			g.count = strtol(optarg, &endp, 0);
+			if (*optarg == '\0' || *endp != '\0' ||
+			    g.count <= 0 ||
+			    (g.count == LONG_MAX && errno == ERANGE)) {
+				warnx("Invalid value for '--count': '%s'",
+				      optarg);
+				util_prg_print_parse_error();
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'f':
 			g.outputfile = optarg;
 			break;
@@ -3135,14 +3270,21 @@ int main(int argc, char *argv[])
 
 	umask(0077);
 
+	/* The state of the APQNs does not change while a command runs */
+	sysfs_cache_apqn_state(true);
+
 	rc = cmd->function();
 
+	sysfs_cache_apqn_state(false);
+
 out:
 	free_kms_plugin(&g.kms_info);
 	if (g.cca.lib_csulcca)
 		dlclose(g.cca.lib_csulcca);
-	if (g.ep11.lib_ep11)
+	if (g.ep11.lib_ep11) {
+		free_ep11_targets(&g.ep11);
 		dlclose(g.ep11.lib_ep11);
+	}
 	if (g.pkey_fd >= 0)
 		close(g.pkey_fd);
 	if (g.keystore)